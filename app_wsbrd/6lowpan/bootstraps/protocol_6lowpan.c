@@ -22,6 +22,7 @@
 #include "common/rand.h"
 #include "common/log_legacy.h"
 #include "common/endian.h"
+#include "common/ws/ws_neigh.h"
 
 #include "6lowpan/fragmentation/cipv6_fragmenter.h"
 #include "6lowpan/iphc_decode/cipv6.h"
@@ -169,6 +170,13 @@ static bool protocol_6lowpan_map_ip_to_link_addr(struct net_if *cur, const uint8
             memcpy(&ll_addr[2], &ip_addr[8], 8);
             ll_addr[2] ^= 2;
         }
+    } else if (!addr_is_ipv6_multicast(ip_addr)) {
+        /* Wi-SUN nodes derive their addresses from their EUI-64, so the MAC of
+         * a known neighbor is found without waiting for a registration */
+        memcpy(&ll_addr[2], &ip_addr[8], 8);
+        ll_addr[2] ^= 2;
+        if (ws_neigh_get(&cur->ws_info.neighbor_storage, &ll_addr[2]))
+            *ll_type = ADDR_802_15_4_LONG;
     }
 
     if (*ll_type != ADDR_NONE) {
@@ -28,10 +28,14 @@
 #include <inttypes.h>
 #include "common/rand.h"
 #include "common/log_legacy.h"
+#include "common/bits.h"
 #include "common/endian.h"
 #include "common/memutils.h"
+#include "common/fnv_hash.h"
+#include "common/mathutils.h"
 
 #include "net/protocol.h"
+#include "net/timers.h"
 #include "6lowpan/iphc_decode/cipv6.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "6lowpan/iphc_decode/iphc_decompress.h"
@@ -41,6 +45,16 @@
 
 #define TRACE_GROUP "6frg"
 
+/*
+ * Sessions are indexed by a hash of (source, tag, size), so that a fragment
+ * does not need to walk all the ongoing sessions. Reassembly buffers only
+ * cover the data received so far and grow as fragments arrive. The memory
+ * used by all the reassembly buffers is bounded: the oldest sessions are
+ * dropped to make room for new data when the limit is reached.
+ */
+#define REASSEMBLY_HASH_SIZE 16
+#define REASSEMBLY_MEM_MAX   (16 * 1024)
+
 typedef struct reassembly_entry {
     uint16_t ttl;   /*!< Reassembly timer (seconds) */
     uint16_t tag;   /*!< Fragmentation datagram TAG ID */
@@ -49,22 +63,32 @@ typedef struct reassembly_entry {
     uint16_t frag_max;  /*!< Maximum fragment size (MAC payload) */
     uint16_t offset; /*!< Data offset from datagram start */
     int16_t pattern; /*!< Size of compressed LoWPAN headers */
+    uint16_t capacity; /*!< Datagram bytes available in buf */
+    uint8_t bucket; /*!< Index in reassembly_interface.hash */
+    bool rfrag; /*!< RFC 8931 session, size is 0 until the first fragment */
+    uint32_t rfrag_bitmap; /*!< Sequences received */
+    uint16_t rfrag_len; /*!< Bytes received */
+    uint16_t rfrag_end; /*!< End of the furthest fragment received */
     buffer_t *buf;
     ns_list_link_t      link; /*!< List link entry */
+    ns_list_link_t      hash_link; /*!< Hash bucket link entry */
 } reassembly_entry_t;
 
 typedef NS_LIST_HEAD(reassembly_entry_t, link) reassembly_list_t;
+typedef NS_LIST_HEAD(reassembly_entry_t, hash_link) reassembly_hash_list_t;
 
 typedef struct reassembly_interface {
     int8_t interface_id;
     uint16_t timeout;
-    reassembly_list_t rx_list;
+    reassembly_list_t rx_list; /*!< Ongoing sessions, newest first */
     reassembly_list_t free_list;
+    reassembly_hash_list_t hash[REASSEMBLY_HASH_SIZE];
     reassembly_entry_t *entry_pointer_buffer;
     ns_list_link_t      link; /*!< List link entry */
 } reassembly_interface_t;
 
 static NS_LIST_DEFINE(reassembly_interface_list, reassembly_interface_t, link);
+static struct cipv6_frag_stats reassembly_stats;
 
 
 /* Reassembly structures and helpers - basically the same as in
@@ -214,18 +238,36 @@ static reassembly_interface_t *reassembly_interface_discover(int8_t interfaceId)
 static void reassembly_entry_free(reassembly_interface_t *interface_ptr, reassembly_entry_t *entry)
 {
     ns_list_remove(&interface_ptr->rx_list, entry);
+    ns_list_remove(&interface_ptr->hash[entry->bucket], entry);
     ns_list_add_to_start(&interface_ptr->free_list, entry);
     if (entry->buf) {
+        reassembly_stats.mem_used -= entry->buf->size;
         entry->buf = buffer_free(entry->buf);
     }
 }
 
-static reassembly_entry_t *reassembly_already_action(reassembly_list_t *reassembly_list,
+static uint8_t reassembly_hash(const buffer_t *buf, uint16_t tag, uint16_t size)
+{
+    uint8_t key[4];
+    uint32_t hash;
+
+    write_be16(key, tag);
+    write_be16(key + 2, size);
+    /* Type will be either long or short 802.15.4 - we skip the PAN ID */
+    hash = fnv_hash_reverse_32_init(buf->src_sa.address + 2, addr_len_from_type(buf->src_sa.addr_type) - 2);
+    hash = fnv_hash_reverse_32_update(key, sizeof(key), hash);
+    return hash % REASSEMBLY_HASH_SIZE;
+}
+
+// RFRAG sessions are only identified by their tag, and are hashed with a size
+// of 0.
+static reassembly_entry_t *reassembly_already_action(reassembly_hash_list_t *reassembly_list,
                                                      const buffer_t *buf,
-                                                     uint16_t tag, uint16_t size)
+                                                     uint16_t tag, uint16_t size, bool rfrag)
 {
     ns_list_foreach(reassembly_entry_t, reassembly_entry, reassembly_list) {
-        if ((reassembly_entry->tag == tag) && (reassembly_entry->size == size) &&
+        if (reassembly_entry->rfrag == rfrag && reassembly_entry->tag == tag &&
+                (rfrag || reassembly_entry->size == size) &&
                 reassembly_entry->buf->src_sa.addr_type == buf->src_sa.addr_type &&
                 reassembly_entry->buf->dst_sa.addr_type == buf->dst_sa.addr_type) {
             /* Type will be either long or short 802.15.4 - we skip the PAN ID */
@@ -240,51 +282,119 @@ static reassembly_entry_t *reassembly_already_action(reassembly_list_t *reassemb
 
 }
 
-static reassembly_entry_t *lowpan_adaptation_reassembly_get(reassembly_interface_t *interface_ptr)
+static reassembly_entry_t *lowpan_adaptation_reassembly_get(reassembly_interface_t *interface_ptr, uint8_t bucket)
 {
     reassembly_entry_t *entry = ns_list_get_first(&interface_ptr->free_list);
     if (!entry) {
-        return NULL;
+        // Reuse the oldest session
+        entry = ns_list_get_last(&interface_ptr->rx_list);
+        if (!entry)
+            return NULL;
+        tr_debug("Reassembly evicted: src %s size %u",
+                 trace_sockaddr(&entry->buf->src_sa, true), entry->size);
+        reassembly_stats.evict_count++;
+        reassembly_entry_free(interface_ptr, entry);
     }
 
     ns_list_remove(&interface_ptr->free_list, entry);
     memset(entry, 0, sizeof(reassembly_entry_t));
     //Add to first
     ns_list_add_to_start(&interface_ptr->rx_list, entry);
+    if (!g_timers[WS_TIMER_CIPV6_FRAG].timeout)
+        ws_timer_start(WS_TIMER_CIPV6_FRAG);
+    entry->bucket = bucket;
+    ns_list_add_to_start(&interface_ptr->hash[bucket], entry);
 
     return entry;
 }
 
-
-buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
+/*
+ * Make sure the reassembly buffer of entry covers the datagram up to
+ * fragment_last. Room is also needed for the hole descriptor following the
+ * fragment, so the capacity is rounded up to the next multiple of 8 past
+ * fragment_last + 1 (or to the datagram size rounded up to 8, as before lazy
+ * allocation).
+ *
+ * The oldest sessions are dropped if the memory limit is reached. Returns
+ * false if entry itself had to be dropped.
+ */
+static bool reassembly_entry_reserve(reassembly_interface_t *interface_ptr, reassembly_entry_t *entry,
+                                     uint16_t fragment_last)
 {
-    reassembly_interface_t *interface_ptr = reassembly_interface_discover(interface_id);
-    if (!interface_ptr) {
-        return buffer_free(buf);
+    uint16_t size = entry->size ? entry->size : LOWPAN_HARD_MTU_LIMIT;
+    uint16_t capacity = MIN((size + 7) & ~7, (fragment_last + 1 + 7 + 7) & ~7);
+    buffer_t *buf;
+
+    if (entry->buf && capacity <= entry->capacity)
+        return true;
+
+    // Allow 1 byte extra for an "Uncompressed IPv6" dispatch byte - the
+    // 6LoWPAN data can be 1 byte longer than the IPv6 data.
+    buf = buffer_get(1 + capacity);
+    while (reassembly_stats.mem_used + buf->size > REASSEMBLY_MEM_MAX) {
+        reassembly_entry_t *oldest = ns_list_get_last(&interface_ptr->rx_list);
+
+        if (oldest == entry) {
+            tr_debug("Reassembly out of memory: size %u", entry->size);
+            reassembly_stats.drop_count++;
+            buffer_free(buf);
+            reassembly_entry_free(interface_ptr, entry);
+            return false;
+        }
+        tr_debug("Reassembly evicted: src %s size %u",
+                 trace_sockaddr(&oldest->buf->src_sa, true), oldest->size);
+        reassembly_stats.evict_count++;
+        reassembly_entry_free(interface_ptr, oldest);
+    }
+    reassembly_stats.mem_used += buf->size;
+    reassembly_stats.mem_used_max = MAX(reassembly_stats.mem_used, reassembly_stats.mem_used_max);
+
+    buffer_data_length_set(buf, 1 + capacity);
+    buffer_data_strip_header(buf, 1);
+    if (entry->buf) {
+        /* Keep metadata (copied from the first fragment), holes and data */
+        buffer_copy_metadata(buf, entry->buf, true);
+        memcpy(buffer_data_pointer(buf) - 1, buffer_data_pointer(entry->buf) - 1, 1 + entry->capacity);
+        reassembly_stats.mem_used -= entry->buf->size;
+        buffer_free(entry->buf);
+        reassembly_stats.grow_count++;
     }
+    entry->buf = buf;
+    entry->capacity = capacity;
+    return true;
+}
 
+/*
+ * Add the fragment data[0:data_len] (starting with its FRAG header) to the
+ * matching reassembly, and return the datagram once it is complete. buf holds
+ * the link metadata of the fragment and is never consumed. For the first
+ * fragment, data must also be the data of buf since the IPHC header is scanned
+ * from it.
+ */
+static buffer_t *cipv6_frag_reassembly_data(reassembly_interface_t *interface_ptr, buffer_t *buf,
+                                            const uint8_t *data, uint16_t data_len)
+{
     uint16_t datagram_size, datagram_tag;
     uint16_t fragment_first;
     uint8_t frag_header;
 
-    uint8_t *ptr = buffer_data_pointer(buf);
+    const uint8_t *ptr = data;
 
-    if (buffer_data_length(buf) < 4)
-        goto reassembly_error;
+    if (data_len < 4)
+        return NULL;
 
     frag_header = ptr[0];
     datagram_size = read_be16(ptr) & 0x07FF;
 
-    if (datagram_size == 0) {
-        goto reassembly_error;
-    }
+    if (datagram_size == 0)
+        return NULL;
 
     ptr += 2;
     datagram_tag = read_be16(ptr);
     ptr += 2;
     if (frag_header & LOWPAN_FRAGN_BIT) {
-        if (buffer_data_length(buf) < 5)
-            goto reassembly_error;
+        if (data_len < 5)
+            return NULL;
         fragment_first = *ptr++ << 3;
     } else {
         fragment_first = 0;
@@ -293,43 +403,33 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
     /* Consume the fragment header. We don't distinguish FRAG1/FRAGN after this
      * point (we treat FRAGN with offset 0 the same as FRAG1)
      */
-    buffer_data_pointer_set(buf, ptr);
-    reassembly_entry_t *frag_ptr = reassembly_already_action(&interface_ptr->rx_list, buf, datagram_tag, datagram_size);
+    data_len -= ptr - data;
+    data = ptr;
+    if (fragment_first == 0) {
+        BUG_ON(data + data_len != buffer_data_end(buf));
+        buffer_data_pointer_set(buf, data);
+    }
+    uint8_t bucket = reassembly_hash(buf, datagram_tag, datagram_size);
+    reassembly_entry_t *frag_ptr = reassembly_already_action(&interface_ptr->hash[bucket], buf, datagram_tag, datagram_size, false);
 
     if (!frag_ptr) {
 
-        frag_ptr = lowpan_adaptation_reassembly_get(interface_ptr);
-        if (!frag_ptr) {
-            goto reassembly_error;
-        }
-
-        buffer_t *reassembly_buffer = buffer_get(1 + ((datagram_size + 7) & ~7));
-        if (!reassembly_buffer) {
-            //Put allocated back to free
-            reassembly_entry_free(interface_ptr, frag_ptr);
-            goto reassembly_error;
-        }
-
-        // Allocate the reassembly buffer.
-        // Allow 1 byte extra for an "Uncompressed IPv6" dispatch byte - the
-        // 6LoWPAN data can be 1 byte longer than the IPv6 data.
-        // Also, round datagram size up to a multiple of 8 to ensure we have
-        // room for a final hole descriptor (it can spill past the indicated
-        // datagram size if the last fragment is smaller than 8 bytes).
+        frag_ptr = lowpan_adaptation_reassembly_get(interface_ptr, bucket);
+        if (!frag_ptr)
+            return NULL;
 
-        reassembly_buffer->src_sa = buf->src_sa;
-        reassembly_buffer->dst_sa = buf->dst_sa;
         frag_ptr->ttl = interface_ptr->timeout;
         frag_ptr->tag = datagram_tag;
         frag_ptr->size = datagram_size;
-        // Set buffer length and adjust start pointer, so it represents the
+        // Allocate the reassembly buffer, its start pointer represents the
         // uncompressed IPv6 packet. (See comment block before this function).
-        buffer_data_length_set(reassembly_buffer, 1 + datagram_size);
-        buffer_data_strip_header(reassembly_buffer, 1);
+        if (!reassembly_entry_reserve(interface_ptr, frag_ptr, fragment_first + data_len - 1))
+            return NULL;
+        frag_ptr->buf->src_sa = buf->src_sa;
+        frag_ptr->buf->dst_sa = buf->dst_sa;
         // Write initial hole descriptor into buffer
         frag_ptr->offset = 0xffff;
-        create_hole(reassembly_buffer, 0, datagram_size - 1, &frag_ptr->offset);
-        frag_ptr->buf = reassembly_buffer;
+        create_hole(frag_ptr->buf, 0, datagram_size - 1, &frag_ptr->offset);
     }
 
     /* For the first link fragment, work out and remember the "pattern"
@@ -341,7 +441,7 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
         uint16_t uncompressed_header_size;
         uint8_t compressed_header_size;
         compressed_header_size = iphc_header_scan(buf, &uncompressed_header_size);
-        lowpan_size = buffer_data_length(buf);
+        lowpan_size = data_len;
         ipv6_size = lowpan_size - compressed_header_size + uncompressed_header_size;
         frag_ptr->pattern = ipv6_size - lowpan_size;
 
@@ -351,20 +451,22 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
         buffer_copy_metadata(frag_ptr->buf, buf, true);
         frag_ptr->buf->options.ll_security_bypass_rx = buf_security;
     } else {
-        ipv6_size = lowpan_size = buffer_data_length(buf);
+        ipv6_size = lowpan_size = data_len;
     }
 
     uint16_t fragment_last = fragment_first + ipv6_size - 1;
     // RFC4944: All link fragments for a datagram except the last one MUST be
     // multiples of eight bytes in length.
     if (ipv6_size % 8 && fragment_last + 1 != datagram_size)
-        goto reassembly_error;
+        return NULL;
     if (fragment_last >= datagram_size) {
         tr_error("Frag out-of-range: last=%u, size=%u", fragment_last, datagram_size);
         //Free Current entry
         reassembly_entry_free(interface_ptr, frag_ptr);
-        goto reassembly_error;
+        return NULL;
     }
+    if (!reassembly_entry_reserve(interface_ptr, frag_ptr, fragment_last))
+        return NULL;
 
     /* Hole-filling algorithm, basically as per RFC 815, but with added
      * checks for overlap. The hole list is kept sorted, as per
@@ -419,15 +521,12 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
     /* Hole list updated, can now copy in the fragment data -  to make sure the
      * initial fragment goes in the right place we use the end offset, rather
      * than the start offset. */
-    memcpy(buffer_data_pointer(frag_ptr->buf) + fragment_last + 1 - lowpan_size, buffer_data_pointer(buf), lowpan_size);
+    memcpy(buffer_data_pointer(frag_ptr->buf) + fragment_last + 1 - lowpan_size, data, lowpan_size);
 
     /* Combine the "improper security" flags, so reassembled buffer's flag is set if any fragment wasn't secure */
     /* XXX should have some sort of overall "merge buffer metadata" routine handling this and whatever else */
     frag_ptr->buf->options.ll_security_bypass_rx |= buf->options.ll_security_bypass_rx;
 
-    /* We've finished with the original fragment buffer */
-    buf = buffer_free(buf);
-
     /* Completion check - any holes left? */
     if (frag_ptr->offset != 0xffff) {
         /* Not yet complete - processing finished on this fragment */
@@ -436,8 +535,10 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
 
     /* No more holes, so our reassembly is complete */
     buf = frag_ptr->buf;
+    reassembly_stats.mem_used -= buf->size;
     frag_ptr->buf = NULL;
     reassembly_entry_free(interface_ptr, frag_ptr);
+    buffer_data_length_set(buf, datagram_size);
 
     /* Buffer start pointer is currently at the "start of uncompressed IPv6
      * packet" position. Move it either forwards or backwards to match
@@ -447,9 +548,138 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
     buf->buf_ptr += frag_ptr->pattern;
     buf->info = (buffer_info_t)(B_DIR_UP | B_FROM_FRAGMENTATION | B_TO_IPV6_TXRX);
     return buf;
+}
+
+/*
+ * RFC 8931 fragments are placed at their offset in the compressed datagram, so
+ * unlike RFC 4944 there is no need for the IPHC header to place them, and no
+ * hole list: the fragments must not overlap, so the datagram is complete once
+ * as many bytes as its size have been received. Fragments received before the
+ * first one (which carries the datagram size) are kept.
+ */
+static buffer_t *cipv6_frag_reassembly_rfrag_data(reassembly_interface_t *interface_ptr, buffer_t *buf,
+                                                  const uint8_t *data, uint16_t data_len,
+                                                  struct cipv6_rfrag_ack *ack)
+{
+    uint16_t datagram_size, fragment_first, fragment_size, hdr;
+    reassembly_entry_t *entry;
+    uint8_t bucket, seq;
+
+    if (data_len < LOWPAN_RFRAG_HDR_LEN)
+        return NULL;
+    hdr = read_be16(data + 2);
+    seq = FIELD_GET(LOWPAN_RFRAG_SEQ_MASK, hdr);
+    fragment_size = FIELD_GET(LOWPAN_RFRAG_SIZE_MASK, hdr);
+    if (seq) {
+        datagram_size = 0;
+        fragment_first = read_be16(data + 4);
+    } else {
+        datagram_size = read_be16(data + 4);
+        fragment_first = 0;
+    }
+    ack->tag = data[1];
+    ack->bitmap = LOWPAN_RFRAG_BITMAP_NULL;
+    ack->send = hdr & LOWPAN_RFRAG_X_MASK;
+    data += LOWPAN_RFRAG_HDR_LEN;
+    data_len -= LOWPAN_RFRAG_HDR_LEN;
 
-reassembly_error:
-    return buffer_free(buf);
+    if (!fragment_size || fragment_size != data_len)
+        return NULL;
+    if (fragment_first + fragment_size > LOWPAN_HARD_MTU_LIMIT)
+        return NULL;
+    if (!seq && (datagram_size < fragment_size || datagram_size > LOWPAN_HARD_MTU_LIMIT))
+        return NULL;
+
+    bucket = reassembly_hash(buf, ack->tag, 0);
+    entry = reassembly_already_action(&interface_ptr->hash[bucket], buf, ack->tag, 0, true);
+    if (!entry) {
+        entry = lowpan_adaptation_reassembly_get(interface_ptr, bucket);
+        if (!entry)
+            return NULL;
+        entry->ttl = interface_ptr->timeout;
+        entry->tag = ack->tag;
+        entry->rfrag = true;
+        if (!reassembly_entry_reserve(interface_ptr, entry, fragment_first + fragment_size - 1))
+            return NULL;
+        entry->buf->src_sa = buf->src_sa;
+        entry->buf->dst_sa = buf->dst_sa;
+    }
+
+    if (entry->rfrag_bitmap & LOWPAN_RFRAG_BITMAP(seq)) {
+        // Retransmission, the RFRAG-ACK was probably lost
+        ack->bitmap = entry->rfrag_bitmap;
+        return NULL;
+    }
+    if (!seq) {
+        bool buf_security = entry->buf->options.ll_security_bypass_rx;
+
+        entry->size = datagram_size;
+        buffer_copy_metadata(entry->buf, buf, true);
+        entry->buf->options.ll_security_bypass_rx = buf_security;
+    }
+    if (entry->size && MAX(entry->rfrag_end, fragment_first + fragment_size) > entry->size) {
+        tr_error("Frag out-of-range: last=%u, size=%u",
+                 MAX(entry->rfrag_end, fragment_first + fragment_size) - 1, entry->size);
+        reassembly_entry_free(interface_ptr, entry);
+        return NULL;
+    }
+    if (!reassembly_entry_reserve(interface_ptr, entry, fragment_first + fragment_size - 1))
+        return NULL;
+
+    memcpy(buffer_data_pointer(entry->buf) + fragment_first, data, fragment_size);
+    entry->buf->options.ll_security_bypass_rx |= buf->options.ll_security_bypass_rx;
+    entry->rfrag_bitmap |= LOWPAN_RFRAG_BITMAP(seq);
+    entry->rfrag_len += fragment_size;
+    entry->rfrag_end = MAX(entry->rfrag_end, fragment_first + fragment_size);
+    ack->bitmap = entry->rfrag_bitmap;
+
+    if (!entry->size || entry->rfrag_len < entry->size)
+        return NULL;
+
+    // The sender may be waiting for the end of a round which will not come if
+    // a fragment was duplicated, so the completion is always acknowledged.
+    ack->send = true;
+    ack->bitmap = LOWPAN_RFRAG_BITMAP_FULL;
+    buf = entry->buf;
+    reassembly_stats.mem_used -= buf->size;
+    entry->buf = NULL;
+    buffer_data_length_set(buf, entry->size);
+    reassembly_entry_free(interface_ptr, entry);
+    buf->info = (buffer_info_t)(B_DIR_UP | B_FROM_FRAGMENTATION | B_TO_IPV6_TXRX);
+    return buf;
+}
+
+buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
+{
+    reassembly_interface_t *interface_ptr = reassembly_interface_discover(interface_id);
+    buffer_t *datagram = NULL;
+
+    if (interface_ptr)
+        datagram = cipv6_frag_reassembly_data(interface_ptr, buf, buffer_data_pointer(buf), buffer_data_length(buf));
+    buffer_free(buf);
+    return datagram;
+}
+
+buffer_t *cipv6_frag_reassembly_fragn(int8_t interface_id, buffer_t *buf, const uint8_t *frag, uint16_t frag_len)
+{
+    reassembly_interface_t *interface_ptr = reassembly_interface_discover(interface_id);
+
+    BUG_ON(!cipv6_frag_is_fragn(frag, frag_len));
+    if (!interface_ptr)
+        return NULL;
+    return cipv6_frag_reassembly_data(interface_ptr, buf, frag, frag_len);
+}
+
+buffer_t *cipv6_frag_reassembly_rfrag(int8_t interface_id, buffer_t *buf, const uint8_t *frag, uint16_t frag_len,
+                                      struct cipv6_rfrag_ack *ack)
+{
+    reassembly_interface_t *interface_ptr = reassembly_interface_discover(interface_id);
+
+    BUG_ON(!cipv6_frag_is_rfrag(frag, frag_len));
+    memset(ack, 0, sizeof(*ack));
+    if (!interface_ptr)
+        return NULL;
+    return cipv6_frag_reassembly_rfrag_data(interface_ptr, buf, frag, frag_len, ack);
 }
 
 static void reassembly_entry_timer_update(reassembly_interface_t *interface_ptr, uint16_t seconds)
@@ -461,6 +691,7 @@ static void reassembly_entry_timer_update(reassembly_interface_t *interface_ptr,
             tr_debug("Reassembly TO: src %s size %u",
                      trace_sockaddr(&reassembly_entry->buf->src_sa, true),
                      reassembly_entry->size);
+            reassembly_stats.timeout_count++;
             reassembly_entry_free(interface_ptr, reassembly_entry);
         }
     }
@@ -468,9 +699,15 @@ static void reassembly_entry_timer_update(reassembly_interface_t *interface_ptr,
 
 void cipv6_frag_timer(int seconds)
 {
+    bool pending = false;
+
     ns_list_foreach(reassembly_interface_t, interface_ptr, &reassembly_interface_list) {
         reassembly_entry_timer_update(interface_ptr, seconds);
+        pending |= !ns_list_is_empty(&interface_ptr->rx_list);
     }
+    // Restarted by lowpan_adaptation_reassembly_get()
+    if (!pending)
+        ws_timer_stop(WS_TIMER_CIPV6_FRAG);
 }
 
 int8_t reassembly_interface_free(int8_t interface_id)
@@ -482,6 +719,8 @@ int8_t reassembly_interface_free(int8_t interface_id)
     }
 
     ns_list_remove(&reassembly_interface_list, interface_ptr);
+    ns_list_foreach_safe(reassembly_entry_t, entry, &interface_ptr->rx_list)
+        reassembly_entry_free(interface_ptr, entry);
 
     //Free Dynamic allocated entry buffer
     free(interface_ptr->entry_pointer_buffer);
@@ -503,6 +742,8 @@ void reassembly_interface_init(int8_t interface_id, uint8_t reassembly_session_l
     interface_ptr->entry_pointer_buffer = reassemply_ptr;
     ns_list_init(&interface_ptr->free_list);
     ns_list_init(&interface_ptr->rx_list);
+    for (int i = 0; i < REASSEMBLY_HASH_SIZE; i++)
+        ns_list_init(&interface_ptr->hash[i]);
 
     for (uint8_t i = 0; i < reassembly_session_limit ; i++) {
         ns_list_add_to_end(&interface_ptr->free_list, reassemply_ptr);
@@ -511,3 +752,17 @@ void reassembly_interface_init(int8_t interface_id, uint8_t reassembly_session_l
 
     ns_list_add_to_end(&reassembly_interface_list, interface_ptr);
 }
+
+const struct cipv6_frag_stats *cipv6_frag_stats(void)
+{
+    return &reassembly_stats;
+}
+
+int cipv6_frag_session_count(void)
+{
+    int count = 0;
+
+    ns_list_foreach(reassembly_interface_t, interface_ptr, &reassembly_interface_list)
+        count += ns_list_count(&interface_ptr->rx_list);
+    return count;
+}
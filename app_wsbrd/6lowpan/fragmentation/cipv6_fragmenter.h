@@ -17,14 +17,62 @@
  */
 #ifndef CIPV6_FRAGMENTER_H
 #define CIPV6_FRAGMENTER_H
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "6lowpan/iphc_decode/cipv6.h"
+
 struct buffer;
+
+struct cipv6_frag_stats {
+    unsigned int mem_used;      // Bytes allocated for reassembly buffers
+    unsigned int mem_used_max;
+    unsigned int grow_count;    // Reassembly buffer reallocations
+    unsigned int evict_count;   // Sessions dropped to make room for new ones
+    unsigned int drop_count;    // Sessions dropped because of the memory limit
+    unsigned int timeout_count;
+};
+
 void reassembly_interface_init(int8_t interface_id, uint8_t reassembly_session_limit, uint16_t reassembly_timeout);
 int8_t reassembly_interface_free(int8_t interface_id);
 
 void cipv6_frag_timer(int seconds);
 struct buffer *cipv6_frag_reassembly(int8_t interface_id, struct buffer *buf);
+const struct cipv6_frag_stats *cipv6_frag_stats(void);
+int cipv6_frag_session_count(void);
+
+// True for a FRAGN fragment with a non-zero offset. Such fragments do not need
+// any 6LoWPAN processing besides reassembly.
+static inline bool cipv6_frag_is_fragn(const uint8_t *frag, uint16_t frag_len)
+{
+    return frag_len >= 5 && (frag[0] & LOWPAN_FRAG_MASK) == LOWPAN_FRAG &&
+           (frag[0] & LOWPAN_FRAGN_BIT) && frag[4];
+}
+
+// Same as cipv6_frag_reassembly() for fragments matching cipv6_frag_is_fragn(),
+// except that the fragment is read from frag instead of buf. This allows to
+// copy the fragment directly from the MAC indication into the reassembly
+// buffer. buf only carries the link metadata and is not consumed.
+struct buffer *cipv6_frag_reassembly_fragn(int8_t interface_id, struct buffer *buf,
+                                           const uint8_t *frag, uint16_t frag_len);
+
+// RFRAG-ACK to send in response to an RFRAG (RFC 8931)
+struct cipv6_rfrag_ack {
+    bool send;
+    uint8_t tag;
+    uint32_t bitmap;
+};
+
+static inline bool cipv6_frag_is_rfrag(const uint8_t *frag, uint16_t frag_len)
+{
+    return frag_len >= 1 && (frag[0] & LOWPAN_RFRAG_MASK) == LOWPAN_RFRAG;
+}
+
+// Same as cipv6_frag_reassembly_fragn() for RFC 8931 fragments. ack is filled
+// with the RFRAG-ACK to send back to the source of buf, if any.
+struct buffer *cipv6_frag_reassembly_rfrag(int8_t interface_id, struct buffer *buf,
+                                           const uint8_t *frag, uint16_t frag_len,
+                                           struct cipv6_rfrag_ack *ack);
 
 
 
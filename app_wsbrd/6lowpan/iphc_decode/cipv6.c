@@ -16,11 +16,24 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include "common/ipv6/6lorh.h"
 #include "common/log_legacy.h"
 #include "common/endian.h"
+#include "common/iobuf.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/specs/icmpv6.h"
+#include "common/specs/ip.h"
+#include "common/specs/ipv6.h"
+#include "common/time_extra.h"
+#include "common/work_pool.h"
 
+#include "app/wsbr_metrics.h"
 #include "ipv6/ipv6.h"
 #include "ipv6/ipv6_resolution.h"
 #include "net/protocol.h"
@@ -33,6 +46,197 @@
 
 #define TRACE_GROUP  "iphc"
 
+// ICMPv6 messages other than echo carry ND, RPL, or errors, which are not
+// expected to queue up behind data traffic. Other packets are sorted using
+// their DSCP.
+static enum buffer_tx_lane lowpan_tx_lane(const buffer_t *buf)
+{
+    const uint8_t *ptr = buffer_data_pointer(buf);
+    uint16_t len = buffer_data_length(buf);
+    uint16_t offset = 40;
+    uint8_t dscp;
+    uint8_t nh;
+
+    if (len < offset)
+        return BUFFER_TX_LANE_DATA_LOW;
+    dscp = (((ptr[0] << 4) | (ptr[1] >> 4)) & IP_TCLASS_DSCP_MASK) >> IP_TCLASS_DSCP_SHIFT;
+    nh = ptr[6];
+    if (nh == IPV6_NH_HOP_BY_HOP && len >= offset + 2) {
+        nh = ptr[offset];
+        offset += (ptr[offset + 1] + 1) * 8;
+    }
+    if (nh == IPV6_NH_ICMPV6 && len > offset &&
+        ptr[offset] != ICMPV6_TYPE_ECHO_REQUEST && ptr[offset] != ICMPV6_TYPE_ECHO_REPLY)
+        return BUFFER_TX_LANE_CONTROL;
+    return dscp >= IP_DSCP_CS4 ? BUFFER_TX_LANE_DATA_HIGH : BUFFER_TX_LANE_DATA_LOW;
+}
+
+/*
+ * With RFC 8138 enabled, the RPL Source Routing Header inserted by the root is
+ * replaced by SRH-6LoRHs, placed after a Page 1 dispatch before the IPHC
+ * header. The IPv6 destination then becomes the final destination.
+ *
+ * Header compression only depends on the packet and on a few parameters of
+ * the interface copied in struct lowpan_cmpr, so lowpan_cmpr_run() can run on
+ * a worker thread (see lowpan_down_workers_init()). lowpan_cmpr_apply() then
+ * updates the buffer on the main thread, since buffers are not allocated nor
+ * freed elsewhere.
+ */
+struct lowpan_cmpr {
+    struct work_item item;
+    buffer_t *buf;
+    struct in6_addr root;
+    bool compress_6lorh;
+    uint16_t max_iphc_size;
+    struct iobuf_write lorh;
+    int lorh_ret;         // See lowpan_6lorh_srh_cmpr(), -EMSGSIZE if too large
+    uint8_t *hc;
+    int hc_len;           // See iphc_compress_hdr()
+    uint16_t hc_consumed;
+};
+
+// Each worker has its own thread, and packets are dispatched by link-layer
+// destination, so packets to a neighbor are never reordered.
+static struct {
+    struct work_pool *pools;
+    int count;
+    unsigned int inflight;
+} g_lowpan_workers;
+
+static void lowpan_cmpr_run(struct lowpan_cmpr *cmpr)
+{
+    buffer_t *buf = cmpr->buf;
+    uint16_t max_iphc_size = cmpr->max_iphc_size;
+    uint8_t *pkt = buffer_data_pointer(buf);
+    uint16_t len = buffer_data_length(buf);
+
+    if (cmpr->compress_6lorh) {
+        cmpr->lorh_ret = lowpan_6lorh_srh_cmpr(&cmpr->lorh, pkt, len, &cmpr->root);
+        if (cmpr->lorh_ret < 0)
+            return;
+        if (cmpr->lorh_ret && cmpr->lorh.len + 1 >= max_iphc_size) {
+            cmpr->lorh_ret = -EMSGSIZE;
+            return;
+        }
+        if (cmpr->lorh_ret) {
+            pkt += cmpr->lorh_ret;
+            len -= cmpr->lorh_ret;
+            max_iphc_size -= cmpr->lorh.len + 1;
+        }
+    }
+    /* No point allocating excessively */
+    max_iphc_size = MIN(max_iphc_size, len);
+    cmpr->hc = xalloc(max_iphc_size);
+    cmpr->hc_len = iphc_compress_hdr(pkt, len, &buf->src_sa, &buf->dst_sa,
+                                     cmpr->hc, max_iphc_size, &cmpr->hc_consumed);
+}
+
+static buffer_t *lowpan_cmpr_apply(struct lowpan_cmpr *cmpr)
+{
+    buffer_t *buf = cmpr->buf;
+    uint8_t *ptr;
+
+    if (cmpr->lorh_ret == -EMSGSIZE) {
+        TRACE(TR_DROP, "drop %-9s: 6LoRH too large", "6lowpan");
+        goto drop;
+    }
+    if (cmpr->lorh_ret < 0) {
+        TRACE(TR_DROP, "drop %-9s: malformed routing header", "6lowpan");
+        goto drop;
+    }
+    if (cmpr->hc_len < 0)
+        goto drop;
+    // 6LoRHs must be followed by an IPHC header
+    if (!cmpr->hc_len && cmpr->lorh_ret) {
+        TRACE(TR_DROP, "drop %-9s: IPHC compression failed", "6lowpan");
+        goto drop;
+    }
+    buffer_data_strip_header(buf, cmpr->lorh_ret);
+    if (cmpr->hc_len) {
+        buffer_data_strip_header(buf, cmpr->hc_consumed);
+        memcpy(buffer_data_reserve_header(buf, cmpr->hc_len), cmpr->hc, cmpr->hc_len);
+    } else {
+        /* Fall back to uncompressed, which means adding a dispatch byte */
+        buf = buffer_headroom(buf, 1);
+        if (buf) {
+            ptr = buffer_data_reserve_header(buf, 1);
+            *ptr = LOWPAN_DISPATCH_IPV6;
+        }
+    }
+    if (buf && cmpr->lorh_ret)
+        buf = buffer_headroom(buf, cmpr->lorh.len + 1);
+    if (buf && cmpr->lorh_ret) {
+        ptr = buffer_data_reserve_header(buf, cmpr->lorh.len + 1);
+        ptr[0] = LOWPAN_6LORH_PAGE1;
+        memcpy(ptr + 1, cmpr->lorh.data, cmpr->lorh.len);
+    }
+    free(cmpr->hc);
+    iobuf_free(&cmpr->lorh);
+    return buf;
+
+drop:
+    free(cmpr->hc);
+    iobuf_free(&cmpr->lorh);
+    return buffer_free(buf);
+}
+
+static buffer_t *lowpan_down_finish(buffer_t *buf)
+{
+    if (!buf)
+        return NULL;
+    buf->tx_stage_us[BUFFER_TX_STAGE_IPHC] = time_now_us(CLOCK_MONOTONIC);
+    wsbr_metrics_tx_latency(WSBR_TX_LATENCY_IPV6, buf->tx_stage_us[BUFFER_TX_STAGE_TUN],
+                            buf->tx_stage_us[BUFFER_TX_STAGE_LOWPAN]);
+    wsbr_metrics_tx_latency(WSBR_TX_LATENCY_LOWPAN, buf->tx_stage_us[BUFFER_TX_STAGE_LOWPAN],
+                            buf->tx_stage_us[BUFFER_TX_STAGE_IPHC]);
+
+    buf->info = (buffer_info_t)(B_FROM_IPV6_TXRX | B_TO_MAC | B_DIR_DOWN);
+
+    return buf;
+}
+
+static void lowpan_cmpr_work(struct work_pool *pool, struct work_item *item)
+{
+    lowpan_cmpr_run(container_of(item, struct lowpan_cmpr, item));
+}
+
+static void lowpan_cmpr_done(struct work_pool *pool, struct work_item *item)
+{
+    struct lowpan_cmpr *cmpr = container_of(item, struct lowpan_cmpr, item);
+    buffer_t *buf;
+
+    buf = lowpan_cmpr_apply(cmpr);
+    g_lowpan_workers.inflight--;
+    free(cmpr);
+    protocol_push(lowpan_down_finish(buf));
+}
+
+static void lowpan_cmpr_submit(struct lowpan_cmpr *cmpr)
+{
+    const sockaddr_t *dst = &cmpr->buf->dst_sa;
+    unsigned int hash = 0;
+
+    for (int i = 0; i < 10; i++)
+        hash = hash * 31 + dst->address[i];
+    cmpr->item.work = lowpan_cmpr_work;
+    cmpr->item.done = lowpan_cmpr_done;
+    g_lowpan_workers.inflight++;
+    work_pool_submit(&g_lowpan_workers.pools[hash % g_lowpan_workers.count], &cmpr->item);
+}
+
+void lowpan_down_workers_init(int count)
+{
+    g_lowpan_workers.pools = zalloc(count * sizeof(*g_lowpan_workers.pools));
+    g_lowpan_workers.count = count;
+    for (int i = 0; i < count; i++)
+        work_pool_init(&g_lowpan_workers.pools[i], 1);
+}
+
+bool lowpan_down_busy(void)
+{
+    return g_lowpan_workers.inflight >= LOWPAN_DOWN_INFLIGHT_MAX;
+}
+
 /* Input: Final IP packet for transmission on link.
  *        Buffer destination = final destination
  *        Buffer source undefined.
@@ -42,8 +246,11 @@
  */
 buffer_t *lowpan_down(buffer_t *buf)
 {
+    struct lowpan_cmpr cmpr_local = { };
     struct net_if *cur = buf->interface;
+    struct lowpan_cmpr *cmpr;
 
+    buf->tx_stage_us[BUFFER_TX_STAGE_LOWPAN] = time_now_us(CLOCK_MONOTONIC);
     buf->options.type = 0;
 
     if (!buf->route) {
@@ -107,17 +314,23 @@ buffer_t *lowpan_down(buffer_t *buf)
      */
     uint16_t max_iphc_size = cur->mac_parameters.mtu - mac_helper_frame_overhead(cur, buf) - 4;
 
-    buf = iphc_compress(buf, max_iphc_size);
-    if (!buf) {
+    buf->options.tx_lane = lowpan_tx_lane(buf);
+
+    cmpr = g_lowpan_workers.count ? zalloc(sizeof(*cmpr)) : &cmpr_local;
+    cmpr->buf            = buf;
+    cmpr->compress_6lorh = cur->rpl_root.compress_6lorh;
+    cmpr->max_iphc_size  = max_iphc_size;
+    memcpy(&cmpr->root, cur->rpl_root.dodag_id, 16);
+    if (g_lowpan_workers.count) {
+        // Continued by lowpan_cmpr_done()
+        lowpan_cmpr_submit(cmpr);
         return NULL;
     }
-
-    buf->info = (buffer_info_t)(B_FROM_IPV6_TXRX | B_TO_MAC | B_DIR_DOWN);
-
-    return buf;
+    lowpan_cmpr_run(cmpr);
+    return lowpan_down_finish(lowpan_cmpr_apply(cmpr));
 }
 
-buffer_t *lowpan_up(buffer_t *buf)
+bool lowpan_up_addr_valid(const buffer_t *buf)
 {
     /* Reject:
      *    Packets without address
@@ -127,15 +340,49 @@ buffer_t *lowpan_up(buffer_t *buf)
     if (buf->dst_sa.addr_type == ADDR_NONE || buf->src_sa.addr_type == ADDR_NONE ||
             read_be16(buf->src_sa.address) == 0xffff ||
             (buf->dst_sa.addr_type == ADDR_802_15_4_SHORT && read_be16(buf->src_sa.address + 2) > 0xfffd)) {
-        goto drop;
+        return false;
+    }
+    if (addr_check_broadcast(buf->src_sa.address, buf->src_sa.addr_type) == 0) {
+        tr_debug("cipv6_up() broadcast src");
+        return false;
     }
+    return true;
+}
+
+/*
+ * The root only receives upward packets, which carry no SRH-6LoRH. The RPI is
+ * of no use to the root, and an IP-in-IP-6LoRH without SRH-6LoRH terminates at
+ * the root: only the inner packet is kept.
+ */
+static buffer_t *lowpan_up_6lorh(buffer_t *buf)
+{
+    struct iobuf_read iobuf = {
+        .data      = buffer_data_pointer(buf) + 1,
+        .data_size = buffer_data_length(buf) - 1,
+    };
+    struct lowpan_6lorh lorh;
+
+    if (lowpan_6lorh_parse(&iobuf, &lorh, &in6addr_any))
+        return buffer_free(buf);
+    if (lorh.srh_len) {
+        TRACE(TR_DROP, "drop %-9s: unexpected SRH-6LoRH", "6lowpan");
+        return buffer_free(buf);
+    }
+    buffer_data_strip_header(buf, 1 + iobuf.cnt);
+    return buf;
+}
+
+buffer_t *lowpan_up(buffer_t *buf)
+{
+    if (!lowpan_up_addr_valid(buf))
+        goto drop;
 
     const uint8_t *ip_hc = buffer_data_pointer(buf);
 
     //tr_debug("IP-UP";
 
-    if (buffer_data_length(buf) < 4 || addr_check_broadcast(buf->src_sa.address, buf->src_sa.addr_type) == 0) {
-        tr_debug("cipv6_up() Too short or broadcast src");
+    if (buffer_data_length(buf) < 4) {
+        tr_debug("cipv6_up() Too short");
         goto drop;
     } else if ((ip_hc[0] & LOWPAN_FRAG_MASK) == LOWPAN_FRAG) {
         /* 11 x00xxx: FRAG1/FRAGN (RFC 4944) */
@@ -145,7 +392,14 @@ buffer_t *lowpan_up(buffer_t *buf)
         /* 10 xxxxxx: MESH (RFC 4944) */
         buf->info = (buffer_info_t)(B_DIR_UP | B_FROM_IPV6_TXRX | B_TO_MESH_ROUTING);
         return buf;
-    } else if (ip_hc[0] == LOWPAN_DISPATCH_IPV6) {
+    } else if (ip_hc[0] == LOWPAN_6LORH_PAGE1) {
+        buf = lowpan_up_6lorh(buf);
+        if (!buf)
+            return NULL;
+        ip_hc = buffer_data_pointer(buf);
+    }
+
+    if (ip_hc[0] == LOWPAN_DISPATCH_IPV6) {
         /* Send this to new handler */
         buffer_data_strip_header(buf, 1);
         buf->ip_routed_up = true;
@@ -17,6 +17,7 @@
  */
 #ifndef _CIPV6_H
 #define _CIPV6_H
+#include <stdbool.h>
 
 typedef struct buffer buffer_t;
 
@@ -30,9 +31,21 @@ typedef struct buffer buffer_t;
 #define LOWPAN_HARD_MTU_LIMIT 2047
 #endif
 
+// Link addresses checks done by lowpan_up()
+bool lowpan_up_addr_valid(const buffer_t *buf);
 buffer_t *lowpan_up(buffer_t *buf);
 buffer_t *lowpan_down(buffer_t *buf);
 
+// Maximum number of packets compressed by the workers at once
+#define LOWPAN_DOWN_INFLIGHT_MAX 32
+
+// Run the header compression of lowpan_down() on count worker threads. The
+// packets are then handed back to the stack from the event loop.
+void lowpan_down_workers_init(int count);
+// True if no more packets should be submitted to lowpan_down() until the
+// workers catch up.
+bool lowpan_down_busy(void);
+
 /* Bits in IPHC header, first byte  (RFC 6282)
  *     0                                       1
  *     0   1   2   3   4   5   6   7   8   9   0   1   2   3   4   5
@@ -104,9 +117,12 @@ buffer_t *lowpan_down(buffer_t *buf);
  *       |   ...      | reserved   - Reserved for future use          |
  *       | 11  011111 | reserved   - Reserved for future use          |
  *       | 11  100xxx | FRAGN      - Fragmentation Header (subsequent)|
- *       | 11  101000 | reserved   - Reserved for future use          |
+ *       | 11  10100x | RFRAG      - Recoverable Fragment (RFC 8931)  |
+ *       | 11  10101x | RFRAG-ACK  - RFRAG Acknowledgment (RFC 8931)  |
+ *       | 11  101100 | reserved   - Reserved for future use          |
  *       |   ...      | reserved   - Reserved for future use          |
- *       | 11  111111 | reserved   - Reserved for future use          |
+ *       | 11  101111 | reserved   - Reserved for future use          |
+ *       | 11  11xxxx | PAGE       - Paging Dispatch (RFC 8025)       |
  *       +------------+-----------------------------------------------+
  *
  */
@@ -128,6 +144,40 @@ buffer_t *lowpan_down(buffer_t *buf);
 #define LOWPAN_FRAGN_BIT            0x20 /* xx 1xxxxx distinguish FRAGN */
 #define LOWPAN_FRAG                 0xC0 /* 11 x00xxx FRAG1/FRAGN */
 #define LOWPAN_FRAG_MASK            0xD8
+#define LOWPAN_RFRAG                0xE8 /* 11 10100E RFRAG */
+#define LOWPAN_RFRAG_ACK            0xEA /* 11 10101E RFRAG-ACK */
+#define LOWPAN_RFRAG_MASK           0xFE
+
+/* RFC 8931 - Figure 2: RFRAG Dispatch Type and Header
+ *    0                   1                   2                   3
+ *    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |1 1 1 0 1 0 0|E|  Datagram_Tag |X| Sequence|   Fragment_Size   |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |       Fragment_Offset         |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * Sizes and offsets are counted in bytes of the compressed datagram. The first
+ * fragment (Sequence 0) carries the Datagram_Size in place of the offset.
+ *
+ * RFC 8931 - Figure 3: RFRAG-ACK Dispatch Type and Header
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |1 1 1 0 1 0 1|E|  Datagram_Tag |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |          RFRAG Acknowledgment Bitmap (32 bits)                 |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+#define LOWPAN_RFRAG_HDR_LEN        6
+#define LOWPAN_RFRAG_ACK_LEN        6
+#define LOWPAN_RFRAG_X_MASK         0x8000
+#define LOWPAN_RFRAG_SEQ_MASK       0x7C00
+#define LOWPAN_RFRAG_SIZE_MASK      0x03FF
+#define LOWPAN_RFRAG_SEQ_MAX        31
+/* The bitmap starts with Sequence 0 at the most significant bit. A NULL
+ * bitmap aborts the datagram, a FULL bitmap acknowledges it entirely. */
+#define LOWPAN_RFRAG_BITMAP(seq)    (0x80000000u >> (seq))
+#define LOWPAN_RFRAG_BITMAP_NULL    0x00000000u
+#define LOWPAN_RFRAG_BITMAP_FULL    0xFFFFFFFFu
 
 /*
  * 6LoWPAN Next Header Compression codes
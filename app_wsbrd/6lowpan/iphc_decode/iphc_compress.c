@@ -17,9 +17,11 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include "common/bits.h"
 #include "common/endian.h"
 #include "common/log_legacy.h"
+#include "common/mathutils.h"
 #include "common/ns_list.h"
 #include "common/specs/ipv6.h"
 
@@ -42,6 +44,30 @@ typedef struct iphc_compress_state {
     const uint8_t *outer_dst_iid;
 } iphc_compress_state_t;
 
+/*
+ * Address compression only depends on the addresses and on the outer IIDs.
+ * Downstream traffic is mostly made of a few long-lived flows, so the result
+ * is cached for the outermost IPv6 header, indexed by its flow label. Other
+ * fields (hop limit, traffic class, next header) are still encoded for each
+ * packet. Each thread has its own cache, see iphc_compress_hdr().
+ */
+#define IPHC_ADDR_CACHE_SIZE 64
+
+struct iphc_addr_cache {
+    bool valid;
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint8_t outer_src_iid[8];
+    uint8_t outer_dst_iid[8];
+    uint8_t mode;
+    uint8_t cmp_src_len;
+    uint8_t cmp_dst_len;
+    uint8_t cmp_src[16];
+    uint8_t cmp_dst[16];
+};
+
+static _Thread_local struct iphc_addr_cache iphc_addr_cache[IPHC_ADDR_CACHE_SIZE];
+
 static bool compress_nh(uint8_t nh, iphc_compress_state_t *restrict cs);
 
 /* Using a specified context, what's the best possible compression of addr? */
@@ -349,10 +375,41 @@ static bool compress_ipv6(iphc_compress_state_t *restrict cs, bool from_nhc)
         return false;
     }
 
+    uint8_t ecn = (in[1] & 0x30) << 2;
+    uint8_t dscp = (in[0] & 0x0F) << 2 | (in[1] & 0xC0) >> 6;
+    uint24_t flow = read_be24(in + 1) & 0xFFFFF;
+    struct iphc_addr_cache *cache = NULL;
+
+    if (!from_nhc && flow)
+        cache = &iphc_addr_cache[flow % IPHC_ADDR_CACHE_SIZE];
+
     /* Compress addresses, get context byte */
     uint8_t cmp_src[16], cmp_dst[16], cmp_src_len, cmp_dst_len;
-    cmp_src_len = compress_addr(in + 8, false, cs->outer_src_iid, cmp_src, &iphc[1]);
-    cmp_dst_len = compress_addr(in + 24, true, cs->outer_dst_iid, cmp_dst, &iphc[1]);
+    if (cache && cache->valid &&
+        !memcmp(cache->src, in + 8, 16) && !memcmp(cache->dst, in + 24, 16) &&
+        !memcmp(cache->outer_src_iid, cs->outer_src_iid, 8) &&
+        !memcmp(cache->outer_dst_iid, cs->outer_dst_iid, 8)) {
+        iphc[1] = cache->mode;
+        cmp_src_len = cache->cmp_src_len;
+        cmp_dst_len = cache->cmp_dst_len;
+        memcpy(cmp_src, cache->cmp_src, cmp_src_len);
+        memcpy(cmp_dst, cache->cmp_dst, cmp_dst_len);
+    } else {
+        cmp_src_len = compress_addr(in + 8, false, cs->outer_src_iid, cmp_src, &iphc[1]);
+        cmp_dst_len = compress_addr(in + 24, true, cs->outer_dst_iid, cmp_dst, &iphc[1]);
+        if (cache) {
+            memcpy(cache->src, in + 8, 16);
+            memcpy(cache->dst, in + 24, 16);
+            memcpy(cache->outer_src_iid, cs->outer_src_iid, 8);
+            memcpy(cache->outer_dst_iid, cs->outer_dst_iid, 8);
+            cache->mode = iphc[1];
+            cache->cmp_src_len = cmp_src_len;
+            cache->cmp_dst_len = cmp_dst_len;
+            memcpy(cache->cmp_src, cmp_src, cmp_src_len);
+            memcpy(cache->cmp_dst, cmp_dst, cmp_dst_len);
+            cache->valid = true;
+        }
+    }
     iphc_bytes += cmp_src_len + cmp_dst_len;
 
     /* Compress Hop Limit */
@@ -372,10 +429,6 @@ static bool compress_ipv6(iphc_compress_state_t *restrict cs, bool from_nhc)
             break;
     }
 
-    uint8_t ecn = (in[1] & 0x30) << 2;
-    uint8_t dscp = (in[0] & 0x0F) << 2 | (in[1] & 0xC0) >> 6;
-    uint24_t flow = read_be24(in + 1) & 0xFFFFF;
-
     if (flow == 0 && ecn == 0 && dscp == 0) {
         iphc[0] |= HC_TF_ELIDED;
     } else if (flow == 0) {
@@ -484,17 +537,45 @@ ext_hdr:
 
 /* Input: An IPv6 frame, with outer layer 802.15.4 MAC (or IP) addresses in src+dst */
 /* Output: 6LoWPAN frame - usually compressed. */
-buffer_t *iphc_compress(buffer_t *buf, uint16_t hc_space)
+int iphc_compress_hdr(const uint8_t *pkt, uint16_t len, const sockaddr_t *src, const sockaddr_t *dst,
+                      uint8_t *out, uint16_t out_space, uint16_t *consumed)
 {
-    uint8_t *ptr = buffer_data_pointer(buf);
-    uint16_t len = buffer_data_length(buf);
     uint8_t src_iid[8], dst_iid[8];
 
-    if (len < 40 || (ptr[0] & 0xF0) != 0x60) {
+    if (len < 40 || (pkt[0] & 0xF0) != 0x60) {
         tr_debug("Not IPv6");
-        return buffer_free(buf);
+        return -EINVAL;
+    }
+    if (!addr_iid_from_outer(src_iid, src) || !addr_iid_from_outer(dst_iid, dst)) {
+        tr_debug("Bad outer addr");
+        return -EINVAL;
     }
 
+    iphc_compress_state_t cs = {
+        .in = pkt,
+        .len = len,
+        .out = out,
+        .out_space = MIN(out_space, len),
+        .consumed = 0,
+        .produced = 0,
+        .outer_src_iid = src_iid,
+        .outer_dst_iid = dst_iid,
+    };
+
+    /* Compression failed, or made it bigger somehow (impossible?) */
+    if (!compress_ipv6(&cs, false) || cs.produced > cs.consumed)
+        return 0;
+    *consumed = cs.consumed;
+    return cs.produced;
+}
+
+buffer_t *iphc_compress(buffer_t *buf, uint16_t hc_space)
+{
+    uint16_t len = buffer_data_length(buf);
+    uint16_t consumed;
+    uint8_t *ptr;
+    int ret;
+
     /* No point allocating excessively */
     if (hc_space > len) {
         hc_space = len;
@@ -509,25 +590,13 @@ buffer_t *iphc_compress(buffer_t *buf, uint16_t hc_space)
         return buffer_free(buf);
     }
 
-    if (!addr_iid_from_outer(src_iid, &buf->src_sa) || !addr_iid_from_outer(dst_iid, &buf->dst_sa)) {
-        tr_debug("Bad outer addr");
+    ret = iphc_compress_hdr(buffer_data_pointer(buf), len, &buf->src_sa, &buf->dst_sa,
+                            hc_out, hc_space, &consumed);
+    if (ret < 0) {
         free(hc_out);
         return buffer_free(buf);
     }
-
-    iphc_compress_state_t cs = {
-        .in = ptr,
-        .len = len,
-        .out = hc_out,
-        .out_space = hc_space,
-        .consumed = 0,
-        .produced = 0,
-        .outer_src_iid = src_iid,
-        .outer_dst_iid = dst_iid,
-    };
-
-    if (!compress_ipv6(&cs, false) || cs.produced > cs.consumed) {
-        /* Compression failed, or made it bigger somehow (impossible?) */
+    if (!ret) {
         /* Fall back to uncompressed, which means adding a dispatch byte */
         buf = buffer_headroom(buf, 1);
         if (buf) {
@@ -538,11 +607,10 @@ buffer_t *iphc_compress(buffer_t *buf, uint16_t hc_space)
         return buf;
     }
 
-    buffer_data_strip_header(buf, cs.consumed);
-    buffer_data_reserve_header(buf, cs.produced);
+    buffer_data_strip_header(buf, consumed);
+    buffer_data_reserve_header(buf, ret);
     /* XXX see note above - should be able to improve this to avoid the temp buffer */
-    memcpy(buffer_data_pointer(buf), hc_out, cs.produced);
+    memcpy(buffer_data_pointer(buf), hc_out, ret);
     free(hc_out);
     return buf;
-
 }
@@ -21,7 +21,18 @@
 #include <stdbool.h>
 
 typedef struct buffer buffer_t;
+typedef struct ns_sockaddr sockaddr_t;
 
+/*
+ * Compress the IPv6 headers at the start of pkt into out, using the link-layer
+ * addresses src and dst. Returns the number of bytes written, and sets
+ * *consumed to the number of bytes of pkt they replace. Returns 0 if the
+ * headers cannot be compressed (the packet is then sent with an IPv6
+ * dispatch), or a negative errno if the packet is invalid. Does not touch any
+ * shared state, so it can be called from a worker thread.
+ */
+int iphc_compress_hdr(const uint8_t *pkt, uint16_t len, const sockaddr_t *src, const sockaddr_t *dst,
+                      uint8_t *out, uint16_t out_space, uint16_t *consumed);
 buffer_t *iphc_compress(buffer_t *buf, uint16_t hc_space);
 
 #endif
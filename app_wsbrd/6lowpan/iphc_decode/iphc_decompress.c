@@ -17,7 +17,9 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include "common/ipv6/6lorh.h"
 #include "common/bits.h"
+#include "common/iobuf.h"
 #include "common/log_legacy.h"
 #include "common/endian.h"
 #include "common/specs/ipv6.h"
@@ -52,6 +54,20 @@ uint16_t iphc_header_scan(buffer_t *buf, uint16_t *uncompressed_size)
         return 1;
     }
 
+    /* RFC 8138 6LoRHs are accounted for with the IPv6 headers they replace */
+    if (ptr < end && ptr[0] == LOWPAN_6LORH_PAGE1) {
+        struct iobuf_read iobuf = {
+            .data      = ptr + 1,
+            .data_size = end - ptr - 1,
+        };
+        struct lowpan_6lorh lorh;
+
+        if (lowpan_6lorh_parse(&iobuf, &lorh, &in6addr_any))
+            return 0;
+        ptr += 1 + iobuf.cnt;
+        uncomp_len += lowpan_6lorh_expanded_len(&lorh);
+    }
+
     /* Handle compressed IP header (LOWPAN_IPHC) - LOWPAN_HC1 etc not handled */
 IPv6START:
     ip_hc = ptr;
@@ -19,11 +19,15 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include "common/ws/ws_regdb.h"
+#include "common/bits.h"
 #include "common/endian.h"
 #include "common/rcp_api.h"
 #include "common/rand.h"
 #include "common/dhcp_server.h"
 #include "common/log_legacy.h"
+#include "common/mathutils.h"
 #include "common/ns_list.h"
 #include "common/version.h"
 #include "common/memutils.h"
@@ -31,11 +35,15 @@
 #include "common/specs/ws.h"
 #include "common/specs/ip.h"
 
+#include "common/codel.h"
 #include "common/random_early_detection.h"
 #include "common/events_scheduler.h"
+#include "common/time_extra.h"
+#include "common/timer.h"
 
 #include "app/wsbrd.h"
 #include "app/wsbr_mac.h"
+#include "app/wsbr_metrics.h"
 #include "net/timers.h"
 #include "net/netaddr_types.h"
 #include "net/ns_buffer.h"
@@ -43,6 +51,7 @@
 #include "net/ns_error_types.h"
 #include "net/protocol.h"
 #include "6lowpan/iphc_decode/cipv6.h"
+#include "6lowpan/fragmentation/cipv6_fragmenter.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "6lowpan/mac/mpx_api.h"
 #include "6lowpan/iphc_decode/iphc_decompress.h"
@@ -56,6 +65,9 @@
 #define ADAPTION_DIRECT_TX_QUEUE_SIZE_THRESHOLD_TRACE 20
 #define LFN_BUFFER_TIMEOUT_PARAM 4
 
+// BC0 + FRAGN headers
+#define LOWPAN_FRAG_HDR_MAX (2 + 5)
+
 typedef struct fragmenter_tx_entry {
     uint16_t tag;   /*!< Fragmentation datagram TAG ID */
     uint16_t size;  /*!< Datagram Total Size (uncompressed) */
@@ -68,26 +80,100 @@ typedef struct fragmenter_tx_entry {
     uint8_t unfrag_len; /*!< Length of headers that precede the FRAG header */
     bool fragmented_data: 1;
     bool first_fragment: 1;
+    bool rfrag: 1; /*!< RFC 8931 fragments, frag_len is the size of all but the last one */
+    bool rfrag_wait_ack: 1;
+    uint8_t rfrag_seq; /*!< Fragment being sent */
+    uint8_t rfrag_count;
+    uint8_t rfrag_rounds;
+    uint32_t rfrag_missing; /*!< Fragments not acknowledged yet */
+    uint64_t rfrag_ack_deadline_ms;
     buffer_t *buf;
-    uint8_t *fragmenter_buf;
+    // Headers preceding the fragment data: unfragmented headers and FRAG
+    // header. The fragment data is sent directly from buf.
+    uint8_t frag_hdr[LOWPAN_FRAG_HDR_MAX];
     ns_list_link_t      link; /*!< List link entry */
 } fragmenter_tx_entry_t;
 
 
 typedef NS_LIST_HEAD(fragmenter_tx_entry_t, link) fragmenter_tx_list_t;
 
+/*
+ * Frames waiting for a free TX process are queued per link-layer destination,
+ * so that a destination accepting frames slowly (LFN, bad link) does not delay
+ * the others. Each destination has one queue per lane (see enum
+ * buffer_tx_lane), served with strict priority: network control frames of
+ * all destinations are served first, then high priority data frames, then
+ * low priority data frames. Data frames of a lane are served using Deficit
+ * Round Robin (DRR) among destinations. The DRR credit is airtime, counted in bytes at the rate of
+ * the base PHY: a frame to a neighbor is charged its length scaled by the
+ * airtime per byte measured for this neighbor (see ws_llc_airtime_tx_conf()),
+ * so neighbors using a slow rate or needing many retries cannot monopolize
+ * the channel.
+ *
+ * With queue_management = codel or fq_codel, data frames are dropped on
+ * dequeue when their sojourn time, measured from their arrival in the
+ * adaptation layer, stays above the target (see common/codel.h). The CoDel
+ * state is shared by all the destinations with codel, and kept per flow with
+ * fq_codel, which amounts to FQ-CoDel (RFC 8290) since flows are already
+ * served with DRR. A flow is freed once empty, so its CoDel state does not
+ * survive idle periods. LFN destinations are exempted, since their frames
+ * wait for the LFN listening slots by design.
+ *
+ * Each lane has a depth limit, so a burst in one lane cannot take all the
+ * buffers, and a few TX processes are reserved to the control lane, so
+ * control frames do not wait for the RCP to confirm a batch of data frames.
+ */
+enum {
+    LOWPAN_TX_CLASS_CONTROL,
+    LOWPAN_TX_CLASS_DATA_HIGH,
+    LOWPAN_TX_CLASS_DATA_LOW,
+    LOWPAN_TX_CLASS_COUNT,
+};
+
+static const uint16_t lowpan_tx_class_size_max[LOWPAN_TX_CLASS_COUNT] = {
+    [LOWPAN_TX_CLASS_CONTROL]   = 64,
+    [LOWPAN_TX_CLASS_DATA_HIGH] = 64,
+    [LOWPAN_TX_CLASS_DATA_LOW]  = UINT16_MAX, // Bounded by the AQM
+};
+
+typedef struct lowpan_tx_flow {
+    uint8_t addr_type;
+    uint8_t addr[8];
+    bool lfn_multicast;
+    bool aqm_exempt;
+    buffer_list_t queue[LOWPAN_TX_CLASS_COUNT];
+    uint16_t queue_size;
+    int deficit;
+    struct codel codel; // fq_codel only
+    ns_list_link_t link;
+} lowpan_tx_flow_t;
+
+typedef NS_LIST_HEAD(lowpan_tx_flow_t, link) lowpan_tx_flow_list_t;
+
+// The RCP holds the LFN broadcast frames until the next LFN broadcast slot,
+// so several of them are given at once to be sent in the same slot instead of
+// one per LFN broadcast interval.
+#define LOWPAN_ACTIVE_LFN_BROADCAST_MAX 4
+
 typedef struct fragmenter_interface {
     int8_t interface_id;
     uint16_t local_frag_tag;
     uint8_t msduHandle;
-    uint8_t *fragment_indirect_tx_buffer; //Used for write fragmentation header
+    uint8_t msduHandle_used[256 / 8]; // Bitmap of the handles of active TX
     fragmenter_tx_entry_t active_broadcast_tx_buf; //Current active direct broadcast tx process
-    fragmenter_tx_entry_t active_lfn_broadcast_tx_buf; //Current active direct lfn broadcast tx process
+    fragmenter_tx_entry_t active_lfn_broadcast_tx_buf[LOWPAN_ACTIVE_LFN_BROADCAST_MAX]; //Current active direct lfn broadcast tx processes
     fragmenter_tx_list_t activeUnicastList; //Unicast packets waiting data confirmation from MAC
-    buffer_list_t directTxQueue; //Waiting free tx process
+    lowpan_tx_flow_list_t directTxFlows; //Waiting free tx process, in DRR order
     uint16_t directTxQueue_size;
+    size_t directTxQueue_bytes; // Allocated size of the queued buffers
+    uint16_t directTxQueue_class_size[LOWPAN_TX_CLASS_COUNT];
     uint16_t directTxQueue_level;
     uint16_t activeTxList_size;
+    struct codel codel; // codel only
+    struct lowpan_aqm_stats aqm_stats;
+    struct timer_entry duty_cycle_timer; // Resumes the data frames deferred by the duty cycle
+    struct timer_entry lfn_tx_timer;     // Releases the LFN unicast frames held on the host
+    struct timer_entry rfrag_timer;      // Expires the RFRAG-ACK waits
     bool fragmenter_active; /*!< Fragmenter state */
     mpx_api_t *mpx_api;
     uint16_t mpx_user_id;
@@ -95,7 +181,25 @@ typedef struct fragmenter_interface {
 } fragmenter_interface_t;
 
 #define LOWPAN_ACTIVE_UNICAST_ONGOING_MAX 10
+#define LOWPAN_ACTIVE_UNICAST_CONTROL_RESERVED 2
+// Airtime credited to a flow for each DRR round, in bytes at the base PHY rate
+#define LOWPAN_TX_FLOW_QUANTUM 1280
 #define LOWPAN_HIGH_PRIORITY_STATE_LENGTH 50 //5 seconds 100us ticks
+// Unicast frames to an LFN are held on the host until this long before the
+// next listening window of the LFN, instead of occupying an RCP TX slot for up
+// to a whole listening interval.
+#define LOWPAN_LFN_TX_LEAD_MS 500
+#define LOWPAN_LFN_QUEUE_MAX  8
+
+/*
+ * With Selective Fragment Recovery (RFC 8931), the fragments of a datagram are
+ * sent in rounds. The last fragment of a round requests an RFRAG-ACK, whose
+ * bitmap tells which fragments must be sent again in the next round. Since
+ * each RFRAG carries its offset, an RFRAG datagram does not prevent other
+ * frames from being sent while waiting for the RFRAG-ACK.
+ */
+#define LOWPAN_RFRAG_ACK_TIMEOUT_MS 5000
+#define LOWPAN_RFRAG_ROUNDS_MAX     3
 
 #define LOWPAN_TX_BUFFER_AGE_LIMIT_LOW_PRIORITY     30 // Remove low priority packets older than limit (seconds)
 #define LOWPAN_TX_BUFFER_AGE_LIMIT_HIGH_PRIORITY    60 // Remove high priority packets older than limit (seconds)
@@ -116,7 +220,8 @@ static bool lowpan_adaptation_request_longer_than_mtu(struct net_if *cur, buffer
 /* Common data tx request process functions */
 static void lowpan_active_buffer_state_reset(fragmenter_tx_entry_t *tx_buffer);
 static uint8_t lowpan_data_request_unique_handle_get(fragmenter_interface_t *interface_ptr);
-static fragmenter_tx_entry_t *lowpan_indirect_entry_allocate(uint16_t fragment_buffer_size);
+static void lowpan_data_request_handle_release(fragmenter_interface_t *interface_ptr, uint8_t handle);
+static fragmenter_tx_entry_t *lowpan_indirect_entry_allocate(void);
 static fragmenter_tx_entry_t *lowpan_adaptation_tx_process_init(fragmenter_interface_t *interface_ptr,
                                                                 bool is_unicast, bool lfn_multicast);
 static void lowpan_adaptation_data_request_primitiv_set(const buffer_t *buf, mcps_data_req_t *dataReq, struct net_if *cur);
@@ -130,9 +235,9 @@ static bool lowpan_adaptation_tx_process_ready(fragmenter_tx_entry_t *tx_ptr);
 
 /* Fragmentation local functions */
 static int8_t lowpan_message_fragmentation_init(buffer_t *buf, fragmenter_tx_entry_t *frag_entry, struct net_if *cur, fragmenter_interface_t *interface_ptr);
-static bool lowpan_message_fragmentation_message_write(const fragmenter_tx_entry_t *frag_entry, mcps_data_req_t *dataReq);
+static bool lowpan_message_fragmentation_message_write(fragmenter_tx_entry_t *frag_entry, mcps_data_req_t *dataReq);
 
-static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, buffer_t *buf);
+static bool lowpan_buffer_tx_allowed(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf);
 
 static void lowpan_adaptation_interface_data_ind(struct net_if *cur, const mcps_data_ind_t *data_ind);
 static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const mcps_data_cnf_t *confirm);
@@ -175,38 +280,242 @@ static void lowpan_adaptation_tx_queue_level_update(struct net_if *cur, fragment
 }
 
 
+static int lowpan_tx_class(const buffer_t *buf)
+{
+    switch (buf->options.tx_lane) {
+    case BUFFER_TX_LANE_CONTROL:
+        return LOWPAN_TX_CLASS_CONTROL;
+    case BUFFER_TX_LANE_DATA_HIGH:
+        return LOWPAN_TX_CLASS_DATA_HIGH;
+    default:
+        return LOWPAN_TX_CLASS_DATA_LOW;
+    }
+}
+
+static bool lowpan_tx_flow_match(const lowpan_tx_flow_t *flow, const buffer_t *buf)
+{
+    int len = buf->dst_sa.addr_type == ADDR_802_15_4_LONG ? 8 : 2;
+
+    return flow->lfn_multicast == buf->options.lfn_multicast &&
+           flow->addr_type == buf->dst_sa.addr_type &&
+           !memcmp(flow->addr, buf->dst_sa.address + PAN_ID_LEN, len);
+}
+
+static bool lowpan_tx_is_lfn(struct net_if *cur, const buffer_t *buf)
+{
+    struct ws_neigh *ws_neigh;
+
+    if (buf->options.lfn_multicast)
+        return true;
+    if (!buf->link_specific.ieee802_15_4.requestAck)
+        return false;
+    ws_neigh = ws_neigh_get(&cur->ws_info.neighbor_storage, buf->dst_sa.address + PAN_ID_LEN);
+    return ws_neigh && ws_neigh->node_role == WS_NR_ROLE_LFN;
+}
+
+static lowpan_tx_flow_t *lowpan_tx_flow_find(fragmenter_interface_t *interface_ptr, const buffer_t *buf)
+{
+    ns_list_foreach(lowpan_tx_flow_t, entry, &interface_ptr->directTxFlows)
+        if (lowpan_tx_flow_match(entry, buf))
+            return entry;
+    return NULL;
+}
+
+static lowpan_tx_flow_t *lowpan_tx_flow_get(struct net_if *cur, fragmenter_interface_t *interface_ptr,
+                                            const buffer_t *buf)
+{
+    lowpan_tx_flow_t *flow;
+
+    flow = lowpan_tx_flow_find(interface_ptr, buf);
+    if (flow)
+        return flow;
+    flow = zalloc(sizeof(*flow));
+    flow->addr_type = buf->dst_sa.addr_type;
+    memcpy(flow->addr, buf->dst_sa.address + PAN_ID_LEN, buf->dst_sa.addr_type == ADDR_802_15_4_LONG ? 8 : 2);
+    flow->lfn_multicast = buf->options.lfn_multicast;
+    // LFN traffic is paced by the LFN intervals, not by the congestion
+    flow->aqm_exempt = lowpan_tx_is_lfn(cur, buf);
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++)
+        ns_list_init(&flow->queue[i]);
+    flow->deficit = LOWPAN_TX_FLOW_QUANTUM;
+    ns_list_add_to_end(&interface_ptr->directTxFlows, flow);
+    return flow;
+}
+
+static int lowpan_tx_flow_cost(struct net_if *cur, const lowpan_tx_flow_t *flow, const buffer_t *buf)
+{
+    const struct phy_params *phy_params = cur->ws_info.phy_config.params;
+    int len = buffer_data_length(buf);
+    struct ws_neigh *ws_neigh;
+    float base_us_per_byte;
+
+    if (flow->addr_type != ADDR_802_15_4_LONG || flow->lfn_multicast || !phy_params || !phy_params->datarate)
+        return len;
+    ws_neigh = ws_neigh_get(&cur->ws_info.neighbor_storage, flow->addr);
+    if (!ws_neigh || isnan(ws_neigh->airtime_us_per_byte))
+        return len;
+    base_us_per_byte = 8.0f * 1000000 / phy_params->datarate;
+    return len * ws_neigh->airtime_us_per_byte / base_us_per_byte;
+}
+
+static void lowpan_tx_flow_remove(struct net_if *cur, fragmenter_interface_t *interface_ptr,
+                                  lowpan_tx_flow_t *flow, buffer_t *buf, int class)
+{
+    ns_list_remove(&flow->queue[class], buf);
+    flow->queue_size--;
+    interface_ptr->directTxQueue_size--;
+    interface_ptr->directTxQueue_bytes -= sizeof(buffer_t) + buf->size;
+    interface_ptr->directTxQueue_class_size[class]--;
+    if (!flow->queue_size) {
+        ns_list_remove(&interface_ptr->directTxFlows, flow);
+        free(flow);
+    }
+    if (cur)
+        lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
+}
+
+static void lowpan_tx_flow_free_all(fragmenter_interface_t *interface_ptr)
+{
+    ns_list_foreach_safe(lowpan_tx_flow_t, flow, &interface_ptr->directTxFlows) {
+        for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++)
+            buffer_free_list(&flow->queue[i]);
+        ns_list_remove(&interface_ptr->directTxFlows, flow);
+        free(flow);
+    }
+    interface_ptr->directTxQueue_size = 0;
+    interface_ptr->directTxQueue_bytes = 0;
+    memset(interface_ptr->directTxQueue_class_size, 0, sizeof(interface_ptr->directTxQueue_class_size));
+    interface_ptr->directTxQueue_level = 0;
+}
+
 static void lowpan_adaptation_tx_queue_write(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
 {
+    lowpan_tx_flow_t *flow = lowpan_tx_flow_get(cur, interface_ptr, buf);
+
     TRACE(TR_QUEUE, "queue: frame enqueued dst:%s", tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
-    ns_list_add_to_end(&interface_ptr->directTxQueue, buf);
+    ns_list_add_to_end(&flow->queue[lowpan_tx_class(buf)], buf);
+    flow->queue_size++;
     interface_ptr->directTxQueue_size++;
+    interface_ptr->directTxQueue_bytes += sizeof(buffer_t) + buf->size;
+    interface_ptr->directTxQueue_class_size[lowpan_tx_class(buf)]++;
     lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
 }
 
 static void lowpan_adaptation_tx_queue_write_to_front(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
 {
+    lowpan_tx_flow_t *flow = lowpan_tx_flow_get(cur, interface_ptr, buf);
+
     TRACE(TR_QUEUE, "queue: frame enqueued front dst:%s", tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
-    ns_list_add_to_start(&interface_ptr->directTxQueue, buf);
+    ns_list_add_to_start(&flow->queue[lowpan_tx_class(buf)], buf);
+    flow->queue_size++;
     interface_ptr->directTxQueue_size++;
+    interface_ptr->directTxQueue_bytes += sizeof(buffer_t) + buf->size;
+    interface_ptr->directTxQueue_class_size[lowpan_tx_class(buf)]++;
     lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
 }
 
+// On congestion, drop the oldest data frame of the lowest lane in use, from
+// the destination with the most queued frames, so that destinations with
+// little traffic are not penalized.
+static bool lowpan_adaptation_tx_queue_drop(struct net_if *cur, fragmenter_interface_t *interface_ptr)
+{
+    lowpan_tx_flow_t *longest = NULL;
+    buffer_t *dropped;
+    int class;
+
+    for (class = LOWPAN_TX_CLASS_DATA_LOW; class > LOWPAN_TX_CLASS_CONTROL; class--)
+        if (interface_ptr->directTxQueue_class_size[class])
+            break;
+    if (class == LOWPAN_TX_CLASS_CONTROL)
+        return false;
+    ns_list_foreach(lowpan_tx_flow_t, flow, &interface_ptr->directTxFlows)
+        if (!ns_list_is_empty(&flow->queue[class]) &&
+            (!longest || flow->queue_size > longest->queue_size))
+            longest = flow;
+    BUG_ON(!longest);
+    dropped = ns_list_get_first(&longest->queue[class]);
+    TRACE(TR_TX_ABORT, "tx-abort: congestion detected dst:%s",
+          tr_eui64(dropped->dst_sa.address + PAN_ID_LEN));
+    lowpan_tx_flow_remove(cur, interface_ptr, longest, dropped, class);
+    buffer_free(dropped);
+    return true;
+}
+
+static bool lowpan_adaptation_tx_queue_aqm_drop(struct net_if *cur, fragmenter_interface_t *interface_ptr,
+                                                lowpan_tx_flow_t *flow, buffer_t *buf)
+{
+    uint64_t now_us = time_now_us(CLOCK_MONOTONIC);
+
+    if (cur->aqm == LOWPAN_AQM_RED || flow->aqm_exempt)
+        return false;
+    if (cur->aqm == LOWPAN_AQM_FQ_CODEL)
+        return codel_drop(&flow->codel, &cur->codel_params,
+                          now_us - buf->tx_stage_us[BUFFER_TX_STAGE_ADAPTATION], now_us,
+                          flow->queue_size <= 1);
+    return codel_drop(&interface_ptr->codel, &cur->codel_params,
+                      now_us - buf->tx_stage_us[BUFFER_TX_STAGE_ADAPTATION], now_us,
+                      interface_ptr->directTxQueue_size <= 1);
+}
+
 static buffer_t *lowpan_adaptation_tx_queue_read(struct net_if *cur, fragmenter_interface_t *interface_ptr)
 {
+    lowpan_tx_flow_t *flow, *last;
+    buffer_t *buf;
+    bool pending;
+
     TRACE(TR_QUEUE, "queue: looking for frame to tx");
     // Currently this function is called only when data confirm is received for previously sent packet.
     if (!interface_ptr->directTxQueue_size) {
         return NULL;
     }
-    ns_list_foreach_safe(buffer_t, buf, &interface_ptr->directTxQueue) {
-        if (lowpan_buffer_tx_allowed(interface_ptr, buf)) {
-            ns_list_remove(&interface_ptr->directTxQueue, buf);
-            interface_ptr->directTxQueue_size--;
-            lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
+
+retry:
+    ns_list_foreach(lowpan_tx_flow_t, entry, &interface_ptr->directTxFlows) {
+        buf = ns_list_get_first(&entry->queue[LOWPAN_TX_CLASS_CONTROL]);
+        if (buf && lowpan_buffer_tx_allowed(cur, interface_ptr, buf)) {
+            lowpan_tx_flow_remove(cur, interface_ptr, entry, buf, LOWPAN_TX_CLASS_CONTROL);
             TRACE(TR_QUEUE, "queue: frame dequeued dst:%s", tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
             return buf;
         }
     }
+
+    // The flow at the head of the list is served while it has credit, then it
+    // is moved to the back of the list with more credit. Flows which cannot
+    // send are skipped but keep their position. The lower lane is only
+    // served when nothing can be sent from the upper one.
+    for (int class = LOWPAN_TX_CLASS_DATA_HIGH; class <= LOWPAN_TX_CLASS_DATA_LOW; class++) {
+        do {
+            pending = false;
+            last = ns_list_get_last(&interface_ptr->directTxFlows);
+            for (flow = ns_list_get_first(&interface_ptr->directTxFlows); flow; ) {
+                lowpan_tx_flow_t *next = flow == last ? NULL : ns_list_get_next(&interface_ptr->directTxFlows, flow);
+
+                buf = ns_list_get_first(&flow->queue[class]);
+                if (buf && lowpan_buffer_tx_allowed(cur, interface_ptr, buf)) {
+                    pending = true;
+                    if (flow->deficit > 0 && lowpan_adaptation_tx_queue_aqm_drop(cur, interface_ptr, flow, buf)) {
+                        TRACE(TR_TX_ABORT, "tx-abort: sojourn time above target dst:%s",
+                              tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
+                        interface_ptr->aqm_stats.codel_drop_count++;
+                        // The flow is freed if it becomes empty
+                        lowpan_tx_flow_remove(cur, interface_ptr, flow, buf, class);
+                        buffer_free(buf);
+                        goto retry;
+                    }
+                    if (flow->deficit > 0) {
+                        flow->deficit -= lowpan_tx_flow_cost(cur, flow, buf);
+                        lowpan_tx_flow_remove(cur, interface_ptr, flow, buf, class);
+                        TRACE(TR_QUEUE, "queue: frame dequeued dst:%s", tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
+                        return buf;
+                    }
+                    flow->deficit += LOWPAN_TX_FLOW_QUANTUM;
+                    ns_list_remove(&interface_ptr->directTxFlows, flow);
+                    ns_list_add_to_end(&interface_ptr->directTxFlows, flow);
+                }
+                flow = next;
+            }
+        } while (pending);
+    }
     return NULL;
 }
 
@@ -231,6 +540,8 @@ static void lowpan_active_buffer_state_reset(fragmenter_tx_entry_t *tx_buffer)
     }
     tx_buffer->fragmented_data = false;
     tx_buffer->first_fragment = true;
+    tx_buffer->rfrag = false;
+    tx_buffer->rfrag_wait_ack = false;
 }
 
 static bool lowpan_active_tx_handle_verify(uint8_t handle, buffer_t *buf)
@@ -260,18 +571,18 @@ static fragmenter_tx_entry_t *lowpan_listed_tx_handle_verify(uint8_t handle, fra
 
 static uint8_t lowpan_data_request_unique_handle_get(fragmenter_interface_t *interface_ptr)
 {
-    bool valid_info = false;
-    uint8_t handle;
-    while (!valid_info) {
-        handle = interface_ptr->msduHandle++;
-        if (!lowpan_listed_tx_handle_verify(handle, &interface_ptr->activeUnicastList) &&
-            !lowpan_active_tx_handle_verify(handle, interface_ptr->active_broadcast_tx_buf.buf) &&
-            !lowpan_active_tx_handle_verify(handle, interface_ptr->active_lfn_broadcast_tx_buf.buf)) {
-            valid_info = true;
-        }
-    }
-    return handle;
+    // At most LOWPAN_ACTIVE_UNICAST_ONGOING_MAX + 2 handles are in use, so a
+    // free handle is found within a few iterations.
+    while (bittest(interface_ptr->msduHandle_used, interface_ptr->msduHandle))
+        interface_ptr->msduHandle++;
+    bitset(interface_ptr->msduHandle_used, interface_ptr->msduHandle);
+    return interface_ptr->msduHandle++;
+}
 
+static void lowpan_data_request_handle_release(fragmenter_interface_t *interface_ptr, uint8_t handle)
+{
+    BUG_ON(!bittest(interface_ptr->msduHandle_used, handle));
+    bitclr(interface_ptr->msduHandle_used, handle);
 }
 
 static void lowpan_list_entry_free(fragmenter_tx_list_t *list, fragmenter_tx_entry_t *entry)
@@ -280,22 +591,38 @@ static void lowpan_list_entry_free(fragmenter_tx_list_t *list, fragmenter_tx_ent
     if (entry->buf) {
         buffer_free(entry->buf);
     }
-    free(entry->fragmenter_buf);
     free(entry);
 }
 
-static void lowpan_list_free(fragmenter_tx_list_t *list, bool fragment_buf_free)
+static void lowpan_list_free(fragmenter_tx_list_t *list)
 {
     while (!ns_list_is_empty(list)) {
         fragmenter_tx_entry_t *entry = ns_list_get_first(list);
-        if (!fragment_buf_free) {
-            //We can't free this pointer becuase it must be until interface is deleted
-            entry->fragmenter_buf = NULL;
-        }
         lowpan_list_entry_free(list, entry);
     }
 }
 
+static void lowpan_adaptation_tx_queue_resume(fragmenter_interface_t *interface_ptr)
+{
+    struct net_if *cur = protocol_stack_interface_info_get_by_id(interface_ptr->interface_id);
+    buffer_t *buf;
+
+    while ((buf = lowpan_adaptation_tx_queue_read(cur, interface_ptr)))
+        lowpan_adaptation_interface_tx(cur, buf);
+}
+
+static void lowpan_adaptation_duty_cycle_timer_cb(struct timer_group *group, struct timer_entry *timer)
+{
+    lowpan_adaptation_tx_queue_resume(container_of(timer, fragmenter_interface_t, duty_cycle_timer));
+}
+
+static void lowpan_adaptation_lfn_tx_timer_cb(struct timer_group *group, struct timer_entry *timer)
+{
+    lowpan_adaptation_tx_queue_resume(container_of(timer, fragmenter_interface_t, lfn_tx_timer));
+}
+
+static void lowpan_adaptation_rfrag_timer_cb(struct timer_group *group, struct timer_entry *timer);
+
 void lowpan_adaptation_interface_init(int8_t interface_id)
 {
     fragmenter_interface_t *interface_ptr = zalloc(sizeof(fragmenter_interface_t));
@@ -305,8 +632,11 @@ void lowpan_adaptation_interface_init(int8_t interface_id)
     interface_ptr->interface_id = interface_id;
     interface_ptr->msduHandle = rand_get_8bit();
     interface_ptr->local_frag_tag = rand_get_16bit();
+    interface_ptr->duty_cycle_timer.callback = lowpan_adaptation_duty_cycle_timer_cb;
+    interface_ptr->lfn_tx_timer.callback = lowpan_adaptation_lfn_tx_timer_cb;
+    interface_ptr->rfrag_timer.callback = lowpan_adaptation_rfrag_timer_cb;
 
-    ns_list_init(&interface_ptr->directTxQueue);
+    ns_list_init(&interface_ptr->directTxFlows);
     ns_list_init(&interface_ptr->activeUnicastList);
 
     ns_list_add_to_end(&fragmenter_interface_list, interface_ptr);
@@ -322,16 +652,16 @@ int8_t lowpan_adaptation_interface_free(int8_t interface_id)
 
     ns_list_remove(&fragmenter_interface_list, interface_ptr);
     //free active tx process
-    lowpan_list_free(&interface_ptr->activeUnicastList, false);
+    lowpan_list_free(&interface_ptr->activeUnicastList);
     interface_ptr->activeTxList_size = 0;
     lowpan_active_buffer_state_reset(&interface_ptr->active_broadcast_tx_buf);
-    lowpan_active_buffer_state_reset(&interface_ptr->active_lfn_broadcast_tx_buf);
+    for (int i = 0; i < LOWPAN_ACTIVE_LFN_BROADCAST_MAX; i++)
+        lowpan_active_buffer_state_reset(&interface_ptr->active_lfn_broadcast_tx_buf[i]);
 
-    buffer_free_list(&interface_ptr->directTxQueue);
-    interface_ptr->directTxQueue_size = 0;
-    interface_ptr->directTxQueue_level = 0;
-    //Free Dynamic allocated entries
-    free(interface_ptr->fragment_indirect_tx_buffer);
+    lowpan_tx_flow_free_all(interface_ptr);
+    timer_stop(NULL, &interface_ptr->duty_cycle_timer);
+    timer_stop(NULL, &interface_ptr->lfn_tx_timer);
+    timer_stop(NULL, &interface_ptr->rfrag_timer);
     free(interface_ptr);
 
     return 0;
@@ -347,16 +677,18 @@ int8_t lowpan_adaptation_interface_reset(int8_t interface_id)
     }
 
     //free active tx process
-    lowpan_list_free(&interface_ptr->activeUnicastList, false);
+    lowpan_list_free(&interface_ptr->activeUnicastList);
     interface_ptr->activeTxList_size  = 0;
     lowpan_active_buffer_state_reset(&interface_ptr->active_broadcast_tx_buf);
-    lowpan_active_buffer_state_reset(&interface_ptr->active_lfn_broadcast_tx_buf);
+    for (int i = 0; i < LOWPAN_ACTIVE_LFN_BROADCAST_MAX; i++)
+        lowpan_active_buffer_state_reset(&interface_ptr->active_lfn_broadcast_tx_buf[i]);
+    memset(interface_ptr->msduHandle_used, 0, sizeof(interface_ptr->msduHandle_used));
     //Clean fragmented message flag
     interface_ptr->fragmenter_active = false;
+    timer_stop(NULL, &interface_ptr->rfrag_timer);
 
-    buffer_free_list(&interface_ptr->directTxQueue);
-    interface_ptr->directTxQueue_size = 0;
-    interface_ptr->directTxQueue_level = 0;
+    lowpan_tx_flow_free_all(interface_ptr);
+    memset(&interface_ptr->codel, 0, sizeof(interface_ptr->codel));
 
     return 0;
 }
@@ -394,27 +726,18 @@ void lowpan_adaptation_interface_mpx_register(int8_t interface_id, struct mpx_ap
     }
 }
 
-static fragmenter_tx_entry_t *lowpan_indirect_entry_allocate(uint16_t fragment_buffer_size)
+static fragmenter_tx_entry_t *lowpan_indirect_entry_allocate(void)
 {
     fragmenter_tx_entry_t *indirec_entry = malloc(sizeof(fragmenter_tx_entry_t));
     if (!indirec_entry) {
         return NULL;
     }
 
-    if (fragment_buffer_size) {
-        indirec_entry->fragmenter_buf = malloc(fragment_buffer_size);
-        if (!indirec_entry->fragmenter_buf) {
-            free(indirec_entry);
-            return NULL;
-        }
-    } else {
-        indirec_entry->fragmenter_buf = NULL;
-    }
-
-
     indirec_entry->buf = NULL;
     indirec_entry->fragmented_data = false;
     indirec_entry->first_fragment = true;
+    indirec_entry->rfrag = false;
+    indirec_entry->rfrag_wait_ack = false;
 
     return indirec_entry;
 }
@@ -486,9 +809,11 @@ static int8_t lowpan_message_fragmentation_init(buffer_t *buf, fragmenter_tx_ent
 /**
  * Return true when there is more fragmented packet for this message
  */
-static bool lowpan_message_fragmentation_message_write(const fragmenter_tx_entry_t *frag_entry, mcps_data_req_t *dataReq)
+static bool lowpan_message_fragmentation_message_write(fragmenter_tx_entry_t *frag_entry, mcps_data_req_t *dataReq)
 {
-    uint8_t *ptr = dataReq->msdu;
+    uint8_t *ptr = frag_entry->frag_hdr;
+
+    BUG_ON(frag_entry->unfrag_len + 5 > sizeof(frag_entry->frag_hdr));
     if (frag_entry->unfrag_len) {
         memcpy(ptr, frag_entry->buf->buf  + frag_entry->unfrag_ptr, frag_entry->unfrag_len);
         ptr += frag_entry->unfrag_len;
@@ -501,32 +826,103 @@ static bool lowpan_message_fragmentation_message_write(const fragmenter_tx_entry
         ptr = write_be16(ptr, frag_entry->tag);
         *ptr++ = frag_entry->offset;
     }
-    memcpy(ptr, buffer_data_pointer(frag_entry->buf), frag_entry->frag_len);
-    ptr += frag_entry->frag_len;
-    dataReq->msduLength = ptr - dataReq->msdu;
+    dataReq->msdu_prefix = frag_entry->frag_hdr;
+    dataReq->msdu_prefix_len = ptr - frag_entry->frag_hdr;
+    dataReq->msdu = buffer_data_pointer(frag_entry->buf);
+    dataReq->msduLength = frag_entry->frag_len;
     return frag_entry->offset * 8 + frag_entry->frag_len < frag_entry->size;
 }
 
+static int8_t lowpan_message_rfrag_init(buffer_t *buf, fragmenter_tx_entry_t *frag_entry, struct net_if *cur, fragmenter_interface_t *interface_ptr)
+{
+    uint16_t overhead = mac_helper_frame_overhead(cur, buf);
+    unsigned int count;
+
+    if (interface_ptr->mpx_api)
+        overhead += interface_ptr->mpx_api->mpx_headroom_size_get(interface_ptr->mpx_api, interface_ptr->mpx_user_id);
+    frag_entry->frag_max = cur->mac_parameters.mtu - overhead;
+    if (frag_entry->frag_max <= LOWPAN_RFRAG_HDR_LEN)
+        return -1;
+    frag_entry->size = buffer_data_length(buf);
+    if (frag_entry->size > LOWPAN_HARD_MTU_LIMIT)
+        return -1;
+    frag_entry->orig_size = frag_entry->size;
+    frag_entry->frag_len = MIN(frag_entry->frag_max - LOWPAN_RFRAG_HDR_LEN, LOWPAN_RFRAG_SIZE_MASK);
+    // The RFRAG-ACK bitmap limits the datagram to 32 fragments, larger
+    // datagrams use RFC 4944 fragments.
+    count = (frag_entry->size + frag_entry->frag_len - 1) / frag_entry->frag_len;
+    if (count > LOWPAN_RFRAG_SEQ_MAX + 1)
+        return -1;
+    frag_entry->unfrag_ptr = buf->buf_ptr;
+    frag_entry->unfrag_len = 0;
+    frag_entry->rfrag_count = count;
+    frag_entry->rfrag_missing = count > LOWPAN_RFRAG_SEQ_MAX ? LOWPAN_RFRAG_BITMAP_FULL
+                                                            : ~(LOWPAN_RFRAG_BITMAP_FULL >> count);
+    frag_entry->rfrag_seq = 0;
+    frag_entry->rfrag_rounds = 0;
+    frag_entry->rfrag_wait_ack = false;
+    frag_entry->fragmented_data = true;
+    frag_entry->rfrag = true;
+    return 0;
+}
+
+// Return the first fragment not acknowledged from seq, or rfrag_count
+static uint8_t lowpan_message_rfrag_next(const fragmenter_tx_entry_t *frag_entry, uint8_t seq)
+{
+    while (seq < frag_entry->rfrag_count && !(frag_entry->rfrag_missing & LOWPAN_RFRAG_BITMAP(seq)))
+        seq++;
+    return seq;
+}
+
+static void lowpan_message_rfrag_write(fragmenter_tx_entry_t *frag_entry, mcps_data_req_t *dataReq)
+{
+    uint16_t offset = frag_entry->rfrag_seq * frag_entry->frag_len;
+    uint16_t len = MIN(frag_entry->frag_len, frag_entry->size - offset);
+    uint8_t *ptr = frag_entry->frag_hdr;
+    uint16_t hdr;
+
+    hdr = FIELD_PREP(LOWPAN_RFRAG_SEQ_MASK, frag_entry->rfrag_seq) |
+          FIELD_PREP(LOWPAN_RFRAG_SIZE_MASK, len);
+    // The last fragment of the round requests an RFRAG-ACK
+    if (lowpan_message_rfrag_next(frag_entry, frag_entry->rfrag_seq + 1) == frag_entry->rfrag_count)
+        hdr |= LOWPAN_RFRAG_X_MASK;
+    *ptr++ = LOWPAN_RFRAG;
+    *ptr++ = frag_entry->tag;
+    ptr = write_be16(ptr, hdr);
+    ptr = write_be16(ptr, frag_entry->rfrag_seq ? offset : frag_entry->size);
+    dataReq->msdu_prefix = frag_entry->frag_hdr;
+    dataReq->msdu_prefix_len = ptr - frag_entry->frag_hdr;
+    dataReq->msdu = buffer_data_pointer(frag_entry->buf) + offset;
+    dataReq->msduLength = len;
+}
+
+static fragmenter_tx_entry_t *lowpan_active_lfn_broadcast_free(fragmenter_interface_t *interface_ptr)
+{
+    for (int i = 0; i < LOWPAN_ACTIVE_LFN_BROADCAST_MAX; i++)
+        if (!interface_ptr->active_lfn_broadcast_tx_buf[i].buf)
+            return &interface_ptr->active_lfn_broadcast_tx_buf[i];
+    return NULL;
+}
+
 static fragmenter_tx_entry_t *lowpan_adaptation_tx_process_init(fragmenter_interface_t *interface_ptr,
                                                                 bool is_unicast, bool lfn_multicast)
 {
-    // For broadcast, the active TX queue is only 1 entry. For unicast, using a list.
+    // For FFN broadcast, the active TX queue is only 1 entry, for LFN broadcast
+    // an array. For unicast, using a list.
     fragmenter_tx_entry_t *tx_entry;
 
     if (is_unicast) {
-        tx_entry = lowpan_indirect_entry_allocate(0);
+        tx_entry = lowpan_indirect_entry_allocate();
         if (!tx_entry) {
             return NULL;
         }
         ns_list_add_to_end(&interface_ptr->activeUnicastList, tx_entry);
         interface_ptr->activeTxList_size++;
     } else if (lfn_multicast) {
-        tx_entry = &interface_ptr->active_lfn_broadcast_tx_buf;
+        tx_entry = lowpan_active_lfn_broadcast_free(interface_ptr);
     } else {
         tx_entry = &interface_ptr->active_broadcast_tx_buf;
     }
-    tx_entry->fragmenter_buf = interface_ptr->fragment_indirect_tx_buffer;
-
     if (!tx_entry) {
         return NULL;
     }
@@ -606,9 +1002,16 @@ static void lowpan_data_request_to_mac(struct net_if *cur, buffer_t *buf, fragme
     mcps_data_req_t dataReq;
 
     BUG_ON(!interface_ptr->mpx_api);
+    buf->tx_stage_us[BUFFER_TX_STAGE_MAC] = time_now_us(CLOCK_MONOTONIC);
+    if (!buf->tx_stage_us[BUFFER_TX_STAGE_MAC_FIRST]) {
+        buf->tx_stage_us[BUFFER_TX_STAGE_MAC_FIRST] = buf->tx_stage_us[BUFFER_TX_STAGE_MAC];
+        wsbr_metrics_tx_latency(WSBR_TX_LATENCY_QUEUE, buf->tx_stage_us[BUFFER_TX_STAGE_ADAPTATION],
+                                buf->tx_stage_us[BUFFER_TX_STAGE_MAC]);
+    }
     lowpan_adaptation_data_request_primitiv_set(buf, &dataReq, cur);
-    if (tx_ptr->fragmented_data) {
-        dataReq.msdu = tx_ptr->fragmenter_buf;
+    if (tx_ptr->rfrag) {
+        lowpan_message_rfrag_write(tx_ptr, &dataReq);
+    } else if (tx_ptr->fragmented_data) {
         lowpan_message_fragmentation_message_write(tx_ptr, &dataReq);
     } else {
         dataReq.msduLength = buffer_data_length(buf);
@@ -616,6 +1019,7 @@ static void lowpan_data_request_to_mac(struct net_if *cur, buffer_t *buf, fragme
     }
 
     dataReq.lfn_multicast = buf->options.lfn_multicast;
+    dataReq.fragment = tx_ptr->fragmented_data;
     interface_ptr->mpx_api->mpx_data_request(interface_ptr->mpx_api, &dataReq, interface_ptr->mpx_user_id);
 }
 
@@ -631,7 +1035,44 @@ static bool lowpan_adaptation_is_destination_tx_active(fragmenter_tx_list_t *lis
     return false;
 }
 
-static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, buffer_t *buf)
+// Return the delay before the start of the next listening window of an LFN,
+// 0 if its timing is unknown.
+static uint64_t lowpan_lfn_listen_delay_ms(struct net_if *cur, const struct ws_neigh *ws_neigh)
+{
+    const struct ws_neigh_fhss *fhss_data = &ws_neigh->fhss_data_unsecured;
+    uint64_t interval_us = (uint64_t)fhss_data->lfn.uc_listen_interval_ms * 1000;
+    uint64_t now_us = time_now_us(CLOCK_MONOTONIC);
+    uint64_t ref_us;
+
+    // Reference point: start of the listening slot in which the LUTT-IE was sent
+    ref_us = rcp_clock_to_host_us(cur->rcp, fhss_data->lfn.lutt_rx_tstamp_us);
+    if (!interval_us || !ref_us)
+        return 0;
+    ref_us -= (uint64_t)fhss_data->lfn.uc_interval_offset_ms * 1000;
+    if (now_us <= ref_us)
+        return (ref_us - now_us) / 1000;
+    return (interval_us - (now_us - ref_us) % interval_us) / 1000;
+}
+
+static bool lowpan_lfn_tx_hold(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
+{
+    struct ws_neigh *ws_neigh = ws_neigh_get(&cur->ws_info.neighbor_storage, buf->dst_sa.address + PAN_ID_LEN);
+    uint64_t delay_ms;
+
+    if (!ws_neigh || ws_neigh->node_role != WS_NR_ROLE_LFN)
+        return false;
+    delay_ms = lowpan_lfn_listen_delay_ms(cur, ws_neigh);
+    if (delay_ms <= LOWPAN_LFN_TX_LEAD_MS)
+        return false;
+    delay_ms -= LOWPAN_LFN_TX_LEAD_MS;
+    // The timer is set to the earliest release
+    if (timer_stopped(&interface_ptr->lfn_tx_timer) ||
+        interface_ptr->lfn_tx_timer.expire_ms > time_cached_ms() + delay_ms)
+        timer_start_rel(NULL, &interface_ptr->lfn_tx_timer, delay_ms);
+    return true;
+}
+
+static bool lowpan_buffer_tx_allowed(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
 {
     bool is_unicast = buf->link_specific.ieee802_15_4.requestAck;
 
@@ -640,11 +1081,11 @@ static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, buff
         TRACE(TR_QUEUE, "queue: tx not allowed: fragmented tx in progress");
         return false;
     }
-    // Do not accept more than one active broadcast TX
+    // Do not accept more than one active FFN broadcast TX
     if (!is_unicast) {
-        if (buf->options.lfn_multicast && interface_ptr->active_lfn_broadcast_tx_buf.buf) {
-            TRACE(TR_QUEUE, "queue: tx not allowed: lfn broadcast frame with handle %u already in MAC",
-                  interface_ptr->active_lfn_broadcast_tx_buf.buf->seq);
+        if (buf->options.lfn_multicast && !lowpan_active_lfn_broadcast_free(interface_ptr)) {
+            TRACE(TR_QUEUE, "queue: tx not allowed: %u lfn broadcast frames already in MAC",
+                  LOWPAN_ACTIVE_LFN_BROADCAST_MAX);
             return false;
         }
         if (!buf->options.lfn_multicast && interface_ptr->active_broadcast_tx_buf.buf) {
@@ -654,6 +1095,11 @@ static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, buff
         }
     }
 
+    if (is_unicast && lowpan_tx_class(buf) != LOWPAN_TX_CLASS_CONTROL &&
+        interface_ptr->activeTxList_size >= LOWPAN_ACTIVE_UNICAST_ONGOING_MAX - LOWPAN_ACTIVE_UNICAST_CONTROL_RESERVED) {
+        TRACE(TR_QUEUE, "queue: tx not allowed: remaining tx reserved to control frames");
+        return false;
+    }
     if (is_unicast && interface_ptr->activeTxList_size >= LOWPAN_ACTIVE_UNICAST_ONGOING_MAX) {
         TRACE(TR_QUEUE, "queue: tx not allowed: too many active tx");
         //New TX is not possible there is already too manyactive connecting
@@ -667,13 +1113,30 @@ static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, buff
               tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
         return false;
     }
+
+    if (is_unicast && lowpan_lfn_tx_hold(cur, interface_ptr, buf)) {
+        TRACE(TR_QUEUE, "queue: tx not allowed: lfn not listening dst:%s",
+              tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
+        return false;
+    }
+
+    // Data frames wait in the queue, where the AQM and the buffer age limits
+    // still apply, until some airtime leaves the duty cycle window.
+    if (lowpan_tx_class(buf) != LOWPAN_TX_CLASS_CONTROL &&
+        duty_cycle_above(&cur->ws_info.duty_cycle, WS_DUTY_CYCLE_SHAPING_PERMILLE)) {
+        TRACE(TR_QUEUE, "queue: tx not allowed: duty cycle budget almost exhausted");
+        if (timer_stopped(&interface_ptr->duty_cycle_timer))
+            timer_start_rel(NULL, &interface_ptr->duty_cycle_timer,
+                            duty_cycle_release_ms(&cur->ws_info.duty_cycle));
+        return false;
+    }
     return true;
 }
 
 static bool lowpan_adaptation_interface_check_buffer_timeout(struct net_if *cur, buffer_t *buf)
 {
     // Convert from 100ms slots to seconds
-    uint32_t buffer_age_s = (g_monotonic_time_100ms - buf->adaptation_timestamp) / 10;
+    uint32_t buffer_age_s = (ws_timer_monotonic_100ms() - buf->adaptation_timestamp) / 10;
     int lfn_bc_interval_s = cur->ws_info.fhss_config.lfn_bc_interval / 1000;
     struct ws_neigh *ws_neigh;
     int lfn_uc_l_interval_s;
@@ -693,6 +1156,13 @@ static bool lowpan_adaptation_interface_check_buffer_timeout(struct net_if *cur,
     return buffer_age_s > LOWPAN_TX_BUFFER_AGE_LIMIT_LOW_PRIORITY;
 }
 
+const struct lowpan_aqm_stats *lowpan_adaptation_aqm_stats(int8_t interface_id)
+{
+    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
+
+    return interface_ptr ? &interface_ptr->aqm_stats : NULL;
+}
+
 int lowpan_adaptation_queue_size(int8_t interface_id)
 {
     fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
@@ -700,6 +1170,13 @@ int lowpan_adaptation_queue_size(int8_t interface_id)
     return interface_ptr ? interface_ptr->directTxQueue_size : 0;
 }
 
+size_t lowpan_adaptation_queue_bytes(int8_t interface_id)
+{
+    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
+
+    return interface_ptr ? interface_ptr->directTxQueue_bytes : 0;
+}
+
 int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
 {
     if (!buf) {
@@ -717,37 +1194,48 @@ int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
 
     if (!buf->adaptation_timestamp) {
         // Set TX start timestamp
-        buf->adaptation_timestamp = g_monotonic_time_100ms;
+        buf->tx_stage_us[BUFFER_TX_STAGE_ADAPTATION] = time_now_us(CLOCK_MONOTONIC);
+        buf->adaptation_timestamp = ws_timer_monotonic_100ms();
         if (!buf->adaptation_timestamp) {
             buf->adaptation_timestamp--;
         }
     } else if (lowpan_adaptation_interface_check_buffer_timeout(cur, buf)) {
         TRACE(TR_TX_ABORT, "tx-abort: buffer timed out dst:%s", tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
+        if (lowpan_tx_is_lfn(cur, buf))
+            interface_ptr->aqm_stats.lfn_expired_count++;
         goto tx_error_handler;
     }
 
     //Check packet size
     bool fragmented_needed = lowpan_adaptation_request_longer_than_mtu(cur, buf, interface_ptr);
-    if (fragmented_needed) {
-        // If fragmentation TX buffer not allocated, do it now.
-        if (!interface_ptr->fragment_indirect_tx_buffer)
-            interface_ptr->fragment_indirect_tx_buffer = xalloc(cur->mac_parameters.mtu);
-    }
     bool is_unicast = buf->link_specific.ieee802_15_4.requestAck;
+    struct ws_neigh *ws_neigh;
+    lowpan_tx_flow_t *flow;
 
-    if (!lowpan_buffer_tx_allowed(interface_ptr, buf)) {
+    if (!lowpan_buffer_tx_allowed(cur, interface_ptr, buf)) {
 
-        if (red_congestion_check(&cur->random_early_detection)) {
-            WARN("congestion detected: dropping oldest packet");
-            // If we need to drop packet we drop oldest normal Priority packet.
-            buffer_t *dropped = ns_list_get_first(&interface_ptr->directTxQueue);
-            if (dropped) {
-                TRACE(TR_TX_ABORT, "tx-abort: congestion detected dst:%s",
-                      tr_eui64(dropped->dst_sa.address + PAN_ID_LEN));
-                ns_list_remove(&interface_ptr->directTxQueue, dropped);
-                interface_ptr->directTxQueue_size--;
-                buffer_free(dropped);
+        if (cur->aqm == LOWPAN_AQM_RED) {
+            if (red_congestion_check(&cur->random_early_detection)) {
+                WARN("congestion detected: dropping oldest packet");
+                if (lowpan_adaptation_tx_queue_drop(cur, interface_ptr))
+                    interface_ptr->aqm_stats.red_drop_count++;
             }
+        } else if (interface_ptr->directTxQueue_size >= cur->random_early_detection.threshold_max) {
+            // CoDel only acts on dequeue, the queue is still bounded
+            WARN("queue full: dropping oldest packet");
+            if (lowpan_adaptation_tx_queue_drop(cur, interface_ptr))
+                interface_ptr->aqm_stats.overlimit_drop_count++;
+        }
+        flow = lowpan_tx_flow_find(interface_ptr, buf);
+        if (is_unicast && flow && flow->queue_size >= LOWPAN_LFN_QUEUE_MAX && lowpan_tx_is_lfn(cur, buf)) {
+            TRACE(TR_TX_ABORT, "tx-abort: lfn queue full dst:%s", tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
+            interface_ptr->aqm_stats.lfn_limit_drop_count++;
+            goto tx_error_handler;
+        }
+        if (interface_ptr->directTxQueue_class_size[lowpan_tx_class(buf)] >= lowpan_tx_class_size_max[lowpan_tx_class(buf)]) {
+            TRACE(TR_TX_ABORT, "tx-abort: queue lane full dst:%s", tr_eui64(buf->dst_sa.address + PAN_ID_LEN));
+            interface_ptr->aqm_stats.lane_drop_count++;
+            goto tx_error_handler;
         }
         lowpan_adaptation_tx_queue_write(cur, interface_ptr, buf);
         return 0;
@@ -759,20 +1247,26 @@ int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
     fragmenter_tx_entry_t *tx_ptr = lowpan_adaptation_tx_process_init(interface_ptr, is_unicast,
                                                                       buf->options.lfn_multicast);
     if (!tx_ptr) {
+        lowpan_data_request_handle_release(interface_ptr, buf->seq);
         goto tx_error_handler;
     }
 
     tx_ptr->buf = buf;
 
     if (fragmented_needed) {
-        //Fragmentation init
-        if (lowpan_message_fragmentation_init(buf, tx_ptr, cur, interface_ptr)) {
-            lowpan_adaptation_data_process_clean(interface_ptr, tx_ptr);
-            return -1;
-        }
+        ws_neigh = is_unicast ? ws_neigh_get(&cur->ws_info.neighbor_storage, buf->dst_sa.address + PAN_ID_LEN) : NULL;
+        if (ws_neigh && ws_neigh->sfr && !lowpan_message_rfrag_init(buf, tx_ptr, cur, interface_ptr)) {
+            tx_ptr->tag = interface_ptr->local_frag_tag++;
+        } else {
+            //Fragmentation init
+            if (lowpan_message_fragmentation_init(buf, tx_ptr, cur, interface_ptr)) {
+                lowpan_adaptation_data_process_clean(interface_ptr, tx_ptr);
+                return -1;
+            }
 
-        tx_ptr->tag = interface_ptr->local_frag_tag++;
-        interface_ptr->fragmenter_active = true;
+            tx_ptr->tag = interface_ptr->local_frag_tag++;
+            interface_ptr->fragmenter_active = true;
+        }
     }
 
     lowpan_data_request_to_mac(cur, buf, tx_ptr, interface_ptr);
@@ -820,6 +1314,9 @@ static void lowpan_adaptation_data_process_clean(fragmenter_interface_t *interfa
     buffer_t *buf = tx_ptr->buf;
 
     tx_ptr->buf = NULL;
+    wsbr_metrics_tx_latency(WSBR_TX_LATENCY_TOTAL, buf->tx_stage_us[BUFFER_TX_STAGE_TUN],
+                            time_now_us(CLOCK_MONOTONIC));
+    lowpan_data_request_handle_release(interface_ptr, buf->seq);
     if (buf->link_specific.ieee802_15_4.requestAck) {
         ns_list_remove(&interface_ptr->activeUnicastList, tx_ptr);
         free(tx_ptr);
@@ -828,6 +1325,116 @@ static void lowpan_adaptation_data_process_clean(fragmenter_interface_t *interfa
     buffer_free(buf);
 }
 
+static void lowpan_adaptation_rfrag_timer_update(fragmenter_interface_t *interface_ptr)
+{
+    uint64_t deadline_ms = UINT64_MAX;
+
+    ns_list_foreach(fragmenter_tx_entry_t, entry, &interface_ptr->activeUnicastList)
+        if (entry->rfrag && entry->rfrag_wait_ack)
+            deadline_ms = MIN(deadline_ms, entry->rfrag_ack_deadline_ms);
+    if (deadline_ms == UINT64_MAX)
+        timer_stop(NULL, &interface_ptr->rfrag_timer);
+    else
+        timer_start_abs(NULL, &interface_ptr->rfrag_timer, deadline_ms);
+}
+
+// Send again the fragments not acknowledged
+static void lowpan_adaptation_rfrag_round(struct net_if *cur, fragmenter_interface_t *interface_ptr,
+                                          fragmenter_tx_entry_t *tx_ptr)
+{
+    tx_ptr->rfrag_wait_ack = false;
+    if (tx_ptr->rfrag_missing && tx_ptr->rfrag_rounds >= LOWPAN_RFRAG_ROUNDS_MAX)
+        TRACE(TR_TX_ABORT, "tx-abort: rfrag not acknowledged dst:%s",
+              tr_eui64(tx_ptr->buf->dst_sa.address + PAN_ID_LEN));
+    if (!tx_ptr->rfrag_missing || tx_ptr->rfrag_rounds >= LOWPAN_RFRAG_ROUNDS_MAX) {
+        lowpan_adaptation_data_process_clean(interface_ptr, tx_ptr);
+        return;
+    }
+    tx_ptr->rfrag_rounds++;
+    tx_ptr->rfrag_seq = lowpan_message_rfrag_next(tx_ptr, 0);
+    lowpan_data_request_to_mac(cur, tx_ptr->buf, tx_ptr, interface_ptr);
+}
+
+static void lowpan_adaptation_rfrag_timer_cb(struct timer_group *group, struct timer_entry *timer)
+{
+    fragmenter_interface_t *interface_ptr = container_of(timer, fragmenter_interface_t, rfrag_timer);
+    struct net_if *cur = protocol_stack_interface_info_get_by_id(interface_ptr->interface_id);
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+
+    ns_list_foreach_safe(fragmenter_tx_entry_t, entry, &interface_ptr->activeUnicastList)
+        if (entry->rfrag && entry->rfrag_wait_ack && entry->rfrag_ack_deadline_ms <= now_ms)
+            lowpan_adaptation_rfrag_round(cur, interface_ptr, entry);
+    lowpan_adaptation_rfrag_timer_update(interface_ptr);
+    lowpan_adaptation_tx_queue_resume(interface_ptr);
+}
+
+// Whatever the status of the confirmation, the next fragment of the round is
+// sent: the lost fragments will be reported by the RFRAG-ACK.
+static void lowpan_adaptation_rfrag_confirm(struct net_if *cur, fragmenter_interface_t *interface_ptr,
+                                            fragmenter_tx_entry_t *tx_ptr)
+{
+    tx_ptr->rfrag_seq = lowpan_message_rfrag_next(tx_ptr, tx_ptr->rfrag_seq + 1);
+    if (!tx_ptr->rfrag_missing) {
+        lowpan_adaptation_data_process_clean(interface_ptr, tx_ptr);
+    } else if (tx_ptr->rfrag_seq < tx_ptr->rfrag_count) {
+        lowpan_data_request_to_mac(cur, tx_ptr->buf, tx_ptr, interface_ptr);
+    } else {
+        tx_ptr->rfrag_wait_ack = true;
+        tx_ptr->rfrag_ack_deadline_ms = time_now_ms(CLOCK_MONOTONIC) + LOWPAN_RFRAG_ACK_TIMEOUT_MS;
+        lowpan_adaptation_rfrag_timer_update(interface_ptr);
+    }
+}
+
+static void lowpan_adaptation_rfrag_ack_recv(struct net_if *cur, fragmenter_interface_t *interface_ptr,
+                                             const uint8_t src[8], const uint8_t *data, uint16_t data_len)
+{
+    fragmenter_tx_entry_t *tx_ptr = NULL;
+    uint32_t bitmap;
+
+    if (!interface_ptr || data_len < LOWPAN_RFRAG_ACK_LEN)
+        return;
+    bitmap = read_be32(data + 2);
+    ns_list_foreach(fragmenter_tx_entry_t, entry, &interface_ptr->activeUnicastList)
+        if (entry->rfrag && (uint8_t)entry->tag == data[1] &&
+            !memcmp(entry->buf->dst_sa.address + PAN_ID_LEN, src, 8))
+            tx_ptr = entry;
+    if (!tx_ptr)
+        return;
+    if (bitmap == LOWPAN_RFRAG_BITMAP_NULL) {
+        TRACE(TR_TX_ABORT, "tx-abort: rfrag aborted by dst:%s", tr_eui64(src));
+        tx_ptr->rfrag_missing = 0;
+    } else {
+        tx_ptr->rfrag_missing &= ~bitmap;
+    }
+    // Otherwise, the round in progress ends with a new RFRAG-ACK request
+    if (tx_ptr->rfrag_wait_ack) {
+        lowpan_adaptation_rfrag_round(cur, interface_ptr, tx_ptr);
+        lowpan_adaptation_rfrag_timer_update(interface_ptr);
+        lowpan_adaptation_tx_queue_resume(interface_ptr);
+    }
+}
+
+static void lowpan_adaptation_rfrag_ack_send(struct net_if *cur, const buffer_t *frag,
+                                             const struct cipv6_rfrag_ack *ack)
+{
+    uint8_t data[LOWPAN_RFRAG_ACK_LEN];
+    buffer_t *buf;
+
+    data[0] = LOWPAN_RFRAG_ACK;
+    data[1] = ack->tag;
+    write_be32(data + 2, ack->bitmap);
+    buf = buffer_get(sizeof(data));
+    buffer_data_add(buf, data, sizeof(data));
+    buf->dst_sa = frag->src_sa;
+    buf->src_sa.addr_type = ADDR_802_15_4_LONG;
+    write_be16(buf->src_sa.address, cur->ws_info.pan_information.pan_id);
+    memcpy(buf->src_sa.address + PAN_ID_LEN, cur->mac, 8);
+    buf->interface = cur;
+    buf->options.tx_lane = BUFFER_TX_LANE_CONTROL;
+    buf->info = (buffer_info_t)(B_FROM_IPV6_TXRX | B_TO_MAC | B_DIR_DOWN);
+    protocol_push(buf);
+}
+
 static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const mcps_data_cnf_t *confirm)
 {
     if (!cur || !confirm) {
@@ -840,12 +1447,14 @@ static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const m
     }
 
     //Check first
-    fragmenter_tx_entry_t *tx_ptr;
+    fragmenter_tx_entry_t *tx_ptr = NULL;
+    for (int i = 0; i < LOWPAN_ACTIVE_LFN_BROADCAST_MAX; i++)
+        if (lowpan_active_tx_handle_verify(confirm->hif.handle, interface_ptr->active_lfn_broadcast_tx_buf[i].buf))
+            tx_ptr = &interface_ptr->active_lfn_broadcast_tx_buf[i];
     if (lowpan_active_tx_handle_verify(confirm->hif.handle, interface_ptr->active_broadcast_tx_buf.buf)) {
         tx_ptr = &interface_ptr->active_broadcast_tx_buf;
         BUG_ON(tx_ptr->buf->link_specific.ieee802_15_4.requestAck);
-    } else if (lowpan_active_tx_handle_verify(confirm->hif.handle, interface_ptr->active_lfn_broadcast_tx_buf.buf)) {
-        tx_ptr = &interface_ptr->active_lfn_broadcast_tx_buf;
+    } else if (tx_ptr) {
         BUG_ON(tx_ptr->buf->link_specific.ieee802_15_4.requestAck);
     } else {
         tx_ptr = lowpan_listed_tx_handle_verify(confirm->hif.handle, &interface_ptr->activeUnicastList);
@@ -857,8 +1466,12 @@ static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const m
         return -1;
     }
     buffer_t *buf = tx_ptr->buf;
+    uint64_t now_us = time_now_us(CLOCK_MONOTONIC);
 
-    if (confirm->hif.status == HIF_STATUS_SUCCESS) {
+    wsbr_metrics_tx_latency(WSBR_TX_LATENCY_RCP, buf->tx_stage_us[BUFFER_TX_STAGE_MAC], now_us);
+    if (tx_ptr->rfrag) {
+        lowpan_adaptation_rfrag_confirm(cur, interface_ptr, tx_ptr);
+    } else if (confirm->hif.status == HIF_STATUS_SUCCESS) {
         //Check is there more packets
         if (lowpan_adaptation_tx_process_ready(tx_ptr)) {
             if (tx_ptr->fragmented_data)
@@ -869,6 +1482,7 @@ static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const m
         }
     } else {
         if (buf->link_specific.ieee802_15_4.requestAck && confirm->hif.status == HIF_STATUS_TIMEDOUT) {
+            lowpan_data_request_handle_release(interface_ptr, buf->seq);
             lowpan_adaptation_tx_queue_write_to_front(cur, interface_ptr, buf);
             ns_list_remove(&interface_ptr->activeUnicastList, tx_ptr);
             free(tx_ptr);
@@ -898,12 +1512,33 @@ static bool mac_data_is_broadcast_addr(const sockaddr_t *addr)
 
 static void lowpan_adaptation_interface_data_ind(struct net_if *cur, const mcps_data_ind_t *data_ind)
 {
-    buffer_t *buf = buffer_get(data_ind->msduLength);
-    if (!buf || !cur) {
+    // Subsequent fragments and RFRAGs are copied straight from the indication
+    // into the reassembly buffer, buf then only carries the link metadata.
+    bool fragn = cipv6_frag_is_fragn(data_ind->msdu_ptr, data_ind->msduLength);
+    bool rfrag = cipv6_frag_is_rfrag(data_ind->msdu_ptr, data_ind->msduLength);
+    struct cipv6_rfrag_ack rfrag_ack;
+    struct ws_neigh *ws_neigh;
+    buffer_t *buf;
+    buffer_t *datagram = NULL;
+    if (!cur) {
+        return;
+    }
+    if (data_ind->Key.SecurityLevel && data_ind->SrcAddrMode == IEEE802154_ADDR_MODE_64_BIT &&
+        data_ind->msduLength && (data_ind->msdu_ptr[0] & LOWPAN_RFRAG_MASK) == LOWPAN_RFRAG_ACK) {
+        ws_neigh = ws_neigh_get(&cur->ws_info.neighbor_storage, data_ind->SrcAddr);
+        if (ws_neigh)
+            ws_neigh->sfr = true;
+        lowpan_adaptation_rfrag_ack_recv(cur, lowpan_adaptation_interface_discover(cur->id),
+                                         data_ind->SrcAddr, data_ind->msdu_ptr, data_ind->msduLength);
+        return;
+    }
+    buf = fragn || rfrag ? buffer_get_minimal(0) : buffer_get(data_ind->msduLength);
+    if (!buf) {
         return;
     }
     uint8_t *ptr;
-    buffer_data_add(buf, data_ind->msdu_ptr, data_ind->msduLength);
+    if (!fragn && !rfrag)
+        buffer_data_add(buf, data_ind->msdu_ptr, data_ind->msduLength);
     //tr_debug("MAC Paylod size %u %s",data_ind->msduLength, tr_eui64(data_ind->msdu_ptr));
     buf->src_sa.addr_type = (addrtype_e)data_ind->SrcAddrMode;
     ptr = write_be16(buf->src_sa.address, data_ind->SrcPANId);
@@ -935,6 +1570,29 @@ static void lowpan_adaptation_interface_data_ind(struct net_if *cur, const mcps_
         buf->options.ll_security_bypass_rx = true;
     }
 
+    if (fragn) {
+        if (lowpan_up_addr_valid(buf))
+            datagram = cipv6_frag_reassembly_fragn(cur->id, buf, data_ind->msdu_ptr, data_ind->msduLength);
+        buffer_free(buf);
+        protocol_push(datagram);
+        return;
+    }
+    if (rfrag) {
+        // An RFRAG can only have been sent by a node supporting RFRAG-ACKs
+        ws_neigh = ws_neigh_get(&cur->ws_info.neighbor_storage, data_ind->SrcAddr);
+        if (ws_neigh && data_ind->Key.SecurityLevel)
+            ws_neigh->sfr = true;
+        if (lowpan_up_addr_valid(buf)) {
+            datagram = cipv6_frag_reassembly_rfrag(cur->id, buf, data_ind->msdu_ptr, data_ind->msduLength,
+                                                   &rfrag_ack);
+            if (rfrag_ack.send)
+                lowpan_adaptation_rfrag_ack_send(cur, buf, &rfrag_ack);
+        }
+        buffer_free(buf);
+        protocol_push(datagram);
+        return;
+    }
+
     buf->info = (buffer_info_t)(B_TO_IPV6_TXRX | B_FROM_MAC | B_DIR_UP);
     protocol_push(buf);
 }
@@ -984,17 +1642,26 @@ int8_t lowpan_adaptation_free_messages_from_queues_by_address(struct net_if *cur
     }
 
     //Check next directTxQueue there may be pending packets also
-    ns_list_foreach_safe(buffer_t, entry, &interface_ptr->directTxQueue) {
-        if (lowpan_tx_buffer_address_compare(&entry->dst_sa, address_ptr, adr_type)) {
-            TRACE(TR_TX_ABORT, "tx-abort: associated neighbor deleted dst:%s",
-                  tr_eui64(entry->dst_sa.address + PAN_ID_LEN));
-            ns_list_remove(&interface_ptr->directTxQueue, entry);
-            interface_ptr->directTxQueue_size--;
-            //Update Average QUEUE
-            lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
-            buffer_free(entry);
+    ns_list_foreach_safe(lowpan_tx_flow_t, flow, &interface_ptr->directTxFlows) {
+        for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++) {
+            ns_list_foreach_safe(buffer_t, entry, &flow->queue[i]) {
+                if (!lowpan_tx_buffer_address_compare(&entry->dst_sa, address_ptr, adr_type))
+                    continue;
+                TRACE(TR_TX_ABORT, "tx-abort: associated neighbor deleted dst:%s",
+                      tr_eui64(entry->dst_sa.address + PAN_ID_LEN));
+                ns_list_remove(&flow->queue[i], entry);
+                flow->queue_size--;
+                interface_ptr->directTxQueue_size--;
+                buffer_free(entry);
+            }
+        }
+        if (!flow->queue_size) {
+            ns_list_remove(&interface_ptr->directTxFlows, flow);
+            free(flow);
         }
     }
+    //Update Average QUEUE
+    lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
 
     return 0;
 }
@@ -18,6 +18,7 @@
 
 #ifndef LOWPAN_ADAPTATION_INTERFACE_H_
 #define LOWPAN_ADAPTATION_INTERFACE_H_
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -29,6 +30,22 @@ struct mpx_api;
 enum buffer_priority;
 typedef enum addrtype addrtype_e;
 
+// Active queue management of the TX queue, see queue_management in wsbrd.conf
+enum lowpan_aqm {
+    LOWPAN_AQM_RED,
+    LOWPAN_AQM_CODEL,
+    LOWPAN_AQM_FQ_CODEL,
+};
+
+struct lowpan_aqm_stats {
+    uint64_t red_drop_count;       // Dropped on enqueue by RED
+    uint64_t codel_drop_count;     // Dropped on dequeue by CoDel
+    uint64_t overlimit_drop_count; // Dropped on enqueue, queue full (CoDel)
+    uint64_t lane_drop_count;      // Dropped on enqueue, lane full
+    uint64_t lfn_limit_drop_count; // Dropped on enqueue, LFN destination queue full
+    uint64_t lfn_expired_count;    // LFN frames which timed out in the queue
+};
+
 void lowpan_adaptation_interface_init(int8_t interface_id);
 
 int8_t lowpan_adaptation_interface_free(int8_t interface_id);
@@ -38,6 +55,8 @@ int8_t lowpan_adaptation_interface_reset(int8_t interface_id);
 void lowpan_adaptation_interface_mpx_register(int8_t interface_id, struct mpx_api *mpx_api, uint16_t mpx_user_id);
 
 int lowpan_adaptation_queue_size(int8_t interface_id);
+size_t lowpan_adaptation_queue_bytes(int8_t interface_id);
+const struct lowpan_aqm_stats *lowpan_adaptation_aqm_stats(int8_t interface_id);
 
 /**
  * \brief call this before normal TX. This function prepare buffer link specific metadata and verify packet destination
@@ -12,6 +12,7 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _GNU_SOURCE
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,7 @@
 
 #include "commandline_values.h"
 #include "wsbr_cfg.h"
+#include "wsbr_pan_load.h"
 #include "wsbrd.h"
 
 #include "commandline.h"
@@ -54,6 +56,10 @@ static const struct number_limit valid_broadcast_interval = {
     100, 0xFFFFFF
 };
 
+static const struct number_limit valid_broadcast_interval_min = {
+    0, 0xFFFFFF
+};
+
 static const struct number_limit valid_lfn_broadcast_interval = {
     10000, 600000 // 10s-10min
 };
@@ -62,6 +68,10 @@ static const struct number_limit valid_lfn_broadcast_sync_period = {
     1, 60
 };
 
+static const struct number_limit valid_lfn_mcast_unicast_max = {
+    0, UINT8_MAX
+};
+
 static const struct number_limit valid_lowpan_mtu = {
     LOWPAN_MTU_MIN, LOWPAN_MTU_MAX
 };
@@ -72,6 +82,47 @@ static const struct number_limit valid_pan_id = {
     0, 0xfffe
 };
 
+static const struct number_limit valid_tls_workers = {
+    0, 64
+};
+
+// Also used for tun_workers
+static const struct number_limit valid_lowpan_workers = {
+    0, 16
+};
+
+static const struct number_limit valid_active_supp_max = {
+    0, UINT16_MAX
+};
+
+static const struct number_limit valid_dhcp_pool_size = {
+    0, 1 << 20
+};
+
+static const struct number_limit valid_radius_sockets = {
+    1, AUTH_RADIUS_SOCK_MAX
+};
+
+static const struct number_limit valid_tls_session_cache_size = {
+    0, UINT16_MAX
+};
+
+static const struct number_limit valid_eap_tls_fragment_size = {
+    64, WS_MTU_BYTES
+};
+
+static const struct number_limit valid_chan_excl_threshold = {
+    0, 100 // percent
+};
+
+static const struct number_limit valid_chan_excl_period = {
+    60, 86400 // 1min-1day
+};
+
+static const struct number_limit valid_duty_cycle_budget = {
+    0, 1000 // permille
+};
+
 void print_help_br(FILE *stream) {
     fprintf(stream, "\n");
     fprintf(stream, "Start Wi-SUN border router\n");
@@ -118,7 +169,10 @@ void print_help_br(FILE *stream) {
     fprintf(stream, "Debug:\n");
     fprintf(stream, "  --capture=FILE        Record raw data received on UART and network interfaces, and save it\n");
     fprintf(stream, "                          to FILE. Also record timer ticks, and use a predicable RNG for\n");
-    fprintf(stream, "                          replay using wsbrd-fuzz.\n");
+    fprintf(stream, "                          replay using wsbrd-fuzz. FILE is compressed with zstd if its name\n");
+    fprintf(stream, "                          ends with .zst.\n");
+    fprintf(stream, "  --capture-checkpoint=SECONDS Copy the storage in the capture every SECONDS (default: 600,\n");
+    fprintf(stream, "                          0 to disable), so wsbrd-fuzz can start a replay from there.\n");
     fprintf(stream, "\n");
     fprintf(stream, "Examples:\n");
     fprintf(stream, "  wsbrd -u /dev/ttyUSB0 -n Wi-SUN -d EU -C cert.pem -A ca.pem -K key.pem\n");
@@ -148,6 +202,17 @@ static void conf_set_macaddr(const struct storage_parse_info *info, void *raw_de
     (*macaddr_count)++;
 }
 
+static void conf_add_pcap_filter_mac64(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
+{
+    struct wsbrd_conf *config = raw_dest;
+
+    if (config->pcap_filter_mac64_count >= ARRAY_SIZE(config->pcap_filter_mac64))
+        FATAL(1, "%s:%d: maximum number of pcap_filter_mac64 reached", info->filename, info->linenr);
+    if (parse_byte_array(config->pcap_filter_mac64[config->pcap_filter_mac64_count], 8, info->value))
+        FATAL(1, "%s:%d: invalid mac64: %s", info->filename, info->linenr, info->value);
+    config->pcap_filter_mac64_count++;
+}
+
 static void conf_set_gtk(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
 {
     uintptr_t gtk_count = (uintptr_t)raw_param;
@@ -160,6 +225,59 @@ static void conf_set_gtk(const struct storage_parse_info *info, void *raw_dest,
         FATAL(1, "%s:%d: invalid key: %s", info->filename, info->linenr, info->value);
 }
 
+static void conf_add_radius_server(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
+{
+    struct sockaddr_storage *addrs = raw_dest;
+    int i;
+
+    for (i = 0; i < AUTH_RADIUS_SERVER_MAX; i++)
+        if (addrs[i].ss_family == AF_UNSPEC)
+            break;
+    if (i == AUTH_RADIUS_SERVER_MAX)
+        FATAL(1, "%s:%d: maximum number of radius servers reached", info->filename, info->linenr);
+    conf_set_netaddr(info, &addrs[i], raw_param);
+}
+
+static void conf_add_pan_load_peer(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
+{
+    struct sockaddr_in6 *addrs = raw_dest;
+    struct storage_parse_info tmp = *info;
+    unsigned int port = 0;
+    char *end;
+    int i;
+
+    for (i = 0; i < WSBR_PAN_LOAD_PEER_MAX; i++)
+        if (addrs[i].sin6_family == AF_UNSPEC)
+            break;
+    if (i == WSBR_PAN_LOAD_PEER_MAX)
+        FATAL(1, "%s:%d: maximum number of PAN load peers reached", info->filename, info->linenr);
+    // Accept "[addr]:port" in addition to a plain address
+    if (tmp.value[0] == '[') {
+        end = strchr(tmp.value, ']');
+        if (!end || (end[1] && (end[1] != ':' || sscanf(end + 2, "%u", &port) != 1 || port > UINT16_MAX)))
+            FATAL(1, "%s:%d: invalid peer: %s", info->filename, info->linenr, info->value);
+        *end = '\0';
+        memmove(tmp.value, tmp.value + 1, strlen(tmp.value));
+    }
+    conf_set_netaddr(&tmp, &addrs[i], raw_param);
+    // Port 0 is replaced by pan_load_port once the configuration is parsed
+    addrs[i].sin6_port = htons(port);
+}
+
+static void conf_add_dhcp_server(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
+{
+    struct sockaddr_in6 *addrs = raw_dest;
+    int i;
+
+    // The first entry holds the default value, the unspecified address
+    for (i = 0; i < DHCP_RELAY_SERVER_MAX; i++)
+        if (IN6_IS_ADDR_UNSPECIFIED(&addrs[i].sin6_addr))
+            break;
+    if (i == DHCP_RELAY_SERVER_MAX)
+        FATAL(1, "%s:%d: maximum number of DHCP servers reached", info->filename, info->linenr);
+    conf_set_netaddr(info, &addrs[i], raw_param);
+}
+
 static void conf_set_dhcp_internal(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
 {
     struct sockaddr_in6 *dest = raw_dest;
@@ -180,21 +298,47 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         { "uart_device",                   config->rcp_cfg.uart_dev,               conf_set_string,      (void *)sizeof(config->rcp_cfg.uart_dev) },
         { "uart_baudrate",                 &config->rcp_cfg.uart_baudrate,         conf_set_number,      NULL },
         { "uart_rtscts",                   &config->rcp_cfg.uart_rtscts,           conf_set_bool,        NULL },
+        { "uart_thread",                   &config->rcp_cfg.uart_thread,           conf_set_bool,        NULL },
         { "cpc_instance",                  config->rcp_cfg.cpc_instance,           conf_set_string,      (void *)sizeof(config->rcp_cfg.cpc_instance) },
+        { "rcp_radio_list_cache",          &config->rcp_cfg.radio_list_cache,      conf_set_bool,        NULL },
+        { "rcp_reset_restore",             &config->rcp_reset_restore,             conf_set_bool,        NULL },
+        { "instance",                      config->instance,                          conf_set_string,      (void *)sizeof(config->instance) },
         { "tun_device",                    config->tun_dev,                           conf_set_string,      (void *)sizeof(config->tun_dev) },
         { "tun_autoconf",                  &config->tun_autoconf,                     conf_set_bool,        NULL },
         { "neighbor_proxy",                config->neighbor_proxy,                    conf_set_string,      (void *)sizeof(config->neighbor_proxy) },
         { "user",                          config->user,                              conf_set_string,      (void *)sizeof(config->user) },
         { "group",                         config->group,                             conf_set_string,      (void *)sizeof(config->group) },
         { "color_output",                  &config->color_output,                     conf_set_enum,        &valid_tristate },
+        { "log_journal",                   &config->log_journal,                      conf_set_bool,        NULL },
+        { "crypto_backend",                &config->crypto_backend,                   conf_set_enum,        &valid_crypto_backends },
         { "use_tap",                       NULL,                                      conf_deprecated,      NULL },
         { "ipv6_prefix",                   &config->ipv6_prefix,                      conf_set_netmask,     NULL },
         { "storage_prefix",                config->storage_prefix,                    conf_set_string,      (void *)sizeof(config->storage_prefix) },
+        { "storage_fsync",                 &config->storage_fsync,                    conf_set_bool,        NULL },
+        { "storage_commit_window",         &config->storage_commit_window_ms,         conf_set_number,      &valid_unsigned },
+        { "dbus_change_window",            &config->dbus_change_window_ms,            conf_set_number,      &valid_unsigned },
+        { "storage_tables",                &config->storage_tables,                   conf_set_bool,        NULL },
+        { "storage_keys_binary",           &config->storage_keys_binary,              conf_set_bool,        NULL },
+        { "storage_snapshot_prefix",       config->storage_snapshot_prefix,           conf_set_string,      (void *)sizeof(config->storage_snapshot_prefix) },
+        { "storage_snapshot_interval",     &config->storage_snapshot_interval_ms,     conf_set_ms_from_s,   &valid_unsigned },
+        { "neighbor_snapshot_max_age",     &config->neighbor_snapshot_max_age_ms,     conf_set_ms_from_s,   &valid_unsigned },
         { "trace",                         &g_enabled_traces,                         conf_add_flags,       &valid_traces },
-        { "internal_dhcp",                 &config->dhcp_server,                      conf_set_dhcp_internal, NULL },
-        { "dhcp_server",                   &config->dhcp_server,                      conf_set_netaddr,     &valid_ipv6 },
-        { "radius_server",                 &config->auth_cfg.radius_addr,             conf_set_netaddr,     &valid_ipv4or6 },
+        { "trace_rate_limit",              g_trace_ratelimit_cfg,                     conf_set_trace_rate,  &valid_traces },
+        { "trace_sample",                  g_trace_ratelimit_cfg,                     conf_set_trace_sample, &valid_traces },
+        { "trace_ring",                    config->trace_ring,                        conf_set_string,      (void *)sizeof(config->trace_ring) },
+        { "trace_ring_size",               &config->trace_ring_size,                  conf_set_number,      &valid_positive },
+        { "internal_dhcp",                 &config->dhcp_server[0],                   conf_set_dhcp_internal, NULL },
+        { "dhcp_server",                   config->dhcp_server,                       conf_add_dhcp_server, &valid_ipv6 },
+        { "dhcp_pool_start",               &config->dhcp_pool_start,                  conf_set_netaddr,     &valid_ipv6 },
+        { "dhcp_pool_size",                &config->dhcp_pool_size,                   conf_set_number,      &valid_dhcp_pool_size },
+        { "dhcp_lease_lifetime",           &config->dhcp_lease_lifetime_s,            conf_set_seconds_from_minutes, &valid_unsigned },
+        { "radius_server",                 config->auth_cfg.radius_addr,              conf_add_radius_server, &valid_ipv4or6 },
+        { "radius_sockets",                &config->auth_cfg.radius_sockets,          conf_set_number,      &valid_radius_sockets },
         { "radius_secret",                 config->auth_cfg.radius_secret,            conf_set_string,      (void *)sizeof(config->auth_cfg.radius_secret) },
+        { "tls_workers",                   &config->auth_cfg.tls_workers,             conf_set_number,      &valid_tls_workers },
+        { "auth_active_max",               &config->auth_cfg.active_supp_max,         conf_set_number,      &valid_active_supp_max },
+        { "tls_session_cache_size",        &config->auth_cfg.tls_session_cache_size,  conf_set_number,      &valid_tls_session_cache_size },
+        { "eap_tls_fragment_size",         &config->auth_cfg.eap_tls_frag_len,        conf_set_number,      &valid_eap_tls_fragment_size },
         { "key",                           &config->auth_cfg.key,                     conf_set_pem,         NULL },
         { "certificate",                   &config->auth_cfg.cert,                    conf_set_pem,         NULL },
         { "authority",                     &config->auth_cfg.ca_cert,                 conf_set_pem,         NULL },
@@ -211,11 +355,16 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         { "chan_spacing",                  &config->ws_chan_spacing,                  conf_set_number,      NULL },
         { "chan_count",                    &config->ws_chan_count,                    conf_set_number,      NULL },
         { "allowed_channels",              config->ws_allowed_channels,               conf_set_bitmask,     NULL },
+        { "chan_excl_threshold",           &config->chan_excl_threshold,              conf_set_number,      &valid_chan_excl_threshold },
+        { "chan_excl_period",              &config->chan_excl_period_ms,              conf_set_ms_from_s,   &valid_chan_excl_period },
         { "pan_id",                        &config->ws_pan_id,                        conf_set_number,      &valid_pan_id },
         { "enable_lfn",                    &config->enable_lfn,                       conf_set_bool,        NULL },
         { "enable_ffn10",                  &config->enable_ffn10,                     conf_set_bool,        NULL },
         { "rpl_compat",                    &config->rpl_compat,                       conf_set_bool,        NULL },
         { "rpl_rpi_ignorable",             &config->rpl_rpi_ignorable,                conf_set_bool,        NULL },
+        { "rpl_6lorh",                     &config->rpl_6lorh,                        conf_set_bool,        NULL },
+        { "rpl_paced_refresh",             &config->rpl_paced_refresh,                conf_set_bool,        NULL },
+        { "mpl_aggregate_tx",              &config->mpl_aggregate_tx,                 conf_set_bool,        NULL },
         { "fan_version",                   &config->ws_fan_version,                   conf_set_enum,        &valid_fan_versions },
         { "gtk\\[*]",                      config->auth_cfg.gtk_init,                 conf_set_gtk,         (void *)WS_GTK_COUNT },
         { "lgtk\\[*]",                     config->auth_cfg.gtk_init + WS_GTK_COUNT,  conf_set_gtk,         (void *)WS_LGTK_COUNT },
@@ -223,8 +372,13 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         { "unicast_dwell_interval",        &config->uc_dwell_interval,                conf_set_number,      &valid_unicast_dwell_interval },
         { "broadcast_dwell_interval",      &config->bc_dwell_interval,                conf_set_number,      &valid_broadcast_dwell_interval },
         { "broadcast_interval",            &config->bc_interval,                      conf_set_number,      &valid_broadcast_interval },
+        { "broadcast_interval_min",        &config->bc_interval_min,                  conf_set_number,      &valid_broadcast_interval_min },
         { "lfn_broadcast_interval",        &config->lfn_bc_interval,                  conf_set_number,      &valid_lfn_broadcast_interval },
         { "lfn_broadcast_sync_period",     &config->lfn_bc_sync_period,               conf_set_number,      &valid_lfn_broadcast_sync_period },
+        { "lfn_multicast_unicast_max",     &config->lfn_mcast_unicast_max,            conf_set_number,      &valid_lfn_mcast_unicast_max },
+        { "icmp_rate_limit",               &config->icmp_rate_limit,                  conf_set_number,      &valid_unsigned },
+        { "icmp_type_rate_limit",          &config->icmp_type_rate_limit,             conf_set_number,      &valid_unsigned },
+        { "icmp_dst_rate_limit",           &config->icmp_dst_rate_limit,              conf_set_number,      &valid_unsigned },
         { "pmk_lifetime",                  &config->auth_cfg.ffn.pmk_lifetime_s,      conf_set_seconds_from_minutes, &valid_unsigned },
         { "ptk_lifetime",                  &config->auth_cfg.ffn.ptk_lifetime_s,      conf_set_seconds_from_minutes, &valid_unsigned },
         { "gtk_expire_offset",             &config->auth_cfg.ffn.gtk_expire_offset_s, conf_set_seconds_from_minutes, &valid_unsigned },
@@ -244,7 +398,30 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         { "join_metrics",                  &config->ws_join_metrics,                  conf_set_flags,       &valid_join_metrics },
         { "lowpan_mtu",                    &config->lowpan_mtu,                       conf_set_number,      &valid_lowpan_mtu },
         { "pan_size",                      &config->pan_size,                         conf_set_number,      &valid_uint16 },
+        { "pan_load_port",                 &config->pan_load_port,                    conf_set_number,      &valid_uint16 },
+        { "pan_load_peer",                 config->pan_load_peers,                    conf_add_pan_load_peer, &valid_ipv6 },
+        { "pan_load_threshold",            &config->pan_load_threshold,               conf_set_number,      &valid_uint16 },
+        { "admission_control",             &config->admission_control,                conf_set_bool,        NULL },
+        { "admission_auth_max",            &config->admission_auth_max,               conf_set_number,      &valid_unsigned },
+        { "admission_dao_rate_max",        &config->admission_dao_rate_max,           conf_set_number,      &valid_unsigned },
+        { "neighbor_max",                  &config->neighbor_max,                     conf_set_number,      &valid_unsigned },
         { "pcap_file",                     config->pcap_file,                         conf_set_string,      (void *)sizeof(config->pcap_file) },
+        { "pcap_file_size_max",            &config->pcap_file_size_max,               conf_set_number,      &valid_unsigned },
+        { "pcap_file_rotate_interval",     &config->pcap_file_rotate_s,               conf_set_number,      &valid_unsigned },
+        { "pcap_filter_mac64",             config,                                    conf_add_pcap_filter_mac64, NULL },
+        { "pcap_filter_frames",            &config->pcap_filter_frames,               conf_set_flags,       &valid_pcap_frames },
+        { "metrics_socket",                config->metrics_socket,                    conf_set_string,      (void *)sizeof(config->metrics_socket) },
+        { "events_socket",                 config->events_socket,                     conf_set_string,      (void *)sizeof(config->events_socket) },
+        { "packet_socket",                 config->packet_socket,                     conf_set_string,      (void *)sizeof(config->packet_socket) },
+        { "queue_management",              &config->queue_management,                 conf_set_enum,        &valid_queue_management },
+        { "codel_target",                  &config->codel_target_ms,                  conf_set_number,      &valid_positive },
+        { "codel_interval",                &config->codel_interval_ms,                conf_set_number,      &valid_positive },
+        { "lowpan_workers",                &config->lowpan_workers,                   conf_set_number,      &valid_lowpan_workers },
+        { "tun_workers",                   &config->tun_workers,                      conf_set_number,      &valid_lowpan_workers },
+        { "duty_cycle_budget",             &config->duty_cycle_budget,                conf_set_number,      &valid_duty_cycle_budget },
+        { "duty_cycle_window",             &config->duty_cycle_window_ms,             conf_set_ms_from_s,   &valid_positive },
+        { "campaign_hop_interval",         &config->campaign_hop_interval_ms,         conf_set_number,      &valid_positive },
+        { "cpu_accounting",                &config->cpu_accounting,                   conf_set_enum,        &valid_cpu_accounting },
         { }
     };
     static const char *opts_short = "u:F:o:t:T:n:d:m:c:S:K:C:A:b:HhvD";
@@ -265,6 +442,7 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         { "authority",   required_argument, 0,  'A' },
         { "baudrate",    required_argument, 0,  'b' },
         { "capture",     required_argument, 0,  'r' },
+        { "capture-checkpoint", required_argument, 0, 'R' },
         { "hardflow",    no_argument,       0,  'H' },
         { "help",        no_argument,       0,  'h' },
         { "version",     no_argument,       0,  'v' },
@@ -280,15 +458,23 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
     // Keep these values in sync with examples/wsbrd.conf
     config->rcp_cfg.uart_baudrate = 115200;
     config->tun_autoconf = true;
-    config->dhcp_server.sin6_family = AF_INET6;
-    config->dhcp_server.sin6_addr = in6addr_any;
+    config->dhcp_server[0].sin6_family = AF_INET6;
+    config->dhcp_server[0].sin6_addr = in6addr_any;
     config->ws_class = 0;
     config->ws_domain = REG_DOMAIN_UNDEF;
     config->ws_mode = 0;
     config->ws_size = WS_NETWORK_SIZE_SMALL;
     config->ws_pan_id = -1;
+    config->capture_checkpoint_s = 600;
+    config->storage_commit_window_ms = 1000;
+    config->storage_snapshot_interval_ms = 600 * 1000;
+    config->codel_target_ms = 500;
+    config->codel_interval_ms = 5000;
+    config->duty_cycle_budget = -1;
+    config->duty_cycle_window_ms = 3600 * 1000;
     config->ws_phy_op_modes[0] = -1;
     config->color_output = -1;
+    config->trace_ring_size = 4096;
     config->tx_power = 14;
     config->uc_dwell_interval = 255;
     config->bc_interval = 1020;
@@ -307,18 +493,31 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
     config->auth_cfg.lfn.gtk_expire_offset_s = 129600 * 60;
     config->auth_cfg.lfn.gtk_new_activation_time = 180;
     config->auth_cfg.lfn.gtk_new_install_required = 90;
+    config->auth_cfg.active_supp_max = 500;
+    config->auth_cfg.radius_sockets = 4;
     config->ws_lfn_revocation_lifetime_reduction = 30;
     config->ws_allowed_mac_address_count = 0;
     config->ws_denied_mac_address_count = 0;
     config->ws_regional_regulation = 0;
     config->ws_async_frag_duration = 500;
     config->pan_size = -1;
+    config->pan_load_port = WSBR_PAN_LOAD_PORT;
+    config->pan_load_threshold = 10;
+    config->admission_auth_max = 50;
+    config->admission_dao_rate_max = 20;
+    config->campaign_hop_interval_ms = 100;
+    config->icmp_rate_limit = 10;
+    config->icmp_type_rate_limit = 5;
+    config->icmp_dst_rate_limit = 5;
+    config->chan_excl_period_ms = 600 * 1000;
     config->ws_join_metrics = (unsigned int)-1;
+    config->pcap_filter_frames = (unsigned int)-1;
     config->ws_fan_version = WS_FAN_VERSION_1_1;
     config->enable_lfn = true;
     config->enable_ffn10 = false;
     config->rpl_compat = true;
     config->rpl_rpi_ignorable = false;
+    config->rpl_6lorh = false;
     strcpy(config->storage_prefix, "/var/lib/wsbrd/");
     memset(config->ws_mac_address, 0xff, sizeof(config->ws_mac_address));
     memset(config->ws_allowed_channels, 0xFF, sizeof(config->ws_allowed_channels));
@@ -407,6 +606,10 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
             case 'r':
                 snprintf(config->capture, sizeof(config->capture), "%s", optarg); // safe strncpy()
                 break;
+            case 'R':
+                strcpy(info.key, "capture-checkpoint");
+                conf_set_number(&info, &config->capture_checkpoint_s, &valid_unsigned);
+                break;
             case 'h':
                 print_help(stdout);
                 // fall through
@@ -422,12 +625,23 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         FATAL(1, "unexpected argument: %s", argv[optind]);
     if ((config->storage_exit || !config->list_rf_configs) && storage_check_access(config->storage_prefix))
         FATAL(1, "%s: %m", config->storage_prefix);
+    if (config->storage_snapshot_prefix[0]) {
+        if (!strcmp(config->storage_snapshot_prefix, config->storage_prefix))
+            FATAL(1, "\"storage_snapshot_prefix\" must differ from \"storage_prefix\"");
+        if (storage_check_access(config->storage_snapshot_prefix))
+            FATAL(1, "%s: %m", config->storage_snapshot_prefix);
+    }
     if (config->storage_exit)
         return;
     if (!config->rcp_cfg.uart_dev[0] && !config->rcp_cfg.cpc_instance[0])
         FATAL(1, "missing \"uart_device\" (or \"cpc_instance\") parameter");
     if (config->rcp_cfg.uart_dev[0] && config->rcp_cfg.cpc_instance[0])
         FATAL(1, "\"uart_device\" and \"cpc_instance\" are exclusive %s", config->rcp_cfg.uart_dev);
+    for (const char *c = config->instance; *c; c++)
+        if (!isalnum((unsigned char)*c) && *c != '_')
+            FATAL(1, "invalid \"instance\" \"%s\": only letters, digits and '_' are allowed", config->instance);
+    if (isdigit((unsigned char)config->instance[0]))
+        FATAL(1, "invalid \"instance\" \"%s\": cannot start with a digit", config->instance);
     if (!config->user[0] && config->group[0])
         WARN("group is set while user is not: privileges will not be dropped if started as root");
     if (config->user[0] && !config->group[0])
@@ -470,6 +684,12 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         WARN("mix FAN 1.1 PHY mode with FAN1.0 class");
     if (config->ws_chan_plan_id && !config->ws_phy_mode_id)
         WARN("mix FAN 1.0 mode with FAN1.1 channel plan");
+#ifndef HAVE_FAN10
+    if (config->enable_ffn10)
+        FATAL(1, "\"enable_ffn10\" is not supported by this build");
+    if (config->ws_fan_version == WS_FAN_VERSION_1_0)
+        FATAL(1, "\"fan_version = 1.0\" is not supported by this build");
+#endif
     if (config->enable_ffn10 && config->enable_lfn)
         WARN("mixing enable_lfn and enable_ffn10 is unreliable and insecure");
     if (!config->ws_chan_plan_id && config->enable_lfn)
@@ -480,9 +700,13 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         WARN("mix \"phy_operating_modes\" and FAN1.0 mode");
     if (config->bc_interval < config->bc_dwell_interval)
         FATAL(1, "broadcast interval %d can't be lower than broadcast dwell interval %d", config->bc_interval, config->bc_dwell_interval);
+    if (config->bc_interval_min && config->bc_interval_min < config->bc_dwell_interval)
+        FATAL(1, "minimum broadcast interval %d can't be lower than broadcast dwell interval %d", config->bc_interval_min, config->bc_dwell_interval);
+    if (config->bc_interval_min > config->bc_interval)
+        FATAL(1, "minimum broadcast interval %d can't be greater than broadcast interval %d", config->bc_interval_min, config->bc_interval);
     if (config->ws_allowed_mac_address_count > 0 && config->ws_denied_mac_address_count > 0)
         FATAL(1, "allowed_mac64 and denied_mac64 are exclusive");
-    if (config->auth_cfg.radius_addr.ss_family == AF_UNSPEC) {
+    if (config->auth_cfg.radius_addr[0].ss_family == AF_UNSPEC) {
         if (!config->auth_cfg.key.iov_base)
             FATAL(1, "missing \"key\" (or \"auth_cfg.radius_addr\") parameter");
         if (!config->auth_cfg.cert.iov_base)
@@ -512,8 +736,22 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
     if (memzcmp(config->auth_cfg.gtk_init, sizeof(config->auth_cfg.gtk_init)) &&
          config->ws_pan_id != -1)
         WARN("setting both PAN_ID and (L)GTKs may generate inconsistencies on the network");
-    if (config->capture[0] && !config->storage_delete)
+    // wsbrd-fuzz expects the RCP initialization sequence in the capture
+    if (config->capture[0] && config->rcp_cfg.radio_list_cache) {
+        WARN("\"rcp_radio_list_cache\" is ignored with --capture");
+        config->rcp_cfg.radio_list_cache = false;
+    }
+    if (config->capture[0] && !config->storage_delete && !config->capture_checkpoint_s)
         WARN("--capture used without --delete-storage");
-    if (config->tun_autoconf && !IN6_IS_ADDR_UNSPECIFIED(&config->dhcp_server.sin6_addr))
+    for (int i = 0; i < ARRAY_SIZE(config->pan_load_peers); i++)
+        if (config->pan_load_peers[i].sin6_family != AF_UNSPEC && !config->pan_load_peers[i].sin6_port)
+            config->pan_load_peers[i].sin6_port = htons(config->pan_load_port);
+    if (config->tun_autoconf && !IN6_IS_ADDR_UNSPECIFIED(&config->dhcp_server[0].sin6_addr))
         WARN("\"dhcp_server\" is set: make sure that \"ipv6_prefix\" matches");
+    if (config->dhcp_pool_size && !IN6_IS_ADDR_UNSPECIFIED(&config->dhcp_server[0].sin6_addr))
+        WARN("\"dhcp_pool_size\" is ignored when \"dhcp_server\" is set");
+    if (config->dhcp_pool_size && config->dhcp_pool_start.sin6_family != AF_INET6)
+        FATAL(1, "\"dhcp_pool_size\" requires \"dhcp_pool_start\"");
+    if (config->codel_target_ms >= config->codel_interval_ms)
+        FATAL(1, "\"codel_target\" must be smaller than \"codel_interval\"");
 }
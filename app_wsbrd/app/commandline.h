@@ -24,22 +24,39 @@
 #include <net/if.h>
 
 #include "common/authenticator/authenticator.h"
+#include "common/dhcp_relay.h"
 #include "common/specs/ws.h"
 #include "common/ws/ws_chan_mask.h"
 #include "common/rcp_api.h"
 #include "common/bits.h"
 
+#define WSBR_PAN_LOAD_PEER_MAX 8
+
+enum wsbr_cpu_accounting {
+    WSBR_CPU_ACCOUNTING_NONE,
+    WSBR_CPU_ACCOUNTING_CPU,
+    WSBR_CPU_ACCOUNTING_HEAP, // CPU and heap
+};
+
 // This struct is filled by parse_commandline() and never modified after.
 struct wsbrd_conf {
     bool list_rf_configs;
     int color_output;
+    bool log_journal;
+    int crypto_backend;
+    char trace_ring[PATH_MAX];
+    int trace_ring_size;
 
     struct rcp_cfg rcp_cfg;
+    bool rcp_reset_restore;
 
     char tun_dev[IF_NAMESIZE];
     char neighbor_proxy[IF_NAMESIZE];
     bool tun_autoconf;
-    struct sockaddr_in6 dhcp_server;
+    struct sockaddr_in6 dhcp_server[DHCP_RELAY_SERVER_MAX]; // Unspecified for unused entries
+    struct sockaddr_in6 dhcp_pool_start;
+    int dhcp_pool_size;
+    int dhcp_lease_lifetime_s;
 
     char ws_name[33]; // null-terminated string of 32 chars
     int  ws_size;
@@ -51,21 +68,33 @@ struct wsbrd_conf {
     int  ws_chan_spacing;
     int  ws_chan_count;
     uint8_t ws_allowed_channels[WS_CHAN_MASK_LEN];
+    int  chan_excl_threshold;
+    int  chan_excl_period_ms;
     int  ws_phy_mode_id;
     int  ws_chan_plan_id;
     // -1 for base mode +1 for sentinel
     uint8_t ws_phy_op_modes[FIELD_MAX(WS_MASK_POM_COUNT) - 1 + 1];
 
+    char instance[64];
+    int  dbus_change_window_ms;
     char user[LOGIN_NAME_MAX];
     char group[LOGIN_NAME_MAX];
 
     struct in6_addr ipv6_prefix;
 
     char capture[PATH_MAX];
+    int  capture_checkpoint_s;
 
     char storage_prefix[PATH_MAX];
     bool storage_delete;
     bool storage_exit;
+    bool storage_fsync;
+    int  storage_commit_window_ms;
+    bool storage_tables;
+    bool storage_keys_binary;
+    char storage_snapshot_prefix[PATH_MAX];
+    int  storage_snapshot_interval_ms;
+    int  neighbor_snapshot_max_age_ms;
 
     int  tx_power;
     int  ws_pan_id;
@@ -77,12 +106,20 @@ struct wsbrd_conf {
     int  uc_dwell_interval;
     int  bc_dwell_interval;
     int  bc_interval;
+    int  bc_interval_min;
     int  lfn_bc_interval;
     int  lfn_bc_sync_period;
+    int  lfn_mcast_unicast_max;
+    int  icmp_rate_limit;
+    int  icmp_type_rate_limit;
+    int  icmp_dst_rate_limit;
     bool enable_lfn;
     bool enable_ffn10;
     bool rpl_compat;
     bool rpl_rpi_ignorable;
+    bool rpl_6lorh;
+    bool rpl_paced_refresh;
+    bool mpl_aggregate_tx;
     unsigned int ws_join_metrics;
 
     uint8_t ws_mac_address[8];
@@ -93,7 +130,31 @@ struct wsbrd_conf {
 
     int lowpan_mtu;
     int pan_size;
+    int pan_load_port;
+    struct sockaddr_in6 pan_load_peers[WSBR_PAN_LOAD_PEER_MAX]; // AF_UNSPEC for unused entries
+    int pan_load_threshold;
+    bool admission_control;
+    int admission_auth_max;
+    int admission_dao_rate_max;
+    int campaign_hop_interval_ms;
+    int neighbor_max;
     char pcap_file[PATH_MAX];
+    int pcap_file_size_max;
+    int pcap_file_rotate_s;
+    uint8_t pcap_filter_mac64[10][8];
+    uint8_t pcap_filter_mac64_count;
+    unsigned int pcap_filter_frames;
+    char metrics_socket[PATH_MAX];
+    char events_socket[PATH_MAX];
+    char packet_socket[PATH_MAX];
+    int cpu_accounting;
+    int queue_management;
+    int codel_target_ms;
+    int codel_interval_ms;
+    int lowpan_workers;
+    int tun_workers;
+    int duty_cycle_budget; // permille, -1 for the default of the regulation
+    int duty_cycle_window_ms;
 };
 
 void print_help_br(FILE *stream);
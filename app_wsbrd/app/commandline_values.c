@@ -11,12 +11,14 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include "app_wsbrd/6lowpan/lowpan_adaptation_interface.h"
 #include "common/ws/ws_regdb.h"
 #include "common/bits.h"
 #include "common/hif.h"
 #include "common/log.h"
 #include "common/specs/ws.h"
 
+#include "commandline.h"
 #include "wsbr_cfg.h"
 
 #include "commandline_values.h"
@@ -71,6 +73,38 @@ const struct name_value valid_join_metrics[] = {
     { "plf",  BIT(WS_JM_PLF) },
 };
 
+// Same names as in the traces
+const struct name_value valid_pcap_frames[] = {
+    { "all",       (unsigned int)-1 },
+    { "adv",       BIT(WS_FT_PA) },
+    { "adv-sol",   BIT(WS_FT_PAS) },
+    { "cfg",       BIT(WS_FT_PC) },
+    { "cfg-sol",   BIT(WS_FT_PCS) },
+    { "data",      BIT(WS_FT_DATA) },
+    { "ack",       BIT(WS_FT_ACK) },
+    { "eapol",     BIT(WS_FT_EAPOL) },
+    { "l-adv",     BIT(WS_FT_LPA) },
+    { "l-adv-sol", BIT(WS_FT_LPAS) },
+    { "l-cfg",     BIT(WS_FT_LPC) },
+    { "l-cfg-sol", BIT(WS_FT_LPCS) },
+    { "l-tsync",   BIT(WS_FT_LTS) },
+    { NULL },
+};
+
+const struct name_value valid_cpu_accounting[] = {
+    { "none", WSBR_CPU_ACCOUNTING_NONE },
+    { "cpu",  WSBR_CPU_ACCOUNTING_CPU },
+    { "heap", WSBR_CPU_ACCOUNTING_HEAP },
+    { NULL },
+};
+
+const struct name_value valid_queue_management[] = {
+    { "red",      LOWPAN_AQM_RED },
+    { "codel",    LOWPAN_AQM_CODEL },
+    { "fq_codel", LOWPAN_AQM_FQ_CODEL },
+    { NULL },
+};
+
 const struct name_value valid_ws_regional_regulations[] = {
     { "none", HIF_REG_NONE },
     { "arib", HIF_REG_ARIB },
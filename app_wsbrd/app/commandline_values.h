@@ -20,6 +20,9 @@ extern const struct name_value valid_ws_size[];
 extern const struct name_value valid_fan_versions[];
 extern const struct name_value valid_traces[];
 extern const struct name_value valid_join_metrics[];
+extern const struct name_value valid_pcap_frames[];
+extern const struct name_value valid_cpu_accounting[];
+extern const struct name_value valid_queue_management[];
 extern const struct name_value valid_ws_regional_regulations[];
 
 #endif
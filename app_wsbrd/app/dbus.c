@@ -11,15 +11,24 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <math.h>
 
 #include "app_wsbrd/app/wsbrd.h"
 #include "app_wsbrd/app/commandline_values.h"
+#include "app_wsbrd/app/wsbr_metrics.h"
+#include "app_wsbrd/app/wsbr_pcapng.h"
 #include "app_wsbrd/ws/ws_auth.h"
 #include "app_wsbrd/ws/ws_llc.h"
+#include "common/cpu_usage.h"
+#include "common/dbus.h"
 #include "common/log.h"
+#include "common/memutils.h"
 #include "common/string_extra.h"
+#include "common/time_extra.h"
+#include "common/timer.h"
 #include "common/tun.h"
 #include "common/version.h"
 
@@ -82,11 +91,11 @@ int dbus_set_link_mode_switch(sd_bus_message *m, void *userdata, sd_bus_error *r
     else if (eui64_len != 8)
         return sd_bus_error_set_errno(ret_error, EINVAL);
 
-    if (ms_mode > WS_MODE_SWITCH_MAC)
+    if (ms_mode > WS_MODE_SWITCH_AUTO)
         return sd_bus_error_set_errno(ret_error, EINVAL);
-    if (ms_mode > WS_MODE_SWITCH_DISABLED && !phy_mode_id)
+    if ((ms_mode == WS_MODE_SWITCH_PHY || ms_mode == WS_MODE_SWITCH_MAC) && !phy_mode_id)
         return sd_bus_error_set_errno(ret_error, EINVAL);
-    if (ms_mode == WS_MODE_SWITCH_DEFAULT && phy_mode_id)
+    if ((ms_mode == WS_MODE_SWITCH_DEFAULT || ms_mode == WS_MODE_SWITCH_AUTO) && phy_mode_id)
         return sd_bus_error_set_errno(ret_error, EINVAL);
 
     ret = ws_llc_set_mode_switch(&ctxt->net_if, ms_mode, phy_mode_id, eui64);
@@ -97,6 +106,26 @@ int dbus_set_link_mode_switch(sd_bus_message *m, void *userdata, sd_bus_error *r
     return 0;
 }
 
+int dbus_set_link_sfr(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+    struct ws_neigh *ws_neigh;
+    size_t eui64_len;
+    uint8_t *eui64;
+    int enable;
+
+    sd_bus_message_read_array(m, 'y', (const void **)&eui64, &eui64_len);
+    sd_bus_message_read_basic(m, 'b', &enable);
+    if (eui64_len != 8)
+        return sd_bus_error_set_errno(ret_error, EINVAL);
+    ws_neigh = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage, eui64);
+    if (!ws_neigh)
+        return sd_bus_error_set_errno(ret_error, ENODEV);
+    ws_neigh->sfr = enable;
+    sd_bus_reply_method_return(m, NULL);
+    return 0;
+}
+
 int dbus_set_link_edfe(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 {
     struct wsbr_ctxt *ctxt = userdata;
@@ -117,7 +146,8 @@ int dbus_set_link_edfe(sd_bus_message *m, void *userdata, sd_bus_error *ret_erro
         return sd_bus_error_set_errno(ret_error, EINVAL);
     if (edfe_mode == WS_EDFE_DEFAULT && !eui64)
         return sd_bus_error_set_errno(ret_error, EINVAL);
-    if (edfe_mode == WS_EDFE_ENABLED && version_older_than(ctxt->rcp.version_api, 2, 2, 0))
+    if ((edfe_mode == WS_EDFE_ENABLED || edfe_mode == WS_EDFE_FRAGMENT) &&
+        version_older_than(ctxt->rcp.version_api, 2, 2, 0))
         return sd_bus_error_set_errno(ret_error, ENOTSUP);
 
     ret = ws_llc_set_edfe(&ctxt->net_if, edfe_mode, eui64);
@@ -128,6 +158,48 @@ int dbus_set_link_edfe(sd_bus_message *m, void *userdata, sd_bus_error *ret_erro
     return 0;
 }
 
+static int dbus_get_node_stats(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+    const struct ws_neigh_stats *stats;
+    sd_bus_message *reply;
+    struct ws_neigh *neigh;
+    size_t eui64_len;
+    uint8_t *eui64;
+    time_t now_s;
+    int ret;
+
+    sd_bus_message_read_array(m, 'y', (const void **)&eui64, &eui64_len);
+    if (eui64_len != 8)
+        return sd_bus_error_set_errno(ret_error, EINVAL);
+    neigh = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage, eui64);
+    if (!neigh)
+        return sd_bus_error_set_errno(ret_error, ENOENT);
+
+    now_s = time_now_s(CLOCK_MONOTONIC);
+    ret = sd_bus_message_new_method_return(m, &reply);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    sd_bus_message_append(reply, "u", WS_NEIGH_STATS_PERIOD_S);
+    sd_bus_message_open_container(reply, 'a', "(uqqqqqyuq)");
+    // Oldest first
+    for (int i = 1; i <= WS_NEIGH_STATS_COUNT; i++) {
+        stats = &neigh->stats[(neigh->stats_head + i) % WS_NEIGH_STATS_COUNT];
+        if (!stats->tx_count && !stats->rx_count)
+            continue;
+        sd_bus_message_append(reply, "(uqqqqqyuq)",
+                              (uint32_t)(now_s - stats->start_s),
+                              stats->tx_count, stats->tx_ack, stats->tx_retries,
+                              stats->tx_cca_fail, stats->rx_count, stats->phy_mode_id,
+                              stats->tx_count ? stats->tx_latency_ms_sum / stats->tx_count : 0,
+                              stats->tx_latency_ms_max);
+    }
+    sd_bus_message_close_container(reply);
+    ret = sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return ret;
+}
+
 int dbus_join_multicast_group(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 {
     struct wsbr_ctxt *ctxt = userdata;
@@ -249,7 +321,7 @@ static int dbus_ie_custom_clear(sd_bus_message *m, void *userdata, sd_bus_error
 {
     struct wsbr_ctxt *ctxt = userdata;
 
-    ws_ie_custom_clear(&ctxt->net_if.ws_info.ie_custom_list);
+    ws_ie_custom_clear(&ctxt->net_if.ws_info.ie_custom);
     ws_mngt_pan_version_increase(&ctxt->net_if.ws_info);
     sd_bus_reply_method_return(m, NULL);
     return 0;
@@ -285,7 +357,7 @@ static int dbus_ie_custom_insert(sd_bus_message *m, void *userdata, sd_bus_error
         }
         frame_type_mask |= BIT(frame_type_list[i]);
     }
-    ret = ws_ie_custom_update(&ctxt->net_if.ws_info.ie_custom_list, ie_type, ie_id,
+    ret = ws_ie_custom_update(&ctxt->net_if.ws_info.ie_custom, ie_type, ie_id,
                               content, content_len, frame_type_mask);
     if (ret < 0)
         return sd_bus_error_set_errno(ret_error, -ret);
@@ -309,6 +381,8 @@ int dbus_increment_rpl_dtsn(sd_bus_message *m, void *userdata, sd_bus_error *ret
 {
     struct wsbr_ctxt *ctxt = userdata;
 
+    if (ctxt->net_if.rpl_root.paced_refresh && rpl_refresh_in_progress(&ctxt->net_if.rpl_root))
+        return sd_bus_error_set_errno(ret_error, EBUSY);
     rpl_dtsn_inc(&ctxt->net_if.rpl_root);
     sd_bus_reply_method_return(m, NULL);
     return 0;
@@ -318,6 +392,8 @@ int dbus_increment_rpl_dodag_version_number(sd_bus_message *m, void *userdata, s
 {
     struct wsbr_ctxt *ctxt = userdata;
 
+    if (ctxt->net_if.rpl_root.paced_refresh && rpl_refresh_in_progress(&ctxt->net_if.rpl_root))
+        return sd_bus_error_set_errno(ret_error, EBUSY);
     rpl_dodag_version_inc(&ctxt->net_if.rpl_root);
     sd_bus_reply_method_return(m, NULL);
     return 0;
@@ -357,6 +433,158 @@ int dbus_deny_mac64(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
     return dbus_set_filter_src64(m, userdata, ret_error, false);
 }
 
+static int dbus_set_pcap_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+    struct iobuf_write buf = { };
+    unsigned int frames = 0;
+    const uint8_t *eui64;
+    const char *name;
+    size_t eui64_len;
+    int i;
+
+    sd_bus_message_enter_container(m, 'a', "ay");
+    while (sd_bus_message_read_array(m, 'y', (const void **)&eui64, &eui64_len) > 0) {
+        if (eui64_len != 8) {
+            iobuf_free(&buf);
+            return sd_bus_error_set_errno(ret_error, EINVAL);
+        }
+        iobuf_push_data(&buf, eui64, eui64_len);
+    }
+    sd_bus_message_close_container(m);
+    sd_bus_message_enter_container(m, 'a', "s");
+    while (sd_bus_message_read(m, "s", &name) > 0) {
+        // str_to_val() exits on unknown names
+        for (i = 0; valid_pcap_frames[i].name; i++)
+            if (!strcmp(valid_pcap_frames[i].name, name))
+                break;
+        if (!valid_pcap_frames[i].name) {
+            iobuf_free(&buf);
+            return sd_bus_error_set_errno(ret_error, EINVAL);
+        }
+        frames |= valid_pcap_frames[i].val;
+    }
+    sd_bus_message_close_container(m);
+
+    wsbr_pcapng_set_filter(ctxt, (uint8_t (*)[8])buf.data, buf.len / 8, frames ? frames : (unsigned int)-1);
+    iobuf_free(&buf);
+    sd_bus_reply_method_return(m, NULL);
+    return 0;
+}
+
+static int dbus_start_campaign(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+    struct iobuf_write dsts = { };
+    struct iobuf_write blocks = { };
+    struct iobuf_write lens = { };
+    const uint8_t *data;
+    size_t data_len;
+    uint16_t port;
+    int ret = 0;
+
+    sd_bus_message_enter_container(m, 'a', "ay");
+    while (sd_bus_message_read_array(m, 'y', (const void **)&data, &data_len) > 0) {
+        if (data_len != 16)
+            ret = -EINVAL;
+        iobuf_push_data(&dsts, data, 16);
+    }
+    sd_bus_message_close_container(m);
+    sd_bus_message_read(m, "q", &port);
+    sd_bus_message_enter_container(m, 'a', "ay");
+    while (sd_bus_message_read_array(m, 'y', (const void **)&data, &data_len) > 0) {
+        if (data_len > UINT16_MAX)
+            ret = -EINVAL;
+        // The data stays valid until the message is released
+        iobuf_push_data(&blocks, &data, sizeof(data));
+        iobuf_push_data(&lens, &(uint16_t){ data_len }, sizeof(uint16_t));
+    }
+    sd_bus_message_close_container(m);
+    if (!ret)
+        ret = wsbr_campaign_start(ctxt, port, (const uint8_t (*)[16])dsts.data, dsts.len / 16,
+                                  (const uint8_t *const *)blocks.data, (const uint16_t *)lens.data,
+                                  blocks.len / sizeof(data));
+    iobuf_free(&dsts);
+    iobuf_free(&blocks);
+    iobuf_free(&lens);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    sd_bus_reply_method_return(m, NULL);
+    return 0;
+}
+
+static int dbus_stop_campaign(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+
+    wsbr_campaign_stop(ctxt);
+    sd_bus_reply_method_return(m, NULL);
+    return 0;
+}
+
+// Upper bound of the nodes returned by GetNodes
+#define DBUS_NODES_MAX 16384
+// The serialized values of the Nodes and RoutingGraph properties are reused
+// until a node is added, removed or changes its routes. Link metrics,
+// authentication state and LFN registrations do not invalidate them, so they
+// are also rebuilt once this old.
+#define DBUS_PROP_CACHE_MAX_AGE_MS 5000
+
+struct dbus_prop_cache {
+    uint64_t gen;
+    sd_bus_message *msg;
+    uint64_t msg_gen;
+    uint64_t msg_time_ms;
+};
+
+static struct dbus_prop_cache g_dbus_nodes = {
+    .gen = 1,
+};
+
+static struct dbus_prop_cache g_dbus_routing_graph = {
+    .gen = 1,
+};
+
+/*
+ * Serializing these properties walks the whole supplicant and RPL target
+ * tables, and the single-threaded main loop cannot process the RCP meanwhile.
+ * Clients polling them are served a copy of the last serialized value
+ * instead.
+ */
+static int dbus_prop_cache_reply(struct dbus_prop_cache *cache,
+                                 sd_bus *bus, const char *path, const char *interface,
+                                 const char *property, sd_bus_message *reply,
+                                 void (*build)(sd_bus_message *m, const char *property,
+                                               struct wsbr_ctxt *ctxt),
+                                 struct wsbr_ctxt *ctxt)
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    sd_bus_message *msg;
+    int ret;
+
+    if (!cache->msg || cache->msg_gen != cache->gen ||
+        now_ms - cache->msg_time_ms > DBUS_PROP_CACHE_MAX_AGE_MS) {
+        cache->msg = sd_bus_message_unref(cache->msg);
+        // Only used as a container, this message is never sent
+        ret = sd_bus_message_new_signal(bus, &msg, path, interface, property);
+        if (ret < 0)
+            return ret;
+        build(msg, property, ctxt);
+        ret = sd_bus_message_seal(msg, 1, 0);
+        if (ret < 0) {
+            sd_bus_message_unref(msg);
+            return ret;
+        }
+        cache->msg = msg;
+        cache->msg_gen = cache->gen;
+        cache->msg_time_ms = now_ms;
+    }
+    ret = sd_bus_message_rewind(cache->msg, true);
+    if (ret < 0)
+        return ret;
+    return sd_bus_message_copy(reply, cache->msg, true);
+}
+
 void dbus_message_open_info(sd_bus_message *m, const char *property,
                             const char *name, const char *type)
 {
@@ -436,6 +664,20 @@ void dbus_message_append_node(sd_bus_message *m, const char *property,
             dbus_message_open_info(m, property, "mdr_cmd_capable", "b");
             sd_bus_message_append(m, "b", neighbor->pom_ie.mdr_command_capable);
             dbus_message_close_info(m, property);
+
+            if (neighbor->airtime_us) {
+                dbus_message_open_info(m, property, "airtime_us", "t");
+                sd_bus_message_append(m, "t", neighbor->airtime_us);
+                dbus_message_close_info(m, property);
+            }
+            if (neighbor->edfe_tx_count) {
+                dbus_message_open_info(m, property, "edfe_tx", "u");
+                sd_bus_message_append(m, "u", neighbor->edfe_tx_count);
+                dbus_message_close_info(m, property);
+                dbus_message_open_info(m, property, "edfe_tx_failed", "u");
+                sd_bus_message_append(m, "u", neighbor->edfe_tx_fail_count);
+                dbus_message_close_info(m, property);
+            }
         }
     }
     sd_bus_message_close_container(m);
@@ -463,7 +705,7 @@ void dbus_message_append_node_br(sd_bus_message *m, const char *property, struct
     dbus_message_append_node(m, property, &ctxt->rcp.eui64, true, NULL, &neigh);
 }
 
-static void dbus_message_append_rpl_target(sd_bus_message *reply, struct rpl_target *target, uint8_t pcs)
+static void dbus_message_append_rpl_target(sd_bus_message *reply, struct rpl_target *target)
 {
     uint8_t j;
 
@@ -471,11 +713,11 @@ static void dbus_message_append_rpl_target(sd_bus_message *reply, struct rpl_tar
     sd_bus_message_append_array(reply, 'y', target->prefix, 16);
     sd_bus_message_append(reply, "b", target->external);
     sd_bus_message_open_container(reply, 'a', "ay");
-    for (uint8_t i = 0; i < pcs + 1; i++) {
-        if (!memzcmp(target->transits + i, sizeof(struct rpl_transit)))
+    for (uint8_t i = 0; i < target->transits_len; i++) {
+        if (!target->transits[i].parent)
             continue;
         for (j = 0; j < i; j++)
-            if (!memcmp(target->transits + i, target->transits + j, sizeof(struct rpl_transit)))
+            if (target->transits[i].parent == target->transits[j].parent)
                 break;
         if (i == j)
             sd_bus_message_append_array(reply, 'y', target->transits[i].parent, 16);
@@ -486,48 +728,235 @@ static void dbus_message_append_rpl_target(sd_bus_message *reply, struct rpl_tar
 
 static void dbus_message_append_ipv6_neigh(sd_bus_message *reply, struct ipv6_neighbour *ipv6_neigh, struct rpl_root *root)
 {
-    struct rpl_target target = { };
+    struct rpl_transit transit = { .parent = root->dodag_id };
+    struct rpl_target target = {
+        .transits     = &transit,
+        .transits_len = 1,
+    };
 
     memcpy(target.prefix, ipv6_neigh->ip_address, 16);
     target.external = true;
-    memcpy(target.transits[0].parent, root->dodag_id, 16);
-    dbus_message_append_rpl_target(reply, &target, root->pcs);
+    dbus_message_append_rpl_target(reply, &target);
 }
 
-int dbus_get_routing_graph(sd_bus *bus, const char *path, const char *interface,
-                           const char *property, sd_bus_message *reply,
-                           void *userdata, sd_bus_error *ret_error)
+void dbus_nodes_changed(void)
+{
+    g_dbus_nodes.gen++;
+    dbus_emit_change("Nodes");
+}
+
+static void dbus_message_append_node_list(sd_bus_message *m, const char *property,
+                                          struct wsbr_ctxt *ctxt)
+{
+    sd_bus_message_open_container(m, 'a', "(aya{sv})");
+    dbus_message_append_node_br(m, property, ctxt);
+    dbus_message_append_nodes(m, property, ctxt);
+    sd_bus_message_close_container(m);
+}
+
+static int dbus_get_nodes(sd_bus *bus, const char *path, const char *interface,
+                          const char *property, sd_bus_message *reply,
+                          void *userdata, sd_bus_error *ret_error)
+{
+    return dbus_prop_cache_reply(&g_dbus_nodes, bus, path, interface, property, reply,
+                                 dbus_message_append_node_list, userdata);
+}
+
+static int dbus_eui64_cmp(const void *a, const void *b)
+{
+    return memcmp(a, b, 8);
+}
+
+static int dbus_get_nodes_paged(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 {
     struct wsbr_ctxt *ctxt = userdata;
+    size_t first_len, last_len;
+    const uint8_t *first, *last;
+    sd_bus_message *reply;
+    uint8_t (*eui64)[8];
+    uint32_t max_count;
+    int len, count = 0;
+    uint64_t since;
+    uint8_t role;
+    int ret;
+
+    ret = sd_bus_message_read(m, "t", &since);
+    if (ret >= 0)
+        ret = sd_bus_message_read_array(m, 'y', (const void **)&first, &first_len);
+    if (ret >= 0)
+        ret = sd_bus_message_read_array(m, 'y', (const void **)&last, &last_len);
+    if (ret >= 0)
+        ret = sd_bus_message_read(m, "yu", &role, &max_count);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    if ((first_len && first_len != 8) || (last_len && last_len != 8))
+        return sd_bus_error_set_errno(ret_error, EINVAL);
+
+    ret = sd_bus_message_new_method_return(m, &reply);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    sd_bus_message_append(reply, "t", g_dbus_nodes.gen);
+    sd_bus_message_open_container(reply, 'a', "(aya{sv})");
+    // Nothing was added, removed or rerouted since the client last asked
+    if (since != g_dbus_nodes.gen) {
+        eui64 = xalloc(DBUS_NODES_MAX * sizeof(*eui64));
+        memcpy(eui64[0], ctxt->rcp.eui64.u8, 8);
+        len = 1 + dbus_supp_list(ctxt, eui64 + 1, DBUS_NODES_MAX - 1);
+        // Sorting gives a stable order, so the client can continue from the
+        // last EUI-64 received.
+        qsort(eui64, len, sizeof(*eui64), dbus_eui64_cmp);
+        for (int i = 0; i < len && (!max_count || count < max_count); i++) {
+            if (first_len && memcmp(eui64[i], first, 8) < 0)
+                continue;
+            if (last_len && memcmp(eui64[i], last, 8) > 0)
+                break;
+            if (!memcmp(eui64[i], ctxt->rcp.eui64.u8, 8)) {
+                if (role != UINT8_MAX && role != WS_NR_ROLE_BR)
+                    continue;
+                dbus_message_append_node_br(reply, "Nodes", ctxt);
+                count++;
+            } else if (dbus_message_append_node_supp(reply, "Nodes", ctxt, eui64[i],
+                                                     role == UINT8_MAX ? -1 : role)) {
+                count++;
+            }
+        }
+        free(eui64);
+    }
+    sd_bus_message_close_container(reply);
+    ret = sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return ret;
+}
+
+static void dbus_message_append_routing_graph(sd_bus_message *reply, const char *property,
+                                              struct wsbr_ctxt *ctxt)
+{
+    struct ipv6_neighbour_cache *cache = &ctxt->net_if.ipv6_neighbour_cache;
     struct rpl_target target_br = { };
+    struct ipv6_neighbour *ipv6_neigh;
     struct rpl_target *target;
     struct ws_neigh *ws_neigh;
 
     sd_bus_message_open_container(reply, 'a', "(aybaay)");
 
     tun_addr_get_uc_global(&ctxt->tun, (struct in6_addr *)target_br.prefix);
-    dbus_message_append_rpl_target(reply, &target_br, 0);
+    dbus_message_append_rpl_target(reply, &target_br);
 
     SLIST_FOREACH(target, &ctxt->net_if.rpl_root.targets, link)
-        dbus_message_append_rpl_target(reply, target, ctxt->net_if.rpl_root.pcs);
+        dbus_message_append_rpl_target(reply, target);
 
     // Since LFN are not routed by RPL, rank 1 LFNs are not RPL targets.
     // This hack allows to expose rank 1 LFNs and relies on their ipv6 address
-    // registration.
-    ns_list_foreach(struct ipv6_neighbour, ipv6_neigh, &ctxt->net_if.ipv6_neighbour_cache.list) {
-        if (IN6_IS_ADDR_MULTICAST(ipv6_neigh->ip_address) || IN6_IS_ADDR_LINKLOCAL(ipv6_neigh->ip_address))
-            continue;
-        if (rpl_target_get(&ctxt->net_if.rpl_root, ipv6_neigh->ip_address))
+    // registration. Only the addresses registered by LFN neighbors are
+    // visited, using the EUI-64 index of the neighbor cache.
+    SLIST_FOREACH(ws_neigh, &ctxt->net_if.ws_info.neighbor_storage.neigh_list, link) {
+        if (ws_neigh->node_role != WS_NR_ROLE_LFN)
             continue;
-        ws_neigh = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage,
-                                ipv6_neighbour_eui64(&ctxt->net_if.ipv6_neighbour_cache, ipv6_neigh));
-        if (!ws_neigh || ws_neigh->node_role != WS_NR_ROLE_LFN)
-            continue;
-        dbus_message_append_ipv6_neigh(reply, ipv6_neigh, &ctxt->net_if.rpl_root);
+        SLIST_FOREACH(ipv6_neigh, ipv6_neighbour_eui64_bucket(cache, ws_neigh->mac64), eui64_link) {
+            if (memcmp(ipv6_neighbour_eui64(cache, ipv6_neigh), ws_neigh->mac64, 8))
+                continue;
+            if (IN6_IS_ADDR_MULTICAST(ipv6_neigh->ip_address) || IN6_IS_ADDR_LINKLOCAL(ipv6_neigh->ip_address))
+                continue;
+            if (rpl_target_get(&ctxt->net_if.rpl_root, ipv6_neigh->ip_address))
+                continue;
+            dbus_message_append_ipv6_neigh(reply, ipv6_neigh, &ctxt->net_if.rpl_root);
+        }
     }
 
     sd_bus_message_close_container(reply);
-    return 0;
+}
+
+int dbus_get_routing_graph(sd_bus *bus, const char *path, const char *interface,
+                           const char *property, sd_bus_message *reply,
+                           void *userdata, sd_bus_error *ret_error)
+{
+    return dbus_prop_cache_reply(&g_dbus_routing_graph, bus, path, interface, property, reply,
+                                 dbus_message_append_routing_graph, userdata);
+}
+
+void dbus_routing_graph_changed(void)
+{
+    g_dbus_routing_graph.gen++;
+    dbus_emit_change("RoutingGraph");
+}
+
+static void dbus_message_append_snapshot_node(sd_bus_message *reply, const uint8_t eui64[8],
+                                              const struct ws_neigh *neigh)
+{
+    sd_bus_message_open_container(reply, 'r', "aybay");
+    sd_bus_message_append_array(reply, 'y', eui64, 8);
+    if (neigh) {
+        sd_bus_message_append(reply, "b", neigh->pom_ie.mdr_command_capable);
+        sd_bus_message_append_array(reply, 'y', neigh->pom_ie.phy_op_mode_id,
+                                    neigh->pom_ie.phy_op_mode_number);
+    } else {
+        sd_bus_message_append(reply, "b", false);
+        sd_bus_message_append_array(reply, 'y', NULL, 0);
+    }
+    sd_bus_message_close_container(reply);
+}
+
+/*
+ * Compact alternative to the Nodes, RoutingGraph, Gtks and Lgtks properties
+ * for clients polling the border router. Nodes are reduced to their EUI-64
+ * and POM-IE. Nodes and routes are only returned when the generation differs
+ * from the one provided by the client (ie. something was added, removed or
+ * rerouted), the keys are always returned.
+ */
+static int dbus_get_snapshot(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+    const uint8_t *phy_op_modes = ctxt->net_if.ws_info.phy_config.phy_op_modes;
+    struct ws_neigh br = { .pom_ie.mdr_command_capable = true };
+    sd_bus_message *reply;
+    uint8_t (*eui64)[8];
+    uint64_t since;
+    int len;
+    int ret;
+
+    ret = sd_bus_message_read(m, "t", &since);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+
+    ret = sd_bus_message_new_method_return(m, &reply);
+    if (ret < 0)
+        return sd_bus_error_set_errno(ret_error, -ret);
+    sd_bus_message_append(reply, "t", g_dbus_nodes.gen);
+    if (since != g_dbus_nodes.gen) {
+        sd_bus_message_open_container(reply, 'a', "(aybay)");
+        while (phy_op_modes[br.pom_ie.phy_op_mode_number])
+            br.pom_ie.phy_op_mode_number++;
+        memcpy(br.pom_ie.phy_op_mode_id, phy_op_modes, br.pom_ie.phy_op_mode_number);
+        dbus_message_append_snapshot_node(reply, ctxt->rcp.eui64.u8, &br);
+        eui64 = xalloc(DBUS_NODES_MAX * sizeof(*eui64));
+        len = dbus_supp_list(ctxt, eui64, DBUS_NODES_MAX);
+        for (int i = 0; i < len; i++)
+            dbus_message_append_snapshot_node(reply, eui64[i],
+                                              ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage, eui64[i]));
+        free(eui64);
+        sd_bus_message_close_container(reply);
+        dbus_message_append_routing_graph(reply, "RoutingGraph", ctxt);
+    } else {
+        sd_bus_message_append(reply, "a(aybay)", 0);
+        sd_bus_message_append(reply, "a(aybaay)", 0);
+    }
+    dbus_get_transient_keys(reply, &ctxt->net_if, ret_error, false);
+    dbus_get_transient_keys(reply, &ctxt->net_if, ret_error, true);
+    ret = sd_bus_send(NULL, reply, NULL);
+    sd_bus_message_unref(reply);
+    return ret;
+}
+
+void dbus_emit_routing_graph_change(struct rpl_root *root, struct rpl_target *target, const char *event)
+{
+    sd_bus_message *msg;
+
+    msg = dbus_signal_new("RoutingGraphChanged");
+    if (!msg)
+        return;
+    sd_bus_message_append(msg, "s", event);
+    dbus_message_append_rpl_target(msg, target);
+    dbus_signal_send(msg);
 }
 
 int dbus_get_hw_address(sd_bus *bus, const char *path, const char *interface,
@@ -583,6 +1012,137 @@ int wsbrd_get_ws_size(sd_bus *bus, const char *path, const char *interface,
     return 0;
 }
 
+static int dbus_get_rpl_refresh_progress(sd_bus *bus, const char *path, const char *interface,
+                                         const char *property, sd_bus_message *reply,
+                                         void *userdata, sd_bus_error *ret_error)
+{
+    struct rpl_root *root = userdata;
+
+    sd_bus_message_append(reply, "(uuub)",
+                          root->refresh.done, root->refresh.total,
+                          root->refresh.gen ? (uint32_t)time_get_elapsed(CLOCK_MONOTONIC, root->refresh.start_s) : 0,
+                          rpl_refresh_in_progress(root));
+    return 0;
+}
+
+static int dbus_get_campaign_progress(sd_bus *bus, const char *path, const char *interface,
+                                      const char *property, sd_bus_message *reply,
+                                      void *userdata, sd_bus_error *ret_error)
+{
+    const struct wsbr_ctxt *ctxt = userdata;
+    const struct wsbr_campaign *campaign = &ctxt->campaign;
+
+    sd_bus_message_append(reply, "(uuutb)",
+                          campaign->dst_done, campaign->dst_failed, campaign->dst_count,
+                          campaign->tx_count, wsbr_campaign_running(ctxt));
+    return 0;
+}
+
+static int dbus_get_tx_latency(sd_bus *bus, const char *path, const char *interface,
+                               const char *property, sd_bus_message *reply,
+                               void *userdata, sd_bus_error *ret_error)
+{
+    const struct histogram *hist;
+
+    sd_bus_message_open_container(reply, 'a', "(sttttt)");
+    for (int i = 0; i < WSBR_TX_LATENCY_COUNT; i++) {
+        hist = &g_metrics.tx_latency_us[i];
+        sd_bus_message_append(reply, "(sttttt)", wsbr_metrics_tx_latency_str(i), hist->count,
+                              histogram_quantile(hist, 0.5), histogram_quantile(hist, 0.9),
+                              histogram_quantile(hist, 0.99), hist->max);
+    }
+    sd_bus_message_close_container(reply);
+    return 0;
+}
+
+static int dbus_get_loop_latency(sd_bus *bus, const char *path, const char *interface,
+                                 const char *property, sd_bus_message *reply,
+                                 void *userdata, sd_bus_error *ret_error)
+{
+    const struct histogram *hist = &g_metrics.loop_latency_us;
+
+    sd_bus_message_append(reply, "(ttttt)", hist->count,
+                          histogram_quantile(hist, 0.5), histogram_quantile(hist, 0.9),
+                          histogram_quantile(hist, 0.99), hist->max);
+    return 0;
+}
+
+static int dbus_get_timer_wakeup_rate(sd_bus *bus, const char *path, const char *interface,
+                                      const char *property, sd_bus_message *reply,
+                                      void *userdata, sd_bus_error *ret_error)
+{
+    sd_bus_message_append(reply, "u", timer_wakeup_rate());
+    return 0;
+}
+
+static int dbus_get_memory_usage(sd_bus *bus, const char *path, const char *interface,
+                                 const char *property, sd_bus_message *reply,
+                                 void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+    const struct wsbr_mem_usage *usage;
+
+    wsbr_mem_update(ctxt);
+    sd_bus_message_open_container(reply, 'a', "(suutt)");
+    for (int i = 0; i < WSBR_MEM_TABLE_COUNT; i++) {
+        usage = &ctxt->mem.tables[i];
+        sd_bus_message_append(reply, "(suutt)", wsbr_mem_table_str(i),
+                              usage->count, usage->count_max,
+                              (uint64_t)usage->bytes, (uint64_t)usage->bytes_max);
+    }
+    sd_bus_message_close_container(reply);
+    return 0;
+}
+
+static int dbus_get_duty_cycle(sd_bus *bus, const char *path, const char *interface,
+                               const char *property, sd_bus_message *reply,
+                               void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+    struct duty_cycle *dc = &ctxt->net_if.ws_info.duty_cycle;
+
+    if (!duty_cycle_enabled(dc))
+        return sd_bus_error_set_errno(ret_error, ENODATA);
+    sd_bus_message_append(reply, "(ttt)", duty_cycle_window_ms(dc) / 1000,
+                          dc->budget_us, duty_cycle_used_us(dc));
+    return 0;
+}
+
+static int dbus_get_cpu_usage(sd_bus *bus, const char *path, const char *interface,
+                              const char *property, sd_bus_message *reply,
+                              void *userdata, sd_bus_error *ret_error)
+{
+    const struct cpu_usage_entry *entries;
+    char name[128];
+    int count;
+
+    if (!g_cpu_usage_enabled)
+        return sd_bus_error_set_errno(ret_error, ENODATA);
+    entries = cpu_usage_entries(&count);
+    sd_bus_message_open_container(reply, 'a', "(sstttx)");
+    for (int i = 0; i < count; i++)
+        sd_bus_message_append(reply, "(sstttx)", cpu_usage_type_str(entries[i].type),
+                              cpu_usage_name(&entries[i], name, sizeof(name)),
+                              entries[i].calls, entries[i].cpu_ns / 1000,
+                              entries[i].cpu_max_ns / 1000, entries[i].heap_bytes);
+    sd_bus_message_close_container(reply);
+    return 0;
+}
+
+static int dbus_reload_config(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    wsbr_config_reload(userdata);
+    sd_bus_reply_method_return(m, NULL);
+    return 0;
+}
+
+static int dbus_reset_cpu_usage(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    cpu_usage_reset();
+    sd_bus_reply_method_return(m, NULL);
+    return 0;
+}
+
 int dbus_get_string(sd_bus *bus, const char *path, const char *interface,
                const char *property, sd_bus_message *reply,
                void *userdata, sd_bus_error *ret_error)
@@ -600,6 +1160,10 @@ const sd_bus_vtable wsbrd_dbus_vtable[] = {
         SD_BUS_METHOD("SetModeSwitch",       "ayi",    NULL, dbus_set_mode_switch,       SD_BUS_VTABLE_DEPRECATED),
         SD_BUS_METHOD("SetLinkModeSwitch",   "ayuy",   NULL, dbus_set_link_mode_switch,  0),
         SD_BUS_METHOD("SetLinkEdfe",         "ayy",    NULL, dbus_set_link_edfe,         0),
+        SD_BUS_METHOD("SetLinkSfr",          "ayb",    NULL, dbus_set_link_sfr,          0),
+        SD_BUS_METHOD("GetNodeStats",        "ay",     "ua(uqqqqqyuq)", dbus_get_node_stats, 0),
+        SD_BUS_METHOD("GetNodes",            "tayayyu", "ta(aya{sv})", dbus_get_nodes_paged, 0),
+        SD_BUS_METHOD("GetSnapshot",         "t",      "ta(aybay)a(aybaay)aayaay", dbus_get_snapshot, 0),
         SD_BUS_METHOD("RevokePairwiseKeys",  "ay",     NULL, dbus_revoke_pairwise_keys,  0),
         SD_BUS_METHOD("RevokeGroupKeys",     "ayay",   NULL, dbus_revoke_group_keys,     0),
         SD_BUS_METHOD("InstallGtk",          "ay",     NULL, dbus_install_gtk,           0),
@@ -607,9 +1171,14 @@ const sd_bus_vtable wsbrd_dbus_vtable[] = {
         SD_BUS_METHOD("IeCustomInsert",      "yyayay", NULL, dbus_ie_custom_insert,      0),
         SD_BUS_METHOD("IeCustomClear",       NULL,     NULL, dbus_ie_custom_clear,       0),
         SD_BUS_METHOD("IncrementRplDtsn",    NULL,     NULL, dbus_increment_rpl_dtsn,    0),
+        SD_BUS_METHOD("ResetCpuUsage",       NULL,     NULL, dbus_reset_cpu_usage,       0),
+        SD_BUS_METHOD("ReloadConfig",        NULL,     NULL, dbus_reload_config,         0),
         SD_BUS_METHOD("IncrementRplDodagVersionNumber", NULL, NULL, dbus_increment_rpl_dodag_version_number, 0),
         SD_BUS_METHOD("AllowMac64",          "aay",    NULL, dbus_allow_mac64, 0),
         SD_BUS_METHOD("DenyMac64",           "aay",    NULL, dbus_deny_mac64, 0),
+        SD_BUS_METHOD("SetPcapFilter",       "aayas",  NULL, dbus_set_pcap_filter, 0),
+        SD_BUS_METHOD("StartCampaign",       "aayqaay", NULL, dbus_start_campaign, 0),
+        SD_BUS_METHOD("StopCampaign",        NULL,     NULL, dbus_stop_campaign, 0),
         SD_BUS_PROPERTY("Gtks", "aay", dbus_get_gtks,
                         offsetof(struct wsbr_ctxt, net_if),
                         SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
@@ -626,6 +1195,16 @@ const sd_bus_vtable wsbrd_dbus_vtable[] = {
                         SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION),
         SD_BUS_PROPERTY("RoutingGraph", "a(aybaay)", dbus_get_routing_graph, 0,
                         SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION),
+        SD_BUS_SIGNAL("RoutingGraphChanged", "s(aybaay)", 0),
+        SD_BUS_PROPERTY("TxLatency", "a(sttttt)", dbus_get_tx_latency, 0, 0),
+        SD_BUS_PROPERTY("LoopLatency", "(ttttt)", dbus_get_loop_latency, 0, 0),
+        SD_BUS_PROPERTY("CpuUsage", "a(sstttx)", dbus_get_cpu_usage, 0, 0),
+        SD_BUS_PROPERTY("DutyCycle", "(ttt)", dbus_get_duty_cycle, 0, 0),
+        SD_BUS_PROPERTY("MemoryUsage", "a(suutt)", dbus_get_memory_usage, 0, 0),
+        SD_BUS_PROPERTY("RplRefreshProgress", "(uuub)", dbus_get_rpl_refresh_progress,
+                        offsetof(struct wsbr_ctxt, net_if.rpl_root),
+                        0),
+        SD_BUS_PROPERTY("CampaignProgress", "(uuutb)", dbus_get_campaign_progress, 0, 0),
         SD_BUS_PROPERTY("HwAddress", "ay", dbus_get_hw_address,
                         offsetof(struct wsbr_ctxt, rcp.eui64),
                         0),
@@ -656,5 +1235,6 @@ const sd_bus_vtable wsbrd_dbus_vtable[] = {
         SD_BUS_PROPERTY("WisunFanVersion", "y", dbus_get_fan_version,
                         offsetof(struct wsbr_ctxt, net_if.id),
                         SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("TimerWakeupRate", "u", dbus_get_timer_wakeup_rate, 0, 0),
         SD_BUS_VTABLE_END
 };
@@ -15,13 +15,39 @@
 #define WSBR_DBUS_H
 
 struct wsbr_ctxt;
+struct rpl_root;
+struct rpl_target;
+
+// Events of the RoutingGraphChanged signal
+#define DBUS_ROUTING_GRAPH_ADD    "add"
+#define DBUS_ROUTING_GRAPH_UPDATE "update"
+#define DBUS_ROUTING_GRAPH_DEL    "del"
 
 #ifdef HAVE_LIBSYSTEMD
 #include <systemd/sd-bus.h>
 
 extern const struct sd_bus_vtable wsbrd_dbus_vtable[];
+
+void dbus_emit_routing_graph_change(struct rpl_root *root, struct rpl_target *target, const char *event);
+// Invalidate the Nodes property, and its cached value.
+void dbus_nodes_changed(void);
+// Invalidate the RoutingGraph property, and its cached value.
+void dbus_routing_graph_changed(void);
 #else
 static const struct sd_bus_vtable *const wsbrd_dbus_vtable;
+
+static inline void dbus_emit_routing_graph_change(struct rpl_root *root, struct rpl_target *target,
+                                                  const char *event)
+{
+}
+
+static inline void dbus_nodes_changed(void)
+{
+}
+
+static inline void dbus_routing_graph_changed(void)
+{
+}
 #endif
 
 #endif
@@ -45,20 +45,40 @@ void dbus_message_append_supp(sd_bus_message *m, const char *property, const voi
     }
 }
 
-int dbus_get_nodes(sd_bus *bus, const char *path, const char *interface,
-                   const char *property, sd_bus_message *reply,
-                   void *userdata, sd_bus_error *ret_error)
+int dbus_supp_list(struct wsbr_ctxt *ctxt, uint8_t eui64[][8], int len)
+{
+    const struct auth_supp_ctx *supp;
+    int i = 0;
+
+    SLIST_FOREACH(supp, &ctxt->auth.supplicants, link) {
+        if (i == len)
+            break;
+        memcpy(eui64[i++], supp->eui64.u8, 8);
+    }
+    return i;
+}
+
+bool dbus_message_append_node_supp(sd_bus_message *m, const char *property,
+                                   struct wsbr_ctxt *ctxt, const uint8_t eui64[8], int role)
+{
+    const struct auth_supp_ctx *supp;
+    const struct ws_neigh *neigh;
+
+    supp = auth_get_supp(&ctxt->auth, (const struct eui64 *)eui64);
+    if (role >= 0 && (!supp || supp->node_role != role))
+        return false;
+    neigh = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage, eui64);
+    dbus_message_append_node(m, property, (const struct eui64 *)eui64, false, supp, neigh);
+    return true;
+}
+
+void dbus_message_append_nodes(sd_bus_message *m, const char *property, struct wsbr_ctxt *ctxt)
 {
-    struct wsbr_ctxt *ctxt = userdata;
     const struct auth_supp_ctx *supp;
     const struct ws_neigh *neigh;
 
-    sd_bus_message_open_container(reply, 'a', "(aya{sv})");
-    dbus_message_append_node_br(reply, property, ctxt);
     SLIST_FOREACH(supp, &ctxt->auth.supplicants, link) {
         neigh = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage, supp->eui64.u8);
-        dbus_message_append_node(reply, property, &supp->eui64, false, supp, neigh);
+        dbus_message_append_node(m, property, &supp->eui64, false, supp, neigh);
     }
-    sd_bus_message_close_container(reply);
-    return 0;
 }
@@ -31,8 +31,15 @@ void dbus_message_append_node(sd_bus_message *m, const char *property,
                               bool is_br, const void *supp,
                               const struct ws_neigh *neighbor);
 void dbus_message_append_node_br(sd_bus_message *m, const char *property, struct wsbr_ctxt *ctxt);
-int dbus_get_nodes(sd_bus *bus, const char *path, const char *interface,
-                   const char *property, sd_bus_message *reply,
-                   void *userdata, sd_bus_error *ret_error);
+
+// Fill eui64 with the supplicants known by the authenticator, return their
+// number.
+int dbus_supp_list(struct wsbr_ctxt *ctxt, uint8_t eui64[][8], int len);
+// Append the node with the given EUI-64, unless role is positive and differs
+// from the role of the node. Return true if the node was appended.
+bool dbus_message_append_node_supp(sd_bus_message *m, const char *property,
+                                   struct wsbr_ctxt *ctxt, const uint8_t eui64[8], int role);
+// Append every supplicant.
+void dbus_message_append_nodes(sd_bus_message *m, const char *property, struct wsbr_ctxt *ctxt);
 
 #endif
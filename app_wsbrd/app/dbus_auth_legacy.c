@@ -15,6 +15,7 @@
 #include <math.h>
 
 #include "app_wsbrd/app/wsbrd.h"
+#include "app_wsbrd/ws/ws_auth.h"
 #include "app_wsbrd/ws/ws_pae_auth.h"
 #include "app_wsbrd/ws/ws_pae_controller.h"
 #include "app_wsbrd/ws/ws_pae_key_storage.h"
@@ -81,32 +82,44 @@ void dbus_message_append_supp(sd_bus_message *m, const char *property, const voi
     }
 }
 
-int dbus_get_nodes(sd_bus *bus, const char *path, const char *interface,
-                   const char *property, sd_bus_message *reply,
-                   void *userdata, sd_bus_error *ret_error)
+int dbus_supp_list(struct wsbr_ctxt *ctxt, uint8_t eui64[][8], int len)
+{
+    return ws_pae_auth_supp_list(ctxt->net_if.id, eui64, len);
+}
+
+bool dbus_message_append_node_supp(sd_bus_message *m, const char *property,
+                                   struct wsbr_ctxt *ctxt, const uint8_t eui64[8], int role)
 {
     const struct ws_neigh *neighbor_info;
-    struct wsbr_ctxt *ctxt = userdata;
-    int len_pae;
-    uint8_t eui64_pae[4096][8];
     supp_entry_t *supp;
 
-    len_pae = ws_pae_auth_supp_list(ctxt->net_if.id, eui64_pae, sizeof(eui64_pae));
-
-    sd_bus_message_open_container(reply, 'a', "(aya{sv})");
-    dbus_message_append_node_br(reply, property, ctxt);
-
-    for (int i = 0; i < len_pae; i++) {
-        neighbor_info = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage, eui64_pae[i]);
-        if (ws_pae_key_storage_supp_exists(eui64_pae[i]))
-            supp = ws_pae_key_storage_supp_read(NULL, eui64_pae[i], NULL, NULL, NULL);
-        else
-            supp = NULL;
-        dbus_message_append_node(reply, property, (struct eui64 *)eui64_pae[i],
-                                 false, supp, neighbor_info);
-        if (supp)
-            free(supp);
+    if (ws_pae_key_storage_supp_exists(eui64))
+        supp = ws_pae_key_storage_supp_read(NULL, eui64, NULL, NULL, NULL);
+    else
+        supp = NULL;
+    if (role >= 0 && (!supp || supp->sec_keys.node_role != role)) {
+        free(supp);
+        return false;
     }
-    sd_bus_message_close_container(reply);
-    return 0;
+    neighbor_info = ws_neigh_get(&ctxt->net_if.ws_info.neighbor_storage, eui64);
+    dbus_message_append_node(m, property, (const struct eui64 *)eui64, false, supp, neighbor_info);
+    free(supp);
+    return true;
+}
+
+void dbus_message_append_nodes(sd_bus_message *m, const char *property, struct wsbr_ctxt *ctxt)
+{
+    uint8_t (*eui64_pae)[8];
+    int active, waiting;
+    int len_pae;
+
+    ws_auth_session_count(&ctxt->net_if, &active, &waiting);
+    len_pae = ws_pae_key_storage_count() + active + waiting;
+    if (!len_pae)
+        return;
+    eui64_pae = xalloc(len_pae * sizeof(*eui64_pae));
+    len_pae = dbus_supp_list(ctxt, eui64_pae, len_pae);
+    for (int i = 0; i < len_pae; i++)
+        dbus_message_append_node_supp(m, property, ctxt, eui64_pae[i], -1);
+    free(eui64_pae);
 }
@@ -44,11 +44,14 @@ typedef struct mcps_data_req {
     uint8_t DstAddr[8];             /**< Destination address */
     uint16_t msduLength;            /**< Service data unit length */
     uint8_t *msdu;                  /**< Service data unit */
+    uint8_t msdu_prefix_len;        /**< Length of msdu_prefix */
+    const uint8_t *msdu_prefix;     /**< Written before msdu, avoids to copy msdu to prepend a header */
     uint8_t msduHandle;             /**< Handle associated with MSDU */
     bool TxAckReq: 1;               /**< Specifies whether ACK is needed or not */
     bool SeqNumSuppressed: 1;       /**< True suppress sequence number from frame. This will be only checked when 2015 extension is enabled */
     bool PanIdSuppressed: 1;        /**< True suppress PAN-id is done when possible from frame. This will be only checked when 2015 extension is enabled */
     bool lfn_multicast: 1;          /**< Multicast packet for LFN */
+    bool fragment: 1;               /**< Fragment of a 6LoWPAN datagram */
     struct mlme_security Key;       /**< Security key */
     struct rcp_rate_info rate_list[4];
     uint8_t ms_mode;
@@ -13,9 +13,11 @@
  */
 #include <errno.h>
 #include <ifaddrs.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/queue.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
 #include <linux/if.h>
@@ -33,13 +35,19 @@
 #include "common/bits.h"
 #include "common/capture.h"
 #include "common/log.h"
+#include "common/memutils.h"
+#include "common/sys_queue_extra.h"
 #include "common/endian.h"
 #include "common/iobuf.h"
 #include "common/netinet_in_extra.h"
+#include "common/mathutils.h"
+#include "common/time_extra.h"
 #include "common/tun.h"
+#include "common/work_pool.h"
 #include "common/specs/ipv6.h"
 #include "common/specs/icmpv6.h"
 
+#include "6lowpan/iphc_decode/cipv6.h"
 #include "6lowpan/lowpan_adaptation_interface.h"
 #include "net/protocol.h"
 #include "net/netaddr_types.h"
@@ -47,11 +55,88 @@
 #include "tun.h"
 #include "wsbrd.h"
 
+// Maximum number of packets read from TUN per poll() wakeup, so that a burst
+// from the backhaul does not cost one wakeup per packet, nor starve the RCP.
+#define WSBR_TUN_READ_BUDGET 16
+
+// Packet being written to TUN by a worker of wsbr_tun_workers.
+struct wsbr_tun_job {
+    struct work_item item;
+    int fd;
+    ssize_t ret;
+    int err;
+    uint16_t len;
+    uint8_t pkt[];
+};
+
+static void wsbr_tun_job_work(struct work_pool *pool, struct work_item *item)
+{
+    struct wsbr_tun_job *job = container_of(item, struct wsbr_tun_job, item);
+
+    job->ret = xwrite(job->fd, job->pkt, job->len);
+    job->err = errno;
+}
+
+static void wsbr_tun_job_done(struct work_pool *pool, struct work_item *item)
+{
+    struct wsbr_tun_job *job = container_of(item, struct wsbr_tun_job, item);
+
+    if (job->ret < 0)
+        WARN("%s: write: %s", __func__, strerror(job->err));
+    else if (job->ret != job->len)
+        WARN("%s: write: Short write: %zd < %d", __func__, job->ret, job->len);
+    g_ctxt.tun_workers.inflight--;
+    free(job);
+}
+
+void wsbr_tun_workers_init(struct wsbr_ctxt *ctxt, int count)
+{
+    struct wsbr_tun_workers *workers = &ctxt->tun_workers;
+
+    workers->pools = zalloc(count * sizeof(*workers->pools));
+    workers->count = count;
+    for (int i = 0; i < count; i++)
+        work_pool_init(&workers->pools[i], 1);
+}
+
+// Packets are dispatched by IPv6 source, destination and flow label, so each
+// flow is written by a single thread, in order.
+static void wsbr_tun_workers_write(struct wsbr_ctxt *ctxt, const uint8_t *buf, uint16_t len)
+{
+    struct wsbr_tun_workers *workers = &ctxt->tun_workers;
+    struct wsbr_tun_job *job;
+    unsigned int hash = 0;
+
+    if (workers->inflight >= WSBR_TUN_WORKERS_INFLIGHT_MAX) {
+        TRACE(TR_DROP, "drop %-9s: write queue full", "tun");
+        workers->drop_count++;
+        return;
+    }
+    for (int i = 1; i < MIN(len, IPV6_HDRLEN); i++)
+        if (i < 4 || i >= IPV6_HDROFF_SRC_ADDR)
+            hash = hash * 31 + buf[i];
+    job = xalloc(sizeof(*job) + len);
+    job->item.work = wsbr_tun_job_work;
+    job->item.done = wsbr_tun_job_done;
+    job->fd  = ctxt->tun.fd;
+    job->len = len;
+    memcpy(job->pkt, buf, len);
+    workers->inflight++;
+    work_pool_submit(&workers->pools[hash % workers->count], &job->item);
+}
+
 ssize_t wsbr_tun_write(uint8_t *buf, uint16_t len)
 {
     struct wsbr_ctxt *ctxt = &g_ctxt;
     ssize_t ret;
 
+    if (wsbr_pktshm_write(ctxt, buf, len))
+        return len;
+    if (ctxt->tun_workers.count) {
+        TRACE(TR_TUN, "tx-tun: %u bytes", len);
+        wsbr_tun_workers_write(ctxt, buf, len);
+        return len;
+    }
     ret = xwrite(ctxt->tun.fd, buf, len);
     TRACE(TR_TUN, "tx-tun: %u bytes", len);
     if (ret < 0)
@@ -61,53 +146,258 @@ ssize_t wsbr_tun_write(uint8_t *buf, uint16_t len)
     return ret;
 }
 
-void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16])
+// Neighbor proxy entries and routes are added in bursts when the network
+// (re)joins. Instead of a blocking netlink transaction per node, requests are
+// queued and sent at once by wsbr_tun_nl_commit(), with several messages in a
+// single send(). Acknowledgments are handled by wsbr_tun_nl_recv() from the
+// main loop.
+//
+// Maximum size of the netlink messages concatenated in a single send().
+#define WSBR_TUN_NL_BATCH_SIZE (16 * 1024)
+
+enum wsbr_tun_nl_type {
+    WSBR_TUN_NL_NEIGH_ADD,
+    WSBR_TUN_NL_ROUTE_ADD,
+};
+
+struct wsbr_tun_nl_req {
+    enum wsbr_tun_nl_type type;
+    struct in6_addr addr;
+    uint32_t seq;
+    STAILQ_ENTRY(wsbr_tun_nl_req) link;
+};
+
+// Declare struct wsbr_tun_nl_req_list
+STAILQ_HEAD(wsbr_tun_nl_req_list, wsbr_tun_nl_req);
+
+static struct {
+    struct nl_sock *sock;
+    struct wsbr_tun_nl_req_list pending;  // Not sent yet
+    struct wsbr_tun_nl_req_list inflight; // Waiting for acknowledgment
+} g_tun_nl = {
+    .pending  = STAILQ_HEAD_INITIALIZER(g_tun_nl.pending),
+    .inflight = STAILQ_HEAD_INITIALIZER(g_tun_nl.inflight),
+};
+
+static const char *wsbr_tun_nl_req_str(const struct wsbr_tun_nl_req *req)
 {
-    struct wsbr_ctxt *ctxt = &g_ctxt;
+    switch (req->type) {
+    case WSBR_TUN_NL_NEIGH_ADD: return "rtnl_neigh_add";
+    case WSBR_TUN_NL_ROUTE_ADD: return "rtnl_route_add";
+    default: BUG();
+    }
+}
+
+static void wsbr_tun_nl_queue(enum wsbr_tun_nl_type type, const uint8_t addr[16])
+{
+    struct wsbr_tun_nl_req *req;
+
+    if (!g_tun_nl.sock)
+        return;
+    STAILQ_FOREACH(req, &g_tun_nl.pending, link)
+        if (req->type == type && !memcmp(req->addr.s6_addr, addr, 16))
+            return;
+    req = zalloc(sizeof(*req));
+    req->type = type;
+    memcpy(req->addr.s6_addr, addr, 16);
+    STAILQ_INSERT_TAIL(&g_tun_nl.pending, req, link);
+}
+
+// Called for each acknowledgment, error is a negative errno or 0.
+static void wsbr_tun_nl_done(uint32_t seq, int error)
+{
+    struct wsbr_tun_nl_req *req;
+
+    // The kernel processes requests in order, so this is usually the head
+    STAILQ_FOREACH(req, &g_tun_nl.inflight, link)
+        if (req->seq == seq)
+            break;
+    if (!req)
+        return;
+    STAILQ_REMOVE(&g_tun_nl.inflight, req, wsbr_tun_nl_req, link);
+    if (error == -ENOMEM || error == -ENOBUFS || error == -EBUSY) {
+        TRACE(TR_TUN, "%s %s: %s, retrying", wsbr_tun_nl_req_str(req),
+              tr_ipv6(req->addr.s6_addr), strerror(-error));
+        STAILQ_INSERT_TAIL(&g_tun_nl.pending, req, link);
+        return;
+    }
+    if (error && error != -EEXIST)
+        FATAL(2, "%s %s: %s", wsbr_tun_nl_req_str(req), tr_ipv6(req->addr.s6_addr), strerror(-error));
+    free(req);
+}
+
+static int wsbr_tun_nl_ack_cb(struct nl_msg *msg, void *arg)
+{
+    wsbr_tun_nl_done(nlmsg_hdr(msg)->nlmsg_seq, 0);
+    return NL_OK;
+}
+
+static int wsbr_tun_nl_err_cb(struct sockaddr_nl *nla, struct nlmsgerr *err, void *arg)
+{
+    wsbr_tun_nl_done(err->msg.nlmsg_seq, err->error);
+    return NL_SKIP;
+}
+
+static struct nl_msg *wsbr_tun_nl_build(struct wsbr_ctxt *ctxt, const struct wsbr_tun_nl_req *req,
+                                        int proxy_ifindex)
+{
+    struct rtnl_nexthop *nl_nexthop;
+    struct rtnl_route *nl_route;
     struct rtnl_neigh *nl_neigh;
-    struct nl_addr *src_ipv6_nl_addr;
-    struct nl_sock *sock;
-    int err, ifindex;
+    struct nl_addr *nl_addr;
+    struct nl_msg *msg;
+    int ret;
 
-    if (strlen(ctxt->config.neighbor_proxy) == 0)
+    nl_addr = nl_addr_build(AF_INET6, req->addr.s6_addr, 16);
+    FATAL_ON(!nl_addr, 2, "nl_addr_build: %s", strerror(ENOMEM));
+    switch (req->type) {
+    case WSBR_TUN_NL_NEIGH_ADD:
+        nl_neigh = rtnl_neigh_alloc();
+        FATAL_ON(!nl_neigh, 2, "rtnl_neigh_alloc: %s", strerror(ENOMEM));
+        rtnl_neigh_set_ifindex(nl_neigh, proxy_ifindex);
+        rtnl_neigh_set_dst(nl_neigh, nl_addr);
+        rtnl_neigh_set_flags(nl_neigh, NTF_PROXY);
+        rtnl_neigh_set_flags(nl_neigh, NTF_ROUTER);
+        ret = rtnl_neigh_build_add_request(nl_neigh, NLM_F_CREATE, &msg);
+        FATAL_ON(ret < 0, 2, "rtnl_neigh_build_add_request: %s", nl_geterror(ret));
+        rtnl_neigh_put(nl_neigh);
+        break;
+    case WSBR_TUN_NL_ROUTE_ADD:
+        nl_route = rtnl_route_alloc();
+        FATAL_ON(!nl_route, 2, "rtnl_route_alloc: %s", strerror(ENOMEM));
+        nl_nexthop = rtnl_route_nh_alloc();
+        FATAL_ON(!nl_nexthop, 2, "rtnl_route_nh_alloc: %s", strerror(ENOMEM));
+        rtnl_route_set_dst(nl_route, nl_addr);
+        rtnl_route_nh_set_ifindex(nl_nexthop, ctxt->tun.ifindex);
+        rtnl_route_add_nexthop(nl_route, nl_nexthop);
+        ret = rtnl_route_build_add_request(nl_route, 0, &msg);
+        FATAL_ON(ret < 0, 2, "rtnl_route_build_add_request: %s", nl_geterror(ret));
+        rtnl_route_put(nl_route);
+        break;
+    default:
+        BUG();
+    }
+    nl_addr_put(nl_addr);
+    return msg;
+}
+
+static void wsbr_tun_nl_send(struct iobuf_write *buf, uint32_t seq_first)
+{
+    struct wsbr_tun_nl_req *req, *tmp;
+    int ret;
+
+    ret = nl_sendto(g_tun_nl.sock, buf->data, buf->len);
+    buf->len = 0;
+    if (ret >= 0)
         return;
-    ifindex = if_nametoindex(ctxt->config.neighbor_proxy);
-    if (!ifindex) {
-        ERROR("if_nametoindex %s: %m", ctxt->config.neighbor_proxy);
+    // No acknowledgment will come, retry during the next commit
+    WARN("nl_sendto: %s", nl_geterror(ret));
+    STAILQ_FOREACH_SAFE(req, &g_tun_nl.inflight, link, tmp) {
+        if ((int32_t)(req->seq - seq_first) < 0)
+            continue;
+        STAILQ_REMOVE(&g_tun_nl.inflight, req, wsbr_tun_nl_req, link);
+        STAILQ_INSERT_TAIL(&g_tun_nl.pending, req, link);
+    }
+}
+
+void wsbr_tun_nl_commit(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_tun_nl_req_list reqs = STAILQ_HEAD_INITIALIZER(reqs);
+    struct iobuf_write buf = { };
+    struct wsbr_tun_nl_req *req;
+    struct nlmsghdr *hdr;
+    uint32_t seq_first;
+    struct nl_msg *msg;
+    int proxy_ifindex;
+
+    if (STAILQ_EMPTY(&g_tun_nl.pending))
         return;
+    STAILQ_CONCAT(&reqs, &g_tun_nl.pending);
+
+    proxy_ifindex = if_nametoindex(ctxt->config.neighbor_proxy);
+    if (!proxy_ifindex)
+        ERROR("if_nametoindex %s: %m", ctxt->config.neighbor_proxy);
+    while ((req = STAILQ_FIRST(&reqs))) {
+        STAILQ_REMOVE_HEAD(&reqs, link);
+        if (req->type == WSBR_TUN_NL_NEIGH_ADD && !proxy_ifindex) {
+            free(req);
+            continue;
+        }
+        msg = wsbr_tun_nl_build(ctxt, req, proxy_ifindex);
+        // Sets the sequence number and NLM_F_ACK
+        nl_complete_msg(g_tun_nl.sock, msg);
+        hdr = nlmsg_hdr(msg);
+        req->seq = hdr->nlmsg_seq;
+        if (!buf.len)
+            seq_first = req->seq;
+        iobuf_push_data(&buf, hdr, NLMSG_ALIGN(hdr->nlmsg_len));
+        nlmsg_free(msg);
+        STAILQ_INSERT_TAIL(&g_tun_nl.inflight, req, link);
+        if (buf.len >= WSBR_TUN_NL_BATCH_SIZE)
+            wsbr_tun_nl_send(&buf, seq_first);
     }
+    if (buf.len)
+        wsbr_tun_nl_send(&buf, seq_first);
+    iobuf_free(&buf);
+}
 
-    sock = nl_socket_alloc();
-    BUG_ON(!sock);
-    err = nl_connect(sock, NETLINK_ROUTE);
-    FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
+void wsbr_tun_nl_recv(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_tun_nl_req *req;
+    int ret;
+
+    ret = nl_recvmsgs_default(g_tun_nl.sock);
+    if (ret == -NLE_NOMEM) {
+        // The socket receive buffer overflowed and acknowledgments were lost,
+        // the requests may have been applied or not: send them again.
+        WARN("nl_recvmsgs: %s", nl_geterror(ret));
+        while ((req = STAILQ_FIRST(&g_tun_nl.inflight))) {
+            STAILQ_REMOVE_HEAD(&g_tun_nl.inflight, link);
+            STAILQ_INSERT_TAIL(&g_tun_nl.pending, req, link);
+        }
+    } else if (ret < 0) {
+        WARN("nl_recvmsgs: %s", nl_geterror(ret));
+    }
+}
 
-    src_ipv6_nl_addr = nl_addr_build(AF_INET6, address, 16);
-    FATAL_ON(!src_ipv6_nl_addr, 2, "nl_addr_build: %s", strerror(ENOMEM));
-    nl_neigh = rtnl_neigh_alloc();
-    BUG_ON(!nl_neigh);
+int wsbr_tun_nl_fd(struct wsbr_ctxt *ctxt)
+{
+    return g_tun_nl.sock ? nl_socket_get_fd(g_tun_nl.sock) : -1;
+}
 
-    rtnl_neigh_set_ifindex(nl_neigh, ifindex);
-    rtnl_neigh_set_dst(nl_neigh, src_ipv6_nl_addr);
-    rtnl_neigh_set_flags(nl_neigh, NTF_PROXY);
-    rtnl_neigh_set_flags(nl_neigh, NTF_ROUTER);
-    err = rtnl_neigh_add(sock, nl_neigh, NLM_F_CREATE);
-    if (err < 0 && err != NLE_EXIST)
-        FATAL(2, "rtnl_neigh_add: %s", nl_geterror(err));
+static void wsbr_tun_nl_init(struct wsbr_ctxt *ctxt)
+{
+    int ret;
 
-    rtnl_neigh_put(nl_neigh);
-    nl_addr_put(src_ipv6_nl_addr);
-    nl_socket_free(sock);
+    g_tun_nl.sock = nl_socket_alloc();
+    FATAL_ON(!g_tun_nl.sock, 2, "nl_socket_alloc: %s", strerror(ENOMEM));
+    ret = nl_connect(g_tun_nl.sock, NETLINK_ROUTE);
+    FATAL_ON(ret < 0, 2, "nl_connect NETLINK_ROUTE: %s", nl_geterror(ret));
+    ret = nl_socket_set_nonblocking(g_tun_nl.sock);
+    FATAL_ON(ret < 0, 2, "nl_socket_set_nonblocking: %s", nl_geterror(ret));
+    // Several requests are in flight, acknowledgments are matched in
+    // wsbr_tun_nl_done()
+    nl_socket_disable_seq_check(g_tun_nl.sock);
+    nl_socket_modify_cb(g_tun_nl.sock, NL_CB_ACK, NL_CB_CUSTOM, wsbr_tun_nl_ack_cb, NULL);
+    nl_socket_modify_err_cb(g_tun_nl.sock, NL_CB_CUSTOM, wsbr_tun_nl_err_cb, NULL);
 }
 
-void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16])
+void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16])
 {
     struct wsbr_ctxt *ctxt = &g_ctxt;
 
     if (strlen(ctxt->config.neighbor_proxy) == 0)
         return;
+    wsbr_tun_nl_queue(WSBR_TUN_NL_NEIGH_ADD, address);
+}
 
-    tun_route_add(&ctxt->tun,  (const struct in6_addr *)address);
+void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16])
+{
+    struct wsbr_ctxt *ctxt = &g_ctxt;
+
+    if (strlen(ctxt->config.neighbor_proxy) == 0)
+        return;
+    wsbr_tun_nl_queue(WSBR_TUN_NL_ROUTE_ADD, address);
 }
 
 void wsbr_tun_init(struct wsbr_ctxt *ctxt)
@@ -118,6 +408,11 @@ void wsbr_tun_init(struct wsbr_ctxt *ctxt)
     strcpy(ctxt->tun.ifname, ctxt->config.tun_dev);
     tun_init(&ctxt->tun, ctxt->config.tun_autoconf);
     capture_register_netfd(ctxt->tun.fd);
+    // Needed to read the TUN until it is empty
+    ret = fcntl(ctxt->tun.fd, F_SETFL, fcntl(ctxt->tun.fd, F_GETFL) | O_NONBLOCK);
+    FATAL_ON(ret < 0, 2, "fcntl %s: %m", ctxt->tun.ifname);
+    if (ctxt->config.neighbor_proxy[0])
+        wsbr_tun_nl_init(ctxt);
 
     if (ctxt->config.tun_autoconf) {
         memcpy(addr.s6_addr + 8, &ctxt->rcp.eui64, 8);
@@ -171,21 +466,18 @@ static bool is_icmpv6_type_supported_by_wisun(uint8_t iv6t)
         return false;
 }
 
-void wsbr_tun_read(struct wsbr_ctxt *ctxt)
+bool wsbr_tun_stalled(struct wsbr_ctxt *ctxt)
 {
-    uint8_t buf[1504]; // Max ethernet frame size + TUN header
-    struct iobuf_read iobuf = { .data = buf };
+    return lowpan_adaptation_queue_size(ctxt->net_if.id) > 2 || lowpan_down_busy();
+}
+
+void wsbr_tun_inject(struct wsbr_ctxt *ctxt, const uint8_t *pkt, size_t len)
+{
+    struct iobuf_read iobuf = { .data = pkt, .data_size = len };
     uint8_t ip_version, nxthdr;
     buffer_t *buf_6lowpan;
     uint8_t type;
 
-    iobuf.data_size = xread(ctxt->tun.fd, buf, sizeof(buf));
-    if (iobuf.data_size < 0) {
-        WARN("%s: read: %m", __func__);
-        return;
-    }
-    TRACE(TR_TUN, "rx-tun: %i bytes", iobuf.data_size);
-
     ip_version = FIELD_GET(IPV6_MASK_VERSION, iobuf_pop_be32(&iobuf));
     if (ip_version != 6) {
         TRACE(TR_DROP, "drop %-9s: unsupported IPv%u", "tun", ip_version);
@@ -195,6 +487,7 @@ void wsbr_tun_read(struct wsbr_ctxt *ctxt)
     buf_6lowpan = buffer_get_minimal(iobuf.data_size);
     if (!buf_6lowpan)
         FATAL(1,"could not allocate tun buffer_t");
+    buf_6lowpan->tx_stage_us[BUFFER_TX_STAGE_TUN] = time_now_us(CLOCK_MONOTONIC);
     buf_6lowpan->interface = &ctxt->net_if;
     buffer_data_add(buf_6lowpan, iobuf.data, iobuf.data_size);
 
@@ -231,3 +524,27 @@ void wsbr_tun_read(struct wsbr_ctxt *ctxt)
     buf_6lowpan->info = (buffer_info_t)(B_DIR_DOWN | B_FROM_IPV6_FWD | B_TO_IPV6_FWD);
     protocol_push(buf_6lowpan);
 }
+
+// Returns false when there is nothing more to read.
+static bool wsbr_tun_read_one(struct wsbr_ctxt *ctxt)
+{
+    uint8_t buf[1504]; // Max ethernet frame size + TUN header
+    ssize_t len;
+
+    len = xread(ctxt->tun.fd, buf, sizeof(buf));
+    if (len < 0) {
+        if (errno != EAGAIN)
+            WARN("%s: read: %m", __func__);
+        return false;
+    }
+    TRACE(TR_TUN, "rx-tun: %zi bytes", len);
+    wsbr_tun_inject(ctxt, buf, len);
+    return true;
+}
+
+void wsbr_tun_read(struct wsbr_ctxt *ctxt)
+{
+    for (int i = 0; i < WSBR_TUN_READ_BUDGET; i++)
+        if (!wsbr_tun_read_one(ctxt) || wsbr_tun_stalled(ctxt))
+            break;
+}
@@ -13,18 +13,45 @@
  */
 #ifndef TUN_H
 #define TUN_H
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 
 struct wsbr_ctxt;
+struct work_pool;
 struct net_if;
 
+// Maximum number of packets waiting to be written by the workers, above which
+// packets are dropped.
+#define WSBR_TUN_WORKERS_INFLIGHT_MAX 256
+
+// Threads writing the packets from the Wi-SUN network to TUN, see the
+// tun_workers option. Unused if count is 0.
+struct wsbr_tun_workers {
+    struct work_pool *pools; // One thread each
+    int count;
+    unsigned int inflight;
+    uint64_t drop_count;
+};
+
 void wsbr_tun_init(struct wsbr_ctxt *ctxt);
+// Read up to WSBR_TUN_READ_BUDGET packets, or until wsbr_tun_stalled().
 void wsbr_tun_read(struct wsbr_ctxt *ctxt);
+// Process an IPv6 packet as if it was read from TUN.
+void wsbr_tun_inject(struct wsbr_ctxt *ctxt, const uint8_t *pkt, size_t len);
+// True if packets from TUN should wait for the 6LoWPAN queue to drain.
+bool wsbr_tun_stalled(struct wsbr_ctxt *ctxt);
 int wsbr_tun_join_mcast_group(int sock_mcast, const char *if_name, const uint8_t mcast_group[16]);
 int wsbr_tun_leave_mcast_group(int sock_mcast, const char *if_name, const uint8_t mcast_group[16]);
 ssize_t wsbr_tun_write(uint8_t *buf, uint16_t len);
+void wsbr_tun_workers_init(struct wsbr_ctxt *ctxt, int count);
 
+// Send the netlink requests queued by tun_add_node_to_proxy_neightbl() and
+// tun_add_ipv6_direct_route() in a single batch.
+void wsbr_tun_nl_commit(struct wsbr_ctxt *ctxt);
+// Process the acknowledgments, to be called when wsbr_tun_nl_fd() is ready.
+void wsbr_tun_nl_recv(struct wsbr_ctxt *ctxt);
+int wsbr_tun_nl_fd(struct wsbr_ctxt *ctxt);
 void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16]);
 void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16]);
 
@@ -0,0 +1,68 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include "app_wsbrd/6lowpan/lowpan_adaptation_interface.h"
+#include "app_wsbrd/rpl/rpl.h"
+#include "app_wsbrd/ws/ws_auth.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/timer.h"
+
+#include "wsbrd.h"
+#include "wsbr_admission.h"
+
+static unsigned int wsbr_admission_ratio(unsigned int val, unsigned int max)
+{
+    if (!max)
+        return 0;
+    return MIN(100 * val / max, 100);
+}
+
+static void wsbr_admission_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct wsbr_ctxt *ctxt = container_of(timer, struct wsbr_ctxt, admission.timer);
+    struct ws_pan_information *pan_info = &ctxt->net_if.ws_info.pan_information;
+    struct wsbr_admission *admission = &ctxt->admission;
+    unsigned int load_auth, load_queue, load_dao;
+    unsigned int dao_rate, load;
+    int active, waiting;
+
+    ws_auth_session_count(&ctxt->net_if, &active, &waiting);
+    load_auth = wsbr_admission_ratio(active + waiting, ctxt->config.admission_auth_max);
+    load_queue = wsbr_admission_ratio(lowpan_adaptation_queue_size(ctxt->net_if.id),
+                                      ctxt->net_if.random_early_detection.threshold_max);
+    dao_rate = (ctxt->net_if.rpl_root.dao_rx_count - admission->dao_rx_count) * 1000 / WSBR_ADMISSION_PERIOD_MS;
+    admission->dao_rx_count = ctxt->net_if.rpl_root.dao_rx_count;
+    load_dao = wsbr_admission_ratio(dao_rate, ctxt->config.admission_dao_rate_max);
+    load = MAX(MAX(load_auth, load_queue), load_dao);
+
+    // Rise fast, decay slowly, so the advertisements do not oscillate
+    if (load < admission->load)
+        load = (3 * admission->load + load) / 4;
+    if (load == admission->load)
+        return;
+    if (!admission->load || !load)
+        INFO("admission: load %u%% (auth %u%%, queue %u%%, dao %u%%)",
+             load, load_auth, load_queue, load_dao);
+    admission->load = load;
+    pan_info->pan_size_admission = pan_info->max_pan_size * load / 100;
+}
+
+void wsbr_admission_init(struct wsbr_ctxt *ctxt)
+{
+    ctxt->admission.dao_rx_count = ctxt->net_if.rpl_root.dao_rx_count;
+    ctxt->admission.timer.callback  = wsbr_admission_timer;
+    ctxt->admission.timer.period_ms = WSBR_ADMISSION_PERIOD_MS;
+    timer_start_rel(NULL, &ctxt->admission.timer, WSBR_ADMISSION_PERIOD_MS);
+}
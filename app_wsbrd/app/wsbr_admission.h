@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_ADMISSION_H
+#define WSBR_ADMISSION_H
+
+/*
+ * Join admission control, enabled with admission_control. The border router
+ * load is measured every WSBR_ADMISSION_PERIOD_MS as the highest of:
+ *   - the ongoing authentications, relative to admission_auth_max,
+ *   - the 6LoWPAN queue depth, relative to the maximum RED threshold,
+ *   - the DAO rate, relative to admission_dao_rate_max.
+ * Each ratio is capped at 100%, a maximum of 0 ignores the corresponding
+ * input. The load is smoothed, and the same proportion of the maximum PAN
+ * size is added to the advertised PAN size. This raises the PAN cost and the
+ * PAN Load Factor of the JM-IE, so joining nodes prefer another PAN while the
+ * border router is busy. Nodes already joined are not affected.
+ */
+
+#include <stdint.h>
+
+#include "common/timer.h"
+
+struct wsbr_ctxt;
+
+#define WSBR_ADMISSION_PERIOD_MS 5000
+
+struct wsbr_admission {
+    struct timer_entry timer;
+    uint64_t dao_rx_count;
+    uint8_t load; // Percent
+};
+
+void wsbr_admission_init(struct wsbr_ctxt *ctxt);
+
+#endif
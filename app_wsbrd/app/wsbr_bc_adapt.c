@@ -0,0 +1,68 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <inttypes.h>
+
+#include "app_wsbrd/ws/ws_bootstrap_6lbr.h"
+#include "app_wsbrd/ws/ws_mngt.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/timer.h"
+
+#include "wsbrd.h"
+#include "wsbr_bc_adapt.h"
+
+static void wsbr_bc_adapt_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct wsbr_ctxt *ctxt = container_of(timer, struct wsbr_ctxt, bc_adapt.timer);
+    struct ws_fhss_config *fhss = &ctxt->net_if.ws_info.fhss_config;
+    struct wsbr_bc_adapt *adapt = &ctxt->bc_adapt;
+    unsigned int slot_count = MAX(WSBR_BC_ADAPT_PERIOD_MS / fhss->bc_interval, 1);
+    uint32_t bc_interval = fhss->bc_interval;
+
+    if (adapt->tx_count > WSBR_BC_ADAPT_LOAD_HIGH * slot_count) {
+        bc_interval = MAX(bc_interval / 2, ctxt->config.bc_interval_min);
+        adapt->low_periods = 0;
+    } else if (adapt->tx_count < WSBR_BC_ADAPT_LOAD_LOW * slot_count) {
+        if (++adapt->low_periods >= WSBR_BC_ADAPT_HOLD_PERIODS) {
+            bc_interval = MIN(bc_interval * 2, ctxt->config.bc_interval);
+            adapt->low_periods = 0;
+        }
+    } else {
+        adapt->low_periods = 0;
+    }
+
+    if (bc_interval != fhss->bc_interval) {
+        INFO("bc-adapt: %u frames in %u slots, broadcast interval %"PRIu32"ms -> %"PRIu32"ms",
+             adapt->tx_count, slot_count, fhss->bc_interval, bc_interval);
+        fhss->bc_interval = bc_interval;
+        ws_bootstrap_6lbr_fhss_configure(&ctxt->net_if);
+        ws_mngt_pan_version_increase(&ctxt->net_if.ws_info);
+    }
+    adapt->tx_count = 0;
+}
+
+void wsbr_bc_adapt_tx(struct wsbr_ctxt *ctxt)
+{
+    ctxt->bc_adapt.tx_count++;
+}
+
+void wsbr_bc_adapt_init(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_bc_adapt *adapt = &ctxt->bc_adapt;
+
+    adapt->timer.callback  = wsbr_bc_adapt_timer;
+    adapt->timer.period_ms = WSBR_BC_ADAPT_PERIOD_MS;
+    timer_start_rel(NULL, &adapt->timer, adapt->timer.period_ms);
+}
@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_BC_ADAPT_H
+#define WSBR_BC_ADAPT_H
+
+/*
+ * Adapt the FFN broadcast interval to the broadcast load (MPL, DIO, DAO and
+ * other multicast traffic), between broadcast_interval_min and
+ * broadcast_interval.
+ *
+ * Every WSBR_BC_ADAPT_PERIOD_MS, the number of broadcast frames sent is
+ * compared to the number of broadcast slots of the period. Above
+ * WSBR_BC_ADAPT_LOAD_HIGH frames per slot, the interval is halved. Below
+ * WSBR_BC_ADAPT_LOAD_LOW frames per slot for WSBR_BC_ADAPT_HOLD_PERIODS
+ * consecutive periods, it is doubled. The RCP schedule is updated, and the
+ * PAN Version is increased so the nodes receive the new BS-IE.
+ *
+ * The LFN broadcast interval is not adapted: LFNs only learn the LBS-IE on
+ * their broadcast sync, a change would desynchronize them until then.
+ */
+
+#include "common/timer.h"
+
+struct wsbr_ctxt;
+
+#define WSBR_BC_ADAPT_PERIOD_MS     60000
+#define WSBR_BC_ADAPT_LOAD_HIGH     3 // Frames per slot
+#define WSBR_BC_ADAPT_LOAD_LOW      1 // Frames per slot
+#define WSBR_BC_ADAPT_HOLD_PERIODS  5
+
+struct wsbr_bc_adapt {
+    struct timer_entry timer;
+    unsigned int tx_count;
+    int low_periods;
+};
+
+void wsbr_bc_adapt_init(struct wsbr_ctxt *ctxt);
+void wsbr_bc_adapt_tx(struct wsbr_ctxt *ctxt);
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "app_wsbrd/6lowpan/lowpan_adaptation_interface.h"
+#include "app_wsbrd/rpl/rpl_srh.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/time_extra.h"
+#include "common/timer.h"
+
+#include "wsbrd.h"
+#include "wsbr_campaign.h"
+
+static void wsbr_campaign_free(struct wsbr_campaign *campaign)
+{
+    for (int i = 0; i < campaign->block_count; i++)
+        free(campaign->blocks[i]);
+    free(campaign->blocks);
+    free(campaign->block_lens);
+    free(campaign->dsts);
+    free(campaign->branches);
+    campaign->blocks       = NULL;
+    campaign->block_lens   = NULL;
+    campaign->block_count  = 0;
+    campaign->dsts         = NULL;
+    campaign->branches     = NULL;
+    campaign->branch_count = 0;
+    if (campaign->fd >= 0)
+        close(campaign->fd);
+    campaign->fd = -1;
+}
+
+static struct wsbr_campaign_branch *wsbr_campaign_branch_get(struct wsbr_campaign *campaign,
+                                                             const uint8_t nxthop[16])
+{
+    struct wsbr_campaign_branch *branch;
+
+    for (int i = 0; i < campaign->branch_count; i++)
+        if (!memcmp(campaign->branches[i].nxthop, nxthop, 16))
+            return &campaign->branches[i];
+    // There are at most as many branches as destinations
+    branch = &campaign->branches[campaign->branch_count++];
+    memcpy(branch->nxthop, nxthop, 16);
+    branch->head = -1;
+    branch->tail = -1;
+    return branch;
+}
+
+static void wsbr_campaign_branch_push(struct wsbr_campaign *campaign,
+                                      struct wsbr_campaign_branch *branch, int i)
+{
+    campaign->dsts[i].next = -1;
+    if (branch->tail >= 0)
+        campaign->dsts[branch->tail].next = i;
+    else
+        branch->head = i;
+    branch->tail = i;
+}
+
+static bool wsbr_campaign_send(struct wsbr_ctxt *ctxt, struct wsbr_campaign_branch *branch)
+{
+    struct wsbr_campaign *campaign = &ctxt->campaign;
+    struct wsbr_campaign_dst *dst = &campaign->dsts[branch->head];
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6,
+        .sin6_port   = htons(campaign->port),
+    };
+    ssize_t ret;
+
+    memcpy(&addr.sin6_addr, dst->addr, 16);
+    ret = sendto(campaign->fd, campaign->blocks[dst->block_next], campaign->block_lens[dst->block_next],
+                 0, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret < 0 && errno == EAGAIN)
+        return false;
+    if (ret < 0) {
+        WARN("%s: sendto %s: %m", __func__, tr_ipv6(dst->addr));
+        campaign->dst_failed++;
+        branch->head = dst->next;
+        return true;
+    }
+    campaign->tx_count++;
+    dst->block_next++;
+    if (dst->block_next == campaign->block_count) {
+        campaign->dst_done++;
+        branch->head = dst->next;
+    }
+    return true;
+}
+
+static void wsbr_campaign_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct wsbr_ctxt *ctxt = container_of(timer, struct wsbr_ctxt, campaign.timer);
+    struct wsbr_campaign *campaign = &ctxt->campaign;
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    struct wsbr_campaign_branch *branch;
+    bool pending = false;
+
+    for (int i = 0; i < campaign->branch_count; i++) {
+        branch = &campaign->branches[i];
+        if (branch->head < 0)
+            continue;
+        pending = true;
+        if (branch->next_tx_ms > now_ms)
+            continue;
+        // Leave room in the queue for the rest of the traffic
+        if (lowpan_adaptation_queue_size(ctxt->net_if.id) >= ctxt->net_if.random_early_detection.threshold_min)
+            break;
+        if (!wsbr_campaign_send(ctxt, branch))
+            break;
+        if (branch->head >= 0)
+            branch->next_tx_ms = now_ms + campaign->dsts[branch->head].hops * ctxt->config.campaign_hop_interval_ms;
+    }
+    if (pending)
+        return;
+    INFO("campaign: done in %"PRIu64"s, %d/%d nodes, %d failed", (now_ms - campaign->start_ms) / 1000,
+         campaign->dst_done, campaign->dst_count, campaign->dst_failed);
+    timer_stop(NULL, &campaign->timer);
+    wsbr_campaign_free(campaign);
+}
+
+int wsbr_campaign_start(struct wsbr_ctxt *ctxt, uint16_t port,
+                        const uint8_t (*dsts)[16], int dst_count,
+                        const uint8_t *const *blocks, const uint16_t *block_lens, int block_count)
+{
+    struct wsbr_campaign *campaign = &ctxt->campaign;
+    struct wsbr_campaign_branch *branch;
+    struct wsbr_campaign_dst *dst;
+    uint8_t hops_max = 1;
+    const uint8_t *nxthop;
+    int ret;
+
+    if (wsbr_campaign_running(ctxt))
+        return -EBUSY;
+    if (!dst_count || !block_count || !port)
+        return -EINVAL;
+
+    campaign->fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (campaign->fd < 0)
+        return -errno;
+    ret = setsockopt(campaign->fd, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+                     &ctxt->tun.ifindex, sizeof(ctxt->tun.ifindex));
+    if (ret < 0) {
+        ret = -errno;
+        wsbr_campaign_free(campaign);
+        return ret;
+    }
+    campaign->port        = port;
+    campaign->block_count = block_count;
+    campaign->blocks      = xalloc(block_count * sizeof(*campaign->blocks));
+    campaign->block_lens  = xalloc(block_count * sizeof(*campaign->block_lens));
+    for (int i = 0; i < block_count; i++) {
+        campaign->blocks[i] = xalloc(MAX(block_lens[i], 1));
+        memcpy(campaign->blocks[i], blocks[i], block_lens[i]);
+        campaign->block_lens[i] = block_lens[i];
+    }
+    campaign->dst_count = dst_count;
+    campaign->dsts      = zalloc(dst_count * sizeof(*campaign->dsts));
+    // One more for the multicast branch
+    campaign->branches  = zalloc((dst_count + 1) * sizeof(*campaign->branches));
+    campaign->dst_done   = 0;
+    campaign->dst_failed = 0;
+    campaign->tx_count   = 0;
+    campaign->start_ms   = time_now_ms(CLOCK_MONOTONIC);
+
+    for (int i = 0; i < dst_count; i++) {
+        dst = &campaign->dsts[i];
+        memcpy(dst->addr, dsts[i], 16);
+        if (IN6_IS_ADDR_MULTICAST(dst->addr))
+            continue;
+        ret = rpl_srh_build(&ctxt->net_if.rpl_root, dst->addr, NULL, &nxthop);
+        if (ret < 0) {
+            TRACE(TR_TX_ABORT, "tx-abort %-9s: no route to %s", "campaign", tr_ipv6(dst->addr));
+            campaign->dst_failed++;
+            continue;
+        }
+        dst->hops = ret + 1;
+        hops_max = MAX(hops_max, dst->hops);
+        branch = wsbr_campaign_branch_get(campaign, nxthop);
+        wsbr_campaign_branch_push(campaign, branch, i);
+    }
+    branch = NULL;
+    for (int i = 0; i < dst_count; i++) {
+        dst = &campaign->dsts[i];
+        if (!IN6_IS_ADDR_MULTICAST(dst->addr))
+            continue;
+        if (!branch)
+            branch = wsbr_campaign_branch_get(campaign, dst->addr);
+        dst->hops = hops_max;
+        wsbr_campaign_branch_push(campaign, branch, i);
+    }
+
+    INFO("campaign: %d blocks to %d nodes through %d branches",
+         block_count, dst_count, campaign->branch_count);
+    campaign->timer.callback  = wsbr_campaign_timer;
+    campaign->timer.period_ms = ctxt->config.campaign_hop_interval_ms;
+    timer_start_rel(NULL, &campaign->timer, 0);
+    return 0;
+}
+
+void wsbr_campaign_stop(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_campaign *campaign = &ctxt->campaign;
+
+    if (!wsbr_campaign_running(ctxt))
+        return;
+    INFO("campaign: stopped, %d/%d nodes, %d failed",
+         campaign->dst_done, campaign->dst_count, campaign->dst_failed);
+    timer_stop(NULL, &campaign->timer);
+    wsbr_campaign_free(campaign);
+}
+
+bool wsbr_campaign_running(const struct wsbr_ctxt *ctxt)
+{
+    return ctxt->campaign.dsts;
+}
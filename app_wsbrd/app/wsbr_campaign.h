@@ -0,0 +1,82 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_CAMPAIGN_H
+#define WSBR_CAMPAIGN_H
+
+/*
+ * Paced transmission of the same series of UDP datagrams (blocks) to many
+ * nodes, typically a firmware image, started with the StartCampaign D-Bus
+ * method.
+ *
+ * The destinations are grouped by the first hop of their RPL route (branch).
+ * Branches are served in parallel, since their traffic mostly goes through
+ * different parts of the network, while the destinations of a branch are
+ * served one after the other, all their blocks in a row. After a block is
+ * sent on a branch, the next one waits campaign_hop_interval_ms per hop
+ * towards the destination, so the packet has likely left the branch. Nothing
+ * is sent while the 6LoWPAN queue is above the minimum RED threshold, this
+ * leaves room for the other traffic and avoids congestion drops.
+ *
+ * Multicast destinations form a branch of their own, paced after the deepest
+ * unicast destination. Blocks are not acknowledged, the head-end is in charge
+ * of the end-to-end reliability.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/timer.h"
+
+struct wsbr_ctxt;
+
+struct wsbr_campaign_dst {
+    uint8_t addr[16];
+    uint8_t hops;
+    int block_next;
+    int next;       // Index of the next destination of the branch, -1 if last
+};
+
+struct wsbr_campaign_branch {
+    uint8_t nxthop[16];
+    uint64_t next_tx_ms;
+    int head;       // Index of the destination being served, -1 when done
+    int tail;
+};
+
+struct wsbr_campaign {
+    int fd;
+    uint16_t port;
+    struct timer_entry timer;
+    uint8_t **blocks;
+    uint16_t *block_lens;
+    int block_count;
+    struct wsbr_campaign_dst *dsts; // NULL when no campaign is running
+    int dst_count;
+    struct wsbr_campaign_branch *branches;
+    int branch_count;
+    // Progress, reset by wsbr_campaign_start()
+    int dst_done;
+    int dst_failed;
+    uint64_t tx_count;
+    uint64_t start_ms;
+};
+
+// blocks and block_lens are copied. Return a negative errno on failure.
+int wsbr_campaign_start(struct wsbr_ctxt *ctxt, uint16_t port,
+                        const uint8_t (*dsts)[16], int dst_count,
+                        const uint8_t *const *blocks, const uint16_t *block_lens, int block_count);
+void wsbr_campaign_stop(struct wsbr_ctxt *ctxt);
+bool wsbr_campaign_running(const struct wsbr_ctxt *ctxt);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <inttypes.h>
+#include <string.h>
+
+#include "app_wsbrd/ws/ws_bootstrap_6lbr.h"
+#include "app_wsbrd/ws/ws_mngt.h"
+#include "common/bits.h"
+#include "common/hif.h"
+#include "common/log.h"
+#include "common/memutils.h"
+#include "common/rcp_api.h"
+#include "common/timer.h"
+
+#include "wsbrd.h"
+#include "wsbr_chan_excl.h"
+
+static int wsbr_chan_excl_fail_permille(const struct wsbr_chan_stats *stats)
+{
+    if (stats->tx_count < WSBR_CHAN_EXCL_MIN_SAMPLES)
+        return -1;
+    return stats->tx_fail_count * 1000 / stats->tx_count;
+}
+
+static void wsbr_chan_excl_apply(struct wsbr_ctxt *ctxt)
+{
+    struct ws_fhss_config *fhss = &ctxt->net_if.ws_info.fhss_config;
+    struct wsbr_chan_excl *excl = &ctxt->chan_excl;
+
+    memcpy(fhss->uc_chan_mask, excl->uc_chan_mask, sizeof(fhss->uc_chan_mask));
+    memcpy(fhss->bc_chan_mask, excl->bc_chan_mask, sizeof(fhss->bc_chan_mask));
+    for (int i = 0; i < fhss->chan_params->chan_count; i++) {
+        if (!excl->chans[i].excl_periods)
+            continue;
+        bitclr(fhss->uc_chan_mask, i);
+        bitclr(fhss->bc_chan_mask, i);
+    }
+    ws_bootstrap_6lbr_fhss_configure(&ctxt->net_if);
+    ws_mngt_pan_version_increase(&ctxt->net_if.ws_info);
+}
+
+static void wsbr_chan_excl_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct wsbr_ctxt *ctxt = container_of(timer, struct wsbr_ctxt, chan_excl.timer);
+    const struct ws_fhss_config *fhss = &ctxt->net_if.ws_info.fhss_config;
+    struct wsbr_chan_excl *excl = &ctxt->chan_excl;
+    struct wsbr_chan_stats *stats;
+    int chan_count = 0, excl_count = 0;
+    bool changed = false;
+    int worst, fail;
+
+    for (int i = 0; i < fhss->chan_params->chan_count; i++) {
+        if (!bittest(excl->uc_chan_mask, i))
+            continue;
+        chan_count++;
+        stats = &excl->chans[i];
+        if (stats->excl_periods && !--stats->excl_periods) {
+            INFO("chan-excl: channel %d restored", i);
+            changed = true;
+        }
+        if (stats->excl_periods)
+            excl_count++;
+    }
+
+    // Exclude the worst channels first
+    while (excl_count < chan_count / WSBR_CHAN_EXCL_RATIO_MAX) {
+        worst = -1;
+        for (int i = 0; i < fhss->chan_params->chan_count; i++) {
+            stats = &excl->chans[i];
+            if (!bittest(excl->uc_chan_mask, i) || stats->excl_periods)
+                continue;
+            fail = wsbr_chan_excl_fail_permille(stats);
+            if (fail <= ctxt->config.chan_excl_threshold * 10)
+                continue;
+            if (worst < 0 || fail > wsbr_chan_excl_fail_permille(&excl->chans[worst]))
+                worst = i;
+        }
+        if (worst < 0)
+            break;
+        stats = &excl->chans[worst];
+        INFO("chan-excl: channel %d excluded, %u/%u tx failed, %u rx, rsl %"PRId64"dBm", worst,
+             stats->tx_fail_count, stats->tx_count, stats->rx_count,
+             stats->rx_count ? stats->rx_power_sum_dbm / (int64_t)stats->rx_count : 0);
+        stats->excl_periods = WSBR_CHAN_EXCL_HOLD_PERIODS;
+        excl_count++;
+        changed = true;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(excl->chans); i++) {
+        excl->chans[i].tx_count         = 0;
+        excl->chans[i].tx_fail_count    = 0;
+        excl->chans[i].rx_count         = 0;
+        excl->chans[i].rx_power_sum_dbm = 0;
+    }
+    if (changed)
+        wsbr_chan_excl_apply(ctxt);
+}
+
+void wsbr_chan_excl_tx_cnf(struct wsbr_ctxt *ctxt, const struct rcp_tx_cnf *cnf)
+{
+    struct wsbr_chan_stats *stats;
+
+    if (!ctxt->config.chan_excl_threshold || cnf->chan_num >= ARRAY_SIZE(ctxt->chan_excl.chans))
+        return;
+    stats = &ctxt->chan_excl.chans[cnf->chan_num];
+    // The confirmation of a broadcast frame carries no ACK, it cannot be told
+    // apart from a unicast one without parsing the frame, so only the outcome
+    // of the channel access is known.
+    if (cnf->status == HIF_STATUS_SUCCESS && cnf->frame_len) {
+        stats->tx_count++;
+    } else if (cnf->status == HIF_STATUS_NOACK || cnf->status == HIF_STATUS_CCA) {
+        stats->tx_count++;
+        stats->tx_fail_count++;
+    }
+}
+
+void wsbr_chan_excl_rx_ind(struct wsbr_ctxt *ctxt, const struct rcp_rx_ind *ind)
+{
+    struct wsbr_chan_stats *stats;
+
+    if (!ctxt->config.chan_excl_threshold || ind->chan_num >= ARRAY_SIZE(ctxt->chan_excl.chans))
+        return;
+    stats = &ctxt->chan_excl.chans[ind->chan_num];
+    stats->rx_count++;
+    stats->rx_power_sum_dbm += ind->rx_power_dbm;
+}
+
+void wsbr_chan_excl_init(struct wsbr_ctxt *ctxt)
+{
+    const struct ws_fhss_config *fhss = &ctxt->net_if.ws_info.fhss_config;
+    struct wsbr_chan_excl *excl = &ctxt->chan_excl;
+
+    if (ws_chan_mask_get_fixed(fhss->uc_chan_mask) >= 0 || ws_chan_mask_get_fixed(fhss->bc_chan_mask) >= 0) {
+        WARN("chan_excl_threshold: ignored with a fixed channel");
+        ctxt->config.chan_excl_threshold = 0;
+        return;
+    }
+    memcpy(excl->uc_chan_mask, fhss->uc_chan_mask, sizeof(excl->uc_chan_mask));
+    memcpy(excl->bc_chan_mask, fhss->bc_chan_mask, sizeof(excl->bc_chan_mask));
+    excl->timer.callback  = wsbr_chan_excl_timer;
+    excl->timer.period_ms = ctxt->config.chan_excl_period_ms;
+    timer_start_rel(NULL, &excl->timer, excl->timer.period_ms);
+}
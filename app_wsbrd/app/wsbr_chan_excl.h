@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_CHAN_EXCL_H
+#define WSBR_CHAN_EXCL_H
+
+/*
+ * Exclude the channels with a persistent interferer from the unicast and
+ * broadcast schedules, on top of allowed_channels.
+ *
+ * The confirmations of the unicast frames and the channel access failures are
+ * accounted to the channel of their last attempt, and the RSL of the received
+ * frames is averaged per channel. Every chan_excl_period, a channel with at
+ * least WSBR_CHAN_EXCL_MIN_SAMPLES transmissions and a failure ratio above
+ * chan_excl_threshold is excluded for WSBR_CHAN_EXCL_HOLD_PERIODS periods,
+ * after which it is tried again. At most 1/WSBR_CHAN_EXCL_RATIO_MAX of the
+ * channels are excluded at once, the worst ones first.
+ *
+ * The RCP schedules are updated, and the PAN Version is increased so the
+ * nodes refresh the broadcast schedule. The unicast schedule is advertised in
+ * every frame.
+ */
+
+#include <stdint.h>
+
+#include "common/timer.h"
+#include "common/ws/ws_chan_mask.h"
+
+struct wsbr_ctxt;
+struct rcp_tx_cnf;
+struct rcp_rx_ind;
+
+#define WSBR_CHAN_EXCL_MIN_SAMPLES  20
+#define WSBR_CHAN_EXCL_HOLD_PERIODS 6
+#define WSBR_CHAN_EXCL_RATIO_MAX    4
+
+struct wsbr_chan_stats {
+    uint32_t tx_count;
+    uint32_t tx_fail_count;
+    uint32_t rx_count;
+    int64_t  rx_power_sum_dbm;
+    int      excl_periods; // Remaining periods of exclusion, 0 if in use
+};
+
+struct wsbr_chan_excl {
+    struct timer_entry timer;
+    // Masks computed from the configuration, before exclusion
+    uint8_t uc_chan_mask[WS_CHAN_MASK_LEN];
+    uint8_t bc_chan_mask[WS_CHAN_MASK_LEN];
+    struct wsbr_chan_stats chans[WS_CHAN_MASK_LEN * 8];
+};
+
+void wsbr_chan_excl_init(struct wsbr_ctxt *ctxt);
+void wsbr_chan_excl_tx_cnf(struct wsbr_ctxt *ctxt, const struct rcp_tx_cnf *cnf);
+void wsbr_chan_excl_rx_ind(struct wsbr_ctxt *ctxt, const struct rcp_rx_ind *ind);
+
+#endif
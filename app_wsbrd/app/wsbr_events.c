@@ -0,0 +1,212 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app_wsbrd/rpl/rpl.h"
+#include "common/iobuf.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/time_extra.h"
+
+#include "wsbrd.h"
+#include "wsbr_events.h"
+
+#define WSBR_EVENTS_HDR_LEN 12
+
+static void wsbr_events_sub_close(struct wsbr_events *events, struct wsbr_events_sub *sub)
+{
+    event_loop_del(&sub->ev);
+    close(sub->ev.fd);
+    SLIST_REMOVE(&events->subs, sub, wsbr_events_sub, link);
+    free(sub);
+}
+
+static bool wsbr_events_sub_send(struct wsbr_events *events, struct wsbr_events_sub *sub)
+{
+    size_t offset, len;
+    ssize_t ret;
+
+    while (sub->cursor < events->head) {
+        offset = sub->cursor % WSBR_EVENTS_RING_SIZE;
+        len = MIN(events->head - sub->cursor, WSBR_EVENTS_RING_SIZE - offset);
+        ret = send(sub->ev.fd, events->ring + offset, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Resumed by wsbr_events_sub_recv() once the socket is writable
+            event_loop_mod(&sub->ev, EPOLLIN | EPOLLOUT);
+            return true;
+        }
+        if (ret < 0) {
+            WARN("%s: send: %m", __func__);
+            return false;
+        }
+        sub->cursor += ret;
+    }
+    event_loop_mod(&sub->ev, EPOLLIN);
+    return true;
+}
+
+static void wsbr_events_sub_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_events_sub *sub = container_of(src, struct wsbr_events_sub, ev);
+    struct wsbr_events *events = sub->events;
+    uint8_t buf[64];
+    ssize_t ret;
+
+    if (revents & EPOLLIN) {
+        // Subscribers are not expected to send anything, their input is only
+        // read to detect the end of the connection.
+        ret = recv(src->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            wsbr_events_sub_close(events, sub);
+            return;
+        }
+    }
+    if (revents & (EPOLLOUT | EPOLLERR))
+        if (!wsbr_events_sub_send(events, sub))
+            wsbr_events_sub_close(events, sub);
+}
+
+void wsbr_events_init(struct wsbr_ctxt *ctxt)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct wsbr_events *events = &ctxt->events;
+    int ret;
+
+    if (strlen(ctxt->config.events_socket) >= sizeof(addr.sun_path))
+        FATAL(1, "events_socket: path too long");
+    strcpy(addr.sun_path, ctxt->config.events_socket);
+    events->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    FATAL_ON(events->fd < 0, 2, "%s: socket: %m", __func__);
+    // A previous instance may have left the socket behind
+    if (unlink(addr.sun_path) < 0 && errno != ENOENT)
+        FATAL(2, "%s: unlink %s: %m", __func__, addr.sun_path);
+    ret = bind(events->fd, (struct sockaddr *)&addr, sizeof(addr));
+    FATAL_ON(ret < 0, 2, "%s: bind %s: %m", __func__, addr.sun_path);
+    ret = listen(events->fd, 4);
+    FATAL_ON(ret < 0, 2, "%s: listen: %m", __func__);
+    events->ring = xalloc(WSBR_EVENTS_RING_SIZE);
+    SLIST_INIT(&events->subs);
+}
+
+void wsbr_events_accept(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_events *events = &ctxt->events;
+    struct wsbr_events_sub *sub;
+    int fd;
+
+    fd = accept4(events->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        WARN("%s: accept: %m", __func__);
+        return;
+    }
+    sub = zalloc(sizeof(*sub));
+    sub->events      = events;
+    sub->cursor      = events->head;
+    sub->ev.fd       = fd;
+    sub->ev.events   = EPOLLIN;
+    sub->ev.callback = wsbr_events_sub_recv;
+    event_loop_add(&sub->ev);
+    SLIST_INSERT_HEAD(&events->subs, sub, link);
+}
+
+void wsbr_events_flush(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_events *events = &ctxt->events;
+    struct wsbr_events_sub *sub, *tmp;
+
+    SLIST_FOREACH_SAFE(sub, &events->subs, link, tmp)
+        if (sub->cursor < events->head && !(sub->ev.events & EPOLLOUT))
+            if (!wsbr_events_sub_send(events, sub))
+                wsbr_events_sub_close(events, sub);
+}
+
+static void wsbr_events_push(struct wsbr_events *events, enum wsbr_event_type type,
+                             const void *payload, size_t payload_len)
+{
+    struct wsbr_events_sub *sub, *tmp;
+    struct iobuf_write buf = { };
+    size_t offset, len;
+
+    if (!events->ring)
+        return;
+    iobuf_push_le16(&buf, WSBR_EVENTS_HDR_LEN + payload_len);
+    iobuf_push_u8(&buf, type);
+    iobuf_push_u8(&buf, 0);
+    iobuf_push_le64(&buf, time_now_us(CLOCK_REALTIME));
+    if (payload_len)
+        iobuf_push_data(&buf, payload, payload_len);
+    BUG_ON(buf.len > UINT16_MAX);
+
+    // The oldest events are overwritten, a subscriber which still needs them
+    // would receive a corrupted stream.
+    SLIST_FOREACH_SAFE(sub, &events->subs, link, tmp) {
+        if (events->head + buf.len - sub->cursor <= WSBR_EVENTS_RING_SIZE)
+            continue;
+        WARN("events: subscriber too slow, disconnecting");
+        wsbr_events_sub_close(events, sub);
+    }
+    for (int i = 0; i < buf.len; i += len) {
+        offset = (events->head + i) % WSBR_EVENTS_RING_SIZE;
+        len = MIN(buf.len - i, WSBR_EVENTS_RING_SIZE - offset);
+        memcpy(events->ring + offset, buf.data + i, len);
+    }
+    events->head += buf.len;
+    iobuf_free(&buf);
+}
+
+void wsbr_events_target(struct wsbr_ctxt *ctxt, enum wsbr_event_type type,
+                        const struct rpl_target *target)
+{
+    struct iobuf_write buf = { };
+    uint8_t j;
+
+    if (!ctxt->events.ring)
+        return;
+    iobuf_push_data(&buf, target->prefix, 16);
+    if (type == WSBR_EVENT_TARGET_UPDATE) {
+        // Same deduplication as the RoutingGraph D-Bus property
+        for (uint8_t i = 0; i < target->transits_len; i++) {
+            if (!target->transits[i].parent)
+                continue;
+            for (j = 0; j < i; j++)
+                if (target->transits[i].parent == target->transits[j].parent)
+                    break;
+            if (i == j)
+                iobuf_push_data(&buf, target->transits[i].parent, 16);
+        }
+    }
+    wsbr_events_push(&ctxt->events, type, buf.data, buf.len);
+    iobuf_free(&buf);
+}
+
+void wsbr_events_auth_gtk_installed(struct wsbr_ctxt *ctxt, const struct eui64 *eui64, uint8_t key_index)
+{
+    uint8_t payload[9];
+
+    memcpy(payload, eui64, 8);
+    payload[8] = key_index;
+    wsbr_events_push(&ctxt->events, WSBR_EVENT_AUTH_GTK_INSTALLED, payload, sizeof(payload));
+}
+
+void wsbr_events_rcp_reset(struct wsbr_ctxt *ctxt)
+{
+    wsbr_events_push(&ctxt->events, WSBR_EVENT_RCP_RESET, NULL, 0);
+}
@@ -0,0 +1,88 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_EVENTS_H
+#define WSBR_EVENTS_H
+
+/*
+ * Stream of network events on the Unix socket set by the events_socket
+ * option, for consumers which cannot afford the D-Bus signals at high rates.
+ *
+ * Events are appended to a ring buffer of WSBR_EVENTS_RING_SIZE bytes. Each
+ * connected subscriber has its own cursor in the ring, and receives the events
+ * produced after its connection. Subscribers are flushed once per iteration of
+ * the main loop, and never block wsbrd: a subscriber which falls behind by
+ * more than the ring size is disconnected.
+ *
+ * Each event is:
+ *   le16  length of the event, including this header
+ *   u8    type (enum wsbr_event_type)
+ *   u8    reserved (0)
+ *   le64  timestamp (CLOCK_REALTIME, in us)
+ *   ...   payload, depending on the type:
+ *     TARGET_ADD, TARGET_DEL   IPv6 address (16 bytes)
+ *     TARGET_UPDATE            IPv6 address (16 bytes), then the IPv6 address
+ *                              of each parent (16 bytes)
+ *     AUTH_GTK_INSTALLED       EUI-64 (8 bytes), key index (u8)
+ *     RCP_RESET                none
+ * Unknown types must be skipped using the length.
+ */
+
+#include <sys/queue.h>
+#include <stdint.h>
+
+#include "common/event_loop.h"
+#include "common/sys_queue_extra.h"
+
+struct eui64;
+struct rpl_target;
+struct wsbr_ctxt;
+
+#define WSBR_EVENTS_RING_SIZE (64 * 1024)
+
+enum wsbr_event_type {
+    WSBR_EVENT_TARGET_ADD         = 1,
+    WSBR_EVENT_TARGET_DEL         = 2,
+    WSBR_EVENT_TARGET_UPDATE      = 3,
+    WSBR_EVENT_AUTH_GTK_INSTALLED = 4,
+    WSBR_EVENT_RCP_RESET          = 5,
+};
+
+struct wsbr_events_sub {
+    struct event_source ev;
+    struct wsbr_events *events;
+    uint64_t cursor; // Offset in the stream of the next byte to send
+    SLIST_ENTRY(wsbr_events_sub) link;
+};
+
+SLIST_HEAD(wsbr_events_sub_list, wsbr_events_sub);
+
+struct wsbr_events {
+    int fd;
+    uint8_t *ring;
+    uint64_t head; // Bytes written since startup
+    struct wsbr_events_sub_list subs;
+};
+
+void wsbr_events_init(struct wsbr_ctxt *ctxt);
+void wsbr_events_accept(struct wsbr_ctxt *ctxt);
+// Send the events queued during the last iteration.
+void wsbr_events_flush(struct wsbr_ctxt *ctxt);
+
+// Nothing is recorded when events_socket is not set.
+void wsbr_events_target(struct wsbr_ctxt *ctxt, enum wsbr_event_type type,
+                        const struct rpl_target *target);
+void wsbr_events_auth_gtk_installed(struct wsbr_ctxt *ctxt, const struct eui64 *eui64, uint8_t key_index);
+void wsbr_events_rcp_reset(struct wsbr_ctxt *ctxt);
+
+#endif
@@ -43,6 +43,7 @@
 
 #include "wsbrd.h"
 #include "wsbr_mac.h"
+#include "wsbr_metrics.h"
 #include "wsbr_pcapng.h"
 #include "tun.h"
 #include "dbus.h"
@@ -64,7 +65,7 @@ void wsbr_data_req_ext(struct net_if *cur,
         .hif.status = HIF_STATUS_TIMEDOUT,
     };
     struct ieee802154_hdr hdr = { };
-    struct iobuf_write frame = { };
+    struct iobuf_write frame = iobuf_scratch();
 
     BUG_ON(data->TxAckReq && data->fhss_type == HIF_FHSS_TYPE_ASYNC);
     BUG_ON(data->DstAddrMode != IEEE802154_ADDR_MODE_NONE &&
@@ -72,7 +73,7 @@ void wsbr_data_req_ext(struct net_if *cur,
     BUG_ON(data->DstAddrMode != IEEE802154_ADDR_MODE_64_BIT &&
            (data->fhss_type == HIF_FHSS_TYPE_FFN_UC || data->fhss_type == HIF_FHSS_TYPE_LFN_UC || data->fhss_type == HIF_FHSS_TYPE_LFN_PA));
     BUG_ON(!ie_ext);
-    BUG_ON(ie_ext->payloadIovLength > 2);
+    BUG_ON(ie_ext->payloadIovLength > 3);
     BUG_ON(ie_ext->headerIovLength != 1);
     BUG_ON(data->Key.SecurityLevel && data->Key.SecurityLevel != IEEE802154_SEC_LEVEL_ENC_MIC64);
 
@@ -106,6 +107,9 @@ void wsbr_data_req_ext(struct net_if *cur,
     if (data->Key.SecurityLevel)
         iobuf_push_data_reserved(&frame, 8); // MIC-64
 
+    g_metrics.rcp_tx_frames++;
+    if (data->fhss_type == HIF_FHSS_TYPE_FFN_BC)
+        wsbr_bc_adapt_tx(container_of(cur, struct wsbr_ctxt, net_if));
     rcp_req_data_tx(cur->rcp, frame.data, frame.len,
                     data->msduHandle,  data->fhss_type, neighbor_ws ? &neighbor_ws->fhss_data_unsecured : NULL,
                     neighbor_ws ? neighbor_ws->frame_counter_min : NULL,
@@ -139,8 +143,9 @@ void wsbr_tx_cnf(struct rcp *rcp, const struct rcp_tx_cnf *cnf)
         mcps_ie.payloadIeListLength = ie_payload.data_size;
 
         if (!ret && ctxt->config.pcap_file[0])
-            wsbr_pcapng_write_frame(ctxt, cnf->timestamp_us, cnf->frame, cnf->frame_len);
+            wsbr_pcapng_write_frame(ctxt, cnf->timestamp_us, &hdr, &ie_header, &ie_payload);
     }
+    wsbr_chan_excl_tx_cnf(ctxt, cnf);
     ws_llc_mac_confirm_cb(&ctxt->net_if, &mcps_cnf, &mcps_ie);
 }
 
@@ -184,6 +189,8 @@ void wsbr_rx_ind(struct rcp *rcp, const struct rcp_rx_ind *ind)
     mcps_ie.payloadIeListLength = ie_payload.data_size;
 
     if (ctxt->config.pcap_file[0])
-        wsbr_pcapng_write_frame(ctxt, ind->timestamp_us, ind->frame, ind->frame_len);
+        wsbr_pcapng_write_frame(ctxt, ind->timestamp_us, &hdr, &ie_header, &ie_payload);
+    g_metrics.rcp_rx_frames++;
+    wsbr_chan_excl_rx_ind(ctxt, ind);
     ws_llc_mac_indication_cb(&ctxt->net_if, &mcps_ind, &mcps_ie);
 }
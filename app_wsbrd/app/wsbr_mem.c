@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <assert.h>
+
+#include "app_wsbrd/6lowpan/fragmentation/cipv6_fragmenter.h"
+#include "app_wsbrd/6lowpan/lowpan_adaptation_interface.h"
+#include "app_wsbrd/ipv6/ipv6_routing_table.h"
+#include "app_wsbrd/mpl/mpl.h"
+#include "app_wsbrd/net/ns_buffer.h"
+#include "app_wsbrd/rpl/rpl.h"
+#include "app_wsbrd/ws/ws_auth.h"
+#include "app_wsbrd/ws/ws_llc.h"
+#include "common/memutils.h"
+#include "common/ws/ws_neigh.h"
+
+#include "wsbrd.h"
+#include "wsbr_mem.h"
+
+static void wsbr_mem_set(struct wsbr_mem *mem, enum wsbr_mem_table table,
+                         unsigned int count, size_t bytes)
+{
+    struct wsbr_mem_usage *usage = &mem->tables[table];
+
+    usage->count = count;
+    usage->bytes = bytes;
+    if (usage->count_max < count)
+        usage->count_max = count;
+    if (usage->bytes_max < bytes)
+        usage->bytes_max = bytes;
+}
+
+void wsbr_mem_update(struct wsbr_ctxt *ctxt)
+{
+    const struct buffer_pool_stats *pool;
+    struct net_if *net_if = &ctxt->net_if;
+    struct wsbr_mem *mem = &ctxt->mem;
+    const struct rpl_target *target;
+    unsigned int count;
+    size_t bytes;
+
+    wsbr_mem_set(mem, WSBR_MEM_WS_NEIGH, net_if->ws_info.neighbor_storage.count,
+                 net_if->ws_info.neighbor_storage.count * sizeof(struct ws_neigh));
+
+    count = 0;
+    bytes = 0;
+    SLIST_FOREACH(target, &net_if->rpl_root.targets, link) {
+        count++;
+        bytes += sizeof(*target) + target->transits_len * sizeof(struct rpl_transit);
+    }
+    wsbr_mem_set(mem, WSBR_MEM_RPL_TARGET, count, bytes);
+
+    count = ns_list_count(&net_if->ipv6_neighbour_cache.list);
+    wsbr_mem_set(mem, WSBR_MEM_IPV6_NEIGH, count, count * sizeof(ipv6_neighbour_t));
+    count = ipv6_destination_cache_count();
+    wsbr_mem_set(mem, WSBR_MEM_IPV6_DEST, count, count * sizeof(ipv6_destination_t));
+
+    wsbr_mem_set(mem, WSBR_MEM_REASSEMBLY, cipv6_frag_session_count(), cipv6_frag_stats()->mem_used);
+    wsbr_mem_set(mem, WSBR_MEM_LOWPAN_QUEUE, lowpan_adaptation_queue_size(net_if->id),
+                 lowpan_adaptation_queue_bytes(net_if->id));
+    count = ws_llc_queue_size(net_if);
+    wsbr_mem_set(mem, WSBR_MEM_LLC_QUEUE, count, count * ws_llc_message_size());
+
+    ws_auth_supp_usage(net_if, &count, &bytes);
+    wsbr_mem_set(mem, WSBR_MEM_SUPP, count, bytes);
+    mpl_buffer_usage(&count, &bytes);
+    wsbr_mem_set(mem, WSBR_MEM_MPL, count, bytes);
+
+    count = 0;
+    bytes = 0;
+    for (int i = 0; (pool = buffer_pool_stats(i)); i++) {
+        count += pool->in_use;
+        bytes += pool->in_use * (sizeof(buffer_t) + pool->size);
+    }
+    wsbr_mem_set(mem, WSBR_MEM_BUFFER, count, bytes);
+}
+
+static void wsbr_mem_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    wsbr_mem_update(container_of(timer, struct wsbr_ctxt, mem.timer));
+}
+
+void wsbr_mem_init(struct wsbr_ctxt *ctxt)
+{
+    ctxt->mem.timer.callback  = wsbr_mem_timer;
+    ctxt->mem.timer.period_ms = WSBR_MEM_SAMPLE_PERIOD_MS;
+    timer_start_rel(NULL, &ctxt->mem.timer, WSBR_MEM_SAMPLE_PERIOD_MS);
+}
+
+const char *wsbr_mem_table_str(enum wsbr_mem_table table)
+{
+    static const char *names[] = {
+        [WSBR_MEM_WS_NEIGH]     = "ws_neigh",
+        [WSBR_MEM_RPL_TARGET]   = "rpl_target",
+        [WSBR_MEM_IPV6_NEIGH]   = "ipv6_neigh",
+        [WSBR_MEM_IPV6_DEST]    = "ipv6_dest",
+        [WSBR_MEM_REASSEMBLY]   = "reassembly",
+        [WSBR_MEM_LOWPAN_QUEUE] = "lowpan_queue",
+        [WSBR_MEM_LLC_QUEUE]    = "llc_queue",
+        [WSBR_MEM_SUPP]         = "supp",
+        [WSBR_MEM_MPL]          = "mpl",
+        [WSBR_MEM_BUFFER]       = "buffer",
+    };
+
+    static_assert(ARRAY_SIZE(names) == WSBR_MEM_TABLE_COUNT, "out-of-date names");
+    return names[table];
+}
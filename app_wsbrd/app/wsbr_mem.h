@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_MEM_H
+#define WSBR_MEM_H
+
+/*
+ * Entry count and memory of the main tables of wsbrd, exported on D-Bus
+ * (MemoryUsage) and in the metrics, to size the host and detect growth on
+ * long-running border routers.
+ *
+ * Tables are sampled every WSBR_MEM_SAMPLE_PERIOD_MS and on each read, and
+ * the high-water marks are those of the samples. Unless stated otherwise, the
+ * bytes are the fixed size of the entries, without the memory they reference
+ * or the allocator overhead.
+ */
+
+#include <stddef.h>
+
+#include "common/timer.h"
+
+struct wsbr_ctxt;
+
+#define WSBR_MEM_SAMPLE_PERIOD_MS 5000
+
+enum wsbr_mem_table {
+    WSBR_MEM_WS_NEIGH,
+    WSBR_MEM_RPL_TARGET,
+    WSBR_MEM_IPV6_NEIGH,
+    WSBR_MEM_IPV6_DEST,
+    WSBR_MEM_REASSEMBLY,   // Bytes of the reassembly buffers
+    WSBR_MEM_LOWPAN_QUEUE, // Bytes of the queued buffers
+    WSBR_MEM_LLC_QUEUE,
+    WSBR_MEM_SUPP,
+    WSBR_MEM_MPL,          // Bytes of the buffered IPv6 packets
+    WSBR_MEM_BUFFER,       // Pooled packet buffers in use, headers included
+    WSBR_MEM_TABLE_COUNT,
+};
+
+struct wsbr_mem_usage {
+    unsigned int count;
+    unsigned int count_max;
+    size_t bytes;
+    size_t bytes_max;
+};
+
+struct wsbr_mem {
+    struct wsbr_mem_usage tables[WSBR_MEM_TABLE_COUNT];
+    struct timer_entry timer;
+};
+
+void wsbr_mem_init(struct wsbr_ctxt *ctxt);
+// Refresh the samples, see wsbr_mem.tables.
+void wsbr_mem_update(struct wsbr_ctxt *ctxt);
+const char *wsbr_mem_table_str(enum wsbr_mem_table table);
+
+#endif
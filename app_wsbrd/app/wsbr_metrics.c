@@ -0,0 +1,295 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "app_wsbrd/6lowpan/fragmentation/cipv6_fragmenter.h"
+#include "app_wsbrd/6lowpan/lowpan_adaptation_interface.h"
+#include "app_wsbrd/ipv6/icmpv6.h"
+#include "app_wsbrd/ipv6/ipv6.h"
+#include "app_wsbrd/ws/ws_auth.h"
+#include "common/log.h"
+#include "common/memutils.h"
+#include "common/timer.h"
+
+#include "wsbrd.h"
+#include "wsbr_metrics.h"
+
+struct wsbr_metrics g_metrics;
+
+static const unsigned int wsbr_metrics_tx_retries_bounds[] = WSBR_METRICS_TX_RETRIES_BOUNDS;
+static_assert(ARRAY_SIZE(wsbr_metrics_tx_retries_bounds) + 1 == ARRAY_SIZE(g_metrics.tx_retries),
+              "unexpected number of buckets");
+
+void wsbr_metrics_tx_cnf(uint8_t status, uint8_t tx_retries)
+{
+    int i;
+
+    if (status < ARRAY_SIZE(g_metrics.tx_cnf_status))
+        g_metrics.tx_cnf_status[status]++;
+    for (i = 0; i < ARRAY_SIZE(wsbr_metrics_tx_retries_bounds); i++)
+        if (tx_retries <= wsbr_metrics_tx_retries_bounds[i])
+            break;
+    g_metrics.tx_retries[i]++;
+    g_metrics.tx_retries_sum += tx_retries;
+}
+
+const char *wsbr_metrics_tx_latency_str(enum wsbr_tx_latency stage)
+{
+    static const char *names[] = {
+        [WSBR_TX_LATENCY_IPV6]   = "ipv6",
+        [WSBR_TX_LATENCY_LOWPAN] = "lowpan",
+        [WSBR_TX_LATENCY_QUEUE]  = "queue",
+        [WSBR_TX_LATENCY_RCP]    = "rcp",
+        [WSBR_TX_LATENCY_TOTAL]  = "total",
+    };
+
+    static_assert(ARRAY_SIZE(names) == WSBR_TX_LATENCY_COUNT, "out-of-date names");
+    return names[stage];
+}
+
+void wsbr_metrics_init(struct wsbr_ctxt *ctxt)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int ret;
+
+    if (strlen(ctxt->config.metrics_socket) >= sizeof(addr.sun_path))
+        FATAL(1, "metrics_socket: path too long");
+    strcpy(addr.sun_path, ctxt->config.metrics_socket);
+    ctxt->metrics_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    FATAL_ON(ctxt->metrics_fd < 0, 2, "%s: socket: %m", __func__);
+    // A previous instance may have left the socket behind
+    if (unlink(addr.sun_path) < 0 && errno != ENOENT)
+        FATAL(2, "%s: unlink %s: %m", __func__, addr.sun_path);
+    ret = bind(ctxt->metrics_fd, (struct sockaddr *)&addr, sizeof(addr));
+    FATAL_ON(ret < 0, 2, "%s: bind %s: %m", __func__, addr.sun_path);
+    ret = listen(ctxt->metrics_fd, 4);
+    FATAL_ON(ret < 0, 2, "%s: listen: %m", __func__);
+}
+
+static void wsbr_metrics_timer_group(FILE *out, const char *name, const struct timer_group *group)
+{
+    fprintf(out, "wsbrd_timer_expirations_total{group=\"%s\"} %"PRIu64"\n", name, group->expire_count);
+}
+
+// Only one bucket bound per power of 2 is exported to keep the exposition
+// small, the finer buckets are used for the quantiles exposed on D-Bus.
+static void wsbr_metrics_histogram_write(FILE *out, const char *name, const char *labels,
+                                         const struct histogram *hist)
+{
+    const char *sep = labels[0] ? "," : "";
+    uint64_t count = 0;
+    char braces[48];
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+        count += hist->buckets[i];
+        if ((i + 1) % (1 << HISTOGRAM_SUB_BITS))
+            continue;
+        fprintf(out, "%s_bucket{%s%sle=\"%"PRIu64"\"} %"PRIu64"\n",
+                name, labels, sep, histogram_bucket_max(i), count);
+    }
+    fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %"PRIu64"\n", name, labels, sep, hist->count);
+    snprintf(braces, sizeof(braces), labels[0] ? "{%s}" : "%s", labels);
+    fprintf(out, "%s_sum%s %"PRIu64"\n", name, braces, hist->sum);
+    fprintf(out, "%s_count%s %"PRIu64"\n", name, braces, hist->count);
+}
+
+static void wsbr_metrics_tx_latency_write(FILE *out)
+{
+    char labels[32];
+
+    fprintf(out, "# TYPE wsbrd_tx_latency_us histogram\n");
+    for (int stage = 0; stage < WSBR_TX_LATENCY_COUNT; stage++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", wsbr_metrics_tx_latency_str(stage));
+        wsbr_metrics_histogram_write(out, "wsbrd_tx_latency_us", labels, &g_metrics.tx_latency_us[stage]);
+    }
+}
+
+static void wsbr_metrics_mem_write(struct wsbr_ctxt *ctxt, FILE *out)
+{
+    const struct wsbr_mem_usage *tables = ctxt->mem.tables;
+
+    wsbr_mem_update(ctxt);
+    fprintf(out, "# TYPE wsbrd_table_entries gauge\n");
+    for (int i = 0; i < WSBR_MEM_TABLE_COUNT; i++)
+        fprintf(out, "wsbrd_table_entries{table=\"%s\"} %u\n", wsbr_mem_table_str(i), tables[i].count);
+    fprintf(out, "# TYPE wsbrd_table_entries_max gauge\n");
+    for (int i = 0; i < WSBR_MEM_TABLE_COUNT; i++)
+        fprintf(out, "wsbrd_table_entries_max{table=\"%s\"} %u\n", wsbr_mem_table_str(i), tables[i].count_max);
+    fprintf(out, "# TYPE wsbrd_table_bytes gauge\n");
+    fprintf(out, "# HELP wsbrd_table_bytes Approximate memory of the entries of each table\n");
+    for (int i = 0; i < WSBR_MEM_TABLE_COUNT; i++)
+        fprintf(out, "wsbrd_table_bytes{table=\"%s\"} %zu\n", wsbr_mem_table_str(i), tables[i].bytes);
+    fprintf(out, "# TYPE wsbrd_table_bytes_max gauge\n");
+    for (int i = 0; i < WSBR_MEM_TABLE_COUNT; i++)
+        fprintf(out, "wsbrd_table_bytes_max{table=\"%s\"} %zu\n", wsbr_mem_table_str(i), tables[i].bytes_max);
+}
+
+static void wsbr_metrics_write(struct wsbr_ctxt *ctxt, FILE *out)
+{
+    const struct cipv6_frag_stats *frag_stats = cipv6_frag_stats();
+    const struct ipv6_mcast_stats *mcast_stats = ipv6_mcast_stats();
+    const struct icmpv6_stats *icmp_stats = icmpv6_stats();
+    const struct lowpan_aqm_stats *aqm_stats;
+    uint64_t count = 0;
+    int active, waiting;
+
+    fprintf(out, "# TYPE wsbrd_rcp_rx_frames counter\n");
+    fprintf(out, "wsbrd_rcp_rx_frames_total %"PRIu64"\n", g_metrics.rcp_rx_frames);
+    fprintf(out, "# TYPE wsbrd_rcp_tx_frames counter\n");
+    fprintf(out, "wsbrd_rcp_tx_frames_total %"PRIu64"\n", g_metrics.rcp_tx_frames);
+    fprintf(out, "# TYPE wsbrd_rcp_resets counter\n");
+    fprintf(out, "wsbrd_rcp_resets_total %u\n", ctxt->rcp.reset_count);
+    fprintf(out, "# TYPE wsbrd_tun_write_drops counter\n");
+    fprintf(out, "wsbrd_tun_write_drops_total %"PRIu64"\n", ctxt->tun_workers.drop_count);
+    fprintf(out, "# TYPE wsbrd_pktshm_packets counter\n");
+    fprintf(out, "wsbrd_pktshm_packets_total{dir=\"tx\"} %"PRIu64"\n", ctxt->pktshm.tx_count);
+    fprintf(out, "wsbrd_pktshm_packets_total{dir=\"rx\"} %"PRIu64"\n", ctxt->pktshm.rx_count);
+    fprintf(out, "# TYPE wsbrd_pktshm_drops counter\n");
+    fprintf(out, "wsbrd_pktshm_drops_total %"PRIu64"\n", ctxt->pktshm.tx_drop);
+    fprintf(out, "# TYPE wsbrd_log_journal_drops counter\n");
+    fprintf(out, "wsbrd_log_journal_drops_total %"PRIu64"\n", g_log_journal_dropped);
+
+    fprintf(out, "# TYPE wsbrd_tx_confirm counter\n");
+    fprintf(out, "# HELP wsbrd_tx_confirm Confirmations of data frames by status\n");
+    for (int i = 0; i < ARRAY_SIZE(g_metrics.tx_cnf_status); i++)
+        fprintf(out, "wsbrd_tx_confirm_total{status=\"%s\"} %"PRIu64"\n",
+                hif_status_str(i), g_metrics.tx_cnf_status[i]);
+
+    fprintf(out, "# TYPE wsbrd_tx_retries histogram\n");
+    for (int i = 0; i < ARRAY_SIZE(g_metrics.tx_retries); i++) {
+        count += g_metrics.tx_retries[i];
+        if (i < ARRAY_SIZE(wsbr_metrics_tx_retries_bounds))
+            fprintf(out, "wsbrd_tx_retries_bucket{le=\"%u\"} %"PRIu64"\n",
+                    wsbr_metrics_tx_retries_bounds[i], count);
+        else
+            fprintf(out, "wsbrd_tx_retries_bucket{le=\"+Inf\"} %"PRIu64"\n", count);
+    }
+    fprintf(out, "wsbrd_tx_retries_sum %"PRIu64"\n", g_metrics.tx_retries_sum);
+    fprintf(out, "wsbrd_tx_retries_count %"PRIu64"\n", count);
+
+    wsbr_metrics_tx_latency_write(out);
+    fprintf(out, "# TYPE wsbrd_loop_latency_us histogram\n");
+    wsbr_metrics_histogram_write(out, "wsbrd_loop_latency_us", "", &g_metrics.loop_latency_us);
+
+    fprintf(out, "# TYPE wsbrd_lowpan_queue_size gauge\n");
+    fprintf(out, "wsbrd_lowpan_queue_size %d\n", lowpan_adaptation_queue_size(ctxt->net_if.id));
+
+    aqm_stats = lowpan_adaptation_aqm_stats(ctxt->net_if.id);
+    fprintf(out, "# TYPE wsbrd_lowpan_queue_drops counter\n");
+    fprintf(out, "wsbrd_lowpan_queue_drops_total{reason=\"red\"} %"PRIu64"\n", aqm_stats->red_drop_count);
+    fprintf(out, "wsbrd_lowpan_queue_drops_total{reason=\"codel\"} %"PRIu64"\n", aqm_stats->codel_drop_count);
+    fprintf(out, "wsbrd_lowpan_queue_drops_total{reason=\"overlimit\"} %"PRIu64"\n", aqm_stats->overlimit_drop_count);
+    fprintf(out, "wsbrd_lowpan_queue_drops_total{reason=\"lane\"} %"PRIu64"\n", aqm_stats->lane_drop_count);
+    fprintf(out, "wsbrd_lowpan_queue_drops_total{reason=\"lfn_limit\"} %"PRIu64"\n", aqm_stats->lfn_limit_drop_count);
+    fprintf(out, "wsbrd_lowpan_queue_drops_total{reason=\"lfn_expired\"} %"PRIu64"\n", aqm_stats->lfn_expired_count);
+
+    if (duty_cycle_enabled(&ctxt->net_if.ws_info.duty_cycle)) {
+        fprintf(out, "# TYPE wsbrd_duty_cycle_budget_us gauge\n");
+        fprintf(out, "wsbrd_duty_cycle_budget_us %"PRIu64"\n", ctxt->net_if.ws_info.duty_cycle.budget_us);
+        fprintf(out, "# TYPE wsbrd_duty_cycle_used_us gauge\n");
+        fprintf(out, "wsbrd_duty_cycle_used_us %"PRIu64"\n", duty_cycle_used_us(&ctxt->net_if.ws_info.duty_cycle));
+    }
+
+    fprintf(out, "# TYPE wsbrd_lfn_multicast counter\n");
+    fprintf(out, "# HELP wsbrd_lfn_multicast Multicast packets forwarded to LFNs by method\n");
+    fprintf(out, "wsbrd_lfn_multicast_total{method=\"broadcast\"} %"PRIu64"\n", mcast_stats->broadcast_count);
+    fprintf(out, "wsbrd_lfn_multicast_total{method=\"unicast\"} %"PRIu64"\n", mcast_stats->unicast_count);
+
+    fprintf(out, "# TYPE wsbrd_icmp_errors counter\n");
+    fprintf(out, "wsbrd_icmp_errors_total{type=\"dst_unreachable\"} %"PRIu64"\n", icmp_stats->tx_errors[0]);
+    fprintf(out, "wsbrd_icmp_errors_total{type=\"packet_too_big\"} %"PRIu64"\n", icmp_stats->tx_errors[1]);
+    fprintf(out, "wsbrd_icmp_errors_total{type=\"time_exceeded\"} %"PRIu64"\n", icmp_stats->tx_errors[2]);
+    fprintf(out, "wsbrd_icmp_errors_total{type=\"parameter_problem\"} %"PRIu64"\n", icmp_stats->tx_errors[3]);
+    fprintf(out, "# TYPE wsbrd_icmp_errors_rate_limited counter\n");
+    fprintf(out, "wsbrd_icmp_errors_rate_limited_total{limit=\"global\"} %"PRIu64"\n",
+            icmp_stats->ratelimit_drops[ICMPV6_RATELIMIT_DROP_GLOBAL]);
+    fprintf(out, "wsbrd_icmp_errors_rate_limited_total{limit=\"type\"} %"PRIu64"\n",
+            icmp_stats->ratelimit_drops[ICMPV6_RATELIMIT_DROP_TYPE]);
+    fprintf(out, "wsbrd_icmp_errors_rate_limited_total{limit=\"destination\"} %"PRIu64"\n",
+            icmp_stats->ratelimit_drops[ICMPV6_RATELIMIT_DROP_DST]);
+
+    fprintf(out, "# TYPE wsbrd_reassembly_failures counter\n");
+    fprintf(out, "wsbrd_reassembly_failures_total{reason=\"evict\"} %u\n", frag_stats->evict_count);
+    fprintf(out, "wsbrd_reassembly_failures_total{reason=\"memory\"} %u\n", frag_stats->drop_count);
+    fprintf(out, "wsbrd_reassembly_failures_total{reason=\"timeout\"} %u\n", frag_stats->timeout_count);
+    fprintf(out, "# TYPE wsbrd_reassembly_memory_bytes gauge\n");
+    fprintf(out, "wsbrd_reassembly_memory_bytes %u\n", frag_stats->mem_used);
+
+    fprintf(out, "# TYPE wsbrd_rpl_dao_rx counter\n");
+    fprintf(out, "wsbrd_rpl_dao_rx_total %"PRIu64"\n", ctxt->net_if.rpl_root.dao_rx_count);
+    fprintf(out, "# TYPE wsbrd_rpl_targets gauge\n");
+    fprintf(out, "wsbrd_rpl_targets %u\n", rpl_target_count(&ctxt->net_if.rpl_root));
+
+    ws_auth_session_count(&ctxt->net_if, &active, &waiting);
+    fprintf(out, "# TYPE wsbrd_eapol_sessions gauge\n");
+    fprintf(out, "wsbrd_eapol_sessions{state=\"active\"} %d\n", active);
+    fprintf(out, "wsbrd_eapol_sessions{state=\"waiting\"} %d\n", waiting);
+    fprintf(out, "# TYPE wsbrd_admission_load_percent gauge\n");
+    fprintf(out, "wsbrd_admission_load_percent %u\n", ctxt->admission.load);
+
+    wsbr_metrics_mem_write(ctxt, out);
+
+    fprintf(out, "# TYPE wsbrd_timer_expirations counter\n");
+    wsbr_metrics_timer_group(out, "default", timer_group_default());
+    wsbr_metrics_timer_group(out, "rpl", &ctxt->net_if.rpl_root.timer_group);
+    wsbr_metrics_timer_group(out, "ws_neigh", &ctxt->net_if.ws_info.neighbor_storage.timer_group);
+    wsbr_metrics_timer_group(out, "ipv6_neigh", &ctxt->net_if.ipv6_neighbour_cache.timer_group);
+#ifndef HAVE_AUTH_LEGACY
+    wsbr_metrics_timer_group(out, "auth", &ctxt->auth.timer_group);
+
+    fprintf(out, "# TYPE wsbrd_eap_success counter\n");
+    fprintf(out, "wsbrd_eap_success_total %"PRIu64"\n", ctxt->auth.eap_success_count);
+    fprintf(out, "# TYPE wsbrd_eap_success_requests counter\n");
+    fprintf(out, "wsbrd_eap_success_requests_total %"PRIu64"\n", ctxt->auth.eap_round_count);
+#endif
+    fprintf(out, "# EOF\n");
+}
+
+void wsbr_metrics_accept(struct wsbr_ctxt *ctxt)
+{
+    size_t buf_len;
+    char *buf;
+    FILE *out;
+    ssize_t ret;
+    int fd;
+
+    fd = accept4(ctxt->metrics_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        WARN("%s: accept: %m", __func__);
+        return;
+    }
+    out = open_memstream(&buf, &buf_len);
+    FATAL_ON(!out, 2, "%s: open_memstream: %m", __func__);
+    wsbr_metrics_write(ctxt, out);
+    fclose(out);
+    // The exposition is a few KiB and fits in the socket buffer, a client
+    // which does not read it does not block wsbrd.
+    ret = send(fd, buf, buf_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (ret < 0)
+        WARN("%s: send: %m", __func__);
+    else if (ret != buf_len)
+        WARN("%s: short send", __func__);
+    free(buf);
+    close(fd);
+}
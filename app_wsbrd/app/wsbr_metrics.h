@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_METRICS_H
+#define WSBR_METRICS_H
+
+#include <stdint.h>
+
+#include "common/hif.h"
+#include "common/histogram.h"
+
+/*
+ * Counters exported in the OpenMetrics text format on the Unix socket set by
+ * the metrics_socket option. wsbrd is single threaded, so counters are plain
+ * integers incremented in place, without any locking or allocation. Gauges
+ * (queue sizes, EAPOL sessions...) are read from their owner on each scrape.
+ *
+ * A scrape is a connection to the socket: the whole exposition is written and
+ * the connection is closed, without reading any request, eg:
+ *   socat - UNIX-CONNECT:/run/wsbrd/metrics
+ */
+
+struct wsbr_ctxt;
+
+// Upper bounds of the buckets of wsbr_metrics.tx_retries, the last bucket
+// is +Inf.
+#define WSBR_METRICS_TX_RETRIES_BOUNDS { 0, 1, 2, 3, 5, 8 }
+
+// Latency of the stages of the TX path of IPv6 packets, computed from
+// buffer_t.tx_stage_us.
+enum wsbr_tx_latency {
+    WSBR_TX_LATENCY_IPV6,   // TUN read to lowpan_down(): forwarding, SRH
+    WSBR_TX_LATENCY_LOWPAN, // Address resolution and IPHC compression
+    WSBR_TX_LATENCY_QUEUE,  // Queueing in the adaptation layer
+    WSBR_TX_LATENCY_RCP,    // Frame request to confirmation (RCP queue, airtime)
+    WSBR_TX_LATENCY_TOTAL,  // TUN read to the confirmation of the last frame
+    WSBR_TX_LATENCY_COUNT,
+};
+
+struct wsbr_metrics {
+    uint64_t rcp_rx_frames;
+    uint64_t rcp_tx_frames;
+    // Confirmations of data frames, indexed by enum hif_data_status
+    uint64_t tx_cnf_status[HIF_STATUS_COUNT];
+    // Histogram of the retries of data frames, not cumulative
+    uint64_t tx_retries[7];
+    uint64_t tx_retries_sum;
+    struct histogram tx_latency_us[WSBR_TX_LATENCY_COUNT];
+    // Processing time of the iterations of the main loop, which bounds the
+    // reaction time to the RCP.
+    struct histogram loop_latency_us;
+};
+
+extern struct wsbr_metrics g_metrics;
+
+void wsbr_metrics_init(struct wsbr_ctxt *ctxt);
+void wsbr_metrics_accept(struct wsbr_ctxt *ctxt);
+void wsbr_metrics_tx_cnf(uint8_t status, uint8_t tx_retries);
+const char *wsbr_metrics_tx_latency_str(enum wsbr_tx_latency stage);
+
+// Nothing is recorded when start_us is 0 (stage not reached).
+static inline void wsbr_metrics_tx_latency(enum wsbr_tx_latency stage, uint64_t start_us, uint64_t end_us)
+{
+    if (start_us && end_us >= start_us)
+        histogram_add(&g_metrics.tx_latency_us[stage], end_us - start_us);
+}
+
+#endif
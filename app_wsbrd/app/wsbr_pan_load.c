@@ -0,0 +1,143 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <errno.h>
+
+#include "app_wsbrd/rpl/rpl.h"
+#include "common/iobuf.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/time_extra.h"
+#include "common/timer.h"
+
+#include "wsbrd.h"
+#include "wsbr_pan_load.h"
+
+#define WSBR_PAN_LOAD_VERSION 1
+
+static void wsbr_pan_load_update(struct wsbr_ctxt *ctxt)
+{
+    struct ws_pan_information *pan_info = &ctxt->net_if.ws_info.pan_information;
+    uint16_t pan_size = rpl_target_count(&ctxt->net_if.rpl_root);
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    uint16_t pan_size_min = pan_size;
+    uint16_t bias = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(ctxt->pan_load.peers); i++) {
+        if (!ctxt->pan_load.peers[i].update_ms ||
+            ctxt->pan_load.peers[i].update_ms + WSBR_PAN_LOAD_EXPIRE_MS < now_ms)
+            continue;
+        pan_size_min = MIN(pan_size_min, ctxt->pan_load.peers[i].pan_size);
+    }
+    if (pan_size - pan_size_min > ctxt->config.pan_load_threshold)
+        bias = pan_size - pan_size_min;
+    if (bias != pan_info->pan_size_bias)
+        INFO("pan load: %u nodes, lightest peer PAN %u nodes, advertise %u nodes",
+             pan_size, pan_size_min, MIN(pan_size + bias, UINT16_MAX));
+    pan_info->pan_size_bias = bias;
+}
+
+static void wsbr_pan_load_send(struct wsbr_ctxt *ctxt)
+{
+    const struct ws_pan_information *pan_info = &ctxt->net_if.ws_info.pan_information;
+    const struct sockaddr_in6 *addr;
+    struct iobuf_write buf = { };
+    ssize_t ret;
+
+    iobuf_push_u8(&buf, WSBR_PAN_LOAD_VERSION);
+    iobuf_push_u8(&buf, 0);
+    iobuf_push_be16(&buf, pan_info->pan_id);
+    iobuf_push_be16(&buf, rpl_target_count(&ctxt->net_if.rpl_root));
+    iobuf_push_be16(&buf, pan_info->max_pan_size);
+    for (int i = 0; i < ARRAY_SIZE(ctxt->config.pan_load_peers); i++) {
+        addr = &ctxt->config.pan_load_peers[i];
+        if (addr->sin6_family == AF_UNSPEC)
+            break;
+        ret = sendto(ctxt->pan_load.fd, buf.data, buf.len, 0,
+                     (struct sockaddr *)addr, sizeof(*addr));
+        // A peer may not be started yet
+        if (ret < 0 && errno != ECONNREFUSED)
+            WARN("%s: sendto %s: %m", __func__, tr_ipv6(addr->sin6_addr.s6_addr));
+    }
+    iobuf_free(&buf);
+}
+
+static void wsbr_pan_load_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct wsbr_ctxt *ctxt = container_of(timer, struct wsbr_ctxt, pan_load.timer);
+
+    wsbr_pan_load_send(ctxt);
+    wsbr_pan_load_update(ctxt);
+}
+
+void wsbr_pan_load_recv(struct wsbr_ctxt *ctxt)
+{
+    struct sockaddr_in6 src;
+    socklen_t src_len = sizeof(src);
+    struct iobuf_read buf = { };
+    uint8_t data[64];
+    ssize_t ret;
+    int i;
+
+    ret = recvfrom(ctxt->pan_load.fd, data, sizeof(data), 0, (struct sockaddr *)&src, &src_len);
+    if (ret < 0) {
+        WARN("%s: recvfrom: %m", __func__);
+        return;
+    }
+    for (i = 0; i < ARRAY_SIZE(ctxt->config.pan_load_peers); i++)
+        if (ctxt->config.pan_load_peers[i].sin6_port == src.sin6_port &&
+            IN6_ARE_ADDR_EQUAL(&ctxt->config.pan_load_peers[i].sin6_addr, &src.sin6_addr))
+            break;
+    if (i == ARRAY_SIZE(ctxt->config.pan_load_peers)) {
+        TRACE(TR_DROP, "drop %-9s: unknown peer %s", "pan-load", tr_ipv6(src.sin6_addr.s6_addr));
+        return;
+    }
+    buf.data = data;
+    buf.data_size = ret;
+    if (iobuf_pop_u8(&buf) != WSBR_PAN_LOAD_VERSION) {
+        TRACE(TR_DROP, "drop %-9s: unsupported version", "pan-load");
+        return;
+    }
+    iobuf_pop_u8(&buf); // Reserved
+    iobuf_pop_be16(&buf); // PAN ID
+    ctxt->pan_load.peers[i].pan_size = iobuf_pop_be16(&buf);
+    iobuf_pop_be16(&buf); // Maximum PAN size
+    if (buf.err) {
+        TRACE(TR_DROP, "drop %-9s: malformed packet", "pan-load");
+        return;
+    }
+    ctxt->pan_load.peers[i].update_ms = time_now_ms(CLOCK_MONOTONIC);
+}
+
+void wsbr_pan_load_init(struct wsbr_ctxt *ctxt)
+{
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6,
+        .sin6_addr   = IN6ADDR_ANY_INIT,
+        .sin6_port   = htons(ctxt->config.pan_load_port),
+    };
+    int ret;
+
+    ctxt->pan_load.fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    FATAL_ON(ctxt->pan_load.fd < 0, 2, "%s: socket: %m", __func__);
+    ret = bind(ctxt->pan_load.fd, (struct sockaddr *)&addr, sizeof(addr));
+    FATAL_ON(ret < 0, 2, "%s: bind port %d: %m", __func__, ctxt->config.pan_load_port);
+    ctxt->pan_load.timer.callback  = wsbr_pan_load_timer;
+    ctxt->pan_load.timer.period_ms = WSBR_PAN_LOAD_PERIOD_MS;
+    timer_start_rel(NULL, &ctxt->pan_load.timer, WSBR_PAN_LOAD_PERIOD_MS);
+}
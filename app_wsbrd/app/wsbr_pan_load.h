@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_PAN_LOAD_H
+#define WSBR_PAN_LOAD_H
+
+/*
+ * Coordinate the PAN size advertised by co-located border routers, so joining
+ * nodes spread across their PANs.
+ *
+ * Every WSBR_PAN_LOAD_PERIOD_MS, each border router sends the number of nodes
+ * registered in its PAN to the peers listed in pan_load_peer, over UDP:
+ *   u8    version (1)
+ *   u8    reserved (0)
+ *   be16  PAN ID
+ *   be16  PAN size (number of RPL targets)
+ *   be16  maximum PAN size
+ * When the PAN holds more than pan_load_threshold nodes above the lightest
+ * peer PAN, the difference is added to the PAN size advertised in the PAN-IE
+ * (and to the PAN Load Factor of the JM-IE, which derives from it). Nodes
+ * compare the PAN cost of the PANs they hear, so new nodes are steered toward
+ * the lighter PAN, while nodes already joined are not forced to leave.
+ */
+
+#include <stdint.h>
+
+#include "common/timer.h"
+
+#include "commandline.h"
+
+struct wsbr_ctxt;
+
+#define WSBR_PAN_LOAD_PORT      4576
+#define WSBR_PAN_LOAD_PERIOD_MS 5000
+// A peer is ignored if it has not been heard for this duration
+#define WSBR_PAN_LOAD_EXPIRE_MS (3 * WSBR_PAN_LOAD_PERIOD_MS)
+
+struct wsbr_pan_load_peer {
+    uint16_t pan_size;
+    uint64_t update_ms; // 0 if never heard
+};
+
+struct wsbr_pan_load {
+    int fd;
+    struct timer_entry timer;
+    // Indexed like wsbrd_conf.pan_load_peers
+    struct wsbr_pan_load_peer peers[WSBR_PAN_LOAD_PEER_MAX];
+};
+
+void wsbr_pan_load_init(struct wsbr_ctxt *ctxt);
+void wsbr_pan_load_recv(struct wsbr_ctxt *ctxt);
+
+#endif
@@ -13,6 +13,10 @@
  */
 #define _DEFAULT_SOURCE
 #include <sys/stat.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -26,55 +30,182 @@
 #include "common/iobuf.h"
 #include "common/pcapng.h"
 #include "common/string_extra.h"
+#include "common/time_extra.h"
 #include "common/specs/ieee802154.h"
+#include "common/ws/ws_ie.h"
 
 #include "rcp_api_legacy.h"
 #include "wsbrd.h"
+#include "wsbr_pcapng.h"
 
-void wsbr_pcapng_closed(struct wsbr_ctxt *ctxt)
+// Blocks are queued and written by wsbr_pcapng_flush() once per main loop
+// iteration, so a slow reader does not stall the processing of RCP frames.
+// When the reader does not keep up, frames are dropped once the queue is full.
+#define PCAPNG_QUEUE_SIZE_MAX (1024 * 1024)
+// When rotation is enabled, regular files are only written by chunks of this
+// size to limit write amplification on flash storage.
+#define PCAPNG_WRITE_ALIGN    (64 * 1024)
+
+static void wsbr_pcapng_queue_reset(struct wsbr_ctxt *ctxt)
+{
+    ctxt->pcapng_queue.len = 0;
+    ctxt->pcapng_queue_offset = 0;
+    event_loop_mod(&ctxt->ev_pcap, 0);
+}
+
+static size_t wsbr_pcapng_queue_len(struct wsbr_ctxt *ctxt)
+{
+    return ctxt->pcapng_queue.len - ctxt->pcapng_queue_offset;
+}
+
+static bool wsbr_pcapng_rotation_enabled(struct wsbr_ctxt *ctxt)
+{
+    return ctxt->pcapng_type == S_IFREG &&
+           (ctxt->config.pcap_file_size_max || ctxt->config.pcap_file_rotate_s);
+}
+
+static void wsbr_pcapng_closed(struct wsbr_ctxt *ctxt)
 {
     int ret;
 
     WARN("stopped pcapng capture");
+    event_loop_del(&ctxt->ev_pcap);
     ret = close(ctxt->pcapng_fd);
     FATAL_ON(ret < 0, 2, "close pcapng: %m");
     ctxt->pcapng_fd = -1;
-    ctxt->fds[POLLFD_PCAP].fd = -1;
+    ctxt->ev_pcap.fd = -1;
+    wsbr_pcapng_queue_reset(ctxt);
 }
 
-static void wsbr_pcapng_write_start(struct wsbr_ctxt *ctxt);
+// Only FIFOs are watched: regular files are always writable, so watching them
+// would prevent the event loop from sleeping. The queue is flushed before each
+// wait, so the callback only has to detect when the reader goes away.
+static void wsbr_pcapng_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_pcap);
 
-static void wsbr_pcapng_write(struct wsbr_ctxt *ctxt, const struct iobuf_write *buf)
+    if (revents & EPOLLERR)
+        wsbr_pcapng_closed(ctxt);
+}
+
+static void wsbr_pcapng_watch(struct wsbr_ctxt *ctxt)
+{
+    if (ctxt->pcapng_type != S_IFIFO)
+        return;
+    ctxt->ev_pcap.fd = ctxt->pcapng_fd;
+    ctxt->ev_pcap.callback = wsbr_pcapng_recv;
+    event_loop_add(&ctxt->ev_pcap);
+}
+
+static void wsbr_pcapng_queue(struct wsbr_ctxt *ctxt, const struct iobuf_write *buf)
+{
+    if (wsbr_pcapng_queue_len(ctxt) + buf->len > PCAPNG_QUEUE_SIZE_MAX) {
+        if (!ctxt->pcapng_drop_count)
+            WARN("pcapng queue full");
+        ctxt->pcapng_drop_count++;
+        return;
+    }
+    if (ctxt->pcapng_drop_count) {
+        WARN("pcapng: %u blocks dropped", ctxt->pcapng_drop_count);
+        ctxt->pcapng_drop_count = 0;
+    }
+    iobuf_push_data(&ctxt->pcapng_queue, buf->data, buf->len);
+}
+
+static void wsbr_pcapng_write_start(struct wsbr_ctxt *ctxt)
+{
+    struct iobuf_write buf = { };
+
+    pcapng_write_shb(&buf);
+    pcapng_write_idb(&buf, LINKTYPE_IEEE802_15_4_NOFCS);
+    wsbr_pcapng_queue(ctxt, &buf);
+    iobuf_free(&buf);
+}
+
+static void wsbr_pcapng_open_file(struct wsbr_ctxt *ctxt)
+{
+    ctxt->pcapng_fd = open(ctxt->config.pcap_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    FATAL_ON(ctxt->pcapng_fd < 0, 2, "open %s: %m", ctxt->config.pcap_file);
+    ctxt->pcapng_file_size = 0;
+    ctxt->pcapng_file_start_ms = time_now_ms(CLOCK_MONOTONIC);
+}
+
+// The previous capture file is kept with a ".1" suffix, so the disk usage is
+// bounded to twice pcap_file_size_max.
+static void wsbr_pcapng_rotate(struct wsbr_ctxt *ctxt)
 {
+    char path[PATH_MAX];
     int ret;
 
+    wsbr_pcapng_flush(ctxt, true);
+    ret = close(ctxt->pcapng_fd);
+    FATAL_ON(ret < 0, 2, "close pcapng: %m");
+    ret = snprintf(path, sizeof(path), "%s.1", ctxt->config.pcap_file);
+    FATAL_ON(ret >= sizeof(path), 2, "%s: path too long", ctxt->config.pcap_file);
+    ret = rename(ctxt->config.pcap_file, path);
+    FATAL_ON(ret < 0, 2, "rename %s: %m", ctxt->config.pcap_file);
+    wsbr_pcapng_open_file(ctxt);
+    wsbr_pcapng_queue_reset(ctxt);
+    wsbr_pcapng_write_start(ctxt);
+}
+
+static bool wsbr_pcapng_rotate_needed(struct wsbr_ctxt *ctxt, size_t len)
+{
+    if (!wsbr_pcapng_rotation_enabled(ctxt))
+        return false;
+    if (ctxt->config.pcap_file_size_max &&
+        ctxt->pcapng_file_size + wsbr_pcapng_queue_len(ctxt) + len > ctxt->config.pcap_file_size_max)
+        return true;
+    if (ctxt->config.pcap_file_rotate_s &&
+        time_now_ms(CLOCK_MONOTONIC) - ctxt->pcapng_file_start_ms >= ctxt->config.pcap_file_rotate_s * 1000ull)
+        return true;
+    return false;
+}
+
+static void wsbr_pcapng_write(struct wsbr_ctxt *ctxt, const struct iobuf_write *buf)
+{
     // recover if other process stopped reading from FIFO
     if (ctxt->pcapng_fd < 0) {
         ctxt->pcapng_fd = open(ctxt->config.pcap_file, O_WRONLY | O_NONBLOCK);
         if (ctxt->pcapng_fd < 0)
             return;
         WARN("restarted pcapng capture");
-        ctxt->fds[POLLFD_PCAP].fd = ctxt->pcapng_fd;
+        wsbr_pcapng_watch(ctxt);
         wsbr_pcapng_write_start(ctxt);
     }
 
-    ret = write(ctxt->pcapng_fd, buf->data, buf->len);
-    if (ret >= 0)
-        return;
-    if (ctxt->pcapng_type == S_IFIFO && errno == EAGAIN)
-        WARN("pcapng fifo full");
-    else
-        FATAL(2, "write pcapng: %m");
+    if (wsbr_pcapng_rotate_needed(ctxt, buf->len))
+        wsbr_pcapng_rotate(ctxt);
+    wsbr_pcapng_queue(ctxt, buf);
 }
 
-static void wsbr_pcapng_write_start(struct wsbr_ctxt *ctxt)
+void wsbr_pcapng_flush(struct wsbr_ctxt *ctxt, bool force)
 {
-    struct iobuf_write buf = { };
+    size_t len = wsbr_pcapng_queue_len(ctxt);
+    ssize_t ret;
 
-    pcapng_write_shb(&buf);
-    pcapng_write_idb(&buf, LINKTYPE_IEEE802_15_4_NOFCS);
-    wsbr_pcapng_write(ctxt, &buf);
-    iobuf_free(&buf);
+    if (ctxt->pcapng_fd < 0 || !len)
+        return;
+    if (!force && wsbr_pcapng_rotation_enabled(ctxt)) {
+        len -= len % PCAPNG_WRITE_ALIGN;
+        if (!len)
+            return;
+    }
+    ret = write(ctxt->pcapng_fd, ctxt->pcapng_queue.data + ctxt->pcapng_queue_offset, len);
+    if (ret < 0 && errno == EPIPE) {
+        wsbr_pcapng_closed(ctxt);
+        return;
+    }
+    if (ret < 0 && errno != EAGAIN)
+        FATAL(2, "write pcapng: %m");
+    if (ret > 0) {
+        ctxt->pcapng_queue_offset += ret;
+        ctxt->pcapng_file_size += ret;
+    }
+    if (!wsbr_pcapng_queue_len(ctxt))
+        wsbr_pcapng_queue_reset(ctxt);
+    else if (ret < len)
+        event_loop_mod(&ctxt->ev_pcap, EPOLLOUT); // Flush again once writable
 }
 
 void wsbr_pcapng_init(struct wsbr_ctxt *ctxt)
@@ -100,35 +231,69 @@ void wsbr_pcapng_init(struct wsbr_ctxt *ctxt)
                 FATAL(2, "open %s: %m", ctxt->config.pcap_file);
         }
     } else {
-        ctxt->pcapng_fd = open(ctxt->config.pcap_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-        FATAL_ON(ctxt->pcapng_fd < 0, 2, "open %s: %m", ctxt->config.pcap_file);
+        wsbr_pcapng_open_file(ctxt);
     }
 
-    ctxt->fds[POLLFD_PCAP].fd = ctxt->pcapng_fd;
+    wsbr_pcapng_set_filter(ctxt, ctxt->config.pcap_filter_mac64, ctxt->config.pcap_filter_mac64_count,
+                           ctxt->config.pcap_filter_frames);
+    wsbr_pcapng_watch(ctxt);
     wsbr_pcapng_write_start(ctxt);
 }
 
+void wsbr_pcapng_set_filter(struct wsbr_ctxt *ctxt, const uint8_t (*mac64)[8], int mac64_count,
+                            unsigned int frames)
+{
+    free(ctxt->pcapng_filter_mac64);
+    ctxt->pcapng_filter_mac64 = NULL;
+    if (mac64_count) {
+        ctxt->pcapng_filter_mac64 = xalloc(mac64_count * 8);
+        memcpy(ctxt->pcapng_filter_mac64, mac64, mac64_count * 8);
+    }
+    ctxt->pcapng_filter_mac64_count = mac64_count;
+    ctxt->pcapng_filter_frames = frames;
+}
+
+static bool wsbr_pcapng_filter(struct wsbr_ctxt *ctxt, const struct ieee802154_hdr *hdr,
+                               const struct iobuf_read *ie_header)
+{
+    struct ws_utt_ie utt;
+    int i;
+
+    if (ctxt->pcapng_filter_frames != (unsigned int)-1) {
+        if (!ws_wh_utt_read(ie_header->data, ie_header->data_size, &utt))
+            return false;
+        if (utt.message_type >= 32 || !(ctxt->pcapng_filter_frames & BIT(utt.message_type)))
+            return false;
+    }
+    if (!ctxt->pcapng_filter_mac64_count)
+        return true;
+    for (i = 0; i < ctxt->pcapng_filter_mac64_count; i++)
+        if (!memcmp(ctxt->pcapng_filter_mac64[i], hdr->src.u8, 8) ||
+            !memcmp(ctxt->pcapng_filter_mac64[i], hdr->dst.u8, 8))
+            return true;
+    return false;
+}
+
 void wsbr_pcapng_write_frame(struct wsbr_ctxt *ctxt, uint64_t timestamp_us,
-                             const void *frame, size_t frame_len)
+                             const struct ieee802154_hdr *hdr,
+                             const struct iobuf_read *ie_header,
+                             const struct iobuf_read *ie_payload)
 {
     struct iobuf_write iobuf_pcapng = { };
     struct iobuf_write iobuf_frame = { };
-    struct iobuf_read ie_payload;
-    struct iobuf_read ie_header;
-    struct ieee802154_hdr hdr;
+    struct ieee802154_hdr hdr_nosec;
     struct timespec tp;
-    int ret;
 
-    ret = ieee802154_frame_parse(frame, frame_len, &hdr, &ie_header, &ie_payload);
-    if (ret < 0)
+    if (!wsbr_pcapng_filter(ctxt, hdr, ie_header))
         return;
-    hdr.key_index = 0; // Strip the Auxiliary Security Header
+    hdr_nosec = *hdr;
+    hdr_nosec.key_index = 0; // Strip the Auxiliary Security Header
 
-    ieee802154_frame_write_hdr(&iobuf_frame, &hdr);
-    iobuf_push_data(&iobuf_frame, ie_header.data, ie_header.data_size);
-    if (ie_payload.data_size) {
+    ieee802154_frame_write_hdr(&iobuf_frame, &hdr_nosec);
+    iobuf_push_data(&iobuf_frame, ie_header->data, ie_header->data_size);
+    if (ie_payload->data_size) {
         ieee802154_ie_push_header(&iobuf_frame, IEEE802154_IE_ID_HT1);
-        iobuf_push_data(&iobuf_frame, ie_payload.data, ie_payload.data_size);
+        iobuf_push_data(&iobuf_frame, ie_payload->data, ie_payload->data_size);
     }
 
     if (!ctxt->pcapng_t0_us) {
@@ -14,16 +14,30 @@
 #ifndef WSBR_PCAPNG_H
 #define WSBR_PCAPNG_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 struct wsbr_ctxt;
+struct iobuf_read;
+struct ieee802154_hdr;
 struct mcps_data_ind;
 struct mcps_data_rx_ie_list;
 
 void wsbr_pcapng_init(struct wsbr_ctxt *ctxt);
-void wsbr_pcapng_closed(struct wsbr_ctxt *ctxt);
+// The frame is given already parsed, and is dropped before any block is built
+// if it does not match the filter.
 void wsbr_pcapng_write_frame(struct wsbr_ctxt *ctxt, uint64_t timestamp_us,
-                             const void *frame, size_t frame_len);
+                             const struct ieee802154_hdr *hdr,
+                             const struct iobuf_read *ie_header,
+                             const struct iobuf_read *ie_payload);
+// Only capture the frames from or to one of the given MAC addresses (all
+// frames if the list is empty), and with one of the given Wi-SUN frame types
+// (bitmask of WS_FT_*).
+void wsbr_pcapng_set_filter(struct wsbr_ctxt *ctxt, const uint8_t (*mac64)[8], int mac64_count,
+                            unsigned int frames);
+// Write the queued blocks, should be called before waiting for events. Unless
+// force is set, only whole chunks are written when rotation is enabled.
+void wsbr_pcapng_flush(struct wsbr_ctxt *ctxt, bool force);
 
 #endif
@@ -0,0 +1,265 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/log.h"
+#include "common/memutils.h"
+#include "common/specs/ipv6.h"
+
+#include "tun.h"
+#include "wsbrd.h"
+#include "wsbr_pktshm.h"
+
+// Maximum number of packets processed from the ring per wakeup, like
+// WSBR_TUN_READ_BUDGET.
+#define WSBR_PKTSHM_READ_BUDGET 16
+
+static_assert(sizeof(struct wsbr_pktshm_slot) == WSBR_PKTSHM_SLOT_SIZE, "unexpected slot size");
+
+static struct wsbr_pktshm_slot *wsbr_pktshm_slot(struct wsbr_pktshm *shm, int ring, uint32_t index)
+{
+    return (struct wsbr_pktshm_slot *)((uint8_t *)shm->hdr + shm->hdr->slot_offset[ring] +
+                                       (index % WSBR_PKTSHM_SLOT_COUNT) * WSBR_PKTSHM_SLOT_SIZE);
+}
+
+static void wsbr_pktshm_close(struct wsbr_pktshm *shm)
+{
+    INFO("packet_socket: client disconnected");
+    event_loop_del(&shm->ev_ctrl);
+    close(shm->ev_ctrl.fd);
+    shm->ev_ctrl.fd = -1;
+    event_loop_del(&shm->ev_rx);
+    close(shm->ev_rx.fd);
+    shm->ev_rx.fd = -1;
+    close(shm->efd_tx);
+    shm->efd_tx = -1;
+    munmap(shm->hdr, WSBR_PKTSHM_MAP_SIZE);
+    shm->hdr = NULL;
+}
+
+static int wsbr_pktshm_map(struct wsbr_pktshm *shm)
+{
+    int fd;
+
+    fd = memfd_create("wsbrd-pktshm", MFD_CLOEXEC);
+    FATAL_ON(fd < 0, 2, "%s: memfd_create: %m", __func__);
+    FATAL_ON(ftruncate(fd, WSBR_PKTSHM_MAP_SIZE) < 0, 2, "%s: ftruncate: %m", __func__);
+    shm->hdr = mmap(NULL, WSBR_PKTSHM_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    FATAL_ON(shm->hdr == MAP_FAILED, 2, "%s: mmap: %m", __func__);
+    shm->hdr->magic      = WSBR_PKTSHM_MAGIC;
+    shm->hdr->version    = WSBR_PKTSHM_VERSION;
+    shm->hdr->slot_count = WSBR_PKTSHM_SLOT_COUNT;
+    shm->hdr->slot_size  = WSBR_PKTSHM_SLOT_SIZE;
+    for (int i = 0; i < WSBR_PKTSHM_RING_COUNT; i++) {
+        shm->hdr->slot_offset[i] = sizeof(struct wsbr_pktshm_hdr) +
+                                   i * WSBR_PKTSHM_SLOT_COUNT * WSBR_PKTSHM_SLOT_SIZE;
+        atomic_init(&shm->hdr->rings[i].head, 0);
+        atomic_init(&shm->hdr->rings[i].tail, 0);
+    }
+    return fd;
+}
+
+static bool wsbr_pktshm_setup(struct wsbr_pktshm *shm)
+{
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } ctrl = { };
+    uint8_t ack = 0;
+    struct iovec iov = { .iov_base = &ack, .iov_len = sizeof(ack) };
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = ctrl.buf,
+        .msg_controllen = sizeof(ctrl.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    int fds[3];
+    ssize_t ret;
+
+    ret = recv(shm->ev_ctrl.fd, &shm->client_addr, sizeof(shm->client_addr), MSG_DONTWAIT);
+    if (ret != sizeof(shm->client_addr)) {
+        WARN("packet_socket: invalid client address");
+        return false;
+    }
+    fds[0] = wsbr_pktshm_map(shm);
+    shm->efd_tx = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    FATAL_ON(shm->efd_tx < 0, 2, "%s: eventfd: %m", __func__);
+    shm->ev_rx.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    FATAL_ON(shm->ev_rx.fd < 0, 2, "%s: eventfd: %m", __func__);
+    fds[1] = shm->efd_tx;
+    fds[2] = shm->ev_rx.fd;
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    ret = sendmsg(shm->ev_ctrl.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    // The client keeps its own references to the memory
+    close(fds[0]);
+    if (ret < 0) {
+        WARN("%s: sendmsg: %m", __func__);
+        return false;
+    }
+    event_loop_add(&shm->ev_rx);
+    INFO("packet_socket: client %s connected", tr_ipv6(shm->client_addr.s6_addr));
+    return true;
+}
+
+static void wsbr_pktshm_read(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_pktshm *shm = &ctxt->pktshm;
+    struct wsbr_pktshm_ring *ring = &shm->hdr->rings[WSBR_PKTSHM_RING_TO_BR];
+    struct wsbr_pktshm_slot *slot;
+    uint32_t head, tail, len;
+
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (int i = 0; i < WSBR_PKTSHM_READ_BUDGET && tail != head; i++) {
+        if (wsbr_tun_stalled(ctxt))
+            break;
+        slot = wsbr_pktshm_slot(shm, WSBR_PKTSHM_RING_TO_BR, tail);
+        // The client may write anything in the slots, at any time
+        len = *(volatile uint32_t *)&slot->len;
+        TRACE(TR_TUN, "rx-shm: %u bytes", len);
+        if (len <= WSBR_PKTSHM_PKT_SIZE_MAX)
+            wsbr_tun_inject(ctxt, slot->pkt, len);
+        else
+            TRACE(TR_DROP, "drop %-9s: invalid length %u", "pktshm", len);
+        shm->rx_count++;
+        tail++;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+}
+
+static void wsbr_pktshm_rx_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, pktshm.ev_rx);
+    uint64_t val;
+
+    if (revents & EPOLLIN)
+        read(src->fd, &val, sizeof(val));
+    wsbr_pktshm_read(ctxt);
+}
+
+static void wsbr_pktshm_ctrl_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_pktshm *shm = container_of(src, struct wsbr_pktshm, ev_ctrl);
+    uint8_t buf[16];
+    ssize_t ret;
+
+    if (!shm->hdr) {
+        if (!wsbr_pktshm_setup(shm))
+            wsbr_pktshm_close(shm);
+        return;
+    }
+    // The client is not expected to send anything else, its input is only
+    // read to detect the end of the connection.
+    ret = recv(src->fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        wsbr_pktshm_close(shm);
+}
+
+void wsbr_pktshm_init(struct wsbr_ctxt *ctxt)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct wsbr_pktshm *shm = &ctxt->pktshm;
+    int ret;
+
+    if (strlen(ctxt->config.packet_socket) >= sizeof(addr.sun_path))
+        FATAL(1, "packet_socket: path too long");
+    strcpy(addr.sun_path, ctxt->config.packet_socket);
+    shm->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    FATAL_ON(shm->fd < 0, 2, "%s: socket: %m", __func__);
+    // A previous instance may have left the socket behind
+    if (unlink(addr.sun_path) < 0 && errno != ENOENT)
+        FATAL(2, "%s: unlink %s: %m", __func__, addr.sun_path);
+    ret = bind(shm->fd, (struct sockaddr *)&addr, sizeof(addr));
+    FATAL_ON(ret < 0, 2, "%s: bind %s: %m", __func__, addr.sun_path);
+    ret = listen(shm->fd, 1);
+    FATAL_ON(ret < 0, 2, "%s: listen: %m", __func__);
+    shm->ev_ctrl.events   = EPOLLIN;
+    shm->ev_ctrl.callback = wsbr_pktshm_ctrl_recv;
+    shm->ev_rx.events     = EPOLLIN;
+    shm->ev_rx.budget     = 0; // wsbr_pktshm_read() has its own budget
+    shm->ev_rx.callback   = wsbr_pktshm_rx_recv;
+}
+
+void wsbr_pktshm_accept(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_pktshm *shm = &ctxt->pktshm;
+    int fd;
+
+    fd = accept4(shm->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        WARN("%s: accept: %m", __func__);
+        return;
+    }
+    if (shm->ev_ctrl.fd >= 0) {
+        WARN("packet_socket: client already connected");
+        close(fd);
+        return;
+    }
+    shm->ev_ctrl.fd = fd;
+    event_loop_add(&shm->ev_ctrl);
+}
+
+bool wsbr_pktshm_write(struct wsbr_ctxt *ctxt, const uint8_t *pkt, uint16_t len)
+{
+    struct wsbr_pktshm *shm = &ctxt->pktshm;
+    struct wsbr_pktshm_ring *ring;
+    struct wsbr_pktshm_slot *slot;
+    uint32_t head, tail;
+    uint64_t val = 1;
+
+    if (!shm->hdr || len < IPV6_HDRLEN || memcmp(pkt + IPV6_HDROFF_DST_ADDR, shm->client_addr.s6_addr, 16))
+        return false;
+    ring = &shm->hdr->rings[WSBR_PKTSHM_RING_TO_CLIENT];
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= WSBR_PKTSHM_SLOT_COUNT || len > WSBR_PKTSHM_PKT_SIZE_MAX) {
+        TRACE(TR_DROP, "drop %-9s: ring full", "pktshm");
+        shm->tx_drop++;
+        return true;
+    }
+    slot = wsbr_pktshm_slot(shm, WSBR_PKTSHM_RING_TO_CLIENT, head);
+    slot->len = len;
+    memcpy(slot->pkt, pkt, len);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_seq_cst);
+    TRACE(TR_TUN, "tx-shm: %u bytes", len);
+    shm->tx_count++;
+    // The client only needs a wakeup if it may have seen the ring empty
+    if (head == atomic_load_explicit(&ring->tail, memory_order_seq_cst))
+        write(shm->efd_tx, &val, sizeof(val));
+    return true;
+}
+
+bool wsbr_pktshm_rx_pending(struct wsbr_ctxt *ctxt)
+{
+    struct wsbr_pktshm *shm = &ctxt->pktshm;
+    struct wsbr_pktshm_ring *ring;
+
+    if (!shm->hdr)
+        return false;
+    ring = &shm->hdr->rings[WSBR_PKTSHM_RING_TO_BR];
+    return atomic_load_explicit(&ring->tail, memory_order_relaxed) !=
+           atomic_load_explicit(&ring->head, memory_order_acquire);
+}
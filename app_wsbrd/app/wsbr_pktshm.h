@@ -0,0 +1,111 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSBR_PKTSHM_H
+#define WSBR_PKTSHM_H
+
+/*
+ * Exchange of IPv6 packets with a local application through shared memory,
+ * set by the packet_socket option. This is intended for a head-end running on
+ * the border router host, which would otherwise pay a system call and a copy
+ * per packet in each direction through the TUN interface. TUN stays in use
+ * for all the other traffic.
+ *
+ * A single client at a time connects to the Unix socket (SOCK_SEQPACKET) and
+ * sends its IPv6 address (16 bytes). wsbrd answers with a single byte (0) and
+ * 3 file descriptors (SCM_RIGHTS):
+ *   - a memfd to map (MAP_SHARED, WSBR_PKTSHM_MAP_SIZE bytes),
+ *   - an eventfd signaled by wsbrd when WSBR_PKTSHM_RING_TO_CLIENT becomes
+ *     non-empty,
+ *   - an eventfd to signal by the client when WSBR_PKTSHM_RING_TO_BR becomes
+ *     non-empty.
+ * From then, the packets from the Wi-SUN network destined to the client
+ * address are written in the ring to the client instead of TUN, and the
+ * packets from the ring to wsbrd are processed like packets read from TUN.
+ * The shared memory is released when the client closes the socket.
+ *
+ * The mapping starts with struct wsbr_pktshm_hdr, followed by the slots of
+ * each ring. Each ring is single-producer, single-consumer: the producer only
+ * writes head, the consumer only writes tail, both are free-running indexes
+ * (slot = index % slot_count) accessed with acquire/release semantics. A slot
+ * holds the length of a raw IPv6 packet followed by the packet. Integers use
+ * the host byte order. When a ring is full, the packet is dropped and counted
+ * in the metrics.
+ */
+
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/event_loop.h"
+
+struct wsbr_ctxt;
+
+#define WSBR_PKTSHM_MAGIC        0x6d687377 // "wshm"
+#define WSBR_PKTSHM_VERSION      1
+#define WSBR_PKTSHM_SLOT_COUNT   256
+#define WSBR_PKTSHM_SLOT_SIZE    2048
+#define WSBR_PKTSHM_PKT_SIZE_MAX (WSBR_PKTSHM_SLOT_SIZE - sizeof(uint32_t))
+#define WSBR_PKTSHM_MAP_SIZE     (sizeof(struct wsbr_pktshm_hdr) + \
+                                  2 * WSBR_PKTSHM_SLOT_COUNT * WSBR_PKTSHM_SLOT_SIZE)
+
+enum {
+    WSBR_PKTSHM_RING_TO_CLIENT,
+    WSBR_PKTSHM_RING_TO_BR,
+    WSBR_PKTSHM_RING_COUNT,
+};
+
+struct wsbr_pktshm_ring {
+    // Separate cache lines so the producer and the consumer do not contend
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+};
+
+struct wsbr_pktshm_slot {
+    uint32_t len;
+    uint8_t pkt[WSBR_PKTSHM_PKT_SIZE_MAX];
+};
+
+struct wsbr_pktshm_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    // Offset of the slots of each ring from the start of the mapping
+    uint32_t slot_offset[WSBR_PKTSHM_RING_COUNT];
+    struct wsbr_pktshm_ring rings[WSBR_PKTSHM_RING_COUNT];
+};
+
+struct wsbr_pktshm {
+    int fd;
+    struct event_source ev_ctrl;  // Connection of the client
+    struct event_source ev_rx;    // Eventfd signaled by the client
+    int efd_tx;
+    struct in6_addr client_addr;
+    struct wsbr_pktshm_hdr *hdr;  // NULL when no client is connected
+    uint64_t tx_count;
+    uint64_t tx_drop;
+    uint64_t rx_count;
+};
+
+void wsbr_pktshm_init(struct wsbr_ctxt *ctxt);
+void wsbr_pktshm_accept(struct wsbr_ctxt *ctxt);
+// Write the packet to the client if it is the destination. Return false if
+// the packet is not for the client.
+bool wsbr_pktshm_write(struct wsbr_ctxt *ctxt, const uint8_t *pkt, uint16_t len);
+// True if the client has produced packets not processed yet.
+bool wsbr_pktshm_rx_pending(struct wsbr_ctxt *ctxt);
+
+#endif
@@ -12,15 +12,19 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _GNU_SOURCE
+#include <sys/signalfd.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
 #include "common/ws/ws_regdb.h"
+#include "common/crypto/nist_kw.h"
 #include "common/mbedtls_config_check.h"
 #include "common/bus_uart.h"
 #include "common/bus_cpc.h"
 #include "common/capture.h"
+#include "common/cpu_usage.h"
 #include "common/dbus.h"
 #include "common/dhcp_server.h"
 #include "common/events_scheduler.h"
@@ -33,23 +37,29 @@
 #include "common/key_value_storage.h"
 #include "common/drop_privileges.h"
 #include "common/string_extra.h"
+#include "common/time_extra.h"
 #include "common/specs/ws.h"
 #include "common/rand.h"
 #include "common/rcp_api.h"
 
 #include "6lowpan/bootstraps/protocol_6lowpan.h"
+#include "6lowpan/iphc_decode/cipv6.h"
 #include "6lowpan/lowpan_adaptation_interface.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "ws/ws_pan_info_storage.h"
+#include "ws/ws_neigh_snapshot.h"
 #include "ws/ws_auth.h"
 #include "ws/ws_bootstrap.h"
 #include "ws/ws_bootstrap_6lbr.h"
 #include "ws/ws_common.h"
+#include "ws/ws_mngt.h"
 #include "ws/ws_llc.h"
 #include "ws/ws_pae_controller.h"
+#include "ws/ws_pae_key_storage.h"
 #include "ws/ws_eapol_relay.h"
 #include "ws/ws_config.h"
 #include "ws/ws_eapol_auth_relay.h"
+#include "ipv6/icmpv6.h"
 #include "net/timers.h"
 #include "net/ns_address_internal.h"
 #include "net/netaddr_types.h"
@@ -65,6 +75,7 @@
 #include "commandline.h"
 #include "wsbr_cfg.h"
 #include "wsbr_mac.h"
+#include "wsbr_metrics.h"
 #include "wsbr_pcapng.h"
 #include "libwsbrd.h"
 #include "wsbrd.h"
@@ -76,6 +87,7 @@ static void wsbr_handle_reset(struct rcp *rcp);
 static void wsbr_rpl_target_add(struct rpl_root *root, struct rpl_target *target);
 static void wsbr_rpl_target_del(struct rpl_root *root, struct rpl_target *target);
 static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *target, bool updated_transit);
+static void wsbr_rpl_target_update_done(struct rpl_root *root, bool updated_transit);
 
 static void wsbr_on_gtk_change(struct auth_ctx *auth, const uint8_t gtk[16], uint8_t key_index, bool activate)
 {
@@ -97,9 +109,14 @@ static void wsbr_on_gtk_change(struct auth_ctx *auth, const uint8_t gtk[16], uin
         ws_bootstrap_nw_key_index_set(&ctxt->net_if, slot);
 }
 
+static void wsbr_on_supp_gtk_installed(struct auth_ctx *auth, const struct eui64 *eui64, uint8_t key_index)
+{
+    wsbr_events_auth_gtk_installed(container_of(auth, struct wsbr_ctxt, auth), eui64, key_index);
+}
+
 // See warning in wsbrd.h
 struct wsbr_ctxt g_ctxt = {
-    .scheduler.event_fd = { -1, -1 },
+    .scheduler.event_fd = -1,
 
     .rcp.on_reset = wsbr_handle_reset,
     .rcp.on_tx_cnf = wsbr_tx_cnf,
@@ -108,6 +125,15 @@ struct wsbr_ctxt g_ctxt = {
     // avoid initializating to 0 = STDIN_FILENO
     .tun.fd = -1,
     .pcapng_fd = -1,
+    .metrics_fd = -1,
+    .signal_fd = -1,
+    .pan_load.fd = -1,
+    .campaign.fd = -1,
+    .events.fd = -1,
+    .pktshm.fd = -1,
+    .pktshm.ev_ctrl.fd = -1,
+    .pktshm.ev_rx.fd = -1,
+    .pktshm.efd_tx = -1,
     .rcp.bus.fd = -1,
     .dhcp_server.fd = -1,
     .net_if.rpl_root.sockfd = -1,
@@ -118,6 +144,7 @@ struct wsbr_ctxt g_ctxt = {
     .auth.timeout_ms = 60 * 1000, // Arbitrary
     .auth.sendto_mac    = ws_llc_auth_sendto_mac,
     .auth.on_gtk_change = wsbr_on_gtk_change,
+    .auth.on_supp_gtk_installed = wsbr_on_supp_gtk_installed,
 
     .dhcp_relay.fd = -1,
     // RFC 8415 7.6. Transmission and Retransmission Parameters
@@ -138,6 +165,7 @@ struct wsbr_ctxt g_ctxt = {
     .net_if.rpl_root.on_target_add    = wsbr_rpl_target_add,
     .net_if.rpl_root.on_target_del    = wsbr_rpl_target_del,
     .net_if.rpl_root.on_target_update = wsbr_rpl_target_update,
+    .net_if.rpl_root.on_target_update_done = wsbr_rpl_target_update_done,
 
     .net_if.llc_random_early_detection.weight = RED_AVERAGE_WEIGHT_EIGHTH,
     .net_if.llc_random_early_detection.threshold_min = MAX_SIMULTANEOUS_SECURITY_NEGOTIATIONS_TX_QUEUE_MIN,
@@ -175,6 +203,8 @@ static void wsbr_rpl_target_add(struct rpl_root *root, struct rpl_target *target
                              0);                  // pref
     tun_add_node_to_proxy_neightbl(&ctxt->net_if, target->prefix);
     tun_add_ipv6_direct_route(&ctxt->net_if, target->prefix);
+    dbus_emit_routing_graph_change(root, target, DBUS_ROUTING_GRAPH_ADD);
+    wsbr_events_target(ctxt, WSBR_EVENT_TARGET_ADD, target);
 }
 
 static void wsbr_rpl_target_del(struct rpl_root *root, struct rpl_target *target)
@@ -189,8 +219,10 @@ static void wsbr_rpl_target_del(struct rpl_root *root, struct rpl_target *target
                                 (void *)root,        // info
                                 0);                  // source id
     rpl_storage_del_target(root, target);
-    dbus_emit_change("Nodes");
-    dbus_emit_change("RoutingGraph");
+    dbus_nodes_changed();
+    dbus_routing_graph_changed();
+    dbus_emit_routing_graph_change(root, target, DBUS_ROUTING_GRAPH_DEL);
+    wsbr_events_target(ctxt, WSBR_EVENT_TARGET_DEL, target);
 }
 
 static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *target, bool updated_transit)
@@ -204,16 +236,16 @@ static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *tar
     if (!updated_transit)
         return;
 
-    dbus_emit_change("Nodes");
-    dbus_emit_change("RoutingGraph");
+    dbus_emit_routing_graph_change(root, target, DBUS_ROUTING_GRAPH_UPDATE);
+    wsbr_events_target(ctxt, WSBR_EVENT_TARGET_UPDATE, target);
 
     /*
      * HACK: Delete the neighbor cache entry in case the node did not
      * remove itself. Otherwise routing will choose an "ARO route" instead
      * of a "DAO route", which will fail until ARO expiration.
      */
-    for (uint8_t i = 0; i < root->pcs + 1; i++)
-        if (IN6_ARE_ADDR_EQUAL(target->transits[i].parent, root->dodag_id))
+    for (uint8_t i = 0; i < target->transits_len; i++)
+        if (target->transits[i].parent && IN6_ARE_ADDR_EQUAL(target->transits[i].parent, root->dodag_id))
             is_neigh = true;
     if (!is_neigh) {
         neigh = ipv6_neighbour_lookup(&ctxt->net_if.ipv6_neighbour_cache, target->prefix);
@@ -222,6 +254,17 @@ static void wsbr_rpl_target_update(struct rpl_root *root, struct rpl_target *tar
     }
 }
 
+static void wsbr_rpl_target_update_done(struct rpl_root *root, bool updated_transit)
+{
+    if (!updated_transit)
+        return;
+    // Source routes, and thus next hops, through the updated targets have
+    // changed
+    ipv6_route_cache_flush();
+    dbus_nodes_changed();
+    dbus_routing_graph_changed();
+}
+
 static void ws_enable_mac_filtering(struct wsbr_ctxt *ctxt)
 {
     BUG_ON(ctxt->config.ws_allowed_mac_address_count && ctxt->config.ws_denied_mac_address_count);
@@ -261,6 +304,7 @@ static void wsbr_configure_ws(struct wsbr_ctxt *ctxt)
     struct ws_info *ws_info = &ctxt->net_if.ws_info;
     struct ws_fhss_config *fhss = &ws_info->fhss_config;
     struct chan_params *chan_params;
+    int duty_cycle_budget;
 
     ws_info->phy_config.params = ws_regdb_phy_params(ctxt->config.ws_phy_mode_id,
                                                      ctxt->config.ws_mode);
@@ -295,6 +339,10 @@ static void wsbr_configure_ws(struct wsbr_ctxt *ctxt)
         fhss->regional_regulation = ctxt->config.ws_regional_regulation;
         rcp_set_radio_regulation(&ctxt->rcp, ctxt->config.ws_regional_regulation);
     }
+    duty_cycle_budget = ctxt->config.duty_cycle_budget;
+    if (duty_cycle_budget < 0)
+        duty_cycle_budget = fhss->regional_regulation == HIF_REG_ARIB ? 100 : 0; // ARIB STD-T108: 10% per hour
+    duty_cycle_init(&ws_info->duty_cycle, duty_cycle_budget, ctxt->config.duty_cycle_window_ms);
 
     ws_chan_mask_calc_reg(fhss->uc_chan_mask, fhss->chan_params, fhss->regional_regulation);
     ws_chan_mask_calc_reg(fhss->bc_chan_mask, fhss->chan_params, fhss->regional_regulation);
@@ -342,20 +390,30 @@ static void wsbr_configure_ws(struct wsbr_ctxt *ctxt)
                                                 size_params[ctxt->config.ws_size].mpl_seed_set_entry_lifetime,
                                                 ctxt->config.enable_ffn10 ? MPL_SEED_128_BIT : MPL_SEED_IPV6_SRC,
                                                 &size_params[ctxt->config.ws_size].trickle_mpl);
+    mpl_domain_set_aggregate_tx(ctxt->net_if.mpl_domain, ctxt->config.mpl_aggregate_tx);
+    ctxt->net_if.lfn_mcast_unicast_max = ctxt->config.lfn_mcast_unicast_max;
+    icmpv6_ratelimit_init(&(struct icmpv6_ratelimit_cfg){
+        .rate      = ctxt->config.icmp_rate_limit,
+        .type_rate = ctxt->config.icmp_type_rate_limit,
+        .dst_rate  = ctxt->config.icmp_dst_rate_limit,
+    });
     ws_info->mngt.trickle_params = size_params[ctxt->config.ws_size].trickle_discovery;
 
     ws_info->pan_information.version = ctxt->config.ws_fan_version;
     ws_info->pan_information.max_pan_size = wsbr_get_max_pan_size(ctxt->config.ws_size);
     ws_info->pan_information.test_pan_size = ctxt->config.pan_size;
     ws_info->enable_lfn   = ctxt->config.enable_lfn;
+#ifdef HAVE_FAN10
     ws_info->enable_ffn10 = ctxt->config.enable_ffn10;
+#endif
 
     rcp_set_radio_tx_power(&ctxt->rcp, ctxt->config.tx_power);
     ws_info->tx_power_dbm = ctxt->config.tx_power;
 
     ws_enable_mac_filtering(ctxt);
 
-    timer_group_init(&ws_info->neighbor_storage.timer_group);
+    ws_info->neighbor_storage.max_count = ctxt->config.neighbor_max;
+    ws_neigh_table_init(&ws_info->neighbor_storage);
 }
 
 static void wsbr_check_link_local_addr(struct wsbr_ctxt *ctxt)
@@ -383,6 +441,9 @@ static void wsbr_network_init(struct wsbr_ctxt *ctxt)
     protocol_core_init();
     address_module_init();
     protocol_init(&ctxt->net_if, &ctxt->rcp, ctxt->config.lowpan_mtu);
+    ctxt->net_if.aqm = ctxt->config.queue_management;
+    ctxt->net_if.codel_params.target_us   = ctxt->config.codel_target_ms * 1000;
+    ctxt->net_if.codel_params.interval_us = ctxt->config.codel_interval_ms * 1000;
     ws_bootstrap_init(ctxt->net_if.id);
 
     wsbr_configure_ws(ctxt);
@@ -391,10 +452,15 @@ static void wsbr_network_init(struct wsbr_ctxt *ctxt)
 
     ws_bootstrap_up(&ctxt->net_if, gua.s6_addr);
     wsbr_check_link_local_addr(ctxt);
-    if (IN6_IS_ADDR_UNSPECIFIED(&ctxt->config.dhcp_server.sin6_addr)) {
+    if (IN6_IS_ADDR_UNSPECIFIED(&ctxt->config.dhcp_server[0].sin6_addr)) {
+        ctxt->dhcp_server.valid_lifetime = ctxt->config.dhcp_lease_lifetime_s;
+        ctxt->dhcp_server.pool_size = ctxt->config.dhcp_pool_size;
+        memcpy(ctxt->dhcp_server.pool_start, ctxt->config.dhcp_pool_start.sin6_addr.s6_addr + 8, 8);
+        ctxt->dhcp_server.storage_fsync = ctxt->config.storage_fsync;
         dhcp_start(&ctxt->dhcp_server, ctxt->tun.ifname, ctxt->rcp.eui64.u8, gua.s6_addr);
-    } else if (!IN6_IS_ADDR_LOOPBACK(&ctxt->config.dhcp_server.sin6_addr)) {
-        ctxt->dhcp_relay.server_addr = ctxt->config.dhcp_server.sin6_addr;
+    } else if (!IN6_IS_ADDR_LOOPBACK(&ctxt->config.dhcp_server[0].sin6_addr)) {
+        for (int i = 0; i < ARRAY_SIZE(ctxt->config.dhcp_server); i++)
+            ctxt->dhcp_relay.server_addr[i] = ctxt->config.dhcp_server[i].sin6_addr;
         ctxt->dhcp_relay.link_addr = gua;
         dhcp_relay_start(&ctxt->dhcp_relay);
     }
@@ -402,7 +468,10 @@ static void wsbr_network_init(struct wsbr_ctxt *ctxt)
     memcpy(ctxt->net_if.rpl_root.dodag_id, gua.s6_addr, 16);
     rpl_storage_load(&ctxt->net_if.rpl_root);
     ctxt->net_if.rpl_root.compat = ctxt->config.rpl_compat;
+    ctxt->net_if.rpl_root.storage_fsync = ctxt->config.storage_fsync;
     ctxt->net_if.rpl_root.rpi_ignorable = ctxt->config.rpl_rpi_ignorable;
+    ctxt->net_if.rpl_root.compress_6lorh = ctxt->config.rpl_6lorh;
+    ctxt->net_if.rpl_root.paced_refresh = ctxt->config.rpl_paced_refresh;
     if (ctxt->net_if.rpl_root.instance_id || memcmp(ctxt->net_if.rpl_root.dodag_id, gua.s6_addr, 16))
         FATAL(1, "RPL storage out-of-date (see -D)");
     if (ctxt->config.ws_size == WS_NETWORK_SIZE_SMALL ||
@@ -419,8 +488,14 @@ static void wsbr_handle_reset(struct rcp *rcp)
 {
     struct wsbr_ctxt *ctxt = container_of(rcp, struct wsbr_ctxt, rcp);
 
-    if (ctxt->rcp.has_rf_list)
-        FATAL(3, "unsupported RCP reset");
+    if (ctxt->rcp.has_rf_list) {
+        if (!ctxt->config.rcp_reset_restore)
+            FATAL(3, "unsupported RCP reset");
+        WARN("RCP reset, restoring its configuration");
+        wsbr_events_rcp_reset(ctxt);
+        rcp_restore(&ctxt->rcp);
+        return;
+    }
     INFO("Connected to RCP \"%s\" (%d.%d.%d), API %d.%d.%d", ctxt->rcp.version_label,
           FIELD_GET(0xFF000000, ctxt->rcp.version_fw),
           FIELD_GET(0x00FFFF00, ctxt->rcp.version_fw),
@@ -432,13 +507,143 @@ static void wsbr_handle_reset(struct rcp *rcp)
         FATAL(3, "RCP API < 2.0.0 (too old)");
 }
 
-void kill_handler(int signal)
+static void wsbr_capture_checkpoint(struct timer_group *group, struct timer_entry *timer)
 {
-    struct wsbr_ctxt *ctxt = &g_ctxt;
+    struct wsbr_ctxt *ctxt = container_of(timer, struct wsbr_ctxt, timer_capture);
+
+    capture_checkpoint(ctxt->config.storage_prefix);
+}
+
+static void wsbr_config_check_exit(void)
+{
+    _exit(1);
+}
+
+// parse_commandline() exits on any error, so the new configuration is first
+// parsed by a child process. Registered last, wsbr_config_check_exit() runs
+// before the atexit() handlers inherited from the parent (eg. storage flush).
+static bool wsbr_config_check(struct wsbr_ctxt *ctxt)
+{
+    struct wsbrd_conf *config;
+    int status;
+    pid_t pid;
+
+    pid = fork();
+    FATAL_ON(pid < 0, 2, "%s: fork: %m", __func__);
+    if (!pid) {
+        atexit(wsbr_config_check_exit);
+        config = zalloc(sizeof(*config));
+        optind = 0;
+        parse_commandline(config, ctxt->argc, ctxt->argv, print_help_br);
+        _exit(0);
+    }
+    FATAL_ON(waitpid(pid, &status, 0) < 0, 2, "%s: waitpid: %m", __func__);
+    return WIFEXITED(status) && !WEXITSTATUS(status);
+}
+
+/*
+ * Only a subset of the parameters can be changed without restarting wsbrd.
+ * The other ones are parsed but ignored until the next start. The
+ * configuration files must remain readable once the privileges are dropped.
+ */
+void wsbr_config_reload(struct wsbr_ctxt *ctxt)
+{
+    struct tr_ratelimit_cfg trace_ratelimit_cfg[32];
+    unsigned int enabled_traces;
+    struct wsbrd_conf *config;
+
+    if (!wsbr_config_check(ctxt)) {
+        WARN("invalid configuration, reload aborted");
+        return;
+    }
+    INFO("reloading configuration");
+
+    enabled_traces = g_enabled_traces;
+    memcpy(trace_ratelimit_cfg, g_trace_ratelimit_cfg, sizeof(trace_ratelimit_cfg));
+    // Traces are parsed directly into the global variables and added to the
+    // current ones
+    g_enabled_traces = 0;
+    g_trace_ratelimited = 0;
+    memset(g_trace_ratelimit_cfg, 0, sizeof(g_trace_ratelimit_cfg));
+    config = zalloc(sizeof(*config));
+    optind = 0;
+    parse_commandline(config, ctxt->argc, ctxt->argv, print_help_br);
+    if (g_enabled_traces != enabled_traces ||
+        memcmp(trace_ratelimit_cfg, g_trace_ratelimit_cfg, sizeof(trace_ratelimit_cfg)))
+        INFO("  trace");
+
+    if (config->tx_power != ctxt->config.tx_power) {
+        INFO("  tx_power: %d -> %d", ctxt->config.tx_power, config->tx_power);
+        ctxt->config.tx_power = config->tx_power;
+        rcp_set_radio_tx_power(&ctxt->rcp, ctxt->config.tx_power);
+        ctxt->net_if.ws_info.tx_power_dbm = ctxt->config.tx_power;
+    }
+
+    if (config->ws_allowed_mac_address_count != ctxt->config.ws_allowed_mac_address_count ||
+        config->ws_denied_mac_address_count != ctxt->config.ws_denied_mac_address_count ||
+        memcmp(config->ws_allowed_mac_addresses, ctxt->config.ws_allowed_mac_addresses,
+               sizeof(config->ws_allowed_mac_addresses)) ||
+        memcmp(config->ws_denied_mac_addresses, ctxt->config.ws_denied_mac_addresses,
+               sizeof(config->ws_denied_mac_addresses))) {
+        INFO("  allowed_mac64/denied_mac64");
+        ctxt->config.ws_allowed_mac_address_count = config->ws_allowed_mac_address_count;
+        ctxt->config.ws_denied_mac_address_count  = config->ws_denied_mac_address_count;
+        memcpy(ctxt->config.ws_allowed_mac_addresses, config->ws_allowed_mac_addresses,
+               sizeof(config->ws_allowed_mac_addresses));
+        memcpy(ctxt->config.ws_denied_mac_addresses, config->ws_denied_mac_addresses,
+               sizeof(config->ws_denied_mac_addresses));
+        if (ctxt->config.ws_allowed_mac_address_count || ctxt->config.ws_denied_mac_address_count)
+            ws_enable_mac_filtering(ctxt);
+        else
+            rcp_set_filter_src64(&ctxt->rcp, NULL, 0, false);
+    }
 
+    if (config->pan_size != ctxt->config.pan_size) {
+        INFO("  pan_size: %d -> %d", ctxt->config.pan_size, config->pan_size);
+        ctxt->config.pan_size = config->pan_size;
+        ctxt->net_if.ws_info.pan_information.test_pan_size = ctxt->config.pan_size;
+    }
+
+    if (config->pan_load_threshold != ctxt->config.pan_load_threshold) {
+        INFO("  pan_load_threshold: %d -> %d", ctxt->config.pan_load_threshold, config->pan_load_threshold);
+        ctxt->config.pan_load_threshold = config->pan_load_threshold;
+    }
+
+    // Read by the authenticator on each RADIUS message
+    if (strcmp(config->auth_cfg.radius_secret, ctxt->config.auth_cfg.radius_secret)) {
+        INFO("  radius_secret");
+        memcpy(ctxt->config.auth_cfg.radius_secret, config->auth_cfg.radius_secret,
+               sizeof(ctxt->config.auth_cfg.radius_secret));
+#ifdef HAVE_AUTH_LEGACY
+        ws_pae_controller_radius_shared_secret_set(ctxt->net_if.id, strlen(ctxt->config.auth_cfg.radius_secret),
+                                                   (uint8_t *)ctxt->config.auth_cfg.radius_secret);
+#endif
+    }
+    if (memcmp(config->auth_cfg.radius_addr, ctxt->config.auth_cfg.radius_addr,
+               sizeof(config->auth_cfg.radius_addr)))
+        WARN("radius_server changes require a restart");
+
+    free(config->auth_cfg.key.iov_base);
+    free(config->auth_cfg.cert.iov_base);
+    free(config->auth_cfg.ca_cert.iov_base);
+    free(config);
+}
+
+// Called from the main loop once SIGINT or SIGTERM is received, so the state
+// is consistent and nothing is restricted to async-signal-safe functions.
+static void wsbr_shutdown(struct wsbr_ctxt *ctxt)
+{
     if (ctxt->config.rcp_cfg.uart_dev[0])
         uart_tx_flush(&ctxt->rcp.bus);
-    exit(0);
+    if (ctxt->config.pcap_file[0])
+        wsbr_pcapng_flush(ctxt, true);
+    rpl_storage_flush(&ctxt->net_if.rpl_root);
+    dhcp_lease_flush(&ctxt->dhcp_server);
+    if (ctxt->config.neighbor_snapshot_max_age_ms)
+        ws_neigh_snapshot_store(&ctxt->net_if);
+    // After all the writes above
+    storage_commit_flush();
+    storage_snapshot();
 }
 
 void sig_error_handler(int signal)
@@ -448,103 +653,222 @@ void sig_error_handler(int signal)
     raise(signal);
 }
 
-static void wsbr_fds_init(struct wsbr_ctxt *ctxt)
+// Sockets reading a single datagram per call get a budget, so a flood of
+// requests is processed in one iteration without starving the RCP.
+#define WSBR_SOCKET_BUDGET 8
+// Maximum number of tasklet events dispatched per iteration
+#define WSBR_EVENT_BUDGET 32
+
+static void wsbr_dbus_recv(struct event_source *src, uint32_t revents)
 {
-    ctxt->fds[POLLFD_DBUS].fd = dbus_get_fd();
-    ctxt->fds[POLLFD_DBUS].events = POLLIN;
-    ctxt->fds[POLLFD_RCP].fd = ctxt->rcp.bus.fd;
-    ctxt->fds[POLLFD_RCP].events = POLLIN;
-    ctxt->fds[POLLFD_TUN].fd = ctxt->tun.fd;
-    ctxt->fds[POLLFD_TUN].events = 0;
-    ctxt->fds[POLLFD_EVENT].fd = ctxt->scheduler.event_fd[0];
-    ctxt->fds[POLLFD_EVENT].events = POLLIN;
-    ctxt->fds[POLLFD_TIMER].fd = timer_fd();
-    ctxt->fds[POLLFD_TIMER].events = POLLIN;
-    ctxt->fds[POLLFD_DHCP].fd = IN6_IS_ADDR_UNSPECIFIED(&ctxt->config.dhcp_server.sin6_addr) ?
-                                ctxt->dhcp_server.fd : ctxt->dhcp_relay.fd;
-    ctxt->fds[POLLFD_DHCP].events = POLLIN;
-    ctxt->fds[POLLFD_RPL].fd = ctxt->net_if.rpl_root.sockfd;
-    ctxt->fds[POLLFD_RPL].events = POLLIN;
-    ctxt->fds[POLLFD_BR_EAPOL_RELAY].fd = ws_eapol_relay_get_socket_fd();
-    ctxt->fds[POLLFD_BR_EAPOL_RELAY].events = POLLIN;
-    ctxt->fds[POLLFD_EAPOL_RELAY].fd = ws_auth_fd_eapol_relay(&ctxt->net_if);
-    ctxt->fds[POLLFD_EAPOL_RELAY].events = POLLIN;
-    ctxt->fds[POLLFD_PAE_AUTH].fd = kmp_socket_if_get_pae_socket_fd();
-    ctxt->fds[POLLFD_PAE_AUTH].events = POLLIN;
-    ctxt->fds[POLLFD_RADIUS].fd = ws_auth_fd_radius(&ctxt->net_if);
-    ctxt->fds[POLLFD_RADIUS].events = POLLIN;
+    dbus_process();
 }
 
-static void wsbr_poll(struct wsbr_ctxt *ctxt)
+static void wsbr_rcp_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_rcp);
+
+    rcp_rx(&ctxt->rcp);
+    if (ws_neigh_snapshot_pending() && ctxt->rcp.clock_offset_valid)
+        ws_neigh_snapshot_apply(&ctxt->net_if);
+}
+
+static void wsbr_tun_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_tun);
+
+    wsbr_tun_read(ctxt);
+}
+
+static void wsbr_event_recv(struct event_source *src, uint32_t revents)
 {
     uint64_t val;
-    int ret;
 
-    if (lowpan_adaptation_queue_size(ctxt->net_if.id) > 2)
-        ctxt->fds[POLLFD_TUN].events = 0;
-    else
-        ctxt->fds[POLLFD_TUN].events = POLLIN;
+    read(src->fd, &val, sizeof(val));
+    // Remaining events are processed during the next iteration, after the
+    // RCP had a chance to be serviced.
+    src->pending = event_scheduler_run(WSBR_EVENT_BUDGET);
+}
 
-    if (ctxt->rcp.bus.uart.data_ready)
-        ret = poll(ctxt->fds, POLLFD_COUNT, 0);
+static void wsbr_timer_recv(struct event_source *src, uint32_t revents)
+{
+    timer_process();
+}
+
+static void wsbr_dhcp_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_dhcp);
+
+    if (IN6_IS_ADDR_UNSPECIFIED(&ctxt->config.dhcp_server[0].sin6_addr))
+        dhcp_recv(&ctxt->dhcp_server);
     else
-        ret = poll(ctxt->fds, POLLFD_COUNT, -1);
-    FATAL_ON(ret < 0, 2, "poll: %m");
-
-    if (ctxt->fds[POLLFD_DBUS].revents & POLLIN)
-        dbus_process();
-    if (ctxt->fds[POLLFD_DHCP].revents & POLLIN) {
-        if (IN6_IS_ADDR_UNSPECIFIED(&ctxt->config.dhcp_server.sin6_addr))
-            dhcp_recv(&ctxt->dhcp_server);
-        else
-            dhcp_relay_recv(&ctxt->dhcp_relay);
-    }
-    if (ctxt->fds[POLLFD_RPL].revents & POLLIN)
-        rpl_recv(&ctxt->net_if.rpl_root);
-    if (ctxt->fds[POLLFD_BR_EAPOL_RELAY].revents & POLLIN)
-        ws_eapol_relay_socket_cb(ctxt->fds[POLLFD_BR_EAPOL_RELAY].fd);
-    if (ctxt->fds[POLLFD_EAPOL_RELAY].revents & POLLIN)
-        ws_auth_recv_eapol_relay(&ctxt->net_if);
-    if (ctxt->fds[POLLFD_PAE_AUTH].revents & POLLIN)
-        kmp_socket_if_pae_socket_cb(ctxt->fds[POLLFD_PAE_AUTH].fd);
-    if (ctxt->fds[POLLFD_RADIUS].revents & POLLIN)
-        ws_auth_recv_radius(&ctxt->net_if);
-    if (ctxt->fds[POLLFD_TUN].revents & POLLIN)
-        wsbr_tun_read(ctxt);
-    if (ctxt->fds[POLLFD_EVENT].revents & POLLIN) {
-        read(ctxt->scheduler.event_fd[0], &val, sizeof(val));
-        WARN_ON(val != 'W');
-        event_scheduler_run_until_idle();
-    }
-    if (ctxt->fds[POLLFD_RCP].revents & POLLIN ||
-        ctxt->fds[POLLFD_RCP].revents & POLLERR ||
-        ctxt->rcp.bus.uart.data_ready)
-        rcp_rx(&ctxt->rcp);
-    if (ctxt->fds[POLLFD_TIMER].revents & POLLIN)
-        timer_process();
-    if (ctxt->fds[POLLFD_PCAP].revents & POLLERR)
-        wsbr_pcapng_closed(ctxt);
+        dhcp_relay_recv(&ctxt->dhcp_relay);
+}
+
+static void wsbr_rpl_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_rpl);
+
+    rpl_recv(&ctxt->net_if.rpl_root);
+}
+
+static void wsbr_br_eapol_relay_recv(struct event_source *src, uint32_t revents)
+{
+    ws_eapol_relay_socket_cb(src->fd);
+}
+
+static void wsbr_eapol_relay_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_eapol_relay);
+
+    ws_auth_recv_eapol_relay(&ctxt->net_if);
+}
+
+static void wsbr_pae_auth_recv(struct event_source *src, uint32_t revents)
+{
+    kmp_socket_if_pae_socket_cb(src->fd);
+}
+
+static void wsbr_radius_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_radius);
+
+    ws_auth_recv_radius(&ctxt->net_if);
+}
+
+static void wsbr_netlink_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_netlink);
+
+    wsbr_tun_nl_recv(ctxt);
+}
+
+static void wsbr_metrics_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_metrics);
+
+    wsbr_metrics_accept(ctxt);
+}
+
+static void wsbr_events_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_events);
+
+    wsbr_events_accept(ctxt);
+}
+
+static void wsbr_pktshm_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_pktshm);
+
+    wsbr_pktshm_accept(ctxt);
+}
+
+static void wsbr_pan_load_ev_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsbr_ctxt *ctxt = container_of(src, struct wsbr_ctxt, ev_pan_load);
+
+    wsbr_pan_load_recv(ctxt);
+}
+
+static void wsbr_signal_recv(struct event_source *src, uint32_t revents)
+{
+    struct signalfd_siginfo info;
+    ssize_t ret;
+
+    ret = read(src->fd, &info, sizeof(info));
+    FATAL_ON(ret != sizeof(info), 2, "%s: read: %m", __func__);
+    if (info.ssi_signo == SIGUSR1)
+        cpu_usage_dump();
+    if (info.ssi_signo == SIGHUP)
+        wsbr_config_reload(container_of(src, struct wsbr_ctxt, ev_signal));
+    if (info.ssi_signo == SIGINT || info.ssi_signo == SIGTERM)
+        container_of(src, struct wsbr_ctxt, ev_signal)->exit_requested = true;
+}
+
+static void wsbr_event_source_add(struct event_source *src, int fd, unsigned int budget,
+                                  void (*callback)(struct event_source *src, uint32_t revents))
+{
+    src->fd       = fd;
+    src->events   = EPOLLIN;
+    src->budget   = budget;
+    src->callback = callback;
+    event_loop_add(src);
+}
+
+static void wsbr_fds_init(struct wsbr_ctxt *ctxt)
+{
+    wsbr_event_source_add(&ctxt->ev_dbus, dbus_get_fd(), 0, wsbr_dbus_recv);
+    // RX indications and TX confirmations are processed first
+    ctxt->ev_rcp.priority = true;
+    wsbr_event_source_add(&ctxt->ev_rcp, ctxt->rcp.bus.fd, 0, wsbr_rcp_recv);
+    // wsbr_tun_read() has its own budget
+    wsbr_event_source_add(&ctxt->ev_tun, ctxt->tun.fd, 0, wsbr_tun_recv);
+    wsbr_event_source_add(&ctxt->ev_event, ctxt->scheduler.event_fd, 0, wsbr_event_recv);
+    wsbr_event_source_add(&ctxt->ev_timer, timer_fd(), 0, wsbr_timer_recv);
+    wsbr_event_source_add(&ctxt->ev_dhcp,
+                          IN6_IS_ADDR_UNSPECIFIED(&ctxt->config.dhcp_server[0].sin6_addr) ?
+                          ctxt->dhcp_server.fd : ctxt->dhcp_relay.fd,
+                          WSBR_SOCKET_BUDGET, wsbr_dhcp_recv);
+    wsbr_event_source_add(&ctxt->ev_rpl, ctxt->net_if.rpl_root.sockfd,
+                          WSBR_SOCKET_BUDGET, wsbr_rpl_recv);
+    wsbr_event_source_add(&ctxt->ev_br_eapol_relay, ws_eapol_relay_get_socket_fd(),
+                          WSBR_SOCKET_BUDGET, wsbr_br_eapol_relay_recv);
+    wsbr_event_source_add(&ctxt->ev_eapol_relay, ws_auth_fd_eapol_relay(&ctxt->net_if),
+                          WSBR_SOCKET_BUDGET, wsbr_eapol_relay_recv);
+    wsbr_event_source_add(&ctxt->ev_pae_auth, kmp_socket_if_get_pae_socket_fd(),
+                          WSBR_SOCKET_BUDGET, wsbr_pae_auth_recv);
+    wsbr_event_source_add(&ctxt->ev_radius, ws_auth_fd_radius(&ctxt->net_if),
+                          WSBR_SOCKET_BUDGET, wsbr_radius_recv);
+    wsbr_event_source_add(&ctxt->ev_netlink, wsbr_tun_nl_fd(ctxt), 0, wsbr_netlink_recv);
+    wsbr_event_source_add(&ctxt->ev_metrics, ctxt->metrics_fd, 0, wsbr_metrics_recv);
+    wsbr_event_source_add(&ctxt->ev_events, ctxt->events.fd, 0, wsbr_events_recv);
+    wsbr_event_source_add(&ctxt->ev_pktshm, ctxt->pktshm.fd, 0, wsbr_pktshm_recv);
+    wsbr_event_source_add(&ctxt->ev_pan_load, ctxt->pan_load.fd,
+                          WSBR_SOCKET_BUDGET, wsbr_pan_load_ev_recv);
+    wsbr_event_source_add(&ctxt->ev_signal, ctxt->signal_fd, 0, wsbr_signal_recv);
+}
+
+static void wsbr_poll(struct wsbr_ctxt *ctxt)
+{
+    event_loop_mod(&ctxt->ev_tun, wsbr_tun_stalled(ctxt) ? 0 : EPOLLIN);
+    // The eventfd of the client is not signaled again for packets already in
+    // the ring
+    ctxt->pktshm.ev_rx.pending = !wsbr_tun_stalled(ctxt) && wsbr_pktshm_rx_pending(ctxt);
+
+    // Send the HIF commands and netlink requests produced during the previous
+    // iteration
+    uart_tx_commit(&ctxt->rcp.bus);
+    wsbr_tun_nl_commit(ctxt);
+    if (ctxt->config.pcap_file[0])
+        wsbr_pcapng_flush(ctxt, false);
+    wsbr_events_flush(ctxt);
+    ctxt->ev_rcp.pending = ctxt->rcp.bus.uart.data_ready;
+    event_loop_run();
+    histogram_add(&g_metrics.loop_latency_us, time_now_us(CLOCK_MONOTONIC) - event_loop_wakeup_us());
 }
 
 int wsbr_main(int argc, char *argv[])
 {
     struct sigaction sigact = { };
+    sigset_t sigmask;
     static const char *files[] = {
         "neighbor-*:*:*:*:*:*:*:*",
         "keys-*:*:*:*:*:*:*:*",
+        "tls-*:*:*:*:*:*:*:*",
         "network-keys",
         "br-info",
         "rpl-*",
+        "dhcp-leases",
+        "ws-neigh-snapshot",
         NULL,
     };
     struct wsbr_ctxt *ctxt = &g_ctxt;
+    char dbus_name[128];
+    int ret;
 
     INFO("Silicon Labs Wi-SUN border router %s", version_daemon_str);
     sigact.sa_flags = SA_RESETHAND;
-    sigact.sa_handler = kill_handler;
-    sigaction(SIGINT, &sigact, NULL);
-    sigaction(SIGHUP, &sigact, NULL);
-    sigaction(SIGTERM, &sigact, NULL);
     sigact.sa_handler = sig_error_handler;
     sigaction(SIGILL, &sigact, NULL);
     sigaction(SIGSEGV, &sigact, NULL);
@@ -553,39 +877,102 @@ int wsbr_main(int argc, char *argv[])
     sigaction(SIGQUIT, &sigact, NULL);
     sigact.sa_handler = SIG_IGN;
     sigaction(SIGPIPE, &sigact, NULL); // Handle writing to unread FIFO for pcapng capture
+    ctxt->argc = argc;
+    ctxt->argv = argv;
     parse_commandline(&ctxt->config, argc, argv, print_help_br);
+    if (ctxt->config.cpu_accounting != WSBR_CPU_ACCOUNTING_NONE)
+        cpu_usage_enable(ctxt->config.cpu_accounting == WSBR_CPU_ACCOUNTING_HEAP);
+    // These signals are blocked before any thread is created, so they are
+    // only received through the signalfd, and processed by the main loop.
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGUSR1);
+    sigaddset(&sigmask, SIGHUP);
+    sigaddset(&sigmask, SIGINT);
+    sigaddset(&sigmask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &sigmask, NULL);
+    ctxt->signal_fd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+    FATAL_ON(ctxt->signal_fd < 0, 2, "signalfd: %m");
     if (ctxt->config.color_output != -1)
         g_enable_color_traces = ctxt->config.color_output;
+    if (ctxt->config.log_journal) {
+        ret = log_journal_open();
+        FATAL_ON(ret < 0, 2, "log_journal: %s", strerror(-ret));
+    }
+    if (ctxt->config.trace_ring[0])
+        trace_ring_open(ctxt->config.trace_ring, ctxt->config.trace_ring_size * 1024);
     check_mbedtls_features();
+    ret = nist_kw_backend_set(ctxt->config.crypto_backend);
+    FATAL_ON(ret < 0, 1, "crypto_backend: %s", strerror(-ret));
     event_scheduler_init(&ctxt->scheduler);
     g_storage_prefix = ctxt->config.storage_prefix;
+    storage_commit_window(ctxt->config.storage_commit_window_ms);
+    if (ctxt->config.storage_tables) {
+        storage_table_add("neighbor-");
+        storage_table_add("keys-");
+        storage_table_add("tls-");
+        storage_table_add("rpl-");
+    }
+    g_ws_pae_key_storage_binary = ctxt->config.storage_keys_binary;
+    if (ctxt->config.storage_snapshot_prefix[0])
+        storage_snapshot_init(ctxt->config.storage_snapshot_prefix, ctxt->config.storage_snapshot_interval_ms);
     if (ctxt->config.storage_delete) {
         INFO("deleting storage");
         storage_delete(files);
+        // Do not restore the deleted files after a reboot
+        storage_snapshot();
     }
     if (ctxt->config.storage_exit)
         exit(0);
     if (ctxt->config.pcap_file[0])
         wsbr_pcapng_init(ctxt);
+    if (ctxt->config.metrics_socket[0])
+        wsbr_metrics_init(ctxt);
+    if (ctxt->config.events_socket[0])
+        wsbr_events_init(ctxt);
+    if (ctxt->config.packet_socket[0])
+        wsbr_pktshm_init(ctxt);
+    if (ctxt->config.lowpan_workers)
+        lowpan_down_workers_init(ctxt->config.lowpan_workers);
+    if (ctxt->config.tun_workers)
+        wsbr_tun_workers_init(ctxt, ctxt->config.tun_workers);
+    wsbr_mem_init(ctxt);
+    if (ctxt->config.pan_load_peers[0].sin6_family != AF_UNSPEC)
+        wsbr_pan_load_init(ctxt);
+    if (ctxt->config.admission_control)
+        wsbr_admission_init(ctxt);
     if (ctxt->config.capture[0])
         capture_start(ctxt->config.capture);
+    // The first checkpoint holds the initial storage
+    if (ctxt->config.capture[0] && ctxt->config.capture_checkpoint_s)
+        capture_checkpoint(ctxt->config.storage_prefix);
 
     rcp_init(&ctxt->rcp, &ctxt->config.rcp_cfg);
     if (ctxt->config.list_rf_configs) {
         rail_print_config_list(&ctxt->rcp);
         exit(0);
     }
+    // The RCP is not waited for past this point, so commands can be grouped.
+    // Staged commands are sent by wsbr_poll().
+    if (ctxt->config.rcp_cfg.uart_dev[0])
+        ctxt->rcp.bus.uart.tx_coalesce = true;
     // NOTE: destination address filtering is enabled by default with the
     // native EUI-64.
     if (memcmp(ctxt->config.ws_mac_address, &ieee802154_addr_bc, 8))
         rcp_set_filter_dst64(&ctxt->rcp, ctxt->config.ws_mac_address);
 
     wsbr_tun_init(ctxt);
-    ctxt->timer_legacy.period_ms = WS_TIMER_GLOBAL_PERIOD_MS;
-    ctxt->timer_legacy.callback  = ws_timer_cb;
-    timer_start_rel(NULL, &ctxt->timer_legacy, WS_TIMER_GLOBAL_PERIOD_MS);
+    if (ctxt->config.capture[0] && ctxt->config.capture_checkpoint_s) {
+        ctxt->timer_capture.period_ms = ctxt->config.capture_checkpoint_s * 1000;
+        ctxt->timer_capture.callback  = wsbr_capture_checkpoint;
+        timer_start_rel(NULL, &ctxt->timer_capture, ctxt->timer_capture.period_ms);
+    }
     wsbr_network_init(ctxt);
-    dbus_register("com.silabs.Wisun.BorderRouter",
+    if (ctxt->config.instance[0])
+        snprintf(dbus_name, sizeof(dbus_name), "com.silabs.Wisun.BorderRouter.%s", ctxt->config.instance);
+    else
+        snprintf(dbus_name, sizeof(dbus_name), "com.silabs.Wisun.BorderRouter");
+    dbus_change_window(ctxt->config.dbus_change_window_ms);
+    dbus_register(dbus_name,
                   "/com/silabs/Wisun/BorderRouter",
                   "com.silabs.Wisun.BorderRouter",
                   wsbrd_dbus_vtable, ctxt);
@@ -593,15 +980,21 @@ int wsbr_main(int argc, char *argv[])
         drop_privileges(ctxt->config.user, ctxt->config.group, ctxt->config.neighbor_proxy[0]);
     // FIXME: This call should be made in wsbr_configure_ws() but we cannot do
     // so because of privileges
-    ws_pan_info_storage_write(ctxt->net_if.ws_info.fhss_config.bsi, ctxt->net_if.ws_info.pan_information.pan_id,
-                              ctxt->net_if.ws_info.pan_information.pan_version,
-                              ctxt->net_if.ws_info.pan_information.lfn_version, ctxt->net_if.ws_info.network_name);
+    ws_mngt_version_reserve(&ctxt->net_if.ws_info);
     ws_auth_init(&ctxt->net_if, &ctxt->config, ctxt->tun.ifname);
     ws_bootstrap_6lbr_init(&ctxt->net_if);
+    if (ctxt->config.chan_excl_threshold)
+        wsbr_chan_excl_init(ctxt);
+    if (ctxt->config.bc_interval_min)
+        wsbr_bc_adapt_init(ctxt);
+    if (ctxt->config.neighbor_snapshot_max_age_ms)
+        ws_neigh_snapshot_load(&ctxt->net_if, ctxt->config.neighbor_snapshot_max_age_ms);
     wsbr_fds_init(ctxt);
 
     INFO("Wi-SUN Border Router is ready");
 
-    while (true)
+    while (!ctxt->exit_requested)
         wsbr_poll(ctxt);
+    wsbr_shutdown(ctxt);
+    return 0;
 }
@@ -17,7 +17,6 @@
 #include <sys/types.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <poll.h>
 #ifdef HAVE_LIBSYSTEMD
 #  include <systemd/sd-bus.h>
 #else
@@ -27,36 +26,48 @@ typedef struct sd_bus sd_bus;
 #include "common/authenticator/authenticator.h"
 #include "common/dhcp_relay.h"
 #include "common/dhcp_server.h"
+#include "common/event_loop.h"
 #include "common/events_scheduler.h"
+#include "common/iobuf.h"
 #include "common/rcp_api.h"
 #include "common/timer.h"
 #include "common/tun.h"
 #include "net/protocol.h"
 
 #include "commandline.h"
+#include "wsbr_bc_adapt.h"
+#include "wsbr_chan_excl.h"
+#include "wsbr_admission.h"
+#include "wsbr_campaign.h"
+#include "wsbr_events.h"
+#include "wsbr_mem.h"
+#include "wsbr_pan_load.h"
+#include "wsbr_pktshm.h"
+#include "tun.h"
 
 struct iobuf_read;
 
-enum {
-    POLLFD_TUN,
-    POLLFD_RCP,
-    POLLFD_DBUS,
-    POLLFD_EVENT,
-    POLLFD_TIMER,
-    POLLFD_DHCP,
-    POLLFD_RPL,
-    POLLFD_BR_EAPOL_RELAY, // HAVE_AUTH_LEGACY only
-    POLLFD_EAPOL_RELAY,
-    POLLFD_PAE_AUTH,       // HAVE_AUTH_LEGACY only
-    POLLFD_RADIUS,
-    POLLFD_PCAP,
-    POLLFD_COUNT,
-};
-
 struct wsbr_ctxt {
-    struct pollfd fds[POLLFD_COUNT];
+    struct event_source ev_tun;
+    struct event_source ev_rcp;
+    struct event_source ev_dbus;
+    struct event_source ev_event;
+    struct event_source ev_timer;
+    struct event_source ev_dhcp;
+    struct event_source ev_rpl;
+    struct event_source ev_br_eapol_relay; // HAVE_AUTH_LEGACY only
+    struct event_source ev_eapol_relay;
+    struct event_source ev_pae_auth;       // HAVE_AUTH_LEGACY only
+    struct event_source ev_radius;
+    struct event_source ev_pcap;
+    struct event_source ev_netlink;
+    struct event_source ev_metrics;
+    struct event_source ev_events;
+    struct event_source ev_pktshm;
+    struct event_source ev_pan_load;
+    struct event_source ev_signal;
     struct events_scheduler scheduler;
-    struct timer_entry timer_legacy;
+    struct timer_entry timer_capture;
     struct wsbrd_conf config;
     struct dhcp_relay dhcp_relay;
     struct dhcp_server dhcp_server;
@@ -73,10 +84,39 @@ struct wsbr_ctxt {
     int pcapng_fd;
     mode_t pcapng_type;
     uint64_t pcapng_t0_us;
+    struct iobuf_write pcapng_queue;
+    size_t pcapng_queue_offset;
+    size_t pcapng_file_size;
+    uint64_t pcapng_file_start_ms;
+    unsigned int pcapng_drop_count;
+    uint8_t (*pcapng_filter_mac64)[8];
+    int pcapng_filter_mac64_count;
+    unsigned int pcapng_filter_frames;
+
+    int metrics_fd;
+    int signal_fd; // SIGUSR1, SIGHUP, SIGINT and SIGTERM
+    bool exit_requested;
+    // Kept for wsbr_config_reload()
+    int argc;
+    char **argv;
+
+    struct wsbr_pan_load pan_load;
+    struct wsbr_campaign campaign;
+    struct wsbr_admission admission;
+    struct wsbr_events events;
+    struct wsbr_pktshm pktshm;
+    struct wsbr_tun_workers tun_workers;
+    struct wsbr_mem mem;
+    struct wsbr_chan_excl chan_excl;
+    struct wsbr_bc_adapt bc_adapt;
 };
 
 // This global variable is necessary for various API of nanostack. Beside this
 // case, please never use it.
 extern struct wsbr_ctxt g_ctxt;
 
+// Re-read the configuration and apply the parameters which can be changed at
+// runtime (see examples/wsbrd.conf).
+void wsbr_config_reload(struct wsbr_ctxt *ctxt);
+
 #endif
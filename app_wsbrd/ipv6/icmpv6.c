@@ -20,7 +20,10 @@
 #include <inttypes.h>
 #include "common/ipv6/ipv6_cksum.h"
 #include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/string_extra.h"
+#include "common/time_extra.h"
 #include "common/rand.h"
 #include "common/bits.h"
 #include "common/named_values.h"
@@ -46,6 +49,100 @@
 
 #define TRACE_GROUP "icmp"
 
+struct icmpv6_bucket {
+    uint64_t last_ms;
+    uint32_t tokens; // In thousandths of message
+};
+
+static struct {
+    struct icmpv6_ratelimit_cfg cfg;
+    struct icmpv6_bucket global;
+    struct icmpv6_bucket types[4];
+    struct {
+        uint8_t addr[16];
+        struct icmpv6_bucket bucket;
+    } dsts[ICMPV6_RATELIMIT_DST_SLOTS];
+    struct icmpv6_stats stats;
+} g_icmpv6 = {
+    // RFC 4443 2.4(f) example
+    .cfg.rate = 10,
+};
+
+void icmpv6_ratelimit_init(const struct icmpv6_ratelimit_cfg *cfg)
+{
+    memset(&g_icmpv6, 0, sizeof(g_icmpv6));
+    g_icmpv6.cfg = *cfg;
+}
+
+const struct icmpv6_stats *icmpv6_stats(void)
+{
+    return &g_icmpv6.stats;
+}
+
+// Refill the bucket and tell whether a message can be sent.
+static bool icmpv6_bucket_ready(struct icmpv6_bucket *bucket, unsigned int rate, uint64_t now_ms)
+{
+    uint64_t tokens;
+
+    if (!rate)
+        return true;
+    if (bucket->last_ms)
+        tokens = bucket->tokens + (now_ms - bucket->last_ms) * rate;
+    else
+        tokens = (uint64_t)rate * 1000;
+    bucket->tokens = MIN(tokens, (uint64_t)rate * 1000);
+    bucket->last_ms = now_ms;
+    return bucket->tokens >= 1000;
+}
+
+static void icmpv6_bucket_take(struct icmpv6_bucket *bucket, unsigned int rate)
+{
+    if (rate)
+        bucket->tokens -= 1000;
+}
+
+static bool icmpv6_ratelimit(uint8_t type, const uint8_t dst[16])
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    const struct icmpv6_ratelimit_cfg *cfg = &g_icmpv6.cfg;
+    struct icmpv6_bucket *type_bucket, *dst_bucket;
+    uint32_t hash = 2166136261;
+    int i;
+
+    BUG_ON(type < 1 || type > ARRAY_SIZE(g_icmpv6.types));
+    type_bucket = &g_icmpv6.types[type - 1];
+    // FNV-1a
+    for (int j = 0; j < 16; j++)
+        hash = (hash ^ dst[j]) * 16777619;
+    i = hash % ARRAY_SIZE(g_icmpv6.dsts);
+    if (memcmp(g_icmpv6.dsts[i].addr, dst, 16)) {
+        // The previous destination of this slot is forgotten
+        memcpy(g_icmpv6.dsts[i].addr, dst, 16);
+        memset(&g_icmpv6.dsts[i].bucket, 0, sizeof(g_icmpv6.dsts[i].bucket));
+    }
+    dst_bucket = &g_icmpv6.dsts[i].bucket;
+
+    // Tokens are only taken once every limit passes, so that a destination
+    // flooding the border router does not use the budget of the others.
+    if (!icmpv6_bucket_ready(dst_bucket, cfg->dst_rate, now_ms)) {
+        g_icmpv6.stats.ratelimit_drops[ICMPV6_RATELIMIT_DROP_DST]++;
+        return false;
+    }
+    if (!icmpv6_bucket_ready(type_bucket, cfg->type_rate, now_ms)) {
+        g_icmpv6.stats.ratelimit_drops[ICMPV6_RATELIMIT_DROP_TYPE]++;
+        return false;
+    }
+    if (!icmpv6_bucket_ready(&g_icmpv6.global, cfg->rate, now_ms)) {
+        g_icmpv6.stats.ratelimit_drops[ICMPV6_RATELIMIT_DROP_GLOBAL]++;
+        return false;
+    }
+    icmpv6_bucket_take(dst_bucket, cfg->dst_rate);
+    icmpv6_bucket_take(type_bucket, cfg->type_rate);
+    icmpv6_bucket_take(&g_icmpv6.global, cfg->rate);
+    g_icmpv6.stats.tx_errors[type - 1]++;
+    return true;
+}
+
 /* Check to see if a message is recognisable ICMPv6, and if so, fill in code/type */
 /* This used ONLY for the e.1 + e.2 tests in RFC 4443, to try to avoid ICMPv6 error loops */
 /* Packet may be ill-formed, because we are considering an ICMPv6 error response. */
@@ -163,11 +260,10 @@ buffer_t *icmpv6_error(buffer_t *buf, struct net_if *cur, uint8_t type, uint8_t
     }
     cur = buf->interface;
 
-    /* Token-bucket rate limiting */
-    if (!cur->icmp_tokens) {
+    if (!icmpv6_ratelimit(type, buf->dst_sa.address)) {
+        TRACE(TR_DROP, "drop %-9s: rate limit dst:%s", "icmpv6", tr_ipv6(buf->dst_sa.address));
         return buffer_free(buf);
     }
-    cur->icmp_tokens--;
 
     /* Include as much of the original packet as possible, without exceeding
      * minimum MTU of 1280. */
@@ -41,7 +41,37 @@ struct ipv6_nd_opt_earo {
     bool present;
 };
 
+/*
+ * RFC 4443 2.4(f): ICMPv6 errors are rate limited by token buckets, in
+ * messages per second with bursts of the same size, 0 to disable a limit: one
+ * bucket for all the errors, one per error type, and one per destination.
+ * Destinations share ICMPV6_RATELIMIT_DST_SLOTS buckets indexed by a hash of
+ * their address, so a flood from random sources cannot grow the memory used;
+ * destinations sharing a slot share their limit.
+ */
+#define ICMPV6_RATELIMIT_DST_SLOTS 64
+
+struct icmpv6_ratelimit_cfg {
+    unsigned int rate;
+    unsigned int type_rate;
+    unsigned int dst_rate;
+};
+
+enum icmpv6_ratelimit_drop {
+    ICMPV6_RATELIMIT_DROP_GLOBAL,
+    ICMPV6_RATELIMIT_DROP_TYPE,
+    ICMPV6_RATELIMIT_DROP_DST,
+    ICMPV6_RATELIMIT_DROP_COUNT,
+};
+
+struct icmpv6_stats {
+    uint64_t tx_errors[4]; // Indexed by ICMPv6 type - 1
+    uint64_t ratelimit_drops[ICMPV6_RATELIMIT_DROP_COUNT];
+};
+
 void icmpv6_init(void);
+void icmpv6_ratelimit_init(const struct icmpv6_ratelimit_cfg *cfg);
+const struct icmpv6_stats *icmpv6_stats(void);
 struct buffer *icmpv6_down(struct buffer *buf);
 struct buffer *icmpv6_up(struct buffer *buf);
 struct buffer *icmpv6_error(struct buffer *buf, struct net_if *cur, uint8_t type, uint8_t code, uint32_t aux);
@@ -122,6 +122,15 @@ buffer_routing_info_t *ipv6_buffer_route_to(buffer_t *buf, const uint8_t *next_h
         goto no_route;
     }
 
+    /* Fast path: the result of the unicast case below does not change until
+     * the routing table or the neighbour cache does.
+     */
+    bool use_cache = !next_if && !addr_is_ipv6_multicast(buf->dst_sa.address);
+    int8_t cache_if_id = interface_specific ? cur->id : -1;
+    if (use_cache && ipv6_route_cache_lookup(buf->dst_sa.address, cache_if_id, &route->route_info)) {
+        goto route_found;
+    }
+
     ipv6_destination_t *dest_entry = ipv6_destination_lookup_or_create(buf->dst_sa.address, cur ? cur->id : -1);
     if (!dest_entry) {
         tr_error("ipv6_buffer_route no destination entry %s", tr_ipv6(buf->dst_sa.address));
@@ -208,7 +217,11 @@ buffer_routing_info_t *ipv6_buffer_route_to(buffer_t *buf, const uint8_t *next_h
             goto no_route;
     }
     //tr_debug("%s->last_neighbour := %s", tr_ipv6(dest_entry->destination), tr_ipv6(route->route_info.next_hop_addr));
+    if (use_cache) {
+        ipv6_route_cache_store(buf->dst_sa.address, cache_if_id, &route->route_info);
+    }
 
+route_found:
     if (!cur || route->route_info.interface_id != cur->id) {
         struct net_if *new_if = protocol_stack_interface_info_get_by_id(route->route_info.interface_id);
         if (!new_if) {
@@ -977,6 +990,64 @@ no_forward:
     }
 }
 
+static struct ipv6_mcast_stats ipv6_mcast_stats_data;
+
+const struct ipv6_mcast_stats *ipv6_mcast_stats(void)
+{
+    return &ipv6_mcast_stats_data;
+}
+
+/*
+ * LFNs only listen for broadcast at their LFN broadcast interval (typically
+ * minutes), while they can be reached in unicast at each of their unicast
+ * listening intervals. For a small group, sending a copy to each registrant
+ * is faster and uses less airtime than waiting for the next LFN broadcast
+ * slot, which also wakes up all the other LFNs.
+ */
+static bool ipv6_forward_multicast_to_lfn_unicast(buffer_t *buf)
+{
+    struct net_if *cur = buf->interface;
+    ipv6_neighbour_cache_t *cache = &cur->ipv6_neighbour_cache;
+    const struct ws_neigh *targets[UINT8_MAX];
+    struct ws_neigh *ws_neigh;
+    ipv6_neighbour_t *entry;
+    uint8_t next_hop[16];
+    buffer_t *clone;
+    int count = 0;
+
+    if (!cur->lfn_mcast_unicast_max)
+        return false;
+    // Membership of ff02::1 is implicit, there is no registration to count
+    if (!memcmp(buf->dst_sa.address, ADDR_LINK_LOCAL_ALL_NODES, 16))
+        return false;
+    SLIST_FOREACH(entry, ipv6_neighbour_addr_bucket(cache, buf->dst_sa.address), addr_link) {
+        if (!addr_ipv6_equal(entry->ip_address, buf->dst_sa.address))
+            continue;
+        ws_neigh = ws_neigh_get(&cur->ws_info.neighbor_storage, ipv6_neighbour_eui64(cache, entry));
+        if (!ws_neigh || ws_neigh->node_role != WS_NR_ROLE_LFN)
+            continue;
+        if (count == cur->lfn_mcast_unicast_max)
+            return false;
+        targets[count++] = ws_neigh;
+    }
+    if (!count)
+        return false;
+
+    for (int i = 0; i < count; i++) {
+        clone = buffer_clone(buf);
+        if (!clone)
+            break;
+        memcpy(next_hop, ADDR_LINK_LOCAL_PREFIX, 8);
+        ipv6_addr_conv_iid_eui64(next_hop + 8, targets[i]->mac64);
+        clone->route = ipv6_buffer_route_to(clone, next_hop, cur);
+        clone->options.lfn_multicast = false;
+        clone->info = (buffer_info_t)(B_DIR_DOWN | B_FROM_IPV6 | B_TO_IPV6_TXRX);
+        protocol_push(clone);
+    }
+    ipv6_mcast_stats_data.unicast_count++;
+    return true;
+}
+
 static void ipv6_consider_forwarding_multicast_packet_to_lfn(buffer_t *buf, bool for_us)
 {
     buffer_t *clone;
@@ -998,6 +1069,8 @@ static void ipv6_consider_forwarding_multicast_packet_to_lfn(buffer_t *buf, bool
         return;
     if (!ws_neigh_lfn_count(&buf->interface->ws_info.neighbor_storage))
         return;
+    if (ipv6_forward_multicast_to_lfn_unicast(buf))
+        return;
 
     clone = buffer_clone(buf);
     if (!clone)
@@ -1008,6 +1081,7 @@ static void ipv6_consider_forwarding_multicast_packet_to_lfn(buffer_t *buf, bool
     clone->info = (buffer_info_t)(B_DIR_DOWN | B_FROM_IPV6 | B_TO_IPV6_TXRX);
     protocol_push(clone);
     buf->options.lfn_multicast = false;
+    ipv6_mcast_stats_data.broadcast_count++;
 }
 
 static bool is_for_linux(uint8_t next_header, const uint8_t *data_ptr)
@@ -75,4 +75,14 @@ buffer_t *ipv6_forwarding_up(buffer_t *buf);
 
 void ipv6_transmit_multicast_on_interface(buffer_t *buf, struct net_if *cur);
 
+/* Choices made for the multicast packets forwarded to LFNs, see
+ * net_if.lfn_mcast_unicast_max.
+ */
+struct ipv6_mcast_stats {
+    uint64_t broadcast_count;
+    uint64_t unicast_count;     // Packets replicated, not copies sent
+};
+
+const struct ipv6_mcast_stats *ipv6_mcast_stats(void);
+
 #endif /* _IPV6_H */
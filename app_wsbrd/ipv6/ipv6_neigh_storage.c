@@ -17,7 +17,6 @@
 #include <arpa/inet.h>
 #include <fnmatch.h>
 #include <stdlib.h>
-#include <glob.h>
 
 #include "common/key_value_storage.h"
 #include "common/time_extra.h"
@@ -31,6 +30,11 @@
 #include "net/protocol.h"
 #include "app/tun.h"
 
+// Neighbour files restored per wakeup of ipv6_neigh_storage_load_timer(), so
+// that the event loop is not blocked for long after startup.
+#define IPV6_NEIGH_STORAGE_LOAD_BATCH     64
+#define IPV6_NEIGH_STORAGE_LOAD_PERIOD_MS 10
+
 static void ipv6_neigh_storage_delete(const uint8_t *eui64)
 {
     char filename[PATH_MAX];
@@ -45,6 +49,7 @@ void ipv6_neigh_storage_save(struct ipv6_neighbour_cache *cache, const uint8_t *
     char ipv6_str[INET6_ADDRSTRLEN];
     char time_str[STR_MAX_LEN_DATE];
     struct storage_parse_info *nvm;
+    struct ipv6_neighbour *cur;
     char filename[PATH_MAX];
     time_t ts;
     int i = 0;
@@ -58,7 +63,7 @@ void ipv6_neigh_storage_save(struct ipv6_neighbour_cache *cache, const uint8_t *
         return;
     }
 
-    ns_list_foreach(struct ipv6_neighbour, cur, &cache->list) {
+    SLIST_FOREACH(cur, ipv6_neighbour_eui64_bucket(cache, eui64), eui64_link) {
         if (memcmp(eui64, ipv6_neighbour_eui64(cache, cur), 8))
             continue;
         if (!cur->lifetime_s || !cur->expiration_s)
@@ -70,6 +75,7 @@ void ipv6_neigh_storage_save(struct ipv6_neighbour_cache *cache, const uint8_t *
         fprintf(nvm->file, "lifetime[%d] = %u\n", i, cur->lifetime_s);
         fprintf(nvm->file, "# %s\n", time_str);
         fprintf(nvm->file, "expiration[%d] = %lu\n", i, ts);
+        cur->storage_expiration_s = cur->expiration_s;
         i++;
     }
 
@@ -156,6 +162,7 @@ static void ipv6_neigh_storage_load_neigh(struct ipv6_neighbour_cache *cache, co
 
         ipv6_neigh->lifetime_s = ipv6_neighbors[i].lifetime_s;
         ipv6_neigh->expiration_s = ipv6_neighbors[i].expiration_s;
+        ipv6_neigh->storage_expiration_s = ipv6_neigh->expiration_s;
         // ll_address is a combination of PAN_ID and EUI-64
         ll_addr.addr_type = ADDR_802_15_4_LONG;
         write_be16(ll_addr.address, cur->ws_info.pan_information.pan_id);
@@ -163,25 +170,33 @@ static void ipv6_neigh_storage_load_neigh(struct ipv6_neighbour_cache *cache, co
         // the neighbor state is set to stale
         ipv6_neighbour_entry_update_unsolicited(cache, ipv6_neigh, ll_addr.addr_type, ll_addr.address);
         ipv6_neigh->type = IP_NEIGHBOUR_REGISTERED;
+        ipv6_neighbour_lifetime_update(cache, ipv6_neigh);
     }
 
     storage_close(nvm);
     free(ipv6_neighbors);
 }
 
-void ipv6_neigh_storage_load(struct ipv6_neighbour_cache *cache)
+static void ipv6_neigh_storage_load_timer(struct timer_group *group, struct timer_entry *timer)
 {
-    char pattern[PATH_MAX];
-    glob_t globbuf;
-    int ret;
+    struct ipv6_neighbour_cache *cache = container_of(timer, struct ipv6_neighbour_cache, storage_load_timer);
 
-    sprintf(pattern, "%s%s", g_storage_prefix, "neighbor-*");
-    ret = glob(pattern, 0, NULL, &globbuf);
-    if (ret && ret != GLOB_NOMATCH)
-        WARN("%s: glob %s returned %u", __func__, pattern, ret);
-    if (ret)
+    // Entries registered since startup are newer, and are not overwritten
+    for (int i = 0; i < IPV6_NEIGH_STORAGE_LOAD_BATCH && cache->storage_pending[cache->storage_pending_index]; i++)
+        ipv6_neigh_storage_load_neigh(cache, cache->storage_pending[cache->storage_pending_index++]);
+    if (cache->storage_pending[cache->storage_pending_index])
         return;
+    timer_stop(&cache->timer_group, &cache->storage_load_timer);
+    storage_globfree(cache->storage_pending);
+    cache->storage_pending = NULL;
+}
 
-    for (int i = 0; globbuf.gl_pathv[i]; i++)
-        ipv6_neigh_storage_load_neigh(cache, globbuf.gl_pathv[i]);
+void ipv6_neigh_storage_load(struct ipv6_neighbour_cache *cache)
+{
+    BUG_ON(cache->storage_pending);
+    cache->storage_pending = storage_glob("neighbor-*");
+    cache->storage_pending_index = 0;
+    cache->storage_load_timer.callback  = ipv6_neigh_storage_load_timer;
+    cache->storage_load_timer.period_ms = IPV6_NEIGH_STORAGE_LOAD_PERIOD_MS;
+    timer_start_rel(&cache->timer_group, &cache->storage_load_timer, 0);
 }
@@ -20,6 +20,8 @@
 struct ipv6_neighbour_cache;
 
 void ipv6_neigh_storage_save(struct ipv6_neighbour_cache *cache, const uint8_t *eui64);
+// Neighbours are restored a few at a time from a timer, so that the PAN can
+// operate meanwhile.
 void ipv6_neigh_storage_load(struct ipv6_neighbour_cache *cache);
 
 #endif /* IPV6_NEIGH_STORAGE_H */
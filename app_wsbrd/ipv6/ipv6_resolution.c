@@ -38,10 +38,6 @@
 
 #define TRACE_GROUP "ip6r"
 
-#ifndef RESOLUTION_QUEUE_LIMIT
-#define RESOLUTION_QUEUE_LIMIT 2
-#endif
-
 void ipv6_interface_resolve_send_ns(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, bool unicast, uint8_t seq)
 {
     struct net_if *cur_interface = container_of(cache, struct net_if, ipv6_neighbour_cache);
@@ -74,10 +70,10 @@ ipv6_neighbour_cache_t *ipv6_neighbour_cache_by_interface_id(int8_t interface_id
 }
 
 /* Given a buffer with IP next-hop address and outgoing interface, find the
- * neighbour entry, and if complete, write the link-layer address into the buffer
- * destination, and return the Neighbour Cache entry.
- * If we have an incomplete Neighbour Cache entry, start address resolution
- * and queue the buffer, returning NULL.
+ * neighbour entry, write the link-layer address into the buffer destination,
+ * and return the Neighbour Cache entry.
+ * If the link-layer address is unknown, the buffer is dropped and NULL is
+ * returned.
  */
 ipv6_neighbour_t *ipv6_interface_resolve_new(struct net_if *cur, buffer_t *buf)
 {
@@ -94,14 +90,16 @@ ipv6_neighbour_t *ipv6_interface_resolve_new(struct net_if *cur, buffer_t *buf)
         return NULL;
     }
 
-    if (!ipv6_map_ip_to_ll(cur, NULL, route->route_info.next_hop_addr, &ll_type, &ll_addr) ||
+    // The mapping is deterministic (registration or EUI-64 based IID), so
+    // nothing is ever queued waiting for an address resolution.
+    n = ipv6_neighbour_lookup(&cur->ipv6_neighbour_cache, route->route_info.next_hop_addr);
+    if (!ipv6_map_ip_to_ll(cur, n, route->route_info.next_hop_addr, &ll_type, &ll_addr) ||
         ll_type != ADDR_802_15_4_LONG) {
         TRACE(TR_TX_ABORT, "tx-abort: unable to map ip to link layer address");
         buffer_free(buf);
         return NULL;
     }
 
-    n = ipv6_neighbour_lookup(&cur->ipv6_neighbour_cache, route->route_info.next_hop_addr);
     if (!n)
         n = ipv6_neighbour_create(&cur->ipv6_neighbour_cache,
                                   route->route_info.next_hop_addr, ll_addr + PAN_ID_LEN);
@@ -40,6 +40,8 @@
 #include <netinet/in.h>
 #include "common/rand.h"
 #include "common/bits.h"
+#include "common/fnv_hash.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
 #include "common/log_legacy.h"
 #include "common/string_extra.h"
@@ -63,7 +65,11 @@
 #define NCACHE_MAX_LONG_TERM    8   /* Target for basic GC - expire old entries if more than this */
 #define NCACHE_MAX_SHORT_TERM   32  /* Expire stale entries if more than this */
 #define NCACHE_MAX_ABSOLUTE     64  /* Never have more than this */
-#define NCACHE_GC_AGE           600 /* 10 minutes (1s units - decremented every slow timer call) */
+#define NCACHE_GC_AGE           600 /* 10 minutes (1s units) */
+
+/* Lifetimes are in seconds, NUD timers in 100s of ms */
+#define NCACHE_LIFETIME_SLACK_MS 1000
+#define NCACHE_NUD_SLACK_MS      100
 
 /* Destination Cache garbage collection parameters (system-wide) */
 #define DCACHE_MAX_LONG_TERM    16
@@ -79,12 +85,48 @@
 static NS_LIST_DEFINE(ipv6_destination_cache, ipv6_destination_t, link);
 static NS_LIST_DEFINE(ipv6_routing_table, ipv6_route_t, link);
 
+/*
+ * Routes are also indexed in a path-compressed binary trie (Patricia trie)
+ * keyed on prefix, so that longest prefix match does not need to walk the
+ * whole routing table. Each node holds the list of routes with exactly its
+ * prefix (different next hops, sources or interfaces). Nodes without routes
+ * only exist to branch, and thus always have 2 children.
+ */
+struct ipv6_route_node {
+    uint8_t prefix[16];
+    uint8_t prefix_len;
+    struct ipv6_route_node *parent;
+    struct ipv6_route_node *child[2];
+    NS_LIST_HEAD(ipv6_route_t, node_link) routes;
+};
+
+static struct ipv6_route_node *ipv6_route_trie;
+
+/* Direct-mapped, indexed by a hash of the destination */
+#define IPV6_ROUTE_CACHE_SIZE 64
+
+struct ipv6_route_cache_entry {
+    uint8_t dest[16];
+    int8_t interface_id;
+    uint64_t generation;        // 0 if unused
+    ipv6_route_info_t info;
+    uint32_t hit_count;
+    uint32_t miss_count;
+};
+
+static struct ipv6_route_cache_entry ipv6_route_cache[IPV6_ROUTE_CACHE_SIZE];
+static struct ipv6_route_cache_stats ipv6_route_cache_stats_data;
+static uint64_t ipv6_route_cache_gen = 1;
+
 static void ipv6_destination_cache_forget_neighbour(const ipv6_neighbour_t *neighbour);
 static bool ipv6_destination_release(ipv6_destination_t *dest);
 static uint16_t total_metric(const ipv6_route_t *route);
 static uint8_t ipv6_route_table_count_source(int8_t interface_id, ipv6_route_src_t source);
 static void ipv6_route_table_remove_last_one_from_source(int8_t interface_id, ipv6_route_src_t source);
 static uint8_t ipv6_route_table_get_max_entries(int8_t interface_id, ipv6_route_src_t source);
+static void ipv6_neighbour_nud_timer_cb(struct timer_group *group, struct timer_entry *timer);
+static void ipv6_neighbour_lifetime_timer_cb(struct timer_group *group, struct timer_entry *timer);
+static void ipv6_route_lifetime_timer_cb(struct timer_group *group, struct timer_entry *timer);
 
 static uint32_t next_probe_time(ipv6_neighbour_cache_t *cache, uint8_t retrans_num)
 {
@@ -101,13 +143,39 @@ static uint32_t next_probe_time(ipv6_neighbour_cache_t *cache, uint8_t retrans_n
     return rand_randomise_base(t, 0x4000, 0xBFFF);
 }
 
+struct ipv6_neighbour_list *ipv6_neighbour_addr_bucket(ipv6_neighbour_cache_t *cache, const uint8_t *address)
+{
+    uint64_t hi, lo;
+
+    // Same as rpl_target_bucket(): addresses generally share their prefix,
+    // the multiplication spreads the IID differences into the upper bits.
+    memcpy(&hi, address, 8);
+    memcpy(&lo, address + 8, 8);
+    lo ^= hi;
+    lo *= UINT64_C(0x9e3779b97f4a7c15);
+    return &cache->addr_hash[lo >> (64 - IPV6_NEIGHBOUR_HASH_BITS)];
+}
+
+struct ipv6_neighbour_list *ipv6_neighbour_eui64_bucket(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
+{
+    uint64_t key;
+
+    memcpy(&key, eui64, 8);
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return &cache->eui64_hash[key >> (64 - IPV6_NEIGHBOUR_HASH_BITS)];
+}
+
 void ipv6_neighbour_cache_init(ipv6_neighbour_cache_t *cache, int8_t interface_id)
 {
     /* Init Double linked Routing Table */
     ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list) {
         ipv6_neighbour_entry_remove(cache, cur);
     }
-    cache->gc_timer = NCACHE_GC_PERIOD;
+    for (int i = 0; i < ARRAY_SIZE(cache->addr_hash); i++)
+        SLIST_INIT(&cache->addr_hash[i]);
+    for (int i = 0; i < ARRAY_SIZE(cache->eui64_hash); i++)
+        SLIST_INIT(&cache->eui64_hash[i]);
+    timer_group_init(&cache->timer_group);
     cache->retrans_timer = 1000;
     cache->max_ll_len = 2 + 8;
     cache->interface_id = interface_id;
@@ -132,7 +200,9 @@ void ipv6_neighbour_cache_flush(ipv6_neighbour_cache_t *cache)
 
 ipv6_neighbour_t *ipv6_neighbour_lookup(ipv6_neighbour_cache_t *cache, const uint8_t *address)
 {
-    ns_list_foreach(ipv6_neighbour_t, cur, &cache->list)
+    ipv6_neighbour_t *cur;
+
+    SLIST_FOREACH(cur, ipv6_neighbour_addr_bucket(cache, address), addr_link)
         if (addr_ipv6_equal(cur->ip_address, address))
             return cur;
 
@@ -148,6 +218,12 @@ void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t
      * the entry.
      */
     ns_list_remove(&cache->list, entry);
+    timer_stop(&cache->timer_group, &entry->nud_timer);
+    timer_stop(&cache->timer_group, &entry->lifetime_timer);
+    SLIST_REMOVE(ipv6_neighbour_addr_bucket(cache, entry->ip_address), entry, ipv6_neighbour, addr_link);
+    if (entry->eui64_indexed)
+        SLIST_REMOVE(ipv6_neighbour_eui64_bucket(cache, ipv6_neighbour_eui64(cache, entry)),
+                     entry, ipv6_neighbour, eui64_link);
     switch (entry->state) {
         case IP_NEIGHBOUR_NEW:
         case IP_NEIGHBOUR_INCOMPLETE:
@@ -160,6 +236,7 @@ void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t
             break;
     }
     ipv6_destination_cache_forget_neighbour(entry);
+    ipv6_route_cache_flush();
     if (!IN6_IS_ADDR_MULTICAST(entry->ip_address))
         ipv6_route_delete(entry->ip_address, 128, net_if->id, entry->ip_address, ROUTE_ARO);
     TRACE(TR_NEIGH_IPV6, "IPv6 neighbor del %s / %s",
@@ -170,10 +247,12 @@ void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t
 
 ipv6_neighbour_t *ipv6_neighbour_lookup_mc(ipv6_neighbour_cache_t *cache, const uint8_t *address, const uint8_t *eui64)
 {
+    ipv6_neighbour_t *cur;
+
     if (!IN6_IS_ADDR_MULTICAST(address))
         return NULL;
 
-    ns_list_foreach(ipv6_neighbour_t, cur, &cache->list)
+    SLIST_FOREACH(cur, ipv6_neighbour_addr_bucket(cache, address), addr_link)
         if (addr_ipv6_equal(cur->ip_address, address)) {
             if (memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8))
                 continue;
@@ -207,21 +286,40 @@ ipv6_neighbour_t *ipv6_neighbour_create(ipv6_neighbour_cache_t *cache, const uin
     // neighbour may be using a short link-layer address, not its EUI-64.
     entry = zalloc(sizeof(ipv6_neighbour_t) + cache->max_ll_len + (cache->recv_addr_reg ? 8 : 0));
     memcpy(entry->ip_address, address, 16);
-    if (cache->recv_addr_reg)
-        memcpy(ipv6_neighbour_eui64(cache, entry), eui64, 8);
+    entry->nud_timer.callback = ipv6_neighbour_nud_timer_cb;
+    entry->nud_timer.slack_ms = NCACHE_NUD_SLACK_MS;
+    entry->lifetime_timer.callback = ipv6_neighbour_lifetime_timer_cb;
+    entry->lifetime_timer.slack_ms = NCACHE_LIFETIME_SLACK_MS;
     ns_list_add_to_start(&cache->list, entry);
+    SLIST_INSERT_HEAD(ipv6_neighbour_addr_bucket(cache, address), entry, addr_link);
+    if (cache->recv_addr_reg) {
+        memcpy(ipv6_neighbour_eui64(cache, entry), eui64, 8);
+        SLIST_INSERT_HEAD(ipv6_neighbour_eui64_bucket(cache, eui64), entry, eui64_link);
+        entry->eui64_indexed = true;
+    }
     TRACE(TR_NEIGH_IPV6, "IPv6 neighbor add %s / %s",
           tr_eui64(ipv6_neighbour_eui64(cache, entry)), tr_ipv6(entry->ip_address));
+    ipv6_neighbour_lifetime_update(cache, entry);
 
     return entry;
 }
 
+static void ipv6_neighbour_nud_timer_set(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, uint32_t ms)
+{
+    if (ms)
+        timer_start_rel(&cache->timer_group, &entry->nud_timer, ms);
+    else
+        timer_stop(&cache->timer_group, &entry->nud_timer);
+}
+
 ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
 {
-    /* Reset the GC life, if it's a GC entry */
+    /* Reset the GC life, if it's a GC entry. The lifetime timer notices the
+     * extension when it expires, there is no need to restart it here.
+     */
     if (entry->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
         entry->lifetime_s = NCACHE_GC_AGE;
-        entry->expiration_s = time_now_s(CLOCK_MONOTONIC) + NCACHE_GC_AGE;
+        entry->expiration_s = time_cached_s() + NCACHE_GC_AGE;
     }
 
     /* Move it to the front of the list */
@@ -236,8 +334,8 @@ ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighb
     }
 
     /* Special case for Registered Unreachable entries - restart the probe timer if stopped */
-    else if (entry->state == IP_NEIGHBOUR_UNREACHABLE && entry->timer == 0) {
-        entry->timer = next_probe_time(cache, entry->retrans_count);
+    else if (entry->state == IP_NEIGHBOUR_UNREACHABLE && timer_stopped(&entry->nud_timer)) {
+        ipv6_neighbour_nud_timer_set(cache, entry, next_probe_time(cache, entry->retrans_count));
     }
 
     return entry;
@@ -257,7 +355,11 @@ static bool ipv6_neighbour_update_ll(ipv6_neighbour_t *entry, addrtype_e ll_type
 
 bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list)
+    ipv6_neighbour_t *cur;
+
+    if (!cache->recv_addr_reg)
+        return false;
+    SLIST_FOREACH(cur, ipv6_neighbour_eui64_bucket(cache, eui64), eui64_link)
         if (cur->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE &&
             !memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(cur->ip_address))
@@ -267,7 +369,11 @@ bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const
 
 ipv6_neighbour_t *ipv6_neighbour_lookup_gua_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list)
+    ipv6_neighbour_t *cur;
+
+    if (!cache->recv_addr_reg)
+        return NULL;
+    SLIST_FOREACH(cur, ipv6_neighbour_eui64_bucket(cache, eui64), eui64_link)
         if (cur->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE &&
             !memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(cur->ip_address) &&
@@ -281,27 +387,27 @@ void ipv6_neighbour_set_state(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *e
     switch (state) {
         case IP_NEIGHBOUR_INCOMPLETE:
             entry->retrans_count = 0;
-            entry->timer = cache->retrans_timer;
+            ipv6_neighbour_nud_timer_set(cache, entry, cache->retrans_timer);
             break;
         case IP_NEIGHBOUR_STALE:
-            entry->timer = 0;
+            ipv6_neighbour_nud_timer_set(cache, entry, 0);
             break;
         case IP_NEIGHBOUR_DELAY:
-            entry->timer = DELAY_FIRST_PROBE_TIME;
+            ipv6_neighbour_nud_timer_set(cache, entry, DELAY_FIRST_PROBE_TIME);
             break;
         case IP_NEIGHBOUR_PROBE:
             entry->retrans_count = 0;
-            entry->timer = next_probe_time(cache, 0);
+            ipv6_neighbour_nud_timer_set(cache, entry, next_probe_time(cache, 0));
             break;
         case IP_NEIGHBOUR_REACHABLE:
-            entry->timer = cache->reachable_time;
+            ipv6_neighbour_nud_timer_set(cache, entry, cache->reachable_time);
             break;
         case IP_NEIGHBOUR_UNREACHABLE:
             /* Progress to this from PROBE - timers continue */
             ipv6_destination_cache_forget_neighbour(entry);
             break;
         default:
-            entry->timer = 0;
+            ipv6_neighbour_nud_timer_set(cache, entry, 0);
             break;
     }
     entry->state = state;
@@ -338,121 +444,109 @@ ipv6_neighbour_t *ipv6_neighbour_update_unsolicited(ipv6_neighbour_cache_t *cach
     return entry;
 }
 
-static void ipv6_neighbour_cache_gc_periodic(ipv6_neighbour_cache_t *cache)
+void ipv6_neighbour_lifetime_update(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
 {
-    ns_list_foreach_reverse_safe(ipv6_neighbour_t, entry, &cache->list) {
-        if (entry->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE)
-            continue;
+    uint64_t expire_ms;
 
-        if (time_now_s(CLOCK_MONOTONIC) >= entry->expiration_s)
-            ipv6_neighbour_entry_remove(cache, entry);
+    if (entry->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
+        /* 0 lifetime is an input to the GC, entries are left for a GC period */
+        if (entry->expiration_s)
+            expire_ms = entry->expiration_s * 1000;
+        else
+            expire_ms = time_now_ms(CLOCK_MONOTONIC) + NCACHE_GC_PERIOD * 1000;
+    } else if (entry->lifetime_s && entry->expiration_s) {
+        expire_ms = entry->expiration_s * 1000;
+    } else {
+        /* Tentative and Registered entries are deleted as soon as lifetime expires */
+        expire_ms = time_now_ms(CLOCK_MONOTONIC);
     }
+    timer_start_abs(&cache->timer_group, &entry->lifetime_timer, expire_ms);
 }
 
-void ipv6_neighbour_cache_slow_timer(int seconds)
+static void ipv6_neighbour_lifetime_timer_cb(struct timer_group *group, struct timer_entry *timer)
 {
-    ipv6_neighbour_cache_t *cache = &protocol_stack_interface_info_get()->ipv6_neighbour_cache;
-
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list) {
-        if (cur->lifetime_s && cur->expiration_s &&
-            time_now_s(CLOCK_MONOTONIC) < cur->expiration_s)
-            continue;
-
-        /* Lifetime expired */
-        switch (cur->type) {
-            case IP_NEIGHBOUR_GARBAGE_COLLECTIBLE:
-                /* No immediate action, but 0 lifetime is an input to the GC */
-                break;
-
-            case IP_NEIGHBOUR_TENTATIVE:
-            case IP_NEIGHBOUR_REGISTERED:
-                /* These are deleted as soon as lifetime expires */
-                ipv6_destination_cache_forget_neighbour(cur);
-                ipv6_neighbour_entry_remove(cache, cur);
-                break;
-        }
-    }
-
-    if (cache->gc_timer > seconds) {
-        cache->gc_timer -= seconds;
-        return;
+    ipv6_neighbour_cache_t *cache = container_of(group, ipv6_neighbour_cache_t, timer_group);
+    ipv6_neighbour_t *cur = container_of(timer, ipv6_neighbour_t, lifetime_timer);
+
+    switch (cur->type) {
+        case IP_NEIGHBOUR_GARBAGE_COLLECTIBLE:
+            if (time_cached_s() < cur->expiration_s) {
+                /* Lifetime was extended by ipv6_neighbour_used() */
+                timer_start_abs(group, timer, cur->expiration_s * 1000);
+                return;
+            }
+            ipv6_neighbour_entry_remove(cache, cur);
+            break;
+        case IP_NEIGHBOUR_TENTATIVE:
+        case IP_NEIGHBOUR_REGISTERED:
+            if (cur->lifetime_s && cur->expiration_s &&
+                time_cached_s() < cur->expiration_s) {
+                timer_start_abs(group, timer, cur->expiration_s * 1000);
+                return;
+            }
+            ipv6_destination_cache_forget_neighbour(cur);
+            ipv6_neighbour_entry_remove(cache, cur);
+            break;
     }
-
-    cache->gc_timer = NCACHE_GC_PERIOD;
-    ipv6_neighbour_cache_gc_periodic(cache);
 }
 
-void ipv6_neighbour_cache_fast_timer(int ticks)
+static void ipv6_neighbour_nud_timer_cb(struct timer_group *group, struct timer_entry *timer)
 {
-    ipv6_neighbour_cache_t *cache = &protocol_stack_interface_info_get()->ipv6_neighbour_cache;
-    uint32_t ms = (uint32_t) ticks * 100;
-
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list) {
-        if (cur->timer == 0) {
-            continue;
-        }
-
-        if (cur->timer > ms) {
-            cur->timer -= ms;
-            continue;
-        }
+    ipv6_neighbour_cache_t *cache = container_of(group, ipv6_neighbour_cache_t, timer_group);
+    ipv6_neighbour_t *cur = container_of(timer, ipv6_neighbour_t, nud_timer);
 
-        cur->timer = 0;
-
-        /* Timer expired */
-        switch (cur->state) {
-            case IP_NEIGHBOUR_NEW:
-                /* Shouldn't happen */
-                break;
-            case IP_NEIGHBOUR_INCOMPLETE:
-                if (++cur->retrans_count >= MAX_MULTICAST_SOLICIT) {
-                    /* Should be safe for registration - Tentative/Registered entries can't be INCOMPLETE */
-                    ipv6_destination_cache_forget_neighbour(cur);
-                    ipv6_neighbour_entry_remove(cache, cur);
-                } else {
-                    ipv6_interface_resolve_send_ns(cache, cur, false, cur->retrans_count);
-                    cur->timer = cache->retrans_timer;
-                }
-                break;
-            case IP_NEIGHBOUR_STALE:
-                /* Shouldn't happen */
-                break;
-            case IP_NEIGHBOUR_REACHABLE:
-                ipv6_neighbour_set_state(cache, cur, IP_NEIGHBOUR_STALE);
-                break;
-            case IP_NEIGHBOUR_DELAY:
-                ipv6_neighbour_set_state(cache, cur, IP_NEIGHBOUR_PROBE);
-                ipv6_interface_resolve_send_ns(cache, cur, true, 0);
-                break;
-            case IP_NEIGHBOUR_PROBE:
-                if (cur->retrans_count >= MARK_UNREACHABLE - 1)
-                    ipv6_neighbour_set_state(cache, cur, IP_NEIGHBOUR_UNREACHABLE);
-            /* fall through */
-            case IP_NEIGHBOUR_UNREACHABLE:
-                if (cur->retrans_count < 0xFF) {
-                    cur->retrans_count++;
-                }
+    switch (cur->state) {
+        case IP_NEIGHBOUR_NEW:
+            /* Shouldn't happen */
+            break;
+        case IP_NEIGHBOUR_INCOMPLETE:
+            if (++cur->retrans_count >= MAX_MULTICAST_SOLICIT) {
+                /* Should be safe for registration - Tentative/Registered entries can't be INCOMPLETE */
+                ipv6_destination_cache_forget_neighbour(cur);
+                ipv6_neighbour_entry_remove(cache, cur);
+            } else {
+                ipv6_interface_resolve_send_ns(cache, cur, false, cur->retrans_count);
+                ipv6_neighbour_nud_timer_set(cache, cur, cache->retrans_timer);
+            }
+            break;
+        case IP_NEIGHBOUR_STALE:
+            /* Shouldn't happen */
+            break;
+        case IP_NEIGHBOUR_REACHABLE:
+            ipv6_neighbour_set_state(cache, cur, IP_NEIGHBOUR_STALE);
+            break;
+        case IP_NEIGHBOUR_DELAY:
+            ipv6_neighbour_set_state(cache, cur, IP_NEIGHBOUR_PROBE);
+            ipv6_interface_resolve_send_ns(cache, cur, true, 0);
+            break;
+        case IP_NEIGHBOUR_PROBE:
+            if (cur->retrans_count >= MARK_UNREACHABLE - 1)
+                ipv6_neighbour_set_state(cache, cur, IP_NEIGHBOUR_UNREACHABLE);
+        /* fall through */
+        case IP_NEIGHBOUR_UNREACHABLE:
+            if (cur->retrans_count < 0xFF) {
+                cur->retrans_count++;
+            }
 
-                if (cur->retrans_count >= MAX_UNICAST_SOLICIT && cur->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
-                    ipv6_neighbour_entry_remove(cache, cur);
-                } else {
-                    ipv6_interface_resolve_send_ns(cache, cur, true, cur->retrans_count);
-                    if (cur->retrans_count >= MAX_UNICAST_SOLICIT - 1) {
-                        /* "Final" unicast probe */
-                        if (cur->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
-                            /* Only wait 1 initial retrans time for response to final probe - don't want backoff in this case */
-                            cur->timer = cache->retrans_timer;
-                        } else {
-                            /* We're not going to remove this. Let's stop the timer. We'll restart to probe once more if it's used */
-                            cur->timer = 0;
-                        }
+            if (cur->retrans_count >= MAX_UNICAST_SOLICIT && cur->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
+                ipv6_neighbour_entry_remove(cache, cur);
+            } else {
+                ipv6_interface_resolve_send_ns(cache, cur, true, cur->retrans_count);
+                if (cur->retrans_count >= MAX_UNICAST_SOLICIT - 1) {
+                    /* "Final" unicast probe */
+                    if (cur->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
+                        /* Only wait 1 initial retrans time for response to final probe - don't want backoff in this case */
+                        ipv6_neighbour_nud_timer_set(cache, cur, cache->retrans_timer);
                     } else {
-                        /* Backoff for the next probe */
-                        cur->timer = next_probe_time(cache, cur->retrans_count);
+                        /* We're not going to remove this. Let's stop the timer. We'll restart to probe once more if it's used */
+                        ipv6_neighbour_nud_timer_set(cache, cur, 0);
                     }
+                } else {
+                    /* Backoff for the next probe */
+                    ipv6_neighbour_nud_timer_set(cache, cur, next_probe_time(cache, cur->retrans_count));
                 }
-                break;
-        }
+            }
+            break;
     }
 }
 
@@ -537,6 +631,11 @@ ipv6_destination_t *ipv6_destination_lookup_or_create(const uint8_t *address, in
     return entry;
 }
 
+int ipv6_destination_cache_count(void)
+{
+    return ns_list_count(&ipv6_destination_cache);
+}
+
 static void ipv6_destination_cache_forget_neighbour(const ipv6_neighbour_t *neighbour)
 {
     ns_list_foreach(ipv6_destination_t, entry, &ipv6_destination_cache) {
@@ -637,9 +736,10 @@ static void ipv6_route_print(const ipv6_route_t *route)
     uint8_t addr[16] = { 0 };
     bitcpy(addr, route->prefix, route->prefix_len);
     if (route->lifetime != 0xFFFFFFFF) {
-        tr_debug(" %24s if:%u src:'%s' id:%d lifetime:%"PRIu32,
+        tr_debug(" %24s if:%u src:'%s' id:%d lifetime:%"PRIu64,
                  tr_ipv6_prefix(addr, route->prefix_len), route->info.interface_id,
-                 route_src_names[route->info.source], route->info.source_id, route->lifetime
+                 route_src_names[route->info.source], route->info.source_id,
+                 timer_remaining_ms(&route->lifetime_timer) / 1000
                 );
     } else {
         tr_debug(" %24s if:%u src:'%s' id:%d lifetime:infinite",
@@ -682,15 +782,118 @@ static uint16_t total_metric(const ipv6_route_t *route)
     return metric;
 }
 
+static uint8_t ipv6_route_common_prefix_len(const uint8_t *a, const uint8_t *b, uint8_t max_len)
+{
+    uint8_t len = 0;
+
+    while (len + 8 <= max_len && a[len / 8] == b[len / 8])
+        len += 8;
+    while (len < max_len && bittest(a, len) == bittest(b, len))
+        len++;
+    return len;
+}
+
+static struct ipv6_route_node *ipv6_route_node_new(const uint8_t *prefix, uint8_t prefix_len)
+{
+    struct ipv6_route_node *node = zalloc(sizeof(struct ipv6_route_node));
+
+    bitcpy(node->prefix, prefix, prefix_len);
+    node->prefix_len = prefix_len;
+    ns_list_init(&node->routes);
+    return node;
+}
+
+static struct ipv6_route_node **ipv6_route_node_link(struct ipv6_route_node *node)
+{
+    if (!node->parent)
+        return &ipv6_route_trie;
+    return &node->parent->child[bittest(node->prefix, node->parent->prefix_len)];
+}
+
+static struct ipv6_route_node *ipv6_route_node_get(const uint8_t *prefix, uint8_t prefix_len)
+{
+    struct ipv6_route_node *node = ipv6_route_trie;
+
+    while (node && node->prefix_len <= prefix_len) {
+        if (bitcmp(prefix, node->prefix, node->prefix_len))
+            return NULL;
+        if (node->prefix_len == prefix_len)
+            return node;
+        node = node->child[bittest(prefix, node->prefix_len)];
+    }
+    return NULL;
+}
+
+static struct ipv6_route_node *ipv6_route_node_get_or_create(const uint8_t *prefix, uint8_t prefix_len)
+{
+    struct ipv6_route_node **link = &ipv6_route_trie;
+    struct ipv6_route_node *parent = NULL;
+    struct ipv6_route_node *node, *new, *glue;
+    uint8_t len;
+
+    while ((node = *link)) {
+        len = ipv6_route_common_prefix_len(prefix, node->prefix, MIN(prefix_len, node->prefix_len));
+        if (len == node->prefix_len) {
+            if (len == prefix_len)
+                return node;
+            parent = node;
+            link = &node->child[bittest(prefix, len)];
+            continue;
+        }
+        // The new prefix diverges from node, or is shorter
+        new = ipv6_route_node_new(prefix, prefix_len);
+        if (len == prefix_len) {
+            new->child[bittest(node->prefix, len)] = node;
+            new->parent = parent;
+            node->parent = new;
+            *link = new;
+        } else {
+            glue = ipv6_route_node_new(prefix, len);
+            glue->child[bittest(node->prefix, len)] = node;
+            glue->child[bittest(prefix, len)] = new;
+            glue->parent = parent;
+            node->parent = glue;
+            new->parent = glue;
+            *link = glue;
+        }
+        return new;
+    }
+    new = ipv6_route_node_new(prefix, prefix_len);
+    new->parent = parent;
+    *link = new;
+    return new;
+}
+
+// Remove nodes which neither hold routes nor branch
+static void ipv6_route_node_prune(struct ipv6_route_node *node)
+{
+    struct ipv6_route_node *parent, *child;
+
+    while (node && ns_list_is_empty(&node->routes) && (!node->child[0] || !node->child[1])) {
+        parent = node->parent;
+        child = node->child[0] ? node->child[0] : node->child[1];
+        *ipv6_route_node_link(node) = child;
+        if (child)
+            child->parent = parent;
+        free(node);
+        // The parent may now be a glue node with a single child
+        node = child ? NULL : parent;
+    }
+}
+
 static void ipv6_route_entry_remove(ipv6_route_t *route)
 {
     tr_info("Deleted route:");
     ipv6_route_print(route);
+    timer_stop(NULL, &route->lifetime_timer);
     if (route->info_autofree) {
         free(route->info.info);
     }
     ns_list_remove(&ipv6_routing_table, route);
+    ns_list_remove(&route->node->routes, route);
+    ipv6_route_node_prune(route->node);
     free(route);
+    ipv6_route_cache_flush();
 }
 
 /* Return true is a is better than b */
@@ -718,28 +921,43 @@ static bool ipv6_route_is_better(const ipv6_route_t *a, const ipv6_route_t *b)
     return total_metric(a) < total_metric(b);
 }
 
+/* Find the matching trie nodes holding routes, from the shortest prefix to the longest */
+static int ipv6_route_find_nodes(const uint8_t *addr, struct ipv6_route_node *nodes[129])
+{
+    struct ipv6_route_node *node = ipv6_route_trie;
+    int count = 0;
+
+    while (node && !bitcmp(addr, node->prefix, node->prefix_len)) {
+        if (!ns_list_is_empty(&node->routes))
+            nodes[count++] = node;
+        if (node->prefix_len == 128)
+            break;
+        node = node->child[bittest(addr, node->prefix_len)];
+    }
+    return count;
+}
+
 /* Find the "best" route regardless of reachability, but respecting the skip flag and predicates */
-static ipv6_route_t *ipv6_route_find_best(const uint8_t *addr, int8_t interface_id)
+static ipv6_route_t *ipv6_route_find_best(struct ipv6_route_node *nodes[], int node_count, int8_t interface_id)
 {
     ipv6_route_t *best = NULL;
-    ns_list_foreach(ipv6_route_t, route, &ipv6_routing_table) {
-        /* We mustn't be skipping this route */
-        if (route->search_skip) {
-            continue;
-        }
 
-        /* Interface must match, if caller specified */
-        if (interface_id != -1 && interface_id != route->info.interface_id) {
-            continue;
-        }
+    /* Longer prefixes are always better, so stop at the first node with a candidate */
+    for (int i = node_count - 1; i >= 0 && !best; i--) {
+        ns_list_foreach(ipv6_route_t, route, &nodes[i]->routes) {
+            /* We mustn't be skipping this route */
+            if (route->search_skip) {
+                continue;
+            }
 
-        /* Prefix must match */
-        if (bitcmp(addr, route->prefix, route->prefix_len)) {
-            continue;
-        }
+            /* Interface must match, if caller specified */
+            if (interface_id != -1 && interface_id != route->info.interface_id) {
+                continue;
+            }
 
-        if (!best || ipv6_route_is_better(route, best)) {
-            best = route;
+            if (!best || ipv6_route_is_better(route, best)) {
+                best = route;
+            }
         }
     }
     return best;
@@ -747,10 +965,15 @@ static ipv6_route_t *ipv6_route_find_best(const uint8_t *addr, int8_t interface_
 
 ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_id)
 {
+    struct ipv6_route_node *nodes[129];
     ipv6_route_t *best = NULL;
+    int node_count;
 
-    ns_list_foreach(ipv6_route_t, route, &ipv6_routing_table) {
-        route->search_skip = false;
+    node_count = ipv6_route_find_nodes(dest, nodes);
+    for (int i = 0; i < node_count; i++) {
+        ns_list_foreach(ipv6_route_t, route, &nodes[i]->routes) {
+            route->search_skip = false;
+        }
     }
 
     /* Search algorithm from RFC 4191, S3.2:
@@ -780,7 +1003,7 @@ ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_i
      * possibility would be a special precedence flag.
      */
     for (;;) {
-        ipv6_route_t *route = ipv6_route_find_best(dest, interface_id);
+        ipv6_route_t *route = ipv6_route_find_best(nodes, node_count, interface_id);
         if (!route) {
             break;
         }
@@ -812,8 +1035,14 @@ ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_i
 
 ipv6_route_t *ipv6_route_lookup_with_info(const uint8_t *prefix, uint8_t prefix_len, int8_t interface_id, const uint8_t *next_hop, ipv6_route_src_t source, void *info, int_fast16_t src_id)
 {
-    ns_list_foreach(ipv6_route_t, r, &ipv6_routing_table) {
-        if (interface_id == r->info.interface_id && prefix_len == r->prefix_len && !bitcmp(prefix, r->prefix, prefix_len)) {
+    struct ipv6_route_node *node = ipv6_route_node_get(prefix, prefix_len);
+
+    if (!node) {
+        return NULL;
+    }
+
+    ns_list_foreach(ipv6_route_t, r, &node->routes) {
+        if (interface_id == r->info.interface_id) {
             if (source != ROUTE_ANY) {
                 if (source != r->info.source) {
                     continue;
@@ -871,6 +1100,21 @@ ipv6_route_t *ipv6_route_add_with_info(const uint8_t *prefix, uint8_t prefix_len
     return ipv6_route_add_metric(prefix, prefix_len, interface_id, next_hop, source, info,  source_id, lifetime, PREF_TO_METRIC(pref));
 }
 
+static void ipv6_route_lifetime_set(ipv6_route_t *route, uint32_t lifetime)
+{
+    route->lifetime = lifetime;
+    if (lifetime == 0xFFFFFFFF)
+        timer_stop(NULL, &route->lifetime_timer);
+    else
+        timer_start_rel(NULL, &route->lifetime_timer, lifetime * UINT64_C(1000));
+}
+
+static void ipv6_route_lifetime_timer_cb(struct timer_group *group, struct timer_entry *timer)
+{
+    tr_debug("Route expired");
+    ipv6_route_entry_remove(container_of(timer, ipv6_route_t, lifetime_timer));
+}
+
 ipv6_route_t *ipv6_route_add_metric(const uint8_t *prefix, uint8_t prefix_len, int8_t interface_id, const uint8_t *next_hop, ipv6_route_src_t source, void *info, uint8_t source_id, uint32_t lifetime, uint8_t metric)
 {
     ipv6_route_t *route = NULL;
@@ -920,7 +1164,10 @@ ipv6_route_t *ipv6_route_add_metric(const uint8_t *prefix, uint8_t prefix_len, i
         bitcpy(route->prefix, prefix, prefix_len);
         route->prefix_len = prefix_len;
         route->search_skip = false;
-        route->lifetime = lifetime;
+        memset(&route->lifetime_timer, 0, sizeof(route->lifetime_timer));
+        route->lifetime_timer.callback = ipv6_route_lifetime_timer_cb;
+        route->lifetime_timer.slack_ms = NCACHE_LIFETIME_SLACK_MS;
+        ipv6_route_lifetime_set(route, lifetime);
         route->metric = metric;
         route->info.source = source;
         route->info_autofree = false;
@@ -940,9 +1187,11 @@ ipv6_route_t *ipv6_route_add_metric(const uint8_t *prefix, uint8_t prefix_len, i
         /* Doesn't matter much where they start off, but put them at the */
         /* beginning so new routes tend to get tried first. */
         ns_list_add_to_start(&ipv6_routing_table, route);
+        route->node = ipv6_route_node_get_or_create(route->prefix, prefix_len);
+        ns_list_add_to_start(&route->node->routes, route);
         changed_info = NEW;
     } else { /* updating a route - only lifetime and metric can be changing */
-        route->lifetime = lifetime;
+        ipv6_route_lifetime_set(route, lifetime);
         if (metric != route->metric) {
             route->metric = metric;
             changed_info = UPDATED;
@@ -953,6 +1202,7 @@ ipv6_route_t *ipv6_route_add_metric(const uint8_t *prefix, uint8_t prefix_len, i
     if (changed_info != UNCHANGED) {
         tr_info("%s route:", changed_info == NEW ? "Added" : "Updated");
         ipv6_route_print(route);
+        ipv6_route_cache_flush();
     }
 
     return route;
@@ -1008,31 +1258,79 @@ static void ipv6_route_table_remove_last_one_from_source(int8_t interface_id, ip
     }
 }
 
+static uint8_t ipv6_route_table_get_max_entries(int8_t interface_id, ipv6_route_src_t source)
+{
+    ipv6_neighbour_cache_t *ncache = ipv6_neighbour_cache_by_interface_id(interface_id);
+
+    if (ncache) {
+        return ncache->route_if_info.sources[source];
+    }
+
+    return 0;
+}
 
-void ipv6_route_table_ttl_update(int seconds)
+static struct ipv6_route_cache_entry *ipv6_route_cache_slot(const uint8_t *dest)
 {
-    ns_list_foreach_safe(ipv6_route_t, r, &ipv6_routing_table) {
-        if (r->lifetime == 0xFFFFFFFF) {
-            continue;
-        }
+    return &ipv6_route_cache[fnv_hash_reverse_32_init(dest, 16) % IPV6_ROUTE_CACHE_SIZE];
+}
 
-        if (r->lifetime > seconds) {
-            r->lifetime -= seconds;
-            continue;
-        }
+bool ipv6_route_cache_lookup(const uint8_t *dest, int8_t interface_id, ipv6_route_info_t *info_out)
+{
+    struct ipv6_route_cache_entry *entry = ipv6_route_cache_slot(dest);
 
-        tr_debug("Route expired");
-        ipv6_route_entry_remove(r);
+    if (entry->generation != ipv6_route_cache_gen ||
+        entry->interface_id != interface_id ||
+        !addr_ipv6_equal(entry->dest, dest)) {
+        ipv6_route_cache_stats_data.miss_count++;
+        return false;
     }
+    *info_out = entry->info;
+    entry->hit_count++;
+    ipv6_route_cache_stats_data.hit_count++;
+    return true;
 }
 
-static uint8_t ipv6_route_table_get_max_entries(int8_t interface_id, ipv6_route_src_t source)
+void ipv6_route_cache_store(const uint8_t *dest, int8_t interface_id, const ipv6_route_info_t *info)
 {
-    ipv6_neighbour_cache_t *ncache = ipv6_neighbour_cache_by_interface_id(interface_id);
-
-    if (ncache) {
-        return ncache->route_if_info.sources[source];
+    struct ipv6_route_cache_entry *entry = ipv6_route_cache_slot(dest);
+
+    /* Keep per-path counters when the same path is refreshed */
+    if (!entry->generation || entry->interface_id != interface_id ||
+        !addr_ipv6_equal(entry->dest, dest)) {
+        memcpy(entry->dest, dest, 16);
+        entry->interface_id = interface_id;
+        entry->hit_count = 0;
+        entry->miss_count = 0;
     }
+    entry->generation = ipv6_route_cache_gen;
+    entry->info = *info;
+    entry->miss_count++;
+}
 
-    return 0;
+void ipv6_route_cache_flush(void)
+{
+    ipv6_route_cache_gen++;
+    ipv6_route_cache_stats_data.flush_count++;
+}
+
+const struct ipv6_route_cache_stats *ipv6_route_cache_stats(void)
+{
+    return &ipv6_route_cache_stats_data;
+}
+
+void ipv6_route_cache_print(void)
+{
+    const struct ipv6_route_cache_stats *stats = &ipv6_route_cache_stats_data;
+
+    tr_debug("Route Cache: %"PRIu64" hits, %"PRIu64" misses, %"PRIu64" flushes",
+             stats->hit_count, stats->miss_count, stats->flush_count);
+    for (int i = 0; i < IPV6_ROUTE_CACHE_SIZE; i++) {
+        if (!ipv6_route_cache[i].generation)
+            continue;
+        tr_debug(" %s%%%d via %s (%s, %"PRIu32" hits, %"PRIu32" misses)",
+                 tr_ipv6(ipv6_route_cache[i].dest), ipv6_route_cache[i].interface_id,
+                 tr_ipv6(ipv6_route_cache[i].info.next_hop_addr),
+                 ipv6_route_cache[i].generation == ipv6_route_cache_gen ? "valid" : "stale",
+                 ipv6_route_cache[i].hit_count, ipv6_route_cache[i].miss_count);
+    }
 }
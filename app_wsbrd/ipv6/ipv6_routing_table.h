@@ -23,10 +23,12 @@
 
 #ifndef IPV6_ROUTING_TABLE_H_
 #define IPV6_ROUTING_TABLE_H_
+#include <sys/queue.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
 #include "common/ns_list.h"
+#include "common/timer.h"
 
 #include "net/netaddr_types.h"
 
@@ -96,13 +98,25 @@ typedef struct ipv6_neighbour {
     ip_neighbour_cache_state_e      state;
     ip_neighbour_cache_type_e       type;
     addrtype_e                      ll_type;
-    uint32_t                        timer;                      /* 100ms ticks */
+    struct timer_entry              nud_timer;                  /*!< Next NUD step, depends on state */
+    struct timer_entry              lifetime_timer;             /*!< Checks lifetime_s/expiration_s */
     uint32_t                        lifetime_s;
     time_t                          expiration_s;
+    time_t                          storage_expiration_s;       /*!< expiration_s last written by ipv6_neigh_storage_save() */
+    bool                            proxied;                    /*!< Kernel proxy entry and route requested */
     ns_list_link_t                  link;                       /*!< List link */
+    SLIST_ENTRY(ipv6_neighbour)     addr_link;                  /*!< Link in ipv6_neighbour_cache.addr_hash */
+    SLIST_ENTRY(ipv6_neighbour)     eui64_link;                 /*!< Link in ipv6_neighbour_cache.eui64_hash */
+    bool                            eui64_indexed;              /*!< Linked by eui64_link */
     uint8_t                         ll_address[];
 } ipv6_neighbour_t;
 
+// Declare struct ipv6_neighbour_list
+SLIST_HEAD(ipv6_neighbour_list, ipv6_neighbour);
+
+/* Number of buckets in the neighbour cache indexes, as a power of 2 */
+#define IPV6_NEIGHBOUR_HASH_BITS 10
+
 /* Neighbour Cache entries also store EUI-64 after ll_address if "recv_addr_reg"
  * is set for the cache. This is ADDR_EUI64_ZERO if unknown.
  */
@@ -122,15 +136,31 @@ typedef struct ipv6_neighbour_cache {
     bool                                    omit_na : 1; // except for ARO successes which have a separate flag
     int8_t                                  interface_id;
     uint8_t                                 max_ll_len;
-    uint8_t                                 gc_timer;
     uint32_t                                retrans_timer;
     uint32_t                                reachable_time;
     // Interface specific information for route
     ipv6_route_interface_info_t             route_if_info;
     //uint8_t                                   num_entries;
     NS_LIST_HEAD(ipv6_neighbour_t, link)    list;
+    // Indexes of list by IPv6 address, and by EUI-64 if recv_addr_reg is set
+    struct ipv6_neighbour_list              addr_hash[1 << IPV6_NEIGHBOUR_HASH_BITS];
+    struct ipv6_neighbour_list              eui64_hash[1 << IPV6_NEIGHBOUR_HASH_BITS];
+    struct timer_group                      timer_group;
+    // Neighbour files not restored yet, see ipv6_neigh_storage_load()
+    char                                    **storage_pending;
+    int                                     storage_pending_index;
+    struct timer_entry                      storage_load_timer;
 } ipv6_neighbour_cache_t;
 
+/* Entries of a cache with a given EUI-64 are found in this bucket, chained by
+ * eui64_link. Other EUI-64 may be present in the same bucket.
+ */
+struct ipv6_neighbour_list *ipv6_neighbour_eui64_bucket(ipv6_neighbour_cache_t *cache, const uint8_t *eui64);
+/* Entries of a cache with a given IPv6 address are found in this bucket,
+ * chained by addr_link. A multicast address has one entry per registrant.
+ */
+struct ipv6_neighbour_list *ipv6_neighbour_addr_bucket(ipv6_neighbour_cache_t *cache, const uint8_t *address);
+
 void ipv6_neighbour_cache_init(ipv6_neighbour_cache_t *cache, int8_t interface_id);
 void ipv6_neighbour_cache_flush(ipv6_neighbour_cache_t *cache);
 ipv6_neighbour_t *ipv6_neighbour_update(ipv6_neighbour_cache_t *cache, const uint8_t *address, bool solicited);
@@ -144,8 +174,10 @@ bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const
 ipv6_neighbour_t *ipv6_neighbour_lookup_gua_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64);
 void ipv6_neighbour_entry_update_unsolicited(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, addrtype_e type, const uint8_t *ll_address/*, bool tentative*/);
 ipv6_neighbour_t *ipv6_neighbour_update_unsolicited(ipv6_neighbour_cache_t *cache, const uint8_t *ip_address, addrtype_e ll_type, const uint8_t *ll_address);
-void ipv6_neighbour_cache_fast_timer(int ticks);
-void ipv6_neighbour_cache_slow_timer(int seconds);
+/* Must be called when lifetime_s, expiration_s or the type of an entry is
+ * modified, except to extend the lifetime of an entry.
+ */
+void ipv6_neighbour_lifetime_update(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry);
 
 typedef struct ipv6_route_info {
     ipv6_route_src_t                source;
@@ -167,6 +199,7 @@ typedef struct ipv6_destination {
 } ipv6_destination_t;
 
 void ipv6_destination_cache_print();
+int ipv6_destination_cache_count(void);
 ipv6_destination_t *ipv6_destination_lookup_or_create(const uint8_t *address, int8_t interface_id);
 ipv6_destination_t *ipv6_destination_lookup_or_create_with_route(const uint8_t *address, int8_t interface_id, ipv6_route_info_t *route_out);
 void ipv6_destination_cache_timer(int ticks);
@@ -182,7 +215,10 @@ typedef struct ipv6_route {
     uint8_t             metric;             // 0x40 = RFC 4191 pref high, 0x80 = default, 0xC0 = RFC 4191 pref low
     ipv6_route_info_t   info;
     uint32_t            lifetime;           // (seconds); 0xFFFFFFFF means permanent
+    struct timer_entry  lifetime_timer;
     ns_list_link_t      link;
+    struct ipv6_route_node *node;           // trie node holding routes to this prefix
+    ns_list_link_t      node_link;
     uint8_t             prefix[];           // variable length
 } ipv6_route_t;
 
@@ -200,9 +236,26 @@ ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_i
 
 void ipv6_route_table_remove_interface(int8_t interface_id);
 void ipv6_route_table_set_next_hop_fn(ipv6_route_src_t src, ipv6_route_next_hop_fn_t *fn);
-void ipv6_route_table_ttl_update(int seconds);
 void ipv6_route_table_print();
 bool ipv6_route_table_source_was_invalidated(ipv6_route_src_t src);
+
+/* Forwarding fast path: results of ipv6_buffer_route() for unicast
+ * destinations, so that forwarded packets skip the route, destination and
+ * neighbour lookups. Entries remain valid until a route is added, updated or
+ * removed, or a neighbour is removed. Route providers computing next hops
+ * dynamically must call ipv6_route_cache_flush() when those change.
+ */
+struct ipv6_route_cache_stats {
+    uint64_t hit_count;
+    uint64_t miss_count;
+    uint64_t flush_count;
+};
+
+bool ipv6_route_cache_lookup(const uint8_t *dest, int8_t interface_id, ipv6_route_info_t *info_out);
+void ipv6_route_cache_store(const uint8_t *dest, int8_t interface_id, const ipv6_route_info_t *info);
+void ipv6_route_cache_flush(void);
+const struct ipv6_route_cache_stats *ipv6_route_cache_stats(void);
+void ipv6_route_cache_print(void);
 void ipv6_route_table_source_invalidated_reset(void);
 
 #endif /* IPV6_ROUTING_TABLE_H_ */
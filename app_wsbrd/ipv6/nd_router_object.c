@@ -42,13 +42,31 @@ static void nd_add_ipv6_neigh_route(struct net_if *net_if, struct ipv6_neighbour
 {
     ipv6_route_add_metric(neigh->ip_address, 128, net_if->id, neigh->ip_address,
                           ROUTE_ARO, NULL, 0, neigh->lifetime_s - 2, 32);
+    // Kernel entries are never removed, there is no need to add them again
+    if (neigh->proxied)
+        return;
     tun_add_node_to_proxy_neightbl(net_if, neigh->ip_address);
     tun_add_ipv6_direct_route(net_if, neigh->ip_address);
+    neigh->proxied = true;
+}
+
+/*
+ * Most registrations only refresh an existing one, and thus only move the
+ * expiration forward. The storage is then rewritten only once it lags by
+ * more than a quarter of the lifetime: after a reboot, a restored entry may
+ * expire this much earlier than registered.
+ */
+static bool nd_storage_outdated(const ipv6_neighbour_t *neigh, uint32_t prev_lifetime_s)
+{
+    if (neigh->lifetime_s != prev_lifetime_s || !neigh->lifetime_s)
+        return true;
+    return neigh->expiration_s - neigh->storage_expiration_s > neigh->lifetime_s / 4;
 }
 
 void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neigh, const struct ipv6_nd_opt_earo *aro,
                             struct ws_neigh *ws_neigh)
 {
+    uint32_t prev_lifetime_s = neigh->type == IP_NEIGHBOUR_REGISTERED ? neigh->lifetime_s : 0;
     struct rpl_target *target;
 
     TRACE(TR_NEIGH_IPV6, "IPv6 neighbor refresh %s / %s / %ds",
@@ -59,7 +77,7 @@ void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neig
     if (aro->status == NDP_ARO_STATUS_SUCCESS && aro->lifetime != 0) {
         neigh->type = IP_NEIGHBOUR_REGISTERED;
         neigh->lifetime_s = aro->lifetime * UINT32_C(60);
-        neigh->expiration_s = time_now_s(CLOCK_MONOTONIC) + neigh->lifetime_s;
+        neigh->expiration_s = time_cached_s() + neigh->lifetime_s;
         ipv6_neighbour_set_state(&cur_interface->ipv6_neighbour_cache, neigh, IP_NEIGHBOUR_STALE);
         /* Register with 2 seconds off the lifetime - don't want the NCE to expire before the route */
         if (!IN6_IS_ADDR_MULTICAST(neigh->ip_address)) {
@@ -77,12 +95,16 @@ void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neig
                 rpl_target_del(&cur_interface->rpl_root, target);
         }
     }
-    ipv6_neigh_storage_save(&cur_interface->ipv6_neighbour_cache, ipv6_neighbour_eui64(&cur_interface->ipv6_neighbour_cache, neigh));
+    ipv6_neighbour_lifetime_update(&cur_interface->ipv6_neighbour_cache, neigh);
+    if (nd_storage_outdated(neigh, prev_lifetime_s))
+        ipv6_neigh_storage_save(&cur_interface->ipv6_neighbour_cache, ipv6_neighbour_eui64(&cur_interface->ipv6_neighbour_cache, neigh));
 }
 
 void nd_remove_aro_routes_by_eui64(struct net_if *net_if, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, neigh, &net_if->ipv6_neighbour_cache.list)
+    ipv6_neighbour_t *neigh;
+
+    SLIST_FOREACH(neigh, ipv6_neighbour_eui64_bucket(&net_if->ipv6_neighbour_cache, eui64), eui64_link)
         if ((neigh->type == IP_NEIGHBOUR_REGISTERED || neigh->type == IP_NEIGHBOUR_TENTATIVE) &&
             !memcmp(ipv6_neighbour_eui64(&net_if->ipv6_neighbour_cache, neigh), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(neigh->ip_address))
@@ -91,7 +113,9 @@ void nd_remove_aro_routes_by_eui64(struct net_if *net_if, const uint8_t *eui64)
 
 void nd_restore_aro_routes_by_eui64(struct net_if *net_if, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, neigh, &net_if->ipv6_neighbour_cache.list)
+    ipv6_neighbour_t *neigh;
+
+    SLIST_FOREACH(neigh, ipv6_neighbour_eui64_bucket(&net_if->ipv6_neighbour_cache, eui64), eui64_link)
         if ((neigh->type == IP_NEIGHBOUR_REGISTERED || neigh->type == IP_NEIGHBOUR_TENTATIVE) &&
             !memcmp(ipv6_neighbour_eui64(&net_if->ipv6_neighbour_cache, neigh), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(neigh->ip_address))
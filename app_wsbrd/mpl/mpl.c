@@ -19,10 +19,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <sys/queue.h>
 #include "common/endian.h"
 #include "common/trickle_legacy.h"
 #include "common/rand.h"
 #include "common/bits.h"
+#include "common/fnv_hash.h"
 #include "common/log_legacy.h"
 #include "common/ns_list.h"
 #include "common/seqno.h"
@@ -48,6 +50,9 @@
 #define MAX_BUFFERED_MESSAGES_SIZE 8192
 #define MAX_BUFFERED_MESSAGE_LIFETIME 600 // 1/10 s ticks
 
+/* Number of buckets of the seed set index of a domain, as a power of 2 */
+#define MPL_SEED_HASH_BITS 6
+
 static uint16_t mpl_total_buffered;
 
 /* Note that we don't use a buffer_t, to save a little RAM. We don't need
@@ -59,20 +64,27 @@ typedef struct mpl_data_message {
     uint32_t timestamp;
     trickle_legacy_t trickle;
     ns_list_link_t link;
+    ns_list_link_t age_link;        /* link in mpl_buffered_messages */
+    struct mpl_seed *seed;
     uint16_t mpl_opt_data_offset;   /* offset to option data of MPL option */
     uint8_t message[];
 } mpl_buffered_message_t;
 
 typedef struct mpl_seed {
     ns_list_link_t link;
+    SLIST_ENTRY(mpl_seed) hash_link;
     bool colour;
     uint16_t lifetime;
     uint8_t min_sequence;
     uint8_t id_len;
     NS_LIST_HEAD(mpl_buffered_message_t, link) messages; /* sequence number order */
+    uint8_t buffered[256 / 8];      /* bitmap of the sequences in messages */
     uint8_t id[];
 } mpl_seed_t;
 
+// Declare struct mpl_seed_list
+SLIST_HEAD(mpl_seed_list, mpl_seed);
+
 /* For simplicity, we assume each MPL domain is on exactly 1 interface */
 struct mpl_domain {
     struct net_if *interface;
@@ -81,12 +93,16 @@ struct mpl_domain {
     bool colour;
     uint16_t seed_set_entry_lifetime;
     NS_LIST_HEAD(mpl_seed_t, link) seeds;
+    struct mpl_seed_list seed_hash[1 << MPL_SEED_HASH_BITS];
     trickle_legacy_params_t data_trickle_params;
     ns_list_link_t link;
     uint8_t seed_id_mode;
+    bool aggregate_tx;
 };
 
 static NS_LIST_DEFINE(mpl_domains, mpl_domain_t, link);
+/* All buffered messages, oldest first */
+static NS_LIST_DEFINE(mpl_buffered_messages, mpl_buffered_message_t, age_link);
 
 static void mpl_buffer_delete(mpl_seed_t *seed, mpl_buffered_message_t *message);
 static buffer_t *mpl_exthdr_provider(buffer_t *buf, ipv6_exthdr_stage_e stage, int16_t *result);
@@ -114,6 +130,12 @@ static uint16_t mpl_buffer_size(const mpl_buffered_message_t *message)
     return IPV6_HDRLEN + read_be16(message->message + IPV6_HDROFF_PAYLOAD_LENGTH);
 }
 
+void mpl_buffer_usage(unsigned int *count, size_t *bytes)
+{
+    *count = ns_list_count(&mpl_buffered_messages);
+    *bytes = mpl_total_buffered;
+}
+
 mpl_domain_t *mpl_domain_lookup(struct net_if *cur, const uint8_t address[16])
 {
     ns_list_foreach(mpl_domain_t, domain, &mpl_domains) {
@@ -186,6 +208,8 @@ mpl_domain_t *mpl_domain_create(struct net_if *cur, const uint8_t address[16],
     domain->sequence = rand_get_8bit();
     domain->colour = false;
     ns_list_init(&domain->seeds);
+    for (int i = 0; i < ARRAY_SIZE(domain->seed_hash); i++)
+        SLIST_INIT(&domain->seed_hash[i]);
     domain->seed_set_entry_lifetime = seed_set_entry_lifetime;
     domain->data_trickle_params = *data_trickle_params;
     ns_list_add_to_end(&mpl_domains, domain);
@@ -197,6 +221,11 @@ mpl_domain_t *mpl_domain_create(struct net_if *cur, const uint8_t address[16],
     return domain;
 }
 
+void mpl_domain_set_aggregate_tx(mpl_domain_t *domain, bool enable)
+{
+    domain->aggregate_tx = enable;
+}
+
 bool mpl_domain_delete(struct net_if *cur, const uint8_t address[16])
 {
     mpl_domain_t *domain = mpl_domain_lookup(cur, address);
@@ -223,13 +252,20 @@ bool mpl_domain_delete(struct net_if *cur, const uint8_t address[16])
     return true;
 }
 
-static mpl_seed_t *mpl_seed_lookup(const mpl_domain_t *domain, uint8_t id_len, const uint8_t *seed_id)
+static struct mpl_seed_list *mpl_seed_bucket(mpl_domain_t *domain, uint8_t id_len, const uint8_t *seed_id)
 {
-    ns_list_foreach(mpl_seed_t, seed, &domain->seeds) {
-        if (seed->id_len == id_len && memcmp(seed->id, seed_id, id_len) == 0) {
+    uint32_t hash = fnv_hash_reverse_32_init(seed_id, id_len);
+
+    return &domain->seed_hash[hash & (ARRAY_SIZE(domain->seed_hash) - 1)];
+}
+
+static mpl_seed_t *mpl_seed_lookup(mpl_domain_t *domain, uint8_t id_len, const uint8_t *seed_id)
+{
+    mpl_seed_t *seed;
+
+    SLIST_FOREACH(seed, mpl_seed_bucket(domain, id_len, seed_id), hash_link)
+        if (seed->id_len == id_len && memcmp(seed->id, seed_id, id_len) == 0)
             return seed;
-        }
-    }
 
     return NULL;
 }
@@ -246,8 +282,12 @@ static mpl_seed_t *mpl_seed_create(mpl_domain_t *domain, uint8_t id_len, const u
     seed->id_len = id_len;
     seed->colour = domain->colour;
     ns_list_init(&seed->messages);
+    memset(seed->buffered, 0, sizeof(seed->buffered));
     memcpy(seed->id, seed_id, id_len);
     ns_list_add_to_end(&domain->seeds, seed);
+    if (!g_timers[WS_TIMER_MPL].timeout)
+        ws_timer_start(WS_TIMER_MPL);
+    SLIST_INSERT_HEAD(mpl_seed_bucket(domain, id_len, seed_id), seed, hash_link);
     return seed;
 }
 
@@ -257,6 +297,7 @@ static void mpl_seed_delete(mpl_domain_t *domain, mpl_seed_t *seed)
         mpl_buffer_delete(seed, message);
     }
     ns_list_remove(&domain->seeds, seed);
+    SLIST_REMOVE(mpl_seed_bucket(domain, seed->id_len, seed->id), seed, mpl_seed, hash_link);
     free(seed);
 }
 
@@ -272,6 +313,9 @@ static void mpl_seed_advance_min_sequence(mpl_seed_t *seed, uint8_t min_sequence
 
 static mpl_buffered_message_t *mpl_buffer_lookup(mpl_seed_t *seed, uint8_t sequence)
 {
+    /* Most received messages are new, avoid walking the list for them */
+    if (!bittest(seed->buffered, sequence))
+        return NULL;
     ns_list_foreach(mpl_buffered_message_t, message, &seed->messages) {
         if (mpl_buffer_sequence(message) == sequence) {
             return message;
@@ -282,29 +326,17 @@ static mpl_buffered_message_t *mpl_buffer_lookup(mpl_seed_t *seed, uint8_t seque
 
 static void mpl_free_space(void)
 {
-    mpl_seed_t *oldest_seed = NULL;
-    mpl_buffered_message_t *oldest_message = NULL;
+    mpl_buffered_message_t *oldest_message = ns_list_get_first(&mpl_buffered_messages);
+    mpl_seed_t *oldest_seed;
 
     /* We'll free one message - earliest sequence number from one seed */
     /* Choose which seed by looking at the timestamp - oldest one first */
-    ns_list_foreach(mpl_domain_t, domain, &mpl_domains) {
-        ns_list_foreach(mpl_seed_t, seed, &domain->seeds) {
-            mpl_buffered_message_t *message = ns_list_get_first(&seed->messages);
-            if (!message) {
-                continue;
-            }
-            if (!oldest_message ||
-                    g_monotonic_time_100ms - message->timestamp > g_monotonic_time_100ms - oldest_message->timestamp) {
-                oldest_message = message;
-                oldest_seed = seed;
-            }
-        }
-    }
-
     if (!oldest_message) {
         return;
     }
 
+    oldest_seed = oldest_message->seed;
+    oldest_message = ns_list_get_first(&oldest_seed->messages);
     mpl_seed_advance_min_sequence(oldest_seed, mpl_buffer_sequence(oldest_message) + 1);
 }
 
@@ -344,7 +376,8 @@ static mpl_buffered_message_t *mpl_buffer_create(buffer_t *buf, mpl_domain_t *do
     message->message[IPV6_HDROFF_HOP_LIMIT] = hop_limit;
     message->mpl_opt_data_offset = buf->mpl_option_data_offset;
     message->colour = seed->colour;
-    message->timestamp = g_monotonic_time_100ms;
+    message->timestamp = ws_timer_monotonic_100ms();
+    message->seed = seed;
     /* Make sure trickle structure is initialised */
     trickle_legacy_start(&message->trickle, "MPL MSG", &domain->data_trickle_params);
 
@@ -366,6 +399,8 @@ static mpl_buffered_message_t *mpl_buffer_create(buffer_t *buf, mpl_domain_t *do
     if (!inserted) {
         ns_list_add_to_start(&seed->messages, message);
     }
+    bitset(seed->buffered, sequence);
+    ns_list_add_to_end(&mpl_buffered_messages, message);
     mpl_total_buffered += ip_len;
 
     return message;
@@ -374,7 +409,9 @@ static mpl_buffered_message_t *mpl_buffer_create(buffer_t *buf, mpl_domain_t *do
 static void mpl_buffer_delete(mpl_seed_t *seed, mpl_buffered_message_t *message)
 {
     mpl_total_buffered -= mpl_buffer_size(message);
+    bitclr(seed->buffered, mpl_buffer_sequence(message));
     ns_list_remove(&seed->messages, message);
+    ns_list_remove(&mpl_buffered_messages, message);
     free(message);
 }
 
@@ -585,12 +622,16 @@ bool mpl_forwarder_process_message(buffer_t *buf, mpl_domain_t *domain, bool see
 
 void mpl_timer(int seconds)
 {
+    bool pending = false;
+
     ns_list_foreach(mpl_domain_t, domain, &mpl_domains) {
         uint32_t message_age_limit = (domain->seed_set_entry_lifetime * UINT32_C(10)) / 4;
         if (message_age_limit > MAX_BUFFERED_MESSAGE_LIFETIME) {
             message_age_limit = MAX_BUFFERED_MESSAGE_LIFETIME;
         }
         ns_list_foreach_safe(mpl_seed_t, seed, &domain->seeds) {
+            bool transmitted = false;
+
             /* Count down seed lifetime, and expire immediately when hit */
             if (seed->lifetime > seconds) {
                 seed->lifetime -= seconds;
@@ -605,7 +646,7 @@ void mpl_timer(int seconds)
              */
             ns_list_foreach_safe(mpl_buffered_message_t, message, &seed->messages) {
                 if (!trickle_legacy_running(&message->trickle, &domain->data_trickle_params) &&
-                        g_monotonic_time_100ms - message->timestamp >= message_age_limit) {
+                        ws_timer_monotonic_100ms() - message->timestamp >= message_age_limit) {
                     /*
                      *   RFC 7731 7.4. Buffered Message Set
                      * All MPL Data Messages within a Buffered Message Set MUST have a
@@ -618,11 +659,28 @@ void mpl_timer(int seconds)
                     mpl_seed_advance_min_sequence(seed, mpl_buffer_sequence(message) + 1);
                     continue;
                 }
-                if (trickle_legacy_tick(&message->trickle, &domain->data_trickle_params, seconds))
+                if (trickle_legacy_tick(&message->trickle, &domain->data_trickle_params, seconds)) {
                     mpl_buffer_transmit(domain, message, ns_list_get_next(&seed->messages, message) == NULL);
+                    transmitted = true;
+                }
             }
+            /*
+             * Consecutive messages of a seed (eg. blocks of a firmware
+             * update) are sent back-to-back instead of each in its own
+             * slot of the trickle interval. Only transmissions still
+             * pending in the current interval are moved, so no extra
+             * copy is made.
+             */
+            if (domain->aggregate_tx && transmitted)
+                ns_list_foreach(mpl_buffered_message_t, message, &seed->messages)
+                    if (trickle_legacy_advance(&message->trickle, &domain->data_trickle_params))
+                        mpl_buffer_transmit(domain, message, ns_list_get_next(&seed->messages, message) == NULL);
         }
+        pending |= !ns_list_is_empty(&domain->seeds);
     }
+    // Restarted by mpl_seed_create()
+    if (!pending)
+        ws_timer_stop(WS_TIMER_MPL);
 }
 
 static buffer_t *mpl_exthdr_provider(buffer_t *buf, ipv6_exthdr_stage_e stage, int16_t *result)
@@ -18,6 +18,7 @@
 
 #ifndef MPL_H_
 #define MPL_H_
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -48,6 +49,10 @@ mpl_domain_t *mpl_domain_create(struct net_if *cur, const uint8_t address[16],
                                 uint16_t seed_set_entry_lifetime, uint8_t seed_id_mode,
                                 const struct trickle_legacy_params *data_trickle_params);
 mpl_domain_t *mpl_domain_lookup(struct net_if *cur, const uint8_t address[16]);
+/* Send the pending messages of a seed together when one of them is due */
+void mpl_domain_set_aggregate_tx(mpl_domain_t *domain, bool enable);
 bool mpl_domain_delete(struct net_if *cur, const uint8_t address[16]);
+// Messages buffered for retransmission, over all domains, and their IPv6 size
+void mpl_buffer_usage(unsigned int *count, size_t *bytes);
 
 #endif
@@ -23,6 +23,7 @@
 #include <limits.h>
 #include <sys/socket.h>
 #include "common/log_legacy.h"
+#include "common/memutils.h"
 
 #include "net/netaddr_types.h"
 
@@ -32,6 +33,92 @@
 
 volatile unsigned int buffer_count = 0;
 
+/*
+ * Buffers are allocated from a few size classes, which covers most packets
+ * (ACKs and control messages, 6LoWPAN frames, IPv6 minimum MTU, TUN MTU).
+ * Freed buffers are kept in a per-class free list so the packet paths do not
+ * call malloc() for every frame. The free lists are capped so that a burst
+ * of traffic does not keep memory allocated forever.
+ *
+ * Any buffer whose size is at most the largest class comes from a pool, and
+ * its size is then exactly the class size. Larger buffers use the heap.
+ */
+#define BUFFER_POOL_MAX_FREE 64
+
+static struct buffer_pool {
+    struct buffer_pool_stats stats;
+    unsigned int free_count;
+    buffer_list_t free_list;
+} buffer_pools[] = {
+    { .stats.size =  128, .free_list = NS_LIST_INIT(buffer_pools[0].free_list) },
+    { .stats.size =  512, .free_list = NS_LIST_INIT(buffer_pools[1].free_list) },
+    { .stats.size = 1280, .free_list = NS_LIST_INIT(buffer_pools[2].free_list) },
+    { .stats.size = 2048, .free_list = NS_LIST_INIT(buffer_pools[3].free_list) },
+};
+
+static struct buffer_pool *buffer_pool_get(uint32_t size)
+{
+    for (int i = 0; i < ARRAY_SIZE(buffer_pools); i++)
+        if (size <= buffer_pools[i].stats.size)
+            return &buffer_pools[i];
+    return NULL;
+}
+
+// Returns an uninitialized buffer, buf->size is set to the real size which
+// may be bigger than requested.
+static buffer_t *buffer_alloc(uint32_t size)
+{
+    struct buffer_pool *pool = buffer_pool_get(size);
+    buffer_t *buf;
+
+    if (!pool) {
+        buf = malloc(sizeof(buffer_t) + size);
+        FATAL_ON(!buf, 2);
+        buf->size = size;
+        return buf;
+    }
+    buf = ns_list_get_first(&pool->free_list);
+    if (buf) {
+        ns_list_remove(&pool->free_list, buf);
+        pool->free_count--;
+    } else {
+        buf = malloc(sizeof(buffer_t) + pool->stats.size);
+        FATAL_ON(!buf, 2);
+        pool->stats.miss_count++;
+    }
+    pool->stats.alloc_count++;
+    pool->stats.in_use++;
+    if (pool->stats.in_use > pool->stats.in_use_max)
+        pool->stats.in_use_max = pool->stats.in_use;
+    buf->size = pool->stats.size;
+    return buf;
+}
+
+static void buffer_release(buffer_t *buf)
+{
+    struct buffer_pool *pool = buffer_pool_get(buf->size);
+
+    if (!pool) {
+        free(buf);
+        return;
+    }
+    BUG_ON(buf->size != pool->stats.size);
+    pool->stats.in_use--;
+    if (pool->free_count >= BUFFER_POOL_MAX_FREE) {
+        free(buf);
+        return;
+    }
+    ns_list_add_to_start(&pool->free_list, buf);
+    pool->free_count++;
+}
+
+const struct buffer_pool_stats *buffer_pool_stats(int index)
+{
+    if (index < 0 || index >= ARRAY_SIZE(buffer_pools))
+        return NULL;
+    return &buffer_pools[index].stats;
+}
+
 uint8_t *buffer_corrupt_check(buffer_t *buf)
 {
     if (buf == NULL) {
@@ -82,8 +169,9 @@ buffer_t *buffer_get_specific(uint16_t headroom, uint16_t size, uint16_t minspac
 
     // Note - as well as this alloc+init, buffers can also be "realloced"
     // in buffer_headroom()
-    buf = malloc(sizeof(buffer_t) + total_size);
-    FATAL_ON(!buf, 2);
+    buf = buffer_alloc(total_size);
+    // The pool may give more space than requested, use it as extra headroom
+    total_size = buf->size;
 
     buffer_count++;
     memset(buf, 0, sizeof(buffer_t));
@@ -119,8 +207,8 @@ buffer_t *buffer_headroom(buffer_t *buf, uint16_t size)
         /* This buffer isn't big enough at all - allocate a new block */
         // TODO - should we be giving them extra? probably
         uint32_t new_total = (curr_len + size + 3) & ~ 3;
-        new_buf = malloc(sizeof(buffer_t) + new_total);
-        FATAL_ON(!new_buf, 2);
+        new_buf = buffer_alloc(new_total);
+        new_total = new_buf->size;
         // Copy the buffer_t header
         *new_buf = *buf;
         // Set new pointers, leaving specified headroom
@@ -129,7 +217,7 @@ buffer_t *buffer_headroom(buffer_t *buf, uint16_t size)
         new_buf->size = new_total;
         // Copy the current data
         memcpy(buffer_data_pointer(new_buf), buffer_data_pointer(buf), curr_len);
-        free(buf);
+        buffer_release(buf);
         buf = new_buf;
     } else if (buf->buf_ptr < size) {
         /* This buffer is big enough, but not enough headroom - shuffle */
@@ -172,7 +260,7 @@ buffer_t *buffer_free(buffer_t *buf)
         }
 
         buf = buffer_free_route(buf);
-        free(buf);
+        buffer_release(buf);
 
     } else {
         tr_error("nullp F");
@@ -92,6 +92,14 @@ typedef union buffer_link_info {
 #define IPEXT_FRAGMENT          0x20    /*!< Fragment header present - if set on entry to IP parsing this was reassembled packet */
 
 /** buffer option fields */
+// Strict priority lanes of the adaptation layer TX queue. A zero-initialized
+// buffer gets the lowest priority.
+enum buffer_tx_lane {
+    BUFFER_TX_LANE_DATA_LOW,
+    BUFFER_TX_LANE_DATA_HIGH, // DSCP CS4 and above (AF4x, EF, CS5-CS7)
+    BUFFER_TX_LANE_CONTROL,   // ND, RPL, ICMPv6 errors
+};
+
 typedef struct buffer_options {
     uint8_t hop_limit;                  /*!< IPv6 hop limit */
     uint8_t type;                       /*!< ICMP type, IP next header, MAC frame type... */
@@ -102,6 +110,7 @@ typedef struct buffer_options {
     bool    tunnelled: 1;               /*!< We tunnelled it as part of (RPL?) routing */
     bool    lfn_multicast: 1;           /*!< Buffer contain multicast data for LFN */
     bool    mpl_permitted: 1;           /*!< MPL will be used if enabled on interface and scope >=3 */
+    unsigned tx_lane: 2;                /*!< Lane of the adaptation layer TX queue, see enum buffer_tx_lane */
     signed  ipv6_use_min_mtu: 2;        /*!< Use minimum 1280-byte MTU (RFC 3542) - three settings +1, 0, -1 */
     uint8_t traffic_class;              /*!< Traffic class */
     int24_t flow_label;                 /*!< IPv6 flow label; -1 means unspecified (may auto-generate); -2 means auto-generate required */
@@ -162,6 +171,18 @@ typedef struct buffer_routing_info {
 } buffer_routing_info_t;
 
 /** buffer structure */
+/* Dates (CLOCK_MONOTONIC, in us) recorded along the TX path, 0 when the
+ * buffer did not go through the stage. Used for latency statistics. */
+enum buffer_tx_stage {
+    BUFFER_TX_STAGE_TUN,        /*!< Read from the TUN interface */
+    BUFFER_TX_STAGE_LOWPAN,     /*!< IPv6 processing done, entering lowpan_down() */
+    BUFFER_TX_STAGE_IPHC,       /*!< Header compressed */
+    BUFFER_TX_STAGE_ADAPTATION, /*!< Entered the adaptation layer */
+    BUFFER_TX_STAGE_MAC_FIRST,  /*!< First frame sent to the RCP */
+    BUFFER_TX_STAGE_MAC,        /*!< Last frame (fragment) sent to the RCP */
+    BUFFER_TX_STAGE_COUNT,
+};
+
 /* If adding pointers to this, ensure buffer_free and buffer_copy_metadata are informed */
 typedef struct buffer {
     ns_list_link_t      link;
@@ -176,6 +197,7 @@ typedef struct buffer {
     uint16_t            offset;                 /*!< Offset indicator (used in some upward paths) */
     bool                ip_routed_up: 1;
     uint32_t            adaptation_timestamp;   /*!< Timestamp when buffer pushed to adaptation interface. Unit 100ms */
+    uint64_t            tx_stage_us[BUFFER_TX_STAGE_COUNT];
     buffer_link_info_t  link_specific;
     uint16_t            mpl_option_data_offset;
     buffer_options_t    options;                /*!< Additional signal info etc */
@@ -191,6 +213,18 @@ static_assert(offsetof(buffer_t, link) == 0, "Some use NS_LIST_HEAD_INCOMPLETE")
 
 #define buffer_data_pointer_after_adjustment(x) buffer_corrupt_check(x)
 
+/** Usage statistics of a buffer size class */
+struct buffer_pool_stats {
+    uint16_t size;              /*!< Data size of buffers in this class */
+    unsigned int in_use;        /*!< Buffers currently allocated */
+    unsigned int in_use_max;    /*!< High-water mark of in_use */
+    unsigned int alloc_count;   /*!< Total number of allocations */
+    unsigned int miss_count;    /*!< Allocations which needed malloc() */
+};
+
+/** Get statistics of buffer size class index, or NULL if index is out of range */
+const struct buffer_pool_stats *buffer_pool_stats(int index);
+
 /** Allocate memory for a buffer_t from the heap */
 buffer_t *buffer_get(uint16_t size);
 
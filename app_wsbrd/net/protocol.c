@@ -47,20 +47,6 @@
 
 protocol_interface_list_t NS_LIST_NAME_INIT(protocol_interface_info_list);
 
-void icmp_fast_timer(int ticks)
-{
-    struct net_if *cur = protocol_stack_interface_info_get();
-
-    if (!cur)
-        return;
-
-    /* This gives us the RFC 4443 default (10 tokens/s, bucket size 10) */
-    cur->icmp_tokens += ticks;
-    if (cur->icmp_tokens > 10) {
-        cur->icmp_tokens = 10;
-    }
-}
-
 static uint32_t protocol_stack_interface_set_reachable_time(struct net_if *cur, uint32_t base_reachable_time)
 {
     cur->base_reachable_time = base_reachable_time;
@@ -84,20 +70,15 @@ void update_reachable_time(int seconds)
 
 void protocol_core_init(void)
 {
-    ws_timer_start(WS_TIMER_MONOTONIC_TIME);
     ws_timer_start(WS_TIMER_MPL);
     ws_timer_start(WS_TIMER_PAE_FAST);
     ws_timer_start(WS_TIMER_PAE_SLOW);
     ws_timer_start(WS_TIMER_IPV6_DESTINATION);
-    ws_timer_start(WS_TIMER_IPV6_ROUTE);
     ws_timer_start(WS_TIMER_CIPV6_FRAG);
-    ws_timer_start(WS_TIMER_ICMP_FAST);
     ws_timer_start(WS_TIMER_6LOWPAN_MLD_FAST);
     ws_timer_start(WS_TIMER_6LOWPAN_MLD_SLOW);
     ws_timer_start(WS_TIMER_6LOWPAN_ND);
     ws_timer_start(WS_TIMER_6LOWPAN_ADAPTATION);
-    ws_timer_start(WS_TIMER_6LOWPAN_NEIGHBOR_SLOW);
-    ws_timer_start(WS_TIMER_6LOWPAN_NEIGHBOR_FAST);
     ws_timer_start(WS_TIMER_6LOWPAN_CONTEXT);
     ws_timer_start(WS_TIMER_6LOWPAN_REACHABLE_TIME);
     ws_timer_start(WS_TIMER_WS_COMMON_FAST);
@@ -129,7 +110,6 @@ void protocol_init(struct net_if *entry, struct rcp *rcp, int mtu)
     entry->ws_info.ffn_gtk_index = 0;
     entry->mac_parameters.mtu = mtu;
     entry->rcp = rcp;
-    entry->icmp_tokens = 10;
     entry->cur_hop_limit = UNICAST_HOP_LIMIT_DEFAULT;
     protocol_stack_interface_set_reachable_time(entry, 30000);
     ns_list_link_init(entry, link);
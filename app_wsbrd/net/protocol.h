@@ -17,6 +17,7 @@
  */
 #ifndef _NS_PROTOCOL_H
 #define _NS_PROTOCOL_H
+#include "common/codel.h"
 #include "common/random_early_detection.h"
 #include "common/trickle_legacy.h"
 #include "common/ns_list.h"
@@ -48,7 +49,6 @@ struct net_if {
     struct mpl_domain *mpl_domain;
     ipv6_neighbour_cache_t ipv6_neighbour_cache;
 
-    uint16_t icmp_tokens; /* Token bucket for ICMP rate limiting */
     /* RFC 4861 Host Variables */
     uint8_t cur_hop_limit;
     uint16_t reachable_time_ttl;        // s
@@ -62,6 +62,8 @@ struct net_if {
     struct red_config llc_random_early_detection;
     struct red_config llc_eapol_random_early_detection;
     struct red_config pae_random_early_detection;
+    uint8_t aqm; // enum lowpan_aqm
+    struct codel_params codel_params;
     struct ws_info ws_info;
 
     struct rcp *rcp;
@@ -70,6 +72,10 @@ struct net_if {
 
     struct rpl_root rpl_root;
 
+    // Multicast to at most this many registered LFNs is replicated in unicast
+    // instead of waiting for an LFN broadcast slot, 0 to disable.
+    uint8_t lfn_mcast_unicast_max;
+
     void (*if_stack_buffer_handler)(buffer_t *);
     bool (*if_ns_transmit)(struct net_if *cur, ipv6_neighbour_t *neighCacheEntry, bool unicast, uint8_t seq);
     bool (*if_map_ip_to_link_addr)(struct net_if *cur, const uint8_t *ip_addr, enum addrtype *ll_type, const uint8_t **ll_addr_out);
@@ -84,7 +90,6 @@ extern protocol_interface_list_t protocol_interface_info_list;
 struct net_if *protocol_stack_interface_info_get();
 void protocol_init(struct net_if *net_if, struct rcp *rcp, int mtu);
 
-void icmp_fast_timer(int ticks);
 void update_reachable_time(int seconds);
 
 #endif
@@ -12,6 +12,7 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #include <assert.h>
+#include <limits.h>
 #include "6lowpan/lowpan_adaptation_interface.h"
 #include "6lowpan/fragmentation/cipv6_fragmenter.h"
 #include "ipv6/nd_router_object.h"
@@ -22,22 +23,42 @@
 #include "net/protocol.h"
 #include "mpl/mpl.h"
 #include "rpl/rpl.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
+#include "common/timer.h"
 #include "common/log.h"
 
 #include "timers.h"
 
-int g_monotonic_time_100ms = 0;
+/*
+ * The timers count down in ticks of WS_TIMER_GLOBAL_PERIOD_MS, from
+ * g_ws_timer_tick.origin_ms. Instead of waking up on every tick, the tick
+ * timer expires on the nearest timeout, and is stopped when no timer runs.
+ * Subsystems without pending work stop their timer with ws_timer_stop(), and
+ * start it again when new work arrives.
+ */
+static void ws_timer_cb(struct timer_group *group, struct timer_entry *timer);
+
+static struct {
+    struct timer_entry timer;
+    uint64_t origin_ms;
+} g_ws_timer_tick = {
+    .timer.callback = ws_timer_cb,
+};
 
-static void timer_update_monotonic_time(int ticks)
+uint32_t ws_timer_monotonic_100ms(void)
 {
-    g_monotonic_time_100ms += ticks;
+    static uint64_t start_ms;
+
+    if (!start_ms)
+        start_ms = time_now_ms(CLOCK_MONOTONIC);
+    return (time_now_ms(CLOCK_MONOTONIC) - start_ms) / 100;
 }
 
 static void timer_send_lpa(int time_update)
 {
     struct net_if *interface = protocol_stack_interface_info_get();
-    ws_mngt_lpa_send(&interface->ws_info, interface->ws_info.mngt.lpa_dst);
+    ws_mngt_lpa_timer_cb(&interface->ws_info);
 }
 
 static void timer_send_lts(int time_update)
@@ -55,28 +76,63 @@ static void timer_update_async(int time_update)
 #define timer_entry(name, callback, period_ms, is_periodic) \
     [WS_TIMER_##name] = { #name, callback, period_ms, is_periodic, 0 }
 struct ws_timer g_timers[] = {
-    timer_entry(MONOTONIC_TIME,         timer_update_monotonic_time,                100,                     true),
     timer_entry(MPL,                    mpl_timer,                                  1000,                    true),
     timer_entry(RPL,                    rpl_timer,                                  1000,                    true),
     timer_entry(IPV6_DESTINATION,       ipv6_destination_cache_timer,               DCACHE_GC_PERIOD * 1000, true),
-    timer_entry(IPV6_ROUTE,             ipv6_route_table_ttl_update,                1000,                    true),
     timer_entry(CIPV6_FRAG,             cipv6_frag_timer,                           1000,                    true),
-    timer_entry(ICMP_FAST,              icmp_fast_timer,                            100,                     true),
     timer_entry(PAE_FAST,               ws_pae_controller_fast_timer,               100,                     true),
     timer_entry(PAE_SLOW,               ws_pae_controller_slow_timer,               1000,                    true),
     timer_entry(ASYNC,                  timer_update_async,                         1000,                    true),
-    timer_entry(6LOWPAN_NEIGHBOR_SLOW,  ipv6_neighbour_cache_slow_timer,            1000,                    true),
-    timer_entry(6LOWPAN_NEIGHBOR_FAST,  ipv6_neighbour_cache_fast_timer,            100,                     true),
     timer_entry(6LOWPAN_REACHABLE_TIME, update_reachable_time,                      1000,                    true),
     timer_entry(LPA,                    timer_send_lpa,                             0,                       false),
     timer_entry(LTS,                    timer_send_lts,                             0,                       true),
 };
 static_assert(ARRAY_SIZE(g_timers) == WS_TIMER_COUNT, "missing timer declarations");
 
+// Move the origin to the last elapsed tick. Timers are never expired here.
+static void ws_timer_rebase(void)
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    uint64_t ticks;
+
+    if (!g_ws_timer_tick.origin_ms)
+        g_ws_timer_tick.origin_ms = now_ms;
+    ticks = (now_ms - g_ws_timer_tick.origin_ms) / WS_TIMER_GLOBAL_PERIOD_MS;
+    for (int i = 0; i < ARRAY_SIZE(g_timers); i++)
+        if (g_timers[i].timeout)
+            g_timers[i].timeout -= MIN(ticks, (uint64_t)g_timers[i].timeout - 1);
+    g_ws_timer_tick.origin_ms += ticks * WS_TIMER_GLOBAL_PERIOD_MS;
+}
+
+static void ws_timer_schedule(void)
+{
+    int timeout = INT_MAX;
+
+    for (int i = 0; i < ARRAY_SIZE(g_timers); i++)
+        if (g_timers[i].timeout)
+            timeout = MIN(timeout, g_timers[i].timeout);
+    if (timeout == INT_MAX)
+        timer_stop(NULL, &g_ws_timer_tick.timer);
+    else
+        timer_start_abs(NULL, &g_ws_timer_tick.timer,
+                        g_ws_timer_tick.origin_ms + timeout * WS_TIMER_GLOBAL_PERIOD_MS);
+}
+
+void ws_timer_start_ticks(enum timer_id id, int ticks)
+{
+    BUG_ON(ticks <= 0);
+    ws_timer_rebase();
+    g_timers[id].timeout = ticks;
+    ws_timer_schedule();
+}
+
 void ws_timer_start(enum timer_id id)
 {
     BUG_ON(g_timers[id].period_ms % WS_TIMER_GLOBAL_PERIOD_MS);
-    g_timers[id].timeout = g_timers[id].period_ms / WS_TIMER_GLOBAL_PERIOD_MS;
+    // Timers without period (not implemented) never expire
+    if (!g_timers[id].period_ms)
+        return;
+    ws_timer_start_ticks(id, g_timers[id].period_ms / WS_TIMER_GLOBAL_PERIOD_MS);
 }
 
 void ws_timer_stop(enum timer_id id)
@@ -84,20 +140,34 @@ void ws_timer_stop(enum timer_id id)
     g_timers[id].timeout = 0;
 }
 
-
-void ws_timer_cb(struct timer_group *group, struct timer_entry *timer)
+static void ws_timer_cb(struct timer_group *group, struct timer_entry *timer)
 {
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    bool expired[WS_TIMER_COUNT] = { };
+    uint64_t ticks;
+
+    ticks = (now_ms - g_ws_timer_tick.origin_ms) / WS_TIMER_GLOBAL_PERIOD_MS;
+    g_ws_timer_tick.origin_ms += ticks * WS_TIMER_GLOBAL_PERIOD_MS;
     for (int i = 0; i < ARRAY_SIZE(g_timers); i++) {
         if (!g_timers[i].timeout)
             continue;
-
-        g_timers[i].timeout--; // Always advance one tick at a time
-        if (g_timers[i].timeout)
+        if ((uint64_t)g_timers[i].timeout > ticks) {
+            g_timers[i].timeout -= ticks;
             continue;
+        }
+        g_timers[i].timeout = 0;
+        expired[i] = true;
+    }
 
+    // Timers started by the callbacks are not affected by the ticks above
+    for (int i = 0; i < ARRAY_SIZE(g_timers); i++) {
+        if (!expired[i])
+            continue;
+        // Restarted first, so the callback can stop it
+        if (g_timers[i].periodic)
+            g_timers[i].timeout = g_timers[i].period_ms / WS_TIMER_GLOBAL_PERIOD_MS;
         g_timers[i].callback(1);
         TRACE(TR_TIMERS, "timer: %s", g_timers[i].trace_name);
-        if (g_timers[i].periodic)
-            ws_timer_start(i);
     }
+    ws_timer_schedule();
 }
@@ -15,26 +15,19 @@
 #define WS_TIMERS_H
 
 #include <stdbool.h>
-
-struct timer_entry;
-struct timer_group;
+#include <stdint.h>
 
 #define WS_TIMER_GLOBAL_PERIOD_MS 50
 
 enum timer_id {
-    WS_TIMER_MONOTONIC_TIME,
     WS_TIMER_MPL,
     WS_TIMER_RPL,
     WS_TIMER_IPV6_DESTINATION,
-    WS_TIMER_IPV6_ROUTE,
     WS_TIMER_CIPV6_FRAG,
-    WS_TIMER_ICMP_FAST,
     WS_TIMER_6LOWPAN_MLD_FAST,
     WS_TIMER_6LOWPAN_MLD_SLOW,
     WS_TIMER_6LOWPAN_ND,
     WS_TIMER_6LOWPAN_ADAPTATION,
-    WS_TIMER_6LOWPAN_NEIGHBOR_SLOW,
-    WS_TIMER_6LOWPAN_NEIGHBOR_FAST,
     WS_TIMER_6LOWPAN_CONTEXT,
     WS_TIMER_6LOWPAN_REACHABLE_TIME,
     WS_TIMER_WS_COMMON_FAST,
@@ -47,7 +40,8 @@ enum timer_id {
     WS_TIMER_COUNT,
 };
 
-extern int g_monotonic_time_100ms;
+// Time since startup, in 100ms units
+uint32_t ws_timer_monotonic_100ms(void);
 
 // Expose timer array to avoid boilerplate API functions when "low level"
 // operation are needed.
@@ -60,9 +54,10 @@ struct ws_timer {
 };
 extern struct ws_timer g_timers[WS_TIMER_COUNT];
 
+// Start a timer for its period, or for a number of WS_TIMER_GLOBAL_PERIOD_MS
+// ticks. A running timer is restarted.
 void ws_timer_start(enum timer_id id);
+void ws_timer_start_ticks(enum timer_id id, int ticks);
 void ws_timer_stop(enum timer_id id);
 
-void ws_timer_cb(struct timer_group *group, struct timer_entry *timer);
-
 #endif
@@ -15,6 +15,8 @@
 #include <sys/socket.h>
 #include <netinet/icmp6.h>
 #include <netinet/in.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #include "net/timers.h"
 #include "app/wsbrd.h" // FIXME
@@ -31,8 +33,17 @@
 #include "common/specs/icmpv6.h"
 #include "common/specs/rpl.h"
 #include "rpl_lollipop.h"
+#include "rpl_storage.h"
 #include "rpl.h"
 
+// Maximum number of packets processed by a call to rpl_recv()
+#define RPL_RECV_BATCH        64
+// A 1280 byte DAO fits at most 63 Target options with a 128-bit prefix.
+#define RPL_DAO_TARGET_MAX    64
+// DAO-ACKs sent per RPL_DAO_ACK_PERIOD_MS
+#define RPL_DAO_ACK_BURST     16
+#define RPL_DAO_ACK_PERIOD_MS 50
+
 struct rpl_opt_target {
     uint8_t prefix_len;
     uint8_t prefix[16];
@@ -63,12 +74,64 @@ static const char *tr_icmp_rpl(uint8_t code)
     return val_to_str(code, rpl_codes, "unknown");
 }
 
+static unsigned int rpl_addr_hash(const uint8_t addr[16], int bits)
+{
+    uint64_t hi, lo;
+
+    // Addresses generally share their upper 64 bits, the multiplication
+    // spreads the differences found in the IID into the upper bits of the key.
+    memcpy(&hi, addr, 8);
+    memcpy(&lo, addr + 8, 8);
+    lo ^= hi;
+    lo *= UINT64_C(0x9e3779b97f4a7c15);
+    return lo >> (64 - bits);
+}
+
+static struct rpl_target_list *rpl_target_bucket(struct rpl_root *root, const uint8_t prefix[16])
+{
+    return &root->targets_hash[rpl_addr_hash(prefix, RPL_TARGET_HASH_BITS)];
+}
+
+static const uint8_t *rpl_parent_get(struct rpl_root *root, const uint8_t addr[16])
+{
+    struct rpl_parent_list *bucket = &root->parents_hash[rpl_addr_hash(addr, RPL_PARENT_HASH_BITS)];
+    struct rpl_parent *parent;
+
+    parent = SLIST_FIND(parent, bucket, link, !memcmp(parent->addr, addr, 16));
+    if (!parent) {
+        parent = zalloc(sizeof(struct rpl_parent));
+        memcpy(parent->addr, addr, 16);
+        SLIST_INSERT_HEAD(bucket, parent, link);
+    }
+    parent->refcount++;
+    return parent->addr;
+}
+
+static void rpl_parent_put(struct rpl_root *root, const uint8_t *addr)
+{
+    struct rpl_parent *parent = container_of(addr, struct rpl_parent, addr[0]);
+
+    BUG_ON(!parent->refcount);
+    if (--parent->refcount)
+        return;
+    SLIST_REMOVE(&root->parents_hash[rpl_addr_hash(addr, RPL_PARENT_HASH_BITS)],
+                 parent, rpl_parent, link);
+    free(parent);
+}
+
+static void rpl_transit_update_timer(struct rpl_root *root, struct rpl_target *target);
 struct rpl_target *rpl_target_get(struct rpl_root *root, const uint8_t prefix[16])
 {
     struct rpl_target *target;
 
-    return SLIST_FIND(target, &root->targets, link,
-                      !memcmp(target->prefix, prefix, 16));
+    target = SLIST_FIND(target, rpl_target_bucket(root, prefix), hash_link,
+                        !memcmp(target->prefix, prefix, 16));
+    if (!target && root->storage_pending) {
+        target = rpl_storage_load_target(root, prefix);
+        if (target)
+            rpl_transit_update_timer(root, target);
+    }
+    return target;
 }
 
 static void rpl_transit_expire(struct timer_group *group, struct timer_entry *timer);
@@ -77,8 +140,12 @@ struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16
     struct rpl_target *target = zalloc(sizeof(struct rpl_target));
 
     target->timer.callback = rpl_transit_expire;
+    // Targets appearing after an increment are not part of the refresh.
+    target->refresh_gen = root->refresh.gen;
     memcpy(target->prefix, prefix, 16);
     SLIST_INSERT_HEAD(&root->targets, target, link);
+    SLIST_INSERT_HEAD(rpl_target_bucket(root, target->prefix), target, hash_link);
+    root->srh_cache_gen++;
     if (root->on_target_add)
         root->on_target_add(root, target);
     return target;
@@ -87,10 +154,22 @@ struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16
 void rpl_target_del(struct rpl_root *root, struct rpl_target *target)
 {
     TRACE(TR_RPL, "rpl: target  remove prefix=%s", tr_ipv6_prefix(target->prefix, 128));
+    if (target->update_pending)
+        SLIST_REMOVE(&root->update_pending, target, rpl_target, update_link);
+    if (target->refresh_gen != root->refresh.gen)
+        root->refresh.total--;
     SLIST_REMOVE(&root->targets, target, rpl_target, link);
+    SLIST_REMOVE(rpl_target_bucket(root, target->prefix), target, rpl_target, hash_link);
+    root->srh_cache_gen++;
     if (root->on_target_del)
         root->on_target_del(root, target);
     timer_stop(&root->timer_group, &target->timer);
+    for (uint8_t i = 0; i < target->transits_len; i++)
+        if (target->transits[i].parent)
+            rpl_parent_put(root, target->transits[i].parent);
+    free(target->transits);
+    free(target->srh_cache.seg_list);
+    free(target->srh_cache.hdr);
     free(target);
 }
 
@@ -101,18 +180,85 @@ uint16_t rpl_target_count(struct rpl_root *root)
 
 struct rpl_transit *rpl_transit_preferred(struct rpl_root *root, struct rpl_target *target)
 {
-    for (uint8_t i = 0; i < root->pcs + 1; i++)
-        if (memzcmp(target->transits + i, sizeof(struct rpl_transit)))
+    for (uint8_t i = 0; i < target->transits_len; i++)
+        if (target->transits[i].parent)
             return target->transits + i;
     return NULL;
 }
 
+bool rpl_target_has_transit(const struct rpl_target *target)
+{
+    // rpl_transit_clear() never leaves an unassigned last entry.
+    return target->transits_len;
+}
+
+void rpl_transit_set(struct rpl_root *root, struct rpl_target *target, uint8_t i,
+                     const uint8_t parent[16], uint32_t path_lifetime_s)
+{
+    BUG_ON(i > root->pcs);
+    if (i >= target->transits_len) {
+        target->transits = realloc(target->transits, (i + 1) * sizeof(struct rpl_transit));
+        FATAL_ON(!target->transits, 2, "%s: cannot allocate memory", __func__);
+        memset(target->transits + target->transits_len, 0,
+               (i + 1 - target->transits_len) * sizeof(struct rpl_transit));
+        target->transits_len = i + 1;
+    }
+    if (target->transits[i].parent)
+        rpl_parent_put(root, target->transits[i].parent);
+    target->transits[i].parent = rpl_parent_get(root, parent);
+    target->transits[i].path_lifetime_s = path_lifetime_s;
+}
+
+void rpl_transit_clear(struct rpl_root *root, struct rpl_target *target, uint8_t i)
+{
+    if (i >= target->transits_len || !target->transits[i].parent)
+        return;
+    rpl_parent_put(root, target->transits[i].parent);
+    memset(target->transits + i, 0, sizeof(struct rpl_transit));
+    // Entries past transits_len stay allocated and 0-initialized.
+    while (target->transits_len && !target->transits[target->transits_len - 1].parent)
+        target->transits_len--;
+}
+
+// on_target_update() is deferred to rpl_target_update_flush(), so that a
+// target updated by several DAOs of a burst is only notified once.
+static void rpl_target_updated(struct rpl_root *root, struct rpl_target *target, bool updated_transit)
+{
+    // Any source route going through this target may be affected.
+    if (updated_transit)
+        root->srh_cache_gen++;
+    target->update_transit |= updated_transit;
+    if (target->update_pending)
+        return;
+    target->update_pending = true;
+    SLIST_INSERT_HEAD(&root->update_pending, target, update_link);
+}
+
+static void rpl_target_update_flush(struct rpl_root *root)
+{
+    bool updated_transit = false;
+    struct rpl_target *target;
+    bool updated = false;
+
+    while ((target = SLIST_FIRST(&root->update_pending))) {
+        SLIST_REMOVE_HEAD(&root->update_pending, update_link);
+        target->update_pending = false;
+        updated_transit |= target->update_transit;
+        updated = true;
+        if (root->on_target_update)
+            root->on_target_update(root, target, target->update_transit);
+        target->update_transit = false;
+    }
+    if (updated && root->on_target_update_done)
+        root->on_target_update_done(root, updated_transit);
+}
+
 static void rpl_transit_update_timer(struct rpl_root *root, struct rpl_target *target)
 {
     uint64_t expire_s = UINT64_MAX;
 
-    for (uint8_t i = 0; i < root->pcs + 1; i++) {
-        if (!memzcmp(target->transits + i, sizeof(struct rpl_transit)))
+    for (uint8_t i = 0; i < target->transits_len; i++) {
+        if (!target->transits[i].parent)
             continue;
         if (expire_s > target->path_seq_tstamp_s + target->transits[i].path_lifetime_s)
             expire_s = target->path_seq_tstamp_s + target->transits[i].path_lifetime_s;
@@ -127,21 +273,21 @@ static void rpl_transit_expire(struct timer_group *group, struct timer_entry *ti
     time_t elapsed;
 
     elapsed = time_get_elapsed(CLOCK_MONOTONIC, target->path_seq_tstamp_s);
-    for (uint8_t i = 0; i < root->pcs + 1; i++) {
-        if (!memzcmp(target->transits + i, sizeof(struct rpl_transit)))
+    for (uint8_t i = target->transits_len; i--; ) {
+        if (!target->transits[i].parent)
             continue;
         if (elapsed < target->transits[i].path_lifetime_s)
             continue;
         TRACE(TR_RPL, "rpl: transit expire target=%s parent=%s path-ctl-bit=%u",
                 tr_ipv6_prefix(target->prefix, 128), tr_ipv6(target->transits[i].parent), i);
-        memset(target->transits + i, 0, sizeof(struct rpl_transit));
+        rpl_transit_clear(root, target, i);
     }
-    if (!memzcmp(target->transits, sizeof(target->transits))) {
+    if (!rpl_target_has_transit(target)) {
         rpl_target_del(root, target);
     } else {
         rpl_transit_update_timer(root, target);
-        if (root->on_target_update)
-            root->on_target_update(root, target, true);
+        rpl_target_updated(root, target, true);
+        rpl_target_update_flush(root);
     }
 }
 
@@ -158,10 +304,39 @@ static void rpl_dio_trickle_params(struct rpl_root *root, struct trickle_legacy_
     params->TimerExpirations = TRICKLE_EXPIRATIONS_INFINITE;
 }
 
+static void rpl_refresh_start(struct rpl_root *root)
+{
+    root->refresh.gen++;
+    root->refresh.start_s = time_now_s(CLOCK_MONOTONIC);
+    root->refresh.total   = rpl_target_count(root);
+    root->refresh.done    = 0;
+}
+
+static void rpl_refresh_target(struct rpl_root *root, struct rpl_target *target)
+{
+    if (target->refresh_gen == root->refresh.gen)
+        return;
+    target->refresh_gen = root->refresh.gen;
+    root->refresh.done++;
+    if (root->refresh.done == root->refresh.total)
+        INFO("rpl: refresh complete targets=%d duration=%ds", root->refresh.total,
+             (int)time_get_elapsed(CLOCK_MONOTONIC, root->refresh.start_s));
+}
+
+// A refresh is considered over once every target has sent a DAO, or after
+// the default route lifetime since nodes which did not answer have expired.
+bool rpl_refresh_in_progress(struct rpl_root *root)
+{
+    if (!root->refresh.gen || root->refresh.done >= root->refresh.total)
+        return false;
+    return time_get_elapsed(CLOCK_MONOTONIC, root->refresh.start_s) < root->lifetime_s;
+}
+
 void rpl_dodag_version_inc(struct rpl_root *root)
 {
     struct trickle_legacy_params dio_trickle_params;
 
+    rpl_refresh_start(root);
     root->dodag_version_number = rpl_lollipop_inc(root->dodag_version_number);
     //   RFC 6550 - 8.3. DIO Transmission
     // The following packets and events MUST be considered inconsistencies with
@@ -176,7 +351,13 @@ void rpl_dtsn_inc(struct rpl_root *root)
 {
     struct trickle_legacy_params dio_trickle_params;
 
+    rpl_refresh_start(root);
     root->dtsn++;
+    // A DTSN increment is not an inconsistency in RFC 6550 section 8.3. When
+    // the Trickle timer is not reset, the new DTSN is first advertised at the
+    // current interval, which spreads the DAOs of the first-hop sub-DODAGs.
+    if (root->paced_refresh)
+        return;
     rpl_dio_trickle_params(root, &dio_trickle_params);
     trickle_legacy_inconsistent(&root->dio_trickle, &dio_trickle_params);
 }
@@ -215,6 +396,7 @@ static void rpl_opt_push_config(struct iobuf_write *buf, struct rpl_root *root)
     bitfield |= FIELD_PREP(RPL_MASK_OPT_CONFIG_A, 0);
     bitfield |= FIELD_PREP(RPL_MASK_OPT_CONFIG_PCS, root->pcs);
     bitfield |= FIELD_PREP(RPL_MASK_OPT_CONFIG_RPI, root->rpi_ignorable);
+    bitfield |= FIELD_PREP(RPL_MASK_OPT_CONFIG_T, root->compress_6lorh);
     iobuf_push_u8(buf, bitfield);
     iobuf_push_u8(buf, root->dio_i_doublings);
     iobuf_push_u8(buf, root->dio_i_min);
@@ -305,6 +487,12 @@ static void rpl_send_dio(struct rpl_root *root, const uint8_t dst[16])
     iobuf_free(&buf);
 }
 
+struct rpl_dao_ack {
+    uint8_t dst[16];
+    uint8_t dao_seq;
+    STAILQ_ENTRY(rpl_dao_ack) link;
+};
+
 static void rpl_send_dao_ack(struct rpl_root *root, const uint8_t dst[16], uint8_t dao_seq)
 {
     struct iobuf_write buf = { };
@@ -318,6 +506,36 @@ static void rpl_send_dao_ack(struct rpl_root *root, const uint8_t dst[16], uint8
     iobuf_free(&buf);
 }
 
+static void rpl_dao_ack_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct rpl_root *root = container_of(timer, struct rpl_root, dao_ack_timer);
+    struct rpl_dao_ack *ack;
+
+    for (int i = 0; i < RPL_DAO_ACK_BURST && (ack = STAILQ_FIRST(&root->dao_ack_queue)); i++) {
+        STAILQ_REMOVE_HEAD(&root->dao_ack_queue, link);
+        rpl_send_dao_ack(root, ack->dst, ack->dao_seq);
+        free(ack);
+    }
+    if (STAILQ_EMPTY(&root->dao_ack_queue))
+        timer_stop(&root->timer_group, &root->dao_ack_timer);
+}
+
+// DAO-ACKs are sent once the DAOs of the current burst are applied, and are
+// spread over time since a DAO storm would otherwise fill the TX queues.
+static void rpl_queue_dao_ack(struct rpl_root *root, const uint8_t dst[16], uint8_t dao_seq)
+{
+    struct rpl_dao_ack *ack = zalloc(sizeof(*ack));
+
+    memcpy(ack->dst, dst, 16);
+    ack->dao_seq = dao_seq;
+    STAILQ_INSERT_TAIL(&root->dao_ack_queue, ack, link);
+    if (timer_stopped(&root->dao_ack_timer)) {
+        root->dao_ack_timer.callback  = rpl_dao_ack_timer;
+        root->dao_ack_timer.period_ms = RPL_DAO_ACK_PERIOD_MS;
+        timer_start_rel(&root->timer_group, &root->dao_ack_timer, 0);
+    }
+}
+
 // RFC 6550 - 6.7.9. Solicited Information
 static bool rpl_opt_solicit_matches(struct iobuf_read *opt_buf, struct rpl_root *root)
 {
@@ -421,12 +639,12 @@ static void rpl_transit_update(struct rpl_root *root,
     bool path_ctl_desync, path_ctl_old;
     bool updated_lifetime = false;
     bool updated_transit = false;
-    struct rpl_transit transit;
+    uint32_t path_lifetime_s;
+    struct rpl_transit *cur;
     struct rpl_target *target;
 
     BUG_ON(opt_target->prefix_len != 128);
-    memcpy(transit.parent, opt_transit->parent, 16);
-    transit.path_lifetime_s = opt_transit->path_lifetime * root->lifetime_unit_s;
+    path_lifetime_s = opt_transit->path_lifetime * root->lifetime_unit_s;
 
     target = rpl_target_get(root, opt_target->prefix);
     if (!target) {
@@ -434,7 +652,7 @@ static void rpl_transit_update(struct rpl_root *root,
         BUG_ON(!target);
         target->external = opt_transit->external;
         target->path_seq = opt_transit->path_seq;
-        target->path_seq_tstamp_s = time_now_s(CLOCK_MONOTONIC);
+        target->path_seq_tstamp_s = time_cached_s();
         updated_lifetime = true;
         TRACE(TR_RPL, "rpl: target  new    prefix=%s path-seq=%u external=%u",
               tr_ipv6_prefix(target->prefix, 128), target->path_seq, target->external);
@@ -442,10 +660,11 @@ static void rpl_transit_update(struct rpl_root *root,
 
     if (root->compat) {
         target->path_seq = opt_transit->path_seq;
-        target->path_seq_tstamp_s = time_now_s(CLOCK_MONOTONIC);
+        target->path_seq_tstamp_s = time_cached_s();
         updated_lifetime = true;
         TRACE(TR_RPL, "rpl: target  update prefix=%s path-seq=%u",
               tr_ipv6_prefix(target->prefix, 128), target->path_seq);
+        rpl_refresh_target(root, target);
     } else {
         path_ctl_desync = rpl_lollipop_desync(opt_transit->path_seq, target->path_seq);
         path_ctl_old    = rpl_lollipop_cmp(opt_transit->path_seq, target->path_seq) < 0;
@@ -456,13 +675,15 @@ static void rpl_transit_update(struct rpl_root *root,
             return;
         }
         if (rpl_lollipop_cmp(opt_transit->path_seq, target->path_seq) > 0) {
-            memset(target->transits, 0, sizeof(target->transits));
+            for (uint8_t i = target->transits_len; i--; )
+                rpl_transit_clear(root, target, i);
             updated_lifetime = true;
             target->path_seq = opt_transit->path_seq;
-            target->path_seq_tstamp_s = time_now_s(CLOCK_MONOTONIC);
+            target->path_seq_tstamp_s = time_cached_s();
             updated_transit = true;
             TRACE(TR_RPL, "rpl: target  update prefix=%s path-seq=%u",
                   tr_ipv6_prefix(target->prefix, 128), target->path_seq);
+            rpl_refresh_target(root, target);
         }
     }
 
@@ -472,56 +693,22 @@ static void rpl_transit_update(struct rpl_root *root,
     for (uint8_t i = 0; i < root->pcs + 1; i++) {
         if (!(opt_transit->path_ctl & BIT(7 - i)))
             continue;
-        if (!memcmp(target->transits + i, &transit, sizeof(struct rpl_transit)))
+        cur = i < target->transits_len ? target->transits + i : NULL;
+        if (cur && cur->parent && !memcmp(cur->parent, opt_transit->parent, 16) &&
+            cur->path_lifetime_s == path_lifetime_s)
             continue;
-        if (memzcmp(target->transits + i, sizeof(struct rpl_transit)) &&
-            memcmp(target->transits + i, &transit, sizeof(struct rpl_transit)) && !root->compat)
+        if (cur && cur->parent && !root->compat)
             WARN("%s: overwrite", __func__);
-        target->transits[i] = transit;
+        rpl_transit_set(root, target, i, opt_transit->parent, path_lifetime_s);
         updated_transit = true;
         TRACE(TR_RPL, "rpl: transit new    target=%s parent=%s path-ctl-bit=%u",
               tr_ipv6_prefix(target->prefix, 128), tr_ipv6(target->transits[i].parent), i);
     }
-    if ((updated_lifetime || updated_transit) && root->on_target_update)
-        root->on_target_update(root, target, updated_transit);
+    if (updated_lifetime || updated_transit)
+        rpl_target_updated(root, target, updated_transit);
     rpl_transit_update_timer(root, target);
 }
 
-static bool rpl_apply_transits(struct rpl_root *root, struct rpl_opt_target *opt_target, const uint8_t *opts,
-                               size_t opts_len)
-{
-    struct rpl_opt_transit opt_transit;
-    struct iobuf_read opt_buf;
-    struct iobuf_read buf = {
-        .data_size = opts_len,
-        .data = opts,
-    };
-    bool has_transit = false;
-    uint8_t opt_type;
-
-    while (iobuf_remaining_size(&buf)) {
-        opt_type = iobuf_pop_u8(&buf);
-        if (opt_type == RPL_OPT_PAD1)
-            continue;
-        opt_buf.data_size = iobuf_pop_u8(&buf);
-        opt_buf.data      = iobuf_pop_data_ptr(&buf, opt_buf.data_size);
-        opt_buf.err       = buf.err;
-        opt_buf.cnt       = 0;
-        if (opt_type == RPL_OPT_PADN)
-            continue;
-        if (opt_type == RPL_OPT_TARGET && !has_transit)
-            continue; // Skip grouped target options
-        if (opt_type != RPL_OPT_TRANSIT)
-            break; // No more transits for the current target
-        if (rpl_opt_transit_parse(&opt_buf, &opt_transit)) {
-            has_transit = true;
-            rpl_transit_update(root, opt_target, &opt_transit);
-        }
-        buf.err |= opt_buf.err;
-    }
-    return !buf.err;
-}
-
 static void rpl_recv_dao(struct rpl_root *root, const uint8_t *pkt, size_t size,
                          const uint8_t src[16], const uint8_t dst[16])
 {
@@ -530,14 +717,17 @@ static void rpl_recv_dao(struct rpl_root *root, const uint8_t *pkt, size_t size,
         .data_size = size,
         .data = pkt,
     };
+    struct rpl_opt_target opt_targets[RPL_DAO_TARGET_MAX];
+    struct rpl_opt_transit opt_transit;
     const uint8_t *dodag_id = NULL;
-    struct rpl_opt_target opt_target;
-    bool has_target = false;
+    bool has_transit = false;
+    int opt_targets_len = 0;
     uint8_t instance_id;
     uint8_t bitfield;
     uint8_t opt_type;
     uint8_t dao_seq;
 
+    root->dao_rx_count++;
     if (IN6_IS_ADDR_MULTICAST(dst)) {
         TRACE(TR_DROP, "drop %-9s: unsupported multicast DAO", "rpl-dao");
         return;
@@ -566,22 +756,39 @@ static void rpl_recv_dao(struct rpl_root *root, const uint8_t *pkt, size_t size,
         case RPL_OPT_PADN:
             break;
         case RPL_OPT_TARGET:
-            if (!rpl_opt_target_parse(&opt_buf, &opt_target))
+            // RFC 6550 - 9.4. Structure of DAO Messages
+            // A set of one or more Transit Information options applies to
+            // the preceding group of Target options.
+            if (has_transit) {
+                opt_targets_len = 0;
+                has_transit = false;
+            }
+            if (opt_targets_len == ARRAY_SIZE(opt_targets)) {
+                TRACE(TR_IGNORE, "ignore: rpl-dao too many grouped targets");
                 break;
-            if (opt_target.prefix_len != 128) {
+            }
+            if (!rpl_opt_target_parse(&opt_buf, &opt_targets[opt_targets_len]))
+                break;
+            if (opt_targets[opt_targets_len].prefix_len != 128) {
                 TRACE(TR_IGNORE, "ignore: rpl-dao target prefix length != 128");
                 break;
             }
-            opt_buf.err = !rpl_apply_transits(root, &opt_target, iobuf_ptr(&buf), iobuf_remaining_size(&buf));
-            has_target = true;
+            opt_targets_len++;
             break;
         case RPL_OPT_TRANSIT:
-            // Transits are handled in rpl_apply_transit()
-            if (!has_target)
+            if (!opt_targets_len) {
                 TRACE(TR_IGNORE, "ignore: rpl-dao transit without target");
+                break;
+            }
+            if (!rpl_opt_transit_parse(&opt_buf, &opt_transit))
+                break;
+            for (int i = 0; i < opt_targets_len; i++)
+                rpl_transit_update(root, &opt_targets[i], &opt_transit);
+            has_transit = true;
             break;
         default:
-            has_target = false;
+            opt_targets_len = 0;
+            has_transit = false;
             TRACE(TR_IGNORE, "ignore: rpl-dao unsupported option %u", opt_type);
             break;
         }
@@ -592,7 +799,7 @@ static void rpl_recv_dao(struct rpl_root *root, const uint8_t *pkt, size_t size,
         return;
     }
     if (FIELD_GET(RPL_MASK_DAO_K, bitfield))
-        rpl_send_dao_ack(root, src, dao_seq);
+        rpl_queue_dao_ack(root, src, dao_seq);
 }
 
 void rpl_recv_srh_err(struct rpl_root *root,
@@ -632,16 +839,16 @@ void rpl_recv_srh_err(struct rpl_root *root,
         TRACE(TR_DROP, "drop %-9s: unknown target=%s", "rpl-srh-err", tr_ipv6(dst));
         return;
     }
-    for (uint8_t i = 0; i < root->pcs + 1; i++) {
-        if (!memcmp(target->transits[i].parent, src, 16)) {
-            memset(target->transits + i, 0, sizeof(struct rpl_transit));
+    for (uint8_t i = target->transits_len; i--; ) {
+        if (target->transits[i].parent && !memcmp(target->transits[i].parent, src, 16)) {
+            rpl_transit_clear(root, target, i);
             updated = true;
             TRACE(TR_RPL, "rpl: transit remove target=%s parent=%s path-ctl-bit=%u",
                   tr_ipv6_prefix(dst, 128), tr_ipv6(src), i);
         }
     }
-    if (updated && root->on_target_update)
-        root->on_target_update(root, target, true);
+    if (updated)
+        rpl_target_updated(root, target, true);
 }
 
 static void rpl_recv_dispatch(struct rpl_root *root, const uint8_t *pkt, size_t size,
@@ -687,7 +894,8 @@ static void rpl_recv_dispatch(struct rpl_root *root, const uint8_t *pkt, size_t
     }
 }
 
-void rpl_recv(struct rpl_root *root)
+// Return false if no packet was pending.
+static bool rpl_recv_one(struct rpl_root *root, int flags)
 {
     uint8_t cmsgbuf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
     struct sockaddr_in6 src;
@@ -708,11 +916,13 @@ void rpl_recv(struct rpl_root *root)
     struct cmsghdr *cmsg;
     ssize_t size;
 
-    size = xrecvmsg(root->sockfd, &msg, 0);
+    size = xrecvmsg(root->sockfd, &msg, flags);
+    if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return false;
     FATAL_ON(size < 0, 2, "%s: recvmsg: %m", __func__);
     if (msg.msg_namelen != sizeof(src) || src.sin6_family != AF_INET6) {
         TRACE(TR_DROP, "drop %-9s: source address not IPv6", "rpl");
-        return;
+        return true;
     }
     cmsg = CMSG_FIRSTHDR(&msg);
     BUG_ON(!cmsg);
@@ -722,6 +932,16 @@ void rpl_recv(struct rpl_root *root)
     pktinfo = (struct in6_pktinfo *)CMSG_DATA(cmsg);
     rpl_recv_dispatch(root, iov.iov_base, size,
                       src.sin6_addr.s6_addr, pktinfo->ipi6_addr.s6_addr);
+    return true;
+}
+
+void rpl_recv(struct rpl_root *root)
+{
+    // The socket is known to be readable, only the following reads may block
+    for (int i = 0; i < RPL_RECV_BATCH; i++)
+        if (!rpl_recv_one(root, i ? MSG_DONTWAIT : 0))
+            break;
+    rpl_target_update_flush(root);
 }
 
 void rpl_start(struct rpl_root *root,
@@ -760,6 +980,7 @@ void rpl_start(struct rpl_root *root,
     rpl_dio_trickle_params(root, &dio_trickle_params);
     trickle_legacy_start(&root->dio_trickle, "RPL DIO", &dio_trickle_params);
     timer_group_init(&root->timer_group);
+    STAILQ_INIT(&root->dao_ack_queue);
     SLIST_FOREACH(target, &root->targets, link)
         rpl_transit_update_timer(root, target);
     ws_timer_start(WS_TIMER_RPL);
@@ -36,11 +36,15 @@
  *
  * Once started, the caller has to poll (with poll() or equivalent)
  * rpl_root->sockfd for any incoming packets, and call rpl_recv() when ready.
+ * rpl_recv() processes every pending packet at once: on_target_update() is
+ * called a single time per updated target, followed by on_target_update_done(),
+ * and DAO-ACKs are sent afterwards a few at a time.
  * Additionally rpl_timer() must be setup as a timer callback with the timer ID
  * WS_TIMER_RPL in order to run the trickle algorithm for DIO packets.
  *
  * Some information are stored to disk using rpl_storage.h. They can be restored on
- * reboot by calling rpl_storage_load() before rpl_start().
+ * reboot by calling rpl_storage_load() before rpl_start(). Targets are restored
+ * in the background after that, or when looked up with rpl_target_get().
  *
  * Known limitations:
  * - The RPL Packet Information (RPI) option is never inserted in IPv6 packets.
@@ -68,9 +72,21 @@
  * bit. The handling of path control bits is also made easier that way.
  */
 
+/*
+ * Targets mostly share a small set of parents (the routers of the PAN), so
+ * parent addresses are interned in rpl_root.parents_hash and transits only
+ * reference them. Two transits have the same parent if and only if their
+ * parent pointers are equal.
+ */
+struct rpl_parent {
+    uint8_t addr[16];
+    unsigned int refcount;
+    SLIST_ENTRY(rpl_parent) link;
+};
+
 struct rpl_transit {
+    const uint8_t *parent; // rpl_parent.addr, NULL for an unassigned bit
     uint32_t path_lifetime_s;
-    uint8_t  parent[16];
 };
 
 struct rpl_target {
@@ -83,15 +99,49 @@ struct rpl_target {
     time_t path_seq_tstamp_s;
     // One entry per bit in the path control field, from MSB to LSB (index 0
     // corresponds to the most preferred parent). An unassigned path control
-    // bit maps to a 0-initialized transit.
-    struct rpl_transit transits[8];
+    // bit maps to a 0-initialized transit. The array is allocated up to the
+    // last assigned bit, see rpl_transit_set() and rpl_transit_clear().
+    struct rpl_transit *transits;
+    uint8_t transits_len;
+
+    // Result of the last rpl_srh_build() towards this target, only valid
+    // while generation matches rpl_root.srh_cache_gen.
+    struct {
+        uint64_t generation;
+        bool     valid;
+        uint8_t  seg_count;
+        uint8_t  (*seg_list)[16]; // In SRH order
+        uint8_t  nxthop[16];
+        // Encoded header, built on demand by rpl_srh_build_hdr()
+        uint8_t  *hdr;
+        uint16_t hdr_len;
+    } srh_cache;
 
     struct timer_entry timer;
     SLIST_ENTRY(rpl_target) link;
+    SLIST_ENTRY(rpl_target) hash_link;
+    // Linked in rpl_root.storage_dirty
+    bool storage_dirty;
+    SLIST_ENTRY(rpl_target) storage_link;
+    // Linked in rpl_root.update_pending
+    bool update_pending;
+    bool update_transit;
+    SLIST_ENTRY(rpl_target) update_link;
+    // Value of rpl_root.refresh.gen when the last DAO was received
+    uint32_t refresh_gen;
 };
 
 // Declare struct rpl_target_list
 SLIST_HEAD(rpl_target_list, rpl_target);
+// Declare struct rpl_parent_list
+SLIST_HEAD(rpl_parent_list, rpl_parent);
+// Declare struct rpl_dao_ack_list
+STAILQ_HEAD(rpl_dao_ack_list, rpl_dao_ack);
+
+// Number of buckets in the target index of struct rpl_root, as a power of 2.
+#define RPL_TARGET_HASH_BITS 12
+// Number of buckets in the parent table of struct rpl_root, as a power of 2.
+#define RPL_PARENT_HASH_BITS 8
 
 struct rpl_root {
     int sockfd;
@@ -111,10 +161,14 @@ struct rpl_root {
     uint8_t dtsn; // DAO Trigger Sequence Number
     uint8_t pcs;  // Path Control Size
     bool    rpi_ignorable;
+    bool    compress_6lorh; // RFC 8138, signaled with the T flag (RFC 9035)
 
     void (*on_target_add)(struct rpl_root *root, struct rpl_target *target);
     void (*on_target_del)(struct rpl_root *root, struct rpl_target *target);
     void (*on_target_update)(struct rpl_root *root, struct rpl_target *target, bool updated_transit);
+    // Called after a series of on_target_update(), updated_transit is set if
+    // it was set for any of them.
+    void (*on_target_update_done)(struct rpl_root *root, bool updated_transit);
 
     // When enabled, some parts of the specification are ignored in order to
     // hopefully improve interoperability with faulty devices.
@@ -124,8 +178,45 @@ struct rpl_root {
     // - Source Routing Header compression always uses CmprI = CmprE.
     bool compat;
 
+    // Call fsync() on every file written by rpl_storage_flush().
+    bool storage_fsync;
+
+    // Do not reset the DIO Trickle timer on DTSN increment, the new DTSN is
+    // advertised by the next periodic DIO instead, and refuse increments while
+    // a previous refresh is in progress, see rpl_refresh_in_progress().
+    bool paced_refresh;
+    // Progress of the last DTSN or DODAG Version increment. A target counts as
+    // refreshed once a DAO with a new Path Sequence is received for it.
+    struct {
+        uint32_t gen;
+        time_t   start_s;
+        int      total;
+        int      done;
+    } refresh;
+
     struct timer_group timer_group;
     struct rpl_target_list targets;
+    // Index of targets by prefix, used by rpl_target_get() which is called
+    // for every hop when building a source routing header.
+    struct rpl_target_list targets_hash[1 << RPL_TARGET_HASH_BITS];
+    // Parent addresses referenced by rpl_transit.parent
+    struct rpl_parent_list parents_hash[1 << RPL_PARENT_HASH_BITS];
+    // Incremented whenever a route may have changed, which invalidates every
+    // cached source routing header at once.
+    uint64_t srh_cache_gen;
+    // Targets waiting to be written by rpl_storage_flush()
+    struct rpl_target_list storage_dirty;
+    struct timer_entry storage_timer;
+    // Target files not restored yet, see rpl_storage_load()
+    char **storage_pending;
+    int storage_pending_index;
+    struct timer_entry storage_load_timer;
+    // Targets waiting for on_target_update()
+    struct rpl_target_list update_pending;
+    struct rpl_dao_ack_list dao_ack_queue;
+    struct timer_entry dao_ack_timer;
+
+    uint64_t dao_rx_count;
 };
 
 void rpl_start(struct rpl_root *root,
@@ -135,12 +226,17 @@ void rpl_timer(int ticks);
 
 void rpl_dodag_version_inc(struct rpl_root *root);
 void rpl_dtsn_inc(struct rpl_root *root);
+bool rpl_refresh_in_progress(struct rpl_root *root);
 
 struct rpl_target *rpl_target_get(struct rpl_root *root, const uint8_t prefix[16]);
 struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16]);
 void rpl_target_del(struct rpl_root *root, struct rpl_target *target);
 uint16_t rpl_target_count(struct rpl_root *root);
 struct rpl_transit *rpl_transit_preferred(struct rpl_root *root, struct rpl_target *target);
+bool rpl_target_has_transit(const struct rpl_target *target);
+void rpl_transit_set(struct rpl_root *root, struct rpl_target *target, uint8_t i,
+                     const uint8_t parent[16], uint32_t path_lifetime_s);
+void rpl_transit_clear(struct rpl_root *root, struct rpl_target *target, uint8_t i);
 
 static inline uint16_t rpl_dag_rank(const struct rpl_root *root, uint16_t rank)
 {
@@ -71,13 +71,13 @@ bool rpl_glue_process_rpi(struct rpl_root *root, struct buffer *buf,
 
 static buffer_t *rpl_glue_srh_provider(buffer_t *buf, ipv6_exthdr_stage_e stage, int16_t *res)
 {
-    __attribute__((cleanup(iobuf_free))) struct iobuf_write srh_buf = { };
     struct rpl_root *root = buf->route->route_info.info;
     const uint8_t *rpl_dst = buf->dst_sa.address;
     struct rpl_transit *transit;
-    struct rpl_srh_decmpr srh;
     struct rpl_target *target;
     const uint8_t *nxthop;
+    const uint8_t *srh;
+    int srh_len;
 
     *res = 0;
 
@@ -109,23 +109,23 @@ static buffer_t *rpl_glue_srh_provider(buffer_t *buf, ipv6_exthdr_stage_e stage,
         }
     }
 
-    if (rpl_srh_build(root, rpl_dst, &srh, &nxthop) < 0) {
+    srh_len = rpl_srh_build_hdr(root, rpl_dst, buf->options.type, &srh, &nxthop);
+    if (srh_len < 0) {
         *res = -1;
         return buf;
     }
-    if (!srh.seg_count)
+    if (!srh_len)
         return buf; // TODO: add hop-by-hop option
-    rpl_srh_push(&srh_buf, &srh, nxthop, buf->options.type, root->compat);
 
     switch (stage) {
     case IPV6_EXTHDR_SIZE:
-        *res = srh_buf.len;
+        *res = srh_len;
         return buf;
     case IPV6_EXTHDR_INSERT:
-        buf = buffer_headroom(buf, srh_buf.len);
+        buf = buffer_headroom(buf, srh_len);
         if (!buf)
             return NULL;
-        memcpy(buffer_data_reserve_header(buf, srh_buf.len), srh_buf.data, srh_buf.len);
+        memcpy(buffer_data_reserve_header(buf, srh_len), srh, srh_len);
         buf->route->ip_dest = nxthop;
         buf->options.type = IPV6_NH_ROUTING;
         buf->options.ip_extflags |= IPEXT_SRH_RPL;
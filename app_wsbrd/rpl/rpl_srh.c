@@ -11,21 +11,22 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <stdlib.h>
 #include <string.h>
 
 #include "common/bits.h"
 #include "common/iobuf.h"
 #include "common/log.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/specs/rpl.h"
 #include "common/specs/ipv6.h"
 #include "rpl_srh.h"
 #include "rpl.h"
 
-int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
-                  struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret)
+static int rpl_srh_compute(struct rpl_root *root, const uint8_t dst[16],
+                           const uint8_t **seg_list, const uint8_t **nxthop_ret)
 {
-    const uint8_t *seg_list[WS_RPL_SRH_MAXSEG];
     struct rpl_transit *transit;
     struct rpl_target *target;
     uint8_t seg_count = 0;
@@ -50,7 +51,7 @@ int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
         }
         if (!memcmp(transit->parent, root->dodag_id, 16))
             break;
-        if (seg_count > WS_RPL_SRH_MAXSEG) {
+        if (seg_count >= WS_RPL_SRH_MAXSEG) {
             TRACE(TR_TX_ABORT, "tx-abort: rpl srh > %u hops", WS_RPL_SRH_MAXSEG);
             return -1;
         }
@@ -63,16 +64,73 @@ int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
         seg_list[seg_count++] = nxthop;
         nxthop = transit->parent;
     }
+    *nxthop_ret = nxthop;
+    return seg_count;
+}
+
+int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
+                  struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret)
+{
+    const uint8_t *seg_list[WS_RPL_SRH_MAXSEG];
+    struct rpl_target *target;
+    const uint8_t *nxthop;
+    int seg_count;
+
+    target = rpl_target_get(root, dst);
+    if (!target || !target->srh_cache.valid ||
+        target->srh_cache.generation != root->srh_cache_gen) {
+        seg_count = rpl_srh_compute(root, dst, seg_list, &nxthop);
+        if (seg_count < 0)
+            return seg_count;
+        // The target exists since rpl_srh_compute() succeeded
+        target = rpl_target_get(root, dst);
+        free(target->srh_cache.seg_list);
+        free(target->srh_cache.hdr);
+        target->srh_cache.hdr = NULL;
+        target->srh_cache.seg_list = seg_count ? xalloc(seg_count * 16) : NULL;
+        for (uint8_t i = 0; i < seg_count; i++)
+            memcpy(target->srh_cache.seg_list[i], seg_list[seg_count - i - 1], 16);
+        memcpy(target->srh_cache.nxthop, nxthop, 16);
+        target->srh_cache.seg_count  = seg_count;
+        target->srh_cache.generation = root->srh_cache_gen;
+        target->srh_cache.valid      = true;
+    }
 
     if (nxthop_ret)
-        *nxthop_ret = nxthop;
+        *nxthop_ret = target->srh_cache.nxthop;
     if (srh) {
-        srh->seg_count = seg_count;
-        srh->seg_left  = seg_count;
-        for (uint8_t i = 0; i < seg_count; i++)
-            memcpy(srh->seg_list[i], seg_list[seg_count - i - 1], 16);
+        srh->seg_count = target->srh_cache.seg_count;
+        srh->seg_left  = target->srh_cache.seg_count;
+        if (target->srh_cache.seg_count)
+            memcpy(srh->seg_list, target->srh_cache.seg_list, target->srh_cache.seg_count * 16);
     }
-    return seg_count;
+    return target->srh_cache.seg_count;
+}
+
+int rpl_srh_build_hdr(struct rpl_root *root, const uint8_t dst[16], uint8_t nxthdr,
+                      const uint8_t **hdr, const uint8_t **nxthop_ret)
+{
+    struct iobuf_write buf = { };
+    struct rpl_srh_decmpr srh;
+    struct rpl_target *target;
+    int seg_count;
+
+    seg_count = rpl_srh_build(root, dst, NULL, nxthop_ret);
+    if (seg_count <= 0)
+        return seg_count;
+    target = rpl_target_get(root, dst);
+    if (!target->srh_cache.hdr) {
+        srh.seg_count = target->srh_cache.seg_count;
+        srh.seg_left  = target->srh_cache.seg_count;
+        memcpy(srh.seg_list, target->srh_cache.seg_list, srh.seg_count * 16);
+        rpl_srh_push(&buf, &srh, target->srh_cache.nxthop, nxthdr, root->compat);
+        target->srh_cache.hdr     = buf.data;
+        target->srh_cache.hdr_len = buf.len;
+    }
+    // Only the Next Header field depends on the packet
+    target->srh_cache.hdr[0] = nxthdr;
+    *hdr = target->srh_cache.hdr;
+    return target->srh_cache.hdr_len;
 }
 
 // RFC 6554 - 3. Format of the RPL Routing Header
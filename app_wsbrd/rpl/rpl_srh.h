@@ -34,6 +34,11 @@ struct rpl_srh_decmpr {
 
 int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
                   struct rpl_srh_decmpr *srh, const uint8_t **nxthop);
+// Same as rpl_srh_build() followed by rpl_srh_push(), but the encoded header
+// is cached with the route. Returns the header length, 0 if the destination
+// is a direct child (no header needed), or a negative value on error.
+int rpl_srh_build_hdr(struct rpl_root *root, const uint8_t dst[16], uint8_t nxthdr,
+                      const uint8_t **hdr, const uint8_t **nxthop);
 void rpl_srh_push(struct iobuf_write *buf, const struct rpl_srh_decmpr *srh,
                   const uint8_t dst[16], uint8_t nxthdr, bool cmpri_eq_cmpre);
 
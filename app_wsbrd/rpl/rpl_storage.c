@@ -14,7 +14,6 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <fnmatch.h>
-#include <glob.h>
 #include <unistd.h>
 #include <limits.h>
 #include <stdio.h>
@@ -23,10 +22,19 @@
 #include "common/key_value_storage.h"
 #include "common/time_extra.h"
 #include "common/log.h"
+#include "common/memutils.h"
 #include "common/string_extra.h"
 #include "rpl_storage.h"
 #include "rpl.h"
 
+// Delay between the first update of a target and the write of every target
+// updated meanwhile.
+#define RPL_STORAGE_FLUSH_DELAY_MS 5000
+// Targets restored per wakeup of rpl_storage_load_timer(), so that the event
+// loop is not blocked for long after startup.
+#define RPL_STORAGE_LOAD_BATCH     64
+#define RPL_STORAGE_LOAD_PERIOD_MS 10
+
 void rpl_storage_store_config(const struct rpl_root *root)
 {
     char ipv6_str[STR_MAX_LEN_IPV6];
@@ -76,7 +84,7 @@ void rpl_storage_load_config(struct rpl_root *root, const char *filename)
     storage_close(nvm);
 }
 
-void rpl_storage_store_target(const struct rpl_root *root, const struct rpl_target *target)
+static void rpl_storage_write_target(const struct rpl_root *root, const struct rpl_target *target)
 {
     char time_str[STR_MAX_LEN_DATE];
     char ipv6_str[STR_MAX_LEN_IPV6];
@@ -99,52 +107,84 @@ void rpl_storage_store_target(const struct rpl_root *root, const struct rpl_targ
     fprintf(nvm->file, "path_seq_timestamp = %lu\n",
             target->path_seq_tstamp_s + time_get_storage_offset());
     fprintf(nvm->file, "external = %u\n", target->external);
-    for (uint8_t i = 0; i < root->pcs + 1; i++) {
-        if (!memzcmp(target->transits + i, sizeof(struct rpl_transit)))
+    for (uint8_t i = 0; i < target->transits_len; i++) {
+        if (!target->transits[i].parent)
             continue;
         str_ipv6(target->transits[i].parent, ipv6_str);
         fprintf(nvm->file, "parent[%u] = %s\n", i, ipv6_str);
         fprintf(nvm->file, "parent[%u].path_lifetime_s = %u\n", i,
                 target->transits[i].path_lifetime_s);
     }
+    if (root->storage_fsync && storage_sync(nvm))
+        WARN("%s: fsync %s: %m", __func__, nvm->filename);
     storage_close(nvm);
 }
 
-void rpl_storage_del_target(const struct rpl_root *root, const struct rpl_target *target)
+static void rpl_storage_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    rpl_storage_flush(container_of(timer, struct rpl_root, storage_timer));
+}
+
+void rpl_storage_store_target(struct rpl_root *root, struct rpl_target *target)
+{
+    if (!g_storage_prefix || target->storage_dirty)
+        return;
+    target->storage_dirty = true;
+    SLIST_INSERT_HEAD(&root->storage_dirty, target, storage_link);
+    if (timer_stopped(&root->storage_timer)) {
+        root->storage_timer.callback = rpl_storage_timer;
+        timer_start_rel(&root->timer_group, &root->storage_timer, RPL_STORAGE_FLUSH_DELAY_MS);
+    }
+}
+
+void rpl_storage_flush(struct rpl_root *root)
+{
+    struct rpl_target *target;
+
+    timer_stop(&root->timer_group, &root->storage_timer);
+    while ((target = SLIST_FIRST(&root->storage_dirty))) {
+        SLIST_REMOVE_HEAD(&root->storage_dirty, storage_link);
+        target->storage_dirty = false;
+        rpl_storage_write_target(root, target);
+    }
+}
+
+void rpl_storage_del_target(struct rpl_root *root, struct rpl_target *target)
 {
     char filename[PATH_MAX];
 
+    if (target->storage_dirty) {
+        SLIST_REMOVE(&root->storage_dirty, target, rpl_target, storage_link);
+        target->storage_dirty = false;
+    }
+
     strcpy(filename, "rpl-");
     str_ipv6(target->prefix, filename + strlen(filename));
     storage_delete((const char *[]){ filename, NULL });
 }
 
-void rpl_storage_load_target(struct rpl_root *root, const char *filename)
+struct rpl_target *rpl_storage_load_target(struct rpl_root *root, const uint8_t prefix[16])
 {
+    struct rpl_transit_info {
+        uint8_t parent[16];
+        uint32_t path_lifetime_s;
+    } transits[8] = { };
     struct storage_parse_info *nvm;
     struct rpl_target *target;
-    const char *strptr;
-    uint8_t prefix[16];
+    char filename[PATH_MAX];
     int ret;
 
-    strptr = strrchr(filename, '-');
-    if (!strptr) {
-        WARN("%s %s failure", __func__, filename);
-        return;
-    }
-    ret = inet_pton(AF_INET6, strptr + 1, prefix);
-    if (ret != 1) {
+    strcpy(filename, "rpl-");
+    str_ipv6(prefix, filename + strlen(filename));
+    if (!storage_exists(filename))
+        return NULL;
+    nvm = storage_open_prefix(filename, "r");
+    if (!nvm) {
         WARN("%s %s failure", __func__, filename);
-        return;
+        return NULL;
     }
     target = rpl_target_new(root, prefix);
     BUG_ON(!target);
-
-    nvm = storage_open(filename, "r");
-    if (!nvm) {
-        WARN("%s %s failure", __func__, filename);
-        return;
-    }
     while (true) {
         ret = storage_parse_line(nvm);
         if (ret == EOF)
@@ -158,36 +198,58 @@ void rpl_storage_load_target(struct rpl_root *root, const char *filename)
         } else if (!fnmatch("external", nvm->key, 0)) {
             target->external = strtoul(nvm->value, NULL, 0);
         } else if (!fnmatch("parent\\[*].path_lifetime_s", nvm->key, 0) && nvm->key_array_index < root->pcs + 1) {
-            target->transits[nvm->key_array_index].path_lifetime_s = strtoul(nvm->value, NULL, 0);
+            transits[nvm->key_array_index].path_lifetime_s = strtoul(nvm->value, NULL, 0);
         } else if (!fnmatch("parent\\[*]", nvm->key, 0) && nvm->key_array_index < root->pcs + 1) {
-            ret = inet_pton(AF_INET6, nvm->value, target->transits[nvm->key_array_index].parent);
+            ret = inet_pton(AF_INET6, nvm->value, transits[nvm->key_array_index].parent);
             WARN_ON(ret != 1, "%s:%d: invalid value: %s", nvm->filename, nvm->linenr, nvm->value);
         } else {
             WARN("%s:%d: invalid key: '%s'", nvm->filename, nvm->linenr, nvm->line);
         }
     }
     storage_close(nvm);
+    for (uint8_t i = 0; i < root->pcs + 1; i++)
+        if (memzcmp(transits[i].parent, 16))
+            rpl_transit_set(root, target, i, transits[i].parent, transits[i].path_lifetime_s);
+    return target;
+}
+
+static void rpl_storage_load_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct rpl_root *root = container_of(timer, struct rpl_root, storage_load_timer);
+    const char *filename;
+    uint8_t prefix[16];
+
+    for (int i = 0; i < RPL_STORAGE_LOAD_BATCH && root->storage_pending[root->storage_pending_index]; i++) {
+        filename = root->storage_pending[root->storage_pending_index++];
+        if (strstr(filename, "rpl-config"))
+            continue;
+        if (inet_pton(AF_INET6, strrchr(filename, '-') + 1, prefix) != 1) {
+            WARN("%s %s failure", __func__, filename);
+            continue;
+        }
+        // Restores the target if it was not already looked up
+        rpl_target_get(root, prefix);
+    }
+    if (root->storage_pending[root->storage_pending_index])
+        return;
+    TRACE(TR_RPL, "rpl: storage restored");
+    timer_stop(&root->timer_group, &root->storage_load_timer);
+    storage_globfree(root->storage_pending);
+    root->storage_pending = NULL;
 }
 
 void rpl_storage_load(struct rpl_root *root)
 {
-    char globexpr[PATH_MAX];
-    glob_t globbuf;
-    int ret;
+    char filename[PATH_MAX];
 
     if (!g_storage_prefix)
         return;
-    snprintf(globexpr, sizeof(globexpr), "%s%s", g_storage_prefix, "rpl-*");
-    ret = glob(globexpr, 0, NULL, &globbuf);
-    if (ret && ret != GLOB_NOMATCH)
-        WARN("%s: glob %s returned %u", __func__, globexpr, ret);
-    if (ret)
-        return;
-    for (int i = 0; globbuf.gl_pathv[i]; i++) {
-        if (strstr(globbuf.gl_pathv[i], "rpl-config"))
-            rpl_storage_load_config(root, globbuf.gl_pathv[i]);
-        else
-            rpl_storage_load_target(root, globbuf.gl_pathv[i]);
-    }
-    globfree(&globbuf);
+    snprintf(filename, sizeof(filename), "%srpl-config", g_storage_prefix);
+    if (storage_exists("rpl-config"))
+        rpl_storage_load_config(root, filename);
+    root->storage_pending = storage_glob("rpl-*");
+    root->storage_pending_index = 0;
+    root->storage_load_timer.callback  = rpl_storage_load_timer;
+    root->storage_load_timer.period_ms = RPL_STORAGE_LOAD_PERIOD_MS;
+    timer_start_rel(&root->timer_group, &root->storage_load_timer, 0);
 }
@@ -14,20 +14,33 @@
 #ifndef RPL_STORAGE_H
 #define RPL_STORAGE_H
 
+#include <stdint.h>
+
 struct rpl_root;
 struct rpl_target;
 
 /*
  * Functions for (re)storing RPL data from/to Non-Volatile Memory (NVM).
  * A file is created per target, containing transits with the relevant data.
+ *
+ * Targets are typically updated by every DAO, and many DAOs are received at
+ * once after a DTSN increment. So rpl_storage_store_target() only marks the
+ * target as dirty, and dirty targets are written together a few seconds
+ * later. rpl_storage_flush() forces the pending writes.
+ *
+ * rpl_storage_load() only restores the configuration, so that the DODAG can be
+ * started right away. Targets are then restored a few at a time from a timer,
+ * and rpl_target_get() restores a target immediately with
+ * rpl_storage_load_target() if it was not restored yet.
  */
 
 void rpl_storage_store_config(const struct rpl_root *root);
-void rpl_storage_store_target(const struct rpl_root *root, const struct rpl_target *target);
-void rpl_storage_del_target(const struct rpl_root *root, const struct rpl_target *target);
+void rpl_storage_store_target(struct rpl_root *root, struct rpl_target *target);
+void rpl_storage_del_target(struct rpl_root *root, struct rpl_target *target);
+void rpl_storage_flush(struct rpl_root *root);
 
 void rpl_storage_load_config(struct rpl_root *root, const char *filename);
-void rpl_storage_load_target(struct rpl_root *root, const char *filename);
+struct rpl_target *rpl_storage_load_target(struct rpl_root *root, const uint8_t prefix[16]);
 void rpl_storage_load(struct rpl_root *root);
 
 #endif /* RPL_STORAGE_H */
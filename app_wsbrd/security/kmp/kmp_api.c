@@ -19,6 +19,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/queue.h>
 #include "common/memutils.h"
 #include "common/ns_list.h"
 
@@ -46,13 +47,27 @@ struct kmp_api {
     uint8_t                      instance_identifier;     /**< KMP instance identifier, incremented when created, from 0 to 255 */
     bool                         timer_start_pending : 1; /**< Timer is pending to start */
     bool                         receive_disable : 1;     /**< Receiving disabled, do not route messages anymore */
+    SLIST_ENTRY(kmp_api)         pool_link;               /**< Link in kmp_sec_prot_entry_t pool when deleted */
     sec_prot_t                   sec_prot;                /**< Security protocol interface */
 };
 
+/*
+ * During mass joins, thousands of KMP instances are created and deleted per
+ * minute. Deleted instances are kept per protocol type (they all have the
+ * same size) to be reused by the next supplicant, up to the active supplicant
+ * limit. Allocations made by the protocols themselves (eg. TLS buffers) are
+ * not pooled.
+ */
+#define KMP_POOL_MAX_DEFAULT 64 // When active_supp_max is 0
+
+SLIST_HEAD(kmp_pool, kmp_api);
+
 typedef struct kmp_sec_prot_entry {
     kmp_type_e                   type;                    /**< Security protocol type callback */
     kmp_sec_prot_size            *size;                   /**< Security protocol data size callback */
     kmp_sec_prot_init            *init;                   /**< Security protocol init */
+    struct kmp_pool              pool;                    /**< Deleted instances available for reuse */
+    int                          pool_len;                /**< Number of instances in pool */
     ns_list_link_t               link;                    /**< Link */
 } kmp_sec_prot_entry_t;
 
@@ -108,19 +123,46 @@ static void kmp_sec_prot_receive_disable(sec_prot_t *prot);
 
 #define kmp_api_get_from_prot(prot) (kmp_api_t *)(((uint8_t *)prot) - offsetof(kmp_api_t, sec_prot));
 
+static kmp_sec_prot_entry_t *kmp_service_sec_prot_get(kmp_service_t *service, kmp_type_e type)
+{
+    ns_list_foreach(kmp_sec_prot_entry_t, list_entry, &service->sec_prot_list)
+        if (list_entry->type == type)
+            return list_entry;
+    return NULL;
+}
+
+static void kmp_api_pool_put(kmp_sec_prot_entry_t *sec_prot, kmp_api_t *kmp)
+{
+    int pool_max = KMP_POOL_MAX_DEFAULT;
+
+    if (kmp->sec_prot.sec_cfg && kmp->sec_prot.sec_cfg->active_supp_max)
+        pool_max = kmp->sec_prot.sec_cfg->active_supp_max;
+    if (!sec_prot || sec_prot->pool_len >= pool_max) {
+        free(kmp);
+        return;
+    }
+    SLIST_INSERT_HEAD(&sec_prot->pool, kmp, pool_link);
+    sec_prot->pool_len++;
+}
+
+static void kmp_api_pool_free(kmp_sec_prot_entry_t *sec_prot)
+{
+    kmp_api_t *kmp;
+
+    while ((kmp = SLIST_FIRST(&sec_prot->pool))) {
+        SLIST_REMOVE_HEAD(&sec_prot->pool, pool_link);
+        free(kmp);
+    }
+    sec_prot->pool_len = 0;
+}
+
 kmp_api_t *kmp_api_create(kmp_service_t *service, kmp_type_e type, uint8_t msg_if_instance_id, sec_cfg_t *sec_cfg)
 {
     if (!service) {
         return 0;
     }
 
-    kmp_sec_prot_entry_t *sec_prot = 0;
-    ns_list_foreach(kmp_sec_prot_entry_t, list_entry, &service->sec_prot_list) {
-        if (list_entry->type == type) {
-            sec_prot = list_entry;
-            break;
-        }
-    }
+    kmp_sec_prot_entry_t *sec_prot = kmp_service_sec_prot_get(service, type);
 
     if (!sec_prot) {
         // Unknown security protocol
@@ -134,7 +176,15 @@ kmp_api_t *kmp_api_create(kmp_service_t *service, kmp_type_e type, uint8_t msg_i
         return 0;
     }
 
-    kmp_api_t *kmp = zalloc(sizeof(kmp_api_t) + sec_size);
+    kmp_api_t *kmp = SLIST_FIRST(&sec_prot->pool);
+
+    if (kmp) {
+        SLIST_REMOVE_HEAD(&sec_prot->pool, pool_link);
+        sec_prot->pool_len--;
+        memset(kmp, 0, sizeof(kmp_api_t) + sec_size);
+    } else {
+        kmp = zalloc(sizeof(kmp_api_t) + sec_size);
+    }
 
     kmp->type = type;
     kmp->app_data_ptr = 0;
@@ -168,7 +218,7 @@ kmp_api_t *kmp_api_create(kmp_service_t *service, kmp_type_e type, uint8_t msg_i
     kmp->sec_prot.msg_if_instance_id = msg_if_instance_id;
 
     if (sec_prot->init(&kmp->sec_prot) < 0) {
-        free(kmp);
+        kmp_api_pool_put(sec_prot, kmp);
         return 0;
     }
 
@@ -368,7 +418,7 @@ void kmp_api_delete(kmp_api_t *kmp)
     if (kmp->sec_prot.release) {
         kmp->sec_prot.release(&kmp->sec_prot);
     }
-    free(kmp);
+    kmp_api_pool_put(kmp_service_sec_prot_get(kmp->service, kmp->type), kmp);
 }
 
 void kmp_api_cb_register(kmp_api_t *kmp, kmp_api_create_confirm *create_conf, kmp_api_create_indication *create_ind, kmp_api_finished_indication *finished_ind, kmp_api_finished *finished)
@@ -562,6 +612,8 @@ void kmp_service_sec_protocol_register(kmp_service_t *service, kmp_type_e type,
     sec_prot->type = type;
     sec_prot->size = size;
     sec_prot->init = init;
+    SLIST_INIT(&sec_prot->pool);
+    sec_prot->pool_len = 0;
 
     ns_list_add_to_start(&service->sec_prot_list, sec_prot);
 }
@@ -571,6 +623,7 @@ int8_t kmp_service_sec_protocol_unregister(kmp_service_t *service, kmp_type_e ty
     ns_list_foreach(kmp_sec_prot_entry_t, list_entry, &service->sec_prot_list) {
         if (list_entry->type == type) {
             ns_list_remove(&service->sec_prot_list, list_entry);
+            kmp_api_pool_free(list_entry);
             free(list_entry);
             return 0;
         }
@@ -54,6 +54,7 @@ typedef struct kmp_socket_if {
     uint8_t instance_id;                              /**< Instance identifier */
     bool relay;                                       /**< Interface is relay interface */
     ns_address_t remote_addr;                         /**< Remote address */
+    uint16_t local_port;                              /**< Local port */
     int kmp_socket_id;                                /**< Socket ID */
     ns_list_link_t link;                              /**< Link */
     struct sockaddr_storage remote_sockaddr;          /**< Remote socket address (can be INET4 or INET6) */
@@ -100,6 +101,7 @@ int8_t kmp_socket_if_register(kmp_service_t *service, uint8_t *instance_id, bool
     }
 
     socket_if->relay = relay;
+    socket_if->local_port = local_port;
 
     socket_if->remote_addr.type = ADDRESS_IPV6;
 
@@ -222,13 +224,29 @@ int kmp_socket_if_get_pae_socket_fd()
     return -1;
 }
 
+static void kmp_socket_if_relay_recv(kmp_socket_if_t *socket_if, const uint8_t relay_addr[16], uint16_t relay_port,
+                                     const uint8_t eui_64[8], uint8_t kmp_id, const void *pdu, uint16_t size)
+{
+    kmp_addr_t addr = {
+        .type = KMP_ADDR_EUI_64_AND_IP,
+        .port = relay_port,
+    };
+    kmp_type_e type;
+
+    memcpy(addr.relay_address, relay_addr, 16);
+    memcpy(addr.eui_64, eui_64, 8);
+    type = kmp_api_type_from_id_get(kmp_id);
+    if (type == KMP_TYPE_NONE)
+        return;
+    kmp_service_msg_if_receive(socket_if->kmp_service, socket_if->instance_id, type, &addr, pdu, size, 0);
+}
+
 void kmp_socket_if_pae_socket_cb(int fd)
 {
     kmp_socket_if_t *socket_if = g_kmp_socket_if_instances[KMP_RELAY_INSTANCE_INDEX];
-    uint8_t connection_num = 0;
+    kmp_addr_t addr = { };
     ssize_t data_len;
     uint8_t data[2048];
-    uint8_t *pdu = NULL;
 
     data_len = xrecv(fd, data, sizeof(data), 0);
     if (data_len <= 0)
@@ -238,36 +256,30 @@ void kmp_socket_if_pae_socket_cb(int fd)
         return;
     }
 
-    pdu = malloc(data_len);
-    if (!pdu)
-        return;
-
-    memcpy(pdu, data, data_len);
-
-    kmp_addr_t addr;
-    memset(&addr, 0, sizeof(kmp_addr_t));
-    kmp_type_e type = KMP_TYPE_NONE;
-    uint8_t *data_ptr = pdu;
-
     if (socket_if->relay) {
-        addr.type = KMP_ADDR_EUI_64_AND_IP;
-        memcpy(addr.relay_address, data_ptr, 16);
-        data_ptr += 16;
-        addr.port = read_be16(data_ptr);
-        data_ptr += 2;
-        memcpy(addr.eui_64, data_ptr, 8);
-        data_ptr += 8;
-
-        type = kmp_api_type_from_id_get(*data_ptr++);
-        if (type == KMP_TYPE_NONE) {
-            free(pdu);
+        if (data_len < SOCKET_IF_HEADER_SIZE)
             return;
-        }
-        data_len -= SOCKET_IF_HEADER_SIZE;
+        kmp_socket_if_relay_recv(socket_if, data, read_be16(data + 16), data + 18, data[26],
+                                 data + SOCKET_IF_HEADER_SIZE, data_len - SOCKET_IF_HEADER_SIZE);
+        return;
     }
 
-    kmp_service_msg_if_receive(socket_if->kmp_service, socket_if->instance_id, type, &addr, data_ptr, data_len, connection_num);
-    free(pdu);
+    kmp_service_msg_if_receive(socket_if->kmp_service, socket_if->instance_id, KMP_TYPE_NONE, &addr, data, data_len, 0);
+}
+
+int8_t kmp_socket_if_pae_local_recv(uint16_t local_port, const uint8_t relay_addr[16], uint16_t relay_port,
+                                    const uint8_t eui_64[8], const void *pdu, uint16_t size)
+{
+    kmp_socket_if_t *socket_if = g_kmp_socket_if_instances[KMP_RELAY_INSTANCE_INDEX];
+
+    if (!socket_if || !socket_if->relay || socket_if->local_port != local_port)
+        return -1;
+    // Same as the datagrams with an empty KMP ID, which are dropped
+    if (size < 1)
+        return 0;
+    kmp_socket_if_relay_recv(socket_if, relay_addr, relay_port, eui_64,
+                             *(const uint8_t *)pdu, (const uint8_t *)pdu + 1, size - 1);
+    return 0;
 }
 
 int kmp_socket_if_get_radius_sockfd()
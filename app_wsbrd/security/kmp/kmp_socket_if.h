@@ -40,6 +40,24 @@ typedef struct kmp_service kmp_service_t;
 int kmp_socket_if_get_pae_socket_fd();
 void kmp_socket_if_pae_socket_cb(int fd);
 
+/**
+ * kmp_socket_if_pae_local_recv receive a message from an EAPOL authenticator
+ * relay running in the same process, without going through the sockets
+ *
+ * \param local_port port the message would have been sent to
+ * \param relay_addr address of the EAPOL relay
+ * \param relay_port port of the EAPOL relay
+ * \param eui_64 supplicant EUI-64
+ * \param pdu KMP ID followed by the EAPOL PDU
+ * \param size size of the pdu
+ *
+ * \return < 0 no local KMP service listens on local_port
+ * \return >= 0 success
+ *
+ */
+int8_t kmp_socket_if_pae_local_recv(uint16_t local_port, const uint8_t relay_addr[16], uint16_t relay_port,
+                                    const uint8_t eui_64[8], const void *pdu, uint16_t size);
+
 /**
  * kmp_socket_if_register register socket interface to KMP service
  *
@@ -27,6 +27,7 @@
 #include "common/crypto/hmac_md.h"
 #include "common/endian.h"
 #include "common/rand.h"
+#include "common/time_extra.h"
 #include "common/trickle_legacy.h"
 #include "common/log_legacy.h"
 #include "common/ns_list.h"
@@ -98,6 +99,7 @@ typedef struct radius_client_sec_prot_int {
     bool                          recv_eap_msg_own;             /**< This module owns the received buffer and must manage its memory */
     uint16_t                      send_radius_msg_len;          /**< Send radius message length */
     uint8_t                       *send_radius_msg;             /**< Send radius message */
+    uint64_t                      send_radius_msg_time_ms;      /**< Time of the last radius message send, 0 once answered */
     uint8_t                       identity_len;                 /**< Supplicant EAP identity length */
     uint8_t                       *identity;                    /**< Supplicant EAP identity */
     uint8_t                       radius_code;                  /**< Radius code that was received */
@@ -154,6 +156,8 @@ static void radius_client_sec_prot_timer_timeout(sec_prot_t *prot, uint16_t tick
 
 // Data shared between radius client instances
 static radius_client_sec_prot_shared_t *shared_data = NULL;
+// Smoothed delay between an Access-Request and its answer (0 if unknown)
+static unsigned int radius_latency_ms = 0;
 
 void radius_client_sec_prot_register(kmp_service_t *service)
 {
@@ -225,6 +229,7 @@ static int8_t radius_client_sec_prot_init(sec_prot_t *prot)
     data->recv_eap_msg = NULL;
     data->send_radius_msg_len = 0;
     data->send_radius_msg = NULL;
+    data->send_radius_msg_time_ms = 0;
     data->identity_len = 0;
     data->identity = NULL;
     data->radius_code = RADIUS_MESSAGE_NONE;
@@ -407,6 +412,17 @@ static int8_t radius_client_sec_prot_receive(sec_prot_t *prot, const void *pdu,
         return -1;
     }
 
+    // Same smoothing as the TCP SRTT (RFC 6298)
+    if (data->send_radius_msg_time_ms) {
+        unsigned int latency_ms = time_now_ms(CLOCK_MONOTONIC) - data->send_radius_msg_time_ms;
+
+        if (radius_latency_ms)
+            radius_latency_ms = (7 * radius_latency_ms + latency_ms) / 8;
+        else
+            radius_latency_ms = latency_ms;
+        data->send_radius_msg_time_ms = 0;
+    }
+
     // Response authenticator matches, start validating radius EAP-TLS specific fields
     data->recv_eap_msg = NULL;
     data->recv_eap_msg_len = 0;
@@ -745,10 +761,16 @@ static int8_t radius_client_sec_prot_radius_msg_send(sec_prot_t *prot)
     if (prot->conn_send(prot, data->send_radius_msg, data->send_radius_msg_len, data->radius_id_conn_num) < 0) {
         return -1;
     }
+    data->send_radius_msg_time_ms = time_now_ms(CLOCK_MONOTONIC);
 
     return 0;
 }
 
+unsigned int radius_client_sec_prot_latency_ms(void)
+{
+    return radius_latency_ms;
+}
+
 static void radius_client_sec_prot_radius_msg_free(sec_prot_t *prot)
 {
     radius_client_sec_prot_int_t *data = radius_client_sec_prot_get(prot);
@@ -29,4 +29,10 @@ struct kmp_service;
 
 void radius_client_sec_prot_register(struct kmp_service *service);
 
+/*
+ * Smoothed round trip time of the RADIUS server, 0 if no answer has been
+ * received yet.
+ */
+unsigned int radius_client_sec_prot_latency_ms(void);
+
 #endif
@@ -55,6 +55,7 @@ typedef struct sec_prot_certs {
     cert_chain_entry_t own_cert_chain;                  /**< Own certificate chain */
     cert_chain_list_t trusted_cert_chain_list;          /**< Trusted certificate chain lists */
     uint16_t own_cert_chain_len;                        /**< Own certificate chain certificates length */
+    unsigned int version;                               /**< Incremented when certificates are added */
     bool ext_cert_valid_enabled : 1;                    /**< Extended certificate validation enabled */
 } sec_prot_certs_t;
 
@@ -56,6 +56,7 @@ typedef struct sec_cfg {
     struct sec_timing timing_ffn;
     struct sec_timing timing_lfn;
     sec_radius_cfg_t *radius_cfg;
+    uint16_t active_supp_max;                   /* Upper bound of the adaptive limit of active supplicants, 0 for no limit */
 } sec_cfg_t;
 
 #endif
@@ -117,6 +117,7 @@ typedef struct sec_prot_keys {
 typedef struct frame_counter {
     uint8_t gtk[GTK_LEN];                             /**< GTK of the frame counter */
     uint32_t frame_counter;                           /**< Current frame counter */
+    uint32_t frame_counter_max;                       /**< Stored frame counter, reserved up to this value */
     bool set : 1;                                     /**< Value has been set */
 } frame_counter_t;
 
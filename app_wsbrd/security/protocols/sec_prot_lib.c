@@ -352,9 +352,9 @@ int8_t sec_prot_lib_pmkid_generate(sec_prot_t *prot, uint8_t *pmkid, bool is_aut
     }
 
     if (is_auth)
-        ieee80211_derive_pmkid(pmk, local_eui64, remote_eui64, pmkid);
+        ieee80211_derive_pmkid(NULL, pmk, local_eui64, remote_eui64, pmkid);
     else
-        ieee80211_derive_pmkid(pmk, remote_eui64, local_eui64, pmkid);
+        ieee80211_derive_pmkid(NULL, pmk, remote_eui64, local_eui64, pmkid);
     return 0;
 }
 
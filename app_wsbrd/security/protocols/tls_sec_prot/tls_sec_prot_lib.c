@@ -25,12 +25,14 @@
 #include <mbedtls/error.h>
 #include <mbedtls/platform.h>
 #include <mbedtls/ssl_cookie.h>
+#include <mbedtls/ssl_cache.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/ssl_ciphersuites.h>
 #include <mbedtls/debug.h>
 #include <mbedtls/oid.h>
 #include "common/endian.h"
+#include "common/memutils.h"
 #include "common/crypto/tls.h"
 #include "common/rand.h"
 #include "common/trickle_legacy.h"
@@ -56,10 +58,7 @@ struct tls_security {
     mbedtls_ctr_drbg_context       ctr_drbg;             /**< mbed TLS pseudo random number generator context */
     mbedtls_entropy_context        entropy;              /**< mbed TLS entropy context */
 
-    mbedtls_x509_crt               cacert;               /**< CA certificate(s) */
     mbedtls_x509_crl               *crl;                 /**< Certificate Revocation List */
-    mbedtls_x509_crt               owncert;              /**< Own certificate(s) */
-    mbedtls_pk_context             pkey;                 /**< Private key for own certificate */
     void                           *handle;              /**< Handle provided in callbacks (defined by library user) */
     bool                           ext_cert_valid : 1;   /**< Extended certificate validation enabled */
 #if (MBEDTLS_VERSION_MAJOR < 3)
@@ -118,11 +117,6 @@ int8_t tls_sec_prot_lib_init(tls_security_t *sec)
     sec->entropy.source_count = 0;
 #endif
 
-    mbedtls_x509_crt_init(&sec->cacert);
-
-    mbedtls_x509_crt_init(&sec->owncert);
-    mbedtls_pk_init(&sec->pkey);
-
     sec->crl = NULL;
 
     if (mbedtls_entropy_add_source(&sec->entropy, tls_sec_lib_entropy_poll, NULL,
@@ -164,27 +158,49 @@ void tls_sec_prot_lib_set_cb_register(tls_security_t *sec, void *handle,
 
 void tls_sec_prot_lib_free(tls_security_t *sec)
 {
-    mbedtls_x509_crt_free(&sec->cacert);
     if (sec->crl) {
         mbedtls_x509_crl_free(sec->crl);
         free(sec->crl);
     }
-    mbedtls_x509_crt_free(&sec->owncert);
-    mbedtls_pk_free(&sec->pkey);
     mbedtls_entropy_free(&sec->entropy);
     mbedtls_ctr_drbg_free(&sec->ctr_drbg);
     mbedtls_ssl_config_free(&sec->conf);
     mbedtls_ssl_free(&sec->ssl);
 }
 
-static int tls_sec_prot_lib_configure_certificates(tls_security_t *sec, const sec_prot_certs_t *certs)
+/*
+ * Parsing the certificates and the private key costs about as much as the rest
+ * of the server side of a handshake, and used to be done for each supplicant.
+ * They only depend on sec_prot_certs_t, which is shared by all the supplicants
+ * of the authenticator, so they are parsed once and shared (read-only) by all
+ * the TLS contexts.
+ */
+static struct {
+    const sec_prot_certs_t *certs;
+    unsigned int version;
+    mbedtls_x509_crt cacert;
+    mbedtls_x509_crt owncert;
+    mbedtls_pk_context pkey;
+} g_tls_sec_prot_lib_certs;
+
+static void tls_sec_prot_lib_certs_free(void)
+{
+    mbedtls_x509_crt_free(&g_tls_sec_prot_lib_certs.cacert);
+    mbedtls_x509_crt_free(&g_tls_sec_prot_lib_certs.owncert);
+    mbedtls_pk_free(&g_tls_sec_prot_lib_certs.pkey);
+    g_tls_sec_prot_lib_certs.certs = NULL;
+}
+
+static int tls_sec_prot_lib_certs_parse(tls_security_t *sec, const sec_prot_certs_t *certs)
 {
     int ret;
 
-    if (!certs->own_cert_chain.cert[0]) {
-        tr_error("no own cert");
-        return -1;
-    }
+    if (g_tls_sec_prot_lib_certs.certs == certs && g_tls_sec_prot_lib_certs.version == certs->version)
+        return 0;
+    tls_sec_prot_lib_certs_free();
+    mbedtls_x509_crt_init(&g_tls_sec_prot_lib_certs.cacert);
+    mbedtls_x509_crt_init(&g_tls_sec_prot_lib_certs.owncert);
+    mbedtls_pk_init(&g_tls_sec_prot_lib_certs.pkey);
 
     // Parse own certificate chain
     uint8_t index = 0;
@@ -198,7 +214,7 @@ static int tls_sec_prot_lib_configure_certificates(tls_security_t *sec, const se
             }
             break;
         }
-        ret = tls_load_pem(&sec->owncert, cert, cert_len);
+        ret = tls_load_pem(&g_tls_sec_prot_lib_certs.owncert, cert, cert_len);
         FATAL_ON(!ret, 1, "%s: tls_load_pem: own certificate not found", __func__);
         index++;
     }
@@ -212,20 +228,15 @@ static int tls_sec_prot_lib_configure_certificates(tls_security_t *sec, const se
     }
 
 #if (MBEDTLS_VERSION_MAJOR >= 3)
-    if (mbedtls_pk_parse_key(&sec->pkey, key, key_len, NULL, 0, mbedtls_ctr_drbg_random, &sec->ctr_drbg) < 0) {
+    if (mbedtls_pk_parse_key(&g_tls_sec_prot_lib_certs.pkey, key, key_len, NULL, 0,
+                             mbedtls_ctr_drbg_random, &sec->ctr_drbg) < 0) {
 #else
-    if (mbedtls_pk_parse_key(&sec->pkey, key, key_len, NULL, 0) < 0) {
+    if (mbedtls_pk_parse_key(&g_tls_sec_prot_lib_certs.pkey, key, key_len, NULL, 0) < 0) {
 #endif
         tr_error("Private key parse error");
         return -1;
     }
 
-    // Configure own certificate chain and private key
-    if (mbedtls_ssl_conf_own_cert(&sec->conf, &sec->owncert, &sec->pkey) != 0) {
-        tr_error("Own cert and private key conf error");
-        return -1;
-    }
-
     // Parse trusted certificate chains
     ns_list_foreach(cert_chain_entry_t, entry, &certs->trusted_cert_chain_list) {
         index = 0;
@@ -239,14 +250,39 @@ static int tls_sec_prot_lib_configure_certificates(tls_security_t *sec, const se
                 }
                 break;
             }
-            ret = tls_load_pem(&sec->cacert, cert, cert_len);
+            ret = tls_load_pem(&g_tls_sec_prot_lib_certs.cacert, cert, cert_len);
             FATAL_ON(!ret, 1, "%s: tls_load_pem: CA certificate not found", __func__);
             index++;
         }
     }
 
+    g_tls_sec_prot_lib_certs.certs   = certs;
+    g_tls_sec_prot_lib_certs.version = certs->version;
+    return 0;
+}
+
+static int tls_sec_prot_lib_configure_certificates(tls_security_t *sec, const sec_prot_certs_t *certs)
+{
+    if (!certs->own_cert_chain.cert[0]) {
+        tr_error("no own cert");
+        return -1;
+    }
+
+    if (tls_sec_prot_lib_certs_parse(sec, certs) < 0) {
+        // Do not keep a partially parsed chain
+        tls_sec_prot_lib_certs_free();
+        return -1;
+    }
+
+    // Configure own certificate chain and private key
+    if (mbedtls_ssl_conf_own_cert(&sec->conf, &g_tls_sec_prot_lib_certs.owncert,
+                                  &g_tls_sec_prot_lib_certs.pkey) != 0) {
+        tr_error("Own cert and private key conf error");
+        return -1;
+    }
+
     // Configure trusted certificates and certificate revocation lists
-    mbedtls_ssl_conf_ca_chain(&sec->conf, &sec->cacert, sec->crl);
+    mbedtls_ssl_conf_ca_chain(&sec->conf, &g_tls_sec_prot_lib_certs.cacert, sec->crl);
 
     // Certificate verify required on both client and server
     mbedtls_ssl_conf_authmode(&sec->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
@@ -257,6 +293,55 @@ static int tls_sec_prot_lib_configure_certificates(tls_security_t *sec, const se
     return 0;
 }
 
+/*
+ * Supplicants rejoining after the loss of their PMK present the same
+ * certificate chain, which is verified again with full signature checks.
+ * mbedtls provides no way to skip the chain verification for a certificate
+ * already verified, but a resumed session carries no certificate and skips it
+ * altogether, as well as the ECDHE exchange. The cache is shared by all the
+ * server contexts.
+ */
+#ifdef MBEDTLS_SSL_CACHE_C
+static struct {
+    mbedtls_ssl_cache_context *ctx;
+    int max_entries;
+    int timeout_s;
+} g_tls_sec_prot_lib_cache;
+
+static void tls_sec_prot_lib_session_cache_reset(void)
+{
+    mbedtls_ssl_cache_init(g_tls_sec_prot_lib_cache.ctx);
+    mbedtls_ssl_cache_set_max_entries(g_tls_sec_prot_lib_cache.ctx, g_tls_sec_prot_lib_cache.max_entries);
+    mbedtls_ssl_cache_set_timeout(g_tls_sec_prot_lib_cache.ctx, g_tls_sec_prot_lib_cache.timeout_s);
+}
+#endif
+
+void tls_sec_prot_lib_session_cache_init(int max_entries, int timeout_s)
+{
+#ifdef MBEDTLS_SSL_CACHE_C
+    BUG_ON(g_tls_sec_prot_lib_cache.ctx);
+    if (!max_entries)
+        return;
+    g_tls_sec_prot_lib_cache.ctx = xalloc(sizeof(*g_tls_sec_prot_lib_cache.ctx));
+    g_tls_sec_prot_lib_cache.max_entries = max_entries;
+    g_tls_sec_prot_lib_cache.timeout_s = timeout_s;
+    tls_sec_prot_lib_session_cache_reset();
+#else
+    WARN_ON(max_entries, "TLS session cache requires MBEDTLS_SSL_CACHE_C");
+#endif
+}
+
+void tls_sec_prot_lib_session_cache_flush(void)
+{
+#ifdef MBEDTLS_SSL_CACHE_C
+    if (!g_tls_sec_prot_lib_cache.ctx)
+        return;
+    // The sessions are not bound to a supplicant, so they are all dropped
+    mbedtls_ssl_cache_free(g_tls_sec_prot_lib_cache.ctx);
+    tls_sec_prot_lib_session_cache_reset();
+#endif
+}
+
 int8_t tls_sec_prot_lib_connect(tls_security_t *sec, bool is_server, const sec_prot_certs_t *certs)
 {
 
@@ -280,6 +365,12 @@ int8_t tls_sec_prot_lib_connect(tls_security_t *sec, bool is_server, const sec_p
         return -1;
     }
 
+#ifdef MBEDTLS_SSL_CACHE_C
+    if (is_server && g_tls_sec_prot_lib_cache.ctx)
+        mbedtls_ssl_conf_session_cache(&sec->conf, g_tls_sec_prot_lib_cache.ctx,
+                                       mbedtls_ssl_cache_get, mbedtls_ssl_cache_set);
+#endif
+
 #if !defined(MBEDTLS_SSL_CONF_RNG)
     // Configure random number generator
     mbedtls_ssl_conf_rng(&sec->conf, mbedtls_ctr_drbg_random, &sec->ctr_drbg);
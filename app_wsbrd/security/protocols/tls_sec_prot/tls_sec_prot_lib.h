@@ -137,6 +137,21 @@ void tls_sec_prot_lib_set_cb_register(tls_security_t *sec, void *handle,
                                       tls_sec_prot_lib_export_keys *export_keys, tls_sec_prot_lib_set_timer *set_timer,
                                       tls_sec_prot_lib_get_timer *get_timer);
 
+/**
+ * tls_sec_prot_lib_session_cache_init enable TLS session resumption on server
+ *
+ * \param max_entries maximum number of cached sessions, 0 to disable
+ * \param timeout_s lifetime of a cached session
+ *
+ */
+void tls_sec_prot_lib_session_cache_init(int max_entries, int timeout_s);
+
+/**
+ * tls_sec_prot_lib_session_cache_flush drop all the cached sessions
+ *
+ */
+void tls_sec_prot_lib_session_cache_flush(void);
+
 /**
  * tls_sec_prot_lib_free free security library internal data (e.g. TLS data)
  *
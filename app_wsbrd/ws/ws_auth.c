@@ -18,7 +18,6 @@
 #include "common/authenticator/authenticator.h"
 #include "common/authenticator/authenticator_radius.h"
 #include "common/ws/eapol_relay.h"
-#include "common/mbedtls_extra.h"
 #include "common/string_extra.h"
 
 #include "ws_auth.h"
@@ -43,20 +42,21 @@ int ws_auth_fd_eapol_relay(struct net_if *net_if)
 
 void ws_auth_recv_eapol_relay(struct net_if *net_if)
 {
-    struct in6_addr eapol_target;
+    static struct eapol_relay_rx rx[EAPOL_RELAY_BATCH];
     struct auth_supp_ctx *supp;
-    struct eui64 supp_eui64;
-    uint8_t buf[1500];
-    ssize_t buf_len;
-    uint8_t kmp_id;
-
-    buf_len = eapol_relay_recv(net_if->auth->eapol_relay_fd, buf, sizeof(buf),
-                               &eapol_target, &supp_eui64, &kmp_id);
-    if (buf_len < 0)
+    int count;
+
+    count = eapol_relay_recv_batch(net_if->auth->eapol_relay_fd, rx);
+    if (count <= 0)
         return;
-    supp = auth_fetch_supp(net_if->auth, &supp_eui64);
-    supp->eapol_target = eapol_target;
-    auth_recv_eapol(net_if->auth, kmp_id, &supp_eui64, buf, buf_len);
+    // The answers of the batch are sent together
+    eapol_relay_tx_hold(net_if->auth->eapol_relay_fd);
+    for (int i = 0; i < count; i++) {
+        supp = auth_fetch_supp(net_if->auth, &rx[i].supp_eui64);
+        supp->eapol_target = rx[i].src;
+        auth_recv_eapol(net_if->auth, rx[i].kmp_id, &rx[i].supp_eui64, rx[i].buf, rx[i].buf_len);
+    }
+    eapol_relay_tx_flush();
 }
 
 int ws_auth_fd_radius(struct net_if *net_if)
@@ -74,28 +74,14 @@ const uint8_t *ws_auth_gtk(struct net_if *net_if, int key_index)
     return net_if->auth->gtks[key_index - 1].key;
 }
 
-static void ws_auth_gtkhash_common(const struct auth_ctx *auth, uint8_t gtkhash[][8], int offset, int count)
-{
-    uint8_t sha256[32];
-
-    for (int i = 0; i < count; i++) {
-        if (timer_stopped(&auth->gtks[i + offset].expiration_timer)) {
-            memset(gtkhash[i], 0, 8);
-        } else {
-            xmbedtls_sha256(auth->gtks[i + offset].key, 16, sha256, 0);
-            memcpy(gtkhash[i], sha256 + 24, 8);
-        }
-    }
-}
-
 void ws_auth_gtkhash(struct net_if *net_if, uint8_t gtkhash[WS_GTK_COUNT][8])
 {
-    ws_auth_gtkhash_common(net_if->auth, gtkhash, 0, WS_GTK_COUNT);
+    memcpy(gtkhash, net_if->auth->gtkhashes, WS_GTK_COUNT * 8);
 }
 
 void ws_auth_lgtkhash(struct net_if *net_if, uint8_t lgtkhash[WS_LGTK_COUNT][8])
 {
-    ws_auth_gtkhash_common(net_if->auth, lgtkhash, WS_GTK_COUNT, WS_LGTK_COUNT);
+    memcpy(lgtkhash, net_if->auth->gtkhashes + WS_GTK_COUNT, WS_LGTK_COUNT * 8);
 }
 
 uint8_t ws_auth_lgtk_index(struct net_if *net_if)
@@ -112,3 +98,26 @@ int ws_auth_revoke_pmk(struct net_if *net_if, const struct eui64 *eui64)
 {
     return auth_revoke_pmk(net_if->auth, eui64);
 }
+
+void ws_auth_supp_usage(struct net_if *net_if, unsigned int *count, size_t *bytes)
+{
+    struct auth_supp_ctx *supp;
+
+    *count = 0;
+    SLIST_FOREACH(supp, &net_if->auth->supplicants, link)
+        (*count)++;
+    *bytes = *count * sizeof(struct auth_supp_ctx);
+}
+
+void ws_auth_session_count(struct net_if *net_if, int *active, int *waiting)
+{
+    struct auth_supp_ctx *supp;
+
+    // Supplicants are never queued, a retransmission timer is running while
+    // an exchange is ongoing.
+    *active = 0;
+    *waiting = 0;
+    SLIST_FOREACH(supp, &net_if->auth->supplicants, link)
+        if (!timer_stopped(&supp->rt_timer))
+            (*active)++;
+}
@@ -15,6 +15,7 @@
 #define WS_AUTH_H
 
 #include <net/if.h>
+#include <stddef.h>
 
 #include "common/crypto/ws_keys.h"
 
@@ -40,4 +41,11 @@ bool ws_auth_is_1st_msg(struct net_if *net_if, const void *buf, size_t buf_len);
 
 int ws_auth_revoke_pmk(struct net_if *net_if, const struct eui64 *eui64);
 
+// Number of supplicants with an ongoing authentication, and number of
+// supplicants waiting for one because of congestion.
+void ws_auth_session_count(struct net_if *net_if, int *active, int *waiting);
+// Number of supplicants known by the authenticator, and memory used by their
+// entries (without the ongoing TLS sessions).
+void ws_auth_supp_usage(struct net_if *net_if, unsigned int *count, size_t *bytes);
+
 #endif
@@ -19,12 +19,16 @@
 #include "app_wsbrd/net/protocol.h"
 #include "app_wsbrd/security/eapol/eapol_helper.h"
 #include "app_wsbrd/security/kmp/kmp_socket_if.h"
+#include "app_wsbrd/security/protocols/tls_sec_prot/tls_sec_prot_lib.h"
 #include "app_wsbrd/ws/ws_bootstrap.h"
 #include "app_wsbrd/ws/ws_eapol_pdu.h"
 #include "app_wsbrd/ws/ws_eapol_auth_relay.h"
 #include "app_wsbrd/ws/ws_eapol_relay.h"
 #include "app_wsbrd/ws/ws_llc.h"
+#include "app_wsbrd/ws/ws_pae_auth.h"
 #include "app_wsbrd/ws/ws_pae_controller.h"
+#include "app_wsbrd/ws/ws_pae_key_storage.h"
+#include "app_wsbrd/ws/ws_pae_lib.h"
 #include "common/specs/ieee802159.h"
 #include "common/log_legacy.h"
 #include "common/memutils.h"
@@ -111,6 +115,9 @@ void ws_auth_init(struct net_if *net_if, const struct wsbrd_conf *conf, const ch
     uint8_t addr_linklocal[16];
     bool force = false;
 
+    WARN_ON(conf->auth_cfg.tls_workers, "tls_workers is not supported by the legacy authenticator");
+    tls_sec_prot_lib_session_cache_init(conf->auth_cfg.tls_session_cache_size,
+                                        conf->auth_cfg.ffn.pmk_lifetime_s);
     ws_pae_controller_init(net_if);
     ws_pae_controller_cb_register(net_if,
                                   ws_bootstrap_nw_key_set,
@@ -123,13 +130,16 @@ void ws_auth_init(struct net_if *net_if, const struct wsbrd_conf *conf, const ch
     ws_eapol_pdu_mpx_register(net_if, mpx_api, MPX_ID_KMP);
 
     ws_pae_controller_configure(net_if, &timing_ffn, &timing_lfn,
-                                &size_params[conf->ws_size].security_protocol_config);
+                                &size_params[conf->ws_size].security_protocol_config,
+                                conf->auth_cfg.active_supp_max);
 
     if (conf->auth_cfg.radius_secret[0])
         ws_pae_controller_radius_shared_secret_set(net_if->id, strlen(conf->auth_cfg.radius_secret),
                                                    (uint8_t *)conf->auth_cfg.radius_secret);
-    if (conf->auth_cfg.radius_addr.ss_family != AF_UNSPEC)
-        ws_pae_controller_radius_address_set(net_if->id, &conf->auth_cfg.radius_addr);
+    if (conf->auth_cfg.radius_addr[0].ss_family != AF_UNSPEC)
+        ws_pae_controller_radius_address_set(net_if->id, &conf->auth_cfg.radius_addr[0]);
+    if (conf->auth_cfg.radius_addr[1].ss_family != AF_UNSPEC)
+        WARN("only the first radius_server is used by the legacy authenticator");
 
     force = false;
     for (int i = 0; i < WS_GTK_COUNT; i++) {
@@ -250,5 +260,19 @@ int ws_auth_revoke_pmk(struct net_if *net_if, const struct eui64 *eui64)
     int ret;
 
     ret = ws_pae_controller_node_keys_remove(net_if->id, eui64->u8);
+    tls_sec_prot_lib_session_cache_flush();
     return ret < 0 ? -EINVAL : 0;
 }
+
+void ws_auth_supp_usage(struct net_if *net_if, unsigned int *count, size_t *bytes)
+{
+    // Supplicants are kept in the key storage, and only loaded during their
+    // authentication.
+    *count = ws_pae_key_storage_count();
+    *bytes = *count * sizeof(supp_entry_t);
+}
+
+void ws_auth_session_count(struct net_if *net_if, int *active, int *waiting)
+{
+    ws_pae_auth_session_count(net_if, active, waiting);
+}
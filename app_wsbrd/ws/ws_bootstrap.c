@@ -161,6 +161,8 @@ void ws_bootstrap_nw_key_set(struct net_if *cur,
     struct ws_neigh *neigh;
 
     BUG_ON(key_index < 1 || key_index > 7);
+    // The GTKHASH-IE and LGTKHASH-IE are derived from the keys
+    ws_llc_mngt_ie_cache_invalidate(&cur->ws_info);
     // Firmware API < 0.15 crashes if slots > 3 are accessed
     if (!cur->ws_info.enable_lfn && key_index > 4)
         return;
@@ -183,6 +185,7 @@ void ws_bootstrap_nw_key_set(struct net_if *cur,
 
 void ws_bootstrap_nw_key_index_set(struct net_if *cur, uint8_t index)
 {
+    ws_llc_mngt_ie_cache_invalidate(&cur->ws_info);
     if (cur->ws_info.lfn_gtk_index != 0 &&
         cur->ws_info.lfn_gtk_index != index + 1 &&
         index >= 4 && index < 7)
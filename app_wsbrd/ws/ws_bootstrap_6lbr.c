@@ -57,7 +57,7 @@
 #include "ws/ws_eapol_relay.h"
 #include "ws/ws_mngt.h"
 
-static int8_t ws_bootstrap_6lbr_fhss_configure(struct net_if *cur)
+int8_t ws_bootstrap_6lbr_fhss_configure(struct net_if *cur)
 {
     const struct ws_fhss_config *fhss = &cur->ws_info.fhss_config;
     uint8_t chan_mask_async[WS_CHAN_MASK_LEN];
@@ -203,13 +203,13 @@ static void ws_bootstrap_6lbr_print_interop(struct net_if *cur)
         sprintf(ffn10, "no");
         sprintf(lfn, cur->ws_info.enable_lfn ? "yes" : "no");
     } else {
-        sprintf(ffn10, cur->ws_info.enable_ffn10 ? "yes" : "no");
+        sprintf(ffn10, ws_ffn10_enabled(&cur->ws_info) ? "yes" : "no");
         sprintf(lfn, "no");
     }
     INFO("    1     %-6s    %-6s    %-6s", ffn10, "yes", lfn);
 
     i = 1;
-    if (cur->ws_info.enable_ffn10)
+    if (ws_ffn10_enabled(&cur->ws_info))
         sprintf(ffn10, "can[%i]", i++);
     else
         sprintf(ffn10, "no");
@@ -220,13 +220,13 @@ static void ws_bootstrap_6lbr_print_interop(struct net_if *cur)
     INFO("   >1     %-6s    %-6s    %-6s", ffn10, "yes", lfn);
 
     i = 1;
-    if (cur->ws_info.enable_ffn10) {
+    if (ws_ffn10_enabled(&cur->ws_info)) {
         INFO("  [%i]: neighboring routers must use a channel plan 0 (reg. domain & op. class)", i++);
         INFO("       or 1 (custom)");
     }
     if (cur->ws_info.enable_lfn) {
         INFO("  [%i]: neighboring routers must use a channel plan 2 (reg. domain & ChanPlanId)", i);
-        if (cur->ws_info.enable_ffn10) {
+        if (ws_ffn10_enabled(&cur->ws_info)) {
             INFO("       FFN1.0 prevent propagation of LFN IEs, and compromise network security");
         }
     }
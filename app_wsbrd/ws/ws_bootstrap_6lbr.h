@@ -23,5 +23,7 @@
 struct net_if;
 
 void ws_bootstrap_6lbr_init(struct net_if *cur);
+// Send the schedules of ws_info.fhss_config to the RCP
+int8_t ws_bootstrap_6lbr_fhss_configure(struct net_if *cur);
 
 #endif
@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "common/duty_cycle.h"
 #include "common/ws/ws_neigh.h"
 #include "common/ws/ws_types.h"
 
@@ -29,11 +30,16 @@
 
 extern int DEVICE_MIN_SENS;
 
+// Above this share of the duty cycle budget, data frames and PA/PC are
+// deferred to keep the remaining airtime for the control traffic.
+#define WS_DUTY_CYCLE_SHAPING_PERMILLE 900
+
 enum ws_edfe_mode {
     WS_EDFE_DEFAULT  = 0,
     WS_EDFE_DISABLED = 1,
     WS_EDFE_ENABLED  = 2,
-    WS_EDFE_MAX      = 3,
+    WS_EDFE_FRAGMENT = 3, // Only for fragmented datagrams
+    WS_EDFE_MAX      = 4,
 };
 
 enum ws_mode_switch_mode {
@@ -41,16 +47,22 @@ enum ws_mode_switch_mode {
     WS_MODE_SWITCH_DISABLED = 1,
     WS_MODE_SWITCH_PHY      = 2,
     WS_MODE_SWITCH_MAC      = 3,
+    WS_MODE_SWITCH_AUTO     = 4,
 };
 
 struct ws_pan_information {
     int pan_id;
     int test_pan_size;
+    uint16_t pan_size_bias;     // Added to the advertised PAN size, see wsbr_pan_load.h
+    uint16_t pan_size_admission; // Added to the advertised PAN size, see wsbr_admission.h
     uint16_t max_pan_size;
     struct ws_jm_ie jm;
     uint16_t routing_cost;      /**< ETX to border Router. */
     uint16_t pan_version;       /**< Pan configuration version will be updatd by Border router at PAN. */
     uint16_t lfn_version;      /**< LFN Pan configuration version will be updatd by Border router at PAN. */
+    // Highest versions written to the storage, see ws_mngt_version_reserve()
+    uint16_t pan_version_max;
+    uint16_t lfn_version_max;
     bool lfn_version_set: 1;   /**< 1 LFN PAN version is set. */
     unsigned version: 3;        /**< Pan version support. */
 };
@@ -58,15 +70,18 @@ struct ws_pan_information {
 typedef struct ws_info {
     char network_name[33];
     struct ws_mngt mngt;
-    struct ws_ie_custom_list ie_custom_list;
+    struct ws_ie_custom_table ie_custom;
     bool enable_lfn;
+#ifdef HAVE_FAN10
     bool enable_ffn10;
+#endif
     enum ws_edfe_mode edfe_mode;
     unsigned int key_index_mask;  // Bitmask of installed key indices
     struct ws_pan_information pan_information;
     struct ws_phy_config phy_config;
     struct ws_neigh_table neighbor_storage;
     struct ws_fhss_config fhss_config;
+    struct duty_cycle duty_cycle;
     int tx_power_dbm;
     uint8_t ffn_gtk_index;
     uint8_t lfn_gtk_index;
@@ -75,4 +90,15 @@ typedef struct ws_info {
 
 bool ws_common_is_valid_nr(uint8_t node_role);
 
+// Constant false when FAN 1.0 support is compiled out (-DFAN10=OFF), so the
+// related branches are removed.
+static inline bool ws_ffn10_enabled(const struct ws_info *ws_info)
+{
+#ifdef HAVE_FAN10
+    return ws_info->enable_ffn10;
+#else
+    return false;
+#endif
+}
+
 #endif //WS_COMMON_H_
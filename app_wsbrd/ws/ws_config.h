@@ -36,6 +36,7 @@
  * MAC frame counter NVM storing configuration
  */
 #define FRAME_COUNTER_INCREMENT             1000000     // How much frame counter is incremented on start up
+#define FRAME_COUNTER_RESERVATION           100000      // Frame counters reserved by each write to the storage
 
 /*
  * Candidate parent list parameters
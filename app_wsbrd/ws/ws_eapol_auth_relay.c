@@ -32,8 +32,10 @@
 
 #include "net/protocol.h"
 #include "net/ns_address.h"
+#include "net/ns_address_internal.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "6lowpan/mac/mpx_api.h"
+#include "security/kmp/kmp_socket_if.h"
 #include "ws/ws_config.h"
 #include "ws/ws_eapol_pdu.h"
 #include "ws/ws_eapol_relay_lib.h"
@@ -47,6 +49,7 @@ typedef struct eapol_auth_relay {
     struct net_if *interface_ptr;         /**< Interface pointer */
     ns_address_t remote_addr;                               /**< Remote address and port */
     ns_address_t relay_addr;                                /**< Relay address */
+    uint16_t local_port;                                    /**< Local port */
     int socket_id;                                          /**< Socket ID for relay */
     ns_list_link_t link;                                    /**< Link */
 } eapol_auth_relay_t;
@@ -84,6 +87,7 @@ int8_t ws_eapol_auth_relay_start(struct net_if *interface_ptr, uint16_t local_po
     }
 
     eapol_auth_relay->interface_ptr = interface_ptr;
+    eapol_auth_relay->local_port = local_port;
 
     eapol_auth_relay->remote_addr.type = ADDRESS_IPV6;
     memcpy(&eapol_auth_relay->relay_addr.address, remote_addr, 16);
@@ -173,6 +177,19 @@ void ws_eapol_auth_relay_socket_cb(int fd)
     }
 }
 
+int8_t ws_eapol_auth_relay_local_recv(uint16_t local_port, const uint8_t *relay_addr, uint16_t relay_port,
+                                      const uint8_t *eui_64, const void *pdu, uint16_t size)
+{
+    eapol_auth_relay_t *eapol_auth_relay = g_eapol_auth_relay;
+
+    if (!eapol_auth_relay || eapol_auth_relay->local_port != local_port)
+        return -1;
+    if (!addr_is_assigned_to_interface(eapol_auth_relay->interface_ptr, eapol_auth_relay->relay_addr.address))
+        return -1;
+    return kmp_socket_if_pae_local_recv(eapol_auth_relay->relay_addr.identifier, relay_addr, relay_port,
+                                        eui_64, pdu, size);
+}
+
 static int8_t ws_eapol_auth_relay_send_to_kmp(eapol_auth_relay_t *eapol_auth_relay, const uint8_t *eui_64, const uint8_t *ip_addr, uint16_t port, const void *data, uint16_t data_len)
 {
     struct sockaddr_in6 sockaddr = { .sin6_family = AF_INET6, .sin6_port = htons(eapol_auth_relay->relay_addr.identifier) };
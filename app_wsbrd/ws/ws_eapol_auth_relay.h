@@ -48,4 +48,23 @@ void ws_eapol_auth_relay_socket_cb(int fd);
  */
 int8_t ws_eapol_auth_relay_start(struct net_if *interface_ptr, uint16_t local_port, const uint8_t *remote_addr, uint16_t remote_port);
 
+/**
+ *  ws_eapol_auth_relay_local_recv receive a message from an EAPOL relay
+ *  running in the same process, and hand it directly to the PAE when it is
+ *  local too
+ *
+ * \param local_port port the message would have been sent to
+ * \param relay_addr address of the EAPOL relay
+ * \param relay_port port of the EAPOL relay
+ * \param eui_64 supplicant EUI-64
+ * \param pdu KMP ID followed by the EAPOL PDU
+ * \param size size of the pdu
+ *
+ * \return < 0 the PAE is not local, the message must be sent on the socket
+ * \return >= 0 success
+ *
+ */
+int8_t ws_eapol_auth_relay_local_recv(uint16_t local_port, const uint8_t *relay_addr, uint16_t relay_port,
+                                      const uint8_t *eui_64, const void *pdu, uint16_t size);
+
 #endif
@@ -31,9 +31,11 @@
 
 #include "net/protocol.h"
 #include "net/ns_address.h"
+#include "net/ns_address_internal.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "6lowpan/mac/mpx_api.h"
 #include "ws/ws_config.h"
+#include "ws/ws_eapol_auth_relay.h"
 #include "ws/ws_eapol_pdu.h"
 #include "ws/ws_eapol_relay_lib.h"
 
@@ -44,6 +46,7 @@ typedef struct eapol_relay {
     struct net_if *interface_ptr;         /**< Interface pointer */
     ns_address_t remote_addr;                               /**< Remote address (border router address) */
     int socket_id;                                          /**< Socket ID for relay */
+    uint16_t local_port;                                    /**< Local port */
     ns_list_link_t link;                                    /**< Link */
 } eapol_relay_t;
 
@@ -88,6 +91,7 @@ int8_t ws_eapol_relay_start(struct net_if *interface_ptr, uint16_t local_port, c
     }
 
     eapol_relay->interface_ptr = interface_ptr;
+    eapol_relay->local_port = local_port;
 
     eapol_relay->remote_addr.type = ADDRESS_IPV6;
     memcpy(&eapol_relay->remote_addr.address, remote_addr, 16);
@@ -124,6 +128,12 @@ static int8_t ws_eapol_relay_eapol_pdu_receive(struct net_if *interface_ptr, con
         return -1;
     }
 
+    // The authenticator relay runs in this process, skip the loopback sockets
+    if (addr_is_assigned_to_interface(interface_ptr, eapol_relay->remote_addr.address) &&
+        ws_eapol_auth_relay_local_recv(eapol_relay->remote_addr.identifier,
+                                       eapol_relay->remote_addr.address, eapol_relay->local_port,
+                                       eui_64, pdu, size) >= 0)
+        return 0;
     ws_eapol_relay_lib_send_to_relay(eapol_relay->socket_id, eui_64, &eapol_relay->remote_addr, pdu, size);
     return 0;
 }
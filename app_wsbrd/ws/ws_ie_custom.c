@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include "common/log.h"
+#include "common/memutils.h"
 #include "common/bits.h"
 #include "common/ieee802154_ie.h"
 #include "common/sys_queue_extra.h"
@@ -21,17 +22,55 @@
 
 #include "ws_ie_custom.h"
 
-void ws_ie_custom_clear(struct ws_ie_custom_list *list)
+static void ws_ie_custom_encode(struct ws_ie_custom_table *table)
 {
     struct ws_ie_custom *ie;
 
-    while ((ie = SLIST_POP(list, link))) {
+    for (int i = 0; i < ARRAY_SIZE(table->wh); i++) {
+        iobuf_free(&table->wh[i]);
+        iobuf_free(&table->wp[i]);
+        SLIST_FOREACH(ie, &table->list, link) {
+            if (!(ie->frame_type_mask & BIT(i)))
+                continue;
+            if (ie->ie_type == WS_IE_CUSTOM_TYPE_HEADER)
+                iobuf_push_data(&table->wh[i], ie->buf.data, ie->buf.len);
+            else
+                iobuf_push_data(&table->wp[i], ie->buf.data, ie->buf.len);
+        }
+    }
+}
+
+void ws_ie_custom_clear(struct ws_ie_custom_table *table)
+{
+    struct ws_ie_custom *ie;
+
+    while ((ie = SLIST_POP(&table->list, link))) {
         iobuf_free(&ie->buf);
         free(ie);
     }
+    ws_ie_custom_encode(table);
+}
+
+void ws_ie_custom_push_wh(const struct ws_ie_custom_table *table, uint8_t frame_type,
+                          struct iobuf_write *buf)
+{
+    if (frame_type < ARRAY_SIZE(table->wh) && table->wh[frame_type].len)
+        iobuf_push_data(buf, table->wh[frame_type].data, table->wh[frame_type].len);
+}
+
+void ws_ie_custom_push_wp(const struct ws_ie_custom_table *table, uint8_t frame_type,
+                          struct iobuf_write *buf)
+{
+    if (frame_type < ARRAY_SIZE(table->wp) && table->wp[frame_type].len)
+        iobuf_push_data(buf, table->wp[frame_type].data, table->wp[frame_type].len);
+}
+
+bool ws_ie_custom_has_wp(const struct ws_ie_custom_table *table, uint8_t frame_type)
+{
+    return frame_type < ARRAY_SIZE(table->wp) && table->wp[frame_type].len;
 }
 
-int ws_ie_custom_update(struct ws_ie_custom_list *list, enum ws_ie_custom_type type, uint8_t id,
+int ws_ie_custom_update(struct ws_ie_custom_table *table, enum ws_ie_custom_type type, uint8_t id,
                          const uint8_t *content, size_t content_len, uint16_t frame_type_mask)
 {
     struct ws_ie_custom *ie;
@@ -56,19 +95,20 @@ int ws_ie_custom_update(struct ws_ie_custom_list *list, enum ws_ie_custom_type t
         return -EINVAL;
     }
 
-    ie = SLIST_FIND(ie, list, link, ie->ie_type == type && ie->ie_id == id);
+    ie = SLIST_FIND(ie, &table->list, link, ie->ie_type == type && ie->ie_id == id);
     if (ie) {
         iobuf_free(&ie->buf);
         if (!frame_type_mask) {
-            SLIST_REMOVE(list, ie, ws_ie_custom, link);
+            SLIST_REMOVE(&table->list, ie, ws_ie_custom, link);
             free(ie);
+            ws_ie_custom_encode(table);
             return 0;
         }
     } else {
         ie = calloc(1, sizeof(struct ws_ie_custom));
         if (!ie)
             return -errno;
-        SLIST_INSERT_HEAD(list, ie, link);
+        SLIST_INSERT_HEAD(&table->list, ie, link);
     }
 
     ie->frame_type_mask = frame_type_mask;
@@ -85,5 +125,6 @@ int ws_ie_custom_update(struct ws_ie_custom_list *list, enum ws_ie_custom_type t
         iobuf_push_data(&ie->buf, content, content_len);
         ieee802154_ie_fill_len_nested(&ie->buf, offset, type == WS_IE_CUSTOM_TYPE_NESTED_LONG);
     }
+    ws_ie_custom_encode(table);
     return 0;
 }
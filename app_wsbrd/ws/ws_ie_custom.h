@@ -16,6 +16,7 @@
 
 #include <sys/queue.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 #include "common/iobuf.h"
@@ -38,9 +39,24 @@ struct ws_ie_custom {
 // Define struct ws_ie_custom_list
 SLIST_HEAD(ws_ie_custom_list, ws_ie_custom);
 
+// The IEs enabled for each frame type are concatenated when the list changes,
+// so building a frame only copies them.
+struct ws_ie_custom_table {
+    struct ws_ie_custom_list list;
+    // Indexed by frame type, like the bits of frame_type_mask
+    struct iobuf_write wh[16];
+    struct iobuf_write wp[16]; // Nested IEs
+};
+
 // If frame_type_mask is 0, remove IE(type, id), otherwise insert/update IE(type, id).
-int ws_ie_custom_update(struct ws_ie_custom_list *list, enum ws_ie_custom_type type, uint8_t id,
+int ws_ie_custom_update(struct ws_ie_custom_table *table, enum ws_ie_custom_type type, uint8_t id,
                         const uint8_t *content, size_t content_len, uint16_t frame_type_mask);
-void ws_ie_custom_clear(struct ws_ie_custom_list *list);
+void ws_ie_custom_clear(struct ws_ie_custom_table *table);
+// Append the header IEs or the nested IEs enabled for frame_type.
+void ws_ie_custom_push_wh(const struct ws_ie_custom_table *table, uint8_t frame_type,
+                          struct iobuf_write *buf);
+void ws_ie_custom_push_wp(const struct ws_ie_custom_table *table, uint8_t frame_type,
+                          struct iobuf_write *buf);
+bool ws_ie_custom_has_wp(const struct ws_ie_custom_table *table, uint8_t frame_type);
 
 #endif
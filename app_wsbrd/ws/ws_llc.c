@@ -36,6 +36,7 @@
 #include "common/iobuf.h"
 #include "common/time_extra.h"
 #include "common/mathutils.h"
+#include "common/rand.h"
 #include "common/memutils.h"
 #include "common/mpx.h"
 #include "common/version.h"
@@ -46,6 +47,7 @@
 
 #include "app/wsbrd.h"
 #include "app/wsbr_mac.h"
+#include "app/wsbr_metrics.h"
 #include "app/rcp_api_legacy.h"
 #include "net/timers.h"
 #include "net/protocol.h"
@@ -64,11 +66,25 @@
 #define TRACE_GROUP "wllc"
 
 #define LLC_MESSAGE_QUEUE_LIST_SIZE_MAX   16 //Do not config over 30 never
+#define LLC_MESSAGE_POOL_SIZE             LLC_MESSAGE_QUEUE_LIST_SIZE_MAX
+#define LLC_MPX_ID_COUNT                  16 // mpx_class.mpx_id is 4 bits
+
+// Ensure llc_message_id_allocate() always finds a free MPX ID
+static_assert(LLC_MESSAGE_QUEUE_LIST_SIZE_MAX <= LLC_MPX_ID_COUNT, "out-of-range");
 #define MPX_USER_SIZE 2
 
 #define TX_CONFIRM_EXTENSIVE_FFN_SEC 5
 #define TX_CONFIRM_EXTENSIVE_LFN_MULTIPLIER 3
 
+// Transmission attempts of unicast frames, split by automatic mode switch
+// between several PhyModeIds, see ws_llc_ms_auto_fill_rates()
+#define WS_LLC_TX_ATTEMPTS               20
+#define WS_LLC_MS_AUTO_TX_ATTEMPTS        3
+// Try a faster PhyModeId first for 1 frame out of 10
+#define WS_LLC_MS_AUTO_PROBE_INTERVAL    10
+#define WS_LLC_MS_AUTO_UPDATE_MS       1000
+#define WS_LLC_MS_AUTO_EWMA_WEIGHT     0.25f
+
 typedef struct mpx_user {
     uint16_t                user_id;        /**< User ID for identify MPX User */
     mpx_data_confirm        *data_confirm;  /**< User registred MPX Data confirmation call back */
@@ -89,6 +105,8 @@ typedef struct llc_message {
     unsigned        message_type: 4;   /**< Frame type to UTT */
     unsigned        mpx_id: 5;          /**< MPX sequence */
     bool            ack_requested: 1;   /**< ACK requested */
+    bool            edfe: 1;            /**< Sent with FC-IE */
+    bool            async: 1;           /**< Sent on all the channels */
     unsigned        dst_address_type: 2; /**<  Destination address type */
     unsigned        src_address_type: 2; /**<  Source address type */
     uint8_t         msg_handle;         /**< LLC genetaed unique MAC handle */
@@ -97,9 +115,10 @@ typedef struct llc_message {
     struct iobuf_write ie_buf_header;
     struct iovec    ie_iov_header;
     struct iobuf_write ie_buf_payload;
-    struct iovec    ie_iov_payload[2]; // { WP-IE and MPX-IE header, MPX payload }
+    struct iovec    ie_iov_payload[3]; // { WP-IE and MPX-IE header, MPX payload prefix, MPX payload }
     mcps_data_req_ie_list_t ie_ext;
     time_t tx_time;
+    uint64_t tx_time_us; // CLOCK_MONOTONIC
     struct mlme_security security;
     struct rcp_rate_info rate_list[4];
     ns_list_link_t  link;               /**< List link entry */
@@ -113,18 +132,39 @@ typedef struct temp_entriest {
     bool                            active_eapol_session: 1;        /**< Indicating active EAPOL message */
 } temp_entriest_t;
 
+// Serialized WP-IE of PA, PC and LPA frames. Their content only changes with
+// the PAN version, the keys, or the few fields stored here which are checked
+// before each use.
+struct llc_wp_ie_cache {
+    struct iobuf_write buf;
+    bool valid;
+    uint16_t pan_size;
+    unsigned int jm_mask;
+    uint8_t jm_version;
+};
+
 /** EDFE response and Enhanced ACK data length */
 
 typedef struct llc_data_base {
     ns_list_link_t                  link;                           /**< List link entry */
 
     uint8_t                         mac_handle_base;                /**< Mac handle id base this will be updated by 1 after use */
+    llc_message_t                   *mac_handle_table[UINT8_MAX + 1]; /**< Active messages indexed by MAC handle */
+    llc_message_t                   *mpx_id_table[LLC_MPX_ID_COUNT]; /**< Active MPX messages indexed by MPX ID */
     uint8_t                         llc_message_list_size;          /**< llc_message_list list size */
     mpx_class_t                     mpx_data_base;                  /**< MPX data be including USER API Class and user call backs */
 
     llc_message_list_t              llc_message_list;               /**< Active Message list */
     temp_entriest_t                 temp_entries;
 
+    // Messages are taken from this pool so the TX path does not allocate.
+    // Queued EAPOL frames are not accounted in llc_message_list_size, so
+    // messages are allocated on the heap if the pool is exhausted.
+    llc_message_t                   message_pool[LLC_MESSAGE_POOL_SIZE];
+    llc_message_list_t              message_pool_free;
+
+    struct llc_wp_ie_cache          wp_ie_cache[3];                 /**< See ws_llc_wp_ie_cache_get() */
+
     ws_llc_mngt_ind_cb              *mngt_ind;                      /* Called when Wi-SUN management frame (PA/PAS/PC/PCS/LPA/LPAS/LPC/LPCS) is received */
     ws_llc_mngt_cnf_cb              *mngt_cnf;                      /* Called when RCP confirms transmission of a Wi-SUN management frame (PA/PAS/PC/PCS/LPA/LPAS/LPC/LPCS) */
     struct net_if *interface_ptr;                 /**< List link entry */
@@ -133,8 +173,8 @@ typedef struct llc_data_base {
 static llc_data_base_t g_llc_base;
 
 /** LLC message local functions */
-static llc_message_t *llc_message_discover_by_mac_handle(uint8_t handle, llc_message_list_t *list);
-static llc_message_t *llc_message_discover_by_mpx_id(uint8_t handle, llc_message_list_t *list);
+static llc_message_t *llc_message_discover_by_mac_handle(uint8_t handle, llc_data_base_t *llc_base);
+static llc_message_t *llc_message_discover_by_mpx_id(uint8_t mpx_id, llc_data_base_t *llc_base);
 static void llc_message_free(llc_message_t *message, llc_data_base_t *llc_base);
 static void llc_message_id_allocate(llc_message_t *message, llc_data_base_t *llc_base, bool mpx_user);
 static llc_message_t *llc_message_allocate(llc_data_base_t *llc_base);
@@ -147,6 +187,14 @@ static uint16_t ws_llc_mpx_header_size_get(const mpx_api_t *api, uint16_t user_i
 static void ws_llc_mpx_init(mpx_class_t *mpx_class);
 
 static void ws_llc_rate_handle_tx_conf(llc_data_base_t *base, const mcps_data_cnf_t *data, struct ws_neigh *neighbor);
+static void ws_llc_ms_auto_tx_conf(const struct ws_info *ws_info, const struct llc_message *msg,
+                                   const struct mcps_data_cnf *confirm, struct ws_neigh *ws_neigh);
+static void ws_llc_airtime_tx_conf(const struct ws_info *ws_info, const struct llc_message *msg,
+                                   const struct mcps_data_cnf *confirm, struct ws_neigh *ws_neigh);
+static void ws_llc_stats_tx_conf(const struct ws_info *ws_info, const struct llc_message *msg,
+                                 const struct mcps_data_cnf *confirm, struct ws_neigh *ws_neigh);
+static void ws_llc_duty_cycle_tx_conf(struct ws_info *ws_info, const struct llc_message *msg,
+                                      const struct mcps_data_cnf *confirm);
 
 
 static void ws_llc_mpx_eapol_send(llc_data_base_t *base, llc_message_t *message);
@@ -162,77 +210,87 @@ static uint8_t ws_llc_get_node_role(struct net_if *interface, const uint8_t eui6
 }
 
 /** Discover Message by message handle id */
-static llc_message_t *llc_message_discover_by_mac_handle(uint8_t handle, llc_message_list_t *list)
+static llc_message_t *llc_message_discover_by_mac_handle(uint8_t handle, llc_data_base_t *llc_base)
 {
-    ns_list_foreach(llc_message_t, message, list) {
-        if (message->msg_handle == handle) {
-            return message;
-        }
-    }
-    return NULL;
+    return llc_base->mac_handle_table[handle];
 }
 
-static llc_message_t *llc_message_discover_by_mpx_id(uint8_t handle, llc_message_list_t *list)
+static llc_message_t *llc_message_discover_by_mpx_id(uint8_t mpx_id, llc_data_base_t *llc_base)
 {
-    ns_list_foreach(llc_message_t, message, list) {
-        if ((message->message_type == WS_FT_DATA || message->message_type == WS_FT_EAPOL) && message->mpx_id == handle) {
-            return message;
-        }
+    return llc_base->mpx_id_table[mpx_id % LLC_MPX_ID_COUNT];
+}
+
+static bool llc_message_from_pool(const llc_message_t *message, const llc_data_base_t *llc_base)
+{
+    return message >= llc_base->message_pool &&
+           message < llc_base->message_pool + ARRAY_SIZE(llc_base->message_pool);
+}
+
+// Return a message which is not part of any list to the pool
+static void llc_message_release(llc_message_t *message, llc_data_base_t *llc_base)
+{
+    if (llc_message_from_pool(message, llc_base)) {
+        // The IE buffers are kept for the next user of this entry
+        ns_list_add_to_start(&llc_base->message_pool_free, message);
+    } else {
+        iobuf_free(&message->ie_buf_header);
+        iobuf_free(&message->ie_buf_payload);
+        free(message);
     }
-    return NULL;
 }
 
 //Free message and delete from list
 static void llc_message_free(llc_message_t *message, llc_data_base_t *llc_base)
 {
     ns_list_remove(&llc_base->llc_message_list, message);
-    iobuf_free(&message->ie_buf_header);
-    iobuf_free(&message->ie_buf_payload);
-    free(message);
+    BUG_ON(llc_base->mac_handle_table[message->msg_handle] != message);
+    llc_base->mac_handle_table[message->msg_handle] = NULL;
+    if (llc_base->mpx_id_table[message->mpx_id % LLC_MPX_ID_COUNT] == message)
+        llc_base->mpx_id_table[message->mpx_id % LLC_MPX_ID_COUNT] = NULL;
+    llc_message_release(message, llc_base);
     llc_base->llc_message_list_size--;
     red_aq_calc(&llc_base->interface_ptr->llc_random_early_detection, llc_base->llc_message_list_size);
 }
 
 static void llc_message_id_allocate(llc_message_t *message, llc_data_base_t *llc_base, bool mpx_user)
 {
-    //Guarantee
-    while (1) {
-        if (llc_message_discover_by_mac_handle(llc_base->mac_handle_base, &llc_base->llc_message_list)) {
-            llc_base->mac_handle_base++;
-        } else {
-            break;
-        }
-    }
-    if (mpx_user) {
-        while (1) {
-            if (llc_message_discover_by_mpx_id(llc_base->mpx_data_base.mpx_id, &llc_base->llc_message_list)) {
-                llc_base->mpx_data_base.mpx_id++;
-            } else {
-                break;
-            }
-        }
-    }
+    // The table has many more entries than LLC_MESSAGE_QUEUE_LIST_SIZE_MAX,
+    // so a free handle is found within a few iterations.
+    while (llc_base->mac_handle_table[llc_base->mac_handle_base])
+        llc_base->mac_handle_base++;
+    if (mpx_user)
+        while (llc_message_discover_by_mpx_id(llc_base->mpx_data_base.mpx_id, llc_base))
+            llc_base->mpx_data_base.mpx_id++;
 
     //Storage handle and update base
     message->msg_handle = llc_base->mac_handle_base++;
+    llc_base->mac_handle_table[message->msg_handle] = message;
     if (mpx_user) {
         message->mpx_id = llc_base->mpx_data_base.mpx_id++;
+        llc_base->mpx_id_table[message->mpx_id] = message;
     }
 }
 
 static llc_message_t *llc_message_allocate(llc_data_base_t *llc_base)
 {
+    struct iobuf_write ie_buf_header, ie_buf_payload;
+    llc_message_t *message;
+
     if (llc_base->llc_message_list_size >= LLC_MESSAGE_QUEUE_LIST_SIZE_MAX) {
         return NULL;
     }
 
-    llc_message_t *message = calloc(1, sizeof(llc_message_t));
-    if (!message) {
-        return NULL;
-    }
-    message->ack_requested = false;
-    memset(&message->ie_buf_header, 0, sizeof(struct iobuf_write));
-    memset(&message->ie_buf_payload, 0, sizeof(struct iobuf_write));
+    message = ns_list_get_first(&llc_base->message_pool_free);
+    if (!message)
+        return zalloc(sizeof(llc_message_t));
+    ns_list_remove(&llc_base->message_pool_free, message);
+    ie_buf_header  = message->ie_buf_header;
+    ie_buf_payload = message->ie_buf_payload;
+    memset(message, 0, sizeof(llc_message_t));
+    message->ie_buf_header  = ie_buf_header;
+    message->ie_buf_payload = ie_buf_payload;
+    message->ie_buf_header.len  = 0;
+    message->ie_buf_payload.len = 0;
     return message;
 }
 
@@ -379,6 +437,7 @@ static void ws_llc_data_confirm(struct llc_data_base *base, struct llc_message *
     struct ws_utt_ie ie_utt;
     int ie_rsl;
 
+    wsbr_metrics_tx_cnf(confirm->hif.status, confirm->hif.tx_retries);
     if (msg->ack_requested) {
         switch (confirm->hif.status) {
         case HIF_STATUS_SUCCESS:
@@ -438,7 +497,7 @@ void ws_llc_mac_confirm_cb(struct net_if *net_if, const mcps_data_cnf_t *data,
     struct llc_message *msg;
     time_t tx_confirm_duration;
 
-    msg = llc_message_discover_by_mac_handle(data_cpy.hif.handle, &base->llc_message_list);
+    msg = llc_message_discover_by_mac_handle(data_cpy.hif.handle, base);
     if (!msg)
         return;
 
@@ -467,7 +526,18 @@ void ws_llc_mac_confirm_cb(struct net_if *net_if, const mcps_data_cnf_t *data,
         }
 
         ws_llc_rate_handle_tx_conf(base, data, ws_neigh);
+        if (msg->edfe) {
+            ws_neigh->edfe_tx_count++;
+            if (data_cpy.hif.status != HIF_STATUS_SUCCESS)
+                ws_neigh->edfe_tx_fail_count++;
+        }
+        if (msg->ack_requested) {
+            ws_llc_ms_auto_tx_conf(&net_if->ws_info, msg, &data_cpy, ws_neigh);
+            ws_llc_airtime_tx_conf(&net_if->ws_info, msg, &data_cpy, ws_neigh);
+            ws_llc_stats_tx_conf(&net_if->ws_info, msg, &data_cpy, ws_neigh);
+        }
     }
+    ws_llc_duty_cycle_tx_conf(&net_if->ws_info, msg, &data_cpy);
 
     tx_confirm_duration = time_get_elapsed(CLOCK_MONOTONIC, msg->tx_time);
 
@@ -612,9 +682,7 @@ static void ws_llc_data_ffn_ind(struct net_if *net_if, const mcps_data_ind_t *da
             ws_neigh_us_update(&base->interface_ptr->ws_info.fhss_config, &ws_neigh->fhss_data_unsecured, &ie_us.chan_plan,
                                         ie_us.dwell_interval);
         }
-        if (data->DstAddrMode == ADDR_802_15_4_LONG)
-            ws_neigh->unicast_data_rx = true;
-
+        ws_neigh_stats_rx(ws_neigh);
         // Calculate RSL for all UDATA packets heard
         ws_neigh->rsl_in_dbm = ws_neigh_ewma_next(ws_neigh->rsl_in_dbm, data->hif.rx_power_dbm);
         ws_neigh->rx_power_dbm = data->hif.rx_power_dbm;
@@ -703,9 +771,7 @@ static void ws_llc_data_lfn_ind(struct net_if *net_if, const mcps_data_ind_t *da
                             ie_lus.listen_interval, &ws_neigh->lto_info);
     }
 
-    if (data->DstAddrMode == ADDR_802_15_4_LONG)
-        ws_neigh->unicast_data_rx = true;
-
+    ws_neigh_stats_rx(ws_neigh);
     // Calculate RSL for all UDATA packets heard
     ws_neigh->rsl_in_dbm = ws_neigh_ewma_next(ws_neigh->rsl_in_dbm, data->hif.rx_power_dbm);
     ws_neigh->rx_power_dbm = data->hif.rx_power_dbm;
@@ -1018,9 +1084,8 @@ static inline bool ws_is_frame_mngt(uint8_t frame_type)
     return ret;
 }
 
-/** WS LLC MAC data extension indication  */
-void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
-                              const struct mcps_data_rx_ie_list *ie_ext)
+static void ws_llc_mac_indication(struct net_if *net_if, struct mcps_data_ind *data,
+                                  const struct mcps_data_rx_ie_list *ie_ext)
 {
     struct ws_neigh *neigh;
     struct ws_lutt_ie ie_lutt;
@@ -1059,6 +1124,8 @@ void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
         }
         neigh->frame_counter_min[data->Key.KeyIndex - 1] = add32sat(data->Key.frame_counter, 1);
     }
+    if (neigh)
+        ws_neigh_heard(&net_if->ws_info.neighbor_storage, neigh);
 
     // HACK: In FAN 1.0 the source address is elided in EDFE response frames
     if (ws_wh_fc_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_fc)) {
@@ -1086,17 +1153,86 @@ void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
         TRACE(TR_DROP, "drop %-9s: unsupported frame type (0x%02x)", "15.4", frame_type);
     }
 }
+
+/** WS LLC MAC data extension indication  */
+void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
+                              const struct mcps_data_rx_ie_list *ie_ext)
+{
+    ws_ie_index_build(ie_ext->headerIeList, ie_ext->headerIeListLength,
+                      ie_ext->payloadIeList, ie_ext->payloadIeListLength);
+    ws_llc_mac_indication(net_if, data, ie_ext);
+    ws_ie_index_clear();
+}
+static struct llc_wp_ie_cache *ws_llc_wp_ie_cache_get(llc_data_base_t *base, uint8_t frame_type)
+{
+    switch (frame_type) {
+    case WS_FT_PA:  return &base->wp_ie_cache[0];
+    case WS_FT_PC:  return &base->wp_ie_cache[1];
+    case WS_FT_LPA: return &base->wp_ie_cache[2];
+    default:        return NULL;
+    }
+}
+
+static void ws_llc_wp_ie_write(llc_data_base_t *base, struct iobuf_write *buf, uint8_t frame_type,
+                               const struct wp_ie_list *wp_ies, uint16_t pan_size)
+{
+    struct ws_info *info = &base->interface_ptr->ws_info;
+    uint8_t gtkhash[4][8];
+    int ie_offset;
+
+    ie_offset = ieee802154_ie_push_payload(buf, IEEE802154_IE_ID_WP);
+    if (wp_ies->us)
+        ws_wp_nested_us_write(buf, &info->fhss_config);
+    if (wp_ies->bs)
+        ws_wp_nested_bs_write(buf, &info->fhss_config);
+    if (wp_ies->pan)
+        ws_wp_nested_pan_write(buf, pan_size,
+                               info->pan_information.routing_cost, info->pan_information.version);
+    if (wp_ies->netname)
+        ws_wp_nested_netname_write(buf, info->network_name);
+    if (wp_ies->panver)
+        ws_wp_nested_panver_write(buf, info->pan_information.pan_version);
+    if (wp_ies->gtkhash) {
+        ws_auth_gtkhash(base->interface_ptr, gtkhash);
+        ws_wp_nested_gtkhash_write(buf, gtkhash);
+    }
+    if (wp_ies->pom)
+        ws_wp_nested_pom_write(buf, info->phy_config.phy_op_modes, true);
+    if (wp_ies->lcp)
+        // Only unicast schedule using tag 0 is supported
+        ws_wp_nested_lcp_write(buf, 0, &info->fhss_config);
+    if (wp_ies->lfnver)
+        ws_wp_nested_lfnver_write(buf, info->pan_information.lfn_version);
+    if (wp_ies->lgtkhash) {
+        ws_auth_lgtkhash(base->interface_ptr, gtkhash);
+        ws_wp_nested_lgtkhash_write(buf, gtkhash, ws_auth_lgtk_index(base->interface_ptr));
+    }
+    if (wp_ies->jm)
+        ws_wp_nested_jm_write(buf, &info->pan_information.jm);
+    ws_ie_custom_push_wp(&info->ie_custom, frame_type, buf);
+    ieee802154_ie_fill_len_payload(buf, ie_offset);
+}
+
+// The PAN IE and the JM-IE change without PAN version update
+static bool ws_llc_wp_ie_cache_match(const struct llc_wp_ie_cache *cache,
+                                     const struct ws_info *info, uint16_t pan_size)
+{
+    return cache->valid &&
+           cache->pan_size   == pan_size &&
+           cache->jm_mask    == info->pan_information.jm.mask &&
+           cache->jm_version == info->pan_information.jm.version;
+}
+
 static void ws_llc_prepare_ie(llc_data_base_t *base, llc_message_t *msg,
                               const struct wh_ie_list *wh_ies,
                               const struct wp_ie_list *wp_ies)
 {
     struct ws_info *info = &base->interface_ptr->ws_info;
     uint16_t pan_size = (info->pan_information.test_pan_size == -1) ?
-                         rpl_target_count(&base->interface_ptr->rpl_root) : info->pan_information.test_pan_size;
-    struct ws_ie_custom *ie_custom;
-    bool has_ie_custom_wp = false;
-    uint8_t gtkhash[4][8];
-    int ie_offset;
+                         MIN(rpl_target_count(&base->interface_ptr->rpl_root) + info->pan_information.pan_size_bias +
+                             info->pan_information.pan_size_admission, UINT16_MAX) :
+                         info->pan_information.test_pan_size;
+    struct llc_wp_ie_cache *cache;
     uint8_t plf;
 
     if (info->pan_information.jm.mask & BIT(WS_JM_PLF)) {
@@ -1137,54 +1273,25 @@ static void ws_llc_prepare_ie(llc_data_base_t *base, llc_message_t *msg,
     if (wh_ies->lbc)
         ws_wh_lbc_write(&msg->ie_buf_header, info->fhss_config.lfn_bc_interval,
                         info->fhss_config.lfn_bc_sync_period);
-    SLIST_FOREACH(ie_custom, &info->ie_custom_list, link) {
-        if (!(ie_custom->frame_type_mask & BIT(msg->message_type)))
-            continue;
-        if (ie_custom->ie_type == WS_IE_CUSTOM_TYPE_HEADER)
-            iobuf_push_data(&msg->ie_buf_header, ie_custom->buf.data, ie_custom->buf.len);
-        else
-            has_ie_custom_wp = true;
-    }
+    ws_ie_custom_push_wh(&info->ie_custom, msg->message_type, &msg->ie_buf_header);
     msg->ie_iov_header.iov_base = msg->ie_buf_header.data;
     msg->ie_iov_header.iov_len = msg->ie_buf_header.len;
     msg->ie_ext.headerIeVectorList = &msg->ie_iov_header;
     msg->ie_ext.headerIovLength = 1;
 
-    if (!ws_wp_ie_is_empty(wp_ies) || has_ie_custom_wp) {
-        ie_offset = ieee802154_ie_push_payload(&msg->ie_buf_payload, IEEE802154_IE_ID_WP);
-        if (wp_ies->us)
-            ws_wp_nested_us_write(&msg->ie_buf_payload, &info->fhss_config);
-        if (wp_ies->bs)
-            ws_wp_nested_bs_write(&msg->ie_buf_payload, &info->fhss_config);
-        if (wp_ies->pan)
-            ws_wp_nested_pan_write(&msg->ie_buf_payload, pan_size,
-                                   info->pan_information.routing_cost, info->pan_information.version);
-        if (wp_ies->netname)
-            ws_wp_nested_netname_write(&msg->ie_buf_payload, info->network_name);
-        if (wp_ies->panver)
-            ws_wp_nested_panver_write(&msg->ie_buf_payload, info->pan_information.pan_version);
-        if (wp_ies->gtkhash) {
-            ws_auth_gtkhash(base->interface_ptr, gtkhash);
-            ws_wp_nested_gtkhash_write(&msg->ie_buf_payload, gtkhash);
+    cache = ws_llc_wp_ie_cache_get(base, msg->message_type);
+    if (cache && ws_llc_wp_ie_cache_match(cache, info, pan_size)) {
+        iobuf_push_data(&msg->ie_buf_payload, cache->buf.data, cache->buf.len);
+    } else if (!ws_wp_ie_is_empty(wp_ies) || ws_ie_custom_has_wp(&info->ie_custom, msg->message_type)) {
+        ws_llc_wp_ie_write(base, &msg->ie_buf_payload, msg->message_type, wp_ies, pan_size);
+        if (cache) {
+            iobuf_free(&cache->buf);
+            iobuf_push_data(&cache->buf, msg->ie_buf_payload.data, msg->ie_buf_payload.len);
+            cache->pan_size   = pan_size;
+            cache->jm_mask    = info->pan_information.jm.mask;
+            cache->jm_version = info->pan_information.jm.version;
+            cache->valid      = true;
         }
-        if (wp_ies->pom)
-            ws_wp_nested_pom_write(&msg->ie_buf_payload, info->phy_config.phy_op_modes, true);
-        if (wp_ies->lcp)
-            // Only unicast schedule using tag 0 is supported
-            ws_wp_nested_lcp_write(&msg->ie_buf_payload, 0, &info->fhss_config);
-        if (wp_ies->lfnver)
-            ws_wp_nested_lfnver_write(&msg->ie_buf_payload, info->pan_information.lfn_version);
-        if (wp_ies->lgtkhash) {
-            ws_auth_lgtkhash(base->interface_ptr, gtkhash);
-            ws_wp_nested_lgtkhash_write(&msg->ie_buf_payload, gtkhash, ws_auth_lgtk_index(base->interface_ptr));
-        }
-        if (wp_ies->jm)
-            ws_wp_nested_jm_write(&msg->ie_buf_payload, &info->pan_information.jm);
-        SLIST_FOREACH(ie_custom, &info->ie_custom_list, link)
-            if (ie_custom->frame_type_mask & BIT(msg->message_type) &&
-                ie_custom->ie_type != WS_IE_CUSTOM_TYPE_HEADER)
-                iobuf_push_data(&msg->ie_buf_payload, ie_custom->buf.data, ie_custom->buf.len);
-        ieee802154_ie_fill_len_payload(&msg->ie_buf_payload, ie_offset);
     }
     msg->ie_iov_payload[0].iov_len = msg->ie_buf_payload.len;
     msg->ie_iov_payload[0].iov_base = msg->ie_buf_payload.data;
@@ -1212,7 +1319,7 @@ static uint16_t ws_mpx_header_size_get(llc_data_base_t *base, uint16_t user_id)
     return header_size;
 }
 
-// message->ie_iov_payload[1].iov_len must be set prior to calling this function
+// message->ie_iov_payload[1 to 2].iov_len must be set prior to calling this function
 static void ws_llc_lowpan_mpx_header_write(llc_message_t *message, uint16_t user_id)
 {
     struct mpx_ie mpx_header = {
@@ -1227,7 +1334,8 @@ static void ws_llc_lowpan_mpx_header_write(llc_message_t *message, uint16_t user
     mpx_ie_write(&message->ie_buf_payload, &mpx_header);
     if (message->kmp_id)
         iobuf_push_u8(&message->ie_buf_payload, message->kmp_id);
-    ie_len = message->ie_buf_payload.len - ie_offset - 2 + message->ie_iov_payload[1].iov_len;
+    ie_len = message->ie_buf_payload.len - ie_offset - 2 +
+             message->ie_iov_payload[1].iov_len + message->ie_iov_payload[2].iov_len;
     ieee802154_ie_set_len(&message->ie_buf_payload, ie_offset, ie_len, IEEE802154_IE_PAYLOAD_LEN_MASK);
     message->ie_iov_payload[0].iov_base = message->ie_buf_payload.data;
     message->ie_iov_payload[0].iov_len = message->ie_buf_payload.len;
@@ -1263,13 +1371,289 @@ uint8_t ws_llc_mdr_phy_mode_get(const struct ws_phy_config *phy_config,
                                    ms_phy_mode_id);
 }
 
+static uint8_t ws_llc_ms_mode(const struct ws_info *ws_info, const struct ws_neigh *ws_neigh)
+{
+    return ws_neigh->ms_mode == WS_MODE_SWITCH_DEFAULT ? ws_info->phy_config.ms_mode : ws_neigh->ms_mode;
+}
+
+static int8_t ws_llc_rate_txpow(const struct ws_info *ws_info, const struct ws_neigh *ws_neigh,
+                                uint8_t phy_mode_id)
+{
+    const struct phy_params *phy_params = ws_regdb_phy_params(phy_mode_id, 0);
+
+    if (!ws_neigh || ws_info->fhss_config.regional_regulation != HIF_REG_WPC)
+        return ws_info->tx_power_dbm;
+    else if (phy_params && phy_params->modulation == MODULATION_OFDM)
+        return ws_neigh->apc_txpow_dbm_ofdm;
+    else
+        return ws_neigh->apc_txpow_dbm;
+}
+
+static struct ws_neigh_ms_rate *ws_llc_ms_auto_rate(struct ws_neigh *ws_neigh, uint8_t phy_mode_id)
+{
+    for (int i = 0; i < ws_neigh->ms_rate_count; i++)
+        if (ws_neigh->ms_rates[i].phy_mode_id == phy_mode_id)
+            return &ws_neigh->ms_rates[i];
+    return NULL;
+}
+
+// Build the list of PhyModeIds supported by both ends, keeping the statistics
+// of PhyModeIds which were already present.
+static void ws_llc_ms_auto_rates_update(const struct ws_phy_config *phy_config, struct ws_neigh *ws_neigh)
+{
+    struct ws_neigh_ms_rate rates[ARRAY_SIZE(ws_neigh->ms_rates)];
+    const struct phy_params *phy_params;
+    struct ws_neigh_ms_rate *rate;
+    uint8_t phy_mode_id;
+    int count = 0;
+
+    for (int i = -1; i < ws_neigh->pom_ie.phy_op_mode_number; i++) {
+        phy_mode_id = i < 0 ? phy_config->phy_mode_id_ms_base : ws_neigh->pom_ie.phy_op_mode_id[i];
+        if (i >= 0 && (phy_mode_id == phy_config->phy_mode_id_ms_base ||
+                       !memchr(phy_config->phy_op_modes, phy_mode_id, ARRAY_SIZE(phy_config->phy_op_modes) - 1)))
+            continue;
+        phy_params = ws_regdb_phy_params(phy_mode_id, 0);
+        if (!phy_params)
+            continue;
+        rate = ws_llc_ms_auto_rate(ws_neigh, phy_mode_id);
+        if (rate) {
+            rates[count] = *rate;
+        } else {
+            rates[count].phy_mode_id  = phy_mode_id;
+            rates[count].datarate     = phy_params->datarate;
+            rates[count].tx_attempts  = 0;
+            rates[count].tx_success   = 0;
+            rates[count].success_prob = NAN;
+        }
+        count++;
+    }
+    memcpy(ws_neigh->ms_rates, rates, count * sizeof(rates[0]));
+    ws_neigh->ms_rate_count = count;
+    ws_neigh->ms_rates_pom = ws_neigh->pom_ie;
+}
+
+static float ws_llc_ms_auto_throughput(const struct ws_neigh_ms_rate *rate)
+{
+    // Like Minstrel, ignore rates which mostly fail
+    if (isnan(rate->success_prob) || rate->success_prob < 0.1)
+        return 0;
+    return rate->success_prob * rate->datarate;
+}
+
+static void ws_llc_ms_auto_push_rate(const struct ws_info *ws_info, const struct ws_neigh *ws_neigh,
+                                     struct rcp_rate_info rate_list[4], int *rate_count,
+                                     uint8_t phy_mode_id, uint8_t tx_attempts)
+{
+    rate_list[*rate_count].phy_mode_id  = phy_mode_id;
+    rate_list[*rate_count].tx_attempts  = tx_attempts;
+    rate_list[*rate_count].tx_power_dbm = ws_llc_rate_txpow(ws_info, ws_neigh, phy_mode_id);
+    (*rate_count)++;
+}
+
+/*
+ * Automatic mode switch is a simplified version of the Minstrel rate control
+ * algorithm used for Wi-Fi in Linux. The success probability of each
+ * PhyModeId is measured using the retry chains sent to the RCP, and averaged
+ * with an EWMA. Frames are sent starting with the PhyModeId having the best
+ * expected throughput, then the most reliable PhyModeId, and finally the base
+ * PhyModeId. Periodically, a faster PhyModeId is tried first so that the
+ * statistics of unused PhyModeIds get updated.
+ */
+static void ws_llc_ms_auto_fill_rates(const struct ws_info *ws_info, struct ws_neigh *ws_neigh,
+                                      struct rcp_rate_info rate_list[4])
+{
+    const struct ws_neigh_ms_rate *reliable = NULL;
+    const struct ws_neigh_ms_rate *probe = NULL;
+    const struct ws_neigh_ms_rate *base, *best, *rate;
+    int tx_attempts = WS_LLC_TX_ATTEMPTS;
+    int rate_count = 0;
+    int offset;
+
+    if (!ws_neigh->ms_rate_count || memcmp(&ws_neigh->ms_rates_pom, &ws_neigh->pom_ie, sizeof(ws_neigh->pom_ie)))
+        ws_llc_ms_auto_rates_update(&ws_info->phy_config, ws_neigh);
+    base = &ws_neigh->ms_rates[0];
+    BUG_ON(!ws_neigh->ms_rate_count || base->phy_mode_id != ws_info->phy_config.phy_mode_id_ms_base);
+
+    best = base;
+    for (int i = 1; i < ws_neigh->ms_rate_count; i++)
+        if (ws_llc_ms_auto_throughput(&ws_neigh->ms_rates[i]) > ws_llc_ms_auto_throughput(best))
+            best = &ws_neigh->ms_rates[i];
+    for (int i = 1; i < ws_neigh->ms_rate_count; i++) {
+        rate = &ws_neigh->ms_rates[i];
+        if (rate == best || isnan(rate->success_prob))
+            continue;
+        if (!reliable || rate->success_prob > reliable->success_prob)
+            reliable = rate;
+    }
+
+    if (!ws_neigh->ms_probe_countdown) {
+        ws_neigh->ms_probe_countdown = WS_LLC_MS_AUTO_PROBE_INTERVAL;
+        offset = rand_get_random_in_range(0, ws_neigh->ms_rate_count - 1);
+        for (int i = 0; i < ws_neigh->ms_rate_count; i++) {
+            rate = &ws_neigh->ms_rates[(offset + i) % ws_neigh->ms_rate_count];
+            if (rate->datarate > best->datarate) {
+                probe = rate;
+                break;
+            }
+        }
+    }
+    ws_neigh->ms_probe_countdown--;
+
+    memset(rate_list, 0, 4 * sizeof(struct rcp_rate_info));
+    if (probe) {
+        ws_llc_ms_auto_push_rate(ws_info, ws_neigh, rate_list, &rate_count, probe->phy_mode_id, 1);
+        tx_attempts -= 1;
+    }
+    if (best != base) {
+        ws_llc_ms_auto_push_rate(ws_info, ws_neigh, rate_list, &rate_count,
+                                 best->phy_mode_id, WS_LLC_MS_AUTO_TX_ATTEMPTS);
+        tx_attempts -= WS_LLC_MS_AUTO_TX_ATTEMPTS;
+    }
+    if (reliable && reliable->datarate > base->datarate) {
+        ws_llc_ms_auto_push_rate(ws_info, ws_neigh, rate_list, &rate_count,
+                                 reliable->phy_mode_id, WS_LLC_MS_AUTO_TX_ATTEMPTS);
+        tx_attempts -= WS_LLC_MS_AUTO_TX_ATTEMPTS;
+    }
+    ws_llc_ms_auto_push_rate(ws_info, ws_neigh, rate_list, &rate_count, base->phy_mode_id, tx_attempts);
+}
+
+static void ws_llc_ms_auto_tx_conf(const struct ws_info *ws_info, const struct llc_message *msg,
+                                   const struct mcps_data_cnf *confirm, struct ws_neigh *ws_neigh)
+{
+    uint8_t tx_attempts = confirm->hif.tx_retries + 1;
+    struct ws_neigh_ms_rate *rate;
+    uint64_t now_ms;
+    float success;
+    int n;
+
+    if (ws_llc_ms_mode(ws_info, ws_neigh) != WS_MODE_SWITCH_AUTO)
+        return;
+    if (confirm->hif.status != HIF_STATUS_SUCCESS && confirm->hif.status != HIF_STATUS_NOACK)
+        return;
+
+    // The RCP only reports the total number of retries, which is enough to
+    // know the outcome of each attempt given the retry chain.
+    for (int i = 0; i < 4 && msg->rate_list[i].tx_attempts && tx_attempts; i++) {
+        n = MIN(tx_attempts, msg->rate_list[i].tx_attempts);
+        tx_attempts -= n;
+        rate = ws_llc_ms_auto_rate(ws_neigh, msg->rate_list[i].phy_mode_id);
+        if (!rate)
+            continue;
+        rate->tx_attempts += n;
+        if (!tx_attempts && confirm->hif.status == HIF_STATUS_SUCCESS)
+            rate->tx_success++;
+    }
+
+    now_ms = time_cached_ms();
+    if (now_ms - ws_neigh->ms_stats_update_ms < WS_LLC_MS_AUTO_UPDATE_MS)
+        return;
+    ws_neigh->ms_stats_update_ms = now_ms;
+    for (int i = 0; i < ws_neigh->ms_rate_count; i++) {
+        rate = &ws_neigh->ms_rates[i];
+        if (!rate->tx_attempts)
+            continue;
+        success = (float)rate->tx_success / rate->tx_attempts;
+        if (isnan(rate->success_prob))
+            rate->success_prob = success;
+        else
+            rate->success_prob += WS_LLC_MS_AUTO_EWMA_WEIGHT * (success - rate->success_prob);
+        rate->tx_attempts = 0;
+        rate->tx_success  = 0;
+    }
+}
+
+// The airtime is computed from the datarate of the PhyModeId of each attempt,
+// or of the base PHY for the frames sent without rate list. Preamble,
+// turnaround and ACK are ignored: they only matter for small frames.
+static float ws_llc_tx_us_per_byte(const struct ws_info *ws_info, const struct llc_message *msg,
+                                   const struct mcps_data_cnf *confirm)
+{
+    uint8_t tx_attempts = confirm->hif.tx_retries + 1;
+    const struct phy_params *phy_params;
+    float us_per_byte = 0;
+    int n;
+
+    if (!msg->rate_list[0].tx_attempts)
+        return tx_attempts * 8.0f * 1000000 / ws_info->phy_config.params->datarate;
+    for (int i = 0; i < 4 && msg->rate_list[i].tx_attempts && tx_attempts; i++) {
+        n = MIN(tx_attempts, msg->rate_list[i].tx_attempts);
+        tx_attempts -= n;
+        phy_params = ws_regdb_phy_params(msg->rate_list[i].phy_mode_id, 0);
+        if (!phy_params || !phy_params->datarate)
+            return 0;
+        us_per_byte += n * 8.0f * 1000000 / phy_params->datarate;
+    }
+    return us_per_byte;
+}
+
+static size_t ws_llc_tx_len(const struct llc_message *msg)
+{
+    size_t len = msg->ie_iov_header.iov_len;
+
+    for (int i = 0; i < ARRAY_SIZE(msg->ie_iov_payload); i++)
+        len += msg->ie_iov_payload[i].iov_len;
+    return len;
+}
+
+static void ws_llc_airtime_tx_conf(const struct ws_info *ws_info, const struct llc_message *msg,
+                                   const struct mcps_data_cnf *confirm, struct ws_neigh *ws_neigh)
+{
+    float us_per_byte;
+
+    if (confirm->hif.status != HIF_STATUS_SUCCESS && confirm->hif.status != HIF_STATUS_NOACK)
+        return;
+    us_per_byte = ws_llc_tx_us_per_byte(ws_info, msg, confirm);
+    if (!us_per_byte)
+        return;
+    ws_neigh->airtime_us += us_per_byte * ws_llc_tx_len(msg);
+    ws_neigh->airtime_us_per_byte = ws_neigh_ewma_next(ws_neigh->airtime_us_per_byte, us_per_byte);
+}
+
+static void ws_llc_stats_tx_conf(const struct ws_info *ws_info, const struct llc_message *msg,
+                                 const struct mcps_data_cnf *confirm, struct ws_neigh *ws_neigh)
+{
+    const struct rcp_rate_info *rate = NULL;
+    uint8_t phy_mode_id = 0;
+
+    if (confirm->hif.status == HIF_STATUS_SUCCESS) {
+        if (msg->rate_list[0].tx_attempts)
+            rate = ws_llc_success_rate(msg->rate_list, confirm->hif.tx_retries + 1);
+        phy_mode_id = rate ? rate->phy_mode_id : ws_info->phy_config.phy_mode_id_ms_base;
+    }
+    ws_neigh_stats_tx(ws_neigh, confirm->hif.status, confirm->hif.tx_retries, phy_mode_id,
+                      (time_now_us(CLOCK_MONOTONIC) - msg->tx_time_us) / 1000);
+}
+
+// Async frames are repeated on every channel of the unicast channel mask.
+static void ws_llc_duty_cycle_tx_conf(struct ws_info *ws_info, const struct llc_message *msg,
+                                      const struct mcps_data_cnf *confirm)
+{
+    int chan_count = 1;
+
+    if (!duty_cycle_enabled(&ws_info->duty_cycle))
+        return;
+    if (confirm->hif.status != HIF_STATUS_SUCCESS && confirm->hif.status != HIF_STATUS_NOACK)
+        return;
+    if (msg->async) {
+        chan_count = 0;
+        for (int i = 0; i < ws_info->fhss_config.chan_params->chan_count; i++)
+            if (bittest(ws_info->fhss_config.uc_chan_mask, i))
+                chan_count++;
+    }
+    duty_cycle_add(&ws_info->duty_cycle,
+                   chan_count * ws_llc_tx_us_per_byte(ws_info, msg, confirm) * ws_llc_tx_len(msg));
+}
+
 static void ws_llc_fill_rates(const struct ws_info *ws_info,
-                              const struct ws_neigh *ws_neigh,
+                              struct ws_neigh *ws_neigh,
                               struct rcp_rate_info rate_list[4])
 {
-    const struct phy_params *phy_params;
     uint8_t phy_mode_id;
-    int8_t tx_power_dbm;
+
+    if (ws_llc_ms_mode(ws_info, ws_neigh) == WS_MODE_SWITCH_AUTO) {
+        ws_llc_ms_auto_fill_rates(ws_info, ws_neigh, rate_list);
+        return;
+    }
 
     memset(rate_list, 0, 4 * sizeof(struct rcp_rate_info));
 
@@ -1277,17 +1661,19 @@ static void ws_llc_fill_rates(const struct ws_info *ws_info,
     if (!phy_mode_id)
         phy_mode_id = ws_info->phy_config.phy_mode_id_ms_base;
 
-    phy_params = ws_regdb_phy_params(phy_mode_id, 0);
-    if (!ws_neigh || ws_info->fhss_config.regional_regulation != HIF_REG_WPC)
-        tx_power_dbm = ws_info->tx_power_dbm;
-    else if (phy_params && phy_params->modulation == MODULATION_OFDM)
-        tx_power_dbm = ws_neigh->apc_txpow_dbm_ofdm;
-    else
-        tx_power_dbm = ws_neigh->apc_txpow_dbm;
-
     rate_list[0].phy_mode_id = phy_mode_id;
-    rate_list[0].tx_attempts = 20;
-    rate_list[0].tx_power_dbm = tx_power_dbm;
+    rate_list[0].tx_attempts = WS_LLC_TX_ATTEMPTS;
+    rate_list[0].tx_power_dbm = ws_llc_rate_txpow(ws_info, ws_neigh, phy_mode_id);
+}
+
+static bool ws_llc_use_edfe(const struct ws_info *ws_info, const struct ws_neigh *ws_neigh,
+                            const struct mcps_data_req *data)
+{
+    uint8_t edfe_mode = ws_neigh->edfe_mode == WS_EDFE_DEFAULT ? ws_info->edfe_mode : ws_neigh->edfe_mode;
+
+    // Fragments are sent back-to-back to the same destination, an EDFE
+    // exchange saves the channel access and ACK of each of them.
+    return edfe_mode == WS_EDFE_ENABLED || (edfe_mode == WS_EDFE_FRAGMENT && data->fragment);
 }
 
 static void ws_llc_lowpan_mpx_data_request(llc_data_base_t *base, mpx_user_t *user_cb, const struct mcps_data_req *data)
@@ -1339,12 +1725,8 @@ static void ws_llc_lowpan_mpx_data_request(llc_data_base_t *base, mpx_user_t *us
     if (data->DstAddrMode == IEEE802154_ADDR_MODE_64_BIT) {
         message->dst_address_type = data->DstAddrMode;
         memcpy(message->dst_address, data->DstAddr, 8);
-        if (ws_neigh) {
-            if (ws_neigh->edfe_mode == WS_EDFE_DEFAULT)
-                wh_ies.fc = ws_info->edfe_mode == WS_EDFE_ENABLED;
-            else
-                wh_ies.fc = ws_neigh->edfe_mode == WS_EDFE_ENABLED;
-        }
+        if (ws_neigh)
+            wh_ies.fc = ws_llc_use_edfe(ws_info, ws_neigh, data);
     } else {
         memset(message->dst_address, 0xff, sizeof(message->dst_address));
     }
@@ -1362,6 +1744,7 @@ static void ws_llc_lowpan_mpx_data_request(llc_data_base_t *base, mpx_user_t *us
     if (wh_ies.fc) {
         data_req.TxAckReq = false;
         message->ack_requested = false;
+        message->edfe = true;
     }
 
     if (ws_neigh) {
@@ -1372,7 +1755,7 @@ static void ws_llc_lowpan_mpx_data_request(llc_data_base_t *base, mpx_user_t *us
             memcpy(data_req.rate_list, message->rate_list, sizeof(data_req.rate_list));
         else
             memset(data_req.rate_list, 0, sizeof(data_req.rate_list));
-        data_req.ms_mode = ws_neigh->ms_mode == WS_MODE_SWITCH_DEFAULT ? ws_info->phy_config.ms_mode : ws_neigh->ms_mode;
+        data_req.ms_mode = ws_llc_ms_mode(ws_info, ws_neigh);
     }
     data_req.frame_type = WS_FT_DATA;
 
@@ -1407,27 +1790,36 @@ static void ws_llc_lowpan_mpx_data_request(llc_data_base_t *base, mpx_user_t *us
                                                                                    ws_neigh->fhss_data.lfn.uc_listen_interval_ms,
                                                                                    ws_neigh->lto_info.uc_interval_min_ms,
                                                                                    ws_neigh->lto_info.uc_interval_max_ms);
-        adjusted_offset_ms = ws_neigh_calc_lfn_offset(adjusted_listening_interval,
-                                                   base->interface_ptr->ws_info.fhss_config.lfn_bc_interval);
+        // The offsets of the other LFNs are scanned, only compute it when an
+        // LTO-IE is needed.
         if ((adjusted_listening_interval != ws_neigh->fhss_data.lfn.uc_listen_interval_ms ||
-            !ws_neigh->lto_info.offset_adjusted) && adjusted_listening_interval != 0 && adjusted_offset_ms != 0) {
+            !ws_neigh->lto_info.offset_adjusted) && adjusted_listening_interval != 0)
+            adjusted_offset_ms = ws_neigh_calc_lfn_offset(&base->interface_ptr->ws_info.neighbor_storage, ws_neigh,
+                                                          adjusted_listening_interval,
+                                                          base->interface_ptr->ws_info.fhss_config.lfn_bc_interval);
+        if (adjusted_offset_ms) {
             // FIXME: insert LTO-IE in ws_llc_prepare_ie()
             ws_wh_lto_write(&message->ie_buf_header, adjusted_offset_ms, adjusted_listening_interval);
             ws_neigh->lto_info.offset_adjusted = true;
+            ws_neigh->lto_info.offset_ms = adjusted_offset_ms;
             message->ie_iov_header.iov_base = message->ie_buf_header.data;
             message->ie_iov_header.iov_len = message->ie_buf_header.len;
         }
     }
 
-    message->ie_iov_payload[1].iov_base = data->msdu;
-    message->ie_iov_payload[1].iov_len = data->msduLength;
+    // The frame is written before returning, the payload is not copied
+    message->ie_iov_payload[1].iov_base = (void *)data->msdu_prefix;
+    message->ie_iov_payload[1].iov_len = data->msdu_prefix_len;
+    message->ie_iov_payload[2].iov_base = data->msdu;
+    message->ie_iov_payload[2].iov_len = data->msduLength;
     ws_llc_lowpan_mpx_header_write(message, MPX_ID_6LOWPAN);
     message->ie_iov_payload[0].iov_len = message->ie_buf_payload.len;
     message->ie_iov_payload[0].iov_base = message->ie_buf_payload.data;
     message->ie_ext.payloadIeVectorList = message->ie_iov_payload;
-    message->ie_ext.payloadIovLength = 2;
+    message->ie_ext.payloadIovLength = 3;
 
-    message->tx_time = time_now_s(CLOCK_MONOTONIC);
+    message->tx_time = time_cached_s();
+    message->tx_time_us = time_now_us(CLOCK_MONOTONIC);
 
     ws_trace_llc_mac_req(&data_req, message);
     wsbr_data_req_ext(base->interface_ptr, &data_req, &message->ie_ext);
@@ -1473,7 +1865,8 @@ static void ws_llc_mpx_eapol_send(llc_data_base_t *base, llc_message_t *message)
     else
         data_req.fhss_type = HIF_FHSS_TYPE_FFN_UC;
 
-    message->tx_time = time_now_s(CLOCK_MONOTONIC);
+    message->tx_time = time_cached_s();
+    message->tx_time_us = time_now_us(CLOCK_MONOTONIC);
 
     ws_trace_llc_mac_req(&data_req, message);
     wsbr_data_req_ext(base->interface_ptr, &data_req, &message->ie_ext);
@@ -1611,7 +2004,7 @@ static void ws_llc_clean(llc_data_base_t *base)
 
     ns_list_foreach_safe(llc_message_t, message, &base->temp_entries.llc_eap_pending_list) {
         ns_list_remove(&base->temp_entries.llc_eap_pending_list, message);
-        free(message);
+        llc_message_release(message, base);
     }
     base->temp_entries.llc_eap_pending_list_size = 0;
     base->temp_entries.active_eapol_session = false;
@@ -1663,6 +2056,9 @@ int8_t ws_llc_create(struct net_if *interface,
 
     ns_list_init(&base->temp_entries.llc_eap_pending_list);
     ns_list_init(&base->llc_message_list);
+    ns_list_init(&base->message_pool_free);
+    for (int i = 0; i < ARRAY_SIZE(base->message_pool); i++)
+        ns_list_add_to_end(&base->message_pool_free, &base->message_pool[i]);
     base->interface_ptr = interface;
     base->mngt_ind = mngt_ind;
     base->mngt_cnf = mngt_cnf;
@@ -1676,6 +2072,27 @@ void ws_llc_reset(struct net_if *interface)
     struct llc_data_base *base = &g_llc_base;
 
     ws_llc_clean(base);
+    ws_llc_mngt_ie_cache_invalidate(&interface->ws_info);
+}
+
+int ws_llc_queue_size(struct net_if *interface)
+{
+    struct llc_data_base *base = &g_llc_base;
+
+    return base->llc_message_list_size + base->temp_entries.llc_eap_pending_list_size;
+}
+
+size_t ws_llc_message_size(void)
+{
+    return sizeof(llc_message_t);
+}
+
+void ws_llc_mngt_ie_cache_invalidate(struct ws_info *ws_info)
+{
+    struct llc_data_base *base = &g_llc_base;
+
+    for (int i = 0; i < ARRAY_SIZE(base->wp_ie_cache); i++)
+        base->wp_ie_cache[i].valid = false;
 }
 
 mpx_api_t *ws_llc_mpx_api_get(struct net_if *interface)
@@ -1728,10 +2145,12 @@ int8_t ws_llc_asynch_request(struct ws_info *ws_info, struct ws_llc_mngt_req *re
     if (request->frame_type == WS_FT_PAS)
         data_req.PanIdSuppressed = true;
     data_req.fhss_type = HIF_FHSS_TYPE_ASYNC;
+    message->async = true;
 
     ws_llc_prepare_ie(base, message, &request->wh_ies, &request->wp_ies);
 
-    message->tx_time = time_now_s(CLOCK_MONOTONIC);
+    message->tx_time = time_cached_s();
+    message->tx_time_us = time_now_us(CLOCK_MONOTONIC);
 
     ws_trace_llc_mac_req(&data_req, message);
     wsbr_data_req_ext(base->interface_ptr, &data_req, &message->ie_ext);
@@ -1792,7 +2211,8 @@ int ws_llc_mngt_lfn_request(const struct ws_llc_mngt_req *req, const uint8_t dst
 
     ws_llc_prepare_ie(base, msg, &req->wh_ies, &req->wp_ies);
 
-    msg->tx_time = time_now_s(CLOCK_MONOTONIC);
+    msg->tx_time = time_cached_s();
+    msg->tx_time_us = time_now_us(CLOCK_MONOTONIC);
 
     ws_trace_llc_mac_req(&data_req, msg);
     wsbr_data_req_ext(base->interface_ptr, &data_req, &msg->ie_ext);
@@ -1814,6 +2234,11 @@ int8_t ws_llc_set_mode_switch(struct net_if *interface, uint8_t mode, uint8_t ph
     if (phy_mode_id > 0 && mode == WS_MODE_SWITCH_MAC && version_older_than(interface->rcp->version_api, 2, 1, 0))
         return -ENOTSUP;
 
+    if (mode == WS_MODE_SWITCH_AUTO && phy_mode_id)
+        return -EINVAL;
+    if (mode == WS_MODE_SWITCH_AUTO && version_older_than(interface->rcp->version_api, 2, 0, 1))
+        return -ENOTSUP;
+
     if (mode == WS_MODE_SWITCH_PHY || mode == WS_MODE_SWITCH_MAC) {
         for (i = 0; interface->ws_info.phy_config.phy_op_modes[i]; i++)
             if (phy_mode_id == interface->ws_info.phy_config.phy_op_modes[i])
@@ -1842,6 +2267,7 @@ int8_t ws_llc_set_mode_switch(struct net_if *interface, uint8_t mode, uint8_t ph
         ws_neigh->ms_mode = mode;
         ws_neigh->ms_tx_count = 0;
         ws_neigh->ms_retries_count = 0;
+        ws_neigh->ms_rate_count = 0;
     }
 
     return 0;
@@ -18,6 +18,7 @@
 
 #ifndef WS_LLC_H_
 #define WS_LLC_H_
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "common/ws/ws_interface.h"
@@ -57,6 +58,15 @@ int8_t ws_llc_create(struct net_if *interface,
  */
 void ws_llc_reset(struct net_if *interface);
 
+// Frames waiting for their TX confirmation, and EAPOL frames held until the
+// current EAPOL exchange completes.
+int ws_llc_queue_size(struct net_if *interface);
+size_t ws_llc_message_size(void);
+
+// The WP-IE of PA, PC and LPA frames is serialized once and reused. It must be
+// invalidated when any of its content changes, see ws_llc_wp_ie_cache_match().
+void ws_llc_mngt_ie_cache_invalidate(struct ws_info *ws_info);
+
 /**
  * @brief ws_llc_mpx_api_get Get MPX api for registration purpose.
  * @param interface Interface pointer
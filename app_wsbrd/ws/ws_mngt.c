@@ -14,7 +14,9 @@
 #include <time.h>
 #include "common/ws/ws_ie.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/rand.h"
+#include "common/time_extra.h"
 #include "common/trickle_legacy.h"
 #include "common/specs/ieee802154.h"
 #include "common/specs/ws.h"
@@ -268,17 +270,79 @@ void ws_mngt_lpa_send(struct ws_info *ws_info, const uint8_t dst[8])
     ws_llc_mngt_lfn_request(&req, dst);
 }
 
+// Minimum delay between 2 LPAs. When many LFNs solicit at once (eg. after a
+// power outage), LPAs are spread over the discovery slots of each LFN instead
+// of being sent back-to-back or dropped.
+#define WS_MNGT_LPA_SPACING_MS 100
+
+static struct ws_mngt_lpa *ws_mngt_lpa_queue_get(struct ws_mngt *mngt, int i)
+{
+    return &mngt->lpa_queue[(mngt->lpa_queue_start + i) % WS_MNGT_LPA_QUEUE_LEN];
+}
+
+static const struct ws_mngt_lpa *ws_mngt_lpa_queue_find(struct ws_mngt *mngt, const uint8_t eui64[8])
+{
+    for (int i = 0; i < mngt->lpa_queue_len; i++)
+        if (!memcmp(ws_mngt_lpa_queue_get(mngt, i)->dst, eui64, 8))
+            return ws_mngt_lpa_queue_get(mngt, i);
+    return NULL;
+}
+
+static void ws_mngt_lpa_timer_arm(struct ws_mngt *mngt)
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    uint64_t tx_ms;
+
+    if (!mngt->lpa_queue_len || g_timers[WS_TIMER_LPA].timeout)
+        return;
+    tx_ms = ws_mngt_lpa_queue_get(mngt, 0)->tx_ms;
+    ws_timer_start_ticks(WS_TIMER_LPA, tx_ms > now_ms ?
+                         MAX(1, (tx_ms - now_ms) / WS_TIMER_GLOBAL_PERIOD_MS) : 1);
+}
+
 static void ws_mngt_lpa_schedule(struct ws_mngt *mngt, struct ws_lnd_ie *ie_lnd, const uint8_t eui64[8])
 {
     const uint16_t slot = rand_get_random_in_range(0, ie_lnd->discovery_slots);
-    const int timeout = slot * ie_lnd->discovery_slot_time + ie_lnd->response_delay;
+    uint64_t start_ms = time_now_ms(CLOCK_MONOTONIC) + ie_lnd->response_delay;
+    uint64_t tx_ms = start_ms + slot * ie_lnd->discovery_slot_time;
+    uint64_t min_ms = mngt->lpa_last_ms + WS_MNGT_LPA_SPACING_MS;
+    struct ws_mngt_lpa *lpa;
 
     // FIXME: The LPA slot should be chosen by the RCP. UART transmission
     // delays likely implies that the slot is missed and one of the later
     // slots is used instead (if any).
-    memcpy(mngt->lpa_dst, eui64, 8);
-    // Start timer
-    g_timers[WS_TIMER_LPA].timeout = timeout / WS_TIMER_GLOBAL_PERIOD_MS;
+    if (mngt->lpa_queue_len)
+        min_ms = ws_mngt_lpa_queue_get(mngt, mngt->lpa_queue_len - 1)->tx_ms + WS_MNGT_LPA_SPACING_MS;
+    if (tx_ms < min_ms) {
+        if (!ie_lnd->discovery_slot_time ||
+            (min_ms - start_ms) / ie_lnd->discovery_slot_time + 1 >= ie_lnd->discovery_slots) {
+            TRACE(TR_DROP, "drop %-9s: no LPA slot available for %s",
+                  tr_ws_frame(WS_FT_LPAS), tr_eui64(eui64));
+            return;
+        }
+        // Use the first slot after min_ms
+        tx_ms = start_ms + ((min_ms - start_ms) / ie_lnd->discovery_slot_time + 1) * ie_lnd->discovery_slot_time;
+    }
+    lpa = ws_mngt_lpa_queue_get(mngt, mngt->lpa_queue_len++);
+    memcpy(lpa->dst, eui64, 8);
+    lpa->tx_ms = tx_ms;
+    ws_mngt_lpa_timer_arm(mngt);
+}
+
+void ws_mngt_lpa_timer_cb(struct ws_info *ws_info)
+{
+    struct ws_mngt *mngt = &ws_info->mngt;
+    struct ws_mngt_lpa *lpa;
+
+    if (!mngt->lpa_queue_len)
+        return;
+    lpa = ws_mngt_lpa_queue_get(mngt, 0);
+    mngt->lpa_queue_start = (mngt->lpa_queue_start + 1) % WS_MNGT_LPA_QUEUE_LEN;
+    mngt->lpa_queue_len--;
+    mngt->lpa_last_ms = time_now_ms(CLOCK_MONOTONIC);
+    // The WP-IE content is cached by ws_llc, see ws_llc_mngt_ie_cache_invalidate()
+    ws_mngt_lpa_send(ws_info, lpa->dst);
+    ws_mngt_lpa_timer_arm(mngt);
 }
 
 void ws_mngt_lpas_analyze(struct ws_info *ws_info,
@@ -295,9 +359,13 @@ void ws_mngt_lpas_analyze(struct ws_info *ws_info,
     struct ws_nr_ie ie_nr;
     bool add_neighbor;
 
-    if (g_timers[WS_TIMER_LPA].timeout) {
+    if (ws_mngt_lpa_queue_find(&ws_info->mngt, data->SrcAddr)) {
         TRACE(TR_DROP, "drop %-9s: LPA already queued for %s",
-              tr_ws_frame(WS_FT_LPAS), tr_eui64(ws_info->mngt.lpa_dst));
+              tr_ws_frame(WS_FT_LPAS), tr_eui64(data->SrcAddr));
+        return;
+    }
+    if (ws_info->mngt.lpa_queue_len == WS_MNGT_LPA_QUEUE_LEN) {
+        TRACE(TR_DROP, "drop %-9s: LPA queue full", tr_ws_frame(WS_FT_LPAS));
         return;
     }
 
@@ -539,12 +607,24 @@ void ws_mngt_async_trickle_reset_pc(struct ws_info *ws_info)
     trickle_legacy_inconsistent(&ws_info->mngt.trickle_pc, &ws_info->mngt.trickle_params);
 }
 
+// Async frames are sent on every channel, so they are the first to be skipped
+// when the duty cycle budget is running low.
 void ws_mngt_async_trickle_timer_cb(struct ws_info *ws_info, uint16_t ticks)
 {
-    if (trickle_legacy_tick(&ws_info->mngt.trickle_pa, &ws_info->mngt.trickle_params, ticks))
-        ws_mngt_pa_send(ws_info);
-    if (trickle_legacy_tick(&ws_info->mngt.trickle_pc, &ws_info->mngt.trickle_params, ticks))
-        ws_mngt_pc_send(ws_info);
+    bool shaping = duty_cycle_above(&ws_info->duty_cycle, WS_DUTY_CYCLE_SHAPING_PERMILLE);
+
+    if (trickle_legacy_tick(&ws_info->mngt.trickle_pa, &ws_info->mngt.trickle_params, ticks)) {
+        if (shaping)
+            TRACE(TR_TX_ABORT, "tx-abort %-9s: duty cycle budget almost exhausted", tr_ws_frame(WS_FT_PA));
+        else
+            ws_mngt_pa_send(ws_info);
+    }
+    if (trickle_legacy_tick(&ws_info->mngt.trickle_pc, &ws_info->mngt.trickle_params, ticks)) {
+        if (shaping)
+            TRACE(TR_TX_ABORT, "tx-abort %-9s: duty cycle budget almost exhausted", tr_ws_frame(WS_FT_PC));
+        else
+            ws_mngt_pc_send(ws_info);
+    }
 }
 
 void ws_mngt_lts_send(struct ws_info *ws_info)
@@ -562,16 +642,41 @@ void ws_mngt_lts_send(struct ws_info *ws_info)
     ws_llc_mngt_lfn_request(&req, NULL);
 }
 
+/*
+ * Like the frame counters, the storage does not hold the current versions
+ * but the end of a block of reserved versions. The versions are increased in
+ * memory, and a new block is reserved (written) only when the current one is
+ * used up. After a restart, the versions resume above the block, so they
+ * never go backwards.
+ */
+void ws_mngt_version_reserve(struct ws_info *ws_info)
+{
+    struct ws_pan_information *pan_info = &ws_info->pan_information;
+
+    pan_info->pan_version_max = pan_info->pan_version + WS_MNGT_VERSION_RESERVATION;
+    pan_info->lfn_version_max = pan_info->lfn_version + WS_MNGT_VERSION_RESERVATION;
+    ws_pan_info_storage_write(ws_info->fhss_config.bsi, pan_info->pan_id,
+                              pan_info->pan_version_max, pan_info->lfn_version_max,
+                              ws_info->network_name);
+}
+
+// Serial number arithmetic, versions wrap around
+static bool ws_mngt_version_reserved(uint16_t version, uint16_t version_max)
+{
+    return (uint16_t)(version_max - version) <= WS_MNGT_VERSION_RESERVATION;
+}
+
 void ws_mngt_pan_version_increase(struct ws_info *ws_info)
 {
     INFO("PAN version number update");
     // Version number is not periodically increased forcing nodes to check Border router availability using DAO
     ws_info->pan_information.pan_version++;
+    ws_llc_mngt_ie_cache_invalidate(ws_info);
     // Inconsistent for border router to make information distribute faster
     ws_mngt_async_trickle_reset_pc(ws_info);
-    ws_pan_info_storage_write(ws_info->fhss_config.bsi, ws_info->pan_information.pan_id,
-                              ws_info->pan_information.pan_version, ws_info->pan_information.lfn_version,
-                              ws_info->network_name);
+    if (!ws_mngt_version_reserved(ws_info->pan_information.pan_version, ws_info->pan_information.pan_version_max) ||
+        !ws_mngt_version_reserved(ws_info->pan_information.lfn_version, ws_info->pan_information.lfn_version_max))
+        ws_mngt_version_reserve(ws_info);
 }
 
 void ws_mngt_lfn_version_increase(struct ws_info *ws_info)
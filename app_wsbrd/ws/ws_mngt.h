@@ -22,11 +22,22 @@ struct mcps_data_rx_ie_list;
 struct mcps_data_ind;
 struct ws_info;
 
+// LPAs scheduled in response to LPAS, in transmission order
+#define WS_MNGT_LPA_QUEUE_LEN 16
+
+struct ws_mngt_lpa {
+    uint8_t dst[8];
+    uint64_t tx_ms;
+};
+
 struct ws_mngt {
     trickle_legacy_params_t trickle_params;
     trickle_legacy_t trickle_pa;
     trickle_legacy_t trickle_pc;
-    uint8_t lpa_dst[8];
+    struct ws_mngt_lpa lpa_queue[WS_MNGT_LPA_QUEUE_LEN];
+    int lpa_queue_start;
+    int lpa_queue_len;
+    uint64_t lpa_last_ms;
     bool pan_advert_running;
     bool pan_config_running;
 };
@@ -56,11 +67,17 @@ void ws_mngt_async_trickle_reset_pc(struct ws_info *ws_info);
 void ws_mngt_async_trickle_timer_cb(struct ws_info *ws_info, uint16_t ticks);
 
 void ws_mngt_lpa_send(struct ws_info *ws_info, const uint8_t dst[8]);
+// Send the next queued LPA, called when WS_TIMER_LPA expires
+void ws_mngt_lpa_timer_cb(struct ws_info *ws_info);
 void ws_mngt_lts_send(struct ws_info *ws_info);
 
 // Broadcast an LPC frame on LGTK hash, or active LGTK index change
 void ws_mngt_lpc_pae_cb(struct ws_info *ws_info);
 
+// Number of PAN and LFN version increments written at once to the storage
+#define WS_MNGT_VERSION_RESERVATION 100
+
+void ws_mngt_version_reserve(struct ws_info *ws_info);
 void ws_mngt_pan_version_increase(struct ws_info *ws_info);
 void ws_mngt_lfn_version_increase(struct ws_info *ws_info);
 
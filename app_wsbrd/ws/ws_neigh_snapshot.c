@@ -0,0 +1,288 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/ws/ws_neigh.h"
+#include "common/specs/ws.h"
+#include "common/key_value_storage.h"
+#include "common/memutils.h"
+#include "common/parsers.h"
+#include "common/rcp_api.h"
+#include "common/time_extra.h"
+#include "common/log.h"
+#include "net/protocol.h"
+
+#include "ws_neigh_snapshot.h"
+
+#define WS_NEIGH_SNAPSHOT "ws-neigh-snapshot"
+
+// Above this, the host clock is considered to have been reset (reboot) or
+// stepped between the snapshot and its load.
+#define WS_NEIGH_SNAPSHOT_CLOCK_TOLERANCE_US 1000000
+
+struct ws_neigh_snapshot_entry {
+    struct ws_neigh neigh; // Timestamps in the host clock
+    uint64_t expiration_ms;
+};
+
+static struct {
+    struct ws_neigh_snapshot_entry *entries;
+    int count;
+} g_ws_neigh_snapshot;
+
+static void ws_neigh_snapshot_write_fhss(FILE *file, const char *name, int i, uint8_t role,
+                                         const struct ws_neigh_fhss *fhss, const struct rcp *rcp)
+{
+    char str[3 * WS_CHAN_MASK_LEN];
+
+    if (role == WS_NR_ROLE_LFN)
+        fprintf(file, "%s[%d] = %u,%u,%u,%u,%"PRIu64",%u,%u,%u,%u,%"PRIu64"\n", name, i,
+                fhss->uc_chan_func, fhss->lfn.uc_listen_interval_ms,
+                fhss->lfn.uc_slot_number, fhss->lfn.uc_interval_offset_ms,
+                rcp_clock_to_host_us(rcp, fhss->lfn.lutt_rx_tstamp_us),
+                fhss->lfn.lpa_response_delay_ms, fhss->lfn.lpa_slot_duration_ms,
+                fhss->lfn.lpa_slot_count, fhss->lfn.lpa_slot_first,
+                rcp_clock_to_host_us(rcp, fhss->lfn.lnd_rx_tstamp_us));
+    else
+        fprintf(file, "%s[%d] = %u,%u,%u,%"PRIu64"\n", name, i,
+                fhss->uc_chan_func, fhss->ffn.uc_dwell_interval_ms, fhss->ffn.ufsi,
+                rcp_clock_to_host_us(rcp, fhss->ffn.utt_rx_tstamp_us));
+    str_bytes(fhss->uc_channel_list, WS_CHAN_MASK_LEN, NULL, str, sizeof(str), DELIM_COLON);
+    fprintf(file, "%s_chan[%d] = %s\n", name, i, str);
+}
+
+void ws_neigh_snapshot_store(struct net_if *net_if)
+{
+    struct storage_parse_info *info = storage_open_prefix(WS_NEIGH_SNAPSHOT, "w");
+    struct ws_neigh *neigh;
+    char str[STR_MAX_LEN_EUI64];
+    int i = 0;
+
+    if (!info)
+        return;
+    fprintf(info->file, "monotonic_us = %"PRIu64"\n", time_now_us(CLOCK_MONOTONIC));
+    fprintf(info->file, "realtime_us = %"PRIu64"\n", time_now_us(CLOCK_REALTIME));
+    SLIST_FOREACH(neigh, &net_if->ws_info.neighbor_storage.neigh_list, link) {
+        fprintf(info->file, "mac64[%d] = %s\n", i, str_eui64(neigh->mac64, str));
+        fprintf(info->file, "role[%d] = %u\n", i, neigh->node_role);
+        fprintf(info->file, "trusted[%d] = %d\n", i, neigh->trusted_device);
+        fprintf(info->file, "lifetime[%d] = %u\n", i, neigh->lifetime_s);
+        fprintf(info->file, "expiration[%d] = %"PRIu64"\n", i, neigh->expire_ms);
+        fprintf(info->file, "etx[%d] = %f\n", i, neigh->etx);
+        fprintf(info->file, "rsl[%d] = %f,%f\n", i, neigh->rsl_in_dbm, neigh->rsl_out_dbm);
+        fprintf(info->file, "frame_counter[%d] = %u,%u,%u,%u,%u,%u,%u,%u\n", i,
+                neigh->frame_counter_min[0], neigh->frame_counter_min[1],
+                neigh->frame_counter_min[2], neigh->frame_counter_min[3],
+                neigh->frame_counter_min[4], neigh->frame_counter_min[5],
+                neigh->frame_counter_min[6], neigh->frame_counter_min[7]);
+        ws_neigh_snapshot_write_fhss(info->file, "fhss", i, neigh->node_role,
+                                     &neigh->fhss_data, net_if->rcp);
+        ws_neigh_snapshot_write_fhss(info->file, "fhss_unsecured", i, neigh->node_role,
+                                     &neigh->fhss_data_unsecured, net_if->rcp);
+        i++;
+    }
+    storage_close(info);
+    INFO("saved %d neighbors to " WS_NEIGH_SNAPSHOT, i);
+}
+
+static int ws_neigh_snapshot_parse_fhss(const char *str, uint8_t role, struct ws_neigh_fhss *fhss)
+{
+    unsigned int val[9];
+    uint64_t ts[2];
+
+    if (role == WS_NR_ROLE_LFN) {
+        if (sscanf(str, "%u,%u,%u,%u,%"SCNu64",%u,%u,%u,%u,%"SCNu64,
+                   &val[0], &val[1], &val[2], &val[3], &ts[0],
+                   &val[4], &val[5], &val[6], &val[7], &ts[1]) != 10)
+            return -1;
+        fhss->uc_chan_func              = val[0];
+        fhss->lfn.uc_listen_interval_ms = val[1];
+        fhss->lfn.uc_slot_number        = val[2];
+        fhss->lfn.uc_interval_offset_ms = val[3];
+        fhss->lfn.lutt_rx_tstamp_us     = ts[0];
+        fhss->lfn.lpa_response_delay_ms = val[4];
+        fhss->lfn.lpa_slot_duration_ms  = val[5];
+        fhss->lfn.lpa_slot_count        = val[6];
+        fhss->lfn.lpa_slot_first        = val[7];
+        fhss->lfn.lnd_rx_tstamp_us      = ts[1];
+    } else {
+        if (sscanf(str, "%u,%u,%u,%"SCNu64, &val[0], &val[1], &val[2], &ts[0]) != 4)
+            return -1;
+        fhss->uc_chan_func             = val[0];
+        fhss->ffn.uc_dwell_interval_ms = val[1];
+        fhss->ffn.ufsi                 = val[2];
+        fhss->ffn.utt_rx_tstamp_us     = ts[0];
+    }
+    return 0;
+}
+
+static int ws_neigh_snapshot_parse_line(struct storage_parse_info *info, struct ws_neigh_snapshot_entry *entry)
+{
+    struct ws_neigh *neigh = &entry->neigh;
+    uint32_t *fc = neigh->frame_counter_min;
+
+    if (!fnmatch("mac64\\[*]", info->key, 0))
+        return parse_byte_array(neigh->mac64, 8, info->value);
+    if (!fnmatch("role\\[*]", info->key, 0))
+        neigh->node_role = strtoul(info->value, NULL, 0);
+    else if (!fnmatch("trusted\\[*]", info->key, 0))
+        neigh->trusted_device = strtoul(info->value, NULL, 0);
+    else if (!fnmatch("lifetime\\[*]", info->key, 0))
+        neigh->lifetime_s = strtoul(info->value, NULL, 0);
+    else if (!fnmatch("expiration\\[*]", info->key, 0))
+        entry->expiration_ms = strtoull(info->value, NULL, 0);
+    else if (!fnmatch("etx\\[*]", info->key, 0))
+        neigh->etx = strtof(info->value, NULL);
+    else if (!fnmatch("rsl\\[*]", info->key, 0))
+        return sscanf(info->value, "%f,%f", &neigh->rsl_in_dbm, &neigh->rsl_out_dbm) == 2 ? 0 : -1;
+    else if (!fnmatch("frame_counter\\[*]", info->key, 0))
+        return sscanf(info->value, "%u,%u,%u,%u,%u,%u,%u,%u",
+                      &fc[0], &fc[1], &fc[2], &fc[3], &fc[4], &fc[5], &fc[6], &fc[7]) == 8 ? 0 : -1;
+    else if (!fnmatch("fhss\\[*]", info->key, 0))
+        return ws_neigh_snapshot_parse_fhss(info->value, neigh->node_role, &neigh->fhss_data);
+    else if (!fnmatch("fhss_unsecured\\[*]", info->key, 0))
+        return ws_neigh_snapshot_parse_fhss(info->value, neigh->node_role, &neigh->fhss_data_unsecured);
+    else if (!fnmatch("fhss_chan\\[*]", info->key, 0))
+        return parse_byte_array(neigh->fhss_data.uc_channel_list, WS_CHAN_MASK_LEN, info->value);
+    else if (!fnmatch("fhss_unsecured_chan\\[*]", info->key, 0))
+        return parse_byte_array(neigh->fhss_data_unsecured.uc_channel_list, WS_CHAN_MASK_LEN, info->value);
+    else
+        return -1;
+    return 0;
+}
+
+void ws_neigh_snapshot_load(struct net_if *net_if, uint64_t max_age_ms)
+{
+    struct storage_parse_info *info = storage_open_prefix(WS_NEIGH_SNAPSHOT, "r");
+    uint64_t now_us = time_now_us(CLOCK_MONOTONIC);
+    uint64_t monotonic_us = 0, realtime_us = 0;
+    struct ws_neigh_snapshot_entry *entries = NULL;
+    int64_t clock_drift_us;
+    char filename[PATH_MAX];
+    int count = 0;
+    int ret;
+
+    BUG_ON(g_ws_neigh_snapshot.entries);
+    if (!info)
+        return;
+    snprintf(filename, sizeof(filename), "%s", info->filename);
+    for (;;) {
+        ret = storage_parse_line(info);
+        if (ret == EOF)
+            break;
+        if (ret) {
+            WARN("%s:%d: invalid line: '%s'", info->filename, info->linenr, info->line);
+        } else if (!strcmp("monotonic_us", info->key)) {
+            monotonic_us = strtoull(info->value, NULL, 0);
+        } else if (!strcmp("realtime_us", info->key)) {
+            realtime_us = strtoull(info->value, NULL, 0);
+        } else if (info->key_array_index > (unsigned int)count) {
+            WARN("%s:%d: invalid key index: %d", info->filename, info->linenr, info->key_array_index);
+        } else {
+            if (info->key_array_index == (unsigned int)count) {
+                entries = reallocarray(entries, count + 1, sizeof(*entries));
+                FATAL_ON(!entries, 2, "%s: reallocarray: %m", __func__);
+                memset(&entries[count], 0, sizeof(*entries));
+                count++;
+            }
+            if (ws_neigh_snapshot_parse_line(info, &entries[info->key_array_index]))
+                WARN("%s:%d: invalid line: '%s'", info->filename, info->linenr, info->line);
+        }
+    }
+    storage_close(info);
+    // A snapshot is only valid once
+    unlink(filename);
+
+    // The realtime clock is only used to detect a reboot, the timestamps are
+    // in the monotonic clock.
+    clock_drift_us = (int64_t)(time_now_us(CLOCK_REALTIME) - realtime_us) - (int64_t)(now_us - monotonic_us);
+    if (!monotonic_us || monotonic_us > now_us ||
+        clock_drift_us > WS_NEIGH_SNAPSHOT_CLOCK_TOLERANCE_US ||
+        clock_drift_us < -WS_NEIGH_SNAPSHOT_CLOCK_TOLERANCE_US) {
+        INFO("ignore " WS_NEIGH_SNAPSHOT ": host clock reset");
+        free(entries);
+        return;
+    }
+    if ((now_us - monotonic_us) / 1000 > max_age_ms) {
+        INFO("ignore " WS_NEIGH_SNAPSHOT ": too old (%"PRIu64"s)", (now_us - monotonic_us) / 1000000);
+        free(entries);
+        return;
+    }
+    g_ws_neigh_snapshot.entries = entries;
+    g_ws_neigh_snapshot.count   = count;
+}
+
+bool ws_neigh_snapshot_pending(void)
+{
+    return g_ws_neigh_snapshot.entries;
+}
+
+static void ws_neigh_snapshot_restore_fhss(struct ws_neigh_fhss *dst, const struct ws_neigh_fhss *src,
+                                           uint8_t role, const struct rcp *rcp)
+{
+    *dst = *src;
+    if (role == WS_NR_ROLE_LFN) {
+        dst->lfn.lutt_rx_tstamp_us = rcp_clock_from_host_us(rcp, src->lfn.lutt_rx_tstamp_us);
+        dst->lfn.lnd_rx_tstamp_us  = rcp_clock_from_host_us(rcp, src->lfn.lnd_rx_tstamp_us);
+    } else {
+        dst->ffn.utt_rx_tstamp_us  = rcp_clock_from_host_us(rcp, src->ffn.utt_rx_tstamp_us);
+    }
+    rcp_fhss_uc_chan_encode(dst);
+}
+
+void ws_neigh_snapshot_apply(struct net_if *net_if)
+{
+    struct ws_neigh_table *table = &net_if->ws_info.neighbor_storage;
+    const struct ws_neigh_snapshot_entry *entry;
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    struct ws_neigh *neigh;
+    int count = 0;
+
+    BUG_ON(!net_if->rcp->clock_offset_valid);
+    for (int i = 0; i < g_ws_neigh_snapshot.count; i++) {
+        entry = &g_ws_neigh_snapshot.entries[i];
+        if (entry->expiration_ms <= now_ms)
+            continue;
+        if (ws_neigh_get(table, entry->neigh.mac64))
+            continue;
+        neigh = ws_neigh_add(table, entry->neigh.mac64, entry->neigh.node_role,
+                             net_if->ws_info.tx_power_dbm, net_if->ws_info.key_index_mask);
+        ws_neigh_snapshot_restore_fhss(&neigh->fhss_data, &entry->neigh.fhss_data,
+                                       neigh->node_role, net_if->rcp);
+        ws_neigh_snapshot_restore_fhss(&neigh->fhss_data_unsecured, &entry->neigh.fhss_data_unsecured,
+                                       neigh->node_role, net_if->rcp);
+        neigh->etx         = entry->neigh.etx;
+        neigh->rsl_in_dbm  = entry->neigh.rsl_in_dbm;
+        neigh->rsl_out_dbm = entry->neigh.rsl_out_dbm;
+        // Keys removed since the snapshot keep UINT32_MAX
+        for (int j = 0; j < HIF_KEY_COUNT; j++)
+            if (neigh->frame_counter_min[j] != UINT32_MAX)
+                neigh->frame_counter_min[j] = entry->neigh.frame_counter_min[j];
+        if (entry->neigh.trusted_device)
+            ws_neigh_trust(table, neigh);
+        neigh->lifetime_s = entry->neigh.lifetime_s;
+        neigh->expire_ms  = entry->expiration_ms;
+        timer_start_abs(&table->timer_group, &neigh->timer, entry->expiration_ms);
+        count++;
+    }
+    INFO("restored %d neighbors from " WS_NEIGH_SNAPSHOT, count);
+    free(g_ws_neigh_snapshot.entries);
+    g_ws_neigh_snapshot.entries = NULL;
+    g_ws_neigh_snapshot.count   = 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WS_NEIGH_SNAPSHOT_H
+#define WS_NEIGH_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct net_if;
+
+/*
+ * Unlike the RPL targets, the IPv6 neighbors and the security keys, the 15.4
+ * neighbor table is not part of the storage: after a restart, a node remains
+ * unreachable until a frame from it is received again, since its unicast
+ * schedule is unknown.
+ *
+ * The table (unicast schedule and timing, ETX, RSL, frame counters and
+ * lifetime) can be saved on exit and restored on the next start, as long as
+ * the snapshot is recent and the host did not reboot in between.
+ *
+ * The timestamps of the unicast timing are in the clock of the RCP, which is
+ * reset with wsbrd. They are saved in the host clock, and the snapshot can
+ * only be applied once the offset between both clocks is known, that is once
+ * a frame with a timestamp has been received from the RCP.
+ */
+
+void ws_neigh_snapshot_store(struct net_if *net_if);
+// Read the snapshot, which is then deleted. Older than max_age_ms, it is
+// ignored.
+void ws_neigh_snapshot_load(struct net_if *net_if, uint64_t max_age_ms);
+// Must be called when the RCP clock offset becomes available. Neighbors
+// already heard since startup are not overwritten.
+void ws_neigh_snapshot_apply(struct net_if *net_if);
+bool ws_neigh_snapshot_pending(void);
+
+#endif
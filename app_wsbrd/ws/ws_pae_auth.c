@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include "common/log_legacy.h"
+#include "common/mathutils.h"
 #include "common/rand.h"
 #include "common/memutils.h"
 #include "common/ns_list.h"
@@ -62,9 +63,6 @@
 // Wait after authentication has completed before supplicant entry goes inactive
 #define WAIT_AFTER_AUTHENTICATION_TICKS        15 * 10      // 15 seconds
 
-// Default for maximum number of supplicants
-#define SUPPLICANT_MAX_NUMBER                  5000
-
 /* Default for number of supplicants to purge per garbage collect call from
    nanostack monitor */
 #define SUPPLICANT_NUMBER_TO_PURGE             5
@@ -81,6 +79,24 @@
 
 #define SECONDS_IN_DAY                         (3600 * 24)
 
+/* Admission control: the limit of active supplicants is tuned every period,
+   raised additively while authentications go well and cut multiplicatively on
+   congestion (AIMD). */
+#define ACTIVE_LIMIT_PERIOD                    10         // seconds
+#define ACTIVE_LIMIT_MIN                       8
+#define ACTIVE_LIMIT_INIT                      32
+#define ACTIVE_LIMIT_STEP                      8
+#define ACTIVE_LIMIT_MIN_SAMPLES               4
+#define ACTIVE_LIMIT_SUCCESS_RATE_MIN          50         // percent
+#define ACTIVE_LIMIT_RADIUS_LATENCY_MAX        2000       // milliseconds
+
+// GKH pacing after a GTK insertion: supplicants which only need the new key
+// are admitted at a rate which spreads them over the first half of the time
+// left before the key activation. Shorter windows are not paced.
+#define GKH_PACING_WINDOW_MIN                  600        // seconds
+#define GKH_PACING_BURST                       10         // seconds of credit
+#define GKH_PACING_UNIT                        1000000    // credit per admission
+
 typedef struct pae_auth_gtk {
     sec_prot_gtk_keys_t *next_gtks;                          /**< Next GTKs */
     frame_counters_t *frame_counters;                        /**< Frame counters */
@@ -100,6 +116,9 @@ typedef struct pae_auth {
     ws_pae_auth_congestion_get *congestion_get;              /**< Congestion get callback */
     supp_list_t active_supp_list;                            /**< List of active supplicants */
     supp_list_t waiting_supp_list;                           /**< List of waiting supplicants */
+    supp_index_t supp_index;                                 /**< Active and waiting supplicants by EUI-64 */
+    supp_busy_list_t busy_supp_list;                         /**< Supplicants with KMP timers running */
+    struct timer_group supp_timer_group;                     /**< Timers of the supplicants which are not busy */
     shared_comp_list_t shared_comp_list;                     /**< Shared component list */
     struct event_storage *timer;                             /**< Timer */
     pae_auth_gtk_t gtks;                                     /**< Material for GTKs */
@@ -107,8 +126,17 @@ typedef struct pae_auth {
     const sec_prot_certs_t *certs;                           /**< Certificates */
     sec_prot_keys_nw_info_t *sec_keys_nw_info;               /**< Security keys network information */
     sec_cfg_t *sec_cfg;                                      /**< Security configuration */
-    uint16_t supp_max_number;                                /**< Max number of stored supplicants */
     uint16_t waiting_supp_list_size;                         /**< Waiting supplicants list size */
+    uint16_t active_limit;                                   /**< Current limit of active supplicants */
+    uint16_t active_limit_timer;                             /**< Seconds until the next update of active_limit */
+    uint16_t auth_success_cnt;                               /**< Authentications completed during the period */
+    uint16_t auth_failure_cnt;                               /**< Authentications failed during the period */
+    uint32_t gkh_pacing_time;                                /**< Seconds until the end of GKH pacing, 0 when not pacing */
+    uint64_t gkh_pacing_rate;                                /**< GKH credit gained per second */
+    uint64_t gkh_pacing_credit;                              /**< GKH credit, GKH_PACING_UNIT per admission */
+    uint16_t gkh_pacing_total;                               /**< Supplicants in key storage when pacing started */
+    uint16_t gkh_pacing_admitted;                            /**< GKH admitted since pacing started */
+    uint16_t gkh_pacing_deferred;                            /**< GKH deferred since pacing started */
     uint8_t relay_socked_msg_if_instance_id;                 /**< Relay socket message interface instance identifier */
     uint8_t radius_socked_msg_if_instance_id;                /**< Radius socket message interface instance identifier */
     bool timer_running : 1;                                  /**< Timer is running */
@@ -135,7 +163,7 @@ static bool ws_pae_auth_timer_running(pae_auth_t *pae_auth);
 static void ws_pae_auth_kmp_service_addr_get(kmp_service_t *service, kmp_api_t *kmp, kmp_addr_t *local_addr, kmp_addr_t *remote_addr);
 static void ws_pae_auth_kmp_service_ip_addr_get(kmp_service_t *service, kmp_api_t *kmp, uint8_t *address);
 static kmp_api_t *ws_pae_auth_kmp_service_api_get(kmp_service_t *service, kmp_api_t *kmp, kmp_type_e type);
-static bool ws_pae_auth_active_limit_reached(pae_auth_t *pae_auth);
+static bool ws_pae_auth_active_limit_reached(pae_auth_t *pae_auth, const supp_entry_t *supp_entry);
 static kmp_api_t *ws_pae_auth_kmp_incoming_ind(kmp_service_t *service, uint8_t msg_if_instance_id, kmp_type_e type, const kmp_addr_t *addr, const void *pdu, uint16_t size);
 static void ws_pae_auth_kmp_api_create_confirm(kmp_api_t *kmp, kmp_result_e result);
 static void ws_pae_auth_kmp_api_create_indication(kmp_api_t *kmp, kmp_type_e type, kmp_addr_t *addr);
@@ -146,6 +174,9 @@ static kmp_api_t *ws_pae_auth_kmp_create_and_start(kmp_service_t *service, kmp_t
 static void ws_pae_auth_kmp_api_finished(kmp_api_t *kmp);
 static void ws_pae_auth_active_supp_deleted(void *pae_auth);
 static void ws_pae_auth_waiting_supp_deleted(void *pae_auth);
+static void ws_pae_auth_supp_expired(void *pae_auth, supp_entry_t *supp_entry);
+static void ws_pae_auth_supp_idle_timeout(struct timer_group *group, struct timer_entry *timer);
+static void ws_pae_auth_gkh_pacing_start(pae_auth_t *pae_auth, bool is_lgtk);
 
 static int8_t tasklet_id = -1;
 static NS_LIST_DEFINE(pae_auth_list, pae_auth_t, link);
@@ -174,6 +205,9 @@ void ws_pae_auth_init(struct net_if *interface_ptr,
     pae_auth->interface_ptr = interface_ptr;
     ws_pae_lib_supp_list_init(&pae_auth->active_supp_list);
     ws_pae_lib_supp_list_init(&pae_auth->waiting_supp_list);
+    ws_pae_lib_supp_index_init(&pae_auth->supp_index);
+    LIST_INIT(&pae_auth->busy_supp_list);
+    timer_group_init(&pae_auth->supp_timer_group);
     ws_pae_lib_shared_comp_list_init(&pae_auth->shared_comp_list);
     pae_auth->timer = NULL;
 
@@ -187,8 +221,12 @@ void ws_pae_auth_init(struct net_if *interface_ptr,
     pae_auth->certs = certs;
     pae_auth->sec_keys_nw_info = sec_keys_nw_info;
     pae_auth->sec_cfg = sec_cfg;
-    pae_auth->supp_max_number = SUPPLICANT_MAX_NUMBER;
     pae_auth->waiting_supp_list_size = 0;
+    pae_auth->active_limit = ACTIVE_LIMIT_INIT;
+    pae_auth->active_limit_timer = ACTIVE_LIMIT_PERIOD;
+    pae_auth->auth_success_cnt = 0;
+    pae_auth->auth_failure_cnt = 0;
+    pae_auth->gkh_pacing_time = 0;
 
     pae_auth->gtks.next_gtks = next_gtks;
     pae_auth->gtks.frame_counters = gtk_frame_counters;
@@ -398,10 +436,7 @@ int8_t ws_pae_auth_node_keys_remove(struct net_if *interface_ptr, const uint8_t
     }
 
     // Checks if supplicant is active or waiting
-    supp_entry_t *supp = ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->active_supp_list, eui_64);
-    if (!supp) {
-        supp = ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->waiting_supp_list, eui_64);
-    }
+    supp_entry_t *supp = ws_pae_lib_supp_index_get(&pae_auth->supp_index, eui_64);
 
     if (supp) {
         // Deletes keys and marks as revoked
@@ -490,6 +525,7 @@ int8_t ws_pae_auth_node_access_revoke_start(struct net_if *interface_ptr, bool i
     else
         ws_pae_auth_gtk_key_insert(key_nw_info, key_nw_info_next, timer_cfg->expire_offset, is_lgtk);
     ws_pae_auth_network_keys_from_gtks_set(pae_auth, is_lgtk);
+    ws_pae_auth_gkh_pacing_start(pae_auth, is_lgtk);
 
     // Update keys to NVM as needed
     pae_auth->nw_info_updated(pae_auth->interface_ptr);
@@ -601,18 +637,23 @@ static void ws_pae_auth_tasklet_handler(struct event_payload *event)
 
 void ws_pae_auth_fast_timer(uint16_t ticks)
 {
+    bool running = false;
+
     ns_list_foreach(pae_auth_t, pae_auth, &pae_auth_list) {
         if (!ws_pae_auth_timer_running(pae_auth)) {
             continue;
         }
 
-        // Updates KMP timers
-        bool active_running = ws_pae_lib_supp_list_timer_update(pae_auth, &pae_auth->active_supp_list, ticks, kmp_service_timer_if_timeout, ws_pae_auth_active_supp_deleted);
-        bool wait_running = ws_pae_lib_supp_list_timer_update(pae_auth, &pae_auth->waiting_supp_list, ticks, kmp_service_timer_if_timeout, ws_pae_auth_waiting_supp_deleted);
-        if (!active_running && !wait_running) {
+        // Updates KMP timers, the other supplicants are handled by their idle timer
+        if (!ws_pae_lib_supp_busy_list_timer_update(pae_auth, &pae_auth->busy_supp_list, &pae_auth->supp_timer_group,
+                                                    ticks, kmp_service_timer_if_timeout, ws_pae_auth_supp_expired)) {
             ws_pae_auth_timer_stop(pae_auth);
         }
+        running |= ws_pae_auth_timer_running(pae_auth);
     }
+    // Restarted by ws_pae_auth_timer_start()
+    if (!running)
+        ws_timer_stop(WS_TIMER_PAE_FAST);
 }
 
 void ws_pae_auth_slow_timer_key(pae_auth_t *pae_auth, int i, uint16_t seconds, bool is_lgtk)
@@ -650,21 +691,22 @@ void ws_pae_auth_slow_timer_key(pae_auth_t *pae_auth, int i, uint16_t seconds, b
             int8_t second_index = sec_prot_keys_gtk_install_order_second_index_get(keys);
             if (second_index < 0) {
                 tr_info("%s new install required active index: %i, time: %"PRIu32", system time: %"PRIu32"",
-                        is_lgtk ? "LGTK" : "GTK", active_index, timer_seconds, g_monotonic_time_100ms / 10);
+                        is_lgtk ? "LGTK" : "GTK", active_index, timer_seconds, ws_timer_monotonic_100ms() / 10);
                 ws_pae_auth_gtk_key_insert(keys, pae_auth_gtk->next_gtks, timer_gtk_cfg->expire_offset, is_lgtk);
                 ws_pae_auth_network_keys_from_gtks_set(pae_auth, is_lgtk);
+                ws_pae_auth_gkh_pacing_start(pae_auth, is_lgtk);
                 // Update keys to NVM as needed
                 pae_auth->nw_info_updated(pae_auth->interface_ptr);
             } else {
                 tr_info("%s new install already done; second index: %i, time: %"PRIu32", system time: %"PRIu32"",
-                        is_lgtk ? "LGTK" : "GTK", second_index, timer_seconds, g_monotonic_time_100ms / 10);
+                        is_lgtk ? "LGTK" : "GTK", second_index, timer_seconds, ws_timer_monotonic_100ms() / 10);
             }
         }
 
         if (timer_gtk_cfg->expire_offset / timer_gtk_cfg->new_act_time > timer_seconds) {
             int8_t new_active_index = ws_pae_auth_new_gtk_activate(keys);
             tr_info("%s new activation time active index: %i, time: %"PRIu32", new index: %i, system time: %"PRIu32"",
-                    is_lgtk ? "LGTK" : "GTK", active_index, timer_seconds, new_active_index, g_monotonic_time_100ms / 10);
+                    is_lgtk ? "LGTK" : "GTK", active_index, timer_seconds, new_active_index, ws_timer_monotonic_100ms() / 10);
             if (new_active_index >= 0) {
                 ws_pae_auth_network_key_index_set(pae_auth, new_active_index, is_lgtk);
             }
@@ -680,7 +722,7 @@ void ws_pae_auth_slow_timer_key(pae_auth_t *pae_auth, int i, uint16_t seconds, b
 
     if (timer_seconds == 0) {
         tr_info("%s expired index: %i, system time: %"PRIu32"",
-                is_lgtk ? "LGTK" : "GTK", i, g_monotonic_time_100ms / 10);
+                is_lgtk ? "LGTK" : "GTK", i, ws_timer_monotonic_100ms() / 10);
         ws_pae_auth_gtk_clear(keys, i);
         ws_pae_auth_network_keys_from_gtks_set(pae_auth, is_lgtk);
         // Update keys to NVM as needed
@@ -688,6 +730,104 @@ void ws_pae_auth_slow_timer_key(pae_auth_t *pae_auth, int i, uint16_t seconds, b
     }
 }
 
+static bool ws_pae_auth_tx_congested(pae_auth_t *pae_auth)
+{
+    struct net_if *net_if = pae_auth->interface_ptr;
+    uint16_t queue_len;
+
+    // Same sum as the one fed to the PAE RED by the congestion callback
+    queue_len = red_aq_get(&net_if->random_early_detection) +
+                red_aq_get(&net_if->llc_random_early_detection) +
+                red_aq_get(&net_if->llc_eapol_random_early_detection);
+    return queue_len > net_if->pae_random_early_detection.threshold_min;
+}
+
+static void ws_pae_auth_active_limit_update(pae_auth_t *pae_auth)
+{
+    unsigned int radius_latency_ms = 0;
+    unsigned int done_cnt = pae_auth->auth_success_cnt + pae_auth->auth_failure_cnt;
+    uint16_t active_limit_max = pae_auth->sec_cfg->active_supp_max;
+    uint16_t prev_limit = pae_auth->active_limit;
+    const char *reason = NULL;
+
+    if (!active_limit_max)
+        return;
+    if (pae_auth->sec_cfg->radius_cfg && pae_auth->sec_cfg->radius_cfg->radius_addr_set)
+        radius_latency_ms = radius_client_sec_prot_latency_ms();
+
+    if (ws_pae_auth_tx_congested(pae_auth))
+        reason = "tx queue";
+    else if (done_cnt >= ACTIVE_LIMIT_MIN_SAMPLES &&
+             pae_auth->auth_success_cnt * 100 < done_cnt * ACTIVE_LIMIT_SUCCESS_RATE_MIN)
+        reason = "success rate";
+    else if (radius_latency_ms > ACTIVE_LIMIT_RADIUS_LATENCY_MAX)
+        reason = "radius latency";
+
+    if (reason)
+        pae_auth->active_limit = MAX(pae_auth->active_limit / 2, ACTIVE_LIMIT_MIN);
+    else if (ns_list_count(&pae_auth->active_supp_list) >= pae_auth->active_limit)
+        // Only raise a limit which is actually reached
+        pae_auth->active_limit += ACTIVE_LIMIT_STEP;
+    pae_auth->active_limit = MIN(pae_auth->active_limit, active_limit_max);
+
+    if (pae_auth->active_limit != prev_limit)
+        tr_info("PAE: active limit %u -> %u (%s), success %u/%u, radius latency %ums",
+                prev_limit, pae_auth->active_limit, reason ? reason : "increase",
+                pae_auth->auth_success_cnt, done_cnt, radius_latency_ms);
+    pae_auth->auth_success_cnt = 0;
+    pae_auth->auth_failure_cnt = 0;
+}
+
+static void ws_pae_auth_gkh_pacing_start(pae_auth_t *pae_auth, bool is_lgtk)
+{
+    struct sec_timing *timing = is_lgtk ? &pae_auth->sec_cfg->timing_lfn : &pae_auth->sec_cfg->timing_ffn;
+    sec_prot_gtk_keys_t *keys = is_lgtk ? pae_auth->sec_keys_nw_info->lgtks : pae_auth->sec_keys_nw_info->gtks;
+    int8_t active_index = sec_prot_keys_gtk_status_active_get(keys);
+    uint32_t lifetime, act_lifetime, window;
+    int total;
+
+    if (active_index < 0)
+        return;
+    // The new key is activated when the active one reaches act_lifetime
+    lifetime = sec_prot_keys_gtk_lifetime_get(keys, active_index);
+    act_lifetime = timing->expire_offset / timing->new_act_time;
+    if (lifetime <= act_lifetime)
+        return;
+    // The second half is left to the supplicants deferred or retrying
+    window = (lifetime - act_lifetime) / 2;
+    if (window < GKH_PACING_WINDOW_MIN)
+        return;
+    total = ws_pae_key_storage_count();
+    if (!total)
+        return;
+
+    pae_auth->gkh_pacing_time = window;
+    pae_auth->gkh_pacing_total = MIN(total, UINT16_MAX);
+    pae_auth->gkh_pacing_rate = (uint64_t)pae_auth->gkh_pacing_total * GKH_PACING_UNIT / window;
+    pae_auth->gkh_pacing_credit = MAX(pae_auth->gkh_pacing_rate * GKH_PACING_BURST, GKH_PACING_UNIT);
+    pae_auth->gkh_pacing_admitted = 0;
+    pae_auth->gkh_pacing_deferred = 0;
+    tr_info("PAE: %s inserted, pacing GKH of %u supplicants over %"PRIu32"s",
+            is_lgtk ? "LGTK" : "GTK", pae_auth->gkh_pacing_total, window);
+}
+
+static void ws_pae_auth_gkh_pacing_update(pae_auth_t *pae_auth, uint16_t seconds)
+{
+    uint64_t credit_max = MAX(pae_auth->gkh_pacing_rate * GKH_PACING_BURST, GKH_PACING_UNIT);
+
+    if (!pae_auth->gkh_pacing_time)
+        return;
+    if (pae_auth->gkh_pacing_time > seconds) {
+        pae_auth->gkh_pacing_time -= seconds;
+        pae_auth->gkh_pacing_credit = MIN(pae_auth->gkh_pacing_credit + pae_auth->gkh_pacing_rate * seconds,
+                                          credit_max);
+        return;
+    }
+    pae_auth->gkh_pacing_time = 0;
+    tr_info("PAE: GKH pacing done, admitted %u for %u supplicants, deferred %u",
+            pae_auth->gkh_pacing_admitted, pae_auth->gkh_pacing_total, pae_auth->gkh_pacing_deferred);
+}
+
 void ws_pae_auth_slow_timer(uint16_t seconds)
 {
     ns_list_foreach(pae_auth_t, pae_auth, &pae_auth_list) {
@@ -701,6 +841,14 @@ void ws_pae_auth_slow_timer(uint16_t seconds)
 
         ws_pae_lib_supp_list_slow_timer_update(&pae_auth->active_supp_list, seconds);
 
+        if (pae_auth->active_limit_timer > seconds) {
+            pae_auth->active_limit_timer -= seconds;
+        } else {
+            pae_auth->active_limit_timer = ACTIVE_LIMIT_PERIOD;
+            ws_pae_auth_active_limit_update(pae_auth);
+        }
+        ws_pae_auth_gkh_pacing_update(pae_auth, seconds);
+
         ws_pae_lib_shared_comp_list_timeout(&pae_auth->shared_comp_list, seconds);
     }
 }
@@ -751,7 +899,7 @@ static void ws_pae_auth_gtk_insert(sec_prot_gtk_keys_t *gtks, const uint8_t gtk[
     sec_prot_keys_gtk_status_all_fresh_set(gtks);
 
     tr_info("%s install new index: %i, lifetime: %"PRIu32" system time: %"PRIu32"",
-            is_lgtk ? "LGTK" : "GTK", i_install, lifetime, g_monotonic_time_100ms / 10);
+            is_lgtk ? "LGTK" : "GTK", i_install, lifetime, ws_timer_monotonic_100ms() / 10);
 }
 
 static void ws_pae_auth_gtk_key_insert(sec_prot_gtk_keys_t *gtks, sec_prot_gtk_keys_t *next_gtks, uint32_t lifetime, bool is_lgtk)
@@ -807,6 +955,7 @@ static int8_t ws_pae_auth_timer_if_start(kmp_service_t *service, kmp_api_t *kmp)
     }
 
     ws_pae_lib_kmp_timer_start(&supp_entry->kmp_list, entry);
+    ws_pae_lib_supp_to_busy(pae_auth, &pae_auth->busy_supp_list, supp_entry);
     return 0;
 }
 
@@ -848,6 +997,8 @@ static int8_t ws_pae_auth_shared_comp_remove(kmp_service_t *service, kmp_shared_
 static void ws_pae_auth_timer_start(pae_auth_t *pae_auth)
 {
     pae_auth->timer_running = true;
+    if (!g_timers[WS_TIMER_PAE_FAST].timeout)
+        ws_timer_start(WS_TIMER_PAE_FAST);
 }
 
 static void ws_pae_auth_timer_stop(pae_auth_t *pae_auth)
@@ -904,9 +1055,74 @@ static kmp_api_t *ws_pae_auth_kmp_service_api_get(kmp_service_t *service, kmp_ap
     return ws_pae_lib_kmp_list_type_get(&supp_entry->kmp_list, type);
 }
 
-static bool ws_pae_auth_active_limit_reached(pae_auth_t *pae_auth)
+// Must be called for every supplicant added to the active or the waiting list
+static void ws_pae_auth_supp_index(pae_auth_t *pae_auth, supp_entry_t *supp_entry)
+{
+    supp_entry->idle_timer.callback = ws_pae_auth_supp_idle_timeout;
+    ws_pae_lib_supp_index_add(&pae_auth->supp_index, supp_entry);
+}
+
+static void ws_pae_auth_supp_ticks_set(pae_auth_t *pae_auth, supp_entry_t *supp_entry, uint32_t ticks)
 {
-    return pae_auth->congestion_get(pae_auth->interface_ptr);
+    ws_pae_lib_supp_idle_update(pae_auth, supp_entry);
+    ws_pae_lib_supp_timer_ticks_set(supp_entry, ticks);
+    ws_pae_lib_supp_idle_timer_start(&pae_auth->supp_timer_group, supp_entry);
+}
+
+static void ws_pae_auth_supp_waiting_ticks_set(pae_auth_t *pae_auth, supp_entry_t *supp_entry, uint16_t ticks)
+{
+    ws_pae_lib_supp_idle_update(pae_auth, supp_entry);
+    supp_entry->waiting_ticks = ticks;
+    ws_pae_lib_supp_idle_timer_start(&pae_auth->supp_timer_group, supp_entry);
+}
+
+// Supplicants with a cached PMK only need a 4-way handshake, which costs a
+// fraction of a full EAP-TLS exchange.
+static bool ws_pae_auth_supp_has_pmk(const supp_entry_t *supp_entry)
+{
+    return supp_entry && supp_entry->sec_keys.pmk_set && !supp_entry->sec_keys.pmk_mismatch;
+}
+
+// Supplicants which still hold a valid PTK are most likely coming for a new
+// (L)GTK. While pacing, they consume credit, and are deferred without it.
+static bool ws_pae_auth_gkh_paced(pae_auth_t *pae_auth, const supp_entry_t *supp_entry)
+{
+    struct ws_neigh_table *neigh_table = &pae_auth->interface_ptr->ws_info.neighbor_storage;
+    unsigned int progress_pct;
+
+    if (!pae_auth->gkh_pacing_time || !ws_pae_auth_supp_has_pmk(supp_entry) ||
+        !supp_entry->sec_keys.ptk_set || supp_entry->sec_keys.ptk_mismatch)
+        return false;
+    // Direct neighbors relay the traffic of their sub-DODAG, they are never deferred
+    if (pae_auth->gkh_pacing_credit < GKH_PACING_UNIT && !ws_neigh_get(neigh_table, supp_entry->addr.eui_64)) {
+        pae_auth->gkh_pacing_deferred++;
+        tr_debug("PAE: GKH deferred, eui-64: %s", tr_eui64(supp_entry->addr.eui_64));
+        return true;
+    }
+    pae_auth->gkh_pacing_credit -= MIN(pae_auth->gkh_pacing_credit, GKH_PACING_UNIT);
+    pae_auth->gkh_pacing_admitted++;
+    progress_pct = pae_auth->gkh_pacing_admitted * 100 / pae_auth->gkh_pacing_total;
+    if (progress_pct / 10 != (pae_auth->gkh_pacing_admitted - 1) * 100 / pae_auth->gkh_pacing_total / 10)
+        tr_info("PAE: GKH pacing %u%%, admitted %u/%u, deferred %u", progress_pct,
+                pae_auth->gkh_pacing_admitted, pae_auth->gkh_pacing_total, pae_auth->gkh_pacing_deferred);
+    return false;
+}
+
+static bool ws_pae_auth_active_limit_reached(pae_auth_t *pae_auth, const supp_entry_t *supp_entry)
+{
+    if (pae_auth->congestion_get(pae_auth->interface_ptr)) {
+        WARN("%s: congestion detected", __func__);
+        return true;
+    }
+    if (ws_pae_auth_gkh_paced(pae_auth, supp_entry))
+        return true;
+    // The fast path is only subject to congestion
+    if (!pae_auth->sec_cfg->active_supp_max || ws_pae_auth_supp_has_pmk(supp_entry))
+        return false;
+    if (ns_list_count(&pae_auth->active_supp_list) < pae_auth->active_limit)
+        return false;
+    tr_info("PAE: active limit %u reached", pae_auth->active_limit);
+    return true;
 }
 
 static supp_entry_t *ws_pae_auth_waiting_supp_list_add(pae_auth_t *pae_auth, supp_entry_t *supp_entry, const kmp_addr_t *addr)
@@ -924,9 +1140,11 @@ static supp_entry_t *ws_pae_auth_waiting_supp_list_add(pae_auth_t *pae_auth, sup
         pae_auth->waiting_supp_list_size++;
         sec_prot_keys_init(&supp_entry->sec_keys, pae_auth->sec_keys_nw_info->gtks, pae_auth->sec_keys_nw_info->lgtks, pae_auth->certs);
     }
+    supp_entry->waiting = true;
+    ws_pae_auth_supp_index(pae_auth, supp_entry);
 
     // 90 percent of the EAPOL temporary entry lifetime (10 ticks per second)
-    supp_entry->waiting_ticks = WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME * 900 / 100;
+    ws_pae_auth_supp_waiting_ticks_set(pae_auth, supp_entry, WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME * 900 / 100);
 
     tr_info("PAE: to waiting, list size %i, retry %i, eui-64: %s", pae_auth->waiting_supp_list_size, supp_entry->waiting_ticks, tr_eui64(supp_entry->addr.eui_64));
 
@@ -947,27 +1165,26 @@ static kmp_api_t *ws_pae_auth_kmp_incoming_ind(kmp_service_t *service, uint8_t m
         return kmp_api;
     }
 
-    // For relay messages find supplicant from list of active supplicants based on EUI-64
-    supp_entry_t *supp_entry = ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->active_supp_list, kmp_address_eui_64_get(addr));
+    // For relay messages find supplicant from list of active or waiting supplicants based on EUI-64
+    supp_entry_t *supp_entry = ws_pae_lib_supp_index_get(&pae_auth->supp_index, kmp_address_eui_64_get(addr));
 
-    if (!supp_entry) {
+    if (!supp_entry || supp_entry->waiting) {
         // Check if supplicant is already on the the waiting supplicant list
-        supp_entry = ws_pae_lib_supp_list_entry_eui_64_get(&pae_auth->waiting_supp_list, kmp_address_eui_64_get(addr));
         if (supp_entry) {
             /* Remove from waiting list (supplicant is later added to active list, or if no room back to the start of the
              * waiting list with updated timer)
              */
             ns_list_remove(&pae_auth->waiting_supp_list, supp_entry);
             pae_auth->waiting_supp_list_size--;
-            supp_entry->waiting_ticks = 0;
+            supp_entry->waiting = false;
+            ws_pae_auth_supp_waiting_ticks_set(pae_auth, supp_entry, 0);
         } else {
             // Find supplicant from key storage
             supp_entry = ws_pae_key_storage_supp_read(pae_auth, kmp_address_eui_64_get(addr), pae_auth->sec_keys_nw_info->gtks, pae_auth->sec_keys_nw_info->lgtks, pae_auth->certs);
         }
 
         // Checks if active supplicant list has space for new supplicants
-        if (ws_pae_auth_active_limit_reached(pae_auth)) {
-            WARN("%s: congestion detected, moving supplicant to waiting list", __func__);
+        if (ws_pae_auth_active_limit_reached(pae_auth, supp_entry)) {
             // If there is no space, add supplicant entry to the start of the waiting supplicant list
             supp_entry = ws_pae_auth_waiting_supp_list_add(pae_auth, supp_entry, addr);
             if (!supp_entry) {
@@ -981,6 +1198,7 @@ static kmp_api_t *ws_pae_auth_kmp_incoming_ind(kmp_service_t *service, uint8_t m
                  */
                 tr_debug("PAE: to active, eui-64: %s", tr_eui64(supp_entry->addr.eui_64));
                 ns_list_add_to_start(&pae_auth->active_supp_list, supp_entry);
+                ws_pae_auth_supp_index(pae_auth, supp_entry);
             }
         }
     }
@@ -991,6 +1209,7 @@ static kmp_api_t *ws_pae_auth_kmp_incoming_ind(kmp_service_t *service, uint8_t m
         if (!supp_entry) {
             return 0;
         }
+        ws_pae_auth_supp_index(pae_auth, supp_entry);
         sec_prot_keys_init(&supp_entry->sec_keys, pae_auth->sec_keys_nw_info->gtks, pae_auth->sec_keys_nw_info->lgtks, pae_auth->certs);
     } else {
         // Updates relay address
@@ -998,7 +1217,7 @@ static kmp_api_t *ws_pae_auth_kmp_incoming_ind(kmp_service_t *service, uint8_t m
     }
 
     // Increases waiting time for supplicant authentication
-    ws_pae_lib_supp_timer_ticks_set(supp_entry, WAIT_FOR_AUTHENTICATION_TICKS);
+    ws_pae_auth_supp_ticks_set(pae_auth, supp_entry, WAIT_FOR_AUTHENTICATION_TICKS);
 
     kmp_type_e kmp_type_to_search = type;
 
@@ -1083,8 +1302,16 @@ static bool ws_pae_auth_kmp_api_finished_indication(kmp_api_t *kmp, kmp_result_e
 {
     (void) sec_keys;
 
+    kmp_service_t *service = kmp_api_service_get(kmp);
+    pae_auth_t *pae_auth = ws_pae_auth_by_kmp_service_get(service);
+    if (!pae_auth) {
+        // Should not be possible
+        return false;
+    }
+
     // For now, just ignore if not ok
     if (result != KMP_RESULT_OK) {
+        pae_auth->auth_failure_cnt++;
         return false;
     }
 
@@ -1093,15 +1320,9 @@ static bool ws_pae_auth_kmp_api_finished_indication(kmp_api_t *kmp, kmp_result_e
         // Should not be possible
         return false;
     }
-    kmp_service_t *service = kmp_api_service_get(kmp);
-    pae_auth_t *pae_auth = ws_pae_auth_by_kmp_service_get(service);
-    if (!pae_auth) {
-        // Should not be possible
-        return false;
-    }
 
     // Ensures that supplicant is in active supplicant list before initiating next KMP
-    if (!ws_pae_lib_supp_list_entry_is_in_list(&pae_auth->active_supp_list, supp_entry)) {
+    if (!supp_entry->indexed || supp_entry->waiting) {
         return false;
     }
 
@@ -1115,7 +1336,7 @@ static bool ws_pae_auth_next_kmp_trigger(pae_auth_t *pae_auth, supp_entry_t *sup
 
     if (next_type == KMP_TYPE_NONE) {
         // Supplicant goes inactive after 15 seconds
-        ws_pae_lib_supp_timer_ticks_set(supp_entry, WAIT_AFTER_AUTHENTICATION_TICKS);
+        ws_pae_auth_supp_ticks_set(pae_auth, supp_entry, WAIT_AFTER_AUTHENTICATION_TICKS);
         // All done
         return true;
     } else {
@@ -1131,7 +1352,7 @@ static bool ws_pae_auth_next_kmp_trigger(pae_auth_t *pae_auth, supp_entry_t *sup
     }
 
     // Increases waiting time for supplicant authentication
-    ws_pae_lib_supp_timer_ticks_set(supp_entry, WAIT_FOR_AUTHENTICATION_TICKS);
+    ws_pae_auth_supp_ticks_set(pae_auth, supp_entry, WAIT_FOR_AUTHENTICATION_TICKS);
 
     // Create new instance
     kmp_api_t *new_kmp = ws_pae_auth_kmp_create_and_start(pae_auth->kmp_service, next_type, pae_auth->relay_socked_msg_if_instance_id, supp_entry, pae_auth->sec_cfg);
@@ -1176,7 +1397,7 @@ static kmp_type_e ws_pae_auth_next_protocol_get(pae_auth_t *pae_auth, supp_entry
     sec_prot_keys_t *sec_keys = &supp_entry->sec_keys;
 
     if (sec_keys->node_role == WS_NR_ROLE_UNKNOWN &&
-        !pae_auth->interface_ptr->ws_info.enable_ffn10) {
+        !ws_ffn10_enabled(&pae_auth->interface_ptr->ws_info)) {
         TRACE(TR_DROP, "drop %-9s: FAN 1.0 authentication disabled", "eap");
         return KMP_TYPE_NONE;
     }
@@ -1275,6 +1496,7 @@ static kmp_type_e ws_pae_auth_next_protocol_get(pae_auth_t *pae_auth, supp_entry
 
     if (next_type == KMP_TYPE_NONE) {
         tr_info("PAE: authenticated, eui-64: %s", tr_eui64(supp_entry->addr.eui_64));
+        pae_auth->auth_success_cnt++;
     }
 
     return next_type;
@@ -1335,20 +1557,27 @@ static void ws_pae_auth_active_supp_deleted(void *pae_auth_ptr)
 
     tr_info("Supplicant deleted");
 
-    if (ws_pae_auth_active_limit_reached(pae_auth)) {
-        WARN("%s: congestion detected, leaving supplicant waiting list as is", __func__);
-        return;
+    // Supplicants with a cached PMK are taken first
+    supp_entry_t *retry_supp = NULL;
+    ns_list_foreach(supp_entry_t, entry, &pae_auth->waiting_supp_list) {
+        if (ws_pae_auth_supp_has_pmk(entry)) {
+            retry_supp = entry;
+            break;
+        }
     }
+    if (!retry_supp)
+        retry_supp = ns_list_get_first(&pae_auth->waiting_supp_list);
 
-    supp_entry_t *retry_supp = ns_list_get_first(&pae_auth->waiting_supp_list);
-    if (retry_supp != NULL) {
-        ns_list_remove(&pae_auth->waiting_supp_list, retry_supp);
-        pae_auth->waiting_supp_list_size--;
-        ns_list_add_to_start(&pae_auth->active_supp_list, retry_supp);
-        tr_info("PAE: waiting supplicant to active, eui-64: %s", tr_eui64(retry_supp->addr.eui_64));
-        retry_supp->waiting_ticks = 0;
-        ws_pae_auth_next_kmp_trigger(pae_auth, retry_supp);
-    }
+    if (!retry_supp || ws_pae_auth_active_limit_reached(pae_auth, retry_supp))
+        return;
+
+    ns_list_remove(&pae_auth->waiting_supp_list, retry_supp);
+    pae_auth->waiting_supp_list_size--;
+    ns_list_add_to_start(&pae_auth->active_supp_list, retry_supp);
+    retry_supp->waiting = false;
+    tr_info("PAE: waiting supplicant to active, eui-64: %s", tr_eui64(retry_supp->addr.eui_64));
+    ws_pae_auth_supp_waiting_ticks_set(pae_auth, retry_supp, 0);
+    ws_pae_auth_next_kmp_trigger(pae_auth, retry_supp);
 }
 
 static void ws_pae_auth_waiting_supp_deleted(void *pae_auth_ptr)
@@ -1357,12 +1586,41 @@ static void ws_pae_auth_waiting_supp_deleted(void *pae_auth_ptr)
     pae_auth->waiting_supp_list_size--;
 }
 
+static void ws_pae_auth_supp_expired(void *pae_auth_ptr, supp_entry_t *supp_entry)
+{
+    pae_auth_t *pae_auth = pae_auth_ptr;
+
+    if (supp_entry->waiting)
+        ws_pae_lib_supp_list_to_inactive(pae_auth, &pae_auth->waiting_supp_list, supp_entry, ws_pae_auth_waiting_supp_deleted);
+    else
+        ws_pae_lib_supp_list_to_inactive(pae_auth, &pae_auth->active_supp_list, supp_entry, ws_pae_auth_active_supp_deleted);
+}
+
+static void ws_pae_auth_supp_idle_timeout(struct timer_group *group, struct timer_entry *timer)
+{
+    pae_auth_t *pae_auth = container_of(group, pae_auth_t, supp_timer_group);
+    supp_entry_t *supp_entry = container_of(timer, supp_entry_t, idle_timer);
+
+    if (ws_pae_lib_supp_idle_update(pae_auth, supp_entry))
+        ws_pae_lib_supp_idle_timer_start(&pae_auth->supp_timer_group, supp_entry);
+    else
+        ws_pae_auth_supp_expired(pae_auth, supp_entry);
+}
+
+void ws_pae_auth_session_count(struct net_if *interface_ptr, int *active, int *waiting)
+{
+    pae_auth_t *pae_auth = ws_pae_auth_get(interface_ptr);
+
+    *active = pae_auth ? ns_list_count(&pae_auth->active_supp_list) : 0;
+    *waiting = pae_auth ? pae_auth->waiting_supp_list_size : 0;
+}
+
 int ws_pae_auth_supp_list(int8_t interface_id, uint8_t eui64[][8], int len)
 {
     struct net_if *interface_ptr;
     supp_list_t *supp_lists[2];
     pae_auth_t *pae_auth;
-    int len_ret, j;
+    int len_ret;
 
     interface_ptr = protocol_stack_interface_info_get_by_id(interface_id);
     if (!interface_ptr)
@@ -1378,12 +1636,11 @@ int ws_pae_auth_supp_list(int8_t interface_id, uint8_t eui64[][8], int len)
     if (len_ret == len)
         return len_ret;
 
+    // The key storage was listed entirely, a lookup is cheaper than a scan of
+    // the list with thousands of supplicants.
     for (int i = 0; i < ARRAY_SIZE(supp_lists); i++) {
         ns_list_foreach(supp_entry_t, cur, supp_lists[i]) {
-            for (j = 0; j < len_ret; j++)
-                if (!memcmp(cur->addr.eui_64, eui64[j], 8))
-                    break;
-            if (j != len_ret)
+            if (ws_pae_key_storage_supp_exists(cur->addr.eui_64))
                 continue;
             memcpy(eui64[len_ret++], cur->addr.eui_64, 8);
             if (len_ret == len)
@@ -246,6 +246,7 @@ void ws_pae_auth_cb_register(struct net_if *interface_ptr,
                              ws_pae_auth_congestion_get *congestion_get);
 
 int ws_pae_auth_supp_list(int8_t interface_id, uint8_t eui64[][8], int len);
+void ws_pae_auth_session_count(struct net_if *interface_ptr, int *active, int *waiting);
 void ws_pae_auth_gtk_install(int8_t interface_id, const uint8_t key[GTK_LEN], bool is_lgtk);
 
 #endif
@@ -29,6 +29,7 @@
 #endif
 #include "common/crypto/ws_keys.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/named_values.h"
 #include "common/key_value_storage.h"
 #include "common/parsers.h"
@@ -295,16 +296,30 @@ static bool ws_pae_controller_auth_congestion_get(struct net_if *interface_ptr)
     return controller->congestion_get(interface_ptr);
 }
 
+/*
+ * The storage does not hold the current frame counter but the end of a block
+ * of reserved frame counters. The counters are advanced in memory, and a new
+ * block is reserved (written) only when the current one is nearly used, which
+ * leaves room for the frames sent by the RCP but not confirmed yet. After a
+ * power loss, the frame counters restart above the block, so they never go
+ * backwards.
+ */
 void ws_pae_controller_nw_frame_counter_indication_cb(int8_t net_if_id, unsigned int gtk_index, uint32_t frame_counter)
 {
     struct net_if *interface_ptr = protocol_stack_interface_info_get_by_id(net_if_id);
     pae_controller_t *controller = ws_pae_controller_get(interface_ptr);
+    frame_counter_t *counter;
 
     if (gtk_index >= GTK_NUM)
-        controller->lgtks.frame_counters.counter[gtk_index - GTK_NUM].frame_counter = frame_counter;
+        counter = &controller->lgtks.frame_counters.counter[gtk_index - GTK_NUM];
     else
-        controller->gtks.frame_counters.counter[gtk_index].frame_counter = frame_counter;
+        counter = &controller->gtks.frame_counters.counter[gtk_index];
+    counter->frame_counter = frame_counter;
 
+    if (counter->frame_counter_max >= frame_counter &&
+        counter->frame_counter_max - frame_counter >= FRAME_COUNTER_RESERVATION / 4)
+        return;
+    counter->frame_counter_max = add32sat(frame_counter, FRAME_COUNTER_RESERVATION);
     ws_pae_controller_nvm_nw_info_write(controller->interface_ptr, &controller->sec_keys_nw_info,
                                         &controller->gtks.frame_counters, &controller->lgtks.frame_counters,
                                         controller->interface_ptr->mac);
@@ -456,7 +471,8 @@ void ws_pae_controller_init(struct net_if *interface_ptr)
 int8_t ws_pae_controller_configure(struct net_if *interface_ptr,
                                    const struct sec_timing *timing_ffn,
                                    const struct sec_timing *timing_lfn,
-                                   const struct sec_prot_cfg *sec_prot_cfg)
+                                   const struct sec_prot_cfg *sec_prot_cfg,
+                                   uint16_t active_supp_max)
 {
     pae_controller_t *controller = ws_pae_controller_get(interface_ptr);
     if (controller == NULL) {
@@ -472,6 +488,7 @@ int8_t ws_pae_controller_configure(struct net_if *interface_ptr,
     controller->sec_cfg.timing_lfn = *timing_lfn;
 
     controller->sec_cfg.radius_cfg = pae_controller_config.radius_cfg;
+    controller->sec_cfg.active_supp_max = active_supp_max;
     return 0;
 }
 
@@ -544,6 +561,7 @@ static int8_t ws_pae_controller_nw_info_read(pae_controller_t *controller)
                     tr_error("Frame counter space exhausted");
                     controller->gtks.frame_counters.counter[index].frame_counter = UINT32_MAX;
                 }
+                controller->gtks.frame_counters.counter[index].frame_counter_max = controller->gtks.frame_counters.counter[index].frame_counter;
 
                 tr_info("Read GTK frame counter: index %i value %"PRIu32"", index, controller->gtks.frame_counters.counter[index].frame_counter);
             }
@@ -558,6 +576,7 @@ static int8_t ws_pae_controller_nw_info_read(pae_controller_t *controller)
                     tr_error("Frame counter space exhausted");
                     controller->lgtks.frame_counters.counter[index].frame_counter = UINT32_MAX;
                 }
+                controller->lgtks.frame_counters.counter[index].frame_counter_max = controller->lgtks.frame_counters.counter[index].frame_counter;
 
                 tr_info("Read LGTK frame counter: index %i value %"PRIu32"", index, controller->lgtks.frame_counters.counter[index].frame_counter);
             }
@@ -606,7 +625,8 @@ static int8_t ws_pae_controller_nvm_nw_info_write(const struct net_if *interface
             fprintf(info->file, "gtk[%d].lifetime = %llu\n", i, gtks->gtk[i].lifetime + current_time);
             fprintf(info->file, "gtk[%d].status = %s\n", i, val_to_str(gtks->gtk[i].status, valid_gtk_status, NULL));
             fprintf(info->file, "gtk[%d].install_order = %u\n", i, gtks->gtk[i].install_order);
-            fprintf(info->file, "gtk[%d].frame_counter = %u\n", i, gtk_frame_counters->counter[i].frame_counter);
+            fprintf(info->file, "gtk[%d].frame_counter = %u\n", i,
+                    MAX(gtk_frame_counters->counter[i].frame_counter, gtk_frame_counters->counter[i].frame_counter_max));
             fprintf(info->file, "# For information:\n");
             str_key(gak, GTK_LEN, str_buf, sizeof(str_buf));
             fprintf(info->file, "#gtk[%d].gak = %s\n", i, str_buf);
@@ -626,7 +646,8 @@ static int8_t ws_pae_controller_nvm_nw_info_write(const struct net_if *interface
             fprintf(info->file, "lgtk[%d].lifetime = %llu\n", i, lgtks->gtk[i].lifetime + current_time);
             fprintf(info->file, "lgtk[%d].status = %s\n", i, val_to_str(lgtks->gtk[i].status, valid_gtk_status, NULL));
             fprintf(info->file, "lgtk[%d].install_order = %u\n", i, lgtks->gtk[i].install_order);
-            fprintf(info->file, "lgtk[%d].frame_counter = %u\n", i, lgtk_frame_counters->counter[i].frame_counter);
+            fprintf(info->file, "lgtk[%d].frame_counter = %u\n", i,
+                    MAX(lgtk_frame_counters->counter[i].frame_counter, lgtk_frame_counters->counter[i].frame_counter_max));
             fprintf(info->file, "# For information:\n");
             str_key(gak, GTK_LEN, str_buf, sizeof(str_buf));
             fprintf(info->file, "#lgtk[%d].gak = %s\n", i, str_buf);
@@ -636,6 +657,9 @@ static int8_t ws_pae_controller_nvm_nw_info_write(const struct net_if *interface
             fprintf(info->file, "#lgtk[%d].installed_hash = %s\n", i, str_buf);
         }
     }
+    // The frame counter reservation must survive a power loss
+    if (storage_sync(info))
+        WARN("%s: storage_sync: %m", __func__);
     storage_close(info);
     return 0;
 }
@@ -784,6 +808,7 @@ int8_t ws_pae_controller_own_certificate_add(const arm_certificate_entry_s *cert
         }
         // Updates the length of own certificates
         entry->certs.own_cert_chain_len = sec_prot_certs_cert_chain_entry_len_get(&entry->certs.own_cert_chain);
+        entry->certs.version++;
     }
 
     return ret;
@@ -806,6 +831,7 @@ int8_t ws_pae_controller_trusted_certificate_add(const arm_certificate_entry_s *
             continue;
         }
         sec_prot_certs_chain_list_add(&entry->certs.trusted_cert_chain_list, trusted_cert);
+        entry->certs.version++;
         ret = 0;
     }
 
@@ -901,7 +927,7 @@ int8_t ws_pae_controller_gtk_update(int8_t interface_id, const uint8_t *gtk[GTK_
             lifetime += controller->sec_cfg.timing_ffn.expire_offset;
             if (sec_prot_keys_gtk_set(&controller->gtks.gtks, i, gtk[i], lifetime) >= 0) {
                 controller->gtks.gtks_set = true;
-                tr_info("GTK set index: %i, lifetime %"PRIu32", system time: %"PRIu32"", i, lifetime, g_monotonic_time_100ms / 10);
+                tr_info("GTK set index: %i, lifetime %"PRIu32", system time: %"PRIu32"", i, lifetime, ws_timer_monotonic_100ms() / 10);
             }
         }
     }
@@ -944,7 +970,7 @@ int8_t ws_pae_controller_lgtk_update(int8_t interface_id, const uint8_t *lgtk[LG
             lifetime += controller->sec_cfg.timing_lfn.expire_offset;
             if (sec_prot_keys_gtk_set(&controller->lgtks.gtks, i, lgtk[i], lifetime) >= 0) {
                 controller->lgtks.gtks_set = true;
-                tr_info("LGTK set index: %i, lifetime %"PRIu32", system time: %"PRIu32"", i, lifetime, g_monotonic_time_100ms / 10);
+                tr_info("LGTK set index: %i, lifetime %"PRIu32", system time: %"PRIu32"", i, lifetime, ws_timer_monotonic_100ms() / 10);
             }
         }
     }
@@ -73,6 +73,7 @@ void ws_pae_controller_init(struct net_if *interface_ptr);
  * \param sec_timer_cfg timer configuration or NULL if not set
  * \param sec_prot_cfg protocol configuration or NULL if not set
  * \param timing_cfg timing configuration or NULL if not set
+ * \param active_supp_max maximum number of concurrent authentications, 0 for no limit
  *
  * \return < 0 failure
  * \return >= 0 success
@@ -81,7 +82,8 @@ void ws_pae_controller_init(struct net_if *interface_ptr);
 int8_t ws_pae_controller_configure(struct net_if *interface_ptr,
                                    const struct sec_timing *timing_ffn,
                                    const struct sec_timing *timing_lfn,
-                                   const struct sec_prot_cfg *sec_prot_cfg);
+                                   const struct sec_prot_cfg *sec_prot_cfg,
+                                   uint16_t active_supp_max);
 
 /**
  * ws_pae_controller_init initializes PAE authenticator
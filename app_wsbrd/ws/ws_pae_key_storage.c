@@ -21,11 +21,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
-#include <glob.h>
 #include <fnmatch.h>
 #include <inttypes.h>
 #include "common/bits.h"
+#include "common/iobuf.h"
 #include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/rand.h"
 #include "common/parsers.h"
 #include "common/named_values.h"
@@ -48,19 +50,185 @@ static const struct name_value nr_values[] = {
     { NULL, 0 }
 };
 
+/*
+ * Binary layout of keys-<eui64>, written when g_ws_pae_key_storage_binary is
+ * set. The text layout is still read, files are converted when rewritten.
+ *
+ *   u8   magic[4]  WS_PAE_KEY_STORAGE_MAGIC, the text layout never starts
+ *                  with a NUL byte
+ *   u8   flags     WS_PAE_KEY_STORAGE_PMK, _PMK_REPLAY_CNT, _PTK
+ *   u8   node_role
+ *   u8   gtk_hash_set
+ *   u8   lgtk_hash_set
+ *   u8   pmk[PMK_LEN]          if WS_PAE_KEY_STORAGE_PMK
+ *   le64 pmk_expiration_s     if WS_PAE_KEY_STORAGE_PMK
+ *   le64 pmk_replay_counter   if WS_PAE_KEY_STORAGE_PMK_REPLAY_CNT
+ *   u8   ptk[PTK_LEN]          if WS_PAE_KEY_STORAGE_PTK
+ *   le64 ptk_expiration_s     if WS_PAE_KEY_STORAGE_PTK
+ *   u8   gtk_hash[INS_GTK_HASH_LEN]  for each bit set in gtk_hash_set
+ *   u8   lgtk_hash[INS_GTK_HASH_LEN] for each bit set in lgtk_hash_set
+ */
+#define WS_PAE_KEY_STORAGE_MAGIC "\0WK1"
+#define WS_PAE_KEY_STORAGE_SIZE_MAX 256
+
+enum {
+    WS_PAE_KEY_STORAGE_PMK            = BIT(0),
+    WS_PAE_KEY_STORAGE_PMK_REPLAY_CNT = BIT(1),
+    WS_PAE_KEY_STORAGE_PTK            = BIT(2),
+};
+
+bool g_ws_pae_key_storage_binary = false;
+
+/*
+ * Sorted list of the EUI-64 of the stored keys-<eui64> files, so the queries
+ * from D-Bus and from the authenticator do not scan the storage directory.
+ * It is loaded on first use, and kept up to date by the write and delete
+ * functions, which are the only ones to create or remove these files once
+ * wsbrd has started.
+ */
+static struct {
+    uint8_t (*eui64)[8];
+    int count;
+    int size;
+    bool loaded;
+} g_ws_pae_key_index;
+
+static int ws_pae_key_index_cmp(const void *a, const void *b)
+{
+    return memcmp(a, b, 8);
+}
+
+// Return the position of eui64, or of the first entry greater than it
+static int ws_pae_key_index_find(const uint8_t eui64[8], bool *found)
+{
+    int lo = 0, hi = g_ws_pae_key_index.count, mid, ret;
+
+    *found = false;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        ret = memcmp(g_ws_pae_key_index.eui64[mid], eui64, 8);
+        if (!ret) {
+            *found = true;
+            return mid;
+        }
+        if (ret < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void ws_pae_key_index_load(void)
+{
+    char **files;
+    int count;
+
+    if (g_ws_pae_key_index.loaded)
+        return;
+    g_ws_pae_key_index.loaded = true;
+    if (!g_storage_prefix)
+        return;
+    files = storage_glob("keys-*:*:*:*:*:*:*:*");
+    for (count = 0; files[count]; count++)
+        ;
+    g_ws_pae_key_index.size = count;
+    g_ws_pae_key_index.eui64 = xalloc(MAX(count, 1) * 8);
+    for (int i = 0; files[i]; i++)
+        if (!parse_byte_array(g_ws_pae_key_index.eui64[g_ws_pae_key_index.count], 8,
+                              strrchr(files[i], '-') + 1))
+            g_ws_pae_key_index.count++;
+    storage_globfree(files);
+    qsort(g_ws_pae_key_index.eui64, g_ws_pae_key_index.count, 8, ws_pae_key_index_cmp);
+}
+
+static void ws_pae_key_index_add(const uint8_t eui64[8])
+{
+    bool found;
+    int i;
+
+    ws_pae_key_index_load();
+    i = ws_pae_key_index_find(eui64, &found);
+    if (found)
+        return;
+    if (g_ws_pae_key_index.count == g_ws_pae_key_index.size) {
+        g_ws_pae_key_index.size = MAX(2 * g_ws_pae_key_index.size, 16);
+        g_ws_pae_key_index.eui64 = reallocarray(g_ws_pae_key_index.eui64, g_ws_pae_key_index.size, 8);
+        FATAL_ON(!g_ws_pae_key_index.eui64, 2, "%s: cannot allocate memory", __func__);
+    }
+    memmove(g_ws_pae_key_index.eui64[i + 1], g_ws_pae_key_index.eui64[i],
+            (g_ws_pae_key_index.count - i) * 8);
+    memcpy(g_ws_pae_key_index.eui64[i], eui64, 8);
+    g_ws_pae_key_index.count++;
+}
+
+static bool ws_pae_key_index_del(const uint8_t eui64[8])
+{
+    bool found;
+    int i;
+
+    ws_pae_key_index_load();
+    i = ws_pae_key_index_find(eui64, &found);
+    if (!found)
+        return false;
+    g_ws_pae_key_index.count--;
+    memmove(g_ws_pae_key_index.eui64[i], g_ws_pae_key_index.eui64[i + 1],
+            (g_ws_pae_key_index.count - i) * 8);
+    return true;
+}
+
 bool ws_pae_key_storage_supp_delete(const void *instance, const uint8_t *eui64)
 {
+    const char *files[] = { NULL, NULL };
     char filename[256];
-    char str_buf[24];
-    int ret;
 
     if (!g_storage_prefix)
         return true;
-    str_key(eui64, 8, str_buf, sizeof(str_buf));
-    snprintf(filename, sizeof(filename), "%skeys-%s", g_storage_prefix, str_buf);
-    ret = unlink(filename);
+    strcpy(filename, "keys-");
+    str_key(eui64, 8, filename + strlen(filename), sizeof(filename) - strlen(filename));
+    if (!ws_pae_key_index_del(eui64))
+        return false;
+    files[0] = filename;
+    storage_delete(files);
+    return true;
+}
 
-    return !ret;
+static void ws_pae_key_storage_supp_write_bin(struct storage_parse_info *info, const supp_entry_t *pae_supp,
+                                              uint64_t current_time)
+{
+    const sec_prot_keys_t *keys = &pae_supp->sec_keys;
+    struct iobuf_write buf = { };
+    uint8_t flags = 0;
+
+    if (keys->pmk_set)
+        flags |= WS_PAE_KEY_STORAGE_PMK;
+    if (keys->pmk_key_replay_cnt_set)
+        flags |= WS_PAE_KEY_STORAGE_PMK_REPLAY_CNT;
+    if (keys->ptk_set)
+        flags |= WS_PAE_KEY_STORAGE_PTK;
+    iobuf_push_data(&buf, WS_PAE_KEY_STORAGE_MAGIC, 4);
+    iobuf_push_u8(&buf, flags);
+    iobuf_push_u8(&buf, keys->node_role);
+    iobuf_push_u8(&buf, keys->gtks.ins_gtk_hash_set);
+    iobuf_push_u8(&buf, keys->lgtks.ins_gtk_hash_set);
+    if (keys->pmk_set) {
+        iobuf_push_data(&buf, keys->pmk, PMK_LEN);
+        iobuf_push_le64(&buf, current_time + keys->pmk_lifetime);
+    }
+    if (keys->pmk_key_replay_cnt_set)
+        iobuf_push_le64(&buf, keys->pmk_key_replay_cnt);
+    if (keys->ptk_set) {
+        iobuf_push_data(&buf, keys->ptk, PTK_LEN);
+        iobuf_push_le64(&buf, current_time + keys->ptk_lifetime);
+    }
+    for (int i = 0; i < GTK_NUM; i++)
+        if (keys->gtks.ins_gtk_hash_set & BIT(i))
+            iobuf_push_data(&buf, keys->gtks.ins_gtk_hash[i].hash, INS_GTK_HASH_LEN);
+    for (int i = 0; i < LGTK_NUM; i++)
+        if (keys->lgtks.ins_gtk_hash_set & BIT(i))
+            iobuf_push_data(&buf, keys->lgtks.ins_gtk_hash[i].hash, INS_GTK_HASH_LEN);
+    fwrite(buf.data, 1, buf.len, info->file);
+    iobuf_free(&buf);
 }
 
 int8_t ws_pae_key_storage_supp_write(const void *instance, supp_entry_t *pae_supp)
@@ -76,6 +244,12 @@ int8_t ws_pae_key_storage_supp_write(const void *instance, supp_entry_t *pae_sup
     info = storage_open_prefix(str_buf, "w");
     if (!info)
         return -1;
+    ws_pae_key_index_add(pae_supp->addr.eui_64);
+    if (g_ws_pae_key_storage_binary) {
+        ws_pae_key_storage_supp_write_bin(info, pae_supp, current_time);
+        storage_close(info);
+        return 0;
+    }
     if (pae_supp->sec_keys.pmk_set) {
         str_key(pae_supp->sec_keys.pmk, sizeof(pae_supp->sec_keys.pmk), str_buf, sizeof(str_buf));
         fprintf(info->file, "pmk = %s\n", str_buf);
@@ -109,25 +283,11 @@ int8_t ws_pae_key_storage_supp_write(const void *instance, supp_entry_t *pae_sup
     return 0;
 }
 
-supp_entry_t *ws_pae_key_storage_supp_read(const void *instance, const uint8_t *eui_64, sec_prot_gtk_keys_t *gtks, sec_prot_gtk_keys_t *lgtks, const sec_prot_certs_t *certs)
+static void ws_pae_key_storage_supp_read_txt(struct storage_parse_info *info, supp_entry_t *pae_supp,
+                                             uint64_t current_time)
 {
-    supp_entry_t *pae_supp = malloc(sizeof(supp_entry_t));
-    uint64_t current_time = time_now_s(CLOCK_REALTIME);
-    struct storage_parse_info *info;
-    char str_buf[256];
     int ret;
 
-    ws_pae_lib_supp_init(pae_supp);
-    sec_prot_keys_init(&pae_supp->sec_keys, gtks, lgtks, certs);
-    kmp_address_init(KMP_ADDR_EUI_64_AND_IP, &pae_supp->addr, eui_64);
-    strcpy(str_buf, "keys-");
-    str_key(eui_64, 8, str_buf + strlen(str_buf), sizeof(str_buf) - strlen(str_buf));
-    info = storage_open_prefix(str_buf, "r");
-    if (!info)
-        return pae_supp;
-    // FIXME: the caller already knows the value of eui64
-    memcpy(pae_supp->sec_keys.ptk_eui_64, eui_64, 8);
-    pae_supp->sec_keys.ptk_eui_64_set = true;
     for (;;) {
         ret = storage_parse_line(info);
         if (ret == EOF)
@@ -173,6 +333,92 @@ supp_entry_t *ws_pae_key_storage_supp_read(const void *instance, const uint8_t *
             WARN("%s:%d: invalid key: '%s'", info->filename, info->linenr, info->line);
         }
     }
+}
+
+static void ws_pae_key_storage_supp_read_bin(struct storage_parse_info *info, supp_entry_t *pae_supp,
+                                             uint64_t current_time)
+{
+    sec_prot_keys_t *keys = &pae_supp->sec_keys;
+    uint8_t data[WS_PAE_KEY_STORAGE_SIZE_MAX];
+    struct iobuf_read buf = { .data = data };
+    uint8_t gtk_hash_set, lgtk_hash_set;
+    uint64_t expiration_s;
+    uint8_t flags;
+
+    buf.data_size = fread(data, 1, sizeof(data), info->file);
+    if (buf.data_size < 4 || memcmp(iobuf_pop_data_ptr(&buf, 4), WS_PAE_KEY_STORAGE_MAGIC, 4)) {
+        WARN("%s: invalid header", info->filename);
+        return;
+    }
+    flags = iobuf_pop_u8(&buf);
+    keys->node_role = iobuf_pop_u8(&buf);
+    gtk_hash_set  = iobuf_pop_u8(&buf) & (BIT(GTK_NUM) - 1);
+    lgtk_hash_set = iobuf_pop_u8(&buf) & (BIT(LGTK_NUM) - 1);
+    if (flags & WS_PAE_KEY_STORAGE_PMK) {
+        iobuf_pop_data(&buf, keys->pmk, PMK_LEN);
+        expiration_s = iobuf_pop_le64(&buf);
+        if (current_time < expiration_s)
+            keys->pmk_lifetime = expiration_s - current_time;
+        else
+            WARN("%s: expired PMK lifetime: %"PRIu64, info->filename, expiration_s);
+        keys->pmk_set = true;
+    }
+    if (flags & WS_PAE_KEY_STORAGE_PMK_REPLAY_CNT) {
+        keys->pmk_key_replay_cnt = iobuf_pop_le64(&buf);
+        keys->pmk_key_replay_cnt_set = true;
+    }
+    if (flags & WS_PAE_KEY_STORAGE_PTK) {
+        iobuf_pop_data(&buf, keys->ptk, PTK_LEN);
+        expiration_s = iobuf_pop_le64(&buf);
+        if (current_time < expiration_s)
+            keys->ptk_lifetime = expiration_s - current_time;
+        else
+            WARN("%s: expired PTK lifetime: %"PRIu64, info->filename, expiration_s);
+        keys->ptk_set = true;
+    }
+    for (int i = 0; i < GTK_NUM; i++)
+        if (gtk_hash_set & BIT(i))
+            iobuf_pop_data(&buf, keys->gtks.ins_gtk_hash[i].hash, INS_GTK_HASH_LEN);
+    for (int i = 0; i < LGTK_NUM; i++)
+        if (lgtk_hash_set & BIT(i))
+            iobuf_pop_data(&buf, keys->lgtks.ins_gtk_hash[i].hash, INS_GTK_HASH_LEN);
+    if (buf.err) {
+        WARN("%s: truncated file", info->filename);
+        keys->pmk_set = false;
+        keys->ptk_set = false;
+        return;
+    }
+    keys->gtks.ins_gtk_hash_set  = gtk_hash_set;
+    keys->lgtks.ins_gtk_hash_set = lgtk_hash_set;
+}
+
+supp_entry_t *ws_pae_key_storage_supp_read(const void *instance, const uint8_t *eui_64, sec_prot_gtk_keys_t *gtks, sec_prot_gtk_keys_t *lgtks, const sec_prot_certs_t *certs)
+{
+    supp_entry_t *pae_supp = malloc(sizeof(supp_entry_t));
+    uint64_t current_time = time_now_s(CLOCK_REALTIME);
+    struct storage_parse_info *info;
+    char str_buf[256];
+    int ret;
+
+    ws_pae_lib_supp_init(pae_supp);
+    sec_prot_keys_init(&pae_supp->sec_keys, gtks, lgtks, certs);
+    kmp_address_init(KMP_ADDR_EUI_64_AND_IP, &pae_supp->addr, eui_64);
+    strcpy(str_buf, "keys-");
+    str_key(eui_64, 8, str_buf + strlen(str_buf), sizeof(str_buf) - strlen(str_buf));
+    info = storage_open_prefix(str_buf, "r");
+    if (!info)
+        return pae_supp;
+    // FIXME: the caller already knows the value of eui64
+    memcpy(pae_supp->sec_keys.ptk_eui_64, eui_64, 8);
+    pae_supp->sec_keys.ptk_eui_64_set = true;
+    // The binary layout starts with a NUL byte
+    ret = fgetc(info->file);
+    if (ret != EOF)
+        ungetc(ret, info->file);
+    if (ret)
+        ws_pae_key_storage_supp_read_txt(info, pae_supp, current_time);
+    else
+        ws_pae_key_storage_supp_read_bin(info, pae_supp, current_time);
     storage_close(info);
     if (!pae_supp->sec_keys.pmk_lifetime)
         pae_supp->sec_keys.pmk_set = false;
@@ -185,36 +431,33 @@ supp_entry_t *ws_pae_key_storage_supp_read(const void *instance, const uint8_t *
 
 int ws_pae_key_storage_list(uint8_t eui64[][8], int len)
 {
-    char filename[PATH_MAX];
-    glob_t globbuf;
-    int i, ret;
-
     if (!g_storage_prefix) {
         WARN("storage disabled, cannot retrieve EUI64");
         return 0;
     }
-    snprintf(filename, sizeof(filename), "%skeys-*:*:*:*:*:*:*:*", g_storage_prefix);
-    ret = glob(filename, 0, NULL, &globbuf);
-    if (ret) {
-        WARN_ON(ret != GLOB_NOMATCH, "glob %s returned an error", filename);
+    ws_pae_key_index_load();
+    len = MIN(len, g_ws_pae_key_index.count);
+    memcpy(eui64, g_ws_pae_key_index.eui64, len * 8);
+    return len;
+}
+
+int ws_pae_key_storage_count(void)
+{
+    if (!g_storage_prefix)
         return 0;
-    }
-    for (i = 0; globbuf.gl_pathv[i] && i < len; i++)
-        parse_byte_array(eui64[i], 8, strrchr(globbuf.gl_pathv[i], '-') + 1);
-    globfree(&globbuf);
-    return i;
+    ws_pae_key_index_load();
+    return g_ws_pae_key_index.count;
 }
 
 bool ws_pae_key_storage_supp_exists(const uint8_t eui64[8])
 {
-    char eui64_str[STR_MAX_LEN_EUI64];
-    char filename[PATH_MAX];
-    int ret;
+    bool found;
 
-    str_eui64(eui64, eui64_str);
-    ret = snprintf(filename, sizeof(filename), "%skeys-%s", g_storage_prefix, eui64_str);
-    BUG_ON(ret >= sizeof(filename), "g_storage_prefix too big");
-    return !access(filename, F_OK);
+    if (!g_storage_prefix)
+        return false;
+    ws_pae_key_index_load();
+    ws_pae_key_index_find(eui64, &found);
+    return found;
 }
 
 uint16_t ws_pae_key_storage_storing_interval_get(void)
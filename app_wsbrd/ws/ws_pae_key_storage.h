@@ -29,6 +29,10 @@
 // Interval to check if storage has been modified and needs to be updated to NVM
 #define DEFAULT_STORING_INTERVAL                   3600
 
+// Write the keys-<eui64> files in a binary layout, about 3 times smaller and
+// faster to parse than the text one. Both layouts are read.
+extern bool g_ws_pae_key_storage_binary;
+
 struct supp_entry;
 struct sec_prot_gtk_keys;
 struct sec_prot_certs;
@@ -79,6 +83,7 @@ bool ws_pae_key_storage_supp_delete(const void *instance, const uint8_t *eui64);
 uint16_t ws_pae_key_storage_storing_interval_get(void);
 
 int ws_pae_key_storage_list(uint8_t eui64[][8], int len);
+int ws_pae_key_storage_count(void);
 bool ws_pae_key_storage_supp_exists(const uint8_t eui64[8]);
 
 #endif
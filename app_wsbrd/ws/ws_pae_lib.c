@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include "common/log_legacy.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/ns_list.h"
 
 #include "net/timers.h"
@@ -35,6 +37,9 @@
 
 #include "ws/ws_pae_lib.h"
 
+// Duration of a tick of ws_pae_lib_supp_timer_update()
+#define SUPP_TICK_MS 100
+
 #define TRACE_GROUP "wspl"
 
 void ws_pae_lib_kmp_list_init(kmp_list_t *kmp_list)
@@ -162,6 +167,40 @@ void ws_pae_lib_supp_list_init(supp_list_t *supp_list)
     ns_list_init(supp_list);
 }
 
+static struct supp_hash_list *ws_pae_lib_supp_bucket(const supp_index_t *index, const uint8_t *eui_64)
+{
+    uint64_t key;
+
+    // Same as ws_neigh_bucket()
+    memcpy(&key, eui_64, sizeof(key));
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return (struct supp_hash_list *)&index->hash[key >> (64 - SUPP_INDEX_HASH_BITS)];
+}
+
+void ws_pae_lib_supp_index_init(supp_index_t *index)
+{
+    for (int i = 0; i < ARRAY_SIZE(index->hash); i++)
+        LIST_INIT(&index->hash[i]);
+}
+
+void ws_pae_lib_supp_index_add(supp_index_t *index, supp_entry_t *entry)
+{
+    if (entry->indexed)
+        return;
+    LIST_INSERT_HEAD(ws_pae_lib_supp_bucket(index, entry->addr.eui_64), entry, hash_link);
+    entry->indexed = true;
+}
+
+supp_entry_t *ws_pae_lib_supp_index_get(const supp_index_t *index, const uint8_t *eui_64)
+{
+    supp_entry_t *entry;
+
+    LIST_FOREACH(entry, ws_pae_lib_supp_bucket(index, eui_64), hash_link)
+        if (!memcmp(entry->addr.eui_64, eui_64, 8))
+            return entry;
+    return NULL;
+}
+
 supp_entry_t *ws_pae_lib_supp_list_add(supp_list_t *supp_list, const kmp_addr_t *addr)
 {
     supp_entry_t *entry = malloc(sizeof(supp_entry_t));
@@ -183,6 +222,12 @@ supp_entry_t *ws_pae_lib_supp_list_add(supp_list_t *supp_list, const kmp_addr_t
 int8_t ws_pae_lib_supp_list_remove(void *instance, supp_list_t *supp_list, supp_entry_t *supp, ws_pae_lib_supp_deleted supp_deleted)
 {
     ns_list_remove(supp_list, supp);
+    if (supp->indexed)
+        LIST_REMOVE(supp, hash_link);
+    if (supp->busy)
+        LIST_REMOVE(supp, busy_link);
+    if (supp->idle_timer.expire_ms)
+        timer_stop(supp->idle_timer.group, &supp->idle_timer);
 
     ws_pae_lib_supp_delete(supp);
 
@@ -206,30 +251,80 @@ supp_entry_t *ws_pae_lib_supp_list_entry_eui_64_get(const supp_list_t *supp_list
     return 0;
 }
 
-bool ws_pae_lib_supp_list_timer_update(void *instance, supp_list_t *active_supp_list, uint16_t ticks, ws_pae_lib_kmp_timer_timeout timeout, ws_pae_lib_supp_deleted supp_deleted)
+static bool ws_pae_lib_kmp_timer_running(kmp_list_t *kmp_list)
 {
-    bool timer_running = false;
+    kmp_entry_t *entry = ns_list_get_first(kmp_list);
 
-    ns_list_foreach_safe(supp_entry_t, entry, active_supp_list) {
-        bool running = ws_pae_lib_supp_timer_update(instance, entry, ticks, timeout);
-        if (running) {
-            timer_running = true;
-        } else {
-            ws_pae_lib_supp_list_to_inactive(instance, active_supp_list, entry, supp_deleted);
+    // KMPs with timer running are kept first, see ws_pae_lib_kmp_timer_start()
+    return entry && entry->timer_running;
+}
+
+bool ws_pae_lib_supp_busy_list_timer_update(void *instance, supp_busy_list_t *busy_list, struct timer_group *group,
+                                            uint16_t ticks, ws_pae_lib_kmp_timer_timeout timeout,
+                                            ws_pae_lib_supp_expired supp_expired)
+{
+    supp_entry_t *entry, *tmp;
+
+    LIST_FOREACH_SAFE(entry, busy_list, busy_link, tmp) {
+        if (!ws_pae_lib_supp_timer_update(instance, entry, ticks, timeout)) {
+            supp_expired(instance, entry);
+        } else if (!ws_pae_lib_kmp_timer_running(&entry->kmp_list)) {
+            LIST_REMOVE(entry, busy_link);
+            entry->busy = false;
+            entry->idle_sync_ms = time_now_ms(CLOCK_MONOTONIC);
+            ws_pae_lib_supp_idle_timer_start(group, entry);
         }
     }
 
-    return timer_running;
+    return !LIST_EMPTY(busy_list);
+}
+
+void ws_pae_lib_supp_to_busy(void *instance, supp_busy_list_t *busy_list, supp_entry_t *entry)
+{
+    if (entry->busy)
+        return;
+    ws_pae_lib_supp_idle_update(instance, entry);
+    if (entry->idle_timer.expire_ms)
+        timer_stop(entry->idle_timer.group, &entry->idle_timer);
+    LIST_INSERT_HEAD(busy_list, entry, busy_link);
+    entry->busy = true;
+}
+
+bool ws_pae_lib_supp_idle_update(void *instance, supp_entry_t *entry)
+{
+    uint64_t elapsed;
+
+    if (entry->busy)
+        return true;
+    // Without KMP timers running, updating the timers all at once is
+    // equivalent to updating them on every tick.
+    elapsed = (time_now_ms(CLOCK_MONOTONIC) - entry->idle_sync_ms) / SUPP_TICK_MS;
+    elapsed = MIN(elapsed, UINT16_MAX);
+    entry->idle_sync_ms += elapsed * SUPP_TICK_MS;
+    return ws_pae_lib_supp_timer_update(instance, entry, elapsed, NULL);
+}
+
+void ws_pae_lib_supp_idle_timer_start(struct timer_group *group, supp_entry_t *entry)
+{
+    uint32_t ticks;
+
+    if (entry->busy)
+        return;
+    // See ws_pae_lib_supp_timer_update()
+    ticks = MAX(MAX(entry->ticks, entry->waiting_ticks), 1);
+    if (entry->store_ticks)
+        ticks = MIN(ticks, entry->store_ticks);
+    timer_start_abs(group, &entry->idle_timer, entry->idle_sync_ms + (uint64_t)ticks * SUPP_TICK_MS);
 }
 
 void ws_pae_lib_supp_list_slow_timer_update(supp_list_t *supp_list, uint16_t seconds)
 {
     ns_list_foreach(supp_entry_t, entry, supp_list) {
         if (sec_prot_keys_pmk_lifetime_decrement(&entry->sec_keys, seconds)) {
-            tr_info("PMK and PTK expired, eui-64: %s, system time: %"PRIu32"", tr_eui64(entry->addr.eui_64), g_monotonic_time_100ms / 10);
+            tr_info("PMK and PTK expired, eui-64: %s, system time: %"PRIu32"", tr_eui64(entry->addr.eui_64), ws_timer_monotonic_100ms() / 10);
         }
         if (sec_prot_keys_ptk_lifetime_decrement(&entry->sec_keys, seconds)) {
-            tr_info("PTK expired, eui-64: %s, system time: %"PRIu32"", tr_eui64(entry->addr.eui_64), g_monotonic_time_100ms / 10);
+            tr_info("PTK expired, eui-64: %s, system time: %"PRIu32"", tr_eui64(entry->addr.eui_64), ws_timer_monotonic_100ms() / 10);
         }
     }
 }
@@ -244,6 +339,11 @@ void ws_pae_lib_supp_init(supp_entry_t *entry)
     entry->store_ticks = ws_pae_key_storage_storing_interval_get() * 1000;
     entry->active = true;
     entry->access_revoked = false;
+    entry->waiting = false;
+    entry->indexed = false;
+    entry->busy = false;
+    memset(&entry->idle_timer, 0, sizeof(entry->idle_timer));
+    entry->idle_sync_ms = time_now_ms(CLOCK_MONOTONIC);
 }
 
 void ws_pae_lib_supp_delete(supp_entry_t *entry)
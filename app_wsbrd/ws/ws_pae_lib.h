@@ -19,6 +19,8 @@
 #ifndef WS_PAE_LIB_H_
 #define WS_PAE_LIB_H_
 #include "common/ns_list.h"
+#include "common/sys_queue_extra.h"
+#include "common/timer.h"
 
 #include "security/kmp/kmp_api.h"
 #include "security/kmp/kmp_addr.h"
@@ -36,20 +38,55 @@ typedef struct kmp_entry {
 
 typedef NS_LIST_HEAD(kmp_entry_t, link) kmp_list_t;
 
+/*
+ * Only the supplicants with an ongoing exchange (active or waiting list) have
+ * an entry in memory. Once inactive, a supplicant is only kept in the key
+ * storage (keys-<eui64> files, see ws_pae_key_storage.h), and is read back
+ * when it sends an EAPOL frame again. The number of known supplicants is then
+ * only bounded by the storage, active_supp_max bounds the memory.
+ */
 typedef struct supp_entry {
     kmp_list_t kmp_list;               /**< Ongoing KMP negotiations */
     kmp_addr_t addr;                   /**< EUI-64 (Relay IP address, Relay port) */
-    sec_prot_keys_t sec_keys;          /**< Security keys */
     uint32_t ticks;                    /**< Ticks */
+    sec_prot_keys_t sec_keys;          /**< Security keys */
     uint16_t waiting_ticks;            /**< Waiting ticks */
     uint16_t store_ticks;              /**< NVM store ticks */
     bool active : 1;                   /**< Is active */
     bool access_revoked : 1;           /**< Nodes access is revoked */
+    bool waiting : 1;                  /**< Is on the waiting list (else on the active list) */
+    bool indexed : 1;                  /**< Is in a supp_index_t */
+    bool busy : 1;                     /**< Has KMP timers running, ticked by ws_pae_lib_supp_busy_list_timer_update() */
     ns_list_link_t link;               /**< Link */
+    LIST_ENTRY(supp_entry) hash_link;  /**< Link in a supp_index_t bucket */
+    LIST_ENTRY(supp_entry) busy_link;  /**< Link in a supp_busy_list_t */
+    struct timer_entry idle_timer;     /**< Earliest expiration of the timers when not busy */
+    uint64_t idle_sync_ms;             /**< Last update of the timers when not busy */
 } supp_entry_t;
 
 typedef NS_LIST_HEAD(supp_entry_t, link) supp_list_t;
 
+#define SUPP_INDEX_HASH_BITS 10
+
+// Declare struct supp_hash_list
+LIST_HEAD(supp_hash_list, supp_entry);
+
+/*
+ * Index of the supplicants by EUI-64. Supplicants are indexed while they are
+ * on the active or the waiting list.
+ */
+typedef struct supp_index {
+    struct supp_hash_list hash[1 << SUPP_INDEX_HASH_BITS];
+} supp_index_t;
+
+/*
+ * Supplicants which have KMP timers running. Only those need to be updated on
+ * every tick, the timers of the others are updated lazily, see
+ * ws_pae_lib_supp_idle_update().
+ */
+LIST_HEAD(supp_busy_list, supp_entry);
+typedef struct supp_busy_list supp_busy_list_t;
+
 typedef struct shared_comp_entry {
     kmp_shared_comp_t *data;           /**< KMP shared component data */
     ns_list_link_t link;               /**< Link */
@@ -183,6 +220,35 @@ bool ws_pae_lib_kmp_timer_update(kmp_list_t *kmp_list, uint16_t ticks, ws_pae_li
  */
 void ws_pae_lib_supp_list_init(supp_list_t *supp_list);
 
+/**
+ *  ws_pae_lib_supp_index_init initializes supplicant index
+ *
+ * \param index supplicant index
+ *
+ */
+void ws_pae_lib_supp_index_init(supp_index_t *index);
+
+/**
+ *  ws_pae_lib_supp_index_add adds entry to supplicant index, does nothing if
+ *  the entry is already indexed. Entries are removed from the index by
+ *  ws_pae_lib_supp_list_remove().
+ *
+ * \param index supplicant index
+ * \param entry supplicant entry
+ *
+ */
+void ws_pae_lib_supp_index_add(supp_index_t *index, supp_entry_t *entry);
+
+/**
+ *  ws_pae_lib_supp_index_get gets entry from supplicant index
+ *
+ * \param index supplicant index
+ * \param eui_64 EUI-64
+ *
+ * \return supplicant entry or NULL if not found
+ */
+supp_entry_t *ws_pae_lib_supp_index_get(const supp_index_t *index, const uint8_t *eui_64);
+
 /**
  *  ws_pae_lib_supp_list_add adds entry to supplicant list
  *
@@ -202,6 +268,15 @@ supp_entry_t *ws_pae_lib_supp_list_add(supp_list_t *supp_list, const kmp_addr_t
  */
 typedef void ws_pae_lib_supp_deleted(void *instance);
 
+/**
+ * ws_pae_lib_supp_expired supplicant timers expired callback
+ *
+ * \param instance Instance
+ * \param entry supplicant entry, expected to be moved to inactive
+ *
+ */
+typedef void ws_pae_lib_supp_expired(void *instance, supp_entry_t *entry);
+
 /**
  *  ws_pae_lib_supp_list_add removes entry from supplicant list
  *
@@ -227,19 +302,59 @@ int8_t ws_pae_lib_supp_list_remove(void *instance, supp_list_t *supp_list, supp_
 supp_entry_t *ws_pae_lib_supp_list_entry_eui_64_get(const supp_list_t *supp_list, const uint8_t *eui_64);
 
 /**
- *  ws_pae_lib_supp_list_timer_update updates timers on supplicant list
+ *  ws_pae_lib_supp_busy_list_timer_update updates timers of busy supplicants,
+ *  the ones which no longer have KMP timers running become idle
  *
  * \param instance Instance
- * \param active_supp_list list of active supplicants
- * \param inactive_supp_list list of inactive supplicants
+ * \param busy_list list of busy supplicants
+ * \param group timer group of the idle timers
  * \param ticks timer ticks
  * \param timeout callback to call on timeout
- * \param supp_deleted callback to call on supplicant delete
+ * \param supp_expired callback to call when supplicant timers expire
  *
  * \return true timer needs still to be running
  * \return false timer can be stopped
  */
-bool ws_pae_lib_supp_list_timer_update(void *instance, supp_list_t *active_supp_list, uint16_t ticks, ws_pae_lib_kmp_timer_timeout timeout, ws_pae_lib_supp_deleted supp_deleted);
+bool ws_pae_lib_supp_busy_list_timer_update(void *instance, supp_busy_list_t *busy_list, struct timer_group *group,
+                                            uint16_t ticks, ws_pae_lib_kmp_timer_timeout timeout,
+                                            ws_pae_lib_supp_expired supp_expired);
+
+/**
+ *  ws_pae_lib_supp_to_busy moves supplicant to the list of busy supplicants,
+ *  to be called when a KMP timer starts
+ *
+ * \param instance Instance
+ * \param busy_list list of busy supplicants
+ * \param entry supplicant entry
+ *
+ */
+void ws_pae_lib_supp_to_busy(void *instance, supp_busy_list_t *busy_list, supp_entry_t *entry);
+
+/**
+ *  ws_pae_lib_supp_idle_update updates the timers of an idle supplicant with
+ *  the time elapsed since the last update. Must be called before modifying
+ *  the timers of a supplicant, ws_pae_lib_supp_idle_timer_start() must be
+ *  called after.
+ *
+ * \param instance Instance
+ * \param entry supplicant entry
+ *
+ * \return true timer needs still to be running
+ * \return false supplicant timers have expired
+ */
+bool ws_pae_lib_supp_idle_update(void *instance, supp_entry_t *entry);
+
+/**
+ *  ws_pae_lib_supp_idle_timer_start (re)starts the timer of an idle
+ *  supplicant on the earliest expiration of its timers, does nothing if the
+ *  supplicant is busy. The callback of entry->idle_timer is expected to call
+ *  ws_pae_lib_supp_idle_update().
+ *
+ * \param group timer group
+ * \param entry supplicant entry
+ *
+ */
+void ws_pae_lib_supp_idle_timer_start(struct timer_group *group, supp_entry_t *entry);
 
 /**
  *  ws_pae_lib_supp_list_slow_timer_update updates slow timer on supplicant list
@@ -26,8 +26,9 @@
 
 #include "ws_pan_info_storage.h"
 
-// If PAN version lifetime would be 10 minutes, 1000 increments is about 7 days
-// i.e. storage must be written at least once a week
+// Files written by older versions hold the current PAN version instead of
+// the reserved one. If PAN version lifetime would be 10 minutes, 1000
+// increments is about 7 days i.e. storage must be written at least once a week
 #define PAN_VERSION_STORAGE_READ_INCREMENT    1000
 #define LFN_VERSION_STORAGE_READ_INCREMENT    1000
 
@@ -49,6 +50,10 @@ void ws_pan_info_storage_read(int *bsi, int *pan_id, uint16_t *pan_version, uint
             *bsi = strtoul(info->value, NULL, 0);
         } else if (!fnmatch("pan_id", info->key, 0)) {
             *pan_id = strtoul(info->value, NULL, 0);
+        } else if (!fnmatch("pan_version_max", info->key, 0)) {
+            *pan_version = strtoul(info->value, NULL, 0) + 1;
+        } else if (!fnmatch("lfn_version_max", info->key, 0)) {
+            *lfn_version = strtoul(info->value, NULL, 0) + 1;
         } else if (!fnmatch("pan_version", info->key, 0)) {
             *pan_version = strtoul(info->value, NULL, 0) + PAN_VERSION_STORAGE_READ_INCREMENT;
         } else if (!fnmatch("lfn_version", info->key, 0)) {
@@ -65,7 +70,7 @@ void ws_pan_info_storage_read(int *bsi, int *pan_id, uint16_t *pan_version, uint
     storage_close(info);
 }
 
-void ws_pan_info_storage_write(uint16_t bsi, uint16_t pan_id, uint16_t pan_version, uint16_t lfn_version,
+void ws_pan_info_storage_write(uint16_t bsi, uint16_t pan_id, uint16_t pan_version_max, uint16_t lfn_version_max,
                                const char network_name[33])
 {
     struct storage_parse_info *info = storage_open_prefix("br-info", "w");
@@ -76,8 +81,8 @@ void ws_pan_info_storage_write(uint16_t bsi, uint16_t pan_id, uint16_t pan_versi
     fprintf(info->file, "api_version = %#08x\n", version_daemon_api);
     fprintf(info->file, "bsi = %d\n", bsi);
     fprintf(info->file, "pan_id = %#04x\n", pan_id);
-    fprintf(info->file, "pan_version = %d\n", pan_version);
-    fprintf(info->file, "lfn_version = %d\n", lfn_version);
+    fprintf(info->file, "pan_version_max = %d\n", pan_version_max);
+    fprintf(info->file, "lfn_version_max = %d\n", lfn_version_max);
     str_bytes(network_name, strlen(network_name), NULL, str_buf, sizeof(str_buf), FMT_ASCII_ALNUM);
     fprintf(info->file, "network_name = %s\n", str_buf);
     storage_close(info);
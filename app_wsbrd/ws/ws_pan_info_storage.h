@@ -21,7 +21,9 @@
 
 #include <stdint.h>
 
+// The storage holds the highest PAN and LFN versions reserved, the versions
+// read are the first ones above the reservation.
 void ws_pan_info_storage_read(int *bsi, int *pan_id, uint16_t *pan_version, uint16_t *lfn_version, char network_name[33]);
-void ws_pan_info_storage_write(uint16_t bsi, uint16_t pan_id, uint16_t pan_version, uint16_t lfn_version, const char network_name[33]);
+void ws_pan_info_storage_write(uint16_t bsi, uint16_t pan_id, uint16_t pan_version_max, uint16_t lfn_version_max, const char network_name[33]);
 
 #endif
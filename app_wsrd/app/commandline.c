@@ -49,6 +49,11 @@ static const struct number_limit valid_uc_dwell_interval = {
     15, 255
 };
 
+// A single handshake runs at a time
+static const struct number_limit valid_tls_workers = {
+    0, 1
+};
+
 void print_help(FILE *stream) {
     fprintf(stream, "\n");
     fprintf(stream, "Start Wi-SUN router\n");
@@ -78,11 +83,13 @@ void parse_commandline(struct wsrd_conf *config, int argc, char *argv[])
         { "uart_device",                   config->rcp_cfg.uart_dev,               conf_set_string,      (void *)sizeof(config->rcp_cfg.uart_dev) },
         { "uart_baudrate",                 &config->rcp_cfg.uart_baudrate,         conf_set_number,      NULL },
         { "uart_rtscts",                   &config->rcp_cfg.uart_rtscts,           conf_set_bool,        NULL },
+        { "uart_thread",                   &config->rcp_cfg.uart_thread,           conf_set_bool,        NULL },
         { "cpc_instance",                  config->rcp_cfg.cpc_instance,           conf_set_string,      (void *)sizeof(config->rcp_cfg.cpc_instance) },
         { "tun_device",                    config->tun_dev,                           conf_set_string,      (void *)sizeof(config->tun_dev) },
         { "tun_autoconf",                  &config->tun_autoconf,                     conf_set_bool,        NULL },
         { "user",                          config->user,                              conf_set_string,      (void *)sizeof(config->user) },
         { "group",                         config->group,                             conf_set_string,      (void *)sizeof(config->group) },
+        { "storage_prefix",                config->storage_prefix,                    conf_set_string,      (void *)sizeof(config->storage_prefix) },
         { "network_name",                  config->ws_netname,                        conf_set_string,      (void *)sizeof(config->ws_netname) },
         { "domain",                        &config->ws_domain,                        conf_set_enum,        &valid_ws_domains },
         { "mode",                          &config->ws_mode,                          conf_set_enum_int_hex, &valid_ws_modes },
@@ -97,12 +104,17 @@ void parse_commandline(struct wsrd_conf *config, int argc, char *argv[])
         { "tx_power",                      &config->tx_power,                         conf_set_number,      &valid_int8 },
         { "trace",                         &g_enabled_traces,                         conf_add_flags,       &valid_traces },
         { "color_output",                  &config->color_output,                     conf_set_enum,        &valid_tristate },
+        { "log_journal",                   &config->log_journal,                      conf_set_bool,        NULL },
+        { "crypto_backend",                &config->crypto_backend,                   conf_set_enum,        &valid_crypto_backends },
+        { "tls_workers",                   &config->tls_workers,                      conf_set_number,      &valid_tls_workers },
         { "authority",                     &config->ca_cert,                          conf_set_pem,         NULL },
         { "certificate",                   &config->cert,                             conf_set_pem,         NULL },
         { "key",                           &config->key,                              conf_set_pem,         NULL },
         { "disc_imin",                     &config->disc_cfg.Imin_ms,                 conf_set_ms_from_s,   NULL },
         { "disc_imax",                     &config->disc_cfg.Imax_ms,                 conf_set_ms_from_s,   NULL },
         { "disc_k",                        &config->disc_cfg.k,                       conf_set_number,      &valid_positive },
+        { "rpl_multipath_threshold",       &config->rpl_multipath_threshold,          conf_set_number,      &valid_unsigned },
+        { "rpl_dio_dense_neighbors",       &config->rpl_dio_dense_neighbors,          conf_set_number,      &valid_unsigned },
         { "mac_address",                   &config->ws_mac_address,                   conf_set_array,       (void *)sizeof(config->ws_mac_address) },
         { }
     };
@@ -220,4 +232,6 @@ void parse_commandline(struct wsrd_conf *config, int argc, char *argv[])
         FATAL(1, "invalid \"disc_imax\" parameter");
     if (config->disc_cfg.Imin_ms >= config->disc_cfg.Imax_ms)
         FATAL(1, "inconsistent disc_imin and disc_imax values (disc_imin >= disc_imax)");
+    if (config->storage_prefix[0] && !config->list_rf_configs && storage_check_access(config->storage_prefix))
+        FATAL(1, "%s: %m", config->storage_prefix);
 }
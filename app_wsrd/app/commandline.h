@@ -34,6 +34,7 @@ struct wsrd_conf {
     bool tun_autoconf;
     char user[LOGIN_NAME_MAX];
     char group[LOGIN_NAME_MAX];
+    char storage_prefix[PATH_MAX];
 
     struct trickle_cfg disc_cfg;
 
@@ -54,10 +55,16 @@ struct wsrd_conf {
 
     int  ws_uc_dwell_interval_ms;
 
+    int  rpl_multipath_threshold;
+    int  rpl_dio_dense_neighbors;
+
     struct eui64 ws_mac_address;
 
     bool list_rf_configs;
     int  color_output;
+    bool log_journal;
+    int  crypto_backend;
+    int  tls_workers;
 };
 
 void parse_commandline(struct wsrd_conf *config, int argc, char *argv[]);
@@ -93,6 +93,21 @@ static int dbus_get_primary_parent(sd_bus *bus, const char *path, const char *in
     return 0;
 }
 
+static int dbus_get_rpl_dio_stats(sd_bus *bus, const char *path, const char *interface,
+                                  const char *property, sd_bus_message *reply,
+                                  void *userdata, sd_bus_error *ret_error)
+{
+    struct rpl_ctx *rpl = userdata;
+
+    sd_bus_message_append(reply, "(ttttu)",
+                          rpl->dio_stats.intervals,
+                          rpl->dio_stats.tx,
+                          rpl->dio_stats.rx_consistent,
+                          rpl->dio_stats.rx_inconsistent,
+                          rpl->dio_neigh_count);
+    return 0;
+}
+
 static int dbus_get_pan_version(sd_bus *bus, const char *path, const char *interface,
                                 const char *property, sd_bus_message *reply,
                                 void *userdata, sd_bus_error *ret_error)
@@ -149,5 +164,6 @@ const struct sd_bus_vtable wsrd_dbus_vtable[] = {
     SD_BUS_PROPERTY("PanVersion",    "q",   dbus_get_pan_version,    offsetof(struct wsrd, ws.pan_version), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
     SD_BUS_PROPERTY("PrimaryParent", "ay",  dbus_get_primary_parent, offsetof(struct wsrd, ipv6),           SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
     SD_BUS_PROPERTY("DodagId",       "ay",  dbus_get_dodag_id,       offsetof(struct wsrd, ipv6),           0),
+    SD_BUS_PROPERTY("RplDioStats",   "(ttttu)", dbus_get_rpl_dio_stats, offsetof(struct wsrd, ipv6.rpl),   0),
     SD_BUS_VTABLE_END,
 };
@@ -37,6 +37,7 @@
 #include "app_wsrd/ipv6/6lowpan.h"
 #include "app_wsrd/ipv6/ipv6_addr_mc.h"
 #include "app_wsrd/app/wsrd.h"
+#include "app_wsrd/app/wsrd_storage.h"
 
 #include "ws.h"
 
@@ -180,6 +181,10 @@ void ws_recv_pa(struct wsrd *wsrd, struct ws_ind *ind)
 
     // TODO: POM-IE
 
+    if (wsrd->ws.pan_id == ind->hdr.pan_id && wsrd->pan_size != ie_pan.pan_size) {
+        wsrd->pan_size = ie_pan.pan_size;
+        wsrd_dhcp_update_delay(wsrd);
+    }
     if (!memcmp(&wsrd->eapol_target_eui64, &ieee802154_addr_bc, 8))
         ws_eapol_target_add(wsrd, ind, &ie_pan, &ie_jm);
 }
@@ -282,6 +287,10 @@ static void ws_recv_pc(struct wsrd *wsrd, struct ws_ind *ind)
      * is more likely to leak than the PTK, and authenticator packets are
      * secured using the PTK.
      */
+    // The EAPOL target restored by wsrd_resume() may have left meanwhile
+    if (wsrd->ws.pan_version < 0 && !timer_stopped(&wsrd->resume_timer) &&
+        !ws_neigh_get(&wsrd->ws.neigh_table, wsrd->eapol_target_eui64.u8))
+        memcpy(&wsrd->eapol_target_eui64, ind->neigh->mac64, 8);
     for (int i = 0; i < ARRAY_SIZE(gtkhash); i++)
         if (supp_gtkhash_mismatch(&wsrd->supp, gtkhash[i], i + 1))
             supp_start_key_request(&wsrd->supp);
@@ -490,6 +499,12 @@ void ws_on_recv_cnf(struct ws_ctx *ws, struct ws_frame_ctx *frame_ctx, const str
 
     if (frame_ctx->type == WS_FT_DATA)
         ipv6_nud_confirm_ns(&wsrd->ipv6, cnf->handle, cnf->status == HIF_STATUS_SUCCESS);
+    // The RCP owns the frame counter, it is only stored for wsrd_storage_load()
+    if (cnf->frame_counter > wsrd->tx_frame_counter) {
+        wsrd->tx_frame_counter = cnf->frame_counter;
+        if (wsrd->tx_frame_counter - wsrd->tx_frame_counter_saved >= WSRD_STORAGE_FRAME_COUNTER_STEP)
+            wsrd_storage_save(wsrd);
+    }
 }
 
 void ws_on_send_pas(struct trickle *tkl)
@@ -12,7 +12,6 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _GNU_SOURCE
-#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -21,38 +20,40 @@
 #include "app_wsrd/ipv6/ipv6_addr_mc.h"
 #include "app_wsrd/app/dbus.h"
 #include "app_wsrd/app/ws.h"
+#include "app_wsrd/app/wsrd_storage.h"
 #include "app_wsrd/ipv6/rpl.h"
 #include "common/ws/eapol_relay.h"
 #include "common/ws/ws_regdb.h"
 #include "common/ipv6/ipv6_addr.h"
+#include "common/specs/dhcpv6.h"
+#include "common/key_value_storage.h"
+#include "common/crypto/nist_kw.h"
 #include "common/crypto/ws_keys.h"
 #include "common/mbedtls_config_check.h"
 #include "common/drop_privileges.h"
 #include "common/bits.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
 #include "common/pktbuf.h"
 #include "common/ieee802154_frame.h"
 #include "common/string_extra.h"
+#include "common/time_extra.h"
 #include "common/rail_config.h"
 #include "common/version.h"
 #include "common/dbus.h"
 #include "wsrd.h"
 
-enum {
-    POLLFD_RCP,
-    POLLFD_TIMER,
-    POLLFD_TUN,
-    POLLFD_RPL,
-    POLLFD_DHCP,
-    POLLFD_EAPOL_RELAY,
-    POLLFD_DBUS,
-    POLLFD_COUNT,
-};
+// Wi-SUN FAN 1.1v08 - 6.2.3.1.2.1.2 Global and Unique Local Addresses
+#define WSRD_DHCP_SOL_MAX_DELAY_S      60
+// Arbitrary, see wsrd_dhcp_update_delay()
+#define WSRD_DHCP_SOLICIT_RATE         10
+#define WSRD_DHCP_SOL_MAX_DELAY_CAP_S 900
 
 static void wsrd_on_rcp_reset(struct rcp *rcp);
 static void wsrd_on_etx_outdated(struct ws_neigh_table *table, struct ws_neigh *neigh);
 static void wsrd_on_etx_update(struct ws_neigh_table *table, struct ws_neigh *neigh);
+static void wsrd_on_neigh_del(struct ws_neigh_table *table, struct ws_neigh *neigh);
 static int wsrd_ipv6_sendto_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf, const uint8_t dst[8]);
 static void wsrd_eapol_sendto_mac(struct supp_ctx *supp, uint8_t kmp_id, const void *pkt,
                                   size_t pkt_len, const uint8_t dst[8]);
@@ -63,6 +64,7 @@ static void wsrd_on_pref_parent_change(struct rpl_mrhof *mrhof, struct ipv6_neig
 static void wsrd_on_dhcp_addr_add(struct dhcp_client *client);
 static void wsrd_on_dhcp_addr_del(struct dhcp_client *client);
 static struct in6_addr wsrd_dhcp_get_dst(struct dhcp_client *client);
+static void wsrd_resume_timer_timeout(struct timer_group *group, struct timer_entry *timer);
 
 struct wsrd g_wsrd = {
     .ws.rcp.bus.fd = -1,
@@ -74,11 +76,13 @@ struct wsrd g_wsrd = {
     .ws.pan_version = -1,
     .ws.neigh_table.on_etx_outdated = wsrd_on_etx_outdated,
     .ws.neigh_table.on_etx_update   = wsrd_on_etx_update,
+    .ws.neigh_table.on_del          = wsrd_on_neigh_del,
     .ws.on_recv_ind                 = ws_on_recv_ind,
     .ws.on_recv_cnf                 = ws_on_recv_cnf,
     .ws.eapol_relay_fd = -1,
     .ipv6.sendto_mac = wsrd_ipv6_sendto_mac,
     .eapol_target_eui64 = IEEE802154_ADDR_BC_INIT,
+    .resume_timer.callback = wsrd_resume_timer_timeout,
 
     // Wi-SUN FAN 1.1v08 - 6.5.2.1.1 SUP Operation
     .supp.key_request_txalg.irt_s       =  300, //  5 * 60
@@ -137,7 +141,7 @@ struct wsrd g_wsrd = {
     .ipv6.rpl.mrhof.on_pref_parent_change = wsrd_on_pref_parent_change,
 
     // Wi-SUN FAN 1.1v08 - 6.2.3.1.2.1.2 Global and Unique Local Addresses
-    .ipv6.dhcp.solicit_txalg.max_delay_s = 60,
+    .ipv6.dhcp.solicit_txalg.max_delay_s = WSRD_DHCP_SOL_MAX_DELAY_S,
     .ipv6.dhcp.solicit_txalg.irt_s       = 60,
     .ipv6.dhcp.solicit_txalg.mrt_s       = 3600,
     // RFC 8415 18.2.1. Creation and Transmission of Solicit Messages
@@ -200,7 +204,19 @@ static void wsrd_on_etx_update(struct ws_neigh_table *table, struct ws_neigh *ne
     nce = ipv6_neigh_get_from_eui64(&wsrd->ipv6, neigh->mac64);
     if (!nce || !nce->rpl)
         return;
-    rpl_mrhof_select_parent(&wsrd->ipv6);
+    rpl_mrhof_update(&wsrd->ipv6, nce);
+}
+
+static void wsrd_on_neigh_del(struct ws_neigh_table *table, struct ws_neigh *neigh)
+{
+    struct wsrd *wsrd = container_of(table, struct wsrd, ws.neigh_table);
+    struct ipv6_neigh *nce;
+
+    // The ETX of this neighbor is now unknown
+    nce = ipv6_neigh_get_from_eui64(&wsrd->ipv6, neigh->mac64);
+    if (!nce || !nce->rpl)
+        return;
+    rpl_mrhof_update(&wsrd->ipv6, nce);
 }
 
 static int wsrd_ipv6_sendto_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf, const uint8_t dst[8])
@@ -227,6 +243,7 @@ static void wsrd_eapol_on_gtk_change(struct supp_ctx *supp, const uint8_t gtk[16
         rcp_set_sec_key(&wsrd->ws.rcp, index, NULL, 0);
     }
     dbus_emit_change("Gaks");
+    wsrd_storage_save(wsrd);
 }
 
 static void wsrd_eapol_on_failure(struct supp_ctx *supp)
@@ -252,12 +269,61 @@ static uint8_t *wsrd_eapol_get_target(struct supp_ctx *supp)
     return wsrd->eapol_target_eui64.u8;
 }
 
+/*
+ * After a border router restart, every router solicits at once. The Solicits
+ * of the PAN are spread over WSRD_DHCP_SOLICIT_RATE transmissions per second,
+ * a Solicit from DAGRank n costing about n transmissions (and as many for the
+ * Reply). Only SOL_MAX_DELAY is scaled, the retransmissions already back off
+ * exponentially. The delay also applies to renewals.
+ */
+void wsrd_dhcp_update_delay(struct wsrd *wsrd)
+{
+    struct ipv6_neigh *parent = rpl_neigh_pref_parent(&wsrd->ipv6);
+    uint16_t min_hop_rank_inc;
+    int hops = 1;
+
+    if (parent) {
+        min_hop_rank_inc = ntohs(parent->rpl->config.min_hop_rank_inc);
+        if (min_hop_rank_inc)
+            hops = MAX(1, rpl_mrhof_rank(&wsrd->ipv6) / min_hop_rank_inc);
+    }
+    wsrd->ipv6.dhcp.solicit_txalg.max_delay_s = MIN(MAX(WSRD_DHCP_SOL_MAX_DELAY_S,
+                                                        wsrd->pan_size * hops / WSRD_DHCP_SOLICIT_RATE),
+                                                    WSRD_DHCP_SOL_MAX_DELAY_CAP_S);
+}
+
+static uint32_t wsrd_dhcp_lease_remaining_s(uint64_t expire_s, uint64_t now_s)
+{
+    if (expire_s == UINT64_MAX)
+        return DHCPV6_LIFETIME_INFINITE;
+    return expire_s > now_s ? MIN(expire_s - now_s, DHCPV6_LIFETIME_INFINITE - 1) : 0;
+}
+
+// Return true if the stored DHCPv6 lease was still valid and applied.
+static bool wsrd_dhcp_resume(struct wsrd *wsrd)
+{
+    uint64_t now_s = time_now_s(CLOCK_REALTIME);
+    uint32_t valid_lifetime_s;
+
+    if (IN6_IS_ADDR_UNSPECIFIED(&wsrd->dhcp_lease.addr))
+        return false;
+    valid_lifetime_s = wsrd_dhcp_lease_remaining_s(wsrd->dhcp_lease.valid_lifetime_s, now_s);
+    if (valid_lifetime_s)
+        dhcp_client_restore(&wsrd->ipv6.dhcp, &wsrd->dhcp_lease.addr, valid_lifetime_s,
+                            wsrd_dhcp_lease_remaining_s(wsrd->dhcp_lease.preferred_lifetime_s, now_s),
+                            wsrd_dhcp_lease_remaining_s(wsrd->dhcp_lease.t1_s, now_s));
+    memset(&wsrd->dhcp_lease, 0, sizeof(wsrd->dhcp_lease));
+    return valid_lifetime_s;
+}
+
 static void wsrd_on_pref_parent_change(struct rpl_mrhof *mrhof, struct ipv6_neigh *neigh)
 {
     struct wsrd *wsrd = container_of(mrhof, struct wsrd, ipv6.rpl.mrhof);
 
+    wsrd_dhcp_update_delay(wsrd);
     if (IN6_IS_ADDR_UNSPECIFIED(&wsrd->ipv6.dhcp.iaaddr.ipv6) && !wsrd->ipv6.dhcp.running) {
-        dhcp_client_start(&wsrd->ipv6.dhcp);
+        if (!neigh || !wsrd_dhcp_resume(wsrd))
+            dhcp_client_start(&wsrd->ipv6.dhcp);
     } else if (neigh) {
         rpl_start_dao(&wsrd->ipv6);
         /*
@@ -267,8 +333,10 @@ static void wsrd_on_pref_parent_change(struct rpl_mrhof *mrhof, struct ipv6_neig
          * use that parent as the EAPOL target.
          */
         memcpy(&wsrd->eapol_target_eui64, neigh->eui64, 8);
+        wsrd_storage_save(wsrd);
     } else {
         wsrd->eapol_target_eui64 = ieee802154_addr_bc;
+        event_loop_del(&wsrd->ev_eapol_relay);
         close(wsrd->ws.eapol_relay_fd);
         wsrd->ws.eapol_relay_fd = -1;
         // TODO: handle parent loss
@@ -292,10 +360,14 @@ static void wsrd_on_dhcp_addr_add(struct dhcp_client *client)
     usleep(100000);
 
     rpl_start_dao(&wsrd->ipv6);
+    wsrd_storage_save(wsrd);
     // TODO: enable when full parenting ready
     // rpl_start_dio(&wsrd->ipv6);
+    event_loop_del(&wsrd->ev_eapol_relay);
     close(wsrd->ws.eapol_relay_fd);
     wsrd->ws.eapol_relay_fd = eapol_relay_start(wsrd->ipv6.tun.ifname);
+    wsrd->ev_eapol_relay.fd = wsrd->ws.eapol_relay_fd;
+    event_loop_add(&wsrd->ev_eapol_relay);
 }
 
 static void wsrd_on_dhcp_addr_del(struct dhcp_client *client)
@@ -392,6 +464,8 @@ static void wsrd_init_ipv6(struct wsrd *wsrd)
 
     timer_group_init(&wsrd->ipv6.timer_group);
 
+    wsrd->ipv6.rpl.mrhof.multipath_threshold = wsrd->config.rpl_multipath_threshold;
+    wsrd->ipv6.rpl.dio_dense_neigh = wsrd->config.rpl_dio_dense_neighbors;
     rpl_start(&wsrd->ipv6);
     dhcp_client_init(&wsrd->ipv6.dhcp, &wsrd->ipv6.tun, wsrd->ws.rcp.eui64.u8);
     ipv6_addr_add_mc(&wsrd->ipv6, &ipv6_addr_all_nodes_link);     // ff02::1
@@ -406,31 +480,123 @@ static void wsrd_init_ws(struct wsrd *wsrd)
 {
     strcpy(wsrd->ws.netname, wsrd->config.ws_netname);
 
-    timer_group_init(&wsrd->ws.neigh_table.timer_group);
+    ws_neigh_table_init(&wsrd->ws.neigh_table);
     trickle_init(&wsrd->pas_tkl);
     trickle_init(&wsrd->pcs_tkl);
+}
+
+static void wsrd_start_discovery(struct wsrd *wsrd)
+{
     trickle_start(&wsrd->pas_tkl);
     timer_start_rel(NULL, &wsrd->pan_selection_timer, wsrd->config.disc_cfg.Imin_ms);
 }
 
-static void wsrd_eapol_relay_recv(struct wsrd *wsrd)
+static bool wsrd_resume(struct wsrd *wsrd)
+{
+    uint8_t gak[16];
+
+    if (!wsrd_storage_load(wsrd))
+        return false;
+    INFO("resume pan_id:0x%04x eapol-target:%s", wsrd->ws.pan_id, tr_eui64(wsrd->eapol_target_eui64.u8));
+    rcp_set_filter_pan_id(&wsrd->ws.rcp, wsrd->ws.pan_id);
+    // TODO: handle LGTK
+    for (int i = 0; i < WS_GTK_COUNT; i++) {
+        if (timer_stopped(&wsrd->supp.gtks[i].expiration_timer))
+            continue;
+        ws_generate_gak(wsrd->ws.netname, wsrd->supp.gtks[i].key, gak);
+        rcp_set_sec_key(&wsrd->ws.rcp, i + 1, gak, wsrd->tx_frame_counter);
+    }
+    trickle_start(&wsrd->pcs_tkl);
+    timer_start_rel(NULL, &wsrd->resume_timer, WSRD_RESUME_TIMEOUT_MS);
+    return true;
+}
+
+static void wsrd_resume_timer_timeout(struct timer_group *group, struct timer_entry *timer)
 {
-    struct eui64 supp_eui64;
-    uint8_t buf[1500];
-    ssize_t buf_len;
-    uint8_t kmp_id;
+    struct wsrd *wsrd = container_of(timer, struct wsrd, resume_timer);
+    struct ws_gtk *gtk;
 
-    buf_len = eapol_relay_recv(wsrd->ws.eapol_relay_fd, buf, sizeof(buf),
-                               NULL, &supp_eui64, &kmp_id);
-    if (buf_len < 0)
+    if (wsrd->ws.pan_version >= 0)
         return;
-    ws_if_send_eapol(&wsrd->ws, kmp_id, buf, buf_len, &supp_eui64,
-                     (struct eui64 *)wsrd->supp.authenticator_eui64);
+    INFO("resume failed, starting PAN discovery");
+    trickle_stop(&wsrd->pcs_tkl);
+    wsrd->eapol_target_eui64 = ieee802154_addr_bc;
+    wsrd->ws.pan_id = 0xffff;
+    rcp_set_filter_pan_id(&wsrd->ws.rcp, wsrd->ws.pan_id);
+    dbus_emit_change("PanId");
+    // Also overwrites the stored state through wsrd_eapol_on_gtk_change()
+    for (int i = 0; i < ARRAY_SIZE(wsrd->supp.gtks); i++) {
+        gtk = &wsrd->supp.gtks[i];
+        if (timer_stopped(&gtk->expiration_timer))
+            continue;
+        timer_stop(&wsrd->supp.timer_group, &gtk->expiration_timer);
+        gtk->expiration_timer.callback(&wsrd->supp.timer_group, &gtk->expiration_timer);
+    }
+    supp_reset(&wsrd->supp);
+    wsrd_start_discovery(wsrd);
+}
+
+static void wsrd_eapol_relay_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsrd *wsrd = container_of(src, struct wsrd, ev_eapol_relay);
+    static struct eapol_relay_rx rx[EAPOL_RELAY_BATCH];
+    int count;
+
+    count = eapol_relay_recv_batch(wsrd->ws.eapol_relay_fd, rx);
+    for (int i = 0; i < count; i++)
+        ws_if_send_eapol(&wsrd->ws, rx[i].kmp_id, rx[i].buf, rx[i].buf_len, &rx[i].supp_eui64,
+                         (struct eui64 *)wsrd->supp.authenticator_eui64);
+}
+
+static void wsrd_rcp_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsrd *wsrd = container_of(src, struct wsrd, ev_rcp);
+
+    rcp_rx(&wsrd->ws.rcp);
+}
+
+static void wsrd_timer_recv(struct event_source *src, uint32_t revents)
+{
+    timer_process();
+}
+
+static void wsrd_tun_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsrd *wsrd = container_of(src, struct wsrd, ev_tun);
+
+    ipv6_recvfrom_tun(&wsrd->ipv6);
+}
+
+static void wsrd_rpl_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsrd *wsrd = container_of(src, struct wsrd, ev_rpl);
+
+    rpl_recv(&wsrd->ipv6);
+}
+
+static void wsrd_dhcp_recv(struct event_source *src, uint32_t revents)
+{
+    struct wsrd *wsrd = container_of(src, struct wsrd, ev_dhcp);
+
+    dhcp_client_recv(&wsrd->ipv6.dhcp);
+}
+
+static void wsrd_dbus_recv(struct event_source *src, uint32_t revents)
+{
+    dbus_process();
+}
+
+static void wsrd_event_source_add(struct event_source *src, int fd,
+                                  void (*callback)(struct event_source *src, uint32_t revents))
+{
+    src->fd       = fd;
+    src->events   = EPOLLIN;
+    src->callback = callback;
+    event_loop_add(src);
 }
 
 int wsrd_main(int argc, char *argv[])
 {
-    struct pollfd pfd[POLLFD_COUNT] = { };
     struct sigaction sigact = { };
     struct wsrd *wsrd = &g_wsrd;
     int ret;
@@ -451,8 +617,16 @@ int wsrd_main(int argc, char *argv[])
     parse_commandline(&wsrd->config, argc, argv);
     if (wsrd->config.color_output != -1)
         g_enable_color_traces = wsrd->config.color_output;
+    if (wsrd->config.log_journal) {
+        ret = log_journal_open();
+        FATAL_ON(ret < 0, 2, "log_journal: %s", strerror(-ret));
+    }
+    if (wsrd->config.storage_prefix[0])
+        g_storage_prefix = wsrd->config.storage_prefix;
 
     check_mbedtls_features();
+    ret = nist_kw_backend_set(wsrd->config.crypto_backend);
+    FATAL_ON(ret < 0, 1, "crypto_backend: %s", strerror(-ret));
 
     rcp_init(&wsrd->ws.rcp, &wsrd->config.rcp_cfg);
     if (wsrd->config.list_rf_configs) {
@@ -468,8 +642,11 @@ int wsrd_main(int argc, char *argv[])
     wsrd_init_radio(wsrd);
     wsrd_init_ws(wsrd);
     wsrd_init_ipv6(wsrd);
+    wsrd->supp.tls_workers = wsrd->config.tls_workers;
     supp_init(&wsrd->supp, &wsrd->config.ca_cert, &wsrd->config.cert, &wsrd->config.key, wsrd->ws.rcp.eui64.u8);
     supp_reset(&wsrd->supp);
+    if (!wsrd_resume(wsrd))
+        wsrd_start_discovery(wsrd);
     dbus_register("com.silabs.Wisun.Router",
                   "/com/silabs/Wisun/Router",
                   "com.silabs.Wisun.Router",
@@ -480,37 +657,17 @@ int wsrd_main(int argc, char *argv[])
 
     INFO("Wi-SUN Router successfully started");
 
-    pfd[POLLFD_RCP].fd = wsrd->ws.rcp.bus.fd;
-    pfd[POLLFD_RCP].events = POLLIN;
-    pfd[POLLFD_TIMER].fd = timer_fd();
-    pfd[POLLFD_TIMER].events = POLLIN;
-    pfd[POLLFD_TUN].fd = wsrd->ipv6.tun.fd;
-    pfd[POLLFD_TUN].events = POLLIN;
-    pfd[POLLFD_RPL].fd = wsrd->ipv6.rpl.fd;
-    pfd[POLLFD_RPL].events = POLLIN;
-    pfd[POLLFD_DHCP].fd = wsrd->ipv6.dhcp.fd;
-    pfd[POLLFD_DHCP].events = POLLIN;
-    pfd[POLLFD_DBUS].fd = dbus_get_fd();
-    pfd[POLLFD_DBUS].events = POLLIN;
-    pfd[POLLFD_EAPOL_RELAY].events = POLLIN;
+    wsrd->ev_rcp.priority = true;
+    wsrd_event_source_add(&wsrd->ev_rcp, wsrd->ws.rcp.bus.fd, wsrd_rcp_recv);
+    wsrd_event_source_add(&wsrd->ev_timer, timer_fd(), wsrd_timer_recv);
+    wsrd_event_source_add(&wsrd->ev_tun, wsrd->ipv6.tun.fd, wsrd_tun_recv);
+    wsrd_event_source_add(&wsrd->ev_rpl, wsrd->ipv6.rpl.fd, wsrd_rpl_recv);
+    wsrd_event_source_add(&wsrd->ev_dhcp, wsrd->ipv6.dhcp.fd, wsrd_dhcp_recv);
+    wsrd_event_source_add(&wsrd->ev_dbus, dbus_get_fd(), wsrd_dbus_recv);
+    // Opened once a GUA is assigned, see wsrd_on_dhcp_addr_add()
+    wsrd_event_source_add(&wsrd->ev_eapol_relay, wsrd->ws.eapol_relay_fd, wsrd_eapol_relay_recv);
     while (true) {
-        pfd[POLLFD_EAPOL_RELAY].fd = wsrd->ws.eapol_relay_fd;
-        ret = poll(pfd, POLLFD_COUNT, wsrd->ws.rcp.bus.uart.data_ready ? 0 : -1);
-        FATAL_ON(ret < 0, 2, "poll: %m");
-        if (wsrd->ws.rcp.bus.uart.data_ready ||
-            pfd[POLLFD_RCP].revents & POLLIN)
-            rcp_rx(&wsrd->ws.rcp);
-        if (pfd[POLLFD_TIMER].revents & POLLIN)
-            timer_process();
-        if (pfd[POLLFD_TUN].revents & POLLIN)
-            ipv6_recvfrom_tun(&wsrd->ipv6);
-        if (pfd[POLLFD_RPL].revents & POLLIN)
-            rpl_recv(&wsrd->ipv6);
-        if (pfd[POLLFD_DHCP].revents & POLLIN)
-            dhcp_client_recv(&wsrd->ipv6.dhcp);
-        if (pfd[POLLFD_EAPOL_RELAY].revents & POLLIN)
-            wsrd_eapol_relay_recv(wsrd);
-        if (pfd[POLLFD_DBUS].revents & POLLIN)
-            dbus_process();
+        wsrd->ev_rcp.pending = wsrd->ws.rcp.bus.uart.data_ready;
+        event_loop_run();
     }
 }
@@ -15,6 +15,7 @@
 #define WSRD_H
 
 #include "common/ws/ws_interface.h"
+#include "common/event_loop.h"
 #include "common/trickle.h"
 #include "common/timer.h"
 #include "app_wsrd/supplicant/supplicant.h"
@@ -34,12 +35,39 @@ struct wsrd {
 
     struct supp_ctx supp;
     struct eui64 eapol_target_eui64;
+    uint16_t pan_size; // From the last PAN-IE of the PAN
 
+    /*
+     * DHCPv6 lease read from the storage, applied instead of a Solicit once a
+     * parent is selected. Times are in CLOCK_REALTIME, UINT64_MAX when
+     * infinite.
+     */
+    struct {
+        struct in6_addr addr;
+        uint64_t valid_lifetime_s;
+        uint64_t preferred_lifetime_s;
+        uint64_t t1_s;
+    } dhcp_lease;
+
+    // Resume from the stored join state, see wsrd_storage.h
+    struct timer_entry resume_timer;
+    uint32_t tx_frame_counter;
+    uint32_t tx_frame_counter_saved;
+
+    struct event_source ev_rcp;
+    struct event_source ev_timer;
+    struct event_source ev_tun;
+    struct event_source ev_rpl;
+    struct event_source ev_dhcp;
+    struct event_source ev_eapol_relay;
+    struct event_source ev_dbus;
 };
 
 // Necessary for simulation and fuzzing, prefer passing a pointer when possible.
 extern struct wsrd g_wsrd;
 
 int wsrd_main(int argc, char *argv[]);
+// To be called when the PAN size or our Rank change.
+void wsrd_dhcp_update_delay(struct wsrd *wsrd);
 
 #endif
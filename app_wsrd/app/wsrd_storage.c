@@ -0,0 +1,221 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/ieee802154_frame.h"
+#include "common/key_value_storage.h"
+#include "common/memutils.h"
+#include "common/parsers.h"
+#include "common/time_extra.h"
+#include "common/log.h"
+#include "common/specs/dhcpv6.h"
+#include "common/version.h"
+#include "app_wsrd/app/wsrd.h"
+
+#include "wsrd_storage.h"
+
+static const char *wsrd_storage_gtk_name(int slot, int *index)
+{
+    if (slot < WS_GTK_COUNT) {
+        *index = slot;
+        return "gtk";
+    } else {
+        *index = slot - WS_GTK_COUNT;
+        return "lgtk";
+    }
+}
+
+void wsrd_storage_save(struct wsrd *wsrd)
+{
+    uint64_t now_s = time_now_s(CLOCK_REALTIME);
+    struct dhcp_client *dhcp = &wsrd->ipv6.dhcp;
+    struct supp_ctx *supp = &wsrd->supp;
+    struct storage_parse_info *info;
+    uint32_t lifetime_s;
+    char str_buf[256];
+    const char *name;
+    int index;
+
+    info = storage_open_prefix("router-info", "w");
+    if (!info)
+        return;
+    fprintf(info->file, "api_version = %#08x\n", version_daemon_api);
+    str_bytes(wsrd->ws.netname, strlen(wsrd->ws.netname), NULL, str_buf, sizeof(str_buf), FMT_ASCII_ALNUM);
+    fprintf(info->file, "network_name = %s\n", str_buf);
+    fprintf(info->file, "pan_id = %#04x\n", wsrd->ws.pan_id);
+    str_key(wsrd->eapol_target_eui64.u8, 8, str_buf, sizeof(str_buf));
+    fprintf(info->file, "eapol_target = %s\n", str_buf);
+    str_key(supp->authenticator_eui64, 8, str_buf, sizeof(str_buf));
+    fprintf(info->file, "authenticator = %s\n", str_buf);
+    str_key(supp->tls_client.pmk.key, sizeof(supp->tls_client.pmk.key), str_buf, sizeof(str_buf));
+    fprintf(info->file, "pmk = %s\n", str_buf);
+    fprintf(info->file, "pmk.replay_counter = %" PRId64 "\n", supp->tls_client.pmk.replay_counter);
+    str_key(supp->tls_client.ptk.key, sizeof(supp->tls_client.ptk.key), str_buf, sizeof(str_buf));
+    fprintf(info->file, "ptk = %s\n", str_buf);
+    for (int i = 0; i < ARRAY_SIZE(supp->gtks); i++) {
+        if (timer_stopped(&supp->gtks[i].expiration_timer))
+            continue;
+        name = wsrd_storage_gtk_name(i, &index);
+        str_key(supp->gtks[i].key, sizeof(supp->gtks[i].key), str_buf, sizeof(str_buf));
+        fprintf(info->file, "%s[%d] = %s\n", name, index, str_buf);
+        fprintf(info->file, "%s[%d].lifetime = %" PRIu64 "\n", name, index,
+                now_s + timer_remaining_ms(&supp->gtks[i].expiration_timer) / 1000);
+    }
+    fprintf(info->file, "frame_counter = %" PRIu32 "\n", wsrd->tx_frame_counter);
+    if (!IN6_IS_ADDR_UNSPECIFIED(&dhcp->iaaddr.ipv6)) {
+        fprintf(info->file, "dhcp_iaaddr = %s\n", str_ipv6(dhcp->iaaddr.ipv6.s6_addr, str_buf));
+        lifetime_s = dhcp_iaaddr_valid_lifetime_s(&dhcp->iaaddr);
+        if (lifetime_s != DHCPV6_LIFETIME_INFINITE)
+            fprintf(info->file, "dhcp_iaaddr.valid_lifetime = %" PRIu64 "\n", now_s + lifetime_s);
+        lifetime_s = dhcp_iaaddr_preferred_lifetime_s(&dhcp->iaaddr);
+        if (lifetime_s != DHCPV6_LIFETIME_INFINITE)
+            fprintf(info->file, "dhcp_iaaddr.preferred_lifetime = %" PRIu64 "\n", now_s + lifetime_s);
+        if (!timer_stopped(&dhcp->t1_timer))
+            fprintf(info->file, "dhcp_t1 = %" PRIu64 "\n", now_s + timer_remaining_ms(&dhcp->t1_timer) / 1000);
+    }
+    storage_close(info);
+    wsrd->tx_frame_counter_saved = wsrd->tx_frame_counter;
+}
+
+bool wsrd_storage_load(struct wsrd *wsrd)
+{
+    uint64_t now_s = time_now_s(CLOCK_REALTIME);
+    struct supp_ctx *supp = &wsrd->supp;
+    uint8_t gtks[ARRAY_SIZE(supp->gtks)][16];
+    uint64_t gtk_lifetime_s[ARRAY_SIZE(supp->gtks)] = { };
+    bool gtk_set[ARRAY_SIZE(supp->gtks)] = { };
+    char network_name[WS_NETNAME_LEN] = { };
+    struct storage_parse_info *info;
+    struct eui64 eapol_target = IEEE802154_ADDR_BC_INIT;
+    uint8_t authenticator[8] = { };
+    uint32_t frame_counter = 0;
+    int64_t pmk_replay_counter = 0;
+    bool pmk_set = false, ptk_set = false;
+    uint8_t pmk[32], ptk[48];
+    struct in6_addr dhcp_iaaddr = { };
+    uint64_t dhcp_valid_lifetime_s = UINT64_MAX;
+    uint64_t dhcp_preferred_lifetime_s = UINT64_MAX;
+    uint64_t dhcp_t1_s = UINT64_MAX;
+    int pan_id = -1;
+    int gtk_count = 0;
+    int ret;
+
+    info = storage_open_prefix("router-info", "r");
+    if (!info)
+        return false;
+    for (;;) {
+        ret = storage_parse_line(info);
+        if (ret == EOF)
+            break;
+        if (ret) {
+            WARN("%s:%d: invalid line: '%s'", info->filename, info->linenr, info->line);
+        } else if (!fnmatch("network_name", info->key, 0)) {
+            if (parse_escape_sequences(network_name, info->value, sizeof(network_name)))
+                WARN("%s:%d: parsing error (escape sequence or too long)", info->filename, info->linenr);
+        } else if (!fnmatch("pan_id", info->key, 0)) {
+            pan_id = strtoul(info->value, NULL, 0);
+        } else if (!fnmatch("eapol_target", info->key, 0)) {
+            if (parse_byte_array(eapol_target.u8, 8, info->value))
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else if (!fnmatch("authenticator", info->key, 0)) {
+            if (parse_byte_array(authenticator, 8, info->value))
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else if (!fnmatch("pmk", info->key, 0)) {
+            pmk_set = !parse_byte_array(pmk, sizeof(pmk), info->value);
+            if (!pmk_set)
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else if (!fnmatch("pmk.replay_counter", info->key, 0)) {
+            pmk_replay_counter = strtoll(info->value, NULL, 0);
+        } else if (!fnmatch("ptk", info->key, 0)) {
+            ptk_set = !parse_byte_array(ptk, sizeof(ptk), info->value);
+            if (!ptk_set)
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else if (!fnmatch("gtk\\[*]", info->key, 0) && info->key_array_index < WS_GTK_COUNT) {
+            gtk_set[info->key_array_index] = !parse_byte_array(gtks[info->key_array_index], 16, info->value);
+            if (!gtk_set[info->key_array_index])
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else if (!fnmatch("gtk\\[*].lifetime", info->key, 0) && info->key_array_index < WS_GTK_COUNT) {
+            gtk_lifetime_s[info->key_array_index] = strtoull(info->value, NULL, 0);
+        } else if (!fnmatch("lgtk\\[*]", info->key, 0) && info->key_array_index < WS_LGTK_COUNT) {
+            gtk_set[WS_GTK_COUNT + info->key_array_index] = !parse_byte_array(gtks[WS_GTK_COUNT + info->key_array_index], 16, info->value);
+            if (!gtk_set[WS_GTK_COUNT + info->key_array_index])
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else if (!fnmatch("lgtk\\[*].lifetime", info->key, 0) && info->key_array_index < WS_LGTK_COUNT) {
+            gtk_lifetime_s[WS_GTK_COUNT + info->key_array_index] = strtoull(info->value, NULL, 0);
+        } else if (!fnmatch("frame_counter", info->key, 0)) {
+            frame_counter = strtoul(info->value, NULL, 0);
+        } else if (!fnmatch("dhcp_iaaddr", info->key, 0)) {
+            if (inet_pton(AF_INET6, info->value, &dhcp_iaaddr) != 1)
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else if (!fnmatch("dhcp_iaaddr.valid_lifetime", info->key, 0)) {
+            dhcp_valid_lifetime_s = strtoull(info->value, NULL, 0);
+        } else if (!fnmatch("dhcp_iaaddr.preferred_lifetime", info->key, 0)) {
+            dhcp_preferred_lifetime_s = strtoull(info->value, NULL, 0);
+        } else if (!fnmatch("dhcp_t1", info->key, 0)) {
+            dhcp_t1_s = strtoull(info->value, NULL, 0);
+        } else if (!fnmatch("api_version", info->key, 0)) {
+            // Ignore for now
+        } else {
+            WARN("%s:%d: invalid key: '%s'", info->filename, info->linenr, info->line);
+        }
+    }
+    storage_close(info);
+
+    if (strcmp(network_name, wsrd->ws.netname)) {
+        INFO("router-info: network name changed, ignoring stored state");
+        return false;
+    }
+    if (pan_id < 0 || pan_id >= 0xffff || !pmk_set || !ptk_set ||
+        !memcmp(&eapol_target, &ieee802154_addr_bc, 8))
+        return false;
+    for (int i = 0; i < ARRAY_SIZE(supp->gtks); i++) {
+        if (gtk_set[i] && gtk_lifetime_s[i] <= now_s) {
+            TRACE(TR_SECURITY, "sec: stored %s expired", tr_gtkname(i));
+            gtk_set[i] = false;
+        }
+        if (gtk_set[i] && i < WS_GTK_COUNT)
+            gtk_count++;
+    }
+    if (!gtk_count)
+        return false;
+
+    wsrd->ws.pan_id = pan_id;
+    wsrd->eapol_target_eui64 = eapol_target;
+    memcpy(supp->authenticator_eui64, authenticator, sizeof(supp->authenticator_eui64));
+    memcpy(supp->tls_client.pmk.key, pmk, sizeof(supp->tls_client.pmk.key));
+    supp->tls_client.pmk.replay_counter = pmk_replay_counter;
+    memcpy(supp->tls_client.ptk.key, ptk, sizeof(supp->tls_client.ptk.key));
+    for (int i = 0; i < ARRAY_SIZE(supp->gtks); i++) {
+        if (!gtk_set[i])
+            continue;
+        memcpy(supp->gtks[i].key, gtks[i], sizeof(supp->gtks[i].key));
+        timer_start_rel(&supp->timer_group, &supp->gtks[i].expiration_timer,
+                        (gtk_lifetime_s[i] - now_s) * 1000);
+    }
+    // Enable the GTKHASH-IE checks, see supp_gtkhash_mismatch()
+    supp->running = true;
+    wsrd->tx_frame_counter = frame_counter + WSRD_STORAGE_FRAME_COUNTER_INCREMENT;
+    wsrd->tx_frame_counter_saved = frame_counter;
+    // Checked against the current time once a parent is selected
+    wsrd->dhcp_lease.addr                 = dhcp_iaaddr;
+    wsrd->dhcp_lease.valid_lifetime_s     = dhcp_valid_lifetime_s;
+    wsrd->dhcp_lease.preferred_lifetime_s = dhcp_preferred_lifetime_s;
+    wsrd->dhcp_lease.t1_s                 = dhcp_t1_s;
+    return true;
+}
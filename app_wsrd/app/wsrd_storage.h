@@ -0,0 +1,48 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef WSRD_STORAGE_H
+#define WSRD_STORAGE_H
+
+#include <stdbool.h>
+
+/*
+ * The join state (PAN ID, EAPOL target, PMK, PTK, GTKs and TX frame counter)
+ * is saved under storage_prefix so that wsrd can skip PAN discovery and
+ * authentication after a restart. Once restored, PAN Configuration
+ * Solicits are sent immediately: the PAN Configuration received in return
+ * proves the GTKs are still valid, and GTKHASH-IE mismatches trigger a key
+ * request authenticated by the PMK and PTK. The full join process is started
+ * if no PAN Configuration is received within WSRD_RESUME_TIMEOUT_MS.
+ *
+ * The DHCPv6 lease (address, lifetimes and T1) is saved too, and reused
+ * instead of soliciting a new address as long as it is valid.
+ */
+
+// Arbitrary, leaves room for a few PCS with the default trickle parameters
+#define WSRD_RESUME_TIMEOUT_MS (2 * 60 * 1000)
+
+// The frame counter is saved every WSRD_STORAGE_FRAME_COUNTER_STEP frames and
+// incremented by WSRD_STORAGE_FRAME_COUNTER_INCREMENT when restored, so frame
+// counters are never reused even if wsrd is killed between two writes.
+#define WSRD_STORAGE_FRAME_COUNTER_STEP      100000
+#define WSRD_STORAGE_FRAME_COUNTER_INCREMENT 1000000
+
+struct wsrd;
+
+void wsrd_storage_save(struct wsrd *wsrd);
+// Return true if a valid state was restored. Only the fields of struct wsrd
+// and struct supp_ctx are filled, the RCP is not configured.
+bool wsrd_storage_load(struct wsrd *wsrd);
+
+#endif
@@ -11,44 +11,334 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <netinet/ip6.h>
 #include <errno.h>
+#include <string.h>
+#include <time.h>
 
 #include "common/specs/6lowpan.h"
+#include "common/specs/ipv6.h"
+#include "common/specs/rpl.h"
+#include "common/ipv6/6lorh.h"
 #include "common/ipv6/6lowpan_iphc.h"
 #include "common/ipv6/ipv6_addr.h"
+#include "common/bits.h"
 #include "common/iobuf.h"
 #include "common/log.h"
+#include "common/memutils.h"
 #include "common/pktbuf.h"
+#include "common/sys_queue_extra.h"
+#include "common/time_extra.h"
 #include "app_wsrd/ipv6/ipv6.h"
+#include "app_wsrd/ipv6/rpl.h"
 #include "app_wsrd/app/ws.h"
 #include "6lowpan.h"
 
-void lowpan_recv(struct ipv6_ctx *ipv6,
-                 const uint8_t *buf, size_t buf_len,
-                 const uint8_t src[8], const uint8_t dst[8])
+/*
+ * The root of the DODAG is the reference for the compression of the first hop
+ * of SRH-6LoRHs. Returns false when the node has no parent.
+ */
+static bool lowpan_6lorh_root(struct ipv6_ctx *ipv6, struct in6_addr *root, bool *enabled)
+{
+    struct ipv6_neigh *parent = rpl_neigh_pref_parent(ipv6);
+
+    if (!parent)
+        return false;
+    *root = parent->rpl->dio.dodag_id;
+    *enabled = parent->rpl->config.flags & RPL_MASK_OPT_CONFIG_T;
+    return true;
+}
+
+/*
+ * The SRH-6LoRH is expanded into a RFC 6554 SRH without prefix elision, so
+ * that ipv6_recvfrom_mac() processes it normally. The first hop (this node)
+ * becomes the IPv6 destination and the final destination the last segment.
+ */
+static int lowpan_6lorh_decmpr(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
+                               const uint8_t src_iid[8], const uint8_t dst_iid[8])
+{
+    struct iobuf_read iobuf = {
+        .data      = pktbuf_head(pktbuf) + 1,
+        .data_size = pktbuf_len(pktbuf) - 1,
+    };
+    struct in6_addr root = { };
+    struct lowpan_6lorh lorh;
+    struct ip6_hdr hdr;
+    bool enabled;
+    int ret;
+
+    lowpan_6lorh_root(ipv6, &root, &enabled);
+    ret = lowpan_6lorh_parse(&iobuf, &lorh, &root);
+    if (ret)
+        return ret;
+    pktbuf_pop_head(pktbuf, NULL, 1 + iobuf.cnt);
+    // TODO: RPL Option (RFC 6553)
+    if (lorh.ipinip) {
+        TRACE(TR_DROP, "drop %-9s: unsupported IP-in-IP-6LoRH", "6lowpan");
+        return -EOPNOTSUPP;
+    }
+    if (lorh.srh_len && IN6_IS_ADDR_UNSPECIFIED(&root)) {
+        TRACE(TR_DROP, "drop %-9s: SRH-6LoRH without parent", "6lowpan");
+        return -EINVAL;
+    }
+    lowpan_iphc_decmpr(pktbuf, src_iid, dst_iid);
+    if (pktbuf->err)
+        return -EINVAL;
+    if (!lorh.srh_len)
+        return 0;
+
+    pktbuf_pop_head(pktbuf, &hdr, sizeof(hdr));
+    // Headers are pushed in reverse order, starting with the last segment
+    pktbuf_push_head(pktbuf, &hdr.ip6_dst, sizeof(hdr.ip6_dst));
+    for (int i = lorh.srh_len - 1; i > 0; i--)
+        pktbuf_push_head(pktbuf, &lorh.srh[i], sizeof(lorh.srh[i]));
+    pktbuf_push_head_be32(pktbuf, 0); // CmprI, CmprE, Pad, Reserved
+    pktbuf_push_head_u8(pktbuf, lorh.srh_len);
+    pktbuf_push_head_u8(pktbuf, IPV6_ROUTING_RPL_SRH);
+    pktbuf_push_head_u8(pktbuf, 2 * lorh.srh_len);
+    pktbuf_push_head_u8(pktbuf, hdr.ip6_nxt);
+    hdr.ip6_nxt  = IPPROTO_ROUTING;
+    hdr.ip6_dst  = lorh.srh[0];
+    hdr.ip6_plen = htons(pktbuf_len(pktbuf));
+    pktbuf_push_head(pktbuf, &hdr, sizeof(hdr));
+    return pktbuf->err ? -EINVAL : 0;
+}
+
+static int lowpan_decmpr(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
+                         const uint8_t src[8], const uint8_t dst[8])
 {
     uint8_t src_iid[8], dst_iid[8];
-    struct pktbuf pktbuf = { };
     uint8_t dispatch;
 
+    if (pktbuf_len(pktbuf) < 1) {
+        TRACE(TR_DROP, "drop %-9s: malformed packet", "6lowpan");
+        return -EINVAL;
+    }
+    dispatch = pktbuf_head(pktbuf)[0];
+
+    ipv6_addr_conv_iid_eui64(src_iid, src);
+    ipv6_addr_conv_iid_eui64(dst_iid, dst);
+    if (dispatch == LOWPAN_6LORH_PAGE1)
+        return lowpan_6lorh_decmpr(ipv6, pktbuf, src_iid, dst_iid);
+    if (!LOWPAN_DISPATCH_IS_IPHC(dispatch)) {
+        TRACE(TR_DROP, "drop %-9s: unsupported dispatch type 0x%02x", "6lowpan", dispatch);
+        return -EOPNOTSUPP;
+    }
+    lowpan_iphc_decmpr(pktbuf, src_iid, dst_iid);
+    return pktbuf->err ? -EINVAL : 0;
+}
+
+/*
+ *   RFC 9035 - 3. Updating RFC 6550
+ * The T flag indicates that the RFC 8138 compression is used within the RPL
+ * Instance.
+ */
+static int lowpan_cmpr(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
+                       const uint8_t src[8], const uint8_t dst[8])
+{
+    struct iobuf_write lorh = { };
+    uint8_t src_iid[8], dst_iid[8];
+    bool enabled = false;
+    struct in6_addr root;
+    int ret;
+
+    if (lowpan_6lorh_root(ipv6, &root, &enabled) && enabled) {
+        ret = lowpan_6lorh_srh_cmpr(&lorh, pktbuf_head(pktbuf), pktbuf_len(pktbuf), &root);
+        if (ret < 0) {
+            TRACE(TR_DROP, "drop %-9s: malformed routing header", "6lowpan");
+            iobuf_free(&lorh);
+            return ret;
+        }
+        pktbuf_pop_head(pktbuf, NULL, ret);
+    }
+
     ipv6_addr_conv_iid_eui64(src_iid, src);
     ipv6_addr_conv_iid_eui64(dst_iid, dst);
+    lowpan_iphc_cmpr(pktbuf, src_iid, dst_iid);
+    if (lorh.len) {
+        pktbuf_push_head(pktbuf, lorh.data, lorh.len);
+        pktbuf_push_head_u8(pktbuf, LOWPAN_6LORH_PAGE1);
+    }
+    iobuf_free(&lorh);
+    return pktbuf->err ? -EINVAL : 0;
+}
+
+/*
+ *   RFC 4944 - 5.3. Fragmentation Type and Header
+ * If a fragment recipient disassociates from its sender or the reassembly
+ * timeout (60 seconds) expires, the entire partially reassembled payload
+ * MUST be discarded.
+ */
+#define LOWPAN_VRB_TIMEOUT_MS 60000
+#define LOWPAN_VRB_MAX 32
+
+static void lowpan_vrb_del(struct lowpan_ctx *lowpan, struct lowpan_vrb *vrb)
+{
+    SLIST_REMOVE(&lowpan->vrb_list, vrb, lowpan_vrb, link);
+    lowpan->vrb_count--;
+    free(vrb);
+}
+
+static struct lowpan_vrb *lowpan_vrb_get(struct lowpan_ctx *lowpan,
+                                         const uint8_t src[8], uint16_t tag, uint16_t size)
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    struct lowpan_vrb *vrb, *tmp;
+
+    SLIST_FOREACH_SAFE(vrb, &lowpan->vrb_list, link, tmp) {
+        if (vrb->expire_ms <= now_ms) {
+            TRACE(TR_DROP, "drop %-9s: fragmented datagram timeout", "6lowpan");
+            lowpan_vrb_del(lowpan, vrb);
+            continue;
+        }
+        //   RFC 4944 - 5.3. Fragmentation Type and Header
+        // The recipient of link fragments SHALL use (1) the sender's 802.15.4
+        // source address, (2) the destination's 802.15.4 address, (3)
+        // datagram_size, and (4) datagram_tag to identify all the fragments
+        // that belong to a given datagram.
+        if (!memcmp(vrb->src, src, 8) && vrb->src_tag == tag && vrb->size == size)
+            return vrb;
+    }
+    return NULL;
+}
 
-    pktbuf_init(&pktbuf, buf, buf_len);
+// Offset and length in octets, the last unit may be incomplete.
+static bool lowpan_vrb_overlap(const struct lowpan_vrb *vrb, uint16_t offset, uint16_t len)
+{
+    for (int i = offset / 8; i < (offset + len + 7) / 8; i++)
+        if (bittest(vrb->rx_map, i))
+            return true;
+    return false;
+}
+
+static void lowpan_vrb_mark(struct lowpan_vrb *vrb, uint16_t offset, uint16_t len)
+{
+    for (int i = offset / 8; i < (offset + len + 7) / 8; i++)
+        bitset(vrb->rx_map, i);
+}
+
+static bool lowpan_vrb_complete(const struct lowpan_vrb *vrb)
+{
+    for (int i = 0; i < (vrb->size + 7) / 8; i++)
+        if (!bittest(vrb->rx_map, i))
+            return false;
+    return true;
+}
+
+static void lowpan_frag1_recv(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
+                              const uint8_t src[8], const uint8_t dst[8])
+{
+    struct lowpan_ctx *lowpan = &ipv6->lowpan;
+    uint8_t nxthop[8];
+    struct lowpan_vrb *vrb;
+    uint16_t size, tag;
+    size_t frag_len;
+
+    size = FIELD_GET(LOWPAN_MASK_FRAG_DGRAM_SIZE, pktbuf_pop_head_be16(pktbuf));
+    tag  = pktbuf_pop_head_be16(pktbuf);
+    // NOTE: the IPv6 Payload Length and the UDP Length are inferred from the
+    // fragment instead of the datagram. They are elided again on compression,
+    // so this does not matter as long as they are not interpreted.
+    if (lowpan_decmpr(ipv6, pktbuf, src, dst))
+        return;
+    frag_len = pktbuf_len(pktbuf);
+    if (frag_len > size) {
+        TRACE(TR_DROP, "drop %-9s: malformed packet", "6lowpan");
+        return;
+    }
+    if (ipv6_forward_frag(ipv6, pktbuf, src, nxthop))
+        return;
+
+    // A retransmitted first fragment reuses the existing VRB
+    vrb = lowpan_vrb_get(lowpan, src, tag, size);
+    if (!vrb) {
+        if (lowpan->vrb_count >= LOWPAN_VRB_MAX) {
+            TRACE(TR_DROP, "drop %-9s: too many fragmented datagrams", "6lowpan");
+            return;
+        }
+        vrb = zalloc(sizeof(*vrb));
+        memcpy(vrb->src, src, 8);
+        vrb->src_tag    = tag;
+        vrb->size       = size;
+        vrb->nxthop_tag = lowpan->tag++;
+        vrb->expire_ms  = time_now_ms(CLOCK_MONOTONIC) + LOWPAN_VRB_TIMEOUT_MS;
+        SLIST_INSERT_HEAD(&lowpan->vrb_list, vrb, link);
+        lowpan->vrb_count++;
+    }
+    memcpy(vrb->nxthop, nxthop, 8);
+    lowpan_vrb_mark(vrb, 0, frag_len);
+
+    if (lowpan_cmpr(ipv6, pktbuf, ipv6->eui64, nxthop))
+        return;
+    pktbuf_push_head_be16(pktbuf, vrb->nxthop_tag);
+    pktbuf_push_head_be16(pktbuf, LOWPAN_DISPATCH_FRAG1 << 8 | size);
+    ipv6->sendto_mac(ipv6, pktbuf, nxthop);
+}
+
+/*
+ *   RFC 8930 - 6. Forwarding Fragments
+ * A fragment received before the first one cannot be forwarded since its next
+ * hop is unknown, it is dropped.
+ */
+static void lowpan_fragn_recv(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf, const uint8_t src[8])
+{
+    struct lowpan_ctx *lowpan = &ipv6->lowpan;
+    struct lowpan_vrb *vrb;
+    uint16_t size, tag;
+    uint8_t offset;
+
+    size   = FIELD_GET(LOWPAN_MASK_FRAG_DGRAM_SIZE, pktbuf_pop_head_be16(pktbuf));
+    tag    = pktbuf_pop_head_be16(pktbuf);
+    offset = pktbuf_pop_head_u8(pktbuf);
+    if (pktbuf->err || offset * 8 + pktbuf_len(pktbuf) > size) {
+        TRACE(TR_DROP, "drop %-9s: malformed packet", "6lowpan");
+        return;
+    }
+    vrb = lowpan_vrb_get(lowpan, src, tag, size);
+    if (!vrb) {
+        TRACE(TR_DROP, "drop %-9s: unknown fragmented datagram", "6lowpan");
+        return;
+    }
+    if (lowpan_vrb_overlap(vrb, offset * 8, pktbuf_len(pktbuf))) {
+        TRACE(TR_DROP, "drop %-9s: duplicate fragment", "6lowpan");
+        return;
+    }
+    lowpan_vrb_mark(vrb, offset * 8, pktbuf_len(pktbuf));
+
+    pktbuf_push_head_u8(pktbuf, offset);
+    pktbuf_push_head_be16(pktbuf, vrb->nxthop_tag);
+    pktbuf_push_head_be16(pktbuf, LOWPAN_DISPATCH_FRAGN << 8 | size);
+    ipv6->sendto_mac(ipv6, pktbuf, vrb->nxthop);
+
+    if (lowpan_vrb_complete(vrb))
+        lowpan_vrb_del(lowpan, vrb);
+}
+
+void lowpan_recv(struct ipv6_ctx *ipv6,
+                 const uint8_t *buf, size_t buf_len,
+                 const uint8_t src[8], const uint8_t dst[8])
+{
+    struct pktbuf pktbuf = { };
+    uint8_t dispatch;
+
+    pktbuf_init_headroom(&pktbuf, IPV6_HEADROOM, buf, buf_len);
 
     if (pktbuf_len(&pktbuf) < 1)
         return;
     dispatch = pktbuf.buf[pktbuf.offset_head];
 
-    // TODO: support FRAG1 and FRAGN
-    if (LOWPAN_DISPATCH_IS_IPHC(dispatch)) {
-        lowpan_iphc_decmpr(&pktbuf, src_iid, dst_iid);
-    } else {
-        TRACE(TR_DROP, "drop %-9s: unsupported dispatch type 0x%02x", "6lowpan", dispatch);
+    if (LOWPAN_DISPATCH_IS_FRAG1(dispatch)) {
+        // TODO: reassemble fragmented datagrams destined to this node
+        lowpan_frag1_recv(ipv6, &pktbuf, src, dst);
+        goto err;
+    } else if (LOWPAN_DISPATCH_IS_FRAGN(dispatch)) {
+        lowpan_fragn_recv(ipv6, &pktbuf, src);
         goto err;
     }
+    if (lowpan_decmpr(ipv6, &pktbuf, src, dst))
+        goto err;
 
-    ipv6_recvfrom_mac(ipv6, &pktbuf);
+    ipv6_recvfrom_mac(ipv6, &pktbuf, src);
 err:
     pktbuf_free(&pktbuf);
 }
@@ -58,14 +348,11 @@ int lowpan_send(struct ipv6_ctx *ipv6,
                  const uint8_t src[8],
                  const uint8_t dst[8])
 {
-    uint8_t src_iid[8], dst_iid[8];
+    int ret;
 
-    ipv6_addr_conv_iid_eui64(src_iid, src);
-    ipv6_addr_conv_iid_eui64(dst_iid, dst);
-
-    lowpan_iphc_cmpr(pktbuf, src_iid, dst_iid);
-    if (pktbuf->err)
-        return -EINVAL;
+    ret = lowpan_cmpr(ipv6, pktbuf, src, dst);
+    if (ret)
+        return ret;
 
     return ipv6->sendto_mac(ipv6, pktbuf, dst);
 }
@@ -17,10 +17,45 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/queue.h>
 
 struct ipv6_ctx;
 struct pktbuf;
 
+/*
+ *   RFC 8930 - 3. Overview of 6LoWPAN Fragment Forwarding
+ * Fragmented datagrams are not reassembled before being forwarded: a Virtual
+ * Reassembly Buffer (VRB) is created on reception of the first fragment, which
+ * is routed like a regular packet. The following fragments are then forwarded
+ * to the same next hop as they arrive, with only the datagram tag rewritten.
+ *
+ * Since RFC 4944 offsets are expressed in the uncompressed datagram, the first
+ * fragment can be compressed again for the next hop without affecting the
+ * following ones.
+ *
+ * The received parts of the datagram are tracked per 8-octet unit, the
+ * granularity of the FRAGN offset, so duplicated fragments are not forwarded
+ * again and do not release the VRB early.
+ */
+struct lowpan_vrb {
+    uint8_t  src[8];
+    uint16_t src_tag;
+    uint16_t size;
+    uint8_t  nxthop[8];
+    uint16_t nxthop_tag;
+    uint8_t  rx_map[256 / 8]; // datagram_size is 11 bits, so 256 units max
+    uint64_t expire_ms;
+    SLIST_ENTRY(lowpan_vrb) link;
+};
+
+SLIST_HEAD(lowpan_vrb_list, lowpan_vrb);
+
+struct lowpan_ctx {
+    struct lowpan_vrb_list vrb_list;
+    int vrb_count;
+    uint16_t tag;
+};
+
 void lowpan_recv(struct ipv6_ctx *ipv6,
                  const uint8_t *buf, size_t buf_len,
                  const uint8_t src[8], const uint8_t dst[8]);
@@ -19,7 +19,9 @@
 #include <unistd.h>
 
 #include "common/ipv6/ipv6_addr.h"
+#include "common/ipv6/ipv6_flow_label.h"
 #include "common/bits.h"
+#include "common/endian.h"
 #include "common/ieee802154_frame.h"
 #include "common/log.h"
 #include "common/mathutils.h"
@@ -29,14 +31,118 @@
 #include "common/sys_queue_extra.h"
 #include "common/specs/icmpv6.h"
 #include "common/specs/ipv6.h"
+#include "common/specs/rpl.h"
 #include "app_wsrd/ipv6/6lowpan.h"
 #include "app_wsrd/ipv6/ipv6_addr_mc.h"
+#include "app_wsrd/ipv6/rpl_mrhof.h"
 #include "ipv6.h"
 
-void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf)
+static int ipv6_nxthop(struct ipv6_ctx *ipv6,
+                       const struct ip6_hdr *hdr,
+                       const struct in6_addr **nxthop);
+static void ipv6_addr_resolution(struct ipv6_ctx *ipv6,
+                                 const struct in6_addr *nxthop,
+                                 uint8_t eui64[8]);
+
+static int ipv6_forward_route(struct ipv6_ctx *ipv6, struct ip6_hdr *hdr,
+                              const uint8_t src[8], uint8_t dst_eui64[8])
+{
+    const struct in6_addr *nxthop;
+    int ret;
+
+    if (hdr->ip6_hlim <= 1) {
+        // TODO: send ICMPv6 Time Exceeded
+        TRACE(TR_DROP, "drop %-9s: hop limit exceeded", "ipv6");
+        return -ETIMEDOUT;
+    }
+    hdr->ip6_hlim--;
+    // TODO: RPL Option (RFC 6553), loop detection (RFC 6550 11.2)
+    ret = ipv6_nxthop(ipv6, hdr, &nxthop);
+    if (ret)
+        return ret;
+    ipv6_addr_resolution(ipv6, nxthop, dst_eui64);
+    if (!memcmp(dst_eui64, src, 8)) {
+        TRACE(TR_DROP, "drop %-9s: next hop is the previous hop", "ipv6");
+        return -EHOSTUNREACH;
+    }
+    return 0;
+}
+
+/*
+ * Packets are forwarded from the buffer filled by lowpan_recv(): the IPv6
+ * header and the RPL Source Routing Header are updated in place, and the IPHC
+ * header is rebuilt in the headroom by lowpan_send(). IPHC compression must
+ * run again since the elided IIDs depend on the link-layer addresses, which
+ * change on every hop.
+ */
+static void ipv6_forward(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
+                         struct ip6_hdr *hdr, const uint8_t src[8])
+{
+    uint8_t dst_eui64[8];
+
+    if (ipv6_forward_route(ipv6, hdr, src, dst_eui64))
+        return;
+
+    TRACE(TR_IPV6, "fwd-ipv6 src=%s dst=%s",
+          tr_ipv6(hdr->ip6_src.s6_addr), tr_ipv6(hdr->ip6_dst.s6_addr));
+    // Restores the header at the same place
+    pktbuf_push_head(pktbuf, hdr, sizeof(*hdr));
+    lowpan_send(ipv6, pktbuf, ipv6->eui64, dst_eui64);
+}
+
+/*
+ *   RFC 6554 4.2. Processing Source Routing Headers
+ * The next segment is swapped with the destination address directly in the
+ * header. Both share the first CmprI (or CmprE) bytes, so the previous
+ * destination fits the same room.
+ */
+static int ipv6_srh_process(struct pktbuf *pktbuf, struct ip6_hdr *hdr)
+{
+    struct ip6_rthdr *rthdr = (struct ip6_rthdr *)pktbuf_head(pktbuf);
+    uint8_t cmpri, cmpre, pad, cmpr;
+    uint8_t *seg, tmp[16];
+    size_t hdr_len;
+    uint32_t val;
+    int n, i;
+
+    hdr_len = 8 * (rthdr->ip6r_len + 1);
+    if (pktbuf_len(pktbuf) < hdr_len) {
+        TRACE(TR_DROP, "drop %-9s: malformed packet", "ipv6");
+        return -EINVAL;
+    }
+    val = read_be32((uint8_t *)rthdr + 4);
+    cmpri = FIELD_GET(RPL_MASK_SRH_CMPRI, val);
+    cmpre = FIELD_GET(RPL_MASK_SRH_CMPRE, val);
+    pad   = FIELD_GET(RPL_MASK_SRH_PAD,   val);
+    if (hdr_len < 8 + pad + 16 - cmpre) {
+        TRACE(TR_DROP, "drop %-9s: malformed packet", "ipv6");
+        return -EINVAL;
+    }
+    n = (hdr_len - 8 - pad - (16 - cmpre)) / (16 - cmpri) + 1;
+    if (rthdr->ip6r_segleft > n) {
+        // TODO: send ICMPv6 Parameter Problem
+        TRACE(TR_DROP, "drop %-9s: invalid segments left", "ipv6");
+        return -EINVAL;
+    }
+    rthdr->ip6r_segleft--;
+    i = n - rthdr->ip6r_segleft;
+    cmpr = i < n ? cmpri : cmpre;
+    seg = (uint8_t *)rthdr + 8 + (i - 1) * (16 - cmpri);
+
+    memcpy(tmp, hdr->ip6_dst.s6_addr, 16);
+    memcpy(hdr->ip6_dst.s6_addr + cmpr, seg, 16 - cmpr);
+    memcpy(seg, tmp + cmpr, 16 - cmpr);
+    if (IN6_IS_ADDR_MULTICAST(&hdr->ip6_dst) || IN6_IS_ADDR_MULTICAST(tmp)) {
+        TRACE(TR_DROP, "drop %-9s: multicast address in routing header", "ipv6");
+        return -EINVAL;
+    }
+    return 0;
+}
+
+void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf, const uint8_t src[8])
 {
     struct in6_addr addr_linklocal = ipv6_prefix_linklocal;
-    const struct ip6_rthdr *rthdr;
+    struct ip6_rthdr *rthdr;
     struct icmpv6_hdr icmp;
     struct ip6_hdr hdr;
     ssize_t ret;
@@ -48,6 +154,11 @@ void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf)
         return;
     }
     ipv6_addr_conv_iid_eui64(addr_linklocal.s6_addr + 8, ipv6->eui64);
+    if (IN6_IS_ADDR_UC_GLOBAL(&hdr.ip6_dst) && !IN6_IS_ADDR_UNSPECIFIED(&ipv6->dhcp.iaaddr.ipv6) &&
+        !IN6_ARE_ADDR_EQUAL(&hdr.ip6_dst, &ipv6->dhcp.iaaddr.ipv6)) {
+        ipv6_forward(ipv6, pktbuf, &hdr, src);
+        return;
+    }
     if (!(IN6_IS_ADDR_MULTICAST(&hdr.ip6_dst) && ipv6_addr_has_mc(ipv6, &hdr.ip6_dst)) &&
         !(IN6_IS_ADDR_LINKLOCAL(&hdr.ip6_dst) && IN6_ARE_ADDR_EQUAL(&hdr.ip6_dst, &addr_linklocal)) &&
         !(IN6_IS_ADDR_UC_GLOBAL(&hdr.ip6_dst) && IN6_ARE_ADDR_EQUAL(&hdr.ip6_dst, &ipv6->dhcp.iaaddr.ipv6))) {
@@ -57,14 +168,19 @@ void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf)
     }
 
     if (hdr.ip6_nxt == IPPROTO_ROUTING) {
-        if (pktbuf_len(pktbuf) < sizeof(rthdr)) {
+        if (pktbuf_len(pktbuf) < sizeof(*rthdr)) {
             TRACE(TR_DROP, "drop %-9s: malformed packet", "ipv6");
             return;
         }
         rthdr = (struct ip6_rthdr *)pktbuf_head(pktbuf);
         if (rthdr->ip6r_segleft) {
-            // TODO: handle RPL SRH
-            TRACE(TR_DROP, "drop %-9s: unsupported routing header", "ipv6");
+            if (rthdr->ip6r_type != IPV6_ROUTING_RPL_SRH) {
+                TRACE(TR_DROP, "drop %-9s: unsupported routing header", "ipv6");
+                return;
+            }
+            if (ipv6_srh_process(pktbuf, &hdr))
+                return;
+            ipv6_forward(ipv6, pktbuf, &hdr, src);
             return;
         }
 
@@ -131,6 +247,54 @@ void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf)
         WARN("write tun: Short write: %zi < %zu", ret, pktbuf_len(pktbuf));
 }
 
+/*
+ * Only the first fragment carries the IPv6 header, and the routing decision
+ * made for it applies to the whole datagram. The header is processed the same
+ * way as in ipv6_recvfrom_mac(), except that the datagram cannot be delivered
+ * locally since it is never reassembled.
+ */
+int ipv6_forward_frag(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
+                      const uint8_t src[8], uint8_t dst_eui64[8])
+{
+    const struct in6_addr *gua = &ipv6->dhcp.iaaddr.ipv6;
+    struct ip6_rthdr *rthdr;
+    struct ip6_hdr hdr;
+    int ret;
+
+    pktbuf_pop_head(pktbuf, &hdr, sizeof(hdr));
+    if (pktbuf->err) {
+        TRACE(TR_DROP, "drop %-9s: malformed packet", "ipv6");
+        return -EINVAL;
+    }
+    if (FIELD_GET(IPV6_MASK_VERSION, ntohl(hdr.ip6_flow)) != 6) {
+        TRACE(TR_DROP, "drop %-9s: invalid IP version", "ipv6");
+        return -EINVAL;
+    }
+    if (!IN6_IS_ADDR_UC_GLOBAL(&hdr.ip6_dst) || IN6_IS_ADDR_UNSPECIFIED(gua)) {
+        TRACE(TR_DROP, "drop %-9s: unsupported fragmented datagram", "ipv6");
+        return -EOPNOTSUPP;
+    }
+    if (IN6_ARE_ADDR_EQUAL(&hdr.ip6_dst, gua)) {
+        rthdr = (struct ip6_rthdr *)pktbuf_head(pktbuf);
+        if (hdr.ip6_nxt != IPPROTO_ROUTING || pktbuf_len(pktbuf) < sizeof(*rthdr) ||
+            !rthdr->ip6r_segleft || rthdr->ip6r_type != IPV6_ROUTING_RPL_SRH) {
+            TRACE(TR_DROP, "drop %-9s: unsupported fragmented datagram", "ipv6");
+            return -EOPNOTSUPP;
+        }
+        ret = ipv6_srh_process(pktbuf, &hdr);
+        if (ret)
+            return ret;
+    }
+    ret = ipv6_forward_route(ipv6, &hdr, src, dst_eui64);
+    if (ret)
+        return ret;
+
+    TRACE(TR_IPV6, "fwd-frag src=%s dst=%s",
+          tr_ipv6(hdr.ip6_src.s6_addr), tr_ipv6(hdr.ip6_dst.s6_addr));
+    pktbuf_push_head(pktbuf, &hdr, sizeof(hdr));
+    return 0;
+}
+
 /*
  *   RFC 4861 5.2. Conceptual Sending Algorithm
  * The sender performs a longest prefix match against the Prefix List to
@@ -149,10 +313,12 @@ void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf)
  * cache, next-hop determination is thus always performed.
  */
 static int ipv6_nxthop(struct ipv6_ctx *ipv6,
-                       const struct in6_addr *dst,
+                       const struct ip6_hdr *hdr,
                        const struct in6_addr **nxthop)
 {
+    const struct in6_addr *dst = &hdr->ip6_dst;
     struct ipv6_neigh *nce;
+    uint24_t flow;
 
     //   RFC 4861 5.2. Conceptual Sending Algorithm
     // For multicast packets, the next-hop is always the (multicast)
@@ -177,8 +343,11 @@ static int ipv6_nxthop(struct ipv6_ctx *ipv6,
         return 0;
     }
 
-    // Default to preferred RPL parent.
-    nce = rpl_neigh_pref_parent(ipv6);
+    // Default to preferred RPL parent, or to one of the parents with a
+    // similar path cost so that a flow always takes the same path.
+    flow = FIELD_GET(IPV6_MASK_FLOW, ntohl(hdr->ip6_flow));
+    flow = ipv6_flow_label_tunnel(hdr->ip6_src.s6_addr, dst->s6_addr, flow);
+    nce = rpl_mrhof_multipath_parent(ipv6, flow);
     if (nce) {
         *nxthop = &nce->gua;
         return 0;
@@ -315,7 +484,7 @@ void ipv6_recvfrom_tun(struct ipv6_ctx *ipv6)
         goto err;
     hdr = (const struct ip6_hdr *)pktbuf_head(&pktbuf);
 
-    if (ipv6_nxthop(ipv6, &hdr->ip6_dst, &nxthop))
+    if (ipv6_nxthop(ipv6, hdr, &nxthop))
         return;
     ipv6_addr_resolution(ipv6, nxthop, dst_eui64);
 
@@ -343,12 +512,14 @@ int ipv6_sendto_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
     };
     int ret;
 
+    // No-op if the caller already reserved the headroom
+    pktbuf_reserve_head(pktbuf, IPV6_HEADROOM);
     pktbuf_push_head(pktbuf, &hdr, sizeof(hdr));
 
     TRACE(TR_IPV6, "tx-ipv6 src=%s dst=%s",
           tr_ipv6(hdr.ip6_src.s6_addr), tr_ipv6(hdr.ip6_dst.s6_addr));
 
-    ret = ipv6_nxthop(ipv6, dst, &nxthop);
+    ret = ipv6_nxthop(ipv6, &hdr, &nxthop);
     if (ret < 0)
         return ret;
     ipv6_addr_resolution(ipv6, nxthop, dst_eui64);
@@ -14,6 +14,7 @@
 #ifndef WSRD_IPV6_H
 #define WSRD_IPV6_H
 
+#include "app_wsrd/ipv6/6lowpan.h"
 #include "app_wsrd/ipv6/ndp.h"
 #include "app_wsrd/ipv6/rpl.h"
 #include "common/dhcp_client.h"
@@ -23,6 +24,11 @@
 struct in6_addr;
 struct pktbuf;
 
+// Headroom to reserve in packets given to ipv6_sendto_mac(), or decompressed
+// by 6LoWPAN, so that the IPv6 header and its 6LoWPAN compression can be
+// pushed in place.
+#define IPV6_HEADROOM 64
+
 struct ipv6_ctx {
     struct tun_ctx tun;
     struct dhcp_client dhcp;
@@ -32,16 +38,25 @@ struct ipv6_ctx {
     int reach_base_ms;  // BaseReachableTime
     int probe_delay_ms; // RetransDelay
     struct ipv6_neigh_cache neigh_cache;
+    // Indexes of neigh_cache by GUA and by EUI-64, see ipv6_neigh_get_from_*().
+    // neigh_cache is kept for iteration.
+    struct ipv6_neigh_cache neigh_gua_hash[1 << IPV6_NEIGH_HASH_BITS];
+    struct ipv6_neigh_cache neigh_eui64_hash[1 << IPV6_NEIGH_HASH_BITS];
     uint8_t eui64[8];
 
     struct timer_group timer_group;
     struct rpl_ctx rpl;
+    struct lowpan_ctx lowpan;
 
     int (*sendto_mac)(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf, const uint8_t dst[8]);
 };
 
-void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf);
+void ipv6_recvfrom_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf, const uint8_t src[8]);
 void ipv6_recvfrom_tun(struct ipv6_ctx *ipv6);
+// Route the first fragment of a datagram (IPHC already decompressed), updating
+// its IPv6 header in place. Returns the link-layer address of the next hop.
+int ipv6_forward_frag(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
+                      const uint8_t src[8], uint8_t dst_eui64[8]);
 
 int ipv6_sendto_mac(struct ipv6_ctx *ipv6, struct pktbuf *pktbuf,
                     uint8_t ipproto, uint8_t hlim,
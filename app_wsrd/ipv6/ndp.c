@@ -76,7 +76,7 @@ static void ipv6_send_ns(struct ipv6_ctx *ipv6, struct ipv6_neigh *neigh)
     memset(&ns, 0, sizeof(ns));
     ns.nd_ns_type   = ND_NEIGHBOR_SOLICIT;
     ns.nd_ns_target = dst;
-    pktbuf_push_tail(&pktbuf, &ns, sizeof(ns));
+    pktbuf_init_headroom(&pktbuf, IPV6_HEADROOM, &ns, sizeof(ns));
 
     // TODO: Figure out how NUD works with children.
     if (has_gua && neigh->rpl && neigh->rpl->is_parent) {
@@ -179,12 +179,36 @@ void ipv6_nud_set_state(struct ipv6_ctx *ipv6, struct ipv6_neigh *neigh, int sta
     }
 }
 
+static struct ipv6_neigh_cache *ipv6_neigh_gua_bucket(const struct ipv6_ctx *ipv6,
+                                                      const struct in6_addr *gua)
+{
+    uint64_t hi, lo;
+
+    // Addresses generally share their prefix, the multiplication spreads the
+    // IID differences into the upper bits.
+    memcpy(&hi, gua->s6_addr, 8);
+    memcpy(&lo, gua->s6_addr + 8, 8);
+    lo ^= hi;
+    lo *= UINT64_C(0x9e3779b97f4a7c15);
+    return (struct ipv6_neigh_cache *)&ipv6->neigh_gua_hash[lo >> (64 - IPV6_NEIGH_HASH_BITS)];
+}
+
+static struct ipv6_neigh_cache *ipv6_neigh_eui64_bucket(const struct ipv6_ctx *ipv6,
+                                                        const uint8_t eui64[8])
+{
+    uint64_t key;
+
+    memcpy(&key, eui64, 8);
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return (struct ipv6_neigh_cache *)&ipv6->neigh_eui64_hash[key >> (64 - IPV6_NEIGH_HASH_BITS)];
+}
+
 struct ipv6_neigh *ipv6_neigh_get_from_gua(const struct ipv6_ctx *ipv6,
                                            const struct in6_addr *gua)
 {
     struct ipv6_neigh *neigh;
 
-    return SLIST_FIND(neigh, &ipv6->neigh_cache, link,
+    return SLIST_FIND(neigh, ipv6_neigh_gua_bucket(ipv6, gua), gua_link,
                       IN6_ARE_ADDR_EQUAL(&neigh->gua, gua));
 }
 
@@ -193,7 +217,7 @@ struct ipv6_neigh *ipv6_neigh_get_from_eui64(const struct ipv6_ctx *ipv6,
 {
     struct ipv6_neigh *neigh;
 
-    return SLIST_FIND(neigh, &ipv6->neigh_cache, link,
+    return SLIST_FIND(neigh, ipv6_neigh_eui64_bucket(ipv6, eui64), eui64_link,
                       !memcmp(neigh->eui64, eui64, 8));
 }
 
@@ -222,6 +246,8 @@ struct ipv6_neigh *ipv6_neigh_fetch(struct ipv6_ctx *ipv6,
     SLIST_INSERT_HEAD(&ipv6->neigh_cache, neigh, link);
     neigh->gua = *gua;
     memcpy(neigh->eui64, eui64, 8);
+    SLIST_INSERT_HEAD(ipv6_neigh_gua_bucket(ipv6, gua), neigh, gua_link);
+    SLIST_INSERT_HEAD(ipv6_neigh_eui64_bucket(ipv6, eui64), neigh, eui64_link);
     neigh->nud_timer.callback = ipv6_nud_expire;
     neigh->ns_handle = -1;
     TRACE(TR_NEIGH_IPV6, "neigh-ipv6 add %s eui64=%s",
@@ -234,6 +260,8 @@ void ipv6_neigh_del(struct ipv6_ctx *ipv6, struct ipv6_neigh *neigh)
 {
     timer_stop(&ipv6->timer_group, &neigh->nud_timer);
     SLIST_REMOVE(&ipv6->neigh_cache, neigh, ipv6_neigh, link);
+    SLIST_REMOVE(ipv6_neigh_gua_bucket(ipv6, &neigh->gua), neigh, ipv6_neigh, gua_link);
+    SLIST_REMOVE(ipv6_neigh_eui64_bucket(ipv6, neigh->eui64), neigh, ipv6_neigh, eui64_link);
     TRACE(TR_NEIGH_IPV6, "neigh-ipv6 del %s eui64=%s",
           tr_ipv6(neigh->gua.s6_addr), tr_eui64(neigh->eui64));
     if (neigh->rpl)
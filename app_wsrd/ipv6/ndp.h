@@ -25,6 +25,10 @@ struct ipv6_ctx;
 
 struct ipv6_ctx;
 
+// Number of buckets in the GUA and EUI-64 indexes of the neighbor cache, as a
+// power of 2. Routers rarely have more than a few hundreds of neighbors.
+#define IPV6_NEIGH_HASH_BITS 8
+
 /*
  * Neighbor Discovery Protocol (NDP) is defined in:
  *   - RFC 4861: Neighbor Discovery for IP version 6 (IPv6)
@@ -71,6 +75,8 @@ struct ipv6_neigh {
     struct rpl_neigh *rpl;
 
     SLIST_ENTRY(ipv6_neigh) link;
+    SLIST_ENTRY(ipv6_neigh) gua_link;
+    SLIST_ENTRY(ipv6_neigh) eui64_link;
 };
 
 // Declare struct ipv6_neigh_cache
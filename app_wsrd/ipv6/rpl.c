@@ -37,6 +37,9 @@
 #include "app_wsrd/ipv6/ipv6.h"
 #include "rpl.h"
 
+// DIO redundancy constant in dense neighborhoods, see rpl_dio_trickle_adapt()
+#define RPL_DIO_DENSE_K 2
+
 static const struct name_value rpl_codes[] = {
     { "dis",     RPL_CODE_DIS },
     { "dio",     RPL_CODE_DIO },
@@ -67,7 +70,7 @@ static void rpl_neigh_update(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce,
     TRACE(TR_RPL, "rpl: neigh set %s rank=%u ",
           tr_ipv6(nce->gua.s6_addr), ntohs(dio->rank));
     if (update)
-        rpl_mrhof_select_parent(ipv6);
+        rpl_mrhof_update(ipv6, nce);
 }
 
 static void rpl_neigh_add(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce,
@@ -77,30 +80,25 @@ static void rpl_neigh_add(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce,
 {
     BUG_ON(nce->rpl);
     nce->rpl = zalloc(sizeof(struct rpl_neigh));
+    nce->rpl->nce    = nce;
     nce->rpl->dio    = *dio;
     nce->rpl->config = *config;
     TRACE(TR_RPL, "rpl: neigh add %s", tr_ipv6(nce->gua.s6_addr));
     rpl_neigh_update(ipv6, nce, dio, config, prefix);
-    rpl_mrhof_select_parent(ipv6);
+    rpl_mrhof_update(ipv6, nce);
 }
 
 void rpl_neigh_del(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce)
 {
     TRACE(TR_RPL, "rpl: neigh del %s", tr_ipv6(nce->gua.s6_addr));
-    if (nce->rpl->is_parent) {
-        nce->rpl->dio.rank = RPL_RANK_INFINITE;
-        rpl_mrhof_select_parent(ipv6);
-    }
+    rpl_mrhof_remove(ipv6, nce);
     free(nce->rpl);
     nce->rpl = NULL;
 }
 
 struct ipv6_neigh *rpl_neigh_pref_parent(struct ipv6_ctx *ipv6)
 {
-    struct ipv6_neigh *nce;
-
-    return SLIST_FIND(nce, &ipv6->neigh_cache, link,
-                      nce->rpl && nce->rpl->is_parent);
+    return ipv6->rpl.mrhof.pref_parent;
 }
 
 static void rpl_opt_push(struct iobuf_write *iobuf, uint8_t type,
@@ -182,12 +180,91 @@ static void rpl_send_dio_mc(struct trickle *tkl)
 {
     struct ipv6_ctx *ipv6 = container_of(tkl, struct ipv6_ctx, rpl.dio_trickle);
 
+    ipv6->rpl.dio_stats.tx++;
     rpl_send_dio(ipv6, &ipv6_addr_all_rpl_nodes_link);
 }
 
-void rpl_start_dio(struct ipv6_ctx *ipv6)
+static bool rpl_dio_same_dodag(const struct rpl_dio *a, const struct rpl_dio *b)
+{
+    return a->instance_id == b->instance_id &&
+           a->dodag_verno == b->dodag_verno &&
+           !memcmp(a->dodag_id.s6_addr, b->dodag_id.s6_addr, 16);
+}
+
+// RFC 6550 3.5.1. Rank Comparison (DAGRank())
+static uint16_t rpl_dag_rank(const struct ipv6_neigh *parent, uint16_t rank)
+{
+    uint16_t min_hop_rank_inc = ntohs(parent->rpl->config.min_hop_rank_inc);
+
+    return min_hop_rank_inc ? rank / min_hop_rank_inc : rank;
+}
+
+static int rpl_dio_neigh_count(struct ipv6_ctx *ipv6, const struct ipv6_neigh *parent)
+{
+    struct ipv6_neigh *nce;
+    int count = 0;
+
+    SLIST_FOREACH(nce, &ipv6->neigh_cache, link)
+        if (nce->rpl && rpl_dio_same_dodag(&nce->rpl->dio, &parent->rpl->dio))
+            count++;
+    return count;
+}
+
+/*
+ * With a fixed redundancy constant, a DIO reset in a neighborhood of N routers
+ * triggers up to N transmissions within Imin, and with k = 0 (the Wi-SUN
+ * default) suppression is disabled altogether. In a dense neighborhood:
+ * - k is capped to RPL_DIO_DENSE_K: any neighbor hears a DIO from the DODAG
+ *   at every interval anyway.
+ * - Imin is doubled each time the density doubles, Imax is kept. Since the
+ *   first transmission of the neighborhood is the earliest of N random points
+ *   in [I/2, I), it still happens close to I/2.
+ */
+static void rpl_dio_trickle_adapt(struct ipv6_ctx *ipv6, const struct ipv6_neigh *parent)
 {
     struct trickle_cfg *cfg = &ipv6->rpl.dio_trickle_cfg;
+    int dense = ipv6->rpl.dio_dense_neigh;
+    unsigned int doublings, shift;
+    unsigned int Imin_ms, k;
+
+    /*
+     *   RFC 6550 - 8.3.1. Trickle Parameters
+     * Imin: learned from the DIO message as (2^DIOIntervalMin) ms.
+     */
+    Imin_ms   = POW2(parent->rpl->config.dio_i_min);
+    doublings = parent->rpl->config.dio_i_doublings;
+    k         = parent->rpl->config.dio_redundancy;
+
+    ipv6->rpl.dio_neigh_count = rpl_dio_neigh_count(ipv6, parent);
+    if (dense && ipv6->rpl.dio_neigh_count >= dense) {
+        shift = 0;
+        while (shift < doublings && ipv6->rpl.dio_neigh_count >= dense << (shift + 1))
+            shift++;
+        Imin_ms <<= shift;
+        doublings -= shift;
+        k = k ? MIN(k, RPL_DIO_DENSE_K) : RPL_DIO_DENSE_K;
+    }
+    if (cfg->Imin_ms != Imin_ms || cfg->k != k)
+        TRACE(TR_RPL, "rpl: dio trickle neigh=%d imin=%ums k=%u",
+              ipv6->rpl.dio_neigh_count, Imin_ms, k);
+    cfg->Imin_ms = Imin_ms;
+    cfg->Imax_ms = TRICKLE_DOUBLINGS(Imin_ms, doublings);
+    cfg->k       = k;
+}
+
+static void rpl_dio_interval_done(struct trickle *tkl)
+{
+    struct ipv6_ctx *ipv6 = container_of(tkl, struct ipv6_ctx, rpl.dio_trickle);
+    struct ipv6_neigh *parent = rpl_neigh_pref_parent(ipv6);
+
+    ipv6->rpl.dio_stats.intervals++;
+    // Applies from the next interval
+    if (parent)
+        rpl_dio_trickle_adapt(ipv6, parent);
+}
+
+void rpl_start_dio(struct ipv6_ctx *ipv6)
+{
     struct ipv6_neigh *parent;
 
     parent = rpl_neigh_pref_parent(ipv6);
@@ -196,13 +273,7 @@ void rpl_start_dio(struct ipv6_ctx *ipv6)
         return;
     }
 
-    /*
-     *   RFC 6550 - 8.3.1. Trickle Parameters
-     * Imin: learned from the DIO message as (2^DIOIntervalMin) ms.
-     */
-    cfg->Imin_ms = POW2(parent->rpl->config.dio_i_min);
-    cfg->Imax_ms = TRICKLE_DOUBLINGS(cfg->Imin_ms, parent->rpl->config.dio_i_doublings);
-    cfg->k       = parent->rpl->config.dio_redundancy;
+    rpl_dio_trickle_adapt(ipv6, parent);
     trickle_start(&ipv6->rpl.dio_trickle);
 }
 
@@ -315,11 +386,12 @@ static void rpl_recv_dio(struct ipv6_ctx *ipv6, const uint8_t *buf, size_t buf_l
 {
     const struct rpl_opt_config *config = NULL;
     const struct rpl_opt_prefix *prefix = NULL;
+    struct ipv6_neigh *nce, *parent;
     const struct rpl_dio *dio;
     const struct rpl_opt *opt;
-    struct ipv6_neigh *nce;
     struct in6_addr addr;
     uint8_t eui64[8];
+    uint16_t rank;
     struct iobuf_read iobuf = {
         .data_size = buf_len,
         .data = buf,
@@ -417,11 +489,31 @@ static void rpl_recv_dio(struct ipv6_ctx *ipv6, const uint8_t *buf, size_t buf_l
     ipv6_addr_conv_iid_eui64(eui64, src->s6_addr + 8);
     nce = ipv6_neigh_fetch(ipv6, &addr, eui64);
 
+    parent = rpl_neigh_pref_parent(ipv6);
+    rank = parent ? rpl_mrhof_rank(ipv6) : RPL_RANK_INFINITE;
     if (!nce->rpl)
         rpl_neigh_add(ipv6, nce, dio, config, prefix);
     else
         rpl_neigh_update(ipv6, nce, dio, config, prefix);
 
+    /*
+     *   RFC 6550 8.3. DIO Transmission
+     * Receiving a DIO message from a sender with a lower Rank that causes no
+     * changes to the recipient's parent set, preferred parent, or Rank SHOULD
+     * be considered consistent with respect to the Trickle timer.
+     *
+     * NOTE: A sender with the same DAGRank is also accepted, its DIO is as
+     * useful to our neighbors as ours.
+     */
+    if (!timer_stopped(&ipv6->rpl.dio_trickle.timer) &&
+        parent && parent == rpl_neigh_pref_parent(ipv6) &&
+        rank == rpl_mrhof_rank(ipv6) &&
+        rpl_dio_same_dodag(dio, &parent->rpl->dio) &&
+        rpl_dag_rank(parent, ntohs(dio->rank)) <= rpl_dag_rank(parent, rank)) {
+        trickle_consistent(&ipv6->rpl.dio_trickle);
+        ipv6->rpl.dio_stats.rx_consistent++;
+    }
+
     rfc8415_txalg_stop(&ipv6->rpl.dis_txalg);
 
     // TODO: filter candidate neighbors according to
@@ -497,9 +589,10 @@ static void rpl_recv_dis(struct ipv6_ctx *ipv6, const uint8_t *buf, size_t buf_l
         }
     }
 
-    if (IN6_IS_ADDR_MULTICAST(dst))
+    if (IN6_IS_ADDR_MULTICAST(dst)) {
+        ipv6->rpl.dio_stats.rx_inconsistent++;
         trickle_inconsistent(&ipv6->rpl.dio_trickle);
-    else
+    } else
         rpl_send_dio(ipv6, src);
     return;
 
@@ -633,11 +726,12 @@ void rpl_start(struct ipv6_ctx *ipv6)
     BUG_ON(!ipv6->rpl.mrhof.ws_neigh_table);
     BUG_ON(!ipv6->rpl.mrhof.max_link_metric);
     BUG_ON(!ipv6->rpl.mrhof.parent_switch_threshold);
-    ipv6->rpl.mrhof.cur_min_path_cost = ipv6->rpl.mrhof.max_path_cost;
+    rpl_mrhof_init(&ipv6->rpl.mrhof);
 
     strcpy(ipv6->rpl.dio_trickle.debug_name, "dio");
     ipv6->rpl.dio_trickle.cfg = &ipv6->rpl.dio_trickle_cfg;
     ipv6->rpl.dio_trickle.on_transmit = rpl_send_dio_mc;
+    ipv6->rpl.dio_trickle.on_interval_done = rpl_dio_interval_done;
     trickle_init(&ipv6->rpl.dio_trickle);
     ipv6->rpl.dis_txalg.tx = rpl_trig_dis;
     rfc8415_txalg_init(&ipv6->rpl.dis_txalg);
@@ -31,10 +31,23 @@ struct timer_ctxt;
 #define RPL_RANK_INFINITE UINT16_MAX
 
 struct rpl_neigh {
+    struct ipv6_neigh *nce;
     struct rpl_dio dio;
     struct rpl_opt_config config;
     bool is_parent;
     bool dao_ack_received;
+
+    // Private to rpl_mrhof.c
+    bool is_cand;
+    float path_cost;
+    TAILQ_ENTRY(rpl_neigh) cand_link;
+};
+
+struct rpl_dio_stats {
+    uint64_t intervals;
+    uint64_t tx;
+    uint64_t rx_consistent;
+    uint64_t rx_inconsistent;
 };
 
 struct rpl_ctx {
@@ -42,6 +55,14 @@ struct rpl_ctx {
 
     struct trickle       dio_trickle;
     struct trickle_cfg   dio_trickle_cfg;
+    /*
+     * When at least dio_dense_neigh neighbors advertise the same DODAG, the
+     * DIO redundancy constant is lowered and Imin is scaled with the density.
+     * 0 disables. dio_neigh_count is refreshed on every trickle interval.
+     */
+    int dio_dense_neigh;
+    int dio_neigh_count;
+    struct rpl_dio_stats dio_stats;
     struct rfc8415_txalg dis_txalg;
     struct rfc8415_txalg dao_txalg;
     uint8_t dao_seq;
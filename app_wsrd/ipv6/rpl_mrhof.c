@@ -12,6 +12,7 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #include <math.h>
+#include <string.h>
 
 #include "app_wsrd/ipv6/ipv6.h"
 #include "app_wsrd/ipv6/rpl.h"
@@ -29,13 +30,9 @@ static float rpl_mrhof_etx(const struct rpl_mrhof *mrhof, const struct ipv6_neig
 }
 
 // RFC 6719 3.1. Computing the Path Cost
-static float rpl_mrhof_path_cost(const struct ipv6_ctx *ipv6, const struct ipv6_neigh *nce)
+// The ETX is passed by the caller which often already needs it.
+static float rpl_mrhof_path_cost_etx(const struct rpl_mrhof *mrhof, const struct ipv6_neigh *nce, float etx)
 {
-    const struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
-    float etx;
-
-    etx = rpl_mrhof_etx(mrhof, nce);
-
     /*
      * If the selected metric is a link metric and the metric of the link
      * to a neighbor is not available, the path cost for the path through
@@ -54,70 +51,49 @@ static float rpl_mrhof_path_cost(const struct ipv6_ctx *ipv6, const struct ipv6_
     return etx + ntohs(nce->rpl->dio.rank);
 }
 
-// RFC 6719 3.2.2. Parent Selection Algorithm
-void rpl_mrhof_select_parent(struct ipv6_ctx *ipv6)
+static float rpl_mrhof_path_cost(const struct ipv6_ctx *ipv6, const struct ipv6_neigh *nce)
 {
-    struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
-    struct ipv6_neigh *pref_parent_new = NULL;
-    struct ipv6_neigh *pref_parent_cur;
-    struct ipv6_neigh *nce;
-    float pref_path_cost;
-    float path_cost;
-    float etx;
+    const struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
 
-    /*
-     * A node MUST select the candidate neighbor with the lowest path cost as
-     * its preferred parent [...]
-     */
-    pref_path_cost = mrhof->max_path_cost;
-    SLIST_FOREACH(nce, &ipv6->neigh_cache, link) {
-        if (!nce->rpl)
-            continue;
-        // TODO: refuse neighbors with higher rank than self
-
-        etx = rpl_mrhof_etx(mrhof, nce);
-        if (isnan(etx)) {
-            /*
-             *   Wi-SUN FAN 1.1v08 6.3.4.6.3.2.4 FFN Join State 4: Configure Routing
-             * The FFN MUST perform unicast Neighbor Discovery (Neighbor
-             * Solicit using its link local IPv6 address) with all FFNs from
-             * which it has received a RPL DIO (thereby collecting ETX and
-             * bi-directional RSL for the neighbor).
-             */
-            ipv6_nud_set_state(ipv6, nce, IPV6_NUD_PROBE);
-            continue;
-        }
+    return rpl_mrhof_path_cost_etx(mrhof, nce, rpl_mrhof_etx(mrhof, nce));
+}
 
-        /*
-         * If the selected metric for a link is greater than MAX_LINK_METRIC,
-         * the node SHOULD exclude that link from consideration during parent
-         * selection.
-         */
-        if (etx > mrhof->max_link_metric)
-            continue;
+void rpl_mrhof_init(struct rpl_mrhof *mrhof)
+{
+    mrhof->cur_min_path_cost = mrhof->max_path_cost;
+    TAILQ_INIT(&mrhof->cand_list);
+}
 
-        path_cost = rpl_mrhof_path_cost(ipv6, nce);
-        if (path_cost >= pref_path_cost)
-            continue;
-        pref_path_cost  = path_cost;
-        pref_parent_new = nce;
-    }
+static void rpl_mrhof_cand_insert(struct rpl_mrhof *mrhof, struct rpl_neigh *rpl)
+{
+    struct rpl_neigh *cur;
 
-    /*
-     * If the smallest path cost for paths through the candidate neighbors is
-     * smaller than cur_min_path_cost by less than PARENT_SWITCH_THRESHOLD, the
-     * node MAY continue to use the current preferred parent.
-     */
-    if (pref_path_cost + mrhof->parent_switch_threshold > mrhof->cur_min_path_cost)
-        return;
-    mrhof->cur_min_path_cost = pref_path_cost;
+    TAILQ_FOREACH(cur, &mrhof->cand_list, cand_link)
+        if (cur->path_cost > rpl->path_cost)
+            break;
+    if (cur)
+        TAILQ_INSERT_BEFORE(cur, rpl, cand_link);
+    else
+        TAILQ_INSERT_TAIL(&mrhof->cand_list, rpl, cand_link);
+    rpl->is_cand = true;
+}
 
-    pref_parent_cur = rpl_neigh_pref_parent(ipv6);
-    if (pref_parent_new == pref_parent_cur)
+static void rpl_mrhof_cand_remove(struct rpl_mrhof *mrhof, struct rpl_neigh *rpl)
+{
+    if (!rpl->is_cand)
         return;
+    TAILQ_REMOVE(&mrhof->cand_list, rpl, cand_link);
+    rpl->is_cand = false;
+}
+
+static void rpl_mrhof_set_pref_parent(struct ipv6_ctx *ipv6, struct ipv6_neigh *pref_parent_new)
+{
+    struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
+    struct ipv6_neigh *pref_parent_cur = mrhof->pref_parent;
 
     if (pref_parent_cur)
         pref_parent_cur->rpl->is_parent = false;
+    mrhof->pref_parent = pref_parent_new;
     if (pref_parent_new) {
         pref_parent_new->rpl->is_parent = true;
         TRACE(TR_RPL, "rpl: parent select %s", tr_ipv6(pref_parent_new->gua.s6_addr));
@@ -132,6 +108,132 @@ void rpl_mrhof_select_parent(struct ipv6_ctx *ipv6)
     // TODO: support secondary parents
 }
 
+// RFC 6719 3.2.2. Parent Selection Algorithm
+static void rpl_mrhof_select_parent(struct ipv6_ctx *ipv6)
+{
+    struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
+    struct rpl_neigh *cand = TAILQ_FIRST(&mrhof->cand_list);
+    struct ipv6_neigh *pref_parent = mrhof->pref_parent;
+
+    /*
+     * cur_min_path_cost is the path cost of the current preferred parent. A
+     * preferred parent which is no longer a candidate (link excluded, metric
+     * unknown) can be replaced by any candidate.
+     */
+    if (pref_parent && pref_parent->rpl->is_cand)
+        mrhof->cur_min_path_cost = pref_parent->rpl->path_cost;
+    else
+        mrhof->cur_min_path_cost = mrhof->max_path_cost;
+
+    /*
+     * A node MUST select the candidate neighbor with the lowest path cost as
+     * its preferred parent [...]
+     */
+    if (!cand || cand->nce == pref_parent)
+        return;
+
+    /*
+     * If the smallest path cost for paths through the candidate neighbors is
+     * smaller than cur_min_path_cost by less than PARENT_SWITCH_THRESHOLD, the
+     * node MAY continue to use the current preferred parent.
+     */
+    if (cand->path_cost + mrhof->parent_switch_threshold > mrhof->cur_min_path_cost)
+        return;
+    mrhof->cur_min_path_cost = cand->path_cost;
+    rpl_mrhof_set_pref_parent(ipv6, cand->nce);
+}
+
+void rpl_mrhof_update(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce)
+{
+    struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
+    float etx;
+
+    // TODO: refuse neighbors with higher rank than self
+    rpl_mrhof_cand_remove(mrhof, nce->rpl);
+    etx = rpl_mrhof_etx(mrhof, nce);
+    if (isnan(etx)) {
+        /*
+         *   Wi-SUN FAN 1.1v08 6.3.4.6.3.2.4 FFN Join State 4: Configure Routing
+         * The FFN MUST perform unicast Neighbor Discovery (Neighbor
+         * Solicit using its link local IPv6 address) with all FFNs from
+         * which it has received a RPL DIO (thereby collecting ETX and
+         * bi-directional RSL for the neighbor).
+         */
+        ipv6_nud_set_state(ipv6, nce, IPV6_NUD_PROBE);
+    } else if (etx <= mrhof->max_link_metric) {
+        /*
+         * If the selected metric for a link is greater than MAX_LINK_METRIC,
+         * the node SHOULD exclude that link from consideration during parent
+         * selection.
+         */
+        nce->rpl->path_cost = rpl_mrhof_path_cost_etx(mrhof, nce, etx);
+        if (nce->rpl->path_cost < mrhof->max_path_cost)
+            rpl_mrhof_cand_insert(mrhof, nce->rpl);
+    }
+    rpl_mrhof_select_parent(ipv6);
+}
+
+void rpl_mrhof_remove(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce)
+{
+    struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
+
+    rpl_mrhof_cand_remove(mrhof, nce->rpl);
+    if (mrhof->pref_parent != nce)
+        return;
+    nce->rpl->is_parent = false;
+    mrhof->pref_parent = NULL;
+    rpl_mrhof_select_parent(ipv6);
+    if (!mrhof->pref_parent && mrhof->on_pref_parent_change)
+        mrhof->on_pref_parent_change(mrhof, NULL);
+}
+
+static bool rpl_mrhof_multipath_eligible(const struct ipv6_neigh *pref_parent, const struct rpl_neigh *cand)
+{
+    if (cand->nce == pref_parent)
+        return true;
+    if (cand->dio.instance_id != pref_parent->rpl->dio.instance_id ||
+        cand->dio.dodag_verno != pref_parent->rpl->dio.dodag_verno ||
+        memcmp(cand->dio.dodag_id.s6_addr, pref_parent->rpl->dio.dodag_id.s6_addr, 16))
+        return false;
+    /*
+     * The path cost through the preferred parent is a lower bound of our Rank
+     * (see rpl_mrhof_rank()). A neighbor with a lower Rank is thus closer to
+     * the root than us, and cannot send the packet back.
+     */
+    return ntohs(cand->dio.rank) < pref_parent->rpl->path_cost;
+}
+
+/*
+ * Only the preferred parent is advertised in DAOs, the other parents are used
+ * upstream only. The candidate list is sorted by path cost, the selection is
+ * stable as long as the candidates do not change, so a flow is not reordered.
+ */
+struct ipv6_neigh *rpl_mrhof_multipath_parent(struct ipv6_ctx *ipv6, uint32_t hash)
+{
+    struct rpl_mrhof *mrhof = &ipv6->rpl.mrhof;
+    struct ipv6_neigh *pref_parent = mrhof->pref_parent;
+    struct rpl_neigh *cand;
+    float max_path_cost;
+    int count = 0;
+
+    if (!pref_parent || !pref_parent->rpl->is_cand || !mrhof->multipath_threshold)
+        return pref_parent;
+    max_path_cost = pref_parent->rpl->path_cost + mrhof->multipath_threshold;
+    TAILQ_FOREACH(cand, &mrhof->cand_list, cand_link) {
+        if (cand->path_cost > max_path_cost)
+            break;
+        if (rpl_mrhof_multipath_eligible(pref_parent, cand))
+            count++;
+    }
+    if (count <= 1)
+        return pref_parent;
+    hash %= count;
+    TAILQ_FOREACH(cand, &mrhof->cand_list, cand_link)
+        if (rpl_mrhof_multipath_eligible(pref_parent, cand) && !hash--)
+            return cand->nce;
+    BUG();
+}
+
 static uint16_t rpl_mrhof_path_rank(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce)
 {
     float path_cost;
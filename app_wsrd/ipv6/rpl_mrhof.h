@@ -14,6 +14,7 @@
 #ifndef RPL_MRHOF_H
 #define RPL_MRHOF_H
 
+#include <sys/queue.h>
 #include <stdint.h>
 
 #include "common/bits.h"
@@ -26,8 +27,12 @@
 
 struct ipv6_ctx;
 struct ipv6_neigh;
+struct rpl_neigh;
 struct ws_neigh_table;
 
+// Declare struct rpl_mrhof_cand_list
+TAILQ_HEAD(rpl_mrhof_cand_list, rpl_neigh);
+
 struct rpl_mrhof {
     float max_link_metric;
     float max_path_cost;
@@ -36,7 +41,19 @@ struct rpl_mrhof {
     float cand_parent_threshold;
     float cand_parent_hysteresis;
 
+    // Upstream traffic is spread over the candidates whose path cost exceeds
+    // the one of the preferred parent by at most this value. 0 disables.
+    float multipath_threshold;
+
     float cur_min_path_cost;
+    struct ipv6_neigh *pref_parent;
+
+    /*
+     * Candidate neighbors sorted by increasing path cost, the head is the best
+     * candidate. The path cost of a neighbor is only recomputed when its rank
+     * or its ETX change, see rpl_mrhof_update().
+     */
+    struct rpl_mrhof_cand_list cand_list;
 
     // Required for retrieving link metrics.
     const struct ws_neigh_table *ws_neigh_table;
@@ -44,7 +61,13 @@ struct rpl_mrhof {
     void (*on_pref_parent_change)(struct rpl_mrhof *mrhof, struct ipv6_neigh *neigh);
 };
 
-void rpl_mrhof_select_parent(struct ipv6_ctx *ipv6);
+void rpl_mrhof_init(struct rpl_mrhof *mrhof);
+// To be called when the rank or the ETX of a RPL neighbor change.
+void rpl_mrhof_update(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce);
+// To be called before a RPL neighbor is freed.
+void rpl_mrhof_remove(struct ipv6_ctx *ipv6, struct ipv6_neigh *nce);
 uint16_t rpl_mrhof_rank(struct ipv6_ctx *ipv6);
+// Select the next hop of an upstream packet, hash identifies the flow.
+struct ipv6_neigh *rpl_mrhof_multipath_parent(struct ipv6_ctx *ipv6, uint32_t hash);
 
 #endif
@@ -29,6 +29,7 @@
 #include "common/mbedtls_extra.h"
 #include "common/string_extra.h"
 #include "common/time_extra.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
 #include "common/eapol.h"
 #include "common/iobuf.h"
@@ -63,6 +64,7 @@ static void supp_failure_key_request(struct rfc8415_txalg *txalg)
     struct supp_ctx *supp = container_of(txalg, struct supp_ctx, key_request_txalg);
 
     TRACE(TR_SECURITY, "sec: no valid response to key request after %d retries", supp->key_request_txalg.mrc);
+    supp->key_request_failures++;
     supp->on_failure(supp);
 }
 
@@ -82,7 +84,8 @@ static void supp_timeout_key_request(struct rfc8415_txalg *txalg)
     uint8_t gtkl = 0;
     int i;
 
-    ieee80211_derive_pmkid(supp->tls_client.pmk.key, supp->authenticator_eui64, supp->eui64, pmkid);
+    ieee80211_derive_pmkid(&supp->tls_client.key_cache, supp->tls_client.pmk.key,
+                           supp->authenticator_eui64, supp->eui64, pmkid);
     ws_derive_ptkid(supp->tls_client.ptk.key, supp->authenticator_eui64, supp->eui64, ptkid);
 
     for (i = 0; i < WS_GTK_COUNT; i++)
@@ -226,10 +229,20 @@ bool supp_gtkhash_mismatch(struct supp_ctx *supp, const uint8_t gtkhash[8], uint
     return mismatch;
 }
 
+/*
+ * A GTKHASH change is noticed by a whole neighborhood at once (typically after
+ * a border router restart), which then competes for the same authenticator.
+ * On top of the random initial delay, the delay window is doubled after each
+ * unanswered key request so nodes which failed together do not retry together.
+ */
 void supp_start_key_request(struct supp_ctx *supp)
 {
     if (!rfc8415_txalg_stopped(&supp->key_request_txalg) || !timer_stopped(&supp->failure_timer))
         return;
+    supp->key_request_txalg.max_delay_s = supp->key_request_max_delay_s << MIN(supp->key_request_failures, 4);
+    if (supp->key_request_txalg.mrt_s)
+        supp->key_request_txalg.max_delay_s = MIN(supp->key_request_txalg.max_delay_s,
+                                                  supp->key_request_txalg.mrt_s);
     rfc8415_txalg_start(&supp->key_request_txalg);
     supp->running = true;
     TRACE(TR_SECURITY, "sec: %-8s tx=%"PRIu64"ms", "eapol-key",
@@ -259,8 +272,22 @@ void supp_init(struct supp_ctx *supp, struct iovec *ca_cert, struct iovec *cert,
     for (int i = 0; i < ARRAY_SIZE(supp->gtks); i++)
         supp->gtks[i].expiration_timer.callback = supp_gtk_expiration_timer_timeout;
     rfc8415_txalg_init(&supp->key_request_txalg);
+    supp->key_request_max_delay_s = supp->key_request_txalg.max_delay_s;
     memcpy(supp->eui64, eui64, sizeof(supp->eui64));
 
     tls_init(&supp->tls, MBEDTLS_SSL_IS_CLIENT, ca_cert, cert, key);
     tls_init_client(&supp->tls, &supp->tls_client);
+    mbedtls_ssl_session_init(&supp->tls_session);
+    if (supp->tls_workers) {
+#if defined(MBEDTLS_USE_PSA_CRYPTO) && !defined(MBEDTLS_THREADING_C)
+        FATAL(1, "tls_workers requires mbedtls built with MBEDTLS_THREADING_C");
+#endif
+        // Traces are not thread safe
+        if (g_enabled_traces & TR_MBEDTLS)
+            WARN("mbedtls traces are disabled with TLS worker threads");
+        mbedtls_ssl_conf_dbg(&supp->tls.ssl_config, NULL, NULL);
+        // The worker thread must not call tls_install_pmk()
+        supp->tls_client.pmk_defer = true;
+        work_pool_init(&supp->tls_pool, supp->tls_workers);
+    }
 }
@@ -46,6 +46,7 @@
 #include "common/rfc8415_txalg.h"
 #include "common/pktbuf.h"
 #include "common/timer.h"
+#include "common/work_pool.h"
 
 struct supp_ctx {
     uint8_t eui64[8];
@@ -53,9 +54,23 @@ struct supp_ctx {
 
     struct tls_client_ctx tls_client;
     struct tls_ctx tls;
+    // Offered to the authenticator which established it for an abbreviated
+    // handshake (RFC 5246 7.3)
+    struct mbedtls_ssl_session tls_session;
+    uint8_t tls_session_eui64[8];
+    bool tls_session_set;
 
     bool eap_tls_start_received;
 
+    // EAP-TLS handshake offloaded to a worker thread
+    int tls_workers; // 0 to run the TLS handshake in the main thread
+    struct work_pool tls_pool;
+    struct work_item tls_job;
+    bool    tls_job_busy;
+    bool    tls_job_reset;
+    int     tls_job_status;
+    uint8_t tls_job_eap_id;
+
     // EAP-TLS TX Fragmentation
     int fragment_id;
 
@@ -74,6 +89,9 @@ struct supp_ctx {
     uint8_t snonce[32];
 
     struct rfc8415_txalg key_request_txalg;
+    // Consecutive key requests without response, see supp_start_key_request()
+    int key_request_failures;
+    int key_request_max_delay_s;
     struct timer_entry   failure_timer;
     struct timer_group   timer_group;
     /*
@@ -16,6 +16,7 @@
 #include "common/specs/eap.h"
 #include "common/specs/ws.h"
 #include "common/mbedtls_extra.h"
+#include "common/memutils.h"
 #include "common/mathutils.h"
 #include "common/eapol.h"
 #include "common/iobuf.h"
@@ -38,7 +39,7 @@ static void supp_eap_send_response(struct supp_ctx *supp, uint8_t identifier, ui
     supp->last_tx_eap_type = type;
 }
 
-static void supp_eap_tls_send_response(struct supp_ctx *supp, const struct eap_hdr *eap_hdr)
+static void supp_eap_tls_send_response(struct supp_ctx *supp, uint8_t identifier)
 {
     bool must_fragment = pktbuf_len(&supp->tls_client.io.tx) > WS_MTU_BYTES;
     uint32_t tx_len = pktbuf_len(&supp->tls_client.io.tx);
@@ -58,20 +59,15 @@ static void supp_eap_tls_send_response(struct supp_ctx *supp, const struct eap_h
 
     pktbuf_push_head_u8(&buf, flags);
 
-    supp_eap_send_response(supp, eap_hdr->identifier, EAP_TYPE_TLS, &buf);
+    supp_eap_send_response(supp, identifier, EAP_TYPE_TLS, &buf);
     pktbuf_free(&buf);
     supp->fragment_id++;
 }
 
-static void supp_eap_do_handshake(struct supp_ctx *supp, const struct eap_hdr *eap_hdr)
+static void supp_eap_handshake_done(struct supp_ctx *supp, uint8_t identifier, int ret)
 {
     struct pktbuf buf = { };
-    int ret;
-
-    pktbuf_free(&supp->tls_client.io.tx);
-    supp->fragment_id = 0;
 
-    ret = mbedtls_ssl_handshake(&supp->tls_client.ssl_ctx);
     /*
      *   RFC5216 - 2.1.3. Termination
      * If the EAP server authenticates successfully, the peer MUST send an
@@ -79,8 +75,13 @@ static void supp_eap_do_handshake(struct supp_ctx *supp, const struct eap_hdr *e
      * then MUST respond with an EAP-Success message.
      */
     if (!ret) {
+        mbedtls_ssl_session_free(&supp->tls_session);
+        mbedtls_ssl_session_init(&supp->tls_session);
+        ret = mbedtls_ssl_get_session(&supp->tls_client.ssl_ctx, &supp->tls_session);
+        supp->tls_session_set = !ret;
+        memcpy(supp->tls_session_eui64, supp->authenticator_eui64, sizeof(supp->tls_session_eui64));
         pktbuf_push_tail_u8(&buf, 0); // eap-tls flags
-        supp_eap_send_response(supp, eap_hdr->identifier, EAP_TYPE_TLS, &buf);
+        supp_eap_send_response(supp, identifier, EAP_TYPE_TLS, &buf);
         pktbuf_free(&buf);
         return;
     }
@@ -104,7 +105,46 @@ static void supp_eap_do_handshake(struct supp_ctx *supp, const struct eap_hdr *e
      */
     WARN_ON(ret != MBEDTLS_ERR_SSL_WANT_READ, "%s: mbedtls_ssl_handshake: %s", __func__, tr_mbedtls_err(ret));
     if (pktbuf_len(&supp->tls_client.io.tx) || ret != MBEDTLS_ERR_SSL_WANT_READ)
-        supp_eap_tls_send_response(supp, eap_hdr);
+        supp_eap_tls_send_response(supp, identifier);
+}
+
+// Runs on a worker thread
+static void supp_eap_handshake_work(struct work_pool *pool, struct work_item *item)
+{
+    struct supp_ctx *supp = container_of(item, struct supp_ctx, tls_job);
+
+    supp->tls_job_status = mbedtls_ssl_handshake(&supp->tls_client.ssl_ctx);
+}
+
+static void supp_eap_handshake_work_done(struct work_pool *pool, struct work_item *item)
+{
+    struct supp_ctx *supp = container_of(item, struct supp_ctx, tls_job);
+
+    supp->tls_job_busy = false;
+    if (supp->tls_job_reset) {
+        // The result of the handshake is obsolete
+        supp->tls_client.pmk_pending = false;
+        supp_eap_tls_reset(supp);
+        return;
+    }
+    tls_install_pending_pmk(&supp->tls_client);
+    supp_eap_handshake_done(supp, supp->tls_job_eap_id, supp->tls_job_status);
+}
+
+static void supp_eap_do_handshake(struct supp_ctx *supp, const struct eap_hdr *eap_hdr)
+{
+    pktbuf_free(&supp->tls_client.io.tx);
+    supp->fragment_id = 0;
+
+    if (!supp->tls_workers) {
+        supp_eap_handshake_done(supp, eap_hdr->identifier, mbedtls_ssl_handshake(&supp->tls_client.ssl_ctx));
+        return;
+    }
+    supp->tls_job.work = supp_eap_handshake_work;
+    supp->tls_job.done = supp_eap_handshake_work_done;
+    supp->tls_job_eap_id = eap_hdr->identifier;
+    supp->tls_job_busy = true;
+    work_pool_submit(&supp->tls_pool, &supp->tls_job);
 }
 
 static void supp_eap_tls_recv(struct supp_ctx *supp, const struct eap_hdr *eap_hdr, struct iobuf_read *iobuf)
@@ -183,7 +223,7 @@ static void supp_eap_tls_recv(struct supp_ctx *supp, const struct eap_hdr *eap_h
      * before sending another fragment.
      */
     if (!remaining_size) {
-        supp_eap_tls_send_response(supp, eap_hdr);
+        supp_eap_tls_send_response(supp, eap_hdr->identifier);
         return;
     }
 
@@ -208,6 +248,12 @@ static void supp_eap_tls_recv(struct supp_ctx *supp, const struct eap_hdr *eap_h
 
 void supp_eap_tls_reset(struct supp_ctx *supp)
 {
+    // The TLS context belongs to the worker thread until the handshake returns
+    if (supp->tls_job_busy) {
+        supp->tls_job_reset = true;
+        return;
+    }
+    supp->tls_job_reset = false;
     supp->last_tx_eap_type = EAP_TYPE_NAK;
     supp->last_eap_identifier = -1;
     supp->eap_tls_start_received = false;
@@ -217,6 +263,11 @@ void supp_eap_tls_reset(struct supp_ctx *supp)
     supp->expected_rx_len = 0;
     supp->fragment_id = 0;
     mbedtls_ssl_session_reset(&supp->tls_client.ssl_ctx);
+    // The authenticator falls back to a full handshake if it does not know
+    // the session anymore
+    if (supp->tls_session_set &&
+        !memcmp(supp->tls_session_eui64, supp->authenticator_eui64, sizeof(supp->tls_session_eui64)))
+        mbedtls_ssl_set_session(&supp->tls_client.ssl_ctx, &supp->tls_session);
 }
 
 /*
@@ -315,6 +366,10 @@ void supp_eap_recv(struct supp_ctx *supp, struct iobuf_read *iobuf)
         TRACE(TR_DROP, "drop %-9s: invalid eap header", "eap");
         return;
     }
+    if (supp->tls_job_busy) {
+        TRACE(TR_DROP, "drop %-9s: tls handshake in progress", "eap");
+        return;
+    }
 
     switch (eap_hdr->code) {
     case EAP_CODE_REQUEST:
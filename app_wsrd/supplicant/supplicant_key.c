@@ -19,7 +19,6 @@
 #include "common/specs/ieee80211.h"
 #include "common/specs/eapol.h"
 #include "common/crypto/ieee80211.h"
-#include "common/crypto/hmac_md.h"
 #include "common/crypto/nist_kw.h"
 #include "common/crypto/ws_keys.h"
 #include "common/time_extra.h"
@@ -61,9 +60,7 @@ static void supp_key_message_send(struct supp_ctx *supp, struct eapol_key_frame
      *   IEEE 802.11-2020, 12.7.6 4-way handshake
      * MIC(KCK, EAPOL)
      */
-    hmac_md_sha1(ieee80211_kck(ptk), IEEE80211_AKM_1_KCK_LEN_BYTES,
-                 pktbuf_head(&buf), pktbuf_len(&buf),
-                 response->mic, sizeof(response->mic));
+    ieee80211_mic_compute(&supp->tls_client.key_cache, ptk, pktbuf_head(&buf), pktbuf_len(&buf), response->mic);
 
     // Update MIC
     pktbuf_pop_tail(&buf, NULL, sizeof(*response));
@@ -130,7 +127,7 @@ static bool supp_key_is_mic_valid(struct supp_ctx *supp, const struct eapol_key_
     else
         ptk = supp->tls_client.ptk.key;
 
-    if (!ieee80211_is_mic_valid(ptk, frame, iobuf_ptr(iobuf), iobuf_remaining_size(iobuf)))
+    if (!ieee80211_is_mic_valid(&supp->tls_client.key_cache, ptk, frame, iobuf_ptr(iobuf), iobuf_remaining_size(iobuf)))
         return false;
 
     /*
@@ -330,6 +327,7 @@ static void supp_key_group_message_1_recv(struct supp_ctx *supp, const struct ea
     supp_key_group_message_2_send(supp);
     // We may have started the key request txalg after a gtkhash missmatch
     rfc8415_txalg_stop(&supp->key_request_txalg);
+    supp->key_request_failures = 0;
 }
 
 static void supp_key_pairwise_message_3_recv(struct supp_ctx *supp, const struct eapol_key_frame *frame,
@@ -404,7 +402,8 @@ static void supp_key_pairwise_message_1_recv(struct supp_ctx *supp, const struct
         goto exit;
     }
 
-    ieee80211_derive_pmkid(supp->tls_client.pmk.key, supp->authenticator_eui64, supp->eui64, pmkid);
+    ieee80211_derive_pmkid(&supp->tls_client.key_cache, supp->tls_client.pmk.key,
+                           supp->authenticator_eui64, supp->eui64, pmkid);
 
     if (!kde_read_pmkid(iobuf_ptr(data), iobuf_remaining_size(data), received_pmkid)) {
         TRACE(TR_DROP, "drop %-9s: missing pmkid", "eapol-key");
@@ -431,6 +430,7 @@ static void supp_key_pairwise_message_1_recv(struct supp_ctx *supp, const struct
     supp_key_pairwise_message_2_send(supp, frame);
     // We may have started the key request txalg after a gtkhash missmatch
     rfc8415_txalg_stop(&supp->key_request_txalg);
+    supp->key_request_failures = 0;
 
 exit:
     timer_start_rel(NULL, &supp->failure_timer, supp->timeout_ms);
@@ -23,6 +23,7 @@
 #include "common/specs/eapol.h"
 #include "common/specs/ws.h"
 #include "common/crypto/ieee80211.h"
+#include "common/crypto/ws_keys.h"
 #include "common/ws/eapol_relay.h"
 #include "common/sys_queue_extra.h"
 #include "common/named_values.h"
@@ -60,6 +61,7 @@ static void auth_gtk_expiration_timer_timeout(struct timer_group *group, struct
         auth->on_gtk_change(auth, NULL, slot + 1, false);
     TRACE(TR_SECURITY, "sec: expired %s", tr_gtkname(slot));
     memset(gtk->key, 0, sizeof(gtk->key));
+    memset(auth->gtkhashes[slot], 0, sizeof(auth->gtkhashes[slot]));
 }
 
 /*
@@ -122,6 +124,7 @@ static void auth_gtk_install_timer_timeout(struct timer_group *group, struct tim
         memcpy(new->key, auth->cfg->gtk_init[slot_install], 16);
     else
         rand_get_n_bytes_random(new->key, sizeof(new->key));
+    ws_generate_gtkhash(new->key, auth->gtkhashes[slot_install]);
 
     /*
      *   Wi-SUN FAN 1.1v09 6.3.1.1 Configuration Parameters
@@ -187,6 +190,12 @@ static void auth_rt_timer_timeout(struct timer_group *group, struct timer_entry
 
     supp->rt_count++;
 
+    // Uses its own backoff and failover
+    if (!supp->rt_kmp_id) {
+        radius_rt_timeout(auth, supp);
+        return;
+    }
+
     /*
      *     IEEE 802.11-2020 C.3 MIB detail
      * dot11RSNAConfigPairwiseUpdateCount [...] DEFVAL { 3 }
@@ -194,35 +203,36 @@ static void auth_rt_timer_timeout(struct timer_group *group, struct timer_entry
      * A maximum of 3-5 retransmissions is suggested.
      */
     if (supp->rt_count == 3) {
-        TRACE(TR_SECURITY, "sec: %s max retry count exceeded eui64=%s",
-              supp->rt_kmp_id ? "eapol" : "radius", tr_eui64(supp->eui64.u8));
-        if (!supp->rt_kmp_id)
-            supp->radius.id = -1; // Cancel transaction
+        TRACE(TR_SECURITY, "sec: eapol max retry count exceeded eui64=%s", tr_eui64(supp->eui64.u8));
         timer_stop(group, timer);
         return;
     }
-    TRACE(TR_SECURITY, "sec: %s frame retry eui64=%s",
-          supp->rt_kmp_id ? "eapol" : "radius", tr_eui64(supp->eui64.u8));
+    TRACE(TR_SECURITY, "sec: eapol frame retry eui64=%s", tr_eui64(supp->eui64.u8));
 
     // Update replay counter and MIC on retry
     if (supp->rt_kmp_id == IEEE802159_KMP_ID_80211_4WH || supp->rt_kmp_id == IEEE802159_KMP_ID_80211_GKH)
         auth_key_refresh_rt_buffer(supp);
 
-    if (supp->rt_kmp_id)
-        auth_send_eapol(auth, supp, supp->rt_kmp_id,
-                        pktbuf_head(&supp->rt_buffer),
-                        pktbuf_len(&supp->rt_buffer));
-    else
-        radius_send(auth, supp,
+    auth_send_eapol(auth, supp, supp->rt_kmp_id,
                     pktbuf_head(&supp->rt_buffer),
                     pktbuf_len(&supp->rt_buffer));
 }
 
+static struct auth_supp_ctx_list *auth_supp_bucket(struct auth_ctx *auth, const struct eui64 *eui64)
+{
+    uint64_t key;
+
+    // Same as ws_neigh_bucket()
+    memcpy(&key, eui64->u8, sizeof(key));
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return &auth->supp_hash[key >> (64 - AUTH_SUPP_HASH_BITS)];
+}
+
 struct auth_supp_ctx *auth_get_supp(struct auth_ctx *auth, const struct eui64 *eui64)
 {
     struct auth_supp_ctx *supp;
 
-    SLIST_FIND(supp, &auth->supplicants, link, !memcmp(&supp->eui64, eui64, sizeof(supp->eui64)));
+    SLIST_FIND(supp, auth_supp_bucket(auth, eui64), hash_link, !memcmp(&supp->eui64, eui64, sizeof(supp->eui64)));
     return supp;
 }
 
@@ -241,7 +251,11 @@ struct auth_supp_ctx *auth_fetch_supp(struct auth_ctx *auth, const struct eui64
     supp->rt_timer.callback = auth_rt_timer_timeout;
     if (auth->radius_fd < 0)
         tls_init_client(&auth->tls, &supp->eap_tls.tls);
+    memcpy(supp->eap_tls.tls.eui64, eui64->u8, sizeof(supp->eap_tls.tls.eui64));
+    // The worker thread must not call tls_install_pmk()
+    supp->eap_tls.tls.pmk_defer = auth->tls_pool.thread_count;
     SLIST_INSERT_HEAD(&auth->supplicants, supp, link);
+    SLIST_INSERT_HEAD(auth_supp_bucket(auth, eui64), supp, hash_link);
     TRACE(TR_SECURITY, "sec: %-8s eui64=%s", "supp add", tr_eui64(supp->eui64.u8));
     return supp;
 }
@@ -252,6 +266,10 @@ int auth_revoke_pmk(struct auth_ctx *auth, const struct eui64 *eui64)
     struct tls_pmk *pmk;
     struct tls_ptk *ptk;
 
+    // Otherwise the supplicant could resume its TLS session. Cached sessions
+    // may be restored from storage before the supplicant context exists.
+    if (auth->radius_fd < 0)
+        tls_session_del(&auth->tls, eui64->u8);
     supp = auth_get_supp(auth, eui64);
     if (!supp)
         return -ENODEV;
@@ -343,12 +361,28 @@ void auth_start(struct auth_ctx *auth, const struct eui64 *eui64, bool enable_lf
     BUG_ON(!auth->sendto_mac);
     BUG_ON(!auth->cfg);
 
-    if (auth->cfg->radius_addr.ss_family != AF_UNSPEC)
-        radius_init(auth, (const struct sockaddr *)&auth->cfg->radius_addr);
+    if (auth->cfg->radius_addr[0].ss_family != AF_UNSPEC)
+        radius_init(auth);
     else
         tls_init(&auth->tls, MBEDTLS_SSL_IS_SERVER, &auth->cfg->ca_cert, &auth->cfg->cert, &auth->cfg->key);
+    if (auth->radius_fd < 0) {
+        tls_session_cache_init(&auth->tls, auth->cfg->tls_session_cache_size);
+        tls_session_cache_load(&auth->tls);
+    }
+    if (auth->radius_fd < 0 && auth->cfg->tls_workers) {
+#if defined(MBEDTLS_USE_PSA_CRYPTO) && !defined(MBEDTLS_THREADING_C)
+        FATAL(1, "tls_workers requires mbedtls built with MBEDTLS_THREADING_C");
+#endif
+        // Traces are not thread safe
+        if (g_enabled_traces & TR_MBEDTLS)
+            WARN("mbedtls traces are disabled with TLS worker threads");
+        mbedtls_ssl_conf_dbg(&auth->tls.ssl_config, NULL, NULL);
+        work_pool_init(&auth->tls_pool, auth->cfg->tls_workers);
+    }
 
     SLIST_INIT(&auth->supplicants);
+    for (int i = 0; i < ARRAY_SIZE(auth->supp_hash); i++)
+        SLIST_INIT(&auth->supp_hash[i]);
     timer_group_init(&auth->timer_group);
     auth->eui64 = *eui64;
     auth->gtk_group.activation_timer.callback = auth_gtk_activation_timer_timeout;
@@ -25,6 +25,7 @@
 #include "common/ieee802154_frame.h"
 #include "common/pktbuf.h"
 #include "common/timer.h"
+#include "common/work_pool.h"
 
 struct auth_supp_ctx {
     struct eui64 eui64;
@@ -44,15 +45,22 @@ struct auth_supp_ctx {
     uint8_t  snonce[32];
 
     uint8_t eap_id;
+    int eap_round_count; // EAP requests sent since the EAP-Request/Identity
 
     struct {
         int      frag_id;
         uint32_t frag_expected_len;
         struct tls_client_ctx tls;
         int last_mbedtls_status; // Used to send EAP-Success/Failure messages
+        // Handshake running in auth->tls_pool, tls must not be accessed
+        struct work_item job;
+        bool job_busy;
+        int job_status;
     } eap_tls;
 
     struct {
+        struct auth_radius_server *server; // Server handling the conversation
+        struct auth_radius_sock *sock; // NULL if no transaction is on-going
         int     id;
         uint8_t auth[16];
         uint8_t state[253];
@@ -62,11 +70,40 @@ struct auth_supp_ctx {
     struct in6_addr eapol_target;
 
     SLIST_ENTRY(auth_supp_ctx) link;
+    SLIST_ENTRY(auth_supp_ctx) hash_link;
 };
 
 // Declare struct auth_supp_ctx_list
 SLIST_HEAD(auth_supp_ctx_list, auth_supp_ctx);
 
+#define AUTH_SUPP_HASH_BITS 10
+
+#define AUTH_RADIUS_SERVER_MAX 4
+#define AUTH_RADIUS_SOCK_MAX  16
+
+/*
+ *   RFC 2865 3. Packet Format
+ * The RADIUS server can detect a duplicate request if it has the same client
+ * source IP address and source UDP port and Identifier within a short span of
+ * time.
+ * Each socket uses its own source port, and thus its own identifier space.
+ */
+struct auth_radius_sock {
+    int fd;
+    struct auth_radius_server *server;
+    uint8_t id_next;
+    int pending_count;
+    struct auth_supp_ctx *pending[256]; // Indexed by RADIUS identifier
+};
+
+struct auth_radius_server {
+    const struct sockaddr_storage *addr;
+    struct auth_radius_sock *socks;
+    int sock_count;
+    int pending_count;
+    uint64_t dead_until_ms; // Skipped by the load balancing until then
+};
+
 struct auth_node_cfg {
     int gtk_expire_offset_s; // 0 for infinite
     int gtk_new_install_required; // Percentage of GTK_EXPIRE_OFFSET
@@ -87,30 +124,45 @@ struct auth_cfg {
     struct iovec ca_cert;
     struct iovec cert;
     struct iovec key;
-    struct sockaddr_storage radius_addr;
+    struct sockaddr_storage radius_addr[AUTH_RADIUS_SERVER_MAX]; // AF_UNSPEC for unused entries
+    int radius_sockets; // Per server
     char radius_secret[256];
     uint8_t gtk_init[WS_GTK_COUNT + WS_LGTK_COUNT][16];
+    int tls_workers; // 0 to run TLS handshakes in the main thread
+    int active_supp_max; // Only used by the legacy authenticator
+    int tls_session_cache_size; // 0 to disable TLS session resumption
+    int eap_tls_frag_len; // TLS data per EAP-TLS fragment, 0 for WS_MTU_BYTES
 };
 
 struct auth_ctx {
     struct eui64 eui64;
 
     struct tls_ctx tls;
+    struct work_pool tls_pool; // Unused if thread_count is 0
 
     const struct auth_cfg *cfg;
     struct ws_gtk gtks[WS_GTK_COUNT + WS_LGTK_COUNT];
+    // Computed on install for the GTKHASH-IE and LGTKHASH-IE, zeroed on
+    // expiration
+    uint8_t gtkhashes[WS_GTK_COUNT + WS_LGTK_COUNT][8];
     struct auth_gtk_group gtk_group;
     struct auth_gtk_group lgtk_group;
 
-    int     radius_fd;
-    uint8_t radius_id_next;
+    int radius_fd; // epoll instance watching the RADIUS sockets
+    struct auth_radius_server radius_servers[AUTH_RADIUS_SERVER_MAX];
+    int radius_server_count;
 
     int eapol_relay_fd;
 
     struct auth_supp_ctx_list supplicants;
+    struct auth_supp_ctx_list supp_hash[1 << AUTH_SUPP_HASH_BITS];
     struct timer_group timer_group;
     uint64_t timeout_ms;
 
+    // Completed EAP authentications, and EAP requests they took
+    uint64_t eap_success_count;
+    uint64_t eap_round_count;
+
     void (*sendto_mac)(struct auth_ctx *auth, uint8_t kmp_id, const void *pkt,
                        size_t pkt_len, const struct eui64 *dst);
     /*
@@ -19,6 +19,7 @@
 #include "common/specs/ieee802159.h"
 #include "common/specs/ws.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/eap.h"
 #include "common/endian.h"
 #include "common/eapol.h"
@@ -37,6 +38,15 @@ void auth_eap_send(struct auth_ctx *auth, struct auth_supp_ctx *supp, struct pkt
     BUG_ON(pktbuf_len(pktbuf) < sizeof(eap));
     eap = *(const struct eap_hdr *)pktbuf_head(pktbuf);
     supp->eap_id = eap.identifier;
+    if (eap.code == EAP_CODE_REQUEST)
+        supp->eap_round_count++;
+    if (eap.code == EAP_CODE_SUCCESS) {
+        TRACE(TR_SECURITY, "sec: eap success after %d requests eui64=%s",
+              supp->eap_round_count, tr_eui64(supp->eui64.u8));
+        auth->eap_success_count++;
+        auth->eap_round_count += supp->eap_round_count;
+        supp->eap_round_count = 0;
+    }
 
     eapol_write_hdr_head(pktbuf, EAPOL_PACKET_TYPE_EAP);
     auth_send_eapol(auth, supp, IEEE802159_KMP_ID_8021X,
@@ -66,8 +76,13 @@ void auth_eap_send_request_identity(struct auth_ctx *auth, struct auth_supp_ctx
 {
     struct pktbuf pktbuf = { };
 
+    if (supp->eap_tls.job_busy) {
+        TRACE(TR_SECURITY, "sec: tls handshake in progress eui64=%s", tr_eui64(supp->eui64.u8));
+        return;
+    }
     if (auth->radius_fd < 0)
         auth_eap_tls_reset_supp(supp);
+    supp->eap_round_count = 0;
     eap_write_hdr_head(&pktbuf, EAP_CODE_REQUEST, supp->eap_id + 1, EAP_TYPE_IDENTITY);
     auth_eap_send(auth, supp, &pktbuf);
     pktbuf_free(&pktbuf);
@@ -115,7 +130,8 @@ static void auth_eap_send_tls_start(struct auth_ctx *auth, struct auth_supp_ctx
 
 static void auth_eap_send_mbedtls(struct auth_ctx *auth, struct auth_supp_ctx *supp)
 {
-    bool must_fragment = pktbuf_len(&supp->eap_tls.tls.io.tx) > WS_MTU_BYTES;
+    size_t frag_len = auth->cfg->eap_tls_frag_len ? : WS_MTU_BYTES;
+    bool must_fragment = pktbuf_len(&supp->eap_tls.tls.io.tx) > frag_len;
     uint32_t tx_len = pktbuf_len(&supp->eap_tls.tls.io.tx);
     struct pktbuf pktbuf = { };
     uint8_t flags = 0;
@@ -124,9 +140,9 @@ static void auth_eap_send_mbedtls(struct auth_ctx *auth, struct auth_supp_ctx *s
     if (!supp->eap_tls.frag_id)
         flags |= FIELD_PREP(EAP_TLS_FLAGS_LENGTH_MASK, must_fragment);
 
-    pktbuf_push_tail(&pktbuf, NULL, MIN(pktbuf_len(&supp->eap_tls.tls.io.tx), WS_MTU_BYTES));
+    pktbuf_push_tail(&pktbuf, NULL, MIN(pktbuf_len(&supp->eap_tls.tls.io.tx), frag_len));
     pktbuf_pop_head(&supp->eap_tls.tls.io.tx, pktbuf_head(&pktbuf),
-                    MIN(pktbuf_len(&supp->eap_tls.tls.io.tx), WS_MTU_BYTES));
+                    MIN(pktbuf_len(&supp->eap_tls.tls.io.tx), frag_len));
 
     if (FIELD_GET(EAP_TLS_FLAGS_LENGTH_MASK, flags))
         pktbuf_push_head_be32(&pktbuf, tx_len);
@@ -138,11 +154,15 @@ static void auth_eap_send_mbedtls(struct auth_ctx *auth, struct auth_supp_ctx *s
     supp->eap_tls.frag_id++;
 }
 
-static void auth_eap_handshake(struct auth_ctx *auth, struct auth_supp_ctx *supp)
+static void auth_eap_handshake_done(struct auth_ctx *auth, struct auth_supp_ctx *supp, int status)
 {
-    pktbuf_free(&supp->eap_tls.tls.io.tx);
-    supp->eap_tls.frag_id = 0;
-    supp->eap_tls.last_mbedtls_status = mbedtls_ssl_handshake(&supp->eap_tls.tls.ssl_ctx);
+    const struct auth_node_cfg *cfg = supp->node_role == WS_NR_ROLE_LFN ? &auth->cfg->lfn : &auth->cfg->ffn;
+
+    tls_install_pending_pmk(&supp->eap_tls.tls);
+    // A resumed session must not outlive the PMK policy of a full handshake
+    if (!status)
+        tls_session_store(&auth->tls, &supp->eap_tls.tls, cfg->pmk_lifetime_s);
+    supp->eap_tls.last_mbedtls_status = status;
 
     if (supp->eap_tls.last_mbedtls_status && supp->eap_tls.last_mbedtls_status != MBEDTLS_ERR_SSL_WANT_READ) {
         WARN("%s: mbedtls_ssl_handshake: %d", __func__, supp->eap_tls.last_mbedtls_status);
@@ -158,6 +178,37 @@ static void auth_eap_handshake(struct auth_ctx *auth, struct auth_supp_ctx *supp
     auth_eap_send_mbedtls(auth, supp);
 }
 
+// Runs on a worker thread
+static void auth_eap_handshake_work(struct work_pool *pool, struct work_item *item)
+{
+    struct auth_supp_ctx *supp = container_of(item, struct auth_supp_ctx, eap_tls.job);
+
+    supp->eap_tls.job_status = tls_handshake(&supp->eap_tls.tls);
+}
+
+static void auth_eap_handshake_work_done(struct work_pool *pool, struct work_item *item)
+{
+    struct auth_supp_ctx *supp = container_of(item, struct auth_supp_ctx, eap_tls.job);
+    struct auth_ctx *auth = container_of(pool, struct auth_ctx, tls_pool);
+
+    supp->eap_tls.job_busy = false;
+    auth_eap_handshake_done(auth, supp, supp->eap_tls.job_status);
+}
+
+static void auth_eap_handshake(struct auth_ctx *auth, struct auth_supp_ctx *supp)
+{
+    pktbuf_free(&supp->eap_tls.tls.io.tx);
+    supp->eap_tls.frag_id = 0;
+    if (!auth->tls_pool.thread_count) {
+        auth_eap_handshake_done(auth, supp, tls_handshake(&supp->eap_tls.tls));
+        return;
+    }
+    supp->eap_tls.job.work = auth_eap_handshake_work;
+    supp->eap_tls.job.done = auth_eap_handshake_work_done;
+    supp->eap_tls.job_busy = true;
+    work_pool_submit(&auth->tls_pool, &supp->eap_tls.job);
+}
+
 static void auth_eap_recv_resp_tls(struct auth_ctx *auth, struct auth_supp_ctx *supp, struct iobuf_read *iobuf)
 {
     uint8_t flags = iobuf_pop_u8(iobuf);
@@ -327,6 +378,10 @@ void auth_eap_recv(struct auth_ctx *auth, struct auth_supp_ctx *supp, const void
 
     eap_trace("rx-eap", buf, buf_len);
     eap = buf;
+    if (supp->eap_tls.job_busy) {
+        TRACE(TR_DROP, "drop %-9s: tls handshake in progress", "eap");
+        return;
+    }
     if (eap->identifier != supp->eap_id) {
         TRACE(TR_DROP, "drop %-9s: invalid identifier", "eap");
         return;
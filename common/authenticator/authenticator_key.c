@@ -22,7 +22,6 @@
 #include "common/specs/eapol.h"
 #include "common/specs/ws.h"
 #include "common/crypto/ieee80211.h"
-#include "common/crypto/hmac_md.h"
 #include "common/crypto/nist_kw.h"
 #include "common/crypto/ws_keys.h"
 #include "common/time_extra.h"
@@ -86,7 +85,7 @@ static void auth_key_add_kde_padding(struct pktbuf *buf)
     pktbuf_push_tail(buf, NULL, padding_size);
 }
 
-static void auth_key_message_set_mic(const uint8_t ptk[48], struct pktbuf *message)
+static void auth_key_message_set_mic(struct auth_supp_ctx *supp, const uint8_t ptk[48], struct pktbuf *message)
 {
     struct eapol_key_frame *frame = (struct eapol_key_frame *)(pktbuf_head(message) + sizeof(struct eapol_hdr));
     uint8_t mic[16];
@@ -101,8 +100,7 @@ static void auth_key_message_set_mic(const uint8_t ptk[48], struct pktbuf *messa
      * MIC(KCK, EAPOL)
      */
     memset(frame->mic, 0, sizeof(frame->mic));
-    hmac_md_sha1(ieee80211_kck(ptk), IEEE80211_AKM_1_KCK_LEN_BYTES, pktbuf_head(message), pktbuf_len(message),
-                 mic, sizeof(mic));
+    ieee80211_mic_compute(&supp->eap_tls.tls.key_cache, ptk, pktbuf_head(message), pktbuf_len(message), mic);
 
     // Update MIC
     memcpy(frame->mic, mic, sizeof(mic));
@@ -118,7 +116,7 @@ static bool auth_key_accept_frame(struct auth_supp_ctx *supp, const struct eapol
     else
         ptk = supp->eap_tls.tls.ptk.key;
 
-    if (!ieee80211_is_mic_valid(ptk, frame, data, data_len))
+    if (!ieee80211_is_mic_valid(&supp->eap_tls.tls.key_cache, ptk, frame, data, data_len))
         return false;
 
     /*
@@ -141,9 +139,9 @@ void auth_key_refresh_rt_buffer(struct auth_supp_ctx *supp)
     if (!FIELD_GET(IEEE80211_MASK_KEY_INFO_MIC, be16toh(frame->information)))
         return;
     if (FIELD_GET(IEEE80211_MASK_KEY_INFO_TYPE, be16toh(frame->information)) == IEEE80211_KEY_TYPE_PAIRWISE)
-        auth_key_message_set_mic(supp->eap_tls.tls.ptk.tkey, &supp->rt_buffer);
+        auth_key_message_set_mic(supp, supp->eap_tls.tls.ptk.tkey, &supp->rt_buffer);
     else
-        auth_key_message_set_mic(supp->eap_tls.tls.ptk.key, &supp->rt_buffer);
+        auth_key_message_set_mic(supp, supp->eap_tls.tls.ptk.key, &supp->rt_buffer);
 }
 
 static void auth_key_message_send(struct auth_ctx *auth, struct auth_supp_ctx *supp,
@@ -169,7 +167,7 @@ static void auth_key_message_send(struct auth_ctx *auth, struct auth_supp_ctx *s
     }
 
     if (FIELD_GET(IEEE80211_MASK_KEY_INFO_MIC, be16toh(frame->information)))
-        auth_key_message_set_mic(ptk, &message);
+        auth_key_message_set_mic(supp, ptk, &message);
 
     auth_send_eapol(auth, supp, kmp_id, pktbuf_head(&message), pktbuf_len(&message));
     auth_rt_timer_start(auth, supp, kmp_id, pktbuf_head(&message), pktbuf_len(&message));
@@ -420,7 +418,8 @@ void auth_key_pairwise_message_1_send(struct auth_ctx *auth, struct auth_supp_ct
 
     ieee80211_generate_nonce(auth->eui64.u8, supp->anonce);
     memcpy(message.nonce, supp->anonce, sizeof(message.nonce));
-    ieee80211_derive_pmkid(supp->eap_tls.tls.pmk.key, auth->eui64.u8, supp->eui64.u8, pmkid);
+    ieee80211_derive_pmkid(&supp->eap_tls.tls.key_cache, supp->eap_tls.tls.pmk.key,
+                           auth->eui64.u8, supp->eui64.u8, pmkid);
     kde_write_pmkid(&key_data, pmkid);
 
     TRACE(TR_SECURITY, "sec: %-8s msg=1", "tx-4wh");
@@ -448,14 +447,14 @@ static int auth_key_pairwise_recv(struct auth_ctx *auth, struct auth_supp_ctx *s
 }
 
 static bool auth_is_pmkid_valid(const struct auth_ctx *auth,
-                                const struct auth_supp_ctx *supp,
+                                struct auth_supp_ctx *supp,
                                 const uint8_t pmkid_kde[16])
 {
     const struct auth_node_cfg *cfg = supp->node_role == WS_NR_ROLE_LFN ? &auth->cfg->lfn : &auth->cfg->ffn;
     const struct tls_pmk *pmk = &supp->eap_tls.tls.pmk;
     uint8_t pmkid[16];
 
-    ieee80211_derive_pmkid(pmk->key, auth->eui64.u8, supp->eui64.u8, pmkid);
+    ieee80211_derive_pmkid(&supp->eap_tls.tls.key_cache, pmk->key, auth->eui64.u8, supp->eui64.u8, pmkid);
     if (memcmp(pmkid_kde, pmkid, 16))
         return false;
     if (!cfg->pmk_lifetime_s) // Infinite lifetime
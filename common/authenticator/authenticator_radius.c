@@ -13,6 +13,7 @@
  */
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <errno.h>
 
@@ -27,6 +28,7 @@
 #include "common/endian.h"
 #include "common/iobuf.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/mbedtls_extra.h"
 #include "common/memutils.h"
 #include "common/named_values.h"
@@ -48,6 +50,12 @@
 
 #define RADIUS_PORT 1812
 
+// RFC 5080 2.2.1. Retransmission Behavior, MRT = 16s
+#define RADIUS_RT_COUNT_MAX 3
+#define RADIUS_RT_MAX_MS    16000
+// Time before an unresponsive server is considered again by the load balancing
+#define RADIUS_DEAD_TIME_MS 30000
+
 // RFC 2865 4. Packet Types
 enum radius_type {
     RADIUS_ACCESS_REQUEST   =  1,
@@ -80,10 +88,11 @@ struct radius_hdr {
 // RADIUS Attribute Types
 // https://www.iana.org/assignments/radius-types/radius-types.xhtml#radius-types-2
 enum radius_attr_type {
-    RADIUS_ATTR_STATE    = 24,
-    RADIUS_ATTR_VENDOR   = 26,
-    RADIUS_ATTR_EAP_MSG  = 79,
-    RADIUS_ATTR_MSG_AUTH = 80,
+    RADIUS_ATTR_FRAMED_MTU = 12,
+    RADIUS_ATTR_STATE      = 24,
+    RADIUS_ATTR_VENDOR     = 26,
+    RADIUS_ATTR_EAP_MSG    = 79,
+    RADIUS_ATTR_MSG_AUTH   = 80,
 };
 
 // Private Enterprise Numbers
@@ -102,8 +111,10 @@ struct radius_attr {
     uint8_t val[];
 } __attribute__((packed));
 
-void radius_init(struct auth_ctx *auth, const struct sockaddr *sa)
+static void radius_sock_init(struct auth_ctx *auth, struct auth_radius_sock *sock,
+                             const struct sockaddr_storage *addr)
 {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = sock };
     union {
         struct sockaddr     sa;
         struct sockaddr_in6 sin6;
@@ -111,22 +122,117 @@ void radius_init(struct auth_ctx *auth, const struct sockaddr *sa)
     } u;
     int ret;
 
-    switch (sa->sa_family) {
+    switch (addr->ss_family) {
     case AF_INET:
-        memcpy(&u, sa, sizeof(u.sin));
+        memcpy(&u, addr, sizeof(u.sin));
         u.sin.sin_port = htons(RADIUS_PORT);
         break;
     case AF_INET6:
-        memcpy(&u, sa, sizeof(u.sin6));
+        memcpy(&u, addr, sizeof(u.sin6));
         u.sin6.sin6_port = htons(RADIUS_PORT);
         break;
     default:
         BUG();
     }
-    auth->radius_fd = socket(sa->sa_family, SOCK_DGRAM, IPPROTO_UDP);
-    FATAL_ON(auth->radius_fd < 0, 2, "%s: socket: %m", __func__);
-    ret = connect(auth->radius_fd, &u.sa, sizeof(u));
+    // Each socket is bound to a different ephemeral port by connect()
+    sock->fd = socket(addr->ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    FATAL_ON(sock->fd < 0, 2, "%s: socket: %m", __func__);
+    ret = connect(sock->fd, &u.sa, sizeof(u));
     FATAL_ON(ret < 0, 2, "%s: connect: %m", __func__);
+    ret = epoll_ctl(auth->radius_fd, EPOLL_CTL_ADD, sock->fd, &ev);
+    FATAL_ON(ret < 0, 2, "%s: epoll_ctl: %m", __func__);
+}
+
+void radius_init(struct auth_ctx *auth)
+{
+    struct auth_radius_server *server;
+
+    BUG_ON(auth->cfg->radius_sockets < 1 || auth->cfg->radius_sockets > AUTH_RADIUS_SOCK_MAX);
+    auth->radius_fd = epoll_create1(EPOLL_CLOEXEC);
+    FATAL_ON(auth->radius_fd < 0, 2, "%s: epoll_create1: %m", __func__);
+    for (int i = 0; i < ARRAY_SIZE(auth->cfg->radius_addr); i++) {
+        if (auth->cfg->radius_addr[i].ss_family == AF_UNSPEC)
+            continue;
+        server = &auth->radius_servers[auth->radius_server_count++];
+        server->addr = &auth->cfg->radius_addr[i];
+        server->sock_count = auth->cfg->radius_sockets;
+        server->socks = zalloc(server->sock_count * sizeof(*server->socks));
+        for (int j = 0; j < server->sock_count; j++) {
+            server->socks[j].server = server;
+            radius_sock_init(auth, &server->socks[j], server->addr);
+        }
+    }
+    BUG_ON(!auth->radius_server_count);
+}
+
+/*
+ * New conversations are balanced between the responsive servers: the one with
+ * the fewest pending requests is used. If all the servers are considered dead,
+ * the one which has been dead for the longest time is tried.
+ */
+static struct auth_radius_server *radius_server_pick(struct auth_ctx *auth,
+                                                     const struct auth_radius_server *exclude)
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    struct auth_radius_server *best = NULL;
+    struct auth_radius_server *server;
+
+    for (int i = 0; i < auth->radius_server_count; i++) {
+        server = &auth->radius_servers[i];
+        if (server == exclude || server->dead_until_ms > now_ms)
+            continue;
+        if (!best || server->pending_count < best->pending_count)
+            best = server;
+    }
+    if (best)
+        return best;
+    for (int i = 0; i < auth->radius_server_count; i++) {
+        server = &auth->radius_servers[i];
+        if (server == exclude)
+            continue;
+        if (!best || server->dead_until_ms < best->dead_until_ms)
+            best = server;
+    }
+    return best;
+}
+
+// Allocate an identifier on the least loaded socket of the server
+static int radius_id_new(struct auth_ctx *auth, struct auth_supp_ctx *supp,
+                         struct auth_radius_server *server)
+{
+    struct auth_radius_sock *sock = NULL;
+    int id;
+
+    for (int i = 0; i < server->sock_count; i++)
+        if (!sock || server->socks[i].pending_count < sock->pending_count)
+            sock = &server->socks[i];
+    if (sock->pending_count == ARRAY_SIZE(sock->pending))
+        return -1;
+    // If next identifier is already in use, use the next available one.
+    do
+        id = sock->id_next++;
+    while (sock->pending[id]);
+    sock->pending[id] = supp;
+    sock->pending_count++;
+    server->pending_count++;
+    supp->radius.server = server;
+    supp->radius.sock = sock;
+    supp->radius.id = id;
+    return id;
+}
+
+static void radius_id_release(struct auth_supp_ctx *supp)
+{
+    struct auth_radius_sock *sock = supp->radius.sock;
+
+    if (!sock)
+        return;
+    BUG_ON(sock->pending[supp->radius.id] != supp);
+    sock->pending[supp->radius.id] = NULL;
+    sock->pending_count--;
+    sock->server->pending_count--;
+    supp->radius.sock = NULL;
+    supp->radius.id = -1;
 }
 
 // RFC 2865 5. Attributes
@@ -400,16 +506,39 @@ malformed:
     return -EINVAL;
 }
 
+static struct auth_radius_sock *radius_sock_ready(struct auth_ctx *auth)
+{
+    struct epoll_event ev;
+    int ret;
+
+    ret = epoll_wait(auth->radius_fd, &ev, 1, 0);
+    if (ret < 0)
+        WARN("%s: epoll_wait: %m", __func__);
+    return ret > 0 ? ev.data.ptr : NULL;
+}
+
+int radius_ready_fd(struct auth_ctx *auth)
+{
+    struct auth_radius_sock *sock = radius_sock_ready(auth);
+
+    return sock ? sock->fd : -1;
+}
+
 void radius_recv(struct auth_ctx *auth)
 {
     struct iobuf_read iobuf = { };
+    struct auth_radius_sock *sock;
     const struct radius_hdr *hdr;
     struct auth_supp_ctx *supp;
     uint8_t buf[1024];
     int ret;
 
+    // Level triggered, radius_fd stays readable if other packets are pending
+    sock = radius_sock_ready(auth);
+    if (!sock)
+        return;
     iobuf.data = buf;
-    iobuf.data_size = recv(auth->radius_fd, buf, sizeof(buf), 0);
+    iobuf.data_size = recv(sock->fd, buf, sizeof(buf), 0);
     if (iobuf.data_size < 0) {
         WARN("%s: recv: %m", __func__);
         return;
@@ -422,13 +551,11 @@ void radius_recv(struct auth_ctx *auth)
     }
     iobuf.data_size = ntohs(hdr->len);
 
-    supp = SLIST_FIND(supp, &auth->supplicants, link, supp->radius.id == hdr->id);
+    supp = sock->pending[hdr->id];
     if (!supp) {
         TRACE(TR_DROP, "drop %-9s: unknown id=%u", "radius", hdr->id);
         return;
     }
-    supp->radius.id = -1; // Transaction finished
-    timer_stop(&auth->timer_group, &supp->rt_timer);
 
     TRACE(TR_SECURITY, "sec: rx-radius code=%-16s id=%u",
           tr_radius_code(hdr->code), hdr->id);
@@ -438,6 +565,9 @@ void radius_recv(struct auth_ctx *auth)
         TRACE(TR_DROP, "drop %-9s: invalid response authenticator", "radius");
         return;
     }
+    radius_id_release(supp); // Transaction finished
+    timer_stop(&auth->timer_group, &supp->rt_timer);
+    sock->server->dead_until_ms = 0;
 
     switch (hdr->code) {
     case RADIUS_ACCESS_CHALLENGE:
@@ -448,6 +578,7 @@ void radius_recv(struct auth_ctx *auth)
         }
         break;
     case RADIUS_ACCESS_ACCEPT:
+        supp->radius.state_len = 0; // Conversation finished
         // Use a vendor attribute to retrieve the PMK.
         ret = radius_read_ms_mppe_recv_key(auth, supp, iobuf.data, iobuf.data_size);
         if (ret < 0) {
@@ -456,6 +587,7 @@ void radius_recv(struct auth_ctx *auth)
         }
         break;
     case RADIUS_ACCESS_REJECT:
+        supp->radius.state_len = 0; // Conversation finished
         break;
     default:
         TRACE(TR_DROP, "drop %-9s: unsupported code=%u", "radius", hdr->code);
@@ -493,20 +625,6 @@ static void radius_attr_push(struct pktbuf *pktbuf, uint8_t type, const void *va
     pktbuf_push_tail(pktbuf, val, val_len);
 }
 
-static int radius_id_new(struct auth_ctx *auth)
-{
-    struct auth_supp_ctx *supp;
-    int cnt, id;
-
-    // If next handle is already in use (unlikely), use the next available one.
-    for (cnt = 0; cnt <= UINT8_MAX; cnt++) {
-        id = auth->radius_id_next++;
-        if (!SLIST_FIND(supp, &auth->supplicants, link, supp->radius.id == id))
-            break;
-    }
-    return cnt <= UINT8_MAX ? id : -1;
-}
-
 void radius_send(struct auth_ctx *auth, struct auth_supp_ctx *supp,
                  const void *buf, size_t buf_len)
 {
@@ -514,32 +632,61 @@ void radius_send(struct auth_ctx *auth, struct auth_supp_ctx *supp,
     ssize_t ret;
 
     BUG_ON(buf_len < sizeof(*hdr));
+    BUG_ON(!supp->radius.sock);
     TRACE(TR_SECURITY, "sec: tx-radius code=%-16s id=%u",
           tr_radius_code(hdr->code), hdr->id);
-    ret = send(auth->radius_fd, buf, buf_len, 0);
+    ret = send(supp->radius.sock->fd, buf, buf_len, 0);
     WARN_ON(ret < 0, "%s: send: %m", __func__);
 }
 
+/*
+ * Fill the Identifier, Request Authenticator and Message-Authenticator. This is
+ * done again when a request is sent to another server, since the Identifier
+ * space belongs to the socket (see RFC 5080 2.2.1).
+ */
+static void radius_request_sign(struct auth_ctx *auth, struct auth_supp_ctx *supp,
+                                uint8_t *buf, size_t buf_len)
+{
+    struct radius_hdr *hdr = (struct radius_hdr *)buf;
+    const struct radius_attr *attr;
+    uint8_t *msg_auth;
+
+    BUG_ON(buf_len < sizeof(*hdr));
+    hdr->id = supp->radius.id;
+    rand_get_n_bytes_random(supp->radius.auth, 16);
+    memcpy(hdr->auth, supp->radius.auth, 16);
+
+    attr = radius_attr_find(buf + sizeof(*hdr), buf_len - sizeof(*hdr), RADIUS_ATTR_MSG_AUTH);
+    BUG_ON(!attr || attr->len != sizeof(*attr) + 16);
+    msg_auth = (uint8_t *)attr->val;
+    memset(msg_auth, 0, 16);
+    xmbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_MD5),
+                     (const uint8_t *)auth->cfg->radius_secret, strlen(auth->cfg->radius_secret),
+                     buf, buf_len, msg_auth);
+}
+
 void radius_send_eap(struct auth_ctx *auth, struct auth_supp_ctx *supp,
                      const void *buf, size_t buf_len)
 {
+    struct auth_radius_server *server;
     const struct eap_hdr *eap = buf;
     struct radius_hdr hdr = { };
     struct pktbuf pktbuf = { };
-    int offset_msg_auth;
+    uint32_t framed_mtu;
 
-    supp->radius.id = -1; // Cancel any on-going transaction
-    supp->radius.id = radius_id_new(auth);
-    if (supp->radius.id < 0) {
+    radius_id_release(supp); // Cancel any on-going transaction
+    // The State attribute is only known by the server which sent it
+    if (supp->radius.state_len)
+        server = supp->radius.server;
+    else
+        server = radius_server_pick(auth, NULL);
+    if (radius_id_new(auth, supp, server) < 0) {
         TRACE(TR_DROP, "drop %-9s: too many on-going transations", "radius");
         return;
     }
 
     BUG_ON(buf_len < sizeof(*eap));
     hdr.code = RADIUS_ACCESS_REQUEST;
-    hdr.id   = supp->radius.id;
-    rand_get_n_bytes_random(supp->radius.auth, 16);
-    memcpy(hdr.auth, supp->radius.auth, 16);
     pktbuf_push_tail(&pktbuf, &hdr, sizeof(hdr));
 
     // RFC 3579 3.1. EAP-Message
@@ -552,9 +699,16 @@ void radius_send_eap(struct auth_ctx *auth, struct auth_supp_ctx *supp,
     if (buf_len)
         radius_attr_push(&pktbuf, RADIUS_ATTR_EAP_MSG, buf, buf_len);
 
-    offset_msg_auth = pktbuf.offset_tail + sizeof(struct radius_attr);
     radius_attr_push(&pktbuf, RADIUS_ATTR_MSG_AUTH, NULL, 16);
 
+    // Framed-MTU (RFC 2865 5.12) tells the server the maximum size of the EAP
+    // packets it sends, so its EAP-TLS fragments follow eap_tls_frag_len too.
+    // The EAP-TLS header (type, flags, and message length) takes 6 bytes.
+    if (auth->cfg->eap_tls_frag_len) {
+        framed_mtu = htonl(auth->cfg->eap_tls_frag_len + sizeof(struct eap_hdr) + 6);
+        radius_attr_push(&pktbuf, RADIUS_ATTR_FRAMED_MTU, &framed_mtu, sizeof(framed_mtu));
+    }
+
     if (supp->radius.state_len)
         radius_attr_push(&pktbuf, RADIUS_ATTR_STATE,
                          supp->radius.state, supp->radius.state_len);
@@ -564,12 +718,47 @@ void radius_send_eap(struct auth_ctx *auth, struct auth_supp_ctx *supp,
     memcpy(pktbuf_head(&pktbuf) + offsetof(struct radius_hdr, len),
            &hdr.len, sizeof(hdr.len));
 
-    xmbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_MD5),
-                     (const uint8_t *)auth->cfg->radius_secret, strlen(auth->cfg->radius_secret),
-                     pktbuf_head(&pktbuf), pktbuf_len(&pktbuf),
-                     pktbuf_head(&pktbuf) + offset_msg_auth);
-
+    radius_request_sign(auth, supp, pktbuf_head(&pktbuf), pktbuf_len(&pktbuf));
     radius_send(auth, supp, pktbuf_head(&pktbuf), pktbuf_len(&pktbuf));
     auth_rt_timer_start(auth, supp, 0, pktbuf_head(&pktbuf), pktbuf_len(&pktbuf));
     pktbuf_free(&pktbuf);
 }
+
+/*
+ * The retransmission timer doubles on each attempt (see RFC 5080 2.2.1). When
+ * the maximum retransmission count is reached, the server is considered
+ * unresponsive. Requests starting a conversation are then sent to another
+ * server, the others depend on the State attribute and are canceled.
+ */
+void radius_rt_timeout(struct auth_ctx *auth, struct auth_supp_ctx *supp)
+{
+    struct auth_radius_server *server = supp->radius.server;
+    struct auth_radius_server *next;
+
+    if (!supp->radius.sock) {
+        timer_stop(&auth->timer_group, &supp->rt_timer);
+        return;
+    }
+    if (supp->rt_count < RADIUS_RT_COUNT_MAX) {
+        TRACE(TR_SECURITY, "sec: radius frame retry eui64=%s", tr_eui64(supp->eui64.u8));
+        timer_start_rel(&auth->timer_group, &supp->rt_timer,
+                        MIN(auth->timeout_ms << supp->rt_count, RADIUS_RT_MAX_MS));
+        radius_send(auth, supp, pktbuf_head(&supp->rt_buffer), pktbuf_len(&supp->rt_buffer));
+        return;
+    }
+
+    radius_id_release(supp);
+    server->dead_until_ms = time_now_ms(CLOCK_MONOTONIC) + RADIUS_DEAD_TIME_MS;
+    next = radius_server_pick(auth, server);
+    if (!supp->radius.state_len && next && radius_id_new(auth, supp, next) >= 0) {
+        TRACE(TR_SECURITY, "sec: radius server unresponsive, failover eui64=%s", tr_eui64(supp->eui64.u8));
+        radius_request_sign(auth, supp, pktbuf_head(&supp->rt_buffer), pktbuf_len(&supp->rt_buffer));
+        supp->rt_count = 0;
+        timer_start_rel(&auth->timer_group, &supp->rt_timer, auth->timeout_ms);
+        radius_send(auth, supp, pktbuf_head(&supp->rt_buffer), pktbuf_len(&supp->rt_buffer));
+        return;
+    }
+    TRACE(TR_SECURITY, "sec: radius max retry count exceeded eui64=%s", tr_eui64(supp->eui64.u8));
+    supp->radius.state_len = 0; // The conversation cannot continue
+    timer_stop(&auth->timer_group, &supp->rt_timer);
+}
@@ -22,11 +22,14 @@ struct auth_supp_ctx;
 struct in6_addr;
 struct sockaddr;
 
-void radius_init(struct auth_ctx *auth, const struct sockaddr *sa);
+void radius_init(struct auth_ctx *auth);
 void radius_recv(struct auth_ctx *auth);
+// Return a RADIUS socket with a pending packet, -1 if there is none
+int radius_ready_fd(struct auth_ctx *auth);
 void radius_send(struct auth_ctx *auth, struct auth_supp_ctx *supp,
                  const void *buf, size_t buf_len);
 void radius_send_eap(struct auth_ctx *auth, struct auth_supp_ctx *supp,
                      const void *buf, size_t buf_len);
+void radius_rt_timeout(struct auth_ctx *auth, struct auth_supp_ctx *supp);
 
 #endif
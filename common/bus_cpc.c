@@ -11,6 +11,7 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <errno.h>
 #include <sl_cpc.h>
 
 #include "common/bus.h"
@@ -51,8 +52,17 @@ int cpc_rx(struct bus *bus, void *buf, unsigned int buf_len)
 {
     int ret;
 
-    ret = cpc_read_endpoint(bus->cpc.endpoint, buf, buf_len, 0);
+    // CPC returns one frame per read. Only the first read of a batch may block,
+    // the following ones do not so the caller can keep reading while
+    // data_ready is set, until the endpoint is drained.
+    ret = cpc_read_endpoint(bus->cpc.endpoint, buf, buf_len,
+                            bus->cpc.data_ready ? CPC_ENDPOINT_READ_FLAG_NON_BLOCK : 0);
+    if (ret == -EAGAIN) {
+        bus->cpc.data_ready = false;
+        return 0;
+    }
     FATAL_ON(ret < 0, 2, "cpc_read_endpoint: %s", strerror(-ret));
+    bus->cpc.data_ready = true;
     return ret;
 }
 
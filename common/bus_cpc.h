@@ -13,6 +13,7 @@
  */
 #ifndef BUS_CPC_H
 #define BUS_CPC_H
+#include <stdbool.h>
 #include <stdint.h>
 #include "common/log.h"
 
@@ -35,6 +36,9 @@ typedef void *cpc_handle_t;
 struct bus_cpc {
     cpc_endpoint_t endpoint;
     cpc_handle_t handle;
+    // More frames may be available. Unlike UART, CPC does not tell how many
+    // frames are queued, so this is cleared only once a read returns nothing.
+    bool data_ready;
 };
 
 #ifdef HAVE_LIBCPC
@@ -11,25 +11,53 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
 #include <unistd.h>
 #include <termios.h>
+#include <sys/eventfd.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
 #include <sys/uio.h>
 
 #include "common/bits.h"
 #include "common/endian.h"
-#include "common/iobuf.h"
 #include "common/crc.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
+#include "common/spsc_ring.h"
 #include "common/bus.h"
 #include "common/hif.h"
 
 #include "bus_uart.h"
 
+// Sizes of the rings between the UART thread and the protocol thread, large
+// enough to absorb the frames received while the protocol thread is busy.
+#define UART_THREAD_RX_RING_SIZE (256 * 1024)
+#define UART_THREAD_TX_RING_SIZE  (64 * 1024)
+
+struct uart_thread {
+    pthread_t tid;
+    int tty_fd;
+    int tx_efd;
+    int rx_efd;
+    struct spsc_ring rx_ring;
+    struct spsc_ring tx_ring;
+    // Bytes pushed to tx_ring by the protocol thread, and bytes written by
+    // the UART thread, see uart_tx_flush().
+    size_t tx_queued;
+    atomic_size_t tx_written;
+    // Framing state, only accessed by the UART thread
+    struct bus bus;
+};
+
 int uart_open(const char *device, int bitrate, bool hardflow)
 {
     static const struct {
@@ -88,19 +116,57 @@ int uart_open(const char *device, int bitrate, bool hardflow)
     return fd;
 }
 
+static_assert(UART_RX_BUF_SIZE >= 4 + FIELD_MAX(UART_HDR_LEN_MASK) + 2, "UART_RX_BUF_SIZE too small");
+
+static uint8_t uart_rx_byte(const struct bus *bus, int offset)
+{
+    return bus->uart.rx_buf[(bus->uart.rx_buf_head + offset) % UART_RX_BUF_SIZE];
+}
+
+// Copy len bytes starting at offset from the RX ring buffer
+static void uart_rx_peek(const struct bus *bus, int offset, void *buf, int len)
+{
+    int start = (bus->uart.rx_buf_head + offset) % UART_RX_BUF_SIZE;
+    int len1 = MIN(len, UART_RX_BUF_SIZE - start);
+
+    BUG_ON(offset + len > bus->uart.rx_buf_len);
+    memcpy(buf, bus->uart.rx_buf + start, len1);
+    memcpy((uint8_t *)buf + len1, bus->uart.rx_buf, len - len1);
+}
+
+static void uart_rx_consume(struct bus *bus, int len)
+{
+    BUG_ON(len > bus->uart.rx_buf_len);
+    bus->uart.rx_buf_head = (bus->uart.rx_buf_head + len) % UART_RX_BUF_SIZE;
+    bus->uart.rx_buf_len -= len;
+    if (!bus->uart.rx_buf_len)
+        bus->uart.rx_buf_head = 0;
+}
+
+// Read as much as possible into the free space of the ring buffer. When the
+// free space wraps around, only the first part is read, the next call to
+// uart_read() will fill the rest. read() is used rather than readv() since
+// the fuzzer replays captures by wrapping read().
+static const uint8_t *uart_read_raw(struct bus *bus, ssize_t *size)
+{
+    int tail = (bus->uart.rx_buf_head + bus->uart.rx_buf_len) % UART_RX_BUF_SIZE;
+    int room = UART_RX_BUF_SIZE - bus->uart.rx_buf_len;
+
+    *size = read(bus->fd, bus->uart.rx_buf + tail, MIN(room, UART_RX_BUF_SIZE - tail));
+    FATAL_ON(*size < 0, 2, "%s: read: %m", __func__);
+    FATAL_ON(!*size, 2, "%s: read: Empty read", __func__);
+    bus->uart.rx_buf_len += *size;
+    return bus->uart.rx_buf + tail;
+}
+
 static void uart_read(struct bus *bus)
 {
+    const uint8_t *data;
     ssize_t size;
 
-    size = read(bus->fd,
-                bus->uart.rx_buf + bus->uart.rx_buf_len,
-                sizeof(bus->uart.rx_buf) - bus->uart.rx_buf_len);
-    FATAL_ON(size < 0, 2, "%s: read: %m", __func__);
-    FATAL_ON(!size, 2, "%s: read: Empty read", __func__);
+    data = uart_read_raw(bus, &size);
     TRACE(TR_BUS, "bus rx: %s (%zd bytes)",
-          tr_bytes(bus->uart.rx_buf + bus->uart.rx_buf_len,
-                   size, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), size);
-    bus->uart.rx_buf_len += size;
+          tr_bytes(data, size, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), size);
 }
 
 int uart_tx(struct bus *bus, const void *buf, unsigned int buf_len)
@@ -118,10 +184,23 @@ int uart_tx(struct bus *bus, const void *buf, unsigned int buf_len)
     write_le16(hdr + 2, crc16(CRC_INIT_HCS, hdr, 2));
     write_le16(fcs,     crc16(CRC_INIT_FCS, buf, buf_len));
 
-    ret = writev(bus->fd, iov, ARRAY_SIZE(iov));
-    FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
-    if (ret != sizeof(hdr) + buf_len + sizeof(fcs))
-        FATAL(2 ,"%s: write: Short write", __func__);
+    if (bus->uart.tx_coalesce || bus->uart.thread) {
+        static_assert(UART_TX_BUF_SIZE >= 4 + FIELD_MAX(UART_HDR_LEN_MASK) + 2, "UART_TX_BUF_SIZE too small");
+        if (bus->uart.tx_buf_len + sizeof(hdr) + buf_len + sizeof(fcs) > UART_TX_BUF_SIZE)
+            uart_tx_commit(bus);
+        for (int i = 0; i < ARRAY_SIZE(iov); i++) {
+            memcpy(bus->uart.tx_buf + bus->uart.tx_buf_len, iov[i].iov_base, iov[i].iov_len);
+            bus->uart.tx_buf_len += iov[i].iov_len;
+        }
+        if (!bus->uart.tx_coalesce)
+            uart_tx_commit(bus);
+        ret = sizeof(hdr) + buf_len + sizeof(fcs);
+    } else {
+        ret = writev(bus->fd, iov, ARRAY_SIZE(iov));
+        FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
+        if (ret != sizeof(hdr) + buf_len + sizeof(fcs))
+            FATAL(2 ,"%s: write: Short write", __func__);
+    }
 
     TRACE(TR_BUS, "bus tx: %s %s %02x %02x (%zd bytes)",
           tr_bytes(hdr, sizeof(hdr), NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
@@ -131,51 +210,62 @@ int uart_tx(struct bus *bus, const void *buf, unsigned int buf_len)
     return ret;
 }
 
-int uart_rx(struct bus *bus, void *buf, unsigned int buf_len)
+// Extract the next frame from the RX ring buffer. Returns its length, 0 if no
+// complete frame is available, or -EBADMSG (bad HCS) or -EILSEQ (bad FCS)
+// after dropping one byte. Nothing is logged so the UART thread can use it.
+static int uart_rx_parse(struct bus *bus, void *buf, unsigned int buf_len)
 {
-    struct iobuf_read iobuf = { };
-    const uint8_t *hdr;
-    uint16_t len, fcs;
+    uint8_t hdr[4], fcs[2];
+    uint16_t len;
 
-    if (!bus->uart.data_ready)
-        uart_read(bus);
-    bus->uart.data_ready = false;
-    iobuf.data      = bus->uart.rx_buf;
-    iobuf.data_size = bus->uart.rx_buf_len;
-    hdr = iobuf_pop_data_ptr(&iobuf, 4);
-    if (iobuf.err)
+    if (bus->uart.rx_buf_len < sizeof(hdr))
         return 0;
+    uart_rx_peek(bus, 0, hdr, sizeof(hdr));
     if (!crc_check(CRC_INIT_HCS, hdr, 2, read_le16(hdr + 2))) {
-        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
-        bus->uart.rx_buf_len -= 1;
-        bus->uart.data_ready = true;
-        if (bus->uart.init_phase)
-            TRACE(TR_DROP, "drop %-9s: bad hcs", "uart");
-        else
-            FATAL(3, "%s: bad hcs", __func__);
-        return 0;
+        uart_rx_consume(bus, 1);
+        return -EBADMSG;
     }
     len = FIELD_GET(UART_HDR_LEN_MASK, read_le16(hdr));
     BUG_ON(buf_len < len);
-    iobuf_pop_data(&iobuf, buf, len);
-    fcs = iobuf_pop_le16(&iobuf);
-    if (iobuf.err)
+    if (bus->uart.rx_buf_len < sizeof(hdr) + len + sizeof(fcs))
         return 0; // Frame not fully received
-    bus->uart.data_ready = true;
-    if (!crc_check(CRC_INIT_FCS, buf, len, fcs)) {
-        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
-        bus->uart.rx_buf_len -= 1;
-        if (bus->uart.init_phase)
-            TRACE(TR_DROP, "drop %-9s: bad fcs", "uart");
-        else
-            FATAL(3, "%s: bad fcs", __func__);
-        return 0;
+    uart_rx_peek(bus, sizeof(hdr), buf, len);
+    uart_rx_peek(bus, sizeof(hdr) + len, fcs, sizeof(fcs));
+    if (!crc_check(CRC_INIT_FCS, buf, len, read_le16(fcs))) {
+        uart_rx_consume(bus, 1);
+        return -EILSEQ;
     }
-    memmove(bus->uart.rx_buf, iobuf_ptr(&iobuf), iobuf_remaining_size(&iobuf));
-    bus->uart.rx_buf_len = iobuf_remaining_size(&iobuf);
+    uart_rx_consume(bus, sizeof(hdr) + len + sizeof(fcs));
     return len;
 }
 
+static void uart_rx_error(struct bus *bus, int err)
+{
+    const char *what = err == -EBADMSG ? "hcs" : "fcs";
+
+    if (bus->uart.init_phase)
+        TRACE(TR_DROP, "drop %-9s: bad %s", "uart", what);
+    else
+        FATAL(3, "uart_rx: bad %s", what);
+}
+
+int uart_rx(struct bus *bus, void *buf, unsigned int buf_len)
+{
+    int ret;
+
+    if (!bus->uart.data_ready)
+        uart_read(bus);
+    ret = uart_rx_parse(bus, buf, buf_len);
+    if (ret < 0) {
+        bus->uart.data_ready = true;
+        uart_rx_error(bus, ret);
+        return 0;
+    }
+    // Another frame may already be available
+    bus->uart.data_ready = ret && bus->uart.rx_buf_len;
+    return ret;
+}
+
 static int uart_legacy_tx_append(uint8_t *buf, uint8_t byte)
 {
     if (byte == 0x7D || byte == 0x7E) {
@@ -232,10 +322,10 @@ static size_t uart_legacy_rx_hdlc(struct bus *bus, uint8_t *buf, size_t buf_len)
         uart_read(bus);
 
     i = 0;
-    while (bus->uart.rx_buf[i] == 0x7E && i < bus->uart.rx_buf_len)
+    while (i < bus->uart.rx_buf_len && uart_rx_byte(bus, i) == 0x7E)
         i++;
     frame_start = i;
-    while (bus->uart.rx_buf[i] != 0x7E && i < bus->uart.rx_buf_len)
+    while (i < bus->uart.rx_buf_len && uart_rx_byte(bus, i) != 0x7E)
         i++;
     frame_len = i - frame_start + 1;
     if (bus->uart.init_phase && i >= bus->uart.rx_buf_len)
@@ -245,17 +335,16 @@ static size_t uart_legacy_rx_hdlc(struct bus *bus, uint8_t *buf, size_t buf_len)
         return 0;
 
     BUG_ON(buf_len < frame_len);
-    memcpy(buf, bus->uart.rx_buf + frame_start, frame_len);
+    uart_rx_peek(bus, frame_start, buf, frame_len);
 
-    while (bus->uart.rx_buf[i] == 0x7E && i < bus->uart.rx_buf_len)
+    while (i < bus->uart.rx_buf_len && uart_rx_byte(bus, i) == 0x7E)
         i++;
-    memmove(bus->uart.rx_buf, bus->uart.rx_buf + i, bus->uart.rx_buf_len - i);
-    bus->uart.rx_buf_len -= i;
+    uart_rx_consume(bus, i);
 
     i = 0;
     bus->uart.data_ready = false;
     while (i < bus->uart.rx_buf_len) {
-        if (bus->uart.rx_buf[i] == 0x7E) {
+        if (uart_rx_byte(bus, i) == 0x7E) {
             bus->uart.data_ready = true;
             break;
         }
@@ -315,6 +404,7 @@ bool uart_detect_v2(struct bus *bus)
         .fd = bus->fd,
         .events = POLLIN,
     };
+    uint8_t hdr[4];
     int ret;
 
     ret = poll(&pfd, 1, 10000);
@@ -328,24 +418,193 @@ bool uart_detect_v2(struct bus *bus)
             return false;
         uart_read(bus);
         bus->uart.data_ready = true;
-        for (int i = 0; i < bus->uart.rx_buf_len - 4; i++)
-            if (crc_check(CRC_INIT_HCS, bus->uart.rx_buf + i, 2,
-                          read_le16(bus->uart.rx_buf + i + 2)))
+        for (int i = 0; i < bus->uart.rx_buf_len - 4; i++) {
+            uart_rx_peek(bus, i, hdr, sizeof(hdr));
+            if (crc_check(CRC_INIT_HCS, hdr, 2, read_le16(hdr + 2)))
                 return true;
+        }
     }
 }
 
 static inline int uart_txqlen(struct bus *bus)
 {
+    int fd = bus->uart.thread ? bus->uart.thread->tty_fd : bus->fd;
     int ret, cnt;
 
-    ret = ioctl(bus->fd, TIOCOUTQ, &cnt);
+    ret = ioctl(fd, TIOCOUTQ, &cnt);
     FATAL_ON(ret < 0, 2, "ioctl TIOCOUTQ: %m");
     return cnt;
 }
 
+static void uart_thread_commit(struct bus *bus)
+{
+    struct uart_thread *thread = bus->uart.thread;
+    uint64_t val = 1;
+    ssize_t ret;
+
+    // The ring only fills up if the RCP does not keep up with the host, in
+    // which case a blocking write() would have waited as well.
+    while (!spsc_ring_push(&thread->tx_ring, bus->uart.tx_buf_len, bus->uart.tx_buf))
+        usleep(1000);
+    thread->tx_queued += bus->uart.tx_buf_len;
+    bus->uart.tx_buf_len = 0;
+    ret = write(thread->tx_efd, &val, sizeof(val));
+    FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
+}
+
+void uart_tx_commit(struct bus *bus)
+{
+    ssize_t ret;
+
+    if (!bus->uart.tx_buf_len)
+        return;
+    if (bus->uart.thread) {
+        uart_thread_commit(bus);
+        return;
+    }
+    ret = write(bus->fd, bus->uart.tx_buf, bus->uart.tx_buf_len);
+    FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
+    if (ret != bus->uart.tx_buf_len)
+        FATAL(2 ,"%s: write: Short write", __func__);
+    bus->uart.tx_buf_len = 0;
+}
+
 void uart_tx_flush(struct bus *bus)
 {
+    uart_tx_commit(bus);
+    while (bus->uart.thread &&
+           atomic_load(&bus->uart.thread->tx_written) != bus->uart.thread->tx_queued)
+        usleep(1000);
     while (uart_txqlen(bus))
         usleep(1000);
 }
+
+// Returns false if the RX ring is full.
+static bool uart_thread_rx_frames(struct uart_thread *thread)
+{
+    uint8_t frame[FIELD_MAX(UART_HDR_LEN_MASK)];
+    uint64_t val = 1;
+    bool room;
+    int count = 0;
+    ssize_t ret;
+    int len;
+
+    do {
+        room = spsc_ring_room(&thread->rx_ring) >= sizeof(int32_t) + sizeof(frame);
+        if (!room)
+            break;
+        len = uart_rx_parse(&thread->bus, frame, sizeof(frame));
+        if (len)
+            count += spsc_ring_push(&thread->rx_ring, len, frame);
+    } while (len);
+    if (count) {
+        ret = write(thread->rx_efd, &val, sizeof(val));
+        FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
+    }
+    return room;
+}
+
+static void uart_thread_tx(struct uart_thread *thread)
+{
+    uint8_t buf[UART_TX_BUF_SIZE];
+    ssize_t ret;
+    int32_t len;
+    uint64_t val;
+
+    read(thread->tx_efd, &val, sizeof(val));
+    while (spsc_ring_pop(&thread->tx_ring, &len, buf, sizeof(buf))) {
+        ret = write(thread->tty_fd, buf, len);
+        FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
+        if (ret != len)
+            FATAL(2, "%s: write: Short write", __func__);
+        atomic_fetch_add(&thread->tx_written, len);
+    }
+}
+
+static void *uart_thread_main(void *arg)
+{
+    struct uart_thread *thread = arg;
+    struct bus *bus = &thread->bus;
+    struct pollfd pfd[2] = {
+        { .fd = thread->tty_fd },
+        { .fd = thread->tx_efd, .events = POLLIN },
+    };
+    bool rx_room;
+    ssize_t size;
+    int ret;
+
+    while (true) {
+        // Bytes left by the reset sequence may already contain frames
+        rx_room = uart_thread_rx_frames(thread);
+        // When the protocol thread lags behind, stop reading the UART and
+        // check the ring again a bit later.
+        pfd[0].events = rx_room ? POLLIN : 0;
+        ret = poll(pfd, ARRAY_SIZE(pfd), rx_room ? -1 : 1);
+        FATAL_ON(ret < 0 && errno != EINTR, 2, "%s: poll: %m", __func__);
+        if (pfd[1].revents & POLLIN)
+            uart_thread_tx(thread);
+        if (pfd[0].revents & (POLLIN | POLLERR))
+            uart_read_raw(bus, &size);
+    }
+    return NULL;
+}
+
+static int uart_thread_rx(struct bus *bus, void *buf, unsigned int buf_len)
+{
+    struct uart_thread *thread = bus->uart.thread;
+    uint64_t val;
+    int32_t len;
+
+    if (!bus->uart.data_ready)
+        read(bus->fd, &val, sizeof(val));
+    if (!spsc_ring_pop(&thread->rx_ring, &len, buf, buf_len)) {
+        bus->uart.data_ready = false;
+        return 0;
+    }
+    bus->uart.data_ready = !spsc_ring_empty(&thread->rx_ring);
+    if (len < 0) {
+        uart_rx_error(bus, len);
+        return 0;
+    }
+    TRACE(TR_BUS, "bus rx: %s (%d bytes)",
+          tr_bytes(buf, len, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), len);
+    return len;
+}
+
+void uart_thread_start(struct bus *bus)
+{
+    struct uart_thread *thread = zalloc(sizeof(*thread));
+    sigset_t sigset, sigset_old;
+    int ret;
+
+    uart_tx_commit(bus);
+    thread->rx_ring.buf  = xalloc(UART_THREAD_RX_RING_SIZE);
+    thread->rx_ring.size = UART_THREAD_RX_RING_SIZE;
+    thread->tx_ring.buf  = xalloc(UART_THREAD_TX_RING_SIZE);
+    thread->tx_ring.size = UART_THREAD_TX_RING_SIZE;
+    thread->tty_fd = bus->fd;
+    thread->tx_efd = eventfd(0, EFD_CLOEXEC);
+    FATAL_ON(thread->tx_efd < 0, 2, "%s: eventfd: %m", __func__);
+    // Bytes already received are handed over to the thread
+    thread->bus.uart = bus->uart;
+    bus->uart.rx_buf_head = 0;
+    bus->uart.rx_buf_len  = 0;
+    bus->uart.data_ready  = false;
+    // The event loop watches this eventfd instead of the tty. It is written
+    // by the thread (see uart_thread_rx_frames()) when frames are available.
+    thread->rx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    FATAL_ON(thread->rx_efd < 0, 2, "%s: eventfd: %m", __func__);
+    thread->bus.fd = thread->tty_fd;
+    bus->fd = thread->rx_efd;
+    bus->rx = uart_thread_rx;
+    bus->uart.thread = thread;
+
+    // Signals are handled by the protocol thread, the shutdown path calls
+    // uart_tx_flush() which waits for this thread.
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_SETMASK, &sigset, &sigset_old);
+    ret = pthread_create(&thread->tid, NULL, uart_thread_main, thread);
+    FATAL_ON(ret, 2, "pthread_create: %s", strerror(ret));
+    pthread_sigmask(SIG_SETMASK, &sigset_old, NULL);
+    pthread_setname_np(thread->tid, "uart");
+}
@@ -20,14 +20,29 @@
 #include "common/bits.h"
 
 struct bus;
+struct uart_thread;
 
 #define UART_HDR_LEN_MASK 0x07ff
 
+// Received bytes are stored in a ring buffer large enough to hold several
+// frames, so bursts of indications are drained with few read() calls.
+#define UART_RX_BUF_SIZE 16384
+
+// When tx_coalesce is set, frames are staged until uart_tx_commit() and then
+// sent with a single write(). This is typically done once per iteration of
+// the event loop.
+#define UART_TX_BUF_SIZE 8192
+
 struct bus_uart {
     bool    data_ready;
+    int     rx_buf_head;
     int     rx_buf_len;
-    uint8_t rx_buf[4 + FIELD_MAX(UART_HDR_LEN_MASK) + 2];
+    uint8_t rx_buf[UART_RX_BUF_SIZE];
     bool    init_phase;
+    bool    tx_coalesce;
+    int     tx_buf_len;
+    uint8_t tx_buf[UART_TX_BUF_SIZE];
+    struct uart_thread *thread;
 };
 
 int uart_open(const char *device, int bitrate, bool hardflow);
@@ -41,8 +56,20 @@ int uart_legacy_rx(struct bus *bus, void *buf, unsigned int len);
 // Try to find a valid APIv2 header within the first bytes received.
 bool uart_detect_v2(struct bus *bus);
 
-// Wait for the kernel transmission queue to send all of its content.
+// Send the frames staged by uart_tx() when tx_coalesce is set.
+void uart_tx_commit(struct bus *bus);
+
+// Send the staged frames and wait for the kernel transmission queue to send
+// all of its content.
 void uart_tx_flush(struct bus *bus);
 
+// Move the UART I/O to a dedicated thread, which reads the tty, checks the
+// framing and CRCs, and writes the frames committed by uart_tx_commit().
+// Frames are exchanged with the caller through lock-free rings, so a busy
+// caller does not let the tty buffer overflow. bus->fd is replaced by an
+// eventfd readable when frames are available. Only for APIv2 framing, once
+// the reset sequence is complete.
+void uart_thread_start(struct bus *bus);
+
 #endif
 
@@ -15,11 +15,20 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/random.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 
 #include "common/bits.h"
 #include "common/bus_uart.h"
@@ -33,8 +42,23 @@
 
 #include "capture.h"
 
+// Storage files are split in several records, which must fit in a UART frame
+#define CAPTURE_CHECKPOINT_CHUNK_LEN 1024
+// Compressed data is written to the file at least this often
+#define CAPTURE_ZSTD_FLUSH_MS 1000
+
 struct capture_ctxt {
     int recfd;
+    uint64_t rec_offset; // Uncompressed
+#ifdef HAVE_LIBZSTD
+    ZSTD_CCtx *zstd;     // NULL if not compressed
+    uint8_t *zstd_buf;
+    size_t zstd_buf_len;
+    uint64_t zstd_flush_ms;
+#endif
+    char *rec_filename;
+    FILE *idx_file;
+    unsigned int checkpoint_cnt;
     int *netfd_list;
     int netfd_cnt;
 };
@@ -45,6 +69,69 @@ struct capture_ctxt g_capture_ctxt = {
     .recfd = -1,
 };
 
+#ifdef HAVE_LIBZSTD
+// Errors are not fatal so this can run from atexit()
+static int capture_zstd_write(struct capture_ctxt *ctxt, const void *buf, size_t buf_len,
+                              ZSTD_EndDirective mode)
+{
+    ZSTD_inBuffer in = { .src = buf, .size = buf_len };
+    ZSTD_outBuffer out;
+    size_t remaining;
+    ssize_t ret;
+
+    do {
+        out.dst  = ctxt->zstd_buf;
+        out.size = ctxt->zstd_buf_len;
+        out.pos  = 0;
+        remaining = ZSTD_compressStream2(ctxt->zstd, &out, &in, mode);
+        if (ZSTD_isError(remaining)) {
+            WARN("%s: %s", __func__, ZSTD_getErrorName(remaining));
+            return -1;
+        }
+        if (!out.pos)
+            continue;
+        ret = write(ctxt->recfd, out.dst, out.pos);
+        if (ret < 0) {
+            WARN("%s: write: %m", __func__);
+            return -1;
+        }
+        if (ret != out.pos) {
+            WARN("%s: write: Short write", __func__);
+            return -1;
+        }
+    } while (mode == ZSTD_e_continue ? in.pos < in.size : remaining);
+    return 0;
+}
+
+static void capture_zstd_flush(struct capture_ctxt *ctxt)
+{
+    if (capture_zstd_write(ctxt, NULL, 0, ZSTD_e_flush) < 0)
+        FATAL(2, "%s: capture failed", __func__);
+    ctxt->zstd_flush_ms = time_now_ms(CLOCK_MONOTONIC);
+}
+
+static void capture_zstd_end(void)
+{
+    struct capture_ctxt *ctxt = &g_capture_ctxt;
+
+    capture_zstd_write(ctxt, NULL, 0, ZSTD_e_end);
+}
+
+static void capture_zstd_init(struct capture_ctxt *ctxt)
+{
+    ctxt->zstd = ZSTD_createCCtx();
+    FATAL_ON(!ctxt->zstd, 2, "%s: ZSTD_createCCtx", __func__);
+    ZSTD_CCtx_setParameter(ctxt->zstd, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
+    // Compress in a separate thread when libzstd supports it, ignore errors
+    ZSTD_CCtx_setParameter(ctxt->zstd, ZSTD_c_nbWorkers, 1);
+    ctxt->zstd_buf_len = ZSTD_CStreamOutSize();
+    ctxt->zstd_buf = xalloc(ctxt->zstd_buf_len);
+    ctxt->zstd_flush_ms = time_now_ms(CLOCK_MONOTONIC);
+    // Complete the frame on exit(), including FATAL()
+    atexit(capture_zstd_end);
+}
+#endif
+
 static void capture_record(struct capture_ctxt *ctxt, const void *buf, size_t buf_len)
 {
     uint8_t hdr[4], fcs[2];
@@ -60,10 +147,22 @@ static void capture_record(struct capture_ctxt *ctxt, const void *buf, size_t bu
     write_le16(hdr + 2, crc16(CRC_INIT_HCS, hdr, 2));
     write_le16(fcs,     crc16(CRC_INIT_FCS, buf, buf_len));
 
+#ifdef HAVE_LIBZSTD
+    if (ctxt->zstd) {
+        for (int i = 0; i < ARRAY_SIZE(iov); i++)
+            if (capture_zstd_write(ctxt, iov[i].iov_base, iov[i].iov_len, ZSTD_e_continue) < 0)
+                FATAL(2, "%s: capture failed", __func__);
+        ctxt->rec_offset += sizeof(hdr) + buf_len + sizeof(fcs);
+        if (time_now_ms(CLOCK_MONOTONIC) - ctxt->zstd_flush_ms >= CAPTURE_ZSTD_FLUSH_MS)
+            capture_zstd_flush(ctxt);
+        return;
+    }
+#endif
     ret = writev(ctxt->recfd, iov, ARRAY_SIZE(iov));
     FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
     if (ret != sizeof(hdr) + buf_len + sizeof(fcs))
         FATAL(2 ,"%s: write: Short write", __func__);
+    ctxt->rec_offset += ret;
 }
 
 static void capture_record_timers(struct capture_ctxt *ctxt)
@@ -270,6 +369,106 @@ void capture_record_hif(const void *buf, size_t buf_len)
     capture_record(ctxt, buf, buf_len);
 }
 
+static void capture_record_checkpoint_chunk(struct capture_ctxt *ctxt, uint64_t time_ms, const char *filename,
+                                            uint32_t offset, const uint8_t *buf, size_t buf_len)
+{
+    struct iobuf_write iobuf = { };
+
+    hif_push_u8(&iobuf, HIF_CMD_IND_REPLAY_CHECKPOINT);
+    hif_push_u32(&iobuf, ctxt->checkpoint_cnt);
+    hif_push_u64(&iobuf, time_ms);
+    hif_push_str(&iobuf, filename);
+    hif_push_u32(&iobuf, offset);
+    hif_push_data(&iobuf, buf, buf_len);
+    capture_record(ctxt, iobuf.data, iobuf.len);
+    iobuf_free(&iobuf);
+}
+
+static void capture_record_checkpoint_file(struct capture_ctxt *ctxt, uint64_t time_ms,
+                                           const char *path, const char *filename)
+{
+    uint8_t buf[CAPTURE_CHECKPOINT_CHUNK_LEN];
+    uint32_t offset = 0;
+    ssize_t ret;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        WARN("%s: open %s: %m", __func__, path);
+        return;
+    }
+    do {
+        ret = read(fd, buf, sizeof(buf));
+        if (ret < 0) {
+            WARN("%s: read %s: %m", __func__, path);
+            break;
+        }
+        // Empty files are recorded too
+        if (ret || !offset)
+            capture_record_checkpoint_chunk(ctxt, time_ms, filename, offset, buf, ret);
+        offset += ret;
+    } while (ret == sizeof(buf));
+    close(fd);
+}
+
+void capture_checkpoint(const char *storage_prefix)
+{
+    struct capture_ctxt *ctxt = &g_capture_ctxt;
+    char dirname[PATH_MAX], path[PATH_MAX];
+    const char *basename;
+    uint64_t offset, time_ms;
+    struct dirent *dirent;
+    struct stat st;
+    DIR *dir;
+
+    if (ctxt->recfd < 0)
+        return;
+
+    if (!ctxt->idx_file) {
+        snprintf(path, sizeof(path), "%s.idx", ctxt->rec_filename);
+        ctxt->idx_file = fopen(path, "w");
+        FATAL_ON(!ctxt->idx_file, 2, "fopen %s: %m", path);
+        fprintf(ctxt->idx_file, "# checkpoint time_ms offset end_offset\n");
+    }
+
+    // storage_prefix is either a directory (ending with '/') or a directory
+    // followed by the beginning of the file names.
+    basename = strrchr(storage_prefix, '/');
+    basename = basename ? basename + 1 : storage_prefix;
+    snprintf(dirname, sizeof(dirname), "%.*s", (int)(basename - storage_prefix), storage_prefix);
+    if (!dirname[0])
+        strcpy(dirname, ".");
+
+    time_ms = time_now_ms(CLOCK_MONOTONIC);
+    capture_record_timers(ctxt);
+    offset = ctxt->rec_offset;
+    dir = opendir(dirname);
+    if (dir) {
+        while ((dirent = readdir(dir))) {
+            if (strncmp(dirent->d_name, basename, strlen(basename)))
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", dirname, dirent->d_name);
+            if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+                continue;
+            capture_record_checkpoint_file(ctxt, time_ms, path, dirent->d_name);
+        }
+        closedir(dir);
+    } else {
+        WARN("%s: opendir %s: %m", __func__, dirname);
+    }
+    // An empty file name marks the end of the checkpoint
+    capture_record_checkpoint_chunk(ctxt, time_ms, "", 0, NULL, 0);
+
+#ifdef HAVE_LIBZSTD
+    if (ctxt->zstd)
+        capture_zstd_flush(ctxt);
+#endif
+    fprintf(ctxt->idx_file, "%u %"PRIu64" %"PRIu64" %"PRIu64"\n",
+            ctxt->checkpoint_cnt, time_ms, offset, ctxt->rec_offset);
+    fflush(ctxt->idx_file);
+    ctxt->checkpoint_cnt++;
+}
+
 void capture_register_netfd(int fd)
 {
     struct capture_ctxt *ctxt = &g_capture_ctxt;
@@ -283,9 +482,19 @@ void capture_register_netfd(int fd)
 void capture_start(const char *filename)
 {
     struct capture_ctxt *ctxt = &g_capture_ctxt;
+    const char *ext = strrchr(filename, '.');
 
     ctxt->recfd = open(filename, O_WRONLY | O_CREAT | O_TRUNC,
                        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
     if (ctxt->recfd < 0)
         FATAL(2, "open %s: %m", filename);
+    ctxt->rec_filename = strdup(filename);
+    FATAL_ON(!ctxt->rec_filename, 2, "%s: strdup: %m", __func__);
+    if (ext && !strcmp(ext, ".zst")) {
+#ifdef HAVE_LIBZSTD
+        capture_zstd_init(ctxt);
+#else
+        FATAL(1, "%s: compiled without libzstd", filename);
+#endif
+    }
 }
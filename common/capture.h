@@ -29,6 +29,11 @@
  * read()/write() and write data to the capture file only after capture_start()
  * is called to set the output file. Finally, all random number generation must
  * use xgetrandom() to ensure reproducibility.
+ *
+ * capture_checkpoint() records a copy of the storage files, and appends its
+ * position to an index file (FILE.idx). wsbrd-fuzz can then restore the
+ * storage and start a replay from there instead of from the beginning of the
+ * capture.
  */
 
 ssize_t xread(int fd, void *buf, size_t buf_len);
@@ -48,5 +53,6 @@ ssize_t xgetrandom(void *buf, size_t buf_len, unsigned int flags);
 void capture_register_netfd(int fd);
 void capture_record_hif(const void *buf, size_t buf_len);
 void capture_start(const char *filename);
+void capture_checkpoint(const char *storage_prefix);
 
 #endif
@@ -0,0 +1,81 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include "common/log.h"
+
+#include "codel.h"
+
+static uint64_t codel_isqrt(uint64_t val)
+{
+    uint64_t res = val, prev;
+
+    if (val < 2)
+        return val;
+    // Newton's method, converges from above
+    do {
+        prev = res;
+        res = (res + val / res) / 2;
+    } while (res < prev);
+    return prev;
+}
+
+static uint64_t codel_control_law(const struct codel_params *params, uint64_t t_us, uint32_t count)
+{
+    // interval / sqrt(count), with 10 bits of fractional part for sqrt(count)
+    return t_us + params->interval_us * 1024 / codel_isqrt((uint64_t)count << 20);
+}
+
+// Implements dodequeue() from RFC 8289 section 5.5
+static bool codel_ok_to_drop(struct codel *codel, const struct codel_params *params,
+                             uint64_t sojourn_us, uint64_t now_us, bool backlog_small)
+{
+    if (sojourn_us < params->target_us || backlog_small) {
+        codel->first_above_us = 0;
+        return false;
+    }
+    if (!codel->first_above_us) {
+        codel->first_above_us = now_us + params->interval_us;
+        return false;
+    }
+    return now_us >= codel->first_above_us;
+}
+
+bool codel_drop(struct codel *codel, const struct codel_params *params,
+                uint64_t sojourn_us, uint64_t now_us, bool backlog_small)
+{
+    uint32_t delta;
+
+    BUG_ON(!params->interval_us);
+    if (!codel_ok_to_drop(codel, params, sojourn_us, now_us, backlog_small)) {
+        codel->dropping = false;
+        return false;
+    }
+    if (codel->dropping) {
+        if (now_us < codel->drop_next_us)
+            return false;
+        codel->count++;
+        codel->drop_next_us = codel_control_law(params, codel->drop_next_us, codel->count);
+        return true;
+    }
+    // Enter the dropping state. If it was left recently, resume with a drop
+    // rate close to the last one.
+    codel->dropping = true;
+    delta = codel->count - codel->lastcount;
+    if (delta > 1 && (int64_t)(now_us - codel->drop_next_us) < (int64_t)(16 * params->interval_us))
+        codel->count = delta;
+    else
+        codel->count = 1;
+    codel->drop_next_us = codel_control_law(params, now_us, codel->count);
+    codel->lastcount = codel->count;
+    return true;
+}
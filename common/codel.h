@@ -0,0 +1,53 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_CODEL_H
+#define COMMON_CODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Controlled Delay (CoDel) active queue management, as described in RFC 8289.
+ *
+ * Unlike RED, which looks at the length of the queue, CoDel looks at the time
+ * spent by the packets in the queue (sojourn time). This is better suited to
+ * links whose throughput varies a lot, like FHSS links where the airtime of a
+ * frame depends on the neighbor, the modulation and the retries.
+ *
+ * codel_drop() is called on dequeue with the sojourn time of the packet at the
+ * head of the queue. If it returns true, the packet is dropped and the
+ * function is called again for the next packet.
+ *
+ * The state is small, so it can be kept per flow (FQ-CoDel, RFC 8290).
+ */
+
+struct codel_params {
+    uint64_t target_us;   // Acceptable standing queue delay
+    uint64_t interval_us; // Typically the worst case RTT through the link
+};
+
+struct codel {
+    bool dropping;
+    uint32_t count;
+    uint32_t lastcount;
+    uint64_t first_above_us;
+    uint64_t drop_next_us;
+};
+
+// backlog_small is set when the queue holds less than a MTU worth of data, in
+// which case no packet is dropped whatever its sojourn time.
+bool codel_drop(struct codel *codel, const struct codel_params *params,
+                uint64_t sojourn_us, uint64_t now_us, bool backlog_small);
+
+#endif
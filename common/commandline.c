@@ -16,11 +16,13 @@
 #include <sys/stat.h>
 #include <fnmatch.h>
 #include <fcntl.h>
+#include <strings.h>
 #include <errno.h>
 #include <unistd.h>
 
 #include "common/specs/ws.h"
 #include "common/ws/ws_regdb.h"
+#include "common/crypto/nist_kw.h"
 #include "common/bits.h"
 #include "common/key_value_storage.h"
 #include "common/log.h"
@@ -65,6 +67,12 @@ const struct name_value valid_tristate[] = {
     { NULL },
 };
 
+const struct name_value valid_crypto_backends[] = {
+    { "mbedtls", NIST_KW_BACKEND_MBEDTLS },
+    { "af_alg",  NIST_KW_BACKEND_AF_ALG },
+    { NULL },
+};
+
 const struct name_value valid_booleans[] = {
     { "true",    1 },
     { "false",   0 },
@@ -248,6 +256,58 @@ void conf_set_flags(const struct storage_parse_info *info, void *raw_dest, const
     conf_add_flags(info, dest, raw_param);
 }
 
+// Parse "TAG:N[,TAG:N]". The special tag "warn" applies to WARN() call sites.
+static void conf_set_trace_ratelimit(const struct storage_parse_info *info,
+                                     struct tr_ratelimit_cfg cfg[32],
+                                     const struct name_value *specs, bool sample)
+{
+    char *tmp, *substr, *val, *end;
+    unsigned int mask;
+    long n;
+
+    tmp = strdup(info->value);
+    for (substr = strtok(tmp, ","); substr; substr = strtok(NULL, ",")) {
+        val = strchr(substr, ':');
+        if (!val)
+            FATAL(1, "%s:%d: missing value: %s", info->filename, info->linenr, substr);
+        *val++ = '\0';
+        n = strtol(val, &end, 0);
+        if (*end || n < 0 || n > 100000)
+            FATAL(1, "%s:%d: invalid %s: %s", info->filename, info->linenr, info->key, val);
+        if (!strcasecmp(substr, "warn")) {
+            if (sample)
+                g_warn_ratelimit_cfg.sample = n;
+            else
+                g_warn_ratelimit_cfg.rate = n;
+            continue;
+        }
+        mask = str_to_val(substr, specs);
+        for (int i = 0; i < 32; i++) {
+            if (!(mask & (1u << i)))
+                continue;
+            if (sample)
+                cfg[i].sample = n;
+            else
+                cfg[i].rate = n;
+        }
+    }
+    free(tmp);
+    g_trace_ratelimited = 0;
+    for (int i = 0; i < 32; i++)
+        if (cfg[i].rate || cfg[i].sample > 1)
+            g_trace_ratelimited |= 1u << i;
+}
+
+void conf_set_trace_rate(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
+{
+    conf_set_trace_ratelimit(info, raw_dest, raw_param, false);
+}
+
+void conf_set_trace_sample(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
+{
+    conf_set_trace_ratelimit(info, raw_dest, raw_param, true);
+}
+
 void conf_set_phy_op_modes(const struct storage_parse_info *info, void *raw_dest, const void *raw_param)
 {
     struct storage_parse_info sub_info = *info; // Copy struct to reuse conf_set_enum_int
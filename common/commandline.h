@@ -40,6 +40,7 @@ extern const struct number_limit valid_uint16;
 
 extern const struct name_value valid_tristate[];
 extern const struct name_value valid_booleans[];
+extern const struct name_value valid_crypto_backends[];
 
 extern const struct addrinfo valid_ipv4or6;
 extern const struct addrinfo valid_ipv6;
@@ -58,6 +59,8 @@ void conf_set_netaddr(const struct storage_parse_info *info, void *raw_dest, con
 void conf_set_bitmask(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
 void conf_add_flags(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
 void conf_set_flags(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
+void conf_set_trace_rate(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
+void conf_set_trace_sample(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
 void conf_set_phy_op_modes(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
 void conf_set_pem(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
 void conf_set_array(const struct storage_parse_info *info, void *raw_dest, const void *raw_param);
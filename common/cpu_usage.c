@@ -0,0 +1,243 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_BACKTRACE
+#include <backtrace.h>
+#endif
+#ifdef HAVE_LIBDL
+#include <dlfcn.h>
+#endif
+
+#include "common/log.h"
+#include "common/memutils.h"
+
+#include "cpu_usage.h"
+
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 33)
+#define HAVE_MALLINFO2
+#endif
+#endif
+
+bool g_cpu_usage_enabled;
+
+static struct {
+    bool heap;
+    struct cpu_usage_entry *entries;
+    int entries_len;
+    int entries_size;
+    struct cpu_usage_frame *cur;
+} g_cpu_usage;
+
+static uint64_t cpu_usage_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static size_t cpu_usage_heap(void)
+{
+#ifdef HAVE_MALLINFO2
+    if (g_cpu_usage.heap)
+        return mallinfo2().uordblks;
+#endif
+    return 0;
+}
+
+void cpu_usage_enable(bool heap)
+{
+#ifndef HAVE_MALLINFO2
+    if (heap)
+        WARN("heap accounting requires glibc >= 2.33");
+    heap = false;
+#endif
+    g_cpu_usage.heap = heap;
+    // Allocated early to not account it to the first callbacks
+    g_cpu_usage.entries_size = 64;
+    g_cpu_usage.entries = xalloc(g_cpu_usage.entries_size * sizeof(struct cpu_usage_entry));
+    g_cpu_usage_enabled = true;
+}
+
+void cpu_usage_enter(struct cpu_usage_frame *frame)
+{
+    frame->parent = g_cpu_usage.cur;
+    frame->child_ns = 0;
+    frame->child_heap = 0;
+    frame->heap_start = cpu_usage_heap();
+    frame->start_ns = cpu_usage_now_ns();
+    g_cpu_usage.cur = frame;
+}
+
+static struct cpu_usage_entry *cpu_usage_get(enum cpu_usage_type type, const void *func)
+{
+    struct cpu_usage_entry *entry;
+
+    // There are only a few dozens of different callbacks, and the most
+    // expensive ones are first once sorted by cpu_usage_entries().
+    for (int i = 0; i < g_cpu_usage.entries_len; i++)
+        if (g_cpu_usage.entries[i].func == func && g_cpu_usage.entries[i].type == type)
+            return &g_cpu_usage.entries[i];
+    if (g_cpu_usage.entries_len == g_cpu_usage.entries_size) {
+        g_cpu_usage.entries_size *= 2;
+        g_cpu_usage.entries = realloc(g_cpu_usage.entries,
+                                      g_cpu_usage.entries_size * sizeof(struct cpu_usage_entry));
+        FATAL_ON(!g_cpu_usage.entries, 2, "%s: realloc: %m", __func__);
+    }
+    entry = &g_cpu_usage.entries[g_cpu_usage.entries_len++];
+    memset(entry, 0, sizeof(*entry));
+    entry->func = func;
+    entry->type = type;
+    return entry;
+}
+
+void cpu_usage_leave(struct cpu_usage_frame *frame, enum cpu_usage_type type, const void *func)
+{
+    uint64_t total_ns = cpu_usage_now_ns() - frame->start_ns;
+    int64_t total_heap = (int64_t)cpu_usage_heap() - (int64_t)frame->heap_start;
+    struct cpu_usage_entry *entry;
+    uint64_t self_ns;
+
+    BUG_ON(g_cpu_usage.cur != frame);
+    g_cpu_usage.cur = frame->parent;
+    if (frame->parent) {
+        frame->parent->child_ns   += total_ns;
+        frame->parent->child_heap += total_heap;
+    }
+    self_ns = total_ns > frame->child_ns ? total_ns - frame->child_ns : 0;
+    entry = cpu_usage_get(type, func);
+    entry->calls++;
+    entry->cpu_ns += self_ns;
+    if (entry->cpu_max_ns < self_ns)
+        entry->cpu_max_ns = self_ns;
+    entry->heap_bytes += total_heap - frame->child_heap;
+}
+
+static int cpu_usage_cmp(const void *a, const void *b)
+{
+    const struct cpu_usage_entry *ea = a, *eb = b;
+
+    if (ea->cpu_ns == eb->cpu_ns)
+        return 0;
+    return ea->cpu_ns < eb->cpu_ns ? 1 : -1;
+}
+
+const struct cpu_usage_entry *cpu_usage_entries(int *count)
+{
+    qsort(g_cpu_usage.entries, g_cpu_usage.entries_len, sizeof(struct cpu_usage_entry), cpu_usage_cmp);
+    *count = g_cpu_usage.entries_len;
+    return g_cpu_usage.entries;
+}
+
+void cpu_usage_reset(void)
+{
+    // Entries are kept to not invalidate the search order
+    for (int i = 0; i < g_cpu_usage.entries_len; i++) {
+        g_cpu_usage.entries[i].calls      = 0;
+        g_cpu_usage.entries[i].cpu_ns     = 0;
+        g_cpu_usage.entries[i].cpu_max_ns = 0;
+        g_cpu_usage.entries[i].heap_bytes = 0;
+    }
+}
+
+const char *cpu_usage_type_str(enum cpu_usage_type type)
+{
+    static const char *names[] = {
+        [CPU_USAGE_FD]      = "fd",
+        [CPU_USAGE_TIMER]   = "timer",
+        [CPU_USAGE_TASKLET] = "tasklet",
+    };
+
+    static_assert(ARRAY_SIZE(names) == CPU_USAGE_TYPE_COUNT, "out-of-date names");
+    return names[type];
+}
+
+#ifdef HAVE_BACKTRACE
+static void cpu_usage_syminfo_cb(void *data, uintptr_t pc, const char *symname,
+                                 uintptr_t symval, uintptr_t symsize)
+{
+    const char **name = data;
+
+    if (symname && symval == pc)
+        *name = symname;
+}
+
+static void cpu_usage_error_cb(void *data, const char *msg, int errnum)
+{
+}
+#endif
+
+const char *cpu_usage_name(const struct cpu_usage_entry *entry, char *buf, size_t buf_len)
+{
+    const char *name = NULL;
+#ifdef HAVE_BACKTRACE
+    // Unlike dladdr(), libbacktrace reads the full symbol table and resolves
+    // static functions, which most of the callbacks are.
+    static struct backtrace_state *state;
+
+    if (!state)
+        state = backtrace_create_state(NULL, false, cpu_usage_error_cb, NULL);
+    if (state)
+        backtrace_syminfo(state, (uintptr_t)entry->func, cpu_usage_syminfo_cb, cpu_usage_error_cb, &name);
+#endif
+#ifdef HAVE_LIBDL
+    Dl_info info;
+
+    // dladdr() returns the closest exported symbol, which is only relevant
+    // on an exact match.
+    if (!name && dladdr(entry->func, &info) && info.dli_saddr == entry->func)
+        name = info.dli_sname;
+#endif
+    if (name)
+        snprintf(buf, buf_len, "%s", name);
+    else
+        snprintf(buf, buf_len, "%p", entry->func);
+    return buf;
+}
+
+void cpu_usage_dump(void)
+{
+    const struct cpu_usage_entry *entries;
+    uint64_t total_ns = 0;
+    char name[128];
+    int count;
+
+    if (!g_cpu_usage_enabled) {
+        INFO("cpu usage: accounting disabled");
+        return;
+    }
+    entries = cpu_usage_entries(&count);
+    for (int i = 0; i < count; i++)
+        total_ns += entries[i].cpu_ns;
+    INFO("cpu usage: %"PRIu64"ms in %d callbacks", total_ns / 1000000, count);
+    INFO("  %-7s %-40s %10s %10s %5s %9s %12s", "type", "callback", "calls", "cpu (ms)", "%", "max (us)", "heap (B)");
+    for (int i = 0; i < count; i++) {
+        if (!entries[i].calls)
+            continue;
+        INFO("  %-7s %-40s %10"PRIu64" %10"PRIu64" %5.1f %9"PRIu64" %12"PRId64,
+             cpu_usage_type_str(entries[i].type), cpu_usage_name(&entries[i], name, sizeof(name)),
+             entries[i].calls, entries[i].cpu_ns / 1000000,
+             total_ns ? 100.0 * entries[i].cpu_ns / total_ns : 0.0,
+             entries[i].cpu_max_ns / 1000, entries[i].heap_bytes);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_CPU_USAGE_H
+#define COMMON_CPU_USAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Accounting of the CPU time spent in the callbacks dispatched by the main
+ * loop: event sources (event_loop.c), timers (timer.c) and tasklets
+ * (events_scheduler.c). Entries are keyed by the address of the callback, so
+ * all the timers sharing a callback are accounted together, and are named
+ * from the symbol table when available.
+ *
+ * Time is measured with CLOCK_THREAD_CPUTIME_ID and is exclusive: the time
+ * spent in the timers and tasklets is not accounted to the event source which
+ * dispatched them.
+ *
+ * Optionally, the growth of the heap (mallinfo2) during each callback is
+ * accounted too. It is more expensive and only available with glibc.
+ *
+ * Nothing is done unless cpu_usage_enable() is called, the cost on the
+ * dispatch path is then a single test.
+ */
+
+enum cpu_usage_type {
+    CPU_USAGE_FD,
+    CPU_USAGE_TIMER,
+    CPU_USAGE_TASKLET,
+    CPU_USAGE_TYPE_COUNT,
+};
+
+struct cpu_usage_entry {
+    const void *func;
+    enum cpu_usage_type type;
+    uint64_t calls;
+    uint64_t cpu_ns;
+    uint64_t cpu_max_ns;
+    int64_t heap_bytes;
+};
+
+// Allocated on the stack of the dispatcher
+struct cpu_usage_frame {
+    struct cpu_usage_frame *parent;
+    uint64_t start_ns;
+    uint64_t child_ns;
+    size_t heap_start;
+    int64_t child_heap;
+};
+
+extern bool g_cpu_usage_enabled;
+
+void cpu_usage_enable(bool heap);
+
+void cpu_usage_enter(struct cpu_usage_frame *frame);
+void cpu_usage_leave(struct cpu_usage_frame *frame, enum cpu_usage_type type, const void *func);
+
+// Entries are sorted by decreasing CPU time. The array is valid until the
+// next dispatched callback.
+const struct cpu_usage_entry *cpu_usage_entries(int *count);
+const char *cpu_usage_name(const struct cpu_usage_entry *entry, char *buf, size_t buf_len);
+const char *cpu_usage_type_str(enum cpu_usage_type type);
+void cpu_usage_reset(void);
+void cpu_usage_dump(void);
+
+#endif
@@ -22,6 +22,7 @@
 #define CRC_XOROUT_LEGACY 0xffff
 
 uint16_t crc16(uint16_t crc, const uint8_t *data, int len);
+uint32_t crc32(uint32_t crc, const uint8_t *data, int len);
 bool crc_check(uint16_t init, const uint8_t *data, int len, uint16_t expected_crc);
 
 #endif
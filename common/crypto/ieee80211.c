@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <endian.h>
 #include <mbedtls/md.h>
+#include <mbedtls/sha1.h>
 #include "common/specs/ieee80211.h"
 #include "common/specs/eapol.h"
 #include "common/crypto/hmac_md.h"
@@ -26,12 +27,85 @@
 #include "common/rand.h"
 #include "common/log.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/mbedtls_extra.h"
 #include "common/eapol.h"
 
 #include "ieee80211.h"
 
-bool ieee80211_is_mic_valid(const uint8_t ptk[48], const struct eapol_key_frame *frame,
+static void ieee80211_kck_slot_set(struct ieee80211_kck_slot *slot, const uint8_t kck[16])
+{
+    uint8_t pad[64] = { };
+
+    memcpy(slot->kck, kck, sizeof(slot->kck));
+    memcpy(pad, kck, IEEE80211_AKM_1_KCK_LEN_BYTES);
+    for (int i = 0; i < sizeof(pad); i++)
+        pad[i] ^= 0x36;
+    mbedtls_sha1_init(&slot->inner);
+    xmbedtls_sha1_starts(&slot->inner);
+    xmbedtls_sha1_update(&slot->inner, pad, sizeof(pad));
+    for (int i = 0; i < sizeof(pad); i++)
+        pad[i] ^= 0x36 ^ 0x5c;
+    mbedtls_sha1_init(&slot->outer);
+    xmbedtls_sha1_starts(&slot->outer);
+    xmbedtls_sha1_update(&slot->outer, pad, sizeof(pad));
+    slot->set = true;
+}
+
+static struct ieee80211_kck_slot *ieee80211_kck_slot_get(struct ieee80211_key_cache *cache, const uint8_t kck[16])
+{
+    struct ieee80211_kck_slot *slot;
+
+    for (int i = 0; i < ARRAY_SIZE(cache->kck_slots); i++) {
+        slot = &cache->kck_slots[i];
+        if (slot->set && !memcmp(slot->kck, kck, sizeof(slot->kck))) {
+            cache->kck_slot_last = i;
+            return slot;
+        }
+    }
+    // Replace the slot not used last
+    cache->kck_slot_last = (cache->kck_slot_last + 1) % ARRAY_SIZE(cache->kck_slots);
+    slot = &cache->kck_slots[cache->kck_slot_last];
+    ieee80211_kck_slot_set(slot, kck);
+    return slot;
+}
+
+static const struct ieee80211_kck_slot *ieee80211_mic_start(struct ieee80211_key_cache *cache,
+                                                            const uint8_t ptk[48],
+                                                            mbedtls_sha1_context *sha1)
+{
+    struct ieee80211_kck_slot *slot = ieee80211_kck_slot_get(cache, ieee80211_kck(ptk));
+
+    mbedtls_sha1_init(sha1);
+    mbedtls_sha1_clone(sha1, &slot->inner);
+    return slot;
+}
+
+static void ieee80211_mic_finish(const struct ieee80211_kck_slot *slot,
+                                 mbedtls_sha1_context *sha1, uint8_t hmac[20])
+{
+    xmbedtls_sha1_finish(sha1, hmac);
+    mbedtls_sha1_clone(sha1, &slot->outer);
+    xmbedtls_sha1_update(sha1, hmac, 20);
+    xmbedtls_sha1_finish(sha1, hmac);
+    mbedtls_sha1_free(sha1);
+}
+
+void ieee80211_mic_compute(struct ieee80211_key_cache *cache, const uint8_t ptk[48],
+                           const void *data, size_t data_len, uint8_t mic[16])
+{
+    const struct ieee80211_kck_slot *slot;
+    mbedtls_sha1_context sha1;
+    uint8_t hmac[20];
+
+    slot = ieee80211_mic_start(cache, ptk, &sha1);
+    xmbedtls_sha1_update(&sha1, data, data_len);
+    ieee80211_mic_finish(slot, &sha1, hmac);
+    memcpy(mic, hmac, 16);
+}
+
+bool ieee80211_is_mic_valid(struct ieee80211_key_cache *cache, const uint8_t ptk[48],
+                            const struct eapol_key_frame *frame,
                             const uint8_t *data, size_t data_len)
 {
     struct eapol_hdr eapol = {
@@ -39,20 +113,18 @@ bool ieee80211_is_mic_valid(const uint8_t ptk[48], const struct eapol_key_frame
         .packet_type        = EAPOL_PACKET_TYPE_KEY,
         .packet_body_length = htobe16(sizeof(*frame) + data_len),
     };
-    mbedtls_md_context_t sha1;
+    const struct ieee80211_kck_slot *slot;
+    mbedtls_sha1_context sha1;
     uint8_t hmac[20] = { };
 
-    mbedtls_md_init(&sha1);
-    xmbedtls_md_setup(&sha1, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1);
-    xmbedtls_md_hmac_starts(&sha1, ieee80211_kck(ptk), IEEE80211_AKM_1_KCK_LEN_BYTES);
-    xmbedtls_md_hmac_update(&sha1, (uint8_t *)&eapol, sizeof(eapol));
-    xmbedtls_md_hmac_update(&sha1, (uint8_t *)frame, offsetof(struct eapol_key_frame, mic));
-    xmbedtls_md_hmac_update(&sha1, hmac, sizeof(frame->mic));
-    xmbedtls_md_hmac_update(&sha1, (uint8_t *)frame + offsetof(struct eapol_key_frame, mic) + sizeof(frame->mic),
-                            sizeof(*frame) - offsetof(struct eapol_key_frame, mic) - sizeof(frame->mic));
-    xmbedtls_md_hmac_update(&sha1, data, data_len);
-    xmbedtls_md_hmac_finish(&sha1, hmac);
-    mbedtls_md_free(&sha1);
+    slot = ieee80211_mic_start(cache, ptk, &sha1);
+    xmbedtls_sha1_update(&sha1, (uint8_t *)&eapol, sizeof(eapol));
+    xmbedtls_sha1_update(&sha1, (uint8_t *)frame, offsetof(struct eapol_key_frame, mic));
+    xmbedtls_sha1_update(&sha1, hmac, sizeof(frame->mic));
+    xmbedtls_sha1_update(&sha1, (uint8_t *)frame + offsetof(struct eapol_key_frame, mic) + sizeof(frame->mic),
+                         sizeof(*frame) - offsetof(struct eapol_key_frame, mic) - sizeof(frame->mic));
+    xmbedtls_sha1_update(&sha1, data, data_len);
+    ieee80211_mic_finish(slot, &sha1, hmac);
     return !memcmp(hmac, frame->mic, sizeof(frame->mic));
 }
 
@@ -67,8 +139,11 @@ void ieee80211_prf(const uint8_t *key, size_t key_len, const char *label,
 
     mbedtls_md_init(&sha1);
     xmbedtls_md_setup(&sha1, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1);
+    xmbedtls_md_hmac_starts(&sha1, key, key_len);
     for (uint8_t i = 0; i < roundup(result_size, 20) / 20; i++) {
-        xmbedtls_md_hmac_starts(&sha1, key, key_len);
+        // Reuse the keyed state instead of hashing the key again
+        if (i)
+            xmbedtls_md_hmac_reset(&sha1);
         xmbedtls_md_hmac_update(&sha1, (uint8_t *)label, strlen(label) + 1); // A + Y
         xmbedtls_md_hmac_update(&sha1, data, data_len);                      // B
         xmbedtls_md_hmac_update(&sha1, &i, 1);                               // X
@@ -119,7 +194,8 @@ void ieee80211_derive_ptk384(const uint8_t pmk[32], const uint8_t auth_eui64[8],
     ieee80211_prf(pmk, 32, "Pairwise key expansion", (const uint8_t *)&data, sizeof(data), ptk, 48);
 }
 
-void ieee80211_derive_pmkid(const uint8_t pmk[32], const uint8_t auth_eui64[8], const uint8_t supp_eui64[8],
+void ieee80211_derive_pmkid(struct ieee80211_key_cache *cache,
+                            const uint8_t pmk[32], const uint8_t auth_eui64[8], const uint8_t supp_eui64[8],
                             uint8_t pmkid[16])
 {
     struct {
@@ -130,7 +206,21 @@ void ieee80211_derive_pmkid(const uint8_t pmk[32], const uint8_t auth_eui64[8],
         .pmk_name = "PMK Name",
     };
 
+    if (cache && cache->pmkid.set &&
+        !memcmp(cache->pmkid.pmk, pmk, sizeof(cache->pmkid.pmk)) &&
+        !memcmp(cache->pmkid.auth_eui64, auth_eui64, sizeof(cache->pmkid.auth_eui64)) &&
+        !memcmp(cache->pmkid.supp_eui64, supp_eui64, sizeof(cache->pmkid.supp_eui64))) {
+        memcpy(pmkid, cache->pmkid.pmkid, sizeof(cache->pmkid.pmkid));
+        return;
+    }
     memcpy(data.auth_eui64, auth_eui64, sizeof(data.auth_eui64));
     memcpy(data.supp_eui64, supp_eui64, sizeof(data.supp_eui64));
     hmac_md_sha1(pmk, 32, (const uint8_t *)&data, sizeof(data), pmkid, 16);
+    if (!cache)
+        return;
+    memcpy(cache->pmkid.pmk, pmk, sizeof(cache->pmkid.pmk));
+    memcpy(cache->pmkid.auth_eui64, auth_eui64, sizeof(cache->pmkid.auth_eui64));
+    memcpy(cache->pmkid.supp_eui64, supp_eui64, sizeof(cache->pmkid.supp_eui64));
+    memcpy(cache->pmkid.pmkid, pmkid, sizeof(cache->pmkid.pmkid));
+    cache->pmkid.set = true;
 }
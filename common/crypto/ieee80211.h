@@ -20,16 +20,52 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <mbedtls/sha1.h>
 
 #include "common/specs/ieee80211.h"
 
 struct eapol_key_frame;
 
+/*
+ * Values derived from the keys of a peer, to avoid rehashing on every
+ * EAPOL-Key frame:
+ * - HMAC-SHA1 states keyed with the KCKs last used, where the hashes of
+ *   K ^ ipad and K ^ opad (RFC 2104 2.) are computed once per KCK. There is
+ *   one slot for the PTK and one for the TPTK.
+ * - The last PMKID.
+ * Entries are looked up by their inputs, so the cache never needs to be
+ * flushed when keys change. Zero-initialized caches are valid.
+ */
+struct ieee80211_key_cache {
+    struct ieee80211_kck_slot {
+        uint8_t kck[IEEE80211_AKM_1_KCK_LEN_BYTES];
+        bool set;
+        mbedtls_sha1_context inner;
+        mbedtls_sha1_context outer;
+    } kck_slots[2];
+    int kck_slot_last;
+    struct {
+        uint8_t pmk[32];
+        uint8_t auth_eui64[8];
+        uint8_t supp_eui64[8];
+        uint8_t pmkid[16];
+        bool set;
+    } pmkid;
+};
+
+/*
+ * Compute the Key MIC of the EAPOL-Key frame in "data", whose MIC field is
+ * zeroed, as described in IEEE 802.11-2020 12.7.2.
+ */
+void ieee80211_mic_compute(struct ieee80211_key_cache *cache, const uint8_t ptk[48],
+                           const void *data, size_t data_len, uint8_t mic[16]);
+
 /*
  * Check the Message Integrity Check (MIC) provided by "frame" properly matches with
  * the content of "data" as described in IEEE 802.11-2020.
  */
-bool ieee80211_is_mic_valid(const uint8_t ptk[48], const struct eapol_key_frame *frame,
+bool ieee80211_is_mic_valid(struct ieee80211_key_cache *cache, const uint8_t ptk[48],
+                            const struct eapol_key_frame *frame,
                             const uint8_t *data, size_t data_len);
 
 /*
@@ -85,8 +121,10 @@ static inline const uint8_t *ieee80211_tk(const uint8_t ptk[48])
  *
  * PMKID = Truncate-128(HMAC-SHA-1(PMK, “PMK Name” || AA || SPA))
  *
+ * cache may be NULL.
  */
-void ieee80211_derive_pmkid(const uint8_t pmk[32], const uint8_t auth_eui64[8], const uint8_t supp_eui64[8],
+void ieee80211_derive_pmkid(struct ieee80211_key_cache *cache,
+                            const uint8_t pmk[32], const uint8_t auth_eui64[8], const uint8_t supp_eui64[8],
                             uint8_t pmkid[16]);
 
 #endif
@@ -15,14 +15,154 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <linux/if_alg.h>
+#include <sys/socket.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
 #include <errno.h>
 #include <mbedtls/nist_kw.h>
 
 #include "nist_kw.h"
 
-int nist_kw_core(bool is_wrap, const uint8_t *key, size_t key_bits,
+#ifndef SOL_ALG
+#define SOL_ALG 279
+#endif
+
+static struct {
+    enum nist_kw_backend backend;
+    int alg_fd; // AF_ALG socket bound to ecb(aes)
+} g_nist_kw = {
+    .backend = NIST_KW_BACKEND_MBEDTLS,
+    .alg_fd  = -1,
+};
+
+int nist_kw_backend_set(enum nist_kw_backend backend)
+{
+    struct sockaddr_alg sa = {
+        .salg_family = AF_ALG,
+        .salg_type   = "skcipher",
+        .salg_name   = "ecb(aes)",
+    };
+    int ret;
+
+    if (backend == NIST_KW_BACKEND_AF_ALG && g_nist_kw.alg_fd < 0) {
+        g_nist_kw.alg_fd = socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (g_nist_kw.alg_fd < 0)
+            return -errno;
+        if (bind(g_nist_kw.alg_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+            ret = -errno;
+            close(g_nist_kw.alg_fd);
+            g_nist_kw.alg_fd = -1;
+            return ret;
+        }
+    }
+    g_nist_kw.backend = backend;
+    return 0;
+}
+
+static int nist_kw_alg_aes(int op_fd, bool encrypt, uint8_t block[16])
+{
+    union {
+        struct cmsghdr hdr;
+        uint8_t buf[CMSG_SPACE(sizeof(uint32_t))];
+    } cmsg = { };
+    struct iovec iov = {
+        .iov_base = block,
+        .iov_len  = 16,
+    };
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cmsg.buf,
+        .msg_controllen = sizeof(cmsg.buf),
+    };
+    uint32_t op = encrypt ? ALG_OP_ENCRYPT : ALG_OP_DECRYPT;
+
+    cmsg.hdr.cmsg_level = SOL_ALG;
+    cmsg.hdr.cmsg_type  = ALG_SET_OP;
+    cmsg.hdr.cmsg_len   = CMSG_LEN(sizeof(op));
+    memcpy(CMSG_DATA(&cmsg.hdr), &op, sizeof(op));
+    if (sendmsg(op_fd, &msg, 0) != 16)
+        return -EIO;
+    if (read(op_fd, block, 16) != 16)
+        return -EIO;
+    return 0;
+}
+
+/*
+ *   RFC 3394 2.2.1 Key Wrap and 2.2.2 Key Unwrap (index based)
+ * With A the 64-bit integrity check register, R[1..n] the semiblocks and
+ * t = n * j + i:
+ *   wrap:   B = AES(K, A | R[i]),       A = MSB(64, B) ^ t, R[i] = LSB(64, B)
+ *   unwrap: B = AES-1(K, (A ^ t) | R[i]), A = MSB(64, B),   R[i] = LSB(64, B)
+ */
+static int nist_kw_core_alg(bool is_wrap, const uint8_t *key, size_t key_bits,
+                            const uint8_t *input, size_t input_size,
+                            uint8_t *output, size_t output_size)
+{
+    static const uint8_t iv[8] = { 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6 };
+    size_t n = input_size / 8 - (is_wrap ? 0 : 1);
+    uint8_t block[16];
+    uint8_t *r = output;
+    uint64_t t;
+    int op_fd;
+    int ret;
+
+    if (input_size % 8 || n < 2 || output_size < n * 8 + (is_wrap ? 8 : 0))
+        return -EINVAL;
+    if (setsockopt(g_nist_kw.alg_fd, SOL_ALG, ALG_SET_KEY, key, key_bits / 8) < 0)
+        return -errno;
+    op_fd = accept(g_nist_kw.alg_fd, NULL, 0);
+    if (op_fd < 0)
+        return -errno;
+
+    // A is kept in block[0..7] between iterations
+    if (is_wrap) {
+        r = output + 8;
+        memcpy(block, iv, 8);
+        memmove(r, input, n * 8);
+        for (int j = 0; j <= 5; j++) {
+            for (size_t i = 1; i <= n; i++) {
+                memcpy(block + 8, r + (i - 1) * 8, 8);
+                ret = nist_kw_alg_aes(op_fd, true, block);
+                if (ret)
+                    goto end;
+                t = n * j + i;
+                for (int k = 0; k < 8; k++)
+                    block[7 - k] ^= t >> (8 * k);
+                memcpy(r + (i - 1) * 8, block + 8, 8);
+            }
+        }
+        memcpy(output, block, 8);
+        ret = (n + 1) * 8;
+    } else {
+        memcpy(block, input, 8);
+        memmove(r, input + 8, n * 8);
+        for (int j = 5; j >= 0; j--) {
+            for (size_t i = n; i >= 1; i--) {
+                t = n * j + i;
+                for (int k = 0; k < 8; k++)
+                    block[7 - k] ^= t >> (8 * k);
+                memcpy(block + 8, r + (i - 1) * 8, 8);
+                ret = nist_kw_alg_aes(op_fd, false, block);
+                if (ret)
+                    goto end;
+                memcpy(r + (i - 1) * 8, block + 8, 8);
+            }
+        }
+        ret = memcmp(block, iv, 8) ? -EINVAL : n * 8;
+    }
+end:
+    if (ret < 0)
+        memset(output, 0, output_size);
+    memset(block, 0, sizeof(block));
+    close(op_fd);
+    return ret;
+}
+
+static int nist_kw_core(bool is_wrap, const uint8_t *key, size_t key_bits,
                  const uint8_t *input, size_t input_size,
                  uint8_t *output, size_t output_size)
 {
@@ -53,6 +193,8 @@ int nist_kw_unwrap(const uint8_t *key, size_t key_bits,
                    const uint8_t *input, size_t input_size,
                    uint8_t *output, size_t output_size)
 {
+    if (g_nist_kw.backend == NIST_KW_BACKEND_AF_ALG)
+        return nist_kw_core_alg(false, key, key_bits, input, input_size, output, output_size);
     return nist_kw_core(false, key, key_bits, input, input_size, output, output_size);
 }
 
@@ -60,6 +202,8 @@ int nist_kw_wrap(const uint8_t *key, size_t key_bits,
                  const uint8_t *input, size_t input_size,
                  uint8_t *output, size_t output_size)
 {
+    if (g_nist_kw.backend == NIST_KW_BACKEND_AF_ALG)
+        return nist_kw_core_alg(true, key, key_bits, input, input_size, output, output_size);
     return nist_kw_core(true, key, key_bits, input, input_size, output, output_size);
 }
 
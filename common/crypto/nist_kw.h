@@ -24,13 +24,29 @@
  * Implement Key Wrapping (KW) as defined in NIST SP 800-38F (using AES as
  * cipher).
  *
- * The code is only a wrapper around mbedtls_nist_kw_wrap() and
+ * By default, the code is only a wrapper around mbedtls_nist_kw_wrap() and
  * mbedtls_nist_kw_unwrap(). Parameters are described in nist_kw.h of mbedtls.
  *
  * The functions return a negative value on error or number of bytes in "output"
  * buffer on success.
  */
 
+enum nist_kw_backend {
+    NIST_KW_BACKEND_MBEDTLS,
+    // AES blocks are ciphered by the Linux crypto API through an AF_ALG
+    // socket, which uses the crypto engine of the SoC when the kernel has a
+    // driver for it. Every block costs a system call, so this is expected to
+    // be slower than mbedTLS with CPU crypto extensions.
+    NIST_KW_BACKEND_AF_ALG,
+};
+
+/*
+ * Select the implementation used by nist_kw_wrap() and nist_kw_unwrap().
+ * Return a negative errno if the backend is not available, in which case the
+ * previous one is kept.
+ */
+int nist_kw_backend_set(enum nist_kw_backend backend);
+
 int nist_kw_unwrap(const uint8_t *key, size_t key_bits,
                    const uint8_t *input, size_t input_size,
                    uint8_t *output, size_t output_size);
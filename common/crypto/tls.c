@@ -13,12 +13,19 @@
  */
 
 #define _GNU_SOURCE
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include <mbedtls/debug.h>
 #include <mbedtls/oid.h>
 
+#include "common/key_value_storage.h"
 #include "common/mbedtls_extra.h"
 #include "common/time_extra.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/parsers.h"
 #include "common/log.h"
 
 #include "tls.h"
@@ -71,6 +78,15 @@ void tls_install_pmk(struct tls_client_ctx *tls_client, const uint8_t key[32])
     TRACE(TR_SECURITY, "sec: pmk installed");
 }
 
+void tls_install_pending_pmk(struct tls_client_ctx *tls_client)
+{
+    if (!tls_client->pmk_pending)
+        return;
+    tls_install_pmk(tls_client, tls_client->pmk_pending_key);
+    memset(tls_client->pmk_pending_key, 0, sizeof(tls_client->pmk_pending_key));
+    tls_client->pmk_pending = false;
+}
+
 /*
  *   RFC5216 - 2.3. Key Hierarchy
  * Key_Material = TLS-PRF-128(master_secret, "client EAP encryption",
@@ -96,9 +112,312 @@ static void tls_export_keys(void *ctx, mbedtls_ssl_key_export_type type,
 
     ret = mbedtls_ssl_tls_prf(tls_prf_type, secret, secret_len, "client EAP encryption", random, sizeof(random),
                               derived_key, sizeof(derived_key));
-    FATAL_ON(ret, 2, "%s: mbedtls_ssl_tls_prf: %s", __func__, tr_mbedtls_err(ret));
+    // Cannot fail with valid parameters, avoid logging from a worker thread
+    BUG_ON(ret);
 
-    tls_install_pmk(tls_client, derived_key);
+    if (tls_client->pmk_defer) {
+        memcpy(tls_client->pmk_pending_key, derived_key, sizeof(tls_client->pmk_pending_key));
+        tls_client->pmk_pending = true;
+    } else {
+        tls_install_pmk(tls_client, derived_key);
+    }
+}
+
+// Sessions are stored as "data[i]" lines which must fit in
+// struct storage_parse_info.value
+#define TLS_SESSION_LINE_LEN 64
+#define TLS_SESSION_MAX_LEN  4096
+
+// Connection whose handshake is processed by the current thread. The session
+// cache callbacks only get the shared configuration, so this is how they find
+// the EUI-64 of the supplicant.
+static __thread struct tls_client_ctx *tls_cur_client;
+
+int tls_handshake(struct tls_client_ctx *tls_client)
+{
+    int ret;
+
+    tls_cur_client = tls_client;
+    ret = mbedtls_ssl_handshake(&tls_client->ssl_ctx);
+    tls_cur_client = NULL;
+    return ret;
+}
+
+// Must be called with cache->lock held
+static struct tls_session *tls_session_get(struct tls_session_cache *cache, const uint8_t eui64[8])
+{
+    struct tls_session *entry;
+
+    TAILQ_FOREACH(entry, &cache->sessions, link)
+        if (!memcmp(entry->eui64, eui64, sizeof(entry->eui64)))
+            return entry;
+    return NULL;
+}
+
+// May run on a worker thread
+static int tls_session_cache_get(void *ctx, const unsigned char *id, size_t id_len,
+                                 mbedtls_ssl_session *session)
+{
+    struct tls_session_cache *cache = ctx;
+    struct tls_session *entry;
+    int ret = -1;
+
+    if (!tls_cur_client)
+        return -1;
+    pthread_mutex_lock(&cache->lock);
+    entry = tls_session_get(cache, tls_cur_client->eui64);
+    if (entry && entry->id_len == id_len && !memcmp(entry->id, id, id_len) &&
+        (!entry->expire_s || entry->expire_s > time_now_s(CLOCK_REALTIME))) {
+        ret = mbedtls_ssl_session_load(session, entry->data, entry->data_len);
+        if (!ret) {
+            TAILQ_REMOVE(&cache->sessions, entry, link);
+            TAILQ_INSERT_HEAD(&cache->sessions, entry, link);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return ret ? -1 : 0;
+}
+
+// May run on a worker thread, the session is only saved in the connection
+// context and inserted in the cache by tls_session_store().
+static int tls_session_cache_set(void *ctx, const unsigned char *id, size_t id_len,
+                                 const mbedtls_ssl_session *session)
+{
+    struct tls_client_ctx *tls_client = tls_cur_client;
+    size_t len;
+    int ret;
+
+    if (!tls_client || id_len > sizeof(tls_client->session_pending_id))
+        return -1;
+    ret = mbedtls_ssl_session_save(session, NULL, 0, &len);
+    if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL || len > TLS_SESSION_MAX_LEN)
+        return -1;
+    free(tls_client->session_pending);
+    tls_client->session_pending = xalloc(len);
+    ret = mbedtls_ssl_session_save(session, tls_client->session_pending, len, &len);
+    if (ret) {
+        free(tls_client->session_pending);
+        tls_client->session_pending = NULL;
+        return -1;
+    }
+    tls_client->session_pending_len = len;
+    memcpy(tls_client->session_pending_id, id, id_len);
+    tls_client->session_pending_id_len = id_len;
+    return 0;
+}
+
+static void tls_session_filename(const uint8_t eui64[8], char *filename, size_t filename_len)
+{
+    strcpy(filename, "tls-");
+    str_key(eui64, 8, filename + strlen(filename), filename_len - strlen(filename));
+}
+
+static void tls_session_write(const struct tls_session *entry)
+{
+    struct storage_parse_info *info;
+    char str_buf[256];
+
+    if (!g_storage_prefix)
+        return;
+    tls_session_filename(entry->eui64, str_buf, sizeof(str_buf));
+    info = storage_open_prefix(str_buf, "w");
+    if (!info)
+        return;
+    str_key(entry->id, entry->id_len, str_buf, sizeof(str_buf));
+    fprintf(info->file, "id = %s\n", str_buf);
+    fprintf(info->file, "expire = %" PRIu64 "\n", entry->expire_s);
+    fprintf(info->file, "data_len = %zu\n", entry->data_len);
+    for (size_t i = 0; i * TLS_SESSION_LINE_LEN < entry->data_len; i++) {
+        str_key(entry->data + i * TLS_SESSION_LINE_LEN,
+                MIN(TLS_SESSION_LINE_LEN, entry->data_len - i * TLS_SESSION_LINE_LEN),
+                str_buf, sizeof(str_buf));
+        fprintf(info->file, "data[%zu] = %s\n", i, str_buf);
+    }
+    storage_close(info);
+}
+
+static void tls_session_unlink(const uint8_t eui64[8])
+{
+    const char *files[] = { NULL, NULL };
+    char filename[256];
+
+    if (!g_storage_prefix)
+        return;
+    tls_session_filename(eui64, filename, sizeof(filename));
+    if (!storage_exists(filename))
+        return;
+    files[0] = filename;
+    storage_delete(files);
+}
+
+// Must be called with cache->lock held
+static void tls_session_free(struct tls_session_cache *cache, struct tls_session *entry)
+{
+    TAILQ_REMOVE(&cache->sessions, entry, link);
+    cache->count--;
+    free(entry->data);
+    free(entry);
+}
+
+// Must be called with cache->lock held. Returns the evicted EUI-64 in evicted.
+static struct tls_session *tls_session_new(struct tls_session_cache *cache, const uint8_t eui64[8],
+                                           uint8_t evicted[8], bool *has_evicted)
+{
+    struct tls_session *entry;
+
+    *has_evicted = cache->count >= cache->max;
+    if (*has_evicted) {
+        entry = TAILQ_LAST(&cache->sessions, tls_session_list);
+        memcpy(evicted, entry->eui64, 8);
+        tls_session_free(cache, entry);
+    }
+    entry = zalloc(sizeof(*entry));
+    memcpy(entry->eui64, eui64, sizeof(entry->eui64));
+    TAILQ_INSERT_HEAD(&cache->sessions, entry, link);
+    cache->count++;
+    return entry;
+}
+
+void tls_session_store(struct tls_ctx *tls, struct tls_client_ctx *tls_client, int lifetime_s)
+{
+    struct tls_session_cache *cache = &tls->session_cache;
+    struct tls_session *entry;
+    bool has_evicted = false;
+    uint8_t evicted[8];
+
+    if (!tls_client->session_pending)
+        return;
+    pthread_mutex_lock(&cache->lock);
+    entry = tls_session_get(cache, tls_client->eui64);
+    if (entry) {
+        TAILQ_REMOVE(&cache->sessions, entry, link);
+        TAILQ_INSERT_HEAD(&cache->sessions, entry, link);
+        free(entry->data);
+    } else {
+        entry = tls_session_new(cache, tls_client->eui64, evicted, &has_evicted);
+    }
+    entry->data     = tls_client->session_pending;
+    entry->data_len = tls_client->session_pending_len;
+    memcpy(entry->id, tls_client->session_pending_id, tls_client->session_pending_id_len);
+    entry->id_len   = tls_client->session_pending_id_len;
+    entry->expire_s = lifetime_s ? time_now_s(CLOCK_REALTIME) + lifetime_s : 0;
+    pthread_mutex_unlock(&cache->lock);
+    tls_client->session_pending = NULL;
+    tls_client->session_pending_len = 0;
+
+    // Entries are only freed by the main thread
+    if (has_evicted)
+        tls_session_unlink(evicted);
+    tls_session_write(entry);
+    TRACE(TR_SECURITY, "sec: tls session cached eui64=%s", tr_eui64(entry->eui64));
+}
+
+void tls_session_del(struct tls_ctx *tls, const uint8_t eui64[8])
+{
+    struct tls_session_cache *cache = &tls->session_cache;
+    struct tls_session *entry;
+
+    if (!cache->max)
+        return;
+    pthread_mutex_lock(&cache->lock);
+    entry = tls_session_get(cache, eui64);
+    if (entry)
+        tls_session_free(cache, entry);
+    pthread_mutex_unlock(&cache->lock);
+    tls_session_unlink(eui64);
+}
+
+static void tls_session_read(struct tls_session_cache *cache, const char *filename, const uint8_t eui64[8])
+{
+    struct storage_parse_info *info;
+    struct tls_session *entry;
+    bool has_evicted;
+    uint8_t evicted[8];
+    uint8_t *data = NULL;
+    size_t data_len = 0;
+    uint64_t expire_s = 0;
+    uint8_t id[32];
+    size_t id_len = 0;
+    size_t chunk_len;
+    int ret;
+
+    info = storage_open(filename, "r");
+    if (!info)
+        return;
+    for (;;) {
+        ret = storage_parse_line(info);
+        if (ret == EOF)
+            break;
+        if (ret) {
+            WARN("%s:%d: invalid line: '%s'", info->filename, info->linenr, info->line);
+        } else if (!fnmatch("id", info->key, 0)) {
+            id_len = (strlen(info->value) + 1) / 3;
+            if (id_len > sizeof(id) || parse_byte_array(id, id_len, info->value)) {
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+                id_len = 0;
+            }
+        } else if (!fnmatch("expire", info->key, 0)) {
+            expire_s = strtoull(info->value, NULL, 0);
+        } else if (!fnmatch("data_len", info->key, 0) && !data) {
+            data_len = strtoul(info->value, NULL, 0);
+            if (!data_len || data_len > TLS_SESSION_MAX_LEN) {
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+                break;
+            }
+            data = zalloc(data_len);
+        } else if (!fnmatch("data\\[*]", info->key, 0) && data &&
+                   info->key_array_index * TLS_SESSION_LINE_LEN < data_len) {
+            chunk_len = MIN(TLS_SESSION_LINE_LEN, data_len - info->key_array_index * TLS_SESSION_LINE_LEN);
+            if (parse_byte_array(data + info->key_array_index * TLS_SESSION_LINE_LEN, chunk_len, info->value))
+                WARN("%s:%d: invalid value: %s", info->filename, info->linenr, info->value);
+        } else {
+            WARN("%s:%d: invalid key: '%s'", info->filename, info->linenr, info->line);
+        }
+    }
+    storage_close(info);
+    if (!data || !id_len || (expire_s && expire_s <= time_now_s(CLOCK_REALTIME))) {
+        free(data);
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    entry = tls_session_new(cache, eui64, evicted, &has_evicted);
+    entry->data     = data;
+    entry->data_len = data_len;
+    memcpy(entry->id, id, id_len);
+    entry->id_len   = id_len;
+    entry->expire_s = expire_s;
+    pthread_mutex_unlock(&cache->lock);
+    if (has_evicted)
+        tls_session_unlink(evicted);
+}
+
+void tls_session_cache_load(struct tls_ctx *tls)
+{
+    uint8_t eui64[8];
+    char **files;
+
+    if (!tls->session_cache.max || !g_storage_prefix)
+        return;
+    files = storage_glob("tls-*:*:*:*:*:*:*:*");
+    for (int i = 0; files[i]; i++) {
+        if (parse_byte_array(eui64, 8, strrchr(files[i], '-') + 1))
+            continue;
+        tls_session_read(&tls->session_cache, files[i], eui64);
+    }
+    storage_globfree(files);
+    INFO("%d TLS sessions restored from storage", tls->session_cache.count);
+}
+
+void tls_session_cache_init(struct tls_ctx *tls, int max)
+{
+    struct tls_session_cache *cache = &tls->session_cache;
+
+    TAILQ_INIT(&cache->sessions);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->max = max;
+    if (!max)
+        return;
+    mbedtls_ssl_conf_session_cache(&tls->ssl_config, cache, tls_session_cache_get, tls_session_cache_set);
 }
 
 void tls_init_client(struct tls_ctx *tls, struct tls_client_ctx *tls_client)
@@ -113,6 +432,17 @@ void tls_init_client(struct tls_ctx *tls, struct tls_client_ctx *tls_client)
     mbedtls_ssl_set_export_keys_cb(&tls_client->ssl_ctx, tls_export_keys, tls_client);
 }
 
+static int tls_rng(void *ctx, unsigned char *buf, size_t len)
+{
+    struct tls_ctx *tls = ctx;
+    int ret;
+
+    pthread_mutex_lock(&tls->rng_lock);
+    ret = mbedtls_ctr_drbg_random(&tls->ctr_drbg, buf, len);
+    pthread_mutex_unlock(&tls->rng_lock);
+    return ret;
+}
+
 static void tls_debug(void *ctx, int level, const char *file, int line, const char *string)
 {
     TRACE(TR_MBEDTLS, "%i %s %i %s", level, file, line, string);
@@ -236,7 +566,8 @@ void tls_init(struct tls_ctx *tls, int endpoint, const struct iovec *ca_cert, co
     mbedtls_ctr_drbg_init(&tls->ctr_drbg);
     ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg , mbedtls_entropy_func, &tls->entropy, NULL, 0);
     BUG_ON(ret);
-    mbedtls_ssl_conf_rng(&tls->ssl_config, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
+    pthread_mutex_init(&tls->rng_lock, NULL);
+    mbedtls_ssl_conf_rng(&tls->ssl_config, tls_rng, tls);
 
     ret = mbedtls_ssl_conf_own_cert(&tls->ssl_config, &tls->cert, &tls->key);
     BUG_ON(ret);
@@ -14,12 +14,16 @@
 #ifndef TLS_H
 #define TLS_H
 
+#include <sys/queue.h>
 #include <sys/uio.h>
+#include <pthread.h>
+#include <stdbool.h>
 
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/ssl.h>
 
+#include "common/crypto/ieee80211.h"
 #include "common/pktbuf.h"
 
 struct tls_pmk {
@@ -64,7 +68,50 @@ struct tls_client_ctx {
     struct mbedtls_ssl_context ssl_ctx;
     struct tls_pmk pmk;
     struct tls_ptk ptk;
+    struct ieee80211_key_cache key_cache;
     struct tls_io io;
+    // When the handshake runs on a worker thread, the PMK is only derived
+    // during the handshake and installed later by tls_install_pending_pmk().
+    bool pmk_defer;
+    bool pmk_pending;
+    uint8_t pmk_pending_key[32];
+    // Peer identity the cached TLS sessions are bound to (server only)
+    uint8_t eui64[8];
+    // Session established by the last full handshake, moved to the session
+    // cache by tls_session_store()
+    uint8_t *session_pending;
+    size_t session_pending_len;
+    uint8_t session_pending_id[32];
+    size_t session_pending_id_len;
+};
+
+struct tls_session {
+    uint8_t  eui64[8];
+    uint8_t  id[32];
+    size_t   id_len;
+    uint8_t  *data; // mbedtls_ssl_session_save()
+    size_t   data_len;
+    uint64_t expire_s; // CLOCK_REALTIME, 0 for infinite
+    TAILQ_ENTRY(tls_session) link;
+};
+
+// Declare struct tls_session_list
+TAILQ_HEAD(tls_session_list, tls_session);
+
+/*
+ * Server side cache of TLS sessions, so supplicants rejoining after a reboot
+ * or a PMK loss can resume with an abbreviated handshake (RFC 5246 section
+ * 7.3) instead of exchanging and verifying certificate chains again. Sessions
+ * are bound to the EUI-64 of the supplicant which established them, and the
+ * least recently used entry is evicted when the cache is full. Entries are
+ * only added and removed by the main thread, the lock protects the lookups
+ * from the worker threads.
+ */
+struct tls_session_cache {
+    struct tls_session_list sessions; // Most recently used first
+    int count;
+    int max; // 0 if disabled
+    pthread_mutex_t lock;
 };
 
 struct tls_ctx {
@@ -74,14 +121,26 @@ struct tls_ctx {
     struct mbedtls_x509_crt   ca_cert;
     struct mbedtls_x509_crt   cert;
     struct mbedtls_pk_context key;
+    // The DRBG is shared by all the handshakes, which may run on worker threads
+    pthread_mutex_t rng_lock;
+    struct tls_session_cache session_cache;
 };
 
 int tls_send(void *ctx, const unsigned char *buf, size_t len);
 int tls_recv(void *ctx, unsigned char *buf, size_t len);
 void tls_install_pmk(struct tls_client_ctx *tls_client, const uint8_t key[32]);
+void tls_install_pending_pmk(struct tls_client_ctx *tls_client);
 void tls_init_client(struct tls_ctx *tls, struct tls_client_ctx *tls_client);
+// Wrapper around mbedtls_ssl_handshake() needed for the session cache
+int tls_handshake(struct tls_client_ctx *tls_client);
 int tls_load_pem(struct mbedtls_x509_crt *cert, const uint8_t *buf, size_t buf_len);
 void tls_init(struct tls_ctx *tls, int endpoint, const struct iovec *ca_cert, const struct iovec *cert,
               const struct iovec *key);
 
+// Server only, sessions are persisted in "tls-<eui64>" files
+void tls_session_cache_init(struct tls_ctx *tls, int max);
+void tls_session_cache_load(struct tls_ctx *tls);
+void tls_session_store(struct tls_ctx *tls, struct tls_client_ctx *tls_client, int lifetime_s);
+void tls_session_del(struct tls_ctx *tls, const uint8_t eui64[8]);
+
 #endif
@@ -11,19 +11,43 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <stdbool.h>
 #include <string.h>
 
 #include "common/crypto/hmac_md.h"
 #include "common/mbedtls_extra.h"
+#include "common/memutils.h"
 #include "common/log.h"
 
+#include "ws_keys.h"
+
+// GAKs are recomputed on every key install and D-Bus request, while they only
+// change with the (L)GTKs. Enough entries are kept for all the key slots.
+static struct ws_gak_cache_entry {
+    char    netname[33];
+    uint8_t gtk[16];
+    uint8_t gak[16];
+    bool    set;
+} ws_gak_cache[WS_GTK_COUNT + WS_LGTK_COUNT + 1];
+static int ws_gak_cache_next;
+
 //   Wi-SUN FAN 1.1v08 6.5.4.1.1 Group AES Key (GAK)
 // GAK = Truncate-128(SHA-256(Network Name || L/GTK[X])
 void ws_generate_gak(const char *netname, const uint8_t gtk[16], uint8_t gak[16])
 {
+    struct ws_gak_cache_entry *entry;
     mbedtls_sha256_context ctx;
     uint8_t hash[32];
 
+    for (int i = 0; i < ARRAY_SIZE(ws_gak_cache); i++) {
+        entry = &ws_gak_cache[i];
+        if (entry->set && !memcmp(entry->gtk, gtk, sizeof(entry->gtk)) &&
+            !strcmp(entry->netname, netname)) {
+            memcpy(gak, entry->gak, sizeof(entry->gak));
+            return;
+        }
+    }
+
     mbedtls_sha256_init(&ctx);
     xmbedtls_sha256_starts(&ctx, 0);
     xmbedtls_sha256_update(&ctx, (void *)netname, strlen(netname));
@@ -31,6 +55,26 @@ void ws_generate_gak(const char *netname, const uint8_t gtk[16], uint8_t gak[16]
     xmbedtls_sha256_finish(&ctx, hash);
     mbedtls_sha256_free(&ctx);
     memcpy(gak, hash, 16);
+
+    if (strlen(netname) >= sizeof(entry->netname))
+        return;
+    entry = &ws_gak_cache[ws_gak_cache_next];
+    ws_gak_cache_next = (ws_gak_cache_next + 1) % ARRAY_SIZE(ws_gak_cache);
+    strcpy(entry->netname, netname);
+    memcpy(entry->gtk, gtk, sizeof(entry->gtk));
+    memcpy(entry->gak, gak, sizeof(entry->gak));
+    entry->set = true;
+}
+
+//   Wi-SUN FAN 1.1v08 6.3.2.3.2.4 GTK Hash Information Element (GTKHASH-IE)
+// GTK[X] Hash = Truncate-64(SHA-256(GTK[X]))
+// The truncation keeps the least significant (last) 64 bits.
+void ws_generate_gtkhash(const uint8_t gtk[16], uint8_t gtkhash[8])
+{
+    uint8_t hash[32];
+
+    xmbedtls_sha256(gtk, 16, hash, 0);
+    memcpy(gtkhash, hash + 24, 8);
 }
 
 /*
@@ -27,6 +27,7 @@ struct ws_gtk {
 #define WS_LGTK_COUNT 3
 
 void ws_generate_gak(const char *netname, const uint8_t gtk[16], uint8_t gak[16]);
+void ws_generate_gtkhash(const uint8_t gtk[16], uint8_t gtkhash[8]);
 void ws_derive_ptkid(const uint8_t ptk[48], const uint8_t auth_eui64[8], const uint8_t supp_eui64[8],
                      uint8_t ptkid[16]);
 
@@ -12,30 +12,104 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #include <systemd/sd-bus.h>
+#include <string.h>
 
 #include "common/log.h"
+#include "common/memutils.h"
+#include "common/timer.h"
 
 #include "dbus.h"
 
+// Distinct properties pending in a change window, the set is flushed early
+// if it is full.
+#define DBUS_CHANGES_MAX 16
+
 struct dbus_ctx {
     sd_bus *dbus;
     const char *path;
     const char *interface;
+    // Property names are string literals, only their pointers are kept
+    const char *changes[DBUS_CHANGES_MAX + 1];
+    int changes_len;
+    struct timer_entry change_timer;
 } g_dbus = { };
 
-void dbus_emit_change(const char *property_name)
+static void dbus_flush_changes(void)
 {
     struct dbus_ctx *dbus_ctx = &g_dbus;
     int ret;
 
+    if (!dbus_ctx->changes_len)
+        return;
+    dbus_ctx->changes[dbus_ctx->changes_len] = NULL;
+    ret = sd_bus_emit_properties_changed_strv(dbus_ctx->dbus,
+                                              dbus_ctx->path,
+                                              dbus_ctx->interface,
+                                              (char **)dbus_ctx->changes);
+    if (ret < 0)
+        WARN("sd_bus_emit_properties_changed \"%s\": %s", dbus_ctx->changes[0], strerror(-ret));
+    dbus_ctx->changes_len = 0;
+    timer_stop(NULL, &dbus_ctx->change_timer);
+}
+
+static void dbus_change_timer_cb(struct timer_group *group, struct timer_entry *timer)
+{
+    dbus_flush_changes();
+}
+
+void dbus_change_window(uint64_t window_ms)
+{
+    struct dbus_ctx *dbus_ctx = &g_dbus;
+
+    dbus_flush_changes();
+    dbus_ctx->change_timer.period_ms = window_ms;
+    dbus_ctx->change_timer.callback  = dbus_change_timer_cb;
+}
+
+void dbus_emit_change(const char *property_name)
+{
+    struct dbus_ctx *dbus_ctx = &g_dbus;
+
     if (!dbus_ctx->dbus)
         return;
-    ret = sd_bus_emit_properties_changed(dbus_ctx->dbus,
-                                         dbus_ctx->path,
-                                         dbus_ctx->interface,
-                                         property_name, NULL);
+    for (int i = 0; i < dbus_ctx->changes_len; i++)
+        if (!strcmp(dbus_ctx->changes[i], property_name))
+            return;
+    if (dbus_ctx->changes_len == DBUS_CHANGES_MAX)
+        dbus_flush_changes();
+    dbus_ctx->changes[dbus_ctx->changes_len++] = property_name;
+    if (!dbus_ctx->change_timer.period_ms)
+        dbus_flush_changes();
+    else if (timer_stopped(&dbus_ctx->change_timer))
+        timer_start_rel(NULL, &dbus_ctx->change_timer, dbus_ctx->change_timer.period_ms);
+}
+
+struct sd_bus_message *dbus_signal_new(const char *member)
+{
+    struct dbus_ctx *dbus_ctx = &g_dbus;
+    sd_bus_message *msg;
+    int ret;
+
+    if (!dbus_ctx->dbus)
+        return NULL;
+    ret = sd_bus_message_new_signal(dbus_ctx->dbus, &msg, dbus_ctx->path,
+                                    dbus_ctx->interface, member);
+    if (ret < 0) {
+        WARN("sd_bus_message_new_signal \"%s\": %s", member, strerror(-ret));
+        return NULL;
+    }
+    return msg;
+}
+
+void dbus_signal_send(struct sd_bus_message *msg)
+{
+    struct dbus_ctx *dbus_ctx = &g_dbus;
+    int ret;
+
+    ret = sd_bus_send(dbus_ctx->dbus, msg, NULL);
     if (ret < 0)
-        WARN("sd_bus_emit_properties_changed \"%s\": %s", property_name, strerror(-ret));
+        WARN("sd_bus_send: %s", strerror(-ret));
+    sd_bus_message_unref(msg);
 }
 
 void dbus_register(const char *name, const char *path, const char *interface,
@@ -14,6 +14,9 @@
 #ifndef COMMON_DBUS_H
 #define COMMON_DBUS_H
 
+#include <stdint.h>
+
+struct sd_bus_message;
 struct sd_bus_vtable;
 
 #ifdef HAVE_LIBSYSTEMD
@@ -23,7 +26,18 @@ void dbus_register(const char *name, const char *path, const char *interface,
 int dbus_get_fd(void);
 int dbus_process(void);
 
+// property_name must outlive the change window, it is expected to be a
+// string literal.
 void dbus_emit_change(const char *property_name);
+// Changes emitted during this window (in milliseconds) are sent in a single
+// PropertiesChanged signal, each property appearing once. 0 (the default)
+// sends each change immediately.
+void dbus_change_window(uint64_t window_ms);
+
+// Return a new signal message for the registered object, or NULL if D-Bus is
+// not connected. The message is sent and freed by dbus_signal_send().
+struct sd_bus_message *dbus_signal_new(const char *member);
+void dbus_signal_send(struct sd_bus_message *msg);
 
 #else
 
@@ -49,6 +63,19 @@ static inline void dbus_emit_change(const char *property_name)
 {
 }
 
+static inline void dbus_change_window(uint64_t window_ms)
+{
+}
+
+static inline struct sd_bus_message *dbus_signal_new(const char *member)
+{
+    return NULL;
+}
+
+static inline void dbus_signal_send(struct sd_bus_message *msg)
+{
+}
+
 #endif
 
 #endif
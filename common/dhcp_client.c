@@ -275,6 +275,24 @@ void dhcp_client_start(struct dhcp_client *client)
     client->running = true;
 }
 
+void dhcp_client_restore(struct dhcp_client *client, const struct in6_addr *addr,
+                         uint32_t valid_lifetime_s, uint32_t preferred_lifetime_s, uint32_t t1_s)
+{
+    BUG_ON(client->running);
+    BUG_ON(!valid_lifetime_s);
+    client->iaaddr.ipv6 = *addr;
+    client->iaaddr.preferred_lifetime_s = preferred_lifetime_s;
+    client->iaaddr.valid_lifetime_timer.callback = dhcp_client_addr_expired;
+    if (valid_lifetime_s != DHCPV6_LIFETIME_INFINITE)
+        timer_start_rel(NULL, &client->iaaddr.valid_lifetime_timer, (uint64_t)valid_lifetime_s * 1000);
+    if (t1_s != DHCPV6_LIFETIME_INFINITE)
+        timer_start_rel(NULL, &client->t1_timer, (uint64_t)t1_s * 1000);
+    client->running = true;
+    TRACE(TR_DHCP, "dhcp iaaddr restore %s lifetime:%us t1:%us",
+          tr_ipv6(client->iaaddr.ipv6.s6_addr), valid_lifetime_s, t1_s);
+    client->on_addr_add(client);
+}
+
 void dhcp_client_init(struct dhcp_client *client,
                       const struct tun_ctx *tun,
                       const uint8_t eui64[8])
@@ -55,6 +55,10 @@ void dhcp_client_init(struct dhcp_client *client,
                       const struct tun_ctx *tun,
                       const uint8_t eui64[8]);
 void dhcp_client_start(struct dhcp_client *client);
+// Apply a lease obtained before a restart instead of soliciting a new one.
+// Lifetimes are relative to now, DHCPV6_LIFETIME_INFINITE is accepted.
+void dhcp_client_restore(struct dhcp_client *client, const struct in6_addr *addr,
+                         uint32_t valid_lifetime_s, uint32_t preferred_lifetime_s, uint32_t t1_s);
 void dhcp_client_recv(struct dhcp_client *client);
 
 uint32_t dhcp_iaaddr_valid_lifetime_s(const struct dhcp_iaaddr *iaaddr);
@@ -158,6 +158,25 @@ void dhcp_fill_identity_association(struct iobuf_write *buf, uint32_t ia_id, con
     dhcp_opt_fill(buf, len_offset);
 }
 
+void dhcp_fill_status_code(struct iobuf_write *buf, uint16_t status)
+{
+    int len_offset = dhcp_opt_push(buf, DHCPV6_OPT_STATUS_CODE);
+
+    iobuf_push_be16(buf, status);
+    dhcp_opt_fill(buf, len_offset);
+}
+
+void dhcp_fill_identity_association_status(struct iobuf_write *buf, uint32_t ia_id, uint16_t status)
+{
+    int len_offset = dhcp_opt_push(buf, DHCPV6_OPT_IA_NA);
+
+    iobuf_push_be32(buf, ia_id);
+    iobuf_push_be32(buf, 0); // T1
+    iobuf_push_be32(buf, 0); // T2
+    dhcp_fill_status_code(buf, status);
+    dhcp_opt_fill(buf, len_offset);
+}
+
 void dhcp_fill_server_id(struct iobuf_write *buf, const uint8_t eui64[8])
 {
     int len_offset = dhcp_opt_push(buf, DHCPV6_OPT_SERVER_ID);
@@ -29,6 +29,8 @@ void dhcp_fill_client_id(struct iobuf_write *buf, uint16_t hwaddr_type, const ui
 void dhcp_fill_rapid_commit(struct iobuf_write *buf);
 void dhcp_fill_identity_association(struct iobuf_write *buf, uint32_t ia_id, const uint8_t ipv6[16],
                                     uint32_t preferred_lifetime, uint32_t valid_lifetime);
+void dhcp_fill_identity_association_status(struct iobuf_write *buf, uint32_t ia_id, uint16_t status);
+void dhcp_fill_status_code(struct iobuf_write *buf, uint16_t status);
 void dhcp_fill_server_id(struct iobuf_write *buf, const uint8_t eui64[8]);
 void dhcp_fill_elapsed_time(struct iobuf_write *buf, struct timespec *start);
 
@@ -11,9 +11,11 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <errno.h>
 
 #include "common/specs/dhcpv6.h"
 #include "common/dhcp_common.h"
@@ -21,9 +23,36 @@
 #include "common/log.h"
 #include "common/memutils.h"
 #include "common/netinet_in_extra.h"
+#include "common/time_extra.h"
 
 #include "dhcp_relay.h"
 
+// A server is skipped if it did not answer for DHCP_RELAY_SERVER_TIMEOUT_MS,
+// and tried again DHCP_RELAY_SERVER_RETRY_MS later.
+#define DHCP_RELAY_SERVER_TIMEOUT_MS  5000
+#define DHCP_RELAY_SERVER_RETRY_MS   60000
+#define DHCP_RELAY_BATCH 16
+
+// Outgoing message, built in the buffers of the batch
+struct dhcp_relay_tx {
+    struct dhcpv6_relay_hdr hdr;
+    struct dhcpv6_opt opt_ifindex;
+    uint32_t ifindex;
+    struct dhcpv6_opt opt_relay;
+    struct iovec iov[5];
+    struct sockaddr_in6 dst;
+};
+
+struct dhcp_relay_batch {
+    uint8_t rx_buf[DHCP_RELAY_BATCH][1500];
+    struct sockaddr_in6 rx_src[DHCP_RELAY_BATCH];
+    struct iovec rx_iov[DHCP_RELAY_BATCH];
+    struct mmsghdr rx_msg[DHCP_RELAY_BATCH];
+    struct dhcp_relay_tx tx[DHCP_RELAY_BATCH];
+    struct mmsghdr tx_msg[DHCP_RELAY_BATCH];
+    int tx_count;
+};
+
 void dhcp_relay_start(struct dhcp_relay *relay)
 {
     struct sockaddr_in6 sin6 = {
@@ -31,11 +60,37 @@ void dhcp_relay_start(struct dhcp_relay *relay)
         .sin6_addr = IN6ADDR_ANY_INIT,
         .sin6_port = htons(DHCPV6_SERVER_UDP_PORT),
     };
+    struct dhcp_relay_batch *batch;
+    struct dhcp_relay_server *server;
     int ret;
 
     BUG_ON(!relay->hop_limit);
     BUG_ON(IN6_IS_ADDR_UNSPECIFIED(&relay->link_addr));
-    BUG_ON(IN6_IS_ADDR_UNSPECIFIED(&relay->server_addr));
+
+    relay->server_count = 0;
+    for (int i = 0; i < DHCP_RELAY_SERVER_MAX; i++) {
+        if (IN6_IS_ADDR_UNSPECIFIED(&relay->server_addr[i]))
+            continue;
+        server = &relay->servers[relay->server_count++];
+        memset(server, 0, sizeof(*server));
+        server->addr.sin6_family = AF_INET6;
+        server->addr.sin6_addr = relay->server_addr[i];
+        server->addr.sin6_port = htons(DHCPV6_SERVER_UDP_PORT);
+    }
+    BUG_ON(!relay->server_count);
+
+    batch = zalloc(sizeof(*batch));
+    for (int i = 0; i < DHCP_RELAY_BATCH; i++) {
+        batch->rx_iov[i].iov_base = batch->rx_buf[i];
+        batch->rx_iov[i].iov_len  = sizeof(batch->rx_buf[i]);
+        batch->rx_msg[i].msg_hdr.msg_iov    = &batch->rx_iov[i];
+        batch->rx_msg[i].msg_hdr.msg_iovlen = 1;
+        batch->rx_msg[i].msg_hdr.msg_name   = &batch->rx_src[i];
+        batch->tx_msg[i].msg_hdr.msg_name    = &batch->tx[i].dst;
+        batch->tx_msg[i].msg_hdr.msg_namelen = sizeof(batch->tx[i].dst);
+        batch->tx_msg[i].msg_hdr.msg_iov     = batch->tx[i].iov;
+    }
+    relay->batch = batch;
 
     relay->fd = socket(AF_INET6, SOCK_DGRAM, 0);
     FATAL_ON(relay->fd < 0, 1, "%s: socket: %m", __func__);
@@ -47,6 +102,62 @@ void dhcp_relay_stop(struct dhcp_relay *relay)
 {
     close(relay->fd);
     relay->fd = -1;
+    free(relay->batch);
+    relay->batch = NULL;
+}
+
+/*
+ * The server is selected from the peer address, so the messages of a client
+ * reach the same server. If this server does not answer, the next one is
+ * used. If no server answers, the selected one is still used.
+ */
+static struct dhcp_relay_server *dhcp_relay_server_pick(struct dhcp_relay *relay,
+                                                        const struct in6_addr *peer)
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    struct dhcp_relay_server *server;
+    uint64_t key;
+    int first;
+
+    memcpy(&key, peer->s6_addr + 8, 8);
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    first = (key >> 32) % relay->server_count;
+    for (int i = 0; i < relay->server_count; i++) {
+        server = &relay->servers[(first + i) % relay->server_count];
+        if (server->unanswered_ms &&
+            now_ms - server->unanswered_ms >= DHCP_RELAY_SERVER_TIMEOUT_MS + DHCP_RELAY_SERVER_RETRY_MS)
+            server->unanswered_ms = 0;
+        if (!server->unanswered_ms || now_ms - server->unanswered_ms < DHCP_RELAY_SERVER_TIMEOUT_MS)
+            return server;
+    }
+    return &relay->servers[first];
+}
+
+static struct dhcp_relay_tx *dhcp_relay_tx_new(struct dhcp_relay *relay, int iovlen)
+{
+    struct dhcp_relay_batch *batch = relay->batch;
+
+    BUG_ON(batch->tx_count >= DHCP_RELAY_BATCH);
+    batch->tx_msg[batch->tx_count].msg_hdr.msg_iovlen = iovlen;
+    return &batch->tx[batch->tx_count++];
+}
+
+static void dhcp_relay_tx_flush(struct dhcp_relay *relay)
+{
+    struct dhcp_relay_batch *batch = relay->batch;
+    int sent = 0;
+    int ret;
+
+    while (sent < batch->tx_count) {
+        ret = sendmmsg(relay->fd, batch->tx_msg + sent, batch->tx_count - sent, 0);
+        if (ret < 0) {
+            // The first message failed, the others may still be sent
+            WARN("%s: sendmmsg %s: %m", __func__, tr_ipv6(batch->tx[sent].dst.sin6_addr.s6_addr));
+            ret = 1;
+        }
+        sent += ret;
+    }
+    batch->tx_count = 0;
 }
 
 // RFC 8415 19.1. Relaying a Client Message or a Relay-forward Message
@@ -55,94 +166,79 @@ static void dhcp_relay_fwd(struct dhcp_relay *relay,
                            const struct sockaddr_in6 *peer, uint8_t hops)
 {
     const bool has_ifindex = IN6_IS_ADDR_LINKLOCAL(&peer->sin6_addr);
-    struct dhcpv6_relay_hdr hdr = {
-        .type = DHCPV6_MSG_RELAY_FWD,
-        .hops = hops,
-        .link = IN6_IS_ADDR_UC_GLOBAL(&peer->sin6_addr) ? in6addr_any : relay->link_addr,
-        .peer = peer->sin6_addr,
-    };
-    struct dhcpv6_opt opt_ifindex = {
-        .code = htons(DHCPV6_OPT_INTERFACE_ID),
-        .len  = htons(sizeof(peer->sin6_scope_id)),
-    };
-    struct dhcpv6_opt opt_relay = {
-        .code = htons(DHCPV6_OPT_RELAY),
-        .len  = htons(buf_len),
-    };
-    struct iovec iov[] = {
-        { &hdr,                         sizeof(hdr) },
-        { &opt_ifindex,                 has_ifindex ? sizeof(opt_ifindex) : 0 },
-        { (void *)&peer->sin6_scope_id, has_ifindex ? sizeof(peer->sin6_scope_id) : 0 },
-        { &opt_relay,                   sizeof(opt_relay) },
-        { (void *)buf,                  buf_len },
-    };
-    struct sockaddr_in6 dst = {
-        .sin6_family = AF_INET6,
-        .sin6_addr = relay->server_addr,
-        .sin6_port = htons(DHCPV6_SERVER_UDP_PORT),
-    };
-    struct msghdr msg = {
-        .msg_iov     = iov,
-        .msg_iovlen  = ARRAY_SIZE(iov),
-        .msg_name    = &dst,
-        .msg_namelen = sizeof(dst),
-    };
-    ssize_t ret;
+    struct dhcp_relay_server *server = dhcp_relay_server_pick(relay, &peer->sin6_addr);
+    struct dhcp_relay_tx *tx = dhcp_relay_tx_new(relay, 5);
+
+    tx->hdr.type = DHCPV6_MSG_RELAY_FWD;
+    tx->hdr.hops = hops;
+    tx->hdr.link = IN6_IS_ADDR_UC_GLOBAL(&peer->sin6_addr) ? in6addr_any : relay->link_addr;
+    tx->hdr.peer = peer->sin6_addr;
+    tx->opt_ifindex.code = htons(DHCPV6_OPT_INTERFACE_ID);
+    tx->opt_ifindex.len  = htons(sizeof(tx->ifindex));
+    tx->ifindex = peer->sin6_scope_id;
+    tx->opt_relay.code = htons(DHCPV6_OPT_RELAY);
+    tx->opt_relay.len  = htons(buf_len);
+    tx->iov[0] = (struct iovec){ &tx->hdr,         sizeof(tx->hdr) };
+    tx->iov[1] = (struct iovec){ &tx->opt_ifindex, has_ifindex ? sizeof(tx->opt_ifindex) : 0 };
+    tx->iov[2] = (struct iovec){ &tx->ifindex,     has_ifindex ? sizeof(tx->ifindex) : 0 };
+    tx->iov[3] = (struct iovec){ &tx->opt_relay,   sizeof(tx->opt_relay) };
+    tx->iov[4] = (struct iovec){ (void *)buf,      buf_len };
+    tx->dst = server->addr;
+    if (!server->unanswered_ms)
+        server->unanswered_ms = time_now_ms(CLOCK_MONOTONIC);
 
-    dhcp_trace_tx(&hdr, sizeof(hdr), &dst.sin6_addr);
-    ret = sendmsg(relay->fd, &msg, 0);
-    WARN_ON(ret < 0, "%s: sendmsg: %m", __func__);
+    dhcp_trace_tx(&tx->hdr, sizeof(tx->hdr), &tx->dst.sin6_addr);
 }
 
 // RFC 8415 19.2. Relaying a Relay-reply Message
 static void dhcp_relay_reply(struct dhcp_relay *relay,
-                             const void *buf, size_t buf_len)
+                             const void *buf, size_t buf_len,
+                             const struct sockaddr_in6 *src)
 {
     const struct dhcpv6_relay_hdr *hdr;
-    struct sockaddr_in6 dst = { };
     struct iobuf_read iobuf = {
         .data      = buf,
         .data_size = buf_len,
     };
+    struct dhcp_relay_tx *tx;
     struct iobuf_read opt;
+    uint32_t ifindex = 0;
     ssize_t len;
 
+    for (int i = 0; i < relay->server_count; i++)
+        if (IN6_ARE_ADDR_EQUAL(&relay->servers[i].addr.sin6_addr, &src->sin6_addr))
+            relay->servers[i].unanswered_ms = 0;
+
     hdr = iobuf_pop_data_ptr(&iobuf, sizeof(*hdr));
     len = dhcp_get_option(iobuf_ptr(&iobuf), iobuf_remaining_size(&iobuf),
                           DHCPV6_OPT_INTERFACE_ID, &opt);
     if (len >= 0)
-        iobuf_pop_data(&opt, &dst.sin6_scope_id, sizeof(dst.sin6_scope_id));
+        iobuf_pop_data(&opt, &ifindex, sizeof(ifindex));
     len = dhcp_get_option(iobuf_ptr(&iobuf), iobuf_remaining_size(&iobuf),
                           DHCPV6_OPT_RELAY, &opt);
     if (len < 1) {
         TRACE(TR_DROP, "drop %-9s: malformed packet", "dhcp");
         return;
     }
-    dst.sin6_family = AF_INET6;
-    dst.sin6_addr = hdr->peer;
-    dst.sin6_port = htons(opt.data[0] == DHCPV6_MSG_RELAY_REPLY ?
-                          DHCPV6_SERVER_UDP_PORT : DHCPV6_CLIENT_UDP_PORT);
-    dhcp_trace_tx(opt.data, opt.data_size, &dst.sin6_addr);
-    len = sendto(relay->fd, opt.data, opt.data_size, 0,
-                 (struct sockaddr *)&dst, sizeof(dst));
-    WARN_ON(len < 0, "%s: sendto %s: %m", __func__, tr_ipv6(dst.sin6_addr.s6_addr));
+    tx = dhcp_relay_tx_new(relay, 1);
+    memset(&tx->dst, 0, sizeof(tx->dst));
+    tx->dst.sin6_family = AF_INET6;
+    tx->dst.sin6_addr = hdr->peer;
+    tx->dst.sin6_port = htons(opt.data[0] == DHCPV6_MSG_RELAY_REPLY ?
+                              DHCPV6_SERVER_UDP_PORT : DHCPV6_CLIENT_UDP_PORT);
+    tx->dst.sin6_scope_id = ifindex;
+    // opt.data points to the RX buffer, which is kept until the batch is sent
+    tx->iov[0] = (struct iovec){ (void *)opt.data, opt.data_size };
+    dhcp_trace_tx(opt.data, opt.data_size, &tx->dst.sin6_addr);
 }
 
 // RFC 8415 19. Relay Agent Behavior
-void dhcp_relay_recv(struct dhcp_relay *relay)
+static void dhcp_relay_process(struct dhcp_relay *relay, const uint8_t *buf, size_t buf_len,
+                               const struct sockaddr_in6 *src)
 {
     const struct dhcpv6_relay_hdr *hdr;
-    struct sockaddr_in6 src;
-    uint8_t buf[1500];
-    ssize_t buf_len;
-
-    buf_len = recvfrom(relay->fd, buf, sizeof(buf), 0,
-                       (struct sockaddr *)&src, (socklen_t[1]){ sizeof(src) });
-    if (buf_len < 0) {
-        WARN("%s: recvfrom: %m", __func__);
-        return;
-    }
-    dhcp_trace_rx(buf, buf_len, &src.sin6_addr);
+
+    dhcp_trace_rx(buf, buf_len, &src->sin6_addr);
 
     switch (buf_len >= 1 ? buf[0] : 0) {
     case DHCPV6_MSG_RELAY_FWD:
@@ -155,14 +251,32 @@ void dhcp_relay_recv(struct dhcp_relay *relay)
             TRACE(TR_DROP, "drop %-9s: hop limit exceeded", "dhcp");
             return;
         }
-        dhcp_relay_fwd(relay, buf, buf_len, &src, hdr->hops + 1);
+        dhcp_relay_fwd(relay, buf, buf_len, src, hdr->hops + 1);
         break;
     case DHCPV6_MSG_RELAY_REPLY:
-        dhcp_relay_reply(relay, buf, buf_len);
+        dhcp_relay_reply(relay, buf, buf_len, src);
         break;
     // RFC 7283 Handling Unknown DHCPv6 Messages
     default:
-        dhcp_relay_fwd(relay, buf, buf_len, &src, 0);
+        dhcp_relay_fwd(relay, buf, buf_len, src, 0);
         break;
     }
 }
+
+void dhcp_relay_recv(struct dhcp_relay *relay)
+{
+    struct dhcp_relay_batch *batch = relay->batch;
+    int count;
+
+    for (int i = 0; i < DHCP_RELAY_BATCH; i++)
+        batch->rx_msg[i].msg_hdr.msg_namelen = sizeof(batch->rx_src[i]);
+    // The first message is available, do not wait for the others
+    count = recvmmsg(relay->fd, batch->rx_msg, DHCP_RELAY_BATCH, MSG_WAITFORONE, NULL);
+    if (count < 0) {
+        WARN("%s: recvmmsg: %m", __func__);
+        return;
+    }
+    for (int i = 0; i < count; i++)
+        dhcp_relay_process(relay, batch->rx_buf[i], batch->rx_msg[i].msg_len, &batch->rx_src[i]);
+    dhcp_relay_tx_flush(relay);
+}
@@ -17,11 +17,36 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/*
+ * The relay forwards every client to one of the servers in server_addr, up to
+ * DHCP_RELAY_SERVER_MAX (unused entries are unspecified). A client is always
+ * forwarded to the same server as long as this server answers, so a whole
+ * transaction (and the following renewals) is handled by the same server.
+ * A server which did not answer for some time is skipped until it answers
+ * again.
+ *
+ * dhcp_relay_recv() reads and forwards several messages with a single
+ * recvmmsg() and a single sendmmsg().
+ */
+
+#define DHCP_RELAY_SERVER_MAX 4
+
+struct dhcp_relay_server {
+    struct sockaddr_in6 addr;
+    // Date of the oldest message forwarded since the last answer, 0 if none
+    uint64_t unanswered_ms;
+};
+
 struct dhcp_relay {
     int fd;
     uint8_t hop_limit;
     struct in6_addr link_addr;
-    struct in6_addr server_addr;
+    struct in6_addr server_addr[DHCP_RELAY_SERVER_MAX];
+
+    // Private fields
+    struct dhcp_relay_server servers[DHCP_RELAY_SERVER_MAX];
+    int server_count;
+    struct dhcp_relay_batch *batch;
 };
 
 void dhcp_relay_start(struct dhcp_relay *relay);
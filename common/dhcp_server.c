@@ -13,17 +13,29 @@
  */
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <net/if.h>
+#include <inttypes.h>
+#include <fnmatch.h>
 #include <errno.h>
+#include <stdio.h>
 
 #include "common/capture.h"
+#include "common/endian.h"
+#include "common/key_value_storage.h"
 #include "common/log.h"
 #include "common/iobuf.h"
+#include "common/memutils.h"
+#include "common/parsers.h"
+#include "common/sys_queue_extra.h"
 #include "common/dhcp_common.h"
 #include "common/specs/dhcpv6.h"
 
 #include "dhcp_server.h"
 
+// Delay between the first lease update and the write of the lease file.
+#define DHCP_LEASE_FLUSH_DELAY_MS 5000
+
 static int dhcp_handle_request(struct dhcp_server *dhcp,
                                 struct iobuf_read *req, struct iobuf_write *reply);
 static int dhcp_handle_request_fwd(struct dhcp_server *dhcp,
@@ -76,6 +88,302 @@ static int dhcp_handle_request_fwd(struct dhcp_server *dhcp,
     return 0;
 }
 
+static struct dhcp_lease_list *dhcp_lease_bucket(struct dhcp_server *dhcp,
+                                                  const uint8_t hwaddr[8], uint32_t iaid)
+{
+    uint64_t key;
+
+    memcpy(&key, hwaddr, 8);
+    key ^= iaid;
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return &dhcp->lease_hash[key >> (64 - DHCP_LEASE_HASH_BITS)];
+}
+
+static struct dhcp_lease *dhcp_lease_get(struct dhcp_server *dhcp, uint16_t hwaddr_type,
+                                         const uint8_t hwaddr[8], uint32_t iaid)
+{
+    struct dhcp_lease *lease;
+
+    return SLIST_FIND(lease, dhcp_lease_bucket(dhcp, hwaddr, iaid), link,
+                      lease->iaid == iaid && lease->hwaddr_type == hwaddr_type &&
+                      !memcmp(lease->hwaddr, hwaddr, 8));
+}
+
+static void dhcp_lease_addr(const struct dhcp_server *dhcp, const struct dhcp_lease *lease, uint8_t ipv6[16])
+{
+    memcpy(ipv6, dhcp->prefix, 8);
+    write_be64(ipv6 + 8, read_be64(dhcp->pool_start) + lease->pool_index);
+}
+
+static bool dhcp_lease_expired(const struct dhcp_lease *lease, time_t now_s)
+{
+    return lease->expire_s && lease->expire_s <= now_s;
+}
+
+static void dhcp_lease_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    dhcp_lease_flush(container_of(timer, struct dhcp_server, lease_timer));
+}
+
+static void dhcp_lease_set_dirty(struct dhcp_server *dhcp)
+{
+    if (!g_storage_prefix || !timer_stopped(&dhcp->lease_timer))
+        return;
+    dhcp->lease_timer.callback = dhcp_lease_timer;
+    timer_start_rel(NULL, &dhcp->lease_timer, DHCP_LEASE_FLUSH_DELAY_MS);
+}
+
+void dhcp_lease_flush(struct dhcp_server *dhcp)
+{
+    char ipv6_str[STR_MAX_LEN_IPV6];
+    char eui64_str[STR_MAX_LEN_EUI64];
+    struct storage_parse_info *nvm;
+    struct dhcp_lease *lease;
+    uint8_t ipv6[16];
+    int i = 0;
+
+    if (timer_stopped(&dhcp->lease_timer))
+        return;
+    timer_stop(NULL, &dhcp->lease_timer);
+    nvm = storage_open_prefix("dhcp-leases", "w");
+    if (!nvm) {
+        WARN("%s: unable to open file: \"dhcp-leases\"", __func__);
+        return;
+    }
+    fprintf(nvm->file, "# lease[i] = address,hwaddr_type,hwaddr,iaid,expiration\n");
+    for (uint32_t j = 0; j < dhcp->pool_size; j++) {
+        lease = dhcp->pool[j];
+        if (!lease)
+            continue;
+        dhcp_lease_addr(dhcp, lease, ipv6);
+        str_ipv6(ipv6, ipv6_str);
+        str_eui64(lease->hwaddr, eui64_str);
+        fprintf(nvm->file, "lease[%d] = %s,%u,%s,%#"PRIx32",%jd\n", i++,
+                ipv6_str, lease->hwaddr_type, eui64_str, lease->iaid, (intmax_t)lease->expire_s);
+    }
+    if (dhcp->storage_fsync && storage_sync(nvm))
+        WARN("%s: fsync %s: %m", __func__, nvm->filename);
+    storage_close(nvm);
+}
+
+static struct dhcp_lease *dhcp_lease_add(struct dhcp_server *dhcp, uint16_t hwaddr_type,
+                                         const uint8_t hwaddr[8], uint32_t iaid,
+                                         uint32_t pool_index)
+{
+    struct dhcp_lease *lease = zalloc(sizeof(*lease));
+    uint8_t ipv6[16];
+
+    BUG_ON(dhcp->pool[pool_index]);
+    lease->hwaddr_type = hwaddr_type;
+    memcpy(lease->hwaddr, hwaddr, 8);
+    lease->iaid = iaid;
+    lease->pool_index = pool_index;
+    dhcp->pool[pool_index] = lease;
+    SLIST_INSERT_HEAD(dhcp_lease_bucket(dhcp, hwaddr, iaid), lease, link);
+    dhcp_lease_addr(dhcp, lease, ipv6);
+    TRACE(TR_DHCP, "dhcp lease add %s eui64=%s iaid=%u",
+          tr_ipv6(ipv6), tr_eui64(hwaddr), iaid);
+    return lease;
+}
+
+static void dhcp_lease_del(struct dhcp_server *dhcp, struct dhcp_lease *lease)
+{
+    uint8_t ipv6[16];
+
+    dhcp_lease_addr(dhcp, lease, ipv6);
+    TRACE(TR_DHCP, "dhcp lease del %s eui64=%s iaid=%u",
+          tr_ipv6(ipv6), tr_eui64(lease->hwaddr), lease->iaid);
+    SLIST_REMOVE(dhcp_lease_bucket(dhcp, lease->hwaddr, lease->iaid), lease, dhcp_lease, link);
+    dhcp->pool[lease->pool_index] = NULL;
+    free(lease);
+    dhcp_lease_set_dirty(dhcp);
+}
+
+static void dhcp_lease_renew(struct dhcp_server *dhcp, struct dhcp_lease *lease)
+{
+    time_t expire_s = 0;
+
+    if (dhcp->valid_lifetime != DHCPV6_LIFETIME_INFINITE)
+        expire_s = time(NULL) + dhcp->valid_lifetime;
+    if (lease->expire_s == expire_s)
+        return;
+    lease->expire_s = expire_s;
+    dhcp_lease_set_dirty(dhcp);
+}
+
+// Expired leases are only reclaimed when a free address is searched, the pool
+// is scanned from where the previous search ended.
+static struct dhcp_lease *dhcp_lease_bind(struct dhcp_server *dhcp, uint16_t hwaddr_type,
+                                          const uint8_t hwaddr[8], uint32_t iaid)
+{
+    struct dhcp_lease *lease = dhcp_lease_get(dhcp, hwaddr_type, hwaddr, iaid);
+    time_t now_s = time(NULL);
+    uint32_t idx;
+
+    if (lease) {
+        dhcp_lease_renew(dhcp, lease);
+        return lease;
+    }
+    for (uint32_t i = 0; i < dhcp->pool_size; i++) {
+        idx = (dhcp->pool_next + i) % dhcp->pool_size;
+        lease = dhcp->pool[idx];
+        if (lease && !dhcp_lease_expired(lease, now_s))
+            continue;
+        if (lease)
+            dhcp_lease_del(dhcp, lease);
+        dhcp->pool_next = (idx + 1) % dhcp->pool_size;
+        lease = dhcp_lease_add(dhcp, hwaddr_type, hwaddr, iaid, idx);
+        dhcp_lease_renew(dhcp, lease);
+        dhcp_lease_set_dirty(dhcp);
+        return lease;
+    }
+    TRACE(TR_DHCP, "dhcp pool exhausted");
+    return NULL;
+}
+
+static void dhcp_lease_load(struct dhcp_server *dhcp)
+{
+    char addr_str[STR_MAX_LEN_IPV6], hwaddr_str[STR_MAX_LEN_EUI64];
+    struct storage_parse_info *nvm;
+    uint16_t hwaddr_type;
+    struct in6_addr addr;
+    uint8_t hwaddr[8];
+    intmax_t expire_s;
+    time_t now_s = time(NULL);
+    uint64_t idx;
+    uint32_t iaid;
+    int ret;
+
+    nvm = storage_open_prefix("dhcp-leases", "r");
+    if (!nvm)
+        return;
+    for (;;) {
+        ret = storage_parse_line(nvm);
+        if (ret == EOF)
+            break;
+        if (ret) {
+            WARN("%s:%d: invalid line: '%s'", nvm->filename, nvm->linenr, nvm->line);
+            continue;
+        }
+        if (fnmatch("lease\\[*]", nvm->key, 0)) {
+            WARN("%s:%d: invalid key: '%s'", nvm->filename, nvm->linenr, nvm->line);
+            continue;
+        }
+        if (sscanf(nvm->value, "%39[^,],%hu,%23[^,],%"SCNx32",%jd",
+                   addr_str, &hwaddr_type, hwaddr_str, &iaid, &expire_s) != 5 ||
+            inet_pton(AF_INET6, addr_str, &addr) != 1 ||
+            parse_byte_array(hwaddr, 8, hwaddr_str)) {
+            WARN("%s:%d: invalid value: '%s'", nvm->filename, nvm->linenr, nvm->line);
+            continue;
+        }
+        // The prefix or the pool may have changed since the last run
+        idx = read_be64(addr.s6_addr + 8) - read_be64(dhcp->pool_start);
+        if (memcmp(addr.s6_addr, dhcp->prefix, 8) || idx >= dhcp->pool_size ||
+            (expire_s && expire_s <= now_s))
+            continue;
+        if (dhcp->pool[idx] || dhcp_lease_get(dhcp, hwaddr_type, hwaddr, iaid)) {
+            WARN("%s:%d: duplicate lease", nvm->filename, nvm->linenr);
+            continue;
+        }
+        dhcp_lease_add(dhcp, hwaddr_type, hwaddr, iaid, idx)->expire_s = expire_s;
+    }
+    storage_close(nvm);
+}
+
+// Server Identifier must be present and match in REQUEST, RENEW and RELEASE.
+static int dhcp_check_server_duid(struct dhcp_server *dhcp, struct iobuf_read *req)
+{
+    uint16_t duid_type, ll_type;
+    struct iobuf_read opt;
+    const uint8_t *eui64;
+
+    dhcp_get_option(iobuf_ptr(req), iobuf_remaining_size(req), DHCPV6_OPT_SERVER_ID, &opt);
+    if (opt.err) {
+        TRACE(TR_DROP, "drop %-9s: missing server ID option", "dhcp");
+        return -EINVAL;
+    }
+    duid_type = iobuf_pop_be16(&opt);
+    ll_type = iobuf_pop_be16(&opt);
+    eui64 = iobuf_pop_data_ptr(&opt, 8);
+    if (opt.err || duid_type != DHCPV6_DUID_TYPE_LINK_LAYER ||
+        ll_type != DHCPV6_DUID_HW_TYPE_EUI64 || memcmp(eui64, dhcp->hwaddr, 8)) {
+        TRACE(TR_DROP, "drop %-9s: server ID mismatch", "dhcp");
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int dhcp_handle_request_stateful(struct dhcp_server *dhcp, uint8_t msg_type,
+                                        struct iobuf_read *req, struct iobuf_write *reply,
+                                        uint24_t transaction, uint32_t iaid,
+                                        int hwaddr_type, const uint8_t *hwaddr)
+{
+    uint8_t reply_type = DHCPV6_MSG_REPLY;
+    struct dhcp_lease *lease = NULL;
+    bool rapid_commit = false;
+    struct iobuf_read opt;
+    uint8_t ipv6[16];
+
+    switch (msg_type) {
+    case DHCPV6_MSG_SOLICIT:
+        // The address offered in ADVERTISE is reserved, so REQUEST gets the
+        // same one.
+        rapid_commit = dhcp_get_option(iobuf_ptr(req), iobuf_remaining_size(req),
+                                       DHCPV6_OPT_RAPID_COMMIT, &opt) >= 0;
+        if (!rapid_commit)
+            reply_type = DHCPV6_MSG_ADVERT;
+        lease = dhcp_lease_bind(dhcp, hwaddr_type, hwaddr, iaid);
+        break;
+    case DHCPV6_MSG_REQUEST:
+        if (dhcp_check_server_duid(dhcp, req))
+            return -EINVAL;
+        lease = dhcp_lease_bind(dhcp, hwaddr_type, hwaddr, iaid);
+        break;
+    case DHCPV6_MSG_RENEW:
+        if (dhcp_check_server_duid(dhcp, req))
+            return -EINVAL;
+        // fall through
+    case DHCPV6_MSG_REBIND:
+        lease = dhcp_lease_get(dhcp, hwaddr_type, hwaddr, iaid);
+        if (!lease && msg_type == DHCPV6_MSG_REBIND) {
+            TRACE(TR_DROP, "drop %-9s: no binding", "dhcp");
+            return -ENOENT;
+        }
+        if (lease)
+            dhcp_lease_renew(dhcp, lease);
+        break;
+    case DHCPV6_MSG_RELEASE:
+        if (dhcp_check_server_duid(dhcp, req))
+            return -EINVAL;
+        lease = dhcp_lease_get(dhcp, hwaddr_type, hwaddr, iaid);
+        if (lease)
+            dhcp_lease_del(dhcp, lease);
+        lease = NULL;
+        break;
+    default:
+        TRACE(TR_DROP, "drop %-9s: unsupported msg-type 0x%02x", "dhcp", msg_type);
+        return -EINVAL;
+    }
+
+    iobuf_push_u8(reply, reply_type);
+    iobuf_push_be24(reply, transaction);
+    dhcp_fill_server_id(reply, dhcp->hwaddr);
+    dhcp_fill_client_id(reply, hwaddr_type, hwaddr);
+    if (lease) {
+        dhcp_lease_addr(dhcp, lease, ipv6);
+        dhcp_fill_identity_association(reply, iaid, ipv6, dhcp->preferred_lifetime, dhcp->valid_lifetime);
+    } else if (msg_type == DHCPV6_MSG_RELEASE) {
+        dhcp_fill_status_code(reply, DHCPV6_STATUS_SUCCESS);
+    } else if (msg_type == DHCPV6_MSG_RENEW) {
+        dhcp_fill_identity_association_status(reply, iaid, DHCPV6_STATUS_NO_BINDING);
+    } else {
+        dhcp_fill_status_code(reply, DHCPV6_STATUS_NO_ADDRS_AVAIL);
+    }
+    if (rapid_commit)
+        dhcp_fill_rapid_commit(reply);
+    return 0;
+}
+
 static int dhcp_handle_request(struct dhcp_server *dhcp,
                                 struct iobuf_read *req, struct iobuf_write *reply)
 {
@@ -89,7 +397,7 @@ static int dhcp_handle_request(struct dhcp_server *dhcp,
     msg_type = iobuf_pop_u8(req);
     if (msg_type == DHCPV6_MSG_RELAY_FWD)
         return dhcp_handle_request_fwd(dhcp, req, reply);
-    if (msg_type != DHCPV6_MSG_SOLICIT) {
+    if (msg_type != DHCPV6_MSG_SOLICIT && !dhcp->pool_size) {
         TRACE(TR_DROP, "drop %-9s: unsupported msg-type 0x%02x", "dhcp", msg_type);
         return -EINVAL;
     }
@@ -97,7 +405,7 @@ static int dhcp_handle_request(struct dhcp_server *dhcp,
     transaction = iobuf_pop_be24(req);
     if (dhcp_check_status_code(iobuf_ptr(req), iobuf_remaining_size(req)))
         return -EINVAL;
-    if (dhcp_check_rapid_commit(iobuf_ptr(req), iobuf_remaining_size(req)))
+    if (!dhcp->pool_size && dhcp_check_rapid_commit(iobuf_ptr(req), iobuf_remaining_size(req)))
         return -EINVAL;
     if (dhcp_check_elapsed_time(iobuf_ptr(req), iobuf_remaining_size(req)))
         return -EINVAL;
@@ -107,6 +415,9 @@ static int dhcp_handle_request(struct dhcp_server *dhcp,
     hwaddr_type = dhcp_get_client_hwaddr(iobuf_ptr(req), iobuf_remaining_size(req), &hwaddr);
     if (hwaddr_type < 0)
         return -EINVAL;
+    if (dhcp->pool_size)
+        return dhcp_handle_request_stateful(dhcp, msg_type, req, reply, transaction,
+                                            iaid, hwaddr_type, hwaddr);
 
     memcpy(ipv6, dhcp->prefix, 8);
     memcpy(ipv6 + 8, hwaddr, 8);
@@ -159,6 +470,10 @@ void dhcp_start(struct dhcp_server *dhcp, const char *tun_dev, uint8_t *hwaddr,
     memcpy(dhcp->hwaddr, hwaddr, 8);
     memcpy(dhcp->prefix, prefix, 8);
     dhcp->tun_if_id = if_nametoindex(tun_dev);
+    if (dhcp->pool_size) {
+        dhcp->pool = zalloc(dhcp->pool_size * sizeof(dhcp->pool[0]));
+        dhcp_lease_load(dhcp);
+    }
     dhcp->fd = socket(AF_INET6, SOCK_DGRAM, 0);
     if (dhcp->fd < 0)
         FATAL(1, "%s: socket: %m", __func__);
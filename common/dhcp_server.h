@@ -13,8 +13,13 @@
  */
 #ifndef DHCP_SERVER_H
 #define DHCP_SERVER_H
+#include <sys/queue.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
+
+#include "common/timer.h"
 
 /*
  * dhcp_start() will start listening on port 547. The struct dhcp_server will be
@@ -25,8 +30,35 @@
  * Once started, the caller has to poll (with poll() or equivalent)
  * dhcp_server->fd for any incoming frames. dhcp_recv() has to be called
  * dhcp_server->fd is ready.
+ *
+ * By default, the server is stateless: it only answers to SOLICIT with Rapid
+ * Commit, and the address is derived from the client EUI-64. If pool_size is
+ * set before the call to dhcp_start(), addresses are instead allocated from
+ * the pool_size addresses following pool_start (only the IID is used, the
+ * prefix is always the one given to dhcp_start()). A lease is kept for each
+ * DUID/IAID pair, and REQUEST, RENEW, REBIND and RELEASE are handled.
+ *
+ * Leases are written to the file "dhcp-leases" (under g_storage_prefix) a few
+ * seconds after they change, so a burst of requests results in a single write.
+ * dhcp_lease_flush() forces the pending write.
  */
 
+// Number of buckets of the lease table, as a power of 2. Sized for about 10k
+// leases.
+#define DHCP_LEASE_HASH_BITS 10
+
+struct dhcp_lease {
+    uint16_t hwaddr_type;
+    uint8_t hwaddr[8];
+    uint32_t iaid;
+    uint32_t pool_index;
+    time_t expire_s; // CLOCK_REALTIME, 0 if infinite
+    SLIST_ENTRY(dhcp_lease) link;
+};
+
+// Declare struct dhcp_lease_list
+SLIST_HEAD(dhcp_lease_list, dhcp_lease);
+
 struct dhcp_server {
     int fd;
     int tun_if_id;
@@ -34,9 +66,19 @@ struct dhcp_server {
     uint32_t valid_lifetime;
     uint8_t hwaddr[8];
     uint8_t prefix[8];
+
+    uint8_t pool_start[8];
+    uint32_t pool_size;
+    bool storage_fsync;
+    // Indexed by position in the pool, NULL if the address is free
+    struct dhcp_lease **pool;
+    uint32_t pool_next;
+    struct dhcp_lease_list lease_hash[1 << DHCP_LEASE_HASH_BITS];
+    struct timer_entry lease_timer;
 };
 
 void dhcp_start(struct dhcp_server *dhcp, const char *tun_dev, uint8_t *hwaddr, uint8_t *prefix);
 void dhcp_recv(struct dhcp_server *dhcp);
+void dhcp_lease_flush(struct dhcp_server *dhcp);
 
 #endif
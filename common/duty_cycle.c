@@ -0,0 +1,85 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <string.h>
+
+#include "common/time_extra.h"
+#include "common/log.h"
+
+#include "duty_cycle.h"
+
+void duty_cycle_init(struct duty_cycle *dc, unsigned int budget_permille, uint64_t window_ms)
+{
+    memset(dc, 0, sizeof(*dc));
+    if (!budget_permille)
+        return;
+    BUG_ON(window_ms < DUTY_CYCLE_BUCKETS);
+    dc->bucket_ms  = window_ms / DUTY_CYCLE_BUCKETS;
+    dc->budget_us  = dc->bucket_ms * DUTY_CYCLE_BUCKETS * budget_permille;
+    dc->bucket_cur = time_now_ms(CLOCK_MONOTONIC) / dc->bucket_ms;
+}
+
+static void duty_cycle_update(struct duty_cycle *dc)
+{
+    uint64_t bucket = time_now_ms(CLOCK_MONOTONIC) / dc->bucket_ms;
+
+    if (bucket - dc->bucket_cur >= DUTY_CYCLE_BUCKETS) {
+        memset(dc->bucket_us, 0, sizeof(dc->bucket_us));
+        dc->used_us = 0;
+        dc->bucket_cur = bucket;
+        return;
+    }
+    while (dc->bucket_cur < bucket) {
+        dc->bucket_cur++;
+        dc->used_us -= dc->bucket_us[dc->bucket_cur % DUTY_CYCLE_BUCKETS];
+        dc->bucket_us[dc->bucket_cur % DUTY_CYCLE_BUCKETS] = 0;
+    }
+}
+
+void duty_cycle_add(struct duty_cycle *dc, uint64_t airtime_us)
+{
+    if (!duty_cycle_enabled(dc))
+        return;
+    duty_cycle_update(dc);
+    dc->bucket_us[dc->bucket_cur % DUTY_CYCLE_BUCKETS] += airtime_us;
+    dc->used_us += airtime_us;
+}
+
+uint64_t duty_cycle_used_us(struct duty_cycle *dc)
+{
+    if (!duty_cycle_enabled(dc))
+        return 0;
+    duty_cycle_update(dc);
+    return dc->used_us;
+}
+
+uint64_t duty_cycle_remaining_us(struct duty_cycle *dc)
+{
+    uint64_t used_us = duty_cycle_used_us(dc);
+
+    return dc->budget_us > used_us ? dc->budget_us - used_us : 0;
+}
+
+bool duty_cycle_above(struct duty_cycle *dc, unsigned int threshold_permille)
+{
+    if (!duty_cycle_enabled(dc))
+        return false;
+    return duty_cycle_used_us(dc) * 1000 >= dc->budget_us * threshold_permille;
+}
+
+uint64_t duty_cycle_release_ms(struct duty_cycle *dc)
+{
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+
+    return (now_ms / dc->bucket_ms + 1) * dc->bucket_ms - now_ms;
+}
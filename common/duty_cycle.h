@@ -0,0 +1,61 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_DUTY_CYCLE_H
+#define COMMON_DUTY_CYCLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Sliding window accounting of the transmission time, to stay below the duty
+ * cycle limits of the radio regulations (ie. ARIB STD-T108: 360s per hour).
+ *
+ * The window is split in DUTY_CYCLE_BUCKETS buckets, so the airtime accounted
+ * in a bucket is released at once when the bucket leaves the window. The
+ * resulting error is at most one bucket duration.
+ *
+ * A budget of 0 disables the accounting.
+ */
+
+#define DUTY_CYCLE_BUCKETS 60
+
+struct duty_cycle {
+    uint64_t budget_us;
+    uint64_t bucket_ms;
+    uint64_t bucket_cur;   // Absolute index of the current bucket
+    uint64_t used_us;
+    uint64_t bucket_us[DUTY_CYCLE_BUCKETS];
+};
+
+void duty_cycle_init(struct duty_cycle *dc, unsigned int budget_permille, uint64_t window_ms);
+void duty_cycle_add(struct duty_cycle *dc, uint64_t airtime_us);
+
+uint64_t duty_cycle_used_us(struct duty_cycle *dc);
+uint64_t duty_cycle_remaining_us(struct duty_cycle *dc);
+// True when the airtime used exceeds threshold_permille of the budget.
+bool duty_cycle_above(struct duty_cycle *dc, unsigned int threshold_permille);
+// Delay until the oldest bucket leaves the window.
+uint64_t duty_cycle_release_ms(struct duty_cycle *dc);
+
+static inline bool duty_cycle_enabled(const struct duty_cycle *dc)
+{
+    return dc->budget_us;
+}
+
+static inline uint64_t duty_cycle_window_ms(const struct duty_cycle *dc)
+{
+    return dc->bucket_ms * DUTY_CYCLE_BUCKETS;
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/epoll.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/cpu_usage.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/sys_queue_extra.h"
+#include "common/time_extra.h"
+
+#include "event_loop.h"
+
+// Declare struct event_source_list
+SLIST_HEAD(event_source_list, event_source);
+
+struct event_loop_ctxt {
+    int fd;
+    struct event_source_list sources;
+    int sources_count;
+    uint64_t run_id;
+    // Events returned by the last epoll_wait(), see event_loop_del()
+    struct epoll_event *ready;
+    int ready_size;
+    int ready_len;
+    // Source whose callback is being called
+    struct event_source *cur;
+    uint64_t wakeup_us;
+} g_event_loop_ctxt = {
+    .fd = -1,
+};
+
+static struct event_loop_ctxt *event_loop_ctxt(void)
+{
+    struct event_loop_ctxt *ctxt = &g_event_loop_ctxt;
+
+    if (ctxt->fd >= 0)
+        return ctxt;
+    ctxt->fd = epoll_create1(EPOLL_CLOEXEC);
+    FATAL_ON(ctxt->fd < 0, 2, "epoll_create1: %m");
+    SLIST_INIT(&ctxt->sources);
+    return ctxt;
+}
+
+void event_loop_add(struct event_source *src)
+{
+    struct event_loop_ctxt *ctxt = event_loop_ctxt();
+    struct epoll_event event = {
+        .events = src->events,
+        .data.ptr = src,
+    };
+    int ret;
+
+    if (src->fd < 0)
+        return;
+    BUG_ON(src->added);
+    BUG_ON(!src->callback);
+    ret = epoll_ctl(ctxt->fd, EPOLL_CTL_ADD, src->fd, &event);
+    // Regular files are not supported by epoll, they are always ready so
+    // they are handled like with poll() (eg. replay files in the fuzzer).
+    FATAL_ON(ret < 0 && errno != EPERM, 2, "epoll_ctl ADD: %m");
+    src->always_ready = ret < 0;
+    SLIST_INSERT_HEAD(&ctxt->sources, src, link);
+    ctxt->sources_count++;
+    src->run_id = 0;
+    src->added = true;
+}
+
+void event_loop_mod(struct event_source *src, uint32_t events)
+{
+    struct event_loop_ctxt *ctxt = event_loop_ctxt();
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = src,
+    };
+    int ret;
+
+    if (src->events == events)
+        return;
+    src->events = events;
+    if (!src->added || src->always_ready)
+        return;
+    ret = epoll_ctl(ctxt->fd, EPOLL_CTL_MOD, src->fd, &event);
+    FATAL_ON(ret < 0, 2, "epoll_ctl MOD: %m");
+}
+
+void event_loop_del(struct event_source *src)
+{
+    struct event_loop_ctxt *ctxt = event_loop_ctxt();
+    int ret;
+
+    if (!src->added)
+        return;
+    if (!src->always_ready) {
+        ret = epoll_ctl(ctxt->fd, EPOLL_CTL_DEL, src->fd, NULL);
+        FATAL_ON(ret < 0, 2, "epoll_ctl DEL: %m");
+    }
+    SLIST_REMOVE(&ctxt->sources, src, event_source, link);
+    ctxt->sources_count--;
+    src->added = false;
+    // The source may be freed by the caller, drop any reference to it.
+    for (int i = 0; i < ctxt->ready_len; i++)
+        if (ctxt->ready[i].data.ptr == src)
+            ctxt->ready[i].data.ptr = NULL;
+    if (ctxt->cur == src)
+        ctxt->cur = NULL;
+}
+
+static void event_source_call(struct event_loop_ctxt *ctxt, struct event_source *src, uint32_t revents)
+{
+    unsigned int budget = src->budget ? src->budget : 1;
+    struct cpu_usage_frame frame;
+    void (*callback)(struct event_source *src, uint32_t revents);
+    struct pollfd pfd;
+    int ret;
+
+    src->run_id = ctxt->run_id;
+    ctxt->cur = src;
+    while (true) {
+        callback = src->callback;
+        if (g_cpu_usage_enabled)
+            cpu_usage_enter(&frame);
+        callback(src, revents);
+        time_cache_refresh();
+        if (g_cpu_usage_enabled)
+            cpu_usage_leave(&frame, CPU_USAGE_FD, callback);
+        // WARN: src is not valid anymore if the callback removed it
+        if (ctxt->cur != src || !--budget)
+            break;
+        pfd.fd = src->fd;
+        pfd.events = src->events & (POLLIN | POLLOUT | POLLPRI);
+        pfd.revents = 0;
+        ret = poll(&pfd, 1, 0);
+        FATAL_ON(ret < 0, 2, "poll: %m");
+        // POLL* and EPOLL* values are identical
+        revents = pfd.revents;
+        if (!revents && !src->pending)
+            break;
+    }
+    ctxt->cur = NULL;
+}
+
+static uint32_t event_source_ready(struct event_source *src)
+{
+    return src->always_ready ? src->events & (EPOLLIN | EPOLLOUT) : 0;
+}
+
+static struct event_source *event_loop_next_pending(struct event_loop_ctxt *ctxt, bool priority)
+{
+    struct event_source *src;
+
+    SLIST_FOREACH(src, &ctxt->sources, link)
+        if ((src->pending || event_source_ready(src)) &&
+            src->priority == priority && src->run_id != ctxt->run_id)
+            return src;
+    return NULL;
+}
+
+void event_loop_run(void)
+{
+    struct event_loop_ctxt *ctxt = event_loop_ctxt();
+    struct event_source *src;
+    int timeout = -1;
+    int ret;
+
+    if (ctxt->ready_size < MAX(ctxt->sources_count, 1)) {
+        ctxt->ready_size = MAX(ctxt->sources_count, 1);
+        ctxt->ready = realloc(ctxt->ready, ctxt->ready_size * sizeof(ctxt->ready[0]));
+        FATAL_ON(!ctxt->ready, 2, "%s: cannot allocate memory", __func__);
+    }
+    SLIST_FOREACH(src, &ctxt->sources, link)
+        if (src->pending || event_source_ready(src))
+            timeout = 0;
+
+    ret = epoll_wait(ctxt->fd, ctxt->ready, ctxt->ready_size, timeout);
+    if (ret < 0 && errno == EINTR)
+        return;
+    FATAL_ON(ret < 0, 2, "epoll_wait: %m");
+    ctxt->wakeup_us = time_now_us(CLOCK_MONOTONIC);
+    time_cache_start();
+    ctxt->ready_len = ret;
+    ctxt->run_id++;
+
+    // Priority sources first
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < ctxt->ready_len; i++) {
+            src = ctxt->ready[i].data.ptr;
+            if (src && src->priority == !pass && src->run_id != ctxt->run_id)
+                event_source_call(ctxt, src, ctxt->ready[i].events);
+        }
+        // Callbacks may remove any source, so the list is walked again after
+        // each call. There are only a few sources.
+        while ((src = event_loop_next_pending(ctxt, !pass)))
+            event_source_call(ctxt, src, event_source_ready(src));
+    }
+    ctxt->ready_len = 0;
+    time_cache_stop();
+}
+
+uint64_t event_loop_wakeup_us(void)
+{
+    return g_event_loop_ctxt.wakeup_us;
+}
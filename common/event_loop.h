@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_EVENT_LOOP_H
+#define COMMON_EVENT_LOOP_H
+
+#include <sys/epoll.h>
+#include <sys/queue.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Single-threaded event loop backed by epoll, shared by the daemons and the
+ * tools.
+ *
+ * To watch a file descriptor, set event_source.fd, .events (EPOLLIN, EPOLLOUT)
+ * and .callback, then call event_loop_add(). Sources with a negative fd are
+ * silently ignored, so optional sockets do not need special handling. Like
+ * struct timer_entry, struct event_source is typically included in a bigger
+ * structure retrieved with container_of() from the callback.
+ *
+ * Sources are level-triggered. EPOLLET may be added to events when the
+ * callback always drains the file descriptor (eg. a timerfd or an eventfd).
+ *
+ * The callback receives the returned epoll events. It is called when one of
+ * the requested events or EPOLLERR is set, and at most event_source.budget
+ * times per event_loop_run() (once if budget is 0). Between two calls, the
+ * file descriptor is checked again, so callbacks reading a single message per
+ * call never block. Since no source exceeds its budget before the next
+ * epoll_wait(), a busy socket cannot starve the others.
+ *
+ * Sources which buffer input in user space (eg. the UART) set
+ * event_source.pending so their callback is called (with no events) even
+ * when the file descriptor is not ready.
+ *
+ * Sources with event_source.priority set are called before the others, so
+ * their reaction time is bounded by the budgets of a single iteration.
+ *
+ * Sources must be removed with event_loop_del() before their file descriptor
+ * is closed or the structure is freed. This is allowed from any callback.
+ */
+
+struct event_source {
+    int fd;
+    uint32_t events;
+    unsigned int budget;
+    bool pending;
+    bool priority;
+    void (*callback)(struct event_source *src, uint32_t revents);
+
+    // Private fields
+    bool added;
+    bool always_ready;
+    uint64_t run_id;
+    SLIST_ENTRY(event_source) link;
+};
+
+void event_loop_add(struct event_source *src);
+void event_loop_del(struct event_source *src);
+// Change the events of a source, which may not be added.
+void event_loop_mod(struct event_source *src, uint32_t events);
+
+// Wait for at least one source to be ready and call the callbacks.
+void event_loop_run(void);
+
+// Date (CLOCK_MONOTONIC) of the end of the last wait in event_loop_run(),
+// used to measure the processing time of an iteration.
+uint64_t event_loop_wakeup_us(void);
+
+#endif
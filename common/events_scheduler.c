@@ -12,14 +12,14 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _GNU_SOURCE
+#include <sys/eventfd.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
-#include <fcntl.h>
 
-#include "common/ns_list.h"
+#include "common/cpu_usage.h"
 #include "common/log.h"
 #include "common/memutils.h"
 
@@ -27,77 +27,111 @@
 
 struct events_scheduler *g_event_scheduler;
 
-static struct event_tasklet *event_tasklet_handler_get(uint8_t tasklet_id)
+int8_t event_handler_create(void (*handler_func_ptr)(struct event_payload *))
 {
     struct events_scheduler *ctxt = g_event_scheduler;
 
     BUG_ON(!ctxt);
-    ns_list_foreach(struct event_tasklet, cur, &ctxt->event_tasklet_list) {
-        if (cur->id == tasklet_id) {
-            return cur;
-        }
-    }
-    return NULL;
+    if (ctxt->tasklet_count > INT8_MAX)
+        return -1;
+    ctxt->tasklets[ctxt->tasklet_count] = handler_func_ptr;
+    return ctxt->tasklet_count++;
 }
 
-static int8_t event_tasklet_get_free_id(void)
+static void event_queue_grow(struct events_scheduler *ctxt)
 {
-    /*(Note use of uint8_t to avoid overflow if we reach 0x7F)*/
-    for (uint8_t i = 0; i <= INT8_MAX; i++) {
-        if (!event_tasklet_handler_get(i)) {
-            return i;
-        }
-    }
-    return -1;
+    struct event_payload *queue;
+    size_t size;
+
+    size = ctxt->event_queue_size ? 2 * ctxt->event_queue_size : EVENT_QUEUE_INITIAL_SIZE;
+    queue = xalloc(size * sizeof(struct event_payload));
+    // Unwrap the ring buffer
+    for (size_t i = 0; i < ctxt->event_queue_len; i++)
+        queue[i] = ctxt->event_queue[(ctxt->event_queue_head + i) % ctxt->event_queue_size];
+    free(ctxt->event_queue);
+    ctxt->event_queue = queue;
+    ctxt->event_queue_size = size;
+    ctxt->event_queue_head = 0;
 }
 
-int8_t event_handler_create(void (*handler_func_ptr)(struct event_payload *))
+static void event_queue_push(struct events_scheduler *ctxt, const struct event_payload *event)
+{
+    if (ctxt->event_queue_len == ctxt->event_queue_size)
+        event_queue_grow(ctxt);
+    ctxt->event_queue[(ctxt->event_queue_head + ctxt->event_queue_len) % ctxt->event_queue_size] = *event;
+    ctxt->event_queue_len++;
+}
+
+int8_t event_send(const struct event_payload *event)
 {
     struct events_scheduler *ctxt = g_event_scheduler;
-    struct event_tasklet *new = zalloc(sizeof(struct event_tasklet));
 
     BUG_ON(!ctxt);
-    new->id = event_tasklet_get_free_id();
-    new->func_ptr = handler_func_ptr;
-    ns_list_add_to_end(&ctxt->event_tasklet_list, new);
+    if (event->receiver < 0 || event->receiver >= ctxt->tasklet_count)
+        return -1;
 
-    return new->id;
+    event_queue_push(ctxt, event);
+    // The event loop drains the whole queue once signaled, so it is only
+    // necessary to wake it up for the first event.
+    if (ctxt->event_queue_len == 1)
+        event_scheduler_signal();
+    return 0;
 }
 
-int8_t event_send(const struct event_payload *event)
+void event_send_from_thread(const struct event_payload *event)
 {
     struct events_scheduler *ctxt = g_event_scheduler;
-    struct event_payload *event_dup;
+    bool was_empty;
 
     BUG_ON(!ctxt);
-    if (!event_tasklet_handler_get(event->receiver))
-        return -1;
+    BUG_ON(event->receiver < 0 || event->receiver >= ctxt->tasklet_count);
+    pthread_mutex_lock(&ctxt->async_lock);
+    if (ctxt->async_queue_len == ctxt->async_queue_size) {
+        ctxt->async_queue_size = ctxt->async_queue_size ? 2 * ctxt->async_queue_size : EVENT_QUEUE_INITIAL_SIZE;
+        ctxt->async_queue = realloc(ctxt->async_queue, ctxt->async_queue_size * sizeof(struct event_payload));
+        FATAL_ON(!ctxt->async_queue, 2, "%s: realloc: %m", __func__);
+    }
+    ctxt->async_queue[ctxt->async_queue_len] = *event;
+    was_empty = !ctxt->async_queue_len;
+    __atomic_store_n(&ctxt->async_queue_len, ctxt->async_queue_len + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&ctxt->async_lock);
+    // Writing to an eventfd is thread safe
+    if (was_empty)
+        event_scheduler_signal();
+}
 
-    event_dup = xalloc(sizeof(struct event_payload));
-    memcpy(event_dup, event, sizeof(struct event_payload));
-    ns_list_add_to_end(&ctxt->event_queue, event_dup);
-    event_scheduler_signal();
-    return 0;
+static void event_queue_merge_async(struct events_scheduler *ctxt)
+{
+    if (!__atomic_load_n(&ctxt->async_queue_len, __ATOMIC_ACQUIRE))
+        return;
+    pthread_mutex_lock(&ctxt->async_lock);
+    for (size_t i = 0; i < ctxt->async_queue_len; i++)
+        event_queue_push(ctxt, &ctxt->async_queue[i]);
+    __atomic_store_n(&ctxt->async_queue_len, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&ctxt->async_lock);
 }
 
 bool event_scheduler_dispatch_event(void)
 {
     struct events_scheduler *ctxt = g_event_scheduler;
-    struct event_payload *event = ns_list_get_first(&ctxt->event_queue);
-    struct event_tasklet *tasklet;
+    void (*tasklet)(struct event_payload *);
+    struct cpu_usage_frame frame;
+    struct event_payload event;
 
     BUG_ON(!ctxt);
-    if (!event)
+    event_queue_merge_async(ctxt);
+    if (!ctxt->event_queue_len)
         return false;
-    ns_list_remove(&ctxt->event_queue, event);
-    tasklet = event_tasklet_handler_get(event->receiver);
-    if (tasklet) {
-        tasklet->func_ptr(event);
-    } else {
-        WARN();
-    }
-    free(event);
-
+    // Copy the event since the handler may send events and grow the queue
+    event = ctxt->event_queue[ctxt->event_queue_head];
+    ctxt->event_queue_head = (ctxt->event_queue_head + 1) % ctxt->event_queue_size;
+    ctxt->event_queue_len--;
+    tasklet = ctxt->tasklets[event.receiver];
+    if (g_cpu_usage_enabled)
+        cpu_usage_enter(&frame);
+    tasklet(&event);
+    if (g_cpu_usage_enabled)
+        cpu_usage_leave(&frame, CPU_USAGE_TASKLET, tasklet);
     return true;
 }
 
@@ -106,25 +140,32 @@ void event_scheduler_run_until_idle(void)
     while (event_scheduler_dispatch_event());
 }
 
+bool event_scheduler_run(unsigned int budget)
+{
+    struct events_scheduler *ctxt = g_event_scheduler;
+
+    while (budget--)
+        if (!event_scheduler_dispatch_event())
+            return false;
+    return ctxt->event_queue_len ||
+           __atomic_load_n(&ctxt->async_queue_len, __ATOMIC_ACQUIRE);
+}
+
 void event_scheduler_signal()
 {
     struct events_scheduler *ctxt = g_event_scheduler;
-    uint64_t val = 'W';
+    uint64_t val = 1;
+    ssize_t ret;
 
-    write(ctxt->event_fd[1], &val, sizeof(val));
+    ret = write(ctxt->event_fd, &val, sizeof(val));
+    FATAL_ON(ret != sizeof(val), 2, "%s: write: %m", __func__);
 }
 
 void event_scheduler_init(struct events_scheduler *ctxt)
 {
-    int ret;
-
     g_event_scheduler = ctxt;
-    ret = pipe(ctxt->event_fd);
-    FATAL_ON(ret < 0, 2,  "%s: pipe: %m", __func__);
-
-    fcntl(ctxt->event_fd[1], F_SETPIPE_SZ, sizeof(uint64_t) * 2);
-    fcntl(ctxt->event_fd[1], F_SETFL, O_NONBLOCK);
-
-    ns_list_init(&ctxt->event_queue);
-    ns_list_init(&ctxt->event_tasklet_list);
+    ctxt->event_fd = eventfd(0, EFD_NONBLOCK);
+    FATAL_ON(ctxt->event_fd < 0, 2, "%s: eventfd: %m", __func__);
+    pthread_mutex_init(&ctxt->async_lock, NULL);
+    event_queue_grow(ctxt);
 }
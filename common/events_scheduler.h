@@ -13,28 +13,35 @@
  */
 #ifndef EVENTS_SCHEDULER_H
 #define EVENTS_SCHEDULER_H
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#include "common/ns_list.h"
-
 struct event_payload {
     int8_t receiver;    /* Tasklet ID */
     uint8_t event_id;
     void *data_ptr;
-    ns_list_link_t link;
 };
 
-struct event_tasklet {
-    int8_t id;
-    void (*func_ptr)(struct event_payload *);
-    ns_list_link_t link;
-};
+// Initial capacity of the event queue. The queue only grows when more events
+// are pending, so no allocation happens in the usual case.
+#define EVENT_QUEUE_INITIAL_SIZE 64
 
 struct events_scheduler {
-    int event_fd[2];
-    NS_LIST_HEAD(struct event_tasklet, link) event_tasklet_list;
-    NS_LIST_HEAD(struct event_payload, link) event_queue;
+    int event_fd; // eventfd, only written when the queue becomes non-empty
+    void (*tasklets[INT8_MAX + 1])(struct event_payload *);
+    int tasklet_count;
+    // Ring buffer of pending events
+    struct event_payload *event_queue;
+    size_t event_queue_size;
+    size_t event_queue_head;
+    size_t event_queue_len;
+    // Events sent by other threads, moved to event_queue by the main thread
+    pthread_mutex_t async_lock;
+    struct event_payload *async_queue;
+    size_t async_queue_size;
+    size_t async_queue_len;
 };
 
 /**
@@ -56,6 +63,12 @@ bool event_scheduler_dispatch_event(void);
  */
 void event_scheduler_run_until_idle(void);
 
+/**
+ * \brief Process at most budget events.
+ * \return true if events are still queued.
+ */
+bool event_scheduler_run(unsigned int budget);
+
 /**
  * \brief This function will be called when stack receives an event.
  */
@@ -71,10 +84,18 @@ void event_scheduler_signal(void);
  * a pointer to a copy of the data, not the original pointer.
  *
  * \return 0 Event push OK
- * \return -1 Memory allocation Fail
+ * \return -1 Unknown receiver
  */
 int8_t event_send(const struct event_payload *event);
 
+/**
+ * \brief Send event to event scheduler from another thread.
+ *
+ * Same as event_send(), but can be called from any thread. The event is
+ * dispatched by the main thread, after the events already queued.
+ */
+void event_send_from_thread(const struct event_payload *event);
+
 /**
  * \brief Event handler callback register
  *
@@ -22,37 +22,48 @@
 struct iobuf_read;
 struct iobuf_write;
 
+/*
+ * Commands of HIF.md, which is the reference for their parameters. Each
+ * X(name, id) is expanded to a HIF_CMD_<name> constant and its name for
+ * hif_cmd_str().
+ */
+#define HIF_CMD_LIST(X) \
+    X(REQ_NOP,                  0x01) \
+    X(IND_NOP,                  0x02) \
+    X(REQ_RESET,                0x03) \
+    X(IND_RESET,                0x04) \
+    X(IND_FATAL,                0x05) \
+    X(SET_HOST_API,             0x06) \
+    X(REQ_DATA_TX,              0x10) \
+    X(REQ_DATA_TX_ABORT,        0x11) \
+    X(CNF_DATA_TX,              0x12) \
+    X(IND_DATA_RX,              0x13) \
+    X(REQ_RADIO_ENABLE,         0x20) \
+    X(REQ_RADIO_LIST,           0x21) \
+    X(CNF_RADIO_LIST,           0x22) \
+    X(SET_RADIO,                0x23) \
+    X(SET_RADIO_REGULATION,     0x24) \
+    X(SET_RADIO_TX_POWER,       0x25) \
+    X(SET_FHSS_UC,              0x30) \
+    X(SET_FHSS_FFN_BC,          0x31) \
+    X(SET_FHSS_LFN_BC,          0x32) \
+    X(SET_FHSS_ASYNC,           0x33) \
+    X(SET_SEC_KEY,              0x40) \
+    X(SET_SEC_FRAME_COUNTER_TX, 0x41) \
+    X(SET_SEC_FRAME_COUNTER_RX, 0x42) \
+    X(SET_FILTER_PANID,         0x58) \
+    X(SET_FILTER_SRC64,         0x59) \
+    X(SET_FILTER_DST64,         0x5a) \
+    X(REQ_PING,                 0xe1) \
+    X(CNF_PING,                 0xe2) \
+    X(IND_REPLAY_TIMER,         0xf0) \
+    X(IND_REPLAY_SOCKET,        0xf1) \
+    X(IND_REPLAY_CHECKPOINT,    0xf2)
+
 enum {
-    HIF_CMD_REQ_NOP                  = 0x01,
-    HIF_CMD_IND_NOP                  = 0x02,
-    HIF_CMD_REQ_RESET                = 0x03,
-    HIF_CMD_IND_RESET                = 0x04,
-    HIF_CMD_IND_FATAL                = 0x05,
-    HIF_CMD_SET_HOST_API             = 0x06,
-    HIF_CMD_REQ_DATA_TX              = 0x10,
-    HIF_CMD_REQ_DATA_TX_ABORT        = 0x11,
-    HIF_CMD_CNF_DATA_TX              = 0x12,
-    HIF_CMD_IND_DATA_RX              = 0x13,
-    HIF_CMD_REQ_RADIO_ENABLE         = 0x20,
-    HIF_CMD_REQ_RADIO_LIST           = 0x21,
-    HIF_CMD_CNF_RADIO_LIST           = 0x22,
-    HIF_CMD_SET_RADIO                = 0x23,
-    HIF_CMD_SET_RADIO_REGULATION     = 0x24,
-    HIF_CMD_SET_RADIO_TX_POWER       = 0x25,
-    HIF_CMD_SET_FHSS_UC              = 0x30,
-    HIF_CMD_SET_FHSS_FFN_BC          = 0x31,
-    HIF_CMD_SET_FHSS_LFN_BC          = 0x32,
-    HIF_CMD_SET_FHSS_ASYNC           = 0x33,
-    HIF_CMD_SET_SEC_KEY              = 0x40,
-    HIF_CMD_SET_SEC_FRAME_COUNTER_TX = 0x41,
-    HIF_CMD_SET_SEC_FRAME_COUNTER_RX = 0x42,
-    HIF_CMD_SET_FILTER_PANID         = 0x58,
-    HIF_CMD_SET_FILTER_SRC64         = 0x59,
-    HIF_CMD_SET_FILTER_DST64         = 0x5a,
-    HIF_CMD_REQ_PING                 = 0xe1,
-    HIF_CMD_CNF_PING                 = 0xe2,
-    HIF_CMD_IND_REPLAY_TIMER         = 0xf0,
-    HIF_CMD_IND_REPLAY_SOCKET        = 0xf1,
+#define HIF_CMD_ENUM(name, id) HIF_CMD_##name = id,
+    HIF_CMD_LIST(HIF_CMD_ENUM)
+#undef HIF_CMD_ENUM
 };
 
 enum hif_fatal_code {
@@ -119,6 +130,10 @@ enum hif_mode_switch_type {
 
 #define HIF_KEY_COUNT 8
 
+// Flags of the entries of CNF_RADIO_LIST
+#define HIF_MASK_RADIO_LIST_GROUP 0x0001
+#define HIF_MASK_RADIO_LIST_MCS   0x01fe
+
 const char *hif_cmd_str(uint8_t cmd);
 const char *hif_fatal_str(uint16_t code);
 const char *hif_status_str(uint8_t code);
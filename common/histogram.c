@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include "common/mathutils.h"
+
+#include "histogram.h"
+
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+
+static int histogram_index(uint64_t val)
+{
+    int msb, i;
+
+    if (val < HISTOGRAM_SUB_COUNT)
+        return val;
+    msb = 63 - __builtin_clzll(val);
+    i = (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT +
+        ((val >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1));
+    return MIN(i, HISTOGRAM_BUCKETS - 1);
+}
+
+uint64_t histogram_bucket_max(int i)
+{
+    int shift;
+
+    if (i >= HISTOGRAM_BUCKETS - 1)
+        return UINT64_MAX;
+    if (i < HISTOGRAM_SUB_COUNT)
+        return i;
+    shift = i / HISTOGRAM_SUB_COUNT - 1;
+    return (((uint64_t)(HISTOGRAM_SUB_COUNT + i % HISTOGRAM_SUB_COUNT + 1)) << shift) - 1;
+}
+
+void histogram_add(struct histogram *hist, uint64_t val)
+{
+    hist->buckets[histogram_index(val)]++;
+    hist->count++;
+    hist->sum += val;
+    if (hist->max < val)
+        hist->max = val;
+}
+
+uint64_t histogram_quantile(const struct histogram *hist, double q)
+{
+    uint64_t rank = q * hist->count;
+    uint64_t cumul = 0;
+
+    if (!hist->count)
+        return 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        cumul += hist->buckets[i];
+        if (cumul > rank || cumul == hist->count)
+            return MIN(histogram_bucket_max(i), hist->max);
+    }
+    return hist->max;
+}
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_HISTOGRAM_H
+#define COMMON_HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Fixed-size histogram with log-linear buckets, in the spirit of HDR
+ * histograms: every power of 2 is split into 4 buckets, so the relative error
+ * on reported values is at most 25%. Values up to 2^32 (about 70 minutes when
+ * counting microseconds) are distinguished, larger values fall in the last
+ * bucket. Recording a value is a handful of instructions without allocation.
+ */
+
+#define HISTOGRAM_SUB_BITS 2
+#define HISTOGRAM_BUCKETS  128
+
+struct histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_add(struct histogram *hist, uint64_t val);
+
+// Largest value which falls in bucket i.
+uint64_t histogram_bucket_max(int i);
+
+// Upper bound of the bucket containing the given quantile (0 to 1), clamped
+// to the largest recorded value. Returns 0 for an empty histogram.
+uint64_t histogram_quantile(const struct histogram *hist, double q);
+
+#endif
@@ -20,9 +20,39 @@
 
 #include "iobuf.h"
 
+// Nested users are common (eg. a 15.4 frame is built, then wrapped in a HIF
+// command), so a few scratch buffers are needed.
+#define IOBUF_SCRATCH_COUNT 4
+// Scratch buffers which grew larger than this are freed to bound memory usage.
+#define IOBUF_SCRATCH_MAX_SIZE 4096
+
+struct iobuf_scratch_slot {
+    uint8_t *data;
+    int data_size;
+    bool in_use;
+};
+
+static __thread struct iobuf_scratch_slot iobuf_scratch_slots[IOBUF_SCRATCH_COUNT];
+
+static void iobuf_scratch_acquire(struct iobuf_write *buf)
+{
+    for (int i = 0; i < IOBUF_SCRATCH_COUNT; i++) {
+        if (iobuf_scratch_slots[i].in_use)
+            continue;
+        iobuf_scratch_slots[i].in_use = true;
+        buf->scratch_slot = &iobuf_scratch_slots[i];
+        buf->data         = buf->scratch_slot->data;
+        buf->data_size    = buf->scratch_slot->data_size;
+        return;
+    }
+}
+
 static void iobuf_enlarge_buffer(struct iobuf_write *buf, size_t new_data_size) {
+    if (buf->scratch && !buf->scratch_slot && !buf->data)
+        iobuf_scratch_acquire(buf);
     if (buf->data_size < buf->len + new_data_size) {
-        buf->data_size = MAX(64, buf->len + new_data_size);
+        // Grow geometrically to make appends amortized O(1)
+        buf->data_size = MAX(64, MAX(2 * buf->data_size, buf->len + new_data_size));
         buf->data = realloc(buf->data, buf->data_size);
         BUG_ON(!buf->data);
     }
@@ -96,10 +126,30 @@ void iobuf_push_data_reserved(struct iobuf_write *buf, const int num)
 }
 
 void iobuf_free(struct iobuf_write *buf) {
-    free(buf->data);
+    struct iobuf_scratch_slot *slot = buf->scratch_slot;
+
+    if (slot) {
+        BUG_ON(!slot->in_use);
+        if (buf->data_size > IOBUF_SCRATCH_MAX_SIZE) {
+            free(buf->data);
+            slot->data = NULL;
+            slot->data_size = 0;
+        } else {
+            slot->data = buf->data;
+            slot->data_size = buf->data_size;
+        }
+        slot->in_use = false;
+    } else {
+        free(buf->data);
+    }
     memset(buf, 0, sizeof(struct iobuf_write));
 }
 
+struct iobuf_write iobuf_scratch(void)
+{
+    return (struct iobuf_write){ .scratch = true };
+}
+
 static bool iobuf_validate(struct iobuf_read *buf, size_t data_size)
 {
     if (buf->err || iobuf_remaining_size(buf) < data_size) {
@@ -29,6 +29,11 @@
  * release the memory. At anytime, the user can retrieve the content of the
  * buffer with the fields data and len.
  *
+ * Short-lived buffers built for each frame can be initialized with
+ * iobuf_scratch() instead of { }. On first push, they pick one of the
+ * per-thread scratch buffers, which is given back (not freed) by iobuf_free().
+ * When all the scratch buffers are in use, the heap is used instead.
+ *
  * For reading, the caller has to set the fields data/data_size to the start/len
  * of the buffer he wants to parse. It is possible to have several iobufs
  * pointing to the same buffer (for nested structures). If an error (mostly a
@@ -45,6 +50,9 @@ struct iobuf_write {
     int data_size;
     int len;
     uint8_t *data;
+    // Private fields, see iobuf_scratch()
+    bool scratch;
+    struct iobuf_scratch_slot *scratch_slot;
 };
 
 struct iobuf_read {
@@ -66,6 +74,7 @@ void iobuf_push_le64(struct iobuf_write *buf, uint64_t val);
 void iobuf_push_data(struct iobuf_write *buf, const void *val, int num);
 void iobuf_push_data_reserved(struct iobuf_write *buf, const int num);
 void iobuf_free(struct iobuf_write *buf);
+struct iobuf_write iobuf_scratch(void);
 
 uint8_t iobuf_pop_u8(struct iobuf_read *buf);
 uint16_t iobuf_pop_be16(struct iobuf_read *buf);
@@ -0,0 +1,223 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <netinet/ip6.h>
+#include <errno.h>
+#include <string.h>
+
+#include "common/specs/6lowpan.h"
+#include "common/specs/ipv6.h"
+#include "common/specs/rpl.h"
+#include "common/bits.h"
+#include "common/endian.h"
+#include "common/iobuf.h"
+#include "common/log.h"
+
+#include "6lorh.h"
+
+// RFC 8138 - Table 2: The SRH-6LoRH Types
+static int lowpan_6lorh_srh_hop_len(uint8_t type)
+{
+    return 1 << type;
+}
+
+static uint8_t lowpan_6lorh_srh_type(const struct in6_addr *addr, const struct in6_addr *ref)
+{
+    uint8_t type;
+
+    for (type = LOWPAN_6LORH_TYPE_SRH1; type < LOWPAN_6LORH_TYPE_SRH16; type++)
+        if (!memcmp(addr, ref, 16 - lowpan_6lorh_srh_hop_len(type)))
+            break;
+    return type;
+}
+
+static int lowpan_6lorh_parse_srh(struct iobuf_read *buf, struct lowpan_6lorh *lorh,
+                                  uint8_t dispatch, uint8_t type, const struct in6_addr *root)
+{
+    int hop_len = lowpan_6lorh_srh_hop_len(type);
+    int cnt = FIELD_GET(LOWPAN_MASK_6LORH_SIZE, dispatch) + 1;
+    const struct in6_addr *ref;
+
+    if (lorh->srh_len + cnt > LOWPAN_6LORH_SRH_MAXSEG) {
+        TRACE(TR_DROP, "drop %-9s: too many hops in SRH-6LoRH", "6lowpan");
+        return -E2BIG;
+    }
+    //   RFC 8138 - 5.1. Compressing Addresses
+    // The reference for the first address is the root, then each address is
+    // compressed against the previous one.
+    for (int i = 0; i < cnt; i++) {
+        ref = lorh->srh_len ? &lorh->srh[lorh->srh_len - 1] : root;
+        lorh->srh[lorh->srh_len] = *ref;
+        iobuf_pop_data(buf, lorh->srh[lorh->srh_len].s6_addr + 16 - hop_len, hop_len);
+        lorh->srh_len++;
+    }
+    return 0;
+}
+
+static void lowpan_6lorh_parse_rpi(struct iobuf_read *buf, struct lowpan_6lorh *lorh, uint8_t dispatch)
+{
+    lorh->rpi = true;
+    lorh->rpi_flags = dispatch & (LOWPAN_MASK_6LORH_RPI_O |
+                                  LOWPAN_MASK_6LORH_RPI_R |
+                                  LOWPAN_MASK_6LORH_RPI_F);
+    // The RPLInstanceID is elided for the default instance 0
+    if (!(dispatch & LOWPAN_MASK_6LORH_RPI_I))
+        lorh->rpi_instance_id = iobuf_pop_u8(buf);
+    if (dispatch & LOWPAN_MASK_6LORH_RPI_K)
+        lorh->rpi_sender_rank = iobuf_pop_u8(buf);
+    else
+        lorh->rpi_sender_rank = iobuf_pop_be16(buf);
+}
+
+static int lowpan_6lorh_parse_ipinip(struct iobuf_read *buf, struct lowpan_6lorh *lorh, uint8_t len)
+{
+    //   RFC 8138 - 6.4. The IP-in-IP 6LoRH
+    // The Length of an IP-in-IP-6LoRH indicates the length of the encapsulator
+    // address plus one byte for the Hop Limit. The encapsulator address may be
+    // 0, 1, 2, 8 or 16 bytes long.
+    if (!len || len - 1 > sizeof(lorh->ipinip_encap)) {
+        TRACE(TR_DROP, "drop %-9s: malformed IP-in-IP-6LoRH", "6lowpan");
+        return -EINVAL;
+    }
+    lorh->ipinip = true;
+    lorh->ipinip_hlim = iobuf_pop_u8(buf);
+    lorh->ipinip_encap_len = len - 1;
+    iobuf_pop_data(buf, lorh->ipinip_encap, lorh->ipinip_encap_len);
+    return 0;
+}
+
+int lowpan_6lorh_parse(struct iobuf_read *buf, struct lowpan_6lorh *lorh,
+                       const struct in6_addr *root)
+{
+    uint8_t dispatch, type;
+    int ret;
+
+    memset(lorh, 0, sizeof(*lorh));
+    while (iobuf_remaining_size(buf) && !LOWPAN_DISPATCH_IS_IPHC(iobuf_ptr(buf)[0])) {
+        dispatch = iobuf_pop_u8(buf);
+        type     = iobuf_pop_u8(buf);
+        if (LOWPAN_6LORH_IS_CRITICAL(dispatch)) {
+            if (type <= LOWPAN_6LORH_TYPE_SRH16) {
+                ret = lowpan_6lorh_parse_srh(buf, lorh, dispatch, type, root);
+                if (ret)
+                    return ret;
+            } else if (type == LOWPAN_6LORH_TYPE_RPI) {
+                lowpan_6lorh_parse_rpi(buf, lorh, dispatch);
+            } else {
+                //   RFC 8138 - 4.3. Critical 6LoWPAN Routing Header
+                // A node that does not support a critical 6LoRH Type MUST
+                // discard the packet.
+                TRACE(TR_DROP, "drop %-9s: unsupported critical 6LoRH type %u", "6lowpan", type);
+                return -EOPNOTSUPP;
+            }
+        } else if (LOWPAN_6LORH_IS_ELECTIVE(dispatch)) {
+            if (type == LOWPAN_6LORH_TYPE_IPINIP) {
+                ret = lowpan_6lorh_parse_ipinip(buf, lorh, FIELD_GET(LOWPAN_MASK_6LORH_LEN, dispatch));
+                if (ret)
+                    return ret;
+            } else {
+                //   RFC 8138 - 4.2. Elective Format
+                // A node that does not support an elective 6LoRH Type ignores
+                // it and skips Length bytes.
+                iobuf_pop_data_ptr(buf, FIELD_GET(LOWPAN_MASK_6LORH_LEN, dispatch));
+            }
+        } else {
+            TRACE(TR_DROP, "drop %-9s: invalid 6LoRH dispatch 0x%02x", "6lowpan", dispatch);
+            return -EINVAL;
+        }
+        if (buf->err)
+            break;
+    }
+    if (buf->err || !iobuf_remaining_size(buf)) {
+        TRACE(TR_DROP, "drop %-9s: malformed 6LoRH", "6lowpan");
+        return -EINVAL;
+    }
+    return 0;
+}
+
+size_t lowpan_6lorh_expanded_len(const struct lowpan_6lorh *lorh)
+{
+    size_t len = 0;
+
+    // RFC 6554 SRH without prefix elision (CmprI = CmprE = 0): the first hop
+    // becomes the IPv6 destination and the final destination is appended.
+    if (lorh->srh_len)
+        len += 8 + 16 * lorh->srh_len;
+    // RFC 6553 RPL Option alone in a Hop-by-Hop Options header
+    if (lorh->rpi)
+        len += 8;
+    if (lorh->ipinip)
+        len += sizeof(struct ip6_hdr);
+    return len;
+}
+
+int lowpan_6lorh_srh_cmpr(struct iobuf_write *buf, uint8_t *pkt, size_t pkt_len,
+                          const struct in6_addr *root)
+{
+    struct in6_addr hops[LOWPAN_6LORH_SRH_MAXSEG + 1];
+    uint8_t cmpri, cmpre, pad, cmpr, type;
+    const uint8_t *rthdr, *seg;
+    struct ip6_hdr hdr;
+    int n, cnt, i, j;
+    size_t srh_len;
+    uint32_t val;
+
+    if (pkt_len < sizeof(hdr) + 8)
+        return 0;
+    memcpy(&hdr, pkt, sizeof(hdr));
+    rthdr = pkt + sizeof(hdr);
+    if (hdr.ip6_nxt != IPPROTO_ROUTING || rthdr[2] != IPV6_ROUTING_RPL_SRH || !rthdr[3])
+        return 0;
+    srh_len = 8 * (rthdr[1] + 1);
+    if (pkt_len < sizeof(hdr) + srh_len)
+        return -EINVAL;
+    val = read_be32(rthdr + 4);
+    cmpri = FIELD_GET(RPL_MASK_SRH_CMPRI, val);
+    cmpre = FIELD_GET(RPL_MASK_SRH_CMPRE, val);
+    pad   = FIELD_GET(RPL_MASK_SRH_PAD,   val);
+    if (srh_len < 8 + pad + 16 - cmpre)
+        return -EINVAL;
+    n = (srh_len - 8 - pad - (16 - cmpre)) / (16 - cmpri) + 1;
+    if (rthdr[3] > n || rthdr[3] > LOWPAN_6LORH_SRH_MAXSEG)
+        return -EINVAL;
+
+    // The remaining route, from the current destination to the final one
+    hops[0] = hdr.ip6_dst;
+    cnt = 1;
+    for (i = n - rthdr[3] + 1; i <= n; i++) {
+        cmpr = i < n ? cmpri : cmpre;
+        seg = rthdr + 8 + (i - 1) * (16 - cmpri);
+        hops[cnt] = hdr.ip6_dst;
+        memcpy(hops[cnt].s6_addr + cmpr, seg, 16 - cmpr);
+        cnt++;
+    }
+
+    // Consecutive hops compressed to the same size share a SRH-6LoRH
+    for (i = 0; i < cnt - 1; i = j) {
+        type = lowpan_6lorh_srh_type(&hops[i], i ? &hops[i - 1] : root);
+        for (j = i + 1; j < cnt - 1 && j - i <= LOWPAN_MASK_6LORH_SIZE; j++)
+            if (lowpan_6lorh_srh_type(&hops[j], &hops[j - 1]) != type)
+                break;
+        iobuf_push_u8(buf, LOWPAN_6LORH_CRITICAL | FIELD_PREP(LOWPAN_MASK_6LORH_SIZE, j - i - 1));
+        iobuf_push_u8(buf, type);
+        for (int k = i; k < j; k++)
+            iobuf_push_data(buf, hops[k].s6_addr + 16 - lowpan_6lorh_srh_hop_len(type),
+                            lowpan_6lorh_srh_hop_len(type));
+    }
+
+    hdr.ip6_dst  = hops[cnt - 1];
+    hdr.ip6_nxt  = rthdr[0];
+    hdr.ip6_plen = htons(ntohs(hdr.ip6_plen) - srh_len);
+    memcpy(pkt + srh_len, &hdr, sizeof(hdr));
+    return srh_len;
+}
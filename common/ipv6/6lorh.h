@@ -0,0 +1,79 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef LOWPAN_6LORH_H
+#define LOWPAN_6LORH_H
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct iobuf_write;
+struct iobuf_read;
+
+/*
+ * RFC 8138 6LoWPAN Routing Headers (6LoRH) are placed after a Page 1 dispatch
+ * (RFC 8025), before the IPHC header. They replace the uncompressed RPL
+ * artifacts:
+ * - SRH-6LoRH: RPL Source Routing Header (RFC 6554), where each hop is
+ *   compressed against the previous one, and the first against the root.
+ * - RPI-6LoRH: RPL Option (RFC 6553) in a Hop-by-Hop Options header.
+ * - IP-in-IP-6LoRH: encapsulating IPv6 header.
+ *
+ * The SRH-6LoRH lists the remaining route, starting with the receiver of the
+ * frame and excluding the final destination, which is carried by IPHC. Each
+ * router pops its own address.
+ *
+ * The use of 6LoRH is signaled by the root with the T flag of the DODAG
+ * Configuration Option (RFC 9035).
+ */
+
+//   Wi-SUN FAN 1.1v06 - 4.1.1 General
+// The FAN MUST support mesh networking with FAN nodes being up to 24 hops from
+// the root of the mesh tree.
+#define LOWPAN_6LORH_SRH_MAXSEG 24
+
+#define LOWPAN_6LORH_PAGE1 0xf1
+
+struct lowpan_6lorh {
+    struct in6_addr srh[LOWPAN_6LORH_SRH_MAXSEG];
+    int srh_len;
+    bool rpi;
+    uint8_t rpi_flags; // O, R and F flags of RFC 6553
+    uint8_t rpi_instance_id;
+    uint16_t rpi_sender_rank;
+    bool ipinip;
+    uint8_t ipinip_hlim;
+    uint8_t ipinip_encap_len;
+    uint8_t ipinip_encap[16];
+};
+
+// Parse the 6LoRHs following the Page 1 dispatch, up to the IPHC dispatch.
+// Returns 0 on success, or a negative errno.
+int lowpan_6lorh_parse(struct iobuf_read *buf, struct lowpan_6lorh *lorh,
+                       const struct in6_addr *root);
+
+// Size of the IPv6 headers represented by the 6LoRHs, as accounted for in the
+// datagram size of fragmented packets.
+size_t lowpan_6lorh_expanded_len(const struct lowpan_6lorh *lorh);
+
+// Encode the RPL Source Routing Header following the IPv6 header of pkt into
+// SRH-6LoRHs (the Page 1 dispatch is not included), and remove it: the IPv6
+// header is moved forward over the SRH, with the final destination and an
+// updated payload length. Returns the number of bytes removed at the start of
+// pkt, 0 if there is no SRH to compress, or a negative errno.
+int lowpan_6lorh_srh_cmpr(struct iobuf_write *buf, uint8_t *pkt, size_t pkt_len,
+                          const struct in6_addr *root);
+
+#endif
@@ -479,6 +479,57 @@ static uint8_t lowpan_iphc_cmpr_maddr_stless(struct pktbuf *pktbuf,
     }
 }
 
+// RFC 6282 - 4.3. UDP Header Compression
+static bool lowpan_nhc_cmpr_udp(struct pktbuf *pktbuf)
+{
+    struct udphdr hdr;
+    uint16_t sport, dport;
+    uint8_t nhc;
+
+    if (pktbuf_len(pktbuf) < sizeof(hdr))
+        return false;
+    memcpy(&hdr, pktbuf_head(pktbuf), sizeof(hdr));
+    // The length is elided, it must be deducible from the payload
+    if (ntohs(hdr.uh_ulen) != pktbuf_len(pktbuf))
+        return false;
+    pktbuf_pop_head(pktbuf, NULL, sizeof(hdr));
+
+    // The checksum is always carried in-line, eliding it requires an upper
+    // layer authorization (RFC 6282 - 4.3.2).
+    pktbuf_push_head(pktbuf, &hdr.uh_sum, sizeof(hdr.uh_sum));
+    sport = ntohs(hdr.uh_sport);
+    dport = ntohs(hdr.uh_dport);
+    if ((sport & 0xfff0) == 0xf0b0 && (dport & 0xfff0) == 0xf0b0) {
+        // 11: First 12 bits of both Source Port and Destination Port are 0xf0b
+        // and elided. The remaining 4 bits for each are carried in-line.
+        pktbuf_push_head_u8(pktbuf, FIELD_PREP(LOWPAN_MASK_NHC_UDP_P11_SRC, sport) |
+                                    FIELD_PREP(LOWPAN_MASK_NHC_UDP_P11_DST, dport));
+        nhc = 0b11;
+    } else if ((dport & 0xff00) == 0xf000) {
+        // 01: All 16 bits for Source Port are carried in-line. First 8 bits of
+        // Destination Port is 0xf0 and elided. The remaining 8 bits of
+        // Destination Port are carried in-line.
+        pktbuf_push_head_u8(pktbuf, dport);
+        pktbuf_push_head_be16(pktbuf, sport);
+        nhc = 0b01;
+    } else if ((sport & 0xff00) == 0xf000) {
+        // 10: First 8 bits of Source Port are 0xf0 and elided. The remaining 8
+        // bits of Source Port are carried in-line. All 16 bits for Destination
+        // Port are carried in-line.
+        pktbuf_push_head_be16(pktbuf, dport);
+        pktbuf_push_head_u8(pktbuf, sport);
+        nhc = 0b10;
+    } else {
+        // 00: All 16 bits for both Source Port and Destination Port are
+        // carried in-line.
+        pktbuf_push_head_be16(pktbuf, dport);
+        pktbuf_push_head_be16(pktbuf, sport);
+        nhc = 0b00;
+    }
+    pktbuf_push_head_u8(pktbuf, LOWPAN_NHC_UDP | FIELD_PREP(LOWPAN_MASK_NHC_UDP_P, nhc));
+    return true;
+}
+
 void lowpan_iphc_cmpr(struct pktbuf *pktbuf,
                       const uint8_t src_iid[8],
                       const uint8_t dst_iid[8])
@@ -490,6 +541,10 @@ void lowpan_iphc_cmpr(struct pktbuf *pktbuf,
     pktbuf_pop_head(pktbuf, &hdr, sizeof(hdr));
     BUG_ON(pktbuf->err);
 
+    // Headers are pushed in reverse order, starting with the NHC
+    if (hdr.ip6_nxt == IPPROTO_UDP && lowpan_nhc_cmpr_udp(pktbuf))
+        base |= LOWPAN_MASK_IPHC_NH;
+
     if (IN6_IS_ADDR_MULTICAST(&hdr.ip6_dst)) {
         field = lowpan_iphc_cmpr_maddr_stless(pktbuf, &hdr.ip6_dst);
         base |= LOWPAN_MASK_IPHC_M;
@@ -504,8 +559,8 @@ void lowpan_iphc_cmpr(struct pktbuf *pktbuf,
     field = lowpan_iphc_cmpr_hlim(pktbuf, hdr.ip6_hlim);
     base |= FIELD_PREP(LOWPAN_MASK_IPHC_HLIM, field);
 
-    // TODO: Next Header Compression
-    pktbuf_push_head_u8(pktbuf, hdr.ip6_nxt);
+    if (!FIELD_GET(LOWPAN_MASK_IPHC_NH, base))
+        pktbuf_push_head_u8(pktbuf, hdr.ip6_nxt);
 
     field = lowpan_iphc_cmpr_vtcflow(pktbuf, ntohl(hdr.ip6_flow));
     base |= FIELD_PREP(LOWPAN_MASK_IPHC_TF, field);
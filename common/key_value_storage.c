@@ -12,20 +12,450 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #define _GNU_SOURCE
+#include <sys/queue.h>
+#include <sys/stat.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <fnmatch.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <glob.h>
+#include <dirent.h>
 
+#include "common/crc.h"
+#include "common/endian.h"
+#include "common/iobuf.h"
 #include "common/log.h"
 #include "common/memutils.h"
+#include "common/sys_queue_extra.h"
+#include "common/timer.h"
 
 #include "key_value_storage.h"
 
+/*
+ * A table file starts with STORAGE_TABLE_MAGIC, followed by records:
+ *
+ *   le16 crc        CRC-16/MCRF4XX of the rest of the record
+ *   u8   op         STORAGE_RECORD_SET or STORAGE_RECORD_DEL
+ *   u8   key_len
+ *   le32 value_len  0 for STORAGE_RECORD_DEL
+ *   key
+ *   value
+ *
+ * Records are only appended, and the last one of a key wins. A record torn
+ * by a power loss fails the CRC check, it is dropped along with the end of
+ * the file on next load. Once obsolete records take more than half of the
+ * file, live records are written to a new file which replaces the table with
+ * rename().
+ */
+#define STORAGE_TABLE_MAGIC       "WSKVTBL1"
+#define STORAGE_TABLE_COMPACT_MIN (64 * 1024)
+#define STORAGE_RECORD_HDR_LEN    8
+
+enum {
+    STORAGE_RECORD_SET = 1,
+    STORAGE_RECORD_DEL = 2,
+};
+
+struct storage_record {
+    char *key;
+    uint8_t *value;
+    size_t value_len;
+    SLIST_ENTRY(storage_record) link;
+};
+
+// Declare struct storage_record_list
+SLIST_HEAD(storage_record_list, storage_record);
+
+struct storage_table {
+    char *prefix;
+    char *path;
+    int fd;           // -1 until the table is loaded
+    size_t file_size;
+    size_t live_size; // Size of the magic and of the live records
+    bool sync_pending;
+    struct storage_record_list buckets[1024];
+    SLIST_ENTRY(storage_table) link;
+};
+
+// Declare struct storage_table_list
+SLIST_HEAD(storage_table_list, storage_table);
+
+static struct storage_table_list g_storage_tables = SLIST_HEAD_INITIALIZER(g_storage_tables);
+
+/*
+ * Files are written to <filename>.tmp and renamed over the previous version
+ * on close, so they are never seen truncated, even after a crash.
+ *
+ * When the writer asked for a sync (storage_sync()) and a commit window is
+ * set, the file is not renamed on close but queued. Once the window expires,
+ * all the queued files are fsync'ed, renamed, and their directory is fsync'ed
+ * once. Until then, the previous version stays in place, so the queue is
+ * flushed before any access to the storage.
+ */
+struct storage_pending {
+    char *path;
+    SLIST_ENTRY(storage_pending) link;
+};
+
+// Declare struct storage_pending_list
+SLIST_HEAD(storage_pending_list, storage_pending);
+
+static struct {
+    struct storage_pending_list files;
+    struct timer_entry timer;
+} g_storage_commit = {
+    .files = SLIST_HEAD_INITIALIZER(g_storage_commit.files),
+};
+
 const char *g_storage_prefix = NULL;
 
+static size_t storage_record_size(const struct storage_record *rec)
+{
+    return STORAGE_RECORD_HDR_LEN + strlen(rec->key) + rec->value_len;
+}
+
+static struct storage_record_list *storage_table_bucket(struct storage_table *table, const char *key)
+{
+    uint32_t hash = 2166136261;
+
+    // FNV-1a
+    for (; *key; key++)
+        hash = (hash ^ (uint8_t)*key) * 16777619;
+    return &table->buckets[hash % ARRAY_SIZE(table->buckets)];
+}
+
+static struct storage_record *storage_table_lookup(struct storage_table *table, const char *key)
+{
+    struct storage_record *rec;
+
+    return SLIST_FIND(rec, storage_table_bucket(table, key), link, !strcmp(rec->key, key));
+}
+
+static void storage_table_index_del(struct storage_table *table, struct storage_record *rec)
+{
+    table->live_size -= storage_record_size(rec);
+    SLIST_REMOVE(storage_table_bucket(table, rec->key), rec, storage_record, link);
+    free(rec->key);
+    free(rec->value);
+    free(rec);
+}
+
+static void storage_table_index_set(struct storage_table *table, const char *key,
+                                    const uint8_t *value, size_t value_len)
+{
+    struct storage_record *rec = storage_table_lookup(table, key);
+
+    if (rec) {
+        table->live_size -= storage_record_size(rec);
+        free(rec->value);
+    } else {
+        rec = zalloc(sizeof(*rec));
+        rec->key = strdup(key);
+        FATAL_ON(!rec->key, 2, "%s: cannot allocate memory", __func__);
+        SLIST_INSERT_HEAD(storage_table_bucket(table, key), rec, link);
+    }
+    rec->value = xalloc(value_len ? value_len : 1);
+    memcpy(rec->value, value, value_len);
+    rec->value_len = value_len;
+    table->live_size += storage_record_size(rec);
+}
+
+static void storage_record_push(struct iobuf_write *buf, uint8_t op, const char *key,
+                                const uint8_t *value, size_t value_len)
+{
+    size_t offset = buf->len;
+    size_t key_len = strlen(key);
+
+    BUG_ON(key_len > UINT8_MAX);
+    BUG_ON(value_len > UINT32_MAX);
+    iobuf_push_le16(buf, 0); // CRC placeholder
+    iobuf_push_u8(buf, op);
+    iobuf_push_u8(buf, key_len);
+    iobuf_push_le32(buf, value_len);
+    iobuf_push_data(buf, key, key_len);
+    iobuf_push_data(buf, value, value_len);
+    write_le16(buf->data + offset, crc16(CRC_INIT_HCS, buf->data + offset + 2, buf->len - offset - 2));
+}
+
+static bool storage_write_all(int fd, const uint8_t *data, size_t len)
+{
+    ssize_t ret;
+
+    while (len) {
+        ret = write(fd, data, len);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return false;
+        data += ret;
+        len  -= ret;
+    }
+    return true;
+}
+
+static void storage_table_compact(struct storage_table *table)
+{
+    struct iobuf_write buf = { };
+    struct storage_record *rec;
+    char *tmp_path;
+    int fd, ret;
+
+    iobuf_push_data(&buf, STORAGE_TABLE_MAGIC, strlen(STORAGE_TABLE_MAGIC));
+    for (int i = 0; i < ARRAY_SIZE(table->buckets); i++)
+        SLIST_FOREACH(rec, &table->buckets[i], link)
+            storage_record_push(&buf, STORAGE_RECORD_SET, rec->key, rec->value, rec->value_len);
+    BUG_ON(buf.len != table->live_size);
+
+    ret = asprintf(&tmp_path, "%s.tmp", table->path);
+    FATAL_ON(ret < 0, 2, "%s: cannot allocate memory", __func__);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0 || !storage_write_all(fd, buf.data, buf.len) || fsync(fd) || rename(tmp_path, table->path)) {
+        WARN("%s: %s: %m", __func__, tmp_path);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp_path);
+        }
+    } else {
+        close(table->fd);
+        table->fd = fd;
+        table->file_size = buf.len;
+    }
+    free(tmp_path);
+    iobuf_free(&buf);
+}
+
+static void storage_table_append(struct storage_table *table, struct iobuf_write *buf)
+{
+    if (!storage_write_all(table->fd, buf->data, buf->len)) {
+        WARN("%s: write %s: %m", __func__, table->path);
+        // Do not leave a partial record before the next ones
+        if (ftruncate(table->fd, table->file_size))
+            WARN("%s: ftruncate %s: %m", __func__, table->path);
+        return;
+    }
+    table->file_size += buf->len;
+    if (table->file_size > STORAGE_TABLE_COMPACT_MIN && table->file_size > 2 * table->live_size)
+        storage_table_compact(table);
+}
+
+static void storage_table_set(struct storage_table *table, const char *key,
+                              const uint8_t *value, size_t value_len)
+{
+    struct iobuf_write buf = { };
+
+    storage_table_index_set(table, key, value, value_len);
+    storage_record_push(&buf, STORAGE_RECORD_SET, key, value, value_len);
+    storage_table_append(table, &buf);
+    iobuf_free(&buf);
+}
+
+static void storage_table_del(struct storage_table *table, struct storage_record *rec)
+{
+    struct iobuf_write buf = { };
+
+    storage_record_push(&buf, STORAGE_RECORD_DEL, rec->key, NULL, 0);
+    storage_table_index_del(table, rec);
+    storage_table_append(table, &buf);
+    iobuf_free(&buf);
+}
+
+// Move the files stored before the table was used into the table.
+static void storage_table_migrate(struct storage_table *table)
+{
+    char pattern[PATH_MAX];
+    struct stat st;
+    glob_t globbuf;
+    uint8_t *data;
+    FILE *file;
+    int ret;
+
+    snprintf(pattern, sizeof(pattern), "%s%s*", g_storage_prefix, table->prefix);
+    ret = glob(pattern, 0, NULL, &globbuf);
+    if (ret) {
+        WARN_ON(ret != GLOB_NOMATCH, "glob %s returned an error", pattern);
+        return;
+    }
+    for (int i = 0; globbuf.gl_pathv[i]; i++) {
+        file = fopen(globbuf.gl_pathv[i], "r");
+        if (!file || fstat(fileno(file), &st)) {
+            WARN("%s: %s: %m", __func__, globbuf.gl_pathv[i]);
+            if (file)
+                fclose(file);
+            continue;
+        }
+        data = xalloc(st.st_size + 1);
+        if (fread(data, 1, st.st_size, file) == st.st_size)
+            storage_table_set(table, globbuf.gl_pathv[i] + strlen(g_storage_prefix), data, st.st_size);
+        else
+            WARN("%s: %s: read error", __func__, globbuf.gl_pathv[i]);
+        fclose(file);
+        free(data);
+    }
+    // Only remove the files once they are all in the table
+    for (int i = 0; globbuf.gl_pathv[i]; i++)
+        if (storage_table_lookup(table, globbuf.gl_pathv[i] + strlen(g_storage_prefix)))
+            unlink(globbuf.gl_pathv[i]);
+    INFO("%s: %zu files moved to %s", __func__, globbuf.gl_pathc, table->path);
+    globfree(&globbuf);
+}
+
+static void storage_table_parse(struct storage_table *table, const uint8_t *data, size_t len)
+{
+    struct iobuf_read buf = {
+        .data = data,
+        .data_size = len,
+    };
+    struct storage_record *rec;
+    const char *raw_key;
+    const uint8_t *value;
+    uint32_t value_len;
+    uint8_t key_len;
+    size_t valid;
+    uint16_t crc;
+    char key[256];
+    uint8_t op;
+
+    iobuf_pop_data_ptr(&buf, strlen(STORAGE_TABLE_MAGIC));
+    if (buf.err || memcmp(data, STORAGE_TABLE_MAGIC, strlen(STORAGE_TABLE_MAGIC))) {
+        if (len)
+            WARN("%s: invalid table, dropping content", table->path);
+        valid = 0;
+    } else {
+        valid = buf.cnt;
+    }
+    while (valid && iobuf_remaining_size(&buf)) {
+        crc       = iobuf_pop_le16(&buf);
+        op        = iobuf_pop_u8(&buf);
+        key_len   = iobuf_pop_u8(&buf);
+        value_len = iobuf_pop_le32(&buf);
+        raw_key   = iobuf_pop_data_ptr(&buf, key_len);
+        value     = iobuf_pop_data_ptr(&buf, value_len);
+        if (buf.err || !key_len || crc != crc16(CRC_INIT_HCS, data + valid + 2, buf.cnt - valid - 2) ||
+            (op != STORAGE_RECORD_SET && op != STORAGE_RECORD_DEL)) {
+            WARN("%s: corrupted record at offset %zu, dropping end of file", table->path, valid);
+            break;
+        }
+        memcpy(key, raw_key, key_len);
+        key[key_len] = '\0';
+        rec = storage_table_lookup(table, key);
+        if (op == STORAGE_RECORD_SET)
+            storage_table_index_set(table, key, value, value_len);
+        else if (rec)
+            storage_table_index_del(table, rec);
+        valid = buf.cnt;
+    }
+    table->file_size = valid;
+}
+
+static void storage_table_load(struct storage_table *table)
+{
+    struct stat st;
+    uint8_t *data;
+    bool created;
+    int ret;
+
+    table->fd = open(table->path, O_RDWR | O_APPEND | O_CLOEXEC);
+    created = table->fd < 0 && errno == ENOENT;
+    if (created)
+        table->fd = open(table->path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    FATAL_ON(table->fd < 0, 1, "open %s: %m", table->path);
+    ret = fstat(table->fd, &st);
+    FATAL_ON(ret < 0, 1, "fstat %s: %m", table->path);
+
+    table->live_size = strlen(STORAGE_TABLE_MAGIC);
+    data = xalloc(st.st_size + 1);
+    ret = pread(table->fd, data, st.st_size, 0);
+    FATAL_ON(ret != st.st_size, 1, "read %s: %m", table->path);
+    storage_table_parse(table, data, st.st_size);
+    free(data);
+
+    if (!table->file_size) {
+        ret = ftruncate(table->fd, 0);
+        FATAL_ON(ret < 0, 1, "ftruncate %s: %m", table->path);
+        FATAL_ON(!storage_write_all(table->fd, (const uint8_t *)STORAGE_TABLE_MAGIC, strlen(STORAGE_TABLE_MAGIC)),
+                 1, "write %s: %m", table->path);
+        table->file_size = strlen(STORAGE_TABLE_MAGIC);
+    } else if (table->file_size != st.st_size) {
+        ret = ftruncate(table->fd, table->file_size);
+        FATAL_ON(ret < 0, 1, "ftruncate %s: %m", table->path);
+    }
+    if (created)
+        storage_table_migrate(table);
+    if (table->file_size > STORAGE_TABLE_COMPACT_MIN && table->file_size > 2 * table->live_size)
+        storage_table_compact(table);
+}
+
+// key is relative to g_storage_prefix
+static struct storage_table *storage_table_get(const char *key)
+{
+    struct storage_table *table;
+
+    SLIST_FOREACH(table, &g_storage_tables, link)
+        if (!strncmp(key, table->prefix, strlen(table->prefix)))
+            break;
+    if (table && table->fd < 0)
+        storage_table_load(table);
+    return table;
+}
+
+static struct storage_table *storage_table_get_path(const char *filename)
+{
+    if (!g_storage_prefix || strncmp(filename, g_storage_prefix, strlen(g_storage_prefix)))
+        return NULL;
+    return storage_table_get(filename + strlen(g_storage_prefix));
+}
+
+void storage_table_add(const char *prefix)
+{
+    struct storage_table *table = zalloc(sizeof(*table));
+    int ret;
+
+    BUG_ON(!g_storage_prefix);
+    BUG_ON(!strlen(prefix) || prefix[strlen(prefix) - 1] != '-');
+    table->prefix = strdup(prefix);
+    FATAL_ON(!table->prefix, 2, "%s: cannot allocate memory", __func__);
+    ret = asprintf(&table->path, "%s%.*s.db", g_storage_prefix, (int)strlen(prefix) - 1, prefix);
+    FATAL_ON(ret < 0, 2, "%s: cannot allocate memory", __func__);
+    table->fd = -1;
+    for (int i = 0; i < ARRAY_SIZE(table->buckets); i++)
+        SLIST_INIT(&table->buckets[i]);
+    SLIST_INSERT_HEAD(&g_storage_tables, table, link);
+}
+
+static struct storage_parse_info *storage_table_open(struct storage_parse_info *info, const char *mode)
+{
+    const char *key = info->filename + strlen(g_storage_prefix);
+    struct storage_record *rec;
+
+    if (mode[0] == 'w' && !mode[1]) {
+        info->table_write = true;
+        info->file = open_memstream(&info->buf, &info->buf_len);
+    } else if (mode[0] == 'r' && !mode[1]) {
+        rec = storage_table_lookup(info->table, key);
+        if (rec) {
+            // Copy, the record may be replaced before storage_close()
+            info->buf = xalloc(rec->value_len + 1);
+            memcpy(info->buf, rec->value, rec->value_len);
+            info->buf_len = rec->value_len;
+            info->file = fmemopen(info->buf, info->buf_len, "r");
+        } else {
+            errno = ENOENT;
+        }
+    } else {
+        BUG("unsupported mode %s", mode);
+    }
+    if (!info->file) {
+        free(info->buf);
+        free(info);
+        return NULL;
+    }
+    return info;
+}
+
 int storage_check_access(const char *storage_prefix)
 {
     char *tmp;
@@ -40,13 +470,127 @@ int storage_check_access(const char *storage_prefix)
     }
 }
 
+static void storage_sync_dir(const char *path)
+{
+    char *dir = dirname(strdupa(path));
+    int fd;
+
+    // A rename is only durable once the directory is synced
+    fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd))
+        WARN("%s: fsync %s: %m", __func__, dir);
+    if (fd >= 0)
+        close(fd);
+}
+
+static void storage_commit_file(const char *path, bool sync)
+{
+    char tmp_filename[PATH_MAX + 4];
+    int fd;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", path);
+    if (sync) {
+        fd = open(tmp_filename, O_RDONLY);
+        if (fd < 0 || fsync(fd))
+            WARN("%s: fsync %s: %m", __func__, tmp_filename);
+        if (fd >= 0)
+            close(fd);
+    }
+    if (rename(tmp_filename, path))
+        WARN("%s: rename %s: %m", __func__, path);
+}
+
+void storage_commit_flush(void)
+{
+    struct storage_pending *pending, *prev = NULL;
+    struct storage_table *table;
+
+    SLIST_FOREACH(table, &g_storage_tables, link) {
+        if (table->sync_pending && fsync(table->fd))
+            WARN("%s: fsync %s: %m", __func__, table->path);
+        table->sync_pending = false;
+    }
+    SLIST_FOREACH(pending, &g_storage_commit.files, link)
+        storage_commit_file(pending->path, true);
+    // All the files are usually in the same directory
+    SLIST_FOREACH(pending, &g_storage_commit.files, link) {
+        if (!prev || strcmp(dirname(strdupa(prev->path)), dirname(strdupa(pending->path))))
+            storage_sync_dir(pending->path);
+        prev = pending;
+    }
+    while ((pending = SLIST_FIRST(&g_storage_commit.files))) {
+        SLIST_REMOVE_HEAD(&g_storage_commit.files, link);
+        free(pending->path);
+        free(pending);
+    }
+    timer_stop(NULL, &g_storage_commit.timer);
+}
+
+// A pending file must be committed before it is opened again: a reader
+// expects the new content, and a writer would truncate the <file>.tmp that is
+// still queued.
+static void storage_commit_flush_path(const char *path)
+{
+    struct storage_pending *pending;
+
+    SLIST_FOREACH(pending, &g_storage_commit.files, link)
+        if (!strcmp(pending->path, path))
+            break;
+    if (!pending)
+        return;
+    SLIST_REMOVE(&g_storage_commit.files, pending, storage_pending, link);
+    storage_commit_file(pending->path, true);
+    storage_sync_dir(pending->path);
+    free(pending->path);
+    free(pending);
+}
+
+static void storage_commit_timer_cb(struct timer_group *group, struct timer_entry *timer)
+{
+    storage_commit_flush();
+}
+
+void storage_commit_window(uint64_t window_ms)
+{
+    g_storage_commit.timer.period_ms = window_ms;
+    g_storage_commit.timer.callback  = storage_commit_timer_cb;
+}
+
+static void storage_commit_queue(const char *path)
+{
+    struct storage_pending *pending;
+
+    SLIST_FOREACH(pending, &g_storage_commit.files, link)
+        if (!strcmp(pending->path, path))
+            break;
+    if (!pending) {
+        pending = zalloc(sizeof(*pending));
+        pending->path = strdup(path);
+        FATAL_ON(!pending->path, 2, "%s: strdup: %m", __func__);
+        SLIST_INSERT_HEAD(&g_storage_commit.files, pending, link);
+    }
+    if (timer_stopped(&g_storage_commit.timer))
+        timer_start_rel(NULL, &g_storage_commit.timer, g_storage_commit.timer.period_ms);
+}
+
 struct storage_parse_info *storage_open(const char *filename, const char *mode)
 {
+    char tmp_filename[PATH_MAX + 4];
     struct storage_parse_info *info;
 
     info = zalloc(sizeof(struct storage_parse_info));
     snprintf(info->filename, sizeof(info->filename), "%s", filename);
-    info->file = fopen(info->filename, mode);
+    info->table = storage_table_get_path(info->filename);
+    if (info->table)
+        return storage_table_open(info, mode);
+    storage_commit_flush_path(info->filename);
+    if (mode[0] == 'w' && !mode[1]) {
+        snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", info->filename);
+        info->file = fopen(tmp_filename, mode);
+        info->atomic = true;
+    } else {
+        info->file = fopen(info->filename, mode);
+    }
     if (!info->file) {
         free(info);
         return NULL;
@@ -71,13 +615,34 @@ struct storage_parse_info *storage_open_prefix(const char *filename, const char
 
 int storage_close(struct storage_parse_info *info)
 {
-    FILE *file;
+    int ret;
 
     BUG_ON(!info);
     BUG_ON(!info->file);
-    file = info->file;
+    ret = fclose(info->file);
+    if (info->atomic && !ret) {
+        if (info->sync && g_storage_commit.timer.period_ms) {
+            storage_commit_queue(info->filename);
+        } else {
+            storage_commit_file(info->filename, info->sync);
+            if (info->sync)
+                storage_sync_dir(info->filename);
+        }
+    }
+    if (info->table_write) {
+        storage_table_set(info->table, info->filename + strlen(g_storage_prefix),
+                          (uint8_t *)info->buf, info->buf_len);
+        if (info->table_sync && g_storage_commit.timer.period_ms) {
+            info->table->sync_pending = true;
+            if (timer_stopped(&g_storage_commit.timer))
+                timer_start_rel(NULL, &g_storage_commit.timer, g_storage_commit.timer.period_ms);
+        } else if (info->table_sync && fsync(info->table->fd)) {
+            WARN("%s: fsync %s: %m", __func__, info->table->path);
+        }
+    }
+    free(info->buf);
     free(info);
-    return fclose(file);
+    return ret;
 }
 
 static char *storage_get_line(struct storage_parse_info *info)
@@ -122,8 +687,38 @@ int storage_parse_line(struct storage_parse_info *info)
     return 0;
 }
 
+int storage_sync(struct storage_parse_info *info)
+{
+    if (fflush(info->file))
+        return -1;
+    // Table records are only written by storage_close()
+    if (info->table) {
+        info->table_sync = true;
+        return 0;
+    }
+    // Atomic files are synced before being renamed by storage_close()
+    if (info->atomic) {
+        info->sync = true;
+        return 0;
+    }
+    return fsync(fileno(info->file));
+}
+
+static void storage_table_delete(struct storage_table *table, const char *pattern)
+{
+    struct storage_record *rec, *tmp;
+
+    if (table->fd < 0)
+        storage_table_load(table);
+    for (int i = 0; i < ARRAY_SIZE(table->buckets); i++)
+        SLIST_FOREACH_SAFE(rec, &table->buckets[i], link, tmp)
+            if (!fnmatch(pattern, rec->key, 0))
+                storage_table_del(table, rec);
+}
+
 void storage_delete(const char *files[])
 {
+    struct storage_table *table;
     char filename[PATH_MAX];
     glob_t globbuf;
     int ret;
@@ -131,7 +726,10 @@ void storage_delete(const char *files[])
     if (!g_storage_prefix)
         return;
 
+    storage_commit_flush();
     for (; *files; files++) {
+        SLIST_FOREACH(table, &g_storage_tables, link)
+            storage_table_delete(table, *files);
         snprintf(filename, sizeof(filename), "%s%s", g_storage_prefix, *files);
         ret = glob(filename, 0, NULL, &globbuf);
         if (ret == GLOB_NOMATCH) {
@@ -141,9 +739,287 @@ void storage_delete(const char *files[])
             return;
         }
         for (int i = 0; globbuf.gl_pathv[i]; i++) {
+            // Table files are emptied above, but kept open
+            SLIST_FOREACH(table, &g_storage_tables, link)
+                if (!strcmp(globbuf.gl_pathv[i], table->path))
+                    break;
+            if (table)
+                continue;
             ret = unlink(globbuf.gl_pathv[i]);
             WARN_ON(ret < 0, "unlink %s: %m", globbuf.gl_pathv[i]);
         }
         globfree(&globbuf);
     }
 }
+
+char **storage_glob(const char *pattern)
+{
+    struct storage_table *table;
+    struct storage_record *rec;
+    char path[PATH_MAX];
+    char **files = NULL;
+    glob_t globbuf;
+    int count = 0;
+    size_t len;
+    int ret;
+
+    storage_commit_flush();
+    if (g_storage_prefix) {
+        SLIST_FOREACH(table, &g_storage_tables, link) {
+            if (table->fd < 0)
+                storage_table_load(table);
+            for (int i = 0; i < ARRAY_SIZE(table->buckets); i++) {
+                SLIST_FOREACH(rec, &table->buckets[i], link) {
+                    if (fnmatch(pattern, rec->key, 0))
+                        continue;
+                    files = reallocarray(files, count + 2, sizeof(*files));
+                    FATAL_ON(!files, 2, "%s: cannot allocate memory", __func__);
+                    ret = asprintf(&files[count++], "%s%s", g_storage_prefix, rec->key);
+                    FATAL_ON(ret < 0, 2, "%s: cannot allocate memory", __func__);
+                }
+            }
+        }
+        snprintf(path, sizeof(path), "%s%s", g_storage_prefix, pattern);
+        ret = glob(path, 0, NULL, &globbuf);
+        WARN_ON(ret && ret != GLOB_NOMATCH, "glob %s returned an error", path);
+        for (int i = 0; !ret && globbuf.gl_pathv[i]; i++) {
+            // Leftovers of a table migration, or table files
+            if (storage_table_get_path(globbuf.gl_pathv[i]))
+                continue;
+            // Leftovers of an interrupted write
+            len = strlen(globbuf.gl_pathv[i]);
+            if (len >= 4 && !strcmp(globbuf.gl_pathv[i] + len - 4, ".tmp"))
+                continue;
+            files = reallocarray(files, count + 2, sizeof(*files));
+            FATAL_ON(!files, 2, "%s: cannot allocate memory", __func__);
+            files[count++] = strdup(globbuf.gl_pathv[i]);
+            FATAL_ON(!files[count - 1], 2, "%s: cannot allocate memory", __func__);
+        }
+        if (!ret)
+            globfree(&globbuf);
+    }
+    if (!files)
+        files = xalloc(sizeof(*files));
+    files[count] = NULL;
+    return files;
+}
+
+void storage_globfree(char **files)
+{
+    for (int i = 0; files[i]; i++)
+        free(files[i]);
+    free(files);
+}
+
+bool storage_exists(const char *filename)
+{
+    struct storage_table *table;
+    char path[PATH_MAX];
+
+    if (!g_storage_prefix)
+        return false;
+    storage_commit_flush();
+    table = storage_table_get(filename);
+    if (table)
+        return storage_table_lookup(table, filename);
+    snprintf(path, sizeof(path), "%s%s", g_storage_prefix, filename);
+    return !access(path, F_OK);
+}
+
+/*
+ * The live storage (g_storage_prefix) can be kept in RAM, on a tmpfs, and be
+ * copied to a persistent snapshot prefix periodically and on exit. Only the
+ * files whose content changed are rewritten, each one atomically, and the
+ * snapshot directory is synced once. On start, the snapshot is copied back
+ * when the live storage is empty (ie. after a reboot). The data written since
+ * the last snapshot is lost on power loss.
+ */
+static struct {
+    char *prefix;
+    struct timer_entry timer;
+} g_storage_snapshot;
+
+static void storage_split(const char *prefix, char dirname[PATH_MAX], const char **basename)
+{
+    *basename = strrchr(prefix, '/');
+    *basename = *basename ? *basename + 1 : prefix;
+    snprintf(dirname, PATH_MAX, "%.*s", (int)(*basename - prefix), prefix);
+    if (!dirname[0])
+        strcpy(dirname, ".");
+}
+
+// Return true for the regular files stored under prefix, except the leftovers
+// of an interrupted write.
+static bool storage_dirent_match(const char *dirname, const char *basename,
+                                 const char *name, char path[PATH_MAX])
+{
+    size_t len = strlen(name);
+    struct stat st;
+
+    if (strncmp(name, basename, strlen(basename)))
+        return false;
+    if (len >= 4 && !strcmp(name + len - 4, ".tmp"))
+        return false;
+    snprintf(path, PATH_MAX, "%s/%s", dirname, name);
+    return !stat(path, &st) && S_ISREG(st.st_mode);
+}
+
+static uint8_t *storage_read_file(const char *path, size_t *len)
+{
+    struct stat st;
+    uint8_t *data;
+    ssize_t ret;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    data = xalloc(st.st_size + 1);
+    ret = pread(fd, data, st.st_size, 0);
+    close(fd);
+    if (ret != st.st_size) {
+        free(data);
+        return NULL;
+    }
+    *len = st.st_size;
+    return data;
+}
+
+// Return true if dst was rewritten
+static bool storage_copy_file(const char *src, const char *dst, bool sync)
+{
+    char tmp_path[PATH_MAX + 4];
+    uint8_t *data, *prev;
+    size_t len, prev_len;
+    bool ret = false;
+    int fd;
+
+    data = storage_read_file(src, &len);
+    if (!data) {
+        WARN("%s: read %s: %m", __func__, src);
+        return false;
+    }
+    prev = storage_read_file(dst, &prev_len);
+    if (prev && prev_len == len && !memcmp(prev, data, len))
+        goto out;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", dst);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || !storage_write_all(fd, data, len) || (sync && fsync(fd)) || rename(tmp_path, dst))
+        WARN("%s: write %s: %m", __func__, dst);
+    else
+        ret = true;
+    if (fd >= 0)
+        close(fd);
+out:
+    free(prev);
+    free(data);
+    return ret;
+}
+
+void storage_snapshot(void)
+{
+    char live_dir[PATH_MAX], snap_dir[PATH_MAX];
+    char src[PATH_MAX], dst[PATH_MAX];
+    const char *live_base, *snap_base;
+    struct dirent *dirent;
+    bool changed = false;
+    DIR *dir;
+
+    if (!g_storage_snapshot.prefix)
+        return;
+    storage_commit_flush();
+    storage_split(g_storage_prefix, live_dir, &live_base);
+    storage_split(g_storage_snapshot.prefix, snap_dir, &snap_base);
+
+    dir = opendir(live_dir);
+    if (!dir) {
+        WARN("%s: opendir %s: %m", __func__, live_dir);
+        return;
+    }
+    while ((dirent = readdir(dir))) {
+        if (!storage_dirent_match(live_dir, live_base, dirent->d_name, src))
+            continue;
+        snprintf(dst, sizeof(dst), "%s%s", g_storage_snapshot.prefix, dirent->d_name + strlen(live_base));
+        changed |= storage_copy_file(src, dst, true);
+    }
+    closedir(dir);
+
+    // Drop the files removed from the live storage since the last snapshot
+    dir = opendir(snap_dir);
+    if (!dir) {
+        WARN("%s: opendir %s: %m", __func__, snap_dir);
+        return;
+    }
+    while ((dirent = readdir(dir))) {
+        if (!storage_dirent_match(snap_dir, snap_base, dirent->d_name, dst))
+            continue;
+        snprintf(src, sizeof(src), "%s%s", g_storage_prefix, dirent->d_name + strlen(snap_base));
+        if (!access(src, F_OK))
+            continue;
+        if (unlink(dst) < 0)
+            WARN("%s: unlink %s: %m", __func__, dst);
+        else
+            changed = true;
+    }
+    closedir(dir);
+
+    if (changed)
+        storage_sync_dir(dst);
+}
+
+static void storage_snapshot_restore(void)
+{
+    char live_dir[PATH_MAX], snap_dir[PATH_MAX];
+    char src[PATH_MAX], dst[PATH_MAX];
+    const char *live_base, *snap_base;
+    struct dirent *dirent;
+    int count = 0;
+    DIR *dir;
+
+    storage_split(g_storage_prefix, live_dir, &live_base);
+    storage_split(g_storage_snapshot.prefix, snap_dir, &snap_base);
+
+    // The live storage survives a restart of wsbrd, and is then more recent
+    dir = opendir(live_dir);
+    FATAL_ON(!dir, 1, "opendir %s: %m", live_dir);
+    while ((dirent = readdir(dir)))
+        if (storage_dirent_match(live_dir, live_base, dirent->d_name, dst))
+            break;
+    closedir(dir);
+    if (dirent)
+        return;
+
+    dir = opendir(snap_dir);
+    FATAL_ON(!dir, 1, "opendir %s: %m", snap_dir);
+    while ((dirent = readdir(dir))) {
+        if (!storage_dirent_match(snap_dir, snap_base, dirent->d_name, src))
+            continue;
+        snprintf(dst, sizeof(dst), "%s%s", g_storage_prefix, dirent->d_name + strlen(snap_base));
+        count += storage_copy_file(src, dst, false);
+    }
+    closedir(dir);
+    if (count)
+        INFO("restored %d files from %s", count, g_storage_snapshot.prefix);
+}
+
+static void storage_snapshot_timer_cb(struct timer_group *group, struct timer_entry *timer)
+{
+    storage_snapshot();
+}
+
+void storage_snapshot_init(const char *snapshot_prefix, uint64_t interval_ms)
+{
+    BUG_ON(!g_storage_prefix);
+    BUG_ON(g_storage_snapshot.prefix);
+    g_storage_snapshot.prefix = strdup(snapshot_prefix);
+    FATAL_ON(!g_storage_snapshot.prefix, 2, "%s: strdup: %m", __func__);
+    storage_snapshot_restore();
+    g_storage_snapshot.timer.period_ms = interval_ms;
+    g_storage_snapshot.timer.callback  = storage_snapshot_timer_cb;
+    if (interval_ms)
+        timer_start_rel(NULL, &g_storage_snapshot.timer, interval_ms);
+}
@@ -18,12 +18,21 @@
  * Helpers to read and write configuration files. A configuration files a series
  * of key/values assignments with possible comments.
  *
+ * Files under g_storage_prefix whose name starts with a prefix registered with
+ * storage_table_add() are not stored individually, but as records of a single
+ * table file (see key_value_storage.c). This is transparent for the users of
+ * storage_open() and storage_close(), but the storage must then be listed with
+ * storage_glob() and storage_exists() instead of glob() and access().
+ *
  * All the data is provided by struct storage_parse_info. Fields file and
  * filename are filled by storage_open() (and storage_open_prefix()). These
  * fields are sufficient for write access.
  *
  * If storage_open() fail, error can be read from errno.
  *
+ * Files opened with mode "w" are written atomically: the previous content is
+ * replaced by storage_close(), so it is never seen truncated.
+ *
  * To parse an existing file, parse_line() can be called until it returns EOF
  * (= -1). Function storage_parse_line() fills storage_parse_info with the
  * key/value couple it find. If a parse error happens, it returns < -1.
@@ -33,6 +42,8 @@
  * key_array_index value is UINT_MAX)
  */
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <limits.h>
 
@@ -43,6 +54,16 @@ struct storage_parse_info {
     char line[256];
     char key[256], value[256];
     unsigned int key_array_index;
+
+    // Private fields, used for files written to a temporary file
+    bool atomic;
+    bool sync;
+    // Private fields, used for files stored in a table
+    struct storage_table *table;
+    bool table_write;
+    bool table_sync;
+    char *buf;
+    size_t buf_len;
 };
 
 extern const char *g_storage_prefix;
@@ -53,5 +74,35 @@ struct storage_parse_info *storage_open_prefix(const char *filename, const char
 int storage_close(struct storage_parse_info *file);
 int storage_parse_line(struct storage_parse_info *file);
 void storage_delete(const char *files[]);
+// Make sure the data written to info is on disk once storage_close() returns,
+// or once the commit window expires if one is set.
+int storage_sync(struct storage_parse_info *info);
+// Batch the fsync() of the synced files: they are committed together, with a
+// single fsync() of their directory, window_ms after the first of them is
+// written. 0 (default) disables it.
+void storage_commit_window(uint64_t window_ms);
+// Commit the pending files now. Must be called before exiting, otherwise the
+// files written during the last window are lost.
+void storage_commit_flush(void);
+// Use g_storage_prefix as a live storage, typically on a tmpfs, which is
+// copied to snapshot_prefix every interval_ms (0 disables the timer). The
+// snapshot is restored if the live storage is empty. Must be called after
+// g_storage_prefix is set, before the storage is accessed.
+void storage_snapshot_init(const char *snapshot_prefix, uint64_t interval_ms);
+// Copy the live storage to the snapshot now, after committing the pending
+// files. Must be called before exiting. Does nothing without a snapshot.
+void storage_snapshot(void);
+
+// Store every file starting with prefix (eg. "rpl-") in the table file
+// <prefix>.db (eg. "rpl.db"). Existing files are moved to the table when it is
+// created. Must be called after g_storage_prefix is set.
+void storage_table_add(const char *prefix);
+// Return a NULL-terminated list of the full paths of the stored files matching
+// pattern (relative to g_storage_prefix, see fnmatch()). The paths can be
+// passed to storage_open().
+char **storage_glob(const char *pattern);
+void storage_globfree(char **files);
+// filename is relative to g_storage_prefix.
+bool storage_exists(const char *filename);
 
 #endif
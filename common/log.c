@@ -11,7 +11,13 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <endian.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -22,12 +28,21 @@
 #include "common/crypto/ws_keys.h"
 #include "common/mbedtls_extra.h"
 #include "common/bits.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
 
 #include "log.h"
 
 FILE *g_trace_stream = NULL;
 unsigned int g_enabled_traces = 0;
 bool g_enable_color_traces = true;
+struct tr_ratelimit_cfg g_trace_ratelimit_cfg[32] = { };
+struct tr_ratelimit_cfg g_warn_ratelimit_cfg = { };
+unsigned int g_trace_ratelimited = 0;
+uint64_t g_log_journal_dropped = 0;
+
+static int g_log_journal_fd = -1;
+static uint64_t g_log_journal_dropped_pending = 0;
 
 char *str_bytes(const void *in_start, size_t in_len, const void **in_done, char *out_start, size_t out_len, int opt)
 {
@@ -170,6 +185,19 @@ static __thread int trace_idx = 0;
  */
 static __thread int trace_nested_counter = 0;
 
+/*
+ * Structured fields of the message being printed, only recorded when logging
+ * to journald: the TR_* category of TRACE() and the addresses formatted with
+ * tr_eui64() and tr_ipv6().
+ */
+#define TRACE_FIELDS_MAX 4
+static __thread struct {
+    const char *key;
+    const char *val;
+} trace_fields[TRACE_FIELDS_MAX];
+static __thread int trace_fields_len = 0;
+static __thread unsigned int trace_category = 0;
+
 void __tr_enter()
 {
     trace_nested_counter++;
@@ -178,12 +206,207 @@ void __tr_enter()
 void __tr_exit()
 {
     trace_nested_counter--;
-    if (!trace_nested_counter)
+    if (!trace_nested_counter) {
         trace_idx = 0;
+        trace_fields_len = 0;
+        trace_category = 0;
+    }
+}
+
+void __tr_set_category(unsigned int cond)
+{
+    trace_category = cond;
+}
+
+static void tr_field_add(const char *key, const char *val)
+{
+    if (g_log_journal_fd < 0 || trace_fields_len >= TRACE_FIELDS_MAX)
+        return;
+    trace_fields[trace_fields_len].key = key;
+    trace_fields[trace_fields_len].val = val;
+    trace_fields_len++;
+}
+
+// Returns the number of messages suppressed since the previous one, or -1 if
+// this message must be dropped.
+static int tr_ratelimit(struct tr_ratelimit *state, const struct tr_ratelimit_cfg *cfg)
+{
+    uint64_t now_ms, tokens;
+    struct timespec tp;
+    int suppressed;
+
+    if (cfg->sample > 1 && state->sample_cnt++ % cfg->sample)
+        return -1;
+    if (!cfg->rate)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    now_ms = tp.tv_sec * 1000 + tp.tv_nsec / 1000000;
+    if (state->last_ms)
+        tokens = state->tokens + (now_ms - state->last_ms) * cfg->rate;
+    else
+        tokens = (uint64_t)cfg->rate * 1000;
+    state->tokens = MIN(tokens, (uint64_t)cfg->rate * 1000);
+    state->last_ms = now_ms;
+    if (state->tokens < 1000) {
+        state->suppressed++;
+        return -1;
+    }
+    state->tokens -= 1000;
+    suppressed = state->suppressed;
+    state->suppressed = 0;
+    return suppressed;
+}
+
+bool __tr_ratelimit_trace(struct tr_ratelimit *state, unsigned int cond, const char *file, int line)
+{
+    const struct tr_ratelimit_cfg *cfg;
+    int suppressed;
+
+    cfg = &g_trace_ratelimit_cfg[__builtin_ctz(cond & g_trace_ratelimited)];
+    suppressed = tr_ratelimit(state, cfg);
+    if (suppressed < 0)
+        return false;
+    if (suppressed && g_trace_ring)
+        trace_ring_printf("%s:%d: %d messages suppressed", file, line, suppressed);
+    else if (suppressed)
+        __PRINT_WITH_TIME(90, "%s:%d: %d messages suppressed", file, line, suppressed);
+    return true;
+}
+
+bool __tr_ratelimit_warn(struct tr_ratelimit *state, const char *file, int line)
+{
+    int suppressed;
+
+    suppressed = tr_ratelimit(state, &g_warn_ratelimit_cfg);
+    if (suppressed < 0)
+        return false;
+    if (suppressed)
+        __PRINT(93, "warning: %s:%d: %d messages suppressed", file, line, suppressed);
+    return true;
+}
+
+int log_journal_open(void)
+{
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+        .sun_path   = "/run/systemd/journal/socket",
+    };
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -errno;
+    }
+    g_log_journal_fd = fd;
+    return 0;
+}
+
+static const char *tr_category_str(unsigned int cond)
+{
+    static const char *names[32] = {
+        [__builtin_ctz(TR_BUS)]        = "bus",
+        [__builtin_ctz(TR_CPC)]        = "cpc",
+        [__builtin_ctz(TR_HIF)]        = "hif",
+        [__builtin_ctz(TR_HIF_EXTRA)]  = "hif-extra",
+        [__builtin_ctz(TR_TUN)]        = "tun",
+        [__builtin_ctz(TR_TIMERS)]     = "timers",
+        [__builtin_ctz(TR_TRICKLE)]    = "trickle",
+        [__builtin_ctz(TR_15_4_MNGT)]  = "15.4-mngt",
+        [__builtin_ctz(TR_15_4_DATA)]  = "15.4",
+        [__builtin_ctz(TR_EAP)]        = "eap",
+        [__builtin_ctz(TR_ICMP)]       = "icmp",
+        [__builtin_ctz(TR_DHCP)]       = "dhcp",
+        [__builtin_ctz(TR_RPL)]        = "rpl",
+        [__builtin_ctz(TR_IPV6)]       = "ipv6",
+        [__builtin_ctz(TR_QUEUE)]      = "queue",
+        [__builtin_ctz(TR_DROP)]       = "drop",
+        [__builtin_ctz(TR_TX_ABORT)]   = "tx-abort",
+        [__builtin_ctz(TR_IGNORE)]     = "ignore",
+        [__builtin_ctz(TR_NEIGH_15_4)] = "neigh-15.4",
+        [__builtin_ctz(TR_NEIGH_IPV6)] = "neigh-ipv6",
+        [__builtin_ctz(TR_SECURITY)]   = "security",
+        [__builtin_ctz(TR_MBEDTLS)]    = "mbedtls",
+    };
+    const char *name = names[__builtin_ctz(cond)];
+
+    return name ? name : "unknown";
+}
+
+// Priorities of syslog(3), deduced from the color used by the macros
+static int tr_priority(const char *color)
+{
+    if (!strcmp(color, "91"))
+        return 2; // LOG_CRIT
+    if (!strcmp(color, "31"))
+        return 3; // LOG_ERR
+    if (!strcmp(color, "93"))
+        return 4; // LOG_WARNING
+    if (!strcmp(color, "90") || !strcmp(color, "94"))
+        return 7; // LOG_DEBUG
+    return 6; // LOG_INFO
+}
+
+/*
+ * Native protocol of journald (see systemd.journal-fields(7)): one datagram
+ * per message, made of KEY=value lines. MESSAGE uses the binary form (key,
+ * newline, le64 length, value) so it may contain any character. The socket is
+ * non-blocking: if journald cannot keep up, messages are dropped instead of
+ * stalling the caller, and the drop count is attached to the next message.
+ */
+static void tr_journal_vprintf(const char *color, const char *fmt, va_list ap)
+{
+    char hdr[256 + TRACE_FIELDS_MAX * 64];
+    struct msghdr msghdr = { };
+    struct iovec iov[4];
+    char msg[1024];
+    uint64_t len_le;
+    int hdr_len;
+    int len;
+
+    len = vsnprintf(msg, sizeof(msg), fmt, ap);
+    len = MAX(MIN(len, (int)sizeof(msg) - 1), 0);
+    hdr_len = snprintf(hdr, sizeof(hdr), "PRIORITY=%d\nSYSLOG_IDENTIFIER=%s\n",
+                       tr_priority(color ? color : "0"), program_invocation_short_name);
+    if (trace_category)
+        hdr_len += snprintf(hdr + hdr_len, sizeof(hdr) - hdr_len, "TRACE_CATEGORY=%s\n",
+                            tr_category_str(trace_category));
+    if (g_log_journal_dropped_pending)
+        hdr_len += snprintf(hdr + hdr_len, sizeof(hdr) - hdr_len, "LOG_DROPPED=%"PRIu64"\n",
+                            g_log_journal_dropped_pending);
+    for (int i = 0; i < trace_fields_len; i++)
+        hdr_len += snprintf(hdr + hdr_len, sizeof(hdr) - hdr_len, "%s=%s\n",
+                            trace_fields[i].key, trace_fields[i].val);
+    BUG_ON(hdr_len >= sizeof(hdr));
+    len_le = htole64(len);
+    // The terminating NUL is replaced by the final newline
+    msg[len] = '\n';
+    iov[0].iov_base = hdr;
+    iov[0].iov_len  = hdr_len;
+    iov[1].iov_base = "MESSAGE\n";
+    iov[1].iov_len  = strlen("MESSAGE\n");
+    iov[2].iov_base = &len_le;
+    iov[2].iov_len  = sizeof(len_le);
+    iov[3].iov_base = msg;
+    iov[3].iov_len  = len + 1;
+    msghdr.msg_iov    = iov;
+    msghdr.msg_iovlen = ARRAY_SIZE(iov);
+    if (sendmsg(g_log_journal_fd, &msghdr, MSG_NOSIGNAL) < 0) {
+        g_log_journal_dropped_pending++;
+        g_log_journal_dropped++;
+    } else {
+        g_log_journal_dropped_pending = 0;
+    }
 }
 
 void __tr_vprintf(const char *color, const char *fmt, va_list ap)
 {
+    if (g_log_journal_fd >= 0) {
+        tr_journal_vprintf(color, fmt, ap);
+        return;
+    }
     if (!g_trace_stream) {
         g_trace_stream = stdout;
         setlinebuf(stdout);
@@ -245,6 +468,7 @@ const char *tr_eui64(const uint8_t in[8])
     str_eui64(in, out);
     trace_idx += strlen(out) + 1;
     BUG_ON(trace_idx > sizeof(trace_buffer));
+    tr_field_add("EUI64", out);
     return out;
 }
 
@@ -271,6 +495,7 @@ const char *tr_ipv6(const uint8_t in[16])
     str_ipv6(in, out);
     trace_idx += strlen(out) + 1;
     BUG_ON(trace_idx > sizeof(trace_buffer));
+    tr_field_add("IPV6", out);
     return out;
 }
 
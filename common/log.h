@@ -22,6 +22,7 @@
 #include <time.h>
 
 #include "common/backtrace_show.h"
+#include "common/trace_ring.h"
 
 /*
  * Use BUG() and BUG_ON() in the same ways than assert(). Consider this
@@ -54,7 +55,8 @@
  *
  * Use TRACE() to provide debug traces in final code. TRACE() is always
  * conditional. The user have to set g_enabled_traces to make some traces
- * appear.
+ * appear. If g_trace_ring is set, traces are recorded in binary form instead
+ * of being printed (see common/trace_ring.h).
  *
  * BUG_ON(), FATAL_ON(), ERROR_ON() and WARN_ON(), allow to keep error handling
  * small enough. However, as soon as you add a description of the error, the
@@ -71,6 +73,42 @@ extern FILE *g_trace_stream;
 extern unsigned int g_enabled_traces;
 extern bool g_enable_color_traces;
 
+/*
+ * Once log_journal_open() succeeds, messages are sent to journald through its
+ * native socket instead of g_trace_stream, with structured fields: PRIORITY,
+ * TRACE_CATEGORY for TRACE(), and EUI64 and IPV6 for the addresses formatted
+ * with tr_eui64() and tr_ipv6(). The socket never blocks: messages which do not
+ * fit in its queue are dropped and counted in g_log_journal_dropped, and the
+ * next delivered message carries a LOG_DROPPED field. Returns -errno on error.
+ */
+int log_journal_open(void);
+extern uint64_t g_log_journal_dropped;
+
+/*
+ * Each TRACE() and WARN() call site can be rate limited with a token bucket
+ * (rate messages per second, with bursts of the same size) and/or sampled
+ * (only 1 message out of sample is kept). Both are configured per trace
+ * category. When messages are dropped by the rate limit, their count is
+ * reported with the next message that goes through.
+ */
+struct tr_ratelimit_cfg {
+    unsigned int rate;   // 0 for unlimited
+    unsigned int sample; // 0 or 1 to keep every message
+};
+
+struct tr_ratelimit {
+    uint64_t last_ms;
+    uint32_t tokens; // In thousandths of message
+    uint32_t suppressed;
+    uint32_t sample_cnt;
+};
+
+// Indexed by the bit number of the TR_* value
+extern struct tr_ratelimit_cfg g_trace_ratelimit_cfg[32];
+extern struct tr_ratelimit_cfg g_warn_ratelimit_cfg;
+// TR_* categories with a non-zero entry in g_trace_ratelimit_cfg
+extern unsigned int g_trace_ratelimited;
+
 enum {
     TR_BUS        = 0x00000001,
     TR_CPC        = 0x00000004,
@@ -149,6 +187,9 @@ const char *tr_gtkname(uint8_t slot);
 
 void __tr_enter();
 void __tr_exit();
+void __tr_set_category(unsigned int cond);
+bool __tr_ratelimit_trace(struct tr_ratelimit *state, unsigned int cond, const char *file, int line);
+bool __tr_ratelimit_warn(struct tr_ratelimit *state, const char *file, int line);
 __attribute__ ((format(printf, 2, 3)))
 void __tr_printf(const char *color, const char *fmt, ...);
 __attribute__ ((format(printf, 2, 0)))
@@ -156,14 +197,24 @@ void __tr_vprintf(const char *color, const char *fmt, va_list ap);
 
 #define __TRACE(COND, MSG, ...) \
     do {                                                             \
-        if (g_enabled_traces & (COND)) {                             \
-            if (MSG[0] != '\0')                                      \
+        static struct tr_ratelimit __rl;                             \
+                                                                     \
+        if ((g_enabled_traces & (COND)) &&                           \
+            __TRACE_RATELIMITED(&__rl, COND)) {                      \
+            __tr_set_category(COND);                                 \
+            if (g_trace_ring)                                        \
+                __RECORD(MSG, ##__VA_ARGS__);                        \
+            else if (MSG[0] != '\0')                                 \
                 __PRINT_WITH_TIME(90, MSG, ##__VA_ARGS__);           \
             else                                                     \
                 __PRINT_WITH_TIME(90, "%s:%d", __FILE__, __LINE__);  \
         }                                                            \
     } while (0)
 
+#define __TRACE_RATELIMITED(STATE, COND) \
+    (!(g_trace_ratelimited & (COND)) ||                              \
+     __tr_ratelimit_trace(STATE, COND, __FILE__, __LINE__))
+
 #define __DEBUG(MSG, ...) \
     do {                                                             \
         if (MSG[0] != '\0')                                          \
@@ -179,6 +230,10 @@ void __tr_vprintf(const char *color, const char *fmt, va_list ap);
 
 #define __WARN(MSG, ...) \
     do {                                                             \
+        static struct tr_ratelimit __rl;                             \
+                                                                     \
+        if (!__WARN_RATELIMITED(&__rl))                              \
+            break;                                                   \
         if (MSG[0] != '\0')                                          \
             __PRINT(93, "warning: " MSG, ##__VA_ARGS__);             \
         else                                                         \
@@ -187,8 +242,9 @@ void __tr_vprintf(const char *color, const char *fmt, va_list ap);
 
 #define __WARN_ON(COND, MSG, ...) \
     ({                                                               \
+        static struct tr_ratelimit __rl;                             \
         bool __ret = (COND);                                         \
-        if (__ret) {                                                 \
+        if (__ret && __WARN_RATELIMITED(&__rl)) {                    \
             if (MSG[0] != '\0')                                      \
                 __PRINT(93, "warning: " MSG, ##__VA_ARGS__);         \
             else                                                     \
@@ -197,6 +253,10 @@ void __tr_vprintf(const char *color, const char *fmt, va_list ap);
         __ret;                                                       \
     })
 
+#define __WARN_RATELIMITED(STATE) \
+    ((!g_warn_ratelimit_cfg.rate && g_warn_ratelimit_cfg.sample <= 1) || \
+     __tr_ratelimit_warn(STATE, __FILE__, __LINE__))
+
 #define __ERROR(MSG, ...) \
     do {                                                             \
         if (MSG[0] != '\0')                                          \
@@ -268,6 +328,16 @@ void __tr_vprintf(const char *color, const char *fmt, va_list ap);
         __tr_exit();                                                 \
     } while(0)
 
+#define __RECORD(MSG, ...) \
+    do {                                                             \
+        __tr_enter();                                                \
+        if (MSG[0] != '\0')                                          \
+            trace_ring_printf(MSG, ##__VA_ARGS__);                   \
+        else                                                         \
+            trace_ring_printf("%s:%d", __FILE__, __LINE__);          \
+        __tr_exit();                                                 \
+    } while(0)
+
 #define __PRINT_WITH_TIME(COLOR, MSG, ...) \
     do {                                                             \
         struct timespec tp;                                          \
@@ -30,6 +30,7 @@
 #include <mbedtls/md.h>
 #include <mbedtls/md5.h>
 #include <mbedtls/pem.h>
+#include <mbedtls/sha1.h>
 #include <mbedtls/sha256.h>
 #include <mbedtls/ssl.h>
 
@@ -57,10 +58,14 @@ static inline const unsigned char *mbedtls_pem_get_buffer(mbedtls_pem_context *c
 #define xmbedtls_md_hmac_starts(ctx, key, keylen)                   XMBEDTLS(md_hmac_starts, ctx, key, keylen)
 #define xmbedtls_md_hmac_update(ctx, input, ilen)                   XMBEDTLS(md_hmac_update, ctx, input, ilen)
 #define xmbedtls_md_hmac_finish(ctx, output)                        XMBEDTLS(md_hmac_finish, ctx, output)
+#define xmbedtls_md_hmac_reset(ctx)                                 XMBEDTLS(md_hmac_reset, ctx)
 #define xmbedtls_md_hmac(md_info, key, keylen, input, ilen, output) XMBEDTLS(md_hmac, md_info, key, keylen, input, ilen, output)
 #define xmbedtls_md5_starts(ctx)                                    XMBEDTLS(md5_starts, ctx)
 #define xmbedtls_md5_update(ctx, input, ilen)                       XMBEDTLS(md5_update, ctx, input, ilen)
 #define xmbedtls_md5_finish(ctx, output)                            XMBEDTLS(md5_finish, ctx, output)
+#define xmbedtls_sha1_starts(ctx)                                   XMBEDTLS(sha1_starts, ctx)
+#define xmbedtls_sha1_update(ctx, input, ilen)                      XMBEDTLS(sha1_update, ctx, input, ilen)
+#define xmbedtls_sha1_finish(ctx, output)                           XMBEDTLS(sha1_finish, ctx, output)
 #define xmbedtls_sha256_starts(ctx, is224)                          XMBEDTLS(sha256_starts, ctx, is224)
 #define xmbedtls_sha256_update(ctx, input, ilen)                    XMBEDTLS(sha256_update, ctx, input, ilen)
 #define xmbedtls_sha256_finish(ctx, output)                         XMBEDTLS(sha256_finish, ctx, output)
@@ -14,6 +14,7 @@
 #define _DEFAULT_SOURCE
 #include <endian.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "common/log.h"
 
@@ -40,6 +41,20 @@ void pktbuf_init(struct pktbuf *pktbuf, const void *buf, size_t buf_len)
     pktbuf_push_tail(pktbuf, buf, buf_len);
 }
 
+void pktbuf_init_headroom(struct pktbuf *pktbuf, size_t headroom, const void *buf, size_t buf_len)
+{
+    pktbuf_free(pktbuf);
+    pktbuf->buf_len = headroom + buf_len;
+    pktbuf->buf = malloc(pktbuf->buf_len);
+    FATAL_ON(!pktbuf->buf, 2, "%s: malloc %zu: %m", __func__, pktbuf->buf_len);
+    pktbuf->offset_head = headroom;
+    pktbuf->offset_tail = headroom + buf_len;
+    if (buf)
+        memcpy(pktbuf_head(pktbuf), buf, buf_len);
+    else
+        memset(pktbuf_head(pktbuf), 0, buf_len);
+}
+
 void pktbuf_free(struct pktbuf *pktbuf)
 {
     free(pktbuf->buf);
@@ -63,6 +78,14 @@ static void pktbuf_extend_head(struct pktbuf *pktbuf, size_t len)
     pktbuf->offset_tail += len;
 }
 
+void pktbuf_reserve_head(struct pktbuf *pktbuf, size_t len)
+{
+    if (pktbuf->err)
+        return;
+    if (pktbuf_len_head(pktbuf) < len)
+        pktbuf_extend_head(pktbuf, len - pktbuf_len_head(pktbuf));
+}
+
 void pktbuf_push_head(struct pktbuf *pktbuf, const void *buf, size_t buf_len)
 {
     if (pktbuf->err)
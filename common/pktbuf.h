@@ -46,6 +46,11 @@ static inline size_t pktbuf_len(const struct pktbuf *pktbuf)
 }
 
 void pktbuf_init(struct pktbuf *pktbuf, const void *buf, size_t buf_len);
+// Same as pktbuf_init(), but leave headroom bytes before the data so that
+// headers can later be pushed without reallocating and moving the data.
+void pktbuf_init_headroom(struct pktbuf *pktbuf, size_t headroom, const void *buf, size_t buf_len);
+// Ensure at least len bytes are available before the data.
+void pktbuf_reserve_head(struct pktbuf *pktbuf, size_t len);
 void pktbuf_free(struct pktbuf *pktbuf);
 
 // Use buf = NULL to reserve bytes (0-init)
@@ -15,19 +15,110 @@
  */
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <limits.h>
 
 #include "common/capture.h"
 #include "common/int24.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 
 #include "rand.h"
 
+/*
+ * The scalar helpers below are used for jitter, Trickle intervals, sequence
+ * numbers... on most of the events processed, and a getrandom() syscall for
+ * each of them is expensive. They are instead served from a ChaCha20
+ * keystream, reseeded from xgetrandom() every RAND_RESEED_BLOCKS blocks.
+ * rand_get_n_bytes_random() still calls xgetrandom() directly since it is
+ * used for keys and nonces.
+ *
+ * The seed is read 8 bytes at a time: tools/fuzz only substitutes predictable
+ * values to larger requests (assumed to be keys), smaller ones still go
+ * through the capture, so a replay gets the same keystream.
+ *
+ * The state is per thread, a few workers (UART, TLS) may use these helpers.
+ */
+#define RAND_RESEED_BLOCKS (1 << 14) // 1 MiB of keystream
+
+static __thread struct {
+    uint32_t key[8];
+    uint64_t counter;
+    uint32_t block[16];
+    uint8_t  block_offset;
+} g_rand_drbg = { .block_offset = sizeof(g_rand_drbg.block) };
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA20_QR(a, b, c, d) do {                  \
+    a += b; d ^= a; d = ROTL32(d, 16);                \
+    c += d; b ^= c; b = ROTL32(b, 12);                \
+    a += b; d ^= a; d = ROTL32(d,  8);                \
+    c += d; b ^= c; b = ROTL32(b,  7);                \
+} while (0)
+
+// RFC 8439 2.3, with a null nonce and a 64-bit block counter
+static void rand_chacha20_block(const uint32_t key[8], uint64_t counter, uint32_t out[16])
+{
+    uint32_t x[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        (uint32_t)counter, (uint32_t)(counter >> 32), 0, 0,
+    };
+
+    memcpy(out, x, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        CHACHA20_QR(x[0], x[4], x[ 8], x[12]);
+        CHACHA20_QR(x[1], x[5], x[ 9], x[13]);
+        CHACHA20_QR(x[2], x[6], x[10], x[14]);
+        CHACHA20_QR(x[3], x[7], x[11], x[15]);
+        CHACHA20_QR(x[0], x[5], x[10], x[15]);
+        CHACHA20_QR(x[1], x[6], x[11], x[12]);
+        CHACHA20_QR(x[2], x[7], x[ 8], x[13]);
+        CHACHA20_QR(x[3], x[4], x[ 9], x[14]);
+    }
+    for (int i = 0; i < 16; i++)
+        out[i] += x[i];
+}
+
+static void rand_drbg_reseed(void)
+{
+    uint8_t *key = (uint8_t *)g_rand_drbg.key;
+    int ret;
+
+    for (int i = 0; i < sizeof(g_rand_drbg.key); i += 8) {
+        ret = xgetrandom(key + i, 8, 0);
+        FATAL_ON(ret != 8, 2);
+    }
+    g_rand_drbg.counter = 0;
+}
+
+static void rand_drbg_get(void *ptr, size_t count)
+{
+    uint8_t *out = ptr;
+    size_t len;
+
+    while (count) {
+        if (g_rand_drbg.block_offset == sizeof(g_rand_drbg.block)) {
+            if (g_rand_drbg.counter % RAND_RESEED_BLOCKS == 0)
+                rand_drbg_reseed();
+            rand_chacha20_block(g_rand_drbg.key, g_rand_drbg.counter++, g_rand_drbg.block);
+            g_rand_drbg.block_offset = 0;
+        }
+        len = MIN(count, sizeof(g_rand_drbg.block) - g_rand_drbg.block_offset);
+        memcpy(out, (uint8_t *)g_rand_drbg.block + g_rand_drbg.block_offset, len);
+        // Consumed keystream is not kept in memory
+        memset((uint8_t *)g_rand_drbg.block + g_rand_drbg.block_offset, 0, len);
+        g_rand_drbg.block_offset += len;
+        out   += len;
+        count -= len;
+    }
+}
+
 uint8_t rand_get_8bit(void)
 {
     uint8_t result;
 
-    rand_get_n_bytes_random(&result, sizeof(result));
+    rand_drbg_get(&result, sizeof(result));
     return result;
 }
 
@@ -35,7 +126,7 @@ uint16_t rand_get_16bit(void)
 {
     uint16_t result;
 
-    rand_get_n_bytes_random(&result, sizeof(result));
+    rand_drbg_get(&result, sizeof(result));
     return result;
 }
 
@@ -48,7 +139,7 @@ uint32_t rand_get_32bit(void)
 {
     uint32_t result;
 
-    rand_get_n_bytes_random(&result, sizeof(result));
+    rand_drbg_get(&result, sizeof(result));
     return result;
 }
 
@@ -56,7 +147,7 @@ uint64_t rand_get_64bit(void)
 {
     uint64_t result;
 
-    rand_get_n_bytes_random(&result, sizeof(result));
+    rand_drbg_get(&result, sizeof(result));
     return result;
 }
 
@@ -19,6 +19,9 @@
 
 /*
  * Helpers around getrandom().
+ *
+ * Only rand_get_n_bytes_random() is suitable for keys and nonces, the other
+ * helpers use a buffered generator seeded from getrandom().
  */
 
 uint8_t rand_get_8bit(void);
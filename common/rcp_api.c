@@ -11,6 +11,7 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <assert.h>
 #include <poll.h>
 
 #include "common/ws/ws_neigh.h"
@@ -19,13 +20,17 @@
 #include "common/bus_cpc.h"
 #include "common/bits.h"
 #include "common/capture.h"
+#include "common/crc.h"
 #include "common/endian.h"
 #include "common/hif.h"
 #include "common/iobuf.h"
+#include "common/key_value_storage.h"
 #include "common/log.h"
 #include "common/mathutils.h"
 #include "common/memutils.h"
+#include "common/parsers.h"
 #include "common/string_extra.h"
+#include "common/time_extra.h"
 #include "common/version.h"
 #include "common/specs/ws.h"
 
@@ -37,9 +42,61 @@ uint8_t rcp_rx_buf[4096];
 // [...] the minimum and maximum values are 0 (–174 dBm) and 254 (80 dBm)
 #define RX_POWER_DBM_MAX 80
 
+// Margin added to the highest frame counter confirmed by the RCP when the keys
+// are restored, to cover the frames transmitted but not yet confirmed when it
+// reset.
+#define RCP_RESTORE_FRAME_COUNTER_MARGIN 4096
+
+// Index in rcp->cfg_cache, -1 if the command is not part of the configuration
+static int rcp_cfg_slot(const uint8_t *data, size_t len)
+{
+    static const uint8_t cmds[] = {
+        HIF_CMD_SET_RADIO_REGULATION,
+        HIF_CMD_SET_RADIO,
+        HIF_CMD_SET_RADIO_TX_POWER,
+        HIF_CMD_SET_FHSS_UC,
+        HIF_CMD_SET_FHSS_FFN_BC,
+        HIF_CMD_SET_FHSS_LFN_BC,
+        HIF_CMD_SET_FHSS_ASYNC,
+        HIF_CMD_SET_FILTER_PANID,
+        HIF_CMD_SET_FILTER_SRC64,
+        HIF_CMD_SET_FILTER_DST64,
+        HIF_CMD_REQ_RADIO_ENABLE,
+        HIF_CMD_SET_SEC_KEY, // Followed by one slot per key
+    };
+
+    static_assert(ARRAY_SIZE(cmds) - 1 + HIF_KEY_COUNT == RCP_CFG_CACHE_LEN, "out-of-date cache");
+    for (int i = 0; i < ARRAY_SIZE(cmds); i++) {
+        if (cmds[i] != data[0])
+            continue;
+        if (data[0] != HIF_CMD_SET_SEC_KEY)
+            return i;
+        BUG_ON(len < 2 || data[1] < 1 || data[1] > HIF_KEY_COUNT);
+        return i + data[1] - 1;
+    }
+    return -1;
+}
+
+static void rcp_cfg_cache_store(struct rcp *rcp, const uint8_t *data, size_t len)
+{
+    struct rcp_cfg_cache *entry;
+    int slot;
+
+    slot = rcp_cfg_slot(data, len);
+    if (slot < 0)
+        return;
+    entry = &rcp->cfg_cache[slot];
+    free(entry->data);
+    entry->data = xalloc(len);
+    memcpy(entry->data, data, len);
+    entry->len = len;
+    entry->seq = ++rcp->cfg_seq;
+}
+
 static void rcp_tx(struct rcp *rcp, struct iobuf_write *buf)
 {
     BUG_ON(!buf->len);
+    rcp_cfg_cache_store(rcp, buf->data, buf->len);
     TRACE(TR_HIF, "hif tx: %s %s", hif_cmd_str(buf->data[0]),
           tr_bytes(buf->data + 1, buf->len - 1,
                    NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
@@ -53,7 +110,7 @@ static void rcp_ind_nop(struct rcp *rcp, struct iobuf_read *buf)
 
 void rcp_req_reset(struct rcp *rcp, bool bootload)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_REQ_RESET);
     hif_push_bool(&buf, bootload);
@@ -64,16 +121,32 @@ void rcp_req_reset(struct rcp *rcp, bool bootload)
 static void rcp_ind_reset(struct rcp *rcp, struct iobuf_read *buf)
 {
     const char *version_label;
+    uint32_t version_api;
+    uint32_t version_fw;
+    struct eui64 eui64;
 
-    FATAL_ON(rcp->has_reset, 3, "unsupported RCP reset");
+    FATAL_ON(rcp->has_reset && !rcp->has_rf_list, 3, "unsupported RCP reset");
 
-    rcp->version_api = hif_pop_u32(buf);
-    rcp->version_fw  = hif_pop_u32(buf);
-    version_label    = hif_pop_str(buf);
-    hif_pop_fixed_u8_array(buf, rcp->eui64.u8, 8);
+    version_api   = hif_pop_u32(buf);
+    version_fw    = hif_pop_u32(buf);
+    version_label = hif_pop_str(buf);
+    hif_pop_fixed_u8_array(buf, eui64.u8, 8);
     BUG_ON(buf->err);
 
-    BUG_ON(version_older_than(rcp->version_api, 2, 0, 0));
+    BUG_ON(version_older_than(version_api, 2, 0, 0));
+    if (rcp->has_reset) {
+        // The radio list and the EUI-64 in use (which may have been
+        // overridden by rcp_set_filter_dst64()) are kept.
+        FATAL_ON(version_api != rcp->version_api || version_fw != rcp->version_fw, 3,
+                 "RCP firmware changed during reset");
+        rcp->reset_count++;
+        if (rcp->on_reset)
+            rcp->on_reset(rcp);
+        return;
+    }
+    rcp->version_api = version_api;
+    rcp->version_fw  = version_fw;
+    rcp->eui64 = eui64;
     rcp->version_label = strdup(version_label);
     BUG_ON(!rcp->version_label);
     rcp->has_reset = true;
@@ -104,7 +177,7 @@ static void rcp_ind_fatal(struct rcp *rcp, struct iobuf_read *buf)
 
 void rcp_set_host_api(struct rcp *rcp, uint32_t host_api_version)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_SET_HOST_API);
     hif_push_u32(&buf, host_api_version);
@@ -126,7 +199,7 @@ void rcp_req_data_tx(struct rcp *rcp,
                      const uint32_t frame_counters_min[HIF_KEY_COUNT],
                      const struct rcp_rate_info rate_list[4], uint8_t ms_mode)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
     int bitfield_offset;
     uint16_t bitfield;
 
@@ -144,7 +217,7 @@ void rcp_req_data_tx(struct rcp *rcp,
         BUG_ON(!fhss_data);
         BUG_ON(!fhss_data->ffn.uc_dwell_interval_ms);
         hif_push_u64(&buf, fhss_data->ffn.utt_rx_tstamp_us);
-        hif_push_u24(&buf, fhss_data->ffn.ufsi);
+        hif_push_u24(&buf, ws_neigh_ut_ufsi(fhss_data, rcp_clock_from_host_us(rcp, time_now_us(CLOCK_MONOTONIC))));
         hif_push_u8(&buf, fhss_data->ffn.uc_dwell_interval_ms);
         break;
     case HIF_FHSS_TYPE_FFN_BC:
@@ -177,25 +250,8 @@ void rcp_req_data_tx(struct rcp *rcp,
         BUG();
     }
     if (fhss_type == HIF_FHSS_TYPE_FFN_UC || fhss_type == HIF_FHSS_TYPE_LFN_UC || fhss_type == HIF_FHSS_TYPE_LFN_PA) {
-        hif_push_u8(&buf, fhss_data->uc_chan_func);
-        switch (fhss_data->uc_chan_func) {
-        case WS_CHAN_FUNC_FIXED: {
-            int chan_fixed = ws_chan_mask_get_fixed(fhss_data->uc_channel_list);
-
-            BUG_ON(chan_fixed < 0);
-            hif_push_u16(&buf, chan_fixed);
-            break;
-        }
-        case WS_CHAN_FUNC_DH1CF: {
-            uint8_t chan_mask_len = ws_chan_mask_width(fhss_data->uc_channel_list);
-
-            hif_push_u8(&buf, chan_mask_len);
-            hif_push_fixed_u8_array(&buf, fhss_data->uc_channel_list, chan_mask_len);
-            break;
-        }
-        default:
-            BUG();
-        }
+        BUG_ON(!fhss_data->uc_chan_hif_len);
+        hif_push_fixed_u8_array(&buf, fhss_data->uc_chan_hif, fhss_data->uc_chan_hif_len);
     }
     if (frame_counters_min) {
         for (uint8_t i = 0; i < 7; i++) {
@@ -223,11 +279,38 @@ void rcp_req_data_tx(struct rcp *rcp,
     write_le16(buf.data + bitfield_offset, bitfield);
     rcp_tx(rcp, &buf);
     iobuf_free(&buf);
+    bitset(rcp->tx_pending, handle);
+}
+
+void rcp_fhss_uc_chan_encode(struct ws_neigh_fhss *fhss_data)
+{
+    uint8_t *ptr = fhss_data->uc_chan_hif;
+    int chan_fixed, chan_mask_len;
+
+    *ptr++ = fhss_data->uc_chan_func;
+    switch (fhss_data->uc_chan_func) {
+    case WS_CHAN_FUNC_FIXED:
+        chan_fixed = ws_chan_mask_get_fixed(fhss_data->uc_channel_list);
+        BUG_ON(chan_fixed < 0);
+        ptr = write_le16(ptr, chan_fixed);
+        break;
+    case WS_CHAN_FUNC_DH1CF:
+        chan_mask_len = ws_chan_mask_width(fhss_data->uc_channel_list);
+        *ptr++ = chan_mask_len;
+        memcpy(ptr, fhss_data->uc_channel_list, chan_mask_len);
+        ptr += chan_mask_len;
+        break;
+    default:
+        // Unsupported, rcp_req_data_tx() refuses to send to this neighbor
+        fhss_data->uc_chan_hif_len = 0;
+        return;
+    }
+    fhss_data->uc_chan_hif_len = ptr - fhss_data->uc_chan_hif;
 }
 
 void rcp_req_data_tx_abort(struct rcp *rcp, uint8_t handle)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_REQ_DATA_TX_ABORT);
     hif_push_u8(&buf, handle);
@@ -235,6 +318,39 @@ void rcp_req_data_tx_abort(struct rcp *rcp, uint8_t handle)
     iobuf_free(&buf);
 }
 
+/*
+ * The RCP timestamps use the clock of the RCP. Its offset to the host clock is
+ * estimated from the time at which the frames are processed: the smallest
+ * offset is the one with the least transport latency. The estimate is raised
+ * by 1us on each sample, so it follows a drift of either clock.
+ */
+static void rcp_clock_sample(struct rcp *rcp, uint64_t rcp_us)
+{
+    int64_t offset_us = time_now_us(CLOCK_MONOTONIC) - rcp_us;
+
+    if (!rcp_us)
+        return;
+    if (!rcp->clock_offset_valid || offset_us < rcp->clock_offset_us)
+        rcp->clock_offset_us = offset_us;
+    else
+        rcp->clock_offset_us++;
+    rcp->clock_offset_valid = true;
+}
+
+uint64_t rcp_clock_to_host_us(const struct rcp *rcp, uint64_t rcp_us)
+{
+    if (!rcp->clock_offset_valid || !rcp_us)
+        return 0;
+    return rcp_us + rcp->clock_offset_us;
+}
+
+uint64_t rcp_clock_from_host_us(const struct rcp *rcp, uint64_t host_us)
+{
+    if (!rcp->clock_offset_valid || !host_us)
+        return 0;
+    return host_us - rcp->clock_offset_us;
+}
+
 static void rcp_cnf_data_tx(struct rcp *rcp, struct iobuf_read *buf)
 {
     struct rcp_tx_cnf cnf = { };
@@ -252,6 +368,9 @@ static void rcp_cnf_data_tx(struct rcp *rcp, struct iobuf_read *buf)
     hif_pop_u8(buf);  // TODO: mode switch stats
     BUG_ON(buf->err);
     WARN_ON(cnf.status >= HIF_STATUS_COUNT, "unsupported HIF status 0x%02x", cnf.status);
+    bitclr(rcp->tx_pending, cnf.handle);
+    rcp->frame_counter_max = MAX(rcp->frame_counter_max, cnf.frame_counter);
+    rcp_clock_sample(rcp, cnf.timestamp_us);
     rcp->on_tx_cnf(rcp, &cnf);
 }
 
@@ -267,12 +386,13 @@ static void rcp_ind_data_rx(struct rcp *rcp, struct iobuf_read *buf)
     ind.chan_num     = hif_pop_u16(buf);
     BUG_ON(buf->err);
     BUG_ON(ind.rx_power_dbm > RX_POWER_DBM_MAX);
+    rcp_clock_sample(rcp, ind.timestamp_us);
     rcp->on_rx_ind(rcp, &ind);
 }
 
 void rcp_req_radio_enable(struct rcp *rcp)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_REQ_RADIO_ENABLE);
     rcp_tx(rcp, &buf);
@@ -281,16 +401,13 @@ void rcp_req_radio_enable(struct rcp *rcp)
 
 void rcp_req_radio_list(struct rcp *rcp)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_REQ_RADIO_LIST);
     rcp_tx(rcp, &buf);
     iobuf_free(&buf);
 }
 
-#define HIF_MASK_RADIO_LIST_GROUP 0x0001
-#define HIF_MASK_RADIO_LIST_MCS   0x01fe
-
 static void rcp_cnf_radio_list(struct rcp *rcp, struct iobuf_read *buf)
 {
     const struct phy_params *phy_params;
@@ -345,9 +462,120 @@ static void rcp_cnf_radio_list(struct rcp *rcp, struct iobuf_read *buf)
         rcp->has_rf_list = true;
 }
 
+/*
+ * The radio list only depends on the RCP firmware, but takes a while to be
+ * retrieved over a slow UART. It is cached in the storage along with the
+ * identity of the RCP. The entries are protected by a CRC, so a truncated or
+ * edited file is ignored and the list requested again.
+ */
+#define RCP_RADIO_LIST_CACHE "rcp-radio-list"
+
+static int rcp_radio_list_entry_str(const struct rcp_rail_config *config, char *buf, size_t buf_len)
+{
+    return snprintf(buf, buf_len, "%u,%u,%u,%u,%d,%d",
+                    config->rail_phy_mode_id, config->chan0_freq, config->chan_spacing,
+                    config->chan_count, config->phy_mode_group, config->sensitivity_dbm);
+}
+
+static void rcp_radio_list_store(struct rcp *rcp)
+{
+    struct storage_parse_info *info = storage_open_prefix(RCP_RADIO_LIST_CACHE, "w");
+    char str[STR_MAX_LEN_EUI64];
+    uint32_t crc = 0xffffffff;
+    char buf[128];
+    int len;
+
+    if (!info)
+        return;
+    fprintf(info->file, "version_api = %#08x\n", rcp->version_api);
+    fprintf(info->file, "version_fw = %#08x\n", rcp->version_fw);
+    fprintf(info->file, "eui64 = %s\n", str_eui64(rcp->eui64.u8, str));
+    for (int i = 0; rcp->rail_config_list[i].chan0_freq; i++) {
+        len = rcp_radio_list_entry_str(&rcp->rail_config_list[i], buf, sizeof(buf));
+        crc = crc32(crc, (const uint8_t *)buf, len);
+        fprintf(info->file, "rail_config[%d] = %s\n", i, buf);
+    }
+    fprintf(info->file, "crc = %#08x\n", crc ^ 0xffffffff);
+    storage_close(info);
+}
+
+static bool rcp_radio_list_load(struct rcp *rcp)
+{
+    struct storage_parse_info *info = storage_open_prefix(RCP_RADIO_LIST_CACHE, "r");
+    struct rcp_rail_config *list = NULL, *entry;
+    uint32_t crc = 0xffffffff;
+    bool has_crc = false;
+    int has_ident = 0;
+    struct eui64 eui64;
+    int count = 0;
+    char buf[128];
+    int val[6];
+    int len;
+    int ret;
+
+    if (!info)
+        return false;
+    for (;;) {
+        ret = storage_parse_line(info);
+        if (ret == EOF)
+            break;
+        if (ret) {
+            goto invalid;
+        } else if (!strcmp("version_api", info->key)) {
+            if (strtoul(info->value, NULL, 0) != rcp->version_api)
+                goto invalid;
+            has_ident++;
+        } else if (!strcmp("version_fw", info->key)) {
+            if (strtoul(info->value, NULL, 0) != rcp->version_fw)
+                goto invalid;
+            has_ident++;
+        } else if (!strcmp("eui64", info->key)) {
+            if (parse_byte_array(eui64.u8, 8, info->value) || memcmp(&eui64, &rcp->eui64, 8))
+                goto invalid;
+            has_ident++;
+        } else if (!strcmp("crc", info->key)) {
+            has_crc = strtoul(info->value, NULL, 0) == (crc ^ 0xffffffff);
+        } else if (!strncmp("rail_config[", info->key, 12)) {
+            if (info->key_array_index != count)
+                goto invalid;
+            if (sscanf(info->value, "%u,%u,%u,%u,%d,%d", &val[0], &val[1], &val[2],
+                       &val[3], &val[4], &val[5]) != 6)
+                goto invalid;
+            list = reallocarray(list, count + 2, sizeof(struct rcp_rail_config));
+            FATAL_ON(!list, 2, "%s: reallocarray: %m", __func__);
+            entry = &list[count];
+            entry->index            = count;
+            entry->rail_phy_mode_id = val[0];
+            entry->chan0_freq       = val[1];
+            entry->chan_spacing     = val[2];
+            entry->chan_count       = val[3];
+            entry->phy_mode_group   = val[4];
+            entry->sensitivity_dbm  = val[5];
+            len = rcp_radio_list_entry_str(entry, buf, sizeof(buf));
+            crc = crc32(crc, (const uint8_t *)buf, len);
+            has_crc = false;
+            count++;
+        }
+    }
+    // version_api, version_fw and eui64
+    if (has_ident != 3 || !has_crc || !count)
+        goto invalid;
+    storage_close(info);
+    memset(&list[count], 0, sizeof(struct rcp_rail_config));
+    free(rcp->rail_config_list);
+    rcp->rail_config_list = list;
+    rcp->has_rf_list = true;
+    return true;
+
+invalid:
+    storage_close(info);
+    free(list);
+    return false;
+}
+
 void rcp_set_radio(struct rcp *rcp, uint8_t radioconf_index, uint8_t ofdm_mcs, bool enable_ms)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     if (version_older_than(rcp->version_api, 2, 0, 1))
         enable_ms = !enable_ms; // API < 2.0.1 has this inverted
@@ -362,7 +590,7 @@ void rcp_set_radio(struct rcp *rcp, uint8_t radioconf_index, uint8_t ofdm_mcs, b
 
 void rcp_set_radio_regulation(struct rcp *rcp, enum hif_reg reg)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_SET_RADIO_REGULATION);
     hif_push_u8(&buf, reg);
@@ -372,7 +600,7 @@ void rcp_set_radio_regulation(struct rcp *rcp, enum hif_reg reg)
 
 void rcp_set_radio_tx_power(struct rcp *rcp, int8_t power_dbm)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_SET_RADIO_TX_POWER);
     hif_push_i8(&buf, power_dbm);
@@ -386,7 +614,7 @@ void rcp_set_fhss_uc(struct rcp *rcp,
 {
     int fixed_channel = ws_chan_mask_get_fixed(chan_mask);
     uint8_t chan_func = (fixed_channel < 0) ? WS_CHAN_FUNC_DH1CF : WS_CHAN_FUNC_FIXED;
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_SET_FHSS_UC);
     hif_push_u8(&buf, dwell_interval_ms);
@@ -423,7 +651,7 @@ void rcp_set_fhss_ffn_bc(struct rcp *rcp,
 {
     int fixed_channel = ws_chan_mask_get_fixed(chan_mask);
     uint8_t chan_func = (fixed_channel < 0) ? WS_CHAN_FUNC_DH1CF : WS_CHAN_FUNC_FIXED;
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf,  HIF_CMD_SET_FHSS_FFN_BC);
     hif_push_u24(&buf, interval_ms);
@@ -468,7 +696,7 @@ void rcp_set_fhss_lfn_bc(struct rcp *rcp,
 {
     int fixed_channel = ws_chan_mask_get_fixed(chan_mask);
     uint8_t chan_func = (fixed_channel < 0) ? WS_CHAN_FUNC_DH1CF : WS_CHAN_FUNC_FIXED;
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf,  HIF_CMD_SET_FHSS_LFN_BC);
     hif_push_u24(&buf, interval_ms);
@@ -497,7 +725,7 @@ void rcp_set_fhss_async(struct rcp *rcp,
                         uint32_t tx_duration_ms,
                         const uint8_t chan_mask[WS_CHAN_MASK_LEN])
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf,  HIF_CMD_SET_FHSS_ASYNC);
     hif_push_u32(&buf, tx_duration_ms);
@@ -512,7 +740,7 @@ void rcp_set_sec_key(struct rcp *rcp,
                      const uint8_t key[16],
                      uint32_t frame_counter)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_SET_SEC_KEY);
     hif_push_u8(&buf, key_index);
@@ -524,7 +752,7 @@ void rcp_set_sec_key(struct rcp *rcp,
 
 void rcp_set_filter_pan_id(struct rcp *rcp, uint16_t pan_id)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_SET_FILTER_PANID);
     hif_push_u16(&buf, pan_id);
@@ -534,7 +762,7 @@ void rcp_set_filter_pan_id(struct rcp *rcp, uint16_t pan_id)
 
 void rcp_set_filter_src64(struct rcp *rcp, const uint8_t eui64[][8], uint8_t count, bool allow)
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     hif_push_u8(&buf, HIF_CMD_SET_FILTER_SRC64);
     hif_push_bool(&buf, allow);
@@ -547,7 +775,7 @@ void rcp_set_filter_src64(struct rcp *rcp, const uint8_t eui64[][8], uint8_t cou
 
 void rcp_set_filter_dst64(struct rcp *rcp, const uint8_t eui64[8])
 {
-    struct iobuf_write buf = { };
+    struct iobuf_write buf = iobuf_scratch();
 
     memcpy(&rcp->eui64, eui64, 8);
 
@@ -557,21 +785,72 @@ void rcp_set_filter_dst64(struct rcp *rcp, const uint8_t eui64[8])
     iobuf_free(&buf);
 }
 
+void rcp_restore(struct rcp *rcp)
+{
+    struct rcp_tx_cnf cnf = { .status = HIF_STATUS_TIMEDOUT };
+    struct rcp_cfg_cache *entry;
+    uint32_t frame_counter;
+    unsigned int seq = 0;
+    int next;
+
+    rcp_set_host_api(rcp, version_daemon_api);
+    // Replay the configuration in the order it was originally sent, since
+    // some commands depend on the previous ones (eg. RADIO_ENABLE).
+    for (;;) {
+        next = -1;
+        for (int i = 0; i < RCP_CFG_CACHE_LEN; i++)
+            if (rcp->cfg_cache[i].seq > seq &&
+                (next < 0 || rcp->cfg_cache[i].seq < rcp->cfg_cache[next].seq))
+                next = i;
+        if (next < 0)
+            break;
+        entry = &rcp->cfg_cache[next];
+        seq = entry->seq;
+        if (entry->data[0] == HIF_CMD_SET_SEC_KEY) {
+            // The RCP must not reuse a frame counter: start above the highest
+            // one it has confirmed.
+            frame_counter = read_le32(entry->data + 18);
+            frame_counter = MAX(frame_counter, add32sat(rcp->frame_counter_max,
+                                                        RCP_RESTORE_FRAME_COUNTER_MARGIN));
+            write_le32(entry->data + 18, frame_counter);
+        }
+        TRACE(TR_HIF, "hif tx: %s %s", hif_cmd_str(entry->data[0]),
+              tr_bytes(entry->data + 1, entry->len - 1,
+                       NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
+        rcp->bus.tx(&rcp->bus, entry->data, entry->len);
+    }
+
+    // The frames queued in the RCP are lost, fail them so the upper layers
+    // release their handles and carry on with their queues.
+    for (int i = 0; i < 256; i++) {
+        if (!bittest(rcp->tx_pending, i))
+            continue;
+        bitclr(rcp->tx_pending, i);
+        cnf.handle = i;
+        rcp->on_tx_cnf(rcp, &cnf);
+    }
+}
+
 struct rcp_cmd rcp_cmd_table[] = {
-    { HIF_CMD_IND_NOP,           rcp_ind_nop        },
-    { HIF_CMD_IND_RESET,         rcp_ind_reset      },
-    { HIF_CMD_IND_FATAL,         rcp_ind_fatal      },
-    { HIF_CMD_CNF_DATA_TX,       rcp_cnf_data_tx    },
-    { HIF_CMD_IND_DATA_RX,       rcp_ind_data_rx    },
-    { HIF_CMD_CNF_RADIO_LIST,    rcp_cnf_radio_list },
-    { HIF_CMD_IND_REPLAY_TIMER,  rcp_ind_nop        },
-    { HIF_CMD_IND_REPLAY_SOCKET, rcp_ind_nop        },
+    { HIF_CMD_IND_NOP,               rcp_ind_nop        },
+    { HIF_CMD_IND_RESET,             rcp_ind_reset      },
+    { HIF_CMD_IND_FATAL,             rcp_ind_fatal      },
+    { HIF_CMD_CNF_DATA_TX,           rcp_cnf_data_tx    },
+    { HIF_CMD_IND_DATA_RX,           rcp_ind_data_rx    },
+    { HIF_CMD_CNF_RADIO_LIST,        rcp_cnf_radio_list },
+    { HIF_CMD_IND_REPLAY_TIMER,      rcp_ind_nop        },
+    { HIF_CMD_IND_REPLAY_SOCKET,     rcp_ind_nop        },
+    { HIF_CMD_IND_REPLAY_CHECKPOINT, rcp_ind_nop        },
     { 0 }
 };
 
+// Built by rcp_init(). Entries point to rcp_cmd_table[] so the handlers
+// replaced by wsbrd-fuzz are honored.
+static const struct rcp_cmd *rcp_cmd_index[256];
+
 static bool rcp_init_state_is_valid(struct rcp *rcp, uint8_t cmd)
 {
-    if (cmd == HIF_CMD_IND_REPLAY_TIMER)
+    if (cmd == HIF_CMD_IND_REPLAY_TIMER || cmd == HIF_CMD_IND_REPLAY_CHECKPOINT)
         return true;
     if (!rcp->has_reset)
         return cmd == HIF_CMD_IND_RESET;
@@ -580,34 +859,56 @@ static bool rcp_init_state_is_valid(struct rcp *rcp, uint8_t cmd)
     return true;
 }
 
-void rcp_rx(struct rcp *rcp)
+static void rcp_rx_dispatch(struct rcp *rcp, struct iobuf_read *buf)
 {
-    struct iobuf_read buf = { .data = rcp_rx_buf };
     uint32_t cmd;
 
-    buf.data_size = rcp->bus.rx(&rcp->bus, rcp_rx_buf, sizeof(rcp_rx_buf));
-    if (!buf.data_size)
-        return;
-    capture_record_hif(buf.data, buf.data_size);
-    cmd = hif_pop_u8(&buf);
+    capture_record_hif(buf->data, buf->data_size);
+    cmd = hif_pop_u8(buf);
     TRACE(TR_HIF, "hif rx: %s %s", hif_cmd_str(cmd),
-          tr_bytes(iobuf_ptr(&buf), iobuf_remaining_size(&buf),
+          tr_bytes(iobuf_ptr(buf), iobuf_remaining_size(buf),
                    NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
     if (!rcp_init_state_is_valid(rcp, cmd)) {
         TRACE(TR_DROP, "drop %-9s: unexpected command during reset sequence", "hif");
         return;
     }
-    for (int i = 0; rcp_cmd_table[i].fn; i++)
-        if (rcp_cmd_table[i].cmd == cmd)
-            return rcp_cmd_table[i].fn(rcp, &buf);
+    if (rcp_cmd_index[cmd])
+        return rcp_cmd_index[cmd]->fn(rcp, buf);
     TRACE(TR_DROP, "drop %-9s: unsupported command 0x%02x", "hif", cmd);
 }
 
+void rcp_rx(struct rcp *rcp)
+{
+    struct iobuf_read buf;
+    unsigned int frame_count = 0;
+
+    // bus.uart.data_ready and bus.cpc.data_ready indicate that more frames
+    // may already be available: dispatch them without going back to poll().
+    do {
+        buf = (struct iobuf_read){ .data = rcp_rx_buf };
+        buf.data_size = rcp->bus.rx(&rcp->bus, rcp_rx_buf, sizeof(rcp_rx_buf));
+        if (!buf.data_size)
+            break;
+        rcp_rx_dispatch(rcp, &buf);
+        frame_count++;
+    } while (rcp->bus.uart.data_ready || rcp->bus.cpc.data_ready);
+
+    if (!frame_count)
+        return;
+    rcp->rx_wakeup_count++;
+    rcp->rx_frame_count += frame_count;
+    if (frame_count > rcp->rx_frame_per_wakeup_max)
+        rcp->rx_frame_per_wakeup_max = frame_count;
+}
+
 void rcp_init(struct rcp *rcp, const struct rcp_cfg *config)
 {
     struct pollfd pfd = { };
     int ret;
 
+    for (const struct rcp_cmd *cmd = rcp_cmd_table; cmd->fn; cmd++)
+        rcp_cmd_index[cmd->cmd] = cmd;
+
     if (config->uart_dev[0]) {
         rcp->bus.fd = uart_open(config->uart_dev, config->uart_baudrate, config->uart_rtscts);
         rcp->version_api = VERSION(2, 0, 0); // default assumed version
@@ -645,7 +946,16 @@ void rcp_init(struct rcp *rcp, const struct rcp_cfg *config)
 
     rcp_set_host_api(rcp, version_daemon_api);
 
-    rcp_req_radio_list(rcp);
-    while (!rcp->has_rf_list)
-        rcp_rx(rcp);
+    if (config->radio_list_cache && rcp_radio_list_load(rcp)) {
+        TRACE(TR_HIF, "hif: radio list loaded from " RCP_RADIO_LIST_CACHE);
+    } else {
+        rcp_req_radio_list(rcp);
+        while (!rcp->has_rf_list)
+            rcp_rx(rcp);
+        if (config->radio_list_cache)
+            rcp_radio_list_store(rcp);
+    }
+
+    if (config->uart_dev[0] && config->uart_thread)
+        uart_thread_start(&rcp->bus);
 }
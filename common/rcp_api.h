@@ -70,6 +70,20 @@ struct rcp_cfg {
     char uart_dev[PATH_MAX];
     int  uart_baudrate;
     bool uart_rtscts;
+    bool uart_thread;
+    // Load the radio list from the storage (see g_storage_prefix) when the
+    // same RCP was already seen, instead of requesting it
+    bool radio_list_cache;
+};
+
+// Commands SET_RADIO*, SET_FHSS_*, SET_FILTER_*, REQ_RADIO_ENABLE, and one
+// SET_SEC_KEY per key.
+#define RCP_CFG_CACHE_LEN (11 + HIF_KEY_COUNT)
+
+struct rcp_cfg_cache {
+    uint8_t *data;
+    size_t len;
+    unsigned int seq;
 };
 
 struct rcp {
@@ -86,6 +100,26 @@ struct rcp {
     const char *version_label;
     struct eui64 eui64;
     struct rcp_rail_config *rail_config_list;
+
+    // Number of rcp_rx() calls which processed at least one frame, total
+    // number of frames processed, and maximum number of frames processed in
+    // a single call.
+    unsigned int rx_wakeup_count;
+    unsigned int rx_frame_count;
+    unsigned int rx_frame_per_wakeup_max;
+
+    // Estimated offset from the RCP timestamps to CLOCK_MONOTONIC, see
+    // rcp_clock_to_host_us().
+    int64_t clock_offset_us;
+    bool clock_offset_valid;
+
+    // Last configuration commands sent, replayed by rcp_restore(), handles of
+    // the frames not confirmed yet, and highest frame counter confirmed.
+    struct rcp_cfg_cache cfg_cache[RCP_CFG_CACHE_LEN];
+    unsigned int cfg_seq;
+    uint8_t tx_pending[256 / 8];
+    uint32_t frame_counter_max;
+    unsigned int reset_count;
 };
 
 // Share rx buffer with legacy implementation to not allocate twice
@@ -93,9 +127,19 @@ extern uint8_t rcp_rx_buf[4096];
 
 void rcp_init(struct rcp *rcp, const struct rcp_cfg *config);
 
+// Process all the frames available on the bus.
 void rcp_rx(struct rcp *rcp);
 
+// Convert a timestamp of the RCP (eg. rcp_rx_ind.timestamp_us) to the host
+// CLOCK_MONOTONIC. Return 0 until a frame has been received.
+uint64_t rcp_clock_to_host_us(const struct rcp *rcp, uint64_t rcp_us);
+uint64_t rcp_clock_from_host_us(const struct rcp *rcp, uint64_t host_us);
+
 void rcp_req_reset(struct rcp *rcp, bool bootload);
+// Restore the state of the RCP after an unexpected reset (on_reset() called
+// with has_rf_list set): the configuration is replayed, and the frames which
+// were not confirmed are failed with HIF_STATUS_TIMEDOUT.
+void rcp_restore(struct rcp *rcp);
 void rcp_set_host_api(struct rcp *rcp, uint32_t host_api_version);
 
 void rcp_req_data_tx(struct rcp *rcp,
@@ -105,6 +149,10 @@ void rcp_req_data_tx(struct rcp *rcp,
                      const uint32_t frame_counters_min[HIF_KEY_COUNT],
                      const struct rcp_rate_info rate_list[4], uint8_t ms_mode);
 void rcp_req_data_tx_abort(struct rcp *rcp, uint8_t handle);
+// Encode the unicast channel section of rcp_req_data_tx() into
+// fhss_data->uc_chan_hif. Must be called whenever uc_chan_func or
+// uc_channel_list are modified.
+void rcp_fhss_uc_chan_encode(struct ws_neigh_fhss *fhss_data);
 
 void rcp_req_radio_enable(struct rcp *rcp);
 void rcp_req_radio_list(struct rcp *rcp);
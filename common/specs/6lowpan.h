@@ -20,6 +20,10 @@
  * - RFC 4944: Transmission of IPv6 Packets over IEEE 802.15.4 Networks
  * - RFC 6282: Compression Format for IPv6 Datagrams over IEEE 802.15.4-Based
  *   Networks
+ * - RFC 8025: IPv6 over Low-Power Wireless Personal Area Network (6LoWPAN)
+ *   Paging Dispatch
+ * - RFC 8138: IPv6 over Low-Power Wireless Personal Area Network (6LoWPAN)
+ *   Routing Header
  */
 
 // Dispatch Type Field
@@ -34,6 +38,7 @@ enum {
     LOWPAN_DISPATCH_MESH  = 0b10000000,
     LOWPAN_DISPATCH_FRAG1 = 0b11000000,
     LOWPAN_DISPATCH_FRAGN = 0b11100000,
+    LOWPAN_DISPATCH_PAGE  = 0b11110000,
 };
 
 #define LOWPAN_DISPATCH_IS_NALP(dispatch)  (((dispatch) & 0b11000000) == LOWPAN_DISPATCH_NALP)  // 00xxxxxx
@@ -45,6 +50,44 @@ enum {
 #define LOWPAN_DISPATCH_IS_MESH(dispatch)  (((dispatch) & 0b11000000) == LOWPAN_DISPATCH_MESH)  // 10xxxxxx
 #define LOWPAN_DISPATCH_IS_FRAG1(dispatch) (((dispatch) & 0b11111000) == LOWPAN_DISPATCH_FRAG1) // 11000xxx
 #define LOWPAN_DISPATCH_IS_FRAGN(dispatch) (((dispatch) & 0b11111000) == LOWPAN_DISPATCH_FRAGN) // 11100xxx
+#define LOWPAN_DISPATCH_IS_PAGE(dispatch)  (((dispatch) & 0b11110000) == LOWPAN_DISPATCH_PAGE)  // 1111xxxx
+
+// RFC 8025 - Figure 1: Paging Dispatch with Page Number Encoding
+#define LOWPAN_MASK_PAGE 0b00001111
+
+// RFC 8138 - 4. 6LoWPAN Routing Header: 6LoRH dispatches are only valid in
+// Page 1, where they replace the Mesh Header dispatch.
+#define LOWPAN_6LORH_ELECTIVE 0b10000000 // 100xxxxx
+#define LOWPAN_6LORH_CRITICAL 0b10100000 // 101xxxxx
+#define LOWPAN_6LORH_IS_ELECTIVE(dispatch) (((dispatch) & 0b11100000) == LOWPAN_6LORH_ELECTIVE)
+#define LOWPAN_6LORH_IS_CRITICAL(dispatch) (((dispatch) & 0b11100000) == LOWPAN_6LORH_CRITICAL)
+
+// RFC 8138 - Figure 5: Elective 6LoWPAN Routing Header
+// RFC 8138 - Figure 6: Critical 6LoWPAN Routing Header
+#define LOWPAN_MASK_6LORH_LEN  0b00011111
+// RFC 8138 - Figure 7: The SRH-6LoRH
+#define LOWPAN_MASK_6LORH_SIZE 0b00011111
+// RFC 8138 - Figure 10: The Generic RPI-6LoRH Format
+#define LOWPAN_MASK_6LORH_RPI_O 0b00010000
+#define LOWPAN_MASK_6LORH_RPI_R 0b00001000
+#define LOWPAN_MASK_6LORH_RPI_F 0b00000100
+#define LOWPAN_MASK_6LORH_RPI_I 0b00000010
+#define LOWPAN_MASK_6LORH_RPI_K 0b00000001
+
+// 6LoWPAN Routing Header Type
+// https://www.iana.org/assignments/_6lowpan-parameters/_6lowpan-parameters.xhtml#critical-6lowpan-routing-header-type
+// https://www.iana.org/assignments/_6lowpan-parameters/_6lowpan-parameters.xhtml#elective-6lowpan-routing-header-type
+enum {
+    // RFC 8138 - Table 2: The SRH-6LoRH Types: hops compressed to 1, 2, 4,
+    // 8 and 16 bytes
+    LOWPAN_6LORH_TYPE_SRH1   = 0,
+    LOWPAN_6LORH_TYPE_SRH2   = 1,
+    LOWPAN_6LORH_TYPE_SRH4   = 2,
+    LOWPAN_6LORH_TYPE_SRH8   = 3,
+    LOWPAN_6LORH_TYPE_SRH16  = 4,
+    LOWPAN_6LORH_TYPE_RPI    = 5, // Critical
+    LOWPAN_6LORH_TYPE_IPINIP = 6, // Elective
+};
 
 // RFC 4944 - Figure 3: Mesh Addressing Type and Header
 #define LOWPAN_MASK_MESH_V    0b00100000
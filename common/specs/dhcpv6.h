@@ -34,13 +34,13 @@ enum {
 // https://datatracker.ietf.org/doc/html/rfc3315#section-24.2
 enum {
     DHCPV6_MSG_SOLICIT      = 1,
-    DHCPV6_MSG_ADVERT       = 2,  /* Unused */
-    DHCPV6_MSG_REQUEST      = 3,  /* Unused */
+    DHCPV6_MSG_ADVERT       = 2,
+    DHCPV6_MSG_REQUEST      = 3,
     DHCPV6_MSG_CONFIRM      = 4,  /* Unused */
-    DHCPV6_MSG_RENEW        = 5,  /* Unused */
-    DHCPV6_MSG_REBIND       = 6,  /* Unused */
+    DHCPV6_MSG_RENEW        = 5,
+    DHCPV6_MSG_REBIND       = 6,
     DHCPV6_MSG_REPLY        = 7,
-    DHCPV6_MSG_RELEASE      = 8,  /* Unused */
+    DHCPV6_MSG_RELEASE      = 8,
     DHCPV6_MSG_DECLINE      = 9,  /* Unused */
     DHCPV6_MSG_RECONFIGURE  = 10, /* Unused */
     DHCPV6_MSG_INFO_REQUEST = 11, /* Unused */
@@ -73,6 +73,17 @@ enum {
     DHCPV6_OPT_RECONF_ACCEPT   = 20, /* Unused */
 };
 
+// RFC3315 - Section 24.4
+// https://datatracker.ietf.org/doc/html/rfc3315#section-24.4
+enum {
+    DHCPV6_STATUS_SUCCESS         = 0,
+    DHCPV6_STATUS_UNSPEC_FAIL     = 1, /* Unused */
+    DHCPV6_STATUS_NO_ADDRS_AVAIL  = 2,
+    DHCPV6_STATUS_NO_BINDING      = 3,
+    DHCPV6_STATUS_NOT_ON_LINK     = 4, /* Unused */
+    DHCPV6_STATUS_USE_MULTICAST   = 5, /* Unused */
+};
+
 // RFC3315 - Section 24.5
 // https://datatracker.ietf.org/doc/html/rfc3315#section-24.5
 enum {
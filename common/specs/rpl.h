@@ -65,6 +65,8 @@ enum {
 #define RPL_MASK_DAO_ACK_D 0x80
 // DODAG Configuration Option
 // https://www.iana.org/assignments/rpl/rpl.xhtml#dodag-config-option-flags
+// RFC 9035 - 3. Updating RFC 6550: Turn On RFC 8138 Compression
+#define RPL_MASK_OPT_CONFIG_T   0x20
 #define RPL_MASK_OPT_CONFIG_RPI 0x10
 #define RPL_MASK_OPT_CONFIG_A   0x08
 #define RPL_MASK_OPT_CONFIG_PCS 0x07
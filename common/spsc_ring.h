@@ -0,0 +1,107 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_SPSC_RING_H
+#define COMMON_SPSC_RING_H
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/log.h"
+#include "common/mathutils.h"
+
+/*
+ * Lock-free ring buffer with a single producer thread and a single consumer
+ * thread. It stores variable size records, each made of a 32-bit header
+ * followed by header bytes of data when the header is positive. A negative
+ * header carries no data, which is useful to pass error codes.
+ *
+ * The size must be a power of 2. head and tail are free running, only the
+ * consumer writes head and only the producer writes tail.
+ */
+
+struct spsc_ring {
+    uint8_t *buf;
+    size_t size;
+    atomic_size_t head;
+    atomic_size_t tail;
+};
+
+static inline void spsc_ring_copy_in(struct spsc_ring *ring, size_t pos, const void *data, size_t len)
+{
+    size_t start = pos & (ring->size - 1);
+    size_t len1 = MIN(len, ring->size - start);
+
+    memcpy(ring->buf + start, data, len1);
+    memcpy(ring->buf, (const uint8_t *)data + len1, len - len1);
+}
+
+static inline void spsc_ring_copy_out(struct spsc_ring *ring, size_t pos, void *data, size_t len)
+{
+    size_t start = pos & (ring->size - 1);
+    size_t len1 = MIN(len, ring->size - start);
+
+    memcpy(data, ring->buf + start, len1);
+    memcpy((uint8_t *)data + len1, ring->buf, len - len1);
+}
+
+// Producer side: free space, which may only grow until the next push.
+static inline size_t spsc_ring_room(struct spsc_ring *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    return ring->size - (tail - head);
+}
+
+// Producer side: returns false if there is not enough room.
+static inline bool spsc_ring_push(struct spsc_ring *ring, int32_t hdr, const void *data)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t len = hdr > 0 ? hdr : 0;
+
+    if (spsc_ring_room(ring) < sizeof(hdr) + len)
+        return false;
+    spsc_ring_copy_in(ring, tail, &hdr, sizeof(hdr));
+    spsc_ring_copy_in(ring, tail + sizeof(hdr), data, len);
+    atomic_store_explicit(&ring->tail, tail + sizeof(hdr) + len, memory_order_release);
+    return true;
+}
+
+// Consumer side: returns false if the ring is empty.
+static inline bool spsc_ring_pop(struct spsc_ring *ring, int32_t *hdr, void *buf, size_t buf_len)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t len;
+
+    if (head == tail)
+        return false;
+    spsc_ring_copy_out(ring, head, hdr, sizeof(*hdr));
+    len = *hdr > 0 ? *hdr : 0;
+    BUG_ON(len > buf_len);
+    spsc_ring_copy_out(ring, head + sizeof(*hdr), buf, len);
+    atomic_store_explicit(&ring->head, head + sizeof(*hdr) + len, memory_order_release);
+    return true;
+}
+
+// Consumer side
+static inline bool spsc_ring_empty(struct spsc_ring *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_relaxed) ==
+           atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+#endif
@@ -11,9 +11,18 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <stdbool.h>
 #include <stdint.h>
 #include <time.h>
 
+#include "time_extra.h"
+
+// Per thread, so workers never see the time cached by the main loop
+static __thread struct {
+    bool enabled;
+    uint64_t now_ms;
+} g_time_cache;
+
 time_t time_now_s(clockid_t clockid)
 {
     struct timespec tp;
@@ -30,6 +39,43 @@ uint64_t time_now_ms(clockid_t clockid)
     return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
 
+uint64_t time_now_us(clockid_t clockid)
+{
+    struct timespec now;
+
+    clock_gettime(clockid, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void time_cache_start(void)
+{
+    g_time_cache.enabled = true;
+    g_time_cache.now_ms = time_now_ms(CLOCK_MONOTONIC);
+}
+
+void time_cache_refresh(void)
+{
+    if (g_time_cache.enabled)
+        g_time_cache.now_ms = time_now_ms(CLOCK_MONOTONIC);
+}
+
+void time_cache_stop(void)
+{
+    g_time_cache.enabled = false;
+}
+
+uint64_t time_cached_ms(void)
+{
+    if (!g_time_cache.enabled)
+        return time_now_ms(CLOCK_MONOTONIC);
+    return g_time_cache.now_ms;
+}
+
+time_t time_cached_s(void)
+{
+    return time_cached_ms() / 1000;
+}
+
 time_t time_get_elapsed(clockid_t clockid, time_t start)
 {
     struct timespec tp;
@@ -20,8 +20,23 @@ time_t time_now_s(clockid_t clockid);
 
 uint64_t time_now_ms(clockid_t clockid);
 
+uint64_t time_now_us(clockid_t clockid);
+
 time_t time_get_elapsed(clockid_t clockid, time_t start);
 
+/*
+ * CLOCK_MONOTONIC cached between explicit refresh points, for the hot paths
+ * which do not need an accuracy better than the duration of a callback. The
+ * event loop starts the cache after each wakeup, refreshes it after each
+ * callback, and stops it once all the events are dispatched. Outside of this,
+ * or in another thread, the clock is read directly.
+ */
+void time_cache_start(void);
+void time_cache_refresh(void);
+void time_cache_stop(void);
+uint64_t time_cached_ms(void);
+time_t time_cached_s(void);
+
 /*
  * We rely on monotonic clock everywhere. However, monotonic timestamps do
  * not survive to reboots. So timestamp stored on the disk must use realtime
@@ -15,10 +15,13 @@
 #include <sys/timerfd.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "common/cpu_usage.h"
 #include "common/log.h"
 #include "common/sys_queue_extra.h"
 
@@ -26,11 +29,26 @@
 
 // Declare struct timer_group_list
 SLIST_HEAD(timer_group_list, timer_group);
+// Declare struct timer_list
+STAILQ_HEAD(timer_list, timer_entry);
+
+// Value of timer_entry.heap_index for timers removed from the heap by
+// timer_process() whose callback has not been called yet.
+#define TIMER_INDEX_TRIGGERED SIZE_MAX
 
 struct timer_ctxt {
     int fd;
     struct timer_group_list groups;
     struct timer_group group_default;
+    // Binary min-heap ordered by expiration date
+    struct timer_entry **heap;
+    size_t heap_len;
+    size_t heap_size;
+    struct timer_list trig_list;
+    // Wakeup statistics
+    time_t wakeup_cur_s;
+    unsigned int wakeup_cur_count;
+    unsigned int wakeup_prev_count;
 } g_timer_ctxt = {
     .fd = -1,
 };
@@ -44,10 +62,75 @@ static struct timer_ctxt *timer_ctxt(void)
     ctxt->fd = timerfd_create(CLOCK_MONOTONIC, 0);
     FATAL_ON(ctxt->fd < 0, 2, "timerfd_create: %m");
     SLIST_INIT(&ctxt->groups);
+    STAILQ_INIT(&ctxt->trig_list);
     timer_group_init(&ctxt->group_default);
     return ctxt;
 }
 
+static void timer_heap_set(struct timer_ctxt *ctxt, size_t i, struct timer_entry *timer)
+{
+    ctxt->heap[i] = timer;
+    timer->heap_index = i;
+}
+
+static void timer_heap_sift_up(struct timer_ctxt *ctxt, size_t i)
+{
+    struct timer_entry *timer = ctxt->heap[i];
+    size_t parent;
+
+    while (i) {
+        parent = (i - 1) / 2;
+        if (ctxt->heap[parent]->expire_ms <= timer->expire_ms)
+            break;
+        timer_heap_set(ctxt, i, ctxt->heap[parent]);
+        i = parent;
+    }
+    timer_heap_set(ctxt, i, timer);
+}
+
+static void timer_heap_sift_down(struct timer_ctxt *ctxt, size_t i)
+{
+    struct timer_entry *timer = ctxt->heap[i];
+    size_t child;
+
+    while ((child = 2 * i + 1) < ctxt->heap_len) {
+        if (child + 1 < ctxt->heap_len &&
+            ctxt->heap[child + 1]->expire_ms < ctxt->heap[child]->expire_ms)
+            child++;
+        if (timer->expire_ms <= ctxt->heap[child]->expire_ms)
+            break;
+        timer_heap_set(ctxt, i, ctxt->heap[child]);
+        i = child;
+    }
+    timer_heap_set(ctxt, i, timer);
+}
+
+static void timer_heap_insert(struct timer_ctxt *ctxt, struct timer_entry *timer)
+{
+    if (ctxt->heap_len == ctxt->heap_size) {
+        ctxt->heap_size = ctxt->heap_size ? 2 * ctxt->heap_size : 64;
+        ctxt->heap = realloc(ctxt->heap, ctxt->heap_size * sizeof(ctxt->heap[0]));
+        FATAL_ON(!ctxt->heap, 2, "%s: cannot allocate memory", __func__);
+    }
+    timer_heap_set(ctxt, ctxt->heap_len++, timer);
+    timer_heap_sift_up(ctxt, timer->heap_index);
+}
+
+static void timer_heap_remove(struct timer_ctxt *ctxt, struct timer_entry *timer)
+{
+    size_t i = timer->heap_index;
+
+    BUG_ON(i >= ctxt->heap_len || ctxt->heap[i] != timer);
+    ctxt->heap_len--;
+    if (i == ctxt->heap_len)
+        return;
+    timer_heap_set(ctxt, i, ctxt->heap[ctxt->heap_len]);
+    if (i && ctxt->heap[(i - 1) / 2]->expire_ms > ctxt->heap[i]->expire_ms)
+        timer_heap_sift_up(ctxt, i);
+    else
+        timer_heap_sift_down(ctxt, i);
+}
+
 int timer_fd(void)
 {
     struct timer_ctxt *ctxt = timer_ctxt();
@@ -58,18 +141,8 @@ int timer_fd(void)
 struct timer_entry *timer_next(void)
 {
     struct timer_ctxt *ctxt = timer_ctxt();
-    struct timer_entry *cur, *nxt = NULL;
-    struct timer_group *group;
 
-    SLIST_FOREACH(group, &ctxt->groups, link) {
-        cur = SLIST_FIRST(&group->timers);
-        if (!cur)
-            continue;
-        if (nxt && cur->expire_ms >= nxt->expire_ms)
-            continue;
-        nxt = cur;
-    }
-    return nxt;
+    return ctxt->heap_len ? ctxt->heap[0] : NULL;
 }
 
 static void timer_schedule(void)
@@ -87,29 +160,30 @@ static void timer_schedule(void)
     FATAL_ON(ret < 0, 2, "timerfd_settime: %m");
 }
 
+// Pick the date with the most trailing zero bits between expire_ms and
+// expire_ms + slack_ms, so that timers with slack tend to use the same dates.
+// This is the algorithm used by apply_slack() in older Linux kernels.
+static uint64_t timer_apply_slack(uint64_t expire_ms, uint64_t slack_ms)
+{
+    uint64_t limit_ms = expire_ms + slack_ms;
+    uint64_t mask = expire_ms ^ limit_ms;
+
+    if (!mask)
+        return expire_ms;
+    mask = (UINT64_C(1) << (63 - __builtin_clzll(mask))) - 1;
+    return limit_ms & ~mask;
+}
+
 // Returns true if timer_schedule() should be called.
 static bool timer_start(struct timer_group *group, struct timer_entry *timer, uint64_t expire_ms)
 {
     struct timer_ctxt *ctxt = timer_ctxt();
-    struct timer_entry *cur, *prev;
 
-    timer->start_ms = time_now_ms(CLOCK_MONOTONIC);
-
-    if (!group)
-        group = &ctxt->group_default;
-    prev = NULL;
-    SLIST_FOREACH(cur, &group->timers, link) {
-        if (expire_ms <= cur->expire_ms)
-            break;
-        prev = cur;
-    }
-    timer->expire_ms = expire_ms;
-    if (prev)
-        SLIST_INSERT_AFTER(prev, timer, link);
-    else
-        SLIST_INSERT_HEAD(&group->timers, timer, link);
-
-    return !prev;
+    timer->start_ms = time_cached_ms();
+    timer->expire_ms = timer->slack_ms ? timer_apply_slack(expire_ms, timer->slack_ms) : expire_ms;
+    timer->group = group;
+    timer_heap_insert(ctxt, timer);
+    return !timer->heap_index;
 }
 
 static void timer_reset(struct timer_entry *timer)
@@ -121,49 +195,85 @@ static void timer_reset(struct timer_entry *timer)
 void timer_process(void)
 {
     struct timer_ctxt *ctxt = timer_ctxt();
-    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
-    struct timer_entry *timer, *tmp;
-    struct timer_list trig_list;
-    struct timer_group *group;
+    void (*callback)(struct timer_group *group, struct timer_entry *timer);
+    struct cpu_usage_frame frame;
+    struct timer_entry *timer;
+    uint64_t now_ms;
     uint64_t val;
     ssize_t ret;
 
+    // The callbacks restarting their timer see the same time as this function
+    time_cache_refresh();
+    now_ms = time_cached_ms();
+
     ret = read(ctxt->fd, &val, sizeof(val));
     FATAL_ON(ret != 8, 2, "read timer: %m");
     WARN_ON(val != 1);
 
-    SLIST_INIT(&trig_list);
-    SLIST_FOREACH(group, &ctxt->groups, link) {
-        SLIST_FOREACH_SAFE(timer, &group->timers, link, tmp) {
-            if (timer->expire_ms > now_ms)
-                break;
-            SLIST_REMOVE_HEAD(&group->timers, link);
-            SLIST_INSERT_HEAD(&trig_list, timer, link);
-        }
-        while ((timer = SLIST_POP(&trig_list, link))) {
-            if (timer->period_ms) {
-                if (timer->expire_ms + timer->period_ms < now_ms)
-                    WARN("periodic timer overrun");
-                timer_start(group, timer, timer->expire_ms + timer->period_ms);
-            } else {
-                timer_reset(timer);
-            }
-            // WARN: timer->callback() is allowed to free(timer)
-            if (timer->callback)
-                timer->callback(group == &ctxt->group_default ? NULL : group, timer);
+    if (ctxt->wakeup_cur_s != now_ms / 1000) {
+        ctxt->wakeup_prev_count = ctxt->wakeup_cur_s + 1 == now_ms / 1000 ? ctxt->wakeup_cur_count : 0;
+        ctxt->wakeup_cur_s = now_ms / 1000;
+        ctxt->wakeup_cur_count = 0;
+    }
+    ctxt->wakeup_cur_count++;
+
+    // Expired timers are collected first so periodic timers restarted below
+    // are only processed once per call.
+    while ((timer = timer_next()) && timer->expire_ms <= now_ms) {
+        timer_heap_remove(ctxt, timer);
+        timer->heap_index = TIMER_INDEX_TRIGGERED;
+        STAILQ_INSERT_TAIL(&ctxt->trig_list, timer, link);
+    }
+    // A callback may stop any timer of trig_list, see timer_stop().
+    while ((timer = STAILQ_FIRST(&ctxt->trig_list))) {
+        STAILQ_REMOVE_HEAD(&ctxt->trig_list, link);
+        (timer->group ? timer->group : &ctxt->group_default)->expire_count++;
+        if (timer->period_ms) {
+            if (timer->expire_ms + timer->period_ms < now_ms)
+                WARN("periodic timer overrun");
+            timer_start(timer->group, timer, timer->expire_ms + timer->period_ms);
+        } else {
+            timer_reset(timer);
         }
+        // WARN: timer->callback() is allowed to free(timer)
+        callback = timer->callback;
+        if (!callback)
+            continue;
+        if (g_cpu_usage_enabled)
+            cpu_usage_enter(&frame);
+        callback(timer->group, timer);
+        if (g_cpu_usage_enabled)
+            cpu_usage_leave(&frame, CPU_USAGE_TIMER, callback);
     }
     timer_schedule();
 }
 
+unsigned int timer_wakeup_rate(void)
+{
+    struct timer_ctxt *ctxt = timer_ctxt();
+    time_t now_s = time_now_ms(CLOCK_MONOTONIC) / 1000;
+
+    if (now_s == ctxt->wakeup_cur_s)
+        return ctxt->wakeup_prev_count;
+    if (now_s == ctxt->wakeup_cur_s + 1)
+        return ctxt->wakeup_cur_count;
+    return 0;
+}
+
 void timer_group_init(struct timer_group *group)
 {
     struct timer_ctxt *ctxt = timer_ctxt();
 
-    SLIST_INIT(&group->timers);
     SLIST_INSERT_HEAD(&ctxt->groups, group, link);
 }
 
+const struct timer_group *timer_group_default(void)
+{
+    struct timer_ctxt *ctxt = timer_ctxt();
+
+    return &ctxt->group_default;
+}
+
 void timer_start_abs(struct timer_group *group, struct timer_entry *timer, uint64_t expire_ms)
 {
     timer_stop(group, timer);
@@ -173,7 +283,7 @@ void timer_start_abs(struct timer_group *group, struct timer_entry *timer, uint6
 
 void timer_start_rel(struct timer_group *group, struct timer_entry *timer, uint64_t offset_ms)
 {
-    uint64_t start_ms = time_now_ms(CLOCK_MONOTONIC);
+    uint64_t start_ms = time_cached_ms();
 
     timer_start_abs(group, timer, start_ms + offset_ms);
     // More accurate than what is set by timer_start_abs()
@@ -187,10 +297,14 @@ void timer_stop(struct timer_group *group, struct timer_entry *timer)
 
     if (!timer->expire_ms)
         return;
-    if (!group)
-        group = &ctxt->group_default;
-    reschedule = (timer == SLIST_FIRST(&group->timers));
-    SLIST_REMOVE(&group->timers, timer, timer_entry, link);
+    BUG_ON(timer->group != group);
+    if (timer->heap_index == TIMER_INDEX_TRIGGERED) {
+        STAILQ_REMOVE(&ctxt->trig_list, timer, timer_entry, link);
+        timer_reset(timer);
+        return;
+    }
+    reschedule = !timer->heap_index;
+    timer_heap_remove(ctxt, timer);
     timer_reset(timer);
     if (reschedule)
         timer_schedule();
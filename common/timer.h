@@ -16,13 +16,15 @@
 
 #include <sys/queue.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "common/time_extra.h"
 
 /*
- * Timer module backed by a single timerfd. A sorted list of timers is
+ * Timer module backed by a single timerfd. A binary min-heap of timers is
  * maintained and the timerfd is always set to expire at the shortest timeout.
+ * Starting and stopping a timer is O(log n) in the total number of timers.
  *
  * Timer updates occur by calling timer_process() when the timer_fd() is ready,
  * which is typically queried using select() or poll().
@@ -45,27 +47,35 @@
  * from the callback function, but for convenience timer.period_ms provides an
  * automatic restart mechanism when set.
  *
+ * Timers which do not need to be accurate can set timer.slack_ms (similar to
+ * timer_slack_ns in Linux). Their expiration may then be delayed by up to
+ * slack_ms so that timers expiring close to each other are processed in a
+ * single wakeup.
+ *
  * Timers may be dynamically allocated, but they MUST be stopped before being
  * freed. Timers can even be freed from their callback functions (eg. lifetime
  * timers).
  */
 
-// Declare struct timer_list
-SLIST_HEAD(timer_list, timer_entry);
-
 struct timer_group {
-    struct timer_list timers;
     SLIST_ENTRY(timer_group) link;
+    // Read-only, number of expired timers of this group
+    uint64_t expire_count;
 };
 
 struct timer_entry {
     uint64_t period_ms;
+    uint64_t slack_ms;
     void (*callback)(struct timer_group *group, struct timer_entry *timer);
 
     // Read-only fields
     uint64_t start_ms;
     uint64_t expire_ms;
-    SLIST_ENTRY(timer_entry) link;
+
+    // Private fields
+    struct timer_group *group;
+    size_t heap_index;
+    STAILQ_ENTRY(timer_entry) link;
 };
 
 // File descriptor indicating when a timer event is ready to be processed.
@@ -77,9 +87,15 @@ struct timer_entry *timer_next(void);
 // Should be called when timer_fd() is ready.
 void timer_process(void);
 
+// Number of times timer_process() was called during the last second.
+unsigned int timer_wakeup_rate(void);
+
 // Should be called once per project submodule to register a new timer group.
 void timer_group_init(struct timer_group *group);
 
+// Group of the timers started with a NULL group.
+const struct timer_group *timer_group_default(void);
+
 // Start a timer using an absolute monotonic time.
 void timer_start_abs(struct timer_group *group, struct timer_entry *timer, uint64_t expire_ms);
 
@@ -101,7 +117,7 @@ static inline uint64_t timer_duration_ms(const struct timer_entry *timer)
 
 static inline uint64_t timer_remaining_ms(const struct timer_entry *timer)
 {
-    const uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    const uint64_t now_ms = time_cached_ms();
 
     return timer->expire_ms > now_ms ? timer->expire_ms - now_ms : 0;
 }
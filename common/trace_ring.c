@@ -0,0 +1,409 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/log.h"
+#include "common/memutils.h"
+#include "common/mathutils.h"
+
+#include "trace_ring.h"
+
+#define TRACE_RING_CACHE_BITS 11
+
+enum trace_ring_arg {
+    TRACE_RING_ARG_NONE, // "%%" or unsupported conversion
+    TRACE_RING_ARG_INT,
+    TRACE_RING_ARG_UINT,
+    TRACE_RING_ARG_DOUBLE,
+    TRACE_RING_ARG_STR,
+    TRACE_RING_ARG_PTR,
+    TRACE_RING_ARG_ERRNO,
+};
+
+struct trace_ring_conv {
+    const char *start; // Points to the '%'
+    const char *len_mod;
+    int len_mod_len;
+    bool width_star;
+    bool prec_star;
+    char conv;
+    enum trace_ring_arg type;
+};
+
+// Maps the address of format strings to their id in the ring header, so
+// strings are only compared and copied the first time they are used.
+struct trace_ring_cache_entry {
+    const char *fmt;
+    uint16_t id;
+};
+
+struct trace_ring_hdr *g_trace_ring = NULL;
+static struct trace_ring_cache_entry g_trace_ring_cache[1 << TRACE_RING_CACHE_BITS];
+static int g_trace_ring_cache_len;
+
+// Returns the remainder of the format string after the next conversion, or
+// NULL if there is no conversion left.
+static const char *trace_ring_conv_next(const char *fmt, struct trace_ring_conv *conv)
+{
+    fmt = strchr(fmt, '%');
+    if (!fmt)
+        return NULL;
+    memset(conv, 0, sizeof(*conv));
+    conv->start = fmt++;
+    fmt += strspn(fmt, "-+ #0'");
+    if (*fmt == '*') {
+        conv->width_star = true;
+        fmt++;
+    } else {
+        fmt += strspn(fmt, "0123456789");
+    }
+    if (*fmt == '.') {
+        fmt++;
+        if (*fmt == '*') {
+            conv->prec_star = true;
+            fmt++;
+        } else {
+            fmt += strspn(fmt, "0123456789");
+        }
+    }
+    conv->len_mod = fmt;
+    conv->len_mod_len = strspn(fmt, "hljztL");
+    fmt += conv->len_mod_len;
+    conv->conv = *fmt;
+    if (*fmt)
+        fmt++;
+    switch (conv->conv) {
+    case 'd': case 'i': case 'c':
+        conv->type = TRACE_RING_ARG_INT;
+        break;
+    case 'u': case 'x': case 'X': case 'o':
+        conv->type = TRACE_RING_ARG_UINT;
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        conv->type = TRACE_RING_ARG_DOUBLE;
+        break;
+    case 's':
+        conv->type = TRACE_RING_ARG_STR;
+        break;
+    case 'p':
+        conv->type = TRACE_RING_ARG_PTR;
+        break;
+    case 'm':
+        conv->type = TRACE_RING_ARG_ERRNO;
+        break;
+    default:
+        conv->type = TRACE_RING_ARG_NONE;
+        break;
+    }
+    return fmt;
+}
+
+static bool trace_ring_len_mod_is(const struct trace_ring_conv *conv, const char *len_mod)
+{
+    return conv->len_mod_len == strlen(len_mod) && !memcmp(conv->len_mod, len_mod, conv->len_mod_len);
+}
+
+void trace_ring_open(const char *path, size_t size_bytes)
+{
+    struct trace_ring_hdr *ring;
+    size_t rec_count = 1;
+    size_t size;
+    int fd, ret;
+
+    while (rec_count * sizeof(struct trace_ring_rec) < size_bytes && rec_count < UINT32_MAX / 2 + 1)
+        rec_count *= 2;
+    size = sizeof(struct trace_ring_hdr) + rec_count * sizeof(struct trace_ring_rec);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    FATAL_ON(fd < 0, 2, "open %s: %m", path);
+    ret = ftruncate(fd, size);
+    FATAL_ON(ret < 0, 2, "ftruncate %s: %m", path);
+    ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    FATAL_ON(ring == MAP_FAILED, 2, "mmap %s: %m", path);
+    close(fd);
+    ring->version   = TRACE_RING_VERSION;
+    ring->rec_size  = sizeof(struct trace_ring_rec);
+    ring->rec_count = rec_count;
+    __atomic_store_n(&ring->magic, TRACE_RING_MAGIC, __ATOMIC_RELEASE);
+    memset(g_trace_ring_cache, 0, sizeof(g_trace_ring_cache));
+    g_trace_ring_cache_len = 0;
+    g_trace_ring = ring;
+}
+
+static uint16_t trace_ring_fmt_id(struct trace_ring_hdr *ring, const char *fmt)
+{
+    unsigned int mask = ARRAY_SIZE(g_trace_ring_cache) - 1;
+    unsigned int i = ((uintptr_t)fmt * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - TRACE_RING_CACHE_BITS);
+    size_t len;
+
+    for (; g_trace_ring_cache[i].fmt; i = (i + 1) & mask)
+        if (g_trace_ring_cache[i].fmt == fmt)
+            return g_trace_ring_cache[i].id;
+    len = strlen(fmt) + 1;
+    if (ring->fmt_count >= TRACE_RING_FMT_MAX ||
+        ring->fmt_data_len + len > TRACE_RING_FMT_SIZE ||
+        g_trace_ring_cache_len >= ARRAY_SIZE(g_trace_ring_cache) / 2)
+        return TRACE_RING_FMT_NONE;
+    memcpy(ring->fmt_data + ring->fmt_data_len, fmt, len);
+    ring->fmt_offset[ring->fmt_count] = ring->fmt_data_len;
+    ring->fmt_data_len += len;
+    // Readers only look at formats below fmt_count
+    __atomic_store_n(&ring->fmt_count, ring->fmt_count + 1, __ATOMIC_RELEASE);
+    g_trace_ring_cache[i].fmt = fmt;
+    g_trace_ring_cache[i].id = ring->fmt_count - 1;
+    g_trace_ring_cache_len++;
+    return g_trace_ring_cache[i].id;
+}
+
+static bool trace_ring_put(struct trace_ring_rec *rec, const void *data, size_t size)
+{
+    if (rec->args_len + size > sizeof(rec->args)) {
+        rec->flags |= TRACE_RING_TRUNCATED;
+        return false;
+    }
+    memcpy(rec->args + rec->args_len, data, size);
+    rec->args_len += size;
+    return true;
+}
+
+static bool trace_ring_put_u64(struct trace_ring_rec *rec, uint64_t val)
+{
+    return trace_ring_put(rec, &val, sizeof(val));
+}
+
+static bool trace_ring_put_str(struct trace_ring_rec *rec, const char *str)
+{
+    size_t room = sizeof(rec->args) - rec->args_len;
+    size_t len;
+
+    if (!str)
+        str = "(null)";
+    len = strnlen(str, room);
+    if (len < room)
+        return trace_ring_put(rec, str, len + 1);
+    if (room) {
+        memcpy(rec->args + rec->args_len, str, room - 1);
+        rec->args[sizeof(rec->args) - 1] = '\0';
+        rec->args_len = sizeof(rec->args);
+    }
+    rec->flags |= TRACE_RING_TRUNCATED;
+    return false;
+}
+
+static bool trace_ring_put_arg(struct trace_ring_rec *rec, const struct trace_ring_conv *conv,
+                               int saved_errno, va_list *ap)
+{
+    double dval;
+
+    switch (conv->type) {
+    case TRACE_RING_ARG_INT:
+        if (trace_ring_len_mod_is(conv, "hh"))
+            return trace_ring_put_u64(rec, (signed char)va_arg(*ap, int));
+        if (trace_ring_len_mod_is(conv, "h"))
+            return trace_ring_put_u64(rec, (short)va_arg(*ap, int));
+        if (trace_ring_len_mod_is(conv, "l"))
+            return trace_ring_put_u64(rec, va_arg(*ap, long));
+        if (trace_ring_len_mod_is(conv, "ll"))
+            return trace_ring_put_u64(rec, va_arg(*ap, long long));
+        if (trace_ring_len_mod_is(conv, "j"))
+            return trace_ring_put_u64(rec, va_arg(*ap, intmax_t));
+        if (trace_ring_len_mod_is(conv, "z"))
+            return trace_ring_put_u64(rec, va_arg(*ap, ssize_t));
+        if (trace_ring_len_mod_is(conv, "t"))
+            return trace_ring_put_u64(rec, va_arg(*ap, ptrdiff_t));
+        return trace_ring_put_u64(rec, va_arg(*ap, int));
+    case TRACE_RING_ARG_UINT:
+        if (trace_ring_len_mod_is(conv, "hh"))
+            return trace_ring_put_u64(rec, (unsigned char)va_arg(*ap, unsigned int));
+        if (trace_ring_len_mod_is(conv, "h"))
+            return trace_ring_put_u64(rec, (unsigned short)va_arg(*ap, unsigned int));
+        if (trace_ring_len_mod_is(conv, "l"))
+            return trace_ring_put_u64(rec, va_arg(*ap, unsigned long));
+        if (trace_ring_len_mod_is(conv, "ll"))
+            return trace_ring_put_u64(rec, va_arg(*ap, unsigned long long));
+        if (trace_ring_len_mod_is(conv, "j"))
+            return trace_ring_put_u64(rec, va_arg(*ap, uintmax_t));
+        if (trace_ring_len_mod_is(conv, "z"))
+            return trace_ring_put_u64(rec, va_arg(*ap, size_t));
+        if (trace_ring_len_mod_is(conv, "t"))
+            return trace_ring_put_u64(rec, va_arg(*ap, ptrdiff_t));
+        return trace_ring_put_u64(rec, va_arg(*ap, unsigned int));
+    case TRACE_RING_ARG_DOUBLE:
+        if (trace_ring_len_mod_is(conv, "L"))
+            dval = va_arg(*ap, long double);
+        else
+            dval = va_arg(*ap, double);
+        return trace_ring_put(rec, &dval, sizeof(dval));
+    case TRACE_RING_ARG_STR:
+        return trace_ring_put_str(rec, va_arg(*ap, const char *));
+    case TRACE_RING_ARG_PTR:
+        return trace_ring_put_u64(rec, (uintptr_t)va_arg(*ap, void *));
+    case TRACE_RING_ARG_ERRNO:
+        return trace_ring_put_u64(rec, saved_errno);
+    default:
+        return true;
+    }
+}
+
+void trace_ring_vprintf(const char *fmt, va_list ap)
+{
+    struct trace_ring_hdr *ring = g_trace_ring;
+    int saved_errno = errno;
+    struct trace_ring_conv conv;
+    struct trace_ring_rec *rec;
+    struct timespec tp;
+    uint64_t head;
+    va_list aq;
+
+    BUG_ON(!ring);
+    head = ring->head;
+    rec = &ring->recs[head & (ring->rec_count - 1)];
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    clock_gettime(CLOCK_REALTIME, &tp);
+    rec->time_us  = tp.tv_sec * UINT64_C(1000000) + tp.tv_nsec / 1000;
+    rec->fmt_id   = trace_ring_fmt_id(ring, fmt);
+    rec->args_len = 0;
+    rec->flags    = 0;
+    va_copy(aq, ap);
+    while (rec->fmt_id != TRACE_RING_FMT_NONE && (fmt = trace_ring_conv_next(fmt, &conv))) {
+        if (conv.width_star && !trace_ring_put_u64(rec, va_arg(aq, int)))
+            break;
+        if (conv.prec_star && !trace_ring_put_u64(rec, va_arg(aq, int)))
+            break;
+        if (!trace_ring_put_arg(rec, &conv, saved_errno, &aq))
+            break;
+    }
+    va_end(aq);
+    __atomic_store_n(&rec->seq, head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    errno = saved_errno;
+}
+
+void trace_ring_printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    trace_ring_vprintf(fmt, ap);
+    va_end(ap);
+}
+
+__attribute__((format(printf, 4, 5)))
+static void trace_ring_out(char *out, size_t out_len, int *ret, const char *fmt, ...)
+{
+    size_t pos = MIN((size_t)*ret, out_len);
+    va_list ap;
+
+    va_start(ap, fmt);
+    *ret += vsnprintf(out + pos, out_len - pos, fmt, ap);
+    va_end(ap);
+}
+
+static bool trace_ring_get(const uint8_t *args, size_t args_len, size_t *off, void *val, size_t size)
+{
+    if (*off + size > args_len)
+        return false;
+    memcpy(val, args + *off, size);
+    *off += size;
+    return true;
+}
+
+int trace_ring_format(char *out, size_t out_len, const char *fmt,
+                      const uint8_t *args, size_t args_len)
+{
+    struct trace_ring_conv conv;
+    const char *next, *str;
+    char spec[64];
+    size_t off = 0;
+    size_t spec_len;
+    uint64_t val;
+    double dval;
+    int ret = 0;
+
+    if (out_len)
+        out[0] = '\0';
+    while ((next = trace_ring_conv_next(fmt, &conv))) {
+        trace_ring_out(out, out_len, &ret, "%.*s", (int)(conv.start - fmt), fmt);
+        fmt = next;
+        if (conv.type == TRACE_RING_ARG_NONE && conv.conv == '%') {
+            trace_ring_out(out, out_len, &ret, "%%");
+            continue;
+        }
+        if (conv.type == TRACE_RING_ARG_NONE) {
+            trace_ring_out(out, out_len, &ret, "%.*s", (int)(next - conv.start), conv.start);
+            continue;
+        }
+        // Rebuild the conversion with the '*' values and a length modifier
+        // matching the stored argument.
+        spec_len = 0;
+        for (const char *p = conv.start; p < conv.len_mod && spec_len < sizeof(spec) - 24; p++) {
+            if (*p != '*') {
+                spec[spec_len++] = *p;
+                continue;
+            }
+            if (!trace_ring_get(args, args_len, &off, &val, sizeof(val)))
+                goto truncated;
+            spec_len += sprintf(spec + spec_len, "%d", (int)val);
+        }
+        if ((conv.type == TRACE_RING_ARG_INT || conv.type == TRACE_RING_ARG_UINT) && conv.conv != 'c')
+            spec[spec_len++] = 'j';
+        spec[spec_len++] = conv.type == TRACE_RING_ARG_ERRNO ? 's' : conv.conv;
+        spec[spec_len] = '\0';
+        switch (conv.type) {
+        case TRACE_RING_ARG_STR:
+            str = off < args_len ? memchr(args + off, '\0', args_len - off) : NULL;
+            if (!str)
+                goto truncated;
+            trace_ring_out(out, out_len, &ret, spec, (const char *)args + off);
+            off = str - (const char *)args + 1;
+            break;
+        case TRACE_RING_ARG_DOUBLE:
+            if (!trace_ring_get(args, args_len, &off, &dval, sizeof(dval)))
+                goto truncated;
+            trace_ring_out(out, out_len, &ret, spec, dval);
+            break;
+        default:
+            if (!trace_ring_get(args, args_len, &off, &val, sizeof(val)))
+                goto truncated;
+            if (conv.type == TRACE_RING_ARG_INT && conv.conv == 'c')
+                trace_ring_out(out, out_len, &ret, spec, (int)val);
+            else if (conv.type == TRACE_RING_ARG_INT)
+                trace_ring_out(out, out_len, &ret, spec, (intmax_t)val);
+            else if (conv.type == TRACE_RING_ARG_UINT)
+                trace_ring_out(out, out_len, &ret, spec, (uintmax_t)val);
+            else if (conv.type == TRACE_RING_ARG_PTR)
+                trace_ring_out(out, out_len, &ret, spec, (void *)(uintptr_t)val);
+            else
+                trace_ring_out(out, out_len, &ret, spec, strerror(val));
+            break;
+        }
+    }
+    trace_ring_out(out, out_len, &ret, "%s", fmt);
+    return ret;
+
+truncated:
+    trace_ring_out(out, out_len, &ret, "[...]");
+    return ret;
+}
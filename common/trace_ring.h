@@ -0,0 +1,89 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_TRACE_RING_H
+#define COMMON_TRACE_RING_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary trace ring. When enabled, TRACE() does not format anything: each
+ * call stores a fixed-size record (timestamp, format id, raw arguments) in a
+ * memory mapped file. Format strings are interned in the file header the first
+ * time they are seen, so the file is self-describing and can be decoded
+ * offline (or while the process is running) by wsbrd-trace-decode.
+ *
+ * There is a single writer. Readers rely on trace_ring_rec.seq to detect
+ * records which are being overwritten, so no lock is needed.
+ *
+ * Arguments are stored in the order of the conversions of the format string:
+ * integers (including %c and '*' width/precision) and pointers as 8 bytes,
+ * doubles as 8 bytes, errno as 8 bytes for %m, and strings inline with their
+ * terminating null byte. When the record is full, the remaining arguments are
+ * dropped and TRACE_RING_TRUNCATED is set.
+ */
+
+#define TRACE_RING_MAGIC     0x52545357 // "WSTR"
+#define TRACE_RING_VERSION   1
+#define TRACE_RING_FMT_MAX   1024
+#define TRACE_RING_FMT_SIZE  (64 * 1024)
+#define TRACE_RING_ARGS_SIZE 232
+#define TRACE_RING_FMT_NONE  UINT16_MAX
+
+#define TRACE_RING_TRUNCATED 0x01
+
+struct trace_ring_rec {
+    // Index of the record + 1 once complete, 0 while it is written
+    uint64_t seq;
+    uint64_t time_us; // CLOCK_REALTIME
+    uint16_t fmt_id;
+    uint8_t  args_len;
+    uint8_t  flags;
+    uint8_t  reserved[4];
+    uint8_t  args[TRACE_RING_ARGS_SIZE];
+};
+
+struct trace_ring_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size;
+    uint32_t rec_count; // Power of 2
+    uint32_t fmt_count;
+    uint32_t fmt_data_len;
+    uint32_t reserved;
+    // Number of records written since the ring was created
+    uint64_t head;
+    uint32_t fmt_offset[TRACE_RING_FMT_MAX];
+    char fmt_data[TRACE_RING_FMT_SIZE];
+    struct trace_ring_rec recs[];
+};
+
+extern struct trace_ring_hdr *g_trace_ring;
+
+// Create (or truncate) the file at path and start recording into it. The
+// number of records is rounded up to a power of 2.
+void trace_ring_open(const char *path, size_t size_bytes);
+
+__attribute__((format(printf, 1, 2)))
+void trace_ring_printf(const char *fmt, ...);
+__attribute__((format(printf, 1, 0)))
+void trace_ring_vprintf(const char *fmt, va_list ap);
+
+// Format a record the same way printf() would have done. Returns the length
+// of the output (not truncated to out_len), like snprintf().
+int trace_ring_format(char *out, size_t out_len, const char *fmt,
+                      const uint8_t *args, size_t args_len);
+
+#endif
@@ -31,16 +31,15 @@ static void trickle_interval_begin(struct trickle *tkl)
      */
     tkl->c = 0;
     t_ms = randf_range(tkl->I_ms / 2, tkl->I_ms);
-    timer_start_rel(NULL, &tkl->timer_transmit, t_ms);
-    timer_start_rel(NULL, &tkl->timer_interval, tkl->I_ms);
+    tkl->interval_start_ms = time_cached_ms();
+    tkl->transmit_done = false;
+    timer_start_abs(NULL, &tkl->timer, tkl->interval_start_ms + t_ms);
     TRACE(TR_TRICKLE, "tkl %-4s begin: t=%us I[%u,%u]=%us", tkl->debug_name,
           t_ms / 1000, tkl->cfg->Imin_ms / 1000, tkl->cfg->Imax_ms / 1000, tkl->I_ms / 1000);
 }
 
-static void trickle_interval_done(struct timer_group *group, struct timer_entry *timer)
+static void trickle_interval_done(struct trickle *tkl)
 {
-    struct trickle *tkl = container_of(timer, struct trickle, timer_interval);
-
     /*
      * When the interval I expires, Trickle doubles the interval length. If
      * this new interval length would be longer than the time specified by
@@ -54,9 +53,8 @@ static void trickle_interval_done(struct timer_group *group, struct timer_entry
         tkl->on_interval_done(tkl);
 }
 
-static void trickle_transmit(struct timer_group *group, struct timer_entry *timer)
+static void trickle_transmit(struct trickle *tkl)
 {
-    struct trickle *tkl = container_of(timer, struct trickle, timer_transmit);
     bool tx;
 
     /*
@@ -67,17 +65,29 @@ static void trickle_transmit(struct timer_group *group, struct timer_entry *time
     TRACE(TR_TRICKLE, "tkl %-4s %-5s: c=%u k=%d", tkl->debug_name,
           tx ? "tx" : "skip", tkl->c, tkl->cfg->k);
 
+    // Rearmed before the callback, which may reset the timer
+    tkl->transmit_done = true;
+    timer_start_abs(NULL, &tkl->timer, tkl->interval_start_ms + tkl->I_ms);
     if (tx && tkl->on_transmit)
         tkl->on_transmit(tkl);
 }
 
+static void trickle_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct trickle *tkl = container_of(timer, struct trickle, timer);
+
+    if (tkl->transmit_done)
+        trickle_interval_done(tkl);
+    else
+        trickle_transmit(tkl);
+}
+
 void trickle_init(struct trickle *tkl)
 {
     BUG_ON(!tkl);
     BUG_ON(!tkl->cfg);
     BUG_ON(tkl->cfg->Imin_ms > tkl->cfg->Imax_ms);
-    tkl->timer_interval.callback = trickle_interval_done;
-    tkl->timer_transmit.callback = trickle_transmit;
+    tkl->timer.callback = trickle_timer;
 }
 
 void trickle_start(struct trickle *tkl)
@@ -94,8 +104,7 @@ void trickle_start(struct trickle *tkl)
 
 void trickle_stop(struct trickle *tkl)
 {
-    timer_stop(NULL, &tkl->timer_interval);
-    timer_stop(NULL, &tkl->timer_transmit);
+    timer_stop(NULL, &tkl->timer);
     TRACE(TR_TRICKLE, "tkl %-4s stop", tkl->debug_name);
 }
 
@@ -14,6 +14,7 @@
 #ifndef TRICKLE_H
 #define TRICKLE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "common/timer.h"
@@ -39,8 +40,10 @@ struct trickle {
     unsigned int I_ms; // Current Interval Size
     unsigned int c;    // Consistent Counter
 
-    struct timer_entry timer_interval;
-    struct timer_entry timer_transmit;
+    // A single timer expires at t, and then at the end of the interval
+    struct timer_entry timer;
+    uint64_t interval_start_ms;
+    bool transmit_done;
 
     char debug_name[4];
     void (*on_transmit)(struct trickle *tkl);
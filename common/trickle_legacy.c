@@ -128,6 +128,21 @@ bool trickle_legacy_tick(trickle_legacy_t *t, const trickle_legacy_params_t *par
     return transmit;
 }
 
+bool trickle_legacy_advance(trickle_legacy_t *t, const trickle_legacy_params_t *params)
+{
+    if (!trickle_legacy_running(t, params))
+        return false;
+    if (t->now >= t->t)
+        return false;
+    if (t->c >= params->k && params->k != 0)
+        return false;
+    TRACE(TR_TRICKLE, "tkl %-8s early: t=%ds I[%d,%d]=%ds k=%d c=%d",
+          t->debug_name, t->now, params->Imin, params->Imax, t->I, params->k, t->c);
+    /* RFC 6206 Rule 4 will not fire again in this interval */
+    t->t = t->now;
+    return true;
+}
+
 /* Stop the timer (by setting e to infinite) */
 void trickle_legacy_stop(trickle_legacy_t *t)
 {
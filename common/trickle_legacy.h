@@ -75,4 +75,10 @@ void trickle_legacy_inconsistent(trickle_legacy_t *t, const trickle_legacy_param
  */
 bool trickle_legacy_tick(trickle_legacy_t *t, const trickle_legacy_params_t *params, uint16_t ticks);
 
+/* Move the transmission of the current interval to now, if it is still
+ * pending and not suppressed. If return true, you should transmit information
+ * now
+ */
+bool trickle_legacy_advance(trickle_legacy_t *t, const trickle_legacy_params_t *params);
+
 #endif
@@ -217,6 +217,20 @@ void tun_route_del(struct tun_ctx *tun, const struct in6_addr *addr)
     nl_addr_put(nladdr);
 }
 
+void tun_link_set_mtu(struct tun_ctx *tun, int mtu)
+{
+    struct rtnl_link *link;
+    int ret;
+
+    link = rtnl_link_alloc();
+    FATAL_ON(!link, 2, "rtnl_link_alloc: %s", strerror(ENOMEM));
+    rtnl_link_set_ifindex(link, tun->ifindex);
+    rtnl_link_set_mtu(link, mtu);
+    ret = rtnl_link_add(tun->nlsock, link, NLM_F_CREATE);
+    FATAL_ON(ret < 0, 2, "rtnl_link_add: %s", nl_geterror(ret));
+    rtnl_link_put(link);
+}
+
 static int tun_addr_get(struct tun_ctx *tun, struct in6_addr *addr,
                         bool accept_uc_global, bool accept_linklocal)
 {
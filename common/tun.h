@@ -53,6 +53,9 @@ void tun_route_add(struct tun_ctx *tun, const struct in6_addr *addr);
 // ip -6 route del dev [tun->ifname] [addr]
 void tun_route_del(struct tun_ctx *tun, const struct in6_addr *addr);
 
+// ip link set dev [tun->ifname] mtu [mtu]
+void tun_link_set_mtu(struct tun_ctx *tun, int mtu);
+
 // sysctl [dir]/[ifname]/key=[val]
 void tun_sysctl_set(const char *dir, const char *ifname, const char *key, char val);
 
@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "common/log.h"
+#include "common/memutils.h"
+
+#include "work_pool.h"
+
+static void *work_pool_thread(void *arg)
+{
+    struct work_pool *pool = arg;
+    struct work_item *item;
+
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        while (!(item = STAILQ_FIRST(&pool->pending)))
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        STAILQ_REMOVE_HEAD(&pool->pending, link);
+        pthread_mutex_unlock(&pool->lock);
+
+        item->work(pool, item);
+        pthread_mutex_lock(&pool->lock);
+        STAILQ_INSERT_TAIL(&pool->done, item, link);
+        pthread_mutex_unlock(&pool->lock);
+        // Writing to an eventfd is thread safe
+        eventfd_write(pool->efd, 1);
+    }
+    return NULL;
+}
+
+static void work_pool_done(struct event_source *src, uint32_t revents)
+{
+    struct work_pool *pool = container_of(src, struct work_pool, ev_done);
+    struct work_item_list done = STAILQ_HEAD_INITIALIZER(done);
+    struct work_item *item;
+    eventfd_t val;
+
+    eventfd_read(pool->efd, &val);
+    pthread_mutex_lock(&pool->lock);
+    STAILQ_CONCAT(&done, &pool->done);
+    pthread_mutex_unlock(&pool->lock);
+    // WARN: item->done() is allowed to submit the item again
+    while ((item = STAILQ_FIRST(&done))) {
+        STAILQ_REMOVE_HEAD(&done, link);
+        pool->busy_count--;
+        item->done(pool, item);
+    }
+}
+
+void work_pool_init(struct work_pool *pool, int thread_count)
+{
+    sigset_t sigset, sigset_old;
+    char name[24];
+    int ret;
+
+    BUG_ON(thread_count <= 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    STAILQ_INIT(&pool->pending);
+    STAILQ_INIT(&pool->done);
+    pool->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    FATAL_ON(pool->efd < 0, 2, "eventfd: %m");
+    pool->ev_done.fd       = pool->efd;
+    pool->ev_done.events   = EPOLLIN;
+    pool->ev_done.callback = work_pool_done;
+    event_loop_add(&pool->ev_done);
+    pool->threads = xalloc(thread_count * sizeof(*pool->threads));
+    pool->thread_count = thread_count;
+    // Signals are handled by the main thread, the workers must not be
+    // interrupted while the main thread modifies the state.
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_SETMASK, &sigset, &sigset_old);
+    for (int i = 0; i < thread_count; i++) {
+        ret = pthread_create(&pool->threads[i], NULL, work_pool_thread, pool);
+        FATAL_ON(ret, 2, "pthread_create: %s", strerror(ret));
+        snprintf(name, sizeof(name), "worker-%d", i);
+        pthread_setname_np(pool->threads[i], name);
+    }
+    pthread_sigmask(SIG_SETMASK, &sigset_old, NULL);
+}
+
+void work_pool_submit(struct work_pool *pool, struct work_item *item)
+{
+    pool->busy_count++;
+    pthread_mutex_lock(&pool->lock);
+    STAILQ_INSERT_TAIL(&pool->pending, item, link);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef COMMON_WORK_POOL_H
+#define COMMON_WORK_POOL_H
+
+#include <sys/queue.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "common/event_loop.h"
+
+/*
+ * Pool of threads running CPU intensive jobs (typically cryptography) out of
+ * the main event loop. The work() callback of an item runs on a worker thread
+ * and must not touch any state shared with the main thread. Once it returns,
+ * the done() callback is called by the main thread through the event loop, so
+ * the rest of the processing stays single-threaded.
+ */
+
+struct work_pool;
+
+struct work_item {
+    void (*work)(struct work_pool *pool, struct work_item *item);
+    void (*done)(struct work_pool *pool, struct work_item *item);
+    STAILQ_ENTRY(work_item) link;
+};
+
+// Declare struct work_item_list
+STAILQ_HEAD(work_item_list, work_item);
+
+struct work_pool {
+    pthread_t *threads;
+    int thread_count;
+    int efd;
+    struct event_source ev_done;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct work_item_list pending;
+    struct work_item_list done;
+    int busy_count; // Only accessed by the main thread
+};
+
+// Also adds the pool to the event loop.
+void work_pool_init(struct work_pool *pool, int thread_count);
+void work_pool_submit(struct work_pool *pool, struct work_item *item);
+
+#endif
@@ -11,10 +11,12 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "common/ws/ws_interface.h"
@@ -46,43 +48,96 @@ int eapol_relay_start(const char ifname[IF_NAMESIZE])
     return fd;
 }
 
-ssize_t eapol_relay_recv(int fd, void *buf, size_t buf_len, struct in6_addr *src,
-                         struct eui64 *supp_eui64, uint8_t *kmp_id)
+// Transmissions held by eapol_relay_tx_hold(), sent by eapol_relay_tx_flush()
+struct eapol_relay_tx {
+    struct eui64 supp_eui64;
+    uint8_t kmp_id;
+    uint8_t buf[1500];
+    struct iovec iov[3];
+    struct sockaddr_in6 dst;
+};
+
+static struct {
+    int fd; // -1 when not held
+    struct eapol_relay_tx tx[EAPOL_RELAY_BATCH];
+    struct mmsghdr tx_msg[EAPOL_RELAY_BATCH];
+    int tx_count;
+} g_eapol_relay_tx = { .fd = -1 };
+
+int eapol_relay_recv_batch(int fd, struct eapol_relay_rx rx[EAPOL_RELAY_BATCH])
 {
-    struct iovec iov[3] = {
-        // Wi-SUN FAN 1.1v08 Figure 6-1 EAPOL Relay Datagram
-        { .iov_base = supp_eui64, .iov_len = sizeof(*supp_eui64) },
-        { .iov_base = kmp_id,     .iov_len = sizeof(*kmp_id) },
-        { .iov_base = buf,        .iov_len = buf_len },
-    };
-    struct sockaddr_in6 sin6;
-    struct msghdr msg = {
-        .msg_iov     = iov,
-        .msg_iovlen  = ARRAY_SIZE(iov),
-        .msg_name    = &sin6,
-        .msg_namelen = sizeof(sin6),
-    };
-    ssize_t ret;
+    static struct mmsghdr msg[EAPOL_RELAY_BATCH];
+    static struct sockaddr_in6 src[EAPOL_RELAY_BATCH];
+    static struct iovec iov[EAPOL_RELAY_BATCH][3];
+    int count, ret;
 
-    ret = recvmsg(fd, &msg, 0);
+    for (int i = 0; i < EAPOL_RELAY_BATCH; i++) {
+        // Wi-SUN FAN 1.1v08 Figure 6-1 EAPOL Relay Datagram
+        iov[i][0] = (struct iovec){ &rx[i].supp_eui64, sizeof(rx[i].supp_eui64) };
+        iov[i][1] = (struct iovec){ &rx[i].kmp_id,     sizeof(rx[i].kmp_id) };
+        iov[i][2] = (struct iovec){ rx[i].buf,         sizeof(rx[i].buf) };
+        msg[i].msg_hdr = (struct msghdr){
+            .msg_iov     = iov[i],
+            .msg_iovlen  = ARRAY_SIZE(iov[i]),
+            .msg_name    = &src[i],
+            .msg_namelen = sizeof(src[i]),
+        };
+    }
+    // The first datagram is available, do not wait for the others
+    ret = recvmmsg(fd, msg, EAPOL_RELAY_BATCH, MSG_WAITFORONE, NULL);
     if (ret < 0) {
-        WARN("%s: recv: %m", __func__);
+        WARN("%s: recvmmsg: %m", __func__);
         return -errno;
     }
-    if (ret < sizeof(*supp_eui64) + sizeof(*kmp_id)) {
-        TRACE(TR_DROP, "drop %-9s: malformed packet", "eapol-rel");
-        return -EINVAL;
+    count = 0;
+    for (int i = 0; i < ret; i++) {
+        if (msg[i].msg_len < sizeof(rx[i].supp_eui64) + sizeof(rx[i].kmp_id)) {
+            TRACE(TR_DROP, "drop %-9s: malformed packet", "eapol-rel");
+            continue;
+        }
+        rx[i].buf_len = msg[i].msg_len - sizeof(rx[i].supp_eui64) - sizeof(rx[i].kmp_id);
+        if (count != i) {
+            rx[count].supp_eui64 = rx[i].supp_eui64;
+            rx[count].kmp_id     = rx[i].kmp_id;
+            rx[count].buf_len    = rx[i].buf_len;
+            memcpy(rx[count].buf, rx[i].buf, rx[i].buf_len);
+        }
+        rx[count].src = src[i].sin6_addr;
+        TRACE(TR_SECURITY, "sec: %-8s supp=%s", "rx-eapol-rel", tr_eui64(rx[count].supp_eui64.u8));
+        count++;
     }
-    ret -= sizeof(*supp_eui64) + sizeof(*kmp_id);
-    if (src)
-        *src = sin6.sin6_addr;
-    TRACE(TR_SECURITY, "sec: %-8s supp=%s", "rx-eapol-rel", tr_eui64(supp_eui64->u8));
-    return ret;
+    return count;
 }
 
-void eapol_relay_send(int fd, const void *buf, size_t buf_len,
-                      const struct in6_addr *dst,
-                      const struct eui64 *supp_eui64, uint8_t kmp_id)
+void eapol_relay_tx_hold(int fd)
+{
+    if (g_eapol_relay_tx.fd != fd)
+        eapol_relay_tx_flush();
+    g_eapol_relay_tx.fd = fd;
+}
+
+void eapol_relay_tx_flush(void)
+{
+    int sent = 0;
+    int ret;
+
+    while (sent < g_eapol_relay_tx.tx_count) {
+        ret = sendmmsg(g_eapol_relay_tx.fd, g_eapol_relay_tx.tx_msg + sent,
+                       g_eapol_relay_tx.tx_count - sent, 0);
+        if (ret < 0) {
+            // The first datagram failed, the others may still be sent
+            TRACE(TR_TX_ABORT, "tx-abort %-9s: %m", "eapol-rel");
+            ret = 1;
+        }
+        sent += ret;
+    }
+    g_eapol_relay_tx.tx_count = 0;
+    g_eapol_relay_tx.fd = -1;
+}
+
+static void eapol_relay_sendmsg(int fd, const void *buf, size_t buf_len,
+                                const struct sockaddr_in6 *dst,
+                                const struct eui64 *supp_eui64, uint8_t kmp_id)
 {
     struct iovec iov[] = {
         // Wi-SUN FAN 1.1v08 Figure 6-1 EAPOL Relay Datagram
@@ -90,21 +145,54 @@ void eapol_relay_send(int fd, const void *buf, size_t buf_len,
         { .iov_base = &kmp_id,            .iov_len = sizeof(kmp_id)      },
         { .iov_base = (void*)buf,         .iov_len = buf_len             },
     };
-    struct sockaddr_in6 sin6 = {
-        .sin6_family = AF_INET6,
-        .sin6_port   = htons(EAPOL_RELAY_PORT),
-        .sin6_addr   = *dst,
-    };
     struct msghdr msg = {
         .msg_iov     = iov,
         .msg_iovlen  = ARRAY_SIZE(iov),
-        .msg_name    = &sin6,
-        .msg_namelen = sizeof(sin6),
+        .msg_name    = (void *)dst,
+        .msg_namelen = sizeof(*dst),
     };
     ssize_t ret;
 
-    TRACE(TR_SECURITY, "sec: %-8s supp=%s", "tx-eapol-rel", tr_eui64(supp_eui64->u8));
     ret = sendmsg(fd, &msg, 0);
     if (ret < 0)
         TRACE(TR_TX_ABORT, "tx-abort %-9s: %m", "eapol-rel");
 }
+
+void eapol_relay_send(int fd, const void *buf, size_t buf_len,
+                      const struct in6_addr *dst,
+                      const struct eui64 *supp_eui64, uint8_t kmp_id)
+{
+    struct sockaddr_in6 sin6 = {
+        .sin6_family = AF_INET6,
+        .sin6_port   = htons(EAPOL_RELAY_PORT),
+        .sin6_addr   = *dst,
+    };
+    struct eapol_relay_tx *tx;
+    struct mmsghdr *msg;
+
+    TRACE(TR_SECURITY, "sec: %-8s supp=%s", "tx-eapol-rel", tr_eui64(supp_eui64->u8));
+    if (g_eapol_relay_tx.fd != fd || buf_len > sizeof(tx->buf)) {
+        eapol_relay_sendmsg(fd, buf, buf_len, &sin6, supp_eui64, kmp_id);
+        return;
+    }
+    if (g_eapol_relay_tx.tx_count == EAPOL_RELAY_BATCH) {
+        eapol_relay_tx_flush();
+        g_eapol_relay_tx.fd = fd;
+    }
+    tx  = &g_eapol_relay_tx.tx[g_eapol_relay_tx.tx_count];
+    msg = &g_eapol_relay_tx.tx_msg[g_eapol_relay_tx.tx_count];
+    g_eapol_relay_tx.tx_count++;
+    tx->supp_eui64 = *supp_eui64;
+    tx->kmp_id = kmp_id;
+    memcpy(tx->buf, buf, buf_len);
+    tx->dst = sin6;
+    tx->iov[0] = (struct iovec){ &tx->supp_eui64, sizeof(tx->supp_eui64) };
+    tx->iov[1] = (struct iovec){ &tx->kmp_id,     sizeof(tx->kmp_id) };
+    tx->iov[2] = (struct iovec){ tx->buf,         buf_len };
+    msg->msg_hdr = (struct msghdr){
+        .msg_iov     = tx->iov,
+        .msg_iovlen  = ARRAY_SIZE(tx->iov),
+        .msg_name    = &tx->dst,
+        .msg_namelen = sizeof(tx->dst),
+    };
+}
@@ -14,19 +14,38 @@
 #ifndef EAPOL_RELAY_H
 #define EAPOL_RELAY_H
 
+#include <netinet/in.h>
 #include <net/if.h>
 #include <stddef.h>
 #include <stdint.h>
 
-struct eui64;
-struct in6_addr;
+#include "common/ieee802154_frame.h"
 
 // Wi-SUN FAN 1.1v08 6.2.1 Constants
 #define EAPOL_RELAY_PORT 10253
 
+#define EAPOL_RELAY_BATCH 16
+
+struct eapol_relay_rx {
+    struct in6_addr src;
+    struct eui64 supp_eui64;
+    uint8_t kmp_id;
+    size_t buf_len;
+    uint8_t buf[1500];
+};
+
 int eapol_relay_start(const char ifname[IF_NAMESIZE]);
-ssize_t eapol_relay_recv(int fd, void *buf, size_t buf_len, struct in6_addr *src,
-                         struct eui64 *supp_eui64, uint8_t *kmp_id);
+
+// Return the number of valid datagrams stored in rx, or a negative errno.
+int eapol_relay_recv_batch(int fd, struct eapol_relay_rx rx[EAPOL_RELAY_BATCH]);
+
+/*
+ * Between eapol_relay_tx_hold() and eapol_relay_tx_flush(), the datagrams sent
+ * on fd are queued and then sent at once with sendmmsg(). This is meant to
+ * answer a batch of received datagrams. Outside, they are sent immediately.
+ */
+void eapol_relay_tx_hold(int fd);
+void eapol_relay_tx_flush(void);
 void eapol_relay_send(int fd, const void *buf, size_t buf_len,
                       const struct in6_addr *dst,
                       const struct eui64 *supp_eui64, uint8_t kmp_id);
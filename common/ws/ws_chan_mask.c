@@ -11,35 +11,57 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <assert.h>
 #include <errno.h>
 
 #include "common/ws/ws_regdb.h"
+#include "common/specs/ws.h"
 #include "common/bits.h"
+#include "common/endian.h"
 #include "common/log.h"
 #include "common/hif.h"
 #include "common/parsers.h"
 
 #include "ws_chan_mask.h"
 
+/*
+ * Masks are processed 64 channels at a time. Channel i is bit i % 8 of byte
+ * i / 8 (see bittest()), so it is bit i % 64 of little-endian word i / 64.
+ */
+#define WS_CHAN_MASK_WORDS (WS_CHAN_MASK_LEN / 8)
+
+static_assert(WS_CHAN_MASK_LEN % 8 == 0, "channel masks must be made of 64-bit words");
+
+static uint64_t ws_chan_mask_word(const uint8_t chan_mask[WS_CHAN_MASK_LEN], int i)
+{
+    return read_le64(chan_mask + 8 * i);
+}
+
 int ws_chan_mask_get_fixed(const uint8_t chan_mask[WS_CHAN_MASK_LEN])
 {
     int val = -EINVAL;
+    uint64_t word;
 
-    for (int i = 0; i < 8 * WS_CHAN_MASK_LEN; i++) {
-        if (bittest(chan_mask, i)) {
-            if (val >= 0)
-                return -EINVAL;
-            val = i;
-        }
+    for (int i = 0; i < WS_CHAN_MASK_WORDS; i++) {
+        word = ws_chan_mask_word(chan_mask, i);
+        if (!word)
+            continue;
+        if (val >= 0 || __builtin_popcountll(word) != 1)
+            return -EINVAL;
+        val = 64 * i + __builtin_ctzll(word);
     }
     return val;
 }
 
 int ws_chan_mask_width(const uint8_t chan_mask[WS_CHAN_MASK_LEN])
 {
-    for (int i = WS_CHAN_MASK_LEN - 1; i >= 0; i--)
-        if (chan_mask[i])
-            return i + 1;
+    uint64_t word;
+
+    for (int i = WS_CHAN_MASK_WORDS - 1; i >= 0; i--) {
+        word = ws_chan_mask_word(chan_mask, i);
+        if (word)
+            return 8 * i + (63 - __builtin_clzll(word)) / 8 + 1;
+    }
     return 0;
 }
 
@@ -78,21 +100,78 @@ void ws_chan_mask_calc_excl(uint8_t chan_mask_excl[WS_CHAN_MASK_LEN],
     if (ws_chan_mask_get_fixed(chan_mask_custom) >= 0) {
         memset(chan_mask_excl, 0, WS_CHAN_MASK_LEN);
     } else {
-        for (int i = 0; i < WS_CHAN_MASK_LEN; i++)
-            chan_mask_excl[i] = chan_mask_reg[i] & ~chan_mask_custom[i];
+        for (int i = 0; i < WS_CHAN_MASK_WORDS; i++)
+            write_le64(chan_mask_excl + 8 * i,
+                       ws_chan_mask_word(chan_mask_reg, i) & ~ws_chan_mask_word(chan_mask_custom, i));
     }
 }
 
 int ws_chan_mask_ranges(const uint8_t chan_mask[WS_CHAN_MASK_LEN])
 {
-    bool in_range = false;
+    uint64_t word, prev = 0;
     int cnt = 0;
 
-    for (int i = 0; i < 8 * WS_CHAN_MASK_LEN; i++) {
-        if (in_range != bittest(chan_mask, i)) {
-            in_range = !in_range;
-            cnt += in_range;
-        }
+    // Count the first channel of each range: set, with the previous one unset
+    for (int i = 0; i < WS_CHAN_MASK_WORDS; i++) {
+        word = ws_chan_mask_word(chan_mask, i);
+        cnt += __builtin_popcountll(word & ~(word << 1 | prev >> 63));
+        prev = word;
     }
     return cnt;
 }
+
+// Return the first channel >= chan whose bit is val, or 8 * WS_CHAN_MASK_LEN
+static int ws_chan_mask_find(const uint8_t chan_mask[WS_CHAN_MASK_LEN], int chan, bool val)
+{
+    uint64_t word;
+
+    for (int i = chan / 64; i < WS_CHAN_MASK_WORDS; i++) {
+        word = ws_chan_mask_word(chan_mask, i);
+        if (!val)
+            word = ~word;
+        if (i == chan / 64)
+            word &= UINT64_MAX << (chan % 64);
+        if (word)
+            return 64 * i + __builtin_ctzll(word);
+    }
+    return 8 * WS_CHAN_MASK_LEN;
+}
+
+int ws_chan_mask_range_next(const uint8_t chan_mask[WS_CHAN_MASK_LEN], int chan, int *last)
+{
+    int first;
+
+    if (chan >= 8 * WS_CHAN_MASK_LEN)
+        return -1;
+    first = ws_chan_mask_find(chan_mask, chan, true);
+    if (first == 8 * WS_CHAN_MASK_LEN)
+        return -1;
+    *last = ws_chan_mask_find(chan_mask, first, false) - 1;
+    return first;
+}
+
+int ws_chan_mask_excl_ctrl(const uint8_t chan_mask_excl[WS_CHAN_MASK_LEN], int *len)
+{
+    uint64_t word, prev = 0;
+    int range_cnt = 0;
+    int width = 0;
+
+    for (int i = 0; i < WS_CHAN_MASK_WORDS; i++) {
+        word = ws_chan_mask_word(chan_mask_excl, i);
+        range_cnt += __builtin_popcountll(word & ~(word << 1 | prev >> 63));
+        if (word)
+            width = 8 * i + (63 - __builtin_clzll(word)) / 8 + 1;
+        prev = word;
+    }
+    if (!width) {
+        *len = 0;
+        return WS_EXC_CHAN_CTRL_NONE;
+    }
+    // Number of ranges (1 byte), then first and last channel (2 x 2 bytes)
+    if (width < 1 + 4 * range_cnt) {
+        *len = width;
+        return WS_EXC_CHAN_CTRL_BITMASK;
+    }
+    *len = 1 + 4 * range_cnt;
+    return WS_EXC_CHAN_CTRL_RANGE;
+}
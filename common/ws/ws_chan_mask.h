@@ -42,4 +42,12 @@ void ws_chan_mask_calc_excl(uint8_t chan_mask[WS_CHAN_MASK_LEN],
 // contains 2 ranges.
 int ws_chan_mask_ranges(const uint8_t chan_mask[WS_CHAN_MASK_LEN]);
 
+// Get the first range of channels starting at or after chan. Return its first
+// channel and set last to its last channel, or return -1 if there is none.
+int ws_chan_mask_range_next(const uint8_t chan_mask[WS_CHAN_MASK_LEN], int chan, int *last);
+
+// Choose the shortest encoding of the excluded channels in schedule IEs
+// (WS_EXC_CHAN_CTRL_*), and set len to the length of the field in bytes.
+int ws_chan_mask_excl_ctrl(const uint8_t chan_mask_excl[WS_CHAN_MASK_LEN], int *len);
+
 #endif
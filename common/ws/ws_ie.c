@@ -84,15 +84,13 @@ static uint16_t ws_chan_excl_len(const struct ws_fhss_config *fhss_config, bool
     const uint8_t *chan_mask_custom = unicast ? fhss_config->uc_chan_mask : fhss_config->bc_chan_mask;
     uint8_t chan_mask_excl[WS_CHAN_MASK_LEN];
     uint8_t chan_mask_reg[WS_CHAN_MASK_LEN];
+    int len;
 
     BUG_ON(!fhss_config->chan_params);
     ws_chan_mask_calc_reg(chan_mask_reg, fhss_config->chan_params, fhss_config->regional_regulation);
     ws_chan_mask_calc_excl(chan_mask_excl, chan_mask_reg, chan_mask_custom);
-
-    if (!memzcmp(chan_mask_excl, WS_CHAN_MASK_LEN))
-        return 0;
-    return MIN(ws_chan_mask_width(chan_mask_excl),
-               1 + 4 * ws_chan_mask_ranges(chan_mask_excl));
+    ws_chan_mask_excl_ctrl(chan_mask_excl, &len);
+    return len;
 }
 
 uint16_t ws_wp_nested_hopping_schedule_length(const struct ws_fhss_config *fhss_config, bool unicast)
@@ -295,6 +293,7 @@ static void ws_wp_schedule_base_write(struct iobuf_write *buf, const struct ws_f
     uint8_t chan_mask_excl[WS_CHAN_MASK_LEN];
     uint8_t chan_mask_reg[WS_CHAN_MASK_LEN];
     uint8_t tmp8 = 0;
+    int len;
 
     BUG_ON(!fhss_config->chan_params);
     ws_chan_mask_calc_reg(chan_mask_reg, fhss_config->chan_params, fhss_config->regional_regulation);
@@ -302,13 +301,7 @@ static void ws_wp_schedule_base_write(struct iobuf_write *buf, const struct ws_f
 
     tmp8 |= FIELD_PREP(WS_MASK_SCHEDULE_CHAN_PLAN, fhss_config->chan_plan);
     tmp8 |= FIELD_PREP(WS_MASK_SCHEDULE_CHAN_FUNC, func);
-
-    if (!memzcmp(chan_mask_excl, WS_CHAN_MASK_LEN))
-        tmp8 |= FIELD_PREP(WS_MASK_SCHEDULE_CHAN_EXCL, WS_EXC_CHAN_CTRL_NONE);
-    else if (ws_chan_mask_width(chan_mask_excl) < 1 + 4 * ws_chan_mask_ranges(chan_mask_excl))
-        tmp8 |= FIELD_PREP(WS_MASK_SCHEDULE_CHAN_EXCL, WS_EXC_CHAN_CTRL_BITMASK);
-    else
-        tmp8 |= FIELD_PREP(WS_MASK_SCHEDULE_CHAN_EXCL, WS_EXC_CHAN_CTRL_RANGE);
+    tmp8 |= FIELD_PREP(WS_MASK_SCHEDULE_CHAN_EXCL, ws_chan_mask_excl_ctrl(chan_mask_excl, &len));
 
     iobuf_push_u8(buf, tmp8);
 }
@@ -358,40 +351,27 @@ static void ws_wp_chan_excl_write(struct iobuf_write *buf, const struct ws_fhss_
     const uint8_t *chan_mask_custom = unicast ? fhss_config->uc_chan_mask : fhss_config->bc_chan_mask;
     uint8_t chan_mask_excl[WS_CHAN_MASK_LEN];
     uint8_t chan_mask_reg[WS_CHAN_MASK_LEN];
-    int mask_len, range_cnt;
-    int range_start;
+    int first, last;
+    int len;
 
     BUG_ON(!fhss_config->chan_params);
     ws_chan_mask_calc_reg(chan_mask_reg, fhss_config->chan_params, fhss_config->regional_regulation);
     ws_chan_mask_calc_excl(chan_mask_excl, chan_mask_reg, chan_mask_custom);
 
-    if (!memzcmp(chan_mask_excl, WS_CHAN_MASK_LEN))
-        return;
-
-    mask_len = ws_chan_mask_width(chan_mask_excl);
-    range_cnt = ws_chan_mask_ranges(chan_mask_excl);
-
-    if (mask_len < 1 + 4 * range_cnt) {
-        iobuf_push_data(buf, chan_mask_excl, mask_len);
-    } else {
-        iobuf_push_u8(buf, range_cnt);
-        range_start = -1;
-        for (int i = 0; i < 8 * WS_CHAN_MASK_LEN; i++) {
-            if (range_start < 0) {
-                if (bittest(chan_mask_excl, i))
-                    range_start = i;
-            } else {
-                if (!bittest(chan_mask_excl, i)) {
-                    iobuf_push_le16(buf, range_start);
-                    iobuf_push_le16(buf, i - 1);
-                    range_start = -1;
-                }
-            }
-        }
-        if (range_start >= 0) {
-            iobuf_push_le16(buf, range_start);
-            iobuf_push_le16(buf, WS_CHAN_MASK_LEN - 1);
+    switch (ws_chan_mask_excl_ctrl(chan_mask_excl, &len)) {
+    case WS_EXC_CHAN_CTRL_NONE:
+        break;
+    case WS_EXC_CHAN_CTRL_BITMASK:
+        iobuf_push_data(buf, chan_mask_excl, len);
+        break;
+    case WS_EXC_CHAN_CTRL_RANGE:
+        iobuf_push_u8(buf, (len - 1) / 4);
+        for (first = ws_chan_mask_range_next(chan_mask_excl, 0, &last); first >= 0;
+             first = ws_chan_mask_range_next(chan_mask_excl, last + 1, &last)) {
+            iobuf_push_le16(buf, first);
+            iobuf_push_le16(buf, last);
         }
+        break;
     }
 }
 
@@ -566,10 +546,154 @@ void ws_wp_nested_jm_write(struct iobuf_write *buf, const struct ws_jm_ie *jm)
     ieee802154_ie_fill_len_nested(buf, offset, false);
 }
 
+struct ws_ie_index_entry {
+    const uint8_t *data;
+    uint16_t len;
+};
+
+// First occurrence of each IE of the frame being processed, see
+// ws_ie_index_build().
+static struct ws_ie_index {
+    bool valid;
+    const uint8_t *hdr;
+    uint16_t hdr_len;
+    const uint8_t *wp;
+    uint16_t wp_len;
+    uint8_t wh_mask[256 / 8];
+    uint8_t wp_short_mask[128 / 8];
+    uint8_t wp_long_mask[16 / 8];
+    struct ws_ie_index_entry wh[256];
+    struct ws_ie_index_entry wp_short[128];
+    struct ws_ie_index_entry wp_long[16];
+} g_ws_ie_index;
+
+static void ws_ie_index_add(struct ws_ie_index_entry *table, uint8_t *mask, int id,
+                            const uint8_t *data, uint16_t len)
+{
+    if (bittest(mask, id))
+        return;
+    bitset(mask, id);
+    table[id].data = data;
+    table[id].len  = len;
+}
+
+// The lookups below stop at the first malformed IE, so the index does too.
+static void ws_ie_index_build_wh(struct ws_ie_index *index)
+{
+    struct iobuf_read input = {
+        .data_size = index->hdr_len,
+        .data = index->hdr,
+    };
+    const uint8_t *ie_data;
+    uint16_t ie_hdr;
+    int ie_len;
+
+    while (iobuf_remaining_size(&input)) {
+        ie_hdr = iobuf_pop_le16(&input);
+        if (FIELD_GET(IEEE802154_IE_TYPE_MASK, ie_hdr) != IEEE802154_IE_TYPE_HEADER)
+            return;
+        ie_len  = FIELD_GET(IEEE802154_IE_HEADER_LEN_MASK, ie_hdr);
+        ie_data = iobuf_pop_data_ptr(&input, ie_len);
+        if (!ie_data)
+            return;
+        if (FIELD_GET(IEEE802154_IE_HEADER_ID_MASK, ie_hdr) != IEEE802154_IE_ID_WH)
+            continue;
+        if (!ie_len)
+            return;
+        ws_ie_index_add(index->wh, index->wh_mask, ie_data[0], ie_data, ie_len);
+    }
+}
+
+static void ws_ie_index_build_wp(struct ws_ie_index *index)
+{
+    struct iobuf_read input = {
+        .data_size = index->wp_len,
+        .data = index->wp,
+    };
+    const uint8_t *ie_data;
+    uint16_t ie_hdr;
+    int ie_len;
+
+    while (iobuf_remaining_size(&input)) {
+        ie_hdr = iobuf_pop_le16(&input);
+        if (FIELD_GET(IEEE802154_IE_TYPE_MASK, ie_hdr) == IEEE802154_IE_TYPE_NESTED_LONG) {
+            ie_len  = FIELD_GET(IEEE802154_IE_NESTED_LONG_LEN_MASK, ie_hdr);
+            ie_data = iobuf_pop_data_ptr(&input, ie_len);
+            if (!ie_data)
+                return;
+            ws_ie_index_add(index->wp_long, index->wp_long_mask,
+                            FIELD_GET(IEEE802154_IE_NESTED_LONG_ID_MASK, ie_hdr), ie_data, ie_len);
+        } else {
+            ie_len  = FIELD_GET(IEEE802154_IE_NESTED_SHORT_LEN_MASK, ie_hdr);
+            ie_data = iobuf_pop_data_ptr(&input, ie_len);
+            if (!ie_data)
+                return;
+            ws_ie_index_add(index->wp_short, index->wp_short_mask,
+                            FIELD_GET(IEEE802154_IE_NESTED_SHORT_ID_MASK, ie_hdr), ie_data, ie_len);
+        }
+    }
+}
+
+void ws_ie_index_build(const uint8_t *hdr, uint16_t hdr_len, const uint8_t *payload, uint16_t payload_len)
+{
+    struct ws_ie_index *index = &g_ws_ie_index;
+    struct iobuf_read ie_wp;
+
+    memset(index->wh_mask, 0, sizeof(index->wh_mask));
+    memset(index->wp_short_mask, 0, sizeof(index->wp_short_mask));
+    memset(index->wp_long_mask, 0, sizeof(index->wp_long_mask));
+    index->hdr = hdr;
+    index->hdr_len = hdr_len;
+    ws_ie_index_build_wh(index);
+    ieee802154_ie_find_payload(payload, payload_len, IEEE802154_IE_ID_WP, &ie_wp);
+    index->wp = ie_wp.err ? NULL : ie_wp.data;
+    index->wp_len = ie_wp.err ? 0 : ie_wp.data_size;
+    if (index->wp)
+        ws_ie_index_build_wp(index);
+    index->valid = true;
+}
+
+void ws_ie_index_clear(void)
+{
+    g_ws_ie_index.valid = false;
+}
+
+static bool ws_ie_index_lookup(const struct ws_ie_index_entry *table, const uint8_t *mask, int id,
+                               struct iobuf_read *ie_content)
+{
+    memset(ie_content, 0, sizeof(struct iobuf_read));
+    if (!bittest(mask, id)) {
+        ie_content->err = true;
+        return false;
+    }
+    ie_content->data = table[id].data;
+    ie_content->data_size = table[id].len;
+    return true;
+}
+
+static void ws_wp_nested_find(const uint8_t *data, uint16_t length, uint8_t id,
+                              struct iobuf_read *ie_content, bool is_long)
+{
+    const struct ws_ie_index *index = &g_ws_ie_index;
+
+    if (!index->valid || !index->wp || data != index->wp || length != index->wp_len)
+        ieee802154_ie_find_nested(data, length, id, ie_content, is_long);
+    else if (is_long)
+        ws_ie_index_lookup(index->wp_long, index->wp_long_mask, id, ie_content);
+    else
+        ws_ie_index_lookup(index->wp_short, index->wp_short_mask, id, ie_content);
+}
+
 static void ws_wh_find_subid(const uint8_t *data, uint16_t length, uint8_t subid, struct iobuf_read *wh_content)
 {
+    const struct ws_ie_index *index = &g_ws_ie_index;
     const uint8_t *end = data + length;
 
+    if (index->valid && data == index->hdr && length == index->hdr_len) {
+        if (ws_ie_index_lookup(index->wh, index->wh_mask, subid, wh_content))
+            iobuf_pop_u8(wh_content);
+        return;
+    }
     do {
         ieee802154_ie_find_header(data, length, IEEE802154_IE_ID_WH, wh_content);
         if (iobuf_pop_u8(wh_content) == subid)
@@ -842,7 +966,7 @@ bool ws_wp_nested_us_read(const uint8_t *data, uint16_t length, struct ws_us_ie
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_US, &ie_buf, true);
+    ws_wp_nested_find(data, length, WS_WPIE_US, &ie_buf, true);
     us_ie->dwell_interval  = iobuf_pop_u8(&ie_buf);
     us_ie->clock_drift     = iobuf_pop_u8(&ie_buf);
     us_ie->timing_accuracy = iobuf_pop_u8(&ie_buf);
@@ -861,7 +985,7 @@ bool ws_wp_nested_bs_read(const uint8_t *data, uint16_t length, struct ws_bs_ie
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_BS, &ie_buf, true);
+    ws_wp_nested_find(data, length, WS_WPIE_BS, &ie_buf, true);
     bs_ie->broadcast_interval            = iobuf_pop_le32(&ie_buf);
     bs_ie->broadcast_schedule_identifier = iobuf_pop_le16(&ie_buf);
     bs_ie->dwell_interval                = iobuf_pop_u8(&ie_buf);
@@ -882,7 +1006,7 @@ bool ws_wp_nested_pan_read(const uint8_t *data, uint16_t length, struct ws_pan_i
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_PAN, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_PAN, &ie_buf, false);
     pan_ie->pan_size = iobuf_pop_le16(&ie_buf);
     pan_ie->routing_cost = iobuf_pop_le16(&ie_buf);
     tmp8 = iobuf_pop_u8(&ie_buf);
@@ -897,7 +1021,7 @@ bool ws_wp_nested_panver_read(const uint8_t *data, uint16_t length, uint16_t *pa
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_PANVER, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_PANVER, &ie_buf, false);
     *pan_version = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
@@ -906,7 +1030,7 @@ bool ws_wp_nested_gtkhash_read(const uint8_t *data, uint16_t length, uint8_t gtk
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_GTKHASH, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_GTKHASH, &ie_buf, false);
     iobuf_pop_data(&ie_buf, (uint8_t *)gtkhash, 4 * 8);
     return !ie_buf.err;
 }
@@ -915,7 +1039,7 @@ bool ws_wp_nested_netname_read(const uint8_t *data, uint16_t length, struct ws_n
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_NETNAME, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_NETNAME, &ie_buf, false);
     if (iobuf_remaining_size(&ie_buf) > WS_NETNAME_LEN)
         return false;
     memset(netname->netname, 0, sizeof(netname->netname));
@@ -928,7 +1052,7 @@ bool ws_wp_nested_pom_read(const uint8_t *data, uint16_t length, struct ws_pom_i
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_POM, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_POM, &ie_buf, false);
     tmp8 = iobuf_pop_u8(&ie_buf);
     pom_ie->phy_op_mode_number  = FIELD_GET(WS_MASK_POM_COUNT, tmp8);
     pom_ie->mdr_command_capable = FIELD_GET(WS_MASK_POM_MDR,   tmp8);
@@ -940,7 +1064,7 @@ bool ws_wp_nested_lfnver_read(const uint8_t *data, uint16_t length, struct ws_lf
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LFNVER, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_LFNVER, &ie_buf, false);
     ws_lfnver->lfn_version = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
@@ -950,7 +1074,7 @@ bool ws_wp_nested_lgtkhash_read(const uint8_t *data, uint16_t length, uint8_t lg
     struct iobuf_read ie_buf;
     unsigned valid_hashs;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LGTKHASH, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_LGTKHASH, &ie_buf, false);
     valid_hashs = FIELD_GET(WS_MASK_LGTKHASH_LGTK0 | WS_MASK_LGTKHASH_LGTK1 | WS_MASK_LGTKHASH_LGTK2, *data);
     *active_lgtk_index = FIELD_GET(WS_MASK_LGTKHASH_INDEX, *data);
     for (int i = 0; i < 3; i++) {
@@ -966,7 +1090,7 @@ bool ws_wp_nested_lbats_read(const uint8_t *data, uint16_t length, struct ws_lba
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LBATS, &ie_buf, true);
+    ws_wp_nested_find(data, length, WS_WPIE_LBATS, &ie_buf, true);
     lbats_ie->additional_transmissions = iobuf_pop_u8(&ie_buf);
     lbats_ie->next_transmit_delay      = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
@@ -978,7 +1102,7 @@ static void ws_wp_nested_lcp_find_tag(const uint8_t *data, uint16_t length, uint
     const uint8_t *end = data + length;
 
     do {
-        ieee802154_ie_find_nested(data, length, WS_WPIE_LCP, ie_content, true);
+        ws_wp_nested_find(data, length, WS_WPIE_LCP, ie_content, true);
         if (iobuf_pop_u8(ie_content) == tag) {
             ie_content->cnt = 0;
             return;
@@ -1014,7 +1138,7 @@ bool ws_wp_nested_jm_read(const uint8_t *data, uint16_t length, struct ws_jm_ie
     struct iobuf_read ie_buf;
     uint8_t metric;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_JM, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_JM, &ie_buf, false);
     jm->version = iobuf_pop_u8(&ie_buf);
     while (iobuf_remaining_size(&ie_buf)) {
         metric = iobuf_pop_u8(&ie_buf);
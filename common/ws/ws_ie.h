@@ -248,6 +248,16 @@ void   ws_wh_lbc_write(struct iobuf_write *buf, uint24_t interval, uint8_t sync_
 
 void ws_wh_sl_utt_write(struct iobuf_write *buf, uint8_t sl_frame_type);
 
+/*
+ * Looking up an IE scans the IE list from the start. To avoid this, a frame
+ * receive handler can index the IEs of the frame once with
+ * ws_ie_index_build(), and call ws_ie_index_clear() when done. Meanwhile, the
+ * readers below use the index when called with the indexed header IE list or
+ * WP-IE content, and fall back to a linear scan otherwise.
+ */
+void ws_ie_index_build(const uint8_t *hdr, uint16_t hdr_len, const uint8_t *payload, uint16_t payload_len);
+void ws_ie_index_clear(void);
+
 bool ws_wh_utt_read(const uint8_t *data, uint16_t length, struct ws_utt_ie *utt_ie);
 bool ws_wh_bt_read(const uint8_t *data, uint16_t length, struct ws_bt_ie *bt_ie);
 bool ws_wh_fc_read(const uint8_t *data, uint16_t length, struct ws_fc_ie *fc_ie);
@@ -75,6 +75,8 @@ static void ws_write_ies(struct ws_ctx *ws, struct iobuf_write *iobuf, uint8_t f
 
     BUG_ON(wh_ies->utt && wh_ies->sl_utt);
 
+    if (wh_ies->fc)
+        ws_wh_fc_write(iobuf, 50, 255);
     if (wh_ies->utt)
         ws_wh_utt_write(iobuf, frame_type);
     if (wh_ies->sl_utt)
@@ -110,10 +112,12 @@ void ws_if_recv_ind(struct rcp *rcp, const struct rcp_rx_ind *hif_ind)
     if (ret < 0)
         return;
 
+    ws_ie_index_build(ind.ie_hdr.data, ind.ie_hdr.data_size,
+                      ie_payload.data, ie_payload.data_size);
     if (!ws_wh_sl_utt_read(ind.ie_hdr.data, ind.ie_hdr.data_size, &ie_utt) &&
         !ws_wh_utt_read(ind.ie_hdr.data, ind.ie_hdr.data_size, &ie_utt)) {
         TRACE(TR_DROP, "drop %-9s: missing UTT-IE", "15.4");
-        return;
+        goto out;
     }
     // HACK: In FAN 1.0 the source address is elided in EDFE response frames
     if (ws_wh_fc_read(ind.ie_hdr.data, ind.ie_hdr.data_size, &ie_fc)) {
@@ -148,48 +152,71 @@ void ws_if_recv_ind(struct rcp *rcp, const struct rcp_rx_ind *hif_ind)
     ws_print_ind(&ind, ie_utt.message_type);
     if (ws->on_recv_ind)
         ws->on_recv_ind(ws, &ind);
+out:
+    ws_ie_index_clear();
 }
 
-static struct ws_frame_ctx *ws_if_frame_ctx_new(struct ws_ctx *ws, uint8_t type)
+static struct ws_frame_ctx *ws_if_frame_ctx_new(struct ws_ctx *ws, uint8_t type,
+                                                const struct eui64 *dst, struct ws_neigh *neigh)
 {
-    struct ws_frame_ctx *cur, *new;
+    struct ws_frame_ctx *new;
 
-    if (type == SL_FT_DCS &&
-        SLIST_FIND(cur, &ws->frame_ctx_list, link, cur->type == type)) {
+    if (type == SL_FT_DCS && ws->frame_ctx_type_count[type]) {
         WARN("%s tx overlap, consider increasing disc_period_s", tr_ws_frame(type));
         TRACE(TR_TX_ABORT, "tx-abort %-9s: tx already in progress", tr_ws_frame(type));
         return NULL;
     }
-    if ((type == WS_FT_PAS || type == WS_FT_PCS) &&
-        SLIST_FIND(cur, &ws->frame_ctx_list, link, cur->type == type)) {
+    if ((type == WS_FT_PAS || type == WS_FT_PCS) && ws->frame_ctx_type_count[type]) {
         WARN("%s tx overlap, consider increasing trickle Imin", tr_ws_frame(type));
         TRACE(TR_TX_ABORT, "tx-abort %-9s: tx already in progress", tr_ws_frame(type));
         return NULL;
     }
-    if (SLIST_SIZE(&ws->frame_ctx_list, link) > UINT8_MAX) {
+    if (ws->frame_ctx_count > UINT8_MAX) {
         TRACE(TR_TX_ABORT, "tx-abort %-9s: no handle available", tr_ws_frame(type));
         return NULL;
     }
+    if (neigh && neigh->frame_ctx_count >= WS_FRAME_CTX_DST_MAX) {
+        TRACE(TR_TX_ABORT, "tx-abort %-9s: too many frames queued for %s", tr_ws_frame(type), tr_eui64(dst->u8));
+        return NULL;
+    }
 
-    new = zalloc(sizeof(*new));
+    // Handles are allocated in sequence and usually confirmed in order, so
+    // the next one is almost always free.
+    while (ws->frame_ctx[ws->handle_next].in_use)
+        ws->handle_next++;
+    new = &ws->frame_ctx[ws->handle_next];
     new->handle = ws->handle_next++;
     new->type = type;
-    // If next handle is already in use (unlikely), use the next available one.
-    while (SLIST_FIND(cur, &ws->frame_ctx_list, link,
-                      cur->handle == new->handle))
-        new->handle = ws->handle_next++;
-    SLIST_INSERT_HEAD(&ws->frame_ctx_list, new, link);
+    new->dst = *dst;
+    new->in_use = true;
+    new->dst_counted = neigh;
+    ws->frame_ctx_count++;
+    ws->frame_ctx_type_count[type]++;
+    if (neigh)
+        neigh->frame_ctx_count++;
     return new;
 }
 
-static struct ws_frame_ctx *ws_if_frame_ctx_pop(struct ws_ctx *ws, uint8_t handle)
+static struct ws_frame_ctx *ws_if_frame_ctx_get(struct ws_ctx *ws, uint8_t handle)
 {
-    struct ws_frame_ctx *cur;
+    struct ws_frame_ctx *cur = &ws->frame_ctx[handle];
+
+    return cur->in_use ? cur : NULL;
+}
 
-    cur = SLIST_FIND(cur, &ws->frame_ctx_list, link, cur->handle == handle);
-    if (cur)
-        SLIST_REMOVE(&ws->frame_ctx_list, cur, ws_frame_ctx, link);
-    return cur;
+static void ws_if_frame_ctx_free(struct ws_ctx *ws, struct ws_frame_ctx *frame_ctx)
+{
+    struct ws_neigh *neigh;
+
+    if (frame_ctx->dst_counted) {
+        neigh = ws_neigh_get(&ws->neigh_table, frame_ctx->dst.u8);
+        // The neighbor may have been removed and added again meanwhile
+        if (neigh && neigh->frame_ctx_count)
+            neigh->frame_ctx_count--;
+    }
+    ws->frame_ctx_type_count[frame_ctx->type]--;
+    ws->frame_ctx_count--;
+    frame_ctx->in_use = false;
 }
 
 void ws_if_recv_cnf(struct rcp *rcp, const struct rcp_tx_cnf *cnf)
@@ -205,7 +232,7 @@ void ws_if_recv_cnf(struct rcp *rcp, const struct rcp_tx_cnf *cnf)
     if (cnf->status != HIF_STATUS_SUCCESS)
         TRACE(TR_TX_ABORT, "tx-abort 15.4: status %s", hif_status_str(cnf->status));
 
-    frame_ctx = ws_if_frame_ctx_pop(ws, cnf->handle);
+    frame_ctx = ws_if_frame_ctx_get(ws, cnf->handle);
     if (!frame_ctx) {
         ERROR("unknown frame handle: %u", cnf->handle);
         return;
@@ -225,6 +252,7 @@ void ws_if_recv_cnf(struct rcp *rcp, const struct rcp_tx_cnf *cnf)
         ret = ieee802154_frame_parse(cnf->frame, cnf->frame_len, &hdr, &ie_header, &ie_payload);
         if (ret < 0) {
             WARN("%s: malformed frame", __func__);
+            ws_if_frame_ctx_free(ws, frame_ctx);
             return;
         }
         // TODO: check frame counter
@@ -247,7 +275,7 @@ void ws_if_recv_cnf(struct rcp *rcp, const struct rcp_tx_cnf *cnf)
                             cnf->status == HIF_STATUS_SUCCESS);
     if (ws->on_recv_cnf)
         ws->on_recv_cnf(ws, frame_ctx, cnf);
-    free(frame_ctx);
+    ws_if_frame_ctx_free(ws, frame_ctx);
 }
 
 int ws_if_send_data(struct ws_ctx *ws, const void *pkt, size_t pkt_len, const struct eui64 *dst)
@@ -255,7 +283,7 @@ int ws_if_send_data(struct ws_ctx *ws, const void *pkt, size_t pkt_len, const st
     struct ws_neigh *neigh = ws_neigh_get(&ws->neigh_table, dst->u8);
     struct ieee802154_hdr hdr = {
         .frame_type = IEEE802154_FRAME_TYPE_DATA,
-        .ack_req    = neigh,
+        .ack_req    = neigh && !ws->edfe,
         .dst        = *dst,
         .src        = ws->rcp.eui64,
         .pan_id     = neigh ? -1 : ws->pan_id,
@@ -266,13 +294,19 @@ int ws_if_send_data(struct ws_ctx *ws, const void *pkt, size_t pkt_len, const st
         .transfer_type = MPX_FT_FULL_FRAME,
         .multiplex_id  = MPX_ID_6LOWPAN,
     };
+    /*
+     * Wi-SUN FAN 1.1v08 - 6.3.4.3.1.2 Extended Directed Frame Exchange
+     * All EDFE frames are ULAD frames populated as described in section
+     * 6.3.2.1.6. The AR field MUST be set to 0.
+     */
     struct wh_ie_list wh_ies = {
         .utt = true,
+        .fc  = neigh && ws->edfe,
         // TODO: BT-IE, LBT-IE
     };
     struct wp_ie_list wp_ies = { }; // TODO: JM-IE
     struct ws_frame_ctx *frame_ctx;
-    struct iobuf_write iobuf = { };
+    struct iobuf_write iobuf = iobuf_scratch();
     int offset;
 
     if (memcmp(dst, &ieee802154_addr_bc, 8) && !neigh) {
@@ -284,10 +318,9 @@ int ws_if_send_data(struct ws_ctx *ws, const void *pkt, size_t pkt_len, const st
         return -EINVAL;
     }
 
-    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_DATA);
+    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_DATA, &hdr.dst, neigh);
     if (!frame_ctx)
         return -ENOMEM;
-    frame_ctx->dst = hdr.dst;
 
     ieee802154_frame_write_hdr(&iobuf, &hdr);
 
@@ -341,7 +374,7 @@ void ws_if_send_eapol(struct ws_ctx *ws, uint8_t kmp_id,
         .us = true, // TODO: only include US-IE if 1st unicast frame to neighbor
     };
     struct ws_frame_ctx *frame_ctx;
-    struct iobuf_write iobuf = { };
+    struct iobuf_write iobuf = iobuf_scratch();
     struct ws_neigh *neigh;
     int offset;
 
@@ -351,10 +384,9 @@ void ws_if_send_eapol(struct ws_ctx *ws, uint8_t kmp_id,
         return;
     }
 
-    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_EAPOL);
+    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_EAPOL, &hdr.dst, neigh);
     if (!frame_ctx)
         return;
-    frame_ctx->dst = hdr.dst;
 
     ieee802154_frame_write_hdr(&iobuf, &hdr);
 
@@ -395,12 +427,11 @@ void ws_if_send_pas(struct ws_ctx *ws)
         // TODO: POM-IE
     };
     struct ws_frame_ctx *frame_ctx;
-    struct iobuf_write iobuf = { };
+    struct iobuf_write iobuf = iobuf_scratch();
 
-    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_PAS);
+    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_PAS, &hdr.dst, NULL);
     if (!frame_ctx)
         return;
-    frame_ctx->dst = hdr.dst;
 
     ieee802154_frame_write_hdr(&iobuf, &hdr);
 
@@ -435,12 +466,11 @@ void ws_if_send_pcs(struct ws_ctx *ws)
         // TODO: POM-IE
     };
     struct ws_frame_ctx *frame_ctx;
-    struct iobuf_write iobuf = { };
+    struct iobuf_write iobuf = iobuf_scratch();
 
-    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_PCS);
+    frame_ctx = ws_if_frame_ctx_new(ws, WS_FT_PCS, &hdr.dst, NULL);
     if (!frame_ctx)
         return;
-    frame_ctx->dst = hdr.dst;
 
     ieee802154_frame_write_hdr(&iobuf, &hdr);
 
@@ -473,13 +503,13 @@ void ws_if_send(struct ws_ctx *ws, struct ws_send_req *req)
         .multiplex_id  = req->multiplex_id,
     };
     struct ws_frame_ctx *frame_ctx;
-    struct iobuf_write iobuf = { };
+    struct iobuf_write iobuf = iobuf_scratch();
     int offset;
 
-    frame_ctx = ws_if_frame_ctx_new(ws, req->frame_type);
+    frame_ctx = ws_if_frame_ctx_new(ws, req->frame_type, &hdr.dst,
+                                    req->fhss_type == HIF_FHSS_TYPE_FFN_UC ? neigh : NULL);
     if (!frame_ctx)
         return;
-    frame_ctx->dst =  hdr.dst;
 
     ieee802154_frame_write_hdr(&iobuf, &hdr);
 
@@ -69,17 +69,19 @@ struct ws_send_req {
     size_t pkt_len;
 };
 
+// Maximum number of unicast frames waiting for a confirmation per neighbor,
+// so a single unreachable neighbor cannot use all the handles.
+#define WS_FRAME_CTX_DST_MAX 16
+
 // Frame sent to the RCP and waiting for a confirmation.
 struct ws_frame_ctx {
     uint8_t handle;
     uint8_t type;
+    bool in_use;
+    bool dst_counted; // Accounted in ws_neigh.frame_ctx_count
     struct eui64 dst;
-    SLIST_ENTRY(ws_frame_ctx) link;
 };
 
-// Define struct ws_frame_list
-SLIST_HEAD(ws_frame_ctx_list, ws_frame_ctx);
-
 struct ws_ind {
     const struct rcp_rx_ind *hif;
     struct ieee802154_hdr hdr;
@@ -102,8 +104,12 @@ struct ws_ctx {
 
     uint8_t seqno;
     uint8_t  handle_next;
-    struct ws_frame_ctx_list frame_ctx_list;
+    // Indexed by handle
+    struct ws_frame_ctx frame_ctx[UINT8_MAX + 1];
+    int      frame_ctx_count;
+    uint16_t frame_ctx_type_count[UINT8_MAX + 1];
     struct eui64 edfe_src;
+    bool    edfe; // Use EDFE for unicast data frames
     int     eapol_relay_fd;
     uint8_t gak_index;
 
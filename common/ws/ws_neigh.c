@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
+#include <string.h>
 #include <inttypes.h>
 #include <limits.h>
 #include "common/ws/ws_regdb.h"
@@ -30,6 +31,7 @@
 #include "common/mathutils.h"
 #include "common/memutils.h"
 #include "common/rand.h"
+#include "common/rcp_api.h"
 #include "common/log.h"
 #include "common/bits.h"
 #include "common/specs/ws.h"
@@ -38,14 +40,63 @@
 
 #define LFN_SCHEDULE_GUARD_TIME_MS 300
 
+// Neither the neighbor lifetime nor the ETX refresh need to be accurate, this
+// allows to process the timers of many neighbors in a single wakeup.
+#define WS_NEIGH_TIMER_SLACK_MS 2000
+
+// DSNs tracked per neighbor for duplicate detection, and how long the DSN
+// window remains valid without receiving from the neighbor.
+#define WS_NEIGH_DSN_WINDOW_LEN 64
+#define WS_NEIGH_DSN_WINDOW_TIMEOUT_US (5 * 1000000)
+
+// Number of regulatory channel masks kept by ws_neigh_chan_mask_reg()
+#define WS_NEIGH_CHAN_MASK_CACHE_LEN 4
+
+static struct ws_neigh_list *ws_neigh_bucket(const struct ws_neigh_table *table, const uint8_t mac64[8])
+{
+    uint64_t key;
+
+    // Fibonacci hashing: the multiplication mixes all the bytes of the EUI-64
+    // into the upper bits, so vendors sharing an OUI are still spread.
+    memcpy(&key, mac64, sizeof(key));
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return (struct ws_neigh_list *)&table->neigh_hash[key >> (64 - WS_NEIGH_HASH_BITS)];
+}
+
+static struct ws_neigh_lru *ws_neigh_lru(struct ws_neigh_table *table, const struct ws_neigh *neigh)
+{
+    return neigh->trusted_device ? &table->lru_trusted : &table->lru_untrusted;
+}
+
+void ws_neigh_table_init(struct ws_neigh_table *table)
+{
+    timer_group_init(&table->timer_group);
+    TAILQ_INIT(&table->lru_untrusted);
+    TAILQ_INIT(&table->lru_trusted);
+}
+
 static void ws_neigh_timer_cb(struct timer_group *group, struct timer_entry *timer)
 {
     struct ws_neigh_table *table = container_of(group, struct ws_neigh_table, timer_group);
     struct ws_neigh *neigh = container_of(timer, struct ws_neigh, timer);
 
+    // Refreshed since the timer was started
+    if (neigh->expire_ms > time_cached_ms()) {
+        timer_start_abs(&table->timer_group, &neigh->timer, neigh->expire_ms);
+        return;
+    }
     ws_neigh_del(table, neigh->mac64);
 }
 
+static void ws_neigh_lifetime_start(struct ws_neigh_table *table, struct ws_neigh *neigh)
+{
+    neigh->expire_ms = time_cached_ms() + neigh->lifetime_s * 1000;
+    // Frames are received far more often than the lifetime expires, so the
+    // timer is not restarted on every refresh.
+    if (timer_stopped(&neigh->timer) || neigh->timer.expire_ms > neigh->expire_ms)
+        timer_start_abs(&table->timer_group, &neigh->timer, neigh->expire_ms);
+}
+
 // Wi-SUN FAN 1v33 6.2.3.1.6.1 Link Metrics
 static void ws_neigh_etx_compute(struct ws_neigh_table *table, struct ws_neigh *neigh)
 {
@@ -124,13 +175,69 @@ void ws_neigh_etx_update(struct ws_neigh_table *table,
     ws_neigh_etx_compute(table, neigh);
 }
 
+static struct ws_neigh_stats *ws_neigh_stats_cur(struct ws_neigh *neigh)
+{
+    time_t now_s = time_now_s(CLOCK_MONOTONIC);
+    uint32_t start_s = now_s - now_s % WS_NEIGH_STATS_PERIOD_S;
+    struct ws_neigh_stats *stats = &neigh->stats[neigh->stats_head];
+
+    if (stats->start_s == start_s && (stats->tx_count || stats->rx_count))
+        return stats;
+    // Periods without traffic do not use an entry
+    if (stats->tx_count || stats->rx_count) {
+        neigh->stats_head = (neigh->stats_head + 1) % WS_NEIGH_STATS_COUNT;
+        stats = &neigh->stats[neigh->stats_head];
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->start_s = start_s;
+    return stats;
+}
+
+static void ws_neigh_stats_inc(uint16_t *cnt, unsigned int val)
+{
+    *cnt = MIN(*cnt + val, UINT16_MAX);
+}
+
+void ws_neigh_stats_tx(struct ws_neigh *neigh, uint8_t status, uint8_t tx_retries,
+                       uint8_t phy_mode_id, uint64_t latency_ms)
+{
+    struct ws_neigh_stats *stats = ws_neigh_stats_cur(neigh);
+
+    ws_neigh_stats_inc(&stats->tx_count, 1);
+    ws_neigh_stats_inc(&stats->tx_retries, tx_retries);
+    if (status == HIF_STATUS_SUCCESS) {
+        ws_neigh_stats_inc(&stats->tx_ack, 1);
+        stats->phy_mode_id = phy_mode_id;
+    }
+    if (status == HIF_STATUS_CCA)
+        ws_neigh_stats_inc(&stats->tx_cca_fail, 1);
+    stats->tx_latency_ms_max = MIN(MAX(stats->tx_latency_ms_max, latency_ms), UINT16_MAX);
+    stats->tx_latency_ms_sum = MIN(stats->tx_latency_ms_sum + latency_ms, UINT32_MAX);
+}
+
+void ws_neigh_stats_rx(struct ws_neigh *neigh)
+{
+    ws_neigh_stats_inc(&ws_neigh_stats_cur(neigh)->rx_count, 1);
+}
+
 struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
                          const uint8_t mac64[8],
                          uint8_t role, int8_t tx_power_dbm,
                          unsigned int key_index_mask)
 {
-    struct ws_neigh *neigh = zalloc(sizeof(struct ws_neigh));
+    struct ws_neigh *neigh;
 
+    if (table->max_count && table->count >= table->max_count) {
+        neigh = TAILQ_FIRST(&table->lru_untrusted);
+        if (!neigh)
+            neigh = TAILQ_FIRST(&table->lru_trusted);
+        BUG_ON(!neigh);
+        TRACE(TR_NEIGH_15_4, "15.4 neighbor evict %s%s", tr_eui64(neigh->mac64),
+              neigh->trusted_device ? " (trusted)" : "");
+        ws_neigh_del(table, neigh->mac64);
+    }
+
+    neigh = zalloc(sizeof(struct ws_neigh));
     neigh->node_role = role;
     for (uint8_t key_index = 1; key_index <= HIF_KEY_COUNT; key_index++)
         if (!(key_index_mask & BIT(key_index)))
@@ -138,7 +245,8 @@ struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
     memcpy(neigh->mac64, mac64, 8);
     neigh->lifetime_s = WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME;
     neigh->timer.callback = ws_neigh_timer_cb;
-    timer_start_rel(&table->timer_group, &neigh->timer, neigh->lifetime_s * 1000);
+    neigh->timer.slack_ms = WS_NEIGH_TIMER_SLACK_MS;
+    ws_neigh_lifetime_start(table, neigh);
     neigh->rsl_in_dbm = NAN;
     neigh->rsl_in_dbm_unsecured = NAN;
     neigh->rsl_out_dbm = NAN;
@@ -149,9 +257,14 @@ struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
     neigh->apc_txpow_dbm = tx_power_dbm;
     neigh->apc_txpow_dbm_ofdm = tx_power_dbm;
     neigh->etx = NAN;
+    neigh->airtime_us_per_byte = NAN;
     neigh->etx_timer_compute.callback  = ws_neigh_etx_timeout_compute;
     neigh->etx_timer_outdated.callback = ws_neigh_etx_timeout_outdated;
+    neigh->etx_timer_outdated.slack_ms = WS_NEIGH_TIMER_SLACK_MS;
     SLIST_INSERT_HEAD(&table->neigh_list, neigh, link);
+    SLIST_INSERT_HEAD(ws_neigh_bucket(table, neigh->mac64), neigh, hash_link);
+    TAILQ_INSERT_TAIL(&table->lru_untrusted, neigh, lru_link);
+    table->count++;
     if (table->on_add)
         table->on_add(table, neigh);
     TRACE(TR_NEIGH_15_4, "15.4 neighbor add %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
@@ -162,7 +275,7 @@ struct ws_neigh *ws_neigh_get(const struct ws_neigh_table *table, const uint8_t
 {
     struct ws_neigh *neigh;
 
-    return SLIST_FIND(neigh, &table->neigh_list, link,
+    return SLIST_FIND(neigh, ws_neigh_bucket(table, mac64), hash_link,
                       !memcmp(neigh->mac64, mac64, 8));
 }
 
@@ -175,6 +288,9 @@ void ws_neigh_del(struct ws_neigh_table *table, const uint8_t *mac64)
         timer_stop(&table->timer_group, &neigh->etx_timer_compute);
         timer_stop(&table->timer_group, &neigh->etx_timer_outdated);
         SLIST_REMOVE(&table->neigh_list, neigh, ws_neigh, link);
+        SLIST_REMOVE(ws_neigh_bucket(table, neigh->mac64), neigh, ws_neigh, hash_link);
+        TAILQ_REMOVE(ws_neigh_lru(table, neigh), neigh, lru_link);
+        table->count--;
         TRACE(TR_NEIGH_15_4, "15.4 neighbor del %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
         if (table->on_del)
             table->on_del(table, neigh);
@@ -184,61 +300,128 @@ void ws_neigh_del(struct ws_neigh_table *table, const uint8_t *mac64)
 
 size_t ws_neigh_get_neigh_count(struct ws_neigh_table *table)
 {
-    return SLIST_SIZE(&table->neigh_list, link);
+    return table->count;
+}
+
+static void ws_neigh_ut_sample_reset(struct ws_neigh_fhss *fhss_data)
+{
+    int last = fhss_data->ffn.ut_sample_count - 1;
+
+    fhss_data->ffn.ut_samples[0] = fhss_data->ffn.ut_samples[last];
+    fhss_data->ffn.ut_sample_count = 1;
+    fhss_data->ffn.drift_ppm = 0;
 }
 
-static void ws_neigh_calculate_ufsi_drift(struct ws_neigh_fhss *fhss_data, uint24_t ufsi,
-                                          uint64_t timestamp, const uint8_t address[8])
+/*
+ * Least squares fit of the neighbor sequence time against the RCP time over
+ * the stored samples, the slope giving the drift. A single pair of samples
+ * would need a window of several seconds to reach 0.1ppm of precision with 1µs
+ * timestamps, and any error on one timestamp would show up directly.
+ */
+static void ws_neigh_ut_drift_update(struct ws_neigh_fhss *fhss_data, const uint8_t eui64[8])
 {
-    if (fhss_data->ffn.utt_rx_tstamp_us && fhss_data->ffn.ufsi) {
-        // No UFSI on fixed channel
-        if (fhss_data->uc_chan_func == WS_CHAN_FUNC_FIXED) {
+    // The UFSI is the fraction of the sequence of 0x10000 slots elapsed
+    double seq_us = 0x10000 * fhss_data->ffn.uc_dwell_interval_ms * 1000.;
+    int n = fhss_data->ffn.ut_sample_count;
+    double x[WS_NEIGH_UT_SAMPLE_COUNT], y[WS_NEIGH_UT_SAMPLE_COUNT];
+    double mean_x = 0, mean_y = 0, sxx = 0, sxy = 0;
+    double dx, dy, drift_ppm;
+
+    if (!fhss_data->ffn.uc_dwell_interval_ms)
+        return;
+    x[0] = 0;
+    y[0] = 0;
+    for (int i = 1; i < n; i++) {
+        x[i] = fhss_data->ffn.ut_samples[i].tstamp_us - fhss_data->ffn.ut_samples[0].tstamp_us;
+        dx = x[i] - x[i - 1];
+        dy = ((fhss_data->ffn.ut_samples[i].ufsi - fhss_data->ffn.ut_samples[i - 1].ufsi) & 0xffffff) *
+             seq_us / 0x1000000;
+        // Add the complete sequences elapsed between the samples
+        dy += round((dx - dy) / seq_us) * seq_us;
+        // The neighbor has likely restarted or changed its schedule
+        if (fabs(dy - dx) > dx * WS_NEIGH_UT_DRIFT_MAX_PPM / 1000000 + 1000) {
+            TRACE(TR_NEIGH_15_4, "15.4 neighbor sync %s / drift reset", tr_eui64(eui64));
+            ws_neigh_ut_sample_reset(fhss_data);
             return;
         }
-        double seq_length = 0x10000;
-        double ufsi_prev_tmp = fhss_data->ffn.ufsi;
-        double ufsi_cur_tmp = ufsi;
-        if (fhss_data->uc_chan_func == WS_CHAN_FUNC_DH1CF) {
-            if (ufsi_cur_tmp < ufsi_prev_tmp) {
-                ufsi_cur_tmp += 0xffffff;
-            }
-        }
-        // Convert 24-bit UFSI to real time before drift calculation
-        double time_since_seq_start_prev_ms = (ufsi_prev_tmp * seq_length * fhss_data->ffn.uc_dwell_interval_ms) / 0x1000000;
-        double time_since_seq_start_cur_ms = (ufsi_cur_tmp * seq_length * fhss_data->ffn.uc_dwell_interval_ms) / 0x1000000;
-        uint64_t time_since_last_ufsi_us = timestamp - fhss_data->ffn.utt_rx_tstamp_us;
-
-        double ufsi_diff_ms = time_since_seq_start_cur_ms - time_since_seq_start_prev_ms;
-        if (time_since_seq_start_cur_ms < time_since_seq_start_prev_ms)
-            // add ufsi sequence length
-            ufsi_diff_ms += seq_length * fhss_data->ffn.uc_dwell_interval_ms;
-
-        double ufsi_drift_ms = time_since_last_ufsi_us / 1000.f - ufsi_diff_ms;
-        // Since resolution of the RCP timer is 1µs, a window 10 million times
-        // larger (=10s) allows to get 0.1ppm of precision in the calculus below
-        // FIXME: improve precision by storing ufsi over time and calculate drift
-        // over a bigger window
-        if (time_since_last_ufsi_us >= 10000000)
-            TRACE(TR_NEIGH_15_4, "15.4 neighbor sync %s / %.01lfppm drift (%.0lfus in %"PRId64"s)", tr_eui64(address),
-                  1000000000.f * ufsi_drift_ms / time_since_last_ufsi_us, ufsi_drift_ms * 1000, time_since_last_ufsi_us / 1000000);
-        else
-            TRACE(TR_NEIGH_15_4, "15.4 neighbor sync %s / drift measure not available", tr_eui64(address));
+        y[i] = y[i - 1] + dy;
+    }
+    if (n < 3 || x[n - 1] < WS_NEIGH_UT_DRIFT_WINDOW_US) {
+        TRACE(TR_NEIGH_15_4, "15.4 neighbor sync %s / drift measure not available", tr_eui64(eui64));
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        mean_x += x[i] / n;
+        mean_y += y[i] / n;
+    }
+    for (int i = 0; i < n; i++) {
+        sxx += (x[i] - mean_x) * (x[i] - mean_x);
+        sxy += (x[i] - mean_x) * (y[i] - mean_y);
     }
+    drift_ppm = (sxy / sxx - 1) * 1000000;
+    if (fabs(drift_ppm) > WS_NEIGH_UT_DRIFT_MAX_PPM) {
+        TRACE(TR_NEIGH_15_4, "15.4 neighbor sync %s / drift reset", tr_eui64(eui64));
+        ws_neigh_ut_sample_reset(fhss_data);
+        return;
+    }
+    fhss_data->ffn.drift_ppm = drift_ppm;
+    TRACE(TR_NEIGH_15_4, "15.4 neighbor sync %s / %.01lfppm drift (%d samples in %.0lfs)", tr_eui64(eui64),
+          drift_ppm, n, x[n - 1] / 1000000);
+}
+
+static void ws_neigh_ut_sample_add(struct ws_neigh_fhss *fhss_data, uint24_t ufsi,
+                                   uint64_t tstamp_us, const uint8_t eui64[8])
+{
+    int n = fhss_data->ffn.ut_sample_count;
+
+    // No UFSI on fixed channel
+    if (fhss_data->uc_chan_func == WS_CHAN_FUNC_FIXED)
+        return;
+    if (n && tstamp_us == fhss_data->ffn.ut_samples[n - 1].tstamp_us)
+        return;
+    // The RCP has likely restarted
+    if (n && tstamp_us < fhss_data->ffn.ut_samples[n - 1].tstamp_us) {
+        fhss_data->ffn.drift_ppm = 0;
+        n = 0;
+    }
+    if (n >= 2 && tstamp_us - fhss_data->ffn.ut_samples[n - 2].tstamp_us < WS_NEIGH_UT_SAMPLE_INTERVAL_US) {
+        n--;
+    } else if (n == WS_NEIGH_UT_SAMPLE_COUNT) {
+        memmove(fhss_data->ffn.ut_samples, fhss_data->ffn.ut_samples + 1,
+                (n - 1) * sizeof(fhss_data->ffn.ut_samples[0]));
+        n--;
+    }
+    fhss_data->ffn.ut_samples[n].tstamp_us = tstamp_us;
+    fhss_data->ffn.ut_samples[n].ufsi      = ufsi;
+    fhss_data->ffn.ut_sample_count = n + 1;
+    ws_neigh_ut_drift_update(fhss_data, eui64);
 }
 
 void ws_neigh_ut_update(struct ws_neigh_fhss *fhss_data, uint24_t ufsi,
                         uint64_t tstamp_us, const uint8_t eui64[8])
 {
-    ws_neigh_calculate_ufsi_drift(fhss_data, ufsi, tstamp_us, eui64);
-
     if (fhss_data->ffn.utt_rx_tstamp_us == tstamp_us &&
         fhss_data->ffn.ufsi             == ufsi)
         return; // Save an update
 
+    ws_neigh_ut_sample_add(fhss_data, ufsi, tstamp_us, eui64);
     fhss_data->ffn.utt_rx_tstamp_us = tstamp_us;
     fhss_data->ffn.ufsi             = ufsi;
 }
 
+uint24_t ws_neigh_ut_ufsi(const struct ws_neigh_fhss *fhss_data, uint64_t tstamp_us)
+{
+    double shift;
+
+    if (!fhss_data->ffn.drift_ppm || !tstamp_us || !fhss_data->ffn.uc_dwell_interval_ms ||
+        fhss_data->uc_chan_func == WS_CHAN_FUNC_FIXED)
+        return fhss_data->ffn.ufsi;
+    // A UFSI unit is 0x10000 * dwell_ms * 1000 / 0x1000000 µs
+    shift = (double)(int64_t)(tstamp_us - fhss_data->ffn.utt_rx_tstamp_us) *
+            fhss_data->ffn.drift_ppm / 1000000 * 256 / (fhss_data->ffn.uc_dwell_interval_ms * 1000);
+    return (fhss_data->ffn.ufsi + (int64_t)lround(shift)) & 0xffffff;
+}
+
 // Wi-SUN FAN 1.1v08 - 6.3.4.6.4.2.6 Maintaining FFN / LFN Synchronization
 //   When the FFN receives a LUTT-IE from a LFN it does not adjust any time
 //   difference relative to the expected LFN’s unicast listening reference point.
@@ -295,6 +478,66 @@ static void ws_neigh_excluded_mask_by_mask(uint8_t channel_mask[WS_CHAN_MASK_LEN
             bitclr(channel_mask, i);
 }
 
+// Regulatory channel masks are computed from the channel plan of every
+// received US-IE and LCP-IE, which involves a channel plan lookup and parsing
+// the allowed channel string. Neighbors of a PAN are expected to advertise
+// the same few channel plans, so the results are cached.
+static uint16_t ws_neigh_chan_mask_reg(uint8_t chan_mask[WS_CHAN_MASK_LEN],
+                                       const struct ws_generic_channel_info *chan_info,
+                                       uint8_t regional_regulation)
+{
+    static struct {
+        bool     valid;
+        uint8_t  channel_plan;
+        uint8_t  reg_domain;
+        uint8_t  plan_id; // Operating Class or ChanPlanId
+        uint8_t  regional_regulation;
+        uint16_t chan_count;
+        uint8_t  chan_mask[WS_CHAN_MASK_LEN];
+    } cache[WS_NEIGH_CHAN_MASK_CACHE_LEN];
+    static int cache_next;
+    const struct chan_params *params;
+    uint8_t reg_domain, plan_id;
+    int i;
+
+    BUG_ON(chan_info->channel_plan != 0 && chan_info->channel_plan != 2);
+    if (chan_info->channel_plan == 0) {
+        reg_domain = chan_info->plan.zero.regulatory_domain;
+        plan_id    = chan_info->plan.zero.operating_class;
+    } else {
+        reg_domain = chan_info->plan.two.regulatory_domain;
+        plan_id    = chan_info->plan.two.channel_plan_id;
+    }
+    for (i = 0; i < ARRAY_SIZE(cache); i++) {
+        if (cache[i].valid &&
+            cache[i].channel_plan == chan_info->channel_plan &&
+            cache[i].reg_domain == reg_domain &&
+            cache[i].plan_id == plan_id &&
+            cache[i].regional_regulation == regional_regulation) {
+            memcpy(chan_mask, cache[i].chan_mask, WS_CHAN_MASK_LEN);
+            return cache[i].chan_count;
+        }
+    }
+
+    if (chan_info->channel_plan == 0)
+        params = ws_regdb_chan_params(reg_domain, 0, plan_id);
+    else
+        params = ws_regdb_chan_params(reg_domain, plan_id, 0);
+    BUG_ON(!params);
+    ws_chan_mask_calc_reg(chan_mask, params, regional_regulation);
+
+    i = cache_next;
+    cache_next = (cache_next + 1) % ARRAY_SIZE(cache);
+    cache[i].valid               = true;
+    cache[i].channel_plan        = chan_info->channel_plan;
+    cache[i].reg_domain          = reg_domain;
+    cache[i].plan_id             = plan_id;
+    cache[i].regional_regulation = regional_regulation;
+    cache[i].chan_count          = params->chan_count;
+    memcpy(cache[i].chan_mask, chan_mask, WS_CHAN_MASK_LEN);
+    return params->chan_count;
+}
+
 static void ws_neigh_set_chan_list(const struct ws_fhss_config *fhss_config,
                                    uint8_t chan_mask[WS_CHAN_MASK_LEN],
                                    const struct ws_generic_channel_info *chan_info)
@@ -304,30 +547,26 @@ static void ws_neigh_set_chan_list(const struct ws_fhss_config *fhss_config,
         .chan0_freq   = chan_info->plan.one.ch0 * 1000,
         .chan_count   = chan_info->plan.one.number_of_channel,
     };
-    const struct chan_params *params = NULL;
+    uint16_t chan_count;
 
     switch (chan_info->channel_plan) {
     case 0:
-        params = ws_regdb_chan_params(chan_info->plan.zero.regulatory_domain, 0, chan_info->plan.zero.operating_class);
-        BUG_ON(!params);
+    case 2:
+        chan_count = ws_neigh_chan_mask_reg(chan_mask, chan_info, fhss_config->regional_regulation);
         break;
     case 1:
-        params_custom.chan_spacing = ws_regdb_chan_spacing_from_id(chan_info->plan.one.channel_spacing),
-        params = &params_custom;
-        break;
-    case 2:
-        params = ws_regdb_chan_params(chan_info->plan.two.regulatory_domain, chan_info->plan.two.channel_plan_id, 0);
-        BUG_ON(!params);
+        params_custom.chan_spacing = ws_regdb_chan_spacing_from_id(chan_info->plan.one.channel_spacing);
+        ws_chan_mask_calc_reg(chan_mask, &params_custom, fhss_config->regional_regulation);
+        chan_count = params_custom.chan_count;
         break;
     default:
         BUG("unsupported channel plan: %d", chan_info->channel_plan);
     }
 
-    ws_chan_mask_calc_reg(chan_mask, params, fhss_config->regional_regulation);
     if (chan_info->excluded_channel_ctrl == WS_EXC_CHAN_CTRL_RANGE)
-        ws_neigh_excluded_mask_by_range(chan_mask, &chan_info->excluded_channels.range, params->chan_count);
+        ws_neigh_excluded_mask_by_range(chan_mask, &chan_info->excluded_channels.range, chan_count);
     if (chan_info->excluded_channel_ctrl == WS_EXC_CHAN_CTRL_BITMASK)
-        ws_neigh_excluded_mask_by_mask(chan_mask, &chan_info->excluded_channels.mask, params->chan_count);
+        ws_neigh_excluded_mask_by_mask(chan_mask, &chan_info->excluded_channels.mask, chan_count);
 }
 
 void ws_neigh_us_update(const struct ws_fhss_config *fhss_config, struct ws_neigh_fhss *fhss_data,
@@ -341,6 +580,7 @@ void ws_neigh_us_update(const struct ws_fhss_config *fhss_config, struct ws_neig
     } else {
         ws_neigh_set_chan_list(fhss_config, fhss_data->uc_channel_list, chan_info);
     }
+    rcp_fhss_uc_chan_encode(fhss_data);
     fhss_data->ffn.uc_dwell_interval_ms = dwell_interval;
 }
 
@@ -440,13 +680,14 @@ uint24_t ws_neigh_calc_lfn_adjusted_interval(uint24_t bc_interval, uint24_t uc_i
     }
 }
 
-uint24_t ws_neigh_calc_lfn_offset(uint24_t adjusted_listening_interval, uint32_t bc_interval)
+uint24_t ws_neigh_calc_lfn_offset(const struct ws_neigh_table *table, const struct ws_neigh *neigh,
+                                  uint24_t adjusted_listening_interval, uint32_t bc_interval)
 {
     /* This minimalist algorithm ensures that LFN BC will not overlap with any
      * LFN UC.
      * It returns an offset inside the LFN BC Interval that will be used by the
      * MAC to computed the actual offset to be applied by the targeted LFN.
-     * Any LFN UC is placed randomly after the LFN BC, in an interval of
+     * Any LFN UC is placed after the LFN BC, in an interval of
      *   offset = [GUARD_INTERVAL, LFN_BC_INTERVAL - GUARD_INTERVAL] or
      *   offset = [GUARD_INTERVAL, LFN_UC_INTERVAL - GUARD_INTERVAL]
      * For any multiple LFN UC interval, the listening slot will happen at
@@ -458,23 +699,60 @@ uint24_t ws_neigh_calc_lfn_offset(uint24_t adjusted_listening_interval, uint32_t
      *   "offset + n*LFN_BC_INTERVAL - LFN_UC INTERVAL" and
      *   "offset + n*LFN_BC_INTERVAL"
      * These are safe as long as "LFN_UC_INTERVAL >= 2 * GUARD_INTERVAL"
-     * Because of the randomness and the offset range depending on the
-     * LFN UC Interval, there is no protection between LFN Unicast schedules.
-     * However, they are spread as much as possible.
-     * TODO: algorithm that allocates or reallocates offsets to each LFN in
-     * order to minimize overlap.
+     * The range is split in slots of GUARD_INTERVAL (or more when there are
+     * too many), and the offset is taken in one of the slots least used by
+     * the other LFNs, so that unicast schedules stay spread when hundreds of
+     * LFNs share a parent. Only the offsets are compared, the listening
+     * intervals are ignored.
      */
-    uint16_t max_offset_ms;
+    uint16_t slots_use[WS_NEIGH_LFN_OFFSET_SLOTS_MAX];
+    const struct ws_neigh *cur;
+    uint24_t max_offset_ms;
+    uint24_t slot_ms;
+    int slots_count;
+    int slot, count;
+    uint16_t use;
 
     // Cannot protect LFN BC with such a short interval, do nothing
-    if (adjusted_listening_interval < 2 * LFN_SCHEDULE_GUARD_TIME_MS)
+    if (adjusted_listening_interval < 2 * LFN_SCHEDULE_GUARD_TIME_MS ||
+        bc_interval < 2 * LFN_SCHEDULE_GUARD_TIME_MS)
         return 0;
 
     if (adjusted_listening_interval >= bc_interval)
         max_offset_ms = bc_interval - LFN_SCHEDULE_GUARD_TIME_MS;
     else
         max_offset_ms = adjusted_listening_interval - LFN_SCHEDULE_GUARD_TIME_MS;
-    return LFN_SCHEDULE_GUARD_TIME_MS * rand_get_random_in_range(1, max_offset_ms / LFN_SCHEDULE_GUARD_TIME_MS);
+    slot_ms = LFN_SCHEDULE_GUARD_TIME_MS;
+    slot_ms *= roundup(max_offset_ms / LFN_SCHEDULE_GUARD_TIME_MS, WS_NEIGH_LFN_OFFSET_SLOTS_MAX) /
+               WS_NEIGH_LFN_OFFSET_SLOTS_MAX;
+    slots_count = max_offset_ms / slot_ms;
+
+    // Slot i covers [(i + 1) * slot_ms, (i + 2) * slot_ms)
+    memset(slots_use, 0, slots_count * sizeof(slots_use[0]));
+    SLIST_FOREACH(cur, &table->neigh_list, link) {
+        if (cur == neigh || cur->node_role != WS_NR_ROLE_LFN || !cur->lto_info.offset_ms)
+            continue;
+        slot = cur->lto_info.offset_ms / slot_ms - 1;
+        if (slot >= 0 && slot < slots_count && slots_use[slot] < UINT16_MAX)
+            slots_use[slot]++;
+    }
+
+    // Pick randomly among the least used slots
+    use = UINT16_MAX;
+    count = 0;
+    for (int i = 0; i < slots_count; i++) {
+        if (slots_use[i] < use) {
+            use = slots_use[i];
+            count = 0;
+        }
+        if (slots_use[i] == use)
+            count++;
+    }
+    count = rand_get_random_in_range(0, count - 1);
+    for (slot = 0; slot < slots_count; slot++)
+        if (slots_use[slot] == use && !count--)
+            break;
+    return (slot + 1) * slot_ms;
 }
 
 bool ws_neigh_lus_update(const struct ws_fhss_config *fhss_config,
@@ -504,31 +782,36 @@ bool ws_neigh_lus_update(const struct ws_fhss_config *fhss_config,
     } else {
         ws_neigh_set_chan_list(fhss_config, fhss_data->uc_channel_list, chan_info);
     }
+    rcp_fhss_uc_chan_encode(fhss_data);
     return offset_adjusted;
 }
 
 bool ws_neigh_duplicate_packet_check(struct ws_neigh *neigh, uint8_t mac_dsn, uint64_t rx_timestamp)
 {
-    if (neigh->last_dsn != mac_dsn) {
-        // New packet always accepted
-        neigh->last_dsn = mac_dsn;
-        return true;
-    }
-
-    if (!neigh->unicast_data_rx) {
-        // No unicast info stored always accepted
-        return true;
-    }
-
-    rx_timestamp -= neigh->fhss_data.ffn.utt_rx_tstamp_us;
-    rx_timestamp /= 1000000; //Convert to s
-
-    //Compare only when last rx timestamp is less than 5 seconds
-    if (rx_timestamp < 5) {
-        //Packet is sent too fast filter it out
-        return false;
+    // Distance from the most recent DSN, modulo 256
+    uint8_t age = neigh->dsn_last - mac_dsn;
+
+    // DSNs wrap quickly and neighbors may reboot, so the window is discarded
+    // when the neighbor did not send anything for a while.
+    if (!neigh->dsn_window || rx_timestamp - neigh->dsn_rx_tstamp_us >= WS_NEIGH_DSN_WINDOW_TIMEOUT_US)
+        age = WS_NEIGH_DSN_WINDOW_LEN;
+    neigh->dsn_rx_tstamp_us = rx_timestamp;
+
+    if (age < WS_NEIGH_DSN_WINDOW_LEN) {
+        if (neigh->dsn_window & (UINT64_C(1) << age))
+            return false;
+        neigh->dsn_window |= UINT64_C(1) << age;
+    } else if (age > 128) {
+        // Newer DSN, slide the window
+        age = -age;
+        neigh->dsn_window = age < WS_NEIGH_DSN_WINDOW_LEN ? neigh->dsn_window << age : 0;
+        neigh->dsn_window |= 1;
+        neigh->dsn_last = mac_dsn;
+    } else {
+        // Too old to be tracked, assume the neighbor restarted its sequence
+        neigh->dsn_window = 1;
+        neigh->dsn_last = mac_dsn;
     }
-
     return true;
 }
 
@@ -548,31 +831,26 @@ void ws_neigh_trust(struct ws_neigh_table *table, struct ws_neigh *neigh)
     if (neigh->trusted_device)
         return;
 
-    timer_start_rel(&table->timer_group, &neigh->timer, neigh->lifetime_s * 1000);
+    ws_neigh_lifetime_start(table, neigh);
+    TAILQ_REMOVE(&table->lru_untrusted, neigh, lru_link);
     neigh->trusted_device = true;
+    TAILQ_INSERT_TAIL(&table->lru_trusted, neigh, lru_link);
     TRACE(TR_NEIGH_15_4, "15.4 neighbor trusted %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
 }
 
-void ws_neigh_refresh(struct ws_neigh_table *table, struct ws_neigh *neigh, uint32_t lifetime_s)
+void ws_neigh_heard(struct ws_neigh_table *table, struct ws_neigh *neigh)
 {
-    neigh->lifetime_s = lifetime_s;
-    timer_start_rel(&table->timer_group, &neigh->timer, neigh->lifetime_s * 1000);
-    TRACE(TR_NEIGH_15_4, "15.4 neighbor refresh %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
+    struct ws_neigh_lru *lru = ws_neigh_lru(table, neigh);
+
+    if (TAILQ_LAST(lru, ws_neigh_lru) == neigh)
+        return;
+    TAILQ_REMOVE(lru, neigh, lru_link);
+    TAILQ_INSERT_TAIL(lru, neigh, lru_link);
 }
 
-/*
- *   Wi-SUN FAN 1.1v08 3.1 Definitions
- * Exponentially Weighted Moving Average
- *
- *   Wi-SUN FAN 1.1v08 6.2.1 Constants
- * ETX_EWMA_SF    ETX EWMA Smoothing Factor   1/8
- * RSL_EWMA_SF    RSL EWMA Smoothing Factor   1/8
- */
-float ws_neigh_ewma_next(float cur, float val)
+void ws_neigh_refresh(struct ws_neigh_table *table, struct ws_neigh *neigh, uint32_t lifetime_s)
 {
-    // EWMA(0) = X(0)
-    if (isnan(cur))
-        return val;
-    // EWMA(t) = S(X(t)) + (1-S)(EWMA(t-1))
-    return (val + 7 * cur) / 8;
+    neigh->lifetime_s = lifetime_s;
+    ws_neigh_lifetime_start(table, neigh);
+    TRACE(TR_NEIGH_15_4, "15.4 neighbor refresh %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
 }
@@ -19,6 +19,7 @@
 #ifndef WS_NEIGH_H
 #define WS_NEIGH_H
 #include <sys/queue.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
@@ -32,6 +33,25 @@
 #define WS_NEIGHBOUR_TEMPORARY_ENTRY_LIFETIME 600
 #define WS_NEIGHBOR_LINK_TIMEOUT 2200
 
+// Number of buckets in the EUI-64 index of struct ws_neigh_table, as a power
+// of 2. Sized for a few thousands of neighbors with short collision chains.
+#define WS_NEIGH_HASH_BITS 10
+
+// Granularity of the LFN unicast offsets, see ws_neigh_calc_lfn_offset()
+#define WS_NEIGH_LFN_OFFSET_SLOTS_MAX 256
+
+// Recent link statistics of each neighbor, see ws_neigh.stats.
+#define WS_NEIGH_STATS_PERIOD_S 60
+#define WS_NEIGH_STATS_COUNT    16
+
+// UTT-IE samples kept to estimate the clock drift of FFN neighbors, see
+// ws_neigh_ut_update(). Samples closer than WS_NEIGH_UT_SAMPLE_INTERVAL_US
+// replace each other.
+#define WS_NEIGH_UT_SAMPLE_COUNT        8
+#define WS_NEIGH_UT_SAMPLE_INTERVAL_US  1000000
+#define WS_NEIGH_UT_DRIFT_WINDOW_US     10000000
+#define WS_NEIGH_UT_DRIFT_MAX_PPM       200
+
 struct ws_fhss_config;
 
 struct ws_neigh_fhss {
@@ -40,6 +60,16 @@ struct ws_neigh_fhss {
             uint8_t  uc_dwell_interval_ms;  // from US-IE
             uint24_t ufsi;                  // from UTT-IE
             uint64_t utt_rx_tstamp_us;
+            // Last UTT-IE received, oldest first, to fit the neighbor
+            // sequence time against the RCP time.
+            struct {
+                uint64_t tstamp_us;
+                uint24_t ufsi;
+            } ut_samples[WS_NEIGH_UT_SAMPLE_COUNT];
+            uint8_t ut_sample_count;
+            // Estimated drift of the neighbor clock relative to the RCP one,
+            // 0 until enough samples are received.
+            float drift_ppm;
         } ffn;
         struct {
             uint24_t uc_listen_interval_ms; // from LUS-IE
@@ -56,14 +86,41 @@ struct ws_neigh_fhss {
     };
     uint8_t  uc_chan_func;  // from US-IE or LUS-IE/LCP-IE
     uint8_t  uc_channel_list[WS_CHAN_MASK_LEN]; // Neighbor unicast channel list
+    // HIF encoding of uc_chan_func and uc_channel_list, see rcp_fhss_uc_chan_encode()
+    uint8_t  uc_chan_hif[2 + WS_CHAN_MASK_LEN];
+    uint8_t  uc_chan_hif_len;
+};
+
+// Statistics of a PhyModeId used for automatic mode switch
+struct ws_neigh_ms_rate {
+    uint8_t  phy_mode_id;
+    uint32_t datarate;
+    uint16_t tx_attempts;   // Since the last statistics update
+    uint16_t tx_success;    // Since the last statistics update
+    float    success_prob;  // EWMA, NAN until measured
 };
 
 struct lto_info {
     uint24_t uc_interval_min_ms;    // from NR-IE
     uint24_t uc_interval_max_ms;    // from NR-IE
+    uint24_t offset_ms;             // last sent in LTO-IE, 0 if none
     bool offset_adjusted;
 };
 
+// Link statistics of a neighbor over WS_NEIGH_STATS_PERIOD_S. Counters
+// saturate.
+struct ws_neigh_stats {
+    uint32_t start_s;           // CLOCK_MONOTONIC, multiple of the period
+    uint16_t tx_count;          // Unicast frames confirmed by the RCP
+    uint16_t tx_ack;
+    uint16_t tx_retries;
+    uint16_t tx_cca_fail;
+    uint16_t rx_count;          // Data frames
+    uint8_t  phy_mode_id;       // Of the last acknowledged frame, 0 if none
+    uint16_t tx_latency_ms_max; // From the MAC request to the confirmation
+    uint32_t tx_latency_ms_sum;
+};
+
 struct ws_neigh {
     /**
      * Theses fields were introduced to differentiate FHSS data read in secured
@@ -96,23 +153,37 @@ struct ws_neigh {
     float rsl_in_dbm;                                          /*!< RSL EWMA heard from neighbour*/
     float rsl_in_dbm_unsecured;                                /*!< RSL EWMA heard from neighbour*/
     float rsl_out_dbm;                                         /*!< RSL EWMA heard by neighbour*/
-    uint8_t last_dsn;
+    // Sliding window of received DSNs, bit i is set if dsn_last - i was
+    // received, see ws_neigh_duplicate_packet_check().
+    uint8_t dsn_last;
+    uint64_t dsn_window;
+    uint64_t dsn_rx_tstamp_us;
     int rx_power_dbm;
     int rx_power_dbm_unsecured;
     int lqi;
     int lqi_unsecured;
-    bool unicast_data_rx : 1;
     struct ws_pom_ie pom_ie;
     struct lto_info lto_info;
     uint8_t node_role;
+    // Lowest frame counter accepted per key, UINT32_MAX when the key is not
+    // used by the neighbor. Updated on RX and on key changes, and passed as is
+    // to rcp_req_data_tx() so the RCP checks the frame counter of the ACK.
     uint32_t frame_counter_min[HIF_KEY_COUNT];
     uint8_t mac64[8];                                      /*!< MAC64 */
     uint32_t expiration_s;
     uint32_t lifetime_s;                                   /*!< Life time in seconds */
+    // End of the lifetime, timer may expire earlier, see ws_neigh_refresh()
+    uint64_t expire_ms;
     uint8_t ms_phy_mode_id;                                /*!< PhyModeId selected for Mode Switch with this neighbor */
     uint8_t ms_mode;                                       /*!< Mode switch mode */
     uint32_t ms_tx_count;                                  /*!< Mode switch Tx success count */ // TODO: implement fallback mechanism in wbsrd
     uint32_t ms_retries_count;                             /*!< Mode switch Tx retries */ // TODO: implement fallback mechanism in wsbrd
+    // Automatic mode switch, see ws_llc_ms_auto_fill_rates()
+    struct ws_neigh_ms_rate ms_rates[FIELD_MAX(WS_MASK_POM_COUNT) + 1]; // +1 for the base PhyModeId
+    uint8_t ms_rate_count;
+    struct ws_pom_ie ms_rates_pom;                         // POM-IE used to build ms_rates
+    uint8_t ms_probe_countdown;
+    uint64_t ms_stats_update_ms;
 
     /*
      * TX power used for Adaptive Power Control (APC).
@@ -131,11 +202,35 @@ struct ws_neigh {
     struct timer_entry etx_timer_outdated;
 
     uint8_t edfe_mode;
+    uint32_t edfe_tx_count;
+    uint32_t edfe_tx_fail_count;
+
+    // Selective Fragment Recovery (RFC 8931) is used to send fragmented
+    // datagrams. Enabled once an RFRAG or an RFRAG-ACK is received from the
+    // neighbor, or explicitly over D-Bus.
+    bool sfr;
+
+    // Airtime of unicast frames, estimated from the rates and retries of the
+    // TX confirmations. airtime_us_per_byte is an EWMA (NAN until measured)
+    // used for airtime fairness.
+    uint64_t airtime_us;
+    float airtime_us_per_byte;
+
+    // Ring of the statistics of the last WS_NEIGH_STATS_COUNT periods with
+    // some traffic, stats[stats_head] being the current one. The memory is
+    // fixed, so they are always collected. Unused entries are zeroed.
+    struct ws_neigh_stats stats[WS_NEIGH_STATS_COUNT];
+    uint8_t stats_head;
+    // Frames to this neighbor waiting for a confirmation (common/ws only)
+    uint8_t frame_ctx_count;
     bool trusted_device: 1;                                /*!< True mean use normal group key, false for enable pairwise key */
     struct timer_entry timer;
     SLIST_ENTRY(ws_neigh) link;
+    SLIST_ENTRY(ws_neigh) hash_link;
+    TAILQ_ENTRY(ws_neigh) lru_link;
 };
 SLIST_HEAD(ws_neigh_list, ws_neigh);
+TAILQ_HEAD(ws_neigh_lru, ws_neigh);
 
 /**
  * Neighbor hopping info data base
@@ -143,6 +238,17 @@ SLIST_HEAD(ws_neigh_list, ws_neigh);
 struct ws_neigh_table {
     struct timer_group timer_group;
     struct ws_neigh_list neigh_list;
+    // Index of neigh_list by EUI-64, used by ws_neigh_get(). neigh_list is
+    // kept for iteration so the insertion order is preserved.
+    struct ws_neigh_list neigh_hash[1 << WS_NEIGH_HASH_BITS];
+    // Neighbors by time of last reception (oldest first), untrusted and
+    // trusted ones apart. When max_count (0 for no limit) is reached,
+    // ws_neigh_add() evicts the least recently heard untrusted neighbor, or
+    // the least recently heard trusted one if there is none.
+    struct ws_neigh_lru lru_untrusted;
+    struct ws_neigh_lru lru_trusted;
+    int count;
+    int max_count;
     void (*on_add)(struct ws_neigh_table *table, struct ws_neigh *neigh);
     void (*on_del)(struct ws_neigh_table *table, struct ws_neigh *neigh);
 
@@ -154,6 +260,8 @@ struct ws_neigh_table {
     void (*on_etx_update)(struct ws_neigh_table *table, struct ws_neigh *neigh);
 };
 
+void ws_neigh_table_init(struct ws_neigh_table *table);
+
 struct ws_neigh *ws_neigh_get(const struct ws_neigh_table *table, const uint8_t *mac64);
 
 void ws_neigh_del(struct ws_neigh_table *table, const uint8_t *mac64);
@@ -161,6 +269,11 @@ void ws_neigh_del(struct ws_neigh_table *table, const uint8_t *mac64);
 // Unicast Timing update
 void ws_neigh_ut_update(struct ws_neigh_fhss *fhss_data, uint24_t ufsi,
                         uint64_t tstamp_us, const uint8_t eui64[8]);
+// Return the UFSI to send to the RCP along with ffn.utt_rx_tstamp_us for a
+// frame sent at tstamp_us (RCP time). The RCP extrapolates the neighbor
+// position at the nominal rate, so the UFSI is shifted by the drift
+// accumulated since the UTT-IE was received.
+uint24_t ws_neigh_ut_ufsi(const struct ws_neigh_fhss *fhss_data, uint64_t tstamp_us);
 // LFN Unicast timing update
 void ws_neigh_lut_update(struct ws_neigh_fhss *fhss_data,
                          uint16_t slot_number, uint24_t interval_offset,
@@ -182,11 +295,15 @@ bool ws_neigh_lus_update(const struct ws_fhss_config *fhss_config,
 uint24_t ws_neigh_calc_lfn_adjusted_interval(uint24_t bc_interval, uint24_t uc_interval,
                                              uint24_t uc_interval_min, uint24_t uc_interval_max);
 
-uint24_t ws_neigh_calc_lfn_offset(uint24_t adjusted_listening_interval, uint32_t bc_interval);
+// Offset of the LFN unicast schedule relative to the LFN broadcast schedule,
+// to be sent in a LTO-IE and stored in lto_info.offset_ms.
+uint24_t ws_neigh_calc_lfn_offset(const struct ws_neigh_table *table, const struct ws_neigh *neigh,
+                                  uint24_t adjusted_listening_interval, uint32_t bc_interval);
 
 // Node Role update (LFN only)
 void ws_neigh_nr_update(struct ws_neigh *neigh, struct ws_nr_ie *nr_ie);
 
+// Return false if the DSN was already received recently from this neighbor.
 bool ws_neigh_duplicate_packet_check(struct ws_neigh *neigh, uint8_t mac_dsn, uint64_t rx_timestamp);
 
 int ws_neigh_lfn_count(struct ws_neigh_table *table);
@@ -200,6 +317,12 @@ size_t ws_neigh_get_neigh_count(struct ws_neigh_table *table);
 
 void ws_neigh_trust(struct ws_neigh_table *table, struct ws_neigh *neigh);
 
+// Must be called when a frame is received from the neighbor, to maintain the
+// eviction order.
+void ws_neigh_heard(struct ws_neigh_table *table, struct ws_neigh *neigh);
+
+// Only moves expire_ms forward in the common case: the timer is re-armed when
+// it fires before the end of the lifetime, or if the lifetime is shortened.
 void ws_neigh_refresh(struct ws_neigh_table *table, struct ws_neigh *neigh, uint32_t lifetime_s);
 
 // Must be called when a data transmission request is finished.
@@ -207,6 +330,29 @@ void ws_neigh_etx_update(struct ws_neigh_table *table,
                          struct ws_neigh *neigh,
                          int tx_count, bool ack);
 
-float ws_neigh_ewma_next(float cur, float val);
+// Account a TX confirmation of a unicast frame (status is an enum
+// hif_data_status), or a received data frame, in ws_neigh.stats.
+void ws_neigh_stats_tx(struct ws_neigh *neigh, uint8_t status, uint8_t tx_retries,
+                       uint8_t phy_mode_id, uint64_t latency_ms);
+void ws_neigh_stats_rx(struct ws_neigh *neigh);
+
+/*
+ *   Wi-SUN FAN 1.1v08 3.1 Definitions
+ * Exponentially Weighted Moving Average
+ *
+ *   Wi-SUN FAN 1.1v08 6.2.1 Constants
+ * ETX_EWMA_SF    ETX EWMA Smoothing Factor   1/8
+ * RSL_EWMA_SF    RSL EWMA Smoothing Factor   1/8
+ *
+ * Inlined since it is called for every received frame and TX confirmation.
+ */
+static inline float ws_neigh_ewma_next(float cur, float val)
+{
+    // EWMA(0) = X(0)
+    if (isnan(cur))
+        return val;
+    // EWMA(t) = S(X(t)) + (1-S)(EWMA(t-1))
+    return (val + 7 * cur) / 8;
+}
 
 #endif
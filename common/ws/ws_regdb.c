@@ -11,10 +11,13 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <assert.h>
 #include <stddef.h>
 #include <limits.h>
 
+#include "common/bits.h"
 #include "common/hif.h"
+#include "common/log.h"
 #include "common/memutils.h"
 #include "ws_regdb.h"
 
@@ -221,24 +224,68 @@ bool ws_regdb_check_phy_chan_compat(const struct phy_params *phy_params, const s
     return false;
 }
 
-const struct phy_params *ws_regdb_phy_params_from_mode(int operating_mode)
+/*
+ * The tables above are indexed once, on first lookup, by the keys used in the
+ * frames (PHY Mode ID, operating mode, domain and channel plan or class). The
+ * indexes store the position in the table + 1, 0 meaning absent. When several
+ * entries share a key, the first one wins, as with a linear scan.
+ */
+static struct {
+    bool init;
+    uint8_t phy_by_id[UINT8_MAX + 1];
+    uint8_t phy_by_mode[UINT8_MAX + 1];
+    uint8_t chan_by_plan[REG_DOMAIN_UNDEF][UINT8_MAX + 1];
+    uint8_t chan_by_class[REG_DOMAIN_UNDEF][UINT8_MAX + 1];
+    uint16_t std_domains[UINT8_MAX + 1]; // Bitmap of domains by PHY Mode ID
+} g_regdb_index;
+
+static void ws_regdb_index_set(uint8_t *slot, int i)
 {
-    int i;
+    static_assert(ARRAY_SIZE(phy_params_table) < UINT8_MAX, "index overflow");
+    static_assert(ARRAY_SIZE(chan_params_table) < UINT8_MAX, "index overflow");
+    if (!*slot)
+        *slot = i + 1;
+}
 
-    for (i = 0; phy_params_table[i].phy_mode_id; i++)
-        if (phy_params_table[i].op_mode == operating_mode)
-            return &phy_params_table[i];
-    return NULL;
+static void ws_regdb_index_init(void)
+{
+    const struct chan_params *chan;
+    const struct phy_params *phy;
+
+    for (int i = 0; phy_params_table[i].phy_mode_id; i++) {
+        phy = &phy_params_table[i];
+        ws_regdb_index_set(&g_regdb_index.phy_by_id[phy->phy_mode_id], i);
+        ws_regdb_index_set(&g_regdb_index.phy_by_mode[phy->op_mode], i);
+    }
+    for (int i = 0; chan_params_table[i].chan0_freq; i++) {
+        chan = &chan_params_table[i];
+        BUG_ON(chan->reg_domain >= REG_DOMAIN_UNDEF);
+        if (chan->chan_plan_id)
+            ws_regdb_index_set(&g_regdb_index.chan_by_plan[chan->reg_domain][chan->chan_plan_id], i);
+        if (chan->op_class)
+            ws_regdb_index_set(&g_regdb_index.chan_by_class[chan->reg_domain][chan->op_class], i);
+        for (int j = 0; chan->valid_phy_modes[j]; j++)
+            g_regdb_index.std_domains[chan->valid_phy_modes[j]] |= BIT(chan->reg_domain);
+    }
+    g_regdb_index.init = true;
 }
 
-const struct phy_params *ws_regdb_phy_params_from_id(int phy_mode_id)
+static const struct phy_params *ws_regdb_phy_params_from_mode(int operating_mode)
 {
-    int i;
+    if (!g_regdb_index.init)
+        ws_regdb_index_init();
+    if (operating_mode < 0 || operating_mode > UINT8_MAX || !g_regdb_index.phy_by_mode[operating_mode])
+        return NULL;
+    return &phy_params_table[g_regdb_index.phy_by_mode[operating_mode] - 1];
+}
 
-    for (i = 0; phy_params_table[i].phy_mode_id; i++)
-        if (phy_params_table[i].phy_mode_id == phy_mode_id)
-            return &phy_params_table[i];
-    return NULL;
+static const struct phy_params *ws_regdb_phy_params_from_id(int phy_mode_id)
+{
+    if (!g_regdb_index.init)
+        ws_regdb_index_init();
+    if (phy_mode_id < 0 || phy_mode_id > UINT8_MAX || !g_regdb_index.phy_by_id[phy_mode_id])
+        return NULL;
+    return &phy_params_table[g_regdb_index.phy_by_id[phy_mode_id] - 1];
 }
 
 const struct phy_params *ws_regdb_phy_params(int phy_mode_id, int operating_mode)
@@ -251,39 +298,25 @@ const struct phy_params *ws_regdb_phy_params(int phy_mode_id, int operating_mode
     return phy_params;
 }
 
-static const struct chan_params *ws_regdb_chan_params_fan1_0(int reg_domain, int operating_class)
+static const struct chan_params *ws_regdb_chan_params_lookup(uint8_t index[REG_DOMAIN_UNDEF][UINT8_MAX + 1],
+                                                             int reg_domain, int key)
 {
-    int i;
-
-    if (!operating_class)
+    if (!g_regdb_index.init)
+        ws_regdb_index_init();
+    if (reg_domain < 0 || reg_domain >= REG_DOMAIN_UNDEF || key <= 0 || key > UINT8_MAX)
         return NULL;
-    for (i = 0; chan_params_table[i].chan0_freq; i++)
-        if (chan_params_table[i].reg_domain == reg_domain &&
-            chan_params_table[i].op_class == operating_class)
-            return &chan_params_table[i];
-    return NULL;
-}
-
-static const struct chan_params *ws_regdb_chan_params_fan1_1(int reg_domain, int chan_plan_id)
-{
-    int i;
-
-    if (!chan_plan_id)
+    if (!index[reg_domain][key])
         return NULL;
-    for (i = 0; chan_params_table[i].chan0_freq; i++)
-        if (chan_params_table[i].reg_domain == reg_domain &&
-            chan_params_table[i].chan_plan_id == chan_plan_id)
-            return &chan_params_table[i];
-    return NULL;
+    return &chan_params_table[index[reg_domain][key] - 1];
 }
 
 const struct chan_params * ws_regdb_chan_params(int reg_domain, int chan_plan_id, int operating_class)
 {
     const struct chan_params * chan_params = NULL;
 
-    chan_params = ws_regdb_chan_params_fan1_1(reg_domain, chan_plan_id);
+    chan_params = ws_regdb_chan_params_lookup(g_regdb_index.chan_by_plan, reg_domain, chan_plan_id);
     if (!chan_params)
-        chan_params = ws_regdb_chan_params_fan1_0(reg_domain, operating_class);
+        chan_params = ws_regdb_chan_params_lookup(g_regdb_index.chan_by_class, reg_domain, operating_class);
 
     return chan_params;
 }
@@ -313,24 +346,26 @@ int ws_regdb_chan_spacing_id(int val)
 
 int ws_regdb_chan_spacing_from_id(int id)
 {
-    int i;
-
-    for (i = 0; i < ARRAY_SIZE(chan_spacing_table); i++)
-        if (id == chan_spacing_table[i].id)
-            return chan_spacing_table[i].val;
-    return 0;
+    static const int chan_spacing_from_id[] = {
+        [CHANNEL_SPACING_200]  =  200000,
+        [CHANNEL_SPACING_400]  =  400000,
+        [CHANNEL_SPACING_600]  =  600000,
+        [CHANNEL_SPACING_100]  =  100000,
+        [CHANNEL_SPACING_250]  =  250000,
+        [CHANNEL_SPACING_800]  =  800000,
+        [CHANNEL_SPACING_1200] = 1200000,
+    };
+
+    if (id < 0 || id >= ARRAY_SIZE(chan_spacing_from_id))
+        return 0;
+    return chan_spacing_from_id[id];
 }
 
 bool ws_regdb_is_std(uint8_t reg_domain, uint8_t phy_mode_id)
 {
-    int i, j;
-
-    for (i = 0; chan_params_table[i].chan0_freq; i++) {
-        if (chan_params_table[i].reg_domain == reg_domain) {
-            for (j = 0; chan_params_table[i].valid_phy_modes[j]; j++)
-                if (chan_params_table[i].valid_phy_modes[j] == phy_mode_id)
-                    return true;
-        }
-    }
-    return false;
+    if (!g_regdb_index.init)
+        ws_regdb_index_init();
+    if (reg_domain >= REG_DOMAIN_UNDEF)
+        return false;
+    return g_regdb_index.std_domains[phy_mode_id] & BIT(reg_domain);
 }
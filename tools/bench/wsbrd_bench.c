@@ -0,0 +1,746 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common/ipv6/6lowpan_iphc.h"
+#include "common/specs/ieee802154.h"
+#include "common/specs/ws.h"
+#include "common/ws/ws_ie.h"
+#include "common/ws/ws_neigh.h"
+#include "common/crc.h"
+#include "common/endian.h"
+#include "common/ieee802154_frame.h"
+#include "common/ieee802154_ie.h"
+#include "common/iobuf.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/pktbuf.h"
+#include "common/timer.h"
+
+#include "6lowpan/iphc_decode/iphc_compress.h"
+#include "6lowpan/iphc_decode/iphc_decompress.h"
+#include "net/ns_buffer.h"
+#include "rpl/rpl_srh.h"
+#include "rpl/rpl.h"
+
+/*
+ * Microbenchmarks of the data paths of wsbrd, in the spirit of Google
+ * Benchmark: each benchmark is run with an increasing number of iterations
+ * until it lasts at least --min-time, and the time per iteration is reported.
+ * Setup and teardown are excluded from the measure.
+ *
+ * With --csv, the results can be saved and given back with --baseline to a
+ * later build. wsbrd-bench then exits with an error if any benchmark is
+ * slower than its baseline by more than --threshold percent, so it can gate
+ * upgrades in a CI.
+ */
+
+struct bench_state {
+    int arg;
+    uint64_t iterations;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    // Bytes processed per iteration, to report a throughput
+    int bytes;
+};
+
+struct bench {
+    const char *name;
+    void (*fn)(struct bench_state *state);
+    int arg;
+};
+
+struct bench_result {
+    char name[64];
+    double ns;
+};
+
+static struct {
+    const char *filter;
+    double min_time_s;
+    int repetitions;
+    bool csv;
+    const char *baseline;
+    double threshold;
+} g_bench_cfg = {
+    .min_time_s = 0.5,
+    .repetitions = 1,
+    .threshold  = 10,
+};
+
+// Prevent the compiler from discarding the computations being measured
+static volatile uint64_t g_bench_sink;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static void bench_start(struct bench_state *state)
+{
+    state->start_ns = bench_now_ns();
+}
+
+static void bench_stop(struct bench_state *state)
+{
+    state->elapsed_ns += bench_now_ns() - state->start_ns;
+}
+
+static void bench_crc16(struct bench_state *state)
+{
+    uint8_t *data = xalloc(state->arg);
+    uint16_t crc = 0;
+
+    for (int i = 0; i < state->arg; i++)
+        data[i] = rand();
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++)
+        crc ^= crc16(CRC_INIT_FCS, data, state->arg);
+    bench_stop(state);
+    g_bench_sink = crc;
+    state->bytes = state->arg;
+    free(data);
+}
+
+// Fields of a typical HIF command
+static void bench_iobuf_push(struct bench_state *state)
+{
+    static const uint8_t eui64[8] = { 0x02, 0x12, 0x4b, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    struct iobuf_write buf = { };
+
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        buf.len = 0;
+        iobuf_push_u8(&buf, i);
+        iobuf_push_le16(&buf, i);
+        iobuf_push_le32(&buf, i);
+        iobuf_push_le64(&buf, i);
+        iobuf_push_data(&buf, eui64, sizeof(eui64));
+        iobuf_push_data_reserved(&buf, state->arg);
+    }
+    bench_stop(state);
+    g_bench_sink = buf.len;
+    iobuf_free(&buf);
+}
+
+static void bench_iobuf_pop(struct bench_state *state)
+{
+    struct iobuf_write buf = { };
+    struct iobuf_read rbuf = { };
+    uint8_t eui64[8];
+    uint64_t val = 0;
+
+    iobuf_push_u8(&buf, 1);
+    iobuf_push_le16(&buf, 2);
+    iobuf_push_le32(&buf, 3);
+    iobuf_push_le64(&buf, 4);
+    iobuf_push_data_reserved(&buf, sizeof(eui64) + state->arg);
+    rbuf.data = buf.data;
+    rbuf.data_size = buf.len;
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        rbuf.cnt = 0;
+        val += iobuf_pop_u8(&rbuf);
+        val += iobuf_pop_le16(&rbuf);
+        val += iobuf_pop_le32(&rbuf);
+        val += iobuf_pop_le64(&rbuf);
+        iobuf_pop_data(&rbuf, eui64, sizeof(eui64));
+        val += *(const uint8_t *)iobuf_pop_data_ptr(&rbuf, state->arg);
+    }
+    bench_stop(state);
+    BUG_ON(rbuf.err);
+    g_bench_sink = val;
+    iobuf_free(&buf);
+}
+
+// Headers pushed and popped in front of a packet, like a 6LoWPAN dispatch
+static void bench_pktbuf_push_pop(struct bench_state *state)
+{
+    uint8_t payload[128] = { }, hdr[8] = { };
+    struct pktbuf pktbuf = { };
+    uint64_t val = 0;
+
+    pktbuf_init_headroom(&pktbuf, 64, payload, sizeof(payload));
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        pktbuf_push_head_be32(&pktbuf, i);
+        pktbuf_push_head_be16(&pktbuf, i);
+        pktbuf_push_head(&pktbuf, hdr, sizeof(hdr));
+        pktbuf_push_head_u8(&pktbuf, i);
+        val += pktbuf_pop_head_u8(&pktbuf);
+        pktbuf_pop_head(&pktbuf, hdr, sizeof(hdr));
+        val += pktbuf_pop_head_be16(&pktbuf);
+        val += pktbuf_pop_head_be32(&pktbuf);
+    }
+    bench_stop(state);
+    BUG_ON(pktbuf.err);
+    g_bench_sink = val;
+    pktbuf_free(&pktbuf);
+}
+
+struct bench_pkt {
+    uint8_t data[40 + 8 + 64];
+    int len;
+    uint8_t src_iid[8];
+    uint8_t dst_iid[8];
+};
+
+// arg 0 is a link-local DHCPv6 relay message, arg 1 a CoAP request from the
+// backhaul, see also tools/demo/iphc_bench.c.
+static void bench_pkt_init(struct bench_pkt *pkt, int arg)
+{
+    struct ip6_hdr *hdr = (struct ip6_hdr *)pkt->data;
+    struct udphdr *udp = (struct udphdr *)(hdr + 1);
+
+    memset(pkt, 0, sizeof(*pkt));
+    pkt->len = sizeof(pkt->data);
+    hdr->ip6_flow = htonl(6 << 28);
+    hdr->ip6_plen = htons(pkt->len - sizeof(*hdr));
+    hdr->ip6_nxt  = IPPROTO_UDP;
+    hdr->ip6_hlim = arg ? 64 : 255;
+    inet_pton(AF_INET6, arg ? "2001:db8::1"    : "fe80::212:4b00:1:2", &hdr->ip6_src);
+    inet_pton(AF_INET6, arg ? "2001:db8::1:3" : "fe80::212:4b00:1:3", &hdr->ip6_dst);
+    udp->uh_sport = htons(arg ? 49152 : 547);
+    udp->uh_dport = htons(arg ? 5683  : 547);
+    udp->uh_ulen  = hdr->ip6_plen;
+    // The link-layer addresses match the IIDs of link-local addresses, the
+    // global packet is sent by the border router to the first hop.
+    memcpy(pkt->src_iid, (uint8_t[8]){ 0x02, 0x12, 0x4b, 0x00, 0x00, 0x01, 0x00, 0x02 }, 8);
+    memcpy(pkt->dst_iid, (uint8_t[8]){ 0x02, 0x12, 0x4b, 0x00, 0x00, 0x01, 0x00, 0x03 }, 8);
+}
+
+static void bench_sockaddr_set(sockaddr_t *sa, const uint8_t iid[8])
+{
+    sa->addr_type = ADDR_802_15_4_LONG;
+    memcpy(sa->address + 2, iid, 8);
+    sa->address[2] ^= 0x02;
+}
+
+// Allocation of the buffer_t is included, since it is part of each call in
+// the nanostack data path.
+static buffer_t *bench_buffer_new(const struct bench_pkt *pkt, const uint8_t *data, int len)
+{
+    buffer_t *buf = buffer_get(len);
+
+    BUG_ON(!buf);
+    buffer_data_add(buf, data, len);
+    bench_sockaddr_set(&buf->src_sa, pkt->src_iid);
+    bench_sockaddr_set(&buf->dst_sa, pkt->dst_iid);
+    return buf;
+}
+
+static void bench_iphc_compress(struct bench_state *state)
+{
+    struct bench_pkt pkt;
+    buffer_t *buf;
+
+    bench_pkt_init(&pkt, state->arg);
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        buf = bench_buffer_new(&pkt, pkt.data, pkt.len);
+        buf = iphc_compress(buf, pkt.len);
+        BUG_ON(!buf);
+        g_bench_sink = buffer_data_length(buf);
+        buffer_free(buf);
+    }
+    bench_stop(state);
+}
+
+static void bench_iphc_decompress(struct bench_state *state)
+{
+    uint8_t cmpr[sizeof(((struct bench_pkt *)NULL)->data)];
+    struct bench_pkt pkt;
+    buffer_t *buf;
+    int len;
+
+    bench_pkt_init(&pkt, state->arg);
+    buf = iphc_compress(bench_buffer_new(&pkt, pkt.data, pkt.len), pkt.len);
+    len = buffer_data_length(buf);
+    memcpy(cmpr, buffer_data_pointer(buf), len);
+    buffer_free(buf);
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        buf = bench_buffer_new(&pkt, cmpr, len);
+        buf = iphc_decompress(buf);
+        BUG_ON(!buf);
+        g_bench_sink = buffer_data_length(buf);
+        buffer_free(buf);
+    }
+    bench_stop(state);
+}
+
+static void bench_lowpan_iphc_cmpr(struct bench_state *state)
+{
+    struct pktbuf pktbuf = { };
+    struct bench_pkt pkt;
+
+    bench_pkt_init(&pkt, state->arg);
+    pktbuf_init_headroom(&pktbuf, 64, pkt.data, pkt.len);
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        // Restore the uncompressed packet, the buffer is large enough
+        pktbuf.offset_head = 64;
+        pktbuf.offset_tail = 64 + pkt.len;
+        memcpy(pktbuf_head(&pktbuf), pkt.data, pkt.len);
+        lowpan_iphc_cmpr(&pktbuf, pkt.src_iid, pkt.dst_iid);
+    }
+    bench_stop(state);
+    BUG_ON(pktbuf.err);
+    g_bench_sink = pktbuf_len(&pktbuf);
+    pktbuf_free(&pktbuf);
+}
+
+static void bench_lowpan_iphc_decmpr(struct bench_state *state)
+{
+    uint8_t cmpr[sizeof(((struct bench_pkt *)NULL)->data)];
+    struct pktbuf pktbuf = { };
+    struct bench_pkt pkt;
+    int len;
+
+    bench_pkt_init(&pkt, state->arg);
+    pktbuf_init_headroom(&pktbuf, 64, pkt.data, pkt.len);
+    lowpan_iphc_cmpr(&pktbuf, pkt.src_iid, pkt.dst_iid);
+    len = pktbuf_len(&pktbuf);
+    memcpy(cmpr, pktbuf_head(&pktbuf), len);
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        pktbuf.offset_head = 64;
+        pktbuf.offset_tail = 64 + len;
+        memcpy(pktbuf_head(&pktbuf), cmpr, len);
+        lowpan_iphc_decmpr(&pktbuf, pkt.src_iid, pkt.dst_iid);
+    }
+    bench_stop(state);
+    BUG_ON(pktbuf.err || pktbuf_len(&pktbuf) != pkt.len);
+    g_bench_sink = pktbuf_len(&pktbuf);
+    pktbuf_free(&pktbuf);
+}
+
+// IEs of a PAN Configuration, which is the largest frame regularly parsed
+static void bench_ws_ie_build(struct iobuf_write *hdr, struct iobuf_write *payload)
+{
+    static const uint8_t gtkhash[4][8] = { { 1 }, { 2 }, { 3 }, { 4 } };
+    int offset;
+
+    ws_wh_utt_write(hdr, WS_FT_PC);
+    ws_wh_bt_write(hdr);
+    ws_wh_ea_write(hdr, &(struct eui64){ .u8 = { 0x02, 0x12, 0x4b, 0x00, 0x00, 0x00, 0x00, 0x01 } });
+    offset = ieee802154_ie_push_payload(payload, IEEE802154_IE_ID_WP);
+    ws_wp_nested_pan_write(payload, 100, 0, 1);
+    ws_wp_nested_netname_write(payload, "Wi-SUN Network");
+    ws_wp_nested_panver_write(payload, 42);
+    ws_wp_nested_gtkhash_write(payload, gtkhash);
+    ieee802154_ie_fill_len_payload(payload, offset);
+}
+
+static void bench_ws_ie_write(struct bench_state *state)
+{
+    struct iobuf_write hdr = { }, payload = { };
+
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        hdr.len = 0;
+        payload.len = 0;
+        bench_ws_ie_build(&hdr, &payload);
+    }
+    bench_stop(state);
+    g_bench_sink = hdr.len + payload.len;
+    iobuf_free(&hdr);
+    iobuf_free(&payload);
+}
+
+// arg is set to use the IE index, see ws_ie_index_build()
+static void bench_ws_ie_read(struct bench_state *state)
+{
+    struct iobuf_write hdr = { }, payload = { };
+    struct ws_netname_ie netname;
+    struct iobuf_read ie_wp;
+    struct ws_utt_ie utt;
+    struct ws_pan_ie pan;
+    struct ws_bt_ie bt;
+    uint8_t gtkhash[4][8];
+    uint16_t pan_version;
+    uint8_t eui64[8];
+    bool ok = true;
+
+    bench_ws_ie_build(&hdr, &payload);
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        ieee802154_ie_find_payload(payload.data, payload.len, IEEE802154_IE_ID_WP, &ie_wp);
+        if (state->arg)
+            ws_ie_index_build(hdr.data, hdr.len, ie_wp.data, ie_wp.data_size);
+        ok &= ws_wh_utt_read(hdr.data, hdr.len, &utt);
+        ok &= ws_wh_bt_read(hdr.data, hdr.len, &bt);
+        ok &= ws_wh_ea_read(hdr.data, hdr.len, eui64);
+        ok &= ws_wp_nested_pan_read(ie_wp.data, ie_wp.data_size, &pan);
+        ok &= ws_wp_nested_netname_read(ie_wp.data, ie_wp.data_size, &netname);
+        ok &= ws_wp_nested_panver_read(ie_wp.data, ie_wp.data_size, &pan_version);
+        ok &= ws_wp_nested_gtkhash_read(ie_wp.data, ie_wp.data_size, gtkhash);
+        if (state->arg)
+            ws_ie_index_clear();
+    }
+    bench_stop(state);
+    BUG_ON(!ok);
+    g_bench_sink = pan_version;
+    iobuf_free(&hdr);
+    iobuf_free(&payload);
+}
+
+static void bench_rpl_addr(uint8_t addr[16], int i)
+{
+    memset(addr, 0, 16);
+    addr[0] = 0x20;
+    addr[1] = 0x01;
+    addr[2] = 0x0d;
+    addr[3] = 0xb8;
+    write_be32(addr + 12, i);
+}
+
+/*
+ * The DODAG is a tree where every router has 4 children, with the targets
+ * numbered in breadth-first order, so that arg routers form a tree of depth
+ * log4(arg). Source routes are built towards random targets. With a negative
+ * arg, the route cache is invalidated before each call, like after a DAO
+ * changing a transit.
+ */
+static void bench_rpl_srh_build(struct bench_state *state)
+{
+    static struct rpl_root root;
+    int count = abs(state->arg);
+    struct rpl_srh_decmpr srh;
+    struct rpl_target *target;
+    const uint8_t *nxthop;
+    uint8_t (*dst)[16];
+    uint8_t addr[16];
+    int ret = 0;
+
+    memset(&root, 0, sizeof(root));
+    root.pcs = 7;
+    bench_rpl_addr(root.dodag_id, 0);
+    for (int i = 1; i <= count; i++) {
+        bench_rpl_addr(addr, i);
+        target = rpl_target_new(&root, addr);
+        bench_rpl_addr(addr, (i - 1) / 4);
+        rpl_transit_set(&root, target, 0, addr, UINT32_MAX);
+    }
+    dst = xalloc(1024 * sizeof(*dst));
+    for (int i = 0; i < 1024; i++)
+        bench_rpl_addr(dst[i], 1 + rand() % count);
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        if (state->arg < 0)
+            root.srh_cache_gen++;
+        ret |= rpl_srh_build(&root, dst[i % 1024], &srh, &nxthop);
+    }
+    bench_stop(state);
+    BUG_ON(ret < 0);
+    g_bench_sink = srh.seg_count;
+    while ((target = SLIST_FIRST(&root.targets)))
+        rpl_target_del(&root, target);
+    free(dst);
+}
+
+static void bench_ws_neigh_get(struct bench_state *state)
+{
+    static struct ws_neigh_table table;
+    static bool table_init;
+    struct ws_neigh *neigh;
+    uint8_t (*eui64)[8];
+    uint64_t val = 0;
+
+    if (!table_init) {
+        ws_neigh_table_init(&table);
+        table_init = true;
+    }
+    eui64 = xalloc(state->arg * sizeof(*eui64));
+    for (int i = 0; i < state->arg; i++) {
+        for (int j = 0; j < 8; j++)
+            eui64[i][j] = rand();
+        ws_neigh_add(&table, eui64[i], WS_NR_ROLE_ROUTER, 14, BIT(1));
+    }
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        neigh = ws_neigh_get(&table, eui64[(i * 7919) % state->arg]);
+        val += neigh->node_role;
+    }
+    bench_stop(state);
+    g_bench_sink = val;
+    for (int i = 0; i < state->arg; i++)
+        ws_neigh_del(&table, eui64[i]);
+    free(eui64);
+}
+
+// Restart random timers among arg armed ones, like ETX timers refreshed on
+// each TX confirmation.
+static void bench_timer_restart(struct bench_state *state)
+{
+    struct timer_entry *timers = zalloc(state->arg * sizeof(*timers));
+    uint32_t *picks = xalloc(1024 * sizeof(*picks));
+
+    for (int i = 0; i < state->arg; i++)
+        timer_start_rel(NULL, &timers[i], 60000 + rand() % 60000);
+    for (int i = 0; i < 1024; i++)
+        picks[i] = rand();
+    bench_start(state);
+    for (uint64_t i = 0; i < state->iterations; i++) {
+        struct timer_entry *timer = &timers[picks[i % 1024] % state->arg];
+
+        timer_stop(NULL, timer);
+        timer_start_rel(NULL, timer, 60000 + picks[(i + 1) % 1024] % 60000);
+    }
+    bench_stop(state);
+    for (int i = 0; i < state->arg; i++)
+        timer_stop(NULL, &timers[i]);
+    free(timers);
+    free(picks);
+}
+
+static const struct bench g_benches[] = {
+    { "crc16/16",                    bench_crc16,              16 },
+    { "crc16/256",                   bench_crc16,             256 },
+    { "crc16/2047",                  bench_crc16,            2047 },
+    { "iobuf_push/16",               bench_iobuf_push,         16 },
+    { "iobuf_push/1024",             bench_iobuf_push,       1024 },
+    { "iobuf_pop/16",                bench_iobuf_pop,          16 },
+    { "pktbuf_push_pop",             bench_pktbuf_push_pop,     0 },
+    { "iphc_compress/link-local",    bench_iphc_compress,       0 },
+    { "iphc_compress/global",        bench_iphc_compress,       1 },
+    { "iphc_decompress/link-local",  bench_iphc_decompress,     0 },
+    { "iphc_decompress/global",      bench_iphc_decompress,     1 },
+    { "lowpan_iphc_cmpr/link-local", bench_lowpan_iphc_cmpr,    0 },
+    { "lowpan_iphc_cmpr/global",     bench_lowpan_iphc_cmpr,    1 },
+    { "lowpan_iphc_decmpr/link-local", bench_lowpan_iphc_decmpr, 0 },
+    { "lowpan_iphc_decmpr/global",   bench_lowpan_iphc_decmpr,  1 },
+    { "ws_ie_write",                 bench_ws_ie_write,         0 },
+    { "ws_ie_read",                  bench_ws_ie_read,          0 },
+    { "ws_ie_read/indexed",          bench_ws_ie_read,          1 },
+    { "rpl_srh_build/100",           bench_rpl_srh_build,     100 },
+    { "rpl_srh_build/5000",          bench_rpl_srh_build,    5000 },
+    { "rpl_srh_build/100/uncached",  bench_rpl_srh_build,    -100 },
+    { "rpl_srh_build/5000/uncached", bench_rpl_srh_build,   -5000 },
+    { "ws_neigh_get/10",             bench_ws_neigh_get,       10 },
+    { "ws_neigh_get/100",            bench_ws_neigh_get,      100 },
+    { "ws_neigh_get/1000",           bench_ws_neigh_get,     1000 },
+    { "ws_neigh_get/10000",          bench_ws_neigh_get,    10000 },
+    { "timer_restart/100",           bench_timer_restart,     100 },
+    { "timer_restart/10000",         bench_timer_restart,   10000 },
+};
+
+static double bench_run(const struct bench *bench, struct bench_state *state)
+{
+    uint64_t min_ns = g_bench_cfg.min_time_s * 1000000000;
+    double mult;
+
+    state->iterations = 1;
+    while (true) {
+        state->elapsed_ns = 0;
+        state->arg = bench->arg;
+        srand(0);
+        bench->fn(state);
+        if (state->elapsed_ns >= min_ns)
+            break;
+        // Same heuristic as Google Benchmark: aim 40% above the minimum time,
+        // and do not grow more than 10 times between runs.
+        mult = state->elapsed_ns ? 1.4 * min_ns / state->elapsed_ns : 10;
+        state->iterations *= MIN(MAX(mult, 2), 10);
+    }
+    return (double)state->elapsed_ns / state->iterations;
+}
+
+static int bench_baseline_read(struct bench_result **results, const char *filename)
+{
+    char line[256], name[64];
+    FILE *file;
+    int count = 0;
+    double ns;
+
+    file = fopen(filename, "r");
+    FATAL_ON(!file, 1, "%s: %m", filename);
+    *results = NULL;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%63[^,],%lf", name, &ns) != 2)
+            continue; // Header
+        *results = realloc(*results, (count + 1) * sizeof(**results));
+        FATAL_ON(!*results, 2, "%s: cannot allocate memory", __func__);
+        strcpy((*results)[count].name, name);
+        (*results)[count].ns = ns;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+static void bench_print_help(FILE *stream, int exit_code)
+{
+    fprintf(stream, "\n");
+    fprintf(stream, "Run microbenchmarks of the data paths of wsbrd\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Usage:\n");
+    fprintf(stream, "  wsbrd-bench [OPTIONS]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -f, --filter=REGEX      Only run the benchmarks matching REGEX\n");
+    fprintf(stream, "  -t, --min-time=SECONDS  Minimum duration of each benchmark (default: 0.5)\n");
+    fprintf(stream, "  -r, --repetitions=COUNT Run each benchmark COUNT times and keep the fastest\n");
+    fprintf(stream, "                          run, which makes comparisons less noisy (default: 1)\n");
+    fprintf(stream, "  -c, --csv               Print the results as CSV, suitable for --baseline\n");
+    fprintf(stream, "  -b, --baseline=FILE     Compare with the results of a previous run (CSV)\n");
+    fprintf(stream, "  -T, --threshold=PERCENT Slowdown from the baseline considered as a\n");
+    fprintf(stream, "                          regression (default: 10)\n");
+    fprintf(stream, "  -l, --list              List the benchmarks and exit\n");
+    fprintf(stream, "  -h, --help              Print this help\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Exit status is 3 if a regression is detected.\n");
+    fprintf(stream, "\n");
+    exit(exit_code);
+}
+
+static void bench_parse_commandline(int argc, char *argv[])
+{
+    static const struct option opts_long[] = {
+        { "filter",      required_argument, 0, 'f' },
+        { "min-time",    required_argument, 0, 't' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "csv",         no_argument,       0, 'c' },
+        { "baseline",    required_argument, 0, 'b' },
+        { "threshold",   required_argument, 0, 'T' },
+        { "list",        no_argument,       0, 'l' },
+        { "help",        no_argument,       0, 'h' },
+        { 0,             0,                 0,  0  }
+    };
+    char *end;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "f:t:r:cb:T:lh", opts_long, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            g_bench_cfg.filter = optarg;
+            break;
+        case 't':
+            g_bench_cfg.min_time_s = strtod(optarg, &end);
+            FATAL_ON(*end || g_bench_cfg.min_time_s <= 0, 1, "invalid duration: %s", optarg);
+            break;
+        case 'r':
+            g_bench_cfg.repetitions = strtol(optarg, &end, 10);
+            FATAL_ON(*end || g_bench_cfg.repetitions <= 0, 1, "invalid count: %s", optarg);
+            break;
+        case 'c':
+            g_bench_cfg.csv = true;
+            break;
+        case 'b':
+            g_bench_cfg.baseline = optarg;
+            break;
+        case 'T':
+            g_bench_cfg.threshold = strtod(optarg, &end);
+            FATAL_ON(*end || g_bench_cfg.threshold < 0, 1, "invalid threshold: %s", optarg);
+            break;
+        case 'l':
+            for (int i = 0; i < ARRAY_SIZE(g_benches); i++)
+                printf("%s\n", g_benches[i].name);
+            exit(0);
+        case 'h':
+            bench_print_help(stdout, 0);
+            break;
+        case '?':
+        default:
+            bench_print_help(stderr, 1);
+            break;
+        }
+    }
+    if (optind != argc)
+        FATAL(1, "unexpected argument: %s", argv[optind]);
+}
+
+static const struct bench_result *bench_baseline_find(const struct bench_result *baseline, int count,
+                                                     const char *name)
+{
+    for (int i = 0; i < count; i++)
+        if (!strcmp(baseline[i].name, name))
+            return baseline + i;
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const struct bench_result *ref;
+    struct bench_result *baseline = NULL;
+    struct bench_state state = { };
+    int baseline_count = 0;
+    int regressions = 0;
+    double ns, ratio;
+    regex_t regex;
+    int ret;
+
+    bench_parse_commandline(argc, argv);
+    if (g_bench_cfg.filter) {
+        ret = regcomp(&regex, g_bench_cfg.filter, REG_EXTENDED | REG_NOSUB);
+        FATAL_ON(ret, 1, "invalid filter: %s", g_bench_cfg.filter);
+    }
+    if (g_bench_cfg.baseline)
+        baseline_count = bench_baseline_read(&baseline, g_bench_cfg.baseline);
+
+    if (g_bench_cfg.csv)
+        printf("name,ns_per_iter,iterations\n");
+    else
+        printf("%-32s %12s %12s %13s %10s\n", "Benchmark", "Time", "Iterations", "Throughput", "Baseline");
+    for (int i = 0; i < ARRAY_SIZE(g_benches); i++) {
+        if (g_bench_cfg.filter && regexec(&regex, g_benches[i].name, 0, NULL, 0))
+            continue;
+        ns = INFINITY;
+        for (int j = 0; j < g_bench_cfg.repetitions; j++) {
+            state.bytes = 0;
+            ns = MIN(ns, bench_run(&g_benches[i], &state));
+        }
+        ref = bench_baseline_find(baseline, baseline_count, g_benches[i].name);
+        ratio = ref ? 100 * (ns - ref->ns) / ref->ns : 0;
+        if (ratio > g_bench_cfg.threshold)
+            regressions++;
+        if (g_bench_cfg.csv) {
+            printf("%s,%.2lf,%"PRIu64"\n", g_benches[i].name, ns, state.iterations);
+        } else {
+            printf("%-32s %9.1lf ns %12"PRIu64, g_benches[i].name, ns, state.iterations);
+            if (state.bytes)
+                printf(" %8.1lf MB/s", state.bytes * 1000.0 / ns);
+            else
+                printf(" %13s", "");
+            if (ref)
+                printf(" %+9.1lf%%%s", ratio, ratio > g_bench_cfg.threshold ? " REGRESSION" : "");
+            printf("\n");
+        }
+        fflush(stdout);
+    }
+    if (g_bench_cfg.filter)
+        regfree(&regex);
+    free(baseline);
+    if (regressions) {
+        fprintf(stderr, "%d regression(s) over %.0lf%%\n", regressions, g_bench_cfg.threshold);
+        return 3;
+    }
+    return 0;
+}
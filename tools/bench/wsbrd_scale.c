@@ -0,0 +1,604 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/wait.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/specs/ws.h"
+#include "common/ws/ws_neigh.h"
+#include "common/endian.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/time_extra.h"
+
+#include "app/dbus.h"
+#include "app/wsbrd.h"
+#include "ipv6/ipv6_routing_table.h"
+#include "net/ns_address_internal.h"
+#include "rpl/rpl_srh.h"
+#include "rpl/rpl.h"
+
+/*
+ * Scalability check of the tables of wsbrd. A network of --nodes nodes is
+ * synthesized in the process, without RCP nor radio: every node joins the
+ * supplicant table, the neighbor table, the IPv6 neighbor cache (address
+ * registration) and the RPL targets. The RPL DODAG is a tree where every
+ * router has 4 children. This is a worst case for the border router, where
+ * all the nodes are also its direct neighbors.
+ *
+ * Then wsbrd-scale measures:
+ *   - join: the time to insert all the nodes in the tables,
+ *   - steady: the CPU time used per simulated second to process the
+ *     periodic traffic of the network (frames heard, address registrations,
+ *     DAO refreshes and downward packets), see SCALE_*_INTERVAL_S,
+ *   - mem/<table>: the heap growth caused by each table, allocator overhead
+ *     and indexes included,
+ *   - dbus/<property>: the time to build the Nodes and RoutingGraph
+ *     properties after they were invalidated. This needs a D-Bus daemon to
+ *     create messages, and is skipped otherwise.
+ *
+ * Each size runs in a child process so it starts from an empty heap. With
+ * --csv, the results can be given back with --baseline to a later build, and
+ * wsbrd-scale exits with an error if any metric grows by more than
+ * --threshold percent.
+ *
+ * Join convergence over the air (EAPOL, DHCP, DAO retries) is out of scope,
+ * wsbrd-sim covers it at lower scale.
+ */
+
+// Rough rates of a Wi-SUN FAN network at rest, per node
+#define SCALE_HEARD_INTERVAL_S    60   // Frame received from a neighbor
+#define SCALE_ARO_INTERVAL_S      3600 // NS(ARO) registration refresh
+#define SCALE_DAO_INTERVAL_S      1200 // DAO refresh, one lifetime unit
+#define SCALE_TX_INTERVAL_S       60   // Downward packet from the backhaul
+#define SCALE_ARO_LIFETIME_S      7200
+
+#define SCALE_DBUS_PATH           "/com/silabs/Wisun/BorderRouter"
+#define SCALE_DBUS_INTERFACE      "com.silabs.Wisun.BorderRouter"
+
+enum scale_metric {
+    SCALE_JOIN_US,
+    SCALE_STEADY_CPU_US,
+    SCALE_MEM_WS_NEIGH,
+    SCALE_MEM_RPL_TARGET,
+    SCALE_MEM_IPV6_NEIGH,
+    SCALE_MEM_SUPP,
+    SCALE_DBUS_NODES_US,
+    SCALE_DBUS_ROUTING_GRAPH_US,
+    SCALE_METRIC_COUNT,
+};
+
+static const struct {
+    const char *name;
+    const char *unit;
+} g_scale_metrics[SCALE_METRIC_COUNT] = {
+    [SCALE_JOIN_US]               = { "join",              "us"   },
+    [SCALE_STEADY_CPU_US]         = { "steady",            "us/s" },
+    [SCALE_MEM_WS_NEIGH]          = { "mem/ws_neigh",      "B"    },
+    [SCALE_MEM_RPL_TARGET]        = { "mem/rpl_target",    "B"    },
+    [SCALE_MEM_IPV6_NEIGH]        = { "mem/ipv6_neigh",    "B"    },
+    [SCALE_MEM_SUPP]              = { "mem/supp",          "B"    },
+    [SCALE_DBUS_NODES_US]         = { "dbus/Nodes",        "us"   },
+    [SCALE_DBUS_ROUTING_GRAPH_US] = { "dbus/RoutingGraph", "us"   },
+};
+
+// NAN for the metrics not available in this build or environment
+struct scale_result {
+    double values[SCALE_METRIC_COUNT];
+};
+
+struct scale_baseline {
+    char name[64];
+    double value;
+};
+
+static struct {
+    int node_counts[8];
+    int node_count_len;
+    int duration_s;
+    int repetitions;
+    bool csv;
+    const char *baseline;
+    double threshold;
+} g_scale_cfg = {
+    .node_counts    = { 1000, 5000, 10000 },
+    .node_count_len = 3,
+    .duration_s     = 60,
+    .repetitions    = 1,
+    .threshold      = 10,
+};
+
+// Only the tables used by the measures are initialized, callbacks included:
+// nothing is forwarded to the routing table, the storage or an RCP.
+static struct wsbr_ctxt g_scale_ctxt;
+
+static uint64_t scale_now_ns(clockid_t clock)
+{
+    struct timespec tp;
+
+    clock_gettime(clock, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static size_t scale_heap_bytes(void)
+{
+    return mallinfo2().uordblks;
+}
+
+// Node 0 is the border router
+static void scale_addr(uint8_t addr[16], int i)
+{
+    memset(addr, 0, 16);
+    addr[0] = 0x20;
+    addr[1] = 0x01;
+    addr[2] = 0x0d;
+    addr[3] = 0xb8;
+    write_be32(addr + 12, i);
+}
+
+static void scale_eui64(uint8_t eui64[8], int i)
+{
+    memcpy(eui64, (uint8_t[4]){ 0x02, 0x12, 0x4b, 0x00 }, 4);
+    write_be32(eui64 + 4, i);
+}
+
+static void scale_init(struct wsbr_ctxt *ctxt)
+{
+    struct net_if *net_if = &ctxt->net_if;
+
+    ws_neigh_table_init(&net_if->ws_info.neighbor_storage);
+    ipv6_neighbour_cache_init(&net_if->ipv6_neighbour_cache, net_if->id);
+    // Like a border router, registrations are indexed by EUI-64
+    net_if->ipv6_neighbour_cache.recv_addr_reg = true;
+    net_if->rpl_root.pcs = 7;
+    net_if->rpl_root.lifetime_unit_s = 1200;
+    net_if->rpl_root.lifetime_s = 1200 * 6;
+    scale_addr(net_if->rpl_root.dodag_id, 0);
+    scale_eui64(ctxt->rcp.eui64.u8, 0);
+    // Supplicants are allocated like with an external RADIUS server: the
+    // local TLS context of each supplicant is not included.
+    ctxt->auth.radius_fd = 0;
+}
+
+static void scale_join_supp(struct wsbr_ctxt *ctxt, int i)
+{
+#ifndef HAVE_AUTH_LEGACY
+    struct eui64 eui64;
+
+    scale_eui64(eui64.u8, i);
+    auth_fetch_supp(&ctxt->auth, &eui64);
+#endif
+}
+
+static void scale_join_neigh(struct wsbr_ctxt *ctxt, int i)
+{
+    struct ws_neigh_table *table = &ctxt->net_if.ws_info.neighbor_storage;
+    struct ws_neigh *neigh;
+    uint8_t eui64[8];
+
+    scale_eui64(eui64, i);
+    neigh = ws_neigh_add(table, eui64, WS_NR_ROLE_ROUTER, 14, BIT(1));
+    ws_neigh_trust(table, neigh);
+    ws_neigh_refresh(table, neigh, SCALE_ARO_LIFETIME_S);
+}
+
+// Same steps as a registration restored from the storage, see
+// ipv6_neigh_storage.c
+static void scale_join_ipv6(struct wsbr_ctxt *ctxt, int i)
+{
+    ipv6_neighbour_cache_t *cache = &ctxt->net_if.ipv6_neighbour_cache;
+    uint8_t ll_addr[PAN_ID_LEN + 8];
+    ipv6_neighbour_t *neigh;
+    uint8_t addr[16];
+
+    scale_addr(addr, i);
+    write_be16(ll_addr, 0xabcd);
+    scale_eui64(ll_addr + PAN_ID_LEN, i);
+    neigh = ipv6_neighbour_create(cache, addr, ll_addr + PAN_ID_LEN);
+    FATAL_ON(!neigh, 2, "ipv6_neighbour_create()");
+    neigh->lifetime_s = SCALE_ARO_LIFETIME_S;
+    neigh->expiration_s = time_cached_s() + SCALE_ARO_LIFETIME_S;
+    ipv6_neighbour_entry_update_unsolicited(cache, neigh, ADDR_802_15_4_LONG, ll_addr);
+    neigh->type = IP_NEIGHBOUR_REGISTERED;
+    ipv6_neighbour_lifetime_update(cache, neigh);
+}
+
+static void scale_join_rpl(struct wsbr_ctxt *ctxt, int i)
+{
+    struct rpl_root *root = &ctxt->net_if.rpl_root;
+    struct rpl_target *target;
+    uint8_t addr[16];
+
+    scale_addr(addr, i);
+    target = rpl_target_new(root, addr);
+    scale_addr(addr, (i - 1) / 4);
+    rpl_transit_set(root, target, 0, addr, root->lifetime_s);
+}
+
+// Return the join time in microseconds, and the heap used by each table
+static double scale_join(struct wsbr_ctxt *ctxt, int count, struct scale_result *res)
+{
+    static const struct {
+        void (*fn)(struct wsbr_ctxt *ctxt, int i);
+        enum scale_metric mem;
+    } steps[] = {
+        { scale_join_supp,  SCALE_MEM_SUPP       },
+        { scale_join_neigh, SCALE_MEM_WS_NEIGH   },
+        { scale_join_ipv6,  SCALE_MEM_IPV6_NEIGH },
+        { scale_join_rpl,   SCALE_MEM_RPL_TARGET },
+    };
+    uint64_t elapsed_ns = 0;
+    uint64_t start_ns;
+    size_t heap;
+
+    for (int i = 0; i < ARRAY_SIZE(steps); i++) {
+        heap = scale_heap_bytes();
+        start_ns = scale_now_ns(CLOCK_MONOTONIC);
+        for (int j = 1; j <= count; j++)
+            steps[i].fn(ctxt, j);
+        elapsed_ns += scale_now_ns(CLOCK_MONOTONIC) - start_ns;
+        res->values[steps[i].mem] = scale_heap_bytes() - heap;
+    }
+#ifdef HAVE_AUTH_LEGACY
+    res->values[SCALE_MEM_SUPP] = NAN;
+#endif
+    return elapsed_ns / 1000.0;
+}
+
+// Number of events in second s, for count nodes each sending one event
+// every interval_s
+static int scale_events(int count, int interval_s, int s)
+{
+    return (int64_t)(s + 1) * count / interval_s - (int64_t)s * count / interval_s;
+}
+
+// Return the CPU time in microseconds used per simulated second
+static double scale_steady(struct wsbr_ctxt *ctxt, int count, int duration_s)
+{
+    struct ws_neigh_table *table = &ctxt->net_if.ws_info.neighbor_storage;
+    ipv6_neighbour_cache_t *cache = &ctxt->net_if.ipv6_neighbour_cache;
+    struct rpl_root *root = &ctxt->net_if.rpl_root;
+    struct rpl_srh_decmpr srh;
+    struct rpl_target *target;
+    ipv6_neighbour_t *ipv6_neigh;
+    struct ws_neigh *neigh;
+    const uint8_t *nxthop;
+    uint8_t addr[16];
+    uint8_t eui64[8];
+    uint64_t start_ns;
+    int ret = 0;
+    int i;
+
+    start_ns = scale_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    for (int s = 0; s < duration_s; s++) {
+        for (int j = scale_events(count, SCALE_HEARD_INTERVAL_S, s); j; j--) {
+            scale_eui64(eui64, 1 + rand() % count);
+            neigh = ws_neigh_get(table, eui64);
+            BUG_ON(!neigh);
+            ws_neigh_heard(table, neigh);
+        }
+        for (int j = scale_events(count, SCALE_ARO_INTERVAL_S, s); j; j--) {
+            i = 1 + rand() % count;
+            scale_addr(addr, i);
+            scale_eui64(eui64, i);
+            ipv6_neigh = ipv6_neighbour_lookup(cache, addr);
+            BUG_ON(!ipv6_neigh);
+            ipv6_neigh->expiration_s = time_cached_s() + ipv6_neigh->lifetime_s;
+            ipv6_neighbour_lifetime_update(cache, ipv6_neigh);
+            ws_neigh_refresh(table, ws_neigh_get(table, eui64), ipv6_neigh->lifetime_s);
+        }
+        for (int j = scale_events(count, SCALE_DAO_INTERVAL_S, s); j; j--) {
+            i = 1 + rand() % count;
+            scale_addr(addr, i);
+            target = rpl_target_get(root, addr);
+            BUG_ON(!target);
+            scale_addr(addr, (i - 1) / 4);
+            rpl_transit_set(root, target, 0, addr, root->lifetime_s);
+        }
+        for (int j = scale_events(count, SCALE_TX_INTERVAL_S, s); j; j--) {
+            scale_addr(addr, 1 + rand() % count);
+            ret |= rpl_srh_build(root, addr, &srh, &nxthop);
+        }
+    }
+    BUG_ON(ret < 0);
+    return (scale_now_ns(CLOCK_PROCESS_CPUTIME_ID) - start_ns) / 1000.0 / duration_s;
+}
+
+#ifdef HAVE_LIBSYSTEMD
+static sd_bus_property_get_t scale_dbus_getter(const char *property)
+{
+    for (const sd_bus_vtable *entry = wsbrd_dbus_vtable; entry->type != _SD_BUS_VTABLE_END; entry++)
+        if (entry->type == _SD_BUS_VTABLE_PROPERTY && !strcmp(entry->x.property.member, property))
+            return entry->x.property.get;
+    BUG("%s: unknown property", property);
+}
+
+// Return the time in microseconds to build the property from scratch
+static double scale_dbus_get(sd_bus *bus, struct wsbr_ctxt *ctxt, const char *property,
+                             void (*invalidate)(void))
+{
+    sd_bus_property_get_t get = scale_dbus_getter(property);
+    sd_bus_error err = SD_BUS_ERROR_NULL;
+    sd_bus_message *reply;
+    uint64_t start_ns;
+    double us;
+    int ret;
+
+    // Only used as a container, this message is never sent
+    ret = sd_bus_message_new_method_call(bus, &reply, NULL, SCALE_DBUS_PATH,
+                                         "org.freedesktop.DBus.Properties", "Get");
+    FATAL_ON(ret < 0, 2, "%s: sd_bus_message_new_method_call: %s", __func__, strerror(-ret));
+    invalidate();
+    start_ns = scale_now_ns(CLOCK_MONOTONIC);
+    ret = get(bus, SCALE_DBUS_PATH, SCALE_DBUS_INTERFACE, property, reply, ctxt, &err);
+    us = (scale_now_ns(CLOCK_MONOTONIC) - start_ns) / 1000.0;
+    FATAL_ON(ret < 0, 2, "%s: %s: %s", __func__, property, strerror(-ret));
+    sd_bus_message_unref(reply);
+    sd_bus_error_free(&err);
+    return us;
+}
+
+static void scale_dbus(struct wsbr_ctxt *ctxt, struct scale_result *res)
+{
+    sd_bus *bus;
+    int ret;
+
+    ret = sd_bus_open_user(&bus);
+    if (ret < 0)
+        ret = sd_bus_open_system(&bus);
+    if (ret < 0) {
+        WARN("no D-Bus available, skipping the D-Bus metrics: %s", strerror(-ret));
+        return;
+    }
+    res->values[SCALE_DBUS_NODES_US] = scale_dbus_get(bus, ctxt, "Nodes", dbus_nodes_changed);
+    res->values[SCALE_DBUS_ROUTING_GRAPH_US] = scale_dbus_get(bus, ctxt, "RoutingGraph",
+                                                              dbus_routing_graph_changed);
+#ifdef HAVE_AUTH_LEGACY
+    // Supplicants are not synthesized, Nodes only contains the border router
+    res->values[SCALE_DBUS_NODES_US] = NAN;
+#endif
+    sd_bus_flush_close_unref(bus);
+}
+#else
+static void scale_dbus(struct wsbr_ctxt *ctxt, struct scale_result *res)
+{
+}
+#endif
+
+static void scale_measure(int count, struct scale_result *res)
+{
+    struct wsbr_ctxt *ctxt = &g_scale_ctxt;
+
+    for (int i = 0; i < SCALE_METRIC_COUNT; i++)
+        res->values[i] = NAN;
+    srand(0);
+    scale_init(ctxt);
+    res->values[SCALE_JOIN_US] = scale_join(ctxt, count, res);
+    res->values[SCALE_STEADY_CPU_US] = scale_steady(ctxt, count, g_scale_cfg.duration_s);
+    scale_dbus(ctxt, res);
+}
+
+// The tables are never freed, so each measure runs in a child process
+static void scale_run(int count, struct scale_result *res)
+{
+    int fds[2], status;
+    ssize_t ret;
+    pid_t pid;
+
+    FATAL_ON(pipe(fds) < 0, 2, "%s: pipe: %m", __func__);
+    fflush(stdout);
+    pid = fork();
+    FATAL_ON(pid < 0, 2, "%s: fork: %m", __func__);
+    if (!pid) {
+        close(fds[0]);
+        scale_measure(count, res);
+        ret = write(fds[1], res, sizeof(*res));
+        _exit(ret == sizeof(*res) ? 0 : 2);
+    }
+    close(fds[1]);
+    ret = read(fds[0], res, sizeof(*res));
+    close(fds[0]);
+    FATAL_ON(waitpid(pid, &status, 0) < 0, 2, "%s: waitpid: %m", __func__);
+    FATAL_ON(!WIFEXITED(status) || WEXITSTATUS(status), 2, "%d nodes: measure failed", count);
+    FATAL_ON(ret != sizeof(*res), 2, "%d nodes: incomplete result", count);
+}
+
+static int scale_baseline_read(struct scale_baseline **results, const char *filename)
+{
+    char line[256], name[64];
+    FILE *file;
+    int count = 0;
+    double value;
+
+    file = fopen(filename, "r");
+    FATAL_ON(!file, 1, "%s: %m", filename);
+    *results = NULL;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%63[^,],%lf", name, &value) != 2)
+            continue; // Header
+        *results = realloc(*results, (count + 1) * sizeof(**results));
+        FATAL_ON(!*results, 2, "%s: cannot allocate memory", __func__);
+        strcpy((*results)[count].name, name);
+        (*results)[count].value = value;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+static const struct scale_baseline *scale_baseline_find(const struct scale_baseline *baseline, int count,
+                                                        const char *name)
+{
+    for (int i = 0; i < count; i++)
+        if (!strcmp(baseline[i].name, name))
+            return baseline + i;
+    return NULL;
+}
+
+static void scale_parse_node_counts(const char *arg)
+{
+    const char *str = arg;
+    char *end;
+    long val;
+
+    g_scale_cfg.node_count_len = 0;
+    do {
+        FATAL_ON(g_scale_cfg.node_count_len == ARRAY_SIZE(g_scale_cfg.node_counts), 1,
+                 "too many node counts: %s", arg);
+        val = strtol(str, &end, 10);
+        FATAL_ON(end == str || (*end && *end != ',') || val <= 0 || val > 65535, 1,
+                 "invalid node count: %s", arg);
+        g_scale_cfg.node_counts[g_scale_cfg.node_count_len++] = val;
+        str = end + 1;
+    } while (*end);
+}
+
+static void scale_print_help(FILE *stream, int exit_code)
+{
+    fprintf(stream, "\n");
+    fprintf(stream, "Measure how the tables of wsbrd scale with the size of the network\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Usage:\n");
+    fprintf(stream, "  wsbrd-scale [OPTIONS]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -n, --nodes=LIST        Comma-separated network sizes (default: 1000,5000,10000)\n");
+    fprintf(stream, "  -d, --duration=SECONDS  Simulated duration of the steady state (default: 60)\n");
+    fprintf(stream, "  -r, --repetitions=COUNT Run each size COUNT times and keep the best value of\n");
+    fprintf(stream, "                          each metric, which makes comparisons less noisy\n");
+    fprintf(stream, "                          (default: 1)\n");
+    fprintf(stream, "  -c, --csv               Print the results as CSV, suitable for --baseline\n");
+    fprintf(stream, "  -b, --baseline=FILE     Compare with the results of a previous run (CSV)\n");
+    fprintf(stream, "  -T, --threshold=PERCENT Growth from the baseline considered as a\n");
+    fprintf(stream, "                          regression (default: 10)\n");
+    fprintf(stream, "  -h, --help              Print this help\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Exit status is 3 if a regression is detected.\n");
+    fprintf(stream, "\n");
+    exit(exit_code);
+}
+
+static void scale_parse_commandline(int argc, char *argv[])
+{
+    static const struct option opts_long[] = {
+        { "nodes",       required_argument, 0, 'n' },
+        { "duration",    required_argument, 0, 'd' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "csv",         no_argument,       0, 'c' },
+        { "baseline",    required_argument, 0, 'b' },
+        { "threshold",   required_argument, 0, 'T' },
+        { "help",        no_argument,       0, 'h' },
+        { 0,             0,                 0,  0  }
+    };
+    char *end;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:d:r:cb:T:h", opts_long, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            scale_parse_node_counts(optarg);
+            break;
+        case 'd':
+            g_scale_cfg.duration_s = strtol(optarg, &end, 10);
+            FATAL_ON(*end || g_scale_cfg.duration_s <= 0, 1, "invalid duration: %s", optarg);
+            break;
+        case 'r':
+            g_scale_cfg.repetitions = strtol(optarg, &end, 10);
+            FATAL_ON(*end || g_scale_cfg.repetitions <= 0, 1, "invalid count: %s", optarg);
+            break;
+        case 'c':
+            g_scale_cfg.csv = true;
+            break;
+        case 'b':
+            g_scale_cfg.baseline = optarg;
+            break;
+        case 'T':
+            g_scale_cfg.threshold = strtod(optarg, &end);
+            FATAL_ON(*end || g_scale_cfg.threshold < 0, 1, "invalid threshold: %s", optarg);
+            break;
+        case 'h':
+            scale_print_help(stdout, 0);
+            break;
+        case '?':
+        default:
+            scale_print_help(stderr, 1);
+            break;
+        }
+    }
+    if (optind != argc)
+        FATAL(1, "unexpected argument: %s", argv[optind]);
+}
+
+int main(int argc, char *argv[])
+{
+    struct scale_baseline *baseline = NULL;
+    const struct scale_baseline *ref;
+    struct scale_result best, res;
+    int baseline_count = 0;
+    int regressions = 0;
+    char name[64];
+    double ratio;
+
+    scale_parse_commandline(argc, argv);
+    if (g_scale_cfg.baseline)
+        baseline_count = scale_baseline_read(&baseline, g_scale_cfg.baseline);
+
+    if (g_scale_cfg.csv)
+        printf("name,value,unit\n");
+    else
+        printf("%-32s %14s %10s\n", "Metric", "Value", "Baseline");
+    for (int i = 0; i < g_scale_cfg.node_count_len; i++) {
+        for (int j = 0; j < SCALE_METRIC_COUNT; j++)
+            best.values[j] = INFINITY;
+        for (int j = 0; j < g_scale_cfg.repetitions; j++) {
+            scale_run(g_scale_cfg.node_counts[i], &res);
+            for (int k = 0; k < SCALE_METRIC_COUNT; k++)
+                best.values[k] = isnan(res.values[k]) ? NAN : MIN(best.values[k], res.values[k]);
+        }
+        for (int j = 0; j < SCALE_METRIC_COUNT; j++) {
+            if (isnan(best.values[j]))
+                continue;
+            snprintf(name, sizeof(name), "scale/%d/%s", g_scale_cfg.node_counts[i], g_scale_metrics[j].name);
+            ref = scale_baseline_find(baseline, baseline_count, name);
+            ratio = ref && ref->value ? 100 * (best.values[j] - ref->value) / ref->value : 0;
+            if (ratio > g_scale_cfg.threshold)
+                regressions++;
+            if (g_scale_cfg.csv) {
+                printf("%s,%.2lf,%s\n", name, best.values[j], g_scale_metrics[j].unit);
+            } else {
+                printf("%-32s %9.0lf %-4s", name, best.values[j], g_scale_metrics[j].unit);
+                if (ref)
+                    printf(" %+9.1lf%%%s", ratio, ratio > g_scale_cfg.threshold ? " REGRESSION" : "");
+                printf("\n");
+            }
+        }
+        fflush(stdout);
+    }
+    free(baseline);
+    if (regressions) {
+        fprintf(stderr, "%d regression(s) over %.0lf%%\n", regressions, g_scale_cfg.threshold);
+        return 3;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common/memutils.h"
+#include "common/crc.h"
+
+/*
+ * Check crc16() against the check values of the CRC-16 variants documented
+ * in common/crc.c and against a bit-wise implementation, then compare its
+ * speed with the former byte-wise implementation.
+ *
+ * Usage: demo-crc-bench [FRAME_LEN [ITERATIONS]]
+ */
+
+static uint16_t crc16_bitwise(uint16_t crc, const uint8_t *data, int len)
+{
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+    return crc;
+}
+
+static uint16_t crc16_bytewise(uint16_t crc, const uint8_t *data, int len)
+{
+    static uint16_t table[256];
+
+    if (!table[1])
+        for (int i = 0; i < 256; i++)
+            table[i] = crc16_bitwise(0, (uint8_t[1]){ i }, 1);
+    while (len--)
+        crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static double bench(uint16_t (*fn)(uint16_t, const uint8_t *, int),
+                    const uint8_t *data, int len, int iterations)
+{
+    volatile uint16_t crc = 0;
+    uint64_t start_ns;
+
+    start_ns = bench_now_ns();
+    for (int i = 0; i < iterations; i++)
+        crc ^= fn(CRC_INIT_FCS, data, len);
+    return (double)(bench_now_ns() - start_ns) / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    // https://reveng.sourceforge.io/crc-catalogue/16.htm
+    // crc16() takes the initial value of the reflected register, so the
+    // catalogue init value 0xc6c6 of CRC-A is given here as 0x6363.
+    static const struct {
+        const char *name;
+        uint16_t init;
+        uint16_t xorout;
+        uint16_t check;
+    } vectors[] = {
+        { "CRC-16/IBM-SDLC (X-25)", 0xffff, 0xffff, 0x906e },
+        { "CRC-16/MCRF4XX",         0xffff, 0x0000, 0x6f91 },
+        { "CRC-A",                  0x6363, 0x0000, 0xbf05 },
+    };
+    const uint8_t check_str[] = "123456789";
+    int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+    int len = argc > 1 ? atoi(argv[1]) : 2047;
+    uint16_t crc;
+    uint8_t *data;
+    int ret = 0;
+
+    if (len <= 0 || iterations <= 0) {
+        fprintf(stderr, "usage: %s [FRAME_LEN [ITERATIONS]]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 0; i < ARRAY_SIZE(vectors); i++) {
+        crc = crc16(vectors[i].init, check_str, 9) ^ vectors[i].xorout;
+        printf("%-24s 0x%04x %s\n", vectors[i].name, crc, crc == vectors[i].check ? "ok" : "FAIL");
+        if (crc != vectors[i].check)
+            ret = 1;
+    }
+
+    data = xalloc(len);
+    srand(0);
+    for (int i = 0; i < len; i++)
+        data[i] = rand();
+    // Cover every length modulo 8 and unaligned buffers
+    for (int i = 0; i + i % 8 <= len && !ret; i++) {
+        if (crc16(CRC_INIT_FCS, data + i % 8, len - i - i % 8) !=
+            crc16_bitwise(CRC_INIT_FCS, data + i % 8, len - i - i % 8)) {
+            printf("mismatch with bit-wise implementation (offset %d, len %d)\n", i % 8, len - i - i % 8);
+            ret = 1;
+        }
+    }
+
+    printf("%d bytes, %d iterations\n", len, iterations);
+    printf("  byte-wise: %9.1lf ns/frame\n", bench(crc16_bytewise, data, len, iterations));
+    printf("  crc16():   %9.1lf ns/frame\n", bench(crc16, data, len, iterations));
+    free(data);
+    return ret;
+}
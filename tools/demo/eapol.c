@@ -249,7 +249,7 @@ static void init(struct ctx *ctx, struct auth_cfg *auth_cfg, int argc, char *arg
             FATAL_ON(ret < 32, 2, "getrandom: %m");
             break;
         case 'r':
-            conf_set_netaddr(&info, &auth_cfg->radius_addr, NULL);
+            conf_set_netaddr(&info, &auth_cfg->radius_addr[0], NULL);
             break;
         case 's':
             strncpy(auth_cfg->radius_secret, optarg, sizeof(auth_cfg->radius_secret) - 1);
@@ -291,12 +291,12 @@ static void init(struct ctx *ctx, struct auth_cfg *auth_cfg, int argc, char *arg
             exit(EXIT_FAILURE);
         }
     }
-    if (ctx->auth.cfg->radius_addr.ss_family != AF_UNSPEC) {
+    if (ctx->auth.cfg->radius_addr[0].ss_family != AF_UNSPEC) {
         if (memzcmp(ctx->supp.tls_client.pmk.key, 32))
             FATAL(1, "incompatible --radius-server and --pmk");
-        if (ctx->auth.cfg->radius_addr.ss_family != AF_UNSPEC && !ctx->auth.cfg->radius_secret[0])
+        if (ctx->auth.cfg->radius_addr[0].ss_family != AF_UNSPEC && !ctx->auth.cfg->radius_secret[0])
             FATAL(1, "missing --radius-secret");
-        if (ctx->auth.cfg->radius_addr.ss_family == AF_UNSPEC && ctx->auth.cfg->radius_secret[0])
+        if (ctx->auth.cfg->radius_addr[0].ss_family == AF_UNSPEC && ctx->auth.cfg->radius_secret[0])
             FATAL(1, "missing --radius-server");
     } else {
         if (!auth_cfg->ca_cert.iov_base)
@@ -360,6 +360,7 @@ int main(int argc, char *argv[])
         .lfn.gtk_expire_offset_s      = 20,
         .lfn.gtk_new_activation_time  = 720,
         .lfn.gtk_new_install_required = 80,
+        .radius_sockets = 1,
     };
     struct ctx ctx = {
         .supp.key_request_txalg.rand_min = -0.1,
@@ -397,7 +398,7 @@ int main(int argc, char *argv[])
             timer_process();
         if (pfd[1].revents & POLLIN) {
             if (drop()) {
-                ret = recv(ctx.auth.radius_fd, buf, sizeof(buf), 0);
+                ret = recv(radius_ready_fd(&ctx.auth), buf, sizeof(buf), 0);
                 FATAL_ON(ret < 0, 2, "recv: %m");
                 INFO("packet loss (RADIUS server -> client)");
             } else {
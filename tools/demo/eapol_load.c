@@ -0,0 +1,498 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _DEFAULT_SOURCE
+#include <arpa/inet.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "app_wsrd/supplicant/supplicant.h"
+#include "common/authenticator/authenticator.h"
+#include "common/authenticator/authenticator_radius.h"
+#include "common/ws/eapol_relay.h"
+#include "common/commandline.h"
+#include "common/endian.h"
+#include "common/histogram.h"
+#include "common/key_value_storage.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/time_extra.h"
+#include "common/timer.h"
+
+/*
+ * Load test of the authenticator: a configurable number of virtual
+ * supplicants run in the same process and authenticate concurrently (EAP-TLS,
+ * 4WH and GKH) against the internal EAP-TLS server or a RADIUS server. Every
+ * supplicant has its own EUI-64, which carries its index so that the messages
+ * from the authenticator can be dispatched to it without a lookup.
+ *
+ * The latency of a supplicant is measured from its first Key Request to the
+ * installation of its GTK reported by the authenticator, retries included.
+ */
+
+struct load_supp {
+    struct supp_ctx supp;
+    struct load_ctx *ctx;
+    uint64_t start_us;
+    bool started;
+    bool done;
+};
+
+struct load_ctx {
+    struct load_supp *supps;
+    int supp_count;
+    int supp_started;
+    int supp_done;
+    int fail_count;
+    struct sockaddr_storage supp_addr;
+    int supp_fd;
+
+    struct auth_ctx auth;
+    int auth_fd;
+
+    double rate;   // Supplicants started per second, 0 to start all at once
+    int timeout_s;
+    uint64_t start_us;
+    struct timer_entry start_timer;
+    struct timer_entry report_timer;
+    struct histogram latency_us;
+};
+
+#define LOAD_EUI64_PREFIX 0x02
+
+// stub
+void eapol_relay_send(int fd, const void *buf, size_t buf_len,
+                      const struct in6_addr *dst,
+                      const struct eui64 *supp_eui64, uint8_t kmp_id)
+{
+    BUG();
+}
+
+static struct load_supp *load_supp_get(struct load_ctx *ctx, const uint8_t eui64[8])
+{
+    uint32_t i = read_be32(eui64 + 4);
+
+    if (eui64[0] != LOAD_EUI64_PREFIX || i >= ctx->supp_count)
+        return NULL;
+    return &ctx->supps[i];
+}
+
+static void supp_sendto_mac(struct supp_ctx *supp, uint8_t kmp_id,
+                            const void *buf, size_t buf_len, const uint8_t dst[8])
+{
+    struct load_ctx *ctx = container_of(supp, struct load_supp, supp)->ctx;
+    struct iovec iov[] = {
+        { .iov_base = supp->eui64, .iov_len = 8 },
+        { .iov_base = &kmp_id,     .iov_len = 1 },
+        { .iov_base = (void *)buf, .iov_len = buf_len },
+    };
+    struct msghdr msg = {
+        .msg_iov    = iov,
+        .msg_iovlen = 3,
+    };
+    ssize_t ret;
+
+    ret = sendmsg(ctx->supp_fd, &msg, 0);
+    FATAL_ON(ret < 8 + 1 + buf_len, 2, "sendmsg: %m");
+}
+
+static uint8_t *supp_get_target(struct supp_ctx *supp)
+{
+    struct load_ctx *ctx = container_of(supp, struct load_supp, supp)->ctx;
+
+    return ctx->auth.eui64.u8;
+}
+
+static void supp_on_gtk_change(struct supp_ctx *supp, const uint8_t gtk[16], uint8_t index)
+{
+}
+
+static void supp_on_failure(struct supp_ctx *supp)
+{
+    struct load_ctx *ctx = container_of(supp, struct load_supp, supp)->ctx;
+
+    ctx->fail_count++;
+    supp_start_key_request(supp);
+}
+
+static void auth_sendto_mac(struct auth_ctx *auth, uint8_t kmp_id,
+                            const void *buf, size_t buf_len, const struct eui64 *dst)
+{
+    struct load_ctx *ctx = container_of(auth, struct load_ctx, auth);
+    struct iovec iov[] = {
+        { .iov_base = (void *)dst, .iov_len = 8 },
+        { .iov_base = &kmp_id,     .iov_len = 1 },
+        { .iov_base = (void *)buf, .iov_len = buf_len },
+    };
+    struct msghdr msg = {
+        .msg_name    = &ctx->supp_addr,
+        .msg_namelen = sizeof(ctx->supp_addr),
+        .msg_iov     = iov,
+        .msg_iovlen  = 3,
+    };
+    ssize_t ret;
+
+    ret = sendmsg(ctx->auth_fd, &msg, 0);
+    FATAL_ON(ret < 8 + 1 + buf_len, 2, "sendmsg: %m");
+}
+
+static void auth_on_gtk_change(struct auth_ctx *auth, const uint8_t gtk[16], uint8_t index, bool activate)
+{
+}
+
+static void load_report(struct load_ctx *ctx, bool final)
+{
+    uint64_t elapsed_us = time_now_us(CLOCK_MONOTONIC) - ctx->start_us;
+    struct rusage usage;
+    uint64_t cpu_us;
+
+    getrusage(RUSAGE_SELF, &usage);
+    cpu_us = usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec +
+             usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+    printf("%s%.1lfs: %d/%d authenticated (%.1lf/s), %d in progress, %d failures",
+           final ? "total after " : "", elapsed_us / 1e6, ctx->supp_done, ctx->supp_count,
+           ctx->supp_done / (elapsed_us / 1e6), ctx->supp_started - ctx->supp_done, ctx->fail_count);
+    if (ctx->latency_us.count)
+        printf(", latency p50 %.1lfms p90 %.1lfms p99 %.1lfms max %.1lfms",
+               histogram_quantile(&ctx->latency_us, 0.5) / 1e3,
+               histogram_quantile(&ctx->latency_us, 0.9) / 1e3,
+               histogram_quantile(&ctx->latency_us, 0.99) / 1e3,
+               ctx->latency_us.max / 1e3);
+    // RUSAGE_SELF includes the worker threads, but not the RADIUS server
+    printf(", cpu %.1lf%%\n", 100.0 * cpu_us / elapsed_us);
+    fflush(stdout);
+}
+
+static void auth_on_supp_gtk_installed(struct auth_ctx *auth, const struct eui64 *eui64, uint8_t index)
+{
+    struct load_ctx *ctx = container_of(auth, struct load_ctx, auth);
+    struct load_supp *supp = load_supp_get(ctx, eui64->u8);
+
+    BUG_ON(!supp || !supp->started);
+    if (supp->done)
+        return;
+    supp->done = true;
+    ctx->supp_done++;
+    histogram_add(&ctx->latency_us, time_now_us(CLOCK_MONOTONIC) - supp->start_us);
+    if (ctx->supp_done < ctx->supp_count)
+        return;
+    load_report(ctx, true);
+    exit(EXIT_SUCCESS);
+}
+
+static void load_supp_start(struct load_ctx *ctx)
+{
+    struct load_supp *supp = &ctx->supps[ctx->supp_started++];
+
+    supp->started  = true;
+    supp->start_us = time_now_us(CLOCK_MONOTONIC);
+    supp_start_key_request(&supp->supp);
+}
+
+static void load_start_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct load_ctx *ctx = container_of(timer, struct load_ctx, start_timer);
+    uint64_t elapsed_us = time_now_us(CLOCK_MONOTONIC) - ctx->start_us;
+
+    // Catch up if the timer fires late, to keep the average rate
+    while (ctx->supp_started < ctx->supp_count &&
+           ctx->supp_started <= elapsed_us / 1e6 * ctx->rate)
+        load_supp_start(ctx);
+    if (ctx->supp_started == ctx->supp_count)
+        timer_stop(NULL, &ctx->start_timer);
+}
+
+static void load_report_timer(struct timer_group *group, struct timer_entry *timer)
+{
+    struct load_ctx *ctx = container_of(timer, struct load_ctx, report_timer);
+    uint64_t elapsed_us = time_now_us(CLOCK_MONOTONIC) - ctx->start_us;
+
+    if (ctx->timeout_s && elapsed_us >= ctx->timeout_s * 1000000ull) {
+        load_report(ctx, true);
+        INFO("timeout");
+        exit(EXIT_FAILURE);
+    }
+    load_report(ctx, false);
+}
+
+static void help(void)
+{
+    INFO("Load test of the Wi-SUN authenticator with concurrent virtual supplicants");
+    INFO("involving EAPoL, EAP-TLS, IEEE 802.11 4WH/GKH, and optionally RADIUS.");
+    INFO("Usage:");
+    INFO("    demo-eapol-load [opts]");
+    INFO("Available options:");
+    INFO("    -h --help");
+    INFO("    -n --count=INT      Number of virtual supplicants");
+    INFO("                        default=100");
+    INFO("    --rate=FLOAT        Number of supplicants started per second, 0 to start");
+    INFO("                        all of them at once");
+    INFO("                        default=0");
+    INFO("    -t --timeout=INT    Seconds before giving up, 0 to wait forever");
+    INFO("                        default=300");
+    INFO("    -r --radius-server=ADDRESS");
+    INFO("    -s --radius-secret=STRING");
+    INFO("    -p --pmk            Generate PMKs with infinite lifetime and skip EAP-TLS");
+    INFO("    -A --supp-ca=FILE   Certificate authority used to verify the TLS server certificate");
+    INFO("                        default=/usr/local/share/doc/wsbrd/examples/ca_cert.pem");
+    INFO("    -C --supp-cert=FILE Certificate shared by all the supplicants");
+    INFO("                        default=/usr/local/share/doc/wsbrd/examples/node_cert.pem");
+    INFO("    -K --supp-key=FILE  Supplicant private key");
+    INFO("                        default=/usr/local/share/doc/wsbrd/examples/node_key.pem");
+}
+
+static void init(struct load_ctx *ctx, struct auth_cfg *auth_cfg, int argc, char *argv[])
+{
+    const struct eui64 auth_eui64 = { .u8 = { [7] = 1 } };
+    struct sockaddr_in6 auth_addr = { };
+    struct storage_parse_info info;
+    struct iovec supp_cert = { };
+    struct iovec supp_key = { };
+    struct iovec ca_cert = { };
+    uint8_t eui64[8] = { LOAD_EUI64_PREFIX };
+    struct load_supp *supp;
+    bool pmk = false;
+    int ret, opt;
+    const char *opts_short = "hn:t:pr:s:A:C:K:";
+    const struct option opts_long[] = {
+        { "help",          no_argument,       0, 'h' },
+        { "count",         required_argument, 0, 'n' },
+        { "rate",          required_argument, 0, 'f' },
+        { "timeout",       required_argument, 0, 't' },
+        { "pmk",           no_argument,       0, 'p' },
+        { "radius-server", required_argument, 0, 'r' },
+        { "radius-secret", required_argument, 0, 's' },
+        { "auth-ca",       required_argument, 0, 'a' },
+        { "auth-cert",     required_argument, 0, 'c' },
+        { "auth-key",      required_argument, 0, 'k' },
+        { "supp-ca",       required_argument, 0, 'A' },
+        { "supp-cert",     required_argument, 0, 'C' },
+        { "supp-key",      required_argument, 0, 'K' },
+        { }
+    };
+
+    strcpy(info.filename, "commandline");
+    strcpy(info.value, "/usr/local/share/doc/wsbrd/examples/ca_cert.pem");
+    conf_set_pem(&info, &auth_cfg->ca_cert, NULL);
+    strcpy(info.value, "/usr/local/share/doc/wsbrd/examples/br_cert.pem");
+    conf_set_pem(&info, &auth_cfg->cert, NULL);
+    strcpy(info.value, "/usr/local/share/doc/wsbrd/examples/br_key.pem");
+    conf_set_pem(&info, &auth_cfg->key, NULL);
+    strcpy(info.value, "/usr/local/share/doc/wsbrd/examples/ca_cert.pem");
+    conf_set_pem(&info, &ca_cert, NULL);
+    strcpy(info.value, "/usr/local/share/doc/wsbrd/examples/node_cert.pem");
+    conf_set_pem(&info, &supp_cert, NULL);
+    strcpy(info.value, "/usr/local/share/doc/wsbrd/examples/node_key.pem");
+    conf_set_pem(&info, &supp_key, NULL);
+
+    while ((opt = getopt_long(argc, argv, opts_short, opts_long, NULL)) != -1) {
+        for (const struct option *opt_long = opts_long; opt_long->name; opt_long++)
+            if (opt == opt_long->val)
+                strcpy(info.key, opt_long->name);
+        if (optarg)
+            strncpy(info.value, optarg, sizeof(info.value) - 1);
+        switch (opt) {
+        case 'n':
+            conf_set_number(&info, &ctx->supp_count, (struct number_limit[]){ { 1, INT32_MAX } });
+            break;
+        case 'f':
+            ctx->rate = strtod(optarg, NULL);
+            FATAL_ON(ctx->rate < 0, 1, "invalid --rate");
+            break;
+        case 't':
+            conf_set_number(&info, &ctx->timeout_s, &valid_unsigned);
+            break;
+        case 'p':
+            pmk = true;
+            break;
+        case 'r':
+            conf_set_netaddr(&info, &auth_cfg->radius_addr[0], NULL);
+            break;
+        case 's':
+            strncpy(auth_cfg->radius_secret, optarg, sizeof(auth_cfg->radius_secret) - 1);
+            break;
+        case 'a':
+            conf_set_pem(&info, &auth_cfg->ca_cert, NULL);
+            break;
+        case 'c':
+            conf_set_pem(&info, &auth_cfg->cert, NULL);
+            break;
+        case 'k':
+            conf_set_pem(&info, &auth_cfg->key, NULL);
+            break;
+        case 'A':
+            conf_set_pem(&info, &ca_cert, NULL);
+            break;
+        case 'C':
+            conf_set_pem(&info, &supp_cert, NULL);
+            break;
+        case 'K':
+            conf_set_pem(&info, &supp_key, NULL);
+            break;
+        case 'h':
+            help();
+            exit(EXIT_SUCCESS);
+        default:
+            help();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (auth_cfg->radius_addr[0].ss_family != AF_UNSPEC) {
+        if (pmk)
+            FATAL(1, "incompatible --radius-server and --pmk");
+        if (!auth_cfg->radius_secret[0])
+            FATAL(1, "missing --radius-secret");
+    } else {
+        if (auth_cfg->radius_secret[0])
+            FATAL(1, "missing --radius-server");
+        INFO("Using internal EAP-TLS authentication server");
+    }
+
+    auth_start(&ctx->auth, &auth_eui64, true);
+
+    ctx->supps = zalloc(ctx->supp_count * sizeof(*ctx->supps));
+    for (int i = 0; i < ctx->supp_count; i++) {
+        supp = &ctx->supps[i];
+        supp->ctx = ctx;
+        supp->supp.key_request_txalg.rand_min = -0.1;
+        supp->supp.key_request_txalg.irt_s    = 1;
+        supp->supp.key_request_txalg.mrc      = 2;
+        supp->supp.sendto_mac    = supp_sendto_mac;
+        supp->supp.get_target    = supp_get_target;
+        supp->supp.on_gtk_change = supp_on_gtk_change;
+        supp->supp.on_failure    = supp_on_failure;
+        supp->supp.timeout_ms    = 1000;
+        write_be32(eui64 + 4, i);
+        supp_init(&supp->supp, &ca_cert, &supp_cert, &supp_key, eui64);
+        supp_reset(&supp->supp);
+        if (!pmk)
+            continue;
+        ret = getrandom(supp->supp.tls_client.pmk.key, 32, 0);
+        FATAL_ON(ret < 32, 2, "getrandom: %m");
+        // NOTE: Needed to compute the PMKID in the initial Key Request
+        memcpy(supp->supp.authenticator_eui64, &auth_eui64, 8);
+        memcpy(auth_fetch_supp(&ctx->auth, (struct eui64 *)eui64)->eap_tls.tls.pmk.key,
+               supp->supp.tls_client.pmk.key, 32);
+    }
+    if (pmk)
+        auth_cfg->ffn.pmk_lifetime_s = 0; // Infinite
+
+    ctx->auth_fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    FATAL_ON(ctx->auth_fd < 0, 2, "socket: %m");
+    auth_addr.sin6_family = AF_INET6;
+    auth_addr.sin6_addr = in6addr_loopback;
+    // Use EAPoL relay port for Wireshark dissection
+    auth_addr.sin6_port = htons(EAPOL_RELAY_PORT);
+    ret = bind(ctx->auth_fd, (struct sockaddr *)&auth_addr, sizeof(auth_addr));
+    FATAL_ON(ret < 0, 2, "bind: %m");
+
+    ctx->supp_fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    FATAL_ON(ctx->supp_fd < 0, 2, "socket: %m");
+    ret = connect(ctx->supp_fd, (struct sockaddr *)&auth_addr, sizeof(auth_addr));
+    FATAL_ON(ret < 0, 2, "connect: %m");
+    ret = getsockname(ctx->supp_fd, (struct sockaddr *)&ctx->supp_addr,
+                      (socklen_t[1]){ sizeof(ctx->supp_addr) });
+    FATAL_ON(ret < 0, 2, "getsockname: %m");
+    // All the supplicants may send at once, avoid losses on the loopback
+    setsockopt(ctx->auth_fd, SOL_SOCKET, SO_RCVBUF, (int[1]){ 4 * 1024 * 1024 }, sizeof(int));
+    setsockopt(ctx->supp_fd, SOL_SOCKET, SO_RCVBUF, (int[1]){ 4 * 1024 * 1024 }, sizeof(int));
+}
+
+int main(int argc, char *argv[])
+{
+    struct pollfd pfd[4] = { };
+    uint8_t buf[2048];
+    struct load_supp *supp;
+    ssize_t ret;
+    struct auth_cfg auth_cfg = {
+        .ffn.pmk_lifetime_s           = 3600,
+        .ffn.ptk_lifetime_s           = 3600,
+        .ffn.gtk_expire_offset_s      = 3600,
+        .ffn.gtk_new_activation_time  = 720,
+        .ffn.gtk_new_install_required = 80,
+        .lfn.pmk_lifetime_s           = 3600,
+        .lfn.ptk_lifetime_s           = 3600,
+        .lfn.gtk_expire_offset_s      = 3600,
+        .lfn.gtk_new_activation_time  = 720,
+        .lfn.gtk_new_install_required = 80,
+        .radius_sockets = 1,
+    };
+    struct load_ctx ctx = {
+        .supp_count = 100,
+        .timeout_s  = 300,
+
+        .auth.cfg = &auth_cfg,
+        .auth.sendto_mac            = auth_sendto_mac,
+        .auth.on_gtk_change         = auth_on_gtk_change,
+        .auth.on_supp_gtk_installed = auth_on_supp_gtk_installed,
+        .auth.radius_fd  = -1,
+        .auth.timeout_ms = 500,
+
+        .start_timer.callback   = load_start_timer,
+        .report_timer.callback  = load_report_timer,
+        .report_timer.period_ms = 1000,
+    };
+
+    // auth_cfg is mandatory considering ctx.auth.cfg is a const pointer
+    init(&ctx, &auth_cfg, argc, argv);
+
+    INFO("starting %d supplicants", ctx.supp_count);
+    ctx.start_us = time_now_us(CLOCK_MONOTONIC);
+    if (ctx.rate) {
+        ctx.start_timer.period_ms = MAX(1000 / ctx.rate, 1);
+        timer_start_rel(NULL, &ctx.start_timer, 0);
+    } else {
+        while (ctx.supp_started < ctx.supp_count)
+            load_supp_start(&ctx);
+    }
+    timer_start_rel(NULL, &ctx.report_timer, ctx.report_timer.period_ms);
+
+    pfd[0].fd = timer_fd();
+    pfd[0].events = POLLIN;
+    pfd[1].fd = ctx.auth.radius_fd;
+    pfd[1].events = POLLIN;
+    pfd[2].fd = ctx.auth_fd;
+    pfd[2].events = POLLIN;
+    pfd[3].fd = ctx.supp_fd;
+    pfd[3].events = POLLIN;
+    while (1) {
+        ret = poll(pfd, 4, -1);
+        FATAL_ON(ret < 0, 2, "poll: %m");
+        if (pfd[0].revents & POLLIN)
+            timer_process();
+        if (pfd[1].revents & POLLIN)
+            radius_recv(&ctx.auth);
+        if (pfd[2].revents & POLLIN) {
+            ret = recv(ctx.auth_fd, buf, sizeof(buf), 0);
+            FATAL_ON(ret < 8 + 1, 2, "recv: %m");
+            auth_recv_eapol(&ctx.auth, buf[8], (struct eui64 *)buf,
+                            buf + 8 + 1, ret - 8 - 1);
+        }
+        if (pfd[3].revents & POLLIN) {
+            ret = recv(ctx.supp_fd, buf, sizeof(buf), 0);
+            FATAL_ON(ret < 8 + 1, 2, "recv: %m");
+            supp = load_supp_get(&ctx, buf);
+            if (!supp || !supp->started)
+                continue;
+            supp_recv_eapol(&supp->supp, buf[8],
+                            buf + 8 + 1, ret - 8 - 1,
+                            ctx.auth.eui64.u8);
+        }
+    }
+}
@@ -0,0 +1,225 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common/ipv6/6lowpan_iphc.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/parsers.h"
+#include "common/pktbuf.h"
+
+/*
+ * Check that lowpan_iphc_decmpr() restores the packets compressed by
+ * lowpan_iphc_cmpr(), and measure both along with the compressed header size.
+ *
+ * Packets are read from FILE, one IPv6 packet per line written as
+ * colon-separated hex bytes (eg. "60:00:00:00:00:08:11:40:..."), which can be
+ * extracted from a capture. Without FILE, a synthetic mix of the traffic
+ * usually seen on a Wi-SUN network is used (DHCPv6, CoAP on compressible UDP
+ * ports, ICMPv6).
+ *
+ * The forwarding path of wsrd is also measured: the compressed packet is
+ * decompressed, its hop limit decremented in place and compressed again for
+ * the next hop, all in the same buffer.
+ *
+ * Usage: demo-iphc-bench [FILE [ITERATIONS]]
+ */
+
+struct bench_pkt {
+    uint8_t *data;
+    int len;
+    uint8_t src_iid[8];
+    uint8_t dst_iid[8];
+};
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static void bench_pkt_init(struct bench_pkt *pkt, const char *src, const char *dst,
+                           uint8_t nxt, uint8_t hlim, uint16_t sport, uint16_t dport, int payload_len)
+{
+    struct ip6_hdr *hdr;
+    struct udphdr *udp;
+
+    pkt->len = sizeof(*hdr) + payload_len;
+    pkt->data = zalloc(pkt->len);
+    hdr = (struct ip6_hdr *)pkt->data;
+    hdr->ip6_flow = htonl(6 << 28);
+    hdr->ip6_plen = htons(payload_len);
+    hdr->ip6_nxt  = nxt;
+    hdr->ip6_hlim = hlim;
+    inet_pton(AF_INET6, src, &hdr->ip6_src);
+    inet_pton(AF_INET6, dst, &hdr->ip6_dst);
+    for (int i = sizeof(*hdr); i < pkt->len; i++)
+        pkt->data[i] = rand();
+    if (nxt == IPPROTO_UDP) {
+        udp = (struct udphdr *)(hdr + 1);
+        udp->uh_sport = htons(sport);
+        udp->uh_dport = htons(dport);
+        udp->uh_ulen  = htons(payload_len);
+    }
+    // Link-layer addresses match the IIDs of link-local addresses
+    memcpy(pkt->src_iid, hdr->ip6_src.s6_addr + 8, 8);
+    memcpy(pkt->dst_iid, hdr->ip6_dst.s6_addr + 8, 8);
+}
+
+static int bench_pkts_synthetic(struct bench_pkt **pkts)
+{
+    *pkts = zalloc(5 * sizeof(**pkts));
+    srand(0);
+    // DHCPv6 relay
+    bench_pkt_init(&(*pkts)[0], "fe80::212:4b00:1:2", "fe80::212:4b00:1:3",
+                   IPPROTO_UDP, 255, 547, 547, 120);
+    // CoAP to a meter, using the compressible port range
+    bench_pkt_init(&(*pkts)[1], "2001:db8::1", "2001:db8::212:4b00:1:3",
+                   IPPROTO_UDP, 64, 0xf0b1, 0xf0b2, 80);
+    // Meter reading on the CoAP port
+    bench_pkt_init(&(*pkts)[2], "2001:db8::212:4b00:1:3", "2001:db8::1",
+                   IPPROTO_UDP, 63, 49152, 5683, 200);
+    // RPL DIO
+    bench_pkt_init(&(*pkts)[3], "fe80::212:4b00:1:2", "ff02::1a",
+                   IPPROTO_ICMPV6, 255, 0, 0, 60);
+    // Neighbor Solicitation with ARO
+    bench_pkt_init(&(*pkts)[4], "2001:db8::212:4b00:1:3", "fe80::212:4b00:1:2",
+                   IPPROTO_ICMPV6, 255, 0, 0, 40);
+    return 5;
+}
+
+static int bench_pkts_read(struct bench_pkt **pkts, const char *filename)
+{
+    char line[3 * 2048];
+    FILE *file;
+    int count = 0;
+    int len;
+
+    file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        exit(1);
+    }
+    *pkts = NULL;
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        len = (strlen(line) + 1) / 3;
+        if (len < sizeof(struct ip6_hdr))
+            continue;
+        *pkts = realloc(*pkts, (count + 1) * sizeof(**pkts));
+        FATAL_ON(!*pkts, 2);
+        (*pkts)[count].len = len;
+        (*pkts)[count].data = xalloc(len);
+        if (parse_byte_array((*pkts)[count].data, len, line)) {
+            fprintf(stderr, "%s: invalid line: %s\n", filename, line);
+            exit(1);
+        }
+        memcpy((*pkts)[count].src_iid, (*pkts)[count].data + offsetof(struct ip6_hdr, ip6_src) + 8, 8);
+        memcpy((*pkts)[count].dst_iid, (*pkts)[count].data + offsetof(struct ip6_hdr, ip6_dst) + 8, 8);
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 2 ? atoi(argv[2]) : 100000;
+    uint64_t cmpr_ns = 0, decmpr_ns = 0, fwd_ns = 0, start_ns;
+    int realloc_count = 0;
+    struct pktbuf pktbuf = { };
+    long saved = 0, total = 0;
+    struct bench_pkt *pkts;
+    int count, ret = 0;
+
+    count = argc > 1 ? bench_pkts_read(&pkts, argv[1]) : bench_pkts_synthetic(&pkts);
+    if (!count || iterations <= 0) {
+        fprintf(stderr, "usage: %s [FILE [ITERATIONS]]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        struct bench_pkt *pkt = &pkts[i % count];
+
+        pktbuf_init_headroom(&pktbuf, 64, pkt->data, pkt->len);
+        start_ns = bench_now_ns();
+        lowpan_iphc_cmpr(&pktbuf, pkt->src_iid, pkt->dst_iid);
+        cmpr_ns += bench_now_ns() - start_ns;
+        if (pktbuf.err) {
+            printf("packet %d: compression error\n", i % count);
+            ret = 1;
+            break;
+        }
+        if (i < count) {
+            saved += pkt->len - pktbuf_len(&pktbuf);
+            total += pkt->len;
+        }
+        start_ns = bench_now_ns();
+        lowpan_iphc_decmpr(&pktbuf, pkt->src_iid, pkt->dst_iid);
+        decmpr_ns += bench_now_ns() - start_ns;
+        if (pktbuf.err || pktbuf_len(&pktbuf) != pkt->len ||
+            memcmp(pktbuf_head(&pktbuf), pkt->data, pkt->len)) {
+            printf("packet %d: decompressed packet differs\n", i % count);
+            ret = 1;
+            break;
+        }
+    }
+
+    for (int i = 0; !ret && i < iterations; i++) {
+        struct bench_pkt *pkt = &pkts[i % count];
+        struct ip6_hdr *hdr;
+        uint8_t *buf;
+
+        pktbuf_init_headroom(&pktbuf, 64, pkt->data, pkt->len);
+        lowpan_iphc_cmpr(&pktbuf, pkt->src_iid, pkt->dst_iid);
+        buf = pktbuf.buf;
+        start_ns = bench_now_ns();
+        lowpan_iphc_decmpr(&pktbuf, pkt->src_iid, pkt->dst_iid);
+        hdr = (struct ip6_hdr *)pktbuf_head(&pktbuf);
+        hdr->ip6_hlim--;
+        // Next hop, the packet is sent from the link-layer destination
+        lowpan_iphc_cmpr(&pktbuf, pkt->dst_iid, pkt->src_iid);
+        fwd_ns += bench_now_ns() - start_ns;
+        if (pktbuf.err) {
+            printf("packet %d: forwarding error\n", i % count);
+            ret = 1;
+        }
+        if (pktbuf.buf != buf)
+            realloc_count++;
+    }
+    pktbuf_free(&pktbuf);
+
+    printf("%d packets, %d iterations\n", count, iterations);
+    printf("  header bytes saved: %9.1lf bytes/packet (%.1lf%%)\n",
+           (double)saved / MIN(count, iterations), 100.0 * saved / total);
+    printf("  lowpan_iphc_cmpr(): %9.1lf ns/packet\n", (double)cmpr_ns / iterations);
+    printf("  lowpan_iphc_decmpr(): %7.1lf ns/packet\n", (double)decmpr_ns / iterations);
+    printf("  forwarding:         %9.1lf ns/packet (%d reallocations)\n",
+           (double)fwd_ns / iterations, realloc_count);
+    for (int i = 0; i < count; i++)
+        free(pkts[i].data);
+    free(pkts);
+    return ret;
+}
@@ -0,0 +1,121 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common/crypto/nist_kw.h"
+#include "common/memutils.h"
+
+/*
+ * Check nist_kw_wrap() and nist_kw_unwrap() against the test vector of
+ * RFC 3394 4.1, then compare the speed of the available backends when
+ * wrapping a GTK KDE, which is the typical payload of an EAPOL-Key frame.
+ *
+ * Usage: demo-kw-bench [ITERATIONS]
+ */
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static int bench_check(void)
+{
+    static const uint8_t kek[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    static const uint8_t key[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    };
+    static const uint8_t wrapped[24] = {
+        0x1f, 0xa6, 0x8b, 0x0a, 0x81, 0x12, 0xb4, 0x47, 0xae, 0xf3, 0x4b, 0xd8,
+        0xfb, 0x5a, 0x7b, 0x82, 0x9d, 0x3e, 0x86, 0x23, 0x71, 0xd2, 0xcf, 0xe5,
+    };
+    uint8_t unwrapped[16];
+    uint8_t buf[24];
+    int ret;
+
+    ret = nist_kw_wrap(kek, 128, key, sizeof(key), buf, sizeof(buf));
+    if (ret != sizeof(wrapped) || memcmp(buf, wrapped, sizeof(wrapped)))
+        return -1;
+    ret = nist_kw_unwrap(kek, 128, wrapped, sizeof(wrapped), buf, sizeof(buf));
+    if (ret != sizeof(key) || memcmp(buf, key, sizeof(key)))
+        return -1;
+    memcpy(buf, wrapped, sizeof(wrapped));
+    buf[3] ^= 1;
+    ret = nist_kw_unwrap(kek, 128, buf, sizeof(wrapped), unwrapped, sizeof(unwrapped));
+    if (ret >= 0)
+        return -1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *name;
+        enum nist_kw_backend backend;
+    } backends[] = {
+        { "mbedtls", NIST_KW_BACKEND_MBEDTLS },
+        { "af_alg",  NIST_KW_BACKEND_AF_ALG },
+    };
+    int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+    // GTK KDE (6 + 2 + 16 bytes) padded to a multiple of 8 bytes, and a flag
+    uint8_t kek[16], data[40], wrapped[48], unwrapped[40];
+    uint64_t wrap_ns, unwrap_ns, start_ns;
+    int ret = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [ITERATIONS]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 0; i < sizeof(kek); i++)
+        kek[i] = rand();
+    for (int i = 0; i < sizeof(data); i++)
+        data[i] = rand();
+
+    for (int i = 0; i < ARRAY_SIZE(backends); i++) {
+        if (nist_kw_backend_set(backends[i].backend) < 0) {
+            printf("%-8s: not available\n", backends[i].name);
+            continue;
+        }
+        if (bench_check()) {
+            printf("%-8s: RFC 3394 test vector failed\n", backends[i].name);
+            ret = 1;
+            continue;
+        }
+        wrap_ns = unwrap_ns = 0;
+        for (int j = 0; j < iterations; j++) {
+            start_ns = bench_now_ns();
+            nist_kw_wrap(kek, 128, data, sizeof(data), wrapped, sizeof(wrapped));
+            wrap_ns += bench_now_ns() - start_ns;
+            start_ns = bench_now_ns();
+            nist_kw_unwrap(kek, 128, wrapped, sizeof(wrapped), unwrapped, sizeof(unwrapped));
+            unwrap_ns += bench_now_ns() - start_ns;
+        }
+        if (memcmp(data, unwrapped, sizeof(data))) {
+            printf("%-8s: unwrapped data differs\n", backends[i].name);
+            ret = 1;
+            continue;
+        }
+        printf("%-8s: wrap %9.1lf ns, unwrap %9.1lf ns (%zu bytes)\n", backends[i].name,
+               (double)wrap_ns / iterations, (double)unwrap_ns / iterations, sizeof(data));
+    }
+    return ret;
+}
@@ -0,0 +1,514 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/key_value_storage.h"
+#include "common/log.h"
+#include "common/memutils.h"
+#include "common/time_extra.h"
+
+/*
+ * Replay the storage writes of a border router serving a network of a given
+ * size against common/key_value_storage.c, and estimate the resulting flash
+ * wear. The file names and contents mimic those of wsbrd:
+ *   rpl-<ipv6>        RPL target, rewritten on every DAO refresh
+ *   neighbor-<eui64>  IPv6 neighbor, rewritten on every registration
+ *   keys-<eui64>      Supplicant keys, rewritten on every PTK/GTK update
+ *   br-info           PAN information, rewritten every 100 PAN version changes
+ *   network-keys      GTKs and frame counters, synced on every write
+ *
+ * The simulated time advances by steps of one second as fast as possible, and
+ * the writes of each stream are spread uniformly over its period. The commit
+ * window and the snapshots of the storage are driven by the simulated time,
+ * instead of the timers of key_value_storage.c.
+ *
+ * The bytes written are those of the write() syscalls of the process (wchar
+ * in /proc/self/io), and the fsync() calls are counted by wrapping fsync().
+ * When a snapshot prefix is set, the live storage is assumed to be in RAM, and
+ * only the snapshots are accounted for the flash. The wear estimate assumes
+ * that every fsync() programs a partial page on top of the data, and ignores
+ * the filesystem metadata and the write amplification of the flash itself.
+ */
+
+struct bench_stream {
+    const char *name;
+    int period_s;
+    bool per_node;
+    void (*write)(int i);
+};
+
+struct bench_counters {
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t fsyncs;
+};
+
+struct bench_cfg {
+    int nodes;
+    uint64_t duration_s;
+    uint64_t commit_window_ms;
+    const char *snapshot_prefix;
+    uint64_t snapshot_interval_s;
+    bool tables;
+    bool rpl_fsync;
+    uint64_t flash_size_mib;
+    uint64_t flash_cycles;
+    uint64_t page_size;
+};
+
+static struct bench_cfg g_cfg;
+static uint64_t g_fsync_count;
+
+int __real_fsync(int fd);
+int __wrap_fsync(int fd)
+{
+    g_fsync_count++;
+    return __real_fsync(fd);
+}
+
+static uint64_t bench_wchar(void)
+{
+    unsigned long long val;
+    char line[64];
+    uint64_t ret = 0;
+    FILE *file;
+
+    file = fopen("/proc/self/io", "r");
+    FATAL_ON(!file, 2, "open /proc/self/io: %m");
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "wchar: %llu", &val) == 1)
+            ret = val;
+    fclose(file);
+    return ret;
+}
+
+static void bench_counters_get(struct bench_counters *cnt, uint64_t ops)
+{
+    cnt->ops    = ops;
+    cnt->bytes  = bench_wchar();
+    cnt->fsyncs = g_fsync_count;
+}
+
+static void bench_counters_add_delta(struct bench_counters *dst,
+                                     const struct bench_counters *before,
+                                     const struct bench_counters *after)
+{
+    dst->ops    += after->ops    - before->ops;
+    dst->bytes  += after->bytes  - before->bytes;
+    dst->fsyncs += after->fsyncs - before->fsyncs;
+}
+
+static void bench_eui64(int i, uint8_t eui64[8])
+{
+    memset(eui64, 0, 8);
+    eui64[0] = 0x02;
+    eui64[4] = i >> 24;
+    eui64[5] = i >> 16;
+    eui64[6] = i >> 8;
+    eui64[7] = i;
+}
+
+static void bench_ipv6(int i, uint8_t ipv6[16])
+{
+    memset(ipv6, 0, 16);
+    ipv6[0] = 0x20;
+    ipv6[1] = 0x01;
+    ipv6[2] = 0x0d;
+    ipv6[3] = 0xb8;
+    bench_eui64(i, ipv6 + 8);
+}
+
+static struct storage_parse_info *bench_open(const char *filename)
+{
+    struct storage_parse_info *info;
+
+    info = storage_open_prefix(filename, "w");
+    FATAL_ON(!info, 2, "%s: %s: %m", __func__, filename);
+    return info;
+}
+
+static void bench_write_rpl(int i)
+{
+    char time_str[STR_MAX_LEN_DATE];
+    char ipv6_str[STR_MAX_LEN_IPV6];
+    struct storage_parse_info *info;
+    char filename[PATH_MAX];
+    uint8_t ipv6[16];
+    time_t now = time(NULL);
+
+    bench_ipv6(i, ipv6);
+    strcpy(filename, "rpl-");
+    str_ipv6(ipv6, filename + strlen(filename));
+    info = bench_open(filename);
+    fprintf(info->file, "path_seq = %u\n", rand() % 256);
+    str_date(now, time_str);
+    fprintf(info->file, "# %s\n", time_str);
+    fprintf(info->file, "path_seq_timestamp = %lu\n", now);
+    fprintf(info->file, "external = 0\n");
+    // Parents are other nodes of the network
+    for (int j = 0; j < 2; j++) {
+        bench_ipv6((i + j + 1) % g_cfg.nodes, ipv6);
+        fprintf(info->file, "transit[%d].parent = %s\n", j, str_ipv6(ipv6, ipv6_str));
+        fprintf(info->file, "transit[%d].path_lifetime = 7200\n", j);
+    }
+    if (g_cfg.rpl_fsync && storage_sync(info))
+        WARN("%s: fsync: %m", __func__);
+    storage_close(info);
+}
+
+static void bench_write_neighbor(int i)
+{
+    char time_str[STR_MAX_LEN_DATE];
+    char ipv6_str[STR_MAX_LEN_IPV6];
+    char eui64_str[STR_MAX_LEN_EUI64];
+    struct storage_parse_info *info;
+    char filename[PATH_MAX];
+    time_t ts = time(NULL) + 7200;
+    uint8_t eui64[8];
+    uint8_t ipv6[16];
+
+    bench_eui64(i, eui64);
+    bench_ipv6(i, ipv6);
+    sprintf(filename, "neighbor-%s", str_eui64(eui64, eui64_str));
+    info = bench_open(filename);
+    str_date(ts, time_str);
+    fprintf(info->file, "ipv6[0] = %s\n", str_ipv6(ipv6, ipv6_str));
+    fprintf(info->file, "lifetime[0] = 7200\n");
+    fprintf(info->file, "# %s\n", time_str);
+    fprintf(info->file, "expiration[0] = %lu\n", ts);
+    storage_close(info);
+}
+
+static void bench_write_key(struct storage_parse_info *info, const char *name, int len)
+{
+    char str_buf[256];
+    uint8_t key[48];
+
+    BUG_ON(len > sizeof(key));
+    for (int i = 0; i < len; i++)
+        key[i] = rand();
+    str_key(key, len, str_buf, sizeof(str_buf));
+    fprintf(info->file, "%s = %s\n", name, str_buf);
+}
+
+static void bench_write_keys(int i)
+{
+    char eui64_str[STR_MAX_LEN_EUI64];
+    struct storage_parse_info *info;
+    char filename[PATH_MAX];
+    uint64_t now = time(NULL);
+    uint8_t eui64[8];
+    char name[32];
+
+    bench_eui64(i, eui64);
+    sprintf(filename, "keys-%s", str_eui64(eui64, eui64_str));
+    info = bench_open(filename);
+    fprintf(info->file, "eui64 = %s\n", eui64_str);
+    bench_write_key(info, "pmk", 32);
+    fprintf(info->file, "pmk.lifetime = %" PRIu64 "\n", now + 172800);
+    fprintf(info->file, "pmk.replay_counter = %u\n", rand() % 16);
+    bench_write_key(info, "ptk", 48);
+    fprintf(info->file, "ptk.lifetime = %" PRIu64 "\n", now + 86400);
+    for (int j = 0; j < 4; j++) {
+        sprintf(name, "gtk[%d].installed_hash", j);
+        bench_write_key(info, name, 8);
+    }
+    fprintf(info->file, "node_role = ffn-fan11\n");
+    storage_close(info);
+}
+
+static void bench_write_br_info(int i)
+{
+    struct storage_parse_info *info = bench_open("br-info");
+    static int pan_version_max;
+
+    fprintf(info->file, "api_version = %#08x\n", 0x02000000);
+    fprintf(info->file, "bsi = %d\n", 12345);
+    fprintf(info->file, "pan_id = %#04x\n", 0xabcd);
+    fprintf(info->file, "pan_version_max = %d\n", pan_version_max += 100);
+    fprintf(info->file, "lfn_version_max = %d\n", 100);
+    fprintf(info->file, "network_name = Wi-SUN\\x20Network\n");
+    storage_close(info);
+}
+
+static void bench_write_network_keys(int i)
+{
+    struct storage_parse_info *info = bench_open("network-keys");
+    static uint32_t frame_counter;
+    char name[32];
+
+    frame_counter += 1000;
+    for (int j = 0; j < 4; j++) {
+        sprintf(name, "gtk[%d]", j);
+        bench_write_key(info, name, 16);
+        fprintf(info->file, "gtk[%d].frame_counter = %u\n", j, frame_counter);
+    }
+    for (int j = 0; j < 3; j++) {
+        sprintf(name, "lgtk[%d]", j);
+        bench_write_key(info, name, 16);
+        fprintf(info->file, "lgtk[%d].frame_counter = %u\n", j, frame_counter);
+    }
+    if (storage_sync(info))
+        WARN("%s: fsync: %m", __func__);
+    storage_close(info);
+}
+
+static struct bench_stream g_streams[] = {
+    { "rpl",          3600,  true,  bench_write_rpl          },
+    { "neighbor",     3600,  true,  bench_write_neighbor     },
+    { "keys",         86400, true,  bench_write_keys         },
+    { "br-info",      86400, false, bench_write_br_info      },
+    { "network-keys", 300,   false, bench_write_network_keys },
+};
+
+static void bench_print_help(FILE *stream, int exit_code)
+{
+    fprintf(stream, "\n");
+    fprintf(stream, "Replay the storage writes of a Wi-SUN border router and report the write\n");
+    fprintf(stream, "rate, the fsync() count and the estimated flash wear\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Usage:\n");
+    fprintf(stream, "  demo-storage-bench [OPTIONS]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -o, --storage-prefix=PREFIX Storage to use, must end with '/' for a\n");
+    fprintf(stream, "                          directory (default: a new directory in /tmp)\n");
+    fprintf(stream, "  -n, --nodes=COUNT       Network size (default: 1000)\n");
+    fprintf(stream, "  -d, --duration=SECONDS  Simulated duration (default: 86400)\n");
+    fprintf(stream, "  -T, --tables            Store per-node files in tables, like storage_tables\n");
+    fprintf(stream, "  -w, --commit-window=MS  Batch the fsync() calls, like storage_commit_window\n");
+    fprintf(stream, "                          (default: 0)\n");
+    fprintf(stream, "  -S, --snapshot-prefix=PREFIX Snapshot the storage to PREFIX, like\n");
+    fprintf(stream, "                          storage_snapshot_prefix\n");
+    fprintf(stream, "  -I, --snapshot-interval=SECONDS (default: 3600)\n");
+    fprintf(stream, "  -f, --rpl-fsync         Sync the RPL targets, like rpl_storage_fsync\n");
+    fprintf(stream, "  -P, --period=STREAM:SECONDS Period of the writes of a stream, per node for\n");
+    fprintf(stream, "                          rpl, neighbor and keys (default: rpl:3600,\n");
+    fprintf(stream, "                          neighbor:3600, keys:86400, br-info:86400,\n");
+    fprintf(stream, "                          network-keys:300)\n");
+    fprintf(stream, "  --flash-size=MIB        Size of the flash (default: 4096)\n");
+    fprintf(stream, "  --flash-cycles=COUNT    Program/erase cycles of the flash (default: 3000)\n");
+    fprintf(stream, "  --page-size=BYTES       Page size of the flash (default: 4096)\n");
+    fprintf(stream, "  -h, --help              Print this help\n");
+    fprintf(stream, "\n");
+    exit(exit_code);
+}
+
+static uint64_t bench_parse_uint(const char *str, uint64_t min)
+{
+    unsigned long long val;
+    char *end;
+
+    val = strtoull(str, &end, 0);
+    FATAL_ON(*end || !*str || val < min, 1, "invalid value: %s", str);
+    return val;
+}
+
+static void bench_parse_period(const char *str)
+{
+    const char *sep = strchr(str, ':');
+
+    FATAL_ON(!sep, 1, "invalid period: %s", str);
+    for (int i = 0; i < ARRAY_SIZE(g_streams); i++) {
+        if (strlen(g_streams[i].name) != sep - str || strncmp(g_streams[i].name, str, sep - str))
+            continue;
+        g_streams[i].period_s = bench_parse_uint(sep + 1, 0);
+        return;
+    }
+    FATAL(1, "unknown stream: %.*s", (int)(sep - str), str);
+}
+
+static void bench_parse_commandline(int argc, char *argv[])
+{
+    static const struct option opts_long[] = {
+        { "storage-prefix",    required_argument, 0, 'o' },
+        { "nodes",             required_argument, 0, 'n' },
+        { "duration",          required_argument, 0, 'd' },
+        { "tables",            no_argument,       0, 'T' },
+        { "commit-window",     required_argument, 0, 'w' },
+        { "snapshot-prefix",   required_argument, 0, 'S' },
+        { "snapshot-interval", required_argument, 0, 'I' },
+        { "rpl-fsync",         no_argument,       0, 'f' },
+        { "period",            required_argument, 0, 'P' },
+        { "flash-size",        required_argument, 0, 'z' },
+        { "flash-cycles",      required_argument, 0, 'c' },
+        { "page-size",         required_argument, 0, 'p' },
+        { "help",              no_argument,       0, 'h' },
+        { 0,                   0,                 0,  0  }
+    };
+    int opt;
+
+    g_cfg.nodes               = 1000;
+    g_cfg.duration_s          = 86400;
+    g_cfg.snapshot_interval_s = 3600;
+    g_cfg.flash_size_mib      = 4096;
+    g_cfg.flash_cycles        = 3000;
+    g_cfg.page_size           = 4096;
+    while ((opt = getopt_long(argc, argv, "o:n:d:Tw:S:I:fP:h", opts_long, NULL)) != -1) {
+        switch (opt) {
+        case 'o':
+            g_storage_prefix = optarg;
+            break;
+        case 'n':
+            g_cfg.nodes = bench_parse_uint(optarg, 1);
+            break;
+        case 'd':
+            g_cfg.duration_s = bench_parse_uint(optarg, 1);
+            break;
+        case 'T':
+            g_cfg.tables = true;
+            break;
+        case 'w':
+            g_cfg.commit_window_ms = bench_parse_uint(optarg, 0);
+            break;
+        case 'S':
+            g_cfg.snapshot_prefix = optarg;
+            break;
+        case 'I':
+            g_cfg.snapshot_interval_s = bench_parse_uint(optarg, 1);
+            break;
+        case 'f':
+            g_cfg.rpl_fsync = true;
+            break;
+        case 'P':
+            bench_parse_period(optarg);
+            break;
+        case 'z':
+            g_cfg.flash_size_mib = bench_parse_uint(optarg, 1);
+            break;
+        case 'c':
+            g_cfg.flash_cycles = bench_parse_uint(optarg, 1);
+            break;
+        case 'p':
+            g_cfg.page_size = bench_parse_uint(optarg, 0);
+            break;
+        case 'h':
+            bench_print_help(stdout, 0);
+            break;
+        case '?':
+        default:
+            bench_print_help(stderr, 1);
+            break;
+        }
+    }
+    if (optind != argc)
+        bench_print_help(stderr, 1);
+}
+
+static void bench_storage_init(void)
+{
+    static char tmp_prefix[] = "/tmp/demo-storage-bench-XXXXXX";
+    char *prefix;
+
+    if (!g_storage_prefix) {
+        FATAL_ON(!mkdtemp(tmp_prefix), 2, "mkdtemp: %m");
+        FATAL_ON(asprintf(&prefix, "%s/", tmp_prefix) < 0, 2, "%s: cannot allocate memory", __func__);
+        g_storage_prefix = prefix;
+    }
+    FATAL_ON(storage_check_access(g_storage_prefix), 1, "%s: %m", g_storage_prefix);
+    storage_commit_window(g_cfg.commit_window_ms);
+    if (g_cfg.tables) {
+        storage_table_add("neighbor-");
+        storage_table_add("keys-");
+        storage_table_add("tls-");
+        storage_table_add("rpl-");
+    }
+    // The snapshots are taken by bench_run(), not by a timer
+    if (g_cfg.snapshot_prefix)
+        storage_snapshot_init(g_cfg.snapshot_prefix, 0);
+}
+
+static void bench_run(struct bench_counters *total, struct bench_counters *flash,
+                      uint64_t stream_ops[])
+{
+    struct bench_counters before, after;
+    uint64_t ops = 0, first, last;
+    int count;
+
+    bench_counters_get(&before, ops);
+    for (uint64_t t = 0; t < g_cfg.duration_s; t++) {
+        for (int i = 0; i < ARRAY_SIZE(g_streams); i++) {
+            if (!g_streams[i].period_s)
+                continue;
+            // Writes [first, last) of the stream happen during this second
+            count = g_streams[i].per_node ? g_cfg.nodes : 1;
+            first = t * count / g_streams[i].period_s;
+            last  = (t + 1) * count / g_streams[i].period_s;
+            for (uint64_t j = first; j < last; j++)
+                g_streams[i].write(j % count);
+            stream_ops[i] += last - first;
+            ops += last - first;
+        }
+        if (g_cfg.commit_window_ms &&
+            (t + 1) * 1000 / g_cfg.commit_window_ms != t * 1000 / g_cfg.commit_window_ms)
+            storage_commit_flush();
+        if (g_cfg.snapshot_prefix && !((t + 1) % g_cfg.snapshot_interval_s)) {
+            bench_counters_get(&after, ops);
+            bench_counters_add_delta(total, &before, &after);
+            before = after;
+            storage_snapshot();
+            bench_counters_get(&after, ops);
+            bench_counters_add_delta(total, &before, &after);
+            bench_counters_add_delta(flash, &before, &after);
+            before = after;
+        }
+    }
+    storage_commit_flush();
+    bench_counters_get(&after, ops);
+    bench_counters_add_delta(total, &before, &after);
+    if (!g_cfg.snapshot_prefix)
+        *flash = *total;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_counters total = { }, flash = { };
+    uint64_t stream_ops[ARRAY_SIZE(g_streams)] = { };
+    uint64_t start_us, elapsed_us;
+    double scale, programmed;
+
+    bench_parse_commandline(argc, argv);
+    bench_storage_init();
+    srand(0);
+
+    start_us = time_now_us(CLOCK_MONOTONIC);
+    bench_run(&total, &flash, stream_ops);
+    elapsed_us = time_now_us(CLOCK_MONOTONIC) - start_us;
+
+    scale = 86400.0 / g_cfg.duration_s;
+    printf("%d nodes, %"PRIu64"s simulated in %.2lfs, storage %s\n",
+           g_cfg.nodes, g_cfg.duration_s, elapsed_us / 1e6, g_storage_prefix);
+    for (int i = 0; i < ARRAY_SIZE(g_streams); i++)
+        printf("  %-12s %10.0lf writes/day\n", g_streams[i].name, stream_ops[i] * scale);
+    printf("  %"PRIu64" writes (%.0lf ops/s), %.1lf MiB/day written, %.0lf fsync/day\n",
+           total.ops, total.ops / (elapsed_us / 1e6), total.bytes * scale / 1048576, total.fsyncs * scale);
+    if (g_cfg.snapshot_prefix)
+        printf("  snapshots: %.1lf MiB/day written to flash, %.0lf fsync/day\n",
+               flash.bytes * scale / 1048576, flash.fsyncs * scale);
+    programmed = (flash.bytes + flash.fsyncs * g_cfg.page_size) * scale;
+    printf("  flash wear: %.1lf MiB/day programmed, %.3lg%% of the endurance per day",
+           programmed / 1048576, 100 * programmed / (g_cfg.flash_size_mib * 1048576.0 * g_cfg.flash_cycles));
+    if (programmed)
+        printf(", %.1lf years", g_cfg.flash_size_mib * 1048576.0 * g_cfg.flash_cycles / programmed / 365);
+    printf("\n");
+    return 0;
+}
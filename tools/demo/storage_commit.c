@@ -0,0 +1,113 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/key_value_storage.h"
+#include "common/log.h"
+
+/*
+ * Check the commit window of common/key_value_storage.c when the same file is
+ * written several times before the window expires. Every rename() must
+ * succeed, the last content must be kept, and no <file>.tmp must be left.
+ * The exit status is 1 if a check fails.
+ */
+
+int __real_rename(const char *oldpath, const char *newpath);
+static int g_rename_errors;
+
+int __wrap_rename(const char *oldpath, const char *newpath)
+{
+    int ret = __real_rename(oldpath, newpath);
+
+    if (ret < 0)
+        g_rename_errors++;
+    return ret;
+}
+
+static void storage_write(const char *filename, const char *content, bool sync)
+{
+    struct storage_parse_info *info;
+
+    info = storage_open_prefix(filename, "w");
+    FATAL_ON(!info, 2, "%s: %m", filename);
+    fprintf(info->file, "%s\n", content);
+    if (sync)
+        FATAL_ON(storage_sync(info) < 0, 2, "%s: %m", filename);
+    storage_close(info);
+}
+
+static bool storage_check(const char *filename, const char *content)
+{
+    struct storage_parse_info *info;
+    char tmp_filename[PATH_MAX];
+    char line[256] = { };
+    bool ok = true;
+
+    info = storage_open_prefix(filename, "r");
+    FATAL_ON(!info, 2, "%s: %m", filename);
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", info->filename);
+    fgets(line, sizeof(line), info->file);
+    line[strcspn(line, "\n")] = '\0';
+    if (strcmp(line, content)) {
+        printf("%s: \"%s\" instead of \"%s\"\n", filename, line, content);
+        ok = false;
+    }
+    if (!access(tmp_filename, F_OK)) {
+        printf("%s: left behind\n", tmp_filename);
+        ok = false;
+    }
+    storage_close(info);
+    return ok;
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/storage-commit-XXXXXX";
+    char prefix[sizeof(dir) + 1];
+    bool ok = true;
+
+    FATAL_ON(!mkdtemp(dir), 2, "mkdtemp: %m");
+    snprintf(prefix, sizeof(prefix), "%s/", dir);
+    g_storage_prefix = prefix;
+    storage_commit_window(1000);
+
+    // Both writes are queued in the same window
+    storage_write("synced", "1", true);
+    storage_write("synced", "2", true);
+    // The second write is committed immediately
+    storage_write("mixed", "1", true);
+    storage_write("mixed", "2", false);
+    storage_commit_flush();
+    ok &= storage_check("synced", "2");
+    ok &= storage_check("mixed", "2");
+
+    // Read back before the window expires
+    storage_write("read", "1", true);
+    ok &= storage_check("read", "1");
+    storage_commit_flush();
+
+    if (g_rename_errors) {
+        printf("%d rename() failed\n", g_rename_errors);
+        ok = false;
+    }
+    storage_delete((const char *[]){ "synced", "mixed", "read", NULL });
+    rmdir(dir);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <sys/queue.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common/memutils.h"
+#include "common/timer.h"
+
+/*
+ * Compare the cost of restarting timers with common/timer.c against the
+ * sorted list used before it was backed by a heap. The workload mimics
+ * neighbor tables: n timers are armed, then randomly picked timers are
+ * restarted with a random delay, like ETX timers refreshed on TX confirms.
+ *
+ * The list implementation below is a copy of the former insertion algorithm,
+ * without any timerfd handling. The timer.c figures include timerfd_settime()
+ * calls when the earliest timer changes, so they are pessimistic.
+ *
+ * Usage: demo-timer-bench [TIMER_COUNT [RESTART_COUNT]]
+ */
+
+struct list_timer {
+    uint64_t expire_ms;
+    SLIST_ENTRY(list_timer) link;
+};
+
+SLIST_HEAD(list_timer_head, list_timer);
+
+static void list_start(struct list_timer_head *head, struct list_timer *timer, uint64_t expire_ms)
+{
+    struct list_timer *cur, *prev;
+
+    if (timer->expire_ms)
+        SLIST_REMOVE(head, timer, list_timer, link);
+    prev = NULL;
+    SLIST_FOREACH(cur, head, link) {
+        if (expire_ms <= cur->expire_ms)
+            break;
+        prev = cur;
+    }
+    timer->expire_ms = expire_ms;
+    if (prev)
+        SLIST_INSERT_AFTER(prev, timer, link);
+    else
+        SLIST_INSERT_HEAD(head, timer, link);
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static uint64_t bench_rand_delay_ms(void)
+{
+    // Between 1 minute and 1 hour, similar to neighbor and ETX timers
+    return 60 * 1000 + rand() % (59 * 60 * 1000);
+}
+
+static double bench_list(int count, int restarts)
+{
+    struct list_timer_head head = SLIST_HEAD_INITIALIZER(head);
+    struct list_timer *timers = zalloc(count * sizeof(*timers));
+    uint64_t start_ns;
+
+    srand(0);
+    for (int i = 0; i < count; i++)
+        list_start(&head, &timers[i], bench_rand_delay_ms());
+    start_ns = bench_now_ns();
+    for (int i = 0; i < restarts; i++)
+        list_start(&head, &timers[rand() % count], bench_rand_delay_ms());
+    start_ns = bench_now_ns() - start_ns;
+    free(timers);
+    return (double)start_ns / restarts;
+}
+
+static double bench_timer(int count, int restarts)
+{
+    struct timer_entry *timers = zalloc(count * sizeof(*timers));
+    struct timer_group group;
+    uint64_t start_ns;
+
+    timer_group_init(&group);
+    srand(0);
+    for (int i = 0; i < count; i++)
+        timer_start_rel(&group, &timers[i], bench_rand_delay_ms());
+    start_ns = bench_now_ns();
+    for (int i = 0; i < restarts; i++)
+        timer_start_rel(&group, &timers[rand() % count], bench_rand_delay_ms());
+    start_ns = bench_now_ns() - start_ns;
+    for (int i = 0; i < count; i++)
+        timer_stop(&group, &timers[i]);
+    free(timers);
+    return (double)start_ns / restarts;
+}
+
+int main(int argc, char *argv[])
+{
+    int restarts = argc > 2 ? atoi(argv[2]) : 100000;
+    int count = argc > 1 ? atoi(argv[1]) : 3000;
+
+    if (count <= 0 || restarts <= 0) {
+        fprintf(stderr, "usage: %s [TIMER_COUNT [RESTART_COUNT]]\n", argv[0]);
+        return 1;
+    }
+    printf("%d timers, %d restarts\n", count, restarts);
+    printf("  sorted list: %9.1lf ns/restart\n", bench_list(count, restarts));
+    printf("  timer.c:     %9.1lf ns/restart\n", bench_timer(count, restarts));
+    return 0;
+}
@@ -0,0 +1,608 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_LIBSYSTEMD
+#include <systemd/sd-bus.h>
+#endif
+
+#include "common/endian.h"
+#include "common/histogram.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+
+/*
+ * Generate downstream traffic towards the nodes of a Wi-SUN network, like a
+ * head-end would, and measure the latency and loss from the responses.
+ *
+ * UDP packets are sent on the TUN interface of wsbrd (SO_BINDTODEVICE), so
+ * they follow the same path as the traffic routed from the backhaul. The
+ * payload starts with a sequence number and a timestamp, and the nodes are
+ * expected to echo it back (for instance with an UDP echo service on port 7).
+ * A packet without response after --timeout is considered lost.
+ *
+ * Destinations are either given on the command line, or retrieved from the
+ * RoutingGraph D-Bus property of wsbrd. They can be picked uniformly, in turn,
+ * or following a Zipf distribution, where a few nodes receive most of the
+ * traffic. Multicast packets (eg. a firmware push to ff03::fd) can be sent at
+ * a separate rate; all the responses to these are counted.
+ *
+ * Usage: demo-tun-load [OPTIONS] [ADDR...]
+ */
+
+#define LOAD_MAGIC 0x574c4f44 // "WLOD"
+#define LOAD_HDR_LEN 16
+// Packets in flight, older packets are counted as lost when overwritten.
+#define LOAD_RING_SIZE (1 << 18)
+#define LOAD_REPORT_INTERVAL_NS 1000000000
+
+enum {
+    LOAD_DIST_UNIFORM,
+    LOAD_DIST_ROUND_ROBIN,
+    LOAD_DIST_ZIPF,
+};
+
+struct load_cfg {
+    char ifname[IF_NAMESIZE];
+    const char *dbus_name;
+    uint16_t port;
+    double rate;
+    int size_min;
+    int size_max;
+    int dist;
+    double zipf_s;
+    struct in6_addr mcast_addr;
+    double mcast_rate;
+    int mcast_size;
+    int mcast_hops;
+    double duration_s;
+    uint64_t count;
+    double timeout_s;
+    unsigned int seed;
+};
+
+struct load_slot {
+    uint32_t seq;
+    uint64_t tx_ns;
+    uint16_t rx_count;
+    bool mcast;
+    bool used;
+};
+
+struct load_stats {
+    uint64_t tx_count;
+    uint64_t tx_bytes;
+    uint64_t tx_err;
+    uint64_t rx_count;
+    uint64_t rx_dup;
+    uint64_t rx_late;
+    uint64_t lost;
+    uint64_t in_flight;
+    uint64_t mcast_tx_count;
+    uint64_t mcast_rx_count;
+    struct histogram latency_us;
+};
+
+struct load_ctxt {
+    struct load_cfg cfg;
+    struct in6_addr *dst;
+    int dst_count;
+    double *zipf_cdf;
+    int ifindex;
+    int fd;
+    uint32_t seq;
+    struct load_slot *ring;
+    struct load_stats stats;
+};
+
+static volatile sig_atomic_t g_load_stop;
+
+static uint64_t load_now_ns(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static void load_sigint(int signum)
+{
+    g_load_stop = 1;
+}
+
+static void load_print_help(FILE *stream, int exit_code)
+{
+    fprintf(stream, "\n");
+    fprintf(stream, "Send UDP traffic to the nodes of a Wi-SUN network through the TUN interface of\n");
+    fprintf(stream, "wsbrd and measure latency and loss from their echo responses\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Usage:\n");
+    fprintf(stream, "  demo-tun-load [OPTIONS] [ADDR...]\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -i, --interface=IFNAME  TUN interface of wsbrd (default: tun0)\n");
+#ifdef HAVE_LIBSYSTEMD
+    fprintf(stream, "  -b, --dbus[=NAME]       Send to the RPL targets of the border router registered\n");
+    fprintf(stream, "                          on D-Bus with NAME (default: com.silabs.Wisun.BorderRouter)\n");
+#endif
+    fprintf(stream, "  -p, --port=PORT         UDP destination port (default: 7)\n");
+    fprintf(stream, "  -r, --rate=PPS          Unicast packets per second (default: 10)\n");
+    fprintf(stream, "  -s, --size=MIN[-MAX]    UDP payload size, picked uniformly in the range\n");
+    fprintf(stream, "                          (default: 32)\n");
+    fprintf(stream, "  -D, --distribution=DIST Choice of the destinations: uniform, round-robin or\n");
+    fprintf(stream, "                          zipf (default: uniform)\n");
+    fprintf(stream, "  -z, --zipf=EXPONENT     Exponent of the Zipf distribution (default: 1)\n");
+    fprintf(stream, "  -m, --multicast=ADDR    Also send packets to this multicast group\n");
+    fprintf(stream, "  -M, --multicast-rate=PPS Multicast packets per second (default: 0.1)\n");
+    fprintf(stream, "  -S, --multicast-size=BYTES Multicast payload size (default: 1024)\n");
+    fprintf(stream, "  -H, --multicast-hops=HOPS Hop limit of multicast packets (default: 64)\n");
+    fprintf(stream, "  -d, --duration=SECONDS  Stop sending after SECONDS\n");
+    fprintf(stream, "  -n, --count=COUNT       Stop sending after COUNT unicast packets\n");
+    fprintf(stream, "  -t, --timeout=SECONDS   Delay after which a packet is considered lost\n");
+    fprintf(stream, "                          (default: 30)\n");
+    fprintf(stream, "  -e, --seed=VAL          Seed of the random generator (default: 0)\n");
+    fprintf(stream, "  -h, --help              Print this help\n");
+    fprintf(stream, "\n");
+    exit(exit_code);
+}
+
+static void load_parse_size(struct load_cfg *cfg, const char *str)
+{
+    char *end;
+
+    cfg->size_min = strtol(str, &end, 10);
+    cfg->size_max = *end == '-' ? strtol(end + 1, &end, 10) : cfg->size_min;
+    FATAL_ON(*end, 1, "invalid size: %s", str);
+    FATAL_ON(cfg->size_min < LOAD_HDR_LEN || cfg->size_max < cfg->size_min || cfg->size_max > 1280 - 48,
+             1, "size must be between %d and %d bytes: %s", LOAD_HDR_LEN, 1280 - 48, str);
+}
+
+static double load_parse_double(const char *str, double min)
+{
+    char *end;
+    double val;
+
+    val = strtod(str, &end);
+    FATAL_ON(*end || val < min, 1, "invalid value: %s", str);
+    return val;
+}
+
+static void load_dst_add(struct load_ctxt *ctxt, const struct in6_addr *addr)
+{
+    ctxt->dst = realloc(ctxt->dst, (ctxt->dst_count + 1) * sizeof(*ctxt->dst));
+    FATAL_ON(!ctxt->dst, 2, "%s: cannot allocate memory", __func__);
+    ctxt->dst[ctxt->dst_count++] = *addr;
+}
+
+static void load_parse_commandline(struct load_ctxt *ctxt, int argc, char *argv[])
+{
+    static const struct option opts_long[] = {
+        { "interface",      required_argument, 0, 'i' },
+        { "dbus",           optional_argument, 0, 'b' },
+        { "port",           required_argument, 0, 'p' },
+        { "rate",           required_argument, 0, 'r' },
+        { "size",           required_argument, 0, 's' },
+        { "distribution",   required_argument, 0, 'D' },
+        { "zipf",           required_argument, 0, 'z' },
+        { "multicast",      required_argument, 0, 'm' },
+        { "multicast-rate", required_argument, 0, 'M' },
+        { "multicast-size", required_argument, 0, 'S' },
+        { "multicast-hops", required_argument, 0, 'H' },
+        { "duration",       required_argument, 0, 'd' },
+        { "count",          required_argument, 0, 'n' },
+        { "timeout",        required_argument, 0, 't' },
+        { "seed",           required_argument, 0, 'e' },
+        { "help",           no_argument,       0, 'h' },
+        { 0,                0,                 0,  0  }
+    };
+    struct load_cfg *cfg = &ctxt->cfg;
+    struct in6_addr addr;
+    int opt;
+
+    strcpy(cfg->ifname, "tun0");
+    cfg->port       = 7;
+    cfg->rate       = 10;
+    cfg->size_min   = 32;
+    cfg->size_max   = 32;
+    cfg->zipf_s     = 1;
+    cfg->mcast_rate = 0.1;
+    cfg->mcast_size = 1024;
+    cfg->mcast_hops = 64;
+    cfg->timeout_s  = 30;
+    while ((opt = getopt_long(argc, argv, "i:b::p:r:s:D:z:m:M:S:H:d:n:t:e:h", opts_long, NULL)) != -1) {
+        switch (opt) {
+        case 'i':
+            FATAL_ON(strlen(optarg) >= IF_NAMESIZE, 1, "interface name too long: %s", optarg);
+            strcpy(cfg->ifname, optarg);
+            break;
+        case 'b':
+#ifndef HAVE_LIBSYSTEMD
+            FATAL(1, "support for D-Bus is disabled");
+#endif
+            cfg->dbus_name = optarg ? optarg : "com.silabs.Wisun.BorderRouter";
+            break;
+        case 'p':
+            cfg->port = load_parse_double(optarg, 1);
+            FATAL_ON(cfg->port != strtod(optarg, NULL), 1, "invalid port: %s", optarg);
+            break;
+        case 'r':
+            cfg->rate = load_parse_double(optarg, 0);
+            break;
+        case 's':
+            load_parse_size(cfg, optarg);
+            break;
+        case 'D':
+            if (!strcmp(optarg, "uniform"))
+                cfg->dist = LOAD_DIST_UNIFORM;
+            else if (!strcmp(optarg, "round-robin"))
+                cfg->dist = LOAD_DIST_ROUND_ROBIN;
+            else if (!strcmp(optarg, "zipf"))
+                cfg->dist = LOAD_DIST_ZIPF;
+            else
+                FATAL(1, "invalid distribution: %s", optarg);
+            break;
+        case 'z':
+            cfg->zipf_s = load_parse_double(optarg, 0);
+            break;
+        case 'm':
+            if (inet_pton(AF_INET6, optarg, &cfg->mcast_addr) != 1 || !IN6_IS_ADDR_MULTICAST(&cfg->mcast_addr))
+                FATAL(1, "invalid multicast address: %s", optarg);
+            break;
+        case 'M':
+            cfg->mcast_rate = load_parse_double(optarg, 0);
+            break;
+        case 'S':
+            cfg->mcast_size = load_parse_double(optarg, LOAD_HDR_LEN);
+            break;
+        case 'H':
+            cfg->mcast_hops = load_parse_double(optarg, 1);
+            FATAL_ON(cfg->mcast_hops > 255, 1, "invalid hop limit: %s", optarg);
+            break;
+        case 'd':
+            cfg->duration_s = load_parse_double(optarg, 0);
+            break;
+        case 'n':
+            cfg->count = load_parse_double(optarg, 1);
+            break;
+        case 't':
+            cfg->timeout_s = load_parse_double(optarg, 0);
+            break;
+        case 'e':
+            cfg->seed = load_parse_double(optarg, 0);
+            break;
+        case 'h':
+            load_print_help(stdout, 0);
+            break;
+        case '?':
+        default:
+            load_print_help(stderr, 1);
+            break;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (inet_pton(AF_INET6, argv[i], &addr) != 1)
+            FATAL(1, "invalid address: %s", argv[i]);
+        load_dst_add(ctxt, &addr);
+    }
+}
+
+#ifdef HAVE_LIBSYSTEMD
+// RoutingGraph lists the RPL targets as a(aybaay): address, external flag and
+// parents.
+static void load_dbus_get_targets(struct load_ctxt *ctxt)
+{
+    sd_bus_error err = SD_BUS_ERROR_NULL;
+    sd_bus_message *reply = NULL;
+    const void *addr;
+    sd_bus *bus;
+    size_t len;
+    int ret;
+
+    ret = sd_bus_default_system(&bus);
+    FATAL_ON(ret < 0, 2, "sd_bus_default_system: %s", strerror(-ret));
+    ret = sd_bus_get_property(bus, ctxt->cfg.dbus_name, "/com/silabs/Wisun/BorderRouter",
+                              "com.silabs.Wisun.BorderRouter", "RoutingGraph",
+                              &err, &reply, "a(aybaay)");
+    FATAL_ON(ret < 0, 2, "%s: RoutingGraph: %s", ctxt->cfg.dbus_name, err.message ? : strerror(-ret));
+    sd_bus_message_enter_container(reply, 'a', "(aybaay)");
+    while (sd_bus_message_enter_container(reply, 'r', "aybaay") > 0) {
+        ret = sd_bus_message_read_array(reply, 'y', &addr, &len);
+        if (ret >= 0 && len == 16)
+            load_dst_add(ctxt, addr);
+        sd_bus_message_skip(reply, "baay");
+        sd_bus_message_exit_container(reply);
+    }
+    sd_bus_message_exit_container(reply);
+    sd_bus_message_unref(reply);
+    sd_bus_error_free(&err);
+    sd_bus_unref(bus);
+}
+#endif
+
+static void load_zipf_init(struct load_ctxt *ctxt)
+{
+    double sum = 0;
+
+    ctxt->zipf_cdf = xalloc(ctxt->dst_count * sizeof(double));
+    for (int i = 0; i < ctxt->dst_count; i++) {
+        sum += 1 / pow(i + 1, ctxt->cfg.zipf_s);
+        ctxt->zipf_cdf[i] = sum;
+    }
+    for (int i = 0; i < ctxt->dst_count; i++)
+        ctxt->zipf_cdf[i] /= sum;
+}
+
+static const struct in6_addr *load_dst_pick(struct load_ctxt *ctxt)
+{
+    int lo = 0, hi = ctxt->dst_count - 1, mid;
+    double u;
+
+    switch (ctxt->cfg.dist) {
+    case LOAD_DIST_ROUND_ROBIN:
+        return &ctxt->dst[ctxt->stats.tx_count % ctxt->dst_count];
+    case LOAD_DIST_ZIPF:
+        u = (double)rand() / RAND_MAX;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (ctxt->zipf_cdf[mid] < u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return &ctxt->dst[lo];
+    default:
+        return &ctxt->dst[rand() % ctxt->dst_count];
+    }
+}
+
+static void load_slot_release(struct load_ctxt *ctxt, struct load_slot *slot)
+{
+    if (slot->used && !slot->mcast && !slot->rx_count)
+        ctxt->stats.lost++;
+    slot->used = false;
+}
+
+static void load_send(struct load_ctxt *ctxt, const struct in6_addr *dst, int len, bool mcast)
+{
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6,
+        .sin6_addr   = *dst,
+        .sin6_port   = htobe16(ctxt->cfg.port),
+    };
+    uint64_t now_ns = load_now_ns();
+    struct load_slot *slot;
+    uint8_t buf[1500];
+    ssize_t ret;
+
+    BUG_ON(len < LOAD_HDR_LEN || len > sizeof(buf));
+    if (IN6_IS_ADDR_MC_LINKLOCAL(dst))
+        addr.sin6_scope_id = ctxt->ifindex;
+    write_be32(buf, LOAD_MAGIC);
+    write_be32(buf + 4, ctxt->seq);
+    write_be64(buf + 8, now_ns);
+    for (int i = LOAD_HDR_LEN; i < len; i++)
+        buf[i] = i;
+    ret = sendto(ctxt->fd, buf, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret < 0) {
+        // ENOBUFS when the TUN queue is full, the kernel drops the packet
+        TRACE(TR_DROP, "drop %s: %m", tr_ipv6(dst->s6_addr));
+        ctxt->stats.tx_err++;
+        ctxt->seq++;
+        return;
+    }
+    slot = &ctxt->ring[ctxt->seq % LOAD_RING_SIZE];
+    load_slot_release(ctxt, slot);
+    slot->seq      = ctxt->seq;
+    slot->tx_ns    = now_ns;
+    slot->rx_count = 0;
+    slot->mcast    = mcast;
+    slot->used     = true;
+    ctxt->seq++;
+    ctxt->stats.tx_bytes += len;
+    if (mcast)
+        ctxt->stats.mcast_tx_count++;
+    else
+        ctxt->stats.tx_count++;
+}
+
+static void load_recv(struct load_ctxt *ctxt)
+{
+    uint64_t now_ns = load_now_ns();
+    struct load_slot *slot;
+    uint8_t buf[1500];
+    uint32_t seq;
+    ssize_t len;
+
+    while ((len = recv(ctxt->fd, buf, sizeof(buf), MSG_DONTWAIT)) >= 0) {
+        if (len < LOAD_HDR_LEN || read_be32(buf) != LOAD_MAGIC)
+            continue;
+        seq  = read_be32(buf + 4);
+        slot = &ctxt->ring[seq % LOAD_RING_SIZE];
+        if (!slot->used || slot->seq != seq) {
+            ctxt->stats.rx_late++;
+            continue;
+        }
+        if (now_ns - slot->tx_ns > ctxt->cfg.timeout_s * 1000000000) {
+            ctxt->stats.rx_late++;
+            continue;
+        }
+        if (slot->mcast) {
+            ctxt->stats.mcast_rx_count++;
+        } else if (slot->rx_count) {
+            ctxt->stats.rx_dup++;
+            continue;
+        } else {
+            ctxt->stats.rx_count++;
+            histogram_add(&ctxt->stats.latency_us, (now_ns - slot->tx_ns) / 1000);
+        }
+        slot->rx_count++;
+    }
+    FATAL_ON(errno != EAGAIN, 2, "recv: %m");
+}
+
+// Packets older than the timeout are counted as lost
+static void load_expire(struct load_ctxt *ctxt, uint64_t now_ns)
+{
+    static uint32_t seq_expired;
+
+    for (; seq_expired != ctxt->seq; seq_expired++) {
+        struct load_slot *slot = &ctxt->ring[seq_expired % LOAD_RING_SIZE];
+
+        if (slot->used && slot->seq == seq_expired) {
+            if (now_ns - slot->tx_ns < ctxt->cfg.timeout_s * 1000000000)
+                break;
+            load_slot_release(ctxt, slot);
+        }
+    }
+}
+
+static void load_report(struct load_ctxt *ctxt, uint64_t elapsed_ns, bool final)
+{
+    const struct load_stats *stats = &ctxt->stats;
+
+    printf("%s%.0lfs: %"PRIu64" sent (%.1lf kbit/s), %"PRIu64" answered, %"PRIu64" lost",
+           final ? "total after " : "", elapsed_ns / 1e9, stats->tx_count + stats->mcast_tx_count,
+           stats->tx_bytes * 8 / (elapsed_ns / 1e6), stats->rx_count, stats->lost);
+    if (stats->latency_us.count)
+        printf(", latency p50 %.1lfms p90 %.1lfms p99 %.1lfms max %.1lfms",
+               histogram_quantile(&stats->latency_us, 0.5) / 1e3,
+               histogram_quantile(&stats->latency_us, 0.9) / 1e3,
+               histogram_quantile(&stats->latency_us, 0.99) / 1e3,
+               stats->latency_us.max / 1e3);
+    printf("\n");
+    if (!final)
+        return;
+    if (stats->tx_count)
+        printf("  loss: %.2lf%%, %"PRIu64" in flight, %"PRIu64" duplicates, %"PRIu64" late responses, "
+               "%"PRIu64" send errors\n",
+               100.0 * stats->lost / stats->tx_count, stats->in_flight, stats->rx_dup, stats->rx_late,
+               stats->tx_err);
+    if (stats->mcast_tx_count)
+        printf("  multicast: %"PRIu64" sent, %.1lf responses per packet (%d destinations known)\n",
+               stats->mcast_tx_count, (double)stats->mcast_rx_count / stats->mcast_tx_count, ctxt->dst_count);
+}
+
+static void load_socket_init(struct load_ctxt *ctxt)
+{
+    int ret;
+
+    ctxt->ifindex = if_nametoindex(ctxt->cfg.ifname);
+    FATAL_ON(!ctxt->ifindex, 1, "%s: %m", ctxt->cfg.ifname);
+    ctxt->fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    FATAL_ON(ctxt->fd < 0, 2, "socket AF_INET6 SOCK_DGRAM IPPROTO_UDP: %m");
+    // Force the packets through wsbrd even if the host has other routes
+    ret = setsockopt(ctxt->fd, SOL_SOCKET, SO_BINDTODEVICE, ctxt->cfg.ifname, strlen(ctxt->cfg.ifname));
+    FATAL_ON(ret < 0, 2, "setsockopt SO_BINDTODEVICE %s: %m", ctxt->cfg.ifname);
+    ret = setsockopt(ctxt->fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &ctxt->ifindex, sizeof(ctxt->ifindex));
+    FATAL_ON(ret < 0, 2, "setsockopt IPV6_MULTICAST_IF: %m");
+    ret = setsockopt(ctxt->fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ctxt->cfg.mcast_hops, sizeof(int));
+    FATAL_ON(ret < 0, 2, "setsockopt IPV6_MULTICAST_HOPS: %m");
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t start_ns, now_ns, next_ns, mcast_next_ns, report_ns, stop_ns, wake_ns;
+    struct load_ctxt ctxt = { };
+    bool sending = true;
+    bool mcast;
+    struct pollfd pfd;
+    int timeout_ms;
+
+    load_parse_commandline(&ctxt, argc, argv);
+#ifdef HAVE_LIBSYSTEMD
+    if (ctxt.cfg.dbus_name)
+        load_dbus_get_targets(&ctxt);
+#endif
+    FATAL_ON(!ctxt.dst_count && ctxt.cfg.rate, 1, "no destination");
+    if (ctxt.cfg.dist == LOAD_DIST_ZIPF)
+        load_zipf_init(&ctxt);
+    if (ctxt.cfg.rate * ctxt.cfg.timeout_s > LOAD_RING_SIZE)
+        WARN("more than %d packets in flight, some will be counted as lost", LOAD_RING_SIZE);
+    mcast = ctxt.cfg.mcast_rate && IN6_IS_ADDR_MULTICAST(&ctxt.cfg.mcast_addr);
+    srand(ctxt.cfg.seed);
+    ctxt.ring = zalloc(LOAD_RING_SIZE * sizeof(*ctxt.ring));
+    load_socket_init(&ctxt);
+    signal(SIGINT, load_sigint);
+    signal(SIGTERM, load_sigint);
+    INFO("sending to %d destinations at %.1lf packets/s", ctxt.dst_count, ctxt.cfg.rate);
+
+    start_ns = load_now_ns();
+    next_ns = mcast_next_ns = start_ns;
+    report_ns = start_ns + LOAD_REPORT_INTERVAL_NS;
+    stop_ns = UINT64_MAX;
+    pfd.fd = ctxt.fd;
+    pfd.events = POLLIN;
+    while (!g_load_stop) {
+        now_ns = load_now_ns();
+        if (sending && ((ctxt.cfg.duration_s && now_ns - start_ns >= ctxt.cfg.duration_s * 1e9) ||
+                        (ctxt.cfg.count && ctxt.stats.tx_count >= ctxt.cfg.count))) {
+            // Wait for the last responses
+            sending = false;
+            stop_ns = now_ns + ctxt.cfg.timeout_s * 1e9;
+        }
+        if (now_ns >= stop_ns)
+            break;
+        // Do not try to catch up after a long stall
+        next_ns = MAX(next_ns, now_ns - LOAD_REPORT_INTERVAL_NS);
+        while (sending && ctxt.cfg.rate && now_ns >= next_ns) {
+            load_send(&ctxt, load_dst_pick(&ctxt),
+                      ctxt.cfg.size_min + rand() % (ctxt.cfg.size_max - ctxt.cfg.size_min + 1), false);
+            next_ns += 1e9 / ctxt.cfg.rate;
+        }
+        while (sending && mcast && now_ns >= mcast_next_ns) {
+            load_send(&ctxt, &ctxt.cfg.mcast_addr, ctxt.cfg.mcast_size, true);
+            mcast_next_ns += 1e9 / ctxt.cfg.mcast_rate;
+        }
+        if (now_ns >= report_ns) {
+            load_expire(&ctxt, now_ns);
+            load_report(&ctxt, now_ns - start_ns, false);
+            report_ns += LOAD_REPORT_INTERVAL_NS;
+        }
+        wake_ns = MIN(report_ns, stop_ns);
+        if (sending && ctxt.cfg.rate)
+            wake_ns = MIN(wake_ns, next_ns);
+        if (sending && mcast)
+            wake_ns = MIN(wake_ns, mcast_next_ns);
+        timeout_ms = (wake_ns - now_ns + 999999) / 1000000;
+        if (poll(&pfd, 1, timeout_ms) > 0)
+            load_recv(&ctxt);
+    }
+    now_ns = load_now_ns();
+    load_expire(&ctxt, now_ns);
+    // Interrupted before the timeout of the last packets
+    for (int i = 0; i < LOAD_RING_SIZE; i++)
+        if (ctxt.ring[i].used && !ctxt.ring[i].mcast && !ctxt.ring[i].rx_count)
+            ctxt.stats.in_flight++;
+    load_report(&ctxt, now_ns - start_ns, true);
+    free(ctxt.ring);
+    free(ctxt.zipf_cdf);
+    free(ctxt.dst);
+    close(ctxt.fd);
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "app_wsbrd/app/wsbrd.h"
+#include "common/bus_uart.h"
+#include "common/endian.h"
+#include "common/iobuf.h"
+#include "common/mathutils.h"
+#include "common/log.h"
+#include "common/hif.h"
+#include "wsbrd_fuzz.h"
+#include "replay.h"
+
+#include "checkpoint.h"
+
+/*
+ * A replay starting from a checkpoint is made of 2 parts:
+ * - The RCP initialization sequence (reset and radio list), copied from the
+ *   beginning of the capture into a memfd, since wsbrd cannot start without
+ *   it.
+ * - The rest of the capture, starting right after the checkpoint.
+ * The storage recorded in the checkpoint is restored before wsbrd starts.
+ *
+ * Only the storage is restored, so wsbrd starts as after a reboot with the
+ * state of the checkpoint, and not with the exact state it had in memory. The
+ * beginning of the replay may thus differ from what happened during the
+ * capture.
+ */
+
+struct fuzz_checkpoint {
+    unsigned int index;
+    uint64_t time_ms;
+    uint64_t offset;
+    uint64_t end_offset;
+};
+
+// Return the length of the frame (header and FCS included), 0 on EOF
+static size_t fuzz_capture_read(int fd, uint64_t offset, uint8_t buf[], size_t *len)
+{
+    uint8_t hdr[4];
+    ssize_t ret;
+
+    ret = pread(fd, hdr, sizeof(hdr), offset);
+    FATAL_ON(ret < 0, 2, "%s: pread: %m", __func__);
+    if (!ret)
+        return 0;
+    FATAL_ON(ret != sizeof(hdr), 1, "%s: truncated capture", __func__);
+    *len = read_le16(hdr) & UART_HDR_LEN_MASK;
+    ret = pread(fd, buf, *len, offset + sizeof(hdr));
+    FATAL_ON(ret < 0, 2, "%s: pread: %m", __func__);
+    FATAL_ON(ret != *len, 1, "%s: truncated capture", __func__);
+    return sizeof(hdr) + *len + 2;
+}
+
+// Return the offset of the end of the RCP initialization sequence
+static uint64_t fuzz_capture_init_len(int fd, uint64_t *start_ms)
+{
+    uint8_t buf[UART_HDR_LEN_MASK + 1];
+    struct iobuf_read iobuf;
+    uint64_t offset = 0;
+    size_t frame_len;
+    size_t len;
+    uint8_t cmd;
+
+    *start_ms = 0;
+    while ((frame_len = fuzz_capture_read(fd, offset, buf, &len))) {
+        offset += frame_len;
+        iobuf = (struct iobuf_read){ .data = buf, .data_size = len };
+        cmd = hif_pop_u8(&iobuf);
+        if (cmd == HIF_CMD_IND_REPLAY_TIMER && !*start_ms)
+            *start_ms = hif_pop_u64(&iobuf);
+        if (cmd != HIF_CMD_CNF_RADIO_LIST)
+            continue;
+        hif_pop_u8(&iobuf); // entry size
+        if (hif_pop_bool(&iobuf))
+            return offset;
+    }
+    FATAL(1, "capture does not contain the RCP initialization");
+}
+
+static void fuzz_checkpoint_find(const char *capture, uint64_t time_ms, struct fuzz_checkpoint *ckpt)
+{
+    struct fuzz_checkpoint cur;
+    char path[PATH_MAX];
+    char line[256];
+    bool found = false;
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s.idx", capture);
+    file = fopen(path, "r");
+    FATAL_ON(!file, 1, "fopen %s: %m (use split-capture --index to rebuild it)", path);
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%u %"SCNu64" %"SCNu64" %"SCNu64,
+                   &cur.index, &cur.time_ms, &cur.offset, &cur.end_offset) != 4)
+            FATAL(1, "%s: malformed line: %s", path, line);
+        if (cur.time_ms > time_ms)
+            break;
+        *ckpt = cur;
+        found = true;
+    }
+    fclose(file);
+    FATAL_ON(!found, 1, "%s: no checkpoint before the requested time", path);
+}
+
+static void fuzz_storage_split(const char *storage_prefix, char dirname[PATH_MAX], const char **basename)
+{
+    *basename = strrchr(storage_prefix, '/');
+    *basename = *basename ? *basename + 1 : storage_prefix;
+    snprintf(dirname, PATH_MAX, "%.*s", (int)(*basename - storage_prefix), storage_prefix);
+    if (!dirname[0])
+        strcpy(dirname, ".");
+}
+
+static void fuzz_storage_clear(const char *storage_prefix)
+{
+    char dirname[PATH_MAX], path[PATH_MAX];
+    struct dirent *dirent;
+    const char *basename;
+    struct stat st;
+    DIR *dir;
+
+    fuzz_storage_split(storage_prefix, dirname, &basename);
+    dir = opendir(dirname);
+    if (!dir)
+        return;
+    while ((dirent = readdir(dir))) {
+        if (strncmp(dirent->d_name, basename, strlen(basename)))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dirname, dirent->d_name);
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+            continue;
+        FATAL_ON(unlink(path) < 0, 2, "unlink %s: %m", path);
+    }
+    closedir(dir);
+}
+
+static void fuzz_storage_restore(int fd, const struct fuzz_checkpoint *ckpt, const char *storage_prefix)
+{
+    char dirname[PATH_MAX], path[PATH_MAX];
+    uint8_t buf[UART_HDR_LEN_MASK + 1];
+    uint64_t offset = ckpt->offset;
+    const char *basename, *filename;
+    struct iobuf_read iobuf;
+    const uint8_t *data;
+    uint32_t file_offset;
+    size_t frame_len;
+    size_t data_len;
+    size_t len;
+    int file_fd;
+
+    fuzz_storage_split(storage_prefix, dirname, &basename);
+    while (offset < ckpt->end_offset && (frame_len = fuzz_capture_read(fd, offset, buf, &len))) {
+        offset += frame_len;
+        iobuf = (struct iobuf_read){ .data = buf, .data_size = len };
+        if (hif_pop_u8(&iobuf) != HIF_CMD_IND_REPLAY_CHECKPOINT)
+            continue;
+        if (hif_pop_u32(&iobuf) != ckpt->index)
+            continue;
+        hif_pop_u64(&iobuf);
+        filename    = hif_pop_str(&iobuf);
+        file_offset = hif_pop_u32(&iobuf);
+        data_len    = hif_pop_data_ptr(&iobuf, &data);
+        FATAL_ON(iobuf.err, 1, "%s: malformed checkpoint", __func__);
+        if (!filename[0])
+            return;
+        FATAL_ON(strchr(filename, '/'), 1, "%s: invalid file name: %s", __func__, filename);
+        snprintf(path, sizeof(path), "%s/%s", dirname, filename);
+        file_fd = open(path, O_WRONLY | O_CREAT | (file_offset ? 0 : O_TRUNC), 0644);
+        FATAL_ON(file_fd < 0, 2, "open %s: %m", path);
+        if (pwrite(file_fd, data, data_len, file_offset) != data_len)
+            FATAL(2, "pwrite %s: %m", path);
+        close(file_fd);
+    }
+    FATAL(1, "%s: incomplete checkpoint %u", __func__, ckpt->index);
+}
+
+void fuzz_replay_checkpoint(struct fuzz_ctxt *ctxt)
+{
+    uint8_t buf[4096];
+    struct fuzz_checkpoint ckpt;
+    uint64_t init_len, start_ms;
+    uint64_t offset;
+    ssize_t ret;
+    int memfd;
+    int fd;
+
+    FATAL_ON(ctxt->replay_count != 1, 1, "--replay-from requires exactly one --replay");
+    fd = ctxt->replay_fds[0];
+    FATAL_ON(fuzz_replay_is_zstd(fd), 1, "--replay-from requires an uncompressed capture (zstd -d)");
+
+    init_len = fuzz_capture_init_len(fd, &start_ms);
+    fuzz_checkpoint_find(ctxt->replay_path, start_ms + ctxt->replay_from_s * UINT64_C(1000), &ckpt);
+    INFO("replay: starting from checkpoint %u (%"PRIu64"s)", ckpt.index, (ckpt.time_ms - start_ms) / 1000);
+
+    fuzz_storage_clear(ctxt->wsbrd->config.storage_prefix);
+    fuzz_storage_restore(fd, &ckpt, ctxt->wsbrd->config.storage_prefix);
+    ctxt->wsbrd->config.storage_delete = false;
+
+    // The checkpoint of the initial storage precedes the RCP initialization
+    if (ckpt.end_offset <= init_len) {
+        FATAL_ON(lseek(fd, ckpt.end_offset, SEEK_SET) < 0, 2, "lseek: %m");
+        return;
+    }
+
+    memfd = memfd_create("replay-init", 0);
+    FATAL_ON(memfd < 0, 2, "memfd_create: %m");
+    for (offset = 0; offset < init_len; offset += ret) {
+        ret = pread(fd, buf, MIN(sizeof(buf), init_len - offset), offset);
+        FATAL_ON(ret <= 0, 2, "pread: %m");
+        FATAL_ON(pwrite(memfd, buf, ret, offset) != ret, 2, "pwrite: %m");
+    }
+    FATAL_ON(lseek(fd, ckpt.end_offset, SEEK_SET) < 0, 2, "lseek: %m");
+    ctxt->replay_fds[0] = memfd;
+    ctxt->replay_fds[1] = fd;
+    ctxt->replay_count = 2;
+}
@@ -0,0 +1,23 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef FUZZ_CHECKPOINT_H
+#define FUZZ_CHECKPOINT_H
+
+struct fuzz_ctxt;
+
+// Restore the storage from the last checkpoint recorded before
+// ctxt->replay_from_s, and make the replay start from there.
+void fuzz_replay_checkpoint(struct fuzz_ctxt *ctxt);
+
+#endif
@@ -43,6 +43,10 @@ void __wrap_print_help_br(FILE *stream)
     fprintf(stream, "Extra options:\n");
     fprintf(stream, "  --replay=FILE         Replay a sequence captured using --capture. When specified more than\n");
     fprintf(stream, "                          once, files are replayed back to back from left to right.\n");
+    fprintf(stream, "  --replay-from=SECONDS Start the replay from the last checkpoint (see --capture-checkpoint)\n");
+    fprintf(stream, "                          recorded before SECONDS, using the index file FILE.idx.\n");
+    fprintf(stream, "  --replay-stats        Exit at the end of the replay and report the frame rate, the CPU time\n");
+    fprintf(stream, "                          spent per event source and the peak memory usage.\n");
     fprintf(stream, "  --fuzz                Disable CRC check, stub security RNG, relax SPINEL checks, disable NVM.\n");
 }
 
@@ -54,10 +58,26 @@ static void parse_opt_replay(struct fuzz_ctxt *ctxt, const char *arg)
         "--replay used too many times (max %zu)", ARRAY_SIZE(ctxt->replay_fds));
     ret = open(arg, O_RDONLY);
     FATAL_ON(ret < 0, 2, "open '%s': %m", arg);
+    if (!ctxt->replay_count)
+        snprintf(ctxt->replay_path, sizeof(ctxt->replay_path), "%s", arg);
     ctxt->replay_fds[ctxt->replay_count++] = ret;
     ctxt->wsbrd->config.rcp_cfg.uart_dev[0] = true; // UART device does not need to be specified
 }
 
+static void parse_opt_replay_from(struct fuzz_ctxt *ctxt, const char *arg)
+{
+    char *end;
+
+    ctxt->replay_from_s = strtol(arg, &end, 0);
+    if (*end || ctxt->replay_from_s < 0)
+        FATAL(1, "invalid --replay-from: %s", arg);
+}
+
+static void parse_opt_replay_stats(struct fuzz_ctxt *ctxt, const char *arg)
+{
+    ctxt->replay_stats = true;
+}
+
 static void parse_opt_fuzz(struct fuzz_ctxt *ctxt, const char *arg)
 {
     ctxt->fuzzing_enabled = true;
@@ -102,6 +122,8 @@ static int fuzz_parse_opt(struct fuzz_ctxt *ctxt, char **argv, const struct opti
 static int fuzz_parse_arg(struct fuzz_ctxt *ctxt, char **argv)
 {
     static const struct option opts[] = {
+        { "--replay-stats", false, parse_opt_replay_stats },
+        { "--replay-from",  true,  parse_opt_replay_from },
         { "--replay",       true,  parse_opt_replay },
         { "--fuzz",         false, parse_opt_fuzz },
         { 0,                0,     0 },
@@ -137,6 +159,8 @@ int fuzz_parse_commandline(struct fuzz_ctxt *ctxt, char **argv)
 
     if (ctxt->replay_count)
         ctxt->rand_predictable = true;
+    FATAL_ON(ctxt->replay_stats && !ctxt->replay_count, 1, "--replay-stats requires --replay");
+    FATAL_ON(ctxt->replay_from_s >= 0 && !ctxt->replay_count, 1, "--replay-from requires --replay");
 
     return j;
 }
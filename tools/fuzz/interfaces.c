@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include "app_wsbrd/net/netaddr_types.h"
 #include "app_wsbrd/security/kmp/kmp_socket_if.h"
@@ -89,6 +90,7 @@ void __wrap_wsbr_tun_init(struct wsbr_ctxt *wsbrd)
 {
     struct fuzz_ctxt *ctxt = &g_fuzz_ctxt;
     struct fuzz_iface *iface;
+    int ret;
 
     BUG_ON(ctxt->wsbrd != wsbrd);
     if (!ctxt->replay_count) {
@@ -98,6 +100,9 @@ void __wrap_wsbr_tun_init(struct wsbr_ctxt *wsbrd)
 
     iface = fuzz_iface_new(ctxt);
     wsbrd->tun.fd = iface->pipefd[0];
+    // wsbr_tun_read() drains the file descriptor until EAGAIN
+    ret = fcntl(wsbrd->tun.fd, F_SETFL, fcntl(wsbrd->tun.fd, F_GETFL) | O_NONBLOCK);
+    FATAL_ON(ret < 0, 2, "fcntl: %m");
 
     memcpy(ctxt->tun_gua, &wsbrd->config.ipv6_prefix, 8);
     memcpy(ctxt->tun_gua + 8, &wsbrd->rcp.eui64, 8);
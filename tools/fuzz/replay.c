@@ -11,16 +11,80 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#define _GNU_SOURCE
 #include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 
 #include "app_wsbrd/app/wsbrd.h"
 #include "app_wsbrd/net/timers.h"
 #include "tools/fuzz/wsbrd_fuzz.h"
+#include "common/event_loop.h"
 #include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/bus.h"
+#include "common/endian.h"
+#include "common/time_extra.h"
 #include "common/hif.h"
 
+/*
+ * The replay never waits: the clock is virtualized and the timers expire as
+ * soon as the capture reaches their date, so a capture is replayed as fast as
+ * the CPU allows.
+ *
+ * With --replay-stats, the callback of every event source is wrapped to
+ * measure the CPU time spent in each of them, and a report is printed once the
+ * last replay file has been read.
+ *
+ * Captures compressed with zstd (see capture_start()) are decompressed on the
+ * fly by a thread writing to a pipe, which replaces the replay file.
+ */
+
+#define FUZZ_ZSTD_MAGIC 0xfd2fb528
+
+struct fuzz_src_stat {
+    const char *name;
+    struct event_source *src;
+    void (*callback)(struct event_source *src, uint32_t revents);
+    uint64_t cpu_ns;
+    uint64_t call_count;
+};
+
+static const struct {
+    const char *name;
+    size_t offset;
+} fuzz_src_names[] = {
+    { "tun",              offsetof(struct wsbr_ctxt, ev_tun)            },
+    { "rcp",              offsetof(struct wsbr_ctxt, ev_rcp)            },
+    { "dbus",             offsetof(struct wsbr_ctxt, ev_dbus)           },
+    { "event",            offsetof(struct wsbr_ctxt, ev_event)          },
+    { "timer",            offsetof(struct wsbr_ctxt, ev_timer)          },
+    { "dhcp",             offsetof(struct wsbr_ctxt, ev_dhcp)           },
+    { "rpl",              offsetof(struct wsbr_ctxt, ev_rpl)            },
+    { "br-eapol-relay",   offsetof(struct wsbr_ctxt, ev_br_eapol_relay) },
+    { "eapol-relay",      offsetof(struct wsbr_ctxt, ev_eapol_relay)    },
+    { "pae-auth",         offsetof(struct wsbr_ctxt, ev_pae_auth)       },
+    { "radius",           offsetof(struct wsbr_ctxt, ev_radius)         },
+    { "pcap",             offsetof(struct wsbr_ctxt, ev_pcap)           },
+    { "netlink",          offsetof(struct wsbr_ctxt, ev_netlink)        },
+    { "metrics",          offsetof(struct wsbr_ctxt, ev_metrics)        },
+    { "pan-load",         offsetof(struct wsbr_ctxt, ev_pan_load)       },
+};
+
+static struct fuzz_src_stat fuzz_src_stats[32];
+static int fuzz_src_stat_count;
+static uint64_t fuzz_wall_start_ns;
+
 ssize_t __real_write(int fd, const void *buf, size_t count);
 
 int __real_clock_gettime(clockid_t clockid, struct timespec *tp);
@@ -37,6 +101,170 @@ int __wrap_clock_gettime(clockid_t clockid, struct timespec *tp)
     return 0;
 }
 
+// Cannot use time_now_ms() since clock_gettime() is wrapped
+static uint64_t fuzz_real_now_ns(clockid_t clockid)
+{
+    struct timespec tp;
+
+    __real_clock_gettime(clockid, &tp);
+    return tp.tv_sec * UINT64_C(1000000000) + tp.tv_nsec;
+}
+
+static void fuzz_src_callback(struct event_source *src, uint32_t revents)
+{
+    struct fuzz_src_stat *stat = NULL;
+    uint64_t start_ns;
+
+    for (int i = 0; i < fuzz_src_stat_count; i++)
+        if (fuzz_src_stats[i].src == src)
+            stat = &fuzz_src_stats[i];
+    BUG_ON(!stat);
+    start_ns = fuzz_real_now_ns(CLOCK_THREAD_CPUTIME_ID);
+    stat->callback(src, revents);
+    stat->cpu_ns += fuzz_real_now_ns(CLOCK_THREAD_CPUTIME_ID) - start_ns;
+    stat->call_count++;
+}
+
+void __real_event_loop_add(struct event_source *src);
+void __wrap_event_loop_add(struct event_source *src)
+{
+    struct fuzz_ctxt *ctxt = &g_fuzz_ctxt;
+    struct fuzz_src_stat *stat = NULL;
+
+    if (!ctxt->replay_stats || src->callback == fuzz_src_callback) {
+        __real_event_loop_add(src);
+        return;
+    }
+    for (int i = 0; i < fuzz_src_stat_count; i++)
+        if (fuzz_src_stats[i].src == src)
+            stat = &fuzz_src_stats[i];
+    if (!stat && fuzz_src_stat_count < ARRAY_SIZE(fuzz_src_stats)) {
+        stat = &fuzz_src_stats[fuzz_src_stat_count++];
+        stat->src = src;
+        stat->name = "other";
+        for (int i = 0; i < ARRAY_SIZE(fuzz_src_names); i++)
+            if ((uint8_t *)src == (uint8_t *)ctxt->wsbrd + fuzz_src_names[i].offset)
+                stat->name = fuzz_src_names[i].name;
+    }
+    if (stat) {
+        stat->callback = src->callback;
+        src->callback = fuzz_src_callback;
+    }
+    __real_event_loop_add(src);
+}
+
+static void fuzz_replay_stats_print(void)
+{
+    struct fuzz_ctxt *ctxt = &g_fuzz_ctxt;
+    uint64_t wall_ns = fuzz_real_now_ns(CLOCK_MONOTONIC) - fuzz_wall_start_ns;
+    uint64_t cpu_ns = fuzz_real_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t replay_ms = ctxt->replay_time_ms - ctxt->replay_start_time_ms;
+    uint64_t other_ns = cpu_ns;
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    INFO("replay: %"PRIu64" frames in %.3lfs (%.0lf frames/s), %.3lfs of capture replayed",
+         ctxt->replay_frame_count, wall_ns / 1e9,
+         wall_ns ? ctxt->replay_frame_count * 1e9 / wall_ns : 0.0, replay_ms / 1e3);
+    INFO("replay: cpu %.3lfs (user %ld.%03lds, sys %ld.%03lds), peak rss %ld KiB",
+         cpu_ns / 1e9, usage.ru_utime.tv_sec, usage.ru_utime.tv_usec / 1000,
+         usage.ru_stime.tv_sec, usage.ru_stime.tv_usec / 1000, usage.ru_maxrss);
+    for (int i = 0; i < fuzz_src_stat_count; i++) {
+        INFO("replay:   %-16s %9.3lfs %5.1lf%% %10"PRIu64" calls", fuzz_src_stats[i].name,
+             fuzz_src_stats[i].cpu_ns / 1e9, cpu_ns ? 100.0 * fuzz_src_stats[i].cpu_ns / cpu_ns : 0.0,
+             fuzz_src_stats[i].call_count);
+        other_ns -= MIN(other_ns, fuzz_src_stats[i].cpu_ns);
+    }
+    // Startup, RCP initialization, event loop, and other threads
+    INFO("replay:   %-16s %9.3lfs %5.1lf%%", "(outside sources)",
+         other_ns / 1e9, cpu_ns ? 100.0 * other_ns / cpu_ns : 0.0);
+}
+
+bool fuzz_replay_is_zstd(int fd)
+{
+    uint8_t magic[4];
+
+    return pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+           read_le32(magic) == FUZZ_ZSTD_MAGIC;
+}
+
+#ifdef HAVE_LIBZSTD
+struct fuzz_zstd_job {
+    int in_fd;
+    int out_fd;
+};
+
+ssize_t __real_read(int fd, void *buf, size_t buf_len);
+
+static void *fuzz_zstd_thread(void *arg)
+{
+    struct fuzz_zstd_job *job = arg;
+    size_t in_len = ZSTD_DStreamInSize();
+    size_t out_len = ZSTD_DStreamOutSize();
+    uint8_t *in_buf = xalloc(in_len);
+    uint8_t *out_buf = xalloc(out_len);
+    ZSTD_inBuffer in = { .src = in_buf };
+    ZSTD_outBuffer out;
+    ZSTD_DCtx *zstd;
+    ssize_t len;
+    size_t ret;
+
+    zstd = ZSTD_createDCtx();
+    FATAL_ON(!zstd, 2, "%s: ZSTD_createDCtx", __func__);
+    while ((len = __real_read(job->in_fd, in_buf, in_len)) > 0) {
+        in.size = len;
+        in.pos  = 0;
+        while (in.pos < in.size) {
+            out.dst  = out_buf;
+            out.size = out_len;
+            out.pos  = 0;
+            ret = ZSTD_decompressStream(zstd, &out, &in);
+            FATAL_ON(ZSTD_isError(ret), 1, "%s: %s", __func__, ZSTD_getErrorName(ret));
+            for (size_t i = 0; i < out.pos; i += len) {
+                len = __real_write(job->out_fd, out_buf + i, out.pos - i);
+                FATAL_ON(len < 0, 2, "%s: write: %m", __func__);
+            }
+        }
+    }
+    FATAL_ON(len < 0, 2, "%s: read: %m", __func__);
+    // A capture interrupted without exit() ends with an incomplete frame,
+    // the data up to its last flush point has been decompressed anyway.
+    ZSTD_freeDCtx(zstd);
+    close(job->in_fd);
+    close(job->out_fd);
+    free(in_buf);
+    free(out_buf);
+    free(job);
+    return NULL;
+}
+#endif
+
+static int fuzz_replay_open(int fd)
+{
+#ifdef HAVE_LIBZSTD
+    struct fuzz_zstd_job *job;
+    pthread_t thread;
+    int pipefd[2];
+    int ret;
+#endif
+
+    if (!fuzz_replay_is_zstd(fd))
+        return fd;
+#ifdef HAVE_LIBZSTD
+    ret = pipe2(pipefd, O_CLOEXEC);
+    FATAL_ON(ret < 0, 2, "%s: pipe2: %m", __func__);
+    job = zalloc(sizeof(*job));
+    job->in_fd = fd;
+    job->out_fd = pipefd[1];
+    ret = pthread_create(&thread, NULL, fuzz_zstd_thread, job);
+    FATAL_ON(ret, 2, "%s: pthread_create: %s", __func__, strerror(ret));
+    pthread_detach(thread);
+    return pipefd[0];
+#else
+    FATAL(1, "compressed capture: compiled without libzstd");
+#endif
+}
+
 void fuzz_trigger_timer(struct fuzz_ctxt *ctxt)
 {
     uint64_t val = 1;
@@ -56,11 +284,14 @@ void fuzz_ind_replay_timers(struct rcp *rcp, struct iobuf_read *buf)
     FATAL_ON(!ctxt->replay_count, 1, "timer command received while replay is disabled");
 
     ctxt->target_time_ms = hif_pop_u64(buf);
+    if (!ctxt->replay_start_time_ms)
+        ctxt->replay_start_time_ms = ctxt->target_time_ms;
     timer = timer_next();
     if (timer && timer->expire_ms < ctxt->target_time_ms)
         fuzz_trigger_timer(ctxt);
     else
         ctxt->replay_time_ms = ctxt->target_time_ms;
+    time_cache_refresh();
 }
 
 int __real_uart_open(const char *device, int bitrate, bool hardflow);
@@ -68,8 +299,12 @@ int __wrap_uart_open(const char *device, int bitrate, bool hardflow)
 {
     struct fuzz_ctxt *ctxt = &g_fuzz_ctxt;
 
+    if (ctxt->replay_stats) {
+        fuzz_wall_start_ns = fuzz_real_now_ns(CLOCK_MONOTONIC);
+        atexit(fuzz_replay_stats_print);
+    }
     if (ctxt->replay_count)
-        return ctxt->replay_fds[ctxt->replay_i++];
+        return fuzz_replay_open(ctxt->replay_fds[ctxt->replay_i++]);
     else
         return __real_uart_open(device, bitrate, hardflow);
 }
@@ -140,10 +375,15 @@ ssize_t __wrap_read(int fd, void *buf, size_t buf_len)
         } else {
             ctxt->replay_time_ms = ctxt->target_time_ms;
         }
+        time_cache_refresh();
     } else if (fd == ctxt->wsbrd->rcp.bus.fd && !ret && ctxt->replay_i < ctxt->replay_count) {
         // Read from the next replay file
-        ctxt->wsbrd->rcp.bus.fd = ctxt->replay_fds[ctxt->replay_i++];
+        ctxt->wsbrd->rcp.bus.fd = fuzz_replay_open(ctxt->replay_fds[ctxt->replay_i++]);
         ret = __real_read(ctxt->wsbrd->rcp.bus.fd, buf, buf_len);
+    } else if (fd == ctxt->wsbrd->rcp.bus.fd && !ret && ctxt->replay_stats) {
+        // End of the last replay file, the report is printed by atexit()
+        INFO("replay: end of capture");
+        exit(0);
     }
     return ret;
 }
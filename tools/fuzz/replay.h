@@ -14,6 +14,7 @@
 #ifndef FUZZ_REPLAY_H
 #define FUZZ_REPLAY_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct fuzz_ctxt;
@@ -23,5 +24,6 @@ struct wsbr_ctxt;
 
 void fuzz_ind_replay_timers(struct rcp *rcp, struct iobuf_read *buf);
 void fuzz_trigger_timer(struct fuzz_ctxt *ctxt);
+bool fuzz_replay_is_zstd(int fd);
 
 #endif
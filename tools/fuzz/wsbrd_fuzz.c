@@ -21,6 +21,7 @@
 #include "app_wsbrd/app/tun.h"
 #include "tools/fuzz/commandline.h"
 #include "tools/fuzz/interfaces.h"
+#include "tools/fuzz/checkpoint.h"
 #include "tools/fuzz/replay.h"
 #include "common/bus_uart.h"
 #include "common/capture.h"
@@ -38,6 +39,7 @@
 struct fuzz_ctxt g_fuzz_ctxt = {
     .wsbrd = &g_ctxt,
     .mbedtls_time = 1700000000, // Tue Nov 14 23:13:20 CET 2023
+    .replay_from_s = -1,
 };
 
 void __real_parse_commandline(struct wsbrd_conf *config, int argc, char *argv[], void (*print_help)(FILE *stream));
@@ -49,8 +51,14 @@ void __wrap_parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
 
     if (ctxt->fuzzing_enabled)
         ctxt->wsbrd->config.storage_delete = true;
-    if (ctxt->replay_count) {
+    // The UART wrappers expect the frames to be read by the main thread
+    if (ctxt->fuzzing_enabled || ctxt->replay_count)
+        ctxt->wsbrd->config.rcp_cfg.uart_thread = false;
+    if (ctxt->replay_from_s >= 0)
+        fuzz_replay_checkpoint(ctxt);
+    else if (ctxt->replay_count)
         WARN_ON(!ctxt->wsbrd->config.storage_delete, "storage_delete set to false while using replay");
+    if (ctxt->replay_count) {
         WARN_ON(!ctxt->wsbrd->config.tun_autoconf, "tun_autoconf set to false while using replay");
     }
 }
@@ -60,10 +68,14 @@ int __wrap_uart_rx(struct bus *bus, void *buf, unsigned int buf_len)
 {
     struct fuzz_ctxt *fuzz_ctxt = &g_fuzz_ctxt;
 
+    int ret;
+
     if (fuzz_ctxt->replay_count && fuzz_ctxt->replay_time_ms < fuzz_ctxt->target_time_ms)
         return 0;
-    else
-        return __real_uart_rx(bus, buf, buf_len);
+    ret = __real_uart_rx(bus, buf, buf_len);
+    if (ret > 0)
+        fuzz_ctxt->replay_frame_count++;
+    return ret;
 }
 
 bool __real_crc_check(uint16_t init, const uint8_t *data, int len, uint16_t expected_crc);
@@ -14,6 +14,7 @@
 #ifndef WSBRD_FUZZ_H
 #define WSBRD_FUZZ_H
 
+#include <linux/limits.h>
 #include <stdbool.h>
 #include <time.h>
 
@@ -37,6 +38,15 @@ struct fuzz_ctxt {
     struct fuzz_iface *iface_list;
     uint64_t replay_time_ms;
     uint64_t target_time_ms;
+
+    // --replay-from, see checkpoint.c
+    char replay_path[PATH_MAX]; // First replay file
+    int replay_from_s;          // -1 if unset
+
+    // --replay-stats, see replay.c
+    bool replay_stats;
+    uint64_t replay_frame_count;
+    uint64_t replay_start_time_ms; // Replayed time of the first frame
 };
 
 extern struct fuzz_ctxt g_fuzz_ctxt;
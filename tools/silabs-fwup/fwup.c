@@ -29,12 +29,21 @@
 #include "common/spinel.h"
 #include "common/iobuf.h"
 #include "common/memutils.h"
+#include "common/endian.h"
 #include "common/bits.h"
+#include "common/crc.h"
 
+#define FWUP_DEVICES_MAX 16
+
+// Silicon Labs UG266, 3.2 GBL file format
+#define GBL_TAG_ID_HEADER 0x03a617eb
+#define GBL_TAG_ID_END    0xfc0404fc
 
 struct commandline_args {
     int uart_baudrate;
-    char uart_device[PATH_MAX];
+    int btl_baudrate;
+    char uart_devices[FWUP_DEVICES_MAX][PATH_MAX];
+    int uart_device_count;
     char gbl_file_path[PATH_MAX];
 };
 
@@ -50,34 +59,49 @@ void print_help(FILE *stream, int exit_code)
     fprintf(stream, "silabs-fwup expects the device to have the \"bootloader-uart-xmodem\" component.\n");
     fprintf(stream, "Otherwise the update fails without affecting the device.\n");
     fprintf(stream, "\n");
+    fprintf(stream, "Several devices can be flashed concurrently by repeating -u.\n");
+    fprintf(stream, "\n");
     fprintf(stream, "Options:\n");
     fprintf(stream, "  -u, --uart=DEVICE  Use UART bus (default: /dev/ttyACM0)\n");
     fprintf(stream, "  -B, --baurate=RATE Configure UART with this baudrate (default: 115200)\n");
+    fprintf(stream, "  -b, --btl-baudrate=RATE\n");
+    fprintf(stream, "                     Baudrate of the bootloader, if it has been built with a\n");
+    fprintf(stream, "                     different one than the RCP (default: same as -B)\n");
     exit(exit_code);
 }
 
 void parse_commandline(struct commandline_args *cmd, int argc, char *argv[])
 {
     struct stat st;
-    const char *opts_short = "u:B:h";
+    const char *opts_short = "u:B:b:h";
     static const struct option opts_long[] = {
-            { "uart",     required_argument, 0,  'u' },
-            { "baudrate", required_argument, 0,  'B' },
-            { "help",     no_argument,       0,  'h' },
-            { 0,          0,                 0,   0  }
+            { "uart",         required_argument, 0,  'u' },
+            { "baudrate",     required_argument, 0,  'B' },
+            { "btl-baudrate", required_argument, 0,  'b' },
+            { "help",         no_argument,       0,  'h' },
+            { 0,              0,                 0,   0  }
     };
-    int opt, ret;
+    int opt, ret, i;
 
     cmd->uart_baudrate = 115200;
-    strcpy(cmd->uart_device, "/dev/ttyACM0");
     while ((opt = getopt_long(argc, argv, opts_short, opts_long, NULL)) != -1) {
         switch (opt) {
             case 'u':
-                strcpy(cmd->uart_device, optarg);
+                if (cmd->uart_device_count >= FWUP_DEVICES_MAX)
+                    FATAL(1, "too many devices (max %d)", FWUP_DEVICES_MAX);
+                if (strlen(optarg) >= PATH_MAX)
+                    FATAL(1, "argument too long: %s", optarg);
+                for (i = 0; i < cmd->uart_device_count; i++)
+                    if (!strcmp(cmd->uart_devices[i], optarg))
+                        FATAL(1, "duplicated device: %s", optarg);
+                strcpy(cmd->uart_devices[cmd->uart_device_count++], optarg);
                 break;
             case 'B':
                 cmd->uart_baudrate = strtol(optarg, NULL, 10);
                 break;
+            case 'b':
+                cmd->btl_baudrate = strtol(optarg, NULL, 10);
+                break;
             case 'h':
                 print_help(stdout, 0);
                 break;
@@ -88,6 +112,10 @@ void parse_commandline(struct commandline_args *cmd, int argc, char *argv[])
                 break;
         }
     }
+    if (!cmd->uart_device_count)
+        strcpy(cmd->uart_devices[cmd->uart_device_count++], "/dev/ttyACM0");
+    if (!cmd->btl_baudrate)
+        cmd->btl_baudrate = cmd->uart_baudrate;
     if (optind >= argc)
         FATAL(1, "expected argument: GBL_FILE");
     if (optind + 1 < argc)
@@ -177,7 +205,7 @@ static void handle_btl_run(struct bus *bus)
     write(bus->fd, &btl_run, sizeof(uint8_t));
 }
 
-static void handle_rcp_reset(struct bus *bus)
+static void handle_rcp_reset(struct bus *bus, const char *uart_device)
 {
     int cmd;
     const char *version_fw_str;
@@ -192,7 +220,7 @@ static void handle_rcp_reset(struct bus *bus)
     rx_buf.data_size = read_data(bus, buffer, sizeof(buffer),
                                  is_v2 ? uart_rx : uart_legacy_rx);
     if (!rx_buf.data_size) {
-        INFO("No RCP version received");
+        INFO("%s: no RCP version received", uart_device);
         return;
     }
 
@@ -219,7 +247,7 @@ static void handle_rcp_reset(struct bus *bus)
         version_fw_str = hif_pop_str(&rx_buf);
     }
 
-    INFO("Updated to RCP \"%s\" (%d.%d.%d), API %d.%d.%d", version_fw_str,
+    INFO("%s: updated to RCP \"%s\" (%d.%d.%d), API %d.%d.%d", uart_device, version_fw_str,
          FIELD_GET(0xFF000000, rcp_version_fw),
          FIELD_GET(0x00FFFF00, rcp_version_fw),
          FIELD_GET(0x000000FF, rcp_version_fw),
@@ -248,29 +276,61 @@ static void check_if_sx_is_installed()
         exit(EXIT_FAILURE);
 }
 
-int main(int argc, char **argv)
+// The Gecko Bootloader rejects an image with an invalid CRC, but only after
+// the transfer. Check it beforehand so a corrupted file fails immediately
+// without touching any device.
+static void check_gbl_file(const char *path)
 {
-    pid_t pid;
-    int ret, wstatus, sxfd;
-    struct commandline_args cmdline = { };
-    struct bus bus = { };
-    char *sx_args[] = { "sx", "-vv", cmdline.gbl_file_path, NULL };
+    uint8_t *buf;
+    struct stat st;
+    size_t len;
+    FILE *fp;
 
-    parse_commandline(&cmdline, argc, argv);
-    check_if_sx_is_installed();
+    fp = fopen(path, "r");
+    FATAL_ON(!fp, 1, "fopen %s: %m", path);
+    FATAL_ON(fstat(fileno(fp), &st) < 0, 2, "fstat %s: %m", path);
+    len = st.st_size;
+    if (len < 24)
+        FATAL(1, "%s: file too short", path);
+    buf = xalloc(len);
+    if (fread(buf, 1, len, fp) != len)
+        FATAL(1, "fread %s: %m", path);
+    fclose(fp);
+
+    if (read_le32(buf) != GBL_TAG_ID_HEADER)
+        FATAL(1, "%s: not a GBL file", path);
+    if (read_le32(buf + len - 12) != GBL_TAG_ID_END || read_le32(buf + len - 8) != 4)
+        FATAL(1, "%s: missing GBL end tag", path);
+    if ((crc32(0xffffffff, buf, len - 4) ^ 0xffffffff) != read_le32(buf + len - 4))
+        FATAL(1, "%s: invalid GBL CRC", path);
+    free(buf);
+}
+
+static void fwup_device(const struct commandline_args *cmdline, const char *uart_device, bool verbose)
+{
+    char *sx_args[] = { "sx", verbose ? "-vv" : "-q", (char *)cmdline->gbl_file_path, NULL };
+    struct bus bus = { };
+    int ret, wstatus, sxfd;
+    pid_t pid;
 
-    bus.fd = uart_open(cmdline.uart_device, cmdline.uart_baudrate, false);
-    FATAL_ON(bus.fd < 0, 2, "%s: %m", cmdline.uart_device);
+    bus.fd = uart_open(uart_device, cmdline->uart_baudrate, false);
+    FATAL_ON(bus.fd < 0, 2, "%s: %m", uart_device);
     send_btl_update(&bus);
+    if (cmdline->btl_baudrate != cmdline->uart_baudrate) {
+        close(bus.fd);
+        bus.fd = uart_open(uart_device, cmdline->btl_baudrate, false);
+    }
     handle_btl_update(&bus);
     close(bus.fd);
 
+    // sx inherits the termios configuration (and thus the baudrate) set
+    // by uart_open()
     pid = fork();
     if (pid > 0) {
         waitpid(pid, &wstatus, 0);
     } else if (pid == 0) {
-        sxfd = open(cmdline.uart_device, O_RDWR);
-        FATAL_ON(sxfd == -1, 2, "open %s: %m", cmdline.uart_device);
+        sxfd = open(uart_device, O_RDWR);
+        FATAL_ON(sxfd == -1, 2, "open %s: %m", uart_device);
         ret = dup2(sxfd, STDIN_FILENO);
         FATAL_ON(ret == -1, 2, "dup2: %m");
         ret = dup2(sxfd, STDOUT_FILENO);
@@ -284,13 +344,59 @@ int main(int argc, char **argv)
     }
 
     if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
-        FATAL(1, "xmodem transfer failed");
+        FATAL(1, "%s: xmodem transfer failed", uart_device);
 
-    bus.fd = uart_open(cmdline.uart_device, cmdline.uart_baudrate, false);
-    FATAL_ON(bus.fd < 0, 2, "%s: %m", cmdline.uart_device);
+    bus.fd = uart_open(uart_device, cmdline->btl_baudrate, false);
+    FATAL_ON(bus.fd < 0, 2, "%s: %m", uart_device);
     handle_btl_run(&bus);
-    handle_rcp_reset(&bus);
+    if (cmdline->btl_baudrate != cmdline->uart_baudrate) {
+        ret = tcdrain(bus.fd);
+        FATAL_ON(ret < 0, 2, "tcdrain: %m");
+        close(bus.fd);
+        bus.fd = uart_open(uart_device, cmdline->uart_baudrate, false);
+    }
+    handle_rcp_reset(&bus, uart_device);
     close(bus.fd);
+}
+
+int main(int argc, char **argv)
+{
+    struct commandline_args cmdline = { };
+    pid_t pids[FWUP_DEVICES_MAX];
+    int wstatus, failed = 0;
+    pid_t pid;
+    int i;
 
+    parse_commandline(&cmdline, argc, argv);
+    check_if_sx_is_installed();
+    check_gbl_file(cmdline.gbl_file_path);
+
+    if (cmdline.uart_device_count == 1) {
+        fwup_device(&cmdline, cmdline.uart_devices[0], true);
+        return 0;
+    }
+
+    // Each device is handled by its own process since the UART exchanges
+    // are blocking, and errors are reported with FATAL().
+    for (i = 0; i < cmdline.uart_device_count; i++) {
+        pids[i] = fork();
+        FATAL_ON(pids[i] < 0, 2, "fork: %m");
+        if (!pids[i]) {
+            fwup_device(&cmdline, cmdline.uart_devices[i], false);
+            exit(EXIT_SUCCESS);
+        }
+        INFO("%s: update started", cmdline.uart_devices[i]);
+    }
+    for (i = 0; i < cmdline.uart_device_count; i++) {
+        pid = waitpid(pids[i], &wstatus, 0);
+        FATAL_ON(pid < 0, 2, "waitpid: %m");
+        if (WIFEXITED(wstatus) && !WEXITSTATUS(wstatus))
+            continue;
+        WARN("%s: update failed", cmdline.uart_devices[i]);
+        failed++;
+    }
+    if (failed)
+        FATAL(1, "%d/%d devices failed to update", failed, cmdline.uart_device_count);
+    INFO("%d devices updated", cmdline.uart_device_count);
     return 0;
 }
@@ -12,6 +12,7 @@
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <poll.h>
@@ -35,6 +36,12 @@ enum {
   MODE_RX = 2,
 };
 
+enum {
+  OUTPUT_TEXT,
+  OUTPUT_CSV,
+  OUTPUT_JSON,
+};
+
 static const struct name_value accepted_modes[] = {
     { "tx",   MODE_TX },
     { "rx",   MODE_RX },
@@ -42,6 +49,13 @@ static const struct name_value accepted_modes[] = {
     { NULL,  -1 },
 };
 
+static const struct name_value accepted_outputs[] = {
+    { "text", OUTPUT_TEXT },
+    { "csv",  OUTPUT_CSV },
+    { "json", OUTPUT_JSON },
+    { NULL,  -1 },
+};
+
 const struct name_value valid_traces[] = {
     { "bus",       TR_BUS },
     { "cpc",       TR_CPC },
@@ -56,8 +70,12 @@ struct commandline_args {
     char uart_device[256];
     int uart_baudrate;
     int payload_size;
+    int sweep_min;
+    int sweep_max;
+    int sweep_step;
     int number_of_exchanges;
     int window;
+    int output;
     bool reset;
     bool quiet;
     bool verbose;
@@ -78,9 +96,14 @@ void print_help(FILE *stream, int exit_code)
     fprintf(stream, "  -C, --cpc=CPC_INSTANCE Use CPC instance (ie. cpcd_0)\n");
     fprintf(stream, "  -B, --baurate=VAL      Configure UART with this baudrate (default: 115200)\n");
     fprintf(stream, "  -s, --size=SIZE        Size of the payload in frames (default: 512)\n");
+    fprintf(stream, "  -S, --sweep=MIN:MAX[:STEP]\n");
+    fprintf(stream, "                         Run the measurement for each payload size from MIN to\n");
+    fprintf(stream, "                         MAX (default STEP: 64). Overrides --size\n");
     fprintf(stream, "  -c, --count=NUM        Number of frames to send/receive (default: 100)\n");
     fprintf(stream, "  -w, --window=NUM       Send NUM requests ahead of the replies. These frames\n");
-    fprintf(stream, "                         are not accounted in results (default: auto)\n");
+    fprintf(stream, "                         are not accounted in throughput (default: auto)\n");
+    fprintf(stream, "  -o, --output=FORMAT    Report results as text, csv or json (default: text).\n");
+    fprintf(stream, "                         With csv and json, logs are sent to stderr\n");
     fprintf(stream, "  -r, --reset            Reset the RCP before measurement\n");
     fprintf(stream, "  -q, --quiet            Do not show progress\n");
     fprintf(stream, "  -v, --verbose          Show intermediate results\n");
@@ -92,14 +115,16 @@ void print_help(FILE *stream, int exit_code)
 
 void parse_commandline(struct commandline_args *cmd, int argc, char *argv[])
 {
-    const char *opts_short = "u:C:B:s:c:w:rT:qvhl";
+    const char *opts_short = "u:C:B:s:S:c:w:o:rT:qvhl";
     static const struct option opts_long[] = {
         { "uart",     required_argument, 0,  'u' },
         { "cpc",      required_argument, 0,  'C' },
         { "baudrate", required_argument, 0,  'B' },
         { "size",     required_argument, 0,  's' },
+        { "sweep",    required_argument, 0,  'S' },
         { "count",    required_argument, 0,  'c' },
         { "window",   required_argument, 0,  'w' },
+        { "output",   required_argument, 0,  'o' },
         { "trace",    required_argument, 0,  'T' },
         { "reset",    no_argument,       0,  'r' },
         { "quiet",    no_argument,       0,  'q' },
@@ -112,6 +137,7 @@ void parse_commandline(struct commandline_args *cmd, int argc, char *argv[])
 
     cmd->window = -1;
     cmd->payload_size = 515;
+    cmd->sweep_step = 64;
     cmd->number_of_exchanges = 100;
     cmd->uart_baudrate = 115200;
     strcpy(cmd->uart_device, "/dev/ttyACM0");
@@ -129,12 +155,21 @@ void parse_commandline(struct commandline_args *cmd, int argc, char *argv[])
             case 's':
                 cmd->payload_size = strtol(optarg, NULL, 10);
                 break;
+            case 'S':
+                if (sscanf(optarg, "%d:%d:%d", &cmd->sweep_min, &cmd->sweep_max, &cmd->sweep_step) < 2)
+                    FATAL(1, "invalid sweep: %s", optarg);
+                FATAL_ON(cmd->sweep_min > cmd->sweep_max, 1, "invalid sweep: %s", optarg);
+                FATAL_ON(cmd->sweep_step <= 0, 1, "invalid sweep step: %s", optarg);
+                break;
             case 'c':
                 cmd->number_of_exchanges = strtol(optarg, NULL, 10);
                 break;
             case 'w':
                 cmd->window = strtol(optarg, NULL, 10);
                 break;
+            case 'o':
+                cmd->output = str_to_val(optarg, accepted_outputs);
+                break;
             case 'r':
                 cmd->reset = true;
                 WARN("-r is not yet supported");
@@ -166,20 +201,65 @@ void parse_commandline(struct commandline_args *cmd, int argc, char *argv[])
     if (optind + 1 < argc)
         FATAL(1, "unexpected argument: %s", argv[optind + 1]);
     cmd->mode = str_to_val(argv[optind], accepted_modes);
-    if (cmd->window < 0) {
-        cmd->window = 2;
-        if (cmd->payload_size < 256)
-            cmd->window = 10;
-        if (cmd->payload_size < 64)
-            cmd->window = 20;
-        if (cmd->payload_size < 32)
-            cmd->window = 40;
-        INFO("window size: %d", cmd->window);
+    if (!cmd->sweep_max) {
+        cmd->sweep_min = cmd->payload_size;
+        cmd->sweep_max = cmd->payload_size;
     }
-    if (cmd->payload_size * cmd->window >= 4096)
+    FATAL_ON(cmd->sweep_min < 9, 2, "payload size must > 8");
+    if (cmd->output != OUTPUT_TEXT) {
+        // Keep stdout parsable
+        g_trace_stream = stderr;
+        cmd->quiet = true;
+    }
+}
+
+static int get_window(struct commandline_args *cmdline, int size)
+{
+    int window = cmdline->window;
+
+    if (window < 0) {
+        window = 2;
+        if (size < 256)
+            window = 10;
+        if (size < 64)
+            window = 20;
+        if (size < 32)
+            window = 40;
+        INFO("window size: %d", window);
+    }
+    if (size * window >= 4096)
         WARN("huge window is selected");
-    cmd->payload_size -= 9;
-    FATAL_ON(cmd->payload_size < 0, 2, "payload size must > 8");
+    return window;
+}
+
+struct bench {
+    // Date of the last ping request sent with a given counter
+    uint64_t tx_date_ns[UINT16_MAX + 1];
+    uint64_t *rtt_ns;
+    int rtt_count;
+    int rtt_size;
+};
+
+struct bench_result {
+    int size;
+    int window;
+    double duration_s;
+    double frames_per_s;
+    double bytes_per_s;
+    double rtt_mean_us;
+    double rtt_min_us;
+    double rtt_p50_us;
+    double rtt_p90_us;
+    double rtt_p99_us;
+    double rtt_max_us;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
 }
 
 static uint8_t get_spinel_hdr(struct bus *bus)
@@ -212,7 +292,8 @@ static void send_data(struct bus *bus, struct commandline_args *cmdline,
               tr_bytes(buf + 1, buf_len - 1, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
 }
 
-static void send_ping(struct bus *bus, struct commandline_args *cmdline, uint16_t counter, bool is_v2)
+static void send_ping(struct bus *bus, struct commandline_args *cmdline, struct bench *bench,
+                      uint16_t counter, bool is_v2)
 {
     struct iobuf_write tx_buf = { };
     uint8_t payload_buf[cmdline->payload_size];
@@ -232,6 +313,7 @@ static void send_ping(struct bus *bus, struct commandline_args *cmdline, uint16_
     else
         hif_push_data(&tx_buf, payload_buf, (cmdline->mode & MODE_RX) ? cmdline->payload_size : 0);
 
+    bench->tx_date_ns[counter] = now_ns();
     send_data(bus, cmdline, tx_buf.data, tx_buf.len, is_v2);
     iobuf_free(&tx_buf);
 }
@@ -289,7 +371,8 @@ static void rcp_ind_fatal(struct iobuf_read *buf, bool ignore_crc)
         FATAL(3, "rcp error %s", hif_fatal_str(err_code));
 }
 
-static int receive_ping(struct bus *bus, struct commandline_args *cmdline, uint16_t counter, bool is_v2)
+static int receive_ping(struct bus *bus, struct commandline_args *cmdline, struct bench *bench,
+                        uint16_t counter, bool is_v2)
 {
     const uint8_t *payload;
     int expected_payload, val;
@@ -327,6 +410,8 @@ static int receive_ping(struct bus *bus, struct commandline_args *cmdline, uint1
     if (val != counter)
         WARN("sent ping request %d and received reply %d", counter, val);
     counter = val;
+    if (bench->rtt_count < bench->rtt_size)
+        bench->rtt_ns[bench->rtt_count++] = now_ns() - bench->tx_date_ns[counter];
 
     if (!is_v2) {
         val = hif_pop_u16(&rx_buf);
@@ -347,17 +432,6 @@ static int receive_ping(struct bus *bus, struct commandline_args *cmdline, uint1
     return counter + 1;
 }
 
-static void diff_timespec(struct timespec *ts_start, struct timespec *ts_end, struct timespec *ts_result)
-{
-    if ((ts_end->tv_nsec - ts_start->tv_nsec) < 0) {
-        ts_result->tv_sec = ts_end->tv_sec - ts_start->tv_sec - 1;
-        ts_result->tv_nsec = ts_end->tv_nsec - ts_start->tv_nsec + 1000000000;
-    } else {
-        ts_result->tv_sec = ts_end->tv_sec - ts_start->tv_sec;
-        ts_result->tv_nsec = ts_end->tv_nsec - ts_start->tv_nsec;
-    }
-}
-
 static void print_progress(struct commandline_args *cmdline, int out, int in)
 {
     static const char progress[] = { '-', '\\', '|', '/' };
@@ -373,26 +447,97 @@ static void print_progress(struct commandline_args *cmdline, int out, int in)
     fflush(stdout);
 }
 
-static void print_throughput(struct timespec *ts, struct commandline_args *cmdline, bool is_v2)
+static int cmp_u64(const void *a, const void *b)
+{
+    const uint64_t *va = a, *vb = b;
+
+    return (*va > *vb) - (*va < *vb);
+}
+
+// Nearest-rank percentile of a sorted array, in microseconds
+static double percentile_us(const uint64_t *sorted, int count, int percent)
+{
+    int rank = (count * percent + 99) / 100;
+
+    if (!count)
+        return 0;
+    return sorted[rank ? rank - 1 : 0] / 1000.;
+}
+
+static void compute_result(struct bench_result *res, struct bench *bench,
+                           struct commandline_args *cmdline, uint64_t duration_ns, bool is_v2)
 {
-    double real_exchanges_count = cmdline->number_of_exchanges;
-    double real_time = ts->tv_sec + ts->tv_nsec / 1000000000.;
     double real_payload;
+    uint64_t sum = 0;
 
-    if (!is_v2) {
+    if (!is_v2)
         // 1 hdr + 1 cmd + 2 cnt + 2 reply size + 2 crc + 1 term
         real_payload = cmdline->payload_size + 9;
-        if (cmdline->cpc_instance[0])
-            WARN("throughput bias due to CPC encoding");
-        else
-            WARN("throughput bias due to HDLC byte escaping");
-    } else {
+    else
         // 2 len + 2 fcs + 1 cmd + 2 cnt + 2 reply size + 2 fcs
         real_payload = cmdline->payload_size + 11;
-    }
 
-    INFO("throughput: %.0lf bytes/sec", real_payload * real_exchanges_count / real_time);
-    INFO("equivalent baudrate: %.0lf bits/sec", 10 * real_payload * real_exchanges_count / real_time);
+    res->duration_s = duration_ns / 1000000000.;
+    res->frames_per_s = cmdline->number_of_exchanges / res->duration_s;
+    res->bytes_per_s  = real_payload * res->frames_per_s;
+
+    qsort(bench->rtt_ns, bench->rtt_count, sizeof(bench->rtt_ns[0]), cmp_u64);
+    for (int i = 0; i < bench->rtt_count; i++)
+        sum += bench->rtt_ns[i];
+    res->rtt_mean_us = bench->rtt_count ? sum / 1000. / bench->rtt_count : 0;
+    res->rtt_min_us  = percentile_us(bench->rtt_ns, bench->rtt_count, 0);
+    res->rtt_p50_us  = percentile_us(bench->rtt_ns, bench->rtt_count, 50);
+    res->rtt_p90_us  = percentile_us(bench->rtt_ns, bench->rtt_count, 90);
+    res->rtt_p99_us  = percentile_us(bench->rtt_ns, bench->rtt_count, 99);
+    res->rtt_max_us  = percentile_us(bench->rtt_ns, bench->rtt_count, 100);
+}
+
+static void print_result(struct bench_result *res, struct commandline_args *cmdline,
+                         bool is_v2, bool first)
+{
+    switch (cmdline->output) {
+    case OUTPUT_TEXT:
+        if (!is_v2) {
+            if (cmdline->cpc_instance[0])
+                WARN("throughput bias due to CPC encoding");
+            else
+                WARN("throughput bias due to HDLC byte escaping");
+        }
+        if (cmdline->sweep_min != cmdline->sweep_max)
+            INFO("payload size: %d bytes (window %d)", res->size, res->window);
+        INFO("throughput: %.0lf bytes/sec", res->bytes_per_s);
+        INFO("equivalent baudrate: %.0lf bits/sec", 10 * res->bytes_per_s);
+        INFO("frame rate: %.0lf frames/sec", res->frames_per_s);
+        INFO("round-trip latency: min %.0lfus, mean %.0lfus, p50 %.0lfus, p90 %.0lfus, p99 %.0lfus, max %.0lfus",
+             res->rtt_min_us, res->rtt_mean_us, res->rtt_p50_us, res->rtt_p90_us, res->rtt_p99_us, res->rtt_max_us);
+        break;
+    case OUTPUT_CSV:
+        if (first)
+            printf("size,window,count,duration_s,frames_per_s,bytes_per_s,"
+                   "rtt_min_us,rtt_mean_us,rtt_p50_us,rtt_p90_us,rtt_p99_us,rtt_max_us\n");
+        printf("%d,%d,%d,%.6lf,%.1lf,%.1lf,%.1lf,%.1lf,%.1lf,%.1lf,%.1lf,%.1lf\n",
+               res->size, res->window, cmdline->number_of_exchanges, res->duration_s,
+               res->frames_per_s, res->bytes_per_s,
+               res->rtt_min_us, res->rtt_mean_us, res->rtt_p50_us, res->rtt_p90_us, res->rtt_p99_us, res->rtt_max_us);
+        break;
+    case OUTPUT_JSON:
+        printf("%s\n  {\n", first ? "[" : ",");
+        printf("    \"bus\": \"%s\",\n", cmdline->cpc_instance[0] ? "cpc" : "uart");
+        if (!cmdline->cpc_instance[0])
+            printf("    \"baudrate\": %d,\n", cmdline->uart_baudrate);
+        printf("    \"mode\": \"%s\",\n", val_to_str(cmdline->mode, accepted_modes, "unknown"));
+        printf("    \"size\": %d,\n", res->size);
+        printf("    \"window\": %d,\n", res->window);
+        printf("    \"count\": %d,\n", cmdline->number_of_exchanges);
+        printf("    \"duration_s\": %.6lf,\n", res->duration_s);
+        printf("    \"frames_per_s\": %.1lf,\n", res->frames_per_s);
+        printf("    \"bytes_per_s\": %.1lf,\n", res->bytes_per_s);
+        printf("    \"rtt_us\": { \"min\": %.1lf, \"mean\": %.1lf, \"p50\": %.1lf, \"p90\": %.1lf, \"p99\": %.1lf, \"max\": %.1lf }\n",
+               res->rtt_min_us, res->rtt_mean_us, res->rtt_p50_us, res->rtt_p90_us, res->rtt_p99_us, res->rtt_max_us);
+        printf("  }");
+        break;
+    }
+    fflush(stdout);
 }
 
 static void wait_reset(struct bus *bus, struct commandline_args *cmdline, bool is_v2)
@@ -476,13 +621,44 @@ static void sighandler(int signum)
     exit(EXIT_SUCCESS);
 }
 
+static void run_bench(struct bus *bus, struct commandline_args *cmdline, struct bench *bench,
+                      struct bench_result *res, bool is_v2)
+{
+    int in_cnt, out_cnt;
+    uint64_t start_ns;
+
+    bench->rtt_count = 0;
+    out_cnt = 0;
+    in_cnt = 0;
+    while (out_cnt < res->window) {
+        send_ping(bus, cmdline, bench, out_cnt, is_v2);
+        print_progress(cmdline, out_cnt, in_cnt);
+        out_cnt++;
+    }
+    start_ns = now_ns();
+    while (out_cnt < cmdline->number_of_exchanges + res->window) {
+        while (out_cnt <= in_cnt + res->window) {
+            send_ping(bus, cmdline, bench, out_cnt, is_v2);
+            print_progress(cmdline, out_cnt, in_cnt);
+            out_cnt++;
+        }
+        in_cnt = receive_ping(bus, cmdline, bench, in_cnt, is_v2);
+    }
+    start_ns = now_ns() - start_ns;
+    while (in_cnt < out_cnt) {
+        in_cnt = receive_ping(bus, cmdline, bench, in_cnt, is_v2);
+        print_progress(cmdline, out_cnt, in_cnt);
+    }
+    compute_result(res, bench, cmdline, start_ns, is_v2);
+}
+
 int main(int argc, char **argv)
 {
     const struct sigaction sigact = { .sa_handler = sighandler };
-    struct timespec ts_start, ts_end, ts_res;
     struct commandline_args cmdline = { };
+    struct bench_result res;
+    struct bench *bench;
     struct bus bus = { };
-    int in_cnt, out_cnt;
     bool is_v2;
 
     sighandler_data = &bus;
@@ -497,30 +673,21 @@ int main(int argc, char **argv)
     FATAL_ON(bus.fd < 0, 2, "Cannot open device: %m");
     is_v2 = detect_v2(&bus, &cmdline);
 
-    out_cnt = 0;
-    in_cnt = 0;
-    while (out_cnt < cmdline.window) {
-        send_ping(&bus, &cmdline, out_cnt, is_v2);
-        print_progress(&cmdline, out_cnt, in_cnt);
-        out_cnt++;
+    bench = zalloc(sizeof(*bench));
+    for (int size = cmdline.sweep_min; size <= cmdline.sweep_max; size += cmdline.sweep_step) {
+        memset(&res, 0, sizeof(res));
+        res.size = size;
+        res.window = get_window(&cmdline, size);
+        cmdline.payload_size = size - 9;
+        bench->rtt_size = cmdline.number_of_exchanges + res.window;
+        bench->rtt_ns = xalloc(bench->rtt_size * sizeof(bench->rtt_ns[0]));
+        run_bench(&bus, &cmdline, bench, &res, is_v2);
+        print_result(&res, &cmdline, is_v2, size == cmdline.sweep_min);
+        free(bench->rtt_ns);
     }
-    clock_gettime(CLOCK_REALTIME, &ts_start);
-    while (out_cnt < cmdline.number_of_exchanges + cmdline.window) {
-        while (out_cnt <= in_cnt + cmdline.window) {
-            send_ping(&bus, &cmdline, out_cnt, is_v2);
-            print_progress(&cmdline, out_cnt, in_cnt);
-            out_cnt++;
-        }
-        in_cnt = receive_ping(&bus, &cmdline, in_cnt, is_v2);
-    }
-    clock_gettime(CLOCK_REALTIME, &ts_end);
-    while (in_cnt < out_cnt) {
-        in_cnt = receive_ping(&bus, &cmdline, in_cnt, is_v2);
-        print_progress(&cmdline, out_cnt, in_cnt);
-    }
-
-    diff_timespec(&ts_start, &ts_end, &ts_res);
-    print_throughput(&ts_res, &cmdline, is_v2);
+    if (cmdline.output == OUTPUT_JSON)
+        printf("\n]\n");
+    free(bench);
 
     return 0;
 }
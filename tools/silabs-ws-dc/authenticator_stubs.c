@@ -26,6 +26,7 @@
 
 struct tls_client_ctx;
 struct tls_ctx;
+struct work_pool;
 
 void auth_eap_recv(struct auth_ctx *auth, struct auth_supp_ctx *supp, const void *buf, size_t buf_len)
 {
@@ -43,7 +44,12 @@ void radius_send(struct auth_ctx *auth, struct auth_supp_ctx *supp,
     BUG();
 }
 
-void radius_init(struct auth_ctx *auth, const struct sockaddr *sa)
+void radius_rt_timeout(struct auth_ctx *auth, struct auth_supp_ctx *supp)
+{
+    BUG();
+}
+
+void radius_init(struct auth_ctx *auth)
 {
 }
 
@@ -56,6 +62,23 @@ void tls_init_client(struct tls_ctx *tls, struct tls_client_ctx *tls_client)
 {
 }
 
+void tls_session_cache_init(struct tls_ctx *tls, int max)
+{
+}
+
+void tls_session_cache_load(struct tls_ctx *tls)
+{
+}
+
+void tls_session_del(struct tls_ctx *tls, const uint8_t eui64[8])
+{
+}
+
+void work_pool_init(struct work_pool *pool, int thread_count)
+{
+    BUG();
+}
+
 void eapol_relay_send(int fd, const void *buf, size_t buf_len,
                       const struct in6_addr *dst,
                       const struct eui64 *supp_eui64, uint8_t kmp_id)
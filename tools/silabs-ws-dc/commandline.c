@@ -44,6 +44,15 @@ static const struct number_limit valid_uc_dwell_interval = {
     15, 255
 };
 
+/*
+ * The IPv6 packet is sent in a single 15.4 frame. Once compressed by 6LoWPAN,
+ * it must leave room in MAC_IEEE_802_15_4G_MAX_PHY_PACKET_SIZE for the MAC
+ * header, the IEs, the MIC and the FCS.
+ */
+static const struct number_limit valid_bulk_mtu = {
+    1280, 1800
+};
+
 static void print_help(FILE *stream) {
     fprintf(stream, "\n");
     fprintf(stream, "Start Wi-SUN Direct Connect Daemon\n");
@@ -61,6 +70,7 @@ static void print_help(FILE *stream) {
     fprintf(stream, "                          on config file\n");
     fprintf(stream, "  -o, --opt=PARM=VAL    Assign VAL to the parameter PARM. PARM can be any parameter accepted\n");
     fprintf(stream, "                          in the config file\n");
+    fprintf(stream, "  -b, --bulk            Enable bulk transfer mode (see \"bulk\" in the config file)\n");
     fprintf(stream, "  -l, --list-rf-configs Retrieve the possible RF configurations from the RCP then exit. Most\n");
     fprintf(stream, "                          of parameters are ignored in this mode\n");
     fprintf(stream, "  -v, --version         Print version and exit\n");
@@ -93,15 +103,20 @@ void parse_commandline(struct dc_cfg *config, int argc, char *argv[])
         { "target_pmk",                    &config->target_pmk,                       conf_set_array,       (void *)sizeof(config->target_pmk) },
         { "disc_period_s",                 &config->disc_period_s,                    conf_set_number,      &valid_positive },
         { "disc_count_max",                &config->disc_count_max,                   conf_set_number,      &valid_positive },
+        { "bulk",                          &config->bulk,                             conf_set_bool,        NULL },
+        { "bulk_mtu",                      &config->bulk_mtu,                         conf_set_number,      &valid_bulk_mtu },
+        { "bulk_edfe",                     &config->bulk_edfe,                        conf_set_bool,        NULL },
+        { "bulk_report_period_s",          &config->bulk_report_period_s,             conf_set_number,      &valid_positive },
         { "trace",                         &g_enabled_traces,                         conf_add_flags,       &valid_traces },
         { "color_output",                  &config->color_output,                     conf_set_enum,        &valid_tristate },
         { }
     };
-    static const char *opts_short = "F:o:u:T:lhv";
+    static const char *opts_short = "F:o:u:T:blhv";
     static const struct option opts_long[] = {
         { "config",      required_argument, 0,  'F' },
         { "opt",         required_argument, 0,  'o' },
         { "trace",       required_argument, 0,  'T' },
+        { "bulk",        no_argument,       0,  'b' },
         { "list-rf-configs", no_argument,   0,  'l' },
         { "help",        no_argument,       0,  'h' },
         { "version",     no_argument,       0,  'v' },
@@ -150,6 +165,9 @@ void parse_commandline(struct dc_cfg *config, int argc, char *argv[])
                 strcpy(info.key, "trace");
                 conf_add_flags(&info, &g_enabled_traces, valid_traces);
                 break;
+            case 'b':
+                config->bulk = true;
+                break;
             case 'l':
                 config->list_rf_configs = true;
                 break;
@@ -204,4 +222,6 @@ void parse_commandline(struct dc_cfg *config, int argc, char *argv[])
         FATAL(1, "missing \"target_eui64\" parameter");
     if (!memzcmp(config->target_pmk, sizeof(config->target_pmk)))
         FATAL(1, "missing \"target_pmk\" parameter");
+    if (config->bulk && config->ws_uc_dwell_interval_ms < valid_uc_dwell_interval.max)
+        WARN("short \"unicast_dwell_interval\" reduces bulk transfer throughput");
 }
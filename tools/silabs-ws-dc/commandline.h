@@ -45,6 +45,11 @@ struct dc_cfg {
     int disc_period_s;
     int disc_count_max;
 
+    bool bulk;
+    int  bulk_mtu;
+    bool bulk_edfe;
+    int  bulk_report_period_s;
+
     bool list_rf_configs;
     int  color_output;
 };
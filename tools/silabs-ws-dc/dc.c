@@ -11,7 +11,7 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
-#include <poll.h>
+#include <inttypes.h>
 
 #include "common/crypto/ws_keys.h"
 #include "common/ipv6/ipv6_addr.h"
@@ -19,6 +19,7 @@
 #include "common/drop_privileges.h"
 #include "common/string_extra.h"
 #include "common/rail_config.h"
+#include "common/time_extra.h"
 #include "common/memutils.h"
 #include "common/version.h"
 #include "common/sl_ws.h"
@@ -38,12 +39,6 @@
 
 #define DC_KEY_INDEX 8
 
-enum {
-    POLLFD_RCP,
-    POLLFD_TIMER,
-    POLLFD_TUN,
-    POLLFD_COUNT,
-};
 
 static void dc_on_rcp_reset(struct rcp *rcp)
 {
@@ -60,6 +55,36 @@ static void dc_on_rcp_reset(struct rcp *rcp)
         FATAL(3, "RCP API < 2.5.0 (too old)");
 }
 
+static void dc_bulk_stats_add(struct dc_bulk_stats *dst, const struct dc_bulk_stats *src)
+{
+    dst->tx_bytes += src->tx_bytes;
+    dst->tx_pkts  += src->tx_pkts;
+    dst->tx_fail  += src->tx_fail;
+    dst->rx_bytes += src->rx_bytes;
+    dst->rx_pkts  += src->rx_pkts;
+}
+
+static void dc_on_bulk_timer_timeout(struct timer_group *group, struct timer_entry *timer)
+{
+    struct dc *dc = container_of(timer, struct dc, bulk_timer);
+    const struct dc_bulk_stats *cur = &dc->bulk_period;
+    const struct dc_bulk_stats *tot = &dc->bulk_total;
+    uint64_t elapsed_ms;
+
+    dc_bulk_stats_add(&dc->bulk_total, &dc->bulk_period);
+    elapsed_ms = time_now_ms(CLOCK_MONOTONIC) - dc->bulk_start_ms;
+    if (cur->tx_pkts || cur->rx_pkts)
+        INFO("bulk: tx %.1fkbit/s (%u pkts, %u lost) rx %.1fkbit/s (%u pkts)%s",
+             cur->tx_bytes * 8.0 / timer->period_ms, cur->tx_pkts, cur->tx_fail,
+             cur->rx_bytes * 8.0 / timer->period_ms, cur->rx_pkts,
+             dc->ws.edfe ? " edfe" : "");
+    if (elapsed_ms && (cur->tx_pkts || cur->rx_pkts))
+        INFO("bulk: total tx %"PRIu64"B rx %"PRIu64"B in %"PRIu64"s, avg %.1fkbit/s",
+             tot->tx_bytes, tot->rx_bytes, elapsed_ms / 1000,
+             (tot->tx_bytes + tot->rx_bytes) * 8.0 / elapsed_ms);
+    memset(&dc->bulk_period, 0, sizeof(dc->bulk_period));
+}
+
 static void dc_on_disc_timer_timeout(struct timer_group *group, struct timer_entry *timer)
 {
     struct dc *dc = container_of(timer, struct dc, disc_timer);
@@ -104,6 +129,7 @@ static void dc_on_neigh_del(struct ws_neigh_table *table, struct ws_neigh *neigh
     dc_remove_target_route(dc);
     dc->ws.gak_index = 0;
     timer_stop(NULL, &dc->probe_timer);
+    timer_stop(NULL, &dc->bulk_timer);
 }
 
 static void dc_auth_sendto_mac(struct auth_ctx *auth_ctx, uint8_t kmp_id, const void *pkt,
@@ -140,6 +166,12 @@ static void dc_auth_on_supp_gtk_installed(struct auth_ctx *auth_ctx, const struc
         tun_route_add(&dc->tun, &client_linklocal);
         INFO("Direct Connection established with %s", tr_eui64(eui64->u8));
         INFO("%s reachable at %s", tr_eui64(eui64->u8), tr_ipv6(client_linklocal.s6_addr));
+        if (dc->cfg.bulk) {
+            memset(&dc->bulk_period, 0, sizeof(dc->bulk_period));
+            memset(&dc->bulk_total, 0, sizeof(dc->bulk_total));
+            dc->bulk_start_ms = time_now_ms(CLOCK_MONOTONIC);
+            timer_start_rel(NULL, &dc->bulk_timer, dc->bulk_timer.period_ms);
+        }
     }
     if (timer_stopped(&dc->probe_timer)) {
         dc->probe_handle = -1;
@@ -158,6 +190,9 @@ struct dc g_dc = {
     .cfg.tx_power = 14,
     .cfg.disc_period_s = 10,
     .cfg.disc_count_max = 6,
+    .cfg.bulk_mtu = 1500,
+    .cfg.bulk_edfe = true,
+    .cfg.bulk_report_period_s = 5,
     .cfg.ws_allowed_channels = { [0 ... sizeof(g_dc.cfg.ws_allowed_channels) - 1] = 0xff },
     .cfg.target_eui64 = IEEE802154_ADDR_BC_INIT,
     .cfg.color_output = -1,
@@ -186,6 +221,7 @@ struct dc g_dc = {
     .disc_timer.callback = dc_on_disc_timer_timeout,
     .probe_timer.callback = ws_on_probe_timer_timeout,
     .probe_timer.period_ms = DIRECT_CONNECT_SYNC_PERIOD_S * 1000,
+    .bulk_timer.callback = dc_on_bulk_timer_timeout,
 
     .tun.fd = -1,
 };
@@ -198,6 +234,10 @@ static void dc_init_tun(struct dc *dc)
     memcpy(dc->addr_linklocal.s6_addr, ipv6_prefix_linklocal.s6_addr, 8);
     ipv6_addr_conv_iid_eui64(dc->addr_linklocal.s6_addr + 8, dc->ws.rcp.eui64.u8);
     tun_addr_add(&dc->tun, &dc->addr_linklocal, 64);
+    // IPv6 packets are never fragmented by silabs-ws-dc, a larger MTU
+    // reduces the per-packet overhead as long as it fits in a 15.4 frame.
+    if (dc->cfg.bulk && dc->cfg.tun_autoconf)
+        tun_link_set_mtu(&dc->tun, dc->cfg.bulk_mtu);
 }
 
 static void dc_init_radio(struct dc *dc)
@@ -249,12 +289,29 @@ static void dc_init_radio(struct dc *dc)
     rcp_req_radio_enable(&dc->ws.rcp);
 }
 
+static void dc_rcp_recv(struct event_source *src, uint32_t revents)
+{
+    struct dc *dc = container_of(src, struct dc, ev_rcp);
+
+    rcp_rx(&dc->ws.rcp);
+}
+
+static void dc_timer_recv(struct event_source *src, uint32_t revents)
+{
+    timer_process();
+}
+
+static void dc_tun_recv(struct event_source *src, uint32_t revents)
+{
+    struct dc *dc = container_of(src, struct dc, ev_tun);
+
+    ws_recvfrom_tun(dc);
+}
+
 int dc_main(int argc, char *argv[])
 {
-    struct pollfd pfd[POLLFD_COUNT] = { };
     struct auth_supp_ctx *supp;
     struct dc *dc = &g_dc;
-    int ret;
 
     INFO("Silicon Labs Wi-SUN Direct Connect %s", version_daemon_str);
 
@@ -278,30 +335,34 @@ int dc_main(int argc, char *argv[])
     supp = auth_fetch_supp(&dc->auth_ctx, &dc->cfg.target_eui64);
     memcpy(supp->eap_tls.tls.pmk.key, dc->cfg.target_pmk, 32);
 
-    timer_group_init(&dc->ws.neigh_table.timer_group);
+    ws_neigh_table_init(&dc->ws.neigh_table);
     if (dc->cfg.user[0] && dc->cfg.group[0])
         drop_privileges(dc->cfg.user, dc->cfg.group, true); // keep privileges to manage route to target later
 
     dc->disc_timer.period_ms = dc->cfg.disc_period_s * 1000;
+    dc->bulk_timer.period_ms = dc->cfg.bulk_report_period_s * 1000;
+    dc->ws.edfe = dc->cfg.bulk && dc->cfg.bulk_edfe;
     dc_restart_disc_timer(dc);
 
     INFO("Silicon Labs Wi-SUN Direct Connect successfully started");
-
-    pfd[POLLFD_RCP].fd = dc->ws.rcp.bus.fd;
-    pfd[POLLFD_RCP].events = POLLIN;
-    pfd[POLLFD_TIMER].fd = timer_fd();
-    pfd[POLLFD_TIMER].events = POLLIN;
-    pfd[POLLFD_TUN].fd = dc->tun.fd;
-    pfd[POLLFD_TUN].events = POLLIN;
+    if (dc->cfg.bulk)
+        INFO("Bulk transfer mode enabled (EDFE %s)", dc->ws.edfe ? "on" : "off");
+
+    dc->ev_rcp.fd = dc->ws.rcp.bus.fd;
+    dc->ev_rcp.events = EPOLLIN;
+    dc->ev_rcp.callback = dc_rcp_recv;
+    dc->ev_rcp.priority = true;
+    event_loop_add(&dc->ev_rcp);
+    dc->ev_timer.fd = timer_fd();
+    dc->ev_timer.events = EPOLLIN;
+    dc->ev_timer.callback = dc_timer_recv;
+    event_loop_add(&dc->ev_timer);
+    dc->ev_tun.fd = dc->tun.fd;
+    dc->ev_tun.events = EPOLLIN;
+    dc->ev_tun.callback = dc_tun_recv;
+    event_loop_add(&dc->ev_tun);
     while (true) {
-        ret = poll(pfd, POLLFD_COUNT, dc->ws.rcp.bus.uart.data_ready ? 0 : -1);
-        FATAL_ON(ret < 0, 2, "poll: %m");
-        if (dc->ws.rcp.bus.uart.data_ready ||
-            pfd[POLLFD_RCP].revents & POLLIN)
-            rcp_rx(&dc->ws.rcp);
-        if (pfd[POLLFD_TIMER].revents & POLLIN)
-            timer_process();
-        if (pfd[POLLFD_TUN].revents & POLLIN)
-            ws_recvfrom_tun(dc);
+        dc->ev_rcp.pending = dc->ws.rcp.bus.uart.data_ready;
+        event_loop_run();
     }
 }
@@ -16,10 +16,22 @@
 #include <netinet/in.h>
 
 #include "common/ws/ws_interface.h"
+#include "common/event_loop.h"
 #include "common/tun.h"
 
 #include "commandline.h"
 
+// Number of EDFE failures before considering the target does not support it
+#define DC_EDFE_FAIL_MAX 3
+
+struct dc_bulk_stats {
+    uint64_t tx_bytes;
+    uint32_t tx_pkts;
+    uint32_t tx_fail;
+    uint64_t rx_bytes;
+    uint32_t rx_pkts;
+};
+
 struct dc {
     struct dc_cfg cfg;
 
@@ -29,9 +41,19 @@ struct dc {
     int disc_count;
     struct timer_entry probe_timer;
     int probe_handle;
+    struct timer_entry bulk_timer;
+    struct dc_bulk_stats bulk_period;
+    struct dc_bulk_stats bulk_total;
+    uint64_t bulk_start_ms;
+    int  edfe_fail_count;
+    bool edfe_confirmed;
 
     struct tun_ctx tun;
     struct in6_addr addr_linklocal;
+
+    struct event_source ev_rcp;
+    struct event_source ev_timer;
+    struct event_source ev_tun;
 };
 
 extern struct dc g_dc;
@@ -19,6 +19,7 @@
 #include "common/ws/ws_ie_validation.h"
 #include "common/ws/ws_interface.h"
 #include "common/specs/ieee802159.h"
+#include "common/specs/ieee802154.h"
 #include "common/specs/6lowpan.h"
 #include "common/specs/icmpv6.h"
 #include "common/specs/ipv6.h"
@@ -271,6 +272,10 @@ static void ws_recv_6lowpan(struct dc *dc, const uint8_t *buf, size_t buf_len, c
         WARN("write tun : %m");
     else if (ret != pktbuf_len(&pktbuf))
         WARN("write tun: Short write: %zi < %zu", ret, pktbuf_len(&pktbuf));
+    if (ret > 0) {
+        dc->bulk_period.rx_bytes += ret;
+        dc->bulk_period.rx_pkts++;
+    }
 
 err:
     pktbuf_free(&pktbuf);
@@ -379,12 +384,31 @@ void ws_on_recv_ind(struct ws_ctx *ws, struct ws_ind *ind)
     }
 }
 
+static void ws_on_edfe_done(struct dc *dc, bool success)
+{
+    if (!dc->ws.edfe || dc->edfe_confirmed)
+        return;
+    if (success) {
+        dc->edfe_confirmed = true;
+        return;
+    }
+    if (++dc->edfe_fail_count < DC_EDFE_FAIL_MAX)
+        return;
+    WARN("%s does not support EDFE, falling back to acknowledged frames", tr_eui64(dc->cfg.target_eui64.u8));
+    dc->ws.edfe = false;
+}
+
 void ws_on_recv_cnf(struct ws_ctx *ws, struct ws_frame_ctx *frame_ctx, const struct rcp_tx_cnf *cnf)
 {
     struct dc *dc = container_of(ws, struct dc, ws);
+    bool success = cnf->status == HIF_STATUS_SUCCESS;
 
-    if (frame_ctx->type == WS_FT_DATA)
-        ws_on_probe_done(dc, cnf->handle, cnf->status == HIF_STATUS_SUCCESS);
+    if (frame_ctx->type != WS_FT_DATA)
+        return;
+    ws_on_edfe_done(dc, success);
+    if (cnf->handle != dc->probe_handle && !success)
+        dc->bulk_period.tx_fail++;
+    ws_on_probe_done(dc, cnf->handle, success);
 }
 
 void ws_recvfrom_tun(struct dc *dc)
@@ -394,7 +418,7 @@ void ws_recvfrom_tun(struct dc *dc)
     uint8_t dst_eui64[8];
     ssize_t size;
 
-    pktbuf_init(&pktbuf, NULL, 1500);
+    pktbuf_init(&pktbuf, NULL, MAC_IEEE_802_15_4G_MAX_PHY_PACKET_SIZE);
     size = read(dc->tun.fd, pktbuf_head(&pktbuf), pktbuf_len(&pktbuf));
     if (size < 0) {
         WARN("%s read: %m", __func__);
@@ -421,7 +445,10 @@ void ws_recvfrom_tun(struct dc *dc)
     TRACE(TR_IPV6, "tx-ipv6 src=%s dst=%s", tr_ipv6(hdr->ip6_src.s6_addr), tr_ipv6(hdr->ip6_dst.s6_addr));
 
     ipv6_addr_conv_iid_eui64(dst_eui64, hdr->ip6_dst.s6_addr + 8);
-    ws_send_lowpan(dc, &pktbuf, dc->ws.rcp.eui64.u8, dst_eui64);
+    if (ws_send_lowpan(dc, &pktbuf, dc->ws.rcp.eui64.u8, dst_eui64) >= 0) {
+        dc->bulk_period.tx_bytes += size;
+        dc->bulk_period.tx_pkts++;
+    }
 
 err:
     pktbuf_free(&pktbuf);
@@ -0,0 +1,980 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2025 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/ip6.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "common/ipv6/6lowpan_iphc.h"
+#include "common/ipv6/ipv6_addr.h"
+#include "common/specs/6lowpan.h"
+#include "common/specs/icmpv6.h"
+#include "common/specs/ieee802154.h"
+#include "common/specs/ieee802159.h"
+#include "common/specs/rpl.h"
+#include "common/ws/ws_regdb.h"
+#include "common/bus.h"
+#include "common/crc.h"
+#include "common/endian.h"
+#include "common/event_loop.h"
+#include "common/hif.h"
+#include "common/histogram.h"
+#include "common/ieee802154_frame.h"
+#include "common/ieee802154_ie.h"
+#include "common/iobuf.h"
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/mpx.h"
+#include "common/named_values.h"
+#include "common/pktbuf.h"
+#include "common/time_extra.h"
+#include "common/timer.h"
+#include "common/version.h"
+
+/*
+ * Run one wsbrd and many wsrd on the same machine, connected to a virtual RCP
+ * instead of a radio.
+ *
+ * Each daemon is a separate process (they rely on global state) using a
+ * pseudo-terminal as UART. wsbrd-sim implements the RCP side of the HIF
+ * protocol for all of them: frames sent with REQ_DATA_TX are given to the
+ * neighbors of the sender according to the link model, as IND_DATA_RX.
+ * Channel hopping is not simulated and frames are delivered instantly. The
+ * RCP does not need to encrypt anything: the frames are forwarded with their
+ * MIC left empty, only the frame counter is filled.
+ *
+ * For every router, wsbrd-sim measures the time to authenticate (first
+ * secured frame sent) and to join (first RPL DAO-ACK received), and reports
+ * the peak RSS of every daemon once all routers have joined.
+ */
+
+#define SIM_REPORT_INTERVAL_MS 10000
+// Attempts of the RCP for unicast frames, before reporting NOACK
+#define SIM_TX_ATTEMPTS 4
+// Frames queued to a daemon which does not read its UART are dropped
+#define SIM_TX_QUEUE_MAX (1024 * 1024)
+#define SIM_RX_POWER_DBM (-60)
+
+enum {
+    SIM_TOPOLOGY_FULL,
+    SIM_TOPOLOGY_LINE,
+    SIM_TOPOLOGY_GRID,
+    SIM_TOPOLOGY_RANDOM,
+};
+
+static const struct name_value sim_topologies[] = {
+    { "full",   SIM_TOPOLOGY_FULL },
+    { "line",   SIM_TOPOLOGY_LINE },
+    { "grid",   SIM_TOPOLOGY_GRID },
+    { "random", SIM_TOPOLOGY_RANDOM },
+    { NULL },
+};
+
+static const struct name_value sim_traces[] = {
+    { "bus",  TR_BUS },
+    { "hif",  TR_HIF },
+    { "drop", TR_DROP },
+    { NULL },
+};
+
+struct sim_cfg {
+    int router_count;
+    int topology;
+    int degree;
+    int per;
+    unsigned int seed;
+    int duration_s;
+    const char *wsbrd_path;
+    const char *wsrd_path;
+    const char *wsbrd_conf;
+    const char *wsrd_conf;
+    const char *workdir;
+};
+
+struct sim_radio {
+    uint16_t flags;
+    uint8_t  rail_phy_mode_id;
+    uint32_t chan0_freq;
+    uint32_t chan_spacing;
+    uint16_t chan_count;
+};
+
+struct sim_node {
+    struct sim *sim;
+    char name[16];
+    pid_t pid;
+    int tty_fd;
+    char tty[64];
+    struct bus bus;
+    struct event_source ev;
+    // Encoded frames not yet accepted by the pseudo-terminal
+    struct iobuf_write tx;
+    bool tx_blocked;
+    struct eui64 eui64;
+    uint32_t frame_counter[HIF_KEY_COUNT];
+    bool radio_enabled;
+    double x, y;
+    int *neighs;
+    int neigh_count;
+    int hops;            // < 0 if unreachable from the border router
+    uint64_t start_ms;
+    uint64_t auth_ms;    // 0 until the first secured frame is sent
+    uint64_t join_ms;    // 0 until the first DAO-ACK is received
+};
+
+struct sim {
+    struct sim_cfg cfg;
+    struct sim_radio *radios;
+    int radio_count;
+    // nodes[0] is the border router
+    struct sim_node *nodes;
+    int node_count;
+    int alive_count;
+    int auth_count;
+    int join_count;
+    uint64_t tx_count;
+    uint64_t rx_count;
+    uint64_t lost_count;
+    uint64_t start_ms;
+    bool stopping;
+    struct event_source ev_timer;
+    struct event_source ev_sigchld;
+    struct timer_entry report_timer;
+    struct timer_entry duration_timer;
+};
+
+static volatile sig_atomic_t g_sim_stop;
+
+static void sim_kill_handler(int signal)
+{
+    g_sim_stop = 1;
+}
+
+static void sim_print_help(FILE *stream, int exit_code)
+{
+    fprintf(stream, "\n");
+    fprintf(stream, "Simulate a Wi-SUN network made of one wsbrd and many wsrd on a single machine\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Usage:\n");
+    fprintf(stream, "  wsbrd-sim [OPTIONS] -b WSBRD_CONFIG -r WSRD_CONFIG\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -b, --wsbrd-config=FILE Configuration file of the border router\n");
+    fprintf(stream, "  -r, --wsrd-config=FILE  Configuration file used by all the routers\n");
+    fprintf(stream, "  -n, --routers=COUNT     Number of wsrd instances (default: 10)\n");
+    fprintf(stream, "  -t, --topology=MODEL    Link model: full, line, grid or random (default: grid).\n");
+    fprintf(stream, "                          The border router is the first node of the line or\n");
+    fprintf(stream, "                          grid, and the center of the random topology\n");
+    fprintf(stream, "  -D, --degree=COUNT      Average number of neighbors of the random topology\n");
+    fprintf(stream, "                          (default: 8)\n");
+    fprintf(stream, "  -p, --per=PERCENT       Packet error rate of every link (default: 0)\n");
+    fprintf(stream, "  -s, --seed=VAL          Seed of the random topology and of the packet errors\n");
+    fprintf(stream, "                          (default: 0)\n");
+    fprintf(stream, "  -d, --duration=SECONDS  Stop after SECONDS (default: once all routers joined)\n");
+    fprintf(stream, "  -w, --workdir=DIR       Logs and storage of the daemons (default: /tmp/wsbrd-sim)\n");
+    fprintf(stream, "      --wsbrd=PATH        Path of wsbrd (default: wsbrd)\n");
+    fprintf(stream, "      --wsrd=PATH         Path of wsrd (default: wsrd)\n");
+    fprintf(stream, "  -T, --trace=TAG[,TAG]   Enable traces marked with TAG. Valid tags: bus, hif\n");
+    fprintf(stream, "                          and drop\n");
+    fprintf(stream, "  -h, --help              Print this help\n");
+    fprintf(stream, "\n");
+    exit(exit_code);
+}
+
+static void sim_parse_commandline(struct sim_cfg *cfg, int argc, char *argv[])
+{
+    const char *opts_short = "b:r:n:t:D:p:s:d:w:T:h";
+    static const struct option opts_long[] = {
+        { "wsbrd-config", required_argument, 0, 'b' },
+        { "wsrd-config",  required_argument, 0, 'r' },
+        { "routers",      required_argument, 0, 'n' },
+        { "topology",     required_argument, 0, 't' },
+        { "degree",       required_argument, 0, 'D' },
+        { "per",          required_argument, 0, 'p' },
+        { "seed",         required_argument, 0, 's' },
+        { "duration",     required_argument, 0, 'd' },
+        { "workdir",      required_argument, 0, 'w' },
+        { "wsbrd",        required_argument, 0, 'B' },
+        { "wsrd",         required_argument, 0, 'R' },
+        { "trace",        required_argument, 0, 'T' },
+        { "help",         no_argument,       0, 'h' },
+        { 0,              0,                 0,  0  }
+    };
+    const char *substr;
+    int opt;
+
+    cfg->router_count = 10;
+    cfg->topology = SIM_TOPOLOGY_GRID;
+    cfg->degree = 8;
+    cfg->wsbrd_path = "wsbrd";
+    cfg->wsrd_path = "wsrd";
+    cfg->workdir = "/tmp/wsbrd-sim";
+    while ((opt = getopt_long(argc, argv, opts_short, opts_long, NULL)) != -1) {
+        switch (opt) {
+        case 'b':
+            cfg->wsbrd_conf = optarg;
+            break;
+        case 'r':
+            cfg->wsrd_conf = optarg;
+            break;
+        case 'n':
+            cfg->router_count = strtol(optarg, NULL, 10);
+            FATAL_ON(cfg->router_count < 1 || cfg->router_count > UINT16_MAX, 1,
+                     "invalid router count: %s", optarg);
+            break;
+        case 't':
+            cfg->topology = str_to_val(optarg, sim_topologies);
+            break;
+        case 'D':
+            cfg->degree = strtol(optarg, NULL, 10);
+            FATAL_ON(cfg->degree < 1, 1, "invalid degree: %s", optarg);
+            break;
+        case 'p':
+            cfg->per = strtol(optarg, NULL, 10);
+            FATAL_ON(cfg->per < 0 || cfg->per > 100, 1, "invalid packet error rate: %s", optarg);
+            break;
+        case 's':
+            cfg->seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            cfg->duration_s = strtol(optarg, NULL, 10);
+            FATAL_ON(cfg->duration_s < 0, 1, "invalid duration: %s", optarg);
+            break;
+        case 'w':
+            cfg->workdir = optarg;
+            break;
+        case 'B':
+            cfg->wsbrd_path = optarg;
+            break;
+        case 'R':
+            cfg->wsrd_path = optarg;
+            break;
+        case 'T':
+            substr = strtok(optarg, ",");
+            do {
+                g_enabled_traces |= str_to_val(substr, sim_traces);
+            } while ((substr = strtok(NULL, ",")));
+            break;
+        case 'h':
+            sim_print_help(stdout, 0);
+            break;
+        case '?':
+        default:
+            sim_print_help(stderr, 1);
+            break;
+        }
+    }
+    if (optind != argc)
+        FATAL(1, "unexpected argument: %s", argv[optind]);
+    if (!cfg->wsbrd_conf || !cfg->wsrd_conf)
+        FATAL(1, "--wsbrd-config and --wsrd-config are mandatory");
+}
+
+// Advertise every PHY of the regulatory database, so the daemons find the
+// one they are configured with.
+static void sim_radio_list_init(struct sim *sim)
+{
+    const struct chan_params *chan_params;
+    const struct phy_params *phy_params;
+    struct sim_radio radio;
+    int i;
+
+    for (chan_params = chan_params_table; chan_params->chan0_freq; chan_params++) {
+        for (const uint8_t *phy_mode = chan_params->valid_phy_modes; *phy_mode; phy_mode++) {
+            phy_params = ws_regdb_phy_params(*phy_mode, 0);
+            if (!phy_params)
+                continue;
+            radio = (struct sim_radio){
+                .rail_phy_mode_id = phy_params->rail_phy_mode_id,
+                .chan0_freq       = chan_params->chan0_freq,
+                .chan_spacing     = chan_params->chan_spacing,
+                .chan_count       = chan_params->chan_count,
+            };
+            if (phy_params->modulation == MODULATION_OFDM)
+                radio.flags = FIELD_PREP(HIF_MASK_RADIO_LIST_MCS, 0xff);
+            for (i = 0; i < sim->radio_count; i++)
+                if (!memcmp(&sim->radios[i], &radio, sizeof(radio)))
+                    break;
+            if (i < sim->radio_count)
+                continue;
+            sim->radios = reallocarray(sim->radios, sim->radio_count + 1, sizeof(*sim->radios));
+            FATAL_ON(!sim->radios, 2, "%s: cannot allocate memory", __func__);
+            sim->radios[sim->radio_count++] = radio;
+        }
+    }
+}
+
+static void sim_topology_init(struct sim *sim)
+{
+    int side = ceil(sqrt(sim->node_count));
+    struct sim_node *node, *peer;
+    int *queue, head, tail;
+    double range, dx, dy;
+    int unreachable = 0;
+    int hops_max = 0;
+
+    srand(sim->cfg.seed);
+    for (int i = 0; i < sim->node_count; i++) {
+        node = &sim->nodes[i];
+        switch (sim->cfg.topology) {
+        case SIM_TOPOLOGY_FULL:
+            break;
+        case SIM_TOPOLOGY_LINE:
+            node->x = i;
+            break;
+        case SIM_TOPOLOGY_GRID:
+            node->x = i % side;
+            node->y = i / side;
+            break;
+        case SIM_TOPOLOGY_RANDOM:
+            node->x = i ? (double)rand() / RAND_MAX : 0.5;
+            node->y = i ? (double)rand() / RAND_MAX : 0.5;
+            break;
+        }
+    }
+    if (sim->cfg.topology == SIM_TOPOLOGY_FULL)
+        range = INFINITY;
+    else if (sim->cfg.topology == SIM_TOPOLOGY_RANDOM)
+        // Unit disk graph: a disk of this radius contains on average
+        // cfg.degree other nodes.
+        range = sqrt(sim->cfg.degree / (M_PI * sim->node_count));
+    else
+        range = 1;
+
+    for (int i = 0; i < sim->node_count; i++) {
+        node = &sim->nodes[i];
+        for (int j = 0; j < sim->node_count; j++) {
+            peer = &sim->nodes[j];
+            dx = node->x - peer->x;
+            dy = node->y - peer->y;
+            if (i == j || dx * dx + dy * dy > range * range)
+                continue;
+            node->neighs = reallocarray(node->neighs, node->neigh_count + 1, sizeof(int));
+            FATAL_ON(!node->neighs, 2, "%s: cannot allocate memory", __func__);
+            node->neighs[node->neigh_count++] = j;
+        }
+    }
+
+    // Breadth-first search from the border router
+    queue = xalloc(sim->node_count * sizeof(int));
+    for (int i = 0; i < sim->node_count; i++)
+        sim->nodes[i].hops = -1;
+    sim->nodes[0].hops = 0;
+    head = tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        node = &sim->nodes[queue[head++]];
+        for (int i = 0; i < node->neigh_count; i++) {
+            peer = &sim->nodes[node->neighs[i]];
+            if (peer->hops >= 0)
+                continue;
+            peer->hops = node->hops + 1;
+            hops_max = MAX(hops_max, peer->hops);
+            queue[tail++] = node->neighs[i];
+        }
+    }
+    free(queue);
+    for (int i = 1; i < sim->node_count; i++)
+        if (sim->nodes[i].hops < 0)
+            unreachable++;
+    INFO("topology: %d routers, %s, up to %d hops, %d%% packet error rate",
+         sim->cfg.router_count, val_to_str(sim->cfg.topology, sim_topologies, "??"),
+         hops_max, sim->cfg.per);
+    if (unreachable)
+        WARN("%d routers are not connected to the border router", unreachable);
+}
+
+static void sim_node_flush(struct sim_node *node)
+{
+    ssize_t ret;
+
+    while (node->tx.len) {
+        ret = write(node->bus.fd, node->tx.data, node->tx.len);
+        if (ret < 0 && errno == EAGAIN)
+            break;
+        FATAL_ON(ret < 0, 2, "%s: write: %m", node->tty);
+        memmove(node->tx.data, node->tx.data + ret, node->tx.len - ret);
+        node->tx.len -= ret;
+    }
+    if (node->tx_blocked != !!node->tx.len) {
+        node->tx_blocked = node->tx.len;
+        event_loop_mod(&node->ev, node->tx_blocked ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    }
+}
+
+// Same framing as uart_tx(), with a queue since the daemon may be slower than
+// the other nodes.
+static void sim_node_send(struct sim_node *node, const struct iobuf_write *buf)
+{
+    if (!node->pid)
+        return;
+    if (node->tx.len + buf->len > SIM_TX_QUEUE_MAX) {
+        TRACE(TR_DROP, "drop %-9s: %s does not read its UART", "hif", node->name);
+        return;
+    }
+    TRACE(TR_HIF, "hif tx: %s %s %s", node->name, hif_cmd_str(buf->data[0]),
+          tr_bytes(buf->data + 1, buf->len - 1, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
+    iobuf_push_le16(&node->tx, buf->len);
+    iobuf_push_le16(&node->tx, crc16(CRC_INIT_HCS, node->tx.data + node->tx.len - 2, 2));
+    iobuf_push_data(&node->tx, buf->data, buf->len);
+    iobuf_push_le16(&node->tx, crc16(CRC_INIT_FCS, buf->data, buf->len));
+    sim_node_flush(node);
+}
+
+static void sim_ind_reset(struct sim_node *node)
+{
+    struct iobuf_write buf = iobuf_scratch();
+
+    hif_push_u8(&buf, HIF_CMD_IND_RESET);
+    hif_push_u32(&buf, VERSION(2, 4, 0));
+    hif_push_u32(&buf, VERSION(0, 0, 0));
+    hif_push_str(&buf, "wsbrd-sim");
+    hif_push_fixed_u8_array(&buf, node->eui64.u8, 8);
+    sim_node_send(node, &buf);
+    iobuf_free(&buf);
+}
+
+static void sim_cnf_radio_list(struct sim *sim, struct sim_node *node)
+{
+    const int entry_size = 2 + 1 + 4 + 4 + 2 + 2;
+    const int entry_max = (FIELD_MAX(UART_HDR_LEN_MASK) - 3) / entry_size;
+    struct iobuf_write buf = iobuf_scratch();
+
+    for (int i = 0; i < sim->radio_count; i += entry_max) {
+        buf.len = 0;
+        hif_push_u8(&buf, HIF_CMD_CNF_RADIO_LIST);
+        hif_push_u8(&buf, entry_size);
+        hif_push_bool(&buf, i + entry_max >= sim->radio_count);
+        for (int j = i; j < MIN(i + entry_max, sim->radio_count); j++) {
+            hif_push_u16(&buf, sim->radios[j].flags);
+            hif_push_u8(&buf,  sim->radios[j].rail_phy_mode_id);
+            hif_push_u32(&buf, sim->radios[j].chan0_freq);
+            hif_push_u32(&buf, sim->radios[j].chan_spacing);
+            hif_push_u16(&buf, sim->radios[j].chan_count);
+            hif_push_i16(&buf, -100); // sensitivity_dbm
+        }
+        sim_node_send(node, &buf);
+    }
+    iobuf_free(&buf);
+}
+
+static void sim_cnf_data_tx(struct sim_node *node, uint8_t handle, uint8_t status,
+                            uint32_t frame_counter, uint8_t tx_retries)
+{
+    struct iobuf_write buf = iobuf_scratch();
+
+    hif_push_u8(&buf, HIF_CMD_CNF_DATA_TX);
+    hif_push_u8(&buf, handle);
+    hif_push_u8(&buf, status);
+    hif_push_data(&buf, NULL, 0); // No Enhanced ACK
+    hif_push_u64(&buf, time_now_us(CLOCK_MONOTONIC));
+    hif_push_u8(&buf, 0xff); // lqi
+    hif_push_i8(&buf, SIM_RX_POWER_DBM);
+    hif_push_u32(&buf, frame_counter);
+    hif_push_u16(&buf, 0); // chan_num
+    hif_push_u8(&buf, 0); // cca_retries
+    hif_push_u8(&buf, tx_retries);
+    hif_push_u8(&buf, 0); // mode switch statistics
+    sim_node_send(node, &buf);
+    iobuf_free(&buf);
+}
+
+static void sim_ind_data_rx(struct sim *sim, struct sim_node *node, const uint8_t *frame, int frame_len)
+{
+    struct iobuf_write buf = iobuf_scratch();
+
+    hif_push_u8(&buf, HIF_CMD_IND_DATA_RX);
+    hif_push_data(&buf, frame, frame_len);
+    hif_push_u64(&buf, time_now_us(CLOCK_MONOTONIC));
+    hif_push_u8(&buf, 0xff); // lqi
+    hif_push_i8(&buf, SIM_RX_POWER_DBM);
+    hif_push_u8(&buf, 0); // phy_mode_id, unknown
+    hif_push_u16(&buf, 0); // chan_num
+    sim_node_send(node, &buf);
+    iobuf_free(&buf);
+    sim->rx_count++;
+}
+
+// Returns true if the frame carries a RPL DAO-ACK for the receiver.
+static bool sim_frame_is_dao_ack(const struct ieee802154_hdr *hdr,
+                                 const struct iobuf_read *ie_payload,
+                                 const struct sim_node *node)
+{
+    uint8_t src_iid[8], dst_iid[8], node_iid[8];
+    struct pktbuf pktbuf = { };
+    struct iobuf_read ie_mpx;
+    const struct ip6_hdr *ip6;
+    struct mpx_ie mpx;
+    const uint8_t *pkt;
+    bool ret = false;
+    size_t off, len;
+    uint8_t nxt;
+
+    ieee802154_ie_find_payload(ie_payload->data, ie_payload->data_size, IEEE802154_IE_ID_MPX, &ie_mpx);
+    if (ie_mpx.err ||
+        !mpx_ie_parse(ie_mpx.data, ie_mpx.data_size, &mpx) ||
+        mpx.multiplex_id  != MPX_ID_6LOWPAN ||
+        mpx.transfer_type != MPX_FT_FULL_FRAME ||
+        !mpx.frame_length || !LOWPAN_DISPATCH_IS_IPHC(mpx.frame_ptr[0]))
+        return false;
+
+    ipv6_addr_conv_iid_eui64(src_iid, hdr->src.u8);
+    ipv6_addr_conv_iid_eui64(dst_iid, hdr->dst.u8);
+    ipv6_addr_conv_iid_eui64(node_iid, node->eui64.u8);
+    pktbuf_init_headroom(&pktbuf, 64, mpx.frame_ptr, mpx.frame_length);
+    lowpan_iphc_decmpr(&pktbuf, src_iid, dst_iid);
+    if (pktbuf.err || pktbuf_len(&pktbuf) < sizeof(*ip6))
+        goto out;
+    pkt = pktbuf_head(&pktbuf);
+    len = pktbuf_len(&pktbuf);
+    ip6 = (const struct ip6_hdr *)pkt;
+    nxt = ip6->ip6_nxt;
+    off = sizeof(*ip6);
+    // Skip the RPI, the source routing header and the IPv6-in-IPv6 tunnel
+    // used by the border router in non-storing mode.
+    while (off + 2 <= len) {
+        if (nxt == IPPROTO_HOPOPTS || nxt == IPPROTO_ROUTING || nxt == IPPROTO_DSTOPTS) {
+            nxt = pkt[off];
+            off += (pkt[off + 1] + 1) * 8;
+        } else if (nxt == IPPROTO_IPV6 && off + sizeof(*ip6) <= len) {
+            ip6 = (const struct ip6_hdr *)(pkt + off);
+            nxt = ip6->ip6_nxt;
+            off += sizeof(*ip6);
+        } else {
+            break;
+        }
+    }
+    ret = nxt == IPPROTO_ICMPV6 && off + 2 <= len &&
+          pkt[off] == ICMPV6_TYPE_RPL && pkt[off + 1] == RPL_CODE_DAO_ACK &&
+          !memcmp(ip6->ip6_dst.s6_addr + 8, node_iid, 8);
+out:
+    pktbuf_free(&pktbuf);
+    return ret;
+}
+
+static bool sim_link_lost(struct sim *sim)
+{
+    return sim->cfg.per && rand() % 100 < sim->cfg.per;
+}
+
+static void sim_deliver(struct sim *sim, struct sim_node *dst,
+                        const uint8_t *frame, int frame_len,
+                        const struct ieee802154_hdr *hdr,
+                        const struct iobuf_read *ie_payload)
+{
+    sim_ind_data_rx(sim, dst, frame, frame_len);
+    if (dst->join_ms || !dst->auth_ms || !sim_frame_is_dao_ack(hdr, ie_payload, dst))
+        return;
+    dst->join_ms = time_now_ms(CLOCK_MONOTONIC);
+    sim->join_count++;
+    if (!sim->cfg.duration_s && sim->join_count == sim->cfg.router_count)
+        g_sim_stop = 1;
+}
+
+static void sim_req_data_tx(struct sim *sim, struct sim_node *node, struct iobuf_read *buf)
+{
+    struct iobuf_read ie_header = { }, ie_payload = { };
+    uint8_t frame[FIELD_MAX(UART_HDR_LEN_MASK)];
+    struct sim_node *dst = NULL;
+    struct ieee802154_hdr hdr;
+    uint32_t frame_counter = 0;
+    const uint8_t *frame_ptr;
+    int frame_len, offset;
+    uint8_t handle;
+    int attempt;
+
+    handle    = hif_pop_u8(buf);
+    frame_len = hif_pop_data_ptr(buf, &frame_ptr);
+    if (buf->err || frame_len > sizeof(frame)) {
+        TRACE(TR_DROP, "drop %-9s: %s: malformed REQ_DATA_TX", "hif", node->name);
+        return;
+    }
+    memcpy(frame, frame_ptr, frame_len);
+    if (ieee802154_frame_parse(frame, frame_len, &hdr, &ie_header, &ie_payload) < 0) {
+        sim_cnf_data_tx(node, handle, HIF_STATUS_INTERNAL_ERROR, 0, 0);
+        return;
+    }
+    sim->tx_count++;
+
+    if (hdr.key_index) {
+        if (hdr.key_index > HIF_KEY_COUNT) {
+            sim_cnf_data_tx(node, handle, HIF_STATUS_INTERNAL_ERROR, 0, 0);
+            return;
+        }
+        // The auxiliary security header follows the addressing fields, see
+        // ieee802154_frame_write_hdr().
+        offset = 2;
+        if (hdr.seqno >= 0)
+            offset += 1;
+        if (memcmp(&hdr.dst, &ieee802154_addr_bc, 8))
+            offset += 8;
+        if (hdr.pan_id != 0xffff)
+            offset += 2;
+        if (memcmp(&hdr.src, &ieee802154_addr_bc, 8))
+            offset += 8;
+        frame_counter = node->frame_counter[hdr.key_index - 1]++;
+        write_le32(frame + offset + 1, frame_counter);
+        if (!node->auth_ms && node != &sim->nodes[0]) {
+            node->auth_ms = time_now_ms(CLOCK_MONOTONIC);
+            sim->auth_count++;
+        }
+    }
+
+    if (!memcmp(&hdr.dst, &ieee802154_addr_bc, 8)) {
+        for (int i = 0; i < node->neigh_count; i++) {
+            dst = &sim->nodes[node->neighs[i]];
+            if (!dst->radio_enabled || sim_link_lost(sim))
+                sim->lost_count++;
+            else
+                sim_deliver(sim, dst, frame, frame_len, &hdr, &ie_payload);
+        }
+        sim_cnf_data_tx(node, handle, HIF_STATUS_SUCCESS, frame_counter, 0);
+        return;
+    }
+
+    for (int i = 0; i < node->neigh_count && !dst; i++)
+        if (!memcmp(&sim->nodes[node->neighs[i]].eui64, &hdr.dst, 8))
+            dst = &sim->nodes[node->neighs[i]];
+    for (attempt = 0; attempt < SIM_TX_ATTEMPTS; attempt++) {
+        if (dst && dst->radio_enabled && !sim_link_lost(sim))
+            break;
+        sim->lost_count++;
+    }
+    if (attempt == SIM_TX_ATTEMPTS) {
+        sim_cnf_data_tx(node, handle, HIF_STATUS_NOACK, frame_counter, attempt - 1);
+        return;
+    }
+    sim_deliver(sim, dst, frame, frame_len, &hdr, &ie_payload);
+    sim_cnf_data_tx(node, handle, HIF_STATUS_SUCCESS, frame_counter, attempt);
+}
+
+static void sim_set_sec_key(struct sim_node *node, struct iobuf_read *buf)
+{
+    uint8_t key_index;
+    uint32_t frame_counter;
+
+    key_index = hif_pop_u8(buf);
+    hif_pop_fixed_u8_array(buf, NULL, 16);
+    frame_counter = hif_pop_u32(buf);
+    if (buf->err || key_index < 1 || key_index > HIF_KEY_COUNT)
+        return;
+    node->frame_counter[key_index - 1] = frame_counter;
+}
+
+static void sim_rx_dispatch(struct sim *sim, struct sim_node *node, struct iobuf_read *buf)
+{
+    uint8_t cmd;
+
+    cmd = hif_pop_u8(buf);
+    TRACE(TR_HIF, "hif rx: %s %s %s", node->name, hif_cmd_str(cmd),
+          tr_bytes(iobuf_ptr(buf), iobuf_remaining_size(buf), NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
+    switch (cmd) {
+    case HIF_CMD_REQ_RESET:
+        node->radio_enabled = false;
+        sim_ind_reset(node);
+        break;
+    case HIF_CMD_REQ_RADIO_LIST:
+        sim_cnf_radio_list(sim, node);
+        break;
+    case HIF_CMD_REQ_RADIO_ENABLE:
+        node->radio_enabled = true;
+        break;
+    case HIF_CMD_REQ_DATA_TX:
+        sim_req_data_tx(sim, node, buf);
+        break;
+    case HIF_CMD_SET_SEC_KEY:
+        sim_set_sec_key(node, buf);
+        break;
+    // Frames are confirmed as soon as they are requested, there is nothing
+    // to abort. Channels, filters and the other radio settings are ignored.
+    default:
+        break;
+    }
+}
+
+static void sim_node_recv(struct event_source *ev, uint32_t revents)
+{
+    struct sim_node *node = container_of(ev, struct sim_node, ev);
+    struct sim *sim = node->sim;
+    uint8_t buf[FIELD_MAX(UART_HDR_LEN_MASK)];
+    struct iobuf_read iobuf = { .data = buf };
+
+    if (revents & EPOLLOUT)
+        sim_node_flush(node);
+    if ((revents & EPOLLIN) || node->bus.uart.data_ready) {
+        iobuf.data_size = uart_rx(&node->bus, buf, sizeof(buf));
+        if (iobuf.data_size)
+            sim_rx_dispatch(sim, node, &iobuf);
+    }
+    ev->pending = node->bus.uart.data_ready;
+}
+
+static void sim_timer_recv(struct event_source *ev, uint32_t revents)
+{
+    timer_process();
+}
+
+static void sim_sigchld_recv(struct event_source *ev, uint32_t revents)
+{
+    struct sim *sim = container_of(ev, struct sim, ev_sigchld);
+    struct signalfd_siginfo info;
+    int status;
+    pid_t pid;
+
+    if (read(ev->fd, &info, sizeof(info)) != sizeof(info))
+        return;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < sim->node_count; i++) {
+            if (sim->nodes[i].pid != pid)
+                continue;
+            if (!sim->stopping)
+                WARN("%s exited (status %d), see %s/%s.log", sim->nodes[i].name,
+                     WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status),
+                     sim->cfg.workdir, sim->nodes[i].name);
+            sim->nodes[i].pid = 0;
+            sim->nodes[i].tx.len = 0;
+            sim->alive_count--;
+        }
+    }
+}
+
+static void sim_report(struct timer_group *group, struct timer_entry *timer)
+{
+    struct sim *sim = container_of(timer, struct sim, report_timer);
+
+    INFO("%5"PRIu64"s: %d/%d authenticated, %d/%d joined, %"PRIu64" frames sent, %"PRIu64" received, %"PRIu64" lost",
+         (time_now_ms(CLOCK_MONOTONIC) - sim->start_ms) / 1000,
+         sim->auth_count, sim->cfg.router_count, sim->join_count, sim->cfg.router_count,
+         sim->tx_count, sim->rx_count, sim->lost_count);
+}
+
+static void sim_duration_expired(struct timer_group *group, struct timer_entry *timer)
+{
+    g_sim_stop = 1;
+}
+
+static void sim_node_init(struct sim *sim, struct sim_node *node, int index)
+{
+    struct termios tty;
+    int fd;
+
+    node->sim = sim;
+    if (index)
+        snprintf(node->name, sizeof(node->name), "wsrd%d", index);
+    else
+        snprintf(node->name, sizeof(node->name), "wsbrd");
+    memcpy(node->eui64.u8, (uint8_t[8]){ 0x02, 0x00, 0x5e, 0x51, 0x00, 0x00, index >> 8, index }, 8);
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    FATAL_ON(fd < 0, 2, "posix_openpt: %m");
+    FATAL_ON(grantpt(fd) < 0, 2, "grantpt: %m");
+    FATAL_ON(unlockpt(fd) < 0, 2, "unlockpt: %m");
+    snprintf(node->tty, sizeof(node->tty), "%s", ptsname(fd));
+    // Keep the slave side open, so reading the master side does not fail
+    // with EIO when the daemon exits, and disable the echo until the daemon
+    // configures the line itself.
+    node->tty_fd = open(node->tty, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    FATAL_ON(node->tty_fd < 0, 2, "%s: %m", node->tty);
+    FATAL_ON(tcgetattr(node->tty_fd, &tty) < 0, 2, "%s: tcgetattr: %m", node->tty);
+    cfmakeraw(&tty);
+    FATAL_ON(tcsetattr(node->tty_fd, TCSANOW, &tty) < 0, 2, "%s: tcsetattr: %m", node->tty);
+
+    node->bus.fd = fd;
+    node->bus.tx = uart_tx;
+    node->bus.rx = uart_rx;
+    node->ev.fd = fd;
+    node->ev.events = EPOLLIN;
+    node->ev.budget = 8;
+    node->ev.callback = sim_node_recv;
+    event_loop_add(&node->ev);
+}
+
+static void sim_node_spawn(struct sim *sim, struct sim_node *node, const char *path, const char *conf)
+{
+    char storage[PATH_MAX], log[PATH_MAX];
+    sigset_t sigmask;
+    char opt_storage[PATH_MAX + 32];
+    char opt_tun[64];
+    int fd;
+
+    snprintf(storage, sizeof(storage), "%s/%s", sim->cfg.workdir, node->name);
+    snprintf(log, sizeof(log), "%s/%s.log", sim->cfg.workdir, node->name);
+    if (mkdir(storage, 0755) < 0 && errno != EEXIST)
+        FATAL(1, "%s: %m", storage);
+    snprintf(opt_storage, sizeof(opt_storage), "storage_prefix=%s/", storage);
+    snprintf(opt_tun, sizeof(opt_tun), "tun_device=%s", node->name);
+
+    node->start_ms = time_now_ms(CLOCK_MONOTONIC);
+    node->pid = fork();
+    FATAL_ON(node->pid < 0, 2, "fork: %m");
+    if (node->pid) {
+        sim->alive_count++;
+        return;
+    }
+
+    // Ctrl-C is only received by wsbrd-sim, which stops the daemons once the
+    // results are collected.
+    setpgid(0, 0);
+    sigemptyset(&sigmask);
+    sigprocmask(SIG_SETMASK, &sigmask, NULL);
+    fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    FATAL_ON(fd < 0, 2, "%s: %m", log);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    execlp(path, path, "-F", conf, "-u", node->tty, "-o", opt_storage, "-o", opt_tun, NULL);
+    FATAL(2, "%s: %m", path);
+}
+
+// Peak resident set size in kB, 0 if unknown.
+static long sim_node_rss_kb(const struct sim_node *node)
+{
+    char path[64], line[256];
+    long rss_kb = 0;
+    FILE *file;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", node->pid);
+    file = fopen(path, "r");
+    if (!file)
+        return 0;
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "VmHWM: %ld kB", &rss_kb) == 1)
+            break;
+    fclose(file);
+    return rss_kb;
+}
+
+static void sim_print_delays(const char *what, const struct histogram *hist, int total)
+{
+    if (!hist->count) {
+        printf("  %-14s 0/%d\n", what, total);
+        return;
+    }
+    printf("  %-14s %"PRIu64"/%d, p50 %.1lfs, p90 %.1lfs, max %.1lfs\n", what, hist->count, total,
+           histogram_quantile(hist, 0.5) / 1000.0, histogram_quantile(hist, 0.9) / 1000.0,
+           hist->max / 1000.0);
+}
+
+static void sim_print_summary(struct sim *sim)
+{
+    long rss_kb, rss_br_kb, rss_sum_kb = 0, rss_max_kb = 0;
+    struct histogram auth = { }, join = { };
+    const struct sim_node *node;
+    int rss_count = 0;
+
+    rss_br_kb = sim->nodes[0].pid ? sim_node_rss_kb(&sim->nodes[0]) : 0;
+    for (int i = 1; i < sim->node_count; i++) {
+        node = &sim->nodes[i];
+        if (node->auth_ms)
+            histogram_add(&auth, node->auth_ms - node->start_ms);
+        if (node->join_ms)
+            histogram_add(&join, node->join_ms - node->start_ms);
+        if (!node->pid)
+            continue;
+        rss_kb = sim_node_rss_kb(node);
+        rss_sum_kb += rss_kb;
+        rss_max_kb = MAX(rss_max_kb, rss_kb);
+        rss_count++;
+    }
+    printf("after %.1lfs (delays measured from the start of each daemon):\n",
+           (time_now_ms(CLOCK_MONOTONIC) - sim->start_ms) / 1000.0);
+    sim_print_delays("authenticated:", &auth, sim->cfg.router_count);
+    sim_print_delays("joined:", &join, sim->cfg.router_count);
+    printf("  frames:        %"PRIu64" sent, %"PRIu64" received, %"PRIu64" lost\n",
+           sim->tx_count, sim->rx_count, sim->lost_count);
+    printf("  peak RSS:      wsbrd %.1lf MiB, wsrd mean %.1lf MiB, max %.1lf MiB (%d running)\n",
+           rss_br_kb / 1024.0, rss_count ? rss_sum_kb / 1024.0 / rss_count : 0, rss_max_kb / 1024.0,
+           rss_count);
+}
+
+int main(int argc, char *argv[])
+{
+    const struct sigaction sigact = { .sa_handler = sim_kill_handler };
+    struct sim sim = {
+        .report_timer.period_ms = SIM_REPORT_INTERVAL_MS,
+        .report_timer.callback  = sim_report,
+        .duration_timer.callback = sim_duration_expired,
+    };
+    struct rlimit rlim;
+    sigset_t sigmask;
+
+    sim_parse_commandline(&sim.cfg, argc, argv);
+    sim.node_count = sim.cfg.router_count + 1;
+
+    // 2 file descriptors per pseudo-terminal
+    if (!getrlimit(RLIMIT_NOFILE, &rlim)) {
+        rlim.rlim_cur = rlim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rlim);
+        if (rlim.rlim_cur < 2 * sim.node_count + 16)
+            FATAL(1, "too many routers for RLIMIT_NOFILE (%ju)", (uintmax_t)rlim.rlim_cur);
+    }
+    if (mkdir(sim.cfg.workdir, 0755) < 0 && errno != EEXIST)
+        FATAL(1, "%s: %m", sim.cfg.workdir);
+
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigmask, NULL);
+    sim.ev_sigchld.fd = signalfd(-1, &sigmask, SFD_CLOEXEC);
+    FATAL_ON(sim.ev_sigchld.fd < 0, 2, "signalfd: %m");
+    sim.ev_sigchld.events = EPOLLIN;
+    sim.ev_sigchld.callback = sim_sigchld_recv;
+    event_loop_add(&sim.ev_sigchld);
+    sim.ev_timer.fd = timer_fd();
+    sim.ev_timer.events = EPOLLIN;
+    sim.ev_timer.callback = sim_timer_recv;
+    event_loop_add(&sim.ev_timer);
+
+    sim_radio_list_init(&sim);
+    sim.nodes = zalloc(sim.node_count * sizeof(*sim.nodes));
+    sim_topology_init(&sim);
+    for (int i = 0; i < sim.node_count; i++)
+        sim_node_init(&sim, &sim.nodes[i], i);
+
+    sim.start_ms = time_now_ms(CLOCK_MONOTONIC);
+    sim_node_spawn(&sim, &sim.nodes[0], sim.cfg.wsbrd_path, sim.cfg.wsbrd_conf);
+    for (int i = 1; i < sim.node_count; i++)
+        sim_node_spawn(&sim, &sim.nodes[i], sim.cfg.wsrd_path, sim.cfg.wsrd_conf);
+    timer_start_rel(NULL, &sim.report_timer, sim.report_timer.period_ms);
+    if (sim.cfg.duration_s)
+        timer_start_rel(NULL, &sim.duration_timer, sim.cfg.duration_s * 1000);
+
+    while (!g_sim_stop && sim.alive_count)
+        event_loop_run();
+
+    sim_print_summary(&sim);
+    sim.stopping = true;
+    for (int i = 0; i < sim.node_count; i++)
+        if (sim.nodes[i].pid)
+            kill(sim.nodes[i].pid, SIGTERM);
+    // The daemons flush their UART on exit
+    while (sim.alive_count)
+        event_loop_run();
+    return 0;
+}
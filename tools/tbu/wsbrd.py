@@ -11,6 +11,8 @@
 #
 # [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
 #
+import dataclasses
+import time
 import sdbus
 import typing
 
@@ -100,6 +102,13 @@ class WsbrdDbusInterface(
     def routing_graph(self) -> list[tuple[bytes, bool, list[bytes]]]:
         raise NotImplementedError
 
+    @sdbus.dbus_method('t')
+    def get_snapshot(self, since: int) -> tuple[int,
+                                                list[tuple[bytes, bool, bytes]],
+                                                list[tuple[bytes, bool, list[bytes]]],
+                                                list[bytes], list[bytes]]:
+        raise NotImplementedError
+
     @sdbus.dbus_method('ayuy')
     def set_link_mode_switch(self, eui64: bytes, phy_mode_id: int, ms_mode: int) -> None:
         raise NotImplementedError
@@ -158,3 +167,46 @@ def dbus():
         service_name='com.silabs.Wisun.BorderRouter',
         object_path='/com/silabs/Wisun/BorderRouter',
     )
+
+
+# wsbrd only sends the nodes and routes of GetSnapshot when they changed since
+# the generation of the cached copy. Since the POM-IE of the nodes is not
+# covered by the generation, and since the generation restarts with wsbrd, a
+# full snapshot is still requested periodically.
+SNAPSHOT_MAX_AGE_S = 5
+
+
+@dataclasses.dataclass
+class Snapshot:
+    gen: int = 0
+    time: float = 0
+    nodes: list[tuple[bytes, bool, bytes]] = dataclasses.field(default_factory=list)
+    routing_graph: list[tuple[bytes, bool, list[bytes]]] = dataclasses.field(default_factory=list)
+    gtks: list[bytes] = dataclasses.field(default_factory=list)
+    lgtks: list[bytes] = dataclasses.field(default_factory=list)
+
+
+_snapshot = Snapshot()
+
+
+def snapshot() -> Snapshot:
+    global _snapshot
+
+    now = time.monotonic()
+    if now - _snapshot.time > SNAPSHOT_MAX_AGE_S:
+        _snapshot.gen = 0
+    gen, nodes, routing_graph, gtks, lgtks = dbus().get_snapshot(_snapshot.gen)
+    if gen != _snapshot.gen:
+        _snapshot.gen = gen
+        _snapshot.time = now
+        _snapshot.nodes = nodes
+        _snapshot.routing_graph = routing_graph
+    _snapshot.gtks = gtks
+    _snapshot.lgtks = lgtks
+    return _snapshot
+
+
+def snapshot_invalidate():
+    global _snapshot
+
+    _snapshot = Snapshot()
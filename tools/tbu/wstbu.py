@@ -204,6 +204,7 @@ def wsbrd_set_join_metrics(jm_list, jm_version):
 def run_mode(mode: int):
     global jm_version, jm_list
 
+    wsbrd.snapshot_invalidate()
     if mode == 0:
         wsbrd.service.stop('fail')
         wsbrd.config = wsbrd.config_default(config)
@@ -838,11 +839,12 @@ def config_ip_addresses():
 
 @dbus_errcheck
 def config_security_keys():
+    snapshot = wsbrd.snapshot()
     gtks = dict()
-    for i, gtk in enumerate(wsbrd.dbus().gtks):
+    for i, gtk in enumerate(snapshot.gtks):
         if gtk != bytes(16):
             gtks[f'gtk{i}'] = utils.format_key(gtk)
-    for i, gtk in enumerate(wsbrd.dbus().lgtks):
+    for i, gtk in enumerate(snapshot.lgtks):
         if gtk != bytes(16):
             gtks[f'lgtk{i}'] = utils.format_key(gtk)
     return gtks
@@ -851,7 +853,7 @@ def config_security_keys():
 @dbus_errcheck
 def config_dodag_routes():
     routes = []
-    for addr, _, parents in wsbrd.dbus().routing_graph:
+    for addr, _, parents in wsbrd.snapshot().routing_graph:
         if not parents:
             continue
         routes.append({'route': str(ipaddress.IPv6Address(addr))})
@@ -863,7 +865,7 @@ def config_preferred_parent():
     addr = utils.parse_ipv6(flask.request.args.get('ipAddress'))
     if not addr:
         return error(400, WSTBU_ERR_UNKNOWN, 'invalid address')
-    for addr_bytes, _, parents in wsbrd.dbus().routing_graph:
+    for addr_bytes, _, parents in wsbrd.snapshot().routing_graph:
         if addr_bytes != addr.packed:
             continue
         if not parents:
@@ -881,12 +883,12 @@ def capabilities_phy(eui64: str):
     eui64 = utils.parse_eui64(eui64)
     if not eui64:
         return error(400, WSTBU_ERR_UNKNOWN, 'invalid eui64')
-    for _eui64, properties in wsbrd.dbus().nodes:
+    for _eui64, mdr_cmd_capable, pom in wsbrd.snapshot().nodes:
         if _eui64  != eui64:
             continue
         res = dict()
-        res['mdrCmdCapable'] = properties.get('mdr_cmd_capable', ('b', False))[1]
-        res['phyOpModes'] = [int(pom) for pom in properties.get('pom', ('ay', bytes()))[1]]
+        res['mdrCmdCapable'] = mdr_cmd_capable
+        res['phyOpModes'] = [int(mode) for mode in pom]
         return res
     return error(400, WSTBU_ERR_UNKNOWN, 'unknown eui64')
 
@@ -0,0 +1,142 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "common/log.h"
+#include "common/mathutils.h"
+#include "common/trace_ring.h"
+
+/*
+ * Decode the binary traces recorded by wsbrd when trace_ring is set. The
+ * output matches what wsbrd would have printed with the same trace= options.
+ *
+ * Usage: wsbrd-trace-decode [-f] FILE
+ */
+
+static void print_help(FILE *stream, const char *prog)
+{
+    fprintf(stream, "Usage: %s [-f] FILE\n", prog);
+    fprintf(stream, "  -f, --follow  Keep waiting for new records\n");
+}
+
+static const char *trace_decode_fmt(const struct trace_ring_hdr *ring, uint16_t fmt_id)
+{
+    uint32_t fmt_count = __atomic_load_n(&ring->fmt_count, __ATOMIC_ACQUIRE);
+
+    if (fmt_id >= fmt_count || ring->fmt_offset[fmt_id] >= TRACE_RING_FMT_SIZE)
+        return NULL;
+    // The data may be corrupted if the file was truncated
+    if (!memchr(ring->fmt_data + ring->fmt_offset[fmt_id], '\0',
+                TRACE_RING_FMT_SIZE - ring->fmt_offset[fmt_id]))
+        return NULL;
+    return ring->fmt_data + ring->fmt_offset[fmt_id];
+}
+
+// Returns false if the record has been overwritten while being read.
+static bool trace_decode_rec(const struct trace_ring_hdr *ring, uint64_t i)
+{
+    const struct trace_ring_rec *rec = &ring->recs[i & (ring->rec_count - 1)];
+    struct trace_ring_rec copy;
+    const char *fmt;
+    char buf[4096];
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != i + 1)
+        return false;
+    memcpy(&copy, rec, sizeof(copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != i + 1)
+        return false;
+    fmt = trace_decode_fmt(ring, copy.fmt_id);
+    if (fmt)
+        trace_ring_format(buf, sizeof(buf), fmt, copy.args, MIN(copy.args_len, sizeof(copy.args)));
+    else
+        snprintf(buf, sizeof(buf), "<unknown format %u>", copy.fmt_id);
+    printf("%"PRIu64".%06"PRIu64": %s%s\n",
+           copy.time_us / 1000000, copy.time_us % 1000000, buf,
+           copy.flags & TRACE_RING_TRUNCATED && fmt ? " [truncated]" : "");
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option opt_long[] = {
+        { "follow", no_argument, 0, 'f' },
+        { "help",   no_argument, 0, 'h' },
+        { 0,        0,           0,  0  }
+    };
+    const struct trace_ring_hdr *ring;
+    uint64_t head, next = 0;
+    bool follow = false;
+    struct stat st;
+    int fd, opt;
+
+    while ((opt = getopt_long(argc, argv, "fh", opt_long, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            follow = true;
+            break;
+        case 'h':
+            print_help(stdout, argv[0]);
+            exit(0);
+        default:
+            print_help(stderr, argv[0]);
+            exit(1);
+        }
+    }
+    if (optind + 1 != argc) {
+        print_help(stderr, argv[0]);
+        exit(1);
+    }
+
+    fd = open(argv[optind], O_RDONLY);
+    FATAL_ON(fd < 0, 2, "open %s: %m", argv[optind]);
+    FATAL_ON(fstat(fd, &st) < 0, 2, "fstat %s: %m", argv[optind]);
+    FATAL_ON(st.st_size < sizeof(*ring), 1, "%s: file too small", argv[optind]);
+    ring = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    FATAL_ON(ring == MAP_FAILED, 2, "mmap %s: %m", argv[optind]);
+    close(fd);
+    FATAL_ON(__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != TRACE_RING_MAGIC, 1,
+             "%s: not a trace ring", argv[optind]);
+    FATAL_ON(ring->version != TRACE_RING_VERSION || ring->rec_size != sizeof(struct trace_ring_rec), 1,
+             "%s: unsupported trace ring version %u", argv[optind], ring->version);
+    FATAL_ON(!ring->rec_count || ring->rec_count & (ring->rec_count - 1) ||
+             st.st_size < sizeof(*ring) + (uint64_t)ring->rec_count * sizeof(struct trace_ring_rec), 1,
+             "%s: corrupted trace ring", argv[optind]);
+
+    setlinebuf(stdout);
+    do {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head - next > ring->rec_count) {
+            if (next)
+                printf("<%"PRIu64" records lost>\n", head - ring->rec_count - next);
+            next = head - ring->rec_count;
+        }
+        for (; next < head; next++)
+            if (!trace_decode_rec(ring, next))
+                printf("<record %"PRIu64" lost>\n", next);
+        if (follow)
+            usleep(100000);
+    } while (follow);
+    return 0;
+}